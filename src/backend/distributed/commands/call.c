@@ -21,6 +21,8 @@
 #include "distributed/commands/utility_hook.h"
 #include "distributed/connection_management.h"
 #include "distributed/deparse_shard_query.h"
+#include "distributed/function_call_delegation.h"
+#include "distributed/listutils.h"
 #include "distributed/master_metadata_utility.h"
 #include "distributed/metadata_cache.h"
 #include "distributed/multi_executor.h"
@@ -42,6 +44,9 @@
 static bool CallFuncExprRemotely(CallStmt *callStmt,
 								 DistObjectCacheEntry *procedure,
 								 FuncExpr *funcExpr, DestReceiver *dest);
+static bool CallBatchedFuncExprRemotely(DistObjectCacheEntry *procedure,
+										FuncExpr *funcExpr,
+										CitusTableCacheEntry *distTable);
 
 /*
  * CallDistributedProcedureRemotely calls a stored procedure on the worker if possible.
@@ -117,6 +122,18 @@ CallFuncExprRemotely(CallStmt *callStmt, DistObjectCacheEntry *procedure,
 	}
 	Const *partitionValue = (Const *) partitionValueNode;
 
+	/*
+	 * A procedure without output arguments that gets an array of distribution
+	 * argument values can be split into a call per worker.
+	 */
+	if (EnableBatchedFunctionDelegation &&
+		type_is_array(partitionValue->consttype) &&
+		!type_is_array(partitionColumn->vartype) &&
+		CallStmtResultDesc(callStmt) == NULL)
+	{
+		return CallBatchedFuncExprRemotely(procedure, funcExpr, distTable);
+	}
+
 	Datum partitionValueDatum = partitionValue->constvalue;
 	if (partitionValue->consttype != partitionColumn->vartype)
 	{
@@ -206,3 +223,67 @@ CallFuncExprRemotely(CallStmt *callStmt, DistObjectCacheEntry *procedure,
 
 	return true;
 }
+
+
+/*
+ * CallBatchedFuncExprRemotely calls a procedure whose distribution argument is
+ * an array on every worker that holds shards of the array elements, with the
+ * elements that belong to that worker. The calls run in parallel, and each of
+ * them commits on its own worker.
+ */
+static bool
+CallBatchedFuncExprRemotely(DistObjectCacheEntry *procedure, FuncExpr *funcExpr,
+							CitusTableCacheEntry *distTable)
+{
+	int distributionArgIndex = procedure->distributionArgIndex;
+	List *taskList = NIL;
+	int taskId = 0;
+
+	List *batchList = SplitFunctionCallByDistributionArgument(funcExpr,
+															  distributionArgIndex,
+															  distTable);
+	if (batchList == NIL)
+	{
+		return false;
+	}
+
+	ereport(DEBUG1, (errmsg("pushing down the procedure in %d batches",
+							list_length(batchList))));
+
+	BatchedFunctionCall *batch = NULL;
+	foreach_ptr(batch, batchList)
+	{
+		/* build remote command with fully qualified names */
+		StringInfo callCommand = makeStringInfo();
+		appendStringInfo(callCommand, "CALL %s",
+						 pg_get_rule_expr((Node *) batch->funcExpr));
+
+		Task *task = CitusMakeNode(Task);
+		task->jobId = INVALID_JOB_ID;
+		task->taskId = taskId++;
+		task->taskType = DDL_TASK;
+		SetTaskQueryString(task, callCommand->data);
+		task->replicationModel = REPLICATION_MODEL_INVALID;
+		task->dependentTaskList = NIL;
+		task->anchorShardId = batch->placement->shardId;
+		task->relationShardList = NIL;
+		task->taskPlacementList = list_make1(batch->placement);
+
+		taskList = lappend(taskList, task);
+	}
+
+	/*
+	 * We are delegating the distributed transactions to the workers, so we
+	 * should not run the CALLs in transaction blocks.
+	 */
+	TransactionProperties xactProperties = {
+		.errorOnAnyFailure = true,
+		.useRemoteTransactionBlocks = TRANSACTION_BLOCKS_DISALLOWED,
+		.requires2PC = false
+	};
+
+	ExecuteTaskListExtended(ROW_MODIFY_NONE, taskList, NULL, NULL, false,
+							MaxAdaptiveExecutorPoolSize, &xactProperties, NIL);
+
+	return true;
+}
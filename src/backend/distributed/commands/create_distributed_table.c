@@ -25,12 +25,14 @@
 #include "catalog/pg_enum.h"
 #include "catalog/pg_extension.h"
 #include "catalog/pg_opclass.h"
+#include "catalog/pg_sequence.h"
 #if PG_VERSION_NUM >= 12000
 #include "catalog/pg_proc.h"
 #endif
 #include "catalog/pg_trigger.h"
 #include "commands/defrem.h"
 #include "commands/extension.h"
+#include "commands/sequence.h"
 #include "commands/trigger.h"
 #include "distributed/commands/multi_copy.h"
 #include "distributed/citus_ruleutils.h"
@@ -40,6 +42,7 @@
 #include "distributed/listutils.h"
 #include "distributed/master_metadata_utility.h"
 #include "distributed/master_protocol.h"
+#include "distributed/metadata/distobject.h"
 #include "distributed/metadata_cache.h"
 #include "distributed/metadata_sync.h"
 #include "distributed/multi_executor.h"
@@ -56,8 +59,10 @@
 #include "executor/executor.h"
 #include "executor/spi.h"
 #include "nodes/execnodes.h"
+#include "nodes/makefuncs.h"
 #include "nodes/nodeFuncs.h"
 #include "nodes/pg_list.h"
+#include "optimizer/planner.h"
 #include "parser/parse_expr.h"
 #include "parser/parse_node.h"
 #include "parser/parse_relation.h"
@@ -77,6 +82,12 @@
 /* Replication model to use when creating distributed tables */
 int ReplicationModel = REPLICATION_MODEL_COORDINATOR;
 
+/* GUC, whether existing data is read using a parallel scan of the local table */
+bool EnableParallelLocalDataCopy = false;
+
+/* GUC, minimum number of values of the sequences of distributed tables to cache */
+int DistributedSequenceCacheSize = 0;
+
 
 /* local function forward declarations */
 static char AppropriateReplicationModel(char distributionMethod, bool viaDeprecatedAPI);
@@ -98,12 +109,16 @@ static Oid SupportFunctionForColumn(Var *partitionColumn, Oid accessMethodId,
 static void EnsureLocalTableEmptyIfNecessary(Oid relationId, char distributionMethod,
 											 bool viaDepracatedAPI);
 static bool LocalTableEmpty(Oid tableId);
+static void EnsureSequenceCacheSize(Oid relationId);
 static void CopyLocalDataIntoShards(Oid relationId);
+static bool CanCopyLocalDataInParallel(Relation distributedRelation);
+static void CopyLocalDataIntoShardsInParallel(Relation distributedRelation);
 static List * TupleDescColumnNameList(TupleDesc tupleDescriptor);
 static bool RelationUsesIdentityColumns(TupleDesc relationDesc);
 static bool DistributionColumnUsesGeneratedStoredColumn(TupleDesc relationDesc,
 														Var *distributionColumn);
 static bool RelationUsesHeapAccessMethodOrNone(Relation relation);
+static bool RelationAccessMethodOwnedByExtension(Relation relation);
 static bool CanUseExclusiveConnections(Oid relationId, bool localTableEmpty);
 
 /* exports for SQL callable functions */
@@ -211,6 +226,9 @@ create_distributed_table(PG_FUNCTION_ARGS)
 	ObjectAddressSet(tableAddress, RelationRelationId, relationId);
 	EnsureDependenciesExistOnAllNodes(&tableAddress);
 
+	/* the new shards may be joined with reference tables on all nodes */
+	EnsureReferenceTablesExistOnAllNodes();
+
 	/*
 	 * Lock target relation with an exclusive lock - there's no way to make
 	 * sense of this table until we've committed, and we don't want multiple
@@ -344,6 +362,9 @@ CreateDistributedTable(Oid relationId, Var *distributionColumn, char distributio
 	EnsureRelationCanBeDistributed(relationId, distributionColumn, distributionMethod,
 								   colocationId, replicationModel, viaDeprecatedAPI);
 
+	/* the sequence definitions are propagated to the workers along with the table */
+	EnsureSequenceCacheSize(relationId);
+
 	/* we need to calculate these variables before creating distributed metadata */
 	bool localTableEmpty = LocalTableEmpty(relationId);
 	Oid colocatedTableId = ColocatedTableId(colocationId);
@@ -418,6 +439,50 @@ CreateDistributedTable(Oid relationId, Var *distributionColumn, char distributio
 }
 
 
+/*
+ * EnsureSequenceCacheSize raises the number of values that each backend caches
+ * from the sequences owned by the given table to at least
+ * citus.distributed_sequence_cache_size. A backend that inserts many rows
+ * into a distributed table with a serial column then only needs to access the
+ * sequence once for that many rows, both on the coordinator and, through the
+ * sequence definitions in the metadata, on MX workers.
+ */
+static void
+EnsureSequenceCacheSize(Oid relationId)
+{
+	if (DistributedSequenceCacheSize <= 1)
+	{
+		return;
+	}
+
+	List *ownedSequences = getOwnedSequences(relationId, InvalidAttrNumber);
+	Oid sequenceOid = InvalidOid;
+	foreach_oid(sequenceOid, ownedSequences)
+	{
+		Form_pg_sequence sequenceData = pg_get_sequencedef(sequenceOid);
+		if (sequenceData->seqcache >= DistributedSequenceCacheSize)
+		{
+			continue;
+		}
+
+		char *schemaName = get_namespace_name(get_rel_namespace(sequenceOid));
+		char *sequenceName = get_rel_name(sequenceOid);
+
+		AlterSeqStmt *alterSequenceStatement = makeNode(AlterSeqStmt);
+		alterSequenceStatement->sequence = makeRangeVar(schemaName, sequenceName, -1);
+		alterSequenceStatement->options =
+			list_make1(makeDefElem("cache",
+								   (Node *) makeInteger(DistributedSequenceCacheSize),
+								   -1));
+
+		AlterSequence(make_parsestate(NULL), alterSequenceStatement);
+	}
+
+	/* make the new cache size visible to the sequence definitions */
+	CommandCounterIncrement();
+}
+
+
 /*
  * AppropriateReplicationModel function decides which replication model should be
  * used depending on given distribution configuration and global ReplicationModel
@@ -638,10 +703,14 @@ EnsureRelationCanBeDistributed(Oid relationId, Var *distributionColumn,
 	TupleDesc relationDesc = RelationGetDescr(relation);
 	char *relationName = RelationGetRelationName(relation);
 
-	if (!RelationUsesHeapAccessMethodOrNone(relation))
+	if (!RelationUsesHeapAccessMethodOrNone(relation) &&
+		!RelationAccessMethodOwnedByExtension(relation))
 	{
 		ereport(ERROR, (errmsg(
-							"cannot distribute relations using non-heap access methods")));
+							"cannot distribute relations using non-heap access methods"),
+						errdetail("Only access methods that are created by an "
+								  "extension can be used for the shards, since the "
+								  "extension is created on the workers.")));
 	}
 
 #if PG_VERSION_NUM < 120000
@@ -1184,7 +1253,9 @@ RegularTable(Oid relationId)
  * DestReceiver, but we are in a tricky spot here since Citus is already
  * intercepting queries on this table in the planner and executor hooks and we
  * want to read from the local table. To keep it simple, we perform a heap scan
- * directly on the table.
+ * directly on the table. When citus.enable_parallel_local_data_copy is set, we
+ * instead plan a scan of the local table with standard_planner, such that
+ * PostgreSQL can use parallel workers to read the table.
  *
  * Any writes on the table that are started during this operation will be handled
  * as distributed queries once the current transaction commits. SELECTs will
@@ -1210,8 +1281,8 @@ CopyLocalDataIntoShards(Oid distributedRelationId)
 	TableScanDesc scan = NULL;
 #else
 	HeapScanDesc scan = NULL;
-#endif
 	HeapTuple tuple = NULL;
+#endif
 	MemoryContext oldContext = NULL;
 	uint64 rowsCopied = 0;
 
@@ -1240,10 +1311,26 @@ CopyLocalDataIntoShards(Oid distributedRelationId)
 	 */
 	PushActiveSnapshot(GetLatestSnapshot());
 
+	if (EnableParallelLocalDataCopy && CanCopyLocalDataInParallel(distributedRelation))
+	{
+		CopyLocalDataIntoShardsInParallel(distributedRelation);
+
+		heap_close(distributedRelation, NoLock);
+		PopActiveSnapshot();
+
+		return;
+	}
+
 	/* get the table columns */
 	tupleDescriptor = RelationGetDescr(distributedRelation);
+#if PG_VERSION_NUM >= 120000
+
+	/* the table may use another access method than heap */
+	TupleTableSlot *slot = table_slot_create(distributedRelation, NULL);
+#else
 	TupleTableSlot *slot = MakeSingleTupleTableSlotCompat(tupleDescriptor,
 														  &TTSOpsHeapTuple);
+#endif
 	columnNameList = TupleDescColumnNameList(tupleDescriptor);
 
 	/* determine the partition column in the tuple descriptor */
@@ -1277,12 +1364,13 @@ CopyLocalDataIntoShards(Oid distributedRelationId)
 
 	oldContext = MemoryContextSwitchTo(GetPerTupleMemoryContext(estate));
 
+#if PG_VERSION_NUM >= 120000
+	while (table_scan_getnextslot(scan, ForwardScanDirection, slot))
+	{
+#else
 	while ((tuple = heap_getnext(scan, ForwardScanDirection)) != NULL)
 	{
 		/* materialize tuple and send it to a shard */
-#if PG_VERSION_NUM >= 120000
-		ExecStoreHeapTuple(tuple, slot, false);
-#else
 		ExecStoreTuple(tuple, slot, InvalidBuffer, false);
 #endif
 		copyDest->receiveSlot(slot, copyDest);
@@ -1333,6 +1421,116 @@ CopyLocalDataIntoShards(Oid distributedRelationId)
 }
 
 
+/*
+ * CanCopyLocalDataInParallel returns whether the data of the given relation can
+ * be read by a query rather than a heap scan. A query would apply row level
+ * security policies, which the heap scan ignores. Parallel workers cannot take
+ * part in the writes to local placements, so we also skip relations that have
+ * a placement on this node.
+ */
+static bool
+CanCopyLocalDataInParallel(Relation distributedRelation)
+{
+	Oid relationId = RelationGetRelid(distributedRelation);
+	int32 localGroupId = GetLocalGroupId();
+
+	if (distributedRelation->rd_rel->relrowsecurity)
+	{
+		return false;
+	}
+
+	List *shardIntervalList = LoadShardIntervalList(relationId);
+	ShardInterval *shardInterval = NULL;
+	foreach_ptr(shardInterval, shardIntervalList)
+	{
+		List *placementList = ActiveShardPlacementList(shardInterval->shardId);
+		ShardPlacement *placement = NULL;
+		foreach_ptr(placement, placementList)
+		{
+			if (placement->groupId == localGroupId)
+			{
+				return false;
+			}
+		}
+	}
+
+	return true;
+}
+
+
+/*
+ * CopyLocalDataIntoShardsInParallel copies the data of the local table into its
+ * shards by executing a SELECT on the local table into a CitusCopyDestReceiver.
+ * The query is planned with standard_planner directly, since the distributed
+ * planner would plan it as a query on the distributed table. The plan may use
+ * a parallel sequential scan, in which case the parallel workers read and
+ * deform the tuples, while this backend sends them to the shards over the
+ * connections of the current transaction. The shards are not yet committed,
+ * so they can only be written to by this backend.
+ */
+static void
+CopyLocalDataIntoShardsInParallel(Relation distributedRelation)
+{
+	Oid relationId = RelationGetRelid(distributedRelation);
+	TupleDesc tupleDescriptor = RelationGetDescr(distributedRelation);
+	List *columnNameList = TupleDescColumnNameList(tupleDescriptor);
+	int partitionColumnIndex = INVALID_PARTITION_COLUMN_INDEX;
+	bool stopOnFailure = true;
+	StringInfo queryString = makeStringInfo();
+
+	/* the target list only contains the columns in columnNameList */
+	Var *partitionColumn = PartitionColumn(relationId, 0);
+
+	appendStringInfoString(queryString, "SELECT ");
+
+	int columnIndex = 0;
+	char *columnName = NULL;
+	foreach_ptr(columnName, columnNameList)
+	{
+		if (columnIndex > 0)
+		{
+			appendStringInfoString(queryString, ", ");
+		}
+
+		appendStringInfoString(queryString, quote_identifier(columnName));
+
+		if (partitionColumn != NULL &&
+			strcmp(columnName, get_attname(relationId, partitionColumn->varattno,
+										   false)) == 0)
+		{
+			partitionColumnIndex = columnIndex;
+		}
+
+		columnIndex++;
+	}
+
+	appendStringInfo(queryString, " FROM ONLY %s",
+					 generate_qualified_relation_name(relationId));
+
+	Query *query = ParseQueryString(queryString->data, NULL, 0);
+	PlannedStmt *queryPlan = standard_planner(query, CURSOR_OPT_PARALLEL_OK, NULL);
+
+	EState *estate = CreateExecutorState();
+	DestReceiver *copyDest =
+		(DestReceiver *) CreateCitusCopyDestReceiver(relationId, columnNameList,
+													 partitionColumnIndex, estate,
+													 stopOnFailure, NULL);
+
+	/* the executor calls rStartup and rShutdown on the DestReceiver */
+	ExecutePlanIntoDestReceiver(queryPlan, NULL, copyDest);
+
+	uint64 rowsCopied = ((CitusCopyDestReceiver *) copyDest)->tuplesSent;
+	if (rowsCopied > 0)
+	{
+		ereport(NOTICE, (errmsg("Copying data from local table...")));
+		ereport(DEBUG1, (errmsg("Copied " UINT64_FORMAT " rows", rowsCopied)));
+	}
+
+	copyDest->rDestroy(copyDest);
+	FreeExecutorState(estate);
+}
+
+
 /*
  * TupleDescColumnNameList returns a list of column names for the given tuple
  * descriptor as plain strings.
@@ -1420,3 +1618,25 @@ RelationUsesHeapAccessMethodOrNone(Relation relation)
 	return true;
 #endif
 }
+
+
+/*
+ * RelationAccessMethodOwnedByExtension returns whether the table access method
+ * of the given relation, such as a columnar storage format, is created by an
+ * extension. The shards use the same access method, and the extension is
+ * created on the workers along with the other dependencies of the relation.
+ */
+static bool
+RelationAccessMethodOwnedByExtension(Relation relation)
+{
+#if PG_VERSION_NUM >= 120000
+	ObjectAddress accessMethodAddress = { 0 };
+	Oid accessMethodId = relation->rd_rel->relam;
+
+	ObjectAddressSet(accessMethodAddress, AccessMethodRelationId, accessMethodId);
+
+	return IsObjectAddressOwnedByExtension(&accessMethodAddress, NULL);
+#else
+	return false;
+#endif
+}
@@ -0,0 +1,519 @@
+/*-------------------------------------------------------------------------
+ *
+ * distributed_statistics.c
+ *    Statistics of distributed tables for the planner on the coordinator.
+ *
+ *    ANALYZE on a distributed table analyzes the shards on the workers, while
+ *    the table on the coordinator is empty and has no statistics, so the
+ *    planner on the coordinator only sees a tiny table without column
+ *    statistics. When citus.analyze_sample_shard_count is set, ANALYZE also
+ *    samples rows from that many shards in parallel, and computes column
+ *    statistics of the sample on the coordinator.
+ *
+ *    The sample is stored in a temporary table with the columns of the
+ *    distributed table, which is analyzed by postgres itself, such that the
+ *    most common values, histograms and distinct counts are computed by the
+ *    analyze functions of the column types. The statistics of the temporary
+ *    table are then copied to the distributed table. The number of rows and
+ *    pages of the table are the sums of those of all shards, as estimated by
+ *    the ANALYZE of the shards, and are used by the planner through
+ *    CitusGetRelationInfo.
+ *
+ * Copyright (c) Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include "postgres.h"
+
+#include "miscadmin.h"
+
+#include "access/heapam.h"
+#include "access/htup_details.h"
+#include "access/xact.h"
+#include "catalog/heap.h"
+#include "catalog/indexing.h"
+#include "catalog/namespace.h"
+#include "catalog/pg_statistic.h"
+#include "catalog/pg_type.h"
+#include "commands/vacuum.h"
+#include "distributed/citus_ruleutils.h"
+#include "distributed/commands.h"
+#include "distributed/listutils.h"
+#include "distributed/master_metadata_utility.h"
+#include "distributed/metadata_cache.h"
+#include "distributed/multi_executor.h"
+#include "distributed/multi_physical_planner.h"
+#include "distributed/version_compat.h"
+#include "executor/spi.h"
+#include "executor/tuptable.h"
+#include "nodes/makefuncs.h"
+#include "utils/acl.h"
+#include "utils/builtins.h"
+#include "utils/lsyscache.h"
+#include "utils/rel.h"
+#include "utils/syscache.h"
+#include "utils/tuplestore.h"
+
+
+/* number of sample rows per column statistics target, as in postgres */
+#define SAMPLE_ROWS_PER_STATISTICS_TARGET 300
+
+/* query that returns the size of a shard, as estimated by its last ANALYZE */
+#define SHARD_SIZE_QUERY \
+	"SELECT " UINT64_FORMAT "::bigint, reltuples::float8, relpages::float8 " \
+	"FROM pg_class WHERE oid = %s::regclass"
+
+
+/*
+ * GUC, the number of shards that ANALYZE samples to compute statistics of a
+ * distributed table on the coordinator, 0 disables coordinator statistics.
+ */
+int AnalyzeSampleShardCount = 0;
+
+
+/* size of a shard, as estimated by its last ANALYZE on the worker */
+typedef struct ShardSize
+{
+	uint64 shardId;
+	double tupleCount;
+	double pageCount;
+} ShardSize;
+
+
+static List * ShardSizeList(Oid relationId, List *shardIntervalList);
+static Tuplestorestate * SampleShardRows(Oid relationId, List *shardSizeList,
+										 TupleDesc sampleDescriptor);
+static TupleDesc SampleTupleDescriptor(TupleDesc tupleDescriptor);
+static char * SampleColumnList(TupleDesc tupleDescriptor);
+static char * ShardRelationName(Oid relationId, uint64 shardId);
+static Oid CreateSampleTable(Oid relationId, char *sampleTableName);
+static void InsertSampleRows(Oid sampleRelationId, Tuplestorestate *sampleStore,
+							 TupleDesc sampleDescriptor);
+static void CopyColumnStatistics(Oid sampleRelationId, Oid relationId);
+static void ExecuteSampleTableCommand(const char *command);
+
+
+/*
+ * UpdateCoordinatorStatistics computes the statistics of the given distributed
+ * table from a sample of citus.analyze_sample_shard_count of its shards, and
+ * stores them for the planner on the coordinator. It is called by ANALYZE after
+ * the shards were analyzed, so the sizes of the shards are up to date.
+ */
+void
+UpdateCoordinatorStatistics(Oid relationId)
+{
+	if (AnalyzeSampleShardCount <= 0)
+	{
+		return;
+	}
+
+	/* ANALYZE skips tables the user does not own, with a warning */
+	if (!pg_class_ownercheck(relationId, GetUserId()))
+	{
+		return;
+	}
+
+	List *shardIntervalList = LoadShardIntervalList(relationId);
+	if (shardIntervalList == NIL)
+	{
+		return;
+	}
+
+	List *shardSizeList = ShardSizeList(relationId, shardIntervalList);
+	double tupleCount = 0.0;
+	double pageCount = 0.0;
+
+	ShardSize *shardSize = NULL;
+	foreach_ptr(shardSize, shardSizeList)
+	{
+		tupleCount += shardSize->tupleCount;
+		pageCount += shardSize->pageCount;
+	}
+
+	Relation relation = heap_open(relationId, ShareUpdateExclusiveLock);
+	TupleDesc sampleDescriptor = SampleTupleDescriptor(RelationGetDescr(relation));
+
+	if (tupleCount > 0 && sampleDescriptor->natts > 0)
+	{
+		Tuplestorestate *sampleStore = SampleShardRows(relationId, shardSizeList,
+													   sampleDescriptor);
+		char *sampleTableName = psprintf("citus_analyze_sample_%u", relationId);
+
+		Oid sampleRelationId = CreateSampleTable(relationId, sampleTableName);
+		InsertSampleRows(sampleRelationId, sampleStore, sampleDescriptor);
+
+		tuplestore_end(sampleStore);
+
+		ExecuteSampleTableCommand(psprintf("ANALYZE pg_temp.%s",
+										   quote_identifier(sampleTableName)));
+
+		CopyColumnStatistics(sampleRelationId, relationId);
+
+		ExecuteSampleTableCommand(psprintf("DROP TABLE pg_temp.%s",
+										   quote_identifier(sampleTableName)));
+	}
+
+	/* the table on the coordinator is empty, keep the flags set by ANALYZE */
+	bool inOuterTransaction = true;
+
+	vac_update_relstats(relation, (BlockNumber) Min(pageCount, MaxBlockNumber),
+						tupleCount, 0, relation->rd_rel->relhasindex,
+						InvalidTransactionId, InvalidMultiXactId, inOuterTransaction);
+
+	heap_close(relation, NoLock);
+
+	CommandCounterIncrement();
+}
+
+
+/*
+ * ShardSizeList returns the sizes of the given shards of the relation, as
+ * estimated by the ANALYZE of the shards, in the order of the shards.
+ */
+static List *
+ShardSizeList(Oid relationId, List *shardIntervalList)
+{
+	List *taskList = NIL;
+	List *shardSizeList = NIL;
+	uint32 taskId = 1;
+	bool hasReturning = true;
+
+	ShardInterval *shardInterval = NULL;
+	foreach_ptr(shardInterval, shardIntervalList)
+	{
+		uint64 shardId = shardInterval->shardId;
+		char *shardRelationName = ShardRelationName(relationId, shardId);
+		StringInfo sizeQuery = makeStringInfo();
+
+		appendStringInfo(sizeQuery, SHARD_SIZE_QUERY, shardId,
+						 quote_literal_cstr(shardRelationName));
+
+		Task *task = CreateBasicTask(INVALID_JOB_ID, taskId++, SELECT_TASK,
+									 sizeQuery->data);
+		task->anchorShardId = shardId;
+		task->taskPlacementList = ActiveShardPlacementList(shardId);
+
+		taskList = lappend(taskList, task);
+
+		ShardSize *shardSize = palloc0(sizeof(ShardSize));
+		shardSize->shardId = shardId;
+
+		shardSizeList = lappend(shardSizeList, shardSize);
+	}
+
+#if PG_VERSION_NUM >= 120000
+	TupleDesc tupleDescriptor = CreateTemplateTupleDesc(3);
+#else
+	TupleDesc tupleDescriptor = CreateTemplateTupleDesc(3, false);
+#endif
+	TupleDescInitEntry(tupleDescriptor, (AttrNumber) 1, "shard_id", INT8OID, -1, 0);
+	TupleDescInitEntry(tupleDescriptor, (AttrNumber) 2, "tuple_count", FLOAT8OID,
+					   -1, 0);
+	TupleDescInitEntry(tupleDescriptor, (AttrNumber) 3, "page_count", FLOAT8OID,
+					   -1, 0);
+
+	Tuplestorestate *tupleStore = tuplestore_begin_heap(false, false, work_mem);
+
+	ExecuteTaskListIntoTupleStore(ROW_MODIFY_READONLY, taskList, tupleDescriptor,
+								  tupleStore, hasReturning);
+
+	TupleTableSlot *slot = MakeSingleTupleTableSlotCompat(tupleDescriptor,
+														  &TTSOpsMinimalTuple);
+	while (tuplestore_gettupleslot(tupleStore, true, false, slot))
+	{
+		bool isNull = false;
+		uint64 shardId = DatumGetInt64(slot_getattr(slot, 1, &isNull));
+
+		/* tasks complete in any order */
+		ShardSize *shardSize = NULL;
+		foreach_ptr(shardSize, shardSizeList)
+		{
+			if (shardSize->shardId == shardId)
+			{
+				shardSize->tupleCount = DatumGetFloat8(slot_getattr(slot, 2, &isNull));
+				shardSize->pageCount = DatumGetFloat8(slot_getattr(slot, 3, &isNull));
+				break;
+			}
+		}
+
+		ExecClearTuple(slot);
+	}
+
+	ExecDropSingleTupleTableSlot(slot);
+	tuplestore_end(tupleStore);
+
+	return shardSizeList;
+}
+
+
+/*
+ * SampleShardRows samples the rows of citus.analyze_sample_shard_count shards
+ * that are spread over the given shards, such that the sample has about as many
+ * rows as ANALYZE samples from a table. The shards are sampled by pages via
+ * TABLESAMPLE SYSTEM in parallel, so only a fraction of a shard is read.
+ */
+static Tuplestorestate *
+SampleShardRows(Oid relationId, List *shardSizeList, TupleDesc sampleDescriptor)
+{
+	List *taskList = NIL;
+	int shardCount = list_length(shardSizeList);
+	int sampleShardCount = Min(AnalyzeSampleShardCount, shardCount);
+	double sampleRowCount = (double) SAMPLE_ROWS_PER_STATISTICS_TARGET *
+							default_statistics_target;
+	double shardSampleRowCount = sampleRowCount / sampleShardCount;
+	char *columnList = SampleColumnList(sampleDescriptor);
+	bool hasReturning = true;
+
+	for (int sampleIndex = 0; sampleIndex < sampleShardCount; sampleIndex++)
+	{
+		int shardIndex = (int) ((int64) sampleIndex * shardCount / sampleShardCount);
+		ShardSize *shardSize = (ShardSize *) list_nth(shardSizeList, shardIndex);
+		double samplePercent = 100.0;
+		StringInfo sampleQuery = makeStringInfo();
+
+		if (shardSize->tupleCount > shardSampleRowCount)
+		{
+			samplePercent = 100.0 * shardSampleRowCount / shardSize->tupleCount;
+		}
+
+		appendStringInfo(sampleQuery, "SELECT %s FROM %s TABLESAMPLE SYSTEM (%.6f)",
+						 columnList, ShardRelationName(relationId, shardSize->shardId),
+						 samplePercent);
+
+		Task *task = CreateBasicTask(INVALID_JOB_ID, sampleIndex + 1, SELECT_TASK,
+									 sampleQuery->data);
+		task->anchorShardId = shardSize->shardId;
+		task->taskPlacementList = ActiveShardPlacementList(shardSize->shardId);
+
+		taskList = lappend(taskList, task);
+	}
+
+	Tuplestorestate *sampleStore = tuplestore_begin_heap(false, false, work_mem);
+
+	ExecuteTaskListIntoTupleStore(ROW_MODIFY_READONLY, taskList, sampleDescriptor,
+								  sampleStore, hasReturning);
+
+	return sampleStore;
+}
+
+
+/*
+ * SampleTupleDescriptor returns a tuple descriptor with the columns of the
+ * given tuple descriptor that are not dropped, which is the layout of the
+ * sampled rows and of the temporary table that holds them.
+ */
+static TupleDesc
+SampleTupleDescriptor(TupleDesc tupleDescriptor)
+{
+	int columnCount = 0;
+
+	for (int columnIndex = 0; columnIndex < tupleDescriptor->natts; columnIndex++)
+	{
+		if (!TupleDescAttr(tupleDescriptor, columnIndex)->attisdropped)
+		{
+			columnCount++;
+		}
+	}
+
+#if PG_VERSION_NUM >= 120000
+	TupleDesc sampleDescriptor = CreateTemplateTupleDesc(columnCount);
+#else
+	TupleDesc sampleDescriptor = CreateTemplateTupleDesc(columnCount, false);
+#endif
+	AttrNumber sampleAttributeNumber = 1;
+
+	for (int columnIndex = 0; columnIndex < tupleDescriptor->natts; columnIndex++)
+	{
+		if (TupleDescAttr(tupleDescriptor, columnIndex)->attisdropped)
+		{
+			continue;
+		}
+
+		TupleDescCopyEntry(sampleDescriptor, sampleAttributeNumber++, tupleDescriptor,
+						   (AttrNumber) (columnIndex + 1));
+	}
+
+	return sampleDescriptor;
+}
+
+
+/*
+ * SampleColumnList returns the quoted names of the columns in the given tuple
+ * descriptor, separated by commas.
+ */
+static char *
+SampleColumnList(TupleDesc tupleDescriptor)
+{
+	StringInfo columnList = makeStringInfo();
+
+	for (int columnIndex = 0; columnIndex < tupleDescriptor->natts; columnIndex++)
+	{
+		Form_pg_attribute attributeForm = TupleDescAttr(tupleDescriptor, columnIndex);
+
+		if (columnIndex > 0)
+		{
+			appendStringInfoString(columnList, ", ");
+		}
+
+		appendStringInfoString(columnList,
+							   quote_identifier(NameStr(attributeForm->attname)));
+	}
+
+	return columnList->data;
+}
+
+
+/*
+ * ShardRelationName returns the qualified and quoted name of the given shard
+ * of the relation.
+ */
+static char *
+ShardRelationName(Oid relationId, uint64 shardId)
+{
+	char *schemaName = get_namespace_name(get_rel_namespace(relationId));
+	char *shardName = get_rel_name(relationId);
+
+	AppendShardIdToName(&shardName, shardId);
+
+	return quote_qualified_identifier(schemaName, shardName);
+}
+
+
+/*
+ * CreateSampleTable creates a temporary table with the columns of the given
+ * relation to hold the sampled rows, and returns its OID.
+ */
+static Oid
+CreateSampleTable(Oid relationId, char *sampleTableName)
+{
+	bool missingOK = false;
+
+	ExecuteSampleTableCommand(psprintf("CREATE TEMPORARY TABLE %s (LIKE %s)",
+									   quote_identifier(sampleTableName),
+									   generate_qualified_relation_name(relationId)));
+
+	RangeVar *sampleTable = makeRangeVar("pg_temp", sampleTableName, -1);
+
+	return RangeVarGetRelid(sampleTable, NoLock, missingOK);
+}
+
+
+/*
+ * InsertSampleRows inserts the sampled rows into the temporary table. The table
+ * has no indexes or triggers, so the rows are inserted as they are.
+ */
+static void
+InsertSampleRows(Oid sampleRelationId, Tuplestorestate *sampleStore,
+				 TupleDesc sampleDescriptor)
+{
+	Relation sampleRelation = heap_open(sampleRelationId, RowExclusiveLock);
+
+	TupleTableSlot *slot = MakeSingleTupleTableSlotCompat(sampleDescriptor,
+														  &TTSOpsMinimalTuple);
+	while (tuplestore_gettupleslot(sampleStore, true, false, slot))
+	{
+#if PG_VERSION_NUM >= 120000
+		HeapTuple sampleTuple = ExecCopySlotHeapTuple(slot);
+#else
+		HeapTuple sampleTuple = ExecCopySlotTuple(slot);
+#endif
+
+		simple_heap_insert(sampleRelation, sampleTuple);
+
+		heap_freetuple(sampleTuple);
+		ExecClearTuple(slot);
+	}
+
+	ExecDropSingleTupleTableSlot(slot);
+	heap_close(sampleRelation, NoLock);
+
+	CommandCounterIncrement();
+}
+
+
+/*
+ * CopyColumnStatistics replaces the column statistics of the relation with the
+ * statistics of the columns of the same name of the sample table.
+ */
+static void
+CopyColumnStatistics(Oid sampleRelationId, Oid relationId)
+{
+	Datum values[Natts_pg_statistic];
+	bool isNulls[Natts_pg_statistic];
+	bool replaces[Natts_pg_statistic];
+
+	memset(isNulls, false, sizeof(isNulls));
+	memset(replaces, false, sizeof(replaces));
+
+	replaces[Anum_pg_statistic_starelid - 1] = true;
+	replaces[Anum_pg_statistic_staattnum - 1] = true;
+	values[Anum_pg_statistic_starelid - 1] = ObjectIdGetDatum(relationId);
+
+	/* statistics of all columns are replaced, including stale ones */
+	RemoveStatistics(relationId, 0);
+
+	Relation relation = heap_open(relationId, NoLock);
+	TupleDesc tupleDescriptor = RelationGetDescr(relation);
+	Relation statisticRelation = heap_open(StatisticRelationId, RowExclusiveLock);
+	AttrNumber sampleAttributeNumber = 0;
+
+	for (int columnIndex = 0; columnIndex < tupleDescriptor->natts; columnIndex++)
+	{
+		if (TupleDescAttr(tupleDescriptor, columnIndex)->attisdropped)
+		{
+			continue;
+		}
+
+		/* the sample table has the columns that are not dropped, in order */
+		sampleAttributeNumber++;
+
+		HeapTuple statisticTuple = SearchSysCache3(STATRELATTINH,
+												   ObjectIdGetDatum(sampleRelationId),
+												   Int16GetDatum(sampleAttributeNumber),
+												   BoolGetDatum(false));
+		if (!HeapTupleIsValid(statisticTuple))
+		{
+			continue;
+		}
+
+		values[Anum_pg_statistic_staattnum - 1] = Int16GetDatum(columnIndex + 1);
+
+		HeapTuple newStatisticTuple = heap_modify_tuple(statisticTuple,
+														RelationGetDescr(
+															statisticRelation),
+														values, isNulls, replaces);
+
+		CatalogTupleInsert(statisticRelation, newStatisticTuple);
+
+		heap_freetuple(newStatisticTuple);
+		ReleaseSysCache(statisticTuple);
+	}
+
+	heap_close(statisticRelation, RowExclusiveLock);
+	heap_close(relation, NoLock);
+
+	CommandCounterIncrement();
+}
+
+
+/*
+ * ExecuteSampleTableCommand runs a utility command on the temporary sample
+ * table via SPI.
+ */
+static void
+ExecuteSampleTableCommand(const char *command)
+{
+	if (SPI_connect() != SPI_OK_CONNECT)
+	{
+		ereport(ERROR, (errmsg("could not connect to SPI manager")));
+	}
+
+	int spiResult = SPI_execute(command, false, 0);
+	if (spiResult != SPI_OK_UTILITY)
+	{
+		ereport(ERROR, (errmsg("could not run command: %s", command)));
+	}
+
+	SPI_finish();
+}
@@ -20,16 +20,19 @@
 #include "catalog/namespace.h"
 #include "catalog/pg_class.h"
 #include "commands/tablecmds.h"
+#include "distributed/adaptive_executor.h"
 #include "distributed/citus_ruleutils.h"
 #include "distributed/commands.h"
 #include "distributed/commands/utility_hook.h"
 #include "distributed/deparse_shard_query.h"
 #include "distributed/distributed_planner.h"
 #include "distributed/listutils.h"
+#include "distributed/local_executor.h"
 #include "distributed/master_protocol.h"
 #include "distributed/metadata_cache.h"
 #include "distributed/multi_physical_planner.h"
 #include "distributed/resource_lock.h"
+#include "distributed/shard_task_progress.h"
 #include "distributed/version_compat.h"
 #include "lib/stringinfo.h"
 #include "miscadmin.h"
@@ -51,6 +54,18 @@ static void RangeVarCallbackForReindexIndex(const RangeVar *rel, Oid relOid, Oid
 static void ErrorIfUnsupportedIndexStmt(IndexStmt *createIndexStatement);
 static void ErrorIfUnsupportedDropIndexStmt(DropStmt *dropIndexStatement);
 static List * DropIndexTaskList(Oid relationId, Oid indexId, DropStmt *dropStmt);
+static bool TaskListHasShard(List *taskList, uint64 shardId);
+
+
+/*
+ * GUC, the maximum number of shards on a single node on which a
+ * CONCURRENTLY-enabled index command runs at the same time. 0 means the
+ * limit is citus.max_adaptive_executor_pool_size.
+ */
+int MaxConcurrentIndexBuildsPerNode = 0;
+
+
+PG_FUNCTION_INFO_V1(citus_concurrent_index_progress);
 
 
 /*
@@ -911,3 +926,105 @@ DropIndexTaskList(Oid relationId, Oid indexId, DropStmt *dropStmt)
 
 	return taskList;
 }
+
+
+/*
+ * ExecuteConcurrentIndexTaskList runs the tasks of a CONCURRENTLY-enabled
+ * index command on all shards of the given relation. The shards on different
+ * nodes are built in parallel, and on each node up to
+ * citus.max_concurrent_index_builds_per_node shards are built at a time.
+ * Since building an index on many shards can take a long time, the progress
+ * on each shard is made visible to other backends through
+ * citus_concurrent_index_progress.
+ */
+void
+ExecuteConcurrentIndexTaskList(Oid relationId, List *taskList,
+							   bool localExecutionSupported)
+{
+	List *localTaskList = NIL;
+	List *remoteTaskList = NIL;
+
+	if (taskList == NIL)
+	{
+		return;
+	}
+
+	ShardTaskProgressTracker *tracker =
+		StartShardTaskProgress(CONCURRENT_INDEX_MAGIC_NUMBER, taskList, relationId);
+
+	if (localExecutionSupported && ShouldExecuteTasksLocally(taskList))
+	{
+		bool readOnlyPlan = false;
+
+		ExtractLocalAndRemoteTasks(readOnlyPlan, taskList, &localTaskList,
+								   &remoteTaskList);
+
+		ExecuteLocalUtilityTaskList(localTaskList);
+
+		/* shards that also have remote placements are done once those are */
+		Task *localTask = NULL;
+		foreach_ptr(localTask, localTaskList)
+		{
+			if (!TaskListHasShard(remoteTaskList, localTask->anchorShardId))
+			{
+				MarkShardTasksDone(tracker, list_make1(localTask));
+			}
+		}
+	}
+	else
+	{
+		remoteTaskList = taskList;
+	}
+
+	if (remoteTaskList != NIL)
+	{
+		int targetPoolSize = MaxAdaptiveExecutorPoolSize;
+		if (MaxConcurrentIndexBuildsPerNode > 0)
+		{
+			targetPoolSize = MaxConcurrentIndexBuildsPerNode;
+		}
+
+		char *sessionSetupCommand = NULL;
+
+		ExecuteTaskListWithCallback(ROW_MODIFY_NONE, remoteTaskList, targetPoolSize,
+									sessionSetupCommand,
+									ShardTaskProgressTasksCompleted, tracker);
+	}
+
+	FinishShardTaskProgress(tracker);
+}
+
+
+/*
+ * TaskListHasShard returns whether any of the given tasks is anchored on the
+ * given shard.
+ */
+static bool
+TaskListHasShard(List *taskList, uint64 shardId)
+{
+	Task *task = NULL;
+	foreach_ptr(task, taskList)
+	{
+		if (task->anchorShardId == shardId)
+		{
+			return true;
+		}
+	}
+
+	return false;
+}
+
+
+/*
+ * citus_concurrent_index_progress returns the state of every shard of the
+ * CONCURRENTLY-enabled index commands that are in progress.
+ */
+Datum
+citus_concurrent_index_progress(PG_FUNCTION_ARGS)
+{
+	CheckCitusVersion(ERROR);
+
+	ShardTaskProgressReturnRows(CONCURRENT_INDEX_MAGIC_NUMBER, fcinfo);
+
+	PG_RETURN_VOID();
+}
@@ -35,6 +35,9 @@
 #include "distributed/local_multi_copy.h"
 #include "distributed/shard_utils.h"
 
+/* GUC, size of the buffer of a local placement after which it is copied */
+int LocalCopyFlushThresholdBytes = 512 * 1024;
+
 static int ReadFromLocalBufferCallback(void *outBuf, int minRead, int maxRead);
 static void AddSlotToBuffer(TupleTableSlot *slot, CitusCopyDestReceiver *copyDest,
 							CopyOutState localCopyOutState);
@@ -137,7 +140,7 @@ AddSlotToBuffer(TupleTableSlot *slot, CitusCopyDestReceiver *copyDest, CopyOutSt
 static bool
 ShouldSendCopyNow(StringInfo buffer)
 {
-	return buffer->len > LOCAL_COPY_FLUSH_THRESHOLD;
+	return buffer->len > LocalCopyFlushThresholdBytes;
 }
 
 
@@ -204,8 +207,8 @@ ReadFromLocalBufferCallback(void *outBuf, int minRead, int maxRead)
 	int bytesToRead = Min(avail, maxRead);
 	if (bytesToRead > 0)
 	{
-		memcpy_s(outBuf, bytesToRead,
-				 &LocalCopyBuffer->data[LocalCopyBuffer->cursor], bytesToRead);
+		SafeMemcpy(outBuf, bytesToRead,
+				   &LocalCopyBuffer->data[LocalCopyBuffer->cursor], bytesToRead);
 	}
 	bytesRead += bytesToRead;
 	LocalCopyBuffer->cursor += bytesToRead;
@@ -50,6 +50,7 @@
 #include "postgres.h"
 #include "libpq-fe.h"
 #include "miscadmin.h"
+#include "pgstat.h"
 
 #include <arpa/inet.h> /* for htons */
 #include <netinet/in.h> /* for htons */
@@ -65,9 +66,16 @@
 #include "catalog/pg_type.h"
 #include "commands/copy.h"
 #include "commands/defrem.h"
+#include "distributed/citus_custom_scan.h"
 #include "distributed/citus_safe_lib.h"
 #include "distributed/commands/multi_copy.h"
 #include "distributed/commands/utility_hook.h"
+#include "distributed/connection_management.h"
+#include "distributed/ddl_buffer.h"
+#include "distributed/deparse_shard_query.h"
+#include "distributed/distributed_snapshot.h"
+#include "distributed/distributed_planner.h"
+#include "distributed/insert_buffer.h"
 #include "distributed/intermediate_results.h"
 #include "distributed/local_executor.h"
 #include "distributed/log_utils.h"
@@ -82,8 +90,11 @@
 #include "distributed/remote_commands.h"
 #include "distributed/remote_transaction.h"
 #include "distributed/resource_lock.h"
+#include "distributed/result_cache.h"
 #include "distributed/shard_pruning.h"
 #include "distributed/version_compat.h"
+#include "distributed/wait_sampling.h"
+#include "distributed/worker_manager.h"
 #include "distributed/worker_protocol.h"
 #include "distributed/local_multi_copy.h"
 #include "distributed/hash_helpers.h"
@@ -91,10 +102,14 @@
 #include "foreign/foreign.h"
 #include "libpq/libpq.h"
 #include "libpq/pqformat.h"
+#include "mb/pg_wchar.h"
 #include "nodes/makefuncs.h"
 #include "nodes/nodeFuncs.h"
+#include "storage/latch.h"
+#include "tcop/tcopprot.h"
 #include "tsearch/ts_locale.h"
 #include "utils/builtins.h"
+#include "utils/datum.h"
 #include "utils/lsyscache.h"
 #include "utils/rel.h"
 #include "utils/syscache.h"
@@ -104,6 +119,9 @@
 /* constant used in binary protocol */
 static const char BinarySignature[11] = "PGCOPY\n\377\r\n\0";
 
+/* length of the binary header: signature, flags field and header extension length */
+#define BINARY_COPY_HEADER_LENGTH 19
+
 /*
  * Data size threshold to switch over the active placement for a connection.
  * If this is too low, overhead of starting COPY commands will hurt the
@@ -111,7 +129,46 @@ static const char BinarySignature[11] = "PGCOPY\n\377\r\n\0";
  * 4MB is a good balance between memory usage and performance. Note that this
  * is irrelevant in the common case where we open one connection per placement.
  */
-#define COPY_SWITCH_OVER_THRESHOLD (4 * 1024 * 1024)
+int CopySwitchOverThresholdBytes = 4 * 1024 * 1024;
+
+/*
+ * Data size threshold to send the rows buffered for the active placement of a
+ * connection. Sending rows in batches rather than one CopyData message per row
+ * reduces the per-row overhead in libpq and on the worker.
+ */
+#define COPY_SEND_BATCH_THRESHOLD (64 * 1024)
+
+/* size of the buffer that makeStringInfo() allocates for a placement */
+#define COPY_PLACEMENT_BUFFER_INITIAL_SIZE 1024
+
+/*
+ * Number of new shards that COPY into an append-distributed table fills
+ * concurrently. Input rows are distributed across these shards in blocks of
+ * COPY_SEND_BATCH_THRESHOLD bytes, such that the shards on different workers
+ * are written in parallel.
+ */
+int AppendCopyShardCount = 1;
+
+/*
+ * Whether COPY in text or csv format into a hash-distributed table parses
+ * only the distribution column of each row and forwards the other fields to
+ * the workers as is, leaving their validation to the workers.
+ */
+bool EnableCopyPassThrough = false;
+
+/*
+ * Memory in kB that the placement buffers of a COPY may use. When exceeded,
+ * the buffers of the least recently used shards are sent and released until
+ * half of the limit is used. 0 disables the limit.
+ */
+int CopyMemoryLimit = 0;
+
+/*
+ * Whether COPY (SELECT ..) TO STDOUT on distributed tables runs a COPY on the
+ * workers for each task and forwards their output to the client, when the
+ * results of the tasks only need to be concatenated.
+ */
+bool EnableCopySelectForwarding = false;
 
 typedef struct CopyShardState CopyShardState;
 typedef struct CopyPlacementState CopyPlacementState;
@@ -169,8 +226,8 @@ struct CopyPlacementState
 
 	/*
 	 * Buffered COPY data. When the placement is activePlacementState of
-	 * some connection, this is empty. Because in that case we directly
-	 * send the data over connection.
+	 * some connection, this holds at most COPY_SEND_BATCH_THRESHOLD bytes
+	 * of rows that are yet to be sent over the connection.
 	 */
 	StringInfo data;
 
@@ -191,6 +248,12 @@ struct CopyShardState
 
 	/* List of CopyPlacementStates for all active placements of the shard. */
 	List *placementStateList;
+
+	/* List node for CitusCopyDestReceiver->shardStateLruList. */
+	dlist_node lruNode;
+
+	/* progress of the shard in CitusCopyDestReceiver->progress, may be NULL */
+	CommandProgressStep *progressStep;
 };
 
 /* ShardConnections represents a set of connections for each placement of a shard */
@@ -202,6 +265,102 @@ typedef struct ShardConnections
 	List *connectionList;
 } ShardConnections;
 
+/* NewShardCopyState represents a new shard that rows are copied into */
+typedef struct NewShardCopyState
+{
+	ShardConnections shardConnections;
+
+	/* number of bytes copied into the shard, 0 if no shard is started */
+	uint64 copiedDataSizeInBytes;
+
+	/* range of the partition column values copied into the shard */
+	bool partitionValueFound;
+	Datum minPartitionValue;
+	Datum maxPartitionValue;
+} NewShardCopyState;
+
+/*
+ * PartitionColumnRangeState describes the partition column of an append-partitioned
+ * table, to track the range of the rows copied into new shards.
+ */
+typedef struct PartitionColumnRangeState
+{
+	int columnIndex;
+	Oid collation;
+	FmgrInfo *compareFunction;
+	Oid outputFunctionId;
+	int16 typeLength;
+	bool typeByValue;
+} PartitionColumnRangeState;
+
+/*
+ * CopySelectTask is a task of a COPY (SELECT ..) TO STDOUT along with the
+ * placements on which it was not tried yet, in the order of the task
+ * assignment policy.
+ */
+typedef struct CopySelectTask
+{
+	Task *task;
+	List *placementList;
+} CopySelectTask;
+
+/*
+ * CopySelectNode holds the tasks of a COPY (SELECT ..) TO STDOUT that run on
+ * the same node and were not started yet, which the streams to that node take
+ * one at a time.
+ */
+typedef struct CopySelectNode
+{
+	char *nodeName;
+	int nodePort;
+	List *pendingTaskList;
+
+	/* whether the streams to the node were opened */
+	bool streamsOpened;
+
+	/* whether a connection to the node failed, such that it gets no more tasks */
+	bool failed;
+} CopySelectNode;
+
+/*
+ * CopySelectStream is a connection that runs COPY commands for the tasks of a
+ * COPY (SELECT ..) TO STDOUT and whose output is forwarded to the client.
+ */
+typedef struct CopySelectStream
+{
+	CopySelectNode *node;
+
+	/* connection of the stream, NULL once the connection failed */
+	MultiConnection *connection;
+
+	/* task whose COPY command was sent, NULL if the stream is idle */
+	CopySelectTask *task;
+
+	/* whether the worker started sending the COPY output of the task */
+	bool copyStarted;
+
+	/* whether the binary header of the COPY output still needs to be skipped */
+	bool skipBinaryHeader;
+
+	/* whether rows of the task were sent to the client, so it cannot be retried */
+	bool forwardedRows;
+} CopySelectStream;
+
+/*
+ * CopySelectExecution holds the state of forwarding the output of the tasks
+ * of a COPY (SELECT ..) TO STDOUT to the client.
+ */
+typedef struct CopySelectExecution
+{
+	List *nodeList;
+	List *streamList;
+	CopyOutState copyOutState;
+	uint64 tuplesSent;
+
+	/* whether the streams that run a COPY changed since the last wait */
+	bool rebuildWaitEventSet;
+} CopySelectExecution;
+
 
 /* Local functions forward declarations */
 static void CopyToExistingShards(CopyStmt *copyStatement, char *completionTag);
@@ -217,6 +376,7 @@ static void SendCopyBinaryHeaders(CopyOutState copyOutState, int64 shardId,
 static void SendCopyBinaryFooters(CopyOutState copyOutState, int64 shardId,
 								  List *connectionList);
 static StringInfo ConstructCopyStatement(CopyStmt *copyStatement, int64 shardId);
+static void AppendCopyOptions(StringInfo command, List *optionList);
 static void SendCopyDataToAll(StringInfo dataBuffer, int64 shardId, List *connectionList);
 static void SendCopyDataToPlacement(StringInfo dataBuffer, int64 shardId,
 									MultiConnection *connection);
@@ -224,6 +384,13 @@ static void ReportCopyError(MultiConnection *connection, PGresult *result);
 static uint32 AvailableColumnCount(TupleDesc tupleDescriptor);
 static int64 StartCopyToNewShard(ShardConnections *shardConnections,
 								 CopyStmt *copyStatement, bool useBinaryCopyFormat);
+static void EndCopyToNewShard(NewShardCopyState *newShardState,
+							  CopyOutState copyOutState,
+							  PartitionColumnRangeState *rangeState);
+static PartitionColumnRangeState * CreatePartitionColumnRangeState(Oid relationId);
+static void TrackPartitionValue(NewShardCopyState *newShardState,
+								PartitionColumnRangeState *rangeState,
+								Datum *columnValues, bool *columnNulls);
 static int64 CreateEmptyShard(char *relationName);
 
 static Oid TypeForColumnName(Oid relationId, TupleDesc tupleDescriptor, char *columnName);
@@ -236,6 +403,7 @@ static FmgrInfo * TypeOutputFunctions(uint32 columnCount, Oid *typeIdArray,
 									  bool binaryFormat);
 static List * CopyGetAttnums(TupleDesc tupDesc, Relation rel, List *attnamelist);
 static bool CopyStatementHasFormat(CopyStmt *copyStatement, char *formatName);
+static bool CopyResultStmtIsCompressed(CopyStmt *copyStatement);
 static void CitusCopyFrom(CopyStmt *copyStatement, char *completionTag);
 static HTAB * CreateConnectionStateHash(MemoryContext memoryContext);
 static HTAB * CreateShardStateHash(MemoryContext memoryContext);
@@ -264,6 +432,38 @@ static void ShutdownCopyConnectionState(CopyConnectionState *connectionState,
 static void CitusCopyTo(CopyStmt *copyStatement, char *completionTag);
 static int64 ForwardCopyDataFromConnection(CopyOutState copyOutState,
 										   MultiConnection *connection);
+static bool CitusCopySelectTo(CopyStmt *copyStatement, const char *queryString,
+							  char *completionTag);
+static List * ForwardableCopySelectTaskList(PlannedStmt *plannedStmt);
+static uint64 ForwardCopySelectTaskResults(CopyStmt *copyStatement, List *taskList,
+										   int columnCount);
+static List * CopySelectTaskOptionList(CopyStmt *copyStatement);
+static bool CopyStatementHasHeader(CopyStmt *copyStatement);
+static List * CopySelectTaskList(List *taskList);
+static void AssignCopySelectTask(CopySelectExecution *execution,
+								 CopySelectTask *copySelectTask);
+static bool CanRetryCopySelectTask(CopySelectExecution *execution,
+								   CopySelectTask *copySelectTask);
+static bool CanRetryCopySelectNodeTasks(CopySelectExecution *execution,
+										CopySelectNode *node);
+static void ReassignCopySelectNodeTasks(CopySelectExecution *execution,
+										CopySelectNode *node);
+static void OpenCopySelectStreams(CopySelectExecution *execution);
+static CopySelectNode * FindCopySelectNode(List *nodeList, char *nodeName,
+										   int nodePort);
+static bool StartNextCopySelectTask(CopySelectExecution *execution,
+									CopySelectStream *stream, List *optionList);
+static void ForwardCopySelectHeader(CopySelectExecution *execution,
+									List *headerOptionList);
+static bool ReceiveCopySelectHeader(CopySelectExecution *execution,
+									CopySelectStream *stream);
+static bool ForwardCopySelectStreamData(CopySelectExecution *execution,
+										CopySelectStream *stream);
+static bool FinishCopySelectTask(CopySelectExecution *execution,
+								 CopySelectStream *stream);
+static void CopySelectStreamFailed(CopySelectExecution *execution,
+								   CopySelectStream *stream, PGresult *result);
+static WaitEventSet * BuildCopySelectWaitEventSet(List *streamList);
 
 /* Private functions copied and adapted from copy.c in PostgreSQL */
 static void SendCopyBegin(CopyOutState cstate);
@@ -278,6 +478,26 @@ static void CopyAttributeOutText(CopyOutState outputState, char *string);
 static inline void CopyFlushOutput(CopyOutState outputState, char *start, char *pointer);
 static bool CitusSendTupleToPlacements(TupleTableSlot *slot,
 									   CitusCopyDestReceiver *copyDest);
+static bool CanCopyRawFields(CopyStmt *copyStatement, CitusCopyDestReceiver *copyDest);
+static uint64 CopyRawFieldsToShards(CopyState copyState,
+									CitusCopyDestReceiver *copyDest);
+static void AppendCopyRawFieldsData(char **fieldValues, int fieldCount,
+									CopyOutState rowOutputState);
+static void CitusCopyDestReceiverSendRawRow(CitusCopyDestReceiver *copyDest,
+											Datum *columnValues, bool *columnNulls,
+											StringInfo rowData);
+static void CitusSendRawRowToPlacements(CitusCopyDestReceiver *copyDest,
+										Datum *columnValues, bool *columnNulls,
+										StringInfo rowData);
+static CopyShardState * GetCopyDestShardState(CitusCopyDestReceiver *copyDest,
+											  int64 shardId);
+static void SendRowDataToPlacements(CitusCopyDestReceiver *copyDest,
+									CopyShardState *shardState, StringInfo rowData);
+static CommandProgress * StartCopyProgress(Oid relationId);
+static void RecordCopiedRow(CopyShardState *shardState, StringInfo rowData);
+static void EvictCopyShardStates(CitusCopyDestReceiver *copyDest);
+static void ReleaseShardStateBuffers(CitusCopyDestReceiver *copyDest,
+									 CopyShardState *shardState);
 static uint64 ShardIdForTuple(CitusCopyDestReceiver *copyDest, Datum *columnValues,
 							  bool *columnNulls);
 
@@ -438,6 +658,10 @@ CopyToExistingShards(CopyStmt *copyStatement, char *completionTag)
 	copyDest = CreateCitusCopyDestReceiver(tableId, columnNameList, partitionColumnIndex,
 										   executorState, stopOnFailure, NULL);
 	dest = (DestReceiver *) copyDest;
+
+	/* show how many rows went to each shard in citus_command_progress */
+	copyDest->progress = StartCopyProgress(tableId);
+
 	dest->rStartup(dest, 0, tupleDescriptor);
 
 	/*
@@ -485,29 +709,36 @@ CopyToExistingShards(CopyStmt *copyStatement, char *completionTag)
 	errorCallback.previous = error_context_stack;
 	error_context_stack = &errorCallback;
 
-	while (true)
+	if (CanCopyRawFields(copyStatement, copyDest))
 	{
-		ResetPerTupleExprContext(executorState);
+		processedRowCount = CopyRawFieldsToShards(copyState, copyDest);
+	}
+	else
+	{
+		while (true)
+		{
+			ResetPerTupleExprContext(executorState);
 
-		MemoryContext oldContext = MemoryContextSwitchTo(executorTupleContext);
+			MemoryContext oldContext = MemoryContextSwitchTo(executorTupleContext);
 
-		/* parse a row from the input */
-		bool nextRowFound = NextCopyFromCompat(copyState, executorExpressionContext,
-											   columnValues, columnNulls);
+			/* parse a row from the input */
+			bool nextRowFound = NextCopyFromCompat(copyState, executorExpressionContext,
+												   columnValues, columnNulls);
 
-		if (!nextRowFound)
-		{
-			MemoryContextSwitchTo(oldContext);
-			break;
-		}
+			if (!nextRowFound)
+			{
+				MemoryContextSwitchTo(oldContext);
+				break;
+			}
 
-		CHECK_FOR_INTERRUPTS();
+			CHECK_FOR_INTERRUPTS();
 
-		MemoryContextSwitchTo(oldContext);
+			MemoryContextSwitchTo(oldContext);
 
-		dest->receiveSlot(tupleTableSlot, dest);
+			dest->receiveSlot(tupleTableSlot, dest);
 
-		processedRowCount += 1;
+			processedRowCount += 1;
+		}
 	}
 
 	EndCopyFrom(copyState);
@@ -517,6 +748,9 @@ CopyToExistingShards(CopyStmt *copyStatement, char *completionTag)
 
 	/* finish the COPY commands */
 	dest->rShutdown(dest);
+
+	FinishCommandProgress(copyDest->progress);
+
 	dest->rDestroy(dest);
 
 	ExecDropSingleTupleTableSlot(tupleTableSlot);
@@ -536,6 +770,227 @@ CopyToExistingShards(CopyStmt *copyStatement, char *completionTag)
 }
 
 
+/*
+ * CanCopyRawFields returns whether the rows of the given COPY into a
+ * distributed table can be forwarded to the workers without parsing any
+ * column other than the partition column.
+ */
+static bool
+CanCopyRawFields(CopyStmt *copyStatement, CitusCopyDestReceiver *copyDest)
+{
+	ListCell *optionCell = NULL;
+
+	if (!EnableCopyPassThrough)
+	{
+		return false;
+	}
+
+	if (copyDest->tableMetadata->partitionMethod != DISTRIBUTE_BY_HASH)
+	{
+		return false;
+	}
+
+	/* columns that are not in the input need to get their default values */
+	if (copyStatement->attlist != NIL)
+	{
+		return false;
+	}
+
+#if PG_VERSION_NUM >= 120000
+	if (copyStatement->whereClause != NULL)
+	{
+		return false;
+	}
+#endif
+
+	/* rows are forwarded in text format, and local copy needs the tuples */
+	if (copyDest->copyOutState->binary || copyDest->shouldUseLocalCopy)
+	{
+		return false;
+	}
+
+	foreach(optionCell, copyStatement->options)
+	{
+		DefElem *option = (DefElem *) lfirst(optionCell);
+
+		if (strcmp(option->defname, "format") == 0 &&
+			strcmp(defGetString(option), "binary") == 0)
+		{
+			return false;
+		}
+
+		/* these options are applied when converting the raw fields */
+		if (strcmp(option->defname, "force_not_null") == 0 ||
+			strcmp(option->defname, "force_null") == 0)
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+
+/*
+ * CopyRawFieldsToShards reads the rows of a COPY in text or csv format and
+ * sends them to the shards they belong to. Only the partition column of each
+ * row is parsed to find its shard, the other fields are sent as they are.
+ * The function returns the number of rows copied.
+ */
+static uint64
+CopyRawFieldsToShards(CopyState copyState, CitusCopyDestReceiver *copyDest)
+{
+	TupleDesc tupleDescriptor = copyDest->tupleDescriptor;
+	int columnCount = tupleDescriptor->natts;
+	int partitionColumnIndex = copyDest->partitionColumnIndex;
+	Form_pg_attribute partitionColumn = TupleDescAttr(tupleDescriptor,
+													  partitionColumnIndex);
+	Datum *columnValues = palloc0(columnCount * sizeof(Datum));
+	bool *columnNulls = palloc0(columnCount * sizeof(bool));
+	int *fieldColumnIndexes = palloc0(columnCount * sizeof(int));
+	int fieldCount = 0;
+	int partitionFieldIndex = -1;
+	Oid inputFunctionId = InvalidOid;
+	Oid typeIOParam = InvalidOid;
+	FmgrInfo inputFunction;
+	uint64 processedRowCount = 0;
+
+	EState *executorState = copyDest->executorState;
+	MemoryContext executorTupleContext = GetPerTupleMemoryContext(executorState);
+
+	/* the input has a field for each column that is not dropped or generated */
+	for (int columnIndex = 0; columnIndex < columnCount; columnIndex++)
+	{
+		Form_pg_attribute currentColumn = TupleDescAttr(tupleDescriptor, columnIndex);
+
+		if (currentColumn->attisdropped
+#if PG_VERSION_NUM >= 120000
+			|| currentColumn->attgenerated == ATTRIBUTE_GENERATED_STORED
+#endif
+			)
+		{
+			continue;
+		}
+
+		if (columnIndex == partitionColumnIndex)
+		{
+			partitionFieldIndex = fieldCount;
+		}
+
+		fieldColumnIndexes[fieldCount] = columnIndex;
+		fieldCount++;
+	}
+
+	Assert(partitionFieldIndex >= 0);
+
+	getTypeInputInfo(partitionColumn->atttypid, &inputFunctionId, &typeIOParam);
+	fmgr_info(inputFunctionId, &inputFunction);
+
+	/* rows are serialized with the same settings as AppendCopyRowData */
+	CopyOutState rowOutputState = (CopyOutState) palloc0(sizeof(CopyOutStateData));
+	rowOutputState->delim = copyDest->copyOutState->delim;
+	rowOutputState->null_print = copyDest->copyOutState->null_print;
+	rowOutputState->null_print_client = copyDest->copyOutState->null_print_client;
+	rowOutputState->binary = false;
+	rowOutputState->fe_msgbuf = makeStringInfo();
+	rowOutputState->rowcontext = executorTupleContext;
+
+	while (true)
+	{
+		char **fieldValues = NULL;
+		int inputFieldCount = 0;
+
+		ResetPerTupleExprContext(executorState);
+
+		MemoryContext oldContext = MemoryContextSwitchTo(executorTupleContext);
+
+		/* split a row from the input into fields */
+		bool nextRowFound = NextCopyFromRawFields(copyState, &fieldValues,
+												  &inputFieldCount);
+		if (!nextRowFound)
+		{
+			MemoryContextSwitchTo(oldContext);
+			break;
+		}
+
+		CHECK_FOR_INTERRUPTS();
+
+		if (inputFieldCount > fieldCount)
+		{
+			ereport(ERROR, (errcode(ERRCODE_BAD_COPY_FILE_FORMAT),
+							errmsg("extra data after last expected column")));
+		}
+		else if (inputFieldCount < fieldCount)
+		{
+			Form_pg_attribute missingColumn =
+				TupleDescAttr(tupleDescriptor, fieldColumnIndexes[inputFieldCount]);
+
+			ereport(ERROR, (errcode(ERRCODE_BAD_COPY_FILE_FORMAT),
+							errmsg("missing data for column \"%s\"",
+								   NameStr(missingColumn->attname))));
+		}
+
+		/* parse the partition column to find the shard */
+		char *partitionFieldValue = fieldValues[partitionFieldIndex];
+		columnNulls[partitionColumnIndex] = (partitionFieldValue == NULL);
+		if (partitionFieldValue != NULL)
+		{
+			columnValues[partitionColumnIndex] =
+				InputFunctionCall(&inputFunction, partitionFieldValue, typeIOParam,
+								  partitionColumn->atttypmod);
+		}
+
+		resetStringInfo(rowOutputState->fe_msgbuf);
+		AppendCopyRawFieldsData(fieldValues, fieldCount, rowOutputState);
+
+		MemoryContextSwitchTo(oldContext);
+
+		CitusCopyDestReceiverSendRawRow(copyDest, columnValues, columnNulls,
+										rowOutputState->fe_msgbuf);
+
+		processedRowCount += 1;
+	}
+
+	return processedRowCount;
+}
+
+
+/*
+ * AppendCopyRawFieldsData appends the given fields as a row in COPY text
+ * format to the copy buffer in rowOutputState. NULL fields are written as
+ * the null string.
+ */
+static void
+AppendCopyRawFieldsData(char **fieldValues, int fieldCount, CopyOutState rowOutputState)
+{
+	for (int fieldIndex = 0; fieldIndex < fieldCount; fieldIndex++)
+	{
+		char *fieldValue = fieldValues[fieldIndex];
+
+		if (fieldIndex > 0)
+		{
+			CopySendChar(rowOutputState, rowOutputState->delim[0]);
+		}
+
+		if (fieldValue == NULL)
+		{
+			CopySendString(rowOutputState, rowOutputState->null_print_client);
+		}
+		else
+		{
+			CopyAttributeOutText(rowOutputState, fieldValue);
+		}
+	}
+
+	/* append default line termination string depending on the platform */
+#ifndef WIN32
+	CopySendChar(rowOutputState, '\n');
+#else
+	CopySendString(rowOutputState, "\r\n");
+#endif
+}
+
+
 /*
  * CopyToNewShards implements the COPY table_name FROM ... for append-partitioned
  * tables where we create new shards into which to copy rows.
@@ -559,13 +1014,18 @@ CopyToNewShards(CopyStmt *copyStatement, char *completionTag, Oid relationId)
 
 	ErrorContextCallback errorCallback;
 
-	int64 currentShardId = INVALID_SHARD_ID;
 	uint64 shardMaxSizeInBytes = (int64) ShardMaxSize * 1024L;
-	uint64 copiedDataSizeInBytes = 0;
 	uint64 processedRowCount = 0;
 
-	ShardConnections *shardConnections =
-		(ShardConnections *) palloc0(sizeof(ShardConnections));
+	/* rows are copied into a block of one shard at a time, in round-robin order */
+	int newShardCount = AppendCopyShardCount;
+	NewShardCopyState *newShardStates =
+		(NewShardCopyState *) palloc0(newShardCount * sizeof(NewShardCopyState));
+	int currentShardIndex = 0;
+	uint64 blockSizeInBytes = 0;
+
+	/* the partition column range of the new shards is tracked while copying */
+	PartitionColumnRangeState *rangeState = CreatePartitionColumnRangeState(relationId);
 
 	/* initialize copy state to read from COPY data source */
 	CopyState copyState = BeginCopyFrom(NULL,
@@ -635,22 +1095,25 @@ CopyToNewShards(CopyStmt *copyStatement, char *completionTag, Oid relationId)
 		MemoryContextSwitchTo(oldContext);
 		error_context_stack = errorCallback.previous;
 
+		NewShardCopyState *newShardState = &newShardStates[currentShardIndex];
+		ShardConnections *shardConnections = &newShardState->shardConnections;
+
 		/*
 		 * If copied data size is zero, this means either this is the first
-		 * line in the copy or we just filled the previous shard up to its
-		 * capacity. Either way, we need to create a new shard and
-		 * start copying new rows into it.
+		 * line copied into this slot or we just filled the previous shard in
+		 * this slot up to its capacity. Either way, we need to create a new
+		 * shard and start copying new rows into it.
 		 */
-		if (copiedDataSizeInBytes == 0)
+		if (newShardState->copiedDataSizeInBytes == 0)
 		{
 			/* create shard and open connections to shard placements */
-			currentShardId = StartCopyToNewShard(shardConnections, copyStatement,
-												 copyOutState->binary);
+			int64 newShardId = StartCopyToNewShard(shardConnections, copyStatement,
+												   copyOutState->binary);
 
 			/* send copy binary headers to shard placements */
 			if (copyOutState->binary)
 			{
-				SendCopyBinaryHeaders(copyOutState, currentShardId,
+				SendCopyBinaryHeaders(copyOutState, newShardId,
 									  shardConnections->connectionList);
 			}
 		}
@@ -659,52 +1122,49 @@ CopyToNewShards(CopyStmt *copyStatement, char *completionTag, Oid relationId)
 		resetStringInfo(copyOutState->fe_msgbuf);
 		AppendCopyRowData(columnValues, columnNulls, tupleDescriptor,
 						  copyOutState, columnOutputFunctions, NULL);
-		SendCopyDataToAll(copyOutState->fe_msgbuf, currentShardId,
+		SendCopyDataToAll(copyOutState->fe_msgbuf, shardConnections->shardId,
 						  shardConnections->connectionList);
 
+		TrackPartitionValue(newShardState, rangeState, columnValues, columnNulls);
+
 		uint64 messageBufferSize = copyOutState->fe_msgbuf->len;
-		copiedDataSizeInBytes = copiedDataSizeInBytes + messageBufferSize;
+		newShardState->copiedDataSizeInBytes += messageBufferSize;
+		blockSizeInBytes += messageBufferSize;
 
 		/*
 		 * If we filled up this shard to its capacity, send copy binary footers
 		 * to shard placements, and update shard statistics.
 		 */
-		if (copiedDataSizeInBytes > shardMaxSizeInBytes)
+		if (newShardState->copiedDataSizeInBytes > shardMaxSizeInBytes)
 		{
-			Assert(currentShardId != INVALID_SHARD_ID);
-
-			if (copyOutState->binary)
-			{
-				SendCopyBinaryFooters(copyOutState, currentShardId,
-									  shardConnections->connectionList);
-			}
+			EndCopyToNewShard(newShardState, copyOutState, rangeState);
 
-			EndRemoteCopy(currentShardId, shardConnections->connectionList);
-			UpdateShardStatistics(shardConnections->shardId);
+			newShardState->copiedDataSizeInBytes = 0;
+		}
 
-			copiedDataSizeInBytes = 0;
-			currentShardId = INVALID_SHARD_ID;
+		/* move on to the next shard once we copied a block into this one */
+		if (blockSizeInBytes >= COPY_SEND_BATCH_THRESHOLD)
+		{
+			currentShardIndex = (currentShardIndex + 1) % newShardCount;
+			blockSizeInBytes = 0;
 		}
 
 		processedRowCount += 1;
 	}
 
 	/*
-	 * For the last shard, send copy binary footers to shard placements,
-	 * and update shard statistics. If no row is send, there is no shard
-	 * to finalize the copy command.
+	 * For the last shards, send copy binary footers to shard placements,
+	 * and update shard statistics. If no row is sent to a slot, there is
+	 * no shard to finalize the copy command for.
 	 */
-	if (copiedDataSizeInBytes > 0)
+	for (int shardIndex = 0; shardIndex < newShardCount; shardIndex++)
 	{
-		Assert(currentShardId != INVALID_SHARD_ID);
+		NewShardCopyState *newShardState = &newShardStates[shardIndex];
 
-		if (copyOutState->binary)
+		if (newShardState->copiedDataSizeInBytes > 0)
 		{
-			SendCopyBinaryFooters(copyOutState, currentShardId,
-								  shardConnections->connectionList);
+			EndCopyToNewShard(newShardState, copyOutState, rangeState);
 		}
-		EndRemoteCopy(currentShardId, shardConnections->connectionList);
-		UpdateShardStatistics(shardConnections->shardId);
 	}
 
 	EndCopyFrom(copyState);
@@ -1047,17 +1507,30 @@ ConstructCopyStatement(CopyStmt *copyStatement, int64 shardId)
 		appendStringInfoString(command, "TO STDOUT");
 	}
 
-	if (copyStatement->options != NIL)
+	AppendCopyOptions(command, copyStatement->options);
+
+	return command;
+}
+
+
+/*
+ * AppendCopyOptions appends the WITH clause of a COPY statement with the given
+ * options to the command, if there are any.
+ */
+static void
+AppendCopyOptions(StringInfo command, List *optionList)
+{
+	if (optionList != NIL)
 	{
 		ListCell *optionCell = NULL;
 
 		appendStringInfoString(command, " WITH (");
 
-		foreach(optionCell, copyStatement->options)
+		foreach(optionCell, optionList)
 		{
 			DefElem *defel = (DefElem *) lfirst(optionCell);
 
-			if (optionCell != list_head(copyStatement->options))
+			if (optionCell != list_head(optionList))
 			{
 				appendStringInfoString(command, ", ");
 			}
@@ -1092,8 +1565,6 @@ ConstructCopyStatement(CopyStmt *copyStatement, int64 shardId)
 
 		appendStringInfoString(command, ")");
 	}
-
-	return command;
 }
 
 
@@ -1696,23 +2167,168 @@ StartCopyToNewShard(ShardConnections *shardConnections, CopyStmt *copyStatement,
 
 
 /*
- * CreateEmptyShard creates a new shard and related shard placements from the
- * local master node.
+ * EndCopyToNewShard sends copy binary footers to the placements of a shard
+ * started by StartCopyToNewShard, ends the COPY and updates the shard
+ * statistics. The min/max values of the shard are the range of the partition
+ * column values that were copied into it, such that the shard does not need
+ * to be scanned for them.
  */
-static int64
-CreateEmptyShard(char *relationName)
+static void
+EndCopyToNewShard(NewShardCopyState *newShardState, CopyOutState copyOutState,
+				  PartitionColumnRangeState *rangeState)
 {
-	text *relationNameText = cstring_to_text(relationName);
-	Datum relationNameDatum = PointerGetDatum(relationNameText);
-	Datum shardIdDatum = DirectFunctionCall1(master_create_empty_shard,
-											 relationNameDatum);
-	int64 shardId = DatumGetInt64(shardIdDatum);
+	ShardConnections *shardConnections = &newShardState->shardConnections;
+	int64 shardId = shardConnections->shardId;
+	text *minValue = NULL;
+	text *maxValue = NULL;
 
-	return shardId;
-}
+	Assert(shardId != INVALID_SHARD_ID);
 
+	if (copyOutState->binary)
+	{
+		SendCopyBinaryFooters(copyOutState, shardId, shardConnections->connectionList);
+	}
 
-/* *INDENT-OFF* */
+	EndRemoteCopy(shardId, shardConnections->connectionList);
+
+	if (newShardState->partitionValueFound)
+	{
+		char *minValueString = OidOutputFunctionCall(rangeState->outputFunctionId,
+													 newShardState->minPartitionValue);
+		char *maxValueString = OidOutputFunctionCall(rangeState->outputFunctionId,
+													 newShardState->maxPartitionValue);
+
+		minValue = cstring_to_text(minValueString);
+		maxValue = cstring_to_text(maxValueString);
+
+		if (!rangeState->typeByValue)
+		{
+			pfree(DatumGetPointer(newShardState->minPartitionValue));
+			pfree(DatumGetPointer(newShardState->maxPartitionValue));
+		}
+
+		newShardState->partitionValueFound = false;
+	}
+
+	UpdateShardStatisticsWithRange(shardId, minValue, maxValue);
+}
+
+
+/*
+ * CreatePartitionColumnRangeState looks up what is needed to track the range
+ * of the partition column of the given append-partitioned table. The
+ * comparison function is copied, since creating new shards invalidates the
+ * metadata cache entry of the table.
+ */
+static PartitionColumnRangeState *
+CreatePartitionColumnRangeState(Oid relationId)
+{
+	CitusTableCacheEntry *cacheEntry = GetCitusTableCacheEntry(relationId);
+	Var *partitionColumn = cacheEntry->partitionColumn;
+	bool typeIsVarlena = false;
+
+	PartitionColumnRangeState *rangeState = palloc0(sizeof(PartitionColumnRangeState));
+	rangeState->columnIndex = partitionColumn->varattno - 1;
+	rangeState->collation = partitionColumn->varcollid;
+
+	rangeState->compareFunction = palloc0(sizeof(FmgrInfo));
+	fmgr_info_copy(rangeState->compareFunction, cacheEntry->shardColumnCompareFunction,
+				   CurrentMemoryContext);
+
+	getTypeOutputInfo(partitionColumn->vartype, &rangeState->outputFunctionId,
+					  &typeIsVarlena);
+	get_typlenbyval(partitionColumn->vartype, &rangeState->typeLength,
+					&rangeState->typeByValue);
+
+	return rangeState;
+}
+
+
+/*
+ * TrackPartitionValue widens the partition column range of the given new shard
+ * to include the partition column value of a row that was copied into it.
+ * Rows without a partition column value do not affect the range, the same as
+ * for min() and max().
+ */
+static void
+TrackPartitionValue(NewShardCopyState *newShardState,
+					PartitionColumnRangeState *rangeState, Datum *columnValues,
+					bool *columnNulls)
+{
+	int columnIndex = rangeState->columnIndex;
+
+	if (columnNulls[columnIndex])
+	{
+		return;
+	}
+
+	Datum partitionValue = columnValues[columnIndex];
+
+	if (!newShardState->partitionValueFound)
+	{
+		newShardState->minPartitionValue = datumCopy(partitionValue,
+													 rangeState->typeByValue,
+													 rangeState->typeLength);
+		newShardState->maxPartitionValue = datumCopy(partitionValue,
+													 rangeState->typeByValue,
+													 rangeState->typeLength);
+		newShardState->partitionValueFound = true;
+
+		return;
+	}
+
+	Datum minValue = newShardState->minPartitionValue;
+	int minComparison = DatumGetInt32(FunctionCall2Coll(rangeState->compareFunction,
+														rangeState->collation,
+														partitionValue, minValue));
+	if (minComparison < 0)
+	{
+		if (!rangeState->typeByValue)
+		{
+			pfree(DatumGetPointer(minValue));
+		}
+
+		newShardState->minPartitionValue = datumCopy(partitionValue,
+													 rangeState->typeByValue,
+													 rangeState->typeLength);
+	}
+
+	Datum maxValue = newShardState->maxPartitionValue;
+	int maxComparison = DatumGetInt32(FunctionCall2Coll(rangeState->compareFunction,
+														rangeState->collation,
+														partitionValue, maxValue));
+	if (maxComparison > 0)
+	{
+		if (!rangeState->typeByValue)
+		{
+			pfree(DatumGetPointer(maxValue));
+		}
+
+		newShardState->maxPartitionValue = datumCopy(partitionValue,
+													 rangeState->typeByValue,
+													 rangeState->typeLength);
+	}
+}
+
+
+/*
+ * CreateEmptyShard creates a new shard and related shard placements from the
+ * local master node.
+ */
+static int64
+CreateEmptyShard(char *relationName)
+{
+	text *relationNameText = cstring_to_text(relationName);
+	Datum relationNameDatum = PointerGetDatum(relationNameText);
+	Datum shardIdDatum = DirectFunctionCall1(master_create_empty_shard,
+											 relationNameDatum);
+	int64 shardId = DatumGetInt64(shardIdDatum);
+
+	return shardId;
+}
+
+
+/* *INDENT-OFF* */
 
 
 /*
@@ -2064,6 +2680,13 @@ CitusCopyDestReceiverStartup(DestReceiver *dest, int operation,
 {
 	CitusCopyDestReceiver *copyDest = (CitusCopyDestReceiver *) dest;
 
+	/* send buffered rows and DDL before the COPY opens its own connections */
+	FlushBufferedInserts();
+	FlushBufferedDDLCommands();
+
+	/* the connections of suspended cursors may be needed by the COPY */
+	FinishSuspendedStreamingExecutions();
+
 	bool isIntermediateResult = copyDest->intermediateResultIdPrefix != NULL;
 	copyDest->shouldUseLocalCopy = ShouldExecuteCopyLocally(isIntermediateResult);
 	Oid tableId = copyDest->distributedRelationId;
@@ -2133,6 +2756,12 @@ CitusCopyDestReceiverStartup(DestReceiver *dest, int operation,
 	 */
 	SerializeNonCommutativeWrites(shardIntervalList, RowExclusiveLock);
 
+	/* cached results of the shards become stale when the transaction ends */
+	if (!isIntermediateResult)
+	{
+		RecordModifiedShardIntervals(shardIntervalList);
+	}
+
 	/* keep the table metadata to avoid looking it up for every tuple */
 	copyDest->tableMetadata = cacheEntry;
 
@@ -2153,6 +2782,7 @@ CitusCopyDestReceiverStartup(DestReceiver *dest, int operation,
 	copyOutState->fe_msgbuf = makeStringInfo();
 	copyOutState->rowcontext = GetPerTupleMemoryContext(copyDest->executorState);
 	copyDest->copyOutState = copyOutState;
+	copyDest->rowData = makeStringInfo();
 	copyDest->multiShardCopy = false;
 
 	/* prepare functions to call on received tuples */
@@ -2222,6 +2852,8 @@ CitusCopyDestReceiverStartup(DestReceiver *dest, int operation,
 
 	copyDest->shardStateHash = CreateShardStateHash(TopTransactionContext);
 	copyDest->connectionStateHash = CreateConnectionStateHash(TopTransactionContext);
+	dlist_init(&copyDest->shardStateLruList);
+	copyDest->bufferedMemorySize = 0;
 
 	RecordRelationAccessIfReferenceTable(tableId, PLACEMENT_ACCESS_DML);
 }
@@ -2272,12 +2904,6 @@ CitusSendTupleToPlacements(TupleTableSlot *slot, CitusCopyDestReceiver *copyDest
 	CopyOutState copyOutState = copyDest->copyOutState;
 	FmgrInfo *columnOutputFunctions = copyDest->columnOutputFunctions;
 	CopyCoercionData *columnCoercionPaths = copyDest->columnCoercionPaths;
-	ListCell *placementStateCell = NULL;
-	bool cachedShardStateFound = false;
-	bool firstTupleInShard = false;
-
-	bool stopOnFailure = copyDest->stopOnFailure;
-
 
 	EState *executorState = copyDest->executorState;
 	MemoryContext executorTupleContext = GetPerTupleMemoryContext(executorState);
@@ -2293,18 +2919,128 @@ CitusSendTupleToPlacements(TupleTableSlot *slot, CitusCopyDestReceiver *copyDest
 	/* connections hash is kept in memory context */
 	MemoryContextSwitchTo(copyDest->memoryContext);
 
+	CopyShardState *shardState = GetCopyDestShardState(copyDest, shardId);
+
+	if (copyDest->shouldUseLocalCopy && shardState->containsLocalPlacement)
+	{
+		WriteTupleToLocalShard(slot, copyDest, shardId, shardState->copyOutState);
+	}
+
+	/*
+	 * Serialize the tuple once, rather than once for every placement. We write
+	 * into a separate buffer since starting and ending the COPY on a placement
+	 * reuses fe_msgbuf for the binary headers and footers.
+	 */
+	StringInfo rowData = copyDest->rowData;
+	if (shardState->placementStateList != NIL)
+	{
+		StringInfo messageBuffer = copyOutState->fe_msgbuf;
+
+		resetStringInfo(rowData);
+		copyOutState->fe_msgbuf = rowData;
+		AppendCopyRowData(columnValues, columnNulls, tupleDescriptor,
+						  copyOutState, columnOutputFunctions, columnCoercionPaths);
+		copyOutState->fe_msgbuf = messageBuffer;
+	}
+
+	SendRowDataToPlacements(copyDest, shardState, rowData);
+	RecordCopiedRow(shardState, rowData);
+
+	MemoryContextSwitchTo(oldContext);
+
+	copyDest->tuplesSent++;
+
+	/*
+	 * Release per tuple memory allocated in this function. If we're writing
+	 * the results of an INSERT ... SELECT then the SELECT execution will use
+	 * its own executor state and reset the per tuple expression context
+	 * separately.
+	 */
+	ResetPerTupleExprContext(executorState);
+
+	return true;
+}
+
+
+/*
+ * CitusCopyDestReceiverSendRawRow sends a row that is already serialized to
+ * the appropriate shard placement(s), similar to CitusCopyDestReceiverReceive.
+ */
+static void
+CitusCopyDestReceiverSendRawRow(CitusCopyDestReceiver *copyDest, Datum *columnValues,
+								bool *columnNulls, StringInfo rowData)
+{
+	PG_TRY();
+	{
+		CitusSendRawRowToPlacements(copyDest, columnValues, columnNulls, rowData);
+	}
+	PG_CATCH();
+	{
+		/*
+		 * We might be able to recover from errors with ROLLBACK TO SAVEPOINT,
+		 * so unclaim the connections before throwing errors.
+		 */
+		List *connectionStateList = ConnectionStateList(copyDest->connectionStateHash);
+		UnclaimCopyConnections(connectionStateList);
+
+		PG_RE_THROW();
+	}
+	PG_END_TRY();
+}
+
+
+/*
+ * CitusSendRawRowToPlacements sends a row that is already serialized in the
+ * COPY text format to the placements of the shard it belongs to. Only the
+ * partition column needs to be set in columnValues and columnNulls. The row
+ * must not go to a local placement that is copied into using local copy.
+ */
+static void
+CitusSendRawRowToPlacements(CitusCopyDestReceiver *copyDest, Datum *columnValues,
+							bool *columnNulls, StringInfo rowData)
+{
+	EState *executorState = copyDest->executorState;
+	MemoryContext executorTupleContext = GetPerTupleMemoryContext(executorState);
+	MemoryContext oldContext = MemoryContextSwitchTo(executorTupleContext);
+
+	int64 shardId = ShardIdForTuple(copyDest, columnValues, columnNulls);
+
+	/* connections hash is kept in memory context */
+	MemoryContextSwitchTo(copyDest->memoryContext);
+
+	CopyShardState *shardState = GetCopyDestShardState(copyDest, shardId);
+
+	Assert(!(copyDest->shouldUseLocalCopy && shardState->containsLocalPlacement));
+
+	SendRowDataToPlacements(copyDest, shardState, rowData);
+	RecordCopiedRow(shardState, rowData);
+
+	MemoryContextSwitchTo(oldContext);
+
+	copyDest->tuplesSent++;
+
+	ResetPerTupleExprContext(executorState);
+}
+
+
+/*
+ * GetCopyDestShardState returns the state of the given shard in the COPY,
+ * opening connections to its placements when the shard is seen for the first
+ * time.
+ */
+static CopyShardState *
+GetCopyDestShardState(CitusCopyDestReceiver *copyDest, int64 shardId)
+{
+	bool cachedShardStateFound = false;
+
 	CopyShardState *shardState = GetShardState(shardId, copyDest->shardStateHash,
 											   copyDest->connectionStateHash,
-											   stopOnFailure,
+											   copyDest->stopOnFailure,
 											   &cachedShardStateFound,
 											   copyDest->shouldUseLocalCopy,
 											   copyDest->copyOutState);
-	if (!cachedShardStateFound)
-	{
-		firstTupleInShard = true;
-	}
 
-	if (firstTupleInShard && !copyDest->multiShardCopy &&
+	if (!cachedShardStateFound && !copyDest->multiShardCopy &&
 		hash_get_num_entries(copyDest->shardStateHash) == 2)
 	{
 		Oid relationId = copyDest->distributedRelationId;
@@ -2319,26 +3055,106 @@ CitusSendTupleToPlacements(TupleTableSlot *slot, CitusCopyDestReceiver *copyDest
 		}
 	}
 
-	if (copyDest->shouldUseLocalCopy && shardState->containsLocalPlacement)
+	/* keep track of the order in which shards are used for eviction */
+	if (!cachedShardStateFound)
 	{
-		WriteTupleToLocalShard(slot, copyDest, shardId, shardState->copyOutState);
+		dlist_push_head(&copyDest->shardStateLruList, &shardState->lruNode);
+
+		/* look up the progress of the shard once, rows are counted per shard */
+		shardState->progressStep =
+			CommandProgressStepById(copyDest->progress, COMMAND_PROGRESS_STEP_SHARD,
+									shardId);
+	}
+	else
+	{
+		dlist_move_head(&copyDest->shardStateLruList, &shardState->lruNode);
+	}
+
+	return shardState;
+}
+
+
+/*
+ * StartCopyProgress creates a progress monitor for a COPY into the given
+ * distributed table with a step for every shard of the table, in which the
+ * rows sent to the shard are counted. It returns NULL if the progress of the
+ * COPY is not monitored.
+ */
+static CommandProgress *
+StartCopyProgress(Oid relationId)
+{
+	CitusTableCacheEntry *cacheEntry = GetCitusTableCacheEntry(relationId);
+	int shardCount = cacheEntry->shardIntervalArrayLength;
+
+	CommandProgress *progress = StartCommandProgress(COPY_PROGRESS_MAGIC_NUMBER,
+													 relationId, shardCount);
+	if (progress == NULL)
+	{
+		return NULL;
+	}
+
+	for (int shardIndex = 0; shardIndex < shardCount; shardIndex++)
+	{
+		CommandProgressStep *step = &progress->steps[shardIndex];
+
+		step->stepType = COMMAND_PROGRESS_STEP_SHARD;
+		step->stepId = cacheEntry->sortedShardIntervalArray[shardIndex]->shardId;
+	}
+
+	return progress;
+}
+
+
+/*
+ * RecordCopiedRow counts a row that was sent to the given shard in the
+ * progress of the COPY. Rows that only go to local placements are not
+ * serialized, and do not count towards the bytes sent.
+ */
+static void
+RecordCopiedRow(CopyShardState *shardState, StringInfo rowData)
+{
+	CommandProgressStep *step = shardState->progressStep;
+
+	if (step == NULL)
+	{
+		return;
+	}
+
+	step->rowCount++;
+
+	if (shardState->placementStateList != NIL)
+	{
+		step->byteCount += rowData->len;
 	}
+}
 
 
+/*
+ * SendRowDataToPlacements sends a serialized row to all remote placements of
+ * the shard, switching over the connections of the placements when needed.
+ */
+static void
+SendRowDataToPlacements(CitusCopyDestReceiver *copyDest, CopyShardState *shardState,
+						StringInfo rowData)
+{
+	CopyStmt *copyStatement = copyDest->copyStatement;
+	CopyOutState copyOutState = copyDest->copyOutState;
+	int64 shardId = shardState->shardId;
+	ListCell *placementStateCell = NULL;
+
 	foreach(placementStateCell, shardState->placementStateList)
 	{
 		CopyPlacementState *currentPlacementState = lfirst(placementStateCell);
 		CopyConnectionState *connectionState = currentPlacementState->connectionState;
 		CopyPlacementState *activePlacementState = connectionState->activePlacementState;
 		bool switchToCurrentPlacement = false;
-		bool sendTupleOverConnection = false;
 
 		if (activePlacementState == NULL)
 		{
 			switchToCurrentPlacement = true;
 		}
 		else if (currentPlacementState != activePlacementState &&
-				 currentPlacementState->data->len > COPY_SWITCH_OVER_THRESHOLD)
+				 currentPlacementState->data->len > CopySwitchOverThresholdBytes)
 		{
 			switchToCurrentPlacement = true;
 
@@ -2355,79 +3171,143 @@ CitusSendTupleToPlacements(TupleTableSlot *slot, CitusCopyDestReceiver *copyDest
 
 			dlist_delete(&currentPlacementState->bufferedPlacementNode);
 			connectionState->activePlacementState = currentPlacementState;
+		}
 
-			/* send previously buffered tuples */
-			SendCopyDataToPlacement(currentPlacementState->data, shardId,
-									connectionState->connection);
-			resetStringInfo(currentPlacementState->data);
+		/*
+		 * Buffer the tuple. For the active placement we send the buffered
+		 * tuples, including the ones from before it became active, once the
+		 * batch is large enough. The rest is sent when the COPY ends.
+		 */
+		int previousBufferSize = currentPlacementState->data->maxlen;
 
-			/* additionaly, we need to send the current tuple too */
-			sendTupleOverConnection = true;
-		}
-		else if (currentPlacementState != activePlacementState)
-		{
-			/* buffer data */
-			StringInfo copyBuffer = copyOutState->fe_msgbuf;
-			resetStringInfo(copyBuffer);
-			AppendCopyRowData(columnValues, columnNulls, tupleDescriptor,
-							  copyOutState, columnOutputFunctions,
-							  columnCoercionPaths);
-			appendBinaryStringInfo(currentPlacementState->data, copyBuffer->data,
-								   copyBuffer->len);
-		}
-		else
-		{
-			Assert(currentPlacementState == activePlacementState);
-			sendTupleOverConnection = true;
-		}
+		appendBinaryStringInfo(currentPlacementState->data, rowData->data,
+							   rowData->len);
 
-		if (sendTupleOverConnection)
+		copyDest->bufferedMemorySize +=
+			currentPlacementState->data->maxlen - previousBufferSize;
+
+		if (currentPlacementState == connectionState->activePlacementState &&
+			(switchToCurrentPlacement ||
+			 currentPlacementState->data->len >= COPY_SEND_BATCH_THRESHOLD))
 		{
-			resetStringInfo(copyOutState->fe_msgbuf);
-			AppendCopyRowData(columnValues, columnNulls, tupleDescriptor,
-							  copyOutState, columnOutputFunctions, columnCoercionPaths);
-			SendCopyDataToPlacement(copyOutState->fe_msgbuf, shardId,
+			SendCopyDataToPlacement(currentPlacementState->data, shardId,
 									connectionState->connection);
+			resetStringInfo(currentPlacementState->data);
 		}
 	}
 
-	MemoryContextSwitchTo(oldContext);
-
-	copyDest->tuplesSent++;
-
-	/*
-	 * Release per tuple memory allocated in this function. If we're writing
-	 * the results of an INSERT ... SELECT then the SELECT execution will use
-	 * its own executor state and reset the per tuple expression context
-	 * separately.
-	 */
-	ResetPerTupleExprContext(executorState);
-
-	return true;
+	if (CopyMemoryLimit > 0 &&
+		copyDest->bufferedMemorySize > (uint64) CopyMemoryLimit * 1024L)
+	{
+		EvictCopyShardStates(copyDest);
+	}
 }
 
 
 /*
- * ContainsLocalPlacement returns true if the current node has
- * a local placement for the given shard id.
+ * EvictCopyShardStates sends the rows buffered for the least recently used
+ * shards and releases their buffers, until the placement buffers use at most
+ * half of citus.copy_memory_limit.
  */
-static bool
-ContainsLocalPlacement(int64 shardId)
+static void
+EvictCopyShardStates(CitusCopyDestReceiver *copyDest)
 {
-	ListCell *placementCell = NULL;
-	List *activePlacementList = ActiveShardPlacementList(shardId);
-	int32 localGroupId = GetLocalGroupId();
+	uint64 targetMemorySize = (uint64) CopyMemoryLimit * 1024L / 2;
+	dlist_iter iter;
 
-	foreach(placementCell, activePlacementList)
+	dlist_reverse_foreach(iter, &copyDest->shardStateLruList)
 	{
-		ShardPlacement *placement = (ShardPlacement *) lfirst(placementCell);
+		CopyShardState *shardState =
+			dlist_container(CopyShardState, lruNode, iter.cur);
 
-		if (placement->groupId == localGroupId)
+		ReleaseShardStateBuffers(copyDest, shardState);
+
+		if (copyDest->bufferedMemorySize <= targetMemorySize)
 		{
-			return true;
+			break;
 		}
 	}
-	return false;
+}
+
+
+/*
+ * ReleaseShardStateBuffers sends the rows that are buffered for the placements
+ * of the given shard and shrinks their buffers back to the initial size. When
+ * a placement is not the active placement of its connection, the connection
+ * switches over to it, ending the COPY of the shard that was active.
+ */
+static void
+ReleaseShardStateBuffers(CitusCopyDestReceiver *copyDest, CopyShardState *shardState)
+{
+	CopyStmt *copyStatement = copyDest->copyStatement;
+	CopyOutState copyOutState = copyDest->copyOutState;
+	int64 shardId = shardState->shardId;
+	ListCell *placementStateCell = NULL;
+
+	foreach(placementStateCell, shardState->placementStateList)
+	{
+		CopyPlacementState *placementState = lfirst(placementStateCell);
+		CopyConnectionState *connectionState = placementState->connectionState;
+		CopyPlacementState *activePlacementState = connectionState->activePlacementState;
+		StringInfo data = placementState->data;
+		int previousBufferSize = data->maxlen;
+
+		if (previousBufferSize <= COPY_PLACEMENT_BUFFER_INITIAL_SIZE)
+		{
+			/* buffer has not grown, nothing to release */
+			continue;
+		}
+
+		if (data->len > 0 && placementState != activePlacementState)
+		{
+			if (activePlacementState != NULL)
+			{
+				EndPlacementStateCopyCommand(activePlacementState, copyOutState);
+				dlist_push_head(&connectionState->bufferedPlacementList,
+								&activePlacementState->bufferedPlacementNode);
+			}
+
+			StartPlacementStateCopyCommand(placementState, copyStatement,
+										   copyOutState);
+
+			dlist_delete(&placementState->bufferedPlacementNode);
+			connectionState->activePlacementState = placementState;
+		}
+
+		if (data->len > 0)
+		{
+			SendCopyDataToPlacement(data, shardId, connectionState->connection);
+		}
+
+		pfree(data->data);
+		initStringInfo(data);
+
+		copyDest->bufferedMemorySize -= previousBufferSize - data->maxlen;
+	}
+}
+
+
+/*
+ * ContainsLocalPlacement returns true if the current node has
+ * a local placement for the given shard id.
+ */
+static bool
+ContainsLocalPlacement(int64 shardId)
+{
+	ListCell *placementCell = NULL;
+	List *activePlacementList = ActiveShardPlacementList(shardId);
+	int32 localGroupId = GetLocalGroupId();
+
+	foreach(placementCell, activePlacementList)
+	{
+		ShardPlacement *placement = (ShardPlacement *) lfirst(placementCell);
+
+		if (placement->groupId == localGroupId)
+		{
+			return true;
+		}
+	}
+	return false;
 }
 
 
@@ -2581,12 +3461,9 @@ ShutdownCopyConnectionState(CopyConnectionState *connectionState,
 	{
 		CopyPlacementState *placementState =
 			dlist_container(CopyPlacementState, bufferedPlacementNode, iter.cur);
-		uint64 shardId = placementState->shardState->shardId;
 
 		StartPlacementStateCopyCommand(placementState, copyStatement,
 									   copyOutState);
-		SendCopyDataToPlacement(placementState->data, shardId,
-								connectionState->connection);
 		EndPlacementStateCopyCommand(placementState, copyOutState);
 	}
 }
@@ -2641,6 +3518,42 @@ IsCopyResultStmt(CopyStmt *copyStatement)
 }
 
 
+/*
+ * CopyResultStmtIsCompressed determines whether the given COPY ... WITH
+ * (format result) statement has the compression pglz option, meaning that the
+ * data is sent in compressed frames.
+ */
+static bool
+CopyResultStmtIsCompressed(CopyStmt *copyStatement)
+{
+	ListCell *optionCell = NULL;
+	bool isCompressed = false;
+
+	foreach(optionCell, copyStatement->options)
+	{
+		DefElem *defel = (DefElem *) lfirst(optionCell);
+
+		if (strncmp(defel->defname, "compression", NAMEDATALEN) == 0)
+		{
+			char *compressionName = defGetString(defel);
+
+			if (strncmp(compressionName, "pglz", NAMEDATALEN) == 0)
+			{
+				isCompressed = true;
+			}
+			else if (strncmp(compressionName, "none", NAMEDATALEN) != 0)
+			{
+				ereport(ERROR, (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+								errmsg("unsupported COPY compression \"%s\"",
+									   compressionName)));
+			}
+		}
+	}
+
+	return isCompressed;
+}
+
+
 /*
  * CopyStatementHasFormat checks whether the COPY statement has the given
  * format.
@@ -2684,14 +3597,15 @@ ProcessCopyStmt(CopyStmt *copyStatement, char *completionTag, const char *queryS
 	if (IsCopyResultStmt(copyStatement))
 	{
 		const char *resultId = copyStatement->relation->relname;
+		bool isCompressed = CopyResultStmtIsCompressed(copyStatement);
 
 		if (copyStatement->is_from)
 		{
-			ReceiveQueryResultViaCopy(resultId);
+			ReceiveQueryResultViaCopy(resultId, isCompressed);
 		}
 		else
 		{
-			SendQueryResultViaCopy(resultId);
+			SendQueryResultViaCopy(resultId, isCompressed);
 		}
 
 		return NULL;
@@ -2762,215 +3676,1240 @@ ProcessCopyStmt(CopyStmt *copyStatement, char *completionTag, const char *queryS
 				SelectStmt *selectStmt = makeNode(SelectStmt);
 				ResTarget *selectTarget = makeNode(ResTarget);
 
-				allColumns->fields = list_make1(makeNode(A_Star));
-				allColumns->location = -1;
+				allColumns->fields = list_make1(makeNode(A_Star));
+				allColumns->location = -1;
+
+				selectTarget->name = NULL;
+				selectTarget->indirection = NIL;
+				selectTarget->val = (Node *) allColumns;
+				selectTarget->location = -1;
+
+				selectStmt->targetList = list_make1(selectTarget);
+				selectStmt->fromClause = list_make1(copyObject(copyStatement->relation));
+
+				/* replace original statement */
+				copyStatement = copyObject(copyStatement);
+				copyStatement->relation = NULL;
+				copyStatement->query = (Node *) selectStmt;
+			}
+		}
+	}
+
+	/*
+	 * COPY (SELECT ..) TO STDOUT forwards the COPY output of the workers when
+	 * the rows of the tasks only need to be concatenated.
+	 */
+	if (copyStatement->query != NULL && !copyStatement->is_from &&
+		copyStatement->filename == NULL && !copyStatement->is_program)
+	{
+		if (CitusCopySelectTo(copyStatement, queryString, completionTag))
+		{
+			return NULL;
+		}
+	}
+
+
+	if (copyStatement->filename != NULL && !copyStatement->is_program)
+	{
+		char *filename = copyStatement->filename;
+
+		/*
+		 * We execute COPY commands issued by the task-tracker executor here
+		 * because we're not normally allowed to write to a file as a regular
+		 * user and we don't want to execute the query as superuser.
+		 */
+		if (CacheDirectoryElement(filename) && copyStatement->query != NULL &&
+			!copyStatement->is_from && !is_absolute_path(filename))
+		{
+			bool binaryCopyFormat = CopyStatementHasFormat(copyStatement, "binary");
+			Query *query = NULL;
+			Node *queryNode = copyStatement->query;
+			StringInfo userFilePath = makeStringInfo();
+
+			RawStmt *rawStmt = makeNode(RawStmt);
+			rawStmt->stmt = queryNode;
+
+			List *queryTreeList = pg_analyze_and_rewrite(rawStmt, queryString, NULL, 0,
+														 NULL);
+
+			if (list_length(queryTreeList) != 1)
+			{
+				ereport(ERROR, (errmsg("can only execute a single query")));
+			}
+
+			query = (Query *) linitial(queryTreeList);
+
+			/*
+			 * Add a user ID suffix to prevent other users from reading/writing
+			 * the same file. We do this consistently in all functions that interact
+			 * with task files.
+			 */
+			appendStringInfo(userFilePath, "%s.%u", filename, GetUserId());
+
+			int64 tuplesSent = WorkerExecuteSqlTask(query, filename, binaryCopyFormat);
+
+			SafeSnprintf(completionTag, COMPLETION_TAG_BUFSIZE,
+						 "COPY " UINT64_FORMAT, tuplesSent);
+
+			return NULL;
+		}
+	}
+
+
+	return (Node *) copyStatement;
+}
+
+
+/*
+ * CitusCopyTo runs a COPY .. TO STDOUT command on each shard to do a full
+ * table dump.
+ */
+static void
+CitusCopyTo(CopyStmt *copyStatement, char *completionTag)
+{
+	ListCell *shardIntervalCell = NULL;
+	int64 tuplesSent = 0;
+
+	Relation distributedRelation = heap_openrv(copyStatement->relation, AccessShareLock);
+	Oid relationId = RelationGetRelid(distributedRelation);
+	TupleDesc tupleDescriptor = RelationGetDescr(distributedRelation);
+
+	CopyOutState copyOutState = (CopyOutState) palloc0(sizeof(CopyOutStateData));
+	copyOutState->fe_msgbuf = makeStringInfo();
+	copyOutState->binary = false;
+	copyOutState->attnumlist = CopyGetAttnums(tupleDescriptor, distributedRelation,
+											  copyStatement->attlist);
+
+	SendCopyBegin(copyOutState);
+
+	List *shardIntervalList = LoadShardIntervalList(relationId);
+
+	foreach(shardIntervalCell, shardIntervalList)
+	{
+		ShardInterval *shardInterval = lfirst(shardIntervalCell);
+		List *shardPlacementList = ActiveShardPlacementList(shardInterval->shardId);
+		ListCell *shardPlacementCell = NULL;
+		int placementIndex = 0;
+
+		StringInfo copyCommand = ConstructCopyStatement(copyStatement,
+														shardInterval->shardId);
+
+		foreach(shardPlacementCell, shardPlacementList)
+		{
+			ShardPlacement *shardPlacement = lfirst(shardPlacementCell);
+			int connectionFlags = 0;
+			char *userName = NULL;
+			const bool raiseErrors = true;
+
+			MultiConnection *connection = GetPlacementConnection(connectionFlags,
+																 shardPlacement,
+																 userName);
+
+			if (placementIndex == list_length(shardPlacementList) - 1)
+			{
+				/* last chance for this shard */
+				MarkRemoteTransactionCritical(connection);
+			}
+
+			if (PQstatus(connection->pgConn) != CONNECTION_OK)
+			{
+				HandleRemoteTransactionConnectionError(connection, raiseErrors);
+				continue;
+			}
+
+			RemoteTransactionBeginIfNecessary(connection);
+
+			if (!SendRemoteCommand(connection, copyCommand->data))
+			{
+				HandleRemoteTransactionConnectionError(connection, raiseErrors);
+				continue;
+			}
+
+			PGresult *result = GetRemoteCommandResult(connection, raiseErrors);
+			if (PQresultStatus(result) != PGRES_COPY_OUT)
+			{
+				ReportResultError(connection, result, ERROR);
+			}
+
+			PQclear(result);
+
+			tuplesSent += ForwardCopyDataFromConnection(copyOutState, connection);
+			break;
+		}
+
+		if (shardIntervalCell == list_head(shardIntervalList))
+		{
+			/* remove header after the first shard */
+			RemoveOptionFromList(copyStatement->options, "header");
+		}
+	}
+
+	SendCopyEnd(copyOutState);
+
+	heap_close(distributedRelation, AccessShareLock);
+
+	if (completionTag != NULL)
+	{
+		SafeSnprintf(completionTag, COMPLETION_TAG_BUFSIZE, "COPY " UINT64_FORMAT,
+					 tuplesSent);
+	}
+}
+
+
+/*
+ * ForwardCopyDataFromConnection forwards copy data received over the given connection
+ * to the client or file descriptor.
+ */
+static int64
+ForwardCopyDataFromConnection(CopyOutState copyOutState, MultiConnection *connection)
+{
+	char *receiveBuffer = NULL;
+	const int useAsync = 0;
+	bool raiseErrors = true;
+	int64 tuplesSent = 0;
+
+	/* receive copy data message in a synchronous manner */
+	int receiveLength = PQgetCopyData(connection->pgConn, &receiveBuffer, useAsync);
+	while (receiveLength > 0)
+	{
+		bool includeEndOfLine = false;
+
+		CopySendData(copyOutState, receiveBuffer, receiveLength);
+		CopySendEndOfRow(copyOutState, includeEndOfLine);
+		tuplesSent++;
+
+		PQfreemem(receiveBuffer);
+
+		receiveLength = PQgetCopyData(connection->pgConn, &receiveBuffer, useAsync);
+	}
+
+	if (receiveLength != -1)
+	{
+		ReportConnectionError(connection, ERROR);
+	}
+
+	PGresult *result = GetRemoteCommandResult(connection, raiseErrors);
+	if (!IsResponseOK(result))
+	{
+		ReportResultError(connection, result, ERROR);
+	}
+
+	PQclear(result);
+	ClearResults(connection, raiseErrors);
+
+	return tuplesSent;
+}
+
+
+/*
+ * CitusCopySelectTo handles COPY (SELECT ..) TO STDOUT when the query is a
+ * distributed query whose result is the concatenation of the rows of its
+ * tasks. Each task then runs as a COPY on the workers, over multiple
+ * connections per worker, and their output is forwarded to the client as it
+ * arrives, without parsing and formatting the rows on the coordinator. The
+ * function returns false if the query does not qualify, in which case the
+ * COPY is left to postgres, which runs the query through the executor.
+ */
+static bool
+CitusCopySelectTo(CopyStmt *copyStatement, const char *queryString, char *completionTag)
+{
+	if (!EnableCopySelectForwarding || copyStatement->attlist != NIL)
+	{
+		return false;
+	}
+
+	/*
+	 * The tasks run over connections that are not part of a coordinated
+	 * transaction, so they should not see a different state than the
+	 * connections that were used in the transaction so far.
+	 */
+	if (IsMultiStatementTransaction() || InCoordinatedTransaction())
+	{
+		return false;
+	}
+
+	RawStmt *rawStmt = makeNode(RawStmt);
+	rawStmt->stmt = copyObject(copyStatement->query);
+
+	List *queryTreeList = pg_analyze_and_rewrite(rawStmt, queryString, NULL, 0, NULL);
+	if (list_length(queryTreeList) != 1)
+	{
+		return false;
+	}
+
+	Query *query = (Query *) linitial(queryTreeList);
+	if (query->commandType != CMD_SELECT || query->utilityStmt != NULL ||
+		query->rowMarks != NIL || !NeedsDistributedPlanning(query))
+	{
+		return false;
+	}
+
+	PlannedStmt *plannedStmt = pg_plan_query(query, CURSOR_OPT_PARALLEL_OK, NULL);
+
+	List *taskList = ForwardableCopySelectTaskList(plannedStmt);
+	if (taskList == NIL)
+	{
+		return false;
+	}
+
+	/*
+	 * The tasks do not read from a distributed snapshot, so we leave queries
+	 * that should to the executor.
+	 */
+	if (ShouldEstablishDistributedSnapshot(ROW_MODIFY_READONLY, taskList, false))
+	{
+		return false;
+	}
+
+	/* the range table includes the original range table for permission checks */
+	ExecCheckRTPerms(plannedStmt->rtable, true);
+
+	int columnCount = list_length(plannedStmt->planTree->targetlist);
+	uint64 tuplesSent = ForwardCopySelectTaskResults(copyStatement, taskList,
+													 columnCount);
+
+	if (completionTag != NULL)
+	{
+		SafeSnprintf(completionTag, COMPLETION_TAG_BUFSIZE, "COPY " UINT64_FORMAT,
+					 tuplesSent);
+	}
+
+	return true;
+}
+
+
+/*
+ * ForwardableCopySelectTaskList returns the tasks of the given plan if the
+ * plan is a distributed plan that only concatenates the rows of its tasks,
+ * and all tasks are read-only queries on remote placements. Otherwise, it
+ * returns NIL.
+ */
+static List *
+ForwardableCopySelectTaskList(PlannedStmt *plannedStmt)
+{
+	Plan *plan = plannedStmt->planTree;
+	ListCell *targetEntryCell = NULL;
+	ListCell *taskCell = NULL;
+	int workerColumnCount = 0;
+
+	/* anything on top of the distributed scan needs to see the rows */
+	if (!IsCitusCustomScan(plan) || plan->qual != NIL)
+	{
+		return NIL;
+	}
+
+	DistributedPlan *distributedPlan = GetDistributedPlan((CustomScan *) plan);
+	if (distributedPlan->modLevel != ROW_MODIFY_READONLY ||
+		distributedPlan->insertSelectQuery != NULL ||
+		distributedPlan->subPlanList != NIL ||
+		distributedPlan->planningError != NULL)
+	{
+		return NIL;
+	}
+
+	Job *workerJob = distributedPlan->workerJob;
+	if (workerJob == NULL || workerJob->jobQuery == NULL ||
+		workerJob->dependentJobList != NIL || workerJob->deferredPruning ||
+		workerJob->taskPruningQualList != NIL || workerJob->taskList == NIL)
+	{
+		return NIL;
+	}
+
+	/* the scan needs to return the columns of the tasks as they are */
+	foreach(targetEntryCell, workerJob->jobQuery->targetList)
+	{
+		TargetEntry *targetEntry = (TargetEntry *) lfirst(targetEntryCell);
+
+		if (!targetEntry->resjunk)
+		{
+			workerColumnCount++;
+		}
+	}
+
+	if (workerColumnCount != list_length(plan->targetlist))
+	{
+		return NIL;
+	}
+
+	foreach(targetEntryCell, plan->targetlist)
+	{
+		TargetEntry *targetEntry = (TargetEntry *) lfirst(targetEntryCell);
+		Var *column = (Var *) targetEntry->expr;
+
+		if (targetEntry->resjunk || !IsA(column, Var) ||
+			column->varattno != targetEntry->resno)
+		{
+			return NIL;
+		}
+	}
+
+	foreach(taskCell, workerJob->taskList)
+	{
+		Task *task = (Task *) lfirst(taskCell);
+
+		if (task->taskType != SELECT_TASK || task->taskPlacementList == NIL ||
+			TaskAccessesLocalNode(task))
+		{
+			return NIL;
+		}
+	}
+
+	return workerJob->taskList;
+}
+
+
+/*
+ * ForwardCopySelectTaskResults runs a COPY .. TO STDOUT for each of the given
+ * tasks on the node of its first placement and forwards the output to the
+ * client, and returns the number of rows sent. The streams of a node take the
+ * next task of the node when their COPY is done, such that large results do
+ * not hold up the others.
+ *
+ * For the csv header, the COPY of the first task is started before the others
+ * and its header line is forwarded first. For the binary format, the header
+ * and trailer are sent once and skipped in the output of the tasks. A task
+ * whose COPY fails before any of its rows were sent is retried on its next
+ * placement, and a node whose connection failed gets no more tasks.
+ */
+static uint64
+ForwardCopySelectTaskResults(CopyStmt *copyStatement, List *taskList, int columnCount)
+{
+	bool binaryFormat = CopyStatementHasFormat(copyStatement, "binary");
+	bool hasHeader = CopyStatementHasHeader(copyStatement);
+	ListCell *taskCell = NULL;
+	ListCell *streamCell = NULL;
+
+	/* only the first task sends the header line */
+	List *optionList = CopySelectTaskOptionList(copyStatement);
+	List *headerOptionList = optionList;
+	optionList = RemoveOptionFromList(list_copy(optionList), "header");
+
+	CopyOutState copyOutState = (CopyOutState) palloc0(sizeof(CopyOutStateData));
+	copyOutState->fe_msgbuf = makeStringInfo();
+	copyOutState->binary = binaryFormat;
+	copyOutState->rowcontext = CurrentMemoryContext;
+
+	for (int columnIndex = 0; columnIndex < columnCount; columnIndex++)
+	{
+		copyOutState->attnumlist = lappend_int(copyOutState->attnumlist,
+											   columnIndex + 1);
+	}
+
+	CopySelectExecution *execution = palloc0(sizeof(CopySelectExecution));
+	execution->copyOutState = copyOutState;
+	execution->rebuildWaitEventSet = true;
+
+	foreach(taskCell, CopySelectTaskList(taskList))
+	{
+		CopySelectTask *copySelectTask = (CopySelectTask *) lfirst(taskCell);
+
+		AssignCopySelectTask(execution, copySelectTask);
+	}
+
+	OpenCopySelectStreams(execution);
+
+	SendCopyBegin(copyOutState);
+
+	if (binaryFormat)
+	{
+		AppendCopyBinaryHeaders(copyOutState);
+		CopySendEndOfRow(copyOutState, false);
+	}
+
+	if (hasHeader)
+	{
+		ForwardCopySelectHeader(execution, headerOptionList);
+	}
+
+	int eventSetSize = 0;
+	WaitEvent *events = NULL;
+	WaitEventSet *waitEventSet = NULL;
+
+	while (true)
+	{
+		/*
+		 * The output of a COPY that we just started may already be buffered
+		 * by libpq, so we read it before waiting on the sockets.
+		 */
+		bool madeProgress = false;
+		bool hasRunningTasks = false;
+
+		/* tasks of failed nodes may have moved to nodes without streams */
+		OpenCopySelectStreams(execution);
+
+		foreach(streamCell, execution->streamList)
+		{
+			CopySelectStream *stream = (CopySelectStream *) lfirst(streamCell);
+
+			if (stream->connection != NULL && stream->task == NULL &&
+				StartNextCopySelectTask(execution, stream, optionList))
+			{
+				madeProgress = true;
+			}
+
+			if (stream->connection == NULL || stream->task == NULL)
+			{
+				continue;
+			}
+
+			if (ForwardCopySelectStreamData(execution, stream))
+			{
+				madeProgress = true;
+			}
+			else
+			{
+				hasRunningTasks = true;
+			}
+		}
+
+		if (madeProgress)
+		{
+			continue;
+		}
+		else if (!hasRunningTasks)
+		{
+			break;
+		}
+
+		if (execution->rebuildWaitEventSet)
+		{
+			if (waitEventSet != NULL)
+			{
+				FreeWaitEventSet(waitEventSet);
+				pfree(events);
+			}
+
+			/* additional events for the latch and postmaster death */
+			eventSetSize = list_length(execution->streamList) + 2;
+			events = palloc0(eventSetSize * sizeof(WaitEvent));
+			waitEventSet = BuildCopySelectWaitEventSet(execution->streamList);
+			execution->rebuildWaitEventSet = false;
+		}
+
+		SetCitusWaitState(CITUS_WAIT_COPY);
+		int eventCount = WaitEventSetWait(waitEventSet, -1, events, eventSetSize,
+										  PG_WAIT_EXTENSION);
+		SetCitusWaitState(CITUS_WAIT_NONE);
+
+		for (int eventIndex = 0; eventIndex < eventCount; eventIndex++)
+		{
+			WaitEvent *event = &events[eventIndex];
+
+			if (event->events & WL_POSTMASTER_DEATH)
+			{
+				ereport(ERROR, (errmsg("postmaster was shut down, exiting")));
+			}
+
+			if (event->events & WL_LATCH_SET)
+			{
+				ResetLatch(MyLatch);
+				CHECK_FOR_INTERRUPTS();
+			}
+		}
+	}
+
+	if (waitEventSet != NULL)
+	{
+		FreeWaitEventSet(waitEventSet);
+	}
+
+	if (binaryFormat)
+	{
+		AppendCopyBinaryFooters(copyOutState);
+		CopySendEndOfRow(copyOutState, false);
+	}
+
+	SendCopyEnd(copyOutState);
+
+	foreach(streamCell, execution->streamList)
+	{
+		CopySelectStream *stream = (CopySelectStream *) lfirst(streamCell);
+
+		if (stream->connection != NULL)
+		{
+			UnclaimConnection(stream->connection);
+		}
+	}
+
+	return execution->tuplesSent;
+}
+
+
+/*
+ * CopySelectTaskOptionList returns the options for the COPY commands of the
+ * tasks. Text output is converted to the client encoding by the workers,
+ * unless the COPY specifies an encoding.
+ */
+static List *
+CopySelectTaskOptionList(CopyStmt *copyStatement)
+{
+	List *optionList = list_copy(copyStatement->options);
+	ListCell *optionCell = NULL;
+
+	if (CopyStatementHasFormat(copyStatement, "binary"))
+	{
+		return optionList;
+	}
+
+	foreach(optionCell, optionList)
+	{
+		DefElem *defel = (DefElem *) lfirst(optionCell);
+
+		if (strncmp(defel->defname, "encoding", NAMEDATALEN) == 0)
+		{
+			return optionList;
+		}
+	}
+
+	const char *clientEncoding = pg_encoding_to_char(pg_get_client_encoding());
+	DefElem *encodingOption = makeDefElem("encoding",
+										  (Node *) makeString(pstrdup(clientEncoding)),
+										  -1);
+
+	return lappend(optionList, encodingOption);
+}
+
+
+/*
+ * CopyStatementHasHeader returns whether the COPY statement asks for a header
+ * line.
+ */
+static bool
+CopyStatementHasHeader(CopyStmt *copyStatement)
+{
+	ListCell *optionCell = NULL;
+
+	foreach(optionCell, copyStatement->options)
+	{
+		DefElem *defel = (DefElem *) lfirst(optionCell);
+
+		if (strncmp(defel->defname, "header", NAMEDATALEN) == 0)
+		{
+			return defGetBoolean(defel);
+		}
+	}
+
+	return false;
+}
+
+
+/*
+ * CopySelectTaskList returns a CopySelectTask for each of the given tasks.
+ * The planner orders the placements of single shard queries by the task
+ * assignment policy, and we do the same for the tasks of multi-shard
+ * queries.
+ */
+static List *
+CopySelectTaskList(List *taskList)
+{
+	List *copySelectTaskList = NIL;
+	ListCell *taskCell = NULL;
+
+	foreach(taskCell, taskList)
+	{
+		Task *task = (Task *) lfirst(taskCell);
+		List *placementList = list_copy(task->taskPlacementList);
+
+		if (list_length(taskList) > 1)
+		{
+			if (TaskAssignmentPolicy == TASK_ASSIGNMENT_ROUND_ROBIN)
+			{
+				placementList = RoundRobinReorder(task, placementList);
+			}
+			else if (TaskAssignmentPolicy == TASK_ASSIGNMENT_LOCALITY)
+			{
+				placementList = LocalityReorder(task, placementList);
+			}
+		}
+
+		CopySelectTask *copySelectTask = palloc0(sizeof(CopySelectTask));
+		copySelectTask->task = task;
+		copySelectTask->placementList = placementList;
+
+		copySelectTaskList = lappend(copySelectTaskList, copySelectTask);
+	}
+
+	return copySelectTaskList;
+}
+
+
+/*
+ * AssignCopySelectTask adds the task to the pending tasks of the node of its
+ * next placement that is not on a failed node, and removes the placements it
+ * skipped from the placements of the task.
+ */
+static void
+AssignCopySelectTask(CopySelectExecution *execution, CopySelectTask *copySelectTask)
+{
+	while (copySelectTask->placementList != NIL)
+	{
+		ShardPlacement *placement =
+			(ShardPlacement *) linitial(copySelectTask->placementList);
+		copySelectTask->placementList =
+			list_delete_first(copySelectTask->placementList);
+
+		CopySelectNode *node = FindCopySelectNode(execution->nodeList,
+												  placement->nodeName,
+												  placement->nodePort);
+		if (node == NULL)
+		{
+			node = palloc0(sizeof(CopySelectNode));
+			node->nodeName = placement->nodeName;
+			node->nodePort = placement->nodePort;
+
+			execution->nodeList = lappend(execution->nodeList, node);
+		}
+		else if (node->failed)
+		{
+			continue;
+		}
+
+		node->pendingTaskList = lappend(node->pendingTaskList, copySelectTask);
+		return;
+	}
+
+	ereport(ERROR, (errmsg("failed to execute task %u",
+						   copySelectTask->task->taskId)));
+}
+
+
+/*
+ * CanRetryCopySelectTask returns whether the task has a placement left that
+ * is not on a failed node.
+ */
+static bool
+CanRetryCopySelectTask(CopySelectExecution *execution, CopySelectTask *copySelectTask)
+{
+	ListCell *placementCell = NULL;
+
+	foreach(placementCell, copySelectTask->placementList)
+	{
+		ShardPlacement *placement = (ShardPlacement *) lfirst(placementCell);
+		CopySelectNode *node = FindCopySelectNode(execution->nodeList,
+												  placement->nodeName,
+												  placement->nodePort);
+
+		if (node == NULL || !node->failed)
+		{
+			return true;
+		}
+	}
+
+	return false;
+}
+
+
+/*
+ * CanRetryCopySelectNodeTasks returns whether all tasks that are pending on
+ * the given node can be retried on other nodes.
+ */
+static bool
+CanRetryCopySelectNodeTasks(CopySelectExecution *execution, CopySelectNode *node)
+{
+	ListCell *taskCell = NULL;
+
+	foreach(taskCell, node->pendingTaskList)
+	{
+		CopySelectTask *copySelectTask = (CopySelectTask *) lfirst(taskCell);
+
+		if (!CanRetryCopySelectTask(execution, copySelectTask))
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+
+/*
+ * ReassignCopySelectNodeTasks moves the pending tasks of a failed node to
+ * the nodes of their next placements.
+ */
+static void
+ReassignCopySelectNodeTasks(CopySelectExecution *execution, CopySelectNode *node)
+{
+	List *pendingTaskList = node->pendingTaskList;
+	ListCell *taskCell = NULL;
+
+	node->pendingTaskList = NIL;
+
+	foreach(taskCell, pendingTaskList)
+	{
+		CopySelectTask *copySelectTask = (CopySelectTask *) lfirst(taskCell);
+
+		AssignCopySelectTask(execution, copySelectTask);
+	}
+}
+
+
+/*
+ * OpenCopySelectStreams opens up to citus.max_adaptive_executor_pool_size
+ * connections to each node that has pending tasks and no streams yet, and
+ * adds a stream for each connection. The tasks of a node are shared by its
+ * streams. Beyond the first connection to a node, only connection slots that
+ * are available are used. If connecting to a node fails, its tasks move to
+ * their next placements.
+ */
+static void
+OpenCopySelectStreams(CopySelectExecution *execution)
+{
+	bool reassignedTasks = true;
+
+	while (reassignedTasks)
+	{
+		List *newStreamList = NIL;
+		List *connectionList = NIL;
+		ListCell *nodeCell = NULL;
+		ListCell *streamCell = NULL;
+
+		reassignedTasks = false;
+
+		foreach(nodeCell, execution->nodeList)
+		{
+			CopySelectNode *node = (CopySelectNode *) lfirst(nodeCell);
+
+			if (node->streamsOpened || node->failed || node->pendingTaskList == NIL)
+			{
+				continue;
+			}
+
+			int connectionCount = Min(list_length(node->pendingTaskList),
+									  MaxAdaptiveExecutorPoolSize);
+			node->streamsOpened = true;
+
+			for (int connectionIndex = 0; connectionIndex < connectionCount;
+				 connectionIndex++)
+			{
+				int connectionFlags = (connectionIndex == 0) ? 0 : OPTIONAL_CONNECTION;
+
+				MultiConnection *connection = StartNodeConnection(connectionFlags,
+																  node->nodeName,
+																  node->nodePort);
+				if (connection == NULL)
+				{
+					break;
+				}
+
+				/* make sure the next connection to the node is a different one */
+				ClaimConnectionExclusively(connection);
+
+				CopySelectStream *stream = palloc0(sizeof(CopySelectStream));
+				stream->node = node;
+				stream->connection = connection;
+
+				newStreamList = lappend(newStreamList, stream);
+				connectionList = lappend(connectionList, connection);
+			}
+		}
+
+		FinishConnectionListEstablishment(connectionList);
+
+		foreach(streamCell, newStreamList)
+		{
+			CopySelectStream *stream = (CopySelectStream *) lfirst(streamCell);
+			CopySelectNode *node = stream->node;
+			MultiConnection *connection = stream->connection;
+
+			if (PQstatus(connection->pgConn) == CONNECTION_OK || node->failed)
+			{
+				continue;
+			}
+
+			node->failed = true;
+
+			int elevel = CanRetryCopySelectNodeTasks(execution, node) ? WARNING : ERROR;
+			ReportConnectionError(connection, elevel);
+
+			ReassignCopySelectNodeTasks(execution, node);
+			reassignedTasks = true;
+		}
+
+		foreach(streamCell, newStreamList)
+		{
+			CopySelectStream *stream = (CopySelectStream *) lfirst(streamCell);
+			MultiConnection *connection = stream->connection;
+
+			if (stream->node->failed)
+			{
+				CloseConnection(connection);
+				continue;
+			}
+
+			execution->streamList = lappend(execution->streamList, stream);
+		}
+	}
+}
+
+
+/*
+ * FindCopySelectNode returns the node with the given name and port in
+ * nodeList, or NULL if there is no such node.
+ */
+static CopySelectNode *
+FindCopySelectNode(List *nodeList, char *nodeName, int nodePort)
+{
+	ListCell *nodeCell = NULL;
+
+	foreach(nodeCell, nodeList)
+	{
+		CopySelectNode *node = (CopySelectNode *) lfirst(nodeCell);
+
+		if (strncmp(node->nodeName, nodeName, WORKER_LENGTH) == 0 &&
+			node->nodePort == nodePort)
+		{
+			return node;
+		}
+	}
+
+	return NULL;
+}
+
+
+/*
+ * StartNextCopySelectTask sends the COPY command for the next task of the
+ * node of the stream, without waiting for the worker. It returns false if
+ * the node has no tasks left.
+ */
+static bool
+StartNextCopySelectTask(CopySelectExecution *execution, CopySelectStream *stream,
+						List *optionList)
+{
+	CopySelectNode *node = stream->node;
+	MultiConnection *connection = stream->connection;
+
+	if (node->failed || node->pendingTaskList == NIL)
+	{
+		return false;
+	}
 
-				selectTarget->name = NULL;
-				selectTarget->indirection = NIL;
-				selectTarget->val = (Node *) allColumns;
-				selectTarget->location = -1;
+	CopySelectTask *copySelectTask = (CopySelectTask *) linitial(node->pendingTaskList);
+	node->pendingTaskList = list_delete_first(node->pendingTaskList);
 
-				selectStmt->targetList = list_make1(selectTarget);
-				selectStmt->fromClause = list_make1(copyObject(copyStatement->relation));
+	stream->task = copySelectTask;
+	stream->copyStarted = false;
+	stream->skipBinaryHeader = execution->copyOutState->binary;
+	stream->forwardedRows = false;
+	execution->rebuildWaitEventSet = true;
 
-				/* replace original statement */
-				copyStatement = copyObject(copyStatement);
-				copyStatement->relation = NULL;
-				copyStatement->query = (Node *) selectStmt;
-			}
-		}
+	StringInfo copyCommand = makeStringInfo();
+	appendStringInfo(copyCommand, "COPY (%s) TO STDOUT",
+					 TaskQueryString(copySelectTask->task));
+	AppendCopyOptions(copyCommand, optionList);
+
+	if (!SendRemoteCommand(connection, copyCommand->data))
+	{
+		CopySelectStreamFailed(execution, stream, NULL);
 	}
 
+	return true;
+}
 
-	if (copyStatement->filename != NULL && !copyStatement->is_program)
-	{
-		char *filename = copyStatement->filename;
 
-		/*
-		 * We execute COPY commands issued by the task-tracker executor here
-		 * because we're not normally allowed to write to a file as a regular
-		 * user and we don't want to execute the query as superuser.
-		 */
-		if (CacheDirectoryElement(filename) && copyStatement->query != NULL &&
-			!copyStatement->is_from && !is_absolute_path(filename))
-		{
-			bool binaryCopyFormat = CopyStatementHasFormat(copyStatement, "binary");
-			Query *query = NULL;
-			Node *queryNode = copyStatement->query;
-			StringInfo userFilePath = makeStringInfo();
+/*
+ * ForwardCopySelectHeader starts the COPY of the first task that is pending
+ * on a stream with the given options, and forwards its first message, which
+ * holds the header line, to the client. If the COPY fails before that, the
+ * header is taken from the next task.
+ */
+static void
+ForwardCopySelectHeader(CopySelectExecution *execution, List *headerOptionList)
+{
+	while (true)
+	{
+		CopySelectStream *headerStream = NULL;
+		ListCell *streamCell = NULL;
 
-			RawStmt *rawStmt = makeNode(RawStmt);
-			rawStmt->stmt = queryNode;
+		OpenCopySelectStreams(execution);
 
-			List *queryTreeList = pg_analyze_and_rewrite(rawStmt, queryString, NULL, 0,
-														 NULL);
+		/* the first stream runs on the node of the first task */
+		foreach(streamCell, execution->streamList)
+		{
+			CopySelectStream *stream = (CopySelectStream *) lfirst(streamCell);
 
-			if (list_length(queryTreeList) != 1)
+			if (stream->connection != NULL && stream->task == NULL &&
+				stream->node->pendingTaskList != NIL)
 			{
-				ereport(ERROR, (errmsg("can only execute a single query")));
+				headerStream = stream;
+				break;
 			}
+		}
 
-			query = (Query *) linitial(queryTreeList);
-
-			/*
-			 * Add a user ID suffix to prevent other users from reading/writing
-			 * the same file. We do this consistently in all functions that interact
-			 * with task files.
-			 */
-			appendStringInfo(userFilePath, "%s.%u", filename, GetUserId());
-
-			int64 tuplesSent = WorkerExecuteSqlTask(query, filename, binaryCopyFormat);
+		if (headerStream == NULL)
+		{
+			return;
+		}
 
-			SafeSnprintf(completionTag, COMPLETION_TAG_BUFSIZE,
-						 "COPY " UINT64_FORMAT, tuplesSent);
+		StartNextCopySelectTask(execution, headerStream, headerOptionList);
 
-			return NULL;
+		if (headerStream->task != NULL &&
+			ReceiveCopySelectHeader(execution, headerStream))
+		{
+			return;
 		}
 	}
-
-
-	return (Node *) copyStatement;
 }
 
 
 /*
- * CitusCopyTo runs a COPY .. TO STDOUT command on each shard to do a full
- * table dump.
+ * ReceiveCopySelectHeader waits for the first message of the COPY of the
+ * given stream and forwards it to the client. It returns false if the COPY
+ * failed before that.
  */
-static void
-CitusCopyTo(CopyStmt *copyStatement, char *completionTag)
+static bool
+ReceiveCopySelectHeader(CopySelectExecution *execution, CopySelectStream *stream)
 {
-	ListCell *shardIntervalCell = NULL;
-	int64 tuplesSent = 0;
-
-	Relation distributedRelation = heap_openrv(copyStatement->relation, AccessShareLock);
-	Oid relationId = RelationGetRelid(distributedRelation);
-	TupleDesc tupleDescriptor = RelationGetDescr(distributedRelation);
+	MultiConnection *connection = stream->connection;
+	char *receiveBuffer = NULL;
+	const int useAsync = 0;
+	bool raiseErrors = false;
 
-	CopyOutState copyOutState = (CopyOutState) palloc0(sizeof(CopyOutStateData));
-	copyOutState->fe_msgbuf = makeStringInfo();
-	copyOutState->binary = false;
-	copyOutState->attnumlist = CopyGetAttnums(tupleDescriptor, distributedRelation,
-											  copyStatement->attlist);
+	PGresult *result = GetRemoteCommandResult(connection, raiseErrors);
+	if (PQresultStatus(result) != PGRES_COPY_OUT)
+	{
+		CopySelectStreamFailed(execution, stream, result);
+		return false;
+	}
 
-	SendCopyBegin(copyOutState);
+	PQclear(result);
+	stream->copyStarted = true;
 
-	List *shardIntervalList = LoadShardIntervalList(relationId);
+	int receiveLength = PQgetCopyData(connection->pgConn, &receiveBuffer, useAsync);
+	if (receiveLength > 0)
+	{
+		CopySendData(execution->copyOutState, receiveBuffer, receiveLength);
+		CopySendEndOfRow(execution->copyOutState, false);
 
-	foreach(shardIntervalCell, shardIntervalList)
+		PQfreemem(receiveBuffer);
+	}
+	else if (receiveLength == -1)
 	{
-		ShardInterval *shardInterval = lfirst(shardIntervalCell);
-		List *shardPlacementList = ActiveShardPlacementList(shardInterval->shardId);
-		ListCell *shardPlacementCell = NULL;
-		int placementIndex = 0;
+		return FinishCopySelectTask(execution, stream);
+	}
+	else
+	{
+		CopySelectStreamFailed(execution, stream, NULL);
+		return false;
+	}
 
-		StringInfo copyCommand = ConstructCopyStatement(copyStatement,
-														shardInterval->shardId);
+	return true;
+}
 
-		foreach(shardPlacementCell, shardPlacementList)
+
+/*
+ * ForwardCopySelectStreamData forwards the COPY output that the connection
+ * of the stream received to the client, without blocking. It returns true if
+ * the COPY of the task is done or failed.
+ */
+static bool
+ForwardCopySelectStreamData(CopySelectExecution *execution, CopySelectStream *stream)
+{
+	CopyOutState copyOutState = execution->copyOutState;
+	MultiConnection *connection = stream->connection;
+	const int useAsync = 1;
+
+	if (PQconsumeInput(connection->pgConn) == 0)
+	{
+		CopySelectStreamFailed(execution, stream, NULL);
+		return true;
+	}
+
+	if (!stream->copyStarted)
+	{
+		if (PQisBusy(connection->pgConn))
 		{
-			ShardPlacement *shardPlacement = lfirst(shardPlacementCell);
-			int connectionFlags = 0;
-			char *userName = NULL;
-			const bool raiseErrors = true;
+			return false;
+		}
 
-			MultiConnection *connection = GetPlacementConnection(connectionFlags,
-																 shardPlacement,
-																 userName);
+		PGresult *result = PQgetResult(connection->pgConn);
+		if (PQresultStatus(result) != PGRES_COPY_OUT)
+		{
+			CopySelectStreamFailed(execution, stream, result);
+			return true;
+		}
 
-			if (placementIndex == list_length(shardPlacementList) - 1)
-			{
-				/* last chance for this shard */
-				MarkRemoteTransactionCritical(connection);
-			}
+		PQclear(result);
+		stream->copyStarted = true;
+	}
 
-			if (PQstatus(connection->pgConn) != CONNECTION_OK)
-			{
-				HandleRemoteTransactionConnectionError(connection, raiseErrors);
-				continue;
-			}
+	while (true)
+	{
+		char *receiveBuffer = NULL;
 
-			RemoteTransactionBeginIfNecessary(connection);
+		int receiveLength = PQgetCopyData(connection->pgConn, &receiveBuffer, useAsync);
+		if (receiveLength == 0)
+		{
+			/* no complete message available without blocking */
+			return false;
+		}
+		else if (receiveLength == -1)
+		{
+			FinishCopySelectTask(execution, stream);
+			return true;
+		}
+		else if (receiveLength < -1)
+		{
+			CopySelectStreamFailed(execution, stream, NULL);
+			return true;
+		}
 
-			if (!SendRemoteCommand(connection, copyCommand->data))
-			{
-				HandleRemoteTransactionConnectionError(connection, raiseErrors);
-				continue;
-			}
+		char *data = receiveBuffer;
+		int dataLength = receiveLength;
 
-			PGresult *result = GetRemoteCommandResult(connection, raiseErrors);
-			if (PQresultStatus(result) != PGRES_COPY_OUT)
+		if (stream->skipBinaryHeader)
+		{
+			/* the header is part of the first message */
+			if (dataLength < BINARY_COPY_HEADER_LENGTH)
 			{
-				ReportResultError(connection, result, ERROR);
+				ereport(ERROR, (errmsg("unexpected binary COPY header from %s:%d",
+									   connection->hostname, connection->port)));
 			}
 
-			PQclear(result);
+			data += BINARY_COPY_HEADER_LENGTH;
+			dataLength -= BINARY_COPY_HEADER_LENGTH;
+			stream->skipBinaryHeader = false;
+		}
 
-			tuplesSent += ForwardCopyDataFromConnection(copyOutState, connection);
-			break;
+		/* the trailer is sent once all tasks are done */
+		if (copyOutState->binary && dataLength == 2 && data[0] == '\377' &&
+			data[1] == '\377')
+		{
+			dataLength = 0;
 		}
 
-		if (shardIntervalCell == list_head(shardIntervalList))
+		if (dataLength > 0)
 		{
-			/* remove header after the first shard */
-			RemoveOptionFromList(copyStatement->options, "header");
+			CopySendData(copyOutState, data, dataLength);
+			CopySendEndOfRow(copyOutState, false);
+			execution->tuplesSent++;
+			stream->forwardedRows = true;
 		}
+
+		PQfreemem(receiveBuffer);
 	}
+}
 
-	SendCopyEnd(copyOutState);
 
-	heap_close(distributedRelation, AccessShareLock);
+/*
+ * FinishCopySelectTask checks the outcome of the COPY of the stream, once
+ * all its output was received, and marks the stream as idle. It returns
+ * false if the COPY failed.
+ */
+static bool
+FinishCopySelectTask(CopySelectExecution *execution, CopySelectStream *stream)
+{
+	MultiConnection *connection = stream->connection;
+	bool raiseErrors = false;
 
-	if (completionTag != NULL)
+	PGresult *result = GetRemoteCommandResult(connection, raiseErrors);
+	if (!IsResponseOK(result))
 	{
-		SafeSnprintf(completionTag, COMPLETION_TAG_BUFSIZE, "COPY " UINT64_FORMAT,
-					 tuplesSent);
+		CopySelectStreamFailed(execution, stream, result);
+		return false;
 	}
+
+	PQclear(result);
+	ClearResults(connection, raiseErrors);
+
+	stream->task = NULL;
+	execution->rebuildWaitEventSet = true;
+
+	return true;
 }
 
 
 /*
- * ForwardCopyDataFromConnection forwards copy data received over the given connection
- * to the client or file descriptor.
+ * CopySelectStreamFailed handles a failed COPY of the stream, where result
+ * is the result of the COPY, or NULL if no result was received. The task
+ * is retried on its next placement, unless some of its rows were already
+ * sent to the client. If the connection failed, the stream is closed and
+ * the node gets no more tasks. We error out if a task cannot be retried, and otherwise warn.
  */
-static int64
-ForwardCopyDataFromConnection(CopyOutState copyOutState, MultiConnection *connection)
+static void
+CopySelectStreamFailed(CopySelectExecution *execution, CopySelectStream *stream,
+					   PGresult *result)
 {
-	char *receiveBuffer = NULL;
-	const int useAsync = 0;
-	bool raiseErrors = true;
-	int64 tuplesSent = 0;
+	MultiConnection *connection = stream->connection;
+	CopySelectNode *node = stream->node;
+	CopySelectTask *copySelectTask = stream->task;
+	bool connectionFailed = result == NULL ||
+							PQstatus(connection->pgConn) != CONNECTION_OK;
 
-	/* receive copy data message in a synchronous manner */
-	int receiveLength = PQgetCopyData(connection->pgConn, &receiveBuffer, useAsync);
-	while (receiveLength > 0)
+	if (connectionFailed)
 	{
-		bool includeEndOfLine = false;
+		node->failed = true;
+	}
 
-		CopySendData(copyOutState, receiveBuffer, receiveLength);
-		CopySendEndOfRow(copyOutState, includeEndOfLine);
-		tuplesSent++;
+	bool canRetry = !stream->forwardedRows &&
+					CanRetryCopySelectTask(execution, copySelectTask) &&
+					(!connectionFailed || CanRetryCopySelectNodeTasks(execution, node));
+	int elevel = canRetry ? WARNING : ERROR;
 
-		PQfreemem(receiveBuffer);
+	if (connectionFailed)
+	{
+		ReportConnectionError(connection, elevel);
+	}
+	else
+	{
+		ReportResultError(connection, result, elevel);
+	}
 
-		receiveLength = PQgetCopyData(connection->pgConn, &receiveBuffer, useAsync);
+	if (result != NULL)
+	{
+		PQclear(result);
 	}
 
-	if (receiveLength != -1)
+	if (connectionFailed)
 	{
-		ReportConnectionError(connection, ERROR);
+		CloseConnection(connection);
+		stream->connection = NULL;
+
+		ReassignCopySelectNodeTasks(execution, node);
+	}
+	else
+	{
+		ClearResults(connection, false);
 	}
 
-	PGresult *result = GetRemoteCommandResult(connection, raiseErrors);
-	if (!IsResponseOK(result))
+	stream->task = NULL;
+	execution->rebuildWaitEventSet = true;
+
+	AssignCopySelectTask(execution, copySelectTask);
+}
+
+
+/*
+ * BuildCopySelectWaitEventSet creates a WaitEventSet that waits for the
+ * sockets of the streams that run a COPY, as well as for the latch and
+ * postmaster death.
+ */
+static WaitEventSet *
+BuildCopySelectWaitEventSet(List *streamList)
+{
+	/* additional events for the latch and postmaster death */
+	int eventSetSize = list_length(streamList) + 2;
+	ListCell *streamCell = NULL;
+
+	WaitEventSet *waitEventSet = CreateWaitEventSet(CurrentMemoryContext, eventSetSize);
+
+	foreach(streamCell, streamList)
 	{
-		ReportResultError(connection, result, ERROR);
+		CopySelectStream *stream = (CopySelectStream *) lfirst(streamCell);
+		if (stream->task == NULL)
+		{
+			continue;
+		}
+
+		int socket = PQsocket(stream->connection->pgConn);
+
+		AddWaitEventToSet(waitEventSet, WL_SOCKET_READABLE, socket, NULL,
+						  (void *) stream);
 	}
 
-	PQclear(result);
-	ClearResults(connection, raiseErrors);
+	AddWaitEventToSet(waitEventSet, WL_POSTMASTER_DEATH, PGINVALID_SOCKET, NULL, NULL);
+	AddWaitEventToSet(waitEventSet, WL_LATCH_SET, PGINVALID_SOCKET, MyLatch, NULL);
 
-	return tuplesSent;
+	return waitEventSet;
 }
 
 
@@ -3484,8 +5423,9 @@ StartPlacementStateCopyCommand(CopyPlacementState *placementState,
 
 
 /*
- * EndPlacementStateCopyCommand ends the COPY for the given placement. It also
- * sends binary footers if this is a binary COPY.
+ * EndPlacementStateCopyCommand ends the COPY for the given placement, after
+ * sending the rows that are still buffered for it. It also sends binary footers
+ * if this is a binary COPY.
  */
 static void
 EndPlacementStateCopyCommand(CopyPlacementState *placementState,
@@ -3495,6 +5435,12 @@ EndPlacementStateCopyCommand(CopyPlacementState *placementState,
 	uint64 shardId = placementState->shardState->shardId;
 	bool binaryCopy = copyOutState->binary;
 
+	if (placementState->data->len > 0)
+	{
+		SendCopyDataToPlacement(placementState->data, shardId, connection);
+		resetStringInfo(placementState->data);
+	}
+
 	/* send footers and end copy command */
 	if (binaryCopy)
 	{
@@ -16,6 +16,8 @@
 #include <unistd.h>
 
 #include "commands/defrem.h"
+#include "distributed/copy_compression.h"
+#include "distributed/job_cache_space.h"
 #include "distributed/listutils.h"
 #include "distributed/relay_utility.h"
 #include "distributed/transmit.h"
@@ -26,6 +28,10 @@
 #include "storage/fd.h"
 
 
+/* GUC, the amount of written data in kB after which writeback is started */
+int LocalFileFlushAfter = 0;
+
+
 /* Local functions forward declarations */
 static void SendCopyInStart(void);
 static void SendCopyOutStart(void);
@@ -37,12 +43,15 @@ static bool ReceiveCopyData(StringInfo copyData);
 /*
  * RedirectCopyDataToRegularFile receives data from stdin using the standard copy
  * protocol. The function then creates or truncates a file with the given
- * filename, and appends received data to this file.
+ * filename, and appends received data to this file. If decompress is true, the
+ * data consists of frames created by AppendCompressedCopyFrame, which are
+ * decompressed before being written.
  */
 void
-RedirectCopyDataToRegularFile(const char *filename)
+RedirectCopyDataToRegularFile(const char *filename, bool decompress)
 {
 	StringInfo copyData = makeStringInfo();
+	StringInfo rawData = decompress ? makeStringInfo() : copyData;
 	const int fileFlags = (O_APPEND | O_CREAT | O_RDWR | O_TRUNC | PG_BINARY);
 	const int fileMode = (S_IRUSR | S_IWUSR);
 	File fileDesc = FileOpenForTransmit(filename, fileFlags, fileMode);
@@ -56,10 +65,18 @@ RedirectCopyDataToRegularFile(const char *filename)
 		/* if received data has contents, append to regular file */
 		if (copyData->len > 0)
 		{
-			int appended = FileWriteCompat(&fileCompat, copyData->data,
-										   copyData->len, PG_WAIT_IO);
+			if (decompress)
+			{
+				resetStringInfo(rawData);
+				AppendDecompressedCopyFrame(rawData, copyData->data, copyData->len);
+			}
 
-			if (appended != copyData->len)
+			ReserveJobCacheSpace(rawData->len);
+
+			int appended = FileWriteWithWriteback(&fileCompat, rawData->data,
+												  rawData->len, PG_WAIT_IO);
+
+			if (appended != rawData->len)
 			{
 				ereport(ERROR, (errcode_for_file_access(),
 								errmsg("could not append to received file: %m")));
@@ -70,6 +87,11 @@ RedirectCopyDataToRegularFile(const char *filename)
 		copyDone = ReceiveCopyData(copyData);
 	}
 
+	if (decompress)
+	{
+		FreeStringInfo(rawData);
+	}
+
 	FreeStringInfo(copyData);
 	FileClose(fileDesc);
 }
@@ -78,10 +100,12 @@ RedirectCopyDataToRegularFile(const char *filename)
 /*
  * SendRegularFile reads data from the given file, and sends these data to
  * stdout using the standard copy protocol. After all file data are sent, the
- * function ends the copy protocol and closes the file.
+ * function ends the copy protocol and closes the file. If compress is true,
+ * every block of the file is sent as a frame created by
+ * AppendCompressedCopyFrame.
  */
 void
-SendRegularFile(const char *filename)
+SendRegularFile(const char *filename, bool compress)
 {
 	const uint32 fileBufferSize = 32768; /* 32 KB */
 	const int fileFlags = (O_RDONLY | PG_BINARY);
@@ -98,6 +122,8 @@ SendRegularFile(const char *filename)
 	StringInfo fileBuffer = makeStringInfo();
 	enlargeStringInfo(fileBuffer, fileBufferSize);
 
+	StringInfo frameBuffer = compress ? makeStringInfo() : NULL;
+
 	SendCopyOutStart();
 
 	int readBytes = FileReadCompat(&fileCompat, fileBuffer->data, fileBufferSize,
@@ -106,7 +132,16 @@ SendRegularFile(const char *filename)
 	{
 		fileBuffer->len = readBytes;
 
-		SendCopyData(fileBuffer);
+		if (compress)
+		{
+			resetStringInfo(frameBuffer);
+			AppendCompressedCopyFrame(frameBuffer, fileBuffer->data, fileBuffer->len);
+			SendCopyData(frameBuffer);
+		}
+		else
+		{
+			SendCopyData(fileBuffer);
+		}
 
 		resetStringInfo(fileBuffer);
 		readBytes = FileReadCompat(&fileCompat, fileBuffer->data, fileBufferSize,
@@ -115,11 +150,55 @@ SendRegularFile(const char *filename)
 
 	SendCopyDone();
 
+	if (compress)
+	{
+		FreeStringInfo(frameBuffer);
+	}
+
 	FreeStringInfo(fileBuffer);
 	FileClose(fileDesc);
 }
 
 
+/*
+ * FileWriteWithWriteback appends the given data to the file like
+ * FileWriteCompat, and asks the kernel to start writing the data back to disk
+ * once another citus.local_file_flush_after of data was written to the file.
+ *
+ * Writes of intermediate results and partition files only copy the data into
+ * the page cache, but when the dirty pages pile up, the kernel makes the
+ * writing backend wait for the writeback of all of them. Starting the
+ * writeback early lets the disk write the data in the background while the
+ * backend continues to produce it, the same way backend_flush_after does for
+ * relation files. The writeback is started for whole multiples of the setting,
+ * such that no state other than the offset of the file is needed.
+ */
+int
+FileWriteWithWriteback(FileCompat *file, char *buffer, int amount,
+					   uint32 wait_event_info)
+{
+	off_t startOffset = file->offset;
+
+	int bytesWritten = FileWriteCompat(file, buffer, amount, wait_event_info);
+	if (bytesWritten <= 0 || LocalFileFlushAfter <= 0)
+	{
+		return bytesWritten;
+	}
+
+	off_t flushAfterBytes = (off_t) LocalFileFlushAfter * 1024L;
+	off_t flushStartOffset = (startOffset / flushAfterBytes) * flushAfterBytes;
+	off_t flushEndOffset = (file->offset / flushAfterBytes) * flushAfterBytes;
+
+	if (flushEndOffset > flushStartOffset)
+	{
+		FileWriteback(file->fd, flushStartOffset, flushEndOffset - flushStartOffset,
+					  WAIT_EVENT_DATA_FILE_FLUSH);
+	}
+
+	return bytesWritten;
+}
+
+
 /* Helper function that deallocates string info object. */
 void
 FreeStringInfo(StringInfo stringInfo)
@@ -364,6 +443,45 @@ TransmitStatementUser(CopyStmt *copyStatement)
 }
 
 
+/*
+ * TransmitStatementIsCompressed determines whether the given
+ * COPY ... (format 'transmit') statement has the compression pglz option,
+ * meaning that the file is sent in compressed frames.
+ */
+bool
+TransmitStatementIsCompressed(CopyStmt *copyStatement)
+{
+	AssertArg(IsTransmitStmt((Node *) copyStatement));
+
+	bool isCompressed = false;
+	DefElem *defel = NULL;
+	foreach_ptr(defel, copyStatement->options)
+	{
+		if (strncmp(defel->defname, "compression", NAMEDATALEN) == 0)
+		{
+			char *compressionName = defGetString(defel);
+
+			if (strncmp(compressionName, "pglz", NAMEDATALEN) == 0)
+			{
+				isCompressed = true;
+			}
+			else if (strncmp(compressionName, "none", NAMEDATALEN) == 0)
+			{
+				isCompressed = false;
+			}
+			else
+			{
+				ereport(ERROR, (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+								errmsg("unsupported TRANSMIT compression \"%s\"",
+									   compressionName)));
+			}
+		}
+	}
+
+	return isCompressed;
+}
+
+
 /*
  * VerifyTransmitStmt checks that the passed in command is a valid transmit
  * statement. Raise ERROR if not.
@@ -236,6 +236,13 @@ AcquireDistributedLockOnRelations(List *relationIdList, LOCKMODE lockMode)
 
 	int32 localGroupId = GetLocalGroupId();
 
+	/*
+	 * Lock all relations with a single command per worker, rather than
+	 * sending a separate command for every relation to every worker.
+	 */
+	List *lockedRelationIdList = NIL;
+	StringInfo lockRelationCommand = makeStringInfo();
+
 	foreach_oid(relationId, relationIdList)
 	{
 		/*
@@ -245,27 +252,37 @@ AcquireDistributedLockOnRelations(List *relationIdList, LOCKMODE lockMode)
 		if (ShouldSyncTableMetadata(relationId))
 		{
 			char *qualifiedRelationName = generate_qualified_relation_name(relationId);
-			StringInfo lockRelationCommand = makeStringInfo();
 
 			appendStringInfo(lockRelationCommand, LOCK_RELATION_IF_EXISTS,
 							 quote_literal_cstr(qualifiedRelationName),
 							 lockModeText);
 
-			WorkerNode *workerNode = NULL;
-			foreach_ptr(workerNode, workerNodeList)
-			{
-				const char *nodeName = workerNode->workerName;
-				int nodePort = workerNode->workerPort;
+			lockedRelationIdList = lappend_oid(lockedRelationIdList, relationId);
+		}
+	}
+
+	if (lockedRelationIdList == NIL)
+	{
+		return;
+	}
 
-				/* if local node is one of the targets, acquire the lock locally */
-				if (workerNode->groupId == localGroupId)
-				{
-					LockRelationOid(relationId, lockMode);
-					continue;
-				}
+	WorkerNode *workerNode = NULL;
+	foreach_ptr(workerNode, workerNodeList)
+	{
+		const char *nodeName = workerNode->workerName;
+		int nodePort = workerNode->workerPort;
 
-				SendCommandToWorker(nodeName, nodePort, lockRelationCommand->data);
+		/* if local node is one of the targets, acquire the locks locally */
+		if (workerNode->groupId == localGroupId)
+		{
+			foreach_oid(relationId, lockedRelationIdList)
+			{
+				LockRelationOid(relationId, lockMode);
 			}
+
+			continue;
 		}
+
+		SendCommandToWorker(nodeName, nodePort, lockRelationCommand->data);
 	}
 }
@@ -41,11 +41,15 @@
 #include "distributed/commands.h"
 #include "distributed/commands/multi_copy.h"
 #include "distributed/commands/utility_hook.h" /* IWYU pragma: keep */
+#include "distributed/connection_management.h"
+#include "distributed/ddl_buffer.h"
 #include "distributed/deparser.h"
 #include "distributed/deparse_shard_query.h"
+#include "distributed/insert_buffer.h"
 #include "distributed/listutils.h"
 #include "distributed/local_executor.h"
 #include "distributed/maintenanced.h"
+#include "distributed/master_metadata_utility.h"
 #include "distributed/master_protocol.h"
 #include "distributed/metadata_cache.h"
 #include "distributed/metadata_sync.h"
@@ -65,17 +69,37 @@
 
 
 bool EnableDDLPropagation = true; /* ddl propagation is enabled */
+bool EnableBatchedShardDDL = false; /* apply DDL to all shards of a node at once */
 PropSetCmdBehavior PropagateSetCommands = PROPSETCMD_NONE; /* SET prop off */
 static bool shouldInvalidateForeignKeyGraph = false;
 static int activeAlterTables = 0;
 static int activeDropSchemaOrDBs = 0;
 
 
+/*
+ * ShardDDLBatch is a group of shards that have their placements on the same
+ * nodes, such that a DDL command can be applied to all of them in one task.
+ */
+typedef struct ShardDDLBatch
+{
+	/* placements of the first shard, in their original order */
+	List *placementList;
+
+	/* the same placements sorted by node, to compare batches */
+	List *sortedPlacementList;
+
+	List *shardIntervalList;
+} ShardDDLBatch;
+
+
 /* Local functions forward declarations for helper functions */
 static void ExecuteDistributedDDLJob(DDLJob *ddlJob);
 static char * SetSearchPathToCurrentSearchPathCommand(void);
 static char * CurrentSearchPath(void);
 static bool IsDropSchemaOrDB(Node *parsetree);
+static List * BatchedDDLTaskList(List *shardIntervalList, char *escapedSchemaName,
+								 char *escapedCommandString);
+static ShardDDLBatch * FindShardDDLBatch(List *batchList, List *sortedPlacementList);
 
 
 /*
@@ -116,6 +140,9 @@ multi_ProcessUtility(PlannedStmt *pstmt,
 	Node *parsetree = pstmt->utilityStmt;
 	List *ddlJobs = NIL;
 
+	/* make sure the commits of the previous transaction finished on all workers */
+	WaitForPendingCommitPrepared();
+
 	if (IsA(parsetree, TransactionStmt) ||
 		IsA(parsetree, LockStmt) ||
 		IsA(parsetree, ListenStmt) ||
@@ -140,6 +167,15 @@ multi_ProcessUtility(PlannedStmt *pstmt,
 		return;
 	}
 
+	/* utility commands may read or modify shards with buffered rows */
+	FlushBufferedInserts();
+
+	/* DDL commands may be buffered after the buffered ones, others see their effects */
+	if (!IsBufferableDDLStatement(parsetree))
+	{
+		FlushBufferedDDLCommands();
+	}
+
 	bool isCreateAlterExtensionUpdateCitusStmt = IsCreateAlterExtensionUpdateCitusStmt(
 		parsetree);
 	if (EnableVersionChecks && isCreateAlterExtensionUpdateCitusStmt)
@@ -312,13 +348,15 @@ multi_ProcessUtility(PlannedStmt *pstmt,
 			appendStringInfo(transmitPath, ".%d", userId);
 		}
 
+		bool compressed = TransmitStatementIsCompressed(copyStatement);
+
 		if (copyStatement->is_from)
 		{
-			RedirectCopyDataToRegularFile(transmitPath->data);
+			RedirectCopyDataToRegularFile(transmitPath->data, compressed);
 		}
 		else
 		{
-			SendRegularFile(transmitPath->data);
+			SendRegularFile(transmitPath->data, compressed);
 		}
 
 		/* Don't execute the faux copy statement */
@@ -708,6 +746,16 @@ ExecuteDistributedDDLJob(DDLJob *ddlJob)
 
 	if (!ddlJob->concurrentIndexCmd)
 	{
+		/* metadata workers get the command itself as well, which is not buffered */
+		if (OidIsValid(targetRelationId) && !shouldSyncMetadata &&
+			BufferDDLTaskListIfPossible(targetRelationId, ddlJob->taskList))
+		{
+			return;
+		}
+
+		/* the command may depend on buffered commands */
+		FlushBufferedDDLCommands();
+
 		if (shouldSyncMetadata)
 		{
 			char *setSearchPathCommand = SetSearchPathToCurrentSearchPathCommand();
@@ -737,8 +785,8 @@ ExecuteDistributedDDLJob(DDLJob *ddlJob)
 
 		PG_TRY();
 		{
-			ExecuteUtilityTaskListWithoutResults(ddlJob->taskList,
-												 localExecutionSupported);
+			ExecuteConcurrentIndexTaskList(targetRelationId, ddlJob->taskList,
+										   localExecutionSupported);
 
 			if (shouldSyncMetadata)
 			{
@@ -889,6 +937,12 @@ DDLTaskList(Oid relationId, const char *commandString)
 	/* lock metadata before getting placement lists */
 	LockShardListMetadata(shardIntervalList, ShareLock);
 
+	if (EnableBatchedShardDDL)
+	{
+		return BatchedDDLTaskList(shardIntervalList, escapedSchemaName,
+								  escapedCommandString);
+	}
+
 	ShardInterval *shardInterval = NULL;
 	foreach_ptr(shardInterval, shardIntervalList)
 	{
@@ -919,6 +973,128 @@ DDLTaskList(Oid relationId, const char *commandString)
 }
 
 
+/*
+ * BatchedDDLTaskList builds a task for every group of shards that have their
+ * placements on the same nodes, which applies the DDL command to all shards
+ * of the group in a single worker_apply_multi_shard_ddl_command call. That
+ * way, a DDL command takes one round trip per node rather than one per shard.
+ */
+static List *
+BatchedDDLTaskList(List *shardIntervalList, char *escapedSchemaName,
+				   char *escapedCommandString)
+{
+	List *batchList = NIL;
+	List *taskList = NIL;
+	uint64 jobId = INVALID_JOB_ID;
+	int taskId = 1;
+
+	ShardInterval *shardInterval = NULL;
+	foreach_ptr(shardInterval, shardIntervalList)
+	{
+		List *placementList = ActiveShardPlacementList(shardInterval->shardId);
+		List *sortedPlacementList = SortList(placementList,
+											 CompareShardPlacementsByWorker);
+
+		ShardDDLBatch *batch = FindShardDDLBatch(batchList, sortedPlacementList);
+		if (batch == NULL)
+		{
+			batch = palloc0(sizeof(ShardDDLBatch));
+			batch->placementList = placementList;
+			batch->sortedPlacementList = sortedPlacementList;
+
+			batchList = lappend(batchList, batch);
+		}
+
+		batch->shardIntervalList = lappend(batch->shardIntervalList, shardInterval);
+	}
+
+	ShardDDLBatch *batch = NULL;
+	foreach_ptr(batch, batchList)
+	{
+		StringInfo shardIdArray = makeStringInfo();
+		StringInfo applyCommand = makeStringInfo();
+		List *relationShardList = NIL;
+
+		foreach_ptr(shardInterval, batch->shardIntervalList)
+		{
+			RelationShard *relationShard = CitusMakeNode(RelationShard);
+			relationShard->relationId = shardInterval->relationId;
+			relationShard->shardId = shardInterval->shardId;
+
+			/* DDL access to all shards, such that later commands use this connection */
+			relationShardList = lappend(relationShardList, relationShard);
+
+			if (shardIdArray->len > 0)
+			{
+				appendStringInfoChar(shardIdArray, ',');
+			}
+
+			appendStringInfo(shardIdArray, UINT64_FORMAT, shardInterval->shardId);
+		}
+
+		appendStringInfo(applyCommand, WORKER_APPLY_MULTI_SHARD_DDL_COMMAND,
+						 shardIdArray->data, escapedSchemaName, escapedCommandString);
+
+		ShardInterval *anchorShardInterval = linitial(batch->shardIntervalList);
+
+		Task *task = CitusMakeNode(Task);
+		task->jobId = jobId;
+		task->taskId = taskId++;
+		task->taskType = DDL_TASK;
+		SetTaskQueryString(task, applyCommand->data);
+		task->replicationModel = REPLICATION_MODEL_INVALID;
+		task->dependentTaskList = NULL;
+		task->anchorShardId = anchorShardInterval->shardId;
+		task->taskPlacementList = batch->placementList;
+		task->relationShardList = relationShardList;
+
+		taskList = lappend(taskList, task);
+	}
+
+	return taskList;
+}
+
+
+/*
+ * FindShardDDLBatch returns the batch in batchList whose placements are on
+ * the same nodes as the given placements, sorted by node, or NULL if there
+ * is no such batch.
+ */
+static ShardDDLBatch *
+FindShardDDLBatch(List *batchList, List *sortedPlacementList)
+{
+	ShardDDLBatch *batch = NULL;
+	foreach_ptr(batch, batchList)
+	{
+		if (list_length(batch->sortedPlacementList) != list_length(sortedPlacementList))
+		{
+			continue;
+		}
+
+		bool sameNodes = true;
+		ListCell *batchPlacementCell = NULL;
+		ListCell *placementCell = NULL;
+		forboth(batchPlacementCell, batch->sortedPlacementList, placementCell,
+				sortedPlacementList)
+		{
+			if (CompareShardPlacementsByWorker(&lfirst(batchPlacementCell),
+											   &lfirst(placementCell)) != 0)
+			{
+				sameNodes = false;
+				break;
+			}
+		}
+
+		if (sameNodes)
+		{
+			return batch;
+		}
+	}
+
+	return NULL;
+}
+
+
 /*
  * NodeDDLTaskList builds a list of tasks to execute a DDL command on a
  * given target set of nodes.
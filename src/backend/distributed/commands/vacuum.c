@@ -14,6 +14,7 @@
 #include "commands/defrem.h"
 #endif
 #include "commands/vacuum.h"
+#include "distributed/adaptive_executor.h"
 #include "distributed/commands.h"
 #include "distributed/commands/utility_hook.h"
 #include "distributed/deparse_shard_query.h"
@@ -21,6 +22,7 @@
 #include "distributed/metadata_cache.h"
 #include "distributed/multi_executor.h"
 #include "distributed/resource_lock.h"
+#include "distributed/shard_task_progress.h"
 #include "distributed/transaction_management.h"
 #include "distributed/version_compat.h"
 #include "storage/lmgr.h"
@@ -40,6 +42,21 @@ typedef struct CitusVacuumParams
 } CitusVacuumParams;
 
 
+/*
+ * GUC, the maximum number of shards on a single node that are vacuumed or
+ * analyzed at the same time. 0 means the limit is
+ * citus.max_adaptive_executor_pool_size.
+ */
+int MaxConcurrentVacuumsPerNode = 0;
+
+/*
+ * GUCs, the vacuum_cost_delay and vacuum_cost_limit used for VACUUM and
+ * ANALYZE on the shards. -1 means the settings of the workers are used.
+ */
+int WorkerVacuumCostDelay = -1;
+int WorkerVacuumCostLimit = -1;
+
+
 /* Local functions forward declarations for processing distributed table commands */
 static bool IsDistributedVacuumStmt(int vacuumOptions, List *vacuumRelationIdList);
 static List * VacuumTaskList(Oid relationId, CitusVacuumParams vacuumParams,
@@ -49,6 +66,12 @@ static char * DeparseVacuumColumnNames(List *columnNameList);
 static List * VacuumColumnList(VacuumStmt *vacuumStmt, int relationIndex);
 static List * ExtractVacuumTargetRels(VacuumStmt *vacuumStmt);
 static CitusVacuumParams VacuumStmtParams(VacuumStmt *vacstmt);
+static void ExecuteVacuumTaskList(Oid relationId, List *taskList);
+static char * VacuumCostSettingsCommand(void);
+
+
+PG_FUNCTION_INFO_V1(citus_vacuum_progress);
+
 
 /*
  * PostprocessVacuumStmt processes vacuum statements that may need propagation to
@@ -107,18 +130,100 @@ PostprocessVacuumStmt(VacuumStmt *vacuumStmt, const char *vacuumCommand)
 
 			List *vacuumColumnList = VacuumColumnList(vacuumStmt, relationIndex);
 			List *taskList = VacuumTaskList(relationId, vacuumParams, vacuumColumnList);
-
-			/* local execution is not implemented for VACUUM commands */
-			bool localExecutionSupported = false;
-
-			ExecuteUtilityTaskListWithoutResults(taskList, localExecutionSupported);
+			ExecuteVacuumTaskList(relationId, taskList);
 			executedVacuumCount++;
+
+			/* column statistics of a sample are only built for all columns */
+			if ((vacuumParams.options & VACOPT_ANALYZE) != 0 && vacuumColumnList == NIL)
+			{
+				UpdateCoordinatorStatistics(relationId);
+			}
 		}
 		relationIndex++;
 	}
 }
 
 
+/*
+ * ExecuteVacuumTaskList runs the VACUUM or ANALYZE tasks on the shards of the
+ * given relation. The shards on different nodes are processed in parallel, and
+ * on each node up to citus.max_concurrent_vacuums_per_node shards at a time,
+ * with the cost-based delay settings given by citus.worker_vacuum_cost_delay
+ * and citus.worker_vacuum_cost_limit. The progress on each shard is visible
+ * to other backends through citus_vacuum_progress.
+ */
+static void
+ExecuteVacuumTaskList(Oid relationId, List *taskList)
+{
+	if (taskList == NIL)
+	{
+		return;
+	}
+
+	int targetPoolSize = MaxAdaptiveExecutorPoolSize;
+	if (MaxConcurrentVacuumsPerNode > 0)
+	{
+		targetPoolSize = MaxConcurrentVacuumsPerNode;
+	}
+
+	char *sessionSetupCommand = VacuumCostSettingsCommand();
+
+	/* local execution is not implemented for VACUUM commands */
+	ShardTaskProgressTracker *tracker =
+		StartShardTaskProgress(VACUUM_MAGIC_NUMBER, taskList, relationId);
+
+	ExecuteTaskListWithCallback(ROW_MODIFY_NONE, taskList, targetPoolSize,
+								sessionSetupCommand, ShardTaskProgressTasksCompleted,
+								tracker);
+
+	FinishShardTaskProgress(tracker);
+}
+
+
+/*
+ * VacuumCostSettingsCommand returns the command that applies
+ * citus.worker_vacuum_cost_delay and citus.worker_vacuum_cost_limit to a
+ * connection, or NULL if the settings of the workers should be used.
+ */
+static char *
+VacuumCostSettingsCommand(void)
+{
+	StringInfo command = makeStringInfo();
+
+	if (WorkerVacuumCostDelay >= 0)
+	{
+		appendStringInfo(command, "SET vacuum_cost_delay TO %d;", WorkerVacuumCostDelay);
+	}
+
+	if (WorkerVacuumCostLimit > 0)
+	{
+		appendStringInfo(command, "SET vacuum_cost_limit TO %d;", WorkerVacuumCostLimit);
+	}
+
+	if (command->len == 0)
+	{
+		return NULL;
+	}
+
+	return command->data;
+}
+
+
+/*
+ * citus_vacuum_progress returns the state of every shard of the distributed
+ * VACUUM and ANALYZE commands that are in progress.
+ */
+Datum
+citus_vacuum_progress(PG_FUNCTION_ARGS)
+{
+	CheckCitusVersion(ERROR);
+
+	ShardTaskProgressReturnRows(VACUUM_MAGIC_NUMBER, fcinfo);
+
+	PG_RETURN_VOID();
+}
+
+
 /*
  * IsSupportedDistributedVacuumStmt returns whether distributed execution of a
  * given VacuumStmt is supported. The provided relationId list represents
@@ -132,6 +132,22 @@ PostprocessVariableSetStmt(VariableSetStmt *setStmt, const char *setStmtString)
 		MemoryContextSwitchTo(old_context);
 	}
 
+	if (EnableLazySavepointPropagation)
+	{
+		List *inProgressConnectionList = NIL;
+
+		dlist_foreach(iter, &InProgressTransactions)
+		{
+			MultiConnection *connection =
+				dlist_container(MultiConnection, transactionNode, iter.cur);
+
+			inProgressConnectionList = lappend(inProgressConnectionList, connection);
+		}
+
+		/* SET LOCAL has to be undone when rolling back to the active savepoints */
+		RemoteTransactionsBeginIfNecessary(inProgressConnectionList);
+	}
+
 	/* send text of SET stmt to participating nodes... */
 	dlist_foreach(iter, &InProgressTransactions)
 	{
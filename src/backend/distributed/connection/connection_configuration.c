@@ -10,6 +10,7 @@
 
 #include "postgres.h"
 
+#include "access/xact.h"
 #include "distributed/citus_safe_lib.h"
 #include "distributed/connection_management.h"
 #include "distributed/metadata_cache.h"
@@ -40,6 +41,7 @@ static ConnParamsInfo ConnParams;
 /* helper functions for processing connection info */
 static Size CalculateMaxSize(void);
 static int uri_prefix_length(const char *connstr);
+static char * GetPoolinfoForNode(const char *hostname, int32 port);
 
 /*
  * InitConnParms initializes the ConnParams field to point to enough memory to
@@ -235,7 +237,8 @@ GetConnParams(ConnectionHashKey *key, char ***keywords, char ***values,
 	/*
 	 * This function has three sections:
 	 *   - Initialize the keywords and values (to be copied later) of global parameters
-	 *   - Append user/host-specific parameters calculated from the given key
+	 *   - Append user/host-specific parameters calculated from the given key,
+	 *     pointing to the node's pooler if pg_dist_poolinfo has an entry for it
 	 *   - (Enterprise-only) append user/host-specific authentication params
 	 *
 	 * The global parameters have already been assigned from a GUC, so begin by
@@ -261,6 +264,41 @@ GetConnParams(ConnectionHashKey *key, char ***keywords, char ***values,
 		GetDatabaseEncodingName()
 	};
 
+	/*
+	 * When pg_dist_poolinfo specifies a pooler for the node, we connect to the
+	 * pooler instead. The key, and therefore the connection hash, still refers
+	 * to the node itself.
+	 */
+	PQconninfoOption *poolinfoOptions = NULL;
+	char *poolinfo = GetPoolinfoForNode(key->hostname, key->port);
+	if (poolinfo != NULL)
+	{
+		poolinfoOptions = PQconninfoParse(poolinfo, NULL);
+	}
+
+	for (PQconninfoOption *option = poolinfoOptions;
+		 option != NULL && option->keyword != NULL; option++)
+	{
+		if (option->val == NULL || option->val[0] == '\0')
+		{
+			continue;
+		}
+
+		/* poolinfo_valid only allows these keywords */
+		if (strcmp(option->keyword, "host") == 0)
+		{
+			runtimeValues[0] = option->val;
+		}
+		else if (strcmp(option->keyword, "port") == 0)
+		{
+			runtimeValues[1] = option->val;
+		}
+		else if (strcmp(option->keyword, "dbname") == 0)
+		{
+			runtimeValues[2] = option->val;
+		}
+	}
+
 	/*
 	 * Declare local params for readability;
 	 *
@@ -316,11 +354,39 @@ GetConnParams(ConnectionHashKey *key, char ***keywords, char ***values,
 			MemoryContextStrdup(context, runtimeValues[runtimeParamIndex]);
 	}
 
+	if (poolinfoOptions != NULL)
+	{
+		PQconninfoFree(poolinfoOptions);
+	}
+
 	/* final step: add terminal NULL, required by libpq */
 	connKeywords[authParamsIdx] = connValues[authParamsIdx] = NULL;
 }
 
 
+/*
+ * GetPoolinfoForNode returns the pooler settings from pg_dist_poolinfo for the
+ * node with the given host and port, or NULL if there are none or the metadata
+ * cannot be read.
+ */
+static char *
+GetPoolinfoForNode(const char *hostname, int32 port)
+{
+	if (!IsTransactionState() || !CitusHasBeenLoaded())
+	{
+		return NULL;
+	}
+
+	WorkerNode *workerNode = FindWorkerNode(hostname, port);
+	if (workerNode == NULL)
+	{
+		return NULL;
+	}
+
+	return GetPoolinfoViaCatalog(workerNode->nodeId);
+}
+
+
 /*
  * GetConnParam finds the keyword in the configured connection parameters and returns its
  * value.
@@ -25,12 +25,17 @@
 #include "distributed/log_utils.h"
 #include "distributed/memutils.h"
 #include "distributed/metadata_cache.h"
+#include "distributed/node_health.h"
 #include "distributed/hash_helpers.h"
 #include "distributed/placement_connection.h"
 #include "distributed/run_from_same_connection.h"
 #include "distributed/cancel_utils.h"
 #include "distributed/remote_commands.h"
+#include "distributed/shared_connection_stats.h"
+#include "distributed/stat_counters.h"
 #include "distributed/version_compat.h"
+#include "distributed/wait_sampling.h"
+#include "distributed/worker_manager.h"
 #include "mb/pg_wchar.h"
 #include "portability/instr_time.h"
 #include "utils/hsearch.h"
@@ -39,11 +44,19 @@
 
 int NodeConnectionTimeout = 5000;
 int MaxCachedConnectionsPerWorker = 1;
+bool ReleaseConnectionsAtSharedPoolLimit = true;
+int WarmUpConnectionCount = 0;
 
 HTAB *ConnectionHash = NULL;
 HTAB *ConnParamsHash = NULL;
 MemoryContext ConnectionContext = NULL;
 
+/* whether this backend already warmed up its connection cache */
+static bool ConnectionsWarmedUp = false;
+
+/* exports for SQL callable functions */
+PG_FUNCTION_INFO_V1(citus_warm_up_connections);
+
 static uint32 ConnectionHashHash(const void *key, Size keysize);
 static int ConnectionHashCompare(const void *a, const void *b, Size keysize);
 static MultiConnection * StartConnectionEstablishment(ConnectionHashKey *key);
@@ -57,6 +70,10 @@ static MultiConnection * FindAvailableConnection(dlist_head *connections, uint32
 static void GivePurposeToConnection(MultiConnection *connection, int flags);
 static bool RemoteTransactionIdle(MultiConnection *connection);
 static int EventSetSizeForConnectionList(List *connections);
+static int CachedConnectionCount(const char *hostname, int32 port);
+static void DecrementSharedConnectionCounterForConnection(MultiConnection *connection);
+static bool ConnectionHasRunningCommand(MultiConnection *connection);
+static MultiConnection * StartCancelConnection(MultiConnection *runningConnection);
 
 /* types for async connection management */
 enum MultiConnectionPhase
@@ -170,6 +187,43 @@ AfterXactConnectionHandling(bool isCommit)
 }
 
 
+/*
+ * WaitForPendingCommitPrepared reads the results of the COMMIT PREPARED commands
+ * that were sent without waiting at the end of an earlier transaction, such
+ * that the next statement of the session observes the commits on all workers.
+ */
+void
+WaitForPendingCommitPrepared(void)
+{
+	HASH_SEQ_STATUS status;
+	ConnectionHashEntry *entry;
+
+	if (!CommitPreparedPending)
+	{
+		return;
+	}
+
+	hash_seq_init(&status, ConnectionHash);
+	while ((entry = (ConnectionHashEntry *) hash_seq_search(&status)) != 0)
+	{
+		dlist_iter iter;
+
+		dlist_foreach(iter, entry->connections)
+		{
+			MultiConnection *connection =
+				dlist_container(MultiConnection, connectionNode, iter.cur);
+
+			if (connection->commitPreparedPending)
+			{
+				FinishPendingCommitPrepared(connection);
+			}
+		}
+	}
+
+	CommitPreparedPending = false;
+}
+
+
 /*
  * GetNodeConnection() establishes a connection to remote node, using default
  * user and database.
@@ -248,6 +302,12 @@ StartWorkerListConnections(List *workerNodeList, uint32 flags, const char *user,
  * If user or database are NULL, the current session's defaults are used. The
  * following flags influence connection establishment behaviour:
  * - FORCE_NEW_CONNECTION - a new connection is required
+ * - OPTIONAL_CONNECTION - return NULL instead of a new connection if the node
+ *   already has citus.max_shared_pool_size connections across all backends
+ *
+ * Without OPTIONAL_CONNECTION, the first connection of this backend to a node
+ * waits up to citus.node_connection_timeout for the node to drop below the
+ * limit. Further connections are established without waiting.
  *
  * The returned connection has only been initiated, not fully
  * established. That's useful to allow parallel connection establishment. If
@@ -314,6 +374,7 @@ StartNodeUserDatabaseConnection(uint32 flags, const char *hostname, int32 port,
 		connection = FindAvailableConnection(entry->connections, flags);
 		if (connection)
 		{
+			IncrementStatCounter(STAT_CONNECTION_REUSED);
 			GivePurposeToConnection(connection, flags);
 
 			return connection;
@@ -322,10 +383,32 @@ StartNodeUserDatabaseConnection(uint32 flags, const char *hostname, int32 port,
 
 	/*
 	 * Either no caching desired, or no pre-established, non-claimed,
-	 * connection present. Initiate connection establishment.
+	 * connection present. Before initiating connection establishment,
+	 * make sure the node does not get more connections than allowed by
+	 * citus.max_shared_pool_size across all backends.
 	 */
+	if (flags & OPTIONAL_CONNECTION)
+	{
+		if (!TryToIncrementSharedConnectionCounter(hostname, port))
+		{
+			return NULL;
+		}
+	}
+	else if (dlist_is_empty(entry->connections))
+	{
+		/*
+		 * We do not hold any connection to the node that other backends
+		 * might be waiting for, so it is safe to wait for a slot.
+		 */
+		WaitLoopForSharedConnection(hostname, port);
+	}
+	else
+	{
+		IncrementSharedConnectionCounter(hostname, port);
+	}
 
 	connection = StartConnectionEstablishment(&key);
+	connection->sharedCounterIncremented = true;
 
 	dlist_push_tail(entry->connections, &connection->connectionNode);
 
@@ -336,6 +419,207 @@ StartNodeUserDatabaseConnection(uint32 flags, const char *hostname, int32 port,
 }
 
 
+/*
+ * citus_warm_up_connections opens connections to all active primary nodes
+ * until this backend holds the given number of cached connections to each of
+ * them, and returns the total number of usable cached connections.
+ */
+Datum
+citus_warm_up_connections(PG_FUNCTION_ARGS)
+{
+	int32 connectionCount = PG_GETARG_INT32(0);
+
+	CheckCitusVersion(ERROR);
+
+	if (connectionCount < 0)
+	{
+		ereport(ERROR, (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+						errmsg("connection_count cannot be negative")));
+	}
+
+	int establishedConnectionCount = WarmUpConnections(connectionCount);
+
+	PG_RETURN_INT32(establishedConnectionCount);
+}
+
+
+/*
+ * WarmUpConnectionsIfNeeded warms up the connection cache of the backend
+ * once, before its first distributed query, if citus.warm_up_connection_count
+ * is set. This way the first query does not have to slow start its pools and
+ * pays connection establishment for all nodes at once.
+ */
+void
+WarmUpConnectionsIfNeeded(void)
+{
+	if (ConnectionsWarmedUp || WarmUpConnectionCount == 0)
+	{
+		return;
+	}
+
+	ConnectionsWarmedUp = true;
+
+	/* internal backends do not cache connections, so warming up is pointless */
+	if (application_name != NULL && strcmp(application_name, CITUS_APPLICATION_NAME) == 0)
+	{
+		return;
+	}
+
+	WarmUpConnections(WarmUpConnectionCount);
+}
+
+
+/*
+ * WarmUpConnections establishes connections in parallel to all active primary
+ * nodes other than the local one, until there are connectionCount cached
+ * connections for the current user and database to each of them. The
+ * connections are not claimed and therefore end up in the connection cache at
+ * the end of the transaction.
+ *
+ * Since connections beyond citus.max_cached_conns_per_worker would be closed
+ * at the end of the transaction, connectionCount is capped at that value.
+ * Warm-up connections are optional with respect to citus.max_shared_pool_size,
+ * such that warming up never waits for other backends.
+ *
+ * The function returns the number of usable cached connections, including the
+ * ones that existed before.
+ */
+int
+WarmUpConnections(int connectionCount)
+{
+	List *connectionList = NIL;
+	int establishedConnectionCount = 0;
+	int32 localGroupId = GetLocalGroupId();
+
+	connectionCount = Min(connectionCount, MaxCachedConnectionsPerWorker);
+
+	List *workerNodeList = ActivePrimaryNodeList(NoLock);
+	WorkerNode *workerNode = NULL;
+	foreach_ptr(workerNode, workerNodeList)
+	{
+		if (workerNode->groupId == localGroupId)
+		{
+			/* queries on local shards use local execution */
+			continue;
+		}
+
+		int cachedConnectionCount = CachedConnectionCount(workerNode->workerName,
+														  workerNode->workerPort);
+
+		establishedConnectionCount += Min(cachedConnectionCount, connectionCount);
+
+		for (int connectionIndex = cachedConnectionCount;
+			 connectionIndex < connectionCount;
+			 connectionIndex++)
+		{
+			int connectionFlags = FORCE_NEW_CONNECTION | OPTIONAL_CONNECTION;
+			MultiConnection *connection =
+				StartNodeConnection(connectionFlags, workerNode->workerName,
+									workerNode->workerPort);
+			if (connection == NULL)
+			{
+				/* node is at citus.max_shared_pool_size */
+				break;
+			}
+
+			connectionList = lappend(connectionList, connection);
+		}
+	}
+
+	FinishConnectionListEstablishment(connectionList);
+
+	MultiConnection *connection = NULL;
+	foreach_ptr(connection, connectionList)
+	{
+		if (PQstatus(connection->pgConn) == CONNECTION_OK)
+		{
+			establishedConnectionCount++;
+		}
+	}
+
+	return establishedConnectionCount;
+}
+
+
+/*
+ * CachedConnectionCount returns the number of established connections this
+ * backend holds to the given node for the current user and database that
+ * will survive the end of the transaction.
+ */
+static int
+CachedConnectionCount(const char *hostname, int32 port)
+{
+	ConnectionHashKey key;
+	bool found = false;
+	int connectionCount = 0;
+	dlist_iter iter;
+
+	strlcpy(key.hostname, hostname, MAX_NODE_LENGTH);
+	key.port = port;
+	strlcpy(key.user, CurrentUserName(), NAMEDATALEN);
+	strlcpy(key.database, CurrentDatabaseName(), NAMEDATALEN);
+
+	ConnectionHashEntry *entry = hash_search(ConnectionHash, &key, HASH_FIND, &found);
+	if (!found)
+	{
+		return 0;
+	}
+
+	dlist_foreach(iter, entry->connections)
+	{
+		MultiConnection *connection =
+			dlist_container(MultiConnection, connectionNode, iter.cur);
+
+		if (!connection->forceCloseAtTransactionEnd &&
+			PQstatus(connection->pgConn) == CONNECTION_OK)
+		{
+			connectionCount++;
+		}
+	}
+
+	return connectionCount;
+}
+
+
+/*
+ * NodeConnectionCount returns the number of established connections this
+ * backend currently holds to the given node for the current user and
+ * database, whether or not they are in use.
+ */
+int
+NodeConnectionCount(const char *hostname, int32 port)
+{
+	ConnectionHashKey key;
+	bool found = false;
+	int connectionCount = 0;
+	dlist_iter iter;
+
+	strlcpy(key.hostname, hostname, MAX_NODE_LENGTH);
+	key.port = port;
+	strlcpy(key.user, CurrentUserName(), NAMEDATALEN);
+	strlcpy(key.database, CurrentDatabaseName(), NAMEDATALEN);
+
+	ConnectionHashEntry *entry = hash_search(ConnectionHash, &key, HASH_FIND, &found);
+	if (!found)
+	{
+		return 0;
+	}
+
+	dlist_foreach(iter, entry->connections)
+	{
+		MultiConnection *connection =
+			dlist_container(MultiConnection, connectionNode, iter.cur);
+
+		if (PQstatus(connection->pgConn) == CONNECTION_OK)
+		{
+			connectionCount++;
+		}
+	}
+
+	return connectionCount;
+}
+
+
 /*
  * FindAvailableConnection searches the given list of connections for one that
  * is not claimed exclusively or marked as a side channel. If the caller passed
@@ -468,6 +752,8 @@ CloseConnection(MultiConnection *connection)
 	PQfinish(connection->pgConn);
 	connection->pgConn = NULL;
 
+	DecrementSharedConnectionCounterForConnection(connection);
+
 	strlcpy(key.hostname, connection->hostname, MAX_NODE_LENGTH);
 	key.port = connection->port;
 	strlcpy(key.user, connection->user, NAMEDATALEN);
@@ -485,6 +771,7 @@ CloseConnection(MultiConnection *connection)
 		CloseShardPlacementAssociation(connection);
 
 		/* we leave the per-host entry alive */
+		list_free_deep(connection->preparedStatementList);
 		pfree(connection);
 	}
 	else
@@ -548,6 +835,221 @@ ShutdownConnection(MultiConnection *connection)
 	}
 	PQfinish(connection->pgConn);
 	connection->pgConn = NULL;
+
+	DecrementSharedConnectionCounterForConnection(connection);
+}
+
+
+/*
+ * CancelRunningRemoteCommands cancels the commands that are still running on
+ * the connections of this backend, typically after the distributed query
+ * failed or was cancelled.
+ *
+ * Cancelling the connections one by one via PQcancel() blocks for a network
+ * round trip per connection, which adds up when a query ran on hundreds of
+ * shards. Instead, this function opens a single new connection per node and
+ * calls pg_cancel_backend() for all backends of this backend on that node,
+ * such that all nodes are cancelled in parallel. Both establishing the new
+ * connections and waiting for the commands to be cancelled are bounded by
+ * citus.node_connection_timeout. Connections that are still busy afterwards
+ * are cancelled via PQcancel() when they are shut down.
+ */
+void
+CancelRunningRemoteCommands(void)
+{
+	HASH_SEQ_STATUS status;
+	ConnectionHashEntry *entry = NULL;
+	List *runningConnectionList = NIL;
+	List *nodeConnectionList = NIL;
+	List *backendPidArrayList = NIL;
+	List *cancelConnectionList = NIL;
+	List *cancelCommandList = NIL;
+	bool raiseInterrupts = false;
+
+	if (ConnectionHash == NULL)
+	{
+		return;
+	}
+
+	hash_seq_init(&status, ConnectionHash);
+	while ((entry = (ConnectionHashEntry *) hash_seq_search(&status)) != NULL)
+	{
+		dlist_iter iter;
+		MultiConnection *nodeConnection = NULL;
+		StringInfo backendPidArray = makeStringInfo();
+
+		dlist_foreach(iter, entry->connections)
+		{
+			MultiConnection *connection =
+				dlist_container(MultiConnection, connectionNode, iter.cur);
+
+			if (!ConnectionHasRunningCommand(connection))
+			{
+				continue;
+			}
+
+			appendStringInfo(backendPidArray, "%s%d",
+							 backendPidArray->len > 0 ? "," : "",
+							 PQbackendPID(connection->pgConn));
+
+			if (nodeConnection == NULL)
+			{
+				nodeConnection = connection;
+			}
+
+			runningConnectionList = lappend(runningConnectionList, connection);
+		}
+
+		if (nodeConnection == NULL)
+		{
+			continue;
+		}
+
+		nodeConnectionList = lappend(nodeConnectionList, nodeConnection);
+		backendPidArrayList = lappend(backendPidArrayList, backendPidArray);
+	}
+
+	/* a single command is cancelled just as fast by PQcancel() */
+	if (list_length(runningConnectionList) < 2)
+	{
+		return;
+	}
+
+	/* open the cancel connections after the scan, they go into ConnectionHash */
+	ListCell *nodeConnectionCell = NULL;
+	ListCell *backendPidArrayCell = NULL;
+	forboth(nodeConnectionCell, nodeConnectionList,
+			backendPidArrayCell, backendPidArrayList)
+	{
+		MultiConnection *nodeConnection = lfirst(nodeConnectionCell);
+		StringInfo backendPidArray = lfirst(backendPidArrayCell);
+		StringInfo cancelCommand = makeStringInfo();
+
+		MultiConnection *cancelConnection = StartCancelConnection(nodeConnection);
+		if (cancelConnection == NULL)
+		{
+			continue;
+		}
+
+		appendStringInfo(cancelCommand,
+						 "SELECT pg_catalog.pg_cancel_backend(pid) "
+						 "FROM unnest(ARRAY[%s]::int[]) pid",
+						 backendPidArray->data);
+
+		cancelConnectionList = lappend(cancelConnectionList, cancelConnection);
+		cancelCommandList = lappend(cancelCommandList, cancelCommand->data);
+	}
+
+	if (cancelConnectionList == NIL)
+	{
+		return;
+	}
+
+	/* connect to all nodes in parallel */
+	FinishConnectionListEstablishment(cancelConnectionList);
+
+	List *sentConnectionList = NIL;
+	ListCell *cancelConnectionCell = NULL;
+	ListCell *cancelCommandCell = NULL;
+	forboth(cancelConnectionCell, cancelConnectionList,
+			cancelCommandCell, cancelCommandList)
+	{
+		MultiConnection *cancelConnection = lfirst(cancelConnectionCell);
+		char *cancelCommand = lfirst(cancelCommandCell);
+
+		if (PQstatus(cancelConnection->pgConn) != CONNECTION_OK)
+		{
+			continue;
+		}
+
+		if (SendRemoteCommand(cancelConnection, cancelCommand) == 0)
+		{
+			continue;
+		}
+
+		sentConnectionList = lappend(sentConnectionList, cancelConnection);
+	}
+
+	WaitForAllConnectionsWithTimeout(sentConnectionList, raiseInterrupts,
+									 NodeConnectionTimeout);
+
+	/* give the cancelled commands a chance to report the cancellation */
+	if (sentConnectionList != NIL)
+	{
+		WaitForAllConnectionsWithTimeout(runningConnectionList, raiseInterrupts,
+										 NodeConnectionTimeout);
+	}
+
+	MultiConnection *cancelConnection = NULL;
+	foreach_ptr(cancelConnection, cancelConnectionList)
+	{
+		CloseConnection(cancelConnection);
+	}
+}
+
+
+/*
+ * ConnectionHasRunningCommand returns whether a command is running on the
+ * given connection that can be cancelled. Commands of the two-phase commit
+ * are left alone, since they are handled by transaction recovery.
+ */
+static bool
+ConnectionHasRunningCommand(MultiConnection *connection)
+{
+	RemoteTransactionState transactionState =
+		connection->remoteTransaction.transactionState;
+
+	if (PQstatus(connection->pgConn) != CONNECTION_OK ||
+		PQtransactionStatus(connection->pgConn) != PQTRANS_ACTIVE)
+	{
+		return false;
+	}
+
+	return transactionState != REMOTE_TRANS_PREPARING &&
+		   transactionState != REMOTE_TRANS_PREPARED &&
+		   transactionState != REMOTE_TRANS_1PC_COMMITTING &&
+		   transactionState != REMOTE_TRANS_2PC_COMMITTING;
+}
+
+
+/*
+ * StartCancelConnection starts a new connection to the node of the given
+ * running connection, as the same user and database so pg_cancel_backend()
+ * is permitted. The function returns NULL if the node is known to be down or
+ * the node has no connection slots left.
+ */
+static MultiConnection *
+StartCancelConnection(MultiConnection *runningConnection)
+{
+	uint32 connectionFlags = FORCE_NEW_CONNECTION | OPTIONAL_CONNECTION;
+
+	if (NodeIsKnownToBeDown(runningConnection->hostname, runningConnection->port))
+	{
+		return NULL;
+	}
+
+	return StartNodeUserDatabaseConnection(connectionFlags,
+										   runningConnection->hostname,
+										   runningConnection->port,
+										   runningConnection->user,
+										   runningConnection->database);
+}
+
+
+/*
+ * DecrementSharedConnectionCounterForConnection gives back the slot of a closed
+ * connection in the shared connection stats, if it took one.
+ */
+static void
+DecrementSharedConnectionCounterForConnection(MultiConnection *connection)
+{
+	if (!connection->sharedCounterIncremented)
+	{
+		return;
+	}
+
+	DecrementSharedConnectionCounter(connection->hostname, connection->port);
+	connection->sharedCounterIncremented = false;
 }
 
 
@@ -567,12 +1069,14 @@ MultiConnectionStatePoll(MultiConnectionPollState *connectionState)
 
 	if (status == CONNECTION_OK)
 	{
+		IncrementStatCounter(STAT_CONNECTION_ESTABLISHMENT_SUCCEEDED);
 		connectionState->phase = MULTI_CONNECTION_PHASE_CONNECTED;
 		return true;
 	}
 	else if (status == CONNECTION_BAD)
 	{
 		/* FIXME: retries? */
+		IncrementStatCounter(STAT_CONNECTION_ESTABLISHMENT_FAILED);
 		connectionState->phase = MULTI_CONNECTION_PHASE_ERROR;
 		return true;
 	}
@@ -588,11 +1092,13 @@ MultiConnectionStatePoll(MultiConnectionPollState *connectionState)
 	 */
 	if (connectionState->pollmode == PGRES_POLLING_FAILED)
 	{
+		IncrementStatCounter(STAT_CONNECTION_ESTABLISHMENT_FAILED);
 		connectionState->phase = MULTI_CONNECTION_PHASE_ERROR;
 		return true;
 	}
 	else if (connectionState->pollmode == PGRES_POLLING_OK)
 	{
+		IncrementStatCounter(STAT_CONNECTION_ESTABLISHMENT_SUCCEEDED);
 		connectionState->phase = MULTI_CONNECTION_PHASE_CONNECTED;
 		return true;
 	}
@@ -774,8 +1280,10 @@ FinishConnectionListEstablishment(List *multiConnectionList)
 			}
 		}
 
+		SetCitusWaitState(CITUS_WAIT_CONNECTION_ESTABLISHMENT);
 		int eventCount = WaitEventSetWait(waitEventSet, timeout, events, waitCount,
 										  WAIT_EVENT_CLIENT_READ);
+		SetCitusWaitState(CITUS_WAIT_NONE);
 
 		for (int eventIndex = 0; eventIndex < eventCount; eventIndex++)
 		{
@@ -956,6 +1464,43 @@ UnclaimConnection(MultiConnection *connection)
 }
 
 
+/*
+ * ConnectionHasPreparedStatement returns whether a statement with the given
+ * name was prepared over the connection.
+ */
+bool
+ConnectionHasPreparedStatement(MultiConnection *connection, const char *statementName)
+{
+	char *preparedStatementName = NULL;
+	foreach_ptr(preparedStatementName, connection->preparedStatementList)
+	{
+		if (strcmp(preparedStatementName, statementName) == 0)
+		{
+			return true;
+		}
+	}
+
+	return false;
+}
+
+
+/*
+ * RememberPreparedStatement records that a statement with the given name was
+ * prepared over the connection. Prepared statements are not transactional,
+ * so they live as long as the connection.
+ */
+void
+RememberPreparedStatement(MultiConnection *connection, const char *statementName)
+{
+	MemoryContext oldContext = MemoryContextSwitchTo(ConnectionContext);
+
+	connection->preparedStatementList = lappend(connection->preparedStatementList,
+												pstrdup(statementName));
+
+	MemoryContextSwitchTo(oldContext);
+}
+
+
 static uint32
 ConnectionHashHash(const void *key, Size keysize)
 {
@@ -1031,6 +1576,7 @@ StartConnectionEstablishment(ConnectionHashKey *key)
 	connection->connectionStart = GetCurrentTimestamp();
 	connection->connectionId = connectionId++;
 	connection->purpose = CONNECTION_PURPOSE_ANY;
+	connection->shardAffinityGroup = -1;
 
 	/*
 	 * To avoid issues with interrupts not getting caught all our connections
@@ -1127,6 +1673,7 @@ AfterXactHostConnectionHandling(ConnectionHashEntry *entry, bool isCommit)
 			/* unlink from list */
 			dlist_delete(iter.cur);
 
+			list_free_deep(connection->preparedStatementList);
 			pfree(connection);
 		}
 		else
@@ -1149,6 +1696,8 @@ AfterXactHostConnectionHandling(ConnectionHashEntry *entry, bool isCommit)
  * - Connection is forced to close at the end of transaction
  * - Connection is not in OK state
  * - A transaction is still in progress (usually because we are cancelling a distributed transaction)
+ * - The node reached citus.max_shared_pool_size, such that other backends can
+ *   use the connection slot
  */
 static bool
 ShouldShutdownConnection(MultiConnection *connection, const int cachedConnectionCount)
@@ -1170,7 +1719,9 @@ ShouldShutdownConnection(MultiConnection *connection, const int cachedConnection
 		   cachedConnectionCount >= MaxCachedConnectionsPerWorker ||
 		   connection->forceCloseAtTransactionEnd ||
 		   PQstatus(connection->pgConn) != CONNECTION_OK ||
-		   !RemoteTransactionIdle(connection);
+		   !RemoteTransactionIdle(connection) ||
+		   (ReleaseConnectionsAtSharedPoolLimit &&
+			SharedConnectionLimitReached(connection->hostname, connection->port));
 }
 
 
@@ -1213,6 +1764,12 @@ RemoteTransactionIdle(MultiConnection *connection)
 		return true;
 	}
 
+	if (connection->commitPreparedPending)
+	{
+		/* COMMIT PREPARED is in progress, which does not open a transaction */
+		return true;
+	}
+
 	return PQtransactionStatus(connection->pgConn) == PQTRANS_IDLE;
 }
 
@@ -0,0 +1,398 @@
+/*-------------------------------------------------------------------------
+ *
+ * node_health.c
+ *   Keeps track of the nodes that the maintenance daemon cannot connect to,
+ *   such that the adaptive executor does not wait for
+ *   citus.node_connection_timeout in every backend when a node is down.
+ *
+ *   The maintenance daemon opens a new connection to every active node every
+ *   citus.node_heartbeat_interval and stores the outcome in a shared hash
+ *   keyed by (hostname, port). A node that cannot be reached is checked
+ *   again with an exponential backoff, and is considered down until the
+ *   check after that is overdue, such that the nodes are no longer
+ *   considered down when the checks stop.
+ *
+ * Copyright (c) Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include "postgres.h"
+
+#include "libpq-fe.h"
+#include "miscadmin.h"
+
+#include "distributed/connection_management.h"
+#include "distributed/listutils.h"
+#include "distributed/node_health.h"
+#include "distributed/worker_manager.h"
+#include "storage/ipc.h"
+#include "storage/lwlock.h"
+#include "storage/shmem.h"
+#include "utils/hsearch.h"
+#include "utils/timestamp.h"
+
+
+/* maximum time between checks of a node that is down */
+#define NODE_HEARTBEAT_MAX_BACKOFF_MS 10000
+
+
+/*
+ * NodeHealthControlData contains the lock that protects the health of the
+ * nodes.
+ */
+typedef struct NodeHealthControlData
+{
+	int trancheId;
+	char *lockTrancheName;
+	LWLock lock;
+} NodeHealthControlData;
+
+
+/* hash key for the health of a node */
+typedef struct NodeHealthHashKey
+{
+	char hostname[MAX_NODE_LENGTH];
+	int32 port;
+} NodeHealthHashKey;
+
+
+/* hash entry for the health of a node */
+typedef struct NodeHealthHashEntry
+{
+	NodeHealthHashKey key;
+
+	/* number of checks in a row that could not connect, 0 if the node is up */
+	int failureCount;
+
+	TimestampTz nextCheckTime;
+
+	/* time until which the node is considered down if failureCount > 0 */
+	TimestampTz downUntil;
+} NodeHealthHashEntry;
+
+
+/* GUC, milliseconds between checks of the nodes, 0 disables the checks */
+int NodeHeartbeatInterval = 0;
+
+static shmem_startup_hook_type prev_shmem_startup_hook = NULL;
+static NodeHealthControlData *NodeHealthSharedState = NULL;
+static HTAB *NodeHealthHash = NULL;
+
+
+static size_t NodeHealthShmemSize(void);
+static void NodeHealthShmemInit(void);
+static void BuildNodeHealthHashKey(NodeHealthHashKey *key, const char *hostname,
+								   int port);
+static bool NodeHealthCheckIsDue(WorkerNode *workerNode, TimestampTz currentTime);
+static void RecordNodeHealth(WorkerNode *workerNode, bool nodeIsUp);
+
+
+/*
+ * InitializeNodeHealth, called at server start, requests the shared memory
+ * for the health of the nodes.
+ */
+void
+InitializeNodeHealth(void)
+{
+	if (!IsUnderPostmaster)
+	{
+		RequestAddinShmemSpace(NodeHealthShmemSize());
+	}
+
+	prev_shmem_startup_hook = shmem_startup_hook;
+	shmem_startup_hook = NodeHealthShmemInit;
+}
+
+
+/*
+ * CheckNodeHealth opens a new connection to every active node in pg_dist_node
+ * whose check is due, including the nodes of other clusters, and records
+ * whether the connection could be established within
+ * citus.node_connection_timeout.
+ */
+void
+CheckNodeHealth(void)
+{
+	List *checkedNodeList = NIL;
+	List *connectionList = NIL;
+	bool includeNodesFromOtherClusters = true;
+
+	if (NodeHealthHash == NULL)
+	{
+		return;
+	}
+
+	TimestampTz currentTime = GetCurrentTimestamp();
+	List *nodeList = ReadDistNode(includeNodesFromOtherClusters);
+
+	WorkerNode *workerNode = NULL;
+	foreach_ptr(workerNode, nodeList)
+	{
+		if (!workerNode->isActive || !NodeHealthCheckIsDue(workerNode, currentTime))
+		{
+			continue;
+		}
+
+		/* a cached connection would not tell whether new connections succeed */
+		MultiConnection *connection = StartNodeConnection(FORCE_NEW_CONNECTION,
+														  workerNode->workerName,
+														  workerNode->workerPort);
+
+		checkedNodeList = lappend(checkedNodeList, workerNode);
+		connectionList = lappend(connectionList, connection);
+	}
+
+	if (checkedNodeList == NIL)
+	{
+		return;
+	}
+
+	/* connect in parallel, such that nodes that are down do not add up */
+	FinishConnectionListEstablishment(connectionList);
+
+	ListCell *workerNodeCell = NULL;
+	ListCell *connectionCell = NULL;
+	forboth(workerNodeCell, checkedNodeList, connectionCell, connectionList)
+	{
+		workerNode = (WorkerNode *) lfirst(workerNodeCell);
+		MultiConnection *connection = (MultiConnection *) lfirst(connectionCell);
+
+		bool nodeIsUp = connection->pgConn != NULL &&
+						PQstatus(connection->pgConn) == CONNECTION_OK;
+
+		RecordNodeHealth(workerNode, nodeIsUp);
+
+		CloseConnection(connection);
+	}
+}
+
+
+/*
+ * NodeHealthCheckIsDue returns whether the given node was never checked or
+ * its next check is due.
+ */
+static bool
+NodeHealthCheckIsDue(WorkerNode *workerNode, TimestampTz currentTime)
+{
+	NodeHealthHashKey key;
+	bool entryFound = false;
+	bool checkIsDue = true;
+
+	BuildNodeHealthHashKey(&key, workerNode->workerName, workerNode->workerPort);
+
+	LWLockAcquire(&NodeHealthSharedState->lock, LW_SHARED);
+
+	NodeHealthHashEntry *entry =
+		(NodeHealthHashEntry *) hash_search(NodeHealthHash, &key, HASH_FIND,
+											&entryFound);
+	if (entryFound)
+	{
+		checkIsDue = currentTime >= entry->nextCheckTime;
+	}
+
+	LWLockRelease(&NodeHealthSharedState->lock);
+
+	return checkIsDue;
+}
+
+
+/*
+ * RecordNodeHealth stores the outcome of a check of the given node and
+ * schedules the next check, doubling the time between checks for every
+ * check in a row that could not connect. Nodes that do not fit into the
+ * hash are not tracked and thus never considered down.
+ */
+static void
+RecordNodeHealth(WorkerNode *workerNode, bool nodeIsUp)
+{
+	NodeHealthHashKey key;
+	bool entryFound = false;
+	bool nodeWasDown = false;
+
+	BuildNodeHealthHashKey(&key, workerNode->workerName, workerNode->workerPort);
+
+	TimestampTz currentTime = GetCurrentTimestamp();
+
+	LWLockAcquire(&NodeHealthSharedState->lock, LW_EXCLUSIVE);
+
+	NodeHealthHashEntry *entry =
+		(NodeHealthHashEntry *) hash_search(NodeHealthHash, &key, HASH_ENTER_NULL,
+											&entryFound);
+	if (entry != NULL)
+	{
+		if (!entryFound)
+		{
+			entry->failureCount = 0;
+			entry->downUntil = 0;
+		}
+
+		nodeWasDown = entry->failureCount > 0;
+
+		if (nodeIsUp)
+		{
+			entry->failureCount = 0;
+			entry->nextCheckTime = TimestampTzPlusMilliseconds(currentTime,
+															   NodeHeartbeatInterval);
+			entry->downUntil = 0;
+		}
+		else
+		{
+			int64 backoffMs = NodeHeartbeatInterval;
+
+			entry->failureCount++;
+
+			for (int failureIndex = 1; failureIndex < entry->failureCount &&
+				 backoffMs < NODE_HEARTBEAT_MAX_BACKOFF_MS; failureIndex++)
+			{
+				backoffMs *= 2;
+			}
+
+			backoffMs = Max(Min(backoffMs, NODE_HEARTBEAT_MAX_BACKOFF_MS),
+							NodeHeartbeatInterval);
+
+			/* leave the next check time to connect before the node counts as up */
+			int64 checkDurationMs = NodeHeartbeatInterval + NodeConnectionTimeout;
+
+			entry->nextCheckTime = TimestampTzPlusMilliseconds(currentTime, backoffMs);
+			entry->downUntil = TimestampTzPlusMilliseconds(entry->nextCheckTime,
+														   checkDurationMs);
+		}
+	}
+
+	LWLockRelease(&NodeHealthSharedState->lock);
+
+	if (entry == NULL)
+	{
+		return;
+	}
+
+	if (nodeIsUp && nodeWasDown)
+	{
+		ereport(LOG, (errmsg("node %s:%d is up again", workerNode->workerName,
+							 workerNode->workerPort)));
+	}
+	else if (!nodeIsUp && !nodeWasDown)
+	{
+		ereport(LOG, (errmsg("node %s:%d is down", workerNode->workerName,
+							 workerNode->workerPort),
+					  errdetail("Queries will not wait for connections to the node "
+								"until it is up again.")));
+	}
+}
+
+
+/*
+ * NodeIsKnownToBeDown returns whether the last check of the maintenance
+ * daemon could not connect to the given node and the next check is not
+ * overdue.
+ */
+bool
+NodeIsKnownToBeDown(const char *hostname, int port)
+{
+	NodeHealthHashKey key;
+	bool entryFound = false;
+	bool nodeIsDown = false;
+
+	if (NodeHealthHash == NULL)
+	{
+		return false;
+	}
+
+	BuildNodeHealthHashKey(&key, hostname, port);
+
+	LWLockAcquire(&NodeHealthSharedState->lock, LW_SHARED);
+
+	NodeHealthHashEntry *entry =
+		(NodeHealthHashEntry *) hash_search(NodeHealthHash, &key, HASH_FIND,
+											&entryFound);
+	if (entryFound && entry->failureCount > 0)
+	{
+		nodeIsDown = GetCurrentTimestamp() < entry->downUntil;
+	}
+
+	LWLockRelease(&NodeHealthSharedState->lock);
+
+	return nodeIsDown;
+}
+
+
+/*
+ * BuildNodeHealthHashKey fills in the hash key of the given node.
+ */
+static void
+BuildNodeHealthHashKey(NodeHealthHashKey *key, const char *hostname, int port)
+{
+	memset(key, 0, sizeof(NodeHealthHashKey));
+	strlcpy(key->hostname, hostname, MAX_NODE_LENGTH);
+	key->port = port;
+}
+
+
+/*
+ * NodeHealthShmemSize returns the size of the shared memory needed for the
+ * health of the nodes.
+ */
+static size_t
+NodeHealthShmemSize(void)
+{
+	Size size = 0;
+
+	size = add_size(size, sizeof(NodeHealthControlData));
+
+	Size hashSize = hash_estimate_size(MaxWorkerNodesTracked,
+									   sizeof(NodeHealthHashEntry));
+	size = add_size(size, hashSize);
+
+	return size;
+}
+
+
+/*
+ * NodeHealthShmemInit initializes the shared memory for the health of the
+ * nodes.
+ */
+static void
+NodeHealthShmemInit(void)
+{
+	bool alreadyInitialized = false;
+	HASHCTL info;
+
+	LWLockAcquire(AddinShmemInitLock, LW_EXCLUSIVE);
+
+	NodeHealthSharedState =
+		(NodeHealthControlData *) ShmemInitStruct("Citus Node Health",
+												  sizeof(NodeHealthControlData),
+												  &alreadyInitialized);
+
+	/*
+	 * Might already be initialized on EXEC_BACKEND type platforms that call
+	 * shared library initialization functions in every backend.
+	 */
+	if (!alreadyInitialized)
+	{
+		NodeHealthSharedState->trancheId = LWLockNewTrancheId();
+		NodeHealthSharedState->lockTrancheName = "Citus Node Health";
+		LWLockRegisterTranche(NodeHealthSharedState->trancheId,
+							  NodeHealthSharedState->lockTrancheName);
+
+		LWLockInitialize(&NodeHealthSharedState->lock,
+						 NodeHealthSharedState->trancheId);
+	}
+
+	memset(&info, 0, sizeof(info));
+	info.keysize = sizeof(NodeHealthHashKey);
+	info.entrysize = sizeof(NodeHealthHashEntry);
+	int hashFlags = (HASH_ELEM | HASH_BLOBS);
+
+	NodeHealthHash = ShmemInitHash("Citus Node Health Hash",
+								   MaxWorkerNodesTracked, MaxWorkerNodesTracked,
+								   &info, hashFlags);
+
+	LWLockRelease(AddinShmemInitLock);
+
+	if (prev_shmem_startup_hook != NULL)
+	{
+		prev_shmem_startup_hook();
+	}
+}
@@ -112,6 +112,19 @@ typedef struct ConnectionPlacementHashEntry
 static HTAB *ConnectionPlacementHash;
 
 
+/*
+ * Direct-mapped cache of ConnectionPlacementHash entries, indexed by the
+ * placement id modulo the size of the cache. Every placement access looks up
+ * its entry both to find a connection and to assign the connection, and tasks
+ * of consecutive statements in a transaction usually access the same
+ * placements, so most lookups can skip hashing the placement id. The entries
+ * do not move until they are deleted at the end of the transaction.
+ */
+#define PLACEMENT_ENTRY_CACHE_SIZE 1024
+
+static ConnectionPlacementHashEntry *PlacementEntryCache[PLACEMENT_ENTRY_CACHE_SIZE];
+
+
 /*
  * A hash-table mapping colocated placements to connections. Colocated
  * placements being the set of placements on a single node that represent the
@@ -630,6 +643,13 @@ FindOrCreatePlacementEntry(ShardPlacement *placement)
 {
 	ConnectionPlacementHashKey connKey;
 	bool found = false;
+	int cacheIndex = placement->placementId % PLACEMENT_ENTRY_CACHE_SIZE;
+
+	ConnectionPlacementHashEntry *cachedEntry = PlacementEntryCache[cacheIndex];
+	if (cachedEntry != NULL && cachedEntry->key.placementId == placement->placementId)
+	{
+		return cachedEntry;
+	}
 
 	connKey.placementId = placement->placementId;
 
@@ -695,10 +715,12 @@ FindOrCreatePlacementEntry(ShardPlacement *placement)
 
 			placementEntry->primaryConnection = (ConnectionReference *) conRef;
 		}
+
+		/* record association with shard, for invalidation */
+		AssociatePlacementWithShard(placementEntry, placement);
 	}
 
-	/* record association with shard, for invalidation */
-	AssociatePlacementWithShard(placementEntry, placement);
+	PlacementEntryCache[cacheIndex] = placementEntry;
 
 	return placementEntry;
 }
@@ -849,9 +871,10 @@ AssociatePlacementWithShard(ConnectionPlacementHashEntry *placementEntry,
 	}
 
 	/*
-	 * Check if placement is already associated with shard (happens if there's
-	 * multiple connections for a placement).  There'll usually only be few
-	 * placement per shard, so the price of iterating isn't large.
+	 * Check if placement is already associated with shard. Placements are only
+	 * associated when their entry is created, so this is only a safety net.
+	 * There'll usually only be few placement per shard, so the price of
+	 * iterating isn't large.
 	 */
 	dlist_foreach(placementIter, &shardEntry->placementConnections)
 	{
@@ -925,6 +948,9 @@ ResetPlacementConnectionManagement(void)
 	hash_delete_all(ColocatedPlacementsHash);
 	ResetRelationAccessHash();
 
+	/* the cached entries were deleted along with the hash entries */
+	memset(PlacementEntryCache, 0, sizeof(PlacementEntryCache));
+
 	/*
 	 * NB: memory for ConnectionReference structs and subordinate data is
 	 * deleted by virtue of being allocated in TopTransactionContext.
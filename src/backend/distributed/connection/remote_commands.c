@@ -19,6 +19,7 @@
 #include "distributed/log_utils.h"
 #include "distributed/remote_commands.h"
 #include "distributed/cancel_utils.h"
+#include "distributed/wait_sampling.h"
 #include "lib/stringinfo.h"
 #include "miscadmin.h"
 #include "storage/latch.h"
@@ -34,10 +35,13 @@ bool LogRemoteCommands = false;
 
 static bool ClearResultsInternal(MultiConnection *connection, bool raiseErrors,
 								 bool discardWarnings);
-static bool FinishConnectionIO(MultiConnection *connection, bool raiseInterrupts);
+static bool FinishConnectionIO(MultiConnection *connection, bool raiseInterrupts,
+							   CitusWaitState waitState);
 static WaitEventSet * BuildWaitEventSet(MultiConnection **allConnections,
 										int totalConnectionCount,
 										int pendingConnectionsStartIndex);
+static int ExecuteRemoteCommandListInParallel(List *connectionList, List *commandList,
+											  int elevel, List **failedConnectionList);
 
 
 /* simple helpers */
@@ -370,11 +374,113 @@ LogRemoteCommand(MultiConnection *connection, const char *command)
 void
 ExecuteCriticalRemoteCommandList(MultiConnection *connection, List *commandList)
 {
+	ExecuteCriticalRemoteCommandListInParallel(list_make1(connection), commandList);
+}
+
+
+/*
+ * ExecuteCriticalRemoteCommandListInParallel executes every command in the
+ * commandList over all connections in the connectionList concurrently, such
+ * that the time it takes does not grow with the number of nodes. If a command
+ * fails on any of the connections then the transaction aborts.
+ */
+void
+ExecuteCriticalRemoteCommandListInParallel(List *connectionList, List *commandList)
+{
+	ExecuteRemoteCommandListInParallel(connectionList, commandList, ERROR, NULL);
+}
+
+
+/*
+ * ExecuteOptionalRemoteCommandListInParallel executes every command in the
+ * commandList over all connections in the connectionList concurrently. If a
+ * command fails on a connection, a WARNING is emitted, the connection is added
+ * to failedConnectionList and the remaining commands are not sent over it.
+ *
+ * Like ExecuteOptionalRemoteCommand, it returns 0, QUERY_SEND_FAILED or
+ * RESPONSE_NOT_OKAY, whichever is the worst outcome over all connections.
+ */
+int
+ExecuteOptionalRemoteCommandListInParallel(List *connectionList, List *commandList,
+										   List **failedConnectionList)
+{
+	return ExecuteRemoteCommandListInParallel(connectionList, commandList, WARNING,
+											  failedConnectionList);
+}
+
+
+/*
+ * ExecuteRemoteCommandListInParallel sends each command in the commandList to
+ * all connections that did not fail so far, waits for all of them and only
+ * then sends the next command. Failures are reported at the given elevel.
+ */
+static int
+ExecuteRemoteCommandListInParallel(List *connectionList, List *commandList,
+								   int elevel, List **failedConnectionList)
+{
+	List *activeConnectionList = list_copy(connectionList);
+	bool raiseInterrupts = true;
+	int maxError = RESPONSE_OKAY;
+
 	const char *command = NULL;
 	foreach_ptr(command, commandList)
 	{
-		ExecuteCriticalRemoteCommand(connection, command);
+		List *sentConnectionList = NIL;
+
+		MultiConnection *connection = NULL;
+		foreach_ptr(connection, activeConnectionList)
+		{
+			int querySent = SendRemoteCommand(connection, command);
+			if (querySent == 0)
+			{
+				ReportConnectionError(connection, elevel);
+
+				maxError = Max(maxError, QUERY_SEND_FAILED);
+				if (failedConnectionList != NULL)
+				{
+					*failedConnectionList = lappend(*failedConnectionList, connection);
+				}
+
+				continue;
+			}
+
+			sentConnectionList = lappend(sentConnectionList, connection);
+		}
+
+		/* let the nodes run the command concurrently before reading any result */
+		if (list_length(sentConnectionList) > 1)
+		{
+			WaitForAllConnections(sentConnectionList, raiseInterrupts);
+		}
+
+		activeConnectionList = NIL;
+
+		foreach_ptr(connection, sentConnectionList)
+		{
+			PGresult *result = GetRemoteCommandResult(connection, raiseInterrupts);
+			if (!IsResponseOK(result))
+			{
+				ReportResultError(connection, result, elevel);
+				PQclear(result);
+				ForgetResults(connection);
+
+				maxError = Max(maxError, RESPONSE_NOT_OKAY);
+				if (failedConnectionList != NULL)
+				{
+					*failedConnectionList = lappend(*failedConnectionList, connection);
+				}
+
+				continue;
+			}
+
+			PQclear(result);
+			ForgetResults(connection);
+
+			activeConnectionList = lappend(activeConnectionList, connection);
+		}
 	}
+
+	return maxError;
 }
 
 
@@ -457,11 +563,13 @@ ExecuteOptionalRemoteCommand(MultiConnection *connection, const char *command,
  * send commands asynchronously without blocking (at the potential expense of
  * an additional memory allocation). The command string can only include a single
  * command since PQsendQueryParams() supports only that.
+ *
+ * If binaryResults is true, the results are requested in binary format.
  */
 int
 SendRemoteCommandParams(MultiConnection *connection, const char *command,
 						int parameterCount, const Oid *parameterTypes,
-						const char *const *parameterValues)
+						const char *const *parameterValues, bool binaryResults)
 {
 	PGconn *pgConn = connection->pgConn;
 
@@ -478,8 +586,9 @@ SendRemoteCommandParams(MultiConnection *connection, const char *command,
 
 	Assert(PQisnonblocking(pgConn));
 
+	int resultFormat = binaryResults ? 1 : 0;
 	int rc = PQsendQueryParams(pgConn, command, parameterCount, parameterTypes,
-							   parameterValues, NULL, NULL, 0);
+							   parameterValues, NULL, NULL, resultFormat);
 
 	return rc;
 }
@@ -578,7 +687,7 @@ GetRemoteCommandResult(MultiConnection *connection, bool raiseInterrupts)
 		return PQgetResult(connection->pgConn);
 	}
 
-	if (!FinishConnectionIO(connection, raiseInterrupts))
+	if (!FinishConnectionIO(connection, raiseInterrupts, CITUS_WAIT_REMOTE_RESULT))
 	{
 		/* some error(s) happened while doing the I/O, signal the callers */
 		if (PQstatus(pgConn) == CONNECTION_BAD)
@@ -639,7 +748,7 @@ PutRemoteCopyData(MultiConnection *connection, const char *buffer, int nbytes)
 	if (connection->copyBytesWrittenSinceLastFlush > MAX_PUT_COPY_DATA_BUFFER_SIZE)
 	{
 		connection->copyBytesWrittenSinceLastFlush = 0;
-		return FinishConnectionIO(connection, allowInterrupts);
+		return FinishConnectionIO(connection, allowInterrupts, CITUS_WAIT_COPY);
 	}
 
 	return true;
@@ -675,13 +784,13 @@ PutRemoteCopyEnd(MultiConnection *connection, const char *errormsg)
 
 	connection->copyBytesWrittenSinceLastFlush = 0;
 
-	return FinishConnectionIO(connection, allowInterrupts);
+	return FinishConnectionIO(connection, allowInterrupts, CITUS_WAIT_COPY);
 }
 
 
 /*
  * FinishConnectionIO performs pending IO for the connection, while accepting
- * interrupts.
+ * interrupts. While waiting, waitState is shown in the wait event samples.
  *
  * See GetRemoteCommandResult() for documentation of interrupt handling
  * behaviour.
@@ -689,7 +798,8 @@ PutRemoteCopyEnd(MultiConnection *connection, const char *errormsg)
  * Returns true if IO was successfully completed, false otherwise.
  */
 static bool
-FinishConnectionIO(MultiConnection *connection, bool raiseInterrupts)
+FinishConnectionIO(MultiConnection *connection, bool raiseInterrupts,
+				   CitusWaitState waitState)
 {
 	PGconn *pgConn = connection->pgConn;
 	int sock = PQsocket(pgConn);
@@ -736,7 +846,10 @@ FinishConnectionIO(MultiConnection *connection, bool raiseInterrupts)
 			return true;
 		}
 
+		SetCitusWaitState(waitState);
 		int rc = WaitLatchOrSocket(MyLatch, waitFlags, sock, 0, PG_WAIT_EXTENSION);
+		SetCitusWaitState(CITUS_WAIT_NONE);
+
 		if (rc & WL_POSTMASTER_DEATH)
 		{
 			ereport(ERROR, (errmsg("postmaster was shut down, exiting")));
@@ -769,6 +882,46 @@ FinishConnectionIO(MultiConnection *connection, bool raiseInterrupts)
 }
 
 
+/*
+ * FinishConnectionSend blocks until all data that was queued for the given
+ * connection has been sent, without waiting for the results of the commands.
+ * The function returns false if sending failed.
+ */
+bool
+FinishConnectionSend(MultiConnection *connection)
+{
+	PGconn *pgConn = connection->pgConn;
+	int sock = PQsocket(pgConn);
+
+	Assert(PQisnonblocking(pgConn));
+
+	while (true)
+	{
+		int sendStatus = PQflush(pgConn);
+		if (sendStatus == -1)
+		{
+			return false;
+		}
+		else if (sendStatus == 0)
+		{
+			return true;
+		}
+
+		int rc = WaitLatchOrSocket(MyLatch, WL_POSTMASTER_DEATH | WL_LATCH_SET |
+								   WL_SOCKET_WRITEABLE, sock, 0, PG_WAIT_EXTENSION);
+		if (rc & WL_POSTMASTER_DEATH)
+		{
+			ereport(ERROR, (errmsg("postmaster was shut down, exiting")));
+		}
+
+		if (rc & WL_LATCH_SET)
+		{
+			ResetLatch(MyLatch);
+		}
+	}
+}
+
+
 /*
  * WaitForAllConnections blocks until all connections in the list are no
  * longer busy, meaning the pending command has either finished or failed.
@@ -776,6 +929,23 @@ FinishConnectionIO(MultiConnection *connection, bool raiseInterrupts)
 void
 WaitForAllConnections(List *connectionList, bool raiseInterrupts)
 {
+	long timeoutMs = -1;
+
+	WaitForAllConnectionsWithTimeout(connectionList, raiseInterrupts, timeoutMs);
+}
+
+
+/*
+ * WaitForAllConnectionsWithTimeout is like WaitForAllConnections, but stops
+ * waiting after timeoutMs milliseconds unless timeoutMs is -1. The function
+ * returns whether all connections are no longer busy.
+ */
+bool
+WaitForAllConnectionsWithTimeout(List *connectionList, bool raiseInterrupts,
+								 long timeoutMs)
+{
+	bool allConnectionsDone = false;
+	instr_time waitStartTime;
 	int totalConnectionCount = list_length(connectionList);
 	int pendingConnectionsStartIndex = 0;
 	int connectionIndex = 0;
@@ -810,6 +980,8 @@ WaitForAllConnections(List *connectionList, bool raiseInterrupts)
 		}
 	}
 
+	INSTR_TIME_SET_CURRENT(waitStartTime);
+
 	PG_TRY();
 	{
 		bool rebuildWaitEventSet = true;
@@ -819,6 +991,16 @@ WaitForAllConnections(List *connectionList, bool raiseInterrupts)
 			bool cancellationReceived = false;
 			int eventIndex = 0;
 			long timeout = -1;
+
+			if (timeoutMs >= 0)
+			{
+				timeout = MillisecondsToTimeout(waitStartTime, timeoutMs);
+				if (timeout <= 0)
+				{
+					break;
+				}
+			}
+
 			int pendingConnectionCount = totalConnectionCount -
 										 pendingConnectionsStartIndex;
 
@@ -837,9 +1019,11 @@ WaitForAllConnections(List *connectionList, bool raiseInterrupts)
 			}
 
 			/* wait for I/O events */
+			SetCitusWaitState(CITUS_WAIT_REMOTE_RESULT);
 			int eventCount = WaitEventSetWait(waitEventSet, timeout, events,
 											  pendingConnectionCount,
 											  WAIT_EVENT_CLIENT_READ);
+			SetCitusWaitState(CITUS_WAIT_NONE);
 
 			/* process I/O events */
 			for (; eventIndex < eventCount; eventIndex++)
@@ -968,6 +1152,8 @@ WaitForAllConnections(List *connectionList, bool raiseInterrupts)
 			}
 		}
 
+		allConnectionsDone = pendingConnectionsStartIndex >= totalConnectionCount;
+
 		if (waitEventSet != NULL)
 		{
 			FreeWaitEventSet(waitEventSet);
@@ -994,6 +1180,8 @@ WaitForAllConnections(List *connectionList, bool raiseInterrupts)
 		PG_RE_THROW();
 	}
 	PG_END_TRY();
+
+	return allConnectionsDone;
 }
 
 
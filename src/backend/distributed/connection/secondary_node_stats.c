@@ -0,0 +1,402 @@
+/*-------------------------------------------------------------------------
+ *
+ * secondary_node_stats.c
+ *   Keeps track of the replication lag and the load of the secondary nodes,
+ *   such that citus.use_secondary_nodes = 'always' can route reads to a
+ *   secondary that is within citus.max_secondary_replication_lag.
+ *
+ *   The maintenance daemon periodically asks every secondary how far its
+ *   replay is behind and how many client backends are active on it, and
+ *   stores the answers in a shared hash keyed by (hostname, port). Backends
+ *   that plan a read pick the least loaded secondary of the node group whose
+ *   lag is within the bound, where the time since the last check counts as
+ *   additional lag such that the bound also holds when checks stop.
+ *
+ * Copyright (c) Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include "postgres.h"
+
+#include "libpq-fe.h"
+#include "miscadmin.h"
+
+#include "distributed/connection_management.h"
+#include "distributed/listutils.h"
+#include "distributed/remote_commands.h"
+#include "distributed/secondary_node_stats.h"
+#include "distributed/worker_manager.h"
+#include "storage/ipc.h"
+#include "storage/lwlock.h"
+#include "storage/shmem.h"
+#include "utils/hsearch.h"
+#include "utils/timestamp.h"
+
+
+/*
+ * Query that returns whether the node is still a standby, how many
+ * milliseconds its replay is behind and the number of active client
+ * backends. A standby that replayed all WAL it received is not behind,
+ * otherwise the lag is the time since the last replayed commit.
+ */
+#define SECONDARY_NODE_STATS_QUERY \
+	"SELECT pg_is_in_recovery(), " \
+	"CASE WHEN pg_last_wal_receive_lsn() = pg_last_wal_replay_lsn() THEN 0 " \
+	"ELSE extract(epoch FROM now() - pg_last_xact_replay_timestamp()) * 1000 END, " \
+	"(SELECT count(*) FROM pg_stat_activity " \
+	"WHERE state = 'active' AND backend_type = 'client backend')"
+
+
+/*
+ * SecondaryNodeStatsControlData contains the lock that protects the stats of
+ * the secondaries.
+ */
+typedef struct SecondaryNodeStatsControlData
+{
+	int trancheId;
+	char *lockTrancheName;
+	LWLock lock;
+} SecondaryNodeStatsControlData;
+
+
+/* hash key for the stats of a secondary */
+typedef struct SecondaryNodeStatsHashKey
+{
+	char hostname[MAX_NODE_LENGTH];
+	int32 port;
+} SecondaryNodeStatsHashKey;
+
+
+/* hash entry for the stats of a secondary, as of the last check */
+typedef struct SecondaryNodeStatsHashEntry
+{
+	SecondaryNodeStatsHashKey key;
+
+	/* false if the check failed or the node is no longer in recovery */
+	bool replicating;
+
+	double replicationLagMs;
+	int activeBackendCount;
+	TimestampTz checkTime;
+} SecondaryNodeStatsHashEntry;
+
+
+/*
+ * GUC, the maximum replication lag in milliseconds of the secondaries that
+ * reads are routed to. -1 routes reads to the first secondary of the group,
+ * regardless of its lag.
+ */
+int MaxSecondaryReplicationLag = DISABLE_SECONDARY_LAG_ROUTING;
+
+/* GUC, milliseconds between checks of the secondaries, 0 disables the checks */
+int SecondaryNodeCheckInterval = 5000;
+
+static shmem_startup_hook_type prev_shmem_startup_hook = NULL;
+static SecondaryNodeStatsControlData *SecondaryNodeStatsSharedState = NULL;
+static HTAB *SecondaryNodeStatsHash = NULL;
+
+
+static size_t SecondaryNodeStatsShmemSize(void);
+static void SecondaryNodeStatsShmemInit(void);
+static void BuildSecondaryNodeStatsHashKey(SecondaryNodeStatsHashKey *key,
+										   WorkerNode *workerNode);
+static bool CheckSecondaryNode(MultiConnection *connection,
+							   SecondaryNodeStatsHashEntry *stats);
+static void StoreSecondaryNodeStats(WorkerNode *workerNode,
+									SecondaryNodeStatsHashEntry *stats);
+
+
+/*
+ * InitializeSecondaryNodeStats, called at server start, requests the shared
+ * memory for the stats of the secondaries.
+ */
+void
+InitializeSecondaryNodeStats(void)
+{
+	if (!IsUnderPostmaster)
+	{
+		RequestAddinShmemSpace(SecondaryNodeStatsShmemSize());
+	}
+
+	prev_shmem_startup_hook = shmem_startup_hook;
+	shmem_startup_hook = SecondaryNodeStatsShmemInit;
+}
+
+
+/*
+ * CheckSecondaryNodes connects to all active secondaries in pg_dist_node,
+ * including the ones of other clusters, and stores their replication lag and
+ * load. Secondaries that cannot be checked are stored as not replicating,
+ * such that no reads are routed to them.
+ */
+void
+CheckSecondaryNodes(void)
+{
+	List *secondaryNodeList = NIL;
+	List *connectionList = NIL;
+	bool includeNodesFromOtherClusters = true;
+
+	if (SecondaryNodeStatsHash == NULL)
+	{
+		return;
+	}
+
+	List *nodeList = ReadDistNode(includeNodesFromOtherClusters);
+
+	WorkerNode *workerNode = NULL;
+	foreach_ptr(workerNode, nodeList)
+	{
+		if (!workerNode->isActive || !NodeIsSecondary(workerNode))
+		{
+			continue;
+		}
+
+		MultiConnection *connection = StartNodeConnection(0, workerNode->workerName,
+														  workerNode->workerPort);
+
+		secondaryNodeList = lappend(secondaryNodeList, workerNode);
+		connectionList = lappend(connectionList, connection);
+	}
+
+	if (secondaryNodeList == NIL)
+	{
+		return;
+	}
+
+	/* connect in parallel, such that unreachable secondaries do not add up */
+	FinishConnectionListEstablishment(connectionList);
+
+	ListCell *workerNodeCell = NULL;
+	ListCell *connectionCell = NULL;
+	forboth(workerNodeCell, secondaryNodeList, connectionCell, connectionList)
+	{
+		SecondaryNodeStatsHashEntry stats;
+
+		workerNode = (WorkerNode *) lfirst(workerNodeCell);
+		MultiConnection *connection = (MultiConnection *) lfirst(connectionCell);
+
+		memset(&stats, 0, sizeof(stats));
+
+		if (!CheckSecondaryNode(connection, &stats))
+		{
+			ereport(DEBUG1, (errmsg("could not check the replication lag of "
+									"secondary %s:%d", workerNode->workerName,
+									workerNode->workerPort)));
+		}
+
+		stats.checkTime = GetCurrentTimestamp();
+
+		StoreSecondaryNodeStats(workerNode, &stats);
+	}
+}
+
+
+/*
+ * CheckSecondaryNode runs the stats query over the given connection and
+ * fills in the stats from its result. It returns false if the connection
+ * failed or the query did not return the expected result.
+ */
+static bool
+CheckSecondaryNode(MultiConnection *connection, SecondaryNodeStatsHashEntry *stats)
+{
+	PGresult *result = NULL;
+
+	if (connection->pgConn == NULL || PQstatus(connection->pgConn) != CONNECTION_OK)
+	{
+		return false;
+	}
+
+	int queryResult = ExecuteOptionalRemoteCommand(connection,
+												   SECONDARY_NODE_STATS_QUERY,
+												   &result);
+	if (queryResult != RESPONSE_OKAY)
+	{
+		return false;
+	}
+
+	bool resultIsValid = PQntuples(result) == 1 && PQnfields(result) == 3 &&
+						 !PQgetisnull(result, 0, 0) && !PQgetisnull(result, 0, 1);
+	if (resultIsValid)
+	{
+		stats->replicating = strcmp(PQgetvalue(result, 0, 0), "t") == 0;
+		stats->replicationLagMs = Max(strtod(PQgetvalue(result, 0, 1), NULL), 0.0);
+		stats->activeBackendCount = pg_atoi(PQgetvalue(result, 0, 2), sizeof(int32), 0);
+	}
+
+	PQclear(result);
+	ForgetResults(connection);
+
+	return resultIsValid;
+}
+
+
+/*
+ * StoreSecondaryNodeStats stores the stats of the given secondary in the
+ * shared hash. Secondaries that do not fit into the hash are not stored,
+ * such that no reads are routed to them.
+ */
+static void
+StoreSecondaryNodeStats(WorkerNode *workerNode, SecondaryNodeStatsHashEntry *stats)
+{
+	bool entryFound = false;
+
+	BuildSecondaryNodeStatsHashKey(&stats->key, workerNode);
+
+	LWLockAcquire(&SecondaryNodeStatsSharedState->lock, LW_EXCLUSIVE);
+
+	SecondaryNodeStatsHashEntry *entry =
+		(SecondaryNodeStatsHashEntry *) hash_search(SecondaryNodeStatsHash,
+													&stats->key, HASH_ENTER_NULL,
+													&entryFound);
+	if (entry != NULL)
+	{
+		*entry = *stats;
+	}
+
+	LWLockRelease(&SecondaryNodeStatsSharedState->lock);
+}
+
+
+/*
+ * ChooseSecondaryNode returns the secondary in the given list with the
+ * fewest active backends among the ones whose replication lag is within
+ * citus.max_secondary_replication_lag, preferring the one with the lowest
+ * lag when they are equally loaded. The time since the last check is added
+ * to the lag, since the secondary might have fallen behind in the meantime.
+ * It returns NULL if no secondary is within the bound.
+ */
+WorkerNode *
+ChooseSecondaryNode(List *secondaryNodeList)
+{
+	WorkerNode *chosenNode = NULL;
+	double chosenLagMs = 0.0;
+	int chosenBackendCount = 0;
+
+	if (SecondaryNodeStatsHash == NULL)
+	{
+		return NULL;
+	}
+
+	TimestampTz currentTime = GetCurrentTimestamp();
+
+	LWLockAcquire(&SecondaryNodeStatsSharedState->lock, LW_SHARED);
+
+	WorkerNode *workerNode = NULL;
+	foreach_ptr(workerNode, secondaryNodeList)
+	{
+		SecondaryNodeStatsHashKey key;
+		bool entryFound = false;
+
+		BuildSecondaryNodeStatsHashKey(&key, workerNode);
+
+		SecondaryNodeStatsHashEntry *entry =
+			(SecondaryNodeStatsHashEntry *) hash_search(SecondaryNodeStatsHash, &key,
+														HASH_FIND, &entryFound);
+		if (!entryFound || !entry->replicating)
+		{
+			continue;
+		}
+
+		double lagMs = entry->replicationLagMs +
+					   (double) (currentTime - entry->checkTime) / 1000.0;
+		if (lagMs > MaxSecondaryReplicationLag)
+		{
+			continue;
+		}
+
+		if (chosenNode == NULL ||
+			entry->activeBackendCount < chosenBackendCount ||
+			(entry->activeBackendCount == chosenBackendCount && lagMs < chosenLagMs))
+		{
+			chosenNode = workerNode;
+			chosenLagMs = lagMs;
+			chosenBackendCount = entry->activeBackendCount;
+		}
+	}
+
+	LWLockRelease(&SecondaryNodeStatsSharedState->lock);
+
+	return chosenNode;
+}
+
+
+/*
+ * BuildSecondaryNodeStatsHashKey fills in the hash key of the given node.
+ */
+static void
+BuildSecondaryNodeStatsHashKey(SecondaryNodeStatsHashKey *key, WorkerNode *workerNode)
+{
+	memset(key, 0, sizeof(SecondaryNodeStatsHashKey));
+	strlcpy(key->hostname, workerNode->workerName, MAX_NODE_LENGTH);
+	key->port = workerNode->workerPort;
+}
+
+
+/*
+ * SecondaryNodeStatsShmemSize returns the size of the shared memory needed
+ * for the stats of the secondaries.
+ */
+static size_t
+SecondaryNodeStatsShmemSize(void)
+{
+	Size size = 0;
+
+	size = add_size(size, sizeof(SecondaryNodeStatsControlData));
+
+	Size hashSize = hash_estimate_size(MaxWorkerNodesTracked,
+									   sizeof(SecondaryNodeStatsHashEntry));
+	size = add_size(size, hashSize);
+
+	return size;
+}
+
+
+/*
+ * SecondaryNodeStatsShmemInit initializes the shared memory for the stats of
+ * the secondaries.
+ */
+static void
+SecondaryNodeStatsShmemInit(void)
+{
+	bool alreadyInitialized = false;
+	HASHCTL info;
+
+	LWLockAcquire(AddinShmemInitLock, LW_EXCLUSIVE);
+
+	SecondaryNodeStatsSharedState =
+		(SecondaryNodeStatsControlData *) ShmemInitStruct(
+			"Citus Secondary Node Stats", sizeof(SecondaryNodeStatsControlData),
+			&alreadyInitialized);
+
+	/*
+	 * Might already be initialized on EXEC_BACKEND type platforms that call
+	 * shared library initialization functions in every backend.
+	 */
+	if (!alreadyInitialized)
+	{
+		SecondaryNodeStatsSharedState->trancheId = LWLockNewTrancheId();
+		SecondaryNodeStatsSharedState->lockTrancheName = "Citus Secondary Node Stats";
+		LWLockRegisterTranche(SecondaryNodeStatsSharedState->trancheId,
+							  SecondaryNodeStatsSharedState->lockTrancheName);
+
+		LWLockInitialize(&SecondaryNodeStatsSharedState->lock,
+						 SecondaryNodeStatsSharedState->trancheId);
+	}
+
+	memset(&info, 0, sizeof(info));
+	info.keysize = sizeof(SecondaryNodeStatsHashKey);
+	info.entrysize = sizeof(SecondaryNodeStatsHashEntry);
+	int hashFlags = (HASH_ELEM | HASH_BLOBS);
+
+	SecondaryNodeStatsHash = ShmemInitHash("Citus Secondary Node Stats Hash",
+										   MaxWorkerNodesTracked, MaxWorkerNodesTracked,
+										   &info, hashFlags);
+
+	LWLockRelease(AddinShmemInitLock);
+
+	if (prev_shmem_startup_hook != NULL)
+	{
+		prev_shmem_startup_hook();
+	}
+}
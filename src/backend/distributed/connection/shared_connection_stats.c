@@ -0,0 +1,501 @@
+/*-------------------------------------------------------------------------
+ *
+ * shared_connection_stats.c
+ *   Keeps track of the number of connections to each node across all
+ *   backends, such that the total number of connections to a node can be
+ *   limited by citus.max_shared_pool_size.
+ *
+ *   Every backend counts the connections it establishes in a shared hash
+ *   keyed by (hostname, port). Connections that are required for the
+ *   operation to proceed are always counted, possibly after waiting for
+ *   other backends to close theirs, while optional connections, such as
+ *   the additional connections the adaptive executor opens for parallelism,
+ *   are only established if the node is below the limit.
+ *
+ *   The connection slots of a node are shared by the backends, in that a
+ *   backend does not keep its connections to a node that reached the limit
+ *   open after its transaction, such that waiting backends can take over
+ *   the slots instead of every backend holding on to its own connections.
+ *
+ * Copyright (c) Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include "postgres.h"
+#include "pgstat.h"
+
+#include "miscadmin.h"
+
+#include "distributed/connection_management.h"
+#include "distributed/shared_connection_stats.h"
+#include "distributed/worker_manager.h"
+#include "distributed/wait_sampling.h"
+#include "portability/instr_time.h"
+#include "storage/ipc.h"
+#include "storage/latch.h"
+#include "storage/lwlock.h"
+#include "storage/shmem.h"
+#include "utils/hsearch.h"
+#include "utils/memutils.h"
+
+
+/* time to sleep between attempts to reserve a connection to a busy node */
+#define SHARED_CONNECTION_RETRY_INTERVAL_MS 10
+
+
+/*
+ * SharedConnStatsControlData contains the lock that protects the shared
+ * connection counters.
+ */
+typedef struct SharedConnStatsControlData
+{
+	int trancheId;
+	char *lockTrancheName;
+	LWLock lock;
+} SharedConnStatsControlData;
+
+
+/* hash key for the connection counters, we count per node */
+typedef struct SharedConnStatsHashKey
+{
+	char hostname[MAX_NODE_LENGTH];
+	int32 port;
+} SharedConnStatsHashKey;
+
+
+/* hash entry for the connection counters */
+typedef struct SharedConnStatsHashEntry
+{
+	SharedConnStatsHashKey key;
+
+	int connectionCount;
+} SharedConnStatsHashEntry;
+
+
+/*
+ * GUC, the maximum number of connections to each node across all backends.
+ * 0 means that the limit is max_connections of the local node, and -1 disables
+ * throttling.
+ */
+int MaxSharedPoolSize = 0;
+
+static shmem_startup_hook_type prev_shmem_startup_hook = NULL;
+static SharedConnStatsControlData *ConnectionStatsSharedState = NULL;
+
+/* shared counters of all backends */
+static HTAB *SharedConnStatsHash = NULL;
+
+/*
+ * Connections counted by this backend, such that we can give them back when
+ * the backend exits without closing them one by one.
+ */
+static HTAB *LocalConnStatsHash = NULL;
+
+
+static size_t SharedConnectionStatsShmemSize(void);
+static void SharedConnectionStatsShmemInit(void);
+static void InitializeLocalConnStatsHash(void);
+static void BuildSharedConnStatsHashKey(SharedConnStatsHashKey *key,
+										const char *hostname, int port);
+static bool UpdateSharedConnectionCounter(const char *hostname, int port,
+										  bool checkLimit);
+static void SharedConnectionStatsBackendExit(int code, Datum arg);
+
+
+/*
+ * InitializeSharedConnectionStats, called at server start, requests the shared
+ * memory for the connection counters.
+ */
+void
+InitializeSharedConnectionStats(void)
+{
+	if (!IsUnderPostmaster)
+	{
+		RequestAddinShmemSpace(SharedConnectionStatsShmemSize());
+	}
+
+	prev_shmem_startup_hook = shmem_startup_hook;
+	shmem_startup_hook = SharedConnectionStatsShmemInit;
+}
+
+
+/*
+ * GetMaxSharedPoolSize returns the effective maximum number of connections to
+ * each node across all backends.
+ */
+int
+GetMaxSharedPoolSize(void)
+{
+	if (MaxSharedPoolSize == 0)
+	{
+		/* assume the other nodes are configured like this one */
+		return MaxConnections;
+	}
+
+	return MaxSharedPoolSize;
+}
+
+
+/*
+ * TryToIncrementSharedConnectionCounter counts a new connection to the given
+ * node if the node has not yet reached citus.max_shared_pool_size connections
+ * and returns whether it did.
+ */
+bool
+TryToIncrementSharedConnectionCounter(const char *hostname, int port)
+{
+	bool checkLimit = true;
+
+	return UpdateSharedConnectionCounter(hostname, port, checkLimit);
+}
+
+
+/*
+ * IncrementSharedConnectionCounter counts a new connection to the given node,
+ * even if that exceeds citus.max_shared_pool_size.
+ */
+void
+IncrementSharedConnectionCounter(const char *hostname, int port)
+{
+	bool checkLimit = false;
+
+	UpdateSharedConnectionCounter(hostname, port, checkLimit);
+}
+
+
+/*
+ * WaitLoopForSharedConnection counts a new connection to the given node once
+ * other backends have closed enough connections to the node to stay within
+ * citus.max_shared_pool_size. We prefer slow queries over failing queries, so
+ * if no connection is closed within citus.node_connection_timeout, we count
+ * the connection anyway.
+ */
+void
+WaitLoopForSharedConnection(const char *hostname, int port)
+{
+	instr_time waitStart;
+
+	INSTR_TIME_SET_CURRENT(waitStart);
+
+	while (!TryToIncrementSharedConnectionCounter(hostname, port))
+	{
+		if (MillisecondsPassedSince(waitStart) >= NodeConnectionTimeout)
+		{
+			ereport(DEBUG1, (errmsg("exceeding citus.max_shared_pool_size for %s:%d "
+									"after waiting %d ms", hostname, port,
+									NodeConnectionTimeout)));
+
+			IncrementSharedConnectionCounter(hostname, port);
+			break;
+		}
+
+		SetCitusWaitState(CITUS_WAIT_CONNECTION_SLOT);
+		int rc = WaitLatch(MyLatch, WL_LATCH_SET | WL_TIMEOUT | WL_POSTMASTER_DEATH,
+						   SHARED_CONNECTION_RETRY_INTERVAL_MS, PG_WAIT_EXTENSION);
+		SetCitusWaitState(CITUS_WAIT_NONE);
+		ResetLatch(MyLatch);
+
+		/* emergency bailout if postmaster has died */
+		if (rc & WL_POSTMASTER_DEATH)
+		{
+			proc_exit(1);
+		}
+
+		CHECK_FOR_INTERRUPTS();
+	}
+}
+
+
+/*
+ * DecrementSharedConnectionCounter gives back a connection to the given node
+ * that was counted by this backend.
+ */
+void
+DecrementSharedConnectionCounter(const char *hostname, int port)
+{
+	SharedConnStatsHashKey key;
+	bool found = false;
+
+	if (LocalConnStatsHash == NULL)
+	{
+		/* no connections were counted, or the backend is exiting */
+		return;
+	}
+
+	BuildSharedConnStatsHashKey(&key, hostname, port);
+
+	SharedConnStatsHashEntry *localEntry =
+		hash_search(LocalConnStatsHash, &key, HASH_FIND, &found);
+	if (!found || localEntry->connectionCount <= 0)
+	{
+		return;
+	}
+
+	localEntry->connectionCount--;
+
+	LWLockAcquire(&ConnectionStatsSharedState->lock, LW_EXCLUSIVE);
+
+	SharedConnStatsHashEntry *sharedEntry =
+		hash_search(SharedConnStatsHash, &key, HASH_FIND, &found);
+	if (found && sharedEntry->connectionCount > 0)
+	{
+		sharedEntry->connectionCount--;
+	}
+
+	LWLockRelease(&ConnectionStatsSharedState->lock);
+}
+
+
+/*
+ * SharedConnectionLimitReached returns whether the given node has reached
+ * citus.max_shared_pool_size connections across all backends, in which case
+ * backends that need a new connection to the node have to wait for others.
+ */
+bool
+SharedConnectionLimitReached(const char *hostname, int port)
+{
+	SharedConnStatsHashKey key;
+	bool found = false;
+	bool limitReached = false;
+	int maxSharedPoolSize = GetMaxSharedPoolSize();
+
+	if (maxSharedPoolSize == DISABLE_CONNECTION_THROTTLING)
+	{
+		return false;
+	}
+
+	BuildSharedConnStatsHashKey(&key, hostname, port);
+
+	LWLockAcquire(&ConnectionStatsSharedState->lock, LW_SHARED);
+
+	SharedConnStatsHashEntry *sharedEntry =
+		hash_search(SharedConnStatsHash, &key, HASH_FIND, &found);
+	if (found && sharedEntry->connectionCount >= maxSharedPoolSize)
+	{
+		limitReached = true;
+	}
+
+	LWLockRelease(&ConnectionStatsSharedState->lock);
+
+	return limitReached;
+}
+
+
+/*
+ * UpdateSharedConnectionCounter counts a new connection to the given node, if
+ * checkLimit is false or the node is below citus.max_shared_pool_size, and
+ * returns whether the connection was counted.
+ */
+static bool
+UpdateSharedConnectionCounter(const char *hostname, int port, bool checkLimit)
+{
+	SharedConnStatsHashKey key;
+	bool found = false;
+	bool counted = false;
+	int maxSharedPoolSize = GetMaxSharedPoolSize();
+
+	if (maxSharedPoolSize == DISABLE_CONNECTION_THROTTLING)
+	{
+		checkLimit = false;
+	}
+
+	InitializeLocalConnStatsHash();
+	BuildSharedConnStatsHashKey(&key, hostname, port);
+
+	LWLockAcquire(&ConnectionStatsSharedState->lock, LW_EXCLUSIVE);
+
+	SharedConnStatsHashEntry *sharedEntry =
+		hash_search(SharedConnStatsHash, &key, HASH_ENTER_NULL, &found);
+	if (sharedEntry == NULL)
+	{
+		/*
+		 * The hash is full, which only happens if there are more nodes than
+		 * citus.max_worker_nodes_tracked. Do not throttle in that case.
+		 */
+		LWLockRelease(&ConnectionStatsSharedState->lock);
+
+		return true;
+	}
+
+	if (!found)
+	{
+		sharedEntry->connectionCount = 0;
+	}
+
+	if (!checkLimit || sharedEntry->connectionCount < maxSharedPoolSize)
+	{
+		sharedEntry->connectionCount++;
+		counted = true;
+	}
+
+	LWLockRelease(&ConnectionStatsSharedState->lock);
+
+	if (counted)
+	{
+		SharedConnStatsHashEntry *localEntry =
+			hash_search(LocalConnStatsHash, &key, HASH_ENTER, &found);
+		if (!found)
+		{
+			localEntry->connectionCount = 0;
+		}
+
+		localEntry->connectionCount++;
+	}
+
+	return counted;
+}
+
+
+/*
+ * InitializeLocalConnStatsHash creates the hash of connections counted by
+ * this backend on first use and makes sure they are given back when the
+ * backend exits.
+ *
+ * Connections are closed by an atexit() callback, which runs after the
+ * backend detached from shared memory, so we cannot rely on
+ * DecrementSharedConnectionCounter being called for those.
+ */
+static void
+InitializeLocalConnStatsHash(void)
+{
+	HASHCTL info;
+
+	if (LocalConnStatsHash != NULL)
+	{
+		return;
+	}
+
+	memset(&info, 0, sizeof(info));
+	info.keysize = sizeof(SharedConnStatsHashKey);
+	info.entrysize = sizeof(SharedConnStatsHashEntry);
+	info.hcxt = TopMemoryContext;
+	int hashFlags = (HASH_ELEM | HASH_BLOBS | HASH_CONTEXT);
+
+	LocalConnStatsHash = hash_create("Citus Local Connection Stats Hash", 32, &info,
+									 hashFlags);
+
+	before_shmem_exit(SharedConnectionStatsBackendExit, 0);
+}
+
+
+/*
+ * SharedConnectionStatsBackendExit gives back all connections counted by
+ * this backend.
+ */
+static void
+SharedConnectionStatsBackendExit(int code, Datum arg)
+{
+	HASH_SEQ_STATUS status;
+	SharedConnStatsHashEntry *localEntry = NULL;
+
+	if (LocalConnStatsHash == NULL)
+	{
+		return;
+	}
+
+	LWLockAcquire(&ConnectionStatsSharedState->lock, LW_EXCLUSIVE);
+
+	hash_seq_init(&status, LocalConnStatsHash);
+	while ((localEntry = hash_seq_search(&status)) != NULL)
+	{
+		bool found = false;
+
+		SharedConnStatsHashEntry *sharedEntry =
+			hash_search(SharedConnStatsHash, &localEntry->key, HASH_FIND, &found);
+		if (found)
+		{
+			sharedEntry->connectionCount -= Min(localEntry->connectionCount,
+												sharedEntry->connectionCount);
+		}
+	}
+
+	LWLockRelease(&ConnectionStatsSharedState->lock);
+
+	/* do not decrement again when the connections are closed */
+	hash_destroy(LocalConnStatsHash);
+	LocalConnStatsHash = NULL;
+}
+
+
+/*
+ * BuildSharedConnStatsHashKey fills the hash key for the given node. The key
+ * is zeroed first since it is hashed as a blob.
+ */
+static void
+BuildSharedConnStatsHashKey(SharedConnStatsHashKey *key, const char *hostname,
+							int port)
+{
+	memset(key, 0, sizeof(SharedConnStatsHashKey));
+	strlcpy(key->hostname, hostname, MAX_NODE_LENGTH);
+	key->port = port;
+}
+
+
+/*
+ * SharedConnectionStatsShmemSize returns the size of the shared memory needed
+ * for the connection counters.
+ */
+static size_t
+SharedConnectionStatsShmemSize(void)
+{
+	Size size = 0;
+
+	size = add_size(size, sizeof(SharedConnStatsControlData));
+
+	Size hashSize = hash_estimate_size(MaxWorkerNodesTracked,
+									   sizeof(SharedConnStatsHashEntry));
+	size = add_size(size, hashSize);
+
+	return size;
+}
+
+
+/*
+ * SharedConnectionStatsShmemInit initializes the shared memory for the
+ * connection counters.
+ */
+static void
+SharedConnectionStatsShmemInit(void)
+{
+	bool alreadyInitialized = false;
+	HASHCTL info;
+
+	LWLockAcquire(AddinShmemInitLock, LW_EXCLUSIVE);
+
+	ConnectionStatsSharedState =
+		(SharedConnStatsControlData *) ShmemInitStruct("Citus Connection Stats",
+													   sizeof(SharedConnStatsControlData),
+													   &alreadyInitialized);
+
+	/*
+	 * Might already be initialized on EXEC_BACKEND type platforms that call
+	 * shared library initialization functions in every backend.
+	 */
+	if (!alreadyInitialized)
+	{
+		ConnectionStatsSharedState->trancheId = LWLockNewTrancheId();
+		ConnectionStatsSharedState->lockTrancheName = "Citus Connection Stats";
+		LWLockRegisterTranche(ConnectionStatsSharedState->trancheId,
+							  ConnectionStatsSharedState->lockTrancheName);
+
+		LWLockInitialize(&ConnectionStatsSharedState->lock,
+						 ConnectionStatsSharedState->trancheId);
+	}
+
+	memset(&info, 0, sizeof(info));
+	info.keysize = sizeof(SharedConnStatsHashKey);
+	info.entrysize = sizeof(SharedConnStatsHashEntry);
+	int hashFlags = (HASH_ELEM | HASH_BLOBS);
+
+	SharedConnStatsHash = ShmemInitHash("Citus Connection Stats Hash",
+										MaxWorkerNodesTracked, MaxWorkerNodesTracked,
+										&info, hashFlags);
+
+	LWLockRelease(AddinShmemInitLock);
+
+	if (prev_shmem_startup_hook != NULL)
+	{
+		prev_shmem_startup_hook();
+	}
+}
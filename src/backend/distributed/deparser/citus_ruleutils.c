@@ -24,6 +24,7 @@
 #include "catalog/dependency.h"
 #include "catalog/indexing.h"
 #include "catalog/namespace.h"
+#include "catalog/pg_am.h"
 #include "catalog/pg_attribute.h"
 #include "catalog/pg_authid.h"
 #include "catalog/pg_class.h"
@@ -210,6 +211,13 @@ pg_get_sequencedef_string(Oid sequenceRelationId)
 								 pgSequenceForm->seqmax, pgSequenceForm->seqstart,
 								 pgSequenceForm->seqcycle ? "" : "NO ");
 
+	/* the default of 1 is left out, larger caches are kept on the workers */
+	if (pgSequenceForm->seqcache > 1)
+	{
+		sequenceDef = psprintf("%s CACHE " INT64_FORMAT, sequenceDef,
+							   pgSequenceForm->seqcache);
+	}
+
 	return sequenceDef;
 }
 
@@ -444,6 +452,15 @@ pg_get_tableschemadef_string(Oid tableRelationId, bool includeSequenceDefaults)
 		char *partitioningInformation = GeneratePartitioningInformation(tableRelationId);
 		appendStringInfo(&buffer, " PARTITION BY %s ", partitioningInformation);
 	}
+#if PG_VERSION_NUM >= 120000
+	else if (relationKind == RELKIND_RELATION &&
+			 relation->rd_rel->relam != HEAP_TABLE_AM_OID)
+	{
+		/* shards use the access method of the table, e.g. columnar storage */
+		char *accessMethodName = get_am_name(relation->rd_rel->relam);
+		appendStringInfo(&buffer, " USING %s", quote_identifier(accessMethodName));
+	}
+#endif
 
 	/*
 	 * Add any reloptions (storage parameters) defined on the table in a WITH
@@ -84,6 +84,11 @@
  * own readyTaskQueue and otherwise takes a task from the worker pool's
  * readyTaskQueue (on a first-come-first-serve basis).
  *
+ * When citus.executor_pipeline_depth is larger than 1, a session that takes
+ * a read-only task may take additional ready tasks and send them along in a
+ * single multi-statement query. Results come back in order, so ReceiveResults
+ * simply moves on to the next pipelined task whenever a result set ends.
+ *
  * In cases where the tasks finish quickly (e.g. <1ms), a single
  * connection will often be sufficient to finish all tasks. It is
  * therefore not necessary that all connections are established
@@ -115,6 +120,13 @@
  * Execution finishes when all tasks are done, the query errors out, or
  * the user cancels the query.
  *
+ * When citus.enable_streaming_execution is on, top-level SELECTs outside of
+ * a transaction block do not wait for execution to finish. Instead, the event
+ * loop returns to CitusExecScan whenever new rows arrived, and continues once
+ * those rows are consumed. Meanwhile, unread results remain in the socket
+ * buffers, which makes the workers wait rather than the coordinator buffering
+ * the whole result.
+ *
  *-------------------------------------------------------------------------
  */
 
@@ -124,9 +136,12 @@
 #include "miscadmin.h"
 #include "pgstat.h"
 
+#include <math.h>
 #include <sys/stat.h>
+#include <time.h>
 #include <unistd.h>
 
+#include "access/htup_details.h"
 #include "access/transam.h"
 #include "access/xact.h"
 #include "catalog/pg_type.h"
@@ -136,37 +151,84 @@
 #include "distributed/cancel_utils.h"
 #include "distributed/citus_custom_scan.h"
 #include "distributed/citus_safe_lib.h"
+#include "distributed/commands/multi_copy.h"
 #include "distributed/connection_management.h"
+#include "distributed/cpu_affinity.h"
+#include "distributed/ddl_buffer.h"
 #include "distributed/deparse_shard_query.h"
 #include "distributed/distributed_execution_locks.h"
+#include "distributed/distributed_snapshot.h"
+#include "distributed/insert_buffer.h"
 #include "distributed/listutils.h"
 #include "distributed/local_executor.h"
+#include "distributed/metadata_cache.h"
 #include "distributed/multi_client_executor.h"
 #include "distributed/multi_executor.h"
 #include "distributed/multi_partitioning_utils.h"
 #include "distributed/multi_physical_planner.h"
 #include "distributed/multi_resowner.h"
 #include "distributed/multi_server_executor.h"
+#include "distributed/node_health.h"
 #include "distributed/placement_access.h"
 #include "distributed/placement_connection.h"
 #include "distributed/relation_access_tracking.h"
 #include "distributed/remote_commands.h"
 #include "distributed/repartition_join_execution.h"
 #include "distributed/resource_lock.h"
+#include "distributed/result_cache.h"
+#include "distributed/shard_query_stats.h"
+#include "distributed/shardinterval_utils.h"
+#include "distributed/stat_counters.h"
 #include "distributed/subplan_execution.h"
 #include "distributed/transaction_management.h"
 #include "distributed/version_compat.h"
+#include "distributed/wait_sampling.h"
 #include "distributed/worker_protocol.h"
+#include "executor/executor.h"
+#include "lib/binaryheap.h"
 #include "lib/ilist.h"
+#include "optimizer/tlist.h"
 #include "portability/instr_time.h"
 #include "storage/fd.h"
 #include "storage/latch.h"
 #include "utils/int8.h"
 #include "utils/lsyscache.h"
 #include "utils/memutils.h"
+#include "utils/portal.h"
+#include "utils/sortsupport.h"
 #include "utils/timestamp.h"
 
 #define SLOW_START_DISABLED 0
+#define WAIT_EVENT_SET_INDEX_NOT_INITIALIZED -1
+
+
+/*
+ * TaskResultDestination is where the rows of a task go when an execution runs
+ * the tasks of several queries, each of which has its own tuple store.
+ */
+typedef struct TaskResultDestination
+{
+	/* hash key, the task of which the rows are stored */
+	Task *task;
+
+	TupleDesc tupleDescriptor;
+	Tuplestorestate *tupleStore;
+	AttInMetadata *attributeInputMetadata;
+	char **columnArray;
+} TaskResultDestination;
+
+
+/*
+ * SortedTaskResultMerge is the state of merging the sorted rows of the tasks
+ * of a query, which keeps the next row of every task in a slot.
+ */
+typedef struct SortedTaskResultMerge
+{
+	Tuplestorestate **tupleStores;
+	TupleTableSlot **slots;
+	SortSupport sortKeys;
+	int sortKeyCount;
+} SortedTaskResultMerge;
 
 
 /*
@@ -210,6 +272,13 @@ typedef struct DistributedExecution
 	 */
 	bool connectionSetChanged;
 
+	/*
+	 * Flag to indicate that sessions were added to the execution, which only
+	 * requires the new sessions to be added to waitEventSet if it has room
+	 * for them.
+	 */
+	bool sessionsAdded;
+
 	/*
 	 * Flag to indiciate that the set of wait events we are interested
 	 * in might have changed and waitEventSet needs to be updated.
@@ -233,6 +302,24 @@ typedef struct DistributedExecution
 	 */
 	WaitEventSet *waitEventSet;
 
+	/*
+	 * Buffer for the events returned by WaitEventSetWait() and its size. These
+	 * are kept here rather than in RunDistributedExecution() because a streaming
+	 * execution returns to the caller in between rounds of waiting.
+	 */
+	WaitEvent *events;
+	int eventSetSize;
+
+	/*
+	 * Scan of a streaming execution while it is in StreamingExecutionList,
+	 * NULL otherwise.
+	 */
+	CitusScanState *streamingScanState;
+	dlist_node streamingExecutionNode;
+
+	/* number of events in waitEventSet, which has room for eventSetSize events */
+	int waitEventCount;
+
 	/*
 	 * The number of connections we aim to open per worker.
 	 *
@@ -270,6 +357,32 @@ typedef struct DistributedExecution
 	 */
 	uint64 rowsProcessed;
 
+	/* total size of the column values received from the workers, in bytes */
+	uint64 bytesReceived;
+
+	/*
+	 * Number of rows after which the results of the unfinished tasks are no
+	 * longer needed, or 0 if all of them are needed, and whether the execution
+	 * received that many rows.
+	 */
+	uint64 rowLimit;
+	bool rowLimitReached;
+
+	/*
+	 * Number of milliseconds after which a read-only task that is still
+	 * running is also started on another placement, or 0 to never do so, and
+	 * whether the execution did so for any task.
+	 */
+	double hedgedReadThresholdMs;
+	bool hedgedReadsStarted;
+
+	/*
+	 * Whether to keep the timings of finished tasks for EXPLAIN ANALYZE, and
+	 * the resulting list of TaskExecutionTimings.
+	 */
+	bool collectTaskTimings;
+	List *taskTimingList;
+
 	/* statistics on distributed execution */
 	DistributedExecutionStats *executionStats;
 
@@ -284,11 +397,56 @@ typedef struct DistributedExecution
 	AttInMetadata *attributeInputMetadata;
 	char **columnArray;
 
+	/*
+	 * binaryResults indicates whether SELECT tasks request their results in
+	 * binary format, which is only the case when every column type has binary
+	 * send and receive functions. In that case, the other fields hold the
+	 * receive function and I/O parameter of each column and the per-row arrays
+	 * used to form tuples.
+	 */
+	bool binaryResults;
+	FmgrInfo *columnReceiveFunctions;
+	Oid *columnTypeIOParams;
+	Datum *columnValues;
+	bool *columnNulls;
+
 	/*
 	 * jobIdList contains all jobs in the job tree, this is used to
 	 * do cleanup for repartition queries.
 	 */
 	List *jobIdList;
+
+	/*
+	 * If set, taskCompletedCallback is called with the tasks that finished in
+	 * the latest round of events, and returns the tasks that should be added
+	 * to the execution. This allows tasks to start as soon as the tasks they
+	 * depend on are done. The finished tasks are collected in completedTaskList
+	 * in between calls.
+	 */
+	TaskCompletedCallback taskCompletedCallback;
+	void *taskCompletedCallbackContext;
+	List *completedTaskList;
+
+	/*
+	 * If set, the rows of each task are written to the TaskResultDestination
+	 * of the task in this hash rather than to tupleStore.
+	 */
+	HTAB *taskResultDestinationHash;
+
+	/*
+	 * pipelinePrepareTransaction indicates that the execution runs the last
+	 * statement of an implicit transaction that uses 2PC, in which case we send
+	 * PREPARE TRANSACTION along with the last task on each connection.
+	 */
+	bool pipelinePrepareTransaction;
+
+	/*
+	 * If set, sessionSetupCommand is sent over every session before its first
+	 * task, for instance to change settings for the tasks of the execution. The
+	 * connections of such sessions are closed at the end of the transaction,
+	 * such that the settings do not leak into later commands.
+	 */
+	char *sessionSetupCommand;
 } DistributedExecution;
 
 
@@ -371,12 +529,30 @@ typedef struct WorkerPool
 	/* indicates whether to check for the connection timeout */
 	bool checkForPoolTimeout;
 
-	/* last time we opened a connection */
+	/*
+	 * last time we opened a connection, or decided in a slow start cycle not
+	 * to open any
+	 */
 	instr_time lastConnectionOpenTime;
 
 	/* maximum number of connections we are allowed to open at once */
 	uint32 maxNewConnectionsPerCycle;
 
+	/*
+	 * Feedback used by citus.enable_adaptive_slow_start: running averages of
+	 * how long it takes to establish a connection to the worker and to run a
+	 * task on it, and the most recent connection establishment time.
+	 */
+	double connectionEstablishmentTimeMs;
+	double lastConnectionEstablishmentTimeMs;
+	int establishedConnectionCount;
+	double taskExecutionTimeMs;
+	int completedTaskCount;
+
+	/* CPU time spent on the events of the pool's connections, for logging */
+	double cpuTimeMs;
+	int finishedTaskCount;
+
 	/*
 	 * This is only set in WorkerPoolFailed() function. Once a pool fails, we do not
 	 * use it anymore.
@@ -409,6 +585,12 @@ typedef struct WorkerSession
 	/* connection over which the session is established */
 	MultiConnection *connection;
 
+	/* time at which the executor started establishing the connection, if it did */
+	instr_time connectionStartTime;
+
+	/* time at which the connection was established, if the executor did so */
+	instr_time connectionReadyTime;
+
 	/* tasks that need to be executed on this connection, but are not ready to start  */
 	dlist_head pendingTaskQueue;
 
@@ -418,6 +600,13 @@ typedef struct WorkerSession
 	/* task the worker should work on or NULL */
 	struct TaskPlacementExecution *currentTask;
 
+	/*
+	 * Placement executions that were sent in the same batch as currentTask,
+	 * in the order in which their results arrive. Only used when
+	 * citus.executor_pipeline_depth is larger than 1.
+	 */
+	List *pipelinedTaskList;
+
 	/*
 	 * The number of commands sent to the worker over the session. Excludes
 	 * distributed transaction related commands such as BEGIN/COMMIT etc.
@@ -429,6 +618,12 @@ typedef struct WorkerSession
 
 	/* events reported by the latest call to WaitEventSetWait */
 	int latestUnconsumedWaitEvents;
+
+	/* whether the sessionSetupCommand of the execution was sent */
+	bool sessionSetupSent;
+
+	/* name of the statement of which the pipelined PREPARE result is pending */
+	char *pendingPreparedStatementName;
 } WorkerSession;
 
 
@@ -441,6 +636,120 @@ int MaxAdaptiveExecutorPoolSize = 16;
 /* GUC, number of ms to wait between opening connections to the same worker */
 int ExecutorSlowStartInterval = 10;
 
+/* GUC, number of read-only tasks to send over a session at once, 1 disables batching */
+int ExecutorPipelineDepth = 1;
+
+/* GUC, determining the order in which read-only tasks are started */
+int TaskOrderingPolicy = TASK_ORDERING_PLANNING_ORDER;
+
+/* GUC, determining whether idle pools take over tasks that have other placements */
+bool EnableWorkStealing = false;
+
+/* GUC, number of groups the shards of a node are divided into, 0 disables */
+int ShardAffinityGroupCount = 0;
+
+/* GUC, whether to log the CPU time spent on each worker pool */
+bool LogWorkerPoolCpuTime = false;
+
+/* GUC, determining whether slow start uses connection and task timings */
+bool EnableAdaptiveSlowStart = false;
+
+/* GUC, determining whether read-only scans return rows while results arrive */
+bool EnableStreamingExecution = false;
+
+/*
+ * Streaming executions that are suspended in between fetches from their scan.
+ * Other executions in the same transaction first read their remaining results,
+ * see FinishSuspendedStreamingExecutions.
+ */
+static dlist_head StreamingExecutionList = DLIST_STATIC_INIT(StreamingExecutionList);
+
+/* GUC, determining whether LIMIT queries stop once they received enough rows */
+bool EnableLimitEarlyTermination = false;
+
+/* GUC, determining whether SELECT tasks receive their results in binary format */
+bool EnableBinaryProtocol = false;
+
+/* GUC, determining whether PREPARE TRANSACTION is sent along with the last task */
+bool EnablePipelinedPrepare = false;
+
+/* GUC, determining whether BEGIN is sent along with the first task */
+bool EnablePipelinedBegin = false;
+
+/* GUC, maximum number of statements the executor prepares over a connection */
+int MaxPreparedStatementsPerConnection = 1000;
+
+/* GUC, percentile of task execution times after which reads are hedged, 0 disables */
+int HedgedReadPercentile = 0;
+
+/* GUC, minimum number of ms a read-only task runs before it is hedged */
+int HedgedReadMinDelay = 10;
+
+/* smallest memory in kB of a tuple store, the minimum of work_mem */
+#define MIN_TUPLE_STORE_MEMORY 64
+
+/*
+ * GUC, memory in kB that the tuple stores of a distributed execution may use
+ * on the coordinator before they spill to disk, -1 leaves every tuple store
+ * work_mem.
+ */
+int MaxCoordinatorQueryMemory = -1;
+
+/*
+ * Weight of the most recent sample when updating the running estimates of
+ * execution and connection establishment times.
+ */
+#define EXECUTION_TIME_SMOOTHING_FACTOR 0.5
+
+/*
+ * With adaptive slow start, a connection that takes more than this factor longer
+ * to establish than the average signals that the worker is overloaded.
+ */
+#define CONNECTION_CONGESTION_FACTOR 2.0
+
+/*
+ * Number of execution times of recent read-only tasks that the hedged read
+ * threshold is computed from, and the number of them needed to hedge reads.
+ */
+#define HEDGED_READ_SAMPLE_COUNT 128
+#define HEDGED_READ_MIN_SAMPLE_COUNT 16
+
+
+/*
+ * ShardExecutionTimeEntry keeps a running estimate of how long a task on the
+ * given shard took in earlier executions in this backend.
+ */
+typedef struct ShardExecutionTimeEntry
+{
+	uint64 shardId; /* hash key */
+	double executionTimeMs;
+} ShardExecutionTimeEntry;
+
+
+/*
+ * TaskCostEstimate is used to sort tasks by their estimated execution time
+ * when citus.task_ordering_policy is set to longest-first.
+ */
+typedef struct TaskCostEstimate
+{
+	Task *task;
+
+	/* whether the shard was executed by an earlier execution in this backend */
+	bool hasExecutionTime;
+	double executionTimeMs;
+
+	/* shard length as recorded in pg_dist_placement, used as tie-breaker */
+	uint64 shardLength;
+} TaskCostEstimate;
+
+
+/* per-backend execution time estimates, keyed by shard ID */
+static HTAB *ShardExecutionTimeHash = NULL;
+
+/* execution times of the most recent read-only tasks in this backend, in ms */
+static double ReadTaskExecutionTimes[HEDGED_READ_SAMPLE_COUNT];
+static int ReadTaskExecutionTimeCount = 0;
+
 
 /*
  * TaskExecutionState indicates whether or not a command on a shard
@@ -485,6 +794,17 @@ typedef struct ShardCommandExecution
 	/* whether we expect results to come back */
 	bool expectResults;
 
+	/* where the rows of the task go if not to the tuple store of the execution */
+	TaskResultDestination *resultDestination;
+
+	/*
+	 * Whether the task was started on another placement since it took too
+	 * long, and the placement execution of which the rows are stored. The
+	 * rows of the other placement executions are discarded.
+	 */
+	bool hedged;
+	struct TaskPlacementExecution *resultPlacementExecution;
+
 	/*
 	 * RETURNING results from other shard placements can be ignored
 	 * after we got results from the first placements.
@@ -542,6 +862,31 @@ typedef struct TaskPlacementExecution
 
 	/* index in array of placement executions in a ShardCommandExecution */
 	int placementExecutionIndex;
+
+	/* group of the shard, to prefer sessions of the same group, or -1 */
+	int shardAffinityGroup;
+
+	/* whether the command was cancelled since another placement returned rows */
+	bool cancelled;
+
+	/*
+	 * time at which the command was sent, used to estimate task costs. For a
+	 * pipelined command, the worker only starts it once the results of the
+	 * commands before it on the session are complete, so this is then moved
+	 * forward to that time.
+	 */
+	instr_time startTime;
+
+	/*
+	 * For EXPLAIN ANALYZE, the times at which the placement execution was
+	 * queued, at which the connection of its session was established (if
+	 * during this execution) and at which the first result arrived, and the
+	 * number of bytes received.
+	 */
+	instr_time queueStartTime;
+	instr_time connectionReadyTime;
+	instr_time firstResultTime;
+	uint64 bytesReceived;
 } TaskPlacementExecution;
 
 
@@ -556,6 +901,11 @@ static DistributedExecution * CreateDistributedExecution(RowModifyLevel modLevel
 														 TransactionProperties *
 														 xactProperties,
 														 List *jobIdList);
+static uint64 ExecuteTaskGraph(RowModifyLevel modLevel, List *taskList,
+							   int targetPoolSize, TransactionProperties *xactProperties,
+							   List *jobIdList, char *sessionSetupCommand,
+							   TaskCompletedCallback taskCompletedCallback,
+							   void *taskCompletedCallbackContext);
 static TransactionProperties DecideTransactionPropertiesForTaskList(RowModifyLevel
 																	modLevel,
 																	List *taskList,
@@ -563,8 +913,48 @@ static TransactionProperties DecideTransactionPropertiesForTaskList(RowModifyLev
 																	exludeFromTransaction);
 static void StartDistributedExecution(DistributedExecution *execution);
 static void RunLocalExecution(CitusScanState *scanState, DistributedExecution *execution);
+static List * RunLocalExecutionIntoTaskTupleStores(CitusScanState *scanState,
+												   DistributedExecution *execution,
+												   int tupleStoreMemory);
+static List * CreateTaskTupleStores(DistributedExecution *execution,
+									 int tupleStoreMemory);
+static int CountSpilledTupleStores(List *tupleStoreList);
+static void MergeSortedTaskResults(CitusScanState *scanState, List *taskTupleStoreList);
+static int CompareTaskResultSlots(Datum left, Datum right, void *arg);
 static void RunDistributedExecution(DistributedExecution *execution);
+static bool ContinueDistributedExecution(DistributedExecution *execution,
+										 bool pauseOnResults);
+static bool ShouldStreamExecution(CitusScanState *scanState,
+								  DistributedExecution *execution);
+static bool ShouldStreamLocalExecution(CitusScanState *scanState,
+									   DistributedExecution *execution);
+static void StartStreamingExecution(CitusScanState *scanState,
+									DistributedExecution *execution);
+static bool ShouldPipelinePrepareTransaction(DistributedExecution *execution);
+static bool CanPipelinePrepareTransaction(WorkerSession *session);
+static bool CanPipelineBeginOnSession(WorkerSession *session);
+static void ContinueStreamingExecution(CitusScanState *scanState);
+static void EndStreamingExecution(CitusScanState *scanState);
+static bool ActivePortalIsNamed(void);
+static void FreeStreamingExecutionWaitEventSet(void *arg);
+static bool CanUseBinaryResultFormat(TupleDesc tupleDescriptor);
+static void SetupBinaryResultFormat(DistributedExecution *execution);
+static HeapTuple BuildTupleFromBinaryResult(DistributedExecution *execution,
+											TupleDesc tupleDescriptor,
+											PGresult *result, int rowIndex);
 static bool ShouldRunTasksSequentially(List *taskList);
+static uint64 DistributedPlanRowLimit(DistributedPlan *distributedPlan);
+static void TerminateUnfinishedTasks(DistributedExecution *execution);
+static void RecordReadTaskExecutionTime(double executionTimeMs);
+static double HedgedReadThreshold(void);
+static int CompareExecutionTimes(const void *leftElement, const void *rightElement);
+static void StartHedgedReads(DistributedExecution *execution);
+static long HedgedReadTimeout(DistributedExecution *execution, instr_time now);
+static TaskPlacementExecution * HedgedPlacementExecution(TaskPlacementExecution *
+														 placementExecution);
+static bool ClaimTaskResults(TaskPlacementExecution *placementExecution);
+static void CancelHedgedPlacementExecutions(TaskPlacementExecution *
+											resultPlacementExecution);
 static void SequentialRunDistributedExecution(DistributedExecution *execution);
 
 static void FinishDistributedExecution(DistributedExecution *execution);
@@ -581,6 +971,18 @@ static bool DistributedExecutionRequiresRollback(List *taskList);
 static bool TaskListRequires2PC(List *taskList);
 static bool SelectForUpdateOnReferenceTable(RowModifyLevel modLevel, List *taskList);
 static void AssignTasksToConnectionsOrWorkerPool(DistributedExecution *execution);
+static void AssignTaskListToConnectionsOrWorkerPool(DistributedExecution *execution,
+													List *taskList);
+static void AddTasksToDistributedExecution(DistributedExecution *execution,
+										   List *taskList);
+static List * OrderTasksByEstimatedCost(List *taskList);
+static int CompareTaskCostEstimates(const void *leftElement, const void *rightElement);
+static void RecordShardExecutionTime(TaskPlacementExecution *placementExecution);
+static double UpdateRunningAverage(double average, double sample);
+static int AdaptiveSlowStartConnectionCount(WorkerPool *workerPool,
+											int newConnectionCount);
+static void RecordConnectionEstablishmentTime(WorkerSession *session);
+static void RecordTaskExecutionTime(TaskPlacementExecution *placementExecution);
 static void UnclaimAllSessionConnections(List *sessionList);
 static bool UseConnectionPerPlacement(void);
 static PlacementExecutionOrder ExecutionOrderForTask(RowModifyLevel modLevel, Task *task);
@@ -588,17 +990,32 @@ static WorkerPool * FindOrCreateWorkerPool(DistributedExecution *execution,
 										   char *nodeName, int nodePort);
 static WorkerSession * FindOrCreateWorkerSession(WorkerPool *workerPool,
 												 MultiConnection *connection);
+static void AssignShardAffinityGroup(WorkerPool *workerPool,
+									 MultiConnection *connection);
+static int ShardAffinityGroupForTask(Task *task);
 static void ManageWorkerPool(WorkerPool *workerPool);
 static void CheckConnectionTimeout(WorkerPool *workerPool);
+static void FailWorkerPoolOfDownNode(WorkerPool *workerPool);
 static int UsableConnectionCount(WorkerPool *workerPool);
 static long NextEventTimeout(DistributedExecution *execution);
-static WaitEventSet * BuildWaitEventSet(List *sessionList);
-static void RebuildWaitEventSetFlags(WaitEventSet *waitEventSet, List *sessionList);
+static WaitEventSet * BuildWaitEventSet(DistributedExecution *execution);
+static void RebuildWaitEventSetFlags(DistributedExecution *execution);
 static TaskPlacementExecution * PopPlacementExecution(WorkerSession *session);
+static bool SessionMayHaveReadyTasks(WorkerSession *session);
 static TaskPlacementExecution * PopAssignedPlacementExecution(WorkerSession *session);
 static TaskPlacementExecution * PopUnassignedPlacementExecution(WorkerPool *workerPool);
+static TaskPlacementExecution * PopAffinePlacementExecution(WorkerSession *session);
+static TaskPlacementExecution * StealPlacementExecution(WorkerPool *workerPool);
+static TaskPlacementExecution * FindStealablePlacementExecution(ShardCommandExecution *
+																shardCommandExecution);
+static char * PreparedStatementQueryString(WorkerSession *session, Task *task);
 static bool StartPlacementExecutionOnSession(TaskPlacementExecution *placementExecution,
 											 WorkerSession *session);
+static bool CanPipelinePlacementExecution(TaskPlacementExecution *placementExecution);
+static TaskPlacementExecution * PopPipelinablePlacementExecution(WorkerSession *session);
+static char * AppendPipelinedPlacementExecutions(WorkerSession *session,
+												 char *queryString);
+static void AdvancePipelinedPlacementExecution(WorkerSession *session);
 static void ConnectionStateMachine(WorkerSession *session);
 static void HandleMultiConnectionSuccess(WorkerSession *session);
 static void Activate2PCIfModifyingTransactionExpandsToNewNode(WorkerSession *session);
@@ -622,10 +1039,16 @@ static void ExtractParametersForRemoteExecution(ParamListInfo paramListInfo,
 												Oid **parameterTypes,
 												const char ***parameterValues);
 static int GetEventSetSize(List *sessionList);
+static int WaitEventSetCapacity(DistributedExecution *execution);
 static int RebuildWaitEventSet(DistributedExecution *execution);
+static double CurrentCpuTimeMs(void);
+static void LogWorkerPoolCpuTimes(DistributedExecution *execution);
 static void ProcessWaitEvents(DistributedExecution *execution, WaitEvent *events, int
 							  eventCount, bool *cancellationReceived);
 static long MillisecondsBetweenTimestamps(instr_time startTime, instr_time endTime);
+static void RecordTaskExecutionTiming(TaskPlacementExecution *placementExecution);
+static CitusWaitState ExecutionWaitState(DistributedExecution *execution);
+static double ElapsedMilliseconds(instr_time startTime, instr_time endTime);
 
 
 /*
@@ -645,7 +1068,7 @@ AdaptiveExecutorPreExecutorRun(CitusScanState *scanState)
 	 */
 	LockPartitionsForDistributedPlan(distributedPlan);
 
-	ExecuteSubPlans(distributedPlan);
+	scanState->subPlanStatsList = ExecuteSubPlans(distributedPlan);
 }
 
 
@@ -669,25 +1092,59 @@ AdaptiveExecutor(CitusScanState *scanState)
 	List *jobIdList = NIL;
 
 	Job *job = distributedPlan->workerJob;
-	List *taskList = job->taskList;
 
 	/* we should only call this once before the scan finished */
 	Assert(!scanState->finishedRemoteScan);
 
+	/* the rows of a subplan may have been fetched along with other subplans */
+	Tuplestorestate *prefetchedTupleStore =
+		TakePrefetchedSubPlanResult(distributedPlan->planId);
+	if (prefetchedTupleStore != NULL)
+	{
+		scanState->tuplestorestate = prefetchedTupleStore;
+
+		return resultSlot;
+	}
+
+	/* small subplan results may have been inlined rather than sent as files */
+	List *taskList = InlineIntermediateResultsInJob(job);
+
+	/* repeated read-only queries may be answered from the shared result cache */
+	ResultCacheKey *cacheKey = ResultCacheKeyForExecution(scanState, taskList);
+	if (cacheKey != NULL && LookupCachedResult(cacheKey, scanState))
+	{
+		return resultSlot;
+	}
+
 	bool hasDependentJobs = HasDependentJobs(job);
 	if (hasDependentJobs)
 	{
 		jobIdList = ExecuteDependentTasks(taskList, job);
 	}
 
+	/* take consistent snapshots of all nodes before reading from any of them */
+	EnsureDistributedSnapshotForExecution(distributedPlan->modLevel, taskList,
+										  hasDependentJobs);
+
 	if (MultiShardConnectionType == SEQUENTIAL_CONNECTION)
 	{
 		/* defer decision after ExecuteSubPlans() */
 		targetPoolSize = 1;
 	}
 
+	/* with merged task results, the scan and every task have a tuple store */
+	int tupleStoreCount = 1;
+	if (distributedPlan->mergeSortedTaskResults)
+	{
+		tupleStoreCount += list_length(taskList);
+	}
+
+	int tupleStoreMemory = TupleStoreMemoryLimit(tupleStoreCount);
+	scanState->tupleStoreMemory = tupleStoreMemory;
+	scanState->spilledTupleStoreCount = 0;
+
 	scanState->tuplestorestate =
-		tuplestore_begin_heap(randomAccess, interTransactions, work_mem);
+		tuplestore_begin_heap(randomAccess, interTransactions, tupleStoreMemory);
 
 	TransactionProperties xactProperties = DecideTransactionPropertiesForTaskList(
 		distributedPlan->modLevel, taskList,
@@ -705,14 +1162,39 @@ AdaptiveExecutor(CitusScanState *scanState)
 		&xactProperties,
 		jobIdList);
 
+	/* keep the timings of the tasks when they are shown by EXPLAIN ANALYZE */
+	execution->collectTaskTimings = scanState->customScanState.ss.ps.instrument != NULL;
+
 	/*
 	 * Make sure that we acquire the appropriate locks even if the local tasks
 	 * are going to be executed with local execution.
 	 */
 	StartDistributedExecution(execution);
 
+	if (ShouldStreamLocalExecution(scanState, execution))
+	{
+		/* rows are returned from the plan of the local task in CitusExecScan */
+		StartLocalTaskStreaming(scanState, linitial(execution->localTaskList));
+
+		FinishDistributedExecution(execution);
+
+		return resultSlot;
+	}
+
+	/* when the rows of the tasks are merged, every task has its own tuple store */
+	List *taskTupleStoreList = NIL;
+
 	/* execute tasks local to the node (if any) */
-	if (list_length(execution->localTaskList) > 0)
+	if (list_length(execution->localTaskList) > 0 &&
+		distributedPlan->mergeSortedTaskResults)
+	{
+		taskTupleStoreList = RunLocalExecutionIntoTaskTupleStores(scanState, execution,
+																  tupleStoreMemory);
+
+		/* make sure that we only execute remoteTaskList afterwards */
+		AdjustDistributedExecutionAfterLocalExecution(execution);
+	}
+	else if (list_length(execution->localTaskList) > 0)
 	{
 		RunLocalExecution(scanState, execution);
 
@@ -720,12 +1202,52 @@ AdaptiveExecutor(CitusScanState *scanState)
 		AdjustDistributedExecutionAfterLocalExecution(execution);
 	}
 
+	if (ShouldStreamExecution(scanState, execution))
+	{
+		/* rows are returned and more results are read in CitusExecScan */
+		StartStreamingExecution(scanState, execution);
+
+		return resultSlot;
+	}
+
+	/*
+	 * Outside of coordinated transactions, the commands that are still running
+	 * once the LIMIT of the query is reached can be cancelled without affecting
+	 * later commands.
+	 */
+	if (EnableLimitEarlyTermination && list_length(execution->localTaskList) == 0 &&
+		!InCoordinatedTransaction())
+	{
+		execution->rowLimit = DistributedPlanRowLimit(distributedPlan);
+	}
+
+	/*
+	 * Similarly, commands of slow reads that are started on another placement
+	 * can be cancelled once the other placement returned rows.
+	 */
+	if (distributedPlan->modLevel == ROW_MODIFY_READONLY && !InCoordinatedTransaction() &&
+		xactProperties.useRemoteTransactionBlocks != TRANSACTION_BLOCKS_REQUIRED)
+	{
+		execution->hedgedReadThresholdMs = HedgedReadThreshold();
+	}
+
+	if (distributedPlan->mergeSortedTaskResults)
+	{
+		taskTupleStoreList = list_concat(taskTupleStoreList,
+										 CreateTaskTupleStores(execution,
+															   tupleStoreMemory));
+	}
+
 	if (ShouldRunTasksSequentially(execution->tasksToExecute))
 	{
+		IncrementStatCounter(STAT_SEQUENTIAL_EXECUTIONS);
 		SequentialRunDistributedExecution(execution);
 	}
 	else
 	{
+		execution->pipelinePrepareTransaction =
+			ShouldPipelinePrepareTransaction(execution);
+
 		RunDistributedExecution(execution);
 	}
 
@@ -749,6 +1271,9 @@ AdaptiveExecutor(CitusScanState *scanState)
 		}
 	}
 
+	scanState->bytesReceived += execution->bytesReceived;
+	scanState->taskTimingList = execution->taskTimingList;
+
 	FinishDistributedExecution(execution);
 
 	if (hasDependentJobs)
@@ -756,84 +1281,769 @@ AdaptiveExecutor(CitusScanState *scanState)
 		DoRepartitionCleanup(jobIdList);
 	}
 
+	if (distributedPlan->mergeSortedTaskResults)
+	{
+		/* the tuple stores of the tasks are released by the merge */
+		scanState->spilledTupleStoreCount += CountSpilledTupleStores(taskTupleStoreList);
+
+		MergeSortedTaskResults(scanState, taskTupleStoreList);
+	}
+
+	scanState->spilledTupleStoreCount +=
+		CountSpilledTupleStores(list_make1(scanState->tuplestorestate));
+
 	if (SortReturning && distributedPlan->hasReturning)
 	{
 		SortTupleStore(scanState);
 	}
 
+	if (cacheKey != NULL)
+	{
+		StoreCachedResult(cacheKey, scanState);
+	}
+
 	return resultSlot;
 }
 
 
 /*
- * HasDependentJobs returns true if there is any dependent job
- * for the mainjob(top level) job.
+ * ShouldPipelinePrepareTransaction returns true if the given execution can send
+ * PREPARE TRANSACTION in the same round trip as the last task on a connection,
+ * rather than at commit time.
+ *
+ * That is only safe if no more commands are sent over the connections of the
+ * transaction, so we only do it for modifications that use 2PC and run as the
+ * only statement of an implicit transaction at the top level. Later
+ * executions in the same transaction error out in StartDistributedExecution.
  */
 static bool
-HasDependentJobs(Job *mainJob)
+ShouldPipelinePrepareTransaction(DistributedExecution *execution)
 {
-	return list_length(mainJob->dependentJobList) > 0;
-}
+	TransactionProperties *xactProperties = execution->transactionProperties;
 
+	if (!EnablePipelinedPrepare)
+	{
+		return false;
+	}
 
-/*
- * RunLocalExecution runs the localTaskList in the execution, fills the tuplestore
- * and sets the es_processed if necessary.
- *
- * It also sorts the tuplestore if there are no remote tasks remaining.
- */
-static void
-RunLocalExecution(CitusScanState *scanState, DistributedExecution *execution)
-{
-	uint64 rowsProcessed = ExecuteLocalTaskList(scanState, execution->localTaskList);
+	if (execution->modLevel == ROW_MODIFY_READONLY ||
+		list_length(execution->jobIdList) > 0 ||
+		execution->taskCompletedCallback != NULL)
+	{
+		return false;
+	}
 
-	/*
-	 * We're deliberately not setting execution->rowsProcessed here. The main reason
-	 * is that modifications to reference tables would end-up setting it both here
-	 * and in AdaptiveExecutor. Instead, we set executorState here and skip updating it
-	 * for reference table modifications in AdaptiveExecutor.
-	 */
-	EState *executorState = ScanStateGetExecutorState(scanState);
-	executorState->es_processed = rowsProcessed;
+	if (xactProperties->useRemoteTransactionBlocks != TRANSACTION_BLOCKS_REQUIRED ||
+		!xactProperties->requires2PC)
+	{
+		return false;
+	}
+
+	if (IsMultiStatementTransaction() || ExecutorLevel > 1)
+	{
+		return false;
+	}
+
+	return true;
 }
 
 
 /*
- * AdjustDistributedExecutionAfterLocalExecution simply updates the necessary fields of
- * the distributed execution.
+ * CanPipelineBeginOnSession returns whether the BEGIN of the remote transaction
+ * on the given session can be sent in the same round trip as its first task,
+ * instead of waiting for the results of the BEGIN before sending the task.
  */
-static void
-AdjustDistributedExecutionAfterLocalExecution(DistributedExecution *execution)
+static bool
+CanPipelineBeginOnSession(WorkerSession *session)
 {
-	/* we only need to execute the remote tasks */
-	execution->tasksToExecute = execution->remoteTaskList;
+	DistributedExecution *execution = session->workerPool->distributedExecution;
 
-	execution->totalTaskCount = list_length(execution->remoteTaskList);
-	execution->unfinishedTaskCount = list_length(execution->remoteTaskList);
+	if (!EnablePipelinedBegin)
+	{
+		return false;
+	}
+
+	/* a multi-statement query cannot carry parameters or request binary results */
+	if (execution->paramListInfo != NULL || execution->binaryResults)
+	{
+		return false;
+	}
+
+	return CanPipelineRemoteTransactionBegin();
 }
 
 
 /*
- * ExecuteUtilityTaskListWithoutResults is a wrapper around executing task
- * list for utility commands. For remote tasks, it simply calls in adaptive
- * executor's task execution function. For local tasks (if any), kicks Process
- * Utility via CitusProcessUtility for utility commands. As some local utility
- * commands can trigger udf calls, this function also processes those udf calls
- * locally.
+ * CanPipelinePrepareTransaction returns whether the task that is about to be
+ * sent over the given session is the last command of the transaction on the
+ * connection. That is the case when no other tasks of the execution could be
+ * assigned to the session or its worker pool later on.
  */
-void
-ExecuteUtilityTaskListWithoutResults(List *taskList, bool localExecutionSupported)
+static bool
+CanPipelinePrepareTransaction(WorkerSession *session)
 {
-	RowModifyLevel rowModifyLevel = ROW_MODIFY_NONE;
-
-	List *localTaskList = NIL;
-	List *remoteTaskList = NIL;
+	WorkerPool *workerPool = session->workerPool;
+	DistributedExecution *execution = workerPool->distributedExecution;
+	MultiConnection *connection = session->connection;
+	RemoteTransaction *transaction = &(connection->remoteTransaction);
+	Task *task = session->currentTask->shardCommandExecution->task;
 
-	/*
-	 * Divide tasks into two if localExecutionSupported is set to true and execute
-	 * the local tasks
-	 */
-	if (localExecutionSupported && ShouldExecuteTasksLocally(taskList))
+	if (!execution->pipelinePrepareTransaction)
+	{
+		return false;
+	}
+
+	/* a multi-statement query cannot carry parameters */
+	if (execution->paramListInfo != NULL && !task->parametersInQueryStringResolved)
+	{
+		return false;
+	}
+
+	if (!transaction->beginSent || transaction->transactionFailed)
+	{
+		return false;
+	}
+
+	if (!dlist_is_empty(&session->readyTaskQueue) ||
+		!dlist_is_empty(&workerPool->readyTaskQueue) ||
+		!dlist_is_empty(&workerPool->pendingTaskQueue))
+	{
+		return false;
+	}
+
+	return true;
+}
+
+
+/*
+ * ShouldStreamExecution returns true if the rows of the given execution can be
+ * returned while the remaining results are still being read from the workers.
+ *
+ * Streaming keeps connections claimed for the execution while control is back
+ * in the postgres executor, so we only do it for read-only scans that run at
+ * the top level, outside of a transaction block or for a named portal such as
+ * a cursor. The rows of a cursor are then fetched from the workers as they are
+ * fetched from the cursor. Other statements in the transaction first read the
+ * remaining results of the suspended scans, such that they can use the
+ * connections. If an error happens while the scan is suspended, the
+ * connections are closed at the end of the transaction. The scan should also
+ * never have to be rewound nor read backwards, since rows are removed from the
+ * tuple store once they are returned.
+ */
+static bool
+ShouldStreamExecution(CitusScanState *scanState, DistributedExecution *execution)
+{
+	if (!EnableStreamingExecution)
+	{
+		return false;
+	}
+
+	if (execution->modLevel != ROW_MODIFY_READONLY ||
+		list_length(execution->jobIdList) > 0 ||
+		list_length(execution->tasksToExecute) == 0)
+	{
+		return false;
+	}
+
+	/* sorted rows of the tasks are only merged once all of them arrived */
+	if (scanState->distributedPlan->mergeSortedTaskResults)
+	{
+		return false;
+	}
+
+	if ((scanState->eflags & (EXEC_FLAG_BACKWARD | EXEC_FLAG_REWIND |
+							  EXEC_FLAG_EXPLAIN_ONLY)) != 0)
+	{
+		return false;
+	}
+
+	if ((IsTransactionBlock() && !ActivePortalIsNamed()) || ExecutorLevel > 1 ||
+		StoredProcedureLevel > 0 || DoBlockLevel > 0)
+	{
+		return false;
+	}
+
+	/* sequential executions run one task at a time anyway */
+	if (ShouldRunTasksSequentially(execution->tasksToExecute))
+	{
+		return false;
+	}
+
+	return true;
+}
+
+
+/*
+ * ShouldStreamLocalExecution returns true if the rows of the given execution
+ * can be returned straight from the plan of its only local task, rather than
+ * being stored in the tuple store first.
+ *
+ * Unlike remote streaming, this does not hold on to any connections, so it is
+ * also possible within transaction blocks. Since the local task is only run
+ * further while rows are pulled from the scan, we require that all rows come
+ * from that single task and that the scan never needs to be rewound nor read
+ * backwards.
+ */
+static bool
+ShouldStreamLocalExecution(CitusScanState *scanState, DistributedExecution *execution)
+{
+	if (!EnableStreamingExecution)
+	{
+		return false;
+	}
+
+	if (execution->modLevel != ROW_MODIFY_READONLY ||
+		list_length(execution->jobIdList) > 0 ||
+		list_length(execution->localTaskList) != 1 ||
+		list_length(execution->remoteTaskList) > 0)
+	{
+		return false;
+	}
+
+	if ((scanState->eflags & (EXEC_FLAG_BACKWARD | EXEC_FLAG_REWIND |
+							  EXEC_FLAG_EXPLAIN_ONLY)) != 0)
+	{
+		return false;
+	}
+
+	return true;
+}
+
+
+/*
+ * StartStreamingExecution assigns the tasks of the execution to connections
+ * and stores the execution in the scan state, such that CitusExecScan can run
+ * it in steps via ReturnTupleFromStreamingExecution.
+ */
+static void
+StartStreamingExecution(CitusScanState *scanState, DistributedExecution *execution)
+{
+	EState *executorState = ScanStateGetExecutorState(scanState);
+
+	/*
+	 * If the transaction aborts while the scan is suspended, the executor
+	 * memory is reset without CitusEndScan being called. Make sure we do not
+	 * leak the file descriptors of the wait event set in that case.
+	 */
+	MemoryContextCallback *cleanupCallback =
+		MemoryContextAllocZero(executorState->es_query_cxt,
+							   sizeof(MemoryContextCallback));
+	cleanupCallback->func = FreeStreamingExecutionWaitEventSet;
+	cleanupCallback->arg = execution;
+	MemoryContextRegisterResetCallback(executorState->es_query_cxt, cleanupCallback);
+
+	AssignTasksToConnectionsOrWorkerPool(execution);
+
+	/* always (re)build the wait event set the first time */
+	execution->connectionSetChanged = true;
+
+	scanState->streamingExecution = execution;
+
+	execution->streamingScanState = scanState;
+	dlist_push_tail(&StreamingExecutionList, &execution->streamingExecutionNode);
+}
+
+
+/*
+ * ReturnTupleFromStreamingExecution returns the next tuple of a streaming
+ * execution. When all rows in the tuple store have been returned, the tuple
+ * store is emptied and the execution continues until new rows arrive or all
+ * tasks are finished.
+ */
+TupleTableSlot *
+ReturnTupleFromStreamingExecution(CitusScanState *scanState)
+{
+	TupleTableSlot *resultSlot = ReturnTupleFromTuplestore(scanState);
+
+	while (TupIsNull(resultSlot) && scanState->streamingExecution != NULL)
+	{
+		ContinueStreamingExecution(scanState);
+
+		resultSlot = ReturnTupleFromTuplestore(scanState);
+	}
+
+	return resultSlot;
+}
+
+
+/*
+ * FinishStreamingExecution runs the remainder of a streaming execution whose
+ * rows are no longer needed, for instance because of a LIMIT on top of the
+ * scan. The remaining results need to be read from the connections before
+ * they can be used again.
+ */
+void
+FinishStreamingExecution(CitusScanState *scanState)
+{
+	while (scanState->streamingExecution != NULL)
+	{
+		ContinueStreamingExecution(scanState);
+	}
+}
+
+
+/*
+ * ContinueStreamingExecution discards the rows that were already returned and
+ * runs the streaming execution of the scan until it produces more rows. Once
+ * the execution finishes, it is removed from the scan state.
+ */
+static void
+ContinueStreamingExecution(CitusScanState *scanState)
+{
+	DistributedExecution *execution = scanState->streamingExecution;
+
+	tuplestore_clear(scanState->tuplestorestate);
+
+	bool pauseOnResults = true;
+	bool executionFinished = ContinueDistributedExecution(execution, pauseOnResults);
+	if (executionFinished)
+	{
+		EndStreamingExecution(scanState);
+	}
+}
+
+
+/*
+ * EndStreamingExecution finishes the streaming execution of the scan, whose
+ * tasks are all done, and removes it from the scan state.
+ */
+static void
+EndStreamingExecution(CitusScanState *scanState)
+{
+	DistributedExecution *execution = scanState->streamingExecution;
+
+	scanState->bytesReceived += execution->bytesReceived;
+	scanState->taskTimingList = execution->taskTimingList;
+
+	if (execution->streamingScanState != NULL)
+	{
+		dlist_delete(&execution->streamingExecutionNode);
+		execution->streamingScanState = NULL;
+	}
+
+	FinishDistributedExecution(execution);
+
+	scanState->streamingExecution = NULL;
+}
+
+
+/*
+ * FinishSuspendedStreamingExecutions reads the remaining results of the
+ * streaming executions that are suspended in between fetches into the tuple
+ * stores of their scans, and finishes them. Afterwards, their connections can
+ * be used by other executions in the transaction, and their scans return the
+ * remaining rows from the tuple store.
+ */
+void
+FinishSuspendedStreamingExecutions(void)
+{
+	while (!dlist_is_empty(&StreamingExecutionList))
+	{
+		DistributedExecution *execution =
+			dlist_head_element(DistributedExecution, streamingExecutionNode,
+							   &StreamingExecutionList);
+		CitusScanState *scanState = execution->streamingScanState;
+		EState *executorState = ScanStateGetExecutorState(scanState);
+
+		/* the execution may allocate memory that the scan uses later on */
+		MemoryContext oldContext =
+			MemoryContextSwitchTo(executorState->es_query_cxt);
+
+		/* unlike ContinueStreamingExecution, keep the rows that were not fetched */
+		bool pauseOnResults = false;
+		bool executionFinished = false;
+		while (!executionFinished)
+		{
+			executionFinished = ContinueDistributedExecution(execution, pauseOnResults);
+		}
+
+		EndStreamingExecution(scanState);
+
+		MemoryContextSwitchTo(oldContext);
+	}
+}
+
+
+/*
+ * ForgetSuspendedStreamingExecutions empties the list of suspended streaming
+ * executions when their (sub)transaction aborts, since their connections are
+ * then cancelled and their scans cannot be fetched from anymore.
+ */
+void
+ForgetSuspendedStreamingExecutions(void)
+{
+	dlist_mutable_iter iter;
+
+	dlist_foreach_modify(iter, &StreamingExecutionList)
+	{
+		DistributedExecution *execution =
+			dlist_container(DistributedExecution, streamingExecutionNode, iter.cur);
+
+		dlist_delete(&execution->streamingExecutionNode);
+		execution->streamingScanState = NULL;
+	}
+}
+
+
+/*
+ * ActivePortalIsNamed returns whether the statement runs in a named portal,
+ * which is the case for cursors and for portals of the extended query
+ * protocol, whose rows clients can fetch in batches.
+ */
+static bool
+ActivePortalIsNamed(void)
+{
+	return ActivePortal != NULL && ActivePortal->name != NULL &&
+		   ActivePortal->name[0] != '\0';
+}
+
+
+/*
+ * FreeStreamingExecutionWaitEventSet is a memory context reset callback that
+ * frees the wait event set of a streaming execution that did not run to
+ * completion.
+ */
+static void
+FreeStreamingExecutionWaitEventSet(void *arg)
+{
+	DistributedExecution *execution = (DistributedExecution *) arg;
+
+	if (execution->streamingScanState != NULL)
+	{
+		dlist_delete(&execution->streamingExecutionNode);
+		execution->streamingScanState = NULL;
+	}
+
+	if (execution->waitEventSet != NULL)
+	{
+		FreeWaitEventSet(execution->waitEventSet);
+		execution->waitEventSet = NULL;
+	}
+}
+
+
+/*
+ * HasDependentJobs returns true if there is any dependent job
+ * for the mainjob(top level) job.
+ */
+static bool
+HasDependentJobs(Job *mainJob)
+{
+	return list_length(mainJob->dependentJobList) > 0;
+}
+
+
+/*
+ * RunLocalExecution runs the localTaskList in the execution, fills the tuplestore
+ * and sets the es_processed if necessary.
+ *
+ * It also sorts the tuplestore if there are no remote tasks remaining.
+ */
+static void
+RunLocalExecution(CitusScanState *scanState, DistributedExecution *execution)
+{
+	uint64 rowsProcessed = ExecuteLocalTaskList(scanState, execution->localTaskList);
+
+	/*
+	 * We're deliberately not setting execution->rowsProcessed here. The main reason
+	 * is that modifications to reference tables would end-up setting it both here
+	 * and in AdaptiveExecutor. Instead, we set executorState here and skip updating it
+	 * for reference table modifications in AdaptiveExecutor.
+	 */
+	EState *executorState = ScanStateGetExecutorState(scanState);
+	executorState->es_processed = rowsProcessed;
+}
+
+
+/*
+ * RunLocalExecutionIntoTaskTupleStores runs the local tasks of the execution
+ * one by one and writes the rows of every task to a tuple store of its own,
+ * rather than to the tuple store of the scan. It returns the tuple stores.
+ */
+static List *
+RunLocalExecutionIntoTaskTupleStores(CitusScanState *scanState,
+									 DistributedExecution *execution,
+									 int tupleStoreMemory)
+{
+	Tuplestorestate *scanTupleStore = scanState->tuplestorestate;
+	bool randomAccess = false;
+	bool interTransactions = false;
+	List *taskTupleStoreList = NIL;
+
+	Task *task = NULL;
+	foreach_ptr(task, execution->localTaskList)
+	{
+		Tuplestorestate *taskTupleStore =
+			tuplestore_begin_heap(randomAccess, interTransactions, tupleStoreMemory);
+
+		/* local execution writes to the tuple store of the scan */
+		scanState->tuplestorestate = taskTupleStore;
+		ExecuteLocalTaskList(scanState, list_make1(task));
+
+		taskTupleStoreList = lappend(taskTupleStoreList, taskTupleStore);
+	}
+
+	scanState->tuplestorestate = scanTupleStore;
+
+	return taskTupleStoreList;
+}
+
+
+/*
+ * CreateTaskTupleStores gives every task that the execution runs remotely a
+ * tuple store of its own, such that the rows of the tasks do not get mixed in
+ * the tuple store of the execution. It returns the tuple stores, which may
+ * each use tupleStoreMemory kB before they spill to disk.
+ */
+static List *
+CreateTaskTupleStores(DistributedExecution *execution, int tupleStoreMemory)
+{
+	bool randomAccess = false;
+	bool interTransactions = false;
+	List *taskTupleStoreList = NIL;
+	HASHCTL info;
+
+	memset(&info, 0, sizeof(info));
+	info.keysize = sizeof(Task *);
+	info.entrysize = sizeof(TaskResultDestination);
+	info.hcxt = CurrentMemoryContext;
+
+	HTAB *taskResultDestinationHash =
+		hash_create("citus task result destinations", 64, &info,
+					HASH_ELEM | HASH_BLOBS | HASH_CONTEXT);
+
+	Task *task = NULL;
+	foreach_ptr(task, execution->tasksToExecute)
+	{
+		bool found = false;
+		TaskResultDestination *resultDestination =
+			hash_search(taskResultDestinationHash, &task, HASH_ENTER, &found);
+
+		/* all tasks return rows of the execution's tuple descriptor */
+		resultDestination->tupleDescriptor = execution->tupleDescriptor;
+		resultDestination->tupleStore =
+			tuplestore_begin_heap(randomAccess, interTransactions, tupleStoreMemory);
+		resultDestination->attributeInputMetadata = execution->attributeInputMetadata;
+		resultDestination->columnArray = execution->columnArray;
+
+		taskTupleStoreList = lappend(taskTupleStoreList, resultDestination->tupleStore);
+	}
+
+	execution->taskResultDestinationHash = taskResultDestinationHash;
+
+	return taskTupleStoreList;
+}
+
+
+/*
+ * MergeSortedTaskResults merges the rows in the given tuple stores, which are
+ * sorted in the order of the ORDER BY of the masterQuery, into the tuple store
+ * of the scan, and frees the tuple stores. Since the standard planner did not
+ * add a Sort on top of the scan for such plans, this takes the place of the
+ * sort at the cost of only comparing the first rows of the tasks.
+ */
+static void
+MergeSortedTaskResults(CitusScanState *scanState, List *taskTupleStoreList)
+{
+	Query *masterQuery = scanState->distributedPlan->masterQuery;
+	TupleDesc tupleDescriptor = ScanStateGetTupleDescriptor(scanState);
+	int taskCount = list_length(taskTupleStoreList);
+	bool forward = true;
+	bool copy = false;
+
+	SortedTaskResultMerge *merge = palloc0(sizeof(SortedTaskResultMerge));
+	merge->sortKeyCount = list_length(masterQuery->sortClause);
+	merge->sortKeys = palloc0(merge->sortKeyCount * sizeof(SortSupportData));
+	merge->tupleStores = palloc0(Max(taskCount, 1) * sizeof(Tuplestorestate *));
+	merge->slots = palloc0(Max(taskCount, 1) * sizeof(TupleTableSlot *));
+
+	int sortKeyIndex = 0;
+	SortGroupClause *sortClause = NULL;
+	foreach_ptr(sortClause, masterQuery->sortClause)
+	{
+		TargetEntry *sortEntry =
+			get_sortgroupclause_tle(sortClause, masterQuery->targetList);
+		Var *sortColumn = (Var *) sortEntry->expr;
+		SortSupport sortKey = &merge->sortKeys[sortKeyIndex];
+
+		sortKey->ssup_cxt = CurrentMemoryContext;
+		sortKey->ssup_collation = sortColumn->varcollid;
+		sortKey->ssup_nulls_first = sortClause->nulls_first;
+		sortKey->ssup_attno = sortColumn->varattno;
+
+		PrepareSortSupportFromOrderingOp(sortClause->sortop, sortKey);
+
+		sortKeyIndex++;
+	}
+
+	binaryheap *taskHeap = binaryheap_allocate(Max(taskCount, 1),
+											   CompareTaskResultSlots, merge);
+
+	/* start with the first row of every task */
+	int taskIndex = 0;
+	Tuplestorestate *taskTupleStore = NULL;
+	foreach_ptr(taskTupleStore, taskTupleStoreList)
+	{
+		merge->tupleStores[taskIndex] = taskTupleStore;
+		merge->slots[taskIndex] = MakeSingleTupleTableSlotCompat(tupleDescriptor,
+																 &TTSOpsMinimalTuple);
+
+		if (tuplestore_gettupleslot(taskTupleStore, forward, copy,
+									merge->slots[taskIndex]))
+		{
+			binaryheap_add_unordered(taskHeap, Int32GetDatum(taskIndex));
+		}
+
+		taskIndex++;
+	}
+
+	binaryheap_build(taskHeap);
+
+	/* the task with the smallest row is on top, its next row takes its place */
+	while (!binaryheap_empty(taskHeap))
+	{
+		taskIndex = DatumGetInt32(binaryheap_first(taskHeap));
+		taskTupleStore = merge->tupleStores[taskIndex];
+
+		tuplestore_puttupleslot(scanState->tuplestorestate, merge->slots[taskIndex]);
+
+		if (tuplestore_gettupleslot(taskTupleStore, forward, copy,
+									merge->slots[taskIndex]))
+		{
+			binaryheap_replace_first(taskHeap, Int32GetDatum(taskIndex));
+		}
+		else
+		{
+			binaryheap_remove_first(taskHeap);
+		}
+	}
+
+	for (taskIndex = 0; taskIndex < taskCount; taskIndex++)
+	{
+		ExecDropSingleTupleTableSlot(merge->slots[taskIndex]);
+		tuplestore_end(merge->tupleStores[taskIndex]);
+	}
+
+	binaryheap_free(taskHeap);
+}
+
+
+/*
+ * TupleStoreMemoryLimit returns the memory in kB that each of the given number
+ * of tuple stores of a distributed execution may use, such that together they
+ * stay within citus.max_coordinator_query_memory. Tuple stores that reach the
+ * limit spill their rows to a temporary file, so a query with many tasks
+ * writes to disk rather than using work_mem for every task.
+ */
+int
+TupleStoreMemoryLimit(int tupleStoreCount)
+{
+	if (MaxCoordinatorQueryMemory < 0)
+	{
+		return work_mem;
+	}
+
+	int tupleStoreMemory = MaxCoordinatorQueryMemory / Max(tupleStoreCount, 1);
+
+	/* tuple stores keep some rows in memory, the same minimum as for work_mem */
+	return Max(Min(tupleStoreMemory, work_mem), MIN_TUPLE_STORE_MEMORY);
+}
+
+
+/*
+ * CountSpilledTupleStores returns the number of the given tuple stores that
+ * wrote their rows to a temporary file.
+ */
+static int
+CountSpilledTupleStores(List *tupleStoreList)
+{
+	int spilledTupleStoreCount = 0;
+
+	Tuplestorestate *tupleStore = NULL;
+	foreach_ptr(tupleStore, tupleStoreList)
+	{
+		if (tupleStore != NULL && !tuplestore_in_memory(tupleStore))
+		{
+			spilledTupleStoreCount++;
+		}
+	}
+
+	return spilledTupleStoreCount;
+}
+
+
+/*
+ * CompareTaskResultSlots is the comparator of the heap of MergeSortedTaskResults.
+ * The heap keeps the largest element on top, so we return the inverse of the
+ * order of the next rows of the given tasks.
+ */
+static int
+CompareTaskResultSlots(Datum left, Datum right, void *arg)
+{
+	SortedTaskResultMerge *merge = (SortedTaskResultMerge *) arg;
+	TupleTableSlot *leftSlot = merge->slots[DatumGetInt32(left)];
+	TupleTableSlot *rightSlot = merge->slots[DatumGetInt32(right)];
+
+	for (int sortKeyIndex = 0; sortKeyIndex < merge->sortKeyCount; sortKeyIndex++)
+	{
+		SortSupport sortKey = &merge->sortKeys[sortKeyIndex];
+		bool leftIsNull = false;
+		bool rightIsNull = false;
+
+		Datum leftValue = slot_getattr(leftSlot, sortKey->ssup_attno, &leftIsNull);
+		Datum rightValue = slot_getattr(rightSlot, sortKey->ssup_attno, &rightIsNull);
+
+		int comparison = ApplySortComparator(leftValue, leftIsNull, rightValue,
+											 rightIsNull, sortKey);
+		if (comparison != 0)
+		{
+			return -comparison;
+		}
+	}
+
+	return 0;
+}
+
+
+/*
+ * AdjustDistributedExecutionAfterLocalExecution simply updates the necessary fields of
+ * the distributed execution.
+ */
+static void
+AdjustDistributedExecutionAfterLocalExecution(DistributedExecution *execution)
+{
+	/* we only need to execute the remote tasks */
+	execution->tasksToExecute = execution->remoteTaskList;
+
+	execution->totalTaskCount = list_length(execution->remoteTaskList);
+	execution->unfinishedTaskCount = list_length(execution->remoteTaskList);
+}
+
+
+/*
+ * ExecuteUtilityTaskListWithoutResults is a wrapper around executing task
+ * list for utility commands. For remote tasks, it simply calls in adaptive
+ * executor's task execution function. For local tasks (if any), kicks Process
+ * Utility via CitusProcessUtility for utility commands. As some local utility
+ * commands can trigger udf calls, this function also processes those udf calls
+ * locally.
+ */
+void
+ExecuteUtilityTaskListWithoutResults(List *taskList, bool localExecutionSupported)
+{
+	RowModifyLevel rowModifyLevel = ROW_MODIFY_NONE;
+
+	List *localTaskList = NIL;
+	List *remoteTaskList = NIL;
+
+	/* local tasks do not go through CreateDistributedExecution */
+	RecordModifiedShardsOfTaskList(taskList);
+
+	/*
+	 * Divide tasks into two if localExecutionSupported is set to true and execute
+	 * the local tasks
+	 */
+	if (localExecutionSupported && ShouldExecuteTasksLocally(taskList))
 	{
 		/*
 		 * Either we are executing a utility command or a UDF call triggered
@@ -884,6 +2094,95 @@ ExecuteTaskListOutsideTransaction(RowModifyLevel modLevel, List *taskList,
 }
 
 
+/*
+ * ExecuteTaskGraphOutsideTransaction executes the given tasks outside of a
+ * transaction block, and calls taskCompletedCallback whenever tasks finish. The
+ * tasks returned by the callback are added to the same execution, such that
+ * they can start on the connections that became idle without waiting for the
+ * other tasks of the execution to finish.
+ */
+uint64
+ExecuteTaskGraphOutsideTransaction(RowModifyLevel modLevel, List *taskList,
+								   int targetPoolSize, List *jobIdList,
+								   TaskCompletedCallback taskCompletedCallback,
+								   void *taskCompletedCallbackContext)
+{
+	TransactionProperties xactProperties =
+		DecideTransactionPropertiesForTaskList(modLevel, taskList, true);
+
+	char *sessionSetupCommand = NULL;
+
+	return ExecuteTaskGraph(modLevel, taskList, targetPoolSize, &xactProperties,
+							jobIdList, sessionSetupCommand, taskCompletedCallback,
+							taskCompletedCallbackContext);
+}
+
+
+/*
+ * ExecuteTaskListWithCallback executes the given tasks as part of the current
+ * transaction, and calls taskCompletedCallback whenever tasks finish, such
+ * that the caller can keep track of the progress of a long running command.
+ * If sessionSetupCommand is given, it is sent over every connection of the
+ * execution before the first task.
+ */
+uint64
+ExecuteTaskListWithCallback(RowModifyLevel modLevel, List *taskList,
+							int targetPoolSize, char *sessionSetupCommand,
+							TaskCompletedCallback taskCompletedCallback,
+							void *taskCompletedCallbackContext)
+{
+	if (TransactionAccessedLocalPlacement && AnyTaskAccessesLocalNode(taskList))
+	{
+		ErrorIfTransactionAccessedPlacementsLocally();
+	}
+
+	TransactionProperties xactProperties =
+		DecideTransactionPropertiesForTaskList(modLevel, taskList, false);
+
+	return ExecuteTaskGraph(modLevel, taskList, targetPoolSize, &xactProperties,
+							NIL, sessionSetupCommand, taskCompletedCallback,
+							taskCompletedCallbackContext);
+}
+
+
+/*
+ * ExecuteTaskGraph sets up the execution for the given task list with the
+ * given completion callback and runs it.
+ */
+static uint64
+ExecuteTaskGraph(RowModifyLevel modLevel, List *taskList, int targetPoolSize,
+				 TransactionProperties *xactProperties, List *jobIdList,
+				 char *sessionSetupCommand,
+				 TaskCompletedCallback taskCompletedCallback,
+				 void *taskCompletedCallbackContext)
+{
+	TupleDesc tupleDescriptor = NULL;
+	Tuplestorestate *tupleStore = NULL;
+	bool hasReturning = false;
+	ParamListInfo paramListInfo = NULL;
+
+	if (MultiShardConnectionType == SEQUENTIAL_CONNECTION)
+	{
+		targetPoolSize = 1;
+	}
+
+	DistributedExecution *execution =
+		CreateDistributedExecution(modLevel, taskList, hasReturning, paramListInfo,
+								   tupleDescriptor, tupleStore, targetPoolSize,
+								   xactProperties, jobIdList);
+
+	execution->taskCompletedCallback = taskCompletedCallback;
+	execution->taskCompletedCallbackContext = taskCompletedCallbackContext;
+	execution->sessionSetupCommand = sessionSetupCommand;
+
+	StartDistributedExecution(execution);
+	RunDistributedExecution(execution);
+	FinishDistributedExecution(execution);
+
+	return execution->rowsProcessed;
+}
+
+
 /*
  * ExecuteTaskList is a proxy to ExecuteTaskListExtended() with defaults
  * for some of the arguments.
@@ -933,6 +2232,33 @@ ExecuteTaskListExtended(RowModifyLevel modLevel, List *taskList,
 						TupleDesc tupleDescriptor, Tuplestorestate *tupleStore,
 						bool hasReturning, int targetPoolSize,
 						TransactionProperties *xactProperties, List *jobIdList)
+{
+	TaskCompletedCallback taskCompletedCallback = NULL;
+	void *taskCompletedCallbackContext = NULL;
+
+	return ExecuteTaskListExtendedWithCallback(modLevel, taskList, tupleDescriptor,
+											   tupleStore, hasReturning,
+											   targetPoolSize, xactProperties,
+											   jobIdList, taskCompletedCallback,
+											   taskCompletedCallbackContext);
+}
+
+
+/*
+ * ExecuteTaskListExtendedWithCallback sets up the execution for given task
+ * list like ExecuteTaskListExtended and runs it. If taskCompletedCallback is
+ * given, it is called whenever tasks finish, such that the caller can keep
+ * track of the progress of the execution.
+ */
+uint64
+ExecuteTaskListExtendedWithCallback(RowModifyLevel modLevel, List *taskList,
+									TupleDesc tupleDescriptor,
+									Tuplestorestate *tupleStore,
+									bool hasReturning, int targetPoolSize,
+									TransactionProperties *xactProperties,
+									List *jobIdList,
+									TaskCompletedCallback taskCompletedCallback,
+									void *taskCompletedCallbackContext)
 {
 	ParamListInfo paramListInfo = NULL;
 
@@ -944,24 +2270,117 @@ ExecuteTaskListExtended(RowModifyLevel modLevel, List *taskList,
 	 */
 	if (TransactionAccessedLocalPlacement && AnyTaskAccessesLocalNode(taskList))
 	{
-		ErrorIfTransactionAccessedPlacementsLocally();
-	}
+		ErrorIfTransactionAccessedPlacementsLocally();
+	}
+
+	if (MultiShardConnectionType == SEQUENTIAL_CONNECTION)
+	{
+		targetPoolSize = 1;
+	}
+
+	DistributedExecution *execution =
+		CreateDistributedExecution(modLevel, taskList, hasReturning, paramListInfo,
+								   tupleDescriptor, tupleStore, targetPoolSize,
+								   xactProperties, jobIdList);
+
+	execution->taskCompletedCallback = taskCompletedCallback;
+	execution->taskCompletedCallbackContext = taskCompletedCallbackContext;
+
+	StartDistributedExecution(execution);
+	RunDistributedExecution(execution);
+	FinishDistributedExecution(execution);
+
+	return execution->rowsProcessed;
+}
+
+
+/*
+ * ExecuteTaskListsIntoTupleStores runs the task lists of several read-only
+ * queries in a single execution and writes the rows of the tasks in each task
+ * list to the tuple store at the same position in tupleStoreList, using the
+ * tuple descriptor at the same position in tupleDescriptorList.
+ *
+ * Since all tasks share the worker pools of a single execution, the latency
+ * of running the queries is that of the slowest query rather than the sum of
+ * them. The caller makes sure that none of the tasks are executed locally.
+ */
+void
+ExecuteTaskListsIntoTupleStores(List *taskListList, List *tupleDescriptorList,
+								List *tupleStoreList)
+{
+	RowModifyLevel modLevel = ROW_MODIFY_READONLY;
+	ParamListInfo paramListInfo = NULL;
+	TupleDesc tupleDescriptor = NULL;
+	Tuplestorestate *tupleStore = NULL;
+	bool hasReturning = false;
+	bool hasDependentJobs = false;
+	int targetPoolSize = MaxAdaptiveExecutorPoolSize;
+	List *jobIdList = NIL;
+	List *combinedTaskList = NIL;
+	HASHCTL info;
+
+	memset(&info, 0, sizeof(info));
+	info.keysize = sizeof(Task *);
+	info.entrysize = sizeof(TaskResultDestination);
+	info.hcxt = CurrentMemoryContext;
+
+	HTAB *taskResultDestinationHash =
+		hash_create("citus task result destinations", 64, &info,
+					HASH_ELEM | HASH_BLOBS | HASH_CONTEXT);
+
+	ListCell *taskListCell = NULL;
+	ListCell *tupleDescriptorCell = NULL;
+	ListCell *tupleStoreCell = NULL;
+	forthree(taskListCell, taskListList, tupleDescriptorCell, tupleDescriptorList,
+			 tupleStoreCell, tupleStoreList)
+	{
+		List *taskList = (List *) lfirst(taskListCell);
+		TupleDesc taskTupleDescriptor = (TupleDesc) lfirst(tupleDescriptorCell);
+		Tuplestorestate *taskTupleStore = (Tuplestorestate *) lfirst(tupleStoreCell);
 
-	if (MultiShardConnectionType == SEQUENTIAL_CONNECTION)
-	{
-		targetPoolSize = 1;
+		/* the tasks of a query share the input metadata and column array */
+		AttInMetadata *attributeInputMetadata =
+			TupleDescGetAttInMetadata(taskTupleDescriptor);
+		char **columnArray =
+			(char **) palloc0(taskTupleDescriptor->natts * sizeof(char *));
+
+		Task *task = NULL;
+		foreach_ptr(task, taskList)
+		{
+			bool found = false;
+			TaskResultDestination *resultDestination =
+				hash_search(taskResultDestinationHash, &task, HASH_ENTER, &found);
+
+			resultDestination->tupleDescriptor = taskTupleDescriptor;
+			resultDestination->tupleStore = taskTupleStore;
+			resultDestination->attributeInputMetadata = attributeInputMetadata;
+			resultDestination->columnArray = columnArray;
+		}
+
+		combinedTaskList = list_concat(combinedTaskList, list_copy(taskList));
 	}
 
+	/* take consistent snapshots of all nodes before reading from any of them */
+	EnsureDistributedSnapshotForExecution(modLevel, combinedTaskList, hasDependentJobs);
+
+	TransactionProperties xactProperties =
+		DecideTransactionPropertiesForTaskList(modLevel, combinedTaskList,
+											   hasDependentJobs);
+
+	/*
+	 * Without a tuple descriptor for the execution, rows are received in text
+	 * format and ReceiveResults uses the destination of each task instead.
+	 */
 	DistributedExecution *execution =
-		CreateDistributedExecution(modLevel, taskList, hasReturning, paramListInfo,
-								   tupleDescriptor, tupleStore, targetPoolSize,
-								   xactProperties, jobIdList);
+		CreateDistributedExecution(modLevel, combinedTaskList, hasReturning,
+								   paramListInfo, tupleDescriptor, tupleStore,
+								   targetPoolSize, &xactProperties, jobIdList);
+
+	execution->taskResultDestinationHash = taskResultDestinationHash;
 
 	StartDistributedExecution(execution);
 	RunDistributedExecution(execution);
 	FinishDistributedExecution(execution);
-
-	return execution->rowsProcessed;
 }
 
 
@@ -976,6 +2395,21 @@ CreateDistributedExecution(RowModifyLevel modLevel, List *taskList,
 						   Tuplestorestate *tupleStore, int targetPoolSize,
 						   TransactionProperties *xactProperties, List *jobIdList)
 {
+	/* the tasks may read or modify shards with buffered rows, send those first */
+	FlushBufferedInserts();
+
+	/* the same goes for the buffered DDL commands */
+	FlushBufferedDDLCommands();
+
+	/* the connections of suspended cursors may be needed by the tasks */
+	FinishSuspendedStreamingExecutions();
+
+	/* cached results of the modified shards become stale when the transaction ends */
+	if (TaskListModifiesDatabase(modLevel, taskList))
+	{
+		RecordModifiedShardsOfTaskList(taskList);
+	}
+
 	DistributedExecution *execution =
 		(DistributedExecution *) palloc0(sizeof(DistributedExecution));
 
@@ -1000,10 +2434,12 @@ CreateDistributedExecution(RowModifyLevel modLevel, List *taskList,
 	execution->totalTaskCount = list_length(taskList);
 	execution->unfinishedTaskCount = list_length(taskList);
 	execution->rowsProcessed = 0;
+	execution->bytesReceived = 0;
 
 	execution->raiseInterrupts = true;
 
 	execution->connectionSetChanged = false;
+	execution->sessionsAdded = false;
 	execution->waitFlagsChanged = false;
 
 	execution->jobIdList = jobIdList;
@@ -1014,6 +2450,11 @@ CreateDistributedExecution(RowModifyLevel modLevel, List *taskList,
 		execution->attributeInputMetadata = TupleDescGetAttInMetadata(tupleDescriptor);
 		execution->columnArray =
 			(char **) palloc0(tupleDescriptor->natts * sizeof(char *));
+
+		if (EnableBinaryProtocol && CanUseBinaryResultFormat(tupleDescriptor))
+		{
+			SetupBinaryResultFormat(execution);
+		}
 	}
 	else
 	{
@@ -1144,6 +2585,9 @@ StartDistributedExecution(DistributedExecution *execution)
 {
 	TransactionProperties *xactProperties = execution->transactionProperties;
 
+	/* pin the backend to the CPUs for distributed queries, if any */
+	ApplyCpuAffinity(ExecutorCpuAffinity);
+
 	if (xactProperties->useRemoteTransactionBlocks == TRANSACTION_BLOCKS_REQUIRED)
 	{
 		UseCoordinatedTransaction();
@@ -1154,6 +2598,17 @@ StartDistributedExecution(DistributedExecution *execution)
 		CoordinatedTransactionUse2PC();
 	}
 
+	if (AnyRemoteTransactionPrepared())
+	{
+		ereport(ERROR, (errmsg("cannot run a distributed command after the "
+							   "transaction was prepared on the workers"),
+						errdetail("PREPARE TRANSACTION was sent along with the last "
+								  "command of an implicit transaction, but the "
+								  "transaction continued."),
+						errhint("Try re-running the transaction with "
+								"citus.enable_pipelined_prepare set to off.")));
+	}
+
 	/*
 	 * Prevent unsafe concurrent modifications of replicated shards by taking
 	 * locks.
@@ -1278,6 +2733,17 @@ DistributedExecutionRequiresRollback(List *taskList)
 
 	if (ReadOnlyTask(task->taskType))
 	{
+		if (!ReadOnlySelectOpensTransactionBlock && XactReadOnly &&
+			XactIsoLevel == XACT_READ_COMMITTED)
+		{
+			/*
+			 * A read-only transaction cannot write, and a read committed one
+			 * takes a new snapshot for every statement, so the remote side does
+			 * not need to keep anything across statements.
+			 */
+			return false;
+		}
+
 		return SelectOpensTransactionBlock &&
 			   IsTransactionBlock();
 	}
@@ -1524,18 +2990,426 @@ AcquireExecutorShardLocksForExecution(DistributedExecution *execution)
 
 
 /*
- * FinishDistributedExecution cleans up resources associated with a
- * distributed execution.
+ * FinishDistributedExecution cleans up resources associated with a
+ * distributed execution.
+ */
+static void
+FinishDistributedExecution(DistributedExecution *execution)
+{
+	UnsetCitusNoticeLevel();
+
+	if (DistributedExecutionModifiesDatabase(execution))
+	{
+		/* prevent copying shards in same transaction */
+		XactModificationLevel = XACT_MODIFICATION_DATA;
+	}
+}
+
+
+/*
+ * DistributedPlanRowLimit returns the number of rows after which the combine
+ * query of the given plan stops reading rows from the custom scan, which is
+ * the case when a constant LIMIT (and OFFSET) applies directly to the rows
+ * that the tasks return. It returns 0 if all rows of the tasks are needed.
+ */
+static uint64
+DistributedPlanRowLimit(DistributedPlan *distributedPlan)
+{
+	Query *masterQuery = distributedPlan->masterQuery;
+	int64 limitCount = 0;
+	int64 limitOffset = 0;
+
+	if (distributedPlan->modLevel != ROW_MODIFY_READONLY || masterQuery == NULL ||
+		masterQuery->limitCount == NULL || !IsA(masterQuery->limitCount, Const))
+	{
+		return 0;
+	}
+
+	/* ordering, grouping or filtering the rows requires all of them */
+	if (masterQuery->sortClause != NIL || masterQuery->groupClause != NIL ||
+		masterQuery->distinctClause != NIL || masterQuery->havingQual != NULL ||
+		masterQuery->hasAggs || masterQuery->hasWindowFuncs ||
+		masterQuery->hasTargetSRFs || list_length(masterQuery->rtable) != 1 ||
+		(masterQuery->jointree != NULL && masterQuery->jointree->quals != NULL))
+	{
+		return 0;
+	}
+
+	Const *limitCountConst = (Const *) masterQuery->limitCount;
+	if (limitCountConst->constisnull)
+	{
+		/* LIMIT NULL does not limit the rows */
+		return 0;
+	}
+
+	limitCount = DatumGetInt64(limitCountConst->constvalue);
+
+	if (masterQuery->limitOffset != NULL)
+	{
+		if (!IsA(masterQuery->limitOffset, Const))
+		{
+			return 0;
+		}
+
+		Const *limitOffsetConst = (Const *) masterQuery->limitOffset;
+		if (!limitOffsetConst->constisnull)
+		{
+			limitOffset = DatumGetInt64(limitOffsetConst->constvalue);
+		}
+	}
+
+	if (limitCount <= 0 || limitOffset < 0)
+	{
+		return 0;
+	}
+
+	return (uint64) limitCount + (uint64) limitOffset;
+}
+
+
+/*
+ * TerminateUnfinishedTasks stops the execution once it received enough rows
+ * for the LIMIT of the query, or once all hedged reads finished on one of
+ * their placements. Tasks that did not start are not started, and
+ * connections over which a command is still in progress are shut down, which
+ * cancels the command on the worker. Idle connections stay available for
+ * later executions.
+ */
+static void
+TerminateUnfinishedTasks(DistributedExecution *execution)
+{
+	WorkerSession *session = NULL;
+	foreach_ptr(session, execution->sessionList)
+	{
+		MultiConnection *connection = session->connection;
+		RemoteTransaction *transaction = &(connection->remoteTransaction);
+		RemoteTransactionState transactionState = transaction->transactionState;
+
+		if (connection->pgConn == NULL ||
+			connection->connectionState == MULTI_CONNECTION_FAILED)
+		{
+			/* failed connections are closed in CleanUpSessions */
+			continue;
+		}
+
+		if (connection->connectionState == MULTI_CONNECTION_CONNECTED &&
+			session->currentTask == NULL &&
+			(transactionState == REMOTE_TRANS_NOT_STARTED ||
+			 transactionState == REMOTE_TRANS_STARTED))
+		{
+			/* no command in progress */
+			continue;
+		}
+
+		ShutdownConnection(connection);
+		connection->connectionState = MULTI_CONNECTION_LOST;
+
+		if (!transaction->beginSent)
+		{
+			transaction->transactionState = REMOTE_TRANS_NOT_STARTED;
+		}
+	}
+
+	/* the results of the remaining tasks are not needed */
+	execution->unfinishedTaskCount = 0;
+}
+
+
+/*
+ * RecordReadTaskExecutionTime remembers the execution time of a read-only
+ * task that finished in this backend, replacing the oldest one once
+ * HEDGED_READ_SAMPLE_COUNT execution times are kept.
+ */
+static void
+RecordReadTaskExecutionTime(double executionTimeMs)
+{
+	if (HedgedReadPercentile <= 0)
+	{
+		return;
+	}
+
+	int sampleIndex = ReadTaskExecutionTimeCount % HEDGED_READ_SAMPLE_COUNT;
+
+	ReadTaskExecutionTimes[sampleIndex] = executionTimeMs;
+	ReadTaskExecutionTimeCount++;
+
+	/* keep the count within bounds, but beyond the number of samples */
+	if (ReadTaskExecutionTimeCount >= 2 * HEDGED_READ_SAMPLE_COUNT)
+	{
+		ReadTaskExecutionTimeCount -= HEDGED_READ_SAMPLE_COUNT;
+	}
+}
+
+
+/*
+ * HedgedReadThreshold returns the number of milliseconds after which a
+ * read-only task that is still running should also be started on another
+ * placement, which is the citus.hedged_read_percentile of the execution
+ * times of recent read-only tasks, but at least citus.hedged_read_min_delay.
+ * It returns 0 if reads should not be hedged.
+ */
+static double
+HedgedReadThreshold(void)
+{
+	double executionTimes[HEDGED_READ_SAMPLE_COUNT];
+
+	if (HedgedReadPercentile <= 0 ||
+		ReadTaskExecutionTimeCount < HEDGED_READ_MIN_SAMPLE_COUNT)
+	{
+		return 0;
+	}
+
+	int sampleCount = Min(ReadTaskExecutionTimeCount, HEDGED_READ_SAMPLE_COUNT);
+
+	memcpy(executionTimes, ReadTaskExecutionTimes, sampleCount * sizeof(double));
+	qsort(executionTimes, sampleCount, sizeof(double), CompareExecutionTimes);
+
+	int percentileIndex = Min((sampleCount * HedgedReadPercentile) / 100,
+							  sampleCount - 1);
+
+	return Max(executionTimes[percentileIndex], (double) HedgedReadMinDelay);
+}
+
+
+/*
+ * CompareExecutionTimes is a qsort comparator for execution times.
+ */
+static int
+CompareExecutionTimes(const void *leftElement, const void *rightElement)
+{
+	double leftTime = *((const double *) leftElement);
+	double rightTime = *((const double *) rightElement);
+
+	if (leftTime < rightTime)
+	{
+		return -1;
+	}
+	else if (leftTime > rightTime)
+	{
+		return 1;
+	}
+
+	return 0;
+}
+
+
+/*
+ * StartHedgedReads makes another placement of the read-only tasks that have
+ * been running for longer than the hedged read threshold ready to start, such
+ * that a single slow worker does not hold up the execution. The rows of the
+ * placement that returns them first are used, see ClaimTaskResults.
+ */
+static void
+StartHedgedReads(DistributedExecution *execution)
+{
+	instr_time now;
+	INSTR_TIME_SET_CURRENT(now);
+
+	WorkerSession *session = NULL;
+	foreach_ptr(session, execution->sessionList)
+	{
+		TaskPlacementExecution *placementExecution = session->currentTask;
+		if (placementExecution == NULL)
+		{
+			continue;
+		}
+
+		TaskPlacementExecution *hedgedPlacementExecution =
+			HedgedPlacementExecution(placementExecution);
+		if (hedgedPlacementExecution == NULL)
+		{
+			continue;
+		}
+
+		double executionTimeMs =
+			ElapsedMilliseconds(placementExecution->startTime, now);
+		if (executionTimeMs < execution->hedgedReadThresholdMs)
+		{
+			continue;
+		}
+
+		ereport(DEBUG4, (errmsg("hedging task %u after %.3f ms on node %s:%d",
+								placementExecution->shardCommandExecution->task->taskId,
+								executionTimeMs,
+								placementExecution->shardPlacement->nodeName,
+								placementExecution->shardPlacement->nodePort)));
+
+		placementExecution->shardCommandExecution->hedged = true;
+		execution->hedgedReadsStarted = true;
+
+		PlacementExecutionReady(hedgedPlacementExecution);
+	}
+}
+
+
+/*
+ * HedgedReadTimeout returns the number of milliseconds until the first of the
+ * running read-only tasks should be hedged, or a second if there is none.
+ */
+static long
+HedgedReadTimeout(DistributedExecution *execution, instr_time now)
+{
+	double timeout = 1000;
+
+	WorkerSession *session = NULL;
+	foreach_ptr(session, execution->sessionList)
+	{
+		TaskPlacementExecution *placementExecution = session->currentTask;
+		if (placementExecution == NULL ||
+			HedgedPlacementExecution(placementExecution) == NULL)
+		{
+			continue;
+		}
+
+		double executionTimeMs =
+			ElapsedMilliseconds(placementExecution->startTime, now);
+		double timeUntilHedgedReadMs =
+			execution->hedgedReadThresholdMs - executionTimeMs;
+
+		if (timeUntilHedgedReadMs < timeout)
+		{
+			timeout = timeUntilHedgedReadMs;
+		}
+	}
+
+	/* round up, such that we do not wake up just before the threshold */
+	return (long) ceil(timeout);
+}
+
+
+/*
+ * HedgedPlacementExecution returns the placement execution on which the given
+ * running placement execution of a read-only task can be hedged, or NULL if
+ * the task should not be hedged. We only hedge tasks that can run on any
+ * placement, did not return rows yet and were not assigned to a connection
+ * due to earlier accesses in the transaction.
+ */
+static TaskPlacementExecution *
+HedgedPlacementExecution(TaskPlacementExecution *placementExecution)
+{
+	ShardCommandExecution *shardCommandExecution =
+		placementExecution->shardCommandExecution;
+	TaskPlacementExecution *hedgedPlacementExecution = NULL;
+
+	if (placementExecution->executionState != PLACEMENT_EXECUTION_RUNNING ||
+		shardCommandExecution->executionOrder != EXECUTION_ORDER_ANY ||
+		shardCommandExecution->executionState != TASK_EXECUTION_NOT_FINISHED ||
+		shardCommandExecution->hedged ||
+		shardCommandExecution->resultPlacementExecution != NULL)
+	{
+		return NULL;
+	}
+
+	for (int placementExecutionIndex = 0;
+		 placementExecutionIndex < shardCommandExecution->placementExecutionCount;
+		 placementExecutionIndex++)
+	{
+		TaskPlacementExecution *otherPlacementExecution =
+			shardCommandExecution->placementExecutions[placementExecutionIndex];
+
+		if (otherPlacementExecution->assignedSession != NULL)
+		{
+			return NULL;
+		}
+
+		if (hedgedPlacementExecution == NULL &&
+			otherPlacementExecution->executionState == PLACEMENT_EXECUTION_NOT_READY &&
+			!otherPlacementExecution->workerPool->failed)
+		{
+			hedgedPlacementExecution = otherPlacementExecution;
+		}
+	}
+
+	return hedgedPlacementExecution;
+}
+
+
+/*
+ * ClaimTaskResults returns whether the rows of the given placement execution
+ * should be stored. For tasks that can run on any placement, the first
+ * placement execution that returns rows or finishes claims the results of the
+ * task, and the other placement executions of a hedged read are cancelled.
+ */
+static bool
+ClaimTaskResults(TaskPlacementExecution *placementExecution)
+{
+	ShardCommandExecution *shardCommandExecution =
+		placementExecution->shardCommandExecution;
+
+	if (shardCommandExecution->executionOrder != EXECUTION_ORDER_ANY)
+	{
+		return true;
+	}
+
+	if (shardCommandExecution->resultPlacementExecution == NULL)
+	{
+		shardCommandExecution->resultPlacementExecution = placementExecution;
+
+		if (shardCommandExecution->hedged)
+		{
+			CancelHedgedPlacementExecutions(placementExecution);
+		}
+	}
+
+	return shardCommandExecution->resultPlacementExecution == placementExecution;
+}
+
+
+/*
+ * CancelHedgedPlacementExecutions stops the placement executions of a hedged
+ * read other than the given one, which returns the rows. Placement executions
+ * that did not start yet are put back in the pending queue of their worker
+ * pool, and commands that are running are cancelled, unless other tasks were
+ * sent along with them. Rows that still arrive for them are discarded.
  */
 static void
-FinishDistributedExecution(DistributedExecution *execution)
+CancelHedgedPlacementExecutions(TaskPlacementExecution *resultPlacementExecution)
 {
-	UnsetCitusNoticeLevel();
+	ShardCommandExecution *shardCommandExecution =
+		resultPlacementExecution->shardCommandExecution;
 
-	if (DistributedExecutionModifiesDatabase(execution))
+	for (int placementExecutionIndex = 0;
+		 placementExecutionIndex < shardCommandExecution->placementExecutionCount;
+		 placementExecutionIndex++)
 	{
-		/* prevent copying shards in same transaction */
-		XactModificationLevel = XACT_MODIFICATION_DATA;
+		TaskPlacementExecution *placementExecution =
+			shardCommandExecution->placementExecutions[placementExecutionIndex];
+		WorkerPool *workerPool = placementExecution->workerPool;
+
+		if (placementExecution == resultPlacementExecution)
+		{
+			continue;
+		}
+
+		if (placementExecution->executionState == PLACEMENT_EXECUTION_READY &&
+			placementExecution->assignedSession == NULL)
+		{
+			dlist_delete(&placementExecution->workerReadyQueueNode);
+			dlist_push_tail(&workerPool->pendingTaskQueue,
+							&placementExecution->workerPendingQueueNode);
+			workerPool->readyTaskCount--;
+
+			placementExecution->executionState = PLACEMENT_EXECUTION_NOT_READY;
+			continue;
+		}
+
+		if (placementExecution->executionState != PLACEMENT_EXECUTION_RUNNING ||
+			placementExecution->cancelled)
+		{
+			continue;
+		}
+
+		WorkerSession *session = NULL;
+		foreach_ptr(session, workerPool->sessionList)
+		{
+			if (session->currentTask == placementExecution &&
+				session->pipelinedTaskList == NIL)
+			{
+				placementExecution->cancelled =
+					SendCancelationRequest(session->connection);
+				break;
+			}
+		}
 	}
 }
 
@@ -1597,7 +3471,8 @@ CleanUpSessions(DistributedExecution *execution)
 				ClearResults(connection, false);
 			}
 			else if (!(transactionState == REMOTE_TRANS_NOT_STARTED ||
-					   transactionState == REMOTE_TRANS_STARTED))
+					   transactionState == REMOTE_TRANS_STARTED ||
+					   transactionState == REMOTE_TRANS_PREPARED))
 			{
 				/*
 				 * We don't have to handle anything else. Note that the execution
@@ -1651,13 +3526,51 @@ UnclaimAllSessionConnections(List *sessionList)
  */
 static void
 AssignTasksToConnectionsOrWorkerPool(DistributedExecution *execution)
+{
+	AssignTaskListToConnectionsOrWorkerPool(execution, execution->tasksToExecute);
+
+	/*
+	 * The executor claims connections exclusively to make sure that calls to
+	 * StartNodeUserDatabaseConnection do not return the same connections.
+	 *
+	 * We need to do this after assigning tasks to connections because the same
+	 * connection may be be returned multiple times by GetPlacementListConnectionIfCached.
+	 */
+	WorkerSession *session = NULL;
+	foreach_ptr(session, execution->sessionList)
+	{
+		MultiConnection *connection = session->connection;
+
+		ClaimConnectionExclusively(connection);
+	}
+}
+
+
+/*
+ * AssignTaskListToConnectionsOrWorkerPool creates the shard command executions
+ * and placement executions for the given tasks, and adds the placement
+ * executions to the queues of the sessions or worker pools they should run on.
+ */
+static void
+AssignTaskListToConnectionsOrWorkerPool(DistributedExecution *execution,
+										List *taskList)
 {
 	RowModifyLevel modLevel = execution->modLevel;
-	List *taskList = execution->tasksToExecute;
 	bool hasReturning = execution->hasReturning;
 
 	int32 localGroupId = GetLocalGroupId();
 
+	if (TaskOrderingPolicy == TASK_ORDERING_LONGEST_FIRST &&
+		!TaskListModifiesDatabase(modLevel, taskList))
+	{
+		/*
+		 * Tasks are added to the ready queues in list order, so start the
+		 * tasks that are expected to take longest first to avoid having a
+		 * single large shard at the tail of the execution.
+		 */
+		taskList = OrderTasksByEstimatedCost(taskList);
+	}
+
 	Task *task = NULL;
 	foreach_ptr(task, taskList)
 	{
@@ -1682,6 +3595,15 @@ AssignTasksToConnectionsOrWorkerPool(DistributedExecution *execution)
 			(hasReturning && !task->partiallyLocalOrRemote) ||
 			modLevel == ROW_MODIFY_READONLY;
 
+		if (execution->taskResultDestinationHash != NULL)
+		{
+			shardCommandExecution->resultDestination =
+				hash_search(execution->taskResultDestinationHash, &task, HASH_FIND,
+							NULL);
+		}
+
+		int shardAffinityGroup = ShardAffinityGroupForTask(task);
+
 		ShardPlacement *taskPlacement = NULL;
 		foreach_ptr(taskPlacement, task->taskPlacementList)
 		{
@@ -1701,6 +3623,12 @@ AssignTasksToConnectionsOrWorkerPool(DistributedExecution *execution)
 			placementExecution->shardPlacement = taskPlacement;
 			placementExecution->workerPool = workerPool;
 			placementExecution->placementExecutionIndex = placementExecutionIndex;
+			placementExecution->shardAffinityGroup = shardAffinityGroup;
+
+			if (execution->collectTaskTimings)
+			{
+				INSTR_TIME_SET_CURRENT(placementExecution->queueStartTime);
+			}
 
 			if (placementExecutionReady)
 			{
@@ -1807,24 +3735,245 @@ AssignTasksToConnectionsOrWorkerPool(DistributedExecution *execution)
 			}
 		}
 	}
+}
 
-	/*
-	 * The executor claims connections exclusively to make sure that calls to
-	 * StartNodeUserDatabaseConnection do not return the same connections.
-	 *
-	 * We need to do this after assigning tasks to connections because the same
-	 * connection may be be returned multiple times by GetPlacementListConnectionIfCached.
-	 */
+
+/*
+ * ShardAffinityGroupForTask returns the shard affinity group of the anchor
+ * shard of the given task, or -1 if tasks are not grouped by shard. Shards
+ * of hash distributed tables are grouped by their index, such that tasks on
+ * colocated shards end up in the same group.
+ */
+static int
+ShardAffinityGroupForTask(Task *task)
+{
+	uint64 anchorShardId = task->anchorShardId;
+
+	if (ShardAffinityGroupCount <= 0 || anchorShardId == INVALID_SHARD_ID)
+	{
+		return -1;
+	}
+
+	ShardInterval *shardInterval = LoadShardInterval(anchorShardId);
+	char partitionMethod = PartitionMethod(shardInterval->relationId);
+
+	if (partitionMethod == DISTRIBUTE_BY_HASH || partitionMethod == DISTRIBUTE_BY_NONE)
+	{
+		return ShardIndex(shardInterval) % ShardAffinityGroupCount;
+	}
+
+	return anchorShardId % ShardAffinityGroupCount;
+}
+
+
+/*
+ * AddTasksToDistributedExecution adds the given tasks to a running execution.
+ * The execution must not use remote transaction blocks, such that the tasks
+ * are never assigned to a particular connection and can run on any session
+ * of their worker pools.
+ */
+static void
+AddTasksToDistributedExecution(DistributedExecution *execution, List *taskList)
+{
+	int taskCount = list_length(taskList);
+	if (taskCount == 0)
+	{
+		return;
+	}
+
+	Assert(execution->transactionProperties->useRemoteTransactionBlocks ==
+		   TRANSACTION_BLOCKS_DISALLOWED);
+
+	execution->tasksToExecute = list_concat(list_copy(execution->tasksToExecute),
+											taskList);
+	execution->totalTaskCount += taskCount;
+	execution->unfinishedTaskCount += taskCount;
+
+	AssignTaskListToConnectionsOrWorkerPool(execution, taskList);
+
+	/* wake up the idle sessions, such that they pick up the new tasks */
 	WorkerSession *session = NULL;
 	foreach_ptr(session, execution->sessionList)
 	{
 		MultiConnection *connection = session->connection;
+		RemoteTransaction *transaction = &(connection->remoteTransaction);
+		RemoteTransactionState transactionState = transaction->transactionState;
 
-		ClaimConnectionExclusively(connection);
+		if (connection->connectionState == MULTI_CONNECTION_CONNECTED &&
+			(transactionState == REMOTE_TRANS_NOT_STARTED ||
+			 transactionState == REMOTE_TRANS_STARTED))
+		{
+			UpdateConnectionWaitFlags(session, WL_SOCKET_READABLE | WL_SOCKET_WRITEABLE);
+		}
+	}
+}
+
+
+/*
+ * OrderTasksByEstimatedCost returns a new list with the tasks in the given list
+ * ordered by their estimated execution time, from the longest to the shortest.
+ *
+ * The estimate is based on the execution times of the same shards in earlier
+ * executions in this backend. Tasks on shards for which we do not have an
+ * estimate yet go first, ordered by their shard length (if known), since we
+ * cannot rule out that they are the longest ones.
+ */
+static List *
+OrderTasksByEstimatedCost(List *taskList)
+{
+	int taskCount = list_length(taskList);
+	int taskIndex = 0;
+
+	if (taskCount < 2)
+	{
+		return taskList;
+	}
+
+	TaskCostEstimate *costEstimates =
+		(TaskCostEstimate *) palloc0(taskCount * sizeof(TaskCostEstimate));
+
+	Task *task = NULL;
+	foreach_ptr(task, taskList)
+	{
+		TaskCostEstimate *costEstimate = &costEstimates[taskIndex];
+		uint64 shardId = task->anchorShardId;
+
+		costEstimate->task = task;
+
+		if (ShardExecutionTimeHash != NULL && shardId != INVALID_SHARD_ID)
+		{
+			bool found = false;
+			ShardExecutionTimeEntry *timeEntry =
+				hash_search(ShardExecutionTimeHash, &shardId, HASH_FIND, &found);
+
+			if (found)
+			{
+				costEstimate->hasExecutionTime = true;
+				costEstimate->executionTimeMs = timeEntry->executionTimeMs;
+			}
+		}
+
+		if (task->taskPlacementList != NIL)
+		{
+			ShardPlacement *placement =
+				(ShardPlacement *) linitial(task->taskPlacementList);
+
+			costEstimate->shardLength = placement->shardLength;
+		}
+
+		taskIndex++;
+	}
+
+	SafeQsort(costEstimates, taskCount, sizeof(TaskCostEstimate),
+			  CompareTaskCostEstimates);
+
+	List *orderedTaskList = NIL;
+	for (taskIndex = 0; taskIndex < taskCount; taskIndex++)
+	{
+		orderedTaskList = lappend(orderedTaskList, costEstimates[taskIndex].task);
+	}
+
+	pfree(costEstimates);
+
+	return orderedTaskList;
+}
+
+
+/*
+ * CompareTaskCostEstimates orders TaskCostEstimates from the most expensive
+ * to the least expensive. Ties are broken by task ID to keep the order stable.
+ */
+static int
+CompareTaskCostEstimates(const void *leftElement, const void *rightElement)
+{
+	const TaskCostEstimate *leftEstimate = (const TaskCostEstimate *) leftElement;
+	const TaskCostEstimate *rightEstimate = (const TaskCostEstimate *) rightElement;
+
+	/* tasks without an execution time estimate go first */
+	if (leftEstimate->hasExecutionTime != rightEstimate->hasExecutionTime)
+	{
+		return leftEstimate->hasExecutionTime ? 1 : -1;
+	}
+
+	if (leftEstimate->executionTimeMs != rightEstimate->executionTimeMs)
+	{
+		return leftEstimate->executionTimeMs > rightEstimate->executionTimeMs ? -1 : 1;
+	}
+
+	if (leftEstimate->shardLength != rightEstimate->shardLength)
+	{
+		return leftEstimate->shardLength > rightEstimate->shardLength ? -1 : 1;
+	}
+
+	if (leftEstimate->task->taskId != rightEstimate->task->taskId)
+	{
+		return leftEstimate->task->taskId < rightEstimate->task->taskId ? -1 : 1;
+	}
+
+	return 0;
+}
+
+
+/*
+ * RecordShardExecutionTime updates the execution time estimate of the anchor
+ * shard of a successfully finished placement execution.
+ */
+static void
+RecordShardExecutionTime(TaskPlacementExecution *placementExecution)
+{
+	Task *task = placementExecution->shardCommandExecution->task;
+	uint64 shardId = task->anchorShardId;
+	bool found = false;
+	instr_time now;
+
+	if (shardId == INVALID_SHARD_ID || INSTR_TIME_IS_ZERO(placementExecution->startTime))
+	{
+		return;
+	}
+
+	if (ShardExecutionTimeHash == NULL)
+	{
+		HASHCTL info;
+
+		memset(&info, 0, sizeof(info));
+		info.keysize = sizeof(uint64);
+		info.entrysize = sizeof(ShardExecutionTimeEntry);
+		info.hcxt = TopMemoryContext;
+
+		ShardExecutionTimeHash = hash_create("citus shard execution times", 256, &info,
+											 HASH_ELEM | HASH_BLOBS | HASH_CONTEXT);
+	}
+
+	INSTR_TIME_SET_CURRENT(now);
+	double executionTimeMs =
+		MillisecondsBetweenTimestamps(placementExecution->startTime, now);
+
+	ShardExecutionTimeEntry *timeEntry =
+		hash_search(ShardExecutionTimeHash, &shardId, HASH_ENTER, &found);
+	if (!found)
+	{
+		timeEntry->executionTimeMs = executionTimeMs;
+	}
+	else
+	{
+		timeEntry->executionTimeMs = UpdateRunningAverage(timeEntry->executionTimeMs,
+														  executionTimeMs);
 	}
 }
 
 
+/*
+ * UpdateRunningAverage returns the exponentially weighted moving average after
+ * adding the given sample.
+ */
+static double
+UpdateRunningAverage(double average, double sample)
+{
+	return EXECUTION_TIME_SMOOTHING_FACTOR * sample +
+		   (1.0 - EXECUTION_TIME_SMOOTHING_FACTOR) * average;
+}
+
+
 /*
  * UseConnectionPerPlacement returns whether we should use a separate connection
  * per placement even if another connection is idle. We mostly use this in testing
@@ -1870,9 +4019,19 @@ ExecutionOrderForTask(RowModifyLevel modLevel, Task *task)
 			}
 		}
 
+		case MAP_TASK:
+		{
+			/*
+			 * Map tasks only read their shard, so running them on one placement
+			 * is enough. If that placement fails, we continue with the next one,
+			 * and fetch tasks read the partition files from where the map task
+			 * succeeded (see PlacementExecutionDone).
+			 */
+			return EXECUTION_ORDER_ANY;
+		}
+
 		case DDL_TASK:
 		case VACUUM_ANALYZE_TASK:
-		case MAP_TASK:
 		case MERGE_TASK:
 		case MAP_OUTPUT_FETCH_TASK:
 		case MERGE_FETCH_TASK:
@@ -1950,6 +4109,7 @@ FindOrCreateWorkerSession(WorkerPool *workerPool, MultiConnection *connection)
 	session->connection = connection;
 	session->workerPool = workerPool;
 	session->commandsSent = 0;
+	session->waitEventSetIndex = WAIT_EVENT_SET_INDEX_NOT_INITIALIZED;
 	dlist_init(&session->pendingTaskQueue);
 	dlist_init(&session->readyTaskQueue);
 
@@ -1972,13 +4132,70 @@ FindOrCreateWorkerSession(WorkerPool *workerPool, MultiConnection *connection)
 		workerPool->checkForPoolTimeout = true;
 	}
 
+	if (ShardAffinityGroupCount > 0)
+	{
+		AssignShardAffinityGroup(workerPool, connection);
+	}
+
 	workerPool->sessionList = lappend(workerPool->sessionList, session);
 	execution->sessionList = lappend(execution->sessionList, session);
 
+	/* the session is added to the wait event set before the next wait */
+	execution->sessionsAdded = true;
+
 	return session;
 }
 
 
+/*
+ * AssignShardAffinityGroup makes sure that the given connection, which is about
+ * to get a session in the worker pool, has a shard affinity group that no other
+ * session of the pool has, if there is one left.
+ *
+ * The group is kept on the connection, such that a cached connection keeps
+ * running commands on the same shards across executions. The backend on the
+ * other end then keeps the catalog entries and buffers of those shards warm,
+ * much like a core that owns a fixed set of shards.
+ */
+static void
+AssignShardAffinityGroup(WorkerPool *workerPool, MultiConnection *connection)
+{
+	int groupCount = ShardAffinityGroupCount;
+	bool *groupTaken = palloc0(groupCount * sizeof(bool));
+	int shardAffinityGroup = connection->shardAffinityGroup;
+
+	WorkerSession *session = NULL;
+	foreach_ptr(session, workerPool->sessionList)
+	{
+		int sessionGroup = session->connection->shardAffinityGroup;
+		if (sessionGroup >= 0 && sessionGroup < groupCount)
+		{
+			groupTaken[sessionGroup] = true;
+		}
+	}
+
+	if (shardAffinityGroup < 0 || shardAffinityGroup >= groupCount ||
+		groupTaken[shardAffinityGroup])
+	{
+		/* all groups taken, the session runs whatever tasks are left */
+		shardAffinityGroup = -1;
+
+		for (int groupIndex = 0; groupIndex < groupCount; groupIndex++)
+		{
+			if (!groupTaken[groupIndex])
+			{
+				shardAffinityGroup = groupIndex;
+				break;
+			}
+		}
+	}
+
+	connection->shardAffinityGroup = shardAffinityGroup;
+
+	pfree(groupTaken);
+}
+
+
 /*
  * ShouldRunTasksSequentially returns true if each of the individual tasks
  * should be executed one by one. Note that this is different than
@@ -2066,71 +4283,144 @@ SequentialRunDistributedExecution(DistributedExecution *execution)
 void
 RunDistributedExecution(DistributedExecution *execution)
 {
-	WaitEvent *events = NULL;
-
 	AssignTasksToConnectionsOrWorkerPool(execution);
 
+	/* always (re)build the wait event set the first time */
+	execution->connectionSetChanged = true;
+
+	bool pauseOnResults = false;
+	ContinueDistributedExecution(execution, pauseOnResults);
+}
+
+
+/*
+ * ContinueDistributedExecution runs the event loop of a distributed execution
+ * which has already been assigned its tasks. If pauseOnResults is true, the
+ * function returns as soon as a round of events added tuples to the tuple store
+ * of the execution, which allows the caller to return those tuples before more
+ * results are read. Otherwise, the execution runs to completion.
+ *
+ * The function returns true if the execution finished, in which case the wait
+ * event set is freed and the sessions are cleaned up.
+ */
+static bool
+ContinueDistributedExecution(DistributedExecution *execution, bool pauseOnResults)
+{
+	bool executionFinished = false;
+
 	PG_TRY();
 	{
 		bool cancellationReceived = false;
+		bool paused = false;
 
-		int eventSetSize = GetEventSetSize(execution->sessionList);
-
-		/* always (re)build the wait event set the first time */
-		execution->connectionSetChanged = true;
+		if (execution->events == NULL)
+		{
+			execution->eventSetSize = GetEventSetSize(execution->sessionList);
+		}
 
-		while (execution->unfinishedTaskCount > 0 && !cancellationReceived)
+		while (execution->unfinishedTaskCount > 0 && !cancellationReceived && !paused &&
+			   !execution->rowLimitReached)
 		{
 			long timeout = NextEventTimeout(execution);
 
+			if (execution->hedgedReadThresholdMs > 0)
+			{
+				StartHedgedReads(execution);
+			}
+
 			WorkerPool *workerPool = NULL;
 			foreach_ptr(workerPool, execution->workerList)
 			{
-				ManageWorkerPool(workerPool);
+				ManageWorkerPool(workerPool);
+			}
+
+			if (!execution->connectionSetChanged &&
+				(execution->sessionsAdded || execution->waitFlagsChanged))
+			{
+				/* may find that there is no room for new sessions */
+				RebuildWaitEventSetFlags(execution);
 			}
 
 			if (execution->connectionSetChanged)
 			{
-				if (events != NULL)
+				if (execution->events != NULL)
 				{
 					/*
 					 * The execution might take a while, so explicitly free at this point
 					 * because we don't need anymore.
 					 */
-					pfree(events);
-					events = NULL;
+					pfree(execution->events);
+					execution->events = NULL;
 				}
-				eventSetSize = RebuildWaitEventSet(execution);
+				execution->eventSetSize = RebuildWaitEventSet(execution);
 
-				events = palloc0(eventSetSize * sizeof(WaitEvent));
+				execution->events = palloc0(execution->eventSetSize * sizeof(WaitEvent));
 			}
-			else if (execution->waitFlagsChanged)
+
+			/* wait for I/O events */
+			SetCitusWaitState(ExecutionWaitState(execution));
+			int eventCount = WaitEventSetWait(execution->waitEventSet, timeout,
+											  execution->events,
+											  execution->eventSetSize,
+											  WAIT_EVENT_CLIENT_READ);
+			SetCitusWaitState(CITUS_WAIT_NONE);
+			ProcessWaitEvents(execution, execution->events, eventCount,
+							  &cancellationReceived);
+
+			if (execution->completedTaskList != NIL && !cancellationReceived)
 			{
-				RebuildWaitEventSetFlags(execution->waitEventSet, execution->sessionList);
-				execution->waitFlagsChanged = false;
+				List *completedTaskList = execution->completedTaskList;
+				execution->completedTaskList = NIL;
+
+				List *newTaskList = execution->taskCompletedCallback(
+					completedTaskList, execution->taskCompletedCallbackContext);
+
+				AddTasksToDistributedExecution(execution, newTaskList);
 			}
 
-			/* wait for I/O events */
-			int eventCount = WaitEventSetWait(execution->waitEventSet, timeout, events,
-											  eventSetSize, WAIT_EVENT_CLIENT_READ);
-			ProcessWaitEvents(execution, events, eventCount, &cancellationReceived);
+			if (pauseOnResults && execution->tupleStore != NULL &&
+				tuplestore_tuple_count(execution->tupleStore) > 0)
+			{
+				/* let the caller consume the rows before reading more */
+				paused = true;
+			}
 		}
 
-		if (events != NULL)
+		if (!paused || execution->unfinishedTaskCount == 0)
 		{
-			pfree(events);
-		}
+			/* the losing placement executions of hedged reads may still run */
+			if ((execution->rowLimitReached && execution->unfinishedTaskCount > 0) ||
+				execution->hedgedReadsStarted)
+			{
+				TerminateUnfinishedTasks(execution);
+			}
 
-		if (execution->waitEventSet != NULL)
-		{
-			FreeWaitEventSet(execution->waitEventSet);
-			execution->waitEventSet = NULL;
-		}
+			if (execution->events != NULL)
+			{
+				pfree(execution->events);
+				execution->events = NULL;
+			}
+
+			if (execution->waitEventSet != NULL)
+			{
+				FreeWaitEventSet(execution->waitEventSet);
+				execution->waitEventSet = NULL;
+			}
+
+			if (LogWorkerPoolCpuTime)
+			{
+				LogWorkerPoolCpuTimes(execution);
+			}
 
-		CleanUpSessions(execution);
+			CleanUpSessions(execution);
+
+			executionFinished = true;
+		}
 	}
 	PG_CATCH();
 	{
+		SetCitusWaitState(CITUS_WAIT_NONE);
+
 		/*
 		 * We can still recover from error using ROLLBACK TO SAVEPOINT,
 		 * unclaim all connections to allow that.
@@ -2152,14 +4442,17 @@ RunDistributedExecution(DistributedExecution *execution)
 		PG_RE_THROW();
 	}
 	PG_END_TRY();
+
+	return executionFinished;
 }
 
 
 /*
  * RebuildWaitEventSet updates the waitEventSet for the distributed execution.
- * This happens when the connection set for the distributed execution is changed,
- * which means that we need to update which connections we wait on for events.
- * It returns the new event set size.
+ * This happens when a connection of the distributed execution is closed, or
+ * when the current set has no room for new connections, which means that we
+ * need to update which connections we wait on for events. It returns the new
+ * event set size.
  */
 static int
 RebuildWaitEventSet(DistributedExecution *execution)
@@ -2170,11 +4463,12 @@ RebuildWaitEventSet(DistributedExecution *execution)
 		execution->waitEventSet = NULL;
 	}
 
-	execution->waitEventSet = BuildWaitEventSet(execution->sessionList);
+	execution->waitEventSet = BuildWaitEventSet(execution);
 	execution->connectionSetChanged = false;
+	execution->sessionsAdded = false;
 	execution->waitFlagsChanged = false;
 
-	return GetEventSetSize(execution->sessionList);
+	return execution->eventSetSize;
 }
 
 
@@ -2222,7 +4516,53 @@ ProcessWaitEvents(DistributedExecution *execution, WaitEvent *events, int eventC
 		WorkerSession *session = (WorkerSession *) event->user_data;
 		session->latestUnconsumedWaitEvents = event->events;
 
-		ConnectionStateMachine(session);
+		if (LogWorkerPoolCpuTime)
+		{
+			double startCpuTimeMs = CurrentCpuTimeMs();
+
+			ConnectionStateMachine(session);
+
+			session->workerPool->cpuTimeMs += CurrentCpuTimeMs() - startCpuTimeMs;
+		}
+		else
+		{
+			ConnectionStateMachine(session);
+		}
+	}
+}
+
+
+/*
+ * CurrentCpuTimeMs returns the CPU time used by the current process in
+ * milliseconds.
+ */
+static double
+CurrentCpuTimeMs(void)
+{
+	struct timespec cpuTime;
+
+	if (clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &cpuTime) != 0)
+	{
+		return 0.0;
+	}
+
+	return cpuTime.tv_sec * 1000.0 + cpuTime.tv_nsec / 1000000.0;
+}
+
+
+/*
+ * LogWorkerPoolCpuTimes logs the CPU time that the execution spent on the
+ * connections of each of its worker pools.
+ */
+static void
+LogWorkerPoolCpuTimes(DistributedExecution *execution)
+{
+	WorkerPool *workerPool = NULL;
+	foreach_ptr(workerPool, execution->workerList)
+	{
+		ereport(LOG, (errmsg("spent %.3f ms of CPU time on %d tasks on node %s:%d",
+							 workerPool->cpuTimeMs, workerPool->finishedTaskCount,
+							 workerPool->nodeName, workerPool->nodePort)));
 	}
 }
 
@@ -2309,11 +4649,19 @@ ManageWorkerPool(WorkerPool *workerPool)
 			if (MillisecondsPassedSince(workerPool->lastConnectionOpenTime) >=
 				ExecutorSlowStartInterval)
 			{
-				newConnectionCount = Min(newConnectionCount,
-										 workerPool->maxNewConnectionsPerCycle);
+				if (EnableAdaptiveSlowStart)
+				{
+					newConnectionCount =
+						AdaptiveSlowStartConnectionCount(workerPool, newConnectionCount);
+				}
+				else
+				{
+					newConnectionCount = Min(newConnectionCount,
+											 workerPool->maxNewConnectionsPerCycle);
 
-				/* increase the open rate every cycle (like TCP slow start) */
-				workerPool->maxNewConnectionsPerCycle += 1;
+					/* increase the open rate every cycle (like TCP slow start) */
+					workerPool->maxNewConnectionsPerCycle += 1;
+				}
 			}
 			else
 			{
@@ -2328,6 +4676,19 @@ ManageWorkerPool(WorkerPool *workerPool)
 		return;
 	}
 
+	/*
+	 * Do not wait citus.node_connection_timeout for the first connection to a
+	 * node that the maintenance daemon found to be down, unless this backend
+	 * still has a connection to it.
+	 */
+	if (initiatedConnectionCount == 0 &&
+		NodeConnectionCount(workerPool->nodeName, workerPool->nodePort) == 0 &&
+		NodeIsKnownToBeDown(workerPool->nodeName, workerPool->nodePort))
+	{
+		FailWorkerPoolOfDownNode(workerPool);
+		return;
+	}
+
 	ereport(DEBUG4, (errmsg("opening %d new connections to %s:%d", newConnectionCount,
 							workerPool->nodeName, workerPool->nodePort)));
 
@@ -2342,11 +4703,30 @@ ManageWorkerPool(WorkerPool *workerPool)
 			connectionFlags |= OUTSIDE_TRANSACTION;
 		}
 
+		int openConnectionCount =
+			list_length(workerPool->sessionList) - workerPool->failedConnectionCount;
+		if (openConnectionCount > 0 && !UseConnectionPerPlacement())
+		{
+			/*
+			 * The pool can already make progress, so only open more connections
+			 * if the worker is below citus.max_shared_pool_size. Otherwise, the
+			 * remaining tasks run over the existing connections.
+			 */
+			connectionFlags |= OPTIONAL_CONNECTION;
+		}
+
 		/* open a new connection to the worker */
 		MultiConnection *connection = StartNodeUserDatabaseConnection(connectionFlags,
 																	  workerPool->nodeName,
 																	  workerPool->nodePort,
 																	  NULL, NULL);
+		if (connection == NULL)
+		{
+			ereport(DEBUG4, (errmsg("not opening more connections to %s:%d since "
+									"citus.max_shared_pool_size is reached",
+									workerPool->nodeName, workerPool->nodePort)));
+			break;
+		}
 
 		/*
 		 * Assign the initial state in the connection state machine. The connection
@@ -2363,13 +4743,150 @@ ManageWorkerPool(WorkerPool *workerPool)
 
 		/* create a session for the connection */
 		WorkerSession *session = FindOrCreateWorkerSession(workerPool, connection);
+		INSTR_TIME_SET_CURRENT(session->connectionStartTime);
 
 		/* immediately run the state machine to handle potential failure */
 		ConnectionStateMachine(session);
 	}
 
 	INSTR_TIME_SET_CURRENT(workerPool->lastConnectionOpenTime);
-	execution->connectionSetChanged = true;
+}
+
+
+/*
+ * AdaptiveSlowStartConnectionCount decides how many of the newConnectionCount
+ * connections that the pool could use should be opened in the current slow
+ * start cycle, based on how long it takes to establish connections to the worker
+ * and to execute tasks on it.
+ *
+ * Similar to TCP congestion control, the number of connections to open per
+ * cycle grows while additional connections pay off, and is halved when they
+ * would not become usable before the existing connections finish the remaining
+ * tasks, or when connection establishment slows down noticeably, which is a
+ * sign that the worker is overloaded (e.g. by other coordinator backends).
+ */
+static int
+AdaptiveSlowStartConnectionCount(WorkerPool *workerPool, int newConnectionCount)
+{
+	int activeConnectionCount = workerPool->activeConnectionCount;
+	int readyTaskCount = workerPool->readyTaskCount;
+
+	if (workerPool->establishedConnectionCount == 0 ||
+		workerPool->completedTaskCount == 0)
+	{
+		/* no feedback yet, behave like regular slow start */
+		newConnectionCount = Min(newConnectionCount,
+								 workerPool->maxNewConnectionsPerCycle);
+		workerPool->maxNewConnectionsPerCycle += 1;
+
+		return newConnectionCount;
+	}
+
+	double connectionTimeMs = workerPool->connectionEstablishmentTimeMs;
+	double taskTimeMs = workerPool->taskExecutionTimeMs;
+
+	/* time the existing connections need to finish the tasks that are ready */
+	double drainTimeMs = readyTaskCount * taskTimeMs / Max(activeConnectionCount, 1);
+
+	bool connectionsCongested = workerPool->lastConnectionEstablishmentTimeMs >
+								CONNECTION_CONGESTION_FACTOR * connectionTimeMs;
+
+	if (connectionsCongested || drainTimeMs < connectionTimeMs + taskTimeMs)
+	{
+		/*
+		 * A new connection would not finish a single task before the existing
+		 * connections are done, or the worker is slow to accept connections.
+		 */
+		workerPool->maxNewConnectionsPerCycle =
+			Max(1, workerPool->maxNewConnectionsPerCycle / 2);
+
+		ereport(DEBUG4, (errmsg("not opening new connections to %s:%d, expected "
+								"drain time %.1f ms, connection time %.1f ms",
+								workerPool->nodeName, workerPool->nodePort,
+								drainTimeMs, connectionTimeMs)));
+
+		/* wait for the next slow start cycle before deciding again */
+		INSTR_TIME_SET_CURRENT(workerPool->lastConnectionOpenTime);
+
+		return 0;
+	}
+
+	newConnectionCount = Min(newConnectionCount, workerPool->maxNewConnectionsPerCycle);
+
+	/* connections pay off, increase the open rate */
+	workerPool->maxNewConnectionsPerCycle += 1;
+
+	return newConnectionCount;
+}
+
+
+/*
+ * RecordConnectionEstablishmentTime updates the connection establishment time
+ * statistics of the pool of the session when the executor itself established
+ * the connection of the session.
+ */
+static void
+RecordConnectionEstablishmentTime(WorkerSession *session)
+{
+	WorkerPool *workerPool = session->workerPool;
+	instr_time now;
+
+	if (INSTR_TIME_IS_ZERO(session->connectionStartTime))
+	{
+		/* connection was established by an earlier execution */
+		return;
+	}
+
+	INSTR_TIME_SET_CURRENT(now);
+	double connectionTimeMs =
+		MillisecondsBetweenTimestamps(session->connectionStartTime, now);
+
+	if (workerPool->establishedConnectionCount == 0)
+	{
+		workerPool->connectionEstablishmentTimeMs = connectionTimeMs;
+	}
+	else
+	{
+		workerPool->connectionEstablishmentTimeMs =
+			UpdateRunningAverage(workerPool->connectionEstablishmentTimeMs,
+								 connectionTimeMs);
+	}
+
+	workerPool->lastConnectionEstablishmentTimeMs = connectionTimeMs;
+	workerPool->establishedConnectionCount++;
+}
+
+
+/*
+ * RecordTaskExecutionTime updates the task execution time statistics of the
+ * pool of a successfully finished placement execution.
+ */
+static void
+RecordTaskExecutionTime(TaskPlacementExecution *placementExecution)
+{
+	WorkerPool *workerPool = placementExecution->workerPool;
+	instr_time now;
+
+	if (INSTR_TIME_IS_ZERO(placementExecution->startTime))
+	{
+		return;
+	}
+
+	INSTR_TIME_SET_CURRENT(now);
+	double taskTimeMs = MillisecondsBetweenTimestamps(placementExecution->startTime,
+													  now);
+
+	if (workerPool->completedTaskCount == 0)
+	{
+		workerPool->taskExecutionTimeMs = taskTimeMs;
+	}
+	else
+	{
+		workerPool->taskExecutionTimeMs =
+			UpdateRunningAverage(workerPool->taskExecutionTimeMs, taskTimeMs);
+	}
+
+	workerPool->completedTaskCount++;
 }
 
 
@@ -2453,6 +4970,33 @@ CheckConnectionTimeout(WorkerPool *workerPool)
 }
 
 
+/*
+ * FailWorkerPoolOfDownNode fails a worker pool without connecting to its node,
+ * which is known to be down. Like a connection timeout, this errors out if
+ * the execution cannot continue over other placements.
+ */
+static void
+FailWorkerPoolOfDownNode(WorkerPool *workerPool)
+{
+	DistributedExecution *execution = workerPool->distributedExecution;
+	int logLevel = WARNING;
+
+	WorkerPoolFailed(workerPool);
+
+	if (execution->transactionProperties->errorOnAnyFailure || execution->failed)
+	{
+		logLevel = ERROR;
+	}
+
+	ereport(logLevel, (errcode(ERRCODE_CONNECTION_FAILURE),
+					   errmsg("could not establish any connections to the node "
+							  "%s:%d since it is down", workerPool->nodeName,
+							  workerPool->nodePort),
+					   errdetail("The maintenance daemon could not connect to the "
+								 "node at its last check.")));
+}
+
+
 /*
  * UsableConnectionCount returns the number of connections in the worker pool
  * that are (soon to be) usable for sending commands, this includes both idle
@@ -2542,6 +5086,16 @@ NextEventTimeout(DistributedExecution *execution)
 		}
 	}
 
+	if (execution->hedgedReadThresholdMs > 0)
+	{
+		long timeUntilHedgedReadMs = HedgedReadTimeout(execution, now);
+
+		if (timeUntilHedgedReadMs < eventTimeout)
+		{
+			eventTimeout = timeUntilHedgedReadMs;
+		}
+	}
+
 	return Max(1, eventTimeout);
 }
 
@@ -2559,6 +5113,107 @@ MillisecondsBetweenTimestamps(instr_time startTime, instr_time endTime)
 }
 
 
+/*
+ * RecordTaskExecutionTiming adds the timings of a successfully finished
+ * placement execution to the task timings of its execution, which are shown
+ * by EXPLAIN ANALYZE.
+ *
+ * The time between queueing the placement execution and sending the command
+ * is split into the time spent waiting for a new connection to be
+ * established and the time spent waiting for a session to become available.
+ */
+static void
+RecordTaskExecutionTiming(TaskPlacementExecution *placementExecution)
+{
+	WorkerPool *workerPool = placementExecution->workerPool;
+	DistributedExecution *execution = workerPool->distributedExecution;
+	Task *task = placementExecution->shardCommandExecution->task;
+	instr_time now;
+
+	if (INSTR_TIME_IS_ZERO(placementExecution->queueStartTime) ||
+		INSTR_TIME_IS_ZERO(placementExecution->startTime))
+	{
+		return;
+	}
+
+	INSTR_TIME_SET_CURRENT(now);
+
+	instr_time firstResultTime = placementExecution->firstResultTime;
+	if (INSTR_TIME_IS_ZERO(firstResultTime))
+	{
+		firstResultTime = now;
+	}
+
+	double waitTimeMs = ElapsedMilliseconds(placementExecution->queueStartTime,
+											placementExecution->startTime);
+	double connectionWaitMs = 0.0;
+
+	if (!INSTR_TIME_IS_ZERO(placementExecution->connectionReadyTime))
+	{
+		connectionWaitMs = ElapsedMilliseconds(placementExecution->queueStartTime,
+											   placementExecution->connectionReadyTime);
+		connectionWaitMs = Max(0.0, Min(connectionWaitMs, waitTimeMs));
+	}
+
+	TaskExecutionTiming *taskTiming = palloc0(sizeof(TaskExecutionTiming));
+	taskTiming->taskId = task->taskId;
+	taskTiming->nodeName = workerPool->nodeName;
+	taskTiming->nodePort = workerPool->nodePort;
+	taskTiming->connectionWaitMs = connectionWaitMs;
+	taskTiming->queueTimeMs = waitTimeMs - connectionWaitMs;
+	taskTiming->executionTimeMs = ElapsedMilliseconds(placementExecution->startTime,
+													  firstResultTime);
+	taskTiming->transferTimeMs = ElapsedMilliseconds(firstResultTime, now);
+	taskTiming->bytesReceived = placementExecution->bytesReceived;
+
+	execution->taskTimingList = lappend(execution->taskTimingList, taskTiming);
+}
+
+
+/*
+ * ExecutionWaitState returns what the execution is waiting on for the wait
+ * event sampling. When any command is running, we consider the execution to
+ * be waiting for its results, even if more connections are being established.
+ */
+static CitusWaitState
+ExecutionWaitState(DistributedExecution *execution)
+{
+	bool connectionsPending = false;
+
+	WorkerPool *workerPool = NULL;
+	foreach_ptr(workerPool, execution->workerList)
+	{
+		int initiatedConnectionCount = list_length(workerPool->sessionList);
+
+		if (workerPool->activeConnectionCount > workerPool->idleConnectionCount)
+		{
+			return CITUS_WAIT_REMOTE_RESULT;
+		}
+
+		if (initiatedConnectionCount > workerPool->activeConnectionCount +
+			workerPool->failedConnectionCount)
+		{
+			connectionsPending = true;
+		}
+	}
+
+	return connectionsPending ? CITUS_WAIT_CONNECTION_ESTABLISHMENT :
+		   CITUS_WAIT_REMOTE_RESULT;
+}
+
+
+/*
+ * ElapsedMilliseconds returns the number of milliseconds between the given
+ * times, including the fraction.
+ */
+static double
+ElapsedMilliseconds(instr_time startTime, instr_time endTime)
+{
+	INSTR_TIME_SUBTRACT(endTime, startTime);
+	return INSTR_TIME_GET_MILLISEC(endTime);
+}
+
+
 /*
  * ConnectionStateMachine opens a connection and descends into the transaction
  * state machine when ready.
@@ -2598,6 +5253,7 @@ ConnectionStateMachine(WorkerSession *session)
 				}
 				else if (status == CONNECTION_BAD)
 				{
+					IncrementStatCounter(STAT_CONNECTION_ESTABLISHMENT_FAILED);
 					connection->connectionState = MULTI_CONNECTION_FAILED;
 					break;
 				}
@@ -2605,6 +5261,7 @@ ConnectionStateMachine(WorkerSession *session)
 				PostgresPollingStatusType pollMode = PQconnectPoll(connection->pgConn);
 				if (pollMode == PGRES_POLLING_FAILED)
 				{
+					IncrementStatCounter(STAT_CONNECTION_ESTABLISHMENT_FAILED);
 					connection->connectionState = MULTI_CONNECTION_FAILED;
 				}
 				else if (pollMode == PGRES_POLLING_READING)
@@ -2747,6 +5404,18 @@ HandleMultiConnectionSuccess(WorkerSession *session)
 
 	workerPool->activeConnectionCount++;
 	workerPool->idleConnectionCount++;
+
+	IncrementStatCounter(STAT_CONNECTION_ESTABLISHMENT_SUCCEEDED);
+
+	if (!INSTR_TIME_IS_ZERO(session->connectionStartTime))
+	{
+		INSTR_TIME_SET_CURRENT(session->connectionReadyTime);
+	}
+
+	if (EnableAdaptiveSlowStart)
+	{
+		RecordConnectionEstablishmentTime(session);
+	}
 }
 
 
@@ -2855,11 +5524,35 @@ TransactionStateMachine(WorkerSession *session)
 		{
 			case REMOTE_TRANS_NOT_STARTED:
 			{
+				if (execution->sessionSetupCommand != NULL && !session->sessionSetupSent)
+				{
+					int querySent = SendRemoteCommand(connection,
+													  execution->sessionSetupCommand);
+					if (querySent == 0)
+					{
+						connection->connectionState = MULTI_CONNECTION_LOST;
+						return;
+					}
+
+					/* the settings of the command should not outlive the transaction */
+					connection->forceCloseAtTransactionEnd = true;
+					session->sessionSetupSent = true;
+
+					transaction->transactionState = REMOTE_TRANS_CLEARING_RESULTS;
+					UpdateConnectionWaitFlags(session,
+											  WL_SOCKET_READABLE | WL_SOCKET_WRITEABLE);
+					break;
+				}
+
 				if (useRemoteTransactionBlocks == TRANSACTION_BLOCKS_REQUIRED)
 				{
 					/* if we're expanding the nodes in a transaction, use 2PC */
 					Activate2PCIfModifyingTransactionExpandsToNewNode(session);
+				}
 
+				if (useRemoteTransactionBlocks == TRANSACTION_BLOCKS_REQUIRED &&
+					!CanPipelineBeginOnSession(session))
+				{
 					/* need to open a transaction block first */
 					StartRemoteTransactionBegin(connection);
 
@@ -2907,6 +5600,9 @@ TransactionStateMachine(WorkerSession *session)
 				{
 					if (!IsResponseOK(result))
 					{
+						/* a failed PREPARE TRANSACTION leaves nothing to roll back */
+						transaction->preparePipelined = false;
+
 						/* query failures are always hard errors */
 						ReportResultError(connection, result, ERROR);
 					}
@@ -2943,19 +5639,39 @@ TransactionStateMachine(WorkerSession *session)
 				UpdateConnectionWaitFlags(session,
 										  WL_SOCKET_READABLE | WL_SOCKET_WRITEABLE);
 
-				if (transaction->beginSent)
+				if (transaction->preparePipelined)
+				{
+					/* the transaction is prepared, no more commands to send */
+					FinishPipelinedRemoteTransactionPrepare(connection);
+
+					UpdateConnectionWaitFlags(session, WL_SOCKET_READABLE);
+				}
+				else if (transaction->beginSent)
 				{
 					transaction->transactionState = REMOTE_TRANS_STARTED;
+					transaction->lastSuccessfulSubXact = transaction->lastQueuedSubXact;
 				}
 				else
 				{
 					transaction->transactionState = REMOTE_TRANS_NOT_STARTED;
 				}
-				break;
-			}
+				break;
+			}
+
+			case REMOTE_TRANS_STARTED:
+			{
+				if (RemoteTransactionHasPendingSavepoints(connection) &&
+					SessionMayHaveReadyTasks(session))
+				{
+					/* enter the sub-transactions before the connection is used */
+					StartRemoteTransactionPendingSavepoints(connection);
+
+					transaction->transactionState = REMOTE_TRANS_CLEARING_RESULTS;
+					UpdateConnectionWaitFlags(session,
+											  WL_SOCKET_READABLE | WL_SOCKET_WRITEABLE);
+					break;
+				}
 
-			case REMOTE_TRANS_STARTED:
-			{
 				TaskPlacementExecution *placementExecution = PopPlacementExecution(
 					session);
 				if (placementExecution == NULL)
@@ -2998,6 +5714,8 @@ TransactionStateMachine(WorkerSession *session)
 					break;
 				}
 
+				/* currentTask may have advanced if the tasks were pipelined */
+				shardCommandExecution = session->currentTask->shardCommandExecution;
 				shardCommandExecution->gotResults = true;
 				transaction->transactionState = REMOTE_TRANS_CLEARING_RESULTS;
 				break;
@@ -3116,14 +5834,55 @@ PopPlacementExecution(WorkerSession *session)
 			return NULL;
 		}
 
-		/* no more assigned tasks, pick an unassigned task */
-		placementExecution = PopUnassignedPlacementExecution(workerPool);
+		/* no more assigned tasks, pick an unassigned task of the session's shards */
+		placementExecution = PopAffinePlacementExecution(session);
+
+		if (placementExecution == NULL)
+		{
+			/* no more tasks of the session's shards, pick any unassigned task */
+			placementExecution = PopUnassignedPlacementExecution(workerPool);
+		}
+	}
+
+	if (placementExecution == NULL && EnableWorkStealing)
+	{
+		/* nothing to do on this worker, take over a task from a busy worker */
+		placementExecution = StealPlacementExecution(workerPool);
 	}
 
 	return placementExecution;
 }
 
 
+/*
+ * SessionMayHaveReadyTasks returns whether PopPlacementExecution might find a
+ * placement execution for the given session. It may return true when there is
+ * nothing to do, but never returns false when there is.
+ */
+static bool
+SessionMayHaveReadyTasks(WorkerSession *session)
+{
+	WorkerPool *workerPool = session->workerPool;
+
+	if (!dlist_is_empty(&session->readyTaskQueue))
+	{
+		return true;
+	}
+
+	if (session->commandsSent > 0 && UseConnectionPerPlacement())
+	{
+		return false;
+	}
+
+	if (workerPool->readyTaskCount > 0)
+	{
+		return true;
+	}
+
+	return EnableWorkStealing && !dlist_is_empty(&workerPool->pendingTaskQueue);
+}
+
+
 /*
  * PopAssignedPlacementExecution finds an executable task from the queue of assigned tasks.
  */
@@ -3170,6 +5929,141 @@ PopUnassignedPlacementExecution(WorkerPool *workerPool)
 }
 
 
+/*
+ * PopAffinePlacementExecution finds an executable task in the queue of
+ * unassigned tasks of the session's worker pool whose shard is in the shard
+ * affinity group of the session's connection.
+ */
+static TaskPlacementExecution *
+PopAffinePlacementExecution(WorkerSession *session)
+{
+	WorkerPool *workerPool = session->workerPool;
+	int shardAffinityGroup = session->connection->shardAffinityGroup;
+	dlist_iter iter;
+
+	if (ShardAffinityGroupCount <= 0 || shardAffinityGroup < 0)
+	{
+		return NULL;
+	}
+
+	dlist_foreach(iter, &workerPool->readyTaskQueue)
+	{
+		TaskPlacementExecution *placementExecution =
+			dlist_container(TaskPlacementExecution, workerReadyQueueNode, iter.cur);
+
+		if (placementExecution->shardAffinityGroup == shardAffinityGroup)
+		{
+			dlist_delete(&placementExecution->workerReadyQueueNode);
+			workerPool->readyTaskCount--;
+
+			return placementExecution;
+		}
+	}
+
+	return NULL;
+}
+
+
+/*
+ * StealPlacementExecution looks for a task that can run on any placement, has a
+ * (not yet ready) placement on the given worker pool and is still waiting in
+ * the ready queue of another worker pool. If it finds one, the placement
+ * execution in the other pool is moved back to that pool's pending queue and
+ * the placement execution in the given pool is returned instead, such that
+ * idle workers take over unstarted work from busy workers.
+ *
+ * Placement executions that were assigned to a particular session due to
+ * earlier accesses in the transaction are never stolen.
+ */
+static TaskPlacementExecution *
+StealPlacementExecution(WorkerPool *workerPool)
+{
+	dlist_iter iter;
+
+	if (workerPool->failed)
+	{
+		return NULL;
+	}
+
+	dlist_foreach(iter, &workerPool->pendingTaskQueue)
+	{
+		TaskPlacementExecution *placementExecution =
+			dlist_container(TaskPlacementExecution, workerPendingQueueNode, iter.cur);
+		ShardCommandExecution *shardCommandExecution =
+			placementExecution->shardCommandExecution;
+
+		if (placementExecution->executionState != PLACEMENT_EXECUTION_NOT_READY)
+		{
+			continue;
+		}
+
+		TaskPlacementExecution *victimPlacementExecution =
+			FindStealablePlacementExecution(shardCommandExecution);
+		if (victimPlacementExecution == NULL)
+		{
+			continue;
+		}
+
+		WorkerPool *victimWorkerPool = victimPlacementExecution->workerPool;
+
+		ereport(DEBUG4, (errmsg("%s:%d takes over task %u from %s:%d",
+								workerPool->nodeName, workerPool->nodePort,
+								shardCommandExecution->task->taskId,
+								victimWorkerPool->nodeName,
+								victimWorkerPool->nodePort)));
+
+		/* the other placement becomes the fallback in case this one fails */
+		dlist_delete(&victimPlacementExecution->workerReadyQueueNode);
+		victimWorkerPool->readyTaskCount--;
+		victimPlacementExecution->executionState = PLACEMENT_EXECUTION_NOT_READY;
+		dlist_push_tail(&victimWorkerPool->pendingTaskQueue,
+						&victimPlacementExecution->workerPendingQueueNode);
+
+		/* we return directly, so it is safe to modify the list we iterate over */
+		dlist_delete(&placementExecution->workerPendingQueueNode);
+		placementExecution->executionState = PLACEMENT_EXECUTION_READY;
+
+		return placementExecution;
+	}
+
+	return NULL;
+}
+
+
+/*
+ * FindStealablePlacementExecution returns the placement execution of the given
+ * shard command execution that is ready, but not yet started, in the queue of
+ * another worker pool, or NULL if there is none.
+ */
+static TaskPlacementExecution *
+FindStealablePlacementExecution(ShardCommandExecution *shardCommandExecution)
+{
+	if (shardCommandExecution->executionOrder != EXECUTION_ORDER_ANY ||
+		shardCommandExecution->executionState != TASK_EXECUTION_NOT_FINISHED)
+	{
+		return NULL;
+	}
+
+	int placementExecutionCount = shardCommandExecution->placementExecutionCount;
+	for (int placementExecutionIndex = 0;
+		 placementExecutionIndex < placementExecutionCount;
+		 placementExecutionIndex++)
+	{
+		TaskPlacementExecution *placementExecution =
+			shardCommandExecution->placementExecutions[placementExecutionIndex];
+
+		if (placementExecution->executionState == PLACEMENT_EXECUTION_READY &&
+			placementExecution->assignedSession == NULL &&
+			!placementExecution->workerPool->failed)
+		{
+			return placementExecution;
+		}
+	}
+
+	return NULL;
+}
+
+
 /*
  * StartPlacementExecutionOnSession gets a TaskPlacementExecition and
  * WorkerSession, the task's query is sent to the worker via the session.
@@ -3189,11 +6083,13 @@ StartPlacementExecutionOnSession(TaskPlacementExecution *placementExecution,
 	DistributedExecution *execution = workerPool->distributedExecution;
 	ParamListInfo paramListInfo = execution->paramListInfo;
 	MultiConnection *connection = session->connection;
+	RemoteTransaction *transaction = &(connection->remoteTransaction);
 	ShardCommandExecution *shardCommandExecution =
 		placementExecution->shardCommandExecution;
 	Task *task = shardCommandExecution->task;
 	ShardPlacement *taskPlacement = placementExecution->shardPlacement;
 	List *placementAccessList = PlacementAccessListForTask(task, taskPlacement);
+	char *beginCommand = NULL;
 	int querySent = 0;
 
 	char *queryString = NULL;
@@ -3233,6 +6129,63 @@ StartPlacementExecutionOnSession(TaskPlacementExecution *placementExecution,
 	workerPool->idleConnectionCount--;
 	session->currentTask = placementExecution;
 	placementExecution->executionState = PLACEMENT_EXECUTION_RUNNING;
+	INSTR_TIME_SET_CURRENT(placementExecution->startTime);
+	placementExecution->connectionReadyTime = session->connectionReadyTime;
+
+	if (transaction->transactionState == REMOTE_TRANS_NOT_STARTED &&
+		execution->transactionProperties->useRemoteTransactionBlocks ==
+		TRANSACTION_BLOCKS_REQUIRED)
+	{
+		/* open the transaction block in the same round trip as the task */
+		Assert(CanPipelineBeginOnSession(session));
+
+		beginCommand = PipelinedRemoteTransactionBeginCommand(connection);
+	}
+
+	if (ExecutorPipelineDepth > 1 && !UseConnectionPerPlacement() &&
+		CanPipelinePlacementExecution(placementExecution))
+	{
+		/* send other ready tasks in the same round trip */
+		queryString = AppendPipelinedPlacementExecutions(session, queryString);
+	}
+
+	/*
+	 * Binary results require the extended protocol, which does not allow the
+	 * multi-statement queries that we use for pipelining.
+	 */
+	bool binaryResults = execution->binaryResults && task->taskType == SELECT_TASK &&
+						 session->pipelinedTaskList == NIL;
+
+	if (task->preparedStatementName != NULL && !binaryResults &&
+		session->pipelinedTaskList == NIL &&
+		list_length(task->perPlacementQueryStrings) == 0 &&
+		(paramListInfo == NULL || task->parametersInQueryStringResolved))
+	{
+		/* run the task as a statement that is prepared once per connection */
+		char *preparedQueryString = PreparedStatementQueryString(session, task);
+		if (preparedQueryString != NULL)
+		{
+			queryString = preparedQueryString;
+		}
+	}
+
+	if (!binaryResults && CanPipelinePrepareTransaction(session))
+	{
+		/* save a round trip at commit time by preparing the transaction now */
+		StringInfo queryStringWithPrepare = makeStringInfo();
+
+		appendStringInfo(queryStringWithPrepare, "%s;%s", queryString,
+						 PipelinedRemoteTransactionPrepareCommand(connection));
+		queryString = queryStringWithPrepare->data;
+	}
+
+	if (beginCommand != NULL)
+	{
+		StringInfo queryStringWithBegin = makeStringInfo();
+
+		appendStringInfo(queryStringWithBegin, "%s%s", beginCommand, queryString);
+		queryString = queryStringWithBegin->data;
+	}
 
 	if (paramListInfo != NULL && !task->parametersInQueryStringResolved)
 	{
@@ -3240,33 +6193,248 @@ StartPlacementExecutionOnSession(TaskPlacementExecution *placementExecution,
 		Oid *parameterTypes = NULL;
 		const char **parameterValues = NULL;
 
-		/* force evaluation of bound params */
-		paramListInfo = copyParamList(paramListInfo);
+		/* force evaluation of bound params */
+		paramListInfo = copyParamList(paramListInfo);
+
+		ExtractParametersForRemoteExecution(paramListInfo, &parameterTypes,
+											&parameterValues);
+		querySent = SendRemoteCommandParams(connection, queryString, parameterCount,
+											parameterTypes, parameterValues,
+											binaryResults);
+	}
+	else if (binaryResults)
+	{
+		querySent = SendRemoteCommandParams(connection, queryString, 0, NULL, NULL,
+											binaryResults);
+	}
+	else
+	{
+		querySent = SendRemoteCommand(connection, queryString);
+	}
+
+	if (querySent == 0)
+	{
+		connection->connectionState = MULTI_CONNECTION_LOST;
+		return false;
+	}
+
+	int singleRowMode = PQsetSingleRowMode(connection->pgConn);
+	if (singleRowMode == 0)
+	{
+		connection->connectionState = MULTI_CONNECTION_LOST;
+		return false;
+	}
+
+	return true;
+}
+
+
+/*
+ * PreparedStatementQueryString returns the query string that executes the
+ * prepared statement of the task over the connection of the session. If the
+ * statement was not yet prepared over the connection, the PREPARE is sent in
+ * the same round trip and its result is consumed before those of the task.
+ *
+ * The function returns NULL if the connection already has the maximum number
+ * of prepared statements, in which case the task runs its query string.
+ */
+static char *
+PreparedStatementQueryString(WorkerSession *session, Task *task)
+{
+	MultiConnection *connection = session->connection;
+
+	if (ConnectionHasPreparedStatement(connection, task->preparedStatementName))
+	{
+		return task->executeCommand;
+	}
+
+	if (list_length(connection->preparedStatementList) >=
+		MaxPreparedStatementsPerConnection)
+	{
+		return NULL;
+	}
+
+	StringInfo queryString = makeStringInfo();
+	appendStringInfo(queryString, "%s;%s", task->prepareCommand,
+					 task->executeCommand);
+
+	session->pendingPreparedStatementName = task->preparedStatementName;
+
+	return queryString->data;
+}
+
+
+/*
+ * CanPipelinePlacementExecution returns whether the given placement execution
+ * can be sent as part of a multi-statement batch. We only batch read-only
+ * SELECT tasks that can run on any placement and whose query string is
+ * self-contained, since a multi-statement query cannot carry parameters.
+ */
+static bool
+CanPipelinePlacementExecution(TaskPlacementExecution *placementExecution)
+{
+	ShardCommandExecution *shardCommandExecution =
+		placementExecution->shardCommandExecution;
+	DistributedExecution *execution =
+		placementExecution->workerPool->distributedExecution;
+	Task *task = shardCommandExecution->task;
+
+	if (execution->modLevel != ROW_MODIFY_READONLY ||
+		shardCommandExecution->executionOrder != EXECUTION_ORDER_ANY)
+	{
+		return false;
+	}
+
+	if (task->taskType != SELECT_TASK || task->relationRowLockList != NIL ||
+		task->perPlacementQueryStrings != NIL)
+	{
+		return false;
+	}
+
+	if (execution->paramListInfo != NULL && !task->parametersInQueryStringResolved)
+	{
+		return false;
+	}
+
+	return true;
+}
+
+
+/*
+ * PopPipelinablePlacementExecution returns the next assigned or unassigned
+ * placement execution for the session if it can be added to the current
+ * batch, or NULL otherwise. Assigned placement executions take precedence
+ * to keep the order in which PopPlacementExecution would return them.
+ */
+static TaskPlacementExecution *
+PopPipelinablePlacementExecution(WorkerSession *session)
+{
+	WorkerPool *workerPool = session->workerPool;
+
+	if (!dlist_is_empty(&session->readyTaskQueue))
+	{
+		TaskPlacementExecution *placementExecution =
+			dlist_head_element(TaskPlacementExecution, sessionReadyQueueNode,
+							   &session->readyTaskQueue);
+
+		if (!CanPipelinePlacementExecution(placementExecution))
+		{
+			return NULL;
+		}
+
+		return PopAssignedPlacementExecution(session);
+	}
+
+	if (!dlist_is_empty(&workerPool->readyTaskQueue))
+	{
+		TaskPlacementExecution *placementExecution =
+			dlist_head_element(TaskPlacementExecution, workerReadyQueueNode,
+							   &workerPool->readyTaskQueue);
+
+		if (!CanPipelinePlacementExecution(placementExecution))
+		{
+			return NULL;
+		}
+
+		return PopUnassignedPlacementExecution(workerPool);
+	}
+
+	return NULL;
+}
+
+
+/*
+ * AppendPipelinedPlacementExecutions pops up to citus.executor_pipeline_depth - 1
+ * additional ready placement executions for the session and returns a
+ * multi-statement query string that runs them after the given query string.
+ * The results of the statements are returned in order, which allows
+ * ReceiveResults to attribute them to the right placement execution.
+ */
+static char *
+AppendPipelinedPlacementExecutions(WorkerSession *session, char *queryString)
+{
+	WorkerPool *workerPool = session->workerPool;
+	DistributedExecution *execution = workerPool->distributedExecution;
+	MultiConnection *connection = session->connection;
+	StringInfo pipelinedQueryString = NULL;
+
+	Assert(session->pipelinedTaskList == NIL);
+
+	while (list_length(session->pipelinedTaskList) + 1 < ExecutorPipelineDepth)
+	{
+		TaskPlacementExecution *placementExecution =
+			PopPipelinablePlacementExecution(session);
+		if (placementExecution == NULL)
+		{
+			break;
+		}
+
+		Task *task = placementExecution->shardCommandExecution->task;
+		ShardPlacement *taskPlacement = placementExecution->shardPlacement;
+
+		if (pipelinedQueryString == NULL)
+		{
+			pipelinedQueryString = makeStringInfo();
+			appendStringInfoString(pipelinedQueryString, queryString);
+		}
+
+		appendStringInfo(pipelinedQueryString, ";\n%s", TaskQueryString(task));
+
+		if (execution->transactionProperties->useRemoteTransactionBlocks !=
+			TRANSACTION_BLOCKS_DISALLOWED)
+		{
+			List *placementAccessList = PlacementAccessListForTask(task, taskPlacement);
 
-		ExtractParametersForRemoteExecution(paramListInfo, &parameterTypes,
-											&parameterValues);
-		querySent = SendRemoteCommandParams(connection, queryString, parameterCount,
-											parameterTypes, parameterValues);
-	}
-	else
-	{
-		querySent = SendRemoteCommand(connection, queryString);
-	}
+			AssignPlacementListToConnection(placementAccessList, connection);
+		}
 
-	if (querySent == 0)
-	{
-		connection->connectionState = MULTI_CONNECTION_LOST;
-		return false;
+		session->commandsSent++;
+		placementExecution->executionState = PLACEMENT_EXECUTION_RUNNING;
+		INSTR_TIME_SET_CURRENT(placementExecution->startTime);
+		placementExecution->connectionReadyTime = session->connectionReadyTime;
+		session->pipelinedTaskList = lappend(session->pipelinedTaskList,
+											 placementExecution);
 	}
 
-	int singleRowMode = PQsetSingleRowMode(connection->pgConn);
-	if (singleRowMode == 0)
+	if (pipelinedQueryString == NULL)
 	{
-		connection->connectionState = MULTI_CONNECTION_LOST;
-		return false;
+		return queryString;
 	}
 
-	return true;
+	ereport(DEBUG4, (errmsg("pipelining %d tasks over session %ld",
+							list_length(session->pipelinedTaskList) + 1,
+							session->sessionId)));
+
+	return pipelinedQueryString->data;
+}
+
+
+/*
+ * AdvancePipelinedPlacementExecution marks the current task of a session as
+ * done once all of its results have been received and makes the next
+ * pipelined placement execution the current task.
+ */
+static void
+AdvancePipelinedPlacementExecution(WorkerSession *session)
+{
+	TaskPlacementExecution *finishedPlacementExecution = session->currentTask;
+	bool succeeded = true;
+
+	Assert(session->pipelinedTaskList != NIL);
+
+	finishedPlacementExecution->shardCommandExecution->gotResults = true;
+
+	/* once we finished a task on a connection, we no longer allow it to fail */
+	MarkRemoteTransactionCritical(session->connection);
+
+	session->currentTask = (TaskPlacementExecution *) linitial(
+		session->pipelinedTaskList);
+	session->pipelinedTaskList = list_delete_first(session->pipelinedTaskList);
+
+	/* the worker starts the next command once the previous one is done */
+	INSTR_TIME_SET_CURRENT(session->currentTask->startTime);
+
+	PlacementExecutionDone(finishedPlacementExecution, succeeded);
 }
 
 
@@ -3280,6 +6448,7 @@ ReceiveResults(WorkerSession *session, bool storeRows)
 {
 	bool fetchDone = false;
 	MultiConnection *connection = session->connection;
+	RemoteTransaction *transaction = &(connection->remoteTransaction);
 	WorkerPool *workerPool = session->workerPool;
 	DistributedExecution *execution = workerPool->distributedExecution;
 	DistributedExecutionStats *executionStats = execution->executionStats;
@@ -3319,6 +6488,45 @@ ReceiveResults(WorkerSession *session, bool storeRows)
 		}
 
 		ExecStatusType resultStatus = PQresultStatus(result);
+		if (transaction->pendingBeginResultCount > 0)
+		{
+			/* the results of a pipelined BEGIN precede the results of the task */
+			if (!IsResponseOK(result))
+			{
+				ReportResultError(connection, result, ERROR);
+			}
+
+			if (resultStatus != PGRES_SINGLE_TUPLE)
+			{
+				transaction->pendingBeginResultCount--;
+			}
+
+			PQclear(result);
+			continue;
+		}
+
+		if (session->pendingPreparedStatementName != NULL)
+		{
+			/* the result of a pipelined PREPARE precedes the results of the task */
+			if (!IsResponseOK(result))
+			{
+				ReportResultError(connection, result, ERROR);
+			}
+
+			RememberPreparedStatement(connection, session->pendingPreparedStatementName);
+			session->pendingPreparedStatementName = NULL;
+
+			PQclear(result);
+			continue;
+		}
+
+		TaskPlacementExecution *placementExecution = session->currentTask;
+		if (execution->collectTaskTimings &&
+			INSTR_TIME_IS_ZERO(placementExecution->firstResultTime))
+		{
+			INSTR_TIME_SET_CURRENT(placementExecution->firstResultTime);
+		}
+
 		if (resultStatus == PGRES_COMMAND_OK)
 		{
 			char *currentAffectedTupleString = PQcmdTuples(result);
@@ -3350,15 +6558,33 @@ ReceiveResults(WorkerSession *session, bool storeRows)
 			Assert(PQntuples(result) == 0);
 			PQclear(result);
 
+			if (session->pipelinedTaskList != NIL)
+			{
+				/* the results of the next statement in the batch follow */
+				AdvancePipelinedPlacementExecution(session);
+
+				ShardCommandExecution *shardCommandExecution =
+					session->currentTask->shardCommandExecution;
+				storeRows = shardCommandExecution->expectResults &&
+							!shardCommandExecution->gotResults;
+				continue;
+			}
+
 			fetchDone = true;
 			break;
 		}
+		else if (resultStatus != PGRES_SINGLE_TUPLE && placementExecution->cancelled)
+		{
+			/* another placement of the hedged read returns the rows */
+			PQclear(result);
+			continue;
+		}
 		else if (resultStatus != PGRES_SINGLE_TUPLE)
 		{
 			/* query failures are always hard errors */
 			ReportResultError(connection, result, ERROR);
 		}
-		else if (!storeRows)
+		else if (!storeRows || !ClaimTaskResults(placementExecution))
 		{
 			/*
 			 * Already receieved rows from executing on another shard placement or
@@ -3368,8 +6594,21 @@ ReceiveResults(WorkerSession *session, bool storeRows)
 			continue;
 		}
 
+		TaskResultDestination *resultDestination =
+			placementExecution->shardCommandExecution->resultDestination;
+		if (resultDestination != NULL)
+		{
+			/* the execution runs the tasks of several queries */
+			tupleDescriptor = resultDestination->tupleDescriptor;
+			attributeInputMetadata = resultDestination->attributeInputMetadata;
+			columnArray = resultDestination->columnArray;
+			tupleStore = resultDestination->tupleStore;
+			expectedColumnCount = tupleDescriptor->natts;
+		}
+
 		rowsProcessed = PQntuples(result);
 		uint32 columnCount = PQnfields(result);
+		uint64 bytesReceivedBefore = execution->bytesReceived;
 
 		if (columnCount != expectedColumnCount)
 		{
@@ -3378,8 +6617,40 @@ ReceiveResults(WorkerSession *session, bool storeRows)
 								   columnCount, expectedColumnCount)));
 		}
 
+		/* all columns of a result have the same format, since we request it per query */
+		bool binaryResults = columnCount > 0 && PQfformat(result, 0) == 1;
+
 		for (uint32 rowIndex = 0; rowIndex < rowsProcessed; rowIndex++)
 		{
+			if (binaryResults)
+			{
+				for (columnIndex = 0; columnIndex < columnCount; columnIndex++)
+				{
+					/* the length of NULL values is 0 */
+					int valueLength = PQgetlength(result, rowIndex, columnIndex);
+					execution->bytesReceived += valueLength;
+
+					if (SubPlanLevel > 0 && executionStats != NULL)
+					{
+						executionStats->totalIntermediateResultSize += valueLength;
+					}
+				}
+
+				MemoryContext oldContextPerRow = MemoryContextSwitchTo(ioContext);
+
+				HeapTuple heapTuple = BuildTupleFromBinaryResult(execution,
+																 tupleDescriptor,
+																 result, rowIndex);
+
+				MemoryContextSwitchTo(oldContextPerRow);
+
+				tuplestore_puttuple(tupleStore, heapTuple);
+				MemoryContextReset(ioContext);
+
+				execution->rowsProcessed++;
+				continue;
+			}
+
 			memset(columnArray, 0, columnCount * sizeof(char *));
 
 			for (columnIndex = 0; columnIndex < columnCount; columnIndex++)
@@ -3391,11 +6662,13 @@ ReceiveResults(WorkerSession *session, bool storeRows)
 				else
 				{
 					columnArray[columnIndex] = PQgetvalue(result, rowIndex, columnIndex);
+
+					int valueLength = PQgetlength(result, rowIndex, columnIndex);
+					execution->bytesReceived += valueLength;
+
 					if (SubPlanLevel > 0 && executionStats != NULL)
 					{
-						executionStats->totalIntermediateResultSize += PQgetlength(result,
-																				   rowIndex,
-																				   columnIndex);
+						executionStats->totalIntermediateResultSize += valueLength;
 					}
 				}
 			}
@@ -3418,6 +6691,15 @@ ReceiveResults(WorkerSession *session, bool storeRows)
 			execution->rowsProcessed++;
 		}
 
+		placementExecution->bytesReceived +=
+			execution->bytesReceived - bytesReceivedBefore;
+
+		if (execution->rowLimit > 0 && execution->rowsProcessed >= execution->rowLimit)
+		{
+			/* the combine query does not read more rows than that */
+			execution->rowLimitReached = true;
+		}
+
 		PQclear(result);
 
 		if (executionStats != NULL && CheckIfSizeLimitIsExceeded(executionStats))
@@ -3433,6 +6715,132 @@ ReceiveResults(WorkerSession *session, bool storeRows)
 }
 
 
+/*
+ * BuildTupleFromBinaryResult forms a tuple with the given tuple descriptor
+ * from the given row of a result that is in binary format, using the receive
+ * functions of the column types. Binary results are only requested when the
+ * execution has a tuple descriptor, which the result destinations of its
+ * tasks then share, so the receive functions of the execution apply.
+ */
+static HeapTuple
+BuildTupleFromBinaryResult(DistributedExecution *execution, TupleDesc tupleDescriptor,
+						   PGresult *result, int rowIndex)
+{
+	Datum *columnValues = execution->columnValues;
+	bool *columnNulls = execution->columnNulls;
+	int columnCount = tupleDescriptor->natts;
+
+	for (int columnIndex = 0; columnIndex < columnCount; columnIndex++)
+	{
+		Form_pg_attribute attribute = TupleDescAttr(tupleDescriptor, columnIndex);
+		FmgrInfo *receiveFunction = &execution->columnReceiveFunctions[columnIndex];
+		Oid typeIOParam = execution->columnTypeIOParams[columnIndex];
+
+		if (PQgetisnull(result, rowIndex, columnIndex))
+		{
+			columnValues[columnIndex] =
+				ReceiveFunctionCall(receiveFunction, NULL, typeIOParam,
+									attribute->atttypmod);
+			columnNulls[columnIndex] = true;
+			continue;
+		}
+
+		/* libpq guarantees that values are followed by a null byte */
+		StringInfoData valueBuffer;
+		valueBuffer.data = PQgetvalue(result, rowIndex, columnIndex);
+		valueBuffer.len = PQgetlength(result, rowIndex, columnIndex);
+		valueBuffer.maxlen = valueBuffer.len + 1;
+		valueBuffer.cursor = 0;
+
+		columnValues[columnIndex] =
+			ReceiveFunctionCall(receiveFunction, &valueBuffer, typeIOParam,
+								attribute->atttypmod);
+		columnNulls[columnIndex] = false;
+
+		if (valueBuffer.cursor != valueBuffer.len)
+		{
+			ereport(ERROR, (errcode(ERRCODE_INVALID_BINARY_REPRESENTATION),
+							errmsg("incorrect binary data format in column %d of "
+								   "result from worker", columnIndex + 1)));
+		}
+	}
+
+	return heap_form_tuple(tupleDescriptor, columnValues, columnNulls);
+}
+
+
+/*
+ * CanUseBinaryResultFormat returns whether results with the given tuple
+ * descriptor can be transferred in binary format. On top of the checks for
+ * binary COPY, which make sure the workers can send the types, we require a
+ * binary receive function for every type on this node.
+ */
+static bool
+CanUseBinaryResultFormat(TupleDesc tupleDescriptor)
+{
+	if (!CanUseBinaryCopyFormat(tupleDescriptor))
+	{
+		return false;
+	}
+
+	for (int columnIndex = 0; columnIndex < tupleDescriptor->natts; columnIndex++)
+	{
+		Form_pg_attribute attribute = TupleDescAttr(tupleDescriptor, columnIndex);
+		int16 typeLength = 0;
+		bool typeByVal = false;
+		char typeAlign = 0;
+		char typeDelim = 0;
+		Oid typeIOParam = InvalidOid;
+		Oid receiveFunctionId = InvalidOid;
+
+		if (attribute->attisdropped)
+		{
+			/* dropped columns cannot be received at all */
+			return false;
+		}
+
+		get_type_io_data(attribute->atttypid, IOFunc_receive, &typeLength, &typeByVal,
+						 &typeAlign, &typeDelim, &typeIOParam, &receiveFunctionId);
+		if (!OidIsValid(receiveFunctionId))
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+
+/*
+ * SetupBinaryResultFormat looks up the receive functions for the columns of the
+ * execution's tuple descriptor and allocates the arrays used to form tuples
+ * from binary results.
+ */
+static void
+SetupBinaryResultFormat(DistributedExecution *execution)
+{
+	TupleDesc tupleDescriptor = execution->tupleDescriptor;
+	int columnCount = tupleDescriptor->natts;
+
+	execution->columnReceiveFunctions = palloc0(columnCount * sizeof(FmgrInfo));
+	execution->columnTypeIOParams = palloc0(columnCount * sizeof(Oid));
+	execution->columnValues = palloc0(columnCount * sizeof(Datum));
+	execution->columnNulls = palloc0(columnCount * sizeof(bool));
+
+	for (int columnIndex = 0; columnIndex < columnCount; columnIndex++)
+	{
+		Form_pg_attribute attribute = TupleDescAttr(tupleDescriptor, columnIndex);
+		Oid receiveFunctionId = InvalidOid;
+
+		getTypeBinaryInputInfo(attribute->atttypid, &receiveFunctionId,
+							   &execution->columnTypeIOParams[columnIndex]);
+		fmgr_info(receiveFunctionId, &execution->columnReceiveFunctions[columnIndex]);
+	}
+
+	execution->binaryResults = true;
+}
+
+
 /*
  * WorkerPoolFailed marks a worker pool and all the placement executions scheduled
  * on it as failed.
@@ -3520,6 +6928,12 @@ WorkerSessionFailed(WorkerSession *session)
 		PlacementExecutionDone(placementExecution, succeeded);
 	}
 
+	/* tasks that were sent in the same batch also failed */
+	foreach_ptr(placementExecution, session->pipelinedTaskList)
+	{
+		PlacementExecutionDone(placementExecution, succeeded);
+	}
+
 	dlist_foreach(iter, &session->pendingTaskQueue)
 	{
 		placementExecution =
@@ -3563,10 +6977,64 @@ PlacementExecutionDone(TaskPlacementExecution *placementExecution, bool succeede
 		return;
 	}
 
+	if (succeeded && !ClaimTaskResults(placementExecution))
+	{
+		/*
+		 * The rows of another placement of a hedged read are used, so this
+		 * placement execution does not count towards finishing the task.
+		 */
+		placementExecution->executionState = PLACEMENT_EXECUTION_FAILED;
+		return;
+	}
+
 	/* mark the placement execution as finished */
 	if (succeeded)
 	{
+		Task *task = shardCommandExecution->task;
+
 		placementExecution->executionState = PLACEMENT_EXECUTION_FINISHED;
+
+		/* remember which placement holds the output files of a map task */
+		if (task->taskType == MAP_TASK && task->taskExecution != NULL)
+		{
+			task->taskExecution->currentNodeIndex =
+				placementExecution->placementExecutionIndex;
+		}
+
+		if (TaskOrderingPolicy == TASK_ORDERING_LONGEST_FIRST)
+		{
+			RecordShardExecutionTime(placementExecution);
+		}
+
+		if (EnableAdaptiveSlowStart)
+		{
+			RecordTaskExecutionTime(placementExecution);
+		}
+
+		placementExecution->workerPool->finishedTaskCount++;
+
+		if (!INSTR_TIME_IS_ZERO(placementExecution->startTime))
+		{
+			instr_time executionTime;
+
+			INSTR_TIME_SET_CURRENT(executionTime);
+			INSTR_TIME_SUBTRACT(executionTime, placementExecution->startTime);
+
+			RecordShardQueryExecution(task->anchorShardId,
+									  INSTR_TIME_GET_MILLISEC(executionTime));
+
+			if (execution->modLevel == ROW_MODIFY_READONLY)
+			{
+				RecordReadTaskExecutionTime(INSTR_TIME_GET_MILLISEC(executionTime));
+			}
+		}
+
+		if (execution->collectTaskTimings)
+		{
+			RecordTaskExecutionTiming(placementExecution);
+		}
+
+		IncrementStatCounter(STAT_REMOTE_TASKS_EXECUTED);
 	}
 	else
 	{
@@ -3596,6 +7064,12 @@ PlacementExecutionDone(TaskPlacementExecution *placementExecution, bool succeede
 		}
 
 		placementExecution->executionState = PLACEMENT_EXECUTION_FAILED;
+
+		if (shardCommandExecution->resultPlacementExecution == placementExecution)
+		{
+			/* the rows of the next placement are stored, as before */
+			shardCommandExecution->resultPlacementExecution = NULL;
+		}
 	}
 
 	if (executionState != TASK_EXECUTION_NOT_FINISHED)
@@ -3616,6 +7090,13 @@ PlacementExecutionDone(TaskPlacementExecution *placementExecution, bool succeede
 	if (newExecutionState == TASK_EXECUTION_FINISHED)
 	{
 		execution->unfinishedTaskCount--;
+
+		if (execution->taskCompletedCallback != NULL)
+		{
+			execution->completedTaskList = lappend(execution->completedTaskList,
+												   shardCommandExecution->task);
+		}
+
 		return;
 	}
 	else if (newExecutionState == TASK_EXECUTION_FAILED)
@@ -3649,8 +7130,31 @@ ScheduleNextPlacementExecution(TaskPlacementExecution *placementExecution, bool
 		placementExecution->shardCommandExecution;
 	PlacementExecutionOrder executionOrder = shardCommandExecution->executionOrder;
 
-	if ((executionOrder == EXECUTION_ORDER_ANY && !succeeded) ||
-		executionOrder == EXECUTION_ORDER_SEQUENTIAL)
+	if (executionOrder == EXECUTION_ORDER_ANY && !succeeded)
+	{
+		int placementExecutionCount = shardCommandExecution->placementExecutionCount;
+
+		/*
+		 * Fail over to the first placement that has not been tried yet. When
+		 * citus.enable_work_stealing is enabled, this may be a placement that
+		 * precedes the failed one in planning order.
+		 */
+		for (int placementExecutionIndex = 0;
+			 placementExecutionIndex < placementExecutionCount;
+			 placementExecutionIndex++)
+		{
+			TaskPlacementExecution *nextPlacementExecution =
+				shardCommandExecution->placementExecutions[placementExecutionIndex];
+
+			if (nextPlacementExecution->executionState == PLACEMENT_EXECUTION_NOT_READY)
+			{
+				/* move the placement execution to the ready queue */
+				PlacementExecutionReady(nextPlacementExecution);
+				break;
+			}
+		}
+	}
+	else if (executionOrder == EXECUTION_ORDER_SEQUENTIAL)
 	{
 		TaskPlacementExecution *nextPlacementExecution = NULL;
 		int placementExecutionCount PG_USED_FOR_ASSERTS_ONLY =
@@ -3841,50 +7345,32 @@ TaskExecutionStateMachine(ShardCommandExecution *shardCommandExecution)
 
 
 /*
- * BuildWaitEventSet creates a WaitEventSet for the given array of connections
- * which can be used to wait for any of the sockets to become read-ready or
- * write-ready.
+ * BuildWaitEventSet creates a WaitEventSet for the sessions of the given
+ * execution which can be used to wait for any of the sockets to become
+ * read-ready or write-ready. The set has room for the connections that the
+ * execution may still open, such that those can be added to it later.
  */
 static WaitEventSet *
-BuildWaitEventSet(List *sessionList)
+BuildWaitEventSet(DistributedExecution *execution)
 {
-	/* additional 2 is for postmaster and latch */
-	int eventSetSize = GetEventSetSize(sessionList);
+	execution->eventSetSize = WaitEventSetCapacity(execution);
 
 	WaitEventSet *waitEventSet =
-		CreateWaitEventSet(CurrentMemoryContext, eventSetSize);
+		CreateWaitEventSet(CurrentMemoryContext, execution->eventSetSize);
+
+	AddWaitEventToSet(waitEventSet, WL_POSTMASTER_DEATH, PGINVALID_SOCKET, NULL, NULL);
+	AddWaitEventToSet(waitEventSet, WL_LATCH_SET, PGINVALID_SOCKET, MyLatch, NULL);
+	execution->waitEventCount = 2;
 
 	WorkerSession *session = NULL;
-	foreach_ptr(session, sessionList)
+	foreach_ptr(session, execution->sessionList)
 	{
-		MultiConnection *connection = session->connection;
-
-		if (connection->pgConn == NULL)
-		{
-			/* connection died earlier in the transaction */
-			continue;
-		}
-
-		if (connection->waitFlags == 0)
-		{
-			/* not currently waiting for this connection */
-			continue;
-		}
-
-		int sock = PQsocket(connection->pgConn);
-		if (sock == -1)
-		{
-			/* connection was closed */
-			continue;
-		}
-
-		int waitEventSetIndex = AddWaitEventToSet(waitEventSet, connection->waitFlags,
-												  sock, NULL, (void *) session);
-		session->waitEventSetIndex = waitEventSetIndex;
+		session->waitEventSetIndex = WAIT_EVENT_SET_INDEX_NOT_INITIALIZED;
 	}
 
-	AddWaitEventToSet(waitEventSet, WL_POSTMASTER_DEATH, PGINVALID_SOCKET, NULL, NULL);
-	AddWaitEventToSet(waitEventSet, WL_LATCH_SET, PGINVALID_SOCKET, MyLatch, NULL);
+	/* adds all sessions that we currently wait for */
+	execution->waitEventSet = waitEventSet;
+	RebuildWaitEventSetFlags(execution);
 
 	return waitEventSet;
 }
@@ -3902,14 +7388,37 @@ GetEventSetSize(List *sessionList)
 
 
 /*
- * RebuildWaitEventSetFlags modifies the given waitEventSet with the wait flags
- * for connections in the sessionList.
+ * WaitEventSetCapacity returns the number of events that a new wait event set
+ * for the execution has room for. Besides the current sessions, that includes
+ * the connections that the worker pools may still open, which is at most one
+ * per pool up to the target pool size for every unfinished task.
+ */
+static int
+WaitEventSetCapacity(DistributedExecution *execution)
+{
+	int sessionCount = list_length(execution->sessionList);
+	int maxSessionCount = list_length(execution->workerList) *
+						  execution->targetPoolSize;
+	int spareSessionCount = Min(maxSessionCount - sessionCount,
+								execution->unfinishedTaskCount);
+
+	return GetEventSetSize(execution->sessionList) + Max(spareSessionCount, 0);
+}
+
+
+/*
+ * RebuildWaitEventSetFlags modifies the waitEventSet of the given execution
+ * with the wait flags for connections in the sessionList. Sessions that are
+ * not in the set yet are added to it, unless the set has no room for them, in
+ * which case the execution is marked to rebuild the set.
  */
 static void
-RebuildWaitEventSetFlags(WaitEventSet *waitEventSet, List *sessionList)
+RebuildWaitEventSetFlags(DistributedExecution *execution)
 {
+	WaitEventSet *waitEventSet = execution->waitEventSet;
+
 	WorkerSession *session = NULL;
-	foreach_ptr(session, sessionList)
+	foreach_ptr(session, execution->sessionList)
 	{
 		MultiConnection *connection = session->connection;
 		int waitEventSetIndex = session->waitEventSetIndex;
@@ -3933,8 +7442,28 @@ RebuildWaitEventSetFlags(WaitEventSet *waitEventSet, List *sessionList)
 			continue;
 		}
 
-		ModifyWaitEvent(waitEventSet, waitEventSetIndex, connection->waitFlags, NULL);
+		if (waitEventSetIndex != WAIT_EVENT_SET_INDEX_NOT_INITIALIZED)
+		{
+			ModifyWaitEvent(waitEventSet, waitEventSetIndex, connection->waitFlags,
+							NULL);
+			continue;
+		}
+
+		if (execution->waitEventCount >= execution->eventSetSize)
+		{
+			/* no room for the session, build a larger set */
+			execution->connectionSetChanged = true;
+			return;
+		}
+
+		session->waitEventSetIndex = AddWaitEventToSet(waitEventSet,
+													   connection->waitFlags, sock,
+													   NULL, (void *) session);
+		execution->waitEventCount++;
 	}
+
+	execution->sessionsAdded = false;
+	execution->waitFlagsChanged = false;
 }
 
 
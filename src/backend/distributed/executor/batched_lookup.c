@@ -0,0 +1,202 @@
+/*-------------------------------------------------------------------------
+ *
+ * batched_lookup.c
+ *    Lookup of the rows of many distribution column values in one query.
+ *
+ *    Procedures that loop over a set of keys and run a router query for each
+ *    of them wait for a planning and network round trip per key, one after
+ *    the other. citus_lookup_rows() instead returns the rows of all keys in a
+ *    single distributed query with a distribution_column = ANY (keys) filter,
+ *    which is pruned to the shards of the keys and executes the tasks of
+ *    those shards in parallel in the adaptive executor.
+ *
+ * Copyright (c) Citus Data, Inc.
+ *-------------------------------------------------------------------------
+ */
+
+#include "postgres.h"
+
+#include "fmgr.h"
+#include "funcapi.h"
+
+#include "access/tupdesc.h"
+#include "catalog/pg_type.h"
+#include "distributed/citus_ruleutils.h"
+#include "distributed/metadata_cache.h"
+#include "distributed/multi_executor.h"
+#include "distributed/multi_join_order.h"
+#include "distributed/tuplestore.h"
+#include "executor/tstoreReceiver.h"
+#include "lib/stringinfo.h"
+#include "nodes/params.h"
+#include "utils/array.h"
+#include "utils/builtins.h"
+#include "utils/lsyscache.h"
+
+
+static char * LookupRowsQueryString(Oid relationId, TupleDesc tupleDescriptor,
+									Var *partitionColumn);
+static ArrayType * DistributionValueArray(ArrayType *textArray, Var *partitionColumn);
+
+
+/* exports for SQL callable functions */
+PG_FUNCTION_INFO_V1(citus_lookup_rows);
+
+
+/*
+ * citus_lookup_rows returns the rows of the distributed table whose row type is
+ * the type of the first argument, whose distribution column has one of the
+ * values in the given text array. The first argument is only used for its
+ * type, as in SELECT * FROM citus_lookup_rows(NULL::orders, ARRAY['1','2']).
+ */
+Datum
+citus_lookup_rows(PG_FUNCTION_ARGS)
+{
+	Oid rowTypeId = get_fn_expr_argtype(fcinfo->flinfo, 0);
+	TupleDesc tupleDescriptor = NULL;
+
+	CheckCitusVersion(ERROR);
+
+	Oid relationId = get_typ_typrelid(rowTypeId);
+	if (!OidIsValid(relationId) || !IsCitusTable(relationId) ||
+		PartitionMethod(relationId) == DISTRIBUTE_BY_NONE)
+	{
+		ereport(ERROR, (errmsg("row_type must be the row type of a distributed "
+							   "table with a distribution column")));
+	}
+
+	Tuplestorestate *tupleStore = SetupTuplestore(fcinfo, &tupleDescriptor);
+
+	if (PG_ARGISNULL(1))
+	{
+		PG_RETURN_VOID();
+	}
+
+	Var *partitionColumn = DistPartitionKey(relationId);
+	ArrayType *valueArray = DistributionValueArray(PG_GETARG_ARRAYTYPE_P(1),
+												   partitionColumn);
+	if (ArrayGetNItems(ARR_NDIM(valueArray), ARR_DIMS(valueArray)) == 0)
+	{
+		PG_RETURN_VOID();
+	}
+
+	Oid arrayTypeId = get_array_type(partitionColumn->vartype);
+	char *queryString = LookupRowsQueryString(relationId, tupleDescriptor,
+											  partitionColumn);
+
+	/* the planner prunes shards on constant parameters like on constants */
+	ParamListInfo paramListInfo = makeParamList(1);
+	paramListInfo->params[0].ptype = arrayTypeId;
+	paramListInfo->params[0].value = PointerGetDatum(valueArray);
+	paramListInfo->params[0].isnull = false;
+	paramListInfo->params[0].pflags = PARAM_FLAG_CONST;
+
+	Query *query = ParseQueryString(queryString, &arrayTypeId, 1);
+
+	DestReceiver *tupleStoreDestReceiver = CreateDestReceiver(DestTuplestore);
+	SetTuplestoreDestReceiverParams(tupleStoreDestReceiver, tupleStore,
+									CurrentMemoryContext, false);
+
+	ExecuteQueryIntoDestReceiver(query, paramListInfo, tupleStoreDestReceiver);
+
+	tupleStoreDestReceiver->rDestroy(tupleStoreDestReceiver);
+
+	tuplestore_donestoring(tupleStore);
+
+	PG_RETURN_VOID();
+}
+
+
+/*
+ * LookupRowsQueryString returns a query that selects the rows of the given
+ * relation whose distribution column is in the array in $1. The query returns
+ * NULL for dropped columns, such that its rows have the layout of the row type
+ * of the relation.
+ */
+static char *
+LookupRowsQueryString(Oid relationId, TupleDesc tupleDescriptor, Var *partitionColumn)
+{
+	StringInfo queryString = makeStringInfo();
+	char *partitionColumnName = get_attname(relationId, partitionColumn->varattno,
+											false);
+
+	appendStringInfoString(queryString, "SELECT ");
+
+	for (int columnIndex = 0; columnIndex < tupleDescriptor->natts; columnIndex++)
+	{
+		Form_pg_attribute attributeForm = TupleDescAttr(tupleDescriptor, columnIndex);
+
+		if (columnIndex > 0)
+		{
+			appendStringInfoString(queryString, ", ");
+		}
+
+		if (attributeForm->attisdropped)
+		{
+			appendStringInfoString(queryString, "NULL");
+		}
+		else
+		{
+			appendStringInfoString(queryString,
+								   quote_identifier(NameStr(attributeForm->attname)));
+		}
+	}
+
+	appendStringInfo(queryString, " FROM %s WHERE %s = ANY ($1)",
+					 generate_qualified_relation_name(relationId),
+					 quote_identifier(partitionColumnName));
+
+	return queryString->data;
+}
+
+
+/*
+ * DistributionValueArray converts the given array of distribution column
+ * values in text form to an array of the type of the distribution column.
+ * NULL values are left out, since they do not match any row.
+ */
+static ArrayType *
+DistributionValueArray(ArrayType *textArray, Var *partitionColumn)
+{
+	Oid columnTypeId = partitionColumn->vartype;
+	Datum *textDatumArray = NULL;
+	bool *textNullArray = NULL;
+	int textCount = 0;
+	int valueCount = 0;
+	Oid inputFunctionId = InvalidOid;
+	Oid typeIOParam = InvalidOid;
+	int16 typeLength = 0;
+	bool typeByValue = false;
+	char typeAlign = 0;
+
+	if (!OidIsValid(get_array_type(columnTypeId)))
+	{
+		ereport(ERROR, (errmsg("distribution column type %s has no array type",
+							   format_type_be(columnTypeId))));
+	}
+
+	deconstruct_array(textArray, TEXTOID, -1, false, 'i', &textDatumArray,
+					  &textNullArray, &textCount);
+
+	getTypeInputInfo(columnTypeId, &inputFunctionId, &typeIOParam);
+	get_typlenbyvalalign(columnTypeId, &typeLength, &typeByValue, &typeAlign);
+
+	Datum *valueArray = palloc0(Max(textCount, 1) * sizeof(Datum));
+
+	for (int textIndex = 0; textIndex < textCount; textIndex++)
+	{
+		if (textNullArray[textIndex])
+		{
+			continue;
+		}
+
+		char *valueString = TextDatumGetCString(textDatumArray[textIndex]);
+
+		valueArray[valueCount++] = OidInputFunctionCall(inputFunctionId, valueString,
+														typeIOParam,
+														partitionColumn->vartypmod);
+	}
+
+	return construct_array(valueArray, valueCount, columnTypeId, typeLength,
+						   typeByValue, typeAlign);
+}
@@ -17,17 +17,22 @@
 #include "distributed/citus_custom_scan.h"
 #include "distributed/citus_nodefuncs.h"
 #include "distributed/citus_ruleutils.h"
+#include "distributed/colocation_utils.h"
 #include "distributed/deparse_shard_query.h"
 #include "distributed/distributed_execution_locks.h"
+#include "distributed/insert_buffer.h"
 #include "distributed/insert_select_executor.h"
 #include "distributed/insert_select_planner.h"
+#include "distributed/intermediate_result_scan.h"
 #include "distributed/listutils.h"
 #include "distributed/local_executor.h"
 #include "distributed/multi_executor.h"
 #include "distributed/multi_server_executor.h"
 #include "distributed/multi_router_planner.h"
 #include "distributed/query_stats.h"
+#include "distributed/shard_pruning.h"
 #include "distributed/subplan_execution.h"
+#include "distributed/tenant_stats.h"
 #include "distributed/worker_protocol.h"
 #include "executor/executor.h"
 #include "nodes/makefuncs.h"
@@ -55,13 +60,21 @@ static void CitusPreExecScan(CitusScanState *scanState);
 static bool ModifyJobNeedsEvaluation(Job *workerJob);
 static void RegenerateTaskForFasthPathQuery(Job *workerJob);
 static void RegenerateTaskListForInsert(Job *workerJob);
+static DistributedPlan * PruneTaskListByParameters(
+	DistributedPlan *originalDistributedPlan, PlanState *planState);
 static void CacheLocalPlanForShardQuery(Task *task,
 										DistributedPlan *originalDistributedPlan);
+static void CacheLocalPlansForTaskList(DistributedPlan *currentPlan,
+									   DistributedPlan *originalDistributedPlan,
+									   ParamListInfo paramListInfo);
 static bool IsLocalPlanCachingSupported(Job *workerJob,
 										DistributedPlan *originalDistributedPlan);
+static List * CopyTaskListForExecution(List *originalTaskList);
 static DistributedPlan * CopyDistributedPlanWithoutCache(
 	DistributedPlan *originalDistributedPlan);
 static void CitusEndScan(CustomScanState *node);
+static void CollectQueryExecutionStats(CitusScanState *scanState,
+									   CitusQueryExecutionStats *executionStats);
 static void CitusReScan(CustomScanState *node);
 
 
@@ -151,6 +164,7 @@ RegisterCitusCustomScanMethods(void)
 	RegisterCustomScanMethods(&TaskTrackerCustomScanMethods);
 	RegisterCustomScanMethods(&CoordinatorInsertSelectCustomScanMethods);
 	RegisterCustomScanMethods(&DelayedErrorCustomScanMethods);
+	RegisterCustomScanMethods(&ParallelIntermediateResultScanMethods);
 }
 
 
@@ -167,6 +181,8 @@ CitusBeginScan(CustomScanState *node, EState *estate, int eflags)
 
 	CitusScanState *scanState = (CitusScanState *) node;
 
+	scanState->eflags = eflags;
+
 #if PG_VERSION_NUM >= 120000
 
 	/*
@@ -189,6 +205,13 @@ CitusBeginScan(CustomScanState *node, EState *estate, int eflags)
 #endif
 
 	DistributedPlan *distributedPlan = scanState->distributedPlan;
+
+	/* queryId is not set if pg_stat_statements is not installed */
+	if (distributedPlan->queryId != 0)
+	{
+		INSTR_TIME_SET_CURRENT(scanState->startTime);
+	}
+
 	if (distributedPlan->insertSelectQuery != NULL)
 	{
 		/*
@@ -222,21 +245,52 @@ CitusPreExecScan(CitusScanState *scanState)
  * CitusExecScan is called when a tuple is pulled from a custom scan.
  * On the first call, it executes the distributed query and writes the
  * results to a tuple store. The postgres executor calls this function
- * repeatedly to read tuples from the tuple store.
+ * repeatedly to read tuples from the tuple store. For streaming executions,
+ * the tuple store is refilled with the next rows from the workers once the
+ * earlier rows have been read, or the rows of a single local task are read
+ * straight from its plan.
  */
 TupleTableSlot *
 CitusExecScan(CustomScanState *node)
 {
 	CitusScanState *scanState = (CitusScanState *) node;
+	TupleTableSlot *resultSlot = NULL;
 
 	if (!scanState->finishedRemoteScan)
 	{
-		AdaptiveExecutor(scanState);
+		if (BufferInsertIfPossible(scanState))
+		{
+			/* the row is sent along with the other rows of its shard later */
+			EState *executorState = ScanStateGetExecutorState(scanState);
+			executorState->es_processed = 1;
+		}
+		else
+		{
+			AdaptiveExecutor(scanState);
+		}
 
 		scanState->finishedRemoteScan = true;
 	}
 
-	return ReturnTupleFromTuplestore(scanState);
+	if (scanState->streamingExecution != NULL)
+	{
+		resultSlot = ReturnTupleFromStreamingExecution(scanState);
+	}
+	else if (scanState->localQueryDesc != NULL)
+	{
+		resultSlot = ReturnTupleFromLocalTask(scanState);
+	}
+	else
+	{
+		resultSlot = ReturnTupleFromTuplestore(scanState);
+	}
+
+	if (!TupIsNull(resultSlot))
+	{
+		scanState->rowsReturned++;
+	}
+
+	return resultSlot;
 }
 
 
@@ -249,12 +303,33 @@ CitusBeginSelectScan(CustomScanState *node, EState *estate, int eflags)
 	CitusScanState *scanState = (CitusScanState *) node;
 	DistributedPlan *originalDistributedPlan = scanState->distributedPlan;
 
+	if (originalDistributedPlan->workerJob->taskPruningQualList != NIL)
+	{
+		/*
+		 * A multi-shard SELECT was planned before the values of the parameters
+		 * and stable functions that the distribution column is compared with
+		 * were known. Now we can skip the shards that those values rule out.
+		 */
+		PlanState *planState = &(scanState->customScanState.ss.ps);
+
+		scanState->distributedPlan =
+			PruneTaskListByParameters(originalDistributedPlan, planState);
+
+		CacheLocalPlansForTaskList(scanState->distributedPlan, originalDistributedPlan,
+								   estate->es_param_list_info);
+		return;
+	}
+
 	if (!originalDistributedPlan->workerJob->deferredPruning)
 	{
 		/*
 		 * For SELECT queries that have already been pruned we can proceed straight
-		 * to execution, since none of the prepared statement logic applies.
+		 * to execution, since none of the prepared statement logic applies. We
+		 * only make sure that the tasks that run locally are planned once for
+		 * all executions of a prepared statement.
 		 */
+		CacheLocalPlansForTaskList(originalDistributedPlan, originalDistributedPlan,
+								   estate->es_param_list_info);
 		return;
 	}
 
@@ -442,29 +517,64 @@ ModifyJobNeedsEvaluation(Job *workerJob)
  * distributedPlan into the current memory context.
  *
  * We must not change the distributed plan since it may be reused across multiple
- * executions of a prepared statement. Instead we create a deep copy that we only
- * use for the current execution.
- *
- * We also exclude localPlannedStatements from the copyObject call for performance
- * reasons, as they are immutable, so no need to have a deep copy.
+ * executions of a prepared statement. Instead we create a copy that we only
+ * use for the current execution. Only what the execution changes is copied:
+ * the job query, which is evaluated and pruned, and the tasks, whose query
+ * strings and placements are replaced. The other parts of the plan, including
+ * the cached localPlannedStatements, are immutable and shared with the original,
+ * such that plans with many tasks do not need a deep copy on every execution.
  */
 static DistributedPlan *
 CopyDistributedPlanWithoutCache(DistributedPlan *originalDistributedPlan)
 {
-	List *localPlannedStatements =
-		originalDistributedPlan->workerJob->localPlannedStatements;
-	originalDistributedPlan->workerJob->localPlannedStatements = NIL;
+	Job *originalJob = originalDistributedPlan->workerJob;
 
-	DistributedPlan *distributedPlan = copyObject(originalDistributedPlan);
+	DistributedPlan *distributedPlan = palloc(sizeof(DistributedPlan));
+	*distributedPlan = *originalDistributedPlan;
 
-	/* set back the immutable field */
-	originalDistributedPlan->workerJob->localPlannedStatements = localPlannedStatements;
-	distributedPlan->workerJob->localPlannedStatements = localPlannedStatements;
+	Job *workerJob = palloc(sizeof(Job));
+	*workerJob = *originalJob;
+	workerJob->jobQuery = copyObject(originalJob->jobQuery);
+	workerJob->taskList = CopyTaskListForExecution(originalJob->taskList);
+	distributedPlan->workerJob = workerJob;
 
 	return distributedPlan;
 }
 
 
+/*
+ * CopyTaskListForExecution returns shallow copies of the given tasks, which
+ * the execution can change without changing the original tasks, as long as
+ * it only replaces the fields of a task rather than changing what they point
+ * to.
+ *
+ * The query tree of a task whose query string is deparsed lazily is copied
+ * as well, such that the query string is generated in the memory context of
+ * the current execution rather than in the context of the original plan.
+ */
+static List *
+CopyTaskListForExecution(List *originalTaskList)
+{
+	List *taskList = NIL;
+	Task *originalTask = NULL;
+
+	foreach_ptr(originalTask, originalTaskList)
+	{
+		Task *task = palloc(sizeof(Task));
+		*task = *originalTask;
+
+		if (task->queryStringLazy == NULL && task->queryForLocalExecution != NULL)
+		{
+			task->queryForLocalExecution = copyObject(task->queryForLocalExecution);
+		}
+
+		taskList = lappend(taskList, task);
+	}
+
+	return taskList;
+}
+
+
 /*
  * CacheLocalPlanForShardQuery replaces the relation OIDs in the job query
  * with shard relation OIDs and then plans the query and caches the result
@@ -544,6 +654,91 @@ CacheLocalPlanForShardQuery(Task *task, DistributedPlan *originalDistributedPlan
 }
 
 
+/*
+ * CacheLocalPlansForTaskList plans the local tasks of a SELECT whose tasks were
+ * built during planning, and caches the plans in the originalDistributedPlan
+ * such that later executions of a prepared statement do not have to plan the
+ * tasks again. Unlike CacheLocalPlanForShardQuery, this also covers router
+ * queries with joins and multi-shard queries, since the queries of their tasks
+ * already refer to the shards.
+ *
+ * currentPlan is the plan that is executed, which may have fewer tasks than the
+ * originalDistributedPlan if the tasks were pruned using the parameter values.
+ */
+static void
+CacheLocalPlansForTaskList(DistributedPlan *currentPlan,
+						   DistributedPlan *originalDistributedPlan,
+						   ParamListInfo paramListInfo)
+{
+	Job *currentJob = currentPlan->workerJob;
+	List *taskList = currentJob->taskList;
+
+	if (originalDistributedPlan->subPlanList != NIL)
+	{
+		/* the subplan results may be inlined into the tasks on execution */
+		return;
+	}
+
+	if (currentJob->dependentJobList != NIL || taskList == NIL)
+	{
+		return;
+	}
+
+	if (!ShouldExecuteTasksLocally(taskList))
+	{
+		/* the tasks are going to be executed over connections */
+		return;
+	}
+
+	/*
+	 * All memory allocations should happen in the plan's context
+	 * since we'll cache the local plans there.
+	 */
+	MemoryContext oldContext =
+		MemoryContextSwitchTo(GetMemoryChunkContext(originalDistributedPlan));
+
+	Task *task = NULL;
+	foreach_ptr(task, taskList)
+	{
+		if (!TaskAccessesLocalNode(task) || task->anchorShardId == INVALID_SHARD_ID ||
+			list_length(task->relationShardList) == 0)
+		{
+			continue;
+		}
+
+		if (task->parametersInQueryStringResolved)
+		{
+			/* the query contains the parameter values of this execution */
+			continue;
+		}
+
+		if (GetCachedLocalPlan(task, originalDistributedPlan) != NULL)
+		{
+			/* we already have a local plan */
+			continue;
+		}
+
+		Query *shardQuery = LocalTaskQuery(task, paramListInfo);
+
+		LocalPlannedStatement *localPlannedStatement =
+			CitusMakeNode(LocalPlannedStatement);
+		localPlannedStatement->localPlan = planner(shardQuery, 0, NULL);
+		localPlannedStatement->shardId = task->anchorShardId;
+		localPlannedStatement->localGroupId = GetLocalGroupId();
+
+		originalDistributedPlan->workerJob->localPlannedStatements =
+			lappend(originalDistributedPlan->workerJob->localPlannedStatements,
+					localPlannedStatement);
+	}
+
+	MemoryContextSwitchTo(oldContext);
+
+	/* the current plan may be a copy that does not see the new plans */
+	currentJob->localPlannedStatements =
+		originalDistributedPlan->workerJob->localPlannedStatements;
+}
+
+
 /*
  * GetCachedLocalPlan is a helper function which return the cached
  * plan in the distributedPlan for the given task if exists.
@@ -726,6 +921,88 @@ RegenerateTaskForFasthPathQuery(Job *workerJob)
 }
 
 
+/*
+ * PruneTaskListByParameters returns a copy of the distributed plan of a
+ * multi-shard SELECT that only keeps the tasks on shards which are not ruled
+ * out by the filters on the distribution column, given the values of the
+ * parameters and stable functions in the current execution.
+ *
+ * The query strings of the tasks still contain the parameters and functions,
+ * the former of which are sent along with them. The tasks are therefore
+ * shared with the original plan, only the plan and the job are copied.
+ */
+static DistributedPlan *
+PruneTaskListByParameters(DistributedPlan *originalDistributedPlan,
+						  PlanState *planState)
+{
+	Job *originalJob = originalDistributedPlan->workerJob;
+	List *taskList = originalJob->taskList;
+
+	if (taskList == NIL)
+	{
+		return originalDistributedPlan;
+	}
+
+	MasterEvaluationContext evaluationContext = {
+		.planState = planState,
+		.evaluationMode = EVALUATE_FUNCTIONS_PARAMS
+	};
+
+	/*
+	 * Replace the parameters and stable functions with their values and fold
+	 * the resulting arrays. The planner left out filters with volatile
+	 * functions.
+	 */
+	Node *quals = copyObject((Node *) originalJob->taskPruningQualList);
+	quals = PartiallyEvaluateExpression(quals, &evaluationContext);
+	quals = eval_const_expressions(NULL, quals);
+
+	/* the query accesses a single table, which is the first range table entry */
+	Task *firstTask = (Task *) linitial(taskList);
+	Oid relationId = RelationIdForShard(firstTask->anchorShardId);
+	Index rangeTableId = 1;
+
+	List *shardIntervalList = PruneShards(relationId, rangeTableId, (List *) quals,
+										  NULL);
+
+	List *prunedTaskList = NIL;
+	Task *task = NULL;
+	foreach_ptr(task, taskList)
+	{
+		ShardInterval *shardInterval = NULL;
+		foreach_ptr(shardInterval, shardIntervalList)
+		{
+			if (shardInterval->shardId == task->anchorShardId)
+			{
+				prunedTaskList = lappend(prunedTaskList, task);
+				break;
+			}
+		}
+	}
+
+	if (prunedTaskList == NIL)
+	{
+		/* the filters also apply on the worker, one task returns the empty result */
+		prunedTaskList = list_make1(firstTask);
+	}
+
+	ereport(DEBUG2, (errmsg("pruned %d of %d tasks using the values known at "
+							"execution",
+							list_length(taskList) - list_length(prunedTaskList),
+							list_length(taskList))));
+
+	DistributedPlan *currentPlan = palloc(sizeof(DistributedPlan));
+	*currentPlan = *originalDistributedPlan;
+
+	Job *currentJob = palloc(sizeof(Job));
+	*currentJob = *originalJob;
+	currentJob->taskList = prunedTaskList;
+	currentPlan->workerJob = currentJob;
+
+	return currentPlan;
+}
+
+
 /*
  * AdaptiveExecutorCreateScan creates the scan state for the adaptive executor.
  */
@@ -822,17 +1099,53 @@ CitusEndScan(CustomScanState *node)
 		partitionKeyConst = workerJob->partitionKeyValue;
 	}
 
-	/* queryId is not set if pg_stat_statements is not installed */
-	if (queryId != 0)
+	if (scanState->streamingExecution != NULL)
+	{
+		/* read the results that were not consumed out of the connections */
+		FinishStreamingExecution(scanState);
+	}
+
+	/*
+	 * queryId is not set if pg_stat_statements is not installed, and scans
+	 * that never ran (e.g. in EXPLAIN) are not counted.
+	 */
+	bool recordTenantStats = partitionKeyConst != NULL &&
+							 executorType == MULTI_EXECUTOR_ADAPTIVE &&
+							 TenantStatsEnabled() && workerJob->jobQuery != NULL;
+
+	if ((queryId != 0 || recordTenantStats) && scanState->finishedRemoteScan)
 	{
+		CitusQueryExecutionStats executionStats;
+
 		if (partitionKeyConst != NULL && executorType == MULTI_EXECUTOR_ADAPTIVE)
 		{
 			partitionKeyString = DatumToString(partitionKeyConst->constvalue,
 											   partitionKeyConst->consttype);
 		}
 
+		CollectQueryExecutionStats(scanState, &executionStats);
+
 		/* queries without partition key are also recorded */
-		CitusQueryStatsExecutorsEntry(queryId, executorType, partitionKeyString);
+		if (queryId != 0)
+		{
+			CitusQueryStatsExecutorsEntry(queryId, executorType, partitionKeyString,
+										  &executionStats);
+		}
+
+		/* tenants are the distribution column values of a colocation group */
+		if (recordTenantStats)
+		{
+			Oid relationId = ExtractFirstCitusTableId(workerJob->jobQuery);
+			uint32 colocationId = TableColocationId(relationId);
+
+			CitusTenantStatsEntry(colocationId, partitionKeyString, &executionStats);
+		}
+	}
+
+	if (scanState->localQueryDesc != NULL)
+	{
+		/* the rows of the local task are no longer needed */
+		FinishLocalTaskStreaming(scanState);
 	}
 
 	if (scanState->tuplestorestate)
@@ -843,6 +1156,61 @@ CitusEndScan(CustomScanState *node)
 }
 
 
+/*
+ * CollectQueryExecutionStats fills the statement statistics of the finished
+ * execution of the given scan.
+ */
+static void
+CollectQueryExecutionStats(CitusScanState *scanState,
+						   CitusQueryExecutionStats *executionStats)
+{
+	DistributedPlan *distributedPlan = scanState->distributedPlan;
+	Job *workerJob = distributedPlan->workerJob;
+	instr_time executionTime;
+
+	INSTR_TIME_SET_CURRENT(executionTime);
+	INSTR_TIME_SUBTRACT(executionTime, scanState->startTime);
+
+	memset(executionStats, 0, sizeof(CitusQueryExecutionStats));
+	executionStats->executionTimeMs = INSTR_TIME_GET_MILLISEC(executionTime);
+	executionStats->bytesReceived = scanState->bytesReceived;
+
+	/* modifications count the affected rows, like pg_stat_statements */
+	if (distributedPlan->modLevel == ROW_MODIFY_READONLY)
+	{
+		executionStats->rowCount = scanState->rowsReturned;
+	}
+	else
+	{
+		EState *executorState = ScanStateGetExecutorState(scanState);
+
+		executionStats->rowCount = executorState->es_processed;
+	}
+
+	if (workerJob == NULL)
+	{
+		return;
+	}
+
+	Task *task = NULL;
+	foreach_ptr(task, workerJob->taskList)
+	{
+		int relationShardCount = list_length(task->relationShardList);
+
+		executionStats->taskCount++;
+
+		if (relationShardCount > 0)
+		{
+			executionStats->shardCount += relationShardCount;
+		}
+		else if (task->anchorShardId != INVALID_SHARD_ID)
+		{
+			executionStats->shardCount++;
+		}
+	}
+}
+
+
 /*
  * CitusReScan is not normally called, except in certain cases of
  * DECLARE .. CURSOR WITH HOLD ..
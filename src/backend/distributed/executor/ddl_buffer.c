@@ -0,0 +1,416 @@
+/*-------------------------------------------------------------------------
+ *
+ * ddl_buffer.c
+ *   Deferred propagation of DDL commands in transaction blocks.
+ *
+ *   Migrations that run many DDL commands on distributed tables in a
+ *   transaction block pay a round trip to every node for every command.
+ *   When citus.ddl_buffer_size is set, the shard commands of a DDL command
+ *   are not sent right away, but kept until the next statement that is not
+ *   such a DDL command, or commit. The buffered commands are then sent as a
+ *   single command per node, which runs them in the order they were given.
+ *   The buffer is also flushed when it holds citus.ddl_buffer_size commands,
+ *   or before any distributed execution, COPY or savepoint.
+ *
+ *   Only commands whose shards each have a single remote placement are
+ *   buffered, such that the commands of a node only depend on the commands
+ *   that were sent to the same node before. Since the commands are sent
+ *   later, errors on the workers are reported by the statement that flushes
+ *   the buffer rather than by the DDL command itself.
+ *
+ * Copyright (c) Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include "postgres.h"
+
+#include "access/xact.h"
+#include "distributed/ddl_buffer.h"
+#include "distributed/deparse_shard_query.h"
+#include "distributed/insert_buffer.h"
+#include "distributed/listutils.h"
+#include "distributed/local_executor.h"
+#include "distributed/master_metadata_utility.h"
+#include "distributed/multi_executor.h"
+#include "distributed/multi_physical_planner.h"
+#include "distributed/transaction_management.h"
+#include "lib/stringinfo.h"
+#include "nodes/parsenodes.h"
+#include "utils/builtins.h"
+#include "utils/memutils.h"
+
+
+/* shard command of a buffered DDL command */
+typedef struct BufferedDDLTask
+{
+	/* copy of the task, in TopTransactionContext */
+	Task *task;
+
+	/* distributed table of the shards that the task accesses */
+	Oid relationId;
+
+	/* transaction nesting level in which the command was buffered */
+	int nestLevel;
+} BufferedDDLTask;
+
+
+/* buffered shard commands of a node, while building the flush tasks */
+typedef struct NodeDDLBatch
+{
+	uint32 nodeId;
+	Task *task;
+	List *commandList;
+	List *relationShardList;
+} NodeDDLBatch;
+
+
+/* GUC, number of DDL commands buffered in a transaction block, 0 disables */
+int DDLBufferSize = 0;
+
+/* buffered shard commands in the order of the DDL commands, in TopTransactionContext */
+static List *BufferedDDLTaskList = NIL;
+static int BufferedDDLCommandCount = 0;
+
+/* whether the buffer is being flushed, to not flush from within the flush */
+static bool FlushingDDLBuffer = false;
+
+
+static bool CanBufferDDLTaskList(List *taskList);
+static List * NodeDDLBatchTaskList(List *bufferedTaskList);
+static NodeDDLBatch * FindNodeDDLBatch(List *batchList, uint32 nodeId);
+static char * NodeDDLBatchCommand(NodeDDLBatch *batch);
+
+
+/*
+ * BufferDDLTaskListIfPossible adds the shard commands of a DDL command on the
+ * given distributed table to the buffer when DDL buffering is enabled and the
+ * commands qualify, and returns whether it did. Otherwise, the caller is
+ * expected to execute the commands as usual, after flushing the buffer.
+ */
+bool
+BufferDDLTaskListIfPossible(Oid relationId, List *taskList)
+{
+	if (!CanBufferDDLTaskList(taskList))
+	{
+		return false;
+	}
+
+	/* rows that were buffered before the DDL command are sent before it */
+	FlushBufferedInserts();
+
+	MemoryContext oldContext = MemoryContextSwitchTo(TopTransactionContext);
+	int nestLevel = GetCurrentTransactionNestLevel();
+
+	Task *task = NULL;
+	foreach_ptr(task, taskList)
+	{
+		BufferedDDLTask *bufferedTask = palloc0(sizeof(BufferedDDLTask));
+		bufferedTask->task = copyObject(task);
+		bufferedTask->relationId = relationId;
+		bufferedTask->nestLevel = nestLevel;
+
+		BufferedDDLTaskList = lappend(BufferedDDLTaskList, bufferedTask);
+	}
+
+	MemoryContextSwitchTo(oldContext);
+
+	BufferedDDLCommandCount++;
+
+	if (BufferedDDLCommandCount >= DDLBufferSize)
+	{
+		FlushBufferedDDLCommands();
+	}
+
+	return true;
+}
+
+
+/*
+ * CanBufferDDLTaskList returns whether the given shard commands of a DDL
+ * command can be buffered, which requires a transaction block that buffers
+ * DDL commands and shard commands with a single remote placement.
+ *
+ * Commands that need to run over a single connection per node, such as DDL
+ * on tables with foreign keys to reference tables, are not buffered, since
+ * the buffered commands might be sent in parallel mode.
+ */
+static bool
+CanBufferDDLTaskList(List *taskList)
+{
+	if (DDLBufferSize <= 0 || !IsMultiStatementTransaction() ||
+		MultiShardConnectionType == SEQUENTIAL_CONNECTION)
+	{
+		return false;
+	}
+
+	if (taskList == NIL)
+	{
+		return false;
+	}
+
+	Task *task = NULL;
+	foreach_ptr(task, taskList)
+	{
+		if (task->taskType != DDL_TASK || list_length(task->taskPlacementList) != 1)
+		{
+			return false;
+		}
+
+		/* commands on local placements are not sent anywhere, nothing to gain */
+		if (TaskAccessesLocalNode(task))
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+
+/*
+ * BufferedDDLCommandsPending returns whether there are buffered DDL commands
+ * that have not been sent yet.
+ */
+bool
+BufferedDDLCommandsPending(void)
+{
+	return BufferedDDLTaskList != NIL;
+}
+
+
+/*
+ * IsBufferableDDLStatement returns whether the given utility statement may be
+ * a DDL command whose shard commands are buffered, such that it does not need
+ * to flush the buffer before it runs.
+ */
+bool
+IsBufferableDDLStatement(Node *parsetree)
+{
+	if (IsA(parsetree, AlterTableStmt) || IsA(parsetree, RenameStmt))
+	{
+		return true;
+	}
+
+	if (IsA(parsetree, IndexStmt))
+	{
+		return !((IndexStmt *) parsetree)->concurrent;
+	}
+
+	return false;
+}
+
+
+/*
+ * FlushBufferedDDLCommands sends the buffered shard commands to the nodes,
+ * with a single command per node. It is called before anything else may read
+ * or modify the shards more than the buffered commands.
+ */
+void
+FlushBufferedDDLCommands(void)
+{
+	if (BufferedDDLTaskList == NIL || FlushingDDLBuffer)
+	{
+		return;
+	}
+
+	List *taskList = NodeDDLBatchTaskList(BufferedDDLTaskList);
+
+	/* the buffer is gone once the tasks are built, even if the flush fails */
+	BufferedDDLTaskList = NIL;
+	BufferedDDLCommandCount = 0;
+
+	FlushingDDLBuffer = true;
+
+	PG_TRY();
+	{
+		bool localExecutionSupported = true;
+		ExecuteUtilityTaskListWithoutResults(taskList, localExecutionSupported);
+	}
+	PG_CATCH();
+	{
+		FlushingDDLBuffer = false;
+		PG_RE_THROW();
+	}
+	PG_END_TRY();
+
+	FlushingDDLBuffer = false;
+}
+
+
+/*
+ * NodeDDLBatchTaskList returns a task for every node that has placements in
+ * the given buffered shard commands, which runs the commands of the node in
+ * the order in which they were buffered.
+ */
+static List *
+NodeDDLBatchTaskList(List *bufferedTaskList)
+{
+	List *batchList = NIL;
+	List *taskList = NIL;
+	int taskId = 1;
+
+	BufferedDDLTask *bufferedTask = NULL;
+	foreach_ptr(bufferedTask, bufferedTaskList)
+	{
+		Task *task = bufferedTask->task;
+		ShardPlacement *placement = linitial(task->taskPlacementList);
+
+		NodeDDLBatch *batch = FindNodeDDLBatch(batchList, placement->nodeId);
+		if (batch == NULL)
+		{
+			batch = palloc0(sizeof(NodeDDLBatch));
+			batch->nodeId = placement->nodeId;
+			batch->task = task;
+
+			batchList = lappend(batchList, batch);
+		}
+
+		batch->commandList = lappend(batch->commandList, TaskQueryString(task));
+
+		if (task->relationShardList != NIL)
+		{
+			batch->relationShardList = list_concat(batch->relationShardList,
+												   list_copy(task->relationShardList));
+		}
+		else
+		{
+			RelationShard *relationShard = CitusMakeNode(RelationShard);
+			relationShard->relationId = bufferedTask->relationId;
+			relationShard->shardId = task->anchorShardId;
+
+			batch->relationShardList = lappend(batch->relationShardList,
+											   relationShard);
+		}
+	}
+
+	NodeDDLBatch *batch = NULL;
+	foreach_ptr(batch, batchList)
+	{
+		/* the first command of the node provides the placement and anchor shard */
+		Task *task = copyObject(batch->task);
+		task->taskId = taskId++;
+		task->relationShardList = batch->relationShardList;
+		SetTaskQueryString(task, NodeDDLBatchCommand(batch));
+
+		taskList = lappend(taskList, task);
+	}
+
+	return taskList;
+}
+
+
+/*
+ * FindNodeDDLBatch returns the batch of the given node in batchList, or NULL
+ * if there is no such batch.
+ */
+static NodeDDLBatch *
+FindNodeDDLBatch(List *batchList, uint32 nodeId)
+{
+	NodeDDLBatch *batch = NULL;
+	foreach_ptr(batch, batchList)
+	{
+		if (batch->nodeId == nodeId)
+		{
+			return batch;
+		}
+	}
+
+	return NULL;
+}
+
+
+/*
+ * NodeDDLBatchCommand returns the command that runs the shard commands of the
+ * given batch. Multiple commands are run from an anonymous code block, since
+ * the executor expects a single result per task.
+ */
+static char *
+NodeDDLBatchCommand(NodeDDLBatch *batch)
+{
+	if (list_length(batch->commandList) == 1)
+	{
+		return linitial(batch->commandList);
+	}
+
+	StringInfo codeBlock = makeStringInfo();
+	appendStringInfoString(codeBlock, "BEGIN ");
+
+	char *command = NULL;
+	foreach_ptr(command, batch->commandList)
+	{
+		appendStringInfo(codeBlock, "EXECUTE %s; ", quote_literal_cstr(command));
+	}
+
+	appendStringInfoString(codeBlock, "END");
+
+	StringInfo batchCommand = makeStringInfo();
+	appendStringInfo(batchCommand, "DO %s", quote_literal_cstr(codeBlock->data));
+
+	return batchCommand->data;
+}
+
+
+/*
+ * BufferedDDLCommandsAtSubXactCommit moves the buffered commands of the
+ * committed subtransaction to its parent.
+ */
+void
+BufferedDDLCommandsAtSubXactCommit(void)
+{
+	int nestLevel = GetCurrentTransactionNestLevel();
+
+	BufferedDDLTask *bufferedTask = NULL;
+	foreach_ptr(bufferedTask, BufferedDDLTaskList)
+	{
+		if (bufferedTask->nestLevel >= nestLevel)
+		{
+			bufferedTask->nestLevel = nestLevel - 1;
+		}
+	}
+}
+
+
+/*
+ * BufferedDDLCommandsAtSubXactAbort discards the commands that were buffered
+ * in the aborted subtransaction, since they were never sent.
+ */
+void
+BufferedDDLCommandsAtSubXactAbort(void)
+{
+	int nestLevel = GetCurrentTransactionNestLevel();
+	List *remainingTaskList = NIL;
+
+	MemoryContext oldContext = MemoryContextSwitchTo(TopTransactionContext);
+
+	BufferedDDLTask *bufferedTask = NULL;
+	foreach_ptr(bufferedTask, BufferedDDLTaskList)
+	{
+		if (bufferedTask->nestLevel < nestLevel)
+		{
+			remainingTaskList = lappend(remainingTaskList, bufferedTask);
+		}
+	}
+
+	MemoryContextSwitchTo(oldContext);
+
+	BufferedDDLTaskList = remainingTaskList;
+
+	if (BufferedDDLTaskList == NIL)
+	{
+		BufferedDDLCommandCount = 0;
+	}
+}
+
+
+/*
+ * ResetDDLBuffer forgets the buffered commands at the end of the transaction.
+ * Their memory is freed along with TopTransactionContext.
+ */
+void
+ResetDDLBuffer(void)
+{
+	BufferedDDLTaskList = NIL;
+	BufferedDDLCommandCount = 0;
+	FlushingDDLBuffer = false;
+}
@@ -12,6 +12,8 @@
 #include "distributed/hash_helpers.h"
 
 #include "distributed/adaptive_executor.h"
+#include "distributed/command_progress.h"
+#include "distributed/deparse_shard_query.h"
 #include "distributed/directed_acyclic_graph_execution.h"
 #include "distributed/listutils.h"
 #include "distributed/metadata_cache.h"
@@ -33,54 +35,119 @@ typedef struct TaskHashEntry
 {
 	TaskHashKey key;
 	Task *task;
+
+	/* tasks that depend on the task, only used in the dependingTasks HTAB */
+	List *dependingTaskList;
 }TaskHashEntry;
 
+/*
+ * DependencyOrderExecution holds the state of the tasks while they are being
+ * executed in their dependency order.
+ */
+typedef struct DependencyOrderExecution
+{
+	/* tasks that finished, including the excluded tasks */
+	HTAB *completedTasks;
+
+	/* tasks that were handed to the executor, including the excluded tasks */
+	HTAB *startedTasks;
+
+	/* maps each task to the tasks that depend on it */
+	HTAB *dependingTasks;
+
+	/* fetch tasks whose query strings we changed, and their original queries */
+	List *fetchTaskList;
+	List *originalQueryStringList;
+
+	/* tasks done per job, NULL if the progress is not monitored */
+	CommandProgress *progress;
+} DependencyOrderExecution;
+
 static HASHCTL InitHashTableInfo(void);
 static HTAB * CreateTaskHashTable(void);
+static HTAB * CreateDependingTaskHashTable(List *allTasks);
 static bool IsAllDependencyCompleted(Task *task, HTAB *completedTasks);
 static void AddCompletedTasks(List *curCompletedTasks, HTAB *completedTasks);
-static List * FindExecutableTasks(List *allTasks, HTAB *completedTasks);
+static List * FindExecutableTasks(List *allTasks, HTAB *completedTasks,
+								  HTAB *startedTasks);
+static List * DependencyOrderTasksCompleted(List *completedTaskList, void *context);
 static int TaskHashCompare(const void *key1, const void *key2, Size keysize);
 static uint32 TaskHash(const void *key, Size keysize);
-static bool IsTaskAlreadyCompleted(Task *task, HTAB *completedTasks);
+static bool MarkTaskStarted(Task *task, HTAB *startedTasks);
+static List * InitReplicatedMapTaskExecutions(List *taskList);
+static void UpdateMapFetchTaskQueryStrings(List *taskList, List **fetchTaskList,
+										   List **originalQueryStringList);
+static void ResetReplicatedMapTaskState(List *mapTaskList, List *fetchTaskList,
+										List *originalQueryStringList);
+static CommandProgress * StartDependencyOrderProgress(List *allTasks,
+													  HTAB *excludedTasks);
+static void RecordCompletedTasks(CommandProgress *progress, List *completedTaskList);
 
 /*
  * ExecuteTasksInDependencyOrder executes the given tasks except the excluded
- * tasks in their dependency order. To do so, it iterates all
- * the tasks and finds the ones that can be executed at that time, it tries to
- * execute all of them in parallel. The parallelism is bound by MaxAdaptiveExecutorPoolSize.
+ * tasks in their dependency order. To do so, it starts the tasks whose
+ * dependencies are already executed in a single distributed execution, and
+ * adds the tasks that depend on them to the same execution as soon as all of
+ * their dependencies are executed. That way, a slow task only holds back the
+ * tasks that depend on it. The parallelism is bound by MaxAdaptiveExecutorPoolSize.
  */
 void
 ExecuteTasksInDependencyOrder(List *allTasks, List *excludedTasks, List *jobIds)
 {
-	HTAB *completedTasks = CreateTaskHashTable();
+	DependencyOrderExecution *execution = palloc0(sizeof(DependencyOrderExecution));
+	execution->completedTasks = CreateTaskHashTable();
+	execution->startedTasks = CreateTaskHashTable();
+	execution->dependingTasks = CreateDependingTaskHashTable(allTasks);
 
 	/* We only execute depended jobs' tasks, therefore to not execute */
 	/* top level tasks, we add them to the completedTasks. */
-	AddCompletedTasks(excludedTasks, completedTasks);
-	while (true)
+	AddCompletedTasks(excludedTasks, execution->completedTasks);
+	AddCompletedTasks(excludedTasks, execution->startedTasks);
+
+	List *replicatedMapTaskList = InitReplicatedMapTaskExecutions(allTasks);
+
+	/* excluded tasks are the only completed tasks at this point */
+	execution->progress = StartDependencyOrderProgress(allTasks,
+													   execution->completedTasks);
+
+	PG_TRY();
 	{
-		List *curTasks = FindExecutableTasks(allTasks, completedTasks);
-		if (list_length(curTasks) == 0)
+		List *initialTasks = FindExecutableTasks(allTasks, execution->completedTasks,
+												 execution->startedTasks);
+		if (list_length(initialTasks) > 0)
 		{
-			break;
-		}
-		ExecuteTaskListOutsideTransaction(ROW_MODIFY_NONE, curTasks,
-										  MaxAdaptiveExecutorPoolSize, jobIds);
+			UpdateMapFetchTaskQueryStrings(initialTasks, &execution->fetchTaskList,
+										   &execution->originalQueryStringList);
 
-		AddCompletedTasks(curTasks, completedTasks);
-		curTasks = NIL;
+			ExecuteTaskGraphOutsideTransaction(ROW_MODIFY_NONE, initialTasks,
+											   MaxAdaptiveExecutorPoolSize, jobIds,
+											   DependencyOrderTasksCompleted,
+											   execution);
+		}
 	}
+	PG_CATCH();
+	{
+		ResetReplicatedMapTaskState(replicatedMapTaskList, execution->fetchTaskList,
+									execution->originalQueryStringList);
+		PG_RE_THROW();
+	}
+	PG_END_TRY();
+
+	ResetReplicatedMapTaskState(replicatedMapTaskList, execution->fetchTaskList,
+								execution->originalQueryStringList);
+
+	FinishCommandProgress(execution->progress);
 }
 
 
 /*
  * FindExecutableTasks finds the tasks that can be executed currently,
  * which means that all of their dependencies are executed. If a task
- * is already executed, it is not added to the result.
+ * is already started, it is not added to the result. The returned
+ * tasks are marked as started.
  */
 static List *
-FindExecutableTasks(List *allTasks, HTAB *completedTasks)
+FindExecutableTasks(List *allTasks, HTAB *completedTasks, HTAB *startedTasks)
 {
 	List *curTasks = NIL;
 
@@ -88,7 +155,7 @@ FindExecutableTasks(List *allTasks, HTAB *completedTasks)
 	foreach_ptr(task, allTasks)
 	{
 		if (IsAllDependencyCompleted(task, completedTasks) &&
-			!IsTaskAlreadyCompleted(task, completedTasks))
+			MarkTaskStarted(task, startedTasks))
 		{
 			curTasks = lappend(curTasks, task);
 		}
@@ -98,6 +165,241 @@ FindExecutableTasks(List *allTasks, HTAB *completedTasks)
 }
 
 
+/*
+ * DependencyOrderTasksCompleted is called by the adaptive executor with the
+ * tasks that finished in the latest round of events. It records the tasks as
+ * completed, and returns the tasks that depend on them and whose dependencies
+ * are now all executed, such that the executor starts them right away.
+ */
+static List *
+DependencyOrderTasksCompleted(List *completedTaskList, void *context)
+{
+	DependencyOrderExecution *execution = (DependencyOrderExecution *) context;
+	List *executableTaskList = NIL;
+
+	AddCompletedTasks(completedTaskList, execution->completedTasks);
+	RecordCompletedTasks(execution->progress, completedTaskList);
+
+	Task *completedTask = NULL;
+	foreach_ptr(completedTask, completedTaskList)
+	{
+		TaskHashKey taskKey = { completedTask->jobId, completedTask->taskId };
+		bool found = false;
+
+		TaskHashEntry *taskEntry = hash_search(execution->dependingTasks, &taskKey,
+											   HASH_FIND, &found);
+		if (!found)
+		{
+			continue;
+		}
+
+		Task *dependingTask = NULL;
+		foreach_ptr(dependingTask, taskEntry->dependingTaskList)
+		{
+			if (IsAllDependencyCompleted(dependingTask, execution->completedTasks) &&
+				MarkTaskStarted(dependingTask, execution->startedTasks))
+			{
+				executableTaskList = lappend(executableTaskList, dependingTask);
+			}
+		}
+	}
+
+	UpdateMapFetchTaskQueryStrings(executableTaskList, &execution->fetchTaskList,
+								   &execution->originalQueryStringList);
+
+	return executableTaskList;
+}
+
+
+/*
+ * StartDependencyOrderProgress creates a progress monitor for the given tasks
+ * with a step for every job, in which the tasks of the job that are done are
+ * counted. Excluded tasks are not executed and are not counted. The function
+ * returns NULL if the progress is not monitored.
+ */
+static CommandProgress *
+StartDependencyOrderProgress(List *allTasks, HTAB *excludedTasks)
+{
+	List *jobTaskCountList = NIL;
+	List *jobIdList = NIL;
+
+	Task *task = NULL;
+	foreach_ptr(task, allTasks)
+	{
+		TaskHashKey taskKey = { task->jobId, task->taskId };
+		bool excluded = false;
+
+		hash_search(excludedTasks, &taskKey, HASH_FIND, &excluded);
+		if (excluded)
+		{
+			continue;
+		}
+
+		ListCell *jobIdCell = NULL;
+		ListCell *taskCountCell = NULL;
+		bool jobFound = false;
+
+		forboth(jobIdCell, jobIdList, taskCountCell, jobTaskCountList)
+		{
+			if (*((uint64 *) lfirst(jobIdCell)) == task->jobId)
+			{
+				lfirst_int(taskCountCell)++;
+				jobFound = true;
+				break;
+			}
+		}
+
+		if (!jobFound)
+		{
+			uint64 *jobId = palloc(sizeof(uint64));
+			*jobId = task->jobId;
+
+			jobIdList = lappend(jobIdList, jobId);
+			jobTaskCountList = lappend_int(jobTaskCountList, 1);
+		}
+	}
+
+	Oid relationId = InvalidOid;
+	CommandProgress *progress =
+		StartCommandProgress(REPARTITION_QUERY_PROGRESS_MAGIC_NUMBER, relationId,
+							 list_length(jobIdList));
+	if (progress == NULL)
+	{
+		return NULL;
+	}
+
+	int stepIndex = 0;
+	ListCell *jobIdCell = NULL;
+	ListCell *taskCountCell = NULL;
+
+	forboth(jobIdCell, jobIdList, taskCountCell, jobTaskCountList)
+	{
+		CommandProgressStep *step = &progress->steps[stepIndex];
+
+		step->stepType = COMMAND_PROGRESS_STEP_JOB;
+		step->stepId = *((uint64 *) lfirst(jobIdCell));
+		step->tasksTotal = lfirst_int(taskCountCell);
+
+		stepIndex++;
+	}
+
+	return progress;
+}
+
+
+/*
+ * RecordCompletedTasks counts the completed tasks in the steps of their jobs.
+ */
+static void
+RecordCompletedTasks(CommandProgress *progress, List *completedTaskList)
+{
+	if (progress == NULL)
+	{
+		return;
+	}
+
+	Task *completedTask = NULL;
+	foreach_ptr(completedTask, completedTaskList)
+	{
+		CommandProgressStep *step =
+			CommandProgressStepById(progress, COMMAND_PROGRESS_STEP_JOB,
+									completedTask->jobId);
+
+		if (step != NULL)
+		{
+			step->tasksDone++;
+		}
+	}
+}
+
+
+/*
+ * InitReplicatedMapTaskExecutions creates a task execution for each map task in
+ * the given list that has more than one placement. The adaptive executor runs
+ * such map tasks on a single placement, and records in the task execution which
+ * placement holds the map output. The function returns the map tasks it created
+ * a task execution for.
+ */
+static List *
+InitReplicatedMapTaskExecutions(List *taskList)
+{
+	List *replicatedMapTaskList = NIL;
+
+	Task *task = NULL;
+	foreach_ptr(task, taskList)
+	{
+		if (task->taskType == MAP_TASK && list_length(task->taskPlacementList) > 1)
+		{
+			task->taskExecution = InitTaskExecution(task, EXEC_TASK_UNASSIGNED);
+			replicatedMapTaskList = lappend(replicatedMapTaskList, task);
+		}
+	}
+
+	return replicatedMapTaskList;
+}
+
+
+/*
+ * UpdateMapFetchTaskQueryStrings points the map output fetch tasks in the given
+ * list to the placement on which their map task succeeded. The planner points
+ * them to the first placement, which is only guaranteed to hold the map output
+ * if the map task has a single placement. The function appends the updated
+ * tasks and their original query strings to the given lists.
+ */
+static void
+UpdateMapFetchTaskQueryStrings(List *taskList, List **fetchTaskList,
+							   List **originalQueryStringList)
+{
+	Task *task = NULL;
+	foreach_ptr(task, taskList)
+	{
+		if (task->taskType != MAP_OUTPUT_FETCH_TASK)
+		{
+			continue;
+		}
+
+		Task *mapTask = (Task *) linitial(task->dependentTaskList);
+		if (mapTask->taskExecution == NULL)
+		{
+			continue;
+		}
+
+		*fetchTaskList = lappend(*fetchTaskList, task);
+		*originalQueryStringList = lappend(*originalQueryStringList,
+										   TaskQueryString(task));
+
+		StringInfo mapFetchQueryString = MapFetchTaskQueryString(task, mapTask);
+		SetTaskQueryString(task, mapFetchQueryString->data);
+	}
+}
+
+
+/*
+ * ResetReplicatedMapTaskState removes the task executions of the given map tasks
+ * and sets the query strings of the given fetch tasks back to what the planner
+ * generated. The tasks may belong to a cached plan, which must not keep pointers
+ * to memory of this execution.
+ */
+static void
+ResetReplicatedMapTaskState(List *mapTaskList, List *fetchTaskList,
+							List *originalQueryStringList)
+{
+	Task *task = NULL;
+	foreach_ptr(task, mapTaskList)
+	{
+		task->taskExecution = NULL;
+	}
+
+	ListCell *fetchTaskCell = NULL;
+	ListCell *queryStringCell = NULL;
+	forboth(fetchTaskCell, fetchTaskList, queryStringCell, originalQueryStringList)
+	{
+		task = (Task *) lfirst(fetchTaskCell);
+		SetTaskQueryString(task, (char *) lfirst(queryStringCell));
+	}
+}
+
+
 /*
  * AddCompletedTasks adds the givens tasks to completedTasks HTAB.
  */
@@ -129,17 +431,55 @@ CreateTaskHashTable()
 
 
 /*
- * IsTaskAlreadyCompleted returns true if the given task
- * is found in the completedTasks HTAB.
+ * MarkTaskStarted adds the given task to the startedTasks HTAB, and returns
+ * true if the task was not started before.
  */
 static bool
-IsTaskAlreadyCompleted(Task *task, HTAB *completedTasks)
+MarkTaskStarted(Task *task, HTAB *startedTasks)
 {
 	bool found;
 
 	TaskHashKey taskKey = { task->jobId, task->taskId };
-	hash_search(completedTasks, &taskKey, HASH_ENTER, &found);
-	return found;
+	hash_search(startedTasks, &taskKey, HASH_ENTER, &found);
+	return !found;
+}
+
+
+/*
+ * CreateDependingTaskHashTable creates a HTAB that maps each task in the given
+ * list to the tasks that depend on it.
+ */
+static HTAB *
+CreateDependingTaskHashTable(List *allTasks)
+{
+	uint32 hashFlags = (HASH_ELEM | HASH_FUNCTION | HASH_CONTEXT | HASH_COMPARE);
+	HASHCTL info = InitHashTableInfo();
+	HTAB *dependingTasks = hash_create("citus depending task list (jobId, taskId)",
+									   64, &info, hashFlags);
+
+	Task *task = NULL;
+	foreach_ptr(task, allTasks)
+	{
+		Task *dependentTask = NULL;
+		foreach_ptr(dependentTask, task->dependentTaskList)
+		{
+			TaskHashKey taskKey = { dependentTask->jobId, dependentTask->taskId };
+			bool found = false;
+
+			TaskHashEntry *taskEntry = hash_search(dependingTasks, &taskKey,
+												   HASH_ENTER, &found);
+			if (!found)
+			{
+				taskEntry->task = dependentTask;
+				taskEntry->dependingTaskList = NIL;
+			}
+
+			taskEntry->dependingTaskList = lappend(taskEntry->dependingTaskList,
+												   task);
+		}
+	}
+
+	return dependingTasks;
 }
 
 
@@ -17,6 +17,8 @@
 
 #include "access/tupdesc.h"
 #include "catalog/pg_type.h"
+#include "distributed/adaptive_executor.h"
+#include "distributed/command_progress.h"
 #include "distributed/deparse_shard_query.h"
 #include "distributed/intermediate_results.h"
 #include "distributed/listutils.h"
@@ -54,11 +56,25 @@ typedef struct NodeToNodeFragmentsTransfer
 } NodeToNodeFragmentsTransfer;
 
 
+/* GUC, determining whether map tasks push result partitions to their target nodes */
+bool EnablePushBasedRepartition = false;
+
+
 /* forward declarations of local functions */
+static List * PushTasklistResults(const char *resultIdPrefix, List *selectTaskList,
+								  int partitionColumnIndex,
+								  CitusTableCacheEntry *targetRelation,
+								  List *targetPlacementList, bool binaryFormat);
+static List * PushTargetPlacementList(CitusTableCacheEntry *targetRelation,
+									  bool *replicatedTarget);
+static void CreateResultsDirectoryOnNodes(const char *resultIdPrefix,
+										  List *targetPlacementList);
 static void WrapTasksForPartitioning(const char *resultIdPrefix, List *selectTaskList,
 									 int partitionColumnIndex,
 									 CitusTableCacheEntry *targetRelation,
+									 List *targetPlacementList,
 									 bool binaryFormat);
+static char * TargetNodeArraysString(List *targetPlacementList, uint32 sourceNodeId);
 static List * ExecutePartitionTaskList(List *partitionTaskList,
 									   CitusTableCacheEntry *targetRelation);
 static ArrayType * CreateArrayFromDatums(Datum *datumArray, bool *nullsArray, int
@@ -71,7 +87,10 @@ static DistributedResultFragment * TupleToDistributedResultFragment(
 	TupleTableSlot *tupleSlot, CitusTableCacheEntry *targetRelation);
 static Tuplestorestate * ExecuteSelectTasksIntoTupleStore(List *taskList,
 														  TupleDesc resultDescriptor,
-														  bool errorOnAnyFailure);
+														  bool errorOnAnyFailure,
+														  CommandProgressStep *
+														  progressStep);
+static CommandProgressStep * InsertSelectProgressStep(CommandProgressStepType stepType);
 static List ** ColocateFragmentsWithRelation(List *fragmentList,
 											 CitusTableCacheEntry *targetRelation);
 static List * ColocationTransfers(List *fragmentList,
@@ -79,7 +98,10 @@ static List * ColocationTransfers(List *fragmentList,
 static List * FragmentTransferTaskList(List *fragmentListTransfers);
 static char * QueryStringForFragmentsTransfer(
 	NodeToNodeFragmentsTransfer *fragmentsTransfer);
-static void ExecuteFetchTaskList(List *fetchTaskList);
+static void ExecuteFetchTaskList(List *fetchTaskList,
+								 CommandProgressStep *progressStep);
+static List ** ShardResultIdLists(List *fragmentList,
+								  CitusTableCacheEntry *targetRelation);
 
 
 /*
@@ -95,6 +117,12 @@ static void ExecuteFetchTaskList(List *fetchTaskList);
  *
  * partitionColumnIndex determines the column in the selectTaskList to use for
  * partitioning.
+ *
+ * When citus.enable_push_based_repartition is on, the tasks push the partitions
+ * directly to the node of the first placement of each target shard while they
+ * run, instead of writing them to local files which are fetched from the
+ * target nodes afterwards. If the target shards have more placements, the
+ * pushed partitions are fetched from the first placement by the other ones.
  */
 List **
 RedistributeTaskListResults(const char *resultIdPrefix, List *selectTaskList,
@@ -110,6 +138,28 @@ RedistributeTaskListResults(const char *resultIdPrefix, List *selectTaskList,
 	 */
 	UseCoordinatedTransaction();
 
+	if (EnablePushBasedRepartition)
+	{
+		bool replicatedTarget = false;
+		List *targetPlacementList = PushTargetPlacementList(targetRelation,
+															&replicatedTarget);
+		if (targetPlacementList != NIL)
+		{
+			List *fragmentList = PushTasklistResults(resultIdPrefix, selectTaskList,
+													 partitionColumnIndex,
+													 targetRelation,
+													 targetPlacementList,
+													 binaryFormat);
+			if (replicatedTarget)
+			{
+				/* copy the pushed fragments to the other placements */
+				return ColocateFragmentsWithRelation(fragmentList, targetRelation);
+			}
+
+			return ShardResultIdLists(fragmentList, targetRelation);
+		}
+	}
+
 	List *fragmentList = PartitionTasklistResults(resultIdPrefix, selectTaskList,
 												  partitionColumnIndex,
 												  targetRelation, binaryFormat);
@@ -153,24 +203,167 @@ PartitionTasklistResults(const char *resultIdPrefix, List *selectTaskList,
 	 */
 	UseCoordinatedTransaction();
 
+	List *targetPlacementList = NIL;
 	WrapTasksForPartitioning(resultIdPrefix, selectTaskList,
 							 partitionColumnIndex, targetRelation,
-							 binaryFormat);
+							 targetPlacementList, binaryFormat);
 	return ExecutePartitionTaskList(selectTaskList, targetRelation);
 }
 
 
+/*
+ * PushTasklistResults executes the given task list, and partitions results
+ * of each task like PartitionTasklistResults. However, each partition is
+ * streamed to the node of the target shard placement at the same index in
+ * targetPlacementList while the task runs, so the map phase and the transfers
+ * overlap and the fragments do not need to be fetched afterwards.
+ *
+ * The returned fragments are named like in PartitionTasklistResults and are
+ * stored on the nodes of the placements in targetPlacementList, which their
+ * nodeId is set to.
+ */
+static List *
+PushTasklistResults(const char *resultIdPrefix, List *selectTaskList,
+					int partitionColumnIndex, CitusTableCacheEntry *targetRelation,
+					List *targetPlacementList, bool binaryFormat)
+{
+	CreateResultsDirectoryOnNodes(resultIdPrefix, targetPlacementList);
+
+	WrapTasksForPartitioning(resultIdPrefix, selectTaskList,
+							 partitionColumnIndex, targetRelation,
+							 targetPlacementList, binaryFormat);
+	List *fragmentList = ExecutePartitionTaskList(selectTaskList, targetRelation);
+
+	/* the fragments now reside on the nodes of their target placements */
+	DistributedResultFragment *fragment = NULL;
+	foreach_ptr(fragment, fragmentList)
+	{
+		ShardPlacement *targetPlacement = list_nth(targetPlacementList,
+												   fragment->targetShardIndex);
+
+		fragment->nodeId = targetPlacement->nodeId;
+	}
+
+	return fragmentList;
+}
+
+
+/*
+ * PushTargetPlacementList returns the placement of each shard of the target
+ * relation to which the partitions are pushed, in shard index order. This is
+ * the first active placement of the shard. It returns NIL if the partitions
+ * cannot be pushed to the target shards, which is the case when the relation
+ * is not hash or range partitioned, or when any of its shards does not have an
+ * active placement.
+ *
+ * replicatedTarget is set to whether any shard has more than one active
+ * placement, in which case the pushed partitions still need to be copied to
+ * the other placements.
+ */
+static List *
+PushTargetPlacementList(CitusTableCacheEntry *targetRelation, bool *replicatedTarget)
+{
+	List *targetPlacementList = NIL;
+
+	*replicatedTarget = false;
+
+	if (targetRelation->partitionMethod != DISTRIBUTE_BY_HASH &&
+		targetRelation->partitionMethod != DISTRIBUTE_BY_RANGE)
+	{
+		return NIL;
+	}
+
+	int shardCount = targetRelation->shardIntervalArrayLength;
+	for (int shardIndex = 0; shardIndex < shardCount; shardIndex++)
+	{
+		ShardInterval *shardInterval =
+			targetRelation->sortedShardIntervalArray[shardIndex];
+		List *placementList = ActiveShardPlacementList(shardInterval->shardId);
+		if (placementList == NIL)
+		{
+			return NIL;
+		}
+
+		if (list_length(placementList) > 1)
+		{
+			*replicatedTarget = true;
+		}
+
+		targetPlacementList = lappend(targetPlacementList, linitial(placementList));
+	}
+
+	return targetPlacementList;
+}
+
+
+/*
+ * CreateResultsDirectoryOnNodes makes sure that the results directory of the
+ * transaction exists on the nodes of the given placements, and that it is
+ * owned by a backend which stays in the distributed transaction until it ends.
+ *
+ * Map tasks push partitions over connections which they close before they
+ * finish, and a backend removes the results directory when its transaction
+ * ends if it created the directory. We therefore broadcast an empty result to
+ * the target nodes first, over connections that are part of the distributed
+ * transaction.
+ */
+static void
+CreateResultsDirectoryOnNodes(const char *resultIdPrefix, List *targetPlacementList)
+{
+	List *targetNodeList = NIL;
+	TupleDesc tupleDescriptor = NULL;
+	bool writeLocalFile = false;
+
+	ShardPlacement *targetPlacement = NULL;
+	foreach_ptr(targetPlacement, targetPlacementList)
+	{
+		WorkerNode *workerNode = ForceLookupNodeByNodeId(targetPlacement->nodeId);
+
+		targetNodeList = list_append_unique_ptr(targetNodeList, workerNode);
+	}
+
+	StringInfo resultId = makeStringInfo();
+	appendStringInfo(resultId, "%s_push", resultIdPrefix);
+
+#if PG_VERSION_NUM >= 120000
+	tupleDescriptor = CreateTemplateTupleDesc(0);
+#else
+	tupleDescriptor = CreateTemplateTupleDesc(0, false);
+#endif
+
+	EState *estate = CreateExecutorState();
+	DestReceiver *resultDest = CreateRemoteFileDestReceiver(resultId->data, estate,
+															targetNodeList,
+															writeLocalFile);
+
+	resultDest->rStartup(resultDest, 0, tupleDescriptor);
+	resultDest->rShutdown(resultDest);
+	resultDest->rDestroy(resultDest);
+
+	FreeExecutorState(estate);
+}
+
+
 /*
  * WrapTasksForPartitioning wraps the query for each of the tasks by a call
  * to worker_partition_query_result(). Target list of the wrapped query should
  * match the tuple descriptor in ExecutePartitionTaskList().
+ *
+ * If targetPlacementList is not NIL, the query is wrapped by a call to
+ * worker_push_partitioned_query_result() instead, which pushes partition i to
+ * the node of the i-th placement in the list.
  */
 static void
 WrapTasksForPartitioning(const char *resultIdPrefix, List *selectTaskList,
 						 int partitionColumnIndex,
 						 CitusTableCacheEntry *targetRelation,
+						 List *targetPlacementList,
 						 bool binaryFormat)
 {
+	const char *partitionFunctionName = targetPlacementList != NIL ?
+										"worker_push_partitioned_query_result" :
+										"worker_partition_query_result";
+
 	ShardInterval **shardIntervalArray = targetRelation->sortedShardIntervalArray;
 	int shardCount = targetRelation->shardIntervalArrayLength;
 
@@ -211,21 +404,29 @@ WrapTasksForPartitioning(const char *resultIdPrefix, List *selectTaskList,
 		ShardPlacement *shardPlacement = NULL;
 		foreach_ptr(shardPlacement, shardPlacementList)
 		{
+			char *targetNodesString = "";
+			if (targetPlacementList != NIL)
+			{
+				targetNodesString = TargetNodeArraysString(targetPlacementList,
+														   shardPlacement->nodeId);
+			}
+
 			StringInfo wrappedQuery = makeStringInfo();
 			appendStringInfo(wrappedQuery,
 							 "SELECT %u, partition_index"
 							 ", %s || '_' || partition_index::text "
 							 ", rows_written "
-							 "FROM worker_partition_query_result"
-							 "(%s,%s,%d,%s,%s,%s,%s) WHERE rows_written > 0",
+							 "FROM %s"
+							 "(%s,%s,%d,%s,%s,%s,%s%s) WHERE rows_written > 0",
 							 shardPlacement->nodeId,
 							 quote_literal_cstr(taskPrefix),
+							 partitionFunctionName,
 							 quote_literal_cstr(taskPrefix),
 							 quote_literal_cstr(TaskQueryString(selectTask)),
 							 partitionColumnIndex,
 							 quote_literal_cstr(partitionMethodString),
 							 minValuesString->data, maxValuesString->data,
-							 binaryFormatString);
+							 binaryFormatString, targetNodesString);
 			perPlacementQueries = lappend(perPlacementQueries, wrappedQuery->data);
 		}
 
@@ -235,6 +436,53 @@ WrapTasksForPartitioning(const char *resultIdPrefix, List *selectTaskList,
 }
 
 
+/*
+ * TargetNodeArraysString returns the target node name and port arguments of
+ * worker_push_partitioned_query_result() for a task that runs on the given
+ * source node. Partitions whose target placement is on the source node are
+ * written to local files, so their node name is NULL.
+ */
+static char *
+TargetNodeArraysString(List *targetPlacementList, uint32 sourceNodeId)
+{
+	int partitionCount = list_length(targetPlacementList);
+	Datum *nodeNames = palloc0(partitionCount * sizeof(Datum));
+	bool *nodeNameNulls = palloc0(partitionCount * sizeof(bool));
+	Datum *nodePorts = palloc0(partitionCount * sizeof(Datum));
+	bool *nodePortNulls = palloc0(partitionCount * sizeof(bool));
+	int partitionIndex = 0;
+
+	ShardPlacement *targetPlacement = NULL;
+	foreach_ptr(targetPlacement, targetPlacementList)
+	{
+		if (targetPlacement->nodeId == sourceNodeId)
+		{
+			nodeNameNulls[partitionIndex] = true;
+			nodePortNulls[partitionIndex] = true;
+		}
+		else
+		{
+			nodeNames[partitionIndex] = CStringGetTextDatum(targetPlacement->nodeName);
+			nodePorts[partitionIndex] = Int32GetDatum(targetPlacement->nodePort);
+		}
+
+		partitionIndex++;
+	}
+
+	ArrayType *nodeNameArray = CreateArrayFromDatums(nodeNames, nodeNameNulls,
+													 partitionCount, TEXTOID);
+	ArrayType *nodePortArray = CreateArrayFromDatums(nodePorts, nodePortNulls,
+													 partitionCount, INT4OID);
+
+	StringInfo targetNodesString = makeStringInfo();
+	appendStringInfo(targetNodesString, ",%s,%s",
+					 ArrayObjectToString(nodeNameArray, TEXTOID, -1)->data,
+					 ArrayObjectToString(nodePortArray, INT4OID, -1)->data);
+
+	return targetNodesString->data;
+}
+
+
 /*
  * SourceShardPrefix returns result id prefix for partitions which have the
  * given anchor shard id.
@@ -339,9 +587,16 @@ ExecutePartitionTaskList(List *taskList, CitusTableCacheEntry *targetRelation)
 	TupleDescInitEntry(resultDescriptor, (AttrNumber) 4, "rows_written",
 					   INT8OID, -1, 0);
 
+	CommandProgressStep *progressStep =
+		InsertSelectProgressStep(COMMAND_PROGRESS_STEP_PARTITION);
+	if (progressStep != NULL)
+	{
+		progressStep->tasksTotal = list_length(taskList);
+	}
+
 	bool errorOnAnyFailure = false;
 	resultStore = ExecuteSelectTasksIntoTupleStore(taskList, resultDescriptor,
-												   errorOnAnyFailure);
+												   errorOnAnyFailure, progressStep);
 
 	List *fragmentList = NIL;
 	TupleTableSlot *slot = MakeSingleTupleTableSlotCompat(resultDescriptor,
@@ -353,6 +608,12 @@ ExecutePartitionTaskList(List *taskList, CitusTableCacheEntry *targetRelation)
 
 		fragmentList = lappend(fragmentList, distributedResultFragment);
 
+		if (progressStep != NULL)
+		{
+			progressStep->fragmentCount++;
+			progressStep->rowCount += distributedResultFragment->rowCount;
+		}
+
 		ExecClearTuple(slot);
 	}
 
@@ -392,12 +653,15 @@ TupleToDistributedResultFragment(TupleTableSlot *tupleSlot,
 
 /*
  * ExecuteSelectTasksIntoTupleStore executes the given tasks and returns a tuple
- * store containing its results.
+ * store containing its results. If progressStep is given, the tasks that
+ * finish are counted in it while the tasks run.
  */
 static Tuplestorestate *
 ExecuteSelectTasksIntoTupleStore(List *taskList, TupleDesc resultDescriptor,
-								 bool errorOnAnyFailure)
+								 bool errorOnAnyFailure,
+								 CommandProgressStep *progressStep)
 {
+	TaskCompletedCallback taskCompletedCallback = NULL;
 	bool hasReturning = true;
 	int targetPoolSize = MaxAdaptiveExecutorPoolSize;
 	bool randomAccess = true;
@@ -411,9 +675,16 @@ ExecuteSelectTasksIntoTupleStore(List *taskList, TupleDesc resultDescriptor,
 	Tuplestorestate *resultStore = tuplestore_begin_heap(randomAccess, interTransactions,
 														 work_mem);
 
-	ExecuteTaskListExtended(ROW_MODIFY_READONLY, taskList, resultDescriptor,
-							resultStore, hasReturning, targetPoolSize, &xactProperties,
-							NIL);
+	/* count the finished tasks in the progress of the command */
+	if (progressStep != NULL)
+	{
+		taskCompletedCallback = CommandProgressTasksCompleted;
+	}
+
+	ExecuteTaskListExtendedWithCallback(ROW_MODIFY_READONLY, taskList,
+										resultDescriptor, resultStore, hasReturning,
+										targetPoolSize, &xactProperties, NIL,
+										taskCompletedCallback, progressStep);
 
 	return resultStore;
 }
@@ -434,8 +705,33 @@ ColocateFragmentsWithRelation(List *fragmentList, CitusTableCacheEntry *targetRe
 	List *fragmentListTransfers = ColocationTransfers(fragmentList, targetRelation);
 	List *fragmentTransferTaskList = FragmentTransferTaskList(fragmentListTransfers);
 
-	ExecuteFetchTaskList(fragmentTransferTaskList);
+	CommandProgressStep *progressStep =
+		InsertSelectProgressStep(COMMAND_PROGRESS_STEP_FETCH);
+	if (progressStep != NULL)
+	{
+		NodeToNodeFragmentsTransfer *fragmentsTransfer = NULL;
+		foreach_ptr(fragmentsTransfer, fragmentListTransfers)
+		{
+			progressStep->fragmentCount += list_length(fragmentsTransfer->fragmentList);
+		}
+
+		progressStep->tasksTotal = list_length(fragmentTransferTaskList);
+	}
+
+	ExecuteFetchTaskList(fragmentTransferTaskList, progressStep);
 
+	return ShardResultIdLists(fragmentList, targetRelation);
+}
+
+
+/*
+ * ShardResultIdLists groups the result ids of the given fragments by their
+ * target shard. returnValue[shardIndex] is the list of result ids for
+ * targetRelation->sortedShardIntervalArray[shardIndex].
+ */
+static List **
+ShardResultIdLists(List *fragmentList, CitusTableCacheEntry *targetRelation)
+{
 	int shardCount = targetRelation->shardIntervalArrayLength;
 	List **shardResultIdList = palloc0(shardCount * sizeof(List *));
 
@@ -600,10 +896,11 @@ QueryStringForFragmentsTransfer(NodeToNodeFragmentsTransfer *fragmentsTransfer)
 
 /*
  * ExecuteFetchTaskList executes a list of fetch_intermediate_results() tasks.
- * It ignores the byte_count result of the fetch_intermediate_results() calls.
+ * The byte_count results of the fetch_intermediate_results() calls are only
+ * used for the progress of the command, if progressStep is given.
  */
 static void
-ExecuteFetchTaskList(List *taskList)
+ExecuteFetchTaskList(List *taskList, CommandProgressStep *progressStep)
 {
 	TupleDesc resultDescriptor = NULL;
 	Tuplestorestate *resultStore = NULL;
@@ -619,13 +916,40 @@ ExecuteFetchTaskList(List *taskList)
 
 	bool errorOnAnyFailure = true;
 	resultStore = ExecuteSelectTasksIntoTupleStore(taskList, resultDescriptor,
-												   errorOnAnyFailure);
+												   errorOnAnyFailure, progressStep);
 
 	TupleTableSlot *slot = MakeSingleTupleTableSlotCompat(resultDescriptor,
 														  &TTSOpsMinimalTuple);
 
 	while (tuplestore_gettupleslot(resultStore, true, false, slot))
 	{
+		if (progressStep != NULL)
+		{
+			bool isNull = false;
+			Datum byteCountDatum = slot_getattr(slot, 1, &isNull);
+
+			if (!isNull)
+			{
+				progressStep->byteCount += DatumGetInt64(byteCountDatum);
+			}
+		}
+
 		ExecClearTuple(slot);
 	}
 }
+
+
+/*
+ * InsertSelectProgressStep returns the given phase in the progress of the
+ * repartitioned INSERT..SELECT that is running, or NULL if its progress is
+ * not monitored.
+ */
+static CommandProgressStep *
+InsertSelectProgressStep(CommandProgressStepType stepType)
+{
+	CommandProgress *progress =
+		GetCurrentCommandProgress(INSERT_SELECT_PROGRESS_MAGIC_NUMBER);
+	uint64 stepId = 0;
+
+	return CommandProgressStepById(progress, stepType, stepId);
+}
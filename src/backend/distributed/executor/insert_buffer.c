@@ -0,0 +1,482 @@
+/*-------------------------------------------------------------------------
+ *
+ * insert_buffer.c
+ *   Write-behind buffering of single-row INSERTs in transaction blocks.
+ *
+ *   Applications that ingest rows with many single-row INSERT statements in
+ *   a transaction block pay a round trip to a worker for every row. When
+ *   citus.insert_buffer_size is set, router INSERTs without RETURNING or
+ *   ON CONFLICT are not sent right away, but their rows are kept per shard
+ *   and sent as a single multi-row INSERT. A buffer is flushed when it holds
+ *   citus.insert_buffer_size rows, and all buffers are flushed before any
+ *   other distributed execution, utility command or COPY, and at commit.
+ *
+ *   Since the rows are sent later, errors such as unique violations are
+ *   reported by the statement that flushes the buffer rather than by the
+ *   INSERT that added the row.
+ *
+ * Copyright (c) Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include "postgres.h"
+
+#include "access/xact.h"
+#include "distributed/ddl_buffer.h"
+#include "distributed/deparse_shard_query.h"
+#include "distributed/insert_buffer.h"
+#include "distributed/listutils.h"
+#include "distributed/local_executor.h"
+#include "distributed/metadata_cache.h"
+#include "distributed/multi_executor.h"
+#include "distributed/multi_physical_planner.h"
+#include "distributed/relay_utility.h"
+#include "distributed/result_cache.h"
+#include "distributed/transaction_management.h"
+#include "lib/stringinfo.h"
+#include "nodes/execnodes.h"
+#include "utils/builtins.h"
+#include "utils/hsearch.h"
+#include "utils/lsyscache.h"
+#include "utils/memutils.h"
+#include "utils/ruleutils.h"
+
+
+/* hash entry for the buffered rows of a shard */
+typedef struct InsertBuffer
+{
+	uint64 shardId;
+
+	/* copy of the task of the first buffered row, for its placements */
+	Task *task;
+
+	/* INSERT INTO shard (columns) VALUES, shared by all the buffered rows */
+	char *insertPrefix;
+
+	/* comma-separated values of the buffered rows */
+	StringInfo rowValues;
+	int rowCount;
+
+	/* transaction nesting level in which the rows were buffered */
+	int nestLevel;
+} InsertBuffer;
+
+
+/* GUC, number of rows buffered per shard, 0 disables buffering */
+int InsertBufferSize = 0;
+
+/* buffered rows per shard, allocated in TopTransactionContext */
+static HTAB *InsertBufferHash = NULL;
+
+/* whether the buffers are being flushed, to not flush from within the flush */
+static bool FlushingInsertBuffers = false;
+
+
+static bool CanBufferInsert(CitusScanState *scanState);
+static char * InsertPrefixForTask(Task *task, List *targetList);
+static char * InsertRowValues(List *targetList);
+static InsertBuffer * FindInsertBuffer(uint64 shardId, bool *found);
+static void FlushInsertBufferList(List *insertBufferList);
+static Task * InsertBufferTask(InsertBuffer *insertBuffer);
+
+
+/*
+ * BufferInsertIfPossible adds the row of the single-row INSERT of the given
+ * scan state to the buffer of its shard when insert buffering is enabled and
+ * the INSERT qualifies, and returns whether it did. Otherwise, the caller is
+ * expected to execute the INSERT as usual.
+ */
+bool
+BufferInsertIfPossible(CitusScanState *scanState)
+{
+	bool found = false;
+
+	if (!CanBufferInsert(scanState))
+	{
+		return false;
+	}
+
+	Job *workerJob = scanState->distributedPlan->workerJob;
+	Task *task = (Task *) linitial(workerJob->taskList);
+	List *targetList = workerJob->jobQuery->targetList;
+	int nestLevel = GetCurrentTransactionNestLevel();
+
+	char *insertPrefix = InsertPrefixForTask(task, targetList);
+	char *rowValues = InsertRowValues(targetList);
+
+	InsertBuffer *insertBuffer = FindInsertBuffer(task->anchorShardId, &found);
+	if (found && (insertBuffer->nestLevel != nestLevel ||
+				  strcmp(insertBuffer->insertPrefix, insertPrefix) != 0))
+	{
+		/* rows of the buffer need another column list or savepoint, send them */
+		FlushInsertBufferList(list_make1(insertBuffer));
+
+		insertBuffer = FindInsertBuffer(task->anchorShardId, &found);
+	}
+
+	MemoryContext oldContext = MemoryContextSwitchTo(TopTransactionContext);
+
+	if (!found)
+	{
+		insertBuffer->task = copyObject(task);
+		insertBuffer->insertPrefix = pstrdup(insertPrefix);
+		insertBuffer->rowValues = makeStringInfo();
+		insertBuffer->rowCount = 0;
+		insertBuffer->nestLevel = nestLevel;
+	}
+
+	if (insertBuffer->rowCount > 0)
+	{
+		appendStringInfoString(insertBuffer->rowValues, ", ");
+	}
+
+	appendStringInfoString(insertBuffer->rowValues, rowValues);
+	insertBuffer->rowCount++;
+
+	MemoryContextSwitchTo(oldContext);
+
+	/* the row is not sent yet, but cached results of the shard are stale already */
+	RecordModifiedShard(task->anchorShardId);
+
+	if (insertBuffer->rowCount >= InsertBufferSize)
+	{
+		FlushInsertBufferList(list_make1(insertBuffer));
+	}
+
+	return true;
+}
+
+
+/*
+ * CanBufferInsert returns whether the distributed plan of the given scan
+ * state is a single-row INSERT into a single remote shard whose values are
+ * all constants, inside a transaction block that buffers INSERTs.
+ *
+ * Tables with foreign keys are not buffered, since the order in which the
+ * buffers of different shards are flushed may differ from the order of the
+ * INSERTs.
+ */
+static bool
+CanBufferInsert(CitusScanState *scanState)
+{
+	DistributedPlan *distributedPlan = scanState->distributedPlan;
+	Job *workerJob = distributedPlan->workerJob;
+
+	if (InsertBufferSize <= 0 || !IsMultiStatementTransaction())
+	{
+		return false;
+	}
+
+	/* the row needs to be sent after the buffered DDL commands */
+	if (BufferedDDLCommandsPending())
+	{
+		return false;
+	}
+
+	/* EXPLAIN ANALYZE reports the execution of the INSERT itself */
+	if (scanState->customScanState.ss.ps.instrument != NULL)
+	{
+		return false;
+	}
+
+	if (workerJob == NULL || workerJob->jobQuery == NULL ||
+		workerJob->jobQuery->commandType != CMD_INSERT ||
+		workerJob->jobQuery->onConflict != NULL ||
+		distributedPlan->hasReturning || distributedPlan->insertSelectQuery != NULL)
+	{
+		return false;
+	}
+
+	if (list_length(workerJob->taskList) != 1)
+	{
+		return false;
+	}
+
+	Task *task = (Task *) linitial(workerJob->taskList);
+	if (task->rowValuesLists != NIL || task->modifyWithSubquery ||
+		task->anchorShardId == INVALID_SHARD_ID ||
+		!OidIsValid(task->anchorDistributedTableId) ||
+		task->perPlacementQueryStrings != NIL)
+	{
+		return false;
+	}
+
+	/* rows to local placements are not sent anywhere, nothing to gain */
+	if (TaskAccessesLocalNode(task))
+	{
+		return false;
+	}
+
+	CitusTableCacheEntry *cacheEntry =
+		GetCitusTableCacheEntry(task->anchorDistributedTableId);
+	if (cacheEntry->referencedRelationsViaForeignKey != NIL ||
+		cacheEntry->referencingRelationsViaForeignKey != NIL)
+	{
+		return false;
+	}
+
+	TargetEntry *targetEntry = NULL;
+	foreach_ptr(targetEntry, workerJob->jobQuery->targetList)
+	{
+		if (targetEntry->resjunk || !IsA(targetEntry->expr, Const))
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+
+/*
+ * InsertPrefixForTask returns the INSERT INTO shard (columns) VALUES part of
+ * the multi-row INSERT for the shard of the given task.
+ */
+static char *
+InsertPrefixForTask(Task *task, List *targetList)
+{
+	StringInfo insertPrefix = makeStringInfo();
+	Oid relationId = task->anchorDistributedTableId;
+	char *shardName = get_rel_name(relationId);
+	char *schemaName = get_namespace_name(get_rel_namespace(relationId));
+	bool firstColumn = true;
+
+	AppendShardIdToName(&shardName, task->anchorShardId);
+
+	appendStringInfo(insertPrefix, "INSERT INTO %s (",
+					 quote_qualified_identifier(schemaName, shardName));
+
+	TargetEntry *targetEntry = NULL;
+	foreach_ptr(targetEntry, targetList)
+	{
+		char *columnName = get_attname(relationId, targetEntry->resno, false);
+
+		appendStringInfo(insertPrefix, "%s%s", firstColumn ? "" : ", ",
+						 quote_identifier(columnName));
+		firstColumn = false;
+	}
+
+	appendStringInfoString(insertPrefix, ") VALUES ");
+
+	return insertPrefix->data;
+}
+
+
+/*
+ * InsertRowValues returns the parenthesized values of a row of the multi-row
+ * INSERT from the constants in the given target list.
+ */
+static char *
+InsertRowValues(List *targetList)
+{
+	StringInfo rowValues = makeStringInfo();
+	bool forceprefix = false;
+	bool showimplicit = false;
+	bool firstColumn = true;
+
+	appendStringInfoChar(rowValues, '(');
+
+	TargetEntry *targetEntry = NULL;
+	foreach_ptr(targetEntry, targetList)
+	{
+		char *value = deparse_expression((Node *) targetEntry->expr, NIL,
+										 forceprefix, showimplicit);
+
+		appendStringInfo(rowValues, "%s%s", firstColumn ? "" : ", ", value);
+		firstColumn = false;
+	}
+
+	appendStringInfoChar(rowValues, ')');
+
+	return rowValues->data;
+}
+
+
+/*
+ * FindInsertBuffer returns the buffer of the given shard, entering it into
+ * the hash if it does not exist yet.
+ */
+static InsertBuffer *
+FindInsertBuffer(uint64 shardId, bool *found)
+{
+	if (InsertBufferHash == NULL)
+	{
+		HASHCTL info;
+
+		memset(&info, 0, sizeof(info));
+		info.keysize = sizeof(uint64);
+		info.entrysize = sizeof(InsertBuffer);
+		info.hcxt = TopTransactionContext;
+		int hashFlags = (HASH_ELEM | HASH_BLOBS | HASH_CONTEXT);
+
+		InsertBufferHash = hash_create("Citus Insert Buffer Hash", 32, &info,
+									   hashFlags);
+	}
+
+	return (InsertBuffer *) hash_search(InsertBufferHash, &shardId, HASH_ENTER,
+										found);
+}
+
+
+/*
+ * FlushBufferedInserts sends the rows in all the buffers to the shards, with
+ * a single multi-row INSERT per shard. It is called before anything else
+ * may read or modify the shards with buffered rows.
+ */
+void
+FlushBufferedInserts(void)
+{
+	HASH_SEQ_STATUS status;
+	List *insertBufferList = NIL;
+
+	if (InsertBufferHash == NULL || FlushingInsertBuffers)
+	{
+		return;
+	}
+
+	hash_seq_init(&status, InsertBufferHash);
+
+	InsertBuffer *insertBuffer = NULL;
+	while ((insertBuffer = (InsertBuffer *) hash_seq_search(&status)) != NULL)
+	{
+		insertBufferList = lappend(insertBufferList, insertBuffer);
+	}
+
+	FlushInsertBufferList(insertBufferList);
+}
+
+
+/*
+ * FlushInsertBufferList sends the rows in the given buffers to their shards
+ * in parallel and removes the buffers.
+ */
+static void
+FlushInsertBufferList(List *insertBufferList)
+{
+	List *taskList = NIL;
+
+	if (insertBufferList == NIL)
+	{
+		return;
+	}
+
+	InsertBuffer *insertBuffer = NULL;
+	foreach_ptr(insertBuffer, insertBufferList)
+	{
+		ereport(DEBUG1, (errmsg("sending %d buffered rows to shard " UINT64_FORMAT,
+								insertBuffer->rowCount, insertBuffer->shardId)));
+
+		taskList = lappend(taskList, InsertBufferTask(insertBuffer));
+	}
+
+	/* the buffers are gone once the tasks are built, even if the flush fails */
+	foreach_ptr(insertBuffer, insertBufferList)
+	{
+		hash_search(InsertBufferHash, &insertBuffer->shardId, HASH_REMOVE, NULL);
+	}
+
+	FlushingInsertBuffers = true;
+
+	PG_TRY();
+	{
+		ExecuteTaskList(ROW_MODIFY_COMMUTATIVE, taskList, MaxAdaptiveExecutorPoolSize);
+	}
+	PG_CATCH();
+	{
+		FlushingInsertBuffers = false;
+		PG_RE_THROW();
+	}
+	PG_END_TRY();
+
+	FlushingInsertBuffers = false;
+}
+
+
+/*
+ * InsertBufferTask returns a task that inserts the rows of the given buffer
+ * into its shard with a single multi-row INSERT.
+ */
+static Task *
+InsertBufferTask(InsertBuffer *insertBuffer)
+{
+	StringInfo queryString = makeStringInfo();
+
+	appendStringInfoString(queryString, insertBuffer->insertPrefix);
+	appendStringInfoString(queryString, insertBuffer->rowValues->data);
+
+	Task *task = copyObject(insertBuffer->task);
+	SetTaskQueryString(task, queryString->data);
+	task->parametersInQueryStringResolved = true;
+
+	return task;
+}
+
+
+/*
+ * BufferedInsertsAtSubXactCommit moves the buffered rows of the committed
+ * subtransaction to its parent.
+ */
+void
+BufferedInsertsAtSubXactCommit(void)
+{
+	HASH_SEQ_STATUS status;
+	int nestLevel = GetCurrentTransactionNestLevel();
+
+	if (InsertBufferHash == NULL)
+	{
+		return;
+	}
+
+	hash_seq_init(&status, InsertBufferHash);
+
+	InsertBuffer *insertBuffer = NULL;
+	while ((insertBuffer = (InsertBuffer *) hash_seq_search(&status)) != NULL)
+	{
+		if (insertBuffer->nestLevel >= nestLevel)
+		{
+			insertBuffer->nestLevel = nestLevel - 1;
+		}
+	}
+}
+
+
+/*
+ * BufferedInsertsAtSubXactAbort discards the rows that were buffered in the
+ * aborted subtransaction, since they were never sent.
+ */
+void
+BufferedInsertsAtSubXactAbort(void)
+{
+	HASH_SEQ_STATUS status;
+	int nestLevel = GetCurrentTransactionNestLevel();
+
+	if (InsertBufferHash == NULL)
+	{
+		return;
+	}
+
+	hash_seq_init(&status, InsertBufferHash);
+
+	InsertBuffer *insertBuffer = NULL;
+	while ((insertBuffer = (InsertBuffer *) hash_seq_search(&status)) != NULL)
+	{
+		if (insertBuffer->nestLevel >= nestLevel)
+		{
+			/* removing the current entry does not affect the scan */
+			hash_search(InsertBufferHash, &insertBuffer->shardId, HASH_REMOVE, NULL);
+		}
+	}
+}
+
+
+/*
+ * ResetInsertBuffers forgets the buffers at the end of the transaction. Their
+ * memory is freed along with TopTransactionContext.
+ */
+void
+ResetInsertBuffers(void)
+{
+	InsertBufferHash = NULL;
+	FlushingInsertBuffers = false;
+}
@@ -14,6 +14,7 @@
 #include "distributed/citus_ruleutils.h"
 #include "distributed/commands/multi_copy.h"
 #include "distributed/adaptive_executor.h"
+#include "distributed/command_progress.h"
 #include "distributed/deparse_shard_query.h"
 #include "distributed/distributed_execution_locks.h"
 #include "distributed/insert_select_executor.h"
@@ -52,6 +53,7 @@
 
 /* Config variables managed via guc.c */
 bool EnableRepartitionedInsertSelect = true;
+int InsertSelectBatchSize = 0;
 
 /* depth of current insert/select executor. */
 static int insertSelectExecutorLevel = 0;
@@ -68,6 +70,17 @@ static HTAB * ExecutePlanIntoColocatedIntermediateResults(Oid targetRelationId,
 														  PlannedStmt *selectPlan,
 														  EState *executorState,
 														  char *intermediateResultIdPrefix);
+static void ExecutePlanInBatchesIntoRelation(CitusScanState *scanState,
+											 Oid targetRelationId,
+											 Query *insertSelectQuery,
+											 PlannedStmt *selectPlan,
+											 EState *executorState,
+											 char *intermediateResultIdPrefix);
+static void ExecuteIntermediateResultInsertTasks(CitusScanState *scanState,
+												 Oid targetRelationId,
+												 Query *insertSelectQuery,
+												 char *intermediateResultIdPrefix,
+												 HTAB *shardStateHash);
 static List * BuildColumnNameListFromTargetList(Oid targetRelationId,
 												List *insertTargetList);
 static int PartitionColumnIndexFromColumnList(Oid relationId, List *columnNameList);
@@ -82,6 +95,7 @@ static Expr * CastExpr(Expr *expr, Oid sourceType, Oid targetType, Oid targetCol
 					   int targetTypeMod);
 static void WrapTaskListForProjection(List *taskList, List *projectedTargetEntries);
 static void RelableTargetEntryList(List *selectTargetList, List *insertTargetList);
+static CommandProgress * StartInsertSelectProgress(Oid targetRelationId);
 
 
 /*
@@ -197,6 +211,9 @@ CoordinatorInsertSelectExecScanInternal(CustomScanState *node)
 
 			ExecuteSubPlans(distSelectPlan);
 
+			/* rewrite the tasks before they are wrapped in other queries */
+			distSelectTaskList = InlineIntermediateResultsInJob(distSelectJob);
+
 			/*
 			 * We have a separate directory for each transaction, so choosing
 			 * the same result prefix won't cause filename conflicts. Results
@@ -251,6 +268,9 @@ CoordinatorInsertSelectExecScanInternal(CustomScanState *node)
 				WrapTaskListForProjection(distSelectTaskList, projectedTargetEntries);
 			}
 
+			/* show the progress of the phases in citus_command_progress */
+			CommandProgress *progress = StartInsertSelectProgress(targetRelationId);
+
 			List **redistributedResults = RedistributeTaskListResults(distResultPrefix,
 																	  distSelectTaskList,
 																	  partitionColumnIndex,
@@ -271,12 +291,27 @@ CoordinatorInsertSelectExecScanInternal(CustomScanState *node)
 			scanState->tuplestorestate =
 				tuplestore_begin_heap(randomAccess, interTransactions, work_mem);
 
+			CommandProgressStep *insertStep =
+				CommandProgressStepById(progress, COMMAND_PROGRESS_STEP_INSERT, 0);
+			if (insertStep != NULL)
+			{
+				insertStep->tasksTotal = list_length(taskList);
+			}
+
 			uint64 rowsInserted = ExtractAndExecuteLocalAndRemoteTasks(scanState,
 																	   taskList,
 																	   ROW_MODIFY_COMMUTATIVE,
 																	   hasReturning);
 
 			executorState->es_processed = rowsInserted;
+
+			if (insertStep != NULL)
+			{
+				insertStep->tasksDone = insertStep->tasksTotal;
+				insertStep->rowCount = rowsInserted;
+			}
+
+			FinishCommandProgress(progress);
 		}
 		else if (insertSelectQuery->onConflict || hasReturning)
 		{
@@ -290,55 +325,31 @@ CoordinatorInsertSelectExecScanInternal(CustomScanState *node)
 			 * distributed INSERT...SELECT from a set of intermediate results
 			 * to the target relation.
 			 */
-			List *prunedTaskList = NIL;
-
-			shardStateHash = ExecutePlanIntoColocatedIntermediateResults(
-				targetRelationId,
-				insertTargetList,
-				selectPlan,
-				executorState,
-				intermediateResultIdPrefix);
-
-			/* generate tasks for the INSERT..SELECT phase */
-			List *taskList = TwoPhaseInsertSelectTaskList(targetRelationId,
-														  insertSelectQuery,
-														  intermediateResultIdPrefix);
-
-			/*
-			 * We cannot actually execute INSERT...SELECT tasks that read from
-			 * intermediate results that weren't created because no rows were
-			 * written to them. Prune those tasks out by only including tasks
-			 * on shards with connections.
-			 */
-			Task *task = NULL;
-			foreach_ptr(task, taskList)
+			if (InsertSelectBatchSize > 0)
+			{
+				ExecutePlanInBatchesIntoRelation(scanState, targetRelationId,
+												 insertSelectQuery, selectPlan,
+												 executorState,
+												 intermediateResultIdPrefix);
+			}
+			else
 			{
-				uint64 shardId = task->anchorShardId;
-				bool shardModified = false;
-
-				hash_search(shardStateHash, &shardId, HASH_FIND, &shardModified);
-				if (shardModified)
-				{
-					prunedTaskList = lappend(prunedTaskList, task);
-				}
+				shardStateHash = ExecutePlanIntoColocatedIntermediateResults(
+					targetRelationId,
+					insertTargetList,
+					selectPlan,
+					executorState,
+					intermediateResultIdPrefix);
+
+				ExecuteIntermediateResultInsertTasks(scanState, targetRelationId,
+													 insertSelectQuery,
+													 intermediateResultIdPrefix,
+													 shardStateHash);
 			}
 
-			if (prunedTaskList != NIL)
+			if (scanState->tuplestorestate != NULL && SortReturning && hasReturning)
 			{
-				bool randomAccess = true;
-				bool interTransactions = false;
-
-				Assert(scanState->tuplestorestate == NULL);
-				scanState->tuplestorestate =
-					tuplestore_begin_heap(randomAccess, interTransactions, work_mem);
-				ExtractAndExecuteLocalAndRemoteTasks(scanState, prunedTaskList,
-													 ROW_MODIFY_COMMUTATIVE,
-													 hasReturning);
-
-				if (SortReturning && hasReturning)
-				{
-					SortTupleStore(scanState);
-				}
+				SortTupleStore(scanState);
 			}
 		}
 		else
@@ -359,6 +370,39 @@ CoordinatorInsertSelectExecScanInternal(CustomScanState *node)
 }
 
 
+/*
+ * StartInsertSelectProgress creates a progress monitor for a repartitioned
+ * INSERT..SELECT into the given table, with a step for each of its phases:
+ * partitioning the results of the SELECT on the workers, fetching the
+ * fragments to the nodes of the target shards, and inserting them into the
+ * target shards. It returns NULL if the progress is not monitored.
+ */
+static CommandProgress *
+StartInsertSelectProgress(Oid targetRelationId)
+{
+	CommandProgressStepType stepTypes[] = {
+		COMMAND_PROGRESS_STEP_PARTITION,
+		COMMAND_PROGRESS_STEP_FETCH,
+		COMMAND_PROGRESS_STEP_INSERT
+	};
+	int stepCount = lengthof(stepTypes);
+
+	CommandProgress *progress = StartCommandProgress(INSERT_SELECT_PROGRESS_MAGIC_NUMBER,
+													 targetRelationId, stepCount);
+	if (progress == NULL)
+	{
+		return NULL;
+	}
+
+	for (int stepIndex = 0; stepIndex < stepCount; stepIndex++)
+	{
+		progress->steps[stepIndex].stepType = stepTypes[stepIndex];
+	}
+
+	return progress;
+}
+
+
 /*
  * BuildSelectForInsertSelect extracts the SELECT part from an INSERT...SELECT query.
  * If the INSERT...SELECT has CTEs then these are added to the resulting SELECT instead.
@@ -587,6 +631,152 @@ ExecutePlanIntoColocatedIntermediateResults(Oid targetRelationId,
 }
 
 
+/*
+ * ExecutePlanInBatchesIntoRelation executes the given plan in batches of
+ * citus.insert_select_batch_size rows, and inserts each batch into the target
+ * relation before reading the next one. Like in the unbatched case, the rows
+ * of a batch are first written to intermediate results that are colocated
+ * with the target shards, and then inserted by the INSERT..SELECT tasks of
+ * the shards that received rows. The intermediate results of a shard are
+ * overwritten by the next batch, so they never hold more than a batch.
+ *
+ * The rows returned by RETURNING are added to the tuple store of the scan.
+ */
+static void
+ExecutePlanInBatchesIntoRelation(CitusScanState *scanState, Oid targetRelationId,
+								 Query *insertSelectQuery, PlannedStmt *selectPlan,
+								 EState *executorState, char *intermediateResultIdPrefix)
+{
+	ParamListInfo paramListInfo = executorState->es_param_list_info;
+	List *insertTargetList = insertSelectQuery->targetList;
+	bool stopOnFailure = false;
+	int eflags = 0;
+	uint64 rowsSent = 0;
+
+	char partitionMethod = PartitionMethod(targetRelationId);
+	if (partitionMethod == DISTRIBUTE_BY_NONE)
+	{
+		stopOnFailure = true;
+	}
+
+	/* Get column name list and partition column index for the target table */
+	List *columnNameList = BuildColumnNameListFromTargetList(targetRelationId,
+															 insertTargetList);
+	int partitionColumnIndex = PartitionColumnIndexFromColumnList(targetRelationId,
+																  columnNameList);
+
+	/* create a new portal from which we fetch the rows a batch at a time */
+	Portal portal = CreateNewPortal();
+
+	/* don't display the portal in pg_cursors, it is for internal use only */
+	portal->visible = false;
+
+	PortalDefineQuery(portal,
+					  NULL,
+					  "",
+					  "SELECT",
+					  list_make1(selectPlan),
+					  NULL);
+
+	PortalStart(portal, paramListInfo, eflags, GetActiveSnapshot());
+
+	while (true)
+	{
+		/* set up a DestReceiver that copies the batch into the intermediate results */
+		CitusCopyDestReceiver *copyDest =
+			CreateCitusCopyDestReceiver(targetRelationId, columnNameList,
+										partitionColumnIndex, executorState,
+										stopOnFailure, intermediateResultIdPrefix);
+
+		uint64 batchRowCount = PortalRunFetch(portal, FETCH_FORWARD,
+											  InsertSelectBatchSize,
+											  (DestReceiver *) copyDest);
+		if (batchRowCount == 0)
+		{
+			break;
+		}
+
+		rowsSent += copyDest->tuplesSent;
+
+		XactModificationLevel = XACT_MODIFICATION_DATA;
+
+		ExecuteIntermediateResultInsertTasks(scanState, targetRelationId,
+											 insertSelectQuery,
+											 intermediateResultIdPrefix,
+											 copyDest->shardStateHash);
+
+		/* a short batch means the SELECT has no more rows */
+		if (batchRowCount < (uint64) InsertSelectBatchSize)
+		{
+			break;
+		}
+	}
+
+	PortalDrop(portal, false);
+
+	executorState->es_processed = rowsSent;
+}
+
+
+/*
+ * ExecuteIntermediateResultInsertTasks inserts the intermediate results with
+ * the given prefix into the shards of the target relation, and adds the rows
+ * returned by RETURNING to the tuple store of the scan. shardStateHash holds
+ * the shards to which rows were copied.
+ */
+static void
+ExecuteIntermediateResultInsertTasks(CitusScanState *scanState, Oid targetRelationId,
+									 Query *insertSelectQuery,
+									 char *intermediateResultIdPrefix,
+									 HTAB *shardStateHash)
+{
+	DistributedPlan *distributedPlan = scanState->distributedPlan;
+	bool hasReturning = distributedPlan->hasReturning;
+	List *prunedTaskList = NIL;
+
+	/* generate tasks for the INSERT..SELECT phase */
+	List *taskList = TwoPhaseInsertSelectTaskList(targetRelationId,
+												  insertSelectQuery,
+												  intermediateResultIdPrefix);
+
+	/*
+	 * We cannot actually execute INSERT...SELECT tasks that read from
+	 * intermediate results that weren't created because no rows were
+	 * written to them. Prune those tasks out by only including tasks
+	 * on shards with connections.
+	 */
+	Task *task = NULL;
+	foreach_ptr(task, taskList)
+	{
+		uint64 shardId = task->anchorShardId;
+		bool shardModified = false;
+
+		hash_search(shardStateHash, &shardId, HASH_FIND, &shardModified);
+		if (shardModified)
+		{
+			prunedTaskList = lappend(prunedTaskList, task);
+		}
+	}
+
+	if (prunedTaskList == NIL)
+	{
+		return;
+	}
+
+	if (scanState->tuplestorestate == NULL)
+	{
+		bool randomAccess = true;
+		bool interTransactions = false;
+
+		scanState->tuplestorestate =
+			tuplestore_begin_heap(randomAccess, interTransactions, work_mem);
+	}
+
+	ExtractAndExecuteLocalAndRemoteTasks(scanState, prunedTaskList,
+										 ROW_MODIFY_COMMUTATIVE, hasReturning);
+}
+
+
 /*
  * ExecutePlanIntoRelation executes the given plan and inserts the
  * results into the target relation, which is assumed to be a distributed
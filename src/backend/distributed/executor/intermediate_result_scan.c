@@ -0,0 +1,510 @@
+/*-------------------------------------------------------------------------
+ *
+ * intermediate_result_scan.c
+ *    Parallel scan of binary intermediate result files.
+ *
+ *    read_intermediate_result and read_intermediate_results are set returning
+ *    functions, and a function scan always returns all rows of the function.
+ *    A query that joins a large intermediate result with a shard therefore
+ *    only gets a parallel plan in which every parallel worker reads the whole
+ *    result. For results in binary format, the planner is also offered a
+ *    partial path that divides the rows among the processes of a parallel
+ *    query, which then only parse the fields of their own rows.
+ *
+ *    The processes claim chunks of consecutive rows through a counter in the
+ *    dynamic shared memory of the parallel query. Each process walks over all
+ *    records of the files, which only requires reading the field lengths, and
+ *    converts the records of the chunks it claims.
+ *
+ * Copyright (c) Citus Data, Inc.
+ *-------------------------------------------------------------------------
+ */
+
+#include "postgres.h"
+
+#include "miscadmin.h"
+
+#include "access/parallel.h"
+#include "catalog/pg_type.h"
+#include "distributed/intermediate_result_scan.h"
+#include "distributed/intermediate_results.h"
+#include "executor/executor.h"
+#include "nodes/makefuncs.h"
+#include "nodes/nodeFuncs.h"
+#if PG_VERSION_NUM >= 120000
+#include "optimizer/optimizer.h"
+#endif
+#include "optimizer/cost.h"
+#include "optimizer/pathnode.h"
+#include "optimizer/paths.h"
+#include "optimizer/planmain.h"
+#include "optimizer/restrictinfo.h"
+#include "port/atomics.h"
+#include "utils/array.h"
+#include "utils/tuplestore.h"
+
+
+/* number of consecutive rows that a process of a parallel scan claims at once */
+#define PARALLEL_SCAN_CHUNK_ROWS 4096
+
+
+/*
+ * ParallelIntermediateResultScanShared is the state of a parallel scan in
+ * dynamic shared memory.
+ */
+typedef struct ParallelIntermediateResultScanShared
+{
+	/* next chunk of rows that is not claimed by any process */
+	pg_atomic_uint64 nextChunk;
+} ParallelIntermediateResultScanShared;
+
+
+/*
+ * IntermediateResultScanState is the execution state of a parallel scan of
+ * intermediate results in one of its processes.
+ */
+typedef struct IntermediateResultScanState
+{
+	CustomScanState customScanState;
+
+	/* arguments of the read_intermediate_result(s) call */
+	List *argumentStates;
+
+	/* rows of the chunks that this process claimed, read on the first fetch */
+	Tuplestorestate *tupleStore;
+
+	/* shared state, NULL if the scan is not executed by a parallel query */
+	ParallelIntermediateResultScanShared *sharedState;
+
+	/* rows of the chunk that this process claimed last */
+	uint64 claimedRowStart;
+	uint64 claimedRowEnd;
+} IntermediateResultScanState;
+
+
+/* GUC, whether reading intermediate results can use parallel workers */
+bool EnableParallelIntermediateResultScan = true;
+
+
+static double ParallelDivisor(int parallelWorkers);
+static Plan * PlanParallelIntermediateResultScan(PlannerInfo *root, RelOptInfo *rel,
+												 CustomPath *bestPath, List *targetList,
+												 List *clauses, List *customPlans);
+static Node * ParallelIntermediateResultCreateScan(CustomScan *scan);
+static void ParallelIntermediateResultBeginScan(CustomScanState *node, EState *estate,
+												int eflags);
+static TupleTableSlot * ParallelIntermediateResultExecScan(CustomScanState *node);
+static TupleTableSlot * ParallelIntermediateResultScanNext(ScanState *node);
+static bool ParallelIntermediateResultScanRecheck(ScanState *node, TupleTableSlot *slot);
+static void ReadClaimedIntermediateResultRows(IntermediateResultScanState *scanState);
+static bool ClaimIntermediateResultRow(uint64 rowIndex, void *context);
+static void ParallelIntermediateResultEndScan(CustomScanState *node);
+static void ParallelIntermediateResultReScan(CustomScanState *node);
+static Size ParallelIntermediateResultEstimateDSM(CustomScanState *node,
+												  ParallelContext *pcxt);
+static void ParallelIntermediateResultInitializeDSM(CustomScanState *node,
+													ParallelContext *pcxt,
+													void *coordinate);
+static void ParallelIntermediateResultReInitializeDSM(CustomScanState *node,
+													  ParallelContext *pcxt,
+													  void *coordinate);
+static void ParallelIntermediateResultInitializeWorker(CustomScanState *node,
+													   shm_toc *toc,
+													   void *coordinate);
+
+
+static CustomPathMethods ParallelIntermediateResultPathMethods = {
+	.CustomName = "ParallelIntermediateResultPath",
+	.PlanCustomPath = PlanParallelIntermediateResultScan,
+};
+
+CustomScanMethods ParallelIntermediateResultScanMethods = {
+	"Citus Parallel Intermediate Result",
+	ParallelIntermediateResultCreateScan
+};
+
+static CustomExecMethods ParallelIntermediateResultExecMethods = {
+	.CustomName = "ParallelIntermediateResultScan",
+	.BeginCustomScan = ParallelIntermediateResultBeginScan,
+	.ExecCustomScan = ParallelIntermediateResultExecScan,
+	.EndCustomScan = ParallelIntermediateResultEndScan,
+	.ReScanCustomScan = ParallelIntermediateResultReScan,
+	.EstimateDSMCustomScan = ParallelIntermediateResultEstimateDSM,
+	.InitializeDSMCustomScan = ParallelIntermediateResultInitializeDSM,
+	.ReInitializeDSMCustomScan = ParallelIntermediateResultReInitializeDSM,
+	.InitializeWorkerCustomScan = ParallelIntermediateResultInitializeWorker
+};
+
+
+/*
+ * AddParallelIntermediateResultScanPath adds a partial path to the relation
+ * of a read_intermediate_result(s) call on binary results with constant
+ * arguments, if the results are large enough for parallel workers. The costs
+ * are those that AdjustReadIntermediateResultsCostInternal estimated for the
+ * function scan, where every process reads the files, but only parses its
+ * share of the rows.
+ */
+void
+AddParallelIntermediateResultScanPath(RelOptInfo *relOptInfo, double rowCount,
+									  int64 totalResultSize, Cost startupCost,
+									  Cost rowCost, Cost ioCost)
+{
+	if (!EnableParallelIntermediateResultScan || !relOptInfo->consider_parallel)
+	{
+		return;
+	}
+
+	/* parameterized paths are not supported */
+	if (relOptInfo->lateral_relids != NULL)
+	{
+		return;
+	}
+
+	double resultPages = (double) Max(totalResultSize, 0) / BLCKSZ;
+	int parallelWorkers = compute_parallel_worker(relOptInfo, resultPages, -1,
+												  max_parallel_workers_per_gather);
+	if (parallelWorkers <= 0)
+	{
+		return;
+	}
+
+	double parallelDivisor = ParallelDivisor(parallelWorkers);
+
+	CustomPath *customPath = makeNode(CustomPath);
+	customPath->path.pathtype = T_CustomScan;
+	customPath->path.parent = relOptInfo;
+	customPath->path.pathtarget = relOptInfo->reltarget;
+	customPath->path.param_info = NULL;
+	customPath->path.parallel_aware = true;
+	customPath->path.parallel_safe = true;
+	customPath->path.parallel_workers = parallelWorkers;
+	customPath->path.rows = clamp_row_est(rowCount / parallelDivisor);
+	customPath->path.startup_cost = startupCost;
+	customPath->path.total_cost = startupCost + ioCost +
+								  rowCount * rowCost / parallelDivisor;
+	customPath->path.pathkeys = NIL;
+	customPath->methods = &ParallelIntermediateResultPathMethods;
+
+	add_partial_path(relOptInfo, (Path *) customPath);
+}
+
+
+/*
+ * ParallelDivisor returns the number of processes among which a parallel query
+ * divides the rows, in the same way as the cost model of the planner.
+ */
+static double
+ParallelDivisor(int parallelWorkers)
+{
+	double parallelDivisor = parallelWorkers;
+
+	if (parallel_leader_participation)
+	{
+		double leaderContribution = 1.0 - (0.3 * parallelWorkers);
+
+		if (leaderContribution > 0)
+		{
+			parallelDivisor += leaderContribution;
+		}
+	}
+
+	return parallelDivisor;
+}
+
+
+/*
+ * PlanParallelIntermediateResultScan creates the custom scan plan for a
+ * parallel intermediate result path. The plan does not scan a relation of the
+ * range table, so the columns of the function are described by the scan
+ * target list, and the arguments of the function are kept in custom_exprs.
+ */
+static Plan *
+PlanParallelIntermediateResultScan(PlannerInfo *root, RelOptInfo *rel,
+								   CustomPath *bestPath, List *targetList,
+								   List *clauses, List *customPlans)
+{
+	RangeTblEntry *rangeTableEntry = planner_rt_fetch(rel->relid, root);
+	RangeTblFunction *rangeTableFunction =
+		(RangeTblFunction *) linitial(rangeTableEntry->functions);
+	FuncExpr *funcExpression = (FuncExpr *) rangeTableFunction->funcexpr;
+	List *scanTargetList = NIL;
+	AttrNumber columnNumber = 1;
+	ListCell *typeCell = NULL;
+	ListCell *typeModCell = NULL;
+	ListCell *collationCell = NULL;
+
+	forthree(typeCell, rangeTableFunction->funccoltypes,
+			 typeModCell, rangeTableFunction->funccoltypmods,
+			 collationCell, rangeTableFunction->funccolcollations)
+	{
+		Var *column = makeVar(rel->relid, columnNumber, lfirst_oid(typeCell),
+							  lfirst_int(typeModCell), lfirst_oid(collationCell), 0);
+		TargetEntry *targetEntry = makeTargetEntry((Expr *) column, columnNumber,
+												   NULL, false);
+
+		scanTargetList = lappend(scanTargetList, targetEntry);
+		columnNumber++;
+	}
+
+	CustomScan *customScan = makeNode(CustomScan);
+	customScan->methods = &ParallelIntermediateResultScanMethods;
+	customScan->flags = bestPath->flags;
+	customScan->scan.scanrelid = 0;
+	customScan->scan.plan.targetlist = targetList;
+	customScan->scan.plan.qual = extract_actual_clauses(clauses, false);
+	customScan->custom_scan_tlist = scanTargetList;
+	customScan->custom_exprs = copyObject(funcExpression->args);
+
+	return (Plan *) customScan;
+}
+
+
+/*
+ * ParallelIntermediateResultCreateScan creates the execution state of a
+ * parallel intermediate result scan.
+ */
+static Node *
+ParallelIntermediateResultCreateScan(CustomScan *scan)
+{
+	IntermediateResultScanState *scanState = palloc0(sizeof(IntermediateResultScanState));
+
+	scanState->customScanState.ss.ps.type = T_CustomScanState;
+	scanState->customScanState.methods = &ParallelIntermediateResultExecMethods;
+
+	return (Node *) scanState;
+}
+
+
+/*
+ * ParallelIntermediateResultBeginScan prepares the arguments of the function
+ * for evaluation. The files are only read on the first fetch, at which point
+ * the shared state of a parallel query is set up.
+ */
+static void
+ParallelIntermediateResultBeginScan(CustomScanState *node, EState *estate, int eflags)
+{
+	IntermediateResultScanState *scanState = (IntermediateResultScanState *) node;
+	CustomScan *customScan = (CustomScan *) node->ss.ps.plan;
+
+	scanState->argumentStates = ExecInitExprList(customScan->custom_exprs,
+												 (PlanState *) node);
+}
+
+
+/*
+ * ParallelIntermediateResultExecScan returns the next row of the scan.
+ */
+static TupleTableSlot *
+ParallelIntermediateResultExecScan(CustomScanState *node)
+{
+	return ExecScan(&node->ss, (ExecScanAccessMtd) ParallelIntermediateResultScanNext,
+					(ExecScanRecheckMtd) ParallelIntermediateResultScanRecheck);
+}
+
+
+/*
+ * ParallelIntermediateResultScanNext returns the next row that this process
+ * read, or an empty slot when it returned all of them.
+ */
+static TupleTableSlot *
+ParallelIntermediateResultScanNext(ScanState *node)
+{
+	IntermediateResultScanState *scanState = (IntermediateResultScanState *) node;
+	TupleTableSlot *scanSlot = node->ss_ScanTupleSlot;
+
+	if (scanState->tupleStore == NULL)
+	{
+		ReadClaimedIntermediateResultRows(scanState);
+	}
+
+	tuplestore_gettupleslot(scanState->tupleStore, true, false, scanSlot);
+
+	return scanSlot;
+}
+
+
+/*
+ * ParallelIntermediateResultScanRecheck is only called for EvalPlanQual, which
+ * does not apply to intermediate results.
+ */
+static bool
+ParallelIntermediateResultScanRecheck(ScanState *node, TupleTableSlot *slot)
+{
+	return true;
+}
+
+
+/*
+ * ReadClaimedIntermediateResultRows evaluates the arguments of the function
+ * and reads the rows of the chunks that this process claims into a tuple
+ * store.
+ */
+static void
+ReadClaimedIntermediateResultRows(IntermediateResultScanState *scanState)
+{
+	CustomScanState *node = &scanState->customScanState;
+	CustomScan *customScan = (CustomScan *) node->ss.ps.plan;
+	ExprContext *expressionContext = node->ss.ps.ps_ExprContext;
+	TupleDesc tupleDescriptor = node->ss.ss_ScanTupleSlot->tts_tupleDescriptor;
+	ExprState *resultIdState = (ExprState *) linitial(scanState->argumentStates);
+	Expr *resultIdExpression = (Expr *) linitial(customScan->custom_exprs);
+	Datum *resultIdArray = NULL;
+	int resultCount = 0;
+	bool isNull = false;
+
+	MemoryContext oldContext =
+		MemoryContextSwitchTo(expressionContext->ecxt_per_query_memory);
+
+	scanState->tupleStore = tuplestore_begin_heap(false, false, work_mem);
+
+	Datum resultIdDatum = ExecEvalExpr(resultIdState, expressionContext, &isNull);
+	if (isNull)
+	{
+		/* the functions are strict */
+		tuplestore_donestoring(scanState->tupleStore);
+		MemoryContextSwitchTo(oldContext);
+		return;
+	}
+
+	if (exprType((Node *) resultIdExpression) == TEXTARRAYOID)
+	{
+		deconstruct_array(DatumGetArrayTypeP(resultIdDatum), TEXTOID, -1, false, 'i',
+						  &resultIdArray, NULL, &resultCount);
+	}
+	else
+	{
+		resultIdArray = palloc0(sizeof(Datum));
+		resultIdArray[0] = resultIdDatum;
+		resultCount = 1;
+	}
+
+	ReadBinaryIntermediateResultsIntoTupleStore(resultIdArray, resultCount,
+												tupleDescriptor, scanState->tupleStore,
+												ClaimIntermediateResultRow, scanState);
+
+	MemoryContextSwitchTo(oldContext);
+}
+
+
+/*
+ * ClaimIntermediateResultRow returns whether the row at the given position
+ * belongs to a chunk that this process claimed. Rows are passed in order, so
+ * when a row is past the last claimed chunk the process claims the next
+ * unclaimed chunk, which never starts before the row.
+ */
+static bool
+ClaimIntermediateResultRow(uint64 rowIndex, void *context)
+{
+	IntermediateResultScanState *scanState = (IntermediateResultScanState *) context;
+	ParallelIntermediateResultScanShared *sharedState = scanState->sharedState;
+
+	if (sharedState == NULL)
+	{
+		/* not in a parallel query, all rows are returned by this process */
+		return true;
+	}
+
+	if (rowIndex >= scanState->claimedRowEnd)
+	{
+		uint64 chunkIndex = pg_atomic_fetch_add_u64(&sharedState->nextChunk, 1);
+
+		scanState->claimedRowStart = chunkIndex * PARALLEL_SCAN_CHUNK_ROWS;
+		scanState->claimedRowEnd = scanState->claimedRowStart +
+								   PARALLEL_SCAN_CHUNK_ROWS;
+	}
+
+	return rowIndex >= scanState->claimedRowStart;
+}
+
+
+/*
+ * ParallelIntermediateResultEndScan releases the rows of the scan.
+ */
+static void
+ParallelIntermediateResultEndScan(CustomScanState *node)
+{
+	IntermediateResultScanState *scanState = (IntermediateResultScanState *) node;
+
+	if (scanState->tupleStore != NULL)
+	{
+		tuplestore_end(scanState->tupleStore);
+		scanState->tupleStore = NULL;
+	}
+}
+
+
+/*
+ * ParallelIntermediateResultReScan makes the next fetch read the files again,
+ * since the arguments of the function or the claims of a parallel scan may
+ * have changed.
+ */
+static void
+ParallelIntermediateResultReScan(CustomScanState *node)
+{
+	IntermediateResultScanState *scanState = (IntermediateResultScanState *) node;
+
+	ParallelIntermediateResultEndScan(node);
+
+	scanState->claimedRowStart = 0;
+	scanState->claimedRowEnd = 0;
+
+	ExecScanReScan(&node->ss);
+}
+
+
+/*
+ * ParallelIntermediateResultEstimateDSM returns the size of the shared state
+ * of a parallel scan.
+ */
+static Size
+ParallelIntermediateResultEstimateDSM(CustomScanState *node, ParallelContext *pcxt)
+{
+	return sizeof(ParallelIntermediateResultScanShared);
+}
+
+
+/*
+ * ParallelIntermediateResultInitializeDSM initializes the shared state of a
+ * parallel scan in the leader.
+ */
+static void
+ParallelIntermediateResultInitializeDSM(CustomScanState *node, ParallelContext *pcxt,
+										void *coordinate)
+{
+	IntermediateResultScanState *scanState = (IntermediateResultScanState *) node;
+	ParallelIntermediateResultScanShared *sharedState =
+		(ParallelIntermediateResultScanShared *) coordinate;
+
+	pg_atomic_init_u64(&sharedState->nextChunk, 0);
+
+	scanState->sharedState = sharedState;
+}
+
+
+/*
+ * ParallelIntermediateResultReInitializeDSM resets the shared state of a
+ * parallel scan before it is executed again.
+ */
+static void
+ParallelIntermediateResultReInitializeDSM(CustomScanState *node, ParallelContext *pcxt,
+										  void *coordinate)
+{
+	ParallelIntermediateResultScanShared *sharedState =
+		(ParallelIntermediateResultScanShared *) coordinate;
+
+	pg_atomic_write_u64(&sharedState->nextChunk, 0);
+}
+
+
+/*
+ * ParallelIntermediateResultInitializeWorker attaches a parallel worker to the
+ * shared state of a parallel scan.
+ */
+static void
+ParallelIntermediateResultInitializeWorker(CustomScanState *node, shm_toc *toc,
+										   void *coordinate)
+{
+	IntermediateResultScanState *scanState = (IntermediateResultScanState *) node;
+
+	scanState->sharedState = (ParallelIntermediateResultScanShared *) coordinate;
+}
@@ -7,6 +7,8 @@
  *
  *-------------------------------------------------------------------------
  */
+#include <arpa/inet.h> /* for ntohl and ntohs */
+#include <sys/mman.h>
 #include <sys/stat.h>
 #include <unistd.h>
 
@@ -20,7 +22,10 @@
 #include "commands/copy.h"
 #include "distributed/commands/multi_copy.h"
 #include "distributed/connection_management.h"
+#include "distributed/copy_compression.h"
+#include "distributed/intermediate_result_pruning.h"
 #include "distributed/intermediate_results.h"
+#include "distributed/job_cache_space.h"
 #include "distributed/listutils.h"
 #include "distributed/master_metadata_utility.h"
 #include "distributed/metadata_cache.h"
@@ -31,20 +36,124 @@
 #include "distributed/transaction_identifier.h"
 #include "distributed/tuplestore.h"
 #include "distributed/version_compat.h"
+#include "distributed/wait_sampling.h"
 #include "distributed/worker_protocol.h"
 #include "nodes/makefuncs.h"
 #include "nodes/parsenodes.h"
 #include "nodes/primnodes.h"
 #include "storage/fd.h"
+#include "storage/latch.h"
+#include "storage/proc.h"
 #include "tcop/tcopprot.h"
 #include "utils/builtins.h"
+#include "utils/guc.h"
 #include "utils/lsyscache.h"
 #include "utils/memutils.h"
 #include "utils/syscache.h"
 
 
+/* size of the buffer in which result data is collected before writing to a file */
+#define LOCAL_FILE_BUFFER_SIZE (1024 * 1024)
+
+
 static bool CreatedResultsDirectory = false;
 
+/* maximum total size in KB of result files whose decoded rows are kept */
+int MaxDecodedResultCacheSize = 0;
+
+/*
+ * DecodedResultFile is a result file that this backend read earlier in the
+ * current transaction, along with its decoded rows. Tasks of a distributed
+ * query that run over the same connection can then reuse the rows rather
+ * than parsing the file again.
+ */
+typedef struct DecodedResultFile
+{
+	char *resultId;
+	char *copyFormat;
+	TupleDesc tupleDescriptor;
+
+	/* status of the file when it was decoded, to detect that it changed */
+	struct stat fileStat;
+	size_t fileSize;
+
+	/* decoded rows, kept in memory */
+	Tuplestorestate *tupleStore;
+} DecodedResultFile;
+
+/* result files decoded in the current transaction, in TopTransactionContext */
+static List *DecodedResultFileList = NIL;
+static uint64 DecodedResultFileCacheSize = 0;
+
+/* signature at the start of a binary COPY file */
+static const char BinaryCopySignature[11] = "PGCOPY\n\377\r\n\0";
+
+/*
+ * MappedResultFile is a binary COPY file that is mapped into memory, along with
+ * the read position.
+ */
+typedef struct MappedResultFile
+{
+	char *data;
+	size_t size;
+	size_t offset;
+} MappedResultFile;
+
+/*
+ * BinaryResultReader holds the receive functions and buffers to convert the
+ * records of binary result files with the same columns. A read of many small
+ * result files, such as the fragments of a target shard, sets them up once
+ * rather than for every file.
+ */
+typedef struct BinaryResultReader
+{
+	TupleDesc tupleDescriptor;
+	Datum *columnValues;
+	bool *columnNulls;
+	FmgrInfo *receiveFunctions;
+	Oid *typeIOParams;
+
+	/*
+	 * memory context for the reader itself, including the state that receive
+	 * functions cache in their FmgrInfo
+	 */
+	MemoryContext readerContext;
+
+	/* memory context for the values of a single record */
+	MemoryContext tupleContext;
+} BinaryResultReader;
+
+/*
+ * ResultRowFilterState tracks the position of the next row across the result
+ * files that are read with a row filter.
+ */
+typedef struct ResultRowFilterState
+{
+	IntermediateResultRowFilter rowFilter;
+	void *filterContext;
+	uint64 rowIndex;
+} ResultRowFilterState;
+
+/* maximum number of connections fetch_intermediate_results opens to a node */
+int MaxIntermediateResultFetchConnections = 1;
+
+/*
+ * ResultFetchState tracks a connection over which fetch_intermediate_results
+ * fetches results in parallel, and the result it is currently fetching.
+ */
+typedef struct ResultFetchState
+{
+	MultiConnection *connection;
+
+	/* result that is being fetched, or NULL if the connection is done */
+	char *resultId;
+	File fileDesc;
+	FileCompat fileCompat;
+
+	/* buffer for the copy data that is written to the file */
+	StringInfo fileBuffer;
+} ResultFetchState;
+
 
 /* CopyDestReceiver can be used to stream results into a distributed table */
 typedef struct RemoteFileDestReceiver
@@ -67,23 +176,51 @@ typedef struct RemoteFileDestReceiver
 	List *initialNodeList;
 	List *connectionList;
 
-	/* whether to write to a local file */
+	/* whether to write to a local file, and the data that is yet to be written */
 	bool writeLocalFile;
 	FileCompat fileCompat;
+	StringInfo localFileBuffer;
 
 	/* state on how to copy out data types */
 	CopyOutState copyOutState;
 	FmgrInfo *columnOutputFunctions;
 
+	/*
+	 * When partitioning, rows are only sent to the nodes that have the shard
+	 * of the given hash-distributed table that the value of the partition
+	 * column hashes into. Each shard has a list of those connections.
+	 */
+	Oid partitionRelationId;
+	int partitionColumnIndex;
+	CitusTableCacheEntry *partitionTableEntry;
+	List **shardConnectionLists;
+
+	/* whether data is sent to the nodes in compressed frames */
+	bool compressData;
+
+	/* data that is yet to be compressed, and the frame to send */
+	StringInfo pendingData;
+	StringInfo compressedFrame;
+
 	/* number of tuples sent */
 	uint64 tuplesSent;
+
+	/* size of the data sent to each node, or in total when partitioning */
+	uint64 bytesSent;
 } RemoteFileDestReceiver;
 
 
 static void RemoteFileDestReceiverStartup(DestReceiver *dest, int operation,
 										  TupleDesc inputTupleDescriptor);
-static StringInfo ConstructCopyResultStatement(const char *resultId);
-static void WriteToLocalFile(StringInfo copyData, FileCompat *fileCompat);
+static StringInfo ConstructCopyResultStatement(const char *resultId, bool compressData);
+static List ** BuildShardConnectionLists(CitusTableCacheEntry *cacheEntry,
+										 List *nodeList, List *connectionList);
+static List * PartitionedRowConnectionList(RemoteFileDestReceiver *resultDest,
+										   Datum *columnValues, bool *columnNulls);
+static void SendResultData(RemoteFileDestReceiver *resultDest, StringInfo dataBuffer);
+static void FlushPendingResultData(RemoteFileDestReceiver *resultDest);
+static void WriteToLocalFile(RemoteFileDestReceiver *resultDest, StringInfo copyData);
+static void FlushLocalFileBuffer(RemoteFileDestReceiver *resultDest);
 static bool RemoteFileDestReceiverReceive(TupleTableSlot *slot, DestReceiver *dest);
 static void BroadcastCopyData(StringInfo dataBuffer, List *connectionList);
 static void SendCopyDataOverConnection(StringInfo dataBuffer,
@@ -92,14 +229,58 @@ static void RemoteFileDestReceiverShutdown(DestReceiver *destReceiver);
 static void RemoteFileDestReceiverDestroy(DestReceiver *destReceiver);
 
 static char * IntermediateResultsDirectory(void);
+static BinaryResultReader * CreateBinaryResultReader(TupleDesc tupleDescriptor);
+static void FreeBinaryResultReader(BinaryResultReader *reader);
+static void ReadBinaryResultFileIntoTupleStore(char *fileName,
+											   BinaryResultReader *reader,
+											   Tuplestorestate *tupleStore,
+											   ResultRowFilterState *filterState);
+static void ReadMappedBinaryCopyFile(MappedResultFile *file, BinaryResultReader *reader,
+									 Tuplestorestate *tupleStore,
+									 ResultRowFilterState *filterState);
+static void SkipMappedBinaryRecord(MappedResultFile *file, int columnCount);
+static bool ReadMappedInt16(MappedResultFile *file, int16 *value);
+static bool ReadMappedInt32(MappedResultFile *file, int32 *value);
+static Datum ReadMappedBinaryAttribute(MappedResultFile *file, FmgrInfo *receiveFunction,
+									   Oid typeIOParam, int32 typeMod, bool *isNull);
+static void ReadResultFileViaDecodedCache(char *resultId, char *fileName,
+										  struct stat *fileStat, char *copyFormat,
+										  BinaryResultReader *reader,
+										  TupleDesc tupleDescriptor,
+										  Tuplestorestate *tupleStore);
+static bool ResultFileUnchanged(struct stat *decodedStat, struct stat *fileStat);
+static DecodedResultFile * FindDecodedResultFile(char *resultId, char *copyFormat,
+												 TupleDesc tupleDescriptor);
+static DecodedResultFile * DecodeResultFile(char *resultId, char *fileName,
+											struct stat *fileStat, char *copyFormat,
+											BinaryResultReader *reader,
+											TupleDesc tupleDescriptor);
+static void RemoveDecodedResultFile(DecodedResultFile *decodedFile);
+static void ForgetDecodedResultFiles(const char *resultId);
+static void ReadResultFileIntoTupleStore(char *fileName, char *copyFormat,
+										 BinaryResultReader *reader,
+										 TupleDesc tupleDescriptor,
+										 Tuplestorestate *tupleStore);
+static void CopyTupleStoreRows(Tuplestorestate *sourceStore, TupleDesc tupleDescriptor,
+							   Tuplestorestate *targetStore);
 static void ReadIntermediateResultsIntoFuncOutput(FunctionCallInfo fcinfo,
 												  char *copyFormat,
 												  Datum *resultIdArray,
 												  int resultCount);
 static uint64 FetchRemoteIntermediateResult(MultiConnection *connection, char *resultId);
+static uint64 FetchRemoteIntermediateResultsInParallel(Datum *resultIdArray,
+													   int resultCount,
+													   char *remoteHost,
+													   int remotePort,
+													   int connectionCount);
+static File StartRemoteIntermediateResultFetch(MultiConnection *connection,
+											   char *resultId, bool decompress);
+static WaitEventSet * BuildResultFetchWaitEventSet(ResultFetchState *fetchStates,
+												   int fetchStateCount);
 static CopyStatus CopyDataFromConnection(MultiConnection *connection,
-										 FileCompat *fileCompat,
-										 uint64 *bytesReceived);
+										 FileCompat *fileCompat, StringInfo fileBuffer,
+										 uint64 *bytesReceived, bool decompress);
+static void WriteCopyDataToFile(FileCompat *fileCompat, StringInfo fileBuffer);
 
 /* exports for SQL callable functions */
 PG_FUNCTION_INFO_V1(read_intermediate_result);
@@ -217,11 +398,40 @@ CreateRemoteFileDestReceiver(const char *resultId, EState *executorState,
 	resultDest->initialNodeList = initialNodeList;
 	resultDest->memoryContext = CurrentMemoryContext;
 	resultDest->writeLocalFile = writeLocalFile;
+	resultDest->partitionRelationId = InvalidOid;
+	resultDest->partitionColumnIndex = -1;
 
 	return (DestReceiver *) resultDest;
 }
 
 
+/*
+ * CreatePartitionedRemoteFileDestReceiver creates a RemoteFileDestReceiver
+ * that sends each row only to the nodes in initialNodeList that have the shard
+ * of the given hash-distributed table into which the value of the column at
+ * partitionColumnIndex hashes.
+ *
+ * The result on a node is then incomplete, so it may only be used by tasks
+ * that join it with the same shard on the distribution column. The local file
+ * still gets all rows.
+ */
+DestReceiver *
+CreatePartitionedRemoteFileDestReceiver(const char *resultId, EState *executorState,
+										List *initialNodeList, bool writeLocalFile,
+										Oid partitionRelationId,
+										int partitionColumnIndex)
+{
+	DestReceiver *dest = CreateRemoteFileDestReceiver(resultId, executorState,
+													  initialNodeList, writeLocalFile);
+	RemoteFileDestReceiver *resultDest = (RemoteFileDestReceiver *) dest;
+
+	resultDest->partitionRelationId = partitionRelationId;
+	resultDest->partitionColumnIndex = partitionColumnIndex;
+
+	return dest;
+}
+
+
 /*
  * RemoteFileDestReceiverStartup implements the rStartup interface of
  * RemoteFileDestReceiver. It opens connections to the nodes in initialNodeList,
@@ -256,6 +466,15 @@ RemoteFileDestReceiverStartup(DestReceiver *dest, int operation,
 	resultDest->columnOutputFunctions = ColumnOutputFunctions(inputTupleDescriptor,
 															  copyOutState->binary);
 
+	/* compressed frames would mix the rows of different nodes */
+	resultDest->compressData = EnableIntermediateResultCompression &&
+							   !OidIsValid(resultDest->partitionRelationId);
+	if (resultDest->compressData)
+	{
+		resultDest->pendingData = makeStringInfo();
+		resultDest->compressedFrame = makeStringInfo();
+	}
+
 	if (resultDest->writeLocalFile)
 	{
 		const int fileFlags = (O_APPEND | O_CREAT | O_RDWR | O_TRUNC | PG_BINARY);
@@ -263,12 +482,14 @@ RemoteFileDestReceiverStartup(DestReceiver *dest, int operation,
 
 		/* make sure the directory exists */
 		CreateIntermediateResultsDirectory();
+		ForgetDecodedResultFiles(resultId);
 
 		const char *fileName = QueryResultFileName(resultId);
 
 		resultDest->fileCompat = FileCompatFromFileStart(FileOpenForTransmit(fileName,
 																			 fileFlags,
 																			 fileMode));
+		resultDest->localFileBuffer = makeStringInfo();
 	}
 
 	WorkerNode *workerNode = NULL;
@@ -300,7 +521,8 @@ RemoteFileDestReceiverStartup(DestReceiver *dest, int operation,
 	MultiConnection *connection = NULL;
 	foreach_ptr(connection, connectionList)
 	{
-		StringInfo copyCommand = ConstructCopyResultStatement(resultId);
+		StringInfo copyCommand = ConstructCopyResultStatement(resultId,
+															  resultDest->compressData);
 
 		bool querySent = SendRemoteCommand(connection, copyCommand->data);
 		if (!querySent)
@@ -327,15 +549,96 @@ RemoteFileDestReceiverStartup(DestReceiver *dest, int operation,
 		/* send headers when using binary encoding */
 		resetStringInfo(copyOutState->fe_msgbuf);
 		AppendCopyBinaryHeaders(copyOutState);
-		BroadcastCopyData(copyOutState->fe_msgbuf, connectionList);
+		SendResultData(resultDest, copyOutState->fe_msgbuf);
 
 		if (resultDest->writeLocalFile)
 		{
-			WriteToLocalFile(copyOutState->fe_msgbuf, &resultDest->fileCompat);
+			WriteToLocalFile(resultDest, copyOutState->fe_msgbuf);
 		}
 	}
 
 	resultDest->connectionList = connectionList;
+
+	if (OidIsValid(resultDest->partitionRelationId))
+	{
+		CitusTableCacheEntry *cacheEntry =
+			GetCitusTableCacheEntry(resultDest->partitionRelationId);
+
+		resultDest->partitionTableEntry = cacheEntry;
+		resultDest->shardConnectionLists =
+			BuildShardConnectionLists(cacheEntry, initialNodeList, connectionList);
+	}
+}
+
+
+/*
+ * BuildShardConnectionLists returns an array with, for every shard of the
+ * given table, the list of connections in connectionList to the nodes that
+ * have an active placement of the shard. connectionList contains a connection
+ * for each node in nodeList, in the same order.
+ */
+static List **
+BuildShardConnectionLists(CitusTableCacheEntry *cacheEntry, List *nodeList,
+						  List *connectionList)
+{
+	int shardCount = cacheEntry->shardIntervalArrayLength;
+	List **shardConnectionLists = palloc0(shardCount * sizeof(List *));
+
+	for (int shardIndex = 0; shardIndex < shardCount; shardIndex++)
+	{
+		ShardInterval *shardInterval = cacheEntry->sortedShardIntervalArray[shardIndex];
+		List *placementList = ActiveShardPlacementList(shardInterval->shardId);
+
+		ShardPlacement *placement = NULL;
+		foreach_ptr(placement, placementList)
+		{
+			ListCell *connectionCell = list_head(connectionList);
+
+			WorkerNode *workerNode = NULL;
+			foreach_ptr(workerNode, nodeList)
+			{
+				MultiConnection *connection = lfirst(connectionCell);
+				connectionCell = lnext(connectionCell);
+
+				if (workerNode->groupId == placement->groupId)
+				{
+					shardConnectionLists[shardIndex] =
+						list_append_unique_ptr(shardConnectionLists[shardIndex],
+											   connection);
+				}
+			}
+		}
+	}
+
+	return shardConnectionLists;
+}
+
+
+/*
+ * PartitionedRowConnectionList returns the connections of a partitioning
+ * RemoteFileDestReceiver to which the row with the given values is sent.
+ */
+static List *
+PartitionedRowConnectionList(RemoteFileDestReceiver *resultDest, Datum *columnValues,
+							 bool *columnNulls)
+{
+	int partitionColumnIndex = resultDest->partitionColumnIndex;
+
+	/* NULL is not equal to any distribution column value */
+	if (columnNulls[partitionColumnIndex])
+	{
+		return NIL;
+	}
+
+	ShardInterval *shardInterval =
+		FindShardInterval(columnValues[partitionColumnIndex],
+						  resultDest->partitionTableEntry);
+	if (shardInterval == NULL)
+	{
+		return NIL;
+	}
+
+	return resultDest->shardConnectionLists[shardInterval->shardIndex];
 }
 
 
@@ -344,12 +647,12 @@ RemoteFileDestReceiverStartup(DestReceiver *dest, int operation,
  * for copying into a result file.
  */
 static StringInfo
-ConstructCopyResultStatement(const char *resultId)
+ConstructCopyResultStatement(const char *resultId, bool compressData)
 {
 	StringInfo command = makeStringInfo();
 
-	appendStringInfo(command, "COPY \"%s\" FROM STDIN WITH (format result)",
-					 resultId);
+	appendStringInfo(command, "COPY \"%s\" FROM STDIN WITH (format result%s)",
+					 resultId, compressData ? ", compression pglz" : "");
 
 	return command;
 }
@@ -389,12 +692,24 @@ RemoteFileDestReceiverReceive(TupleTableSlot *slot, DestReceiver *dest)
 					  copyOutState, columnOutputFunctions, NULL);
 
 	/* send row to nodes */
-	BroadcastCopyData(copyData, connectionList);
+	if (resultDest->partitionTableEntry != NULL)
+	{
+		List *rowConnectionList = PartitionedRowConnectionList(resultDest,
+															   columnValues,
+															   columnNulls);
+
+		BroadcastCopyData(copyData, rowConnectionList);
+		resultDest->bytesSent += copyData->len;
+	}
+	else
+	{
+		SendResultData(resultDest, copyData);
+	}
 
 	/* write to local file (if applicable) */
 	if (resultDest->writeLocalFile)
 	{
-		WriteToLocalFile(copyOutState->fe_msgbuf, &resultDest->fileCompat);
+		WriteToLocalFile(resultDest, copyOutState->fe_msgbuf);
 	}
 
 	MemoryContextSwitchTo(oldContext);
@@ -408,19 +723,50 @@ RemoteFileDestReceiverReceive(TupleTableSlot *slot, DestReceiver *dest)
 
 
 /*
- * WriteToLocalResultsFile writes the bytes in a StringInfo to a local file.
+ * WriteToLocalFile appends the bytes in a StringInfo to the local file of the
+ * intermediate result. The bytes are buffered, such that the file is written
+ * in large blocks rather than once per row.
+ */
+static void
+WriteToLocalFile(RemoteFileDestReceiver *resultDest, StringInfo copyData)
+{
+	StringInfo localFileBuffer = resultDest->localFileBuffer;
+
+	appendBinaryStringInfo(localFileBuffer, copyData->data, copyData->len);
+
+	if (localFileBuffer->len >= LOCAL_FILE_BUFFER_SIZE)
+	{
+		FlushLocalFileBuffer(resultDest);
+	}
+}
+
+
+/*
+ * FlushLocalFileBuffer writes the buffered bytes to the local file of the
+ * intermediate result.
  */
 static void
-WriteToLocalFile(StringInfo copyData, FileCompat *fileCompat)
+FlushLocalFileBuffer(RemoteFileDestReceiver *resultDest)
 {
-	int bytesWritten = FileWriteCompat(fileCompat, copyData->data,
-									   copyData->len,
-									   PG_WAIT_IO);
+	StringInfo localFileBuffer = resultDest->localFileBuffer;
+
+	if (localFileBuffer->len == 0)
+	{
+		return;
+	}
+
+	ReserveJobCacheSpace(localFileBuffer->len);
+
+	int bytesWritten = FileWriteWithWriteback(&resultDest->fileCompat,
+											  localFileBuffer->data,
+											  localFileBuffer->len, PG_WAIT_IO);
 	if (bytesWritten < 0)
 	{
 		ereport(ERROR, (errcode_for_file_access(),
 						errmsg("could not append to file: %m")));
 	}
+
+	resetStringInfo(localFileBuffer);
 }
 
 
@@ -442,24 +788,182 @@ RemoteFileDestReceiverShutdown(DestReceiver *destReceiver)
 		/* send footers when using binary encoding */
 		resetStringInfo(copyOutState->fe_msgbuf);
 		AppendCopyBinaryFooters(copyOutState);
-		BroadcastCopyData(copyOutState->fe_msgbuf, connectionList);
+		SendResultData(resultDest, copyOutState->fe_msgbuf);
 
 		if (resultDest->writeLocalFile)
 		{
-			WriteToLocalFile(copyOutState->fe_msgbuf, &resultDest->fileCompat);
+			WriteToLocalFile(resultDest, copyOutState->fe_msgbuf);
 		}
 	}
 
+	FlushPendingResultData(resultDest);
+
 	/* close the COPY input */
 	EndRemoteCopy(0, connectionList);
 
 	if (resultDest->writeLocalFile)
 	{
+		FlushLocalFileBuffer(resultDest);
 		FileClose(resultDest->fileCompat.fd);
 	}
 }
 
 
+/*
+ * RemoteFileDestReceiverBytesSent returns the size of the result data that
+ * the given RemoteFileDestReceiver sent to each node.
+ */
+uint64
+RemoteFileDestReceiverBytesSent(DestReceiver *destReceiver)
+{
+	RemoteFileDestReceiver *resultDest = (RemoteFileDestReceiver *) destReceiver;
+
+	return resultDest->bytesSent;
+}
+
+
+/*
+ * SendResultData sends the given copy data to all nodes of the intermediate
+ * result. When compressing, the data is buffered until there is enough of it
+ * to compress into a frame.
+ */
+static void
+SendResultData(RemoteFileDestReceiver *resultDest, StringInfo dataBuffer)
+{
+	if (!resultDest->compressData)
+	{
+		BroadcastCopyData(dataBuffer, resultDest->connectionList);
+		resultDest->bytesSent += dataBuffer->len;
+		return;
+	}
+
+	appendBinaryStringInfo(resultDest->pendingData, dataBuffer->data, dataBuffer->len);
+
+	if (resultDest->pendingData->len >= COPY_COMPRESSION_BLOCK_SIZE)
+	{
+		FlushPendingResultData(resultDest);
+	}
+}
+
+
+/*
+ * FlushPendingResultData compresses the buffered copy data into a frame and
+ * sends it to all nodes of the intermediate result.
+ */
+static void
+FlushPendingResultData(RemoteFileDestReceiver *resultDest)
+{
+	StringInfo pendingData = resultDest->pendingData;
+	StringInfo compressedFrame = resultDest->compressedFrame;
+
+	if (!resultDest->compressData || pendingData->len == 0)
+	{
+		return;
+	}
+
+	resetStringInfo(compressedFrame);
+	AppendCompressedCopyFrame(compressedFrame, pendingData->data, pendingData->len);
+	BroadcastCopyData(compressedFrame, resultDest->connectionList);
+	resultDest->bytesSent += compressedFrame->len;
+
+	resetStringInfo(pendingData);
+}
+
+
+/*
+ * RelayIntermediateResult makes the nodes in targetNodeList fetch the given
+ * intermediate result from the nodes in sourceNodeList, which already have
+ * it. This happens in rounds, in which every node that has the result sends
+ * it to one other node, such that the number of nodes that have the result
+ * doubles in every round and the coordinator does not need to send the
+ * result to every node itself.
+ */
+void
+RelayIntermediateResult(const char *resultId, List *sourceNodeList,
+						List *targetNodeList)
+{
+	List *haveResultNodeList = list_copy(sourceNodeList);
+	ListCell *targetNodeCell = list_head(targetNodeList);
+	int logLevel = LogIntermediateResults ? DEBUG1 : DEBUG4;
+
+	while (targetNodeCell != NULL)
+	{
+		List *connectionList = NIL;
+		List *roundTargetNodeList = NIL;
+		List *commandList = NIL;
+
+		WorkerNode *sourceNode = NULL;
+		foreach_ptr(sourceNode, haveResultNodeList)
+		{
+			if (targetNodeCell == NULL)
+			{
+				break;
+			}
+
+			WorkerNode *targetNode = (WorkerNode *) lfirst(targetNodeCell);
+			targetNodeCell = lnext(targetNodeCell);
+
+			elog(logLevel, "Subplan %s will be relayed from %s:%d to %s:%d", resultId,
+				 sourceNode->workerName, sourceNode->workerPort,
+				 targetNode->workerName, targetNode->workerPort);
+
+			int flags = REQUIRE_SIDECHANNEL;
+			MultiConnection *connection = StartNodeConnection(flags,
+															  targetNode->workerName,
+															  targetNode->workerPort);
+			ClaimConnectionExclusively(connection);
+			MarkRemoteTransactionCritical(connection);
+
+			StringInfo fetchCommand = makeStringInfo();
+			appendStringInfo(fetchCommand,
+							 "SELECT fetch_intermediate_results(ARRAY[%s]::text[], %s, %d)",
+							 quote_literal_cstr(resultId),
+							 quote_literal_cstr(sourceNode->workerName),
+							 sourceNode->workerPort);
+
+			connectionList = lappend(connectionList, connection);
+			commandList = lappend(commandList, fetchCommand->data);
+			roundTargetNodeList = lappend(roundTargetNodeList, targetNode);
+		}
+
+		FinishConnectionListEstablishment(connectionList);
+
+		/* must open transaction blocks to use intermediate results */
+		RemoteTransactionsBeginIfNecessary(connectionList);
+
+		MultiConnection *connection = NULL;
+		ListCell *commandCell = list_head(commandList);
+		foreach_ptr(connection, connectionList)
+		{
+			char *fetchCommand = (char *) lfirst(commandCell);
+			commandCell = lnext(commandCell);
+
+			if (!SendRemoteCommand(connection, fetchCommand))
+			{
+				ReportConnectionError(connection, ERROR);
+			}
+		}
+
+		foreach_ptr(connection, connectionList)
+		{
+			bool raiseInterrupts = true;
+
+			PGresult *result = GetRemoteCommandResult(connection, raiseInterrupts);
+			if (PQresultStatus(result) != PGRES_TUPLES_OK)
+			{
+				ReportResultError(connection, result, ERROR);
+			}
+
+			PQclear(result);
+			ForgetResults(connection);
+			UnclaimConnection(connection);
+		}
+
+		haveResultNodeList = list_concat(haveResultNodeList, roundTargetNodeList);
+	}
+}
+
+
 /*
  * BroadcastCopyData sends copy data to all connections in a list.
  */
@@ -517,11 +1021,11 @@ RemoteFileDestReceiverDestroy(DestReceiver *destReceiver)
  * contents of the file are sent directly to the client.
  */
 void
-SendQueryResultViaCopy(const char *resultId)
+SendQueryResultViaCopy(const char *resultId, bool compress)
 {
 	const char *resultFileName = QueryResultFileName(resultId);
 
-	SendRegularFile(resultFileName);
+	SendRegularFile(resultFileName, compress);
 }
 
 
@@ -535,13 +1039,14 @@ SendQueryResultViaCopy(const char *resultId)
  * are only allowed to read query results from their own directory.
  */
 void
-ReceiveQueryResultViaCopy(const char *resultId)
+ReceiveQueryResultViaCopy(const char *resultId, bool decompress)
 {
 	CreateIntermediateResultsDirectory();
+	ForgetDecodedResultFiles(resultId);
 
 	const char *resultFileName = QueryResultFileName(resultId);
 
-	RedirectCopyDataToRegularFile(resultFileName);
+	RedirectCopyDataToRegularFile(resultFileName, decompress);
 }
 
 
@@ -557,19 +1062,16 @@ CreateIntermediateResultsDirectory(void)
 
 	if (!CreatedResultsDirectory)
 	{
-		int makeOK = mkdir(resultDirectory, S_IRWXU);
-		if (makeOK != 0)
-		{
-			if (errno == EEXIST)
-			{
-				/* someone else beat us to it, that's ok */
-				return resultDirectory;
-			}
+		bool existsOk = true;
 
-			ereport(ERROR, (errcode_for_file_access(),
-							errmsg("could not create intermediate results directory "
-								   "\"%s\": %m",
-								   resultDirectory)));
+		/* fail before writing any results if the job cache is full */
+		CheckJobCacheSpace();
+
+		bool created = CreateJobCacheDirectory(resultDirectory, existsOk);
+		if (!created)
+		{
+			/* someone else beat us to it, that's ok */
+			return resultDirectory;
 		}
 
 		CreatedResultsDirectory = true;
@@ -625,7 +1127,8 @@ QueryResultFileName(const char *resultId)
  * base/pgsql_job_cache/<user id>_<process id>/
  *
  * The latter form can be used for testing COPY ... WITH (format result) without
- * assigning a distributed transaction ID.
+ * assigning a distributed transaction ID. Parallel workers use the process id
+ * of their leader, such that they can read the results of the leader.
  *
  * The pgsql_job_cache directory is emptied on restart in case of failure.
  */
@@ -645,8 +1148,15 @@ IntermediateResultsDirectory(void)
 	}
 	else
 	{
+		int processId = MyProcPid;
+
+		if (MyProc->lockGroupLeader != NULL)
+		{
+			processId = MyProc->lockGroupLeader->pid;
+		}
+
 		appendStringInfo(resultFileName, "base/" PG_JOB_CACHE_DIR "/%u_%u",
-						 userId, MyProcPid);
+						 userId, processId);
 	}
 
 	return resultFileName->data;
@@ -660,6 +1170,10 @@ IntermediateResultsDirectory(void)
 void
 RemoveIntermediateResultsDirectory(void)
 {
+	/* decoded result files are freed with the transaction's memory */
+	DecodedResultFileList = NIL;
+	DecodedResultFileCacheSize = 0;
+
 	if (CreatedResultsDirectory)
 	{
 		CitusRemoveDirectory(IntermediateResultsDirectory());
@@ -760,6 +1274,12 @@ ReadIntermediateResultsIntoFuncOutput(FunctionCallInfo fcinfo, char *copyFormat,
 {
 	TupleDesc tupleDescriptor = NULL;
 	Tuplestorestate *tupleStore = SetupTuplestore(fcinfo, &tupleDescriptor);
+	BinaryResultReader *reader = NULL;
+
+	if (strcmp(copyFormat, "binary") == 0)
+	{
+		reader = CreateBinaryResultReader(tupleDescriptor);
+	}
 
 	for (int resultIndex = 0; resultIndex < resultCount; resultIndex++)
 	{
@@ -774,7 +1294,23 @@ ReadIntermediateResultsIntoFuncOutput(FunctionCallInfo fcinfo, char *copyFormat,
 							errmsg("result \"%s\" does not exist", resultId)));
 		}
 
-		ReadFileIntoTupleStore(resultFileName, copyFormat, tupleDescriptor, tupleStore);
+		if (fileStat.st_size > 0 &&
+			fileStat.st_size <= MaxDecodedResultCacheSize * 1024L)
+		{
+			ReadResultFileViaDecodedCache(resultId, resultFileName, &fileStat,
+										  copyFormat, reader, tupleDescriptor,
+										  tupleStore);
+		}
+		else
+		{
+			ReadResultFileIntoTupleStore(resultFileName, copyFormat, reader,
+										 tupleDescriptor, tupleStore);
+		}
+	}
+
+	if (reader != NULL)
+	{
+		FreeBinaryResultReader(reader);
 	}
 
 	tuplestore_donestoring(tupleStore);
@@ -782,55 +1318,756 @@ ReadIntermediateResultsIntoFuncOutput(FunctionCallInfo fcinfo, char *copyFormat,
 
 
 /*
- * fetch_intermediate_results fetches a set of intermediate results defined in an
- * array of result IDs from a remote node and writes them to a local intermediate
- * result with the same ID.
+ * ReadBinaryIntermediateResultsIntoTupleStore reads the rows of the given
+ * binary result files that the row filter accepts into the tuple store. The
+ * filter is called with the position of every row across all files, in order,
+ * which lets the processes of a parallel scan divide the rows among them.
  */
-Datum
-fetch_intermediate_results(PG_FUNCTION_ARGS)
+void
+ReadBinaryIntermediateResultsIntoTupleStore(Datum *resultIdArray, int resultCount,
+											TupleDesc tupleDescriptor,
+											Tuplestorestate *tupleStore,
+											IntermediateResultRowFilter rowFilter,
+											void *filterContext)
 {
-	ArrayType *resultIdObject = PG_GETARG_ARRAYTYPE_P(0);
-	Datum *resultIdArray = DeconstructArrayObject(resultIdObject);
-	int32 resultCount = ArrayObjectCount(resultIdObject);
-	text *remoteHostText = PG_GETARG_TEXT_P(1);
-	char *remoteHost = text_to_cstring(remoteHostText);
-	int remotePort = PG_GETARG_INT32(2);
-
-	int connectionFlags = FORCE_NEW_CONNECTION;
-	int resultIndex = 0;
-	int64 totalBytesWritten = 0L;
-
-	CheckCitusVersion(ERROR);
+	ResultRowFilterState filterState = { rowFilter, filterContext, 0 };
+	BinaryResultReader *reader = CreateBinaryResultReader(tupleDescriptor);
 
-	if (resultCount == 0)
+	for (int resultIndex = 0; resultIndex < resultCount; resultIndex++)
 	{
-		PG_RETURN_INT64(0);
-	}
+		char *resultId = TextDatumGetCString(resultIdArray[resultIndex]);
+		char *resultFileName = QueryResultFileName(resultId);
+		struct stat fileStat;
 
-	if (!IsMultiStatementTransaction())
-	{
-		ereport(ERROR, (errmsg("fetch_intermediate_results can only be used in a "
-							   "distributed transaction")));
+		if (stat(resultFileName, &fileStat) != 0)
+		{
+			ereport(ERROR, (errcode_for_file_access(),
+							errmsg("result \"%s\" does not exist", resultId)));
+		}
+
+		ReadBinaryResultFileIntoTupleStore(resultFileName, reader, tupleStore,
+										   &filterState);
 	}
 
-	/*
-	 * Make sure that this transaction has a distributed transaction ID.
-	 *
-	 * Intermediate results will be stored in a directory that is derived
-	 * from the distributed transaction ID.
-	 */
-	EnsureDistributedTransactionId();
+	FreeBinaryResultReader(reader);
+	tuplestore_donestoring(tupleStore);
+}
 
-	MultiConnection *connection = GetNodeConnection(connectionFlags, remoteHost,
-													remotePort);
 
-	if (PQstatus(connection->pgConn) != CONNECTION_OK)
+/*
+ * ReadResultFileIntoTupleStore parses a result file in the given format into
+ * the tuple store. Binary files are converted with the given reader.
+ */
+static void
+ReadResultFileIntoTupleStore(char *fileName, char *copyFormat,
+							 BinaryResultReader *reader, TupleDesc tupleDescriptor,
+							 Tuplestorestate *tupleStore)
+{
+	if (strcmp(copyFormat, "binary") == 0)
 	{
-		ereport(ERROR, (errmsg("cannot connect to %s:%d to fetch intermediate results",
-							   remoteHost, remotePort)));
+		ReadBinaryResultFileIntoTupleStore(fileName, reader, tupleStore, NULL);
 	}
-
-	StringInfo beginAndSetXactId = BeginAndSetDistributedTransactionIdCommand();
+	else
+	{
+		ReadFileIntoTupleStore(fileName, copyFormat, tupleDescriptor, tupleStore);
+	}
+}
+
+
+/*
+ * ReadResultFileViaDecodedCache adds the rows of a result file to the tuple
+ * store, using the rows that were decoded when this backend last read the
+ * file if it did not change since. The file may have been rewritten by
+ * another backend in the meantime, which truncates and writes the same file,
+ * so we compare its size and modification time.
+ */
+static void
+ReadResultFileViaDecodedCache(char *resultId, char *fileName, struct stat *fileStat,
+							  char *copyFormat, BinaryResultReader *reader,
+							  TupleDesc tupleDescriptor, Tuplestorestate *tupleStore)
+{
+	DecodedResultFile *decodedFile = FindDecodedResultFile(resultId, copyFormat,
+														   tupleDescriptor);
+	if (decodedFile != NULL && !ResultFileUnchanged(&decodedFile->fileStat, fileStat))
+	{
+		RemoveDecodedResultFile(decodedFile);
+		decodedFile = NULL;
+	}
+
+	if (decodedFile == NULL)
+	{
+		decodedFile = DecodeResultFile(resultId, fileName, fileStat, copyFormat, reader,
+									   tupleDescriptor);
+	}
+
+	CopyTupleStoreRows(decodedFile->tupleStore, tupleDescriptor, tupleStore);
+}
+
+
+/*
+ * ResultFileUnchanged returns whether the file status that was taken when a
+ * result file was decoded still matches the current status of the file.
+ * Writing the file updates its modification time, which Linux keeps with
+ * sub-second precision.
+ */
+static bool
+ResultFileUnchanged(struct stat *decodedStat, struct stat *fileStat)
+{
+	if (decodedStat->st_dev != fileStat->st_dev ||
+		decodedStat->st_ino != fileStat->st_ino ||
+		decodedStat->st_size != fileStat->st_size ||
+		decodedStat->st_mtime != fileStat->st_mtime)
+	{
+		return false;
+	}
+
+#ifdef __linux__
+	if (decodedStat->st_mtim.tv_nsec != fileStat->st_mtim.tv_nsec)
+	{
+		return false;
+	}
+#endif
+
+	return true;
+}
+
+
+/*
+ * FindDecodedResultFile returns the decoded rows of the given result if this
+ * backend decoded them earlier in the transaction with the same column types,
+ * or NULL otherwise.
+ */
+static DecodedResultFile *
+FindDecodedResultFile(char *resultId, char *copyFormat, TupleDesc tupleDescriptor)
+{
+	DecodedResultFile *decodedFile = NULL;
+	foreach_ptr(decodedFile, DecodedResultFileList)
+	{
+		TupleDesc decodedDescriptor = decodedFile->tupleDescriptor;
+		bool sameColumnTypes = decodedDescriptor->natts == tupleDescriptor->natts;
+
+		if (strcmp(decodedFile->resultId, resultId) != 0 ||
+			strcmp(decodedFile->copyFormat, copyFormat) != 0)
+		{
+			continue;
+		}
+
+		for (int columnIndex = 0; sameColumnTypes &&
+			 columnIndex < tupleDescriptor->natts; columnIndex++)
+		{
+			Form_pg_attribute decodedAttribute = TupleDescAttr(decodedDescriptor,
+															   columnIndex);
+			Form_pg_attribute attribute = TupleDescAttr(tupleDescriptor, columnIndex);
+
+			sameColumnTypes = decodedAttribute->atttypid == attribute->atttypid &&
+							  decodedAttribute->atttypmod == attribute->atttypmod;
+		}
+
+		if (sameColumnTypes)
+		{
+			return decodedFile;
+		}
+	}
+
+	return NULL;
+}
+
+
+/*
+ * DecodeResultFile parses the result file into a tuple store that lasts
+ * until the end of the transaction. Result files that were decoded longest
+ * ago are removed to stay within citus.max_decoded_result_cache_size.
+ */
+static DecodedResultFile *
+DecodeResultFile(char *resultId, char *fileName, struct stat *fileStat,
+				 char *copyFormat, BinaryResultReader *reader, TupleDesc tupleDescriptor)
+{
+	size_t fileSize = fileStat->st_size;
+	bool randomAccess = false;
+	bool interTransactions = false;
+	uint64 maxCacheSize = MaxDecodedResultCacheSize * 1024L;
+
+	while (DecodedResultFileList != NIL &&
+		   DecodedResultFileCacheSize + fileSize > maxCacheSize)
+	{
+		RemoveDecodedResultFile((DecodedResultFile *) linitial(DecodedResultFileList));
+	}
+
+	MemoryContext oldContext = MemoryContextSwitchTo(TopTransactionContext);
+
+	DecodedResultFile *decodedFile = palloc0(sizeof(DecodedResultFile));
+	decodedFile->resultId = pstrdup(resultId);
+	decodedFile->copyFormat = pstrdup(copyFormat);
+	decodedFile->tupleDescriptor = CreateTupleDescCopy(tupleDescriptor);
+	decodedFile->fileStat = *fileStat;
+	decodedFile->fileSize = fileSize;
+
+	/*
+	 * The rows should stay in memory, since temporary files are closed
+	 * when the statement ends.
+	 */
+	decodedFile->tupleStore = tuplestore_begin_heap(randomAccess, interTransactions,
+													MAX_KILOBYTES);
+
+	MemoryContextSwitchTo(oldContext);
+
+	ReadResultFileIntoTupleStore(fileName, copyFormat, reader, tupleDescriptor,
+								 decodedFile->tupleStore);
+
+	/* only add the file once it is fully decoded, in case of errors */
+	oldContext = MemoryContextSwitchTo(TopTransactionContext);
+	DecodedResultFileList = lappend(DecodedResultFileList, decodedFile);
+	MemoryContextSwitchTo(oldContext);
+
+	DecodedResultFileCacheSize += fileSize;
+
+	return decodedFile;
+}
+
+
+/*
+ * RemoveDecodedResultFile frees the decoded rows of a result file.
+ */
+static void
+RemoveDecodedResultFile(DecodedResultFile *decodedFile)
+{
+	DecodedResultFileList = list_delete_ptr(DecodedResultFileList, decodedFile);
+	DecodedResultFileCacheSize -= decodedFile->fileSize;
+
+	tuplestore_end(decodedFile->tupleStore);
+	pfree(decodedFile);
+}
+
+
+/*
+ * ForgetDecodedResultFiles removes the decoded rows of the given result when
+ * this backend is about to write the result file. Another write may fall
+ * within the precision of the modification time, so we do not rely on the
+ * file status for writes that we know about.
+ */
+static void
+ForgetDecodedResultFiles(const char *resultId)
+{
+	if (DecodedResultFileList == NIL)
+	{
+		return;
+	}
+
+	/* removing entries modifies the list, so walk over a copy */
+	List *decodedFileList = list_copy(DecodedResultFileList);
+
+	DecodedResultFile *decodedFile = NULL;
+	foreach_ptr(decodedFile, decodedFileList)
+	{
+		if (strcmp(decodedFile->resultId, resultId) == 0)
+		{
+			RemoveDecodedResultFile(decodedFile);
+		}
+	}
+
+	list_free(decodedFileList);
+}
+
+
+/*
+ * CopyTupleStoreRows adds all rows of the source tuple store to the target
+ * tuple store.
+ */
+static void
+CopyTupleStoreRows(Tuplestorestate *sourceStore, TupleDesc tupleDescriptor,
+				   Tuplestorestate *targetStore)
+{
+	TupleTableSlot *slot = MakeSingleTupleTableSlotCompat(tupleDescriptor,
+														  &TTSOpsMinimalTuple);
+	bool forward = true;
+	bool copy = false;
+
+	tuplestore_rescan(sourceStore);
+
+	while (tuplestore_gettupleslot(sourceStore, forward, copy, slot))
+	{
+		tuplestore_puttupleslot(targetStore, slot);
+	}
+
+	ExecDropSingleTupleTableSlot(slot);
+}
+
+
+/*
+ * ReadBinaryResultFileIntoTupleStore parses the records in a binary COPY file
+ * and stores them in the tuple store, like ReadFileIntoTupleStore. Rather than
+ * going through COPY, which reads the file into a buffer and copies every
+ * field into another buffer, the file is mapped into memory and the receive
+ * functions read the fields directly from the mapped pages.
+ *
+ * If filterState is not NULL, only the rows that its filter accepts are read.
+ */
+static void
+ReadBinaryResultFileIntoTupleStore(char *fileName, BinaryResultReader *reader,
+								   Tuplestorestate *tupleStore,
+								   ResultRowFilterState *filterState)
+{
+	MappedResultFile file = { 0 };
+	struct stat fileStat;
+
+	int fileDescriptor = OpenTransientFile(fileName, O_RDONLY | PG_BINARY);
+	if (fileDescriptor < 0)
+	{
+		ereport(ERROR, (errcode_for_file_access(),
+						errmsg("could not open file \"%s\": %m", fileName)));
+	}
+
+	if (fstat(fileDescriptor, &fileStat) < 0)
+	{
+		ereport(ERROR, (errcode_for_file_access(),
+						errmsg("could not stat file \"%s\": %m", fileName)));
+	}
+
+	file.size = fileStat.st_size;
+
+	if (file.size == 0)
+	{
+		/* mmap does not accept empty mappings, let COPY report the error */
+		CloseTransientFile(fileDescriptor);
+		ReadFileIntoTupleStore(fileName, "binary", reader->tupleDescriptor, tupleStore);
+		return;
+	}
+
+	/*
+	 * Some receive functions temporarily write a terminating zero byte into
+	 * the buffer they read from, hence a private, writable mapping.
+	 */
+	file.data = mmap(NULL, file.size, PROT_READ | PROT_WRITE, MAP_PRIVATE,
+					 fileDescriptor, 0);
+	if (file.data == MAP_FAILED)
+	{
+		ereport(ERROR, (errcode_for_file_access(),
+						errmsg("could not map file \"%s\": %m", fileName)));
+	}
+
+	CloseTransientFile(fileDescriptor);
+
+	PG_TRY();
+	{
+		ReadMappedBinaryCopyFile(&file, reader, tupleStore, filterState);
+	}
+	PG_CATCH();
+	{
+		munmap(file.data, file.size);
+
+		PG_RE_THROW();
+	}
+	PG_END_TRY();
+
+	munmap(file.data, file.size);
+}
+
+
+/*
+ * CreateBinaryResultReader looks up the receive functions of the columns of
+ * the given tuple descriptor and allocates the buffers to read binary result
+ * files with those columns. Everything is allocated in a memory context of
+ * the reader, such that FreeBinaryResultReader releases it all at once.
+ */
+static BinaryResultReader *
+CreateBinaryResultReader(TupleDesc tupleDescriptor)
+{
+	int columnCount = tupleDescriptor->natts;
+
+	MemoryContext readerContext = AllocSetContextCreateExtended(CurrentMemoryContext,
+																"BinaryResultReader",
+																ALLOCSET_DEFAULT_MINSIZE,
+																ALLOCSET_DEFAULT_INITSIZE,
+																ALLOCSET_DEFAULT_MAXSIZE);
+	MemoryContext oldContext = MemoryContextSwitchTo(readerContext);
+
+	BinaryResultReader *reader = palloc0(sizeof(BinaryResultReader));
+	reader->tupleDescriptor = tupleDescriptor;
+	reader->columnValues = palloc0(columnCount * sizeof(Datum));
+	reader->columnNulls = palloc0(columnCount * sizeof(bool));
+	reader->receiveFunctions = palloc0(columnCount * sizeof(FmgrInfo));
+	reader->typeIOParams = palloc0(columnCount * sizeof(Oid));
+	reader->readerContext = readerContext;
+	reader->tupleContext = AllocSetContextCreateExtended(readerContext,
+														 "BinaryResultReaderTuple",
+														 ALLOCSET_DEFAULT_MINSIZE,
+														 ALLOCSET_DEFAULT_INITSIZE,
+														 ALLOCSET_DEFAULT_MAXSIZE);
+
+	for (int columnIndex = 0; columnIndex < columnCount; columnIndex++)
+	{
+		Form_pg_attribute column = TupleDescAttr(tupleDescriptor, columnIndex);
+		Oid receiveFunctionId = InvalidOid;
+
+		getTypeBinaryInputInfo(column->atttypid, &receiveFunctionId,
+							   &reader->typeIOParams[columnIndex]);
+		fmgr_info_cxt(receiveFunctionId, &reader->receiveFunctions[columnIndex],
+					  readerContext);
+	}
+
+	MemoryContextSwitchTo(oldContext);
+
+	return reader;
+}
+
+
+/*
+ * FreeBinaryResultReader frees a reader created by CreateBinaryResultReader,
+ * along with its receive functions and buffers.
+ */
+static void
+FreeBinaryResultReader(BinaryResultReader *reader)
+{
+	MemoryContextDelete(reader->readerContext);
+}
+
+
+/*
+ * ReadMappedBinaryCopyFile parses the header and the records of a mapped
+ * binary COPY file and stores the records in the tuple store. The checks and
+ * error messages follow those of COPY FROM in binary format.
+ */
+static void
+ReadMappedBinaryCopyFile(MappedResultFile *file, BinaryResultReader *reader,
+						 Tuplestorestate *tupleStore, ResultRowFilterState *filterState)
+{
+	TupleDesc tupleDescriptor = reader->tupleDescriptor;
+	int columnCount = tupleDescriptor->natts;
+	Datum *columnValues = reader->columnValues;
+	bool *columnNulls = reader->columnNulls;
+	MemoryContext tupleContext = reader->tupleContext;
+	int32 flags = 0;
+	int32 extensionLength = 0;
+
+	/* check the file header */
+	if (file->size < sizeof(BinaryCopySignature) ||
+		memcmp(file->data, BinaryCopySignature, sizeof(BinaryCopySignature)) != 0)
+	{
+		ereport(ERROR, (errcode(ERRCODE_BAD_COPY_FILE_FORMAT),
+						errmsg("COPY file signature not recognized")));
+	}
+
+	file->offset = sizeof(BinaryCopySignature);
+
+	if (!ReadMappedInt32(file, &flags))
+	{
+		ereport(ERROR, (errcode(ERRCODE_BAD_COPY_FILE_FORMAT),
+						errmsg("invalid COPY file header (missing flags)")));
+	}
+
+	if ((flags & (1 << 16)) != 0)
+	{
+		ereport(ERROR, (errcode(ERRCODE_BAD_COPY_FILE_FORMAT),
+						errmsg("invalid COPY file header (WITH OIDS)")));
+	}
+
+	if ((flags >> 16) != 0)
+	{
+		ereport(ERROR, (errcode(ERRCODE_BAD_COPY_FILE_FORMAT),
+						errmsg("unrecognized critical flags in COPY file header")));
+	}
+
+	if (!ReadMappedInt32(file, &extensionLength) || extensionLength < 0)
+	{
+		ereport(ERROR, (errcode(ERRCODE_BAD_COPY_FILE_FORMAT),
+						errmsg("invalid COPY file header (missing length)")));
+	}
+
+	if (file->size - file->offset < (size_t) extensionLength)
+	{
+		ereport(ERROR, (errcode(ERRCODE_BAD_COPY_FILE_FORMAT),
+						errmsg("invalid COPY file header (wrong length)")));
+	}
+
+	file->offset += extensionLength;
+
+	while (true)
+	{
+		int16 fieldCount = 0;
+
+		CHECK_FOR_INTERRUPTS();
+
+		if (!ReadMappedInt16(file, &fieldCount))
+		{
+			/* end of file */
+			break;
+		}
+
+		if (fieldCount == -1)
+		{
+			/* end of data marker, which must be at the end of the file */
+			if (file->offset < file->size)
+			{
+				ereport(ERROR, (errcode(ERRCODE_BAD_COPY_FILE_FORMAT),
+								errmsg("received copy data after EOF marker")));
+			}
+
+			break;
+		}
+
+		if (fieldCount != columnCount)
+		{
+			ereport(ERROR, (errcode(ERRCODE_BAD_COPY_FILE_FORMAT),
+							errmsg("row field count is %d, expected %d",
+								   (int) fieldCount, columnCount)));
+		}
+
+		if (filterState != NULL &&
+			!filterState->rowFilter(filterState->rowIndex++, filterState->filterContext))
+		{
+			SkipMappedBinaryRecord(file, columnCount);
+			continue;
+		}
+
+		MemoryContext oldContext = MemoryContextSwitchTo(tupleContext);
+
+		for (int columnIndex = 0; columnIndex < columnCount; columnIndex++)
+		{
+			Form_pg_attribute column = TupleDescAttr(tupleDescriptor, columnIndex);
+
+			columnValues[columnIndex] =
+				ReadMappedBinaryAttribute(file, &reader->receiveFunctions[columnIndex],
+										  reader->typeIOParams[columnIndex],
+										  column->atttypmod, &columnNulls[columnIndex]);
+		}
+
+		tuplestore_putvalues(tupleStore, tupleDescriptor, columnValues, columnNulls);
+
+		MemoryContextSwitchTo(oldContext);
+		MemoryContextReset(tupleContext);
+	}
+}
+
+
+/*
+ * SkipMappedBinaryRecord moves the read position past the fields of a binary
+ * COPY record, without converting them.
+ */
+static void
+SkipMappedBinaryRecord(MappedResultFile *file, int columnCount)
+{
+	for (int columnIndex = 0; columnIndex < columnCount; columnIndex++)
+	{
+		int32 fieldSize = 0;
+
+		if (!ReadMappedInt32(file, &fieldSize))
+		{
+			ereport(ERROR, (errcode(ERRCODE_BAD_COPY_FILE_FORMAT),
+							errmsg("unexpected EOF in COPY data")));
+		}
+
+		if (fieldSize == -1)
+		{
+			continue;
+		}
+
+		if (fieldSize < 0)
+		{
+			ereport(ERROR, (errcode(ERRCODE_BAD_COPY_FILE_FORMAT),
+							errmsg("invalid field size")));
+		}
+
+		if (file->size - file->offset < (size_t) fieldSize)
+		{
+			ereport(ERROR, (errcode(ERRCODE_BAD_COPY_FILE_FORMAT),
+							errmsg("unexpected EOF in COPY data")));
+		}
+
+		file->offset += fieldSize;
+	}
+}
+
+
+/*
+ * ReadMappedInt16 reads a 16-bit integer in network byte order from the file,
+ * and returns false if the file does not have enough data left.
+ */
+static bool
+ReadMappedInt16(MappedResultFile *file, int16 *value)
+{
+	uint16 networkValue = 0;
+
+	if (file->size - file->offset < sizeof(uint16))
+	{
+		return false;
+	}
+
+	memcpy(&networkValue, file->data + file->offset, sizeof(uint16));
+	file->offset += sizeof(uint16);
+
+	*value = (int16) ntohs(networkValue);
+
+	return true;
+}
+
+
+/*
+ * ReadMappedInt32 reads a 32-bit integer in network byte order from the file,
+ * and returns false if the file does not have enough data left.
+ */
+static bool
+ReadMappedInt32(MappedResultFile *file, int32 *value)
+{
+	uint32 networkValue = 0;
+
+	if (file->size - file->offset < sizeof(uint32))
+	{
+		return false;
+	}
+
+	memcpy(&networkValue, file->data + file->offset, sizeof(uint32));
+	file->offset += sizeof(uint32);
+
+	*value = (int32) ntohl(networkValue);
+
+	return true;
+}
+
+
+/*
+ * ReadMappedBinaryAttribute reads a field of a binary COPY record from the
+ * file and converts it to a datum using the receive function of its type.
+ */
+static Datum
+ReadMappedBinaryAttribute(MappedResultFile *file, FmgrInfo *receiveFunction,
+						  Oid typeIOParam, int32 typeMod, bool *isNull)
+{
+	int32 fieldSize = 0;
+	StringInfoData fieldBuffer;
+	Datum value = 0;
+
+	if (!ReadMappedInt32(file, &fieldSize))
+	{
+		ereport(ERROR, (errcode(ERRCODE_BAD_COPY_FILE_FORMAT),
+						errmsg("unexpected EOF in COPY data")));
+	}
+
+	if (fieldSize == -1)
+	{
+		*isNull = true;
+		return ReceiveFunctionCall(receiveFunction, NULL, typeIOParam, typeMod);
+	}
+
+	if (fieldSize < 0)
+	{
+		ereport(ERROR, (errcode(ERRCODE_BAD_COPY_FILE_FORMAT),
+						errmsg("invalid field size")));
+	}
+
+	if (file->size - file->offset < (size_t) fieldSize)
+	{
+		ereport(ERROR, (errcode(ERRCODE_BAD_COPY_FILE_FORMAT),
+						errmsg("unexpected EOF in COPY data")));
+	}
+
+	char *fieldData = file->data + file->offset;
+	file->offset += fieldSize;
+
+	/*
+	 * StringInfos are expected to have a terminating zero byte. We write it
+	 * over the first byte after the field, which belongs to the next field
+	 * or the end of data marker, and restore that byte afterwards. Since the
+	 * mapping is private, this never modifies the file. A field at the very
+	 * end of the file is copied instead.
+	 */
+	if (file->offset < file->size)
+	{
+		char nextByte = fieldData[fieldSize];
+
+		fieldBuffer.data = fieldData;
+		fieldBuffer.len = fieldSize;
+		fieldBuffer.maxlen = fieldSize + 1;
+		fieldBuffer.cursor = 0;
+
+		fieldData[fieldSize] = '\0';
+		value = ReceiveFunctionCall(receiveFunction, &fieldBuffer, typeIOParam,
+									typeMod);
+		fieldData[fieldSize] = nextByte;
+	}
+	else
+	{
+		initStringInfo(&fieldBuffer);
+		appendBinaryStringInfo(&fieldBuffer, fieldData, fieldSize);
+
+		value = ReceiveFunctionCall(receiveFunction, &fieldBuffer, typeIOParam,
+									typeMod);
+	}
+
+	if (fieldBuffer.cursor != fieldBuffer.len)
+	{
+		ereport(ERROR, (errcode(ERRCODE_INVALID_BINARY_REPRESENTATION),
+						errmsg("incorrect binary data format")));
+	}
+
+	*isNull = false;
+	return value;
+}
+
+
+/*
+ * fetch_intermediate_results fetches a set of intermediate results defined in an
+ * array of result IDs from a remote node and writes them to a local intermediate
+ * result with the same ID.
+ *
+ * When citus.max_intermediate_result_fetch_connections is above 1, the results
+ * are fetched in parallel over up to that many connections to the remote node.
+ */
+Datum
+fetch_intermediate_results(PG_FUNCTION_ARGS)
+{
+	ArrayType *resultIdObject = PG_GETARG_ARRAYTYPE_P(0);
+	Datum *resultIdArray = DeconstructArrayObject(resultIdObject);
+	int32 resultCount = ArrayObjectCount(resultIdObject);
+	text *remoteHostText = PG_GETARG_TEXT_P(1);
+	char *remoteHost = text_to_cstring(remoteHostText);
+	int remotePort = PG_GETARG_INT32(2);
+
+	int connectionFlags = FORCE_NEW_CONNECTION;
+	int resultIndex = 0;
+	int64 totalBytesWritten = 0L;
+
+	CheckCitusVersion(ERROR);
+
+	if (resultCount == 0)
+	{
+		PG_RETURN_INT64(0);
+	}
+
+	if (!IsMultiStatementTransaction())
+	{
+		ereport(ERROR, (errmsg("fetch_intermediate_results can only be used in a "
+							   "distributed transaction")));
+	}
+
+	/*
+	 * Make sure that this transaction has a distributed transaction ID.
+	 *
+	 * Intermediate results will be stored in a directory that is derived
+	 * from the distributed transaction ID.
+	 */
+	EnsureDistributedTransactionId();
+
+	int connectionCount = Min(resultCount, MaxIntermediateResultFetchConnections);
+	if (connectionCount > 1)
+	{
+		totalBytesWritten =
+			FetchRemoteIntermediateResultsInParallel(resultIdArray, resultCount,
+													 remoteHost, remotePort,
+													 connectionCount);
+
+		PG_RETURN_INT64(totalBytesWritten);
+	}
+
+	MultiConnection *connection = GetNodeConnection(connectionFlags, remoteHost,
+													remotePort);
+
+	if (PQstatus(connection->pgConn) != CONNECTION_OK)
+	{
+		ereport(ERROR, (errmsg("cannot connect to %s:%d to fetch intermediate results",
+							   remoteHost, remotePort)));
+	}
+
+	StringInfo beginAndSetXactId = BeginAndSetDistributedTransactionIdCommand();
 	ExecuteCriticalRemoteCommand(connection, beginAndSetXactId->data);
 
 	for (resultIndex = 0; resultIndex < resultCount; resultIndex++)
@@ -857,42 +2094,25 @@ FetchRemoteIntermediateResult(MultiConnection *connection, char *resultId)
 {
 	uint64 totalBytesWritten = 0;
 
-	StringInfo copyCommand = makeStringInfo();
-	const int fileFlags = (O_APPEND | O_CREAT | O_RDWR | O_TRUNC | PG_BINARY);
-	const int fileMode = (S_IRUSR | S_IWUSR);
-
 	PGconn *pgConn = connection->pgConn;
 	int socket = PQsocket(pgConn);
 	bool raiseErrors = true;
 
 	CreateIntermediateResultsDirectory();
 
-	appendStringInfo(copyCommand, "COPY \"%s\" TO STDOUT WITH (format result)",
-					 resultId);
-
-	if (!SendRemoteCommand(connection, copyCommand->data))
-	{
-		ReportConnectionError(connection, ERROR);
-	}
-
-	PGresult *result = GetRemoteCommandResult(connection, raiseErrors);
-	if (PQresultStatus(result) != PGRES_COPY_OUT)
-	{
-		ReportResultError(connection, result, ERROR);
-	}
-
-	PQclear(result);
+	bool decompress = EnableIntermediateResultCompression;
 
-	char *localPath = QueryResultFileName(resultId);
-	File fileDesc = FileOpenForTransmit(localPath, fileFlags, fileMode);
+	File fileDesc = StartRemoteIntermediateResultFetch(connection, resultId, decompress);
 	FileCompat fileCompat = FileCompatFromFileStart(fileDesc);
+	StringInfo fileBuffer = makeStringInfo();
 
 	while (true)
 	{
 		int waitFlags = WL_SOCKET_READABLE | WL_POSTMASTER_DEATH;
 
 		CopyStatus copyStatus = CopyDataFromConnection(connection, &fileCompat,
-													   &totalBytesWritten);
+													   fileBuffer, &totalBytesWritten,
+													   decompress);
 		if (copyStatus == CLIENT_COPY_FAILED)
 		{
 			ereport(ERROR, (errmsg("failed to read result \"%s\" from node %s:%d",
@@ -905,7 +2125,9 @@ FetchRemoteIntermediateResult(MultiConnection *connection, char *resultId)
 
 		Assert(copyStatus == CLIENT_COPY_MORE);
 
+		SetCitusWaitState(CITUS_WAIT_INTERMEDIATE_RESULT);
 		int rc = WaitLatchOrSocket(MyLatch, waitFlags, socket, 0, PG_WAIT_EXTENSION);
+		SetCitusWaitState(CITUS_WAIT_NONE);
 		if (rc & WL_POSTMASTER_DEATH)
 		{
 			ereport(ERROR, (errmsg("postmaster was shut down, exiting")));
@@ -919,6 +2141,7 @@ FetchRemoteIntermediateResult(MultiConnection *connection, char *resultId)
 	}
 
 	FileClose(fileDesc);
+	FreeStringInfo(fileBuffer);
 
 	ClearResults(connection, raiseErrors);
 
@@ -927,12 +2150,287 @@ FetchRemoteIntermediateResult(MultiConnection *connection, char *resultId)
 
 
 /*
- * CopyDataFromConnection reads a row of copy data from connection and writes it
- * to the given file.
+ * StartRemoteIntermediateResultFetch sends the COPY command for fetching the
+ * given result over the connection, and opens the local file into which the
+ * result is written.
+ */
+static File
+StartRemoteIntermediateResultFetch(MultiConnection *connection, char *resultId,
+								   bool decompress)
+{
+	StringInfo copyCommand = makeStringInfo();
+	const int fileFlags = (O_APPEND | O_CREAT | O_RDWR | O_TRUNC | PG_BINARY);
+	const int fileMode = (S_IRUSR | S_IWUSR);
+	bool raiseErrors = true;
+
+	appendStringInfo(copyCommand, "COPY \"%s\" TO STDOUT WITH (format result%s)",
+					 resultId, decompress ? ", compression pglz" : "");
+
+	if (!SendRemoteCommand(connection, copyCommand->data))
+	{
+		ReportConnectionError(connection, ERROR);
+	}
+
+	PGresult *result = GetRemoteCommandResult(connection, raiseErrors);
+	if (PQresultStatus(result) != PGRES_COPY_OUT)
+	{
+		ReportResultError(connection, result, ERROR);
+	}
+
+	PQclear(result);
+
+	ForgetDecodedResultFiles(resultId);
+
+	char *localPath = QueryResultFileName(resultId);
+
+	return FileOpenForTransmit(localPath, fileFlags, fileMode);
+}
+
+
+/*
+ * FetchRemoteIntermediateResultsInParallel fetches the given results from the
+ * remote node over connectionCount connections. Each connection fetches one
+ * result at a time and takes the next result that is not fetched yet when it
+ * is done, so large results do not hold up the others.
+ */
+static uint64
+FetchRemoteIntermediateResultsInParallel(Datum *resultIdArray, int resultCount,
+										 char *remoteHost, int remotePort,
+										 int connectionCount)
+{
+	List *connectionList = NIL;
+	uint64 totalBytesWritten = 0;
+	int nextResultIndex = 0;
+	bool raiseErrors = true;
+	bool decompress = EnableIntermediateResultCompression;
+
+	for (int connectionIndex = 0; connectionIndex < connectionCount; connectionIndex++)
+	{
+		int connectionFlags = FORCE_NEW_CONNECTION;
+		MultiConnection *connection = StartNodeConnection(connectionFlags, remoteHost,
+														  remotePort);
+
+		connectionList = lappend(connectionList, connection);
+	}
+
+	FinishConnectionListEstablishment(connectionList);
+
+	StringInfo beginAndSetXactId = BeginAndSetDistributedTransactionIdCommand();
+
+	MultiConnection *connection = NULL;
+	foreach_ptr(connection, connectionList)
+	{
+		if (PQstatus(connection->pgConn) != CONNECTION_OK)
+		{
+			ereport(ERROR, (errmsg("cannot connect to %s:%d to fetch intermediate "
+								   "results", remoteHost, remotePort)));
+		}
+
+		if (!SendRemoteCommand(connection, beginAndSetXactId->data))
+		{
+			ReportConnectionError(connection, ERROR);
+		}
+	}
+
+	foreach_ptr(connection, connectionList)
+	{
+		if (!ClearResults(connection, raiseErrors))
+		{
+			ereport(ERROR, (errmsg("failed to start a transaction on %s:%d to fetch "
+								   "intermediate results", remoteHost, remotePort)));
+		}
+	}
+
+	CreateIntermediateResultsDirectory();
+
+	ResultFetchState *fetchStates = palloc0(connectionCount * sizeof(ResultFetchState));
+	int activeFetchCount = 0;
+	int fetchStateIndex = 0;
+
+	foreach_ptr(connection, connectionList)
+	{
+		ResultFetchState *fetchState = &fetchStates[fetchStateIndex];
+		char *resultId = TextDatumGetCString(resultIdArray[nextResultIndex]);
+
+		fetchState->connection = connection;
+		fetchState->resultId = resultId;
+		fetchState->fileDesc = StartRemoteIntermediateResultFetch(connection, resultId,
+																  decompress);
+		fetchState->fileCompat = FileCompatFromFileStart(fetchState->fileDesc);
+		fetchState->fileBuffer = makeStringInfo();
+
+		nextResultIndex++;
+		activeFetchCount++;
+		fetchStateIndex++;
+	}
+
+	WaitEventSet *waitEventSet = NULL;
+	WaitEvent *events = palloc0((connectionCount + 2) * sizeof(WaitEvent));
+	bool rebuildWaitEventSet = true;
+
+	while (activeFetchCount > 0)
+	{
+		/*
+		 * The COPY data of a result that we just started fetching may already
+		 * be buffered by libpq, so we read it before waiting on the sockets.
+		 */
+		bool startedFetch = false;
+
+		for (fetchStateIndex = 0; fetchStateIndex < connectionCount; fetchStateIndex++)
+		{
+			ResultFetchState *fetchState = &fetchStates[fetchStateIndex];
+			if (fetchState->resultId == NULL)
+			{
+				continue;
+			}
+
+			connection = fetchState->connection;
+
+			CopyStatus copyStatus = CopyDataFromConnection(connection,
+														   &fetchState->fileCompat,
+														   fetchState->fileBuffer,
+														   &totalBytesWritten,
+														   decompress);
+			if (copyStatus == CLIENT_COPY_FAILED)
+			{
+				ereport(ERROR, (errmsg("failed to read result \"%s\" from node %s:%d",
+									   fetchState->resultId, connection->hostname,
+									   connection->port)));
+			}
+			else if (copyStatus == CLIENT_COPY_MORE)
+			{
+				continue;
+			}
+
+			Assert(copyStatus == CLIENT_COPY_DONE);
+
+			FileClose(fetchState->fileDesc);
+			ClearResults(connection, raiseErrors);
+
+			if (nextResultIndex < resultCount)
+			{
+				char *resultId = TextDatumGetCString(resultIdArray[nextResultIndex]);
+
+				fetchState->resultId = resultId;
+				fetchState->fileDesc =
+					StartRemoteIntermediateResultFetch(connection, resultId, decompress);
+				fetchState->fileCompat = FileCompatFromFileStart(fetchState->fileDesc);
+
+				nextResultIndex++;
+				startedFetch = true;
+			}
+			else
+			{
+				fetchState->resultId = NULL;
+				FreeStringInfo(fetchState->fileBuffer);
+				fetchState->fileBuffer = NULL;
+
+				activeFetchCount--;
+				rebuildWaitEventSet = true;
+			}
+		}
+
+		if (activeFetchCount == 0 || startedFetch)
+		{
+			continue;
+		}
+
+		if (rebuildWaitEventSet)
+		{
+			if (waitEventSet != NULL)
+			{
+				FreeWaitEventSet(waitEventSet);
+			}
+
+			waitEventSet = BuildResultFetchWaitEventSet(fetchStates, connectionCount);
+			rebuildWaitEventSet = false;
+		}
+
+		SetCitusWaitState(CITUS_WAIT_INTERMEDIATE_RESULT);
+		int eventCount = WaitEventSetWait(waitEventSet, -1, events,
+										  connectionCount + 2, PG_WAIT_EXTENSION);
+		SetCitusWaitState(CITUS_WAIT_NONE);
+
+		for (int eventIndex = 0; eventIndex < eventCount; eventIndex++)
+		{
+			WaitEvent *event = &events[eventIndex];
+
+			if (event->events & WL_POSTMASTER_DEATH)
+			{
+				ereport(ERROR, (errmsg("postmaster was shut down, exiting")));
+			}
+
+			if (event->events & WL_LATCH_SET)
+			{
+				ResetLatch(MyLatch);
+				CHECK_FOR_INTERRUPTS();
+			}
+		}
+	}
+
+	if (waitEventSet != NULL)
+	{
+		FreeWaitEventSet(waitEventSet);
+	}
+
+	foreach_ptr(connection, connectionList)
+	{
+		ExecuteCriticalRemoteCommand(connection, "END");
+
+		CloseConnection(connection);
+	}
+
+	return totalBytesWritten;
+}
+
+
+/*
+ * BuildResultFetchWaitEventSet creates a WaitEventSet that waits for the
+ * sockets of the connections that are still fetching a result, as well as
+ * for the latch and postmaster death.
+ */
+static WaitEventSet *
+BuildResultFetchWaitEventSet(ResultFetchState *fetchStates, int fetchStateCount)
+{
+	/* additional events for the latch and postmaster death */
+	int eventSetSize = fetchStateCount + 2;
+
+	WaitEventSet *waitEventSet = CreateWaitEventSet(CurrentMemoryContext, eventSetSize);
+
+	for (int fetchStateIndex = 0; fetchStateIndex < fetchStateCount; fetchStateIndex++)
+	{
+		ResultFetchState *fetchState = &fetchStates[fetchStateIndex];
+		if (fetchState->resultId == NULL)
+		{
+			continue;
+		}
+
+		int socket = PQsocket(fetchState->connection->pgConn);
+
+		AddWaitEventToSet(waitEventSet, WL_SOCKET_READABLE, socket, NULL,
+						  (void *) fetchState);
+	}
+
+	AddWaitEventToSet(waitEventSet, WL_POSTMASTER_DEATH, PGINVALID_SOCKET, NULL, NULL);
+	AddWaitEventToSet(waitEventSet, WL_LATCH_SET, PGINVALID_SOCKET, MyLatch, NULL);
+
+	return waitEventSet;
+}
+
+
+/*
+ * CopyDataFromConnection reads the copy data that the connection received and
+ * writes it to the given file. If decompress is true, each message is a
+ * compressed frame that is decompressed before writing.
+ *
+ * Each message usually holds a single row, so the messages are collected in
+ * the given buffer and written together once no more data can be read without
+ * blocking, or the buffer is full. The caller keeps the buffer across calls
+ * for the same connection.
  */
 static CopyStatus
 CopyDataFromConnection(MultiConnection *connection, FileCompat *fileCompat,
-					   uint64 *bytesReceived)
+					   StringInfo fileBuffer, uint64 *bytesReceived, bool decompress)
 {
 	/*
 	 * Consume input to handle the case where previous copy operation might have
@@ -950,22 +2448,31 @@ CopyDataFromConnection(MultiConnection *connection, FileCompat *fileCompat,
 	int receiveLength = PQgetCopyData(connection->pgConn, &receiveBuffer, asynchronous);
 	while (receiveLength > 0)
 	{
-		/* received copy data; append these data to file */
-		errno = 0;
+		int previousLength = fileBuffer->len;
 
-		int bytesWritten = FileWriteCompat(fileCompat, receiveBuffer,
-										   receiveLength, PG_WAIT_IO);
-		if (bytesWritten != receiveLength)
+		/* received copy data; append these data to the buffer */
+		if (decompress)
 		{
-			ereport(ERROR, (errcode_for_file_access(),
-							errmsg("could not append to file: %m")));
+			AppendDecompressedCopyFrame(fileBuffer, receiveBuffer, receiveLength);
+		}
+		else
+		{
+			appendBinaryStringInfo(fileBuffer, receiveBuffer, receiveLength);
 		}
 
-		*bytesReceived += receiveLength;
+		*bytesReceived += fileBuffer->len - previousLength;
 		PQfreemem(receiveBuffer);
+
+		if (fileBuffer->len >= LOCAL_FILE_BUFFER_SIZE)
+		{
+			WriteCopyDataToFile(fileCompat, fileBuffer);
+		}
+
 		receiveLength = PQgetCopyData(connection->pgConn, &receiveBuffer, asynchronous);
 	}
 
+	WriteCopyDataToFile(fileCompat, fileBuffer);
+
 	if (receiveLength == 0)
 	{
 		/* we cannot read more data without blocking */
@@ -1003,3 +2510,30 @@ CopyDataFromConnection(MultiConnection *connection, FileCompat *fileCompat,
 		return CLIENT_COPY_FAILED;
 	}
 }
+
+
+/*
+ * WriteCopyDataToFile appends the copy data in the given buffer to the file
+ * and resets the buffer.
+ */
+static void
+WriteCopyDataToFile(FileCompat *fileCompat, StringInfo fileBuffer)
+{
+	if (fileBuffer->len == 0)
+	{
+		return;
+	}
+
+	ReserveJobCacheSpace(fileBuffer->len);
+	errno = 0;
+
+	int bytesWritten = FileWriteWithWriteback(fileCompat, fileBuffer->data,
+											  fileBuffer->len, PG_WAIT_IO);
+	if (bytesWritten != fileBuffer->len)
+	{
+		ereport(ERROR, (errcode_for_file_access(),
+						errmsg("could not append to file: %m")));
+	}
+
+	resetStringInfo(fileBuffer);
+}
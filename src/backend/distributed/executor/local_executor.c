@@ -62,7 +62,9 @@
  *
  *  There are also a few limitations/trade-offs that are worth mentioning.
  *  - The local execution on multiple shards might be slow because the execution
- *  has to happen one task at a time (e.g., no parallelism).
+ *  has to happen one task at a time (e.g., no parallelism across tasks). When
+ *  citus.enable_parallel_local_execution is set, the plans of read-only local
+ *  tasks may use PostgreSQL's parallel workers to scan the shards instead.
  *  - If a transaction block/CTE starts with a multi-shard command, we do not
  *  use local query execution since local execution is sequential. Basically,
  *  we do not want to lose parallelism across local tasks by switching to local
@@ -77,9 +79,12 @@
 #include "miscadmin.h"
 
 #include "distributed/commands/utility_hook.h"
+#include "catalog/namespace.h"
 #include "distributed/citus_custom_scan.h"
+#include "distributed/citus_nodefuncs.h"
 #include "distributed/citus_ruleutils.h"
 #include "distributed/deparse_shard_query.h"
+#include "distributed/distributed_snapshot.h"
 #include "distributed/listutils.h"
 #include "distributed/local_executor.h"
 #include "distributed/multi_executor.h"
@@ -87,8 +92,11 @@
 #include "distributed/metadata_cache.h"
 #include "distributed/relation_access_tracking.h"
 #include "distributed/remote_commands.h" /* to access LogRemoteCommands */
+#include "distributed/shard_query_stats.h"
+#include "distributed/stat_counters.h"
 #include "distributed/transaction_management.h"
 #include "distributed/worker_protocol.h"
+#include "executor/executor.h"
 #include "executor/tstoreReceiver.h"
 #include "executor/tuptable.h"
 #if PG_VERSION_NUM >= 120000
@@ -96,12 +104,16 @@
 #else
 #include "optimizer/planner.h"
 #endif
+#include "nodes/nodeFuncs.h"
 #include "nodes/params.h"
+#include "portability/instr_time.h"
+#include "utils/lsyscache.h"
 #include "utils/snapmgr.h"
 
 
 /* controlled via a GUC */
 bool EnableLocalExecution = true;
+bool EnableParallelLocalExecution = false;
 bool LogLocalCommands = false;
 
 bool TransactionAccessedLocalPlacement = false;
@@ -111,9 +123,12 @@ bool TransactionConnectedToLocalGroup = false;
 static void SplitLocalAndRemotePlacements(List *taskPlacementList,
 										  List **localTaskPlacementList,
 										  List **remoteTaskPlacementList);
+static PlannedStmt * PlanLocalTask(CitusScanState *scanState, Task *task);
+static bool ConvertShardRtesToLocalRelations(Node *node, List **shardRelationIdList);
 static uint64 ExecuteLocalTaskPlan(CitusScanState *scanState, PlannedStmt *taskPlan,
 								   char *queryString);
 static void LogLocalCommand(Task *task);
+static void RecordLocalTaskExecution(uint64 shardId, instr_time startTime);
 static void ExtractParametersForLocalExecution(ParamListInfo paramListInfo,
 											   Oid **parameterTypes,
 											   const char ***parameterValues);
@@ -132,102 +147,421 @@ static void LocallyExecuteUdfTaskQuery(Query *localUdfCommandQuery);
 uint64
 ExecuteLocalTaskList(CitusScanState *scanState, List *taskList)
 {
-	EState *executorState = ScanStateGetExecutorState(scanState);
-	DistributedPlan *distributedPlan = scanState->distributedPlan;
-	ParamListInfo paramListInfo = copyParamList(executorState->es_param_list_info);
-	int numParams = 0;
-	Oid *parameterTypes = NULL;
 	uint64 totalRowsProcessed = 0;
 
-	if (paramListInfo != NULL)
+	Task *task = NULL;
+	foreach_ptr(task, taskList)
 	{
-		/* not used anywhere, so declare here */
-		const char **parameterValues = NULL;
+		instr_time startTime;
 
-		ExtractParametersForLocalExecution(paramListInfo, &parameterTypes,
-										   &parameterValues);
+		INSTR_TIME_SET_CURRENT(startTime);
 
-		numParams = paramListInfo->numParams;
+		PlannedStmt *localPlan = PlanLocalTask(scanState, task);
+
+		LogLocalCommand(task);
+
+		char *shardQueryString = task->queryStringLazy
+								 ? task->queryStringLazy
+								 : "<optimized out by local execution>";
+
+		totalRowsProcessed +=
+			ExecuteLocalTaskPlan(scanState, localPlan, shardQueryString);
+
+		RecordLocalTaskExecution(task->anchorShardId, startTime);
 	}
 
-	Task *task = NULL;
-	foreach_ptr(task, taskList)
+	return totalRowsProcessed;
+}
+
+
+/*
+ * StartLocalTaskStreaming starts the execution of the given read-only local
+ * task, such that CitusExecScan can return the rows of the task straight from
+ * its plan via ReturnTupleFromLocalTask rather than storing them in the tuple
+ * store first.
+ *
+ * Plans that use parallel workers need the backend to stay in parallel mode
+ * for as long as they run, which we cannot do while control is back in the
+ * postgres executor. The rows of such plans are stored in the tuple store.
+ */
+void
+StartLocalTaskStreaming(CitusScanState *scanState, Task *task)
+{
+	EState *executorState = ScanStateGetExecutorState(scanState);
+	ParamListInfo paramListInfo = executorState->es_param_list_info;
+	QueryEnvironment *queryEnv = create_queryEnv();
+	int eflags = 0;
+	instr_time startTime;
+
+	INSTR_TIME_SET_CURRENT(startTime);
+
+	PlannedStmt *localPlan = PlanLocalTask(scanState, task);
+
+	LogLocalCommand(task);
+
+	char *shardQueryString = task->queryStringLazy
+							 ? task->queryStringLazy
+							 : "<optimized out by local execution>";
+
+	if (localPlan->parallelModeNeeded || localPlan->commandType != CMD_SELECT)
+	{
+		ExecuteLocalTaskPlan(scanState, localPlan, shardQueryString);
+		RecordLocalTaskExecution(task->anchorShardId, startTime);
+		return;
+	}
+
+	/* the rows are returned one at a time, so no receiver is needed */
+	QueryDesc *queryDesc = CreateQueryDesc(localPlan, shardQueryString,
+										   GetActiveSnapshot(), InvalidSnapshot,
+										   None_Receiver, paramListInfo,
+										   queryEnv, 0);
+
+	ExecutorStart(queryDesc, eflags);
+
+	scanState->localQueryDesc = queryDesc;
+	scanState->localTaskShardId = task->anchorShardId;
+	scanState->localTaskStartTime = startTime;
+}
+
+
+/*
+ * ReturnTupleFromLocalTask returns the next tuple of the local task whose
+ * execution was started by StartLocalTaskStreaming. The values of the tuple
+ * are stored in the scan tuple slot without copying them, which means they
+ * are only valid until the next tuple is fetched. Once the task returns no
+ * more tuples, its execution is finished.
+ */
+TupleTableSlot *
+ReturnTupleFromLocalTask(CitusScanState *scanState)
+{
+	QueryDesc *queryDesc = scanState->localQueryDesc;
+	EState *localExecutorState = queryDesc->estate;
+	TupleTableSlot *scanSlot = scanState->customScanState.ss.ss_ScanTupleSlot;
+	int columnCount = scanSlot->tts_tupleDescriptor->natts;
+
+	ExprState *qual = scanState->customScanState.ss.ps.qual;
+	ProjectionInfo *projInfo = scanState->customScanState.ss.ps.ps_ProjInfo;
+	ExprContext *econtext = scanState->customScanState.ss.ps.ps_ExprContext;
+
+	for (;;)
 	{
+		CHECK_FOR_INTERRUPTS();
+
 		/*
-		 * If we have a valid shard id, a distributed table will be accessed
-		 * during execution. Record it to apply the restrictions related to
-		 * local execution.
+		 * Reset per-tuple memory context to free any expression evaluation
+		 * storage allocated in the previous tuple cycle.
 		 */
-		if (task->anchorShardId != INVALID_SHARD_ID)
+		ResetExprContext(econtext);
+
+		/* the local plan expects to run in its own query context */
+		MemoryContext oldContext =
+			MemoryContextSwitchTo(localExecutorState->es_query_cxt);
+
+		TupleTableSlot *localSlot = ExecProcNode(queryDesc->planstate);
+		if (!TupIsNull(localSlot) && localExecutorState->es_junkFilter != NULL)
 		{
-			TransactionAccessedLocalPlacement = true;
+			/* remove the sort and group columns that are not in the target list */
+			localSlot = ExecFilterJunk(localExecutorState->es_junkFilter, localSlot);
 		}
 
-		PlannedStmt *localPlan = GetCachedLocalPlan(task, distributedPlan);
+		MemoryContextSwitchTo(oldContext);
 
-		/*
-		 * If the plan is already cached, don't need to re-plan, just
-		 * acquire necessary locks.
-		 */
-		if (localPlan != NULL)
+		ExecClearTuple(scanSlot);
+
+		if (TupIsNull(localSlot))
 		{
-			Query *jobQuery = distributedPlan->workerJob->jobQuery;
-			LOCKMODE lockMode =
-				IsModifyCommand(jobQuery) ? RowExclusiveLock : (jobQuery->hasForUpdate ?
-																RowShareLock :
-																AccessShareLock);
+			FinishLocalTaskStreaming(scanState);
 
-			Oid relationId = InvalidOid;
-			foreach_oid(relationId, localPlan->relationOids)
+			if (projInfo)
 			{
-				LockRelationOid(relationId, lockMode);
+				return ExecClearTuple(projInfo->pi_state.resultslot);
 			}
+			else
+			{
+				return scanSlot;
+			}
+		}
+
+		Assert(localSlot->tts_tupleDescriptor->natts == columnCount);
+
+		/* point the scan tuple at the values in the slot of the local plan */
+		slot_getallattrs(localSlot);
+		memcpy(scanSlot->tts_values, localSlot->tts_values, columnCount * sizeof(Datum));
+		memcpy(scanSlot->tts_isnull, localSlot->tts_isnull, columnCount * sizeof(bool));
+		ExecStoreVirtualTuple(scanSlot);
+
+		/* place the current tuple into the expr context */
+		econtext->ecxt_scantuple = scanSlot;
+
+		if (qual && !ExecQual(qual, econtext))
+		{
+			/* skip nodes that do not satisfy the qual (filter) */
+			InstrCountFiltered1(scanState, 1);
+			continue;
+		}
+
+		if (projInfo)
+		{
+			return ExecProject(projInfo);
 		}
 		else
 		{
-			int taskNumParams = numParams;
-			Oid *taskParameterTypes = parameterTypes;
+			return scanSlot;
+		}
+	}
+}
+
+
+/*
+ * FinishLocalTaskStreaming ends the execution of the local task that is
+ * streamed by the given scan, for instance because all of its rows have been
+ * returned or because a LIMIT on top of the scan needs no more rows.
+ */
+void
+FinishLocalTaskStreaming(CitusScanState *scanState)
+{
+	QueryDesc *queryDesc = scanState->localQueryDesc;
+
+	if (queryDesc == NULL)
+	{
+		return;
+	}
+
+	scanState->localQueryDesc = NULL;
+
+	ExecutorFinish(queryDesc);
+	ExecutorEnd(queryDesc);
+
+	FreeQueryDesc(queryDesc);
+
+	RecordLocalTaskExecution(scanState->localTaskShardId,
+							 scanState->localTaskStartTime);
+}
+
+
+/*
+ * RecordLocalTaskExecution records the execution of a local task on the given
+ * shard that started at startTime in the shard query statistics and the stat
+ * counters.
+ */
+static void
+RecordLocalTaskExecution(uint64 shardId, instr_time startTime)
+{
+	instr_time executionTime;
+
+	IncrementStatCounter(STAT_LOCAL_TASKS_EXECUTED);
+
+	INSTR_TIME_SET_CURRENT(executionTime);
+	INSTR_TIME_SUBTRACT(executionTime, startTime);
+
+	RecordShardQueryExecution(shardId, INSTR_TIME_GET_MILLISEC(executionTime));
+}
+
+
+/*
+ * PlanLocalTask returns the plan of the given local task, which is either
+ * taken from the local plan cache of the distributed plan, or planned from the
+ * query string of the task.
+ */
+static PlannedStmt *
+PlanLocalTask(CitusScanState *scanState, Task *task)
+{
+	EState *executorState = ScanStateGetExecutorState(scanState);
+	DistributedPlan *distributedPlan = scanState->distributedPlan;
+
+	/*
+	 * If we have a valid shard id, a distributed table will be accessed
+	 * during execution. Record it to apply the restrictions related to
+	 * local execution.
+	 */
+	if (task->anchorShardId != INVALID_SHARD_ID)
+	{
+		TransactionAccessedLocalPlacement = true;
+	}
+
+	PlannedStmt *localPlan = GetCachedLocalPlan(task, distributedPlan);
+
+	/*
+	 * If the plan is already cached, don't need to re-plan, just
+	 * acquire necessary locks.
+	 */
+	if (localPlan != NULL)
+	{
+		Query *jobQuery = distributedPlan->workerJob->jobQuery;
+		LOCKMODE lockMode =
+			IsModifyCommand(jobQuery) ? RowExclusiveLock : (jobQuery->hasForUpdate ?
+															RowShareLock :
+															AccessShareLock);
+
+		Oid relationId = InvalidOid;
+		foreach_oid(relationId, localPlan->relationOids)
+		{
+			LockRelationOid(relationId, lockMode);
+		}
+
+		return localPlan;
+	}
+
+	ParamListInfo paramListInfo = copyParamList(executorState->es_param_list_info);
+	Query *shardQuery = LocalTaskQuery(task, paramListInfo);
+
+	int cursorOptions = 0;
+
+	/*
+	 * Local tasks are executed one at a time, so allow PostgreSQL to plan
+	 * parallel scans of the shard when it is cheaper. The planner only
+	 * uses parallel workers for read-only queries that are parallel safe.
+	 */
+	if (EnableParallelLocalExecution && shardQuery->commandType == CMD_SELECT &&
+		!shardQuery->hasForUpdate)
+	{
+		cursorOptions |= CURSOR_OPT_PARALLEL_OK;
+	}
+
+	/*
+	 * Altough the shardQuery is local to this node, we prefer planner()
+	 * over standard_planner(). The primary reason for that is Citus itself
+	 * is not very tolarent standard_planner() calls that doesn't go through
+	 * distributed_planner() because of the way that restriction hooks are
+	 * implemented. So, let planner to call distributed_planner() which
+	 * eventually calls standard_planner().
+	 */
+	return planner(shardQuery, cursorOptions, paramListInfo);
+}
+
+
+/*
+ * LocalTaskQuery returns the query tree to plan for executing the given local
+ * task. When the planner kept the query tree of the task, we return a copy of
+ * it in which the shards are referenced as local relations, which saves us from
+ * deparsing the query and parsing it again. Otherwise, the query string of the
+ * task is parsed using the types of the given parameters.
+ *
+ * The shards in a returned query tree are locked, as would have happened during
+ * parse analysis.
+ */
+Query *
+LocalTaskQuery(Task *task, ParamListInfo paramListInfo)
+{
+	Query *taskQuery = task->queryForLocalExecution;
+	int numParams = 0;
+	Oid *parameterTypes = NULL;
+
+	/* INSERTs name the shard only in their query string */
+	if (taskQuery != NULL && taskQuery->commandType != CMD_INSERT)
+	{
+		Query *shardQuery = copyObject(taskQuery);
+		List *shardRelationIdList = NIL;
+
+		if (!ConvertShardRtesToLocalRelations((Node *) shardQuery,
+											  &shardRelationIdList))
+		{
+			LOCKMODE lockMode =
+				IsModifyCommand(shardQuery) ? RowExclusiveLock :
+				(shardQuery->hasForUpdate ? RowShareLock : AccessShareLock);
 
-			if (task->parametersInQueryStringResolved)
+			Oid shardRelationId = InvalidOid;
+			foreach_oid(shardRelationId, shardRelationIdList)
 			{
-				/*
-				 * Parameters were removed from the query string so do not pass them
-				 * here. Otherwise, we might see errors when passing custom types,
-				 * since their OIDs were set to 0 and their type is normally
-				 * inferred from
-				 */
-				taskNumParams = 0;
-				taskParameterTypes = NULL;
+				LockRelationOid(shardRelationId, lockMode);
 			}
 
-			Query *shardQuery = ParseQueryString(TaskQueryString(task),
-												 taskParameterTypes,
-												 taskNumParams);
+			return shardQuery;
+		}
+	}
 
-			int cursorOptions = 0;
+	if (paramListInfo != NULL && !task->parametersInQueryStringResolved)
+	{
+		/* not used anywhere, so declare here */
+		const char **parameterValues = NULL;
 
-			/*
-			 * Altough the shardQuery is local to this node, we prefer planner()
-			 * over standard_planner(). The primary reason for that is Citus itself
-			 * is not very tolarent standard_planner() calls that doesn't go through
-			 * distributed_planner() because of the way that restriction hooks are
-			 * implemented. So, let planner to call distributed_planner() which
-			 * eventually calls standard_planner().
-			 */
-			localPlan = planner(shardQuery, cursorOptions, paramListInfo);
-		}
+		ExtractParametersForLocalExecution(paramListInfo, &parameterTypes,
+										   &parameterValues);
 
-		LogLocalCommand(task);
+		numParams = paramListInfo->numParams;
+	}
 
-		char *shardQueryString = task->queryStringLazy
-								 ? task->queryStringLazy
-								 : "<optimized out by local execution>";
+	/*
+	 * If parameters were removed from the query string, we do not pass them
+	 * here. Otherwise, we might see errors when passing custom types, since
+	 * their OIDs were set to 0 and their type is normally inferred from the
+	 * query string.
+	 */
+	return ParseQueryString(TaskQueryString(task), parameterTypes, numParams);
+}
 
-		totalRowsProcessed +=
-			ExecuteLocalTaskPlan(scanState, localPlan, shardQueryString);
+
+/*
+ * ConvertShardRtesToLocalRelations walks over the query tree and turns the
+ * range table entries that refer to shards by name back into relation range
+ * table entries of the local shard tables, whose OIDs are appended to the given
+ * list. The function returns true if it finds a range table entry that cannot
+ * be planned locally, in which case the query string should be used instead.
+ */
+static bool
+ConvertShardRtesToLocalRelations(Node *node, List **shardRelationIdList)
+{
+	if (node == NULL)
+	{
+		return false;
 	}
 
-	return totalRowsProcessed;
+	/* want to look at all RTEs, even in subqueries, CTEs and such */
+	if (IsA(node, Query))
+	{
+		return query_tree_walker((Query *) node, ConvertShardRtesToLocalRelations,
+								 shardRelationIdList, QTW_EXAMINE_RTES_BEFORE);
+	}
+
+	if (!IsA(node, RangeTblEntry))
+	{
+		return expression_tree_walker(node, ConvertShardRtesToLocalRelations,
+									  shardRelationIdList);
+	}
+
+	RangeTblEntry *rangeTableEntry = (RangeTblEntry *) node;
+	CitusRTEKind rteKind = GetRangeTblKind(rangeTableEntry);
+
+	if (rteKind == CITUS_RTE_RELATION)
+	{
+		/* distributed tables should have been replaced by their shards */
+		return IsCitusTable(rangeTableEntry->relid);
+	}
+	else if (rteKind == CITUS_RTE_REMOTE_QUERY)
+	{
+		return true;
+	}
+	else if (rteKind != CITUS_RTE_SHARD)
+	{
+		return false;
+	}
+
+	char *shardSchemaName = NULL;
+	char *shardRelationName = NULL;
+	ExtractRangeTblExtraData(rangeTableEntry, NULL, &shardSchemaName,
+							 &shardRelationName, NULL);
+
+	bool missingOk = true;
+	Oid shardSchemaId = get_namespace_oid(shardSchemaName, missingOk);
+	if (shardSchemaId == InvalidOid)
+	{
+		return true;
+	}
+
+	Oid shardRelationId = get_relname_relid(shardRelationName, shardSchemaId);
+	if (shardRelationId == InvalidOid)
+	{
+		return true;
+	}
+
+	rangeTableEntry->rtekind = RTE_RELATION;
+	rangeTableEntry->relid = shardRelationId;
+	rangeTableEntry->relkind = get_rel_relkind(shardRelationId);
+	rangeTableEntry->functions = NIL;
+
+	*shardRelationIdList = lappend_oid(*shardRelationIdList, shardRelationId);
+
+	return false;
 }
 
 
@@ -570,6 +904,12 @@ ShouldExecuteTasksLocally(List *taskList)
 		return false;
 	}
 
+	if (InDistributedSnapshot())
+	{
+		/* the local node is read over a connection that imports its snapshot */
+		return false;
+	}
+
 	if (TransactionAccessedLocalPlacement)
 	{
 		bool isValidLocalExecutionPath PG_USED_FOR_ASSERTS_ONLY = false;
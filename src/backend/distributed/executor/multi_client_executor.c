@@ -18,8 +18,10 @@
 #include "miscadmin.h"
 
 #include "commands/dbcommands.h"
+#include "distributed/job_cache_space.h"
 #include "distributed/metadata_cache.h"
 #include "distributed/connection_management.h"
+#include "distributed/copy_compression.h"
 #include "distributed/multi_executor.h"
 #include "distributed/multi_client_executor.h"
 #include "distributed/multi_server_executor.h"
@@ -48,6 +50,8 @@ static PostgresPollingStatusType ClientPollingStatusArray[MAX_CONNECTION_COUNT];
 /* Local functions forward declarations */
 static bool ClientConnectionReady(MultiConnection *connection,
 								  PostgresPollingStatusType pollingStatus);
+static CopyStatus ClientCopyDataToFile(int32 connectionId, int32 fileDescriptor,
+									   bool decompress, uint64 *returnBytesReceived);
 
 
 /* AllocateConnectionId returns a connection id from the connection pool. */
@@ -511,8 +515,42 @@ MultiClientQueryStatus(int32 connectionId)
 /* MultiClientCopyData copies data from the file. */
 CopyStatus
 MultiClientCopyData(int32 connectionId, int32 fileDescriptor, uint64 *returnBytesReceived)
+{
+	bool decompress = false;
+
+	return ClientCopyDataToFile(connectionId, fileDescriptor, decompress,
+								returnBytesReceived);
+}
+
+
+/*
+ * MultiClientCopyDecompressedData copies data from the file like
+ * MultiClientCopyData, except that every copy data message is a frame created
+ * by AppendCompressedCopyFrame, which we decompress as it arrives.
+ */
+CopyStatus
+MultiClientCopyDecompressedData(int32 connectionId, int32 fileDescriptor,
+								uint64 *returnBytesReceived)
+{
+	bool decompress = true;
+
+	return ClientCopyDataToFile(connectionId, fileDescriptor, decompress,
+								returnBytesReceived);
+}
+
+
+/*
+ * ClientCopyDataToFile appends the copy data that has arrived on the given
+ * connection to the given file, decompressing it first if decompress is true.
+ * The function does not block, and returns whether the copy is done, needs
+ * more data, or failed.
+ */
+static CopyStatus
+ClientCopyDataToFile(int32 connectionId, int32 fileDescriptor, bool decompress,
+					 uint64 *returnBytesReceived)
 {
 	char *receiveBuffer = NULL;
+	StringInfo rawData = NULL;
 	const int asynchronous = 1;
 	CopyStatus copyStatus = CLIENT_INVALID_COPY;
 
@@ -531,6 +569,11 @@ MultiClientCopyData(int32 connectionId, int32 fileDescriptor, uint64 *returnByte
 		return CLIENT_COPY_FAILED;
 	}
 
+	if (decompress)
+	{
+		rawData = makeStringInfo();
+	}
+
 	/* receive copy data message in an asynchronous manner */
 	int receiveLength = PQgetCopyData(connection->pgConn, &receiveBuffer, asynchronous);
 	while (receiveLength > 0)
@@ -543,8 +586,22 @@ MultiClientCopyData(int32 connectionId, int32 fileDescriptor, uint64 *returnByte
 			*returnBytesReceived += receiveLength;
 		}
 
-		int appended = write(fileDescriptor, receiveBuffer, receiveLength);
-		if (appended != receiveLength)
+		char *writeBuffer = receiveBuffer;
+		int writeLength = receiveLength;
+
+		if (decompress)
+		{
+			resetStringInfo(rawData);
+			AppendDecompressedCopyFrame(rawData, receiveBuffer, receiveLength);
+
+			writeBuffer = rawData->data;
+			writeLength = rawData->len;
+		}
+
+		ReserveJobCacheSpace(writeLength);
+
+		int appended = write(fileDescriptor, writeBuffer, writeLength);
+		if (appended != writeLength)
 		{
 			/* if write didn't set errno, assume problem is no disk space */
 			if (errno == 0)
@@ -600,6 +657,12 @@ MultiClientCopyData(int32 connectionId, int32 fileDescriptor, uint64 *returnByte
 		ForgetResults(connection);
 	}
 
+	if (rawData != NULL)
+	{
+		pfree(rawData->data);
+		pfree(rawData);
+	}
+
 	return copyStatus;
 }
 
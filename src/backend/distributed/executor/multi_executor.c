@@ -19,6 +19,7 @@
 #include "distributed/citus_custom_scan.h"
 #include "distributed/commands/multi_copy.h"
 #include "distributed/commands/utility_hook.h"
+#include "distributed/connection_management.h"
 #include "distributed/insert_select_executor.h"
 #include "distributed/insert_select_planner.h"
 #include "distributed/listutils.h"
@@ -84,6 +85,16 @@ CitusExecutorStart(QueryDesc *queryDesc, int eflags)
 {
 	PlannedStmt *plannedStmt = queryDesc->plannedstmt;
 
+	/* make sure the commits of the previous transaction finished on all workers */
+	WaitForPendingCommitPrepared();
+
+	/* open cached connections before the first distributed query, if enabled */
+	if (WarmUpConnectionCount > 0 && !(eflags & EXEC_FLAG_EXPLAIN_ONLY) &&
+		IsCitusPlan(plannedStmt->planTree))
+	{
+		WarmUpConnectionsIfNeeded();
+	}
+
 	/*
 	 * We cannot modify XactReadOnly on Windows because it is not
 	 * declared with PGDLLIMPORT.
@@ -754,15 +765,6 @@ IsLocalReferenceTableJoinPlan(PlannedStmt *plan)
 	bool hasLocalTable = false;
 	bool hasReferenceTableReplica = false;
 
-	/*
-	 * We only allow join between reference tables and local tables in the
-	 * coordinator.
-	 */
-	if (!IsCoordinator())
-	{
-		return false;
-	}
-
 	/*
 	 * All groups that have pg_dist_node entries, also have reference
 	 * table replicas.
@@ -770,7 +772,7 @@ IsLocalReferenceTableJoinPlan(PlannedStmt *plan)
 	PrimaryNodeForGroup(GetLocalGroupId(), &hasReferenceTableReplica);
 
 	/*
-	 * If reference table doesn't have replicas on the coordinator, we don't
+	 * If reference table doesn't have replicas on this node, we don't
 	 * allow joins with local tables.
 	 */
 	if (!hasReferenceTableReplica)
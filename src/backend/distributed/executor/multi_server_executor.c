@@ -37,8 +37,6 @@ bool BinaryMasterCopyFormat = false; /* copy data from workers in binary format
 bool EnableRepartitionJoins = false;
 
 
-static bool HasReplicatedDistributedTable(List *relationOids);
-
 /*
  * JobExecutorType selects the executor type for the given distributedPlan using the task
  * executor type config value. The function then checks if the given distributedPlan needs
@@ -96,8 +94,12 @@ JobExecutorType(DistributedPlan *distributedPlan)
 
 	if (executorType == MULTI_EXECUTOR_ADAPTIVE)
 	{
-		/* if we have repartition jobs with adaptive executor and repartition
-		 * joins are not enabled, error out. Otherwise, switch to task-tracker
+		/*
+		 * If we have repartition jobs with adaptive executor and repartition
+		 * joins are not enabled, error out. Otherwise, the adaptive executor
+		 * runs the map, fetch and merge tasks in their dependency order. This
+		 * includes tables with replicated shards, where map tasks fail over to
+		 * other placements and fetch tasks follow the placement they ran on.
 		 */
 		int dependentJobCount = list_length(job->dependentJobList);
 		if (dependentJobCount > 0)
@@ -109,10 +111,6 @@ JobExecutorType(DistributedPlan *distributedPlan)
 								errhint("Set citus.enable_repartition_joins to on "
 										"to enable repartitioning")));
 			}
-			if (HasReplicatedDistributedTable(distributedPlan->relationIdList))
-			{
-				return MULTI_EXECUTOR_TASK_TRACKER;
-			}
 			return MULTI_EXECUTOR_ADAPTIVE;
 		}
 	}
@@ -135,33 +133,6 @@ JobExecutorType(DistributedPlan *distributedPlan)
 }
 
 
-/*
- * HasReplicatedDistributedTable returns true if there is any
- * table in the given list that is:
- * - not a reference table
- * - has replication factor > 1
- */
-static bool
-HasReplicatedDistributedTable(List *relationOids)
-{
-	Oid oid;
-	foreach_oid(oid, relationOids)
-	{
-		char partitionMethod = PartitionMethod(oid);
-		if (partitionMethod == DISTRIBUTE_BY_NONE)
-		{
-			continue;
-		}
-		uint32 tableReplicationFactor = TableShardReplicationFactor(oid);
-		if (tableReplicationFactor > 1)
-		{
-			return true;
-		}
-	}
-	return false;
-}
-
-
 /*
  * MaxMasterConnectionCount returns the number of connections a master can open.
  * A master cannot create more than a certain number of file descriptors (FDs).
@@ -30,6 +30,7 @@
 #include "distributed/connection_management.h"
 #include "distributed/deparse_shard_query.h"
 #include "distributed/distributed_execution_locks.h"
+#include "distributed/job_cache_space.h"
 #include "distributed/listutils.h"
 #include "distributed/local_executor.h"
 #include "distributed/metadata_cache.h"
@@ -108,7 +109,6 @@ static TransmitExecStatus ManageTransmitExecution(TaskTracker *transmitTracker,
 												  DistributedExecutionStats *
 												  executionStats);
 static bool TaskExecutionsCompleted(List *taskList);
-static StringInfo MapFetchTaskQueryString(Task *mapFetchTask, Task *mapTask);
 static void TrackerQueueSqlTask(TaskTracker *taskTracker, Task *task);
 static void TrackerQueueTask(TaskTracker *taskTracker, Task *task);
 static StringInfo TaskAssignmentQuery(Task *task, char *queryString);
@@ -1523,7 +1523,7 @@ TaskExecutionsCompleted(List *taskList)
  * query string allows fetching the map task's partitioned output file from the
  * worker node it's created to the worker node that will execute the merge task.
  */
-static StringInfo
+StringInfo
 MapFetchTaskQueryString(Task *mapFetchTask, Task *mapTask)
 {
 	uint32 partitionFileId = mapFetchTask->partitionId;
@@ -1545,7 +1545,8 @@ MapFetchTaskQueryString(Task *mapFetchTask, Task *mapTask)
 	appendStringInfo(mapFetchQueryString, MAP_OUTPUT_FETCH_COMMAND,
 					 mapTask->jobId, mapTask->taskId, partitionFileId,
 					 mergeTaskId, /* fetch results to merge task */
-					 mapTaskNodeName, mapTaskNodePort);
+					 mapTaskNodeName, mapTaskNodePort,
+					 EnablePartitionFetchCompression ? ", true" : "");
 
 	return mapFetchQueryString;
 }
@@ -2913,6 +2914,10 @@ TaskTrackerExecScan(CustomScanState *node)
 	}
 
 	TupleTableSlot *resultSlot = ReturnTupleFromTuplestore(scanState);
+	if (!TupIsNull(resultSlot))
+	{
+		scanState->rowsReturned++;
+	}
 
 	return resultSlot;
 }
@@ -2927,7 +2932,10 @@ static void
 PrepareMasterJobDirectory(Job *workerJob)
 {
 	StringInfo jobDirectoryName = MasterJobDirectoryName(workerJob->jobId);
-	CitusCreateDirectory(jobDirectoryName);
+	bool existsOk = false;
+
+	CheckJobCacheSpace();
+	CreateJobCacheDirectory(jobDirectoryName->data, existsOk);
 
 	ResourceOwnerEnlargeJobDirectories(CurrentResourceOwner);
 	ResourceOwnerRememberJobDirectory(CurrentResourceOwner, workerJob->jobId);
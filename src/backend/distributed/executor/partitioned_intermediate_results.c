@@ -19,21 +19,30 @@
 #include "access/nbtree.h"
 #include "catalog/pg_am.h"
 #include "catalog/pg_type.h"
+#include "distributed/commands/multi_copy.h"
+#include "distributed/connection_management.h"
 #include "distributed/intermediate_results.h"
 #include "distributed/master_metadata_utility.h"
 #include "distributed/metadata_cache.h"
 #include "distributed/multi_executor.h"
 #include "distributed/pg_dist_shard.h"
 #include "distributed/remote_commands.h"
+#include "distributed/transaction_management.h"
 #include "distributed/tuplestore.h"
 #include "distributed/worker_protocol.h"
 #include "nodes/makefuncs.h"
 #include "nodes/primnodes.h"
 #include "tcop/pquery.h"
 #include "tcop/tcopprot.h"
+#include "utils/builtins.h"
+#include "utils/lsyscache.h"
 #include "utils/typcache.h"
 
 
+/* number of bytes of COPY data to collect before pushing it to a node */
+#define PUSH_BUFFER_SIZE (64 * 1024)
+
+
 /*
  * PartitionedResultDestReceiver is used for streaming tuples into a set of
  * partitioned result files.
@@ -63,13 +72,64 @@ typedef struct PartitionedResultDestReceiver
 	/* how many partitions do we have? */
 	int partitionCount;
 
+	/*
+	 * Node to which partition[i] is pushed, or NULL if it is written to a
+	 * local result file. The arrays are NULL if all partitions are local.
+	 */
+	char **partitionTargetNodeNames;
+	int *partitionTargetNodePorts;
+
 	/*
 	 * Tuples for partition[i] are sent to partitionDestReceivers[i], which
-	 * writes it to a result file.
+	 * writes it to a result file or pushes it to the target node.
 	 */
 	DestReceiver **partitionDestReceivers;
 } PartitionedResultDestReceiver;
 
+
+/*
+ * PartitionPushDestReceiver is used for streaming the tuples of a partition
+ * into a result file on another node over COPY.
+ */
+typedef struct PartitionPushDestReceiver
+{
+	/* public DestReceiver interface */
+	DestReceiver pub;
+
+	/* result id of the partition on the target node */
+	char *resultId;
+
+	/* target node */
+	char *nodeName;
+	int nodePort;
+
+	/* context for per-tuple memory allocation */
+	MemoryContext tupleContext;
+
+	/* MemoryContext for DestReceiver session */
+	MemoryContext memoryContext;
+
+	/* use binary copy or just text copy format? */
+	bool binaryCopy;
+
+	/* descriptor of the tuples that are sent to the node */
+	TupleDesc tupleDescriptor;
+
+	/* state on how to copy out data types */
+	CopyOutState copyOutState;
+	FmgrInfo *columnOutputFunctions;
+
+	/* connection to the target node */
+	MultiConnection *connection;
+
+	/* statistics */
+	uint64 tuplesSent;
+	uint64 bytesSent;
+} PartitionPushDestReceiver;
+
+
+static void PartitionQueryResult(FunctionCallInfo fcinfo, char **targetNodeNames,
+								 int *targetNodePorts);
 static Portal StartPortalForQueryExecution(const char *queryString);
 static CitusTableCacheEntry * QueryTupleShardSearchInfo(ArrayType *minValuesArray,
 														ArrayType *maxValuesArray,
@@ -94,9 +154,23 @@ static bool PartitionedResultDestReceiverReceive(TupleTableSlot *slot,
 												 DestReceiver *dest);
 static void PartitionedResultDestReceiverShutdown(DestReceiver *destReceiver);
 static void PartitionedResultDestReceiverDestroy(DestReceiver *destReceiver);
+static void PartitionDestReceiverStats(PartitionedResultDestReceiver *partitionedDest,
+									   int partitionIndex, uint64 *rowsSent,
+									   uint64 *bytesSent);
+static DestReceiver * CreatePartitionPushDestReceiver(char *resultId, char *nodeName,
+													  int nodePort,
+													  MemoryContext tupleContext,
+													  bool binaryCopy);
+static void PartitionPushDestReceiverStartup(DestReceiver *dest, int operation,
+											 TupleDesc inputTupleDescriptor);
+static bool PartitionPushDestReceiverReceive(TupleTableSlot *slot, DestReceiver *dest);
+static void PushCopyData(PartitionPushDestReceiver *pushDest);
+static void PartitionPushDestReceiverShutdown(DestReceiver *destReceiver);
+static void PartitionPushDestReceiverDestroy(DestReceiver *destReceiver);
 
 /* exports for SQL callable functions */
 PG_FUNCTION_INFO_V1(worker_partition_query_result);
+PG_FUNCTION_INFO_V1(worker_push_partitioned_query_result);
 
 
 /*
@@ -105,6 +179,94 @@ PG_FUNCTION_INFO_V1(worker_partition_query_result);
  */
 Datum
 worker_partition_query_result(PG_FUNCTION_ARGS)
+{
+	PartitionQueryResult(fcinfo, NULL, NULL);
+
+	PG_RETURN_INT64(1);
+}
+
+
+/*
+ * worker_push_partitioned_query_result executes a query and partitions the
+ * results like worker_partition_query_result, but streams each partition over
+ * COPY into a result file on the node given for it in target_node_names and
+ * target_node_ports while the query runs. Partitions whose target node name is
+ * NULL are written to local files.
+ *
+ * The results directory of the transaction must already exist on the target
+ * nodes and be owned by a backend that stays in the transaction, since the
+ * connections used for pushing are closed before this function returns.
+ */
+Datum
+worker_push_partitioned_query_result(PG_FUNCTION_ARGS)
+{
+	ArrayType *minValuesArray = PG_GETARG_ARRAYTYPE_P(4);
+	int32 partitionCount = ArrayObjectCount(minValuesArray);
+
+	ArrayType *targetNodeNamesArray = PG_GETARG_ARRAYTYPE_P(7);
+	ArrayType *targetNodePortsArray = PG_GETARG_ARRAYTYPE_P(8);
+
+	Datum *targetNodeNameDatums = NULL;
+	bool *targetNodeNameNulls = NULL;
+	int targetNodeNameCount = 0;
+	Datum *targetNodePortDatums = NULL;
+	bool *targetNodePortNulls = NULL;
+	int targetNodePortCount = 0;
+
+	CheckCitusVersion(ERROR);
+
+	deconstruct_array(targetNodeNamesArray, TEXTOID, -1, false, 'i',
+					  &targetNodeNameDatums, &targetNodeNameNulls,
+					  &targetNodeNameCount);
+	deconstruct_array(targetNodePortsArray, INT4OID, sizeof(int32), true, 'i',
+					  &targetNodePortDatums, &targetNodePortNulls,
+					  &targetNodePortCount);
+
+	if (targetNodeNameCount != partitionCount || targetNodePortCount != partitionCount)
+	{
+		ereport(ERROR, (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+						errmsg("target node names and ports must have the same "
+							   "number of elements as the partitions")));
+	}
+
+	char **targetNodeNames = palloc0(partitionCount * sizeof(char *));
+	int *targetNodePorts = palloc0(partitionCount * sizeof(int));
+
+	for (int partitionIndex = 0; partitionIndex < partitionCount; partitionIndex++)
+	{
+		if (targetNodeNameNulls[partitionIndex])
+		{
+			continue;
+		}
+
+		if (targetNodePortNulls[partitionIndex])
+		{
+			ereport(ERROR, (errcode(ERRCODE_NULL_VALUE_NOT_ALLOWED),
+							errmsg("target node port of partition %d cannot be NULL",
+								   partitionIndex)));
+		}
+
+		targetNodeNames[partitionIndex] =
+			TextDatumGetCString(targetNodeNameDatums[partitionIndex]);
+		targetNodePorts[partitionIndex] =
+			DatumGetInt32(targetNodePortDatums[partitionIndex]);
+	}
+
+	PartitionQueryResult(fcinfo, targetNodeNames, targetNodePorts);
+
+	PG_RETURN_INT64(1);
+}
+
+
+/*
+ * PartitionQueryResult implements worker_partition_query_result and
+ * worker_push_partitioned_query_result, which share their first arguments and
+ * their output. targetNodeNames and targetNodePorts give the node to push each
+ * partition to, or are NULL to write all partitions to local files.
+ */
+static void
+PartitionQueryResult(FunctionCallInfo fcinfo, char **targetNodeNames,
+					 int *targetNodePorts)
 {
 	ReturnSetInfo *resultInfo = (ReturnSetInfo *) fcinfo->resultinfo;
 
@@ -139,8 +301,8 @@ worker_partition_query_result(PG_FUNCTION_ARGS)
 
 	if (!IsMultiStatementTransaction())
 	{
-		ereport(ERROR, (errmsg("worker_partition_query_result can only be used in a "
-							   "transaction block")));
+		ereport(ERROR, (errmsg("%s can only be used in a transaction block",
+							   get_func_name(fcinfo->flinfo->fn_oid))));
 	}
 
 	/*
@@ -205,6 +367,8 @@ worker_partition_query_result(PG_FUNCTION_ARGS)
 		CreatePartitionedResultDestReceiver(resultIdPrefixString, partitionColumnIndex,
 											partitionCount, tupleDescriptor, binaryCopy,
 											shardSearchInfo, tupleContext);
+	dest->partitionTargetNodeNames = targetNodeNames;
+	dest->partitionTargetNodePorts = targetNodePorts;
 
 	/* execute the query */
 	PortalRun(portal, FETCH_ALL, false, true, (DestReceiver *) dest,
@@ -224,11 +388,8 @@ worker_partition_query_result(PG_FUNCTION_ARGS)
 		Datum values[3];
 		bool nulls[3];
 
-		if (dest->partitionDestReceivers[partitionIndex] != NULL)
-		{
-			FileDestReceiverStats(dest->partitionDestReceivers[partitionIndex],
-								  &recordsWritten, &bytesWritten);
-		}
+		PartitionDestReceiverStats(dest, partitionIndex, &recordsWritten,
+								   &bytesWritten);
 
 		memset(values, 0, sizeof(values));
 		memset(nulls, 0, sizeof(nulls));
@@ -243,8 +404,6 @@ worker_partition_query_result(PG_FUNCTION_ARGS)
 	tuplestore_donestoring(tupleStore);
 	PortalDrop(portal, false);
 	FreeExecutorState(estate);
-
-	PG_RETURN_INT64(1);
 }
 
 
@@ -458,10 +617,29 @@ PartitionedResultDestReceiverReceive(TupleTableSlot *slot, DestReceiver *copyDes
 		StringInfo resultId = makeStringInfo();
 		appendStringInfo(resultId, "%s_%d", partitionedDest->resultIdPrefix,
 						 partitionIndex);
-		char *filePath = QueryResultFileName(resultId->data);
 
-		partitionDest = CreateFileDestReceiver(filePath, partitionedDest->perTupleContext,
-											   partitionedDest->binaryCopy);
+		char **targetNodeNames = partitionedDest->partitionTargetNodeNames;
+		if (targetNodeNames != NULL && targetNodeNames[partitionIndex] != NULL)
+		{
+			int targetNodePort = partitionedDest->partitionTargetNodePorts[partitionIndex];
+
+			partitionDest = CreatePartitionPushDestReceiver(resultId->data,
+															targetNodeNames[
+																partitionIndex],
+															targetNodePort,
+															partitionedDest->
+															perTupleContext,
+															partitionedDest->binaryCopy);
+		}
+		else
+		{
+			char *filePath = QueryResultFileName(resultId->data);
+
+			partitionDest = CreateFileDestReceiver(filePath,
+												   partitionedDest->perTupleContext,
+												   partitionedDest->binaryCopy);
+		}
+
 		partitionedDest->partitionDestReceivers[partitionIndex] = partitionDest;
 		partitionDest->rStartup(partitionDest, 0, partitionedDest->tupleDescriptor);
 	}
@@ -518,3 +696,260 @@ PartitionedResultDestReceiverDestroy(DestReceiver *copyDest)
 	pfree(partitionedDest->partitionDestReceivers);
 	pfree(partitionedDest);
 }
+
+
+/*
+ * PartitionDestReceiverStats returns the number of rows and bytes that were
+ * written to or pushed for the given partition.
+ */
+static void
+PartitionDestReceiverStats(PartitionedResultDestReceiver *partitionedDest,
+						   int partitionIndex, uint64 *rowsSent, uint64 *bytesSent)
+{
+	DestReceiver *partitionDest = partitionedDest->partitionDestReceivers[partitionIndex];
+	char **targetNodeNames = partitionedDest->partitionTargetNodeNames;
+
+	if (partitionDest == NULL)
+	{
+		*rowsSent = 0;
+		*bytesSent = 0;
+	}
+	else if (targetNodeNames != NULL && targetNodeNames[partitionIndex] != NULL)
+	{
+		PartitionPushDestReceiver *pushDest = (PartitionPushDestReceiver *) partitionDest;
+
+		*rowsSent = pushDest->tuplesSent;
+		*bytesSent = pushDest->bytesSent;
+	}
+	else
+	{
+		FileDestReceiverStats(partitionDest, rowsSent, bytesSent);
+	}
+}
+
+
+/*
+ * CreatePartitionPushDestReceiver creates a DestReceiver for pushing the
+ * tuples of a partition into a result file on the given node.
+ */
+static DestReceiver *
+CreatePartitionPushDestReceiver(char *resultId, char *nodeName, int nodePort,
+								MemoryContext tupleContext, bool binaryCopy)
+{
+	PartitionPushDestReceiver *pushDest = palloc0(sizeof(PartitionPushDestReceiver));
+
+	/* set up the DestReceiver function pointers */
+	pushDest->pub.receiveSlot = PartitionPushDestReceiverReceive;
+	pushDest->pub.rStartup = PartitionPushDestReceiverStartup;
+	pushDest->pub.rShutdown = PartitionPushDestReceiverShutdown;
+	pushDest->pub.rDestroy = PartitionPushDestReceiverDestroy;
+	pushDest->pub.mydest = DestCopyOut;
+
+	/* set up output parameters */
+	pushDest->resultId = pstrdup(resultId);
+	pushDest->nodeName = nodeName;
+	pushDest->nodePort = nodePort;
+	pushDest->tupleContext = tupleContext;
+	pushDest->memoryContext = CurrentMemoryContext;
+	pushDest->binaryCopy = binaryCopy;
+
+	return (DestReceiver *) pushDest;
+}
+
+
+/*
+ * PartitionPushDestReceiverStartup implements the rStartup interface of
+ * PartitionPushDestReceiver. It opens a connection to the target node, joins
+ * the distributed transaction there so that the result ends up in the results
+ * directory of the transaction, and starts a COPY into the result file.
+ */
+static void
+PartitionPushDestReceiverStartup(DestReceiver *dest, int operation,
+								 TupleDesc inputTupleDescriptor)
+{
+	PartitionPushDestReceiver *pushDest = (PartitionPushDestReceiver *) dest;
+
+	const char *delimiterCharacter = "\t";
+	const char *nullPrintCharacter = "\\N";
+
+	int connectionFlags = FORCE_NEW_CONNECTION;
+	bool raiseInterrupts = true;
+
+	/* use the memory context that was in place when the DestReceiver was created */
+	MemoryContext oldContext = MemoryContextSwitchTo(pushDest->memoryContext);
+
+	pushDest->tupleDescriptor = inputTupleDescriptor;
+
+	/* define how tuples will be serialised */
+	CopyOutState copyOutState = (CopyOutState) palloc0(sizeof(CopyOutStateData));
+	copyOutState->delim = (char *) delimiterCharacter;
+	copyOutState->null_print = (char *) nullPrintCharacter;
+	copyOutState->null_print_client = (char *) nullPrintCharacter;
+	copyOutState->binary = pushDest->binaryCopy;
+	copyOutState->fe_msgbuf = makeStringInfo();
+	copyOutState->rowcontext = pushDest->tupleContext;
+	pushDest->copyOutState = copyOutState;
+
+	pushDest->columnOutputFunctions = ColumnOutputFunctions(inputTupleDescriptor,
+															copyOutState->binary);
+
+	MultiConnection *connection = GetNodeConnection(connectionFlags, pushDest->nodeName,
+													pushDest->nodePort);
+	if (PQstatus(connection->pgConn) != CONNECTION_OK)
+	{
+		ereport(ERROR, (errmsg("cannot connect to %s:%d to push intermediate results",
+							   pushDest->nodeName, pushDest->nodePort)));
+	}
+
+	StringInfo beginAndSetXactId = BeginAndSetDistributedTransactionIdCommand();
+	ExecuteCriticalRemoteCommand(connection, beginAndSetXactId->data);
+
+	StringInfo copyCommand = makeStringInfo();
+	appendStringInfo(copyCommand, "COPY \"%s\" FROM STDIN WITH (format result)",
+					 pushDest->resultId);
+
+	if (!SendRemoteCommand(connection, copyCommand->data))
+	{
+		ReportConnectionError(connection, ERROR);
+	}
+
+	PGresult *result = GetRemoteCommandResult(connection, raiseInterrupts);
+	if (PQresultStatus(result) != PGRES_COPY_IN)
+	{
+		ReportResultError(connection, result, ERROR);
+	}
+
+	PQclear(result);
+
+	pushDest->connection = connection;
+
+	if (copyOutState->binary)
+	{
+		/* send headers when using binary encoding */
+		AppendCopyBinaryHeaders(copyOutState);
+	}
+
+	MemoryContextSwitchTo(oldContext);
+}
+
+
+/*
+ * PartitionPushDestReceiverReceive implements the receiveSlot function of
+ * PartitionPushDestReceiver. It serializes the tuple and pushes the COPY data
+ * to the target node once enough of it has been collected.
+ */
+static bool
+PartitionPushDestReceiverReceive(TupleTableSlot *slot, DestReceiver *dest)
+{
+	PartitionPushDestReceiver *pushDest = (PartitionPushDestReceiver *) dest;
+
+	TupleDesc tupleDescriptor = pushDest->tupleDescriptor;
+
+	CopyOutState copyOutState = pushDest->copyOutState;
+	FmgrInfo *columnOutputFunctions = pushDest->columnOutputFunctions;
+
+	MemoryContext executorTupleContext = pushDest->tupleContext;
+	MemoryContext oldContext = MemoryContextSwitchTo(executorTupleContext);
+
+	slot_getallattrs(slot);
+
+	Datum *columnValues = slot->tts_values;
+	bool *columnNulls = slot->tts_isnull;
+
+	/* construct row in COPY format */
+	AppendCopyRowData(columnValues, columnNulls, tupleDescriptor,
+					  copyOutState, columnOutputFunctions, NULL);
+
+	if (copyOutState->fe_msgbuf->len > PUSH_BUFFER_SIZE)
+	{
+		PushCopyData(pushDest);
+	}
+
+	MemoryContextSwitchTo(oldContext);
+
+	pushDest->tuplesSent++;
+
+	MemoryContextReset(executorTupleContext);
+
+	return true;
+}
+
+
+/*
+ * PushCopyData sends the collected COPY data to the target node.
+ */
+static void
+PushCopyData(PartitionPushDestReceiver *pushDest)
+{
+	MultiConnection *connection = pushDest->connection;
+	StringInfo copyData = pushDest->copyOutState->fe_msgbuf;
+
+	if (!PutRemoteCopyData(connection, copyData->data, copyData->len))
+	{
+		ereport(ERROR, (errcode(ERRCODE_IO_ERROR),
+						errmsg("failed to push result \"%s\" to %s:%d",
+							   pushDest->resultId, connection->hostname,
+							   connection->port)));
+	}
+
+	pushDest->bytesSent += copyData->len;
+
+	resetStringInfo(copyData);
+}
+
+
+/*
+ * PartitionPushDestReceiverShutdown implements the rShutdown interface of
+ * PartitionPushDestReceiver. It sends the remaining data and the footer, ends
+ * the COPY and closes the connection. The result file stays on the target node
+ * since the results directory is owned by another backend there.
+ */
+static void
+PartitionPushDestReceiverShutdown(DestReceiver *destReceiver)
+{
+	PartitionPushDestReceiver *pushDest = (PartitionPushDestReceiver *) destReceiver;
+	CopyOutState copyOutState = pushDest->copyOutState;
+	MultiConnection *connection = pushDest->connection;
+
+	if (copyOutState->binary)
+	{
+		/* send footers when using binary encoding */
+		AppendCopyBinaryFooters(copyOutState);
+	}
+
+	if (copyOutState->fe_msgbuf->len > 0)
+	{
+		PushCopyData(pushDest);
+	}
+
+	EndRemoteCopy(0, list_make1(connection));
+
+	ExecuteCriticalRemoteCommand(connection, "END");
+
+	CloseConnection(connection);
+	pushDest->connection = NULL;
+}
+
+
+/*
+ * PartitionPushDestReceiverDestroy frees memory allocated as part of the
+ * PartitionPushDestReceiver.
+ */
+static void
+PartitionPushDestReceiverDestroy(DestReceiver *destReceiver)
+{
+	PartitionPushDestReceiver *pushDest = (PartitionPushDestReceiver *) destReceiver;
+
+	if (pushDest->copyOutState)
+	{
+		pfree(pushDest->copyOutState);
+	}
+
+	if (pushDest->columnOutputFunctions)
+	{
+		pfree(pushDest->columnOutputFunctions);
+	}
+
+	pfree(pushDest->resultId);
+	pfree(pushDest);
+}
@@ -3,6 +3,16 @@
  * query_stats.c
  *    Statement-level statistics for distributed queries.
  *
+ *    The custom scan records every execution of a distributed query in a
+ *    shared hash keyed by the query ID of pg_stat_statements, the executor
+ *    and the partition key value of router queries, such that the most
+ *    expensive distributed queries and the hottest partition keys can be
+ *    found through citus_stat_statements.
+ *
+ *    The size of the hash is limited by citus.stat_statements_max. When it
+ *    is full, the least called entries are removed to make room for new
+ *    ones, like in pg_stat_statements.
+ *
  * Copyright (c) Citus Data, Inc.
  *-------------------------------------------------------------------------
  */
@@ -10,57 +20,386 @@
 #include "postgres.h"
 
 #include "fmgr.h"
+#include "miscadmin.h"
 
+#include "catalog/pg_authid.h"
+#include "distributed/metadata_cache.h"
 #include "distributed/query_stats.h"
+#include "distributed/tuplestore.h"
+#include "mb/pg_wchar.h"
+#include "storage/ipc.h"
+#include "storage/lwlock.h"
+#include "storage/shmem.h"
+#include "storage/spin.h"
+#include "utils/acl.h"
 #include "utils/builtins.h"
+#include "utils/hsearch.h"
 
-PG_FUNCTION_INFO_V1(citus_stat_statements_reset);
-PG_FUNCTION_INFO_V1(citus_query_stats);
-PG_FUNCTION_INFO_V1(citus_executor_name);
+
+/* percentage of the entries that is removed when the hash is full */
+#define STAT_STATEMENTS_DEALLOC_PERCENT 5
+
+/* number of columns returned by citus_query_stats */
+#define CITUS_QUERY_STATS_COLUMNS 13
+
+
+/*
+ * QueryStatsControlData contains the lock that protects the shared hash of
+ * statement statistics.
+ */
+typedef struct QueryStatsControlData
+{
+	int trancheId;
+	char *lockTrancheName;
+	LWLock lock;
+} QueryStatsControlData;
+
+
+/*
+ * QueryStatsHashKey identifies the statistics of a query, which are kept
+ * separately per executor and partition key value. The partition key is
+ * truncated to fit, and is empty for queries without a partition key.
+ */
+typedef struct QueryStatsHashKey
+{
+	Oid userId;
+	Oid databaseId;
+	uint64 queryId;
+	MultiExecutorType executorType;
+	char partitionKey[NAMEDATALEN];
+} QueryStatsHashKey;
+
+
+/* hash entry for the statistics of a query */
+typedef struct QueryStatsHashEntry
+{
+	QueryStatsHashKey key;
+
+	slock_t mutex;
+	int64 calls;
+	double totalTimeMs;
+	double minTimeMs;
+	double maxTimeMs;
+	int64 taskCount;
+	int64 rowCount;
+	int64 bytesReceived;
+	int64 shardCount;
+} QueryStatsHashEntry;
 
 
+/*
+ * GUC, the maximum number of statements for which statistics are kept. 0
+ * disables the statistics.
+ */
+int StatStatementsMax = 50000;
+
+static shmem_startup_hook_type prev_shmem_startup_hook = NULL;
+static QueryStatsControlData *QueryStatsSharedState = NULL;
+static HTAB *QueryStatsHash = NULL;
+
+
+static size_t CitusQueryStatsShmemSize(void);
+static void CitusQueryStatsShmemInit(void);
+static void CitusQueryStatsEntryDealloc(void);
+static int CompareQueryStatsEntriesByCalls(const void *leftElement,
+										   const void *rightElement);
 static char * CitusExecutorName(MultiExecutorType executorType);
 
+PG_FUNCTION_INFO_V1(citus_stat_statements_reset);
+PG_FUNCTION_INFO_V1(citus_query_stats);
+PG_FUNCTION_INFO_V1(citus_executor_name);
 
-/* placeholder for InitializeCitusQueryStats */
+
+/*
+ * InitializeCitusQueryStats, called at server start, requests the shared
+ * memory for the statement statistics.
+ */
 void
 InitializeCitusQueryStats(void)
 {
-	/* placeholder for future implementation */
+	if (StatStatementsMax == 0)
+	{
+		return;
+	}
+
+	if (!IsUnderPostmaster)
+	{
+		RequestAddinShmemSpace(CitusQueryStatsShmemSize());
+	}
+
+	prev_shmem_startup_hook = shmem_startup_hook;
+	shmem_startup_hook = CitusQueryStatsShmemInit;
 }
 
 
-/* placeholder for CitusQueryStatsExecutorsEntry */
+/*
+ * CitusQueryStatsExecutorsEntry adds an execution of the given query by the
+ * given executor, with the given partition key value or NULL, to the
+ * statement statistics.
+ */
 void
 CitusQueryStatsExecutorsEntry(uint64 queryId, MultiExecutorType executorType,
-							  char *partitionKey)
+							  char *partitionKey,
+							  CitusQueryExecutionStats *executionStats)
+{
+	QueryStatsHashKey key;
+	bool found = false;
+
+	if (QueryStatsHash == NULL)
+	{
+		return;
+	}
+
+	/* the key is hashed as a blob, so the padding needs to be zeroed */
+	memset(&key, 0, sizeof(QueryStatsHashKey));
+	key.userId = GetUserId();
+	key.databaseId = MyDatabaseId;
+	key.queryId = queryId;
+	key.executorType = executorType;
+
+	if (partitionKey != NULL)
+	{
+		int partitionKeyLength = pg_mbcliplen(partitionKey, strlen(partitionKey),
+											  NAMEDATALEN - 1);
+		memcpy(key.partitionKey, partitionKey, partitionKeyLength);
+	}
+
+	LWLockAcquire(&QueryStatsSharedState->lock, LW_SHARED);
+
+	QueryStatsHashEntry *entry = hash_search(QueryStatsHash, &key, HASH_FIND, &found);
+	if (!found)
+	{
+		/* adding a new entry requires the lock in exclusive mode */
+		LWLockRelease(&QueryStatsSharedState->lock);
+		LWLockAcquire(&QueryStatsSharedState->lock, LW_EXCLUSIVE);
+
+		if (hash_get_num_entries(QueryStatsHash) >= StatStatementsMax)
+		{
+			CitusQueryStatsEntryDealloc();
+		}
+
+		entry = hash_search(QueryStatsHash, &key, HASH_ENTER_NULL, &found);
+		if (entry == NULL)
+		{
+			/* out of shared memory, the execution is not counted */
+			LWLockRelease(&QueryStatsSharedState->lock);
+			return;
+		}
+
+		if (!found)
+		{
+			SpinLockInit(&entry->mutex);
+			entry->calls = 0;
+			entry->totalTimeMs = 0.0;
+			entry->minTimeMs = 0.0;
+			entry->maxTimeMs = 0.0;
+			entry->taskCount = 0;
+			entry->rowCount = 0;
+			entry->bytesReceived = 0;
+			entry->shardCount = 0;
+		}
+	}
+
+	double executionTimeMs = executionStats->executionTimeMs;
+
+	SpinLockAcquire(&entry->mutex);
+
+	if (entry->calls == 0 || executionTimeMs < entry->minTimeMs)
+	{
+		entry->minTimeMs = executionTimeMs;
+	}
+
+	if (entry->calls == 0 || executionTimeMs > entry->maxTimeMs)
+	{
+		entry->maxTimeMs = executionTimeMs;
+	}
+
+	entry->calls++;
+	entry->totalTimeMs += executionTimeMs;
+	entry->taskCount += executionStats->taskCount;
+	entry->rowCount += executionStats->rowCount;
+	entry->bytesReceived += executionStats->bytesReceived;
+	entry->shardCount += executionStats->shardCount;
+
+	SpinLockRelease(&entry->mutex);
+
+	LWLockRelease(&QueryStatsSharedState->lock);
+}
+
+
+/*
+ * CitusQueryStatsEntryDealloc removes the least called entries from the hash
+ * to make room for new ones. The caller should hold the lock in exclusive
+ * mode.
+ */
+static void
+CitusQueryStatsEntryDealloc(void)
+{
+	HASH_SEQ_STATUS status;
+	QueryStatsHashEntry *entry = NULL;
+	int entryIndex = 0;
+
+	long entryCount = hash_get_num_entries(QueryStatsHash);
+	QueryStatsHashEntry **entryArray = palloc(entryCount *
+											  sizeof(QueryStatsHashEntry *));
+
+	hash_seq_init(&status, QueryStatsHash);
+	while ((entry = hash_seq_search(&status)) != NULL)
+	{
+		entryArray[entryIndex++] = entry;
+	}
+
+	qsort(entryArray, entryIndex, sizeof(QueryStatsHashEntry *),
+		  CompareQueryStatsEntriesByCalls);
+
+	int removeCount = Max(entryIndex * STAT_STATEMENTS_DEALLOC_PERCENT / 100, 10);
+	removeCount = Min(removeCount, entryIndex);
+
+	for (int removeIndex = 0; removeIndex < removeCount; removeIndex++)
+	{
+		hash_search(QueryStatsHash, &entryArray[removeIndex]->key, HASH_REMOVE, NULL);
+	}
+
+	pfree(entryArray);
+}
+
+
+/*
+ * CompareQueryStatsEntriesByCalls orders statement statistics entries by
+ * their number of calls in ascending order.
+ */
+static int
+CompareQueryStatsEntriesByCalls(const void *leftElement, const void *rightElement)
 {
-	/* placeholder for future implementation */
+	const QueryStatsHashEntry *leftEntry = *((const QueryStatsHashEntry **) leftElement);
+	const QueryStatsHashEntry *rightEntry =
+		*((const QueryStatsHashEntry **) rightElement);
+
+	if (leftEntry->calls < rightEntry->calls)
+	{
+		return -1;
+	}
+	else if (leftEntry->calls > rightEntry->calls)
+	{
+		return 1;
+	}
+
+	return 0;
 }
 
 
 /*
- * placeholder function for citus_stat_statements_reset
+ * citus_stat_statements_reset removes the statistics of all statements.
  */
 Datum
 citus_stat_statements_reset(PG_FUNCTION_ARGS)
 {
-	ereport(ERROR, (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
-					errmsg("citus_stat_statements_reset() is only supported on "
-						   "Citus Enterprise")));
+	HASH_SEQ_STATUS status;
+	QueryStatsHashEntry *entry = NULL;
+
+	CheckCitusVersion(ERROR);
+
+	if (QueryStatsHash == NULL)
+	{
+		PG_RETURN_VOID();
+	}
+
+	LWLockAcquire(&QueryStatsSharedState->lock, LW_EXCLUSIVE);
+
+	hash_seq_init(&status, QueryStatsHash);
+	while ((entry = hash_seq_search(&status)) != NULL)
+	{
+		hash_search(QueryStatsHash, &entry->key, HASH_REMOVE, NULL);
+	}
+
+	LWLockRelease(&QueryStatsSharedState->lock);
+
 	PG_RETURN_VOID();
 }
 
 
 /*
- * placeholder function for citus_query_stats
+ * citus_query_stats returns the statistics of the distributed queries per
+ * executor and partition key value. Like in pg_stat_statements, users that
+ * are not allowed to read all statistics only see their own queries.
  */
 Datum
 citus_query_stats(PG_FUNCTION_ARGS)
 {
-	ereport(ERROR, (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
-					errmsg("citus_query_stats() is only supported on "
-						   "Citus Enterprise")));
+	TupleDesc tupleDescriptor = NULL;
+	HASH_SEQ_STATUS status;
+	QueryStatsHashEntry *entry = NULL;
+	Oid userId = GetUserId();
+	bool readAllStats = is_member_of_role(userId, DEFAULT_ROLE_READ_ALL_STATS);
+
+	CheckCitusVersion(ERROR);
+
+	Tuplestorestate *tupleStore = SetupTuplestore(fcinfo, &tupleDescriptor);
+
+	if (QueryStatsHash == NULL)
+	{
+		tuplestore_donestoring(tupleStore);
+
+		PG_RETURN_VOID();
+	}
+
+	LWLockAcquire(&QueryStatsSharedState->lock, LW_SHARED);
+
+	hash_seq_init(&status, QueryStatsHash);
+	while ((entry = hash_seq_search(&status)) != NULL)
+	{
+		Datum values[CITUS_QUERY_STATS_COLUMNS];
+		bool isNulls[CITUS_QUERY_STATS_COLUMNS];
+
+		if (!readAllStats && entry->key.userId != userId)
+		{
+			continue;
+		}
+
+		memset(values, 0, sizeof(values));
+		memset(isNulls, false, sizeof(isNulls));
+
+		SpinLockAcquire(&entry->mutex);
+		int64 calls = entry->calls;
+		double totalTimeMs = entry->totalTimeMs;
+		double minTimeMs = entry->minTimeMs;
+		double maxTimeMs = entry->maxTimeMs;
+		int64 taskCount = entry->taskCount;
+		int64 rowCount = entry->rowCount;
+		int64 bytesReceived = entry->bytesReceived;
+		int64 shardCount = entry->shardCount;
+		SpinLockRelease(&entry->mutex);
+
+		values[0] = Int64GetDatum(entry->key.queryId);
+		values[1] = ObjectIdGetDatum(entry->key.userId);
+		values[2] = ObjectIdGetDatum(entry->key.databaseId);
+		values[3] = Int64GetDatum(entry->key.executorType);
+
+		if (entry->key.partitionKey[0] != '\0')
+		{
+			values[4] = CStringGetTextDatum(entry->key.partitionKey);
+		}
+		else
+		{
+			isNulls[4] = true;
+		}
+
+		values[5] = Int64GetDatum(calls);
+		values[6] = Float8GetDatum(totalTimeMs);
+		values[7] = Float8GetDatum(minTimeMs);
+		values[8] = Float8GetDatum(maxTimeMs);
+		values[9] = Int64GetDatum(taskCount);
+		values[10] = Int64GetDatum(rowCount);
+		values[11] = Int64GetDatum(bytesReceived);
+		values[12] = Int64GetDatum(shardCount);
+
+		tuplestore_putvalues(tupleStore, tupleDescriptor, values, isNulls);
+	}
+
+	LWLockRelease(&QueryStatsSharedState->lock);
+
+	tuplestore_donestoring(tupleStore);
+
 	PG_RETURN_VOID();
 }
 
@@ -110,3 +449,71 @@ CitusExecutorName(MultiExecutorType executorType)
 		}
 	}
 }
+
+
+/*
+ * CitusQueryStatsShmemSize returns the size of the shared memory needed for
+ * the statement statistics.
+ */
+static size_t
+CitusQueryStatsShmemSize(void)
+{
+	Size size = 0;
+
+	size = add_size(size, sizeof(QueryStatsControlData));
+
+	Size hashSize = hash_estimate_size(StatStatementsMax, sizeof(QueryStatsHashEntry));
+	size = add_size(size, hashSize);
+
+	return size;
+}
+
+
+/*
+ * CitusQueryStatsShmemInit initializes the shared memory for the statement
+ * statistics.
+ */
+static void
+CitusQueryStatsShmemInit(void)
+{
+	bool alreadyInitialized = false;
+	HASHCTL info;
+
+	LWLockAcquire(AddinShmemInitLock, LW_EXCLUSIVE);
+
+	QueryStatsSharedState =
+		(QueryStatsControlData *) ShmemInitStruct("Citus Query Stats",
+												  sizeof(QueryStatsControlData),
+												  &alreadyInitialized);
+
+	/*
+	 * Might already be initialized on EXEC_BACKEND type platforms that call
+	 * shared library initialization functions in every backend.
+	 */
+	if (!alreadyInitialized)
+	{
+		QueryStatsSharedState->trancheId = LWLockNewTrancheId();
+		QueryStatsSharedState->lockTrancheName = "Citus Query Stats";
+		LWLockRegisterTranche(QueryStatsSharedState->trancheId,
+							  QueryStatsSharedState->lockTrancheName);
+
+		LWLockInitialize(&QueryStatsSharedState->lock,
+						 QueryStatsSharedState->trancheId);
+	}
+
+	memset(&info, 0, sizeof(info));
+	info.keysize = sizeof(QueryStatsHashKey);
+	info.entrysize = sizeof(QueryStatsHashEntry);
+	int hashFlags = (HASH_ELEM | HASH_BLOBS);
+
+	QueryStatsHash = ShmemInitHash("Citus Query Stats Hash",
+								   StatStatementsMax, StatStatementsMax,
+								   &info, hashFlags);
+
+	LWLockRelease(AddinShmemInitLock);
+
+	if (prev_shmem_startup_hook != NULL)
+	{
+		prev_shmem_startup_hook();
+	}
+}
@@ -7,9 +7,9 @@
  * - It generates all the tasks by descending in the tasks tree. Note that each task
  *  has a dependentTaskList.
  * - It generates FetchTask queryStrings with the MapTask queries. It uses the first replicate to
- *  fetch data when replication factor is > 1. Note that if a task fails in any replica adaptive executor
- *  gives an error, so if we come to a fetchTask we know for sure that its dependedMapTask is executed in all
- *  replicas.
+ *  fetch data when replication factor is > 1. Map tasks run on a single placement and fail over to
+ *  the next one on failure, so before executing a fetchTask of a replicated map task we point it to
+ *  the replica where the map task succeeded.
  * - It creates schemas in each worker in a single transaction to store intermediate results.
  * - It iterates all tasks and finds the ones whose dependencies are already executed, and executes them with
  *  adaptive executor logic.
@@ -25,13 +25,20 @@
 
 #include "postgres.h"
 #include "access/hash.h"
+#include "catalog/pg_type.h"
 #include "miscadmin.h"
+#include "utils/array.h"
 #include "utils/builtins.h"
+#include "utils/datum.h"
+#include "utils/lsyscache.h"
+#include "utils/typcache.h"
 #include "distributed/hash_helpers.h"
 
 #include "distributed/adaptive_executor.h"
+#include "distributed/bloom_filter.h"
 #include "distributed/directed_acyclic_graph_execution.h"
 #include "distributed/listutils.h"
+#include "distributed/master_metadata_utility.h"
 #include "distributed/metadata_cache.h"
 #include "distributed/multi_physical_planner.h"
 #include "distributed/multi_server_executor.h"
@@ -41,8 +48,113 @@
 #include "distributed/transmit.h"
 #include "distributed/worker_manager.h"
 #include "distributed/worker_transaction.h"
+#include "distributed/version_compat.h"
+#include "executor/tuptable.h"
+#include "utils/tuplestore.h"
 
 
+/*
+ * We do not probe with a bloom filter that has more than half of its bits set,
+ * since it would let most rows through while making every probe more costly.
+ */
+#define BLOOM_FILTER_MAX_FILL_FACTOR 0.5
+
+/* query that samples the non-NULL partition column values of a filter query */
+#define SPLIT_POINT_SAMPLE_QUERY \
+	"SELECT split_point_input.%s FROM (%s) split_point_input " \
+	"WHERE split_point_input.%s IS NOT NULL AND pg_catalog.random() < %g"
+
+/* query that samples the hash values of the partition column of a filter query */
+#define SKEW_SAMPLE_QUERY \
+	"SELECT pg_catalog.worker_hash(skew_sample_input.%s) FROM (%s) skew_sample_input " \
+	"WHERE skew_sample_input.%s IS NOT NULL AND pg_catalog.random() < %g"
+
+/*
+ * A join key is a heavy hitter if its rows would fill more than half of a
+ * partition when partitions were perfectly balanced. We ignore keys that occur
+ * only a few times in the sample, since their frequency is not reliable.
+ */
+#define HEAVY_HITTER_PARTITION_SHARE 0.5
+#define HEAVY_HITTER_MIN_SAMPLE_COUNT 10
+
+
+/*
+ * MapMergeJobRewrite describes how we change the map tasks of a map merge job
+ * before executing them. If bloomFilter is set, map tasks only partition rows
+ * that pass the filter. If splitPointObject is set, map tasks range partition
+ * on the given split points instead of hash partitioning. If splitHashObject
+ * and broadcastHashObject are set, map tasks spread the rows with the hash
+ * values in the former over all partitions, and write the rows with the hash
+ * values in the latter to all partitions.
+ */
+typedef struct MapMergeJobRewrite
+{
+	MapMergeJob *mapMergeJob;
+	bytea *bloomFilter;
+	ArrayType *splitPointObject;
+	ArrayType *splitHashObject;
+	ArrayType *broadcastHashObject;
+} MapMergeJobRewrite;
+
+/*
+ * HashValueSampleEntry counts how often a hash value of the join key occurs in
+ * the samples of the left (0) and right (1) input of a join.
+ */
+typedef struct HashValueSampleEntry
+{
+	int32 hashValue;
+	uint64 sampleCount[2];
+} HashValueSampleEntry;
+
+/*
+ * SplitPointSortContext holds the comparison function and collation used to
+ * sort sampled partition column values.
+ */
+typedef struct SplitPointSortContext
+{
+	FmgrInfo *comparisonFunction;
+	Oid collation;
+} SplitPointSortContext;
+
+
+/* Config variables managed via guc.c */
+bool EnableRepartitionJoinBloomFilter = false;
+int RepartitionJoinBloomFilterSize = 256; /* bloom filter size in KB */
+bool EnableRepartitionJoinSampling = false;
+bool EnableRepartitionJoinSkewHandling = false;
+double RepartitionJoinSamplePercent = 1.0;
+
+
+static void ApplyBloomFilterSemiJoinReduction(Job *job, List **jobRewriteList);
+static void ApplySampledRangeRepartitioning(Job *job, List **jobRewriteList);
+static MapMergeJobRewrite * FindMapMergeJobRewrite(List *jobRewriteList,
+													 MapMergeJob *mapMergeJob);
+static bool JobHasSplitPoints(List *jobRewriteList, MapMergeJob *mapMergeJob);
+static MapMergeJobRewrite * GetMapMergeJobRewrite(List **jobRewriteList,
+												  MapMergeJob *mapMergeJob);
+static void RewriteMapTasks(List *jobRewriteList, List **rewrittenTaskList,
+							List **originalQueryStringList);
+static void RestoreMapTaskQueryStrings(List *rewrittenTaskList,
+									   List *originalQueryStringList);
+static bool DualHashRepartitionJobPair(Job *job, MapMergeJob **leftJob,
+									   MapMergeJob **rightJob);
+static bool DualHashRepartitionJobs(Job *job, MapMergeJob **buildJob,
+									MapMergeJob **probeJob);
+static bool MapMergeJobInputSize(MapMergeJob *mapMergeJob, uint64 *inputSize);
+static bool JoinTreeHasOnlyInnerJoins(Node *joinTreeNode);
+static bytea * BuildBloomFilterForMapMergeJob(MapMergeJob *mapMergeJob);
+static int SampleMapMergeJob(MapMergeJob *mapMergeJob, Datum **sampleArray,
+							 int sampleCount);
+static ArrayType * SampledSplitPointObject(MapMergeJob *leftJob, MapMergeJob *rightJob);
+static void ApplySkewHandling(Job *job, List **jobRewriteList);
+static bool FindHeavyHitters(MapMergeJob *leftJob, MapMergeJob *rightJob,
+							 ArrayType **leftSplitHashObject,
+							 ArrayType **rightSplitHashObject);
+static uint64 SampleHashValues(MapMergeJob *mapMergeJob, HTAB *hashValueSamples,
+							   int inputIndex);
+static ArrayType * HashValueListToArrayObject(List *hashValueList);
+static int CompareSplitPoints(const void *leftElement, const void *rightElement,
+							  void *context);
 static List * CreateTemporarySchemasForMergeTasks(Job *topLevelJob);
 static List * ExtractJobsInJobTree(Job *job);
 static void TraverseJobTree(Job *curJob, List **jobs);
@@ -59,18 +171,951 @@ static char * GenerateDeleteJobsCommand(List *jobIds);
 List *
 ExecuteDependentTasks(List *topLevelTasks, Job *topLevelJob)
 {
+	List *jobRewriteList = NIL;
+	List *rewrittenTaskList = NIL;
+	List *originalQueryStringList = NIL;
+
 	EnsureNoModificationsHaveBeenDone();
 
+	if (EnableRepartitionJoinSampling)
+	{
+		ApplySampledRangeRepartitioning(topLevelJob, &jobRewriteList);
+	}
+
+	if (EnableRepartitionJoinSkewHandling)
+	{
+		ApplySkewHandling(topLevelJob, &jobRewriteList);
+	}
+
+	if (EnableRepartitionJoinBloomFilter)
+	{
+		ApplyBloomFilterSemiJoinReduction(topLevelJob, &jobRewriteList);
+	}
+
+	RewriteMapTasks(jobRewriteList, &rewrittenTaskList, &originalQueryStringList);
+
 	List *allTasks = TaskAndExecutionList(topLevelTasks);
 
 	List *jobIds = CreateTemporarySchemasForMergeTasks(topLevelJob);
 
-	ExecuteTasksInDependencyOrder(allTasks, topLevelTasks, jobIds);
+	/*
+	 * The map tasks belong to a plan that may be cached, so we restore the map
+	 * queries we rewrote once they ran, also when the execution fails.
+	 */
+	PG_TRY();
+	{
+		ExecuteTasksInDependencyOrder(allTasks, topLevelTasks, jobIds);
+	}
+	PG_CATCH();
+	{
+		RestoreMapTaskQueryStrings(rewrittenTaskList, originalQueryStringList);
+		PG_RE_THROW();
+	}
+	PG_END_TRY();
+
+	RestoreMapTaskQueryStrings(rewrittenTaskList, originalQueryStringList);
 
 	return jobIds;
 }
 
 
+/*
+ * ApplyBloomFilterSemiJoinReduction walks over the given job tree, and finds
+ * inner joins between two dual hash repartitioned inputs. For each such join,
+ * it builds a bloom filter over the join keys of the smaller input, and adds
+ * the filter to the map tasks of the larger input. The map tasks then skip the
+ * rows that cannot find a join partner, instead of shuffling all of them.
+ */
+static void
+ApplyBloomFilterSemiJoinReduction(Job *job, List **jobRewriteList)
+{
+	MapMergeJob *buildJob = NULL;
+	MapMergeJob *probeJob = NULL;
+
+	if (DualHashRepartitionJobs(job, &buildJob, &probeJob))
+	{
+		bytea *bloomFilter = BuildBloomFilterForMapMergeJob(buildJob);
+		double fillFactor = BloomFilterFillFactor(bloomFilter);
+
+		if (fillFactor <= BLOOM_FILTER_MAX_FILL_FACTOR)
+		{
+			MapMergeJobRewrite *jobRewrite = GetMapMergeJobRewrite(jobRewriteList,
+																   probeJob);
+			jobRewrite->bloomFilter = bloomFilter;
+		}
+		else
+		{
+			ereport(DEBUG2, (errmsg("skipping bloom filter of job " UINT64_FORMAT
+									" with fill factor %.2f", buildJob->job.jobId,
+									fillFactor)));
+		}
+	}
+
+	Job *childJob = NULL;
+	foreach_ptr(childJob, job->dependentJobList)
+	{
+		ApplyBloomFilterSemiJoinReduction(childJob, jobRewriteList);
+	}
+}
+
+
+/*
+ * ApplySampledRangeRepartitioning walks over the given job tree, and finds
+ * joins between two dual hash repartitioned inputs. For each such join, it
+ * samples the join keys of both inputs, and lets the map tasks of both inputs
+ * range partition on the quantiles of the sample instead. Hash partitioning
+ * is already balanced for most join keys, but range partitioning on sampled
+ * quantiles also keeps the merge tasks balanced when the hash values of the
+ * join keys are skewed.
+ */
+static void
+ApplySampledRangeRepartitioning(Job *job, List **jobRewriteList)
+{
+	MapMergeJob *leftJob = NULL;
+	MapMergeJob *rightJob = NULL;
+
+	if (DualHashRepartitionJobPair(job, &leftJob, &rightJob))
+	{
+		ArrayType *splitPointObject = SampledSplitPointObject(leftJob, rightJob);
+		if (splitPointObject != NULL)
+		{
+			GetMapMergeJobRewrite(jobRewriteList, leftJob)->splitPointObject =
+				splitPointObject;
+			GetMapMergeJobRewrite(jobRewriteList, rightJob)->splitPointObject =
+				splitPointObject;
+		}
+	}
+
+	Job *childJob = NULL;
+	foreach_ptr(childJob, job->dependentJobList)
+	{
+		ApplySampledRangeRepartitioning(childJob, jobRewriteList);
+	}
+}
+
+
+/*
+ * ApplySkewHandling walks over the given job tree, and finds inner joins between
+ * two dual hash repartitioned inputs that are not range partitioned on sampled
+ * split points. For each such join, it samples the hash values of the join keys
+ * of both inputs, and finds the heavy hitters: join keys with so many rows that
+ * hash partitioning would make their merge task the straggler of the join. The
+ * map tasks then spread the rows of a heavy hitter of the input in which it is
+ * most frequent over all partitions, and write the matching rows of the other
+ * input to all partitions.
+ *
+ * Every pair of joining rows then still meets in exactly one merge task, which
+ * is why we only do this for inner joins: the rows of the other input would
+ * otherwise appear once for each partition in the join result when they find
+ * no join partner.
+ */
+static void
+ApplySkewHandling(Job *job, List **jobRewriteList)
+{
+	MapMergeJob *leftJob = NULL;
+	MapMergeJob *rightJob = NULL;
+
+	if (DualHashRepartitionJobPair(job, &leftJob, &rightJob) &&
+		job->jobQuery != NULL && !job->jobQuery->hasSubLinks &&
+		JoinTreeHasOnlyInnerJoins((Node *) job->jobQuery->jointree) &&
+		!JobHasSplitPoints(*jobRewriteList, leftJob) &&
+		!JobHasSplitPoints(*jobRewriteList, rightJob))
+	{
+		ArrayType *leftSplitHashObject = NULL;
+		ArrayType *rightSplitHashObject = NULL;
+
+		if (FindHeavyHitters(leftJob, rightJob, &leftSplitHashObject,
+							 &rightSplitHashObject))
+		{
+			MapMergeJobRewrite *leftRewrite = GetMapMergeJobRewrite(jobRewriteList,
+																	leftJob);
+			MapMergeJobRewrite *rightRewrite = GetMapMergeJobRewrite(jobRewriteList,
+																	 rightJob);
+
+			leftRewrite->splitHashObject = leftSplitHashObject;
+			leftRewrite->broadcastHashObject = rightSplitHashObject;
+			rightRewrite->splitHashObject = rightSplitHashObject;
+			rightRewrite->broadcastHashObject = leftSplitHashObject;
+		}
+	}
+
+	Job *childJob = NULL;
+	foreach_ptr(childJob, job->dependentJobList)
+	{
+		ApplySkewHandling(childJob, jobRewriteList);
+	}
+}
+
+
+/*
+ * FindHeavyHitters samples the hash values of the partition columns of the map
+ * tasks of both given jobs, and finds the hash values that are heavy hitters.
+ * It sets leftSplitHashObject to the heavy hitters that are more frequent in
+ * the left input, and rightSplitHashObject to those that are more frequent in
+ * the right input. We skip heavy hitters that are frequent in both inputs,
+ * since broadcasting their rows would cost more than the straggler. The
+ * function returns false if there are no heavy hitters.
+ */
+static bool
+FindHeavyHitters(MapMergeJob *leftJob, MapMergeJob *rightJob,
+				 ArrayType **leftSplitHashObject, ArrayType **rightSplitHashObject)
+{
+	uint32 partitionCount = leftJob->partitionCount;
+	List *leftSplitHashList = NIL;
+	List *rightSplitHashList = NIL;
+	HASHCTL info;
+
+	if (rightJob->partitionCount != partitionCount || partitionCount < 2)
+	{
+		return false;
+	}
+
+	memset(&info, 0, sizeof(info));
+	info.keysize = sizeof(int32);
+	info.entrysize = sizeof(HashValueSampleEntry);
+	info.hcxt = CurrentMemoryContext;
+	uint32 hashFlags = (HASH_ELEM | HASH_BLOBS | HASH_CONTEXT);
+
+	HTAB *hashValueSamples = hash_create("repartition join hash value samples", 1024,
+										 &info, hashFlags);
+
+	uint64 sampleCount = SampleHashValues(leftJob, hashValueSamples, 0);
+	sampleCount += SampleHashValues(rightJob, hashValueSamples, 1);
+
+	double heavyHitterSampleCount = Max(HEAVY_HITTER_MIN_SAMPLE_COUNT,
+										HEAVY_HITTER_PARTITION_SHARE * sampleCount /
+										partitionCount);
+
+	HASH_SEQ_STATUS status;
+	hash_seq_init(&status, hashValueSamples);
+
+	HashValueSampleEntry *sampleEntry = NULL;
+	while ((sampleEntry = (HashValueSampleEntry *) hash_seq_search(&status)) != NULL)
+	{
+		uint64 leftSampleCount = sampleEntry->sampleCount[0];
+		uint64 rightSampleCount = sampleEntry->sampleCount[1];
+
+		if (leftSampleCount + rightSampleCount < heavyHitterSampleCount)
+		{
+			continue;
+		}
+
+		if (leftSampleCount >= rightSampleCount &&
+			rightSampleCount * partitionCount < leftSampleCount)
+		{
+			leftSplitHashList = lappend_int(leftSplitHashList, sampleEntry->hashValue);
+		}
+		else if (rightSampleCount > leftSampleCount &&
+				 leftSampleCount * partitionCount < rightSampleCount)
+		{
+			rightSplitHashList = lappend_int(rightSplitHashList,
+											 sampleEntry->hashValue);
+		}
+	}
+
+	hash_destroy(hashValueSamples);
+
+	if (leftSplitHashList == NIL && rightSplitHashList == NIL)
+	{
+		return false;
+	}
+
+	ereport(DEBUG2, (errmsg("splitting %d heavy hitters of job " UINT64_FORMAT
+							" and %d heavy hitters of job " UINT64_FORMAT,
+							list_length(leftSplitHashList), leftJob->job.jobId,
+							list_length(rightSplitHashList), rightJob->job.jobId)));
+
+	*leftSplitHashObject = HashValueListToArrayObject(leftSplitHashList);
+	*rightSplitHashObject = HashValueListToArrayObject(rightSplitHashList);
+
+	return true;
+}
+
+
+/*
+ * SampleHashValues runs the filter queries of the map tasks of the given job on
+ * the workers, and samples RepartitionJoinSamplePercent of the hash values of
+ * their non-NULL partition column values. The function counts the sampled hash
+ * values for the given input in the given hash table, and returns the number of
+ * sampled values.
+ */
+static uint64
+SampleHashValues(MapMergeJob *mapMergeJob, HTAB *hashValueSamples, int inputIndex)
+{
+	List *sampleTaskList = NIL;
+	char *partitionColumnName = quote_identifier(MapTaskPartitionColumnName(
+													 mapMergeJob));
+	double sampleFraction = RepartitionJoinSamplePercent / 100.0;
+	TupleDesc tupleDescriptor = NULL;
+	uint64 sampleCount = 0;
+
+	Task *mapTask = NULL;
+	foreach_ptr(mapTask, mapMergeJob->mapTaskList)
+	{
+		StringInfo sampleQueryString = makeStringInfo();
+		appendStringInfo(sampleQueryString, SKEW_SAMPLE_QUERY,
+						 partitionColumnName, mapTask->filterQueryString,
+						 partitionColumnName, sampleFraction);
+
+		Task *sampleTask = CreateBasicTask(mapTask->jobId, mapTask->taskId,
+										   SELECT_TASK, sampleQueryString->data);
+		sampleTask->anchorShardId = mapTask->anchorShardId;
+		sampleTask->taskPlacementList = mapTask->taskPlacementList;
+		sampleTask->relationShardList = mapTask->relationShardList;
+
+		sampleTaskList = lappend(sampleTaskList, sampleTask);
+	}
+
+#if PG_VERSION_NUM >= 120000
+	tupleDescriptor = CreateTemplateTupleDesc(1);
+#else
+	tupleDescriptor = CreateTemplateTupleDesc(1, false);
+#endif
+	TupleDescInitEntry(tupleDescriptor, (AttrNumber) 1, "hash_value",
+					   INT4OID, -1, 0);
+
+	Tuplestorestate *tupleStore = tuplestore_begin_heap(false, false, work_mem);
+	bool hasReturning = true;
+
+	ExecuteTaskListIntoTupleStore(ROW_MODIFY_READONLY, sampleTaskList, tupleDescriptor,
+								  tupleStore, hasReturning);
+
+	TupleTableSlot *slot = MakeSingleTupleTableSlotCompat(tupleDescriptor,
+														  &TTSOpsMinimalTuple);
+	while (tuplestore_gettupleslot(tupleStore, true, false, slot))
+	{
+		bool isNull = false;
+		Datum hashValueDatum = slot_getattr(slot, 1, &isNull);
+
+		if (!isNull)
+		{
+			int32 hashValue = DatumGetInt32(hashValueDatum);
+			bool found = false;
+
+			HashValueSampleEntry *sampleEntry = hash_search(hashValueSamples,
+															&hashValue, HASH_ENTER,
+															&found);
+			if (!found)
+			{
+				sampleEntry->sampleCount[0] = 0;
+				sampleEntry->sampleCount[1] = 0;
+			}
+
+			sampleEntry->sampleCount[inputIndex]++;
+			sampleCount++;
+		}
+
+		ExecClearTuple(slot);
+	}
+
+	ExecDropSingleTupleTableSlot(slot);
+	tuplestore_end(tupleStore);
+
+	return sampleCount;
+}
+
+
+/*
+ * HashValueListToArrayObject converts the given list of hash values into an
+ * int4 array object.
+ */
+static ArrayType *
+HashValueListToArrayObject(List *hashValueList)
+{
+	int hashValueCount = list_length(hashValueList);
+	Datum *hashValueArray = palloc0(Max(hashValueCount, 1) * sizeof(Datum));
+	int hashValueIndex = 0;
+
+	ListCell *hashValueCell = NULL;
+	foreach(hashValueCell, hashValueList)
+	{
+		hashValueArray[hashValueIndex++] = Int32GetDatum(lfirst_int(hashValueCell));
+	}
+
+	return construct_array(hashValueArray, hashValueCount, INT4OID, sizeof(int32),
+						   true, 'i');
+}
+
+
+/*
+ * FindMapMergeJobRewrite returns the rewrite of the given map merge job from the
+ * given list, or NULL if there is none.
+ */
+static MapMergeJobRewrite *
+FindMapMergeJobRewrite(List *jobRewriteList, MapMergeJob *mapMergeJob)
+{
+	MapMergeJobRewrite *jobRewrite = NULL;
+	foreach_ptr(jobRewrite, jobRewriteList)
+	{
+		if (jobRewrite->mapMergeJob == mapMergeJob)
+		{
+			return jobRewrite;
+		}
+	}
+
+	return NULL;
+}
+
+
+/*
+ * JobHasSplitPoints returns whether the map tasks of the given job range
+ * partition on sampled split points.
+ */
+static bool
+JobHasSplitPoints(List *jobRewriteList, MapMergeJob *mapMergeJob)
+{
+	MapMergeJobRewrite *jobRewrite = FindMapMergeJobRewrite(jobRewriteList,
+															mapMergeJob);
+
+	return jobRewrite != NULL && jobRewrite->splitPointObject != NULL;
+}
+
+
+/*
+ * GetMapMergeJobRewrite returns the rewrite of the given map merge job from the
+ * given list, and adds an empty one to the list if there is none yet.
+ */
+static MapMergeJobRewrite *
+GetMapMergeJobRewrite(List **jobRewriteList, MapMergeJob *mapMergeJob)
+{
+	MapMergeJobRewrite *jobRewrite = FindMapMergeJobRewrite(*jobRewriteList,
+															mapMergeJob);
+	if (jobRewrite != NULL)
+	{
+		return jobRewrite;
+	}
+
+	jobRewrite = palloc0(sizeof(MapMergeJobRewrite));
+	jobRewrite->mapMergeJob = mapMergeJob;
+
+	*jobRewriteList = lappend(*jobRewriteList, jobRewrite);
+
+	return jobRewrite;
+}
+
+
+/*
+ * RewriteMapTasks rewrites the map tasks of the jobs in the given list as their
+ * rewrites describe. The function appends the rewritten tasks and their
+ * original query strings to the given lists.
+ */
+static void
+RewriteMapTasks(List *jobRewriteList, List **rewrittenTaskList,
+				List **originalQueryStringList)
+{
+	MapMergeJobRewrite *jobRewrite = NULL;
+	foreach_ptr(jobRewrite, jobRewriteList)
+	{
+		MapMergeJob *mapMergeJob = jobRewrite->mapMergeJob;
+		char *partitionColumnName = MapTaskPartitionColumnName(mapMergeJob);
+		char *bloomFilterLiteral = NULL;
+
+		if (jobRewrite->bloomFilter != NULL)
+		{
+			Datum bloomFilterText = DirectFunctionCall1(byteaout, PointerGetDatum(
+															jobRewrite->bloomFilter));
+			bloomFilterLiteral = quote_literal_cstr(DatumGetCString(bloomFilterText));
+		}
+
+		Task *mapTask = NULL;
+		foreach_ptr(mapTask, mapMergeJob->mapTaskList)
+		{
+			char *filterQueryString = mapTask->filterQueryString;
+			StringInfo mapQueryString = NULL;
+
+			if (bloomFilterLiteral != NULL)
+			{
+				StringInfo probeQueryString = makeStringInfo();
+				appendStringInfo(probeQueryString, BLOOM_FILTER_PROBE_QUERY,
+								 filterQueryString, bloomFilterLiteral,
+								 quote_identifier(partitionColumnName));
+
+				filterQueryString = probeQueryString->data;
+			}
+
+			if (jobRewrite->splitHashObject != NULL)
+			{
+				mapQueryString = CreateSkewHashMapQueryString(mapMergeJob, mapTask,
+															  filterQueryString,
+															  partitionColumnName,
+															  jobRewrite->
+															  splitHashObject,
+															  jobRewrite->
+															  broadcastHashObject);
+			}
+			else if (jobRewrite->splitPointObject != NULL)
+			{
+				mapQueryString = CreateRangeMapQueryString(mapMergeJob, mapTask,
+														   filterQueryString,
+														   partitionColumnName,
+														   jobRewrite->
+														   splitPointObject);
+			}
+			else
+			{
+				mapQueryString = CreateMapQueryString(mapMergeJob, mapTask,
+													  filterQueryString,
+													  partitionColumnName);
+			}
+
+			*rewrittenTaskList = lappend(*rewrittenTaskList, mapTask);
+			*originalQueryStringList = lappend(*originalQueryStringList,
+											   TaskQueryString(mapTask));
+
+			SetTaskQueryString(mapTask, mapQueryString->data);
+		}
+	}
+}
+
+
+/*
+ * RestoreMapTaskQueryStrings sets the query strings of the given map tasks back
+ * to the query strings they had before we rewrote them.
+ */
+static void
+RestoreMapTaskQueryStrings(List *rewrittenTaskList, List *originalQueryStringList)
+{
+	ListCell *taskCell = NULL;
+	ListCell *queryStringCell = NULL;
+
+	forboth(taskCell, rewrittenTaskList, queryStringCell, originalQueryStringList)
+	{
+		Task *mapTask = (Task *) lfirst(taskCell);
+		char *originalQueryString = (char *) lfirst(queryStringCell);
+
+		SetTaskQueryString(mapTask, originalQueryString);
+	}
+}
+
+
+/*
+ * DualHashRepartitionJobPair returns whether the given job joins the outputs of
+ * two dual hash repartition jobs whose map tasks read from shards, and whose
+ * partition columns are of the same type. If so, the function sets leftJob and
+ * rightJob to the two jobs.
+ */
+static bool
+DualHashRepartitionJobPair(Job *job, MapMergeJob **leftJob, MapMergeJob **rightJob)
+{
+	if (list_length(job->dependentJobList) != 2)
+	{
+		return false;
+	}
+
+	Job *leftJob = (Job *) linitial(job->dependentJobList);
+	Job *rightJob = (Job *) lsecond(job->dependentJobList);
+	if (!CitusIsA(leftJob, MapMergeJob) || !CitusIsA(rightJob, MapMergeJob))
+	{
+		return false;
+	}
+
+	MapMergeJob *leftMapMergeJob = (MapMergeJob *) leftJob;
+	MapMergeJob *rightMapMergeJob = (MapMergeJob *) rightJob;
+	if (leftMapMergeJob->partitionType != DUAL_HASH_PARTITION_TYPE ||
+		rightMapMergeJob->partitionType != DUAL_HASH_PARTITION_TYPE)
+	{
+		return false;
+	}
+
+	/* both sides need to partition the join key the same way */
+	if (leftMapMergeJob->partitionColumn->vartype !=
+		rightMapMergeJob->partitionColumn->vartype)
+	{
+		return false;
+	}
+
+	Task *mapTask = NULL;
+	List *mapTaskList = list_concat(list_copy(leftMapMergeJob->mapTaskList),
+									rightMapMergeJob->mapTaskList);
+	foreach_ptr(mapTask, mapTaskList)
+	{
+		if (mapTask->filterQueryString == NULL ||
+			mapTask->anchorShardId == INVALID_SHARD_ID ||
+			mapTask->dependentTaskList != NIL)
+		{
+			return false;
+		}
+	}
+
+	*leftJob = leftMapMergeJob;
+	*rightJob = rightMapMergeJob;
+
+	return true;
+}
+
+
+/*
+ * DualHashRepartitionJobs returns whether the given job is an inner join of the
+ * outputs of two dual hash repartition jobs that read from shards, and for which
+ * shard statistics are available. If so, the function sets buildJob to the job
+ * with the smaller input, and probeJob to the other one.
+ */
+static bool
+DualHashRepartitionJobs(Job *job, MapMergeJob **buildJob, MapMergeJob **probeJob)
+{
+	MapMergeJob *leftMapMergeJob = NULL;
+	MapMergeJob *rightMapMergeJob = NULL;
+	uint64 leftInputSize = 0;
+	uint64 rightInputSize = 0;
+
+	if (!DualHashRepartitionJobPair(job, &leftMapMergeJob, &rightMapMergeJob))
+	{
+		return false;
+	}
+
+	/* rows of the outer side of a join must not be filtered out */
+	if (job->jobQuery == NULL ||
+		!JoinTreeHasOnlyInnerJoins((Node *) job->jobQuery->jointree))
+	{
+		return false;
+	}
+
+	if (!MapMergeJobInputSize(leftMapMergeJob, &leftInputSize) ||
+		!MapMergeJobInputSize(rightMapMergeJob, &rightInputSize))
+	{
+		return false;
+	}
+
+	if (leftInputSize <= rightInputSize)
+	{
+		*buildJob = leftMapMergeJob;
+		*probeJob = rightMapMergeJob;
+	}
+	else
+	{
+		*buildJob = rightMapMergeJob;
+		*probeJob = leftMapMergeJob;
+	}
+
+	return true;
+}
+
+
+/*
+ * MapMergeJobInputSize sets inputSize to the total size of the shards that the
+ * map tasks of the given job read, as recorded in the shard statistics. The
+ * function returns false if no sizes are recorded for the shards.
+ */
+static bool
+MapMergeJobInputSize(MapMergeJob *mapMergeJob, uint64 *inputSize)
+{
+	uint64 totalShardLength = 0;
+
+	Task *mapTask = NULL;
+	foreach_ptr(mapTask, mapMergeJob->mapTaskList)
+	{
+		totalShardLength += ShardLength(mapTask->anchorShardId);
+	}
+
+	if (totalShardLength == 0)
+	{
+		return false;
+	}
+
+	*inputSize = totalShardLength;
+	return true;
+}
+
+
+/*
+ * JoinTreeHasOnlyInnerJoins returns whether all joins in the given join tree
+ * are inner joins.
+ */
+static bool
+JoinTreeHasOnlyInnerJoins(Node *joinTreeNode)
+{
+	if (joinTreeNode == NULL)
+	{
+		return true;
+	}
+
+	if (IsA(joinTreeNode, FromExpr))
+	{
+		FromExpr *fromExpr = (FromExpr *) joinTreeNode;
+
+		Node *fromListNode = NULL;
+		foreach_ptr(fromListNode, fromExpr->fromlist)
+		{
+			if (!JoinTreeHasOnlyInnerJoins(fromListNode))
+			{
+				return false;
+			}
+		}
+	}
+	else if (IsA(joinTreeNode, JoinExpr))
+	{
+		JoinExpr *joinExpr = (JoinExpr *) joinTreeNode;
+
+		if (joinExpr->jointype != JOIN_INNER)
+		{
+			return false;
+		}
+
+		return JoinTreeHasOnlyInnerJoins(joinExpr->larg) &&
+			   JoinTreeHasOnlyInnerJoins(joinExpr->rarg);
+	}
+
+	return true;
+}
+
+
+/*
+ * BuildBloomFilterForMapMergeJob runs the filter queries of the map tasks of the
+ * given job on the workers, builds a bloom filter over the hash values of their
+ * partition column, and returns the union of these filters.
+ */
+static bytea *
+BuildBloomFilterForMapMergeJob(MapMergeJob *mapMergeJob)
+{
+	List *buildTaskList = NIL;
+	char *partitionColumnName = MapTaskPartitionColumnName(mapMergeJob);
+	int bloomFilterSize = RepartitionJoinBloomFilterSize * 1024;
+	TupleDesc tupleDescriptor = NULL;
+
+	Task *mapTask = NULL;
+	foreach_ptr(mapTask, mapMergeJob->mapTaskList)
+	{
+		StringInfo buildQueryString = makeStringInfo();
+		appendStringInfo(buildQueryString, BLOOM_FILTER_BUILD_QUERY,
+						 quote_identifier(partitionColumnName), bloomFilterSize,
+						 mapTask->filterQueryString);
+
+		Task *buildTask = CreateBasicTask(mapTask->jobId, mapTask->taskId,
+										  SELECT_TASK, buildQueryString->data);
+		buildTask->anchorShardId = mapTask->anchorShardId;
+		buildTask->taskPlacementList = mapTask->taskPlacementList;
+		buildTask->relationShardList = mapTask->relationShardList;
+
+		buildTaskList = lappend(buildTaskList, buildTask);
+	}
+
+#if PG_VERSION_NUM >= 120000
+	tupleDescriptor = CreateTemplateTupleDesc(1);
+#else
+	tupleDescriptor = CreateTemplateTupleDesc(1, false);
+#endif
+	TupleDescInitEntry(tupleDescriptor, (AttrNumber) 1, "bloom_filter",
+					   BYTEAOID, -1, 0);
+
+	Tuplestorestate *tupleStore = tuplestore_begin_heap(false, false, work_mem);
+	bool hasReturning = true;
+
+	ExecuteTaskListIntoTupleStore(ROW_MODIFY_READONLY, buildTaskList, tupleDescriptor,
+								  tupleStore, hasReturning);
+
+	bytea *bloomFilter = palloc0(VARHDRSZ + bloomFilterSize);
+	SET_VARSIZE(bloomFilter, VARHDRSZ + bloomFilterSize);
+
+	TupleTableSlot *slot = MakeSingleTupleTableSlotCompat(tupleDescriptor,
+														  &TTSOpsMinimalTuple);
+	while (tuplestore_gettupleslot(tupleStore, true, false, slot))
+	{
+		bool isNull = false;
+		Datum taskBloomFilter = slot_getattr(slot, 1, &isNull);
+
+		/* filter queries that return no rows yield no filter */
+		if (!isNull)
+		{
+			BloomFilterUnion(bloomFilter, DatumGetByteaPP(taskBloomFilter));
+		}
+
+		ExecClearTuple(slot);
+	}
+
+	ExecDropSingleTupleTableSlot(slot);
+	tuplestore_end(tupleStore);
+
+	return bloomFilter;
+}
+
+
+/*
+ * SampledSplitPointObject samples the partition column values of the map tasks
+ * of both given jobs, and returns split points that divide the sample into as
+ * many equally sized ranges as the jobs have partitions. Since both inputs are
+ * sampled at the same rate, the ranges reflect how many rows of both inputs
+ * each merge task receives. The function returns NULL if the partition column
+ * type cannot be sorted, or if the sample is too small.
+ */
+static ArrayType *
+SampledSplitPointObject(MapMergeJob *leftJob, MapMergeJob *rightJob)
+{
+	Var *partitionColumn = leftJob->partitionColumn;
+	Oid partitionColumnType = partitionColumn->vartype;
+	Oid partitionColumnCollation = partitionColumn->varcollid;
+	uint32 partitionCount = leftJob->partitionCount;
+	Datum *sampleArray = NULL;
+	int16 typeLength = 0;
+	bool typeByValue = false;
+	char typeAlignment = 0;
+
+	/* both sides need to compare the join keys the same way */
+	if (rightJob->partitionCount != partitionCount || partitionCount < 2 ||
+		rightJob->partitionColumn->varcollid != partitionColumnCollation)
+	{
+		return NULL;
+	}
+
+	/* map tasks compare values with the default btree operator class */
+	TypeCacheEntry *typeEntry = lookup_type_cache(partitionColumnType,
+												  TYPECACHE_CMP_PROC_FINFO);
+	if (!OidIsValid(typeEntry->cmp_proc))
+	{
+		return NULL;
+	}
+
+	int sampleCount = SampleMapMergeJob(leftJob, &sampleArray, 0);
+	sampleCount = SampleMapMergeJob(rightJob, &sampleArray, sampleCount);
+
+	if (sampleCount < (int) partitionCount)
+	{
+		ereport(DEBUG2, (errmsg("keeping hash partitioning of jobs " UINT64_FORMAT
+								" and " UINT64_FORMAT " since the sample has only "
+								"%d rows", leftJob->job.jobId, rightJob->job.jobId,
+								sampleCount)));
+		return NULL;
+	}
+
+	SplitPointSortContext sortContext = {
+		.comparisonFunction = &typeEntry->cmp_proc_finfo,
+		.collation = partitionColumnCollation
+	};
+	qsort_arg(sampleArray, sampleCount, sizeof(Datum), CompareSplitPoints,
+			  &sortContext);
+
+	/* range partitioning puts values below the first split point in bucket 0 */
+	uint32 splitPointCount = partitionCount - 1;
+	Datum *splitPointArray = palloc0(splitPointCount * sizeof(Datum));
+	for (uint32 splitPointIndex = 0; splitPointIndex < splitPointCount;
+		 splitPointIndex++)
+	{
+		uint64 sampleIndex = ((uint64) (splitPointIndex + 1) * sampleCount) /
+							 partitionCount;
+		splitPointArray[splitPointIndex] = sampleArray[sampleIndex];
+	}
+
+	get_typlenbyvalalign(partitionColumnType, &typeLength, &typeByValue,
+						 &typeAlignment);
+
+	return construct_array(splitPointArray, splitPointCount, partitionColumnType,
+						   typeLength, typeByValue, typeAlignment);
+}
+
+
+/*
+ * SampleMapMergeJob runs the filter queries of the map tasks of the given job
+ * on the workers, and samples RepartitionJoinSamplePercent of the non-NULL
+ * values of their partition column. The function appends the sampled values to
+ * the given array, which holds the given number of values, and returns the new
+ * number of values in the array.
+ */
+static int
+SampleMapMergeJob(MapMergeJob *mapMergeJob, Datum **sampleArray, int sampleCount)
+{
+	List *sampleTaskList = NIL;
+	Var *partitionColumn = mapMergeJob->partitionColumn;
+	char *partitionColumnName = quote_identifier(MapTaskPartitionColumnName(
+													 mapMergeJob));
+	double sampleFraction = RepartitionJoinSamplePercent / 100.0;
+	TupleDesc tupleDescriptor = NULL;
+	int16 typeLength = 0;
+	bool typeByValue = false;
+
+	Task *mapTask = NULL;
+	foreach_ptr(mapTask, mapMergeJob->mapTaskList)
+	{
+		StringInfo sampleQueryString = makeStringInfo();
+		appendStringInfo(sampleQueryString, SPLIT_POINT_SAMPLE_QUERY,
+						 partitionColumnName, mapTask->filterQueryString,
+						 partitionColumnName, sampleFraction);
+
+		Task *sampleTask = CreateBasicTask(mapTask->jobId, mapTask->taskId,
+										   SELECT_TASK, sampleQueryString->data);
+		sampleTask->anchorShardId = mapTask->anchorShardId;
+		sampleTask->taskPlacementList = mapTask->taskPlacementList;
+		sampleTask->relationShardList = mapTask->relationShardList;
+
+		sampleTaskList = lappend(sampleTaskList, sampleTask);
+	}
+
+#if PG_VERSION_NUM >= 120000
+	tupleDescriptor = CreateTemplateTupleDesc(1);
+#else
+	tupleDescriptor = CreateTemplateTupleDesc(1, false);
+#endif
+	TupleDescInitEntry(tupleDescriptor, (AttrNumber) 1, "split_point",
+					   partitionColumn->vartype, partitionColumn->vartypmod, 0);
+
+	Tuplestorestate *tupleStore = tuplestore_begin_heap(false, false, work_mem);
+	bool hasReturning = true;
+
+	ExecuteTaskListIntoTupleStore(ROW_MODIFY_READONLY, sampleTaskList, tupleDescriptor,
+								  tupleStore, hasReturning);
+
+	int64 newSampleCount = sampleCount + tuplestore_tuple_count(tupleStore);
+	if (newSampleCount >= MaxAllocSize / sizeof(Datum))
+	{
+		ereport(ERROR, (errmsg("repartition join sample is too large"),
+						errhint("Lower citus.repartition_join_sample_percent.")));
+	}
+
+	if (newSampleCount > 0)
+	{
+		if (*sampleArray == NULL)
+		{
+			*sampleArray = palloc(newSampleCount * sizeof(Datum));
+		}
+		else
+		{
+			*sampleArray = repalloc(*sampleArray, newSampleCount * sizeof(Datum));
+		}
+	}
+
+	get_typlenbyval(partitionColumn->vartype, &typeLength, &typeByValue);
+
+	TupleTableSlot *slot = MakeSingleTupleTableSlotCompat(tupleDescriptor,
+														  &TTSOpsMinimalTuple);
+	while (tuplestore_gettupleslot(tupleStore, true, false, slot))
+	{
+		bool isNull = false;
+		Datum sampleValue = slot_getattr(slot, 1, &isNull);
+
+		if (!isNull)
+		{
+			(*sampleArray)[sampleCount] = datumCopy(sampleValue, typeByValue,
+													typeLength);
+			sampleCount++;
+		}
+
+		ExecClearTuple(slot);
+	}
+
+	ExecDropSingleTupleTableSlot(slot);
+	tuplestore_end(tupleStore);
+
+	return sampleCount;
+}
+
+
+/*
+ * CompareSplitPoints compares two sampled partition column values using the
+ * comparison function and collation in the given SplitPointSortContext.
+ */
+static int
+CompareSplitPoints(const void *leftElement, const void *rightElement, void *context)
+{
+	SplitPointSortContext *sortContext = (SplitPointSortContext *) context;
+	Datum leftValue = *((const Datum *) leftElement);
+	Datum rightValue = *((const Datum *) rightElement);
+
+	Datum comparisonDatum = FunctionCall2Coll(sortContext->comparisonFunction,
+											  sortContext->collation, leftValue,
+											  rightValue);
+
+	return DatumGetInt32(comparisonDatum);
+}
+
+
 /*
  * CreateTemporarySchemasForMergeTasks creates the necessary schemas that will be used
  * later in each worker. Single transaction is used to create the schemas.
@@ -0,0 +1,896 @@
+/*-------------------------------------------------------------------------
+ *
+ * result_cache.c
+ *   Keeps the results of read-only queries that consist of a single task,
+ *   such as router queries and queries on reference tables, in shared
+ *   memory, such that repeated queries are answered by the coordinator
+ *   without opening connections to the workers.
+ *
+ *   Results are found through a shared hash keyed by the database, the user
+ *   and a hash of the query string and parameters of the task, and are
+ *   serialized into a chunk of a dynamic shared memory area that lives in
+ *   the main shared memory segment, like the shared metadata cache.
+ *
+ *   Every shard has a generation counter, which transactions that modified
+ *   the shard through the coordinator increment once they committed or
+ *   aborted. A cached result stores the generations of the shards of its
+ *   task as they were before the task was executed, and is stale once any
+ *   of them changed. Transactions that modified shards neither read nor
+ *   store cached results, since their own changes are not visible to others.
+ *
+ *   Modifications that do not go through the coordinator, for instance from
+ *   workers with metadata or directly on the shards, do not increment the
+ *   generations, which is why the cache is opt-in.
+ *
+ * Copyright (c) Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include "postgres.h"
+
+#include "miscadmin.h"
+
+#include "access/hash.h"
+#include "access/htup_details.h"
+#include "access/xact.h"
+#include "distributed/citus_custom_scan.h"
+#include "distributed/deparse_shard_query.h"
+#include "distributed/distributed_planner.h"
+#include "distributed/listutils.h"
+#include "distributed/master_metadata_utility.h"
+#include "distributed/multi_executor.h"
+#include "distributed/multi_physical_planner.h"
+#include "distributed/result_cache.h"
+#include "distributed/version_compat.h"
+#include "executor/tuptable.h"
+#include "optimizer/clauses.h"
+#if PG_VERSION_NUM >= 120000
+#include "optimizer/optimizer.h"
+#endif
+#include "port/atomics.h"
+#include "storage/ipc.h"
+#include "storage/lwlock.h"
+#include "storage/shmem.h"
+#include "utils/dsa.h"
+#include "utils/hsearch.h"
+#include "utils/memutils.h"
+#include "utils/tuplestore.h"
+
+
+/* number of generation counters, shards are spread over them by hash */
+#define RESULT_CACHE_COUNTER_COUNT 4096
+
+/* maximum number of shards that the task of a cached result reads */
+#define RESULT_CACHE_MAX_SHARDS 8
+
+/* expected size of a result, used to size the shared hash */
+#define RESULT_CACHE_AVERAGE_ENTRY_SIZE 2048
+#define RESULT_CACHE_MIN_ENTRIES 64
+
+/* results that take more than this fraction of the cache are not stored */
+#define RESULT_CACHE_MAX_ENTRY_FRACTION 16
+
+
+/*
+ * ResultCacheControlData contains the lock that protects the shared hash, and
+ * the generation counters of the shards.
+ */
+typedef struct ResultCacheControlData
+{
+	int trancheId;
+	char *lockTrancheName;
+	LWLock lock;
+
+	int areaTrancheId;
+	char *areaTrancheName;
+
+	/* incremented when a shard that hashes to the counter was modified */
+	pg_atomic_uint64 generationCounters[RESULT_CACHE_COUNTER_COUNT];
+} ResultCacheControlData;
+
+
+/* hash key for the shared cache */
+typedef struct ResultCacheHashKey
+{
+	Oid databaseId;
+	Oid userId;
+	uint64 queryHash;
+} ResultCacheHashKey;
+
+
+/* hash entry for the shared cache, pointing to the serialized result */
+typedef struct ResultCacheHashEntry
+{
+	ResultCacheHashKey key;
+
+	dsa_pointer data;
+	Size size;
+
+	/* set on every hit, cleared when entries are evicted */
+	bool recentlyUsed;
+} ResultCacheHashEntry;
+
+
+/*
+ * A serialized result starts with a header, followed by the query string and
+ * parameters of the task and the rows as minimal tuples, all MAXALIGN'ed.
+ */
+typedef struct SerializedResultHeader
+{
+	int32 keyLength;
+	int32 columnCount;
+	int32 shardCount;
+	int64 rowCount;
+	uint64 shardIdArray[RESULT_CACHE_MAX_SHARDS];
+	uint64 generationArray[RESULT_CACHE_MAX_SHARDS];
+} SerializedResultHeader;
+
+
+/*
+ * ResultCacheKey is the backend-local key of a query, with the generations of
+ * its shards as they were before the query was executed.
+ */
+struct ResultCacheKey
+{
+	ResultCacheHashKey hashKey;
+	StringInfo keyText;
+
+	int shardCount;
+	uint64 shardIdArray[RESULT_CACHE_MAX_SHARDS];
+	uint64 generationArray[RESULT_CACHE_MAX_SHARDS];
+};
+
+
+/* GUC, size of the shared cache in kB */
+int ResultCacheSize = 0;
+
+/* GUC, whether queries of the current session use the cache */
+bool EnableResultCache = true;
+
+static shmem_startup_hook_type prev_shmem_startup_hook = NULL;
+static ResultCacheControlData *ResultCacheSharedState = NULL;
+
+/* shared hash of cached results */
+static HTAB *ResultCacheHash = NULL;
+
+/* memory of the dynamic shared memory area, and our mapping of it */
+static void *ResultCacheAreaPlace = NULL;
+static dsa_area *ResultCacheArea = NULL;
+
+/* generation counters of the shards that the current transaction modified */
+static bool ModifiedGenerationCounters[RESULT_CACHE_COUNTER_COUNT];
+static bool TransactionModifiedShards = false;
+
+
+static bool AddShardToResultCacheKey(ResultCacheKey *cacheKey, uint64 shardId);
+static void AppendTaskParameters(StringInfo keyText, ParamListInfo paramListInfo);
+static bool CachedResultIsCurrent(SerializedResultHeader *header);
+static bool EvictResultCacheEntries(void);
+static dsa_pointer AllocateCachedResult(Size size);
+static void AttachResultCacheArea(void);
+static uint32 GenerationCounterIndex(uint64 shardId);
+static uint64 CurrentShardGeneration(uint64 shardId);
+static Size ResultCacheAreaSize(void);
+static long ResultCacheMaxEntries(void);
+static Size ResultCacheShmemSize(void);
+static void ResultCacheShmemInit(void);
+
+
+/*
+ * InitializeResultCache, called at server start, requests the shared memory
+ * for the cache if it is enabled.
+ */
+void
+InitializeResultCache(void)
+{
+	if (ResultCacheSize == 0)
+	{
+		return;
+	}
+
+	if (!IsUnderPostmaster)
+	{
+		RequestAddinShmemSpace(ResultCacheShmemSize());
+	}
+
+	prev_shmem_startup_hook = shmem_startup_hook;
+	shmem_startup_hook = ResultCacheShmemInit;
+}
+
+
+/*
+ * ResultCacheKeyForExecution returns the cache key of the given tasks of a
+ * scan, or NULL if the result of the scan cannot be cached. The generations
+ * of the shards of the task are read here, such that the caller should call
+ * this before executing the task.
+ */
+ResultCacheKey *
+ResultCacheKeyForExecution(CitusScanState *scanState, List *taskList)
+{
+	DistributedPlan *distributedPlan = scanState->distributedPlan;
+	Job *job = distributedPlan->workerJob;
+	EState *executorState = ScanStateGetExecutorState(scanState);
+
+	if (ResultCacheSharedState == NULL || !EnableResultCache)
+	{
+		return NULL;
+	}
+
+	/* the shared results do not contain the changes of the current transaction */
+	if (TransactionModifiedShards)
+	{
+		return NULL;
+	}
+
+	/* cached results may contain changes that the snapshot should not see */
+	if (IsolationUsesXactSnapshot())
+	{
+		return NULL;
+	}
+
+	if (distributedPlan->modLevel != ROW_MODIFY_READONLY ||
+		distributedPlan->subPlanList != NIL || job->dependentJobList != NIL ||
+		list_length(taskList) != 1 || job->jobQuery == NULL)
+	{
+		return NULL;
+	}
+
+	/* EXPLAIN ANALYZE shows the execution of the task */
+	if (scanState->customScanState.ss.ps.instrument != NULL)
+	{
+		return NULL;
+	}
+
+	Task *task = (Task *) linitial(taskList);
+	if (task->relationRowLockList != NIL)
+	{
+		return NULL;
+	}
+
+	/* functions such as now() or random() give another result every time */
+	if (contain_mutable_functions((Node *) job->jobQuery))
+	{
+		return NULL;
+	}
+
+	ResultCacheKey *cacheKey = (ResultCacheKey *) palloc0(sizeof(ResultCacheKey));
+
+	RelationShard *relationShard = NULL;
+	foreach_ptr(relationShard, task->relationShardList)
+	{
+		if (!AddShardToResultCacheKey(cacheKey, relationShard->shardId))
+		{
+			return NULL;
+		}
+	}
+
+	if (!AddShardToResultCacheKey(cacheKey, task->anchorShardId))
+	{
+		return NULL;
+	}
+
+	if (cacheKey->shardCount == 0)
+	{
+		return NULL;
+	}
+
+	cacheKey->keyText = makeStringInfo();
+	appendStringInfoString(cacheKey->keyText, TaskQueryString(task));
+	AppendTaskParameters(cacheKey->keyText, executorState->es_param_list_info);
+
+	/* the key is hashed as a blob, zero the padding */
+	memset(&cacheKey->hashKey, 0, sizeof(ResultCacheHashKey));
+	cacheKey->hashKey.databaseId = MyDatabaseId;
+	cacheKey->hashKey.userId = GetUserId();
+	cacheKey->hashKey.queryHash =
+		DatumGetUInt64(hash_any_extended((unsigned char *) cacheKey->keyText->data,
+										 cacheKey->keyText->len, 0));
+
+	return cacheKey;
+}
+
+
+/*
+ * AddShardToResultCacheKey adds the given shard and its current generation to
+ * the given key, unless it is already there or invalid. The function returns
+ * false if the key has no room for more shards.
+ */
+static bool
+AddShardToResultCacheKey(ResultCacheKey *cacheKey, uint64 shardId)
+{
+	if (shardId == INVALID_SHARD_ID)
+	{
+		return true;
+	}
+
+	for (int shardIndex = 0; shardIndex < cacheKey->shardCount; shardIndex++)
+	{
+		if (cacheKey->shardIdArray[shardIndex] == shardId)
+		{
+			return true;
+		}
+	}
+
+	if (cacheKey->shardCount == RESULT_CACHE_MAX_SHARDS)
+	{
+		return false;
+	}
+
+	cacheKey->shardIdArray[cacheKey->shardCount] = shardId;
+	cacheKey->generationArray[cacheKey->shardCount] = CurrentShardGeneration(shardId);
+	cacheKey->shardCount++;
+
+	return true;
+}
+
+
+/*
+ * AppendTaskParameters appends the types and values of the given parameters
+ * to the key text, with the length of every value to keep keys unambiguous.
+ */
+static void
+AppendTaskParameters(StringInfo keyText, ParamListInfo paramListInfo)
+{
+	Oid *parameterTypes = NULL;
+	const char **parameterValues = NULL;
+	bool useOriginalCustomTypeOids = true;
+
+	if (paramListInfo == NULL || paramListInfo->numParams == 0)
+	{
+		return;
+	}
+
+	ExtractParametersFromParamList(paramListInfo, &parameterTypes, &parameterValues,
+								   useOriginalCustomTypeOids);
+
+	for (int parameterIndex = 0; parameterIndex < paramListInfo->numParams;
+		 parameterIndex++)
+	{
+		const char *parameterValue = parameterValues[parameterIndex];
+
+		appendStringInfo(keyText, "\n$%d %u ", parameterIndex + 1,
+						 parameterTypes[parameterIndex]);
+
+		if (parameterValue == NULL)
+		{
+			appendStringInfoString(keyText, "NULL");
+		}
+		else
+		{
+			appendStringInfo(keyText, "%zu:%s", strlen(parameterValue), parameterValue);
+		}
+	}
+}
+
+
+/*
+ * LookupCachedResult fills the tuple store of the given scan with the cached
+ * result of the given key, and returns whether a current result was found.
+ */
+bool
+LookupCachedResult(ResultCacheKey *cacheKey, CitusScanState *scanState)
+{
+	TupleDesc tupleDescriptor = ScanStateGetTupleDescriptor(scanState);
+	bool randomAccess = true;
+	bool interTransactions = false;
+	bool found = false;
+
+	AttachResultCacheArea();
+
+	LWLockAcquire(&ResultCacheSharedState->lock, LW_SHARED);
+
+	ResultCacheHashEntry *entry = hash_search(ResultCacheHash, &cacheKey->hashKey,
+											  HASH_FIND, &found);
+	if (!found)
+	{
+		LWLockRelease(&ResultCacheSharedState->lock);
+		return false;
+	}
+
+	char *data = palloc(entry->size);
+	memcpy(data, dsa_get_address(ResultCacheArea, entry->data), entry->size);
+
+	/* entries are only evicted under the exclusive lock, a lost update is harmless */
+	entry->recentlyUsed = true;
+
+	LWLockRelease(&ResultCacheSharedState->lock);
+
+	SerializedResultHeader *header = (SerializedResultHeader *) data;
+	char *keyText = data + MAXALIGN(sizeof(SerializedResultHeader));
+
+	if (header->keyLength != cacheKey->keyText->len ||
+		memcmp(keyText, cacheKey->keyText->data, header->keyLength) != 0 ||
+		header->columnCount != tupleDescriptor->natts ||
+		!CachedResultIsCurrent(header))
+	{
+		pfree(data);
+		return false;
+	}
+
+	scanState->tuplestorestate =
+		tuplestore_begin_heap(randomAccess, interTransactions, work_mem);
+
+	TupleTableSlot *slot = MakeSingleTupleTableSlotCompat(tupleDescriptor,
+														  &TTSOpsMinimalTuple);
+	Size offset = MAXALIGN(sizeof(SerializedResultHeader)) +
+				  MAXALIGN(header->keyLength);
+
+	for (int64 rowIndex = 0; rowIndex < header->rowCount; rowIndex++)
+	{
+		MinimalTuple tuple = (MinimalTuple) (data + offset);
+		bool shouldFree = false;
+
+		ExecStoreMinimalTuple(tuple, slot, shouldFree);
+		tuplestore_puttupleslot(scanState->tuplestorestate, slot);
+
+		offset += MAXALIGN(tuple->t_len);
+	}
+
+	ExecDropSingleTupleTableSlot(slot);
+	pfree(data);
+
+	ereport(DEBUG1, (errmsg("using the cached result of the query")));
+
+	return true;
+}
+
+
+/*
+ * StoreCachedResult stores the rows in the tuple store of the given scan as
+ * the result of the given key, unless one of its shards was modified after
+ * the key was built. Results that are too large, or do not fit in the cache
+ * after evicting entries, are silently not stored.
+ */
+void
+StoreCachedResult(ResultCacheKey *cacheKey, CitusScanState *scanState)
+{
+	Tuplestorestate *tupleStore = scanState->tuplestorestate;
+	TupleDesc tupleDescriptor = ScanStateGetTupleDescriptor(scanState);
+	Size maxSize = ResultCacheAreaSize() / RESULT_CACHE_MAX_ENTRY_FRACTION;
+	List *tupleList = NIL;
+	bool forward = true;
+	bool copy = false;
+	bool found = false;
+
+	Size size = MAXALIGN(sizeof(SerializedResultHeader)) +
+				MAXALIGN(cacheKey->keyText->len);
+	if (tupleStore == NULL || size > maxSize)
+	{
+		return;
+	}
+
+	TupleTableSlot *slot = MakeSingleTupleTableSlotCompat(tupleDescriptor,
+														  &TTSOpsMinimalTuple);
+
+	while (tuplestore_gettupleslot(tupleStore, forward, copy, slot))
+	{
+		slot_getallattrs(slot);
+
+		MinimalTuple tuple = heap_form_minimal_tuple(tupleDescriptor,
+													 slot->tts_values,
+													 slot->tts_isnull);
+
+		size += MAXALIGN(tuple->t_len);
+		if (size > maxSize)
+		{
+			break;
+		}
+
+		tupleList = lappend(tupleList, tuple);
+	}
+
+	/* the rows are returned from the start of the tuple store */
+	tuplestore_rescan(tupleStore);
+	ExecDropSingleTupleTableSlot(slot);
+
+	if (size > maxSize)
+	{
+		return;
+	}
+
+	char *data = palloc0(size);
+	SerializedResultHeader *header = (SerializedResultHeader *) data;
+
+	header->keyLength = cacheKey->keyText->len;
+	header->columnCount = tupleDescriptor->natts;
+	header->shardCount = cacheKey->shardCount;
+	header->rowCount = list_length(tupleList);
+	memcpy(header->shardIdArray, cacheKey->shardIdArray,
+		   sizeof(cacheKey->shardIdArray));
+	memcpy(header->generationArray, cacheKey->generationArray,
+		   sizeof(cacheKey->generationArray));
+
+	Size offset = MAXALIGN(sizeof(SerializedResultHeader));
+	memcpy(data + offset, cacheKey->keyText->data, cacheKey->keyText->len);
+	offset += MAXALIGN(cacheKey->keyText->len);
+
+	MinimalTuple tuple = NULL;
+	foreach_ptr(tuple, tupleList)
+	{
+		memcpy(data + offset, tuple, tuple->t_len);
+		offset += MAXALIGN(tuple->t_len);
+	}
+
+	AttachResultCacheArea();
+
+	dsa_pointer sharedData = AllocateCachedResult(size);
+	if (!DsaPointerIsValid(sharedData))
+	{
+		pfree(data);
+		return;
+	}
+
+	memcpy(dsa_get_address(ResultCacheArea, sharedData), data, size);
+	pfree(data);
+
+	LWLockAcquire(&ResultCacheSharedState->lock, LW_EXCLUSIVE);
+
+	SerializedResultHeader *sharedHeader =
+		(SerializedResultHeader *) dsa_get_address(ResultCacheArea, sharedData);
+	if (!CachedResultIsCurrent(sharedHeader))
+	{
+		LWLockRelease(&ResultCacheSharedState->lock);
+		dsa_free(ResultCacheArea, sharedData);
+		return;
+	}
+
+	ResultCacheHashEntry *entry = hash_search(ResultCacheHash, &cacheKey->hashKey,
+											  HASH_ENTER_NULL, &found);
+	if (entry == NULL)
+	{
+		LWLockRelease(&ResultCacheSharedState->lock);
+		dsa_free(ResultCacheArea, sharedData);
+		return;
+	}
+
+	if (found)
+	{
+		dsa_free(ResultCacheArea, entry->data);
+	}
+
+	entry->data = sharedData;
+	entry->size = size;
+	entry->recentlyUsed = false;
+
+	LWLockRelease(&ResultCacheSharedState->lock);
+}
+
+
+/*
+ * AllocateCachedResult allocates a chunk of the given size in the area of the
+ * cache, evicting entries once if the area is full. It returns an invalid
+ * pointer if there is still no room.
+ */
+static dsa_pointer
+AllocateCachedResult(Size size)
+{
+	dsa_pointer sharedData = dsa_allocate_extended(ResultCacheArea, size,
+												   DSA_ALLOC_NO_OOM);
+	if (DsaPointerIsValid(sharedData))
+	{
+		return sharedData;
+	}
+
+	if (!EvictResultCacheEntries())
+	{
+		return InvalidDsaPointer;
+	}
+
+	return dsa_allocate_extended(ResultCacheArea, size, DSA_ALLOC_NO_OOM);
+}
+
+
+/*
+ * EvictResultCacheEntries removes the stale entries and the entries that were
+ * not used since the last eviction from the cache, and marks the remaining
+ * entries as not used. It returns whether any entry was removed.
+ */
+static bool
+EvictResultCacheEntries(void)
+{
+	HASH_SEQ_STATUS status;
+	ResultCacheHashEntry *entry = NULL;
+	bool entryRemoved = false;
+
+	LWLockAcquire(&ResultCacheSharedState->lock, LW_EXCLUSIVE);
+
+	hash_seq_init(&status, ResultCacheHash);
+	while ((entry = hash_seq_search(&status)) != NULL)
+	{
+		SerializedResultHeader *header =
+			(SerializedResultHeader *) dsa_get_address(ResultCacheArea, entry->data);
+
+		if (entry->recentlyUsed && CachedResultIsCurrent(header))
+		{
+			entry->recentlyUsed = false;
+			continue;
+		}
+
+		dsa_free(ResultCacheArea, entry->data);
+		hash_search(ResultCacheHash, &entry->key, HASH_REMOVE, NULL);
+		entryRemoved = true;
+	}
+
+	LWLockRelease(&ResultCacheSharedState->lock);
+
+	return entryRemoved;
+}
+
+
+/*
+ * CachedResultIsCurrent returns whether none of the shards of the given result
+ * were modified since the generations in the result were read.
+ */
+static bool
+CachedResultIsCurrent(SerializedResultHeader *header)
+{
+	for (int shardIndex = 0; shardIndex < header->shardCount; shardIndex++)
+	{
+		uint64 shardId = header->shardIdArray[shardIndex];
+
+		if (CurrentShardGeneration(shardId) != header->generationArray[shardIndex])
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+
+/*
+ * RecordModifiedShard records that the current transaction modified the given
+ * shard, such that the generation of the shard is incremented at the end of
+ * the transaction.
+ */
+void
+RecordModifiedShard(uint64 shardId)
+{
+	if (ResultCacheSharedState == NULL || shardId == INVALID_SHARD_ID)
+	{
+		return;
+	}
+
+	ModifiedGenerationCounters[GenerationCounterIndex(shardId)] = true;
+	TransactionModifiedShards = true;
+}
+
+
+/*
+ * RecordModifiedShardsOfTaskList records that the current transaction modified
+ * the shards of the given tasks.
+ */
+void
+RecordModifiedShardsOfTaskList(List *taskList)
+{
+	Task *task = NULL;
+
+	if (ResultCacheSharedState == NULL)
+	{
+		return;
+	}
+
+	foreach_ptr(task, taskList)
+	{
+		RecordModifiedShard(task->anchorShardId);
+
+		RelationShard *relationShard = NULL;
+		foreach_ptr(relationShard, task->relationShardList)
+		{
+			RecordModifiedShard(relationShard->shardId);
+		}
+	}
+}
+
+
+/*
+ * RecordModifiedShardIntervals records that the current transaction modified
+ * the given shards.
+ */
+void
+RecordModifiedShardIntervals(List *shardIntervalList)
+{
+	ShardInterval *shardInterval = NULL;
+
+	if (ResultCacheSharedState == NULL)
+	{
+		return;
+	}
+
+	foreach_ptr(shardInterval, shardIntervalList)
+	{
+		RecordModifiedShard(shardInterval->shardId);
+	}
+}
+
+
+/*
+ * ResultCacheAtEOXact increments the generations of the shards that the
+ * current transaction modified. It is called after the transaction committed
+ * or aborted on all nodes, such that results that are read with a new
+ * generation contain its changes, and must not throw errors.
+ */
+void
+ResultCacheAtEOXact(void)
+{
+	if (!TransactionModifiedShards)
+	{
+		return;
+	}
+
+	for (int counterIndex = 0; counterIndex < RESULT_CACHE_COUNTER_COUNT; counterIndex++)
+	{
+		if (ModifiedGenerationCounters[counterIndex])
+		{
+			pg_atomic_fetch_add_u64(
+				&ResultCacheSharedState->generationCounters[counterIndex], 1);
+			ModifiedGenerationCounters[counterIndex] = false;
+		}
+	}
+
+	TransactionModifiedShards = false;
+}
+
+
+/*
+ * AttachResultCacheArea maps the dynamic shared memory area of the cache in
+ * the current backend, if not done yet.
+ */
+static void
+AttachResultCacheArea(void)
+{
+	if (ResultCacheArea != NULL)
+	{
+		return;
+	}
+
+	MemoryContext oldContext = MemoryContextSwitchTo(TopMemoryContext);
+	ResultCacheArea = dsa_attach_in_place(ResultCacheAreaPlace, NULL);
+	MemoryContextSwitchTo(oldContext);
+
+	on_shmem_exit(dsa_on_shmem_exit_release_in_place,
+				  PointerGetDatum(ResultCacheAreaPlace));
+}
+
+
+/*
+ * GenerationCounterIndex returns the index of the generation counter of the
+ * given shard of the current database.
+ */
+static uint32
+GenerationCounterIndex(uint64 shardId)
+{
+	uint32 shardIdHash = (uint32) (shardId ^ (shardId >> 32)) ^ MyDatabaseId;
+
+	return DatumGetUInt32(hash_uint32(shardIdHash)) % RESULT_CACHE_COUNTER_COUNT;
+}
+
+
+/*
+ * CurrentShardGeneration returns the current generation of the given shard.
+ */
+static uint64
+CurrentShardGeneration(uint64 shardId)
+{
+	uint32 counterIndex = GenerationCounterIndex(shardId);
+
+	return pg_atomic_read_u64(&ResultCacheSharedState->generationCounters[counterIndex]);
+}
+
+
+/*
+ * ResultCacheAreaSize returns the size of the dynamic shared memory area that
+ * holds the serialized results.
+ */
+static Size
+ResultCacheAreaSize(void)
+{
+	return Max((Size) ResultCacheSize * 1024L, dsa_minimum_size());
+}
+
+
+/*
+ * ResultCacheMaxEntries returns the maximum number of results in the shared
+ * hash, based on the size of the area.
+ */
+static long
+ResultCacheMaxEntries(void)
+{
+	return Max(ResultCacheAreaSize() / RESULT_CACHE_AVERAGE_ENTRY_SIZE,
+			   RESULT_CACHE_MIN_ENTRIES);
+}
+
+
+/*
+ * ResultCacheShmemSize returns the size of the shared memory needed for the
+ * cache.
+ */
+static Size
+ResultCacheShmemSize(void)
+{
+	Size size = 0;
+
+	size = add_size(size, sizeof(ResultCacheControlData));
+
+	Size hashSize = hash_estimate_size(ResultCacheMaxEntries(),
+									   sizeof(ResultCacheHashEntry));
+	size = add_size(size, hashSize);
+
+	size = add_size(size, ResultCacheAreaSize());
+
+	return size;
+}
+
+
+/*
+ * ResultCacheShmemInit initializes the shared memory for the cache.
+ */
+static void
+ResultCacheShmemInit(void)
+{
+	bool alreadyInitialized = false;
+	bool areaInitialized = false;
+	HASHCTL info;
+
+	LWLockAcquire(AddinShmemInitLock, LW_EXCLUSIVE);
+
+	ResultCacheSharedState =
+		(ResultCacheControlData *) ShmemInitStruct("Citus Result Cache",
+												   sizeof(ResultCacheControlData),
+												   &alreadyInitialized);
+
+	ResultCacheAreaPlace = ShmemInitStruct("Citus Result Cache Area",
+										   ResultCacheAreaSize(), &areaInitialized);
+
+	/*
+	 * Might already be initialized on EXEC_BACKEND type platforms that call
+	 * shared library initialization functions in every backend.
+	 */
+	if (!alreadyInitialized)
+	{
+		ResultCacheSharedState->trancheId = LWLockNewTrancheId();
+		ResultCacheSharedState->lockTrancheName = "Citus Result Cache";
+		LWLockRegisterTranche(ResultCacheSharedState->trancheId,
+							  ResultCacheSharedState->lockTrancheName);
+
+		LWLockInitialize(&ResultCacheSharedState->lock,
+						 ResultCacheSharedState->trancheId);
+
+		ResultCacheSharedState->areaTrancheId = LWLockNewTrancheId();
+		ResultCacheSharedState->areaTrancheName = "Citus Result Cache Area";
+		LWLockRegisterTranche(ResultCacheSharedState->areaTrancheId,
+							  ResultCacheSharedState->areaTrancheName);
+
+		for (int counterIndex = 0; counterIndex < RESULT_CACHE_COUNTER_COUNT;
+			 counterIndex++)
+		{
+			pg_atomic_init_u64(&ResultCacheSharedState->generationCounters[counterIndex],
+							   0);
+		}
+
+		/* limit the area to its place, such that it never creates DSM segments */
+		dsa_area *area = dsa_create_in_place(ResultCacheAreaPlace,
+											 ResultCacheAreaSize(),
+											 ResultCacheSharedState->areaTrancheId,
+											 NULL);
+		dsa_set_size_limit(area, ResultCacheAreaSize());
+		dsa_detach(area);
+	}
+
+	memset(&info, 0, sizeof(info));
+	info.keysize = sizeof(ResultCacheHashKey);
+	info.entrysize = sizeof(ResultCacheHashEntry);
+	int hashFlags = (HASH_ELEM | HASH_BLOBS);
+
+	ResultCacheHash = ShmemInitHash("Citus Result Cache Hash",
+									ResultCacheMaxEntries(), ResultCacheMaxEntries(),
+									&info, hashFlags);
+
+	LWLockRelease(AddinShmemInitLock);
+
+	if (prev_shmem_startup_hook != NULL)
+	{
+		prev_shmem_startup_hook();
+	}
+}
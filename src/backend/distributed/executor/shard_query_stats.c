@@ -0,0 +1,367 @@
+/*-------------------------------------------------------------------------
+ *
+ * shard_query_stats.c
+ *   Keeps track of the number of tasks and their execution time per shard
+ *   across all backends, such that the rebalancer can balance the load of
+ *   the queries rather than only the size of the shards.
+ *
+ *   The adaptive executor and the local executor record every task they
+ *   finish successfully under the anchor shard of the task in a shared hash
+ *   keyed by shard ID. The size of the hash is limited by
+ *   citus.shard_query_stats_max, tasks on shards that do not fit in the hash
+ *   are not counted until the statistics are reset.
+ *
+ *   Like in pg_stat_statements, existing entries are updated while holding
+ *   the lock in shared mode and a spinlock on the entry, such that backends
+ *   only need to wait for each other when a new shard is added.
+ *
+ * Copyright (c) Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include "postgres.h"
+
+#include "fmgr.h"
+#include "miscadmin.h"
+
+#include "distributed/colocation_utils.h"
+#include "distributed/listutils.h"
+#include "distributed/metadata_cache.h"
+#include "distributed/shard_query_stats.h"
+#include "distributed/tuplestore.h"
+#include "storage/ipc.h"
+#include "storage/lwlock.h"
+#include "storage/shmem.h"
+#include "storage/spin.h"
+#include "utils/builtins.h"
+#include "utils/hsearch.h"
+
+
+/*
+ * ShardQueryStatsControlData contains the lock that protects the shared hash
+ * of shard query statistics.
+ */
+typedef struct ShardQueryStatsControlData
+{
+	int trancheId;
+	char *lockTrancheName;
+	LWLock lock;
+} ShardQueryStatsControlData;
+
+
+/* hash entry for the query statistics of a shard */
+typedef struct ShardQueryStatsHashEntry
+{
+	uint64 shardId;
+
+	slock_t mutex;
+	uint64 queryCount;
+	double totalTimeMs;
+} ShardQueryStatsHashEntry;
+
+
+/*
+ * GUC, the maximum number of shards for which query statistics are kept. 0
+ * disables the statistics.
+ */
+int ShardQueryStatsMax = 10000;
+
+static shmem_startup_hook_type prev_shmem_startup_hook = NULL;
+static ShardQueryStatsControlData *ShardQueryStatsSharedState = NULL;
+static HTAB *ShardQueryStatsHash = NULL;
+
+
+static size_t ShardQueryStatsShmemSize(void);
+static void ShardQueryStatsShmemInit(void);
+static double ShardQueryTotalTime(uint64 shardId);
+
+
+PG_FUNCTION_INFO_V1(citus_shard_query_stats);
+PG_FUNCTION_INFO_V1(citus_shard_query_stats_reset);
+PG_FUNCTION_INFO_V1(citus_shard_cost_by_query_load);
+
+
+/*
+ * InitializeShardQueryStats, called at server start, requests the shared
+ * memory for the shard query statistics.
+ */
+void
+InitializeShardQueryStats(void)
+{
+	if (ShardQueryStatsMax == 0)
+	{
+		return;
+	}
+
+	if (!IsUnderPostmaster)
+	{
+		RequestAddinShmemSpace(ShardQueryStatsShmemSize());
+	}
+
+	prev_shmem_startup_hook = shmem_startup_hook;
+	shmem_startup_hook = ShardQueryStatsShmemInit;
+}
+
+
+/*
+ * RecordShardQueryExecution counts a successfully finished task on the given
+ * shard that took executionTimeMs.
+ */
+void
+RecordShardQueryExecution(uint64 shardId, double executionTimeMs)
+{
+	bool found = false;
+
+	if (ShardQueryStatsHash == NULL || shardId == INVALID_SHARD_ID)
+	{
+		return;
+	}
+
+	LWLockAcquire(&ShardQueryStatsSharedState->lock, LW_SHARED);
+
+	ShardQueryStatsHashEntry *entry =
+		hash_search(ShardQueryStatsHash, &shardId, HASH_FIND, &found);
+	if (!found)
+	{
+		/* adding a new entry requires the lock in exclusive mode */
+		LWLockRelease(&ShardQueryStatsSharedState->lock);
+		LWLockAcquire(&ShardQueryStatsSharedState->lock, LW_EXCLUSIVE);
+
+		entry = hash_search(ShardQueryStatsHash, &shardId, HASH_ENTER_NULL, &found);
+		if (entry == NULL)
+		{
+			/* the hash is full, the shard is not counted */
+			LWLockRelease(&ShardQueryStatsSharedState->lock);
+			return;
+		}
+
+		if (!found)
+		{
+			SpinLockInit(&entry->mutex);
+			entry->queryCount = 0;
+			entry->totalTimeMs = 0.0;
+		}
+	}
+
+	SpinLockAcquire(&entry->mutex);
+	entry->queryCount++;
+	entry->totalTimeMs += executionTimeMs;
+	SpinLockRelease(&entry->mutex);
+
+	LWLockRelease(&ShardQueryStatsSharedState->lock);
+}
+
+
+/*
+ * citus_shard_query_stats returns the number of tasks and their total
+ * execution time in milliseconds for every shard that has statistics.
+ */
+Datum
+citus_shard_query_stats(PG_FUNCTION_ARGS)
+{
+	TupleDesc tupleDescriptor = NULL;
+	HASH_SEQ_STATUS status;
+	ShardQueryStatsHashEntry *entry = NULL;
+
+	CheckCitusVersion(ERROR);
+
+	Tuplestorestate *tupleStore = SetupTuplestore(fcinfo, &tupleDescriptor);
+
+	if (ShardQueryStatsHash == NULL)
+	{
+		tuplestore_donestoring(tupleStore);
+
+		PG_RETURN_VOID();
+	}
+
+	LWLockAcquire(&ShardQueryStatsSharedState->lock, LW_SHARED);
+
+	hash_seq_init(&status, ShardQueryStatsHash);
+	while ((entry = hash_seq_search(&status)) != NULL)
+	{
+		Datum values[3];
+		bool isNulls[3];
+
+		memset(values, 0, sizeof(values));
+		memset(isNulls, false, sizeof(isNulls));
+
+		SpinLockAcquire(&entry->mutex);
+		uint64 queryCount = entry->queryCount;
+		double totalTimeMs = entry->totalTimeMs;
+		SpinLockRelease(&entry->mutex);
+
+		values[0] = Int64GetDatum(entry->shardId);
+		values[1] = Int64GetDatum(queryCount);
+		values[2] = Float8GetDatum(totalTimeMs);
+
+		tuplestore_putvalues(tupleStore, tupleDescriptor, values, isNulls);
+	}
+
+	LWLockRelease(&ShardQueryStatsSharedState->lock);
+
+	tuplestore_donestoring(tupleStore);
+
+	PG_RETURN_VOID();
+}
+
+
+/*
+ * citus_shard_query_stats_reset removes the query statistics of all shards.
+ */
+Datum
+citus_shard_query_stats_reset(PG_FUNCTION_ARGS)
+{
+	HASH_SEQ_STATUS status;
+	ShardQueryStatsHashEntry *entry = NULL;
+
+	CheckCitusVersion(ERROR);
+
+	if (ShardQueryStatsHash == NULL)
+	{
+		PG_RETURN_VOID();
+	}
+
+	LWLockAcquire(&ShardQueryStatsSharedState->lock, LW_EXCLUSIVE);
+
+	hash_seq_init(&status, ShardQueryStatsHash);
+	while ((entry = hash_seq_search(&status)) != NULL)
+	{
+		hash_search(ShardQueryStatsHash, &entry->shardId, HASH_REMOVE, NULL);
+	}
+
+	LWLockRelease(&ShardQueryStatsSharedState->lock);
+
+	PG_RETURN_VOID();
+}
+
+
+/*
+ * citus_shard_cost_by_query_load returns the total execution time in
+ * milliseconds of the tasks on the given shard and the shards that are
+ * colocated with it, as recorded by the executors on this node.
+ *
+ * SQL signature:
+ *
+ * citus_shard_cost_by_query_load(shardid bigint) RETURNS float4
+ */
+Datum
+citus_shard_cost_by_query_load(PG_FUNCTION_ARGS)
+{
+	uint64 shardId = PG_GETARG_INT64(0);
+	double shardGroupTimeMs = 0.0;
+
+	CheckCitusVersion(ERROR);
+
+	ShardInterval *shardInterval = LoadShardInterval(shardId);
+	List *colocatedShardList = ColocatedShardIntervalList(shardInterval);
+
+	ShardInterval *colocatedShard = NULL;
+	foreach_ptr(colocatedShard, colocatedShardList)
+	{
+		shardGroupTimeMs += ShardQueryTotalTime(colocatedShard->shardId);
+	}
+
+	PG_RETURN_FLOAT4((float4) shardGroupTimeMs);
+}
+
+
+/*
+ * ShardQueryTotalTime returns the total execution time in milliseconds of the
+ * tasks on the given shard, or 0 if there are no statistics for the shard.
+ */
+static double
+ShardQueryTotalTime(uint64 shardId)
+{
+	bool found = false;
+	double totalTimeMs = 0.0;
+
+	if (ShardQueryStatsHash == NULL)
+	{
+		return 0.0;
+	}
+
+	LWLockAcquire(&ShardQueryStatsSharedState->lock, LW_SHARED);
+
+	ShardQueryStatsHashEntry *entry =
+		hash_search(ShardQueryStatsHash, &shardId, HASH_FIND, &found);
+	if (found)
+	{
+		SpinLockAcquire(&entry->mutex);
+		totalTimeMs = entry->totalTimeMs;
+		SpinLockRelease(&entry->mutex);
+	}
+
+	LWLockRelease(&ShardQueryStatsSharedState->lock);
+
+	return totalTimeMs;
+}
+
+
+/*
+ * ShardQueryStatsShmemSize returns the size of the shared memory needed for
+ * the shard query statistics.
+ */
+static size_t
+ShardQueryStatsShmemSize(void)
+{
+	Size size = 0;
+
+	size = add_size(size, sizeof(ShardQueryStatsControlData));
+
+	Size hashSize = hash_estimate_size(ShardQueryStatsMax,
+									   sizeof(ShardQueryStatsHashEntry));
+	size = add_size(size, hashSize);
+
+	return size;
+}
+
+
+/*
+ * ShardQueryStatsShmemInit initializes the shared memory for the shard query
+ * statistics.
+ */
+static void
+ShardQueryStatsShmemInit(void)
+{
+	bool alreadyInitialized = false;
+	HASHCTL info;
+
+	LWLockAcquire(AddinShmemInitLock, LW_EXCLUSIVE);
+
+	ShardQueryStatsSharedState =
+		(ShardQueryStatsControlData *) ShmemInitStruct("Citus Shard Query Stats",
+													   sizeof(ShardQueryStatsControlData),
+													   &alreadyInitialized);
+
+	/*
+	 * Might already be initialized on EXEC_BACKEND type platforms that call
+	 * shared library initialization functions in every backend.
+	 */
+	if (!alreadyInitialized)
+	{
+		ShardQueryStatsSharedState->trancheId = LWLockNewTrancheId();
+		ShardQueryStatsSharedState->lockTrancheName = "Citus Shard Query Stats";
+		LWLockRegisterTranche(ShardQueryStatsSharedState->trancheId,
+							  ShardQueryStatsSharedState->lockTrancheName);
+
+		LWLockInitialize(&ShardQueryStatsSharedState->lock,
+						 ShardQueryStatsSharedState->trancheId);
+	}
+
+	memset(&info, 0, sizeof(info));
+	info.keysize = sizeof(uint64);
+	info.entrysize = sizeof(ShardQueryStatsHashEntry);
+	int hashFlags = (HASH_ELEM | HASH_BLOBS);
+
+	ShardQueryStatsHash = ShmemInitHash("Citus Shard Query Stats Hash",
+										ShardQueryStatsMax, ShardQueryStatsMax,
+										&info, hashFlags);
+
+	LWLockRelease(AddinShmemInitLock);
+
+	if (prev_shmem_startup_hook != NULL)
+	{
+		prev_shmem_startup_hook();
+	}
+}
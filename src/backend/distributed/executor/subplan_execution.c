@@ -8,39 +8,227 @@
  *-------------------------------------------------------------------------
  */
 
+#include <unistd.h>
+
 #include "postgres.h"
+#include "miscadmin.h"
 
+#include "catalog/pg_type.h"
+#include "distributed/citus_custom_scan.h"
+#include "distributed/commands/multi_copy.h"
+#include "distributed/deparse_shard_query.h"
+#include "distributed/distributed_planner.h"
 #include "distributed/intermediate_result_pruning.h"
 #include "distributed/intermediate_results.h"
 #include "distributed/listutils.h"
+#include "distributed/local_executor.h"
+#include "distributed/log_utils.h"
+#include "distributed/metadata_cache.h"
 #include "distributed/multi_executor.h"
+#include "distributed/multi_logical_planner.h"
 #include "distributed/multi_physical_planner.h"
+#include "distributed/multi_server_executor.h"
 #include "distributed/recursive_planning.h"
 #include "distributed/subplan_execution.h"
 #include "distributed/transaction_management.h"
+#include "distributed/version_compat.h"
 #include "distributed/worker_manager.h"
 #include "executor/executor.h"
+#include "nodes/makefuncs.h"
+#include "nodes/nodeFuncs.h"
+#include "portability/instr_time.h"
+#include "utils/builtins.h"
+#include "utils/fmgroids.h"
+#include "utils/json.h"
+#include "utils/lsyscache.h"
+#include "utils/memutils.h"
+#include "utils/snapmgr.h"
+#include "utils/tuplestore.h"
 
 
 int MaxIntermediateResult = 1048576; /* maximum size in KB the intermediate result can grow to */
 /* when this is true, we enforce intermediate result size limit in all executors */
 int SubPlanLevel = 0;
 
+/* maximum size in KB of subplan results that are inlined into task queries */
+int MaxInlinedIntermediateResultSize = 0;
+
+/*
+ * Number of nodes to which the coordinator sends an intermediate result
+ * directly. The other nodes that need the result fetch it from the nodes that
+ * already have it. 0 means that the coordinator sends it to all nodes.
+ */
+int IntermediateResultFanout = 0;
+
+/* whether identical subplans reuse the results of earlier statements */
+bool EnableIntermediateResultCache = false;
+
+/* subplan results inlined in the current transaction, in TopTransactionContext */
+List *InlinedIntermediateResultList = NIL;
+
+/* subplan results that can be reused in the current transaction */
+List *CachedIntermediateResultList = NIL;
+
+/* whether independent subplans are executed concurrently */
+bool EnableConcurrentSubPlanExecution = false;
+
+/*
+ * Whether the rows of a subplan result that is joined with a hash-distributed
+ * table on its distribution column are only sent to the nodes of their shard.
+ */
+bool EnablePartitionedSubPlanResults = false;
+
+/* rows of subplans that were fetched along with other subplans */
+List *PrefetchedSubPlanResultList = NIL;
+
+
+/*
+ * InlinedIntermediateResult is a subplan result that is small enough to be
+ * embedded in the task queries rather than being sent to the workers as a
+ * file, or a subplan result that reuses the files of an earlier subplan.
+ */
+typedef struct InlinedIntermediateResult
+{
+	char *resultId;
+
+	/* JSON array of the rows, which json_to_recordset reads instead */
+	char *recordSetData;
+
+	/* result whose files are read instead, if the result is reused */
+	char *reusedResultId;
+} InlinedIntermediateResult;
+
+
+/*
+ * CachedIntermediateResult is a subplan result of an earlier statement in the
+ * current transaction, which subplans with the same query can reuse as long
+ * as they see the same data.
+ */
+typedef struct CachedIntermediateResult
+{
+	/* deparsed subplan query, and the user and command that ran it */
+	char *queryFingerprint;
+	Oid userId;
+	CommandId commandId;
+
+	char *resultId;
+
+	/* nodes that received the result file, and whether it was written locally */
+	List *nodeIdList;
+	bool hasLocalFile;
+} CachedIntermediateResult;
+
+
+/*
+ * PrefetchedSubPlanResult holds the rows that the distributed plan of a
+ * subplan returns, which were fetched before the subplan is executed such
+ * that the tasks of several subplans run concurrently.
+ */
+typedef struct PrefetchedSubPlanResult
+{
+	uint64 planId;
+	Tuplestorestate *tupleStore;
+} PrefetchedSubPlanResult;
+
+
+/*
+ * InlineResultDestReceiver keeps the rows of a subplan in memory as long as
+ * they fit in citus.max_inlined_intermediate_result_size. If the result
+ * grows beyond that, the rows collected so far and all rows that follow are
+ * passed on to a RemoteFileDestReceiver.
+ */
+typedef struct InlineResultDestReceiver
+{
+	/* public DestReceiver interface */
+	DestReceiver pub;
+
+	char *resultId;
+
+	/* EState for per-tuple memory allocation */
+	EState *executorState;
+
+	/* nodes to send the result to if it is not inlined */
+	List *remoteWorkerNodeList;
+
+	/* whether the result is also read from a local file */
+	bool writeLocalFile;
+
+	int operation;
+	TupleDesc tupleDescriptor;
+
+	/* result rows as a JSON array, and the size at which we stop inlining */
+	StringInfo recordSetData;
+	uint64 maxRecordSetSize;
+
+	/* JSON keys and output functions of the columns */
+	char **columnKeys;
+	FmgrInfo *columnOutputFunctions;
+
+	/* rows collected so far */
+	Tuplestorestate *tupleStore;
+
+	/* receiver for results that turn out not to be inlinable */
+	DestReceiver *remoteFileDest;
+} InlineResultDestReceiver;
+
+
+static bool CanInlineSubPlanResults(DistributedPlan *distributedPlan);
+static bool PlanTaskQueriesCanBeRewritten(DistributedPlan *distributedPlan);
+static List * PrefetchIndependentSubPlanResults(List *subPlanList);
+static bool CanPrefetchSubPlanResult(DistributedSubPlan *subPlan);
+static DestReceiver * CreateInlineResultDestReceiver(char *resultId,
+													 EState *executorState,
+													 List *remoteWorkerNodeList,
+													 bool writeLocalFile);
+static void InlineResultDestReceiverStartup(DestReceiver *dest, int operation,
+											TupleDesc tupleDescriptor);
+static bool InlineResultDestReceiverReceive(TupleTableSlot *slot, DestReceiver *dest);
+static void InlineResultDestReceiverShutdown(DestReceiver *dest);
+static void InlineResultDestReceiverDestroy(DestReceiver *dest);
+static uint64 InlineResultDestReceiverBytesSent(DestReceiver *dest);
+static bool CanInlineResultColumns(TupleDesc tupleDescriptor);
+static void AppendRecordSetRow(InlineResultDestReceiver *inlineDest,
+							   TupleTableSlot *slot);
+static void StartRemoteFileDestReceiver(InlineResultDestReceiver *inlineDest);
+static void ForwardCollectedRows(InlineResultDestReceiver *inlineDest,
+								 DestReceiver *dest);
+static void RecordInlinedIntermediateResult(char *resultId, char *recordSetData);
+static void ForgetInlinedIntermediateResult(char *resultId);
+static bool IntermediateResultIsInlined(char *resultId);
+static InlinedIntermediateResult * FindInlinedIntermediateResult(char *resultId);
+static bool CanUseIntermediateResultCache(void);
+static bool ReuseCachedIntermediateResult(char *queryFingerprint, char *resultId,
+										  List *remoteWorkerNodeList,
+										  bool writeLocalFile);
+static void RecordCachedIntermediateResult(char *queryFingerprint, char *resultId,
+										   List *remoteWorkerNodeList,
+										   bool writeLocalFile);
+static void ForgetCachedIntermediateResult(char *resultId);
+static void LinkIntermediateResultFile(char *sourceResultId, char *targetResultId);
+static bool CanInlineIntermediateResultsInJob(Job *job);
+static bool InlineIntermediateResultsWalker(Node *node, bool *readsInlinedResult);
+
 
 /*
  * ExecuteSubPlans executes a list of subplans from a distributed plan
- * by sequentially executing each plan from the top.
+ * by sequentially executing each plan from the top. It returns the
+ * SubPlanExecutionStats of the subplans, which EXPLAIN ANALYZE shows.
+ *
+ * If citus.enable_concurrent_subplan_execution is on, the rows of the
+ * subplans that do not depend on other subplans are first fetched in a
+ * single execution, such that only sending their results is sequential.
  */
-void
+List *
 ExecuteSubPlans(DistributedPlan *distributedPlan)
 {
 	uint64 planId = distributedPlan->planId;
 	List *subPlanList = distributedPlan->subPlanList;
+	List *subPlanStatsList = NIL;
 
 	if (subPlanList == NIL)
 	{
 		/* no subplans to execute */
-		return;
+		return NIL;
 	}
 
 	HTAB *intermediateResultsHash = MakeIntermediateResultHTAB();
@@ -54,6 +242,17 @@ ExecuteSubPlans(DistributedPlan *distributedPlan)
 	 */
 	UseCoordinatedTransaction();
 
+	/* both inlined and reused results require rewriting the task queries */
+	bool canRewriteTaskQueries = CanInlineSubPlanResults(distributedPlan);
+	bool inlineSmallResults = MaxInlinedIntermediateResultSize > 0 &&
+							  canRewriteTaskQueries;
+
+	List *prefetchedPlanList = NIL;
+	if (EnableConcurrentSubPlanExecution)
+	{
+		prefetchedPlanList = PrefetchIndependentSubPlanResults(subPlanList);
+	}
+
 	DistributedSubPlan *subPlan = NULL;
 	foreach_ptr(subPlan, subPlanList)
 	{
@@ -67,15 +266,1117 @@ ExecuteSubPlans(DistributedPlan *distributedPlan)
 		IntermediateResultsHashEntry *entry =
 			SearchIntermediateResult(intermediateResultsHash, resultId);
 
+		bool useResultCache = subPlan->queryFingerprint != NULL &&
+							  CanUseIntermediateResultCache();
+
+		SubPlanExecutionStats *subPlanStats = palloc0(sizeof(SubPlanExecutionStats));
+		subPlanStats->resultId = resultId;
+		subPlanStatsList = lappend(subPlanStatsList, subPlanStats);
+
+		instr_time startTime;
+		INSTR_TIME_SET_CURRENT(startTime);
+
+		if (useResultCache && canRewriteTaskQueries &&
+			ReuseCachedIntermediateResult(subPlan->queryFingerprint, resultId,
+										  remoteWorkerNodeList, entry->writeLocalFile))
+		{
+			subPlanStats->reused = true;
+			continue;
+		}
+
+		/* a prepared statement may have written the result in an earlier execution */
+		ForgetInlinedIntermediateResult(resultId);
+		ForgetCachedIntermediateResult(resultId);
+
+		if (useResultCache)
+		{
+			RecordCachedIntermediateResult(subPlan->queryFingerprint, resultId,
+										   remoteWorkerNodeList, entry->writeLocalFile);
+		}
+
 		SubPlanLevel++;
 		EState *estate = CreateExecutorState();
-		DestReceiver *copyDest =
-			CreateRemoteFileDestReceiver(resultId, estate, remoteWorkerNodeList,
-										 entry->writeLocalFile);
+		DestReceiver *copyDest = NULL;
+		bool inlineDest = inlineSmallResults && remoteWorkerNodeList != NIL;
+
+		/* a cached result may later be read by a query that needs all rows */
+		bool partitionDest = EnablePartitionedSubPlanResults && !inlineDest &&
+							 !useResultCache &&
+							 OidIsValid(entry->partitionRelationId);
+
+		/* beyond the fan-out, nodes fetch the result from the nodes that have it */
+		List *relayWorkerNodeList = NIL;
+
+		if (IntermediateResultFanout > 0 && !partitionDest &&
+			list_length(remoteWorkerNodeList) > IntermediateResultFanout)
+		{
+			relayWorkerNodeList = list_copy_tail(remoteWorkerNodeList,
+												 IntermediateResultFanout);
+			remoteWorkerNodeList = list_truncate(list_copy(remoteWorkerNodeList),
+												 IntermediateResultFanout);
+		}
+
+		if (inlineDest)
+		{
+			copyDest = CreateInlineResultDestReceiver(resultId, estate,
+													  remoteWorkerNodeList,
+													  entry->writeLocalFile);
+		}
+		else if (partitionDest)
+		{
+			Oid partitionRelationId = entry->partitionRelationId;
+			int partitionColumnIndex = entry->partitionColumnIndex;
+			int logLevel = LogIntermediateResults ? DEBUG1 : DEBUG4;
+
+			elog(logLevel, "Subplan %s will be partitioned by the shards of %s",
+				 resultId, get_rel_name(partitionRelationId));
+
+			copyDest = CreatePartitionedRemoteFileDestReceiver(resultId, estate,
+															   remoteWorkerNodeList,
+															   entry->writeLocalFile,
+															   partitionRelationId,
+															   partitionColumnIndex);
+		}
+		else
+		{
+			copyDest = CreateRemoteFileDestReceiver(resultId, estate,
+													remoteWorkerNodeList,
+													entry->writeLocalFile);
+		}
 
 		ExecutePlanIntoDestReceiver(plannedStmt, params, copyDest);
 
 		SubPlanLevel--;
 		FreeExecutorState(estate);
+
+		if (inlineDest)
+		{
+			subPlanStats->resultSize = InlineResultDestReceiverBytesSent(copyDest);
+		}
+		else
+		{
+			subPlanStats->resultSize = RemoteFileDestReceiverBytesSent(copyDest);
+		}
+
+		subPlanStats->nodeCount = list_length(remoteWorkerNodeList);
+		subPlanStats->inlined = IntermediateResultIsInlined(resultId);
+		subPlanStats->partitioned = partitionDest;
+
+		if (relayWorkerNodeList != NIL && !subPlanStats->inlined)
+		{
+			RelayIntermediateResult(resultId, remoteWorkerNodeList,
+									relayWorkerNodeList);
+		}
+
+		instr_time executionTime;
+		INSTR_TIME_SET_CURRENT(executionTime);
+		INSTR_TIME_SUBTRACT(executionTime, startTime);
+		subPlanStats->executionTimeMs = INSTR_TIME_GET_MILLISEC(executionTime);
+	}
+
+	/* a subplan may not have read its rows, for instance because of LIMIT 0 */
+	DistributedPlan *prefetchedPlan = NULL;
+	foreach_ptr(prefetchedPlan, prefetchedPlanList)
+	{
+		TakePrefetchedSubPlanResult(prefetchedPlan->planId);
+	}
+
+	return subPlanStatsList;
+}
+
+
+/*
+ * PrefetchIndependentSubPlanResults runs the tasks of the subplans that can
+ * be prefetched in a single execution of the adaptive executor, and keeps the
+ * rows of each subplan until the subplan is executed. It returns the
+ * distributed plans of the prefetched subplans.
+ *
+ * Subplans that read the results of other subplans are executed in order as
+ * usual. Since all subplans would otherwise see the writes of the subplans
+ * before them, nothing is prefetched if any subplan modifies data.
+ */
+static List *
+PrefetchIndependentSubPlanResults(List *subPlanList)
+{
+	List *prefetchedPlanList = NIL;
+	List *taskListList = NIL;
+	List *tupleDescriptorList = NIL;
+	List *tupleStoreList = NIL;
+	List *combinedTaskList = NIL;
+	bool randomAccess = true;
+	bool interTransactions = false;
+
+	if (TaskExecutorType != MULTI_EXECUTOR_ADAPTIVE ||
+		MultiShardConnectionType == SEQUENTIAL_CONNECTION)
+	{
+		return NIL;
+	}
+
+	DistributedSubPlan *subPlan = NULL;
+	foreach_ptr(subPlan, subPlanList)
+	{
+		PlannedStmt *plannedStmt = subPlan->plan;
+
+		if (plannedStmt->commandType != CMD_SELECT || plannedStmt->hasModifyingCTE)
+		{
+			return NIL;
+		}
+
+		if (!CanPrefetchSubPlanResult(subPlan))
+		{
+			continue;
+		}
+
+		CustomScan *customScan = FetchCitusCustomScanIfExists(plannedStmt->planTree);
+		DistributedPlan *distributedPlan = GetDistributedPlan(customScan);
+		List *taskList = distributedPlan->workerJob->taskList;
+
+#if PG_VERSION_NUM >= 120000
+		TupleDesc tupleDescriptor = ExecTypeFromTL(customScan->custom_scan_tlist);
+#else
+		TupleDesc tupleDescriptor = ExecTypeFromTL(customScan->custom_scan_tlist, false);
+#endif
+
+		prefetchedPlanList = lappend(prefetchedPlanList, distributedPlan);
+		taskListList = lappend(taskListList, taskList);
+		tupleDescriptorList = lappend(tupleDescriptorList, tupleDescriptor);
+		combinedTaskList = list_concat(combinedTaskList, list_copy(taskList));
+	}
+
+	/*
+	 * There is nothing to gain from a single subplan, and local execution runs
+	 * the tasks of one query at a time.
+	 */
+	if (list_length(prefetchedPlanList) < 2 ||
+		ShouldExecuteTasksLocally(combinedTaskList))
+	{
+		return NIL;
+	}
+
+	for (int planIndex = 0; planIndex < list_length(prefetchedPlanList); planIndex++)
+	{
+		Tuplestorestate *tupleStore =
+			tuplestore_begin_heap(randomAccess, interTransactions, work_mem);
+
+		tupleStoreList = lappend(tupleStoreList, tupleStore);
 	}
+
+	SubPlanLevel++;
+	ExecuteTaskListsIntoTupleStores(taskListList, tupleDescriptorList, tupleStoreList);
+	SubPlanLevel--;
+
+	ListCell *planCell = NULL;
+	ListCell *tupleStoreCell = NULL;
+	forboth(planCell, prefetchedPlanList, tupleStoreCell, tupleStoreList)
+	{
+		PrefetchedSubPlanResult *prefetchedResult =
+			palloc0(sizeof(PrefetchedSubPlanResult));
+
+		prefetchedResult->planId = ((DistributedPlan *) lfirst(planCell))->planId;
+		prefetchedResult->tupleStore = (Tuplestorestate *) lfirst(tupleStoreCell);
+
+		PrefetchedSubPlanResultList = lappend(PrefetchedSubPlanResultList,
+											  prefetchedResult);
+	}
+
+	return prefetchedPlanList;
+}
+
+
+/*
+ * CanPrefetchSubPlanResult returns whether the rows of the given subplan can
+ * be fetched before it is executed, which requires a read-only adaptive
+ * executor plan of which the tasks are known at planning time and do not
+ * read the results of other subplans.
+ */
+static bool
+CanPrefetchSubPlanResult(DistributedSubPlan *subPlan)
+{
+	if (subPlan->queryFingerprint != NULL && CanUseIntermediateResultCache())
+	{
+		/* the result of an earlier statement may be reused instead */
+		return false;
+	}
+
+	CustomScan *customScan = FetchCitusCustomScanIfExists(subPlan->plan->planTree);
+	if (customScan == NULL || customScan->methods != &AdaptiveExecutorCustomScanMethods)
+	{
+		return false;
+	}
+
+	DistributedPlan *distributedPlan = GetDistributedPlan(customScan);
+	Job *workerJob = distributedPlan->workerJob;
+
+	/* the rows of the tasks of such plans are merged in AdaptiveExecutor */
+	if (distributedPlan->mergeSortedTaskResults)
+	{
+		return false;
+	}
+
+	if (distributedPlan->modLevel != ROW_MODIFY_READONLY ||
+		distributedPlan->insertSelectQuery != NULL ||
+		distributedPlan->subPlanList != NIL ||
+		distributedPlan->usedSubPlanNodeList != NIL ||
+		workerJob == NULL || workerJob->jobQuery == NULL)
+	{
+		return false;
+	}
+
+	/* the tasks of such jobs are only known when the subplan is executed */
+	if (workerJob->deferredPruning || workerJob->taskPruningQualList != NIL ||
+		workerJob->dependentJobList != NIL)
+	{
+		return false;
+	}
+
+	Query *jobQuery = workerJob->jobQuery;
+
+	return jobQuery->rowMarks == NIL &&
+		   !ContainsReadIntermediateResultFunction((Node *) jobQuery);
+}
+
+
+/*
+ * TakePrefetchedSubPlanResult returns the tuple store with the prefetched rows
+ * of the distributed plan with the given plan id and forgets about it, or
+ * returns NULL if the rows of the plan were not prefetched.
+ */
+Tuplestorestate *
+TakePrefetchedSubPlanResult(uint64 planId)
+{
+	PrefetchedSubPlanResult *prefetchedResult = NULL;
+	foreach_ptr(prefetchedResult, PrefetchedSubPlanResultList)
+	{
+		if (prefetchedResult->planId == planId)
+		{
+			PrefetchedSubPlanResultList = list_delete_ptr(PrefetchedSubPlanResultList,
+														  prefetchedResult);
+
+			return prefetchedResult->tupleStore;
+		}
+	}
+
+	return NULL;
+}
+
+
+/*
+ * CanInlineSubPlanResults returns whether the results of the subplans of the
+ * given plan can be inlined into task queries. The queries of the tasks that
+ * the task tracker executor sends to the workers are not rewritten, so those
+ * need the result files.
+ */
+static bool
+CanInlineSubPlanResults(DistributedPlan *distributedPlan)
+{
+	if (TaskExecutorType != MULTI_EXECUTOR_ADAPTIVE)
+	{
+		return false;
+	}
+
+	return PlanTaskQueriesCanBeRewritten(distributedPlan);
+}
+
+
+/*
+ * PlanTaskQueriesCanBeRewritten returns whether the task queries of the given
+ * plan, and of all its subplans, can be rewritten to read inlined results.
+ */
+static bool
+PlanTaskQueriesCanBeRewritten(DistributedPlan *distributedPlan)
+{
+	Job *workerJob = distributedPlan->workerJob;
+
+	if (workerJob != NULL && !CanInlineIntermediateResultsInJob(workerJob))
+	{
+		return false;
+	}
+
+	DistributedSubPlan *subPlan = NULL;
+	foreach_ptr(subPlan, distributedPlan->subPlanList)
+	{
+		CustomScan *customScan = FetchCitusCustomScanIfExists(subPlan->plan->planTree);
+		if (customScan != NULL &&
+			!PlanTaskQueriesCanBeRewritten(GetDistributedPlan(customScan)))
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+
+/*
+ * CreateInlineResultDestReceiver creates a DestReceiver that keeps a small
+ * subplan result in memory such that it can be inlined into the task queries,
+ * and otherwise sends it to the given nodes like a RemoteFileDestReceiver.
+ */
+static DestReceiver *
+CreateInlineResultDestReceiver(char *resultId, EState *executorState,
+							   List *remoteWorkerNodeList, bool writeLocalFile)
+{
+	InlineResultDestReceiver *inlineDest = (InlineResultDestReceiver *) palloc0(
+		sizeof(InlineResultDestReceiver));
+
+	/* set up the DestReceiver function pointers */
+	inlineDest->pub.receiveSlot = InlineResultDestReceiverReceive;
+	inlineDest->pub.rStartup = InlineResultDestReceiverStartup;
+	inlineDest->pub.rShutdown = InlineResultDestReceiverShutdown;
+	inlineDest->pub.rDestroy = InlineResultDestReceiverDestroy;
+	inlineDest->pub.mydest = DestCopyOut;
+
+	inlineDest->resultId = resultId;
+	inlineDest->executorState = executorState;
+	inlineDest->remoteWorkerNodeList = remoteWorkerNodeList;
+	inlineDest->writeLocalFile = writeLocalFile;
+	inlineDest->maxRecordSetSize = MaxInlinedIntermediateResultSize * 1024L;
+
+	return (DestReceiver *) inlineDest;
+}
+
+
+/*
+ * InlineResultDestReceiverStartup implements the rStartup interface of
+ * InlineResultDestReceiver. If the columns of the result cannot be inlined,
+ * it sends the result to the nodes right away.
+ */
+static void
+InlineResultDestReceiverStartup(DestReceiver *dest, int operation,
+								TupleDesc tupleDescriptor)
+{
+	InlineResultDestReceiver *inlineDest = (InlineResultDestReceiver *) dest;
+	bool randomAccess = false;
+	bool interTransactions = false;
+
+	inlineDest->operation = operation;
+	inlineDest->tupleDescriptor = tupleDescriptor;
+
+	if (!CanInlineResultColumns(tupleDescriptor))
+	{
+		StartRemoteFileDestReceiver(inlineDest);
+		return;
+	}
+
+	int columnCount = tupleDescriptor->natts;
+	inlineDest->columnKeys = (char **) palloc0(columnCount * sizeof(char *));
+
+	for (int columnIndex = 0; columnIndex < columnCount; columnIndex++)
+	{
+		Form_pg_attribute attribute = TupleDescAttr(tupleDescriptor, columnIndex);
+		StringInfo columnKey = makeStringInfo();
+
+		escape_json(columnKey, NameStr(attribute->attname));
+
+		inlineDest->columnKeys[columnIndex] = columnKey->data;
+	}
+
+	inlineDest->columnOutputFunctions = ColumnOutputFunctions(tupleDescriptor, false);
+
+	inlineDest->recordSetData = makeStringInfo();
+	appendStringInfoChar(inlineDest->recordSetData, '[');
+
+	inlineDest->tupleStore = tuplestore_begin_heap(randomAccess, interTransactions,
+												   work_mem);
+}
+
+
+/*
+ * CanInlineResultColumns returns whether rows with the given tuple descriptor
+ * can be passed to json_to_recordset. We only inline columns whose JSON form
+ * is a string that json_to_recordset passes to the input function of the
+ * type, and we need unique column names as JSON keys.
+ */
+static bool
+CanInlineResultColumns(TupleDesc tupleDescriptor)
+{
+	int columnCount = tupleDescriptor->natts;
+
+	for (int columnIndex = 0; columnIndex < columnCount; columnIndex++)
+	{
+		Form_pg_attribute attribute = TupleDescAttr(tupleDescriptor, columnIndex);
+		Oid baseTypeId = getBaseType(attribute->atttypid);
+		char typeType = get_typtype(baseTypeId);
+
+		if (attribute->attisdropped)
+		{
+			return false;
+		}
+
+		if (baseTypeId == JSONOID || baseTypeId == JSONBOID ||
+			type_is_array(baseTypeId))
+		{
+			return false;
+		}
+
+		if (typeType != TYPTYPE_BASE && typeType != TYPTYPE_ENUM &&
+			typeType != TYPTYPE_RANGE)
+		{
+			return false;
+		}
+
+		for (int otherIndex = 0; otherIndex < columnIndex; otherIndex++)
+		{
+			Form_pg_attribute otherAttribute = TupleDescAttr(tupleDescriptor,
+															 otherIndex);
+
+			if (strncmp(NameStr(attribute->attname), NameStr(otherAttribute->attname),
+						NAMEDATALEN) == 0)
+			{
+				return false;
+			}
+		}
+	}
+
+	return true;
+}
+
+
+/*
+ * InlineResultDestReceiverReceive implements the receiveSlot function of
+ * InlineResultDestReceiver. It adds the row to the inlined result until that
+ * grows too large, after which rows are sent to the nodes.
+ */
+static bool
+InlineResultDestReceiverReceive(TupleTableSlot *slot, DestReceiver *dest)
+{
+	InlineResultDestReceiver *inlineDest = (InlineResultDestReceiver *) dest;
+
+	if (inlineDest->remoteFileDest != NULL)
+	{
+		DestReceiver *remoteFileDest = inlineDest->remoteFileDest;
+
+		return remoteFileDest->receiveSlot(slot, remoteFileDest);
+	}
+
+	AppendRecordSetRow(inlineDest, slot);
+	tuplestore_puttupleslot(inlineDest->tupleStore, slot);
+
+	if (inlineDest->recordSetData->len > inlineDest->maxRecordSetSize)
+	{
+		/* the result is too large to inline, send it to the nodes after all */
+		StartRemoteFileDestReceiver(inlineDest);
+	}
+
+	return true;
+}
+
+
+/*
+ * AppendRecordSetRow appends the row in the slot to the JSON array of the
+ * inlined result as an object with a string for each non-NULL column.
+ */
+static void
+AppendRecordSetRow(InlineResultDestReceiver *inlineDest, TupleTableSlot *slot)
+{
+	StringInfo recordSetData = inlineDest->recordSetData;
+	EState *executorState = inlineDest->executorState;
+	int columnCount = inlineDest->tupleDescriptor->natts;
+
+	MemoryContext executorTupleContext = GetPerTupleMemoryContext(executorState);
+	MemoryContext oldContext = MemoryContextSwitchTo(executorTupleContext);
+
+	slot_getallattrs(slot);
+
+	/* separate the row from the previous one, if any */
+	if (recordSetData->len > 1)
+	{
+		appendStringInfoChar(recordSetData, ',');
+	}
+
+	appendStringInfoChar(recordSetData, '{');
+
+	for (int columnIndex = 0; columnIndex < columnCount; columnIndex++)
+	{
+		if (columnIndex > 0)
+		{
+			appendStringInfoChar(recordSetData, ',');
+		}
+
+		appendStringInfo(recordSetData, "%s:", inlineDest->columnKeys[columnIndex]);
+
+		if (slot->tts_isnull[columnIndex])
+		{
+			appendStringInfoString(recordSetData, "null");
+		}
+		else
+		{
+			FmgrInfo *outputFunction = &inlineDest->columnOutputFunctions[columnIndex];
+			char *columnText = OutputFunctionCall(outputFunction,
+												  slot->tts_values[columnIndex]);
+
+			escape_json(recordSetData, columnText);
+		}
+	}
+
+	appendStringInfoChar(recordSetData, '}');
+
+	MemoryContextSwitchTo(oldContext);
+
+	ResetPerTupleExprContext(executorState);
+}
+
+
+/*
+ * StartRemoteFileDestReceiver stops inlining the result and sends the rows
+ * collected so far to the nodes. Any further rows are sent by the same
+ * RemoteFileDestReceiver.
+ */
+static void
+StartRemoteFileDestReceiver(InlineResultDestReceiver *inlineDest)
+{
+	DestReceiver *remoteFileDest =
+		CreateRemoteFileDestReceiver(inlineDest->resultId, inlineDest->executorState,
+									 inlineDest->remoteWorkerNodeList,
+									 inlineDest->writeLocalFile);
+
+	remoteFileDest->rStartup(remoteFileDest, inlineDest->operation,
+							 inlineDest->tupleDescriptor);
+
+	if (inlineDest->tupleStore != NULL)
+	{
+		ForwardCollectedRows(inlineDest, remoteFileDest);
+
+		tuplestore_end(inlineDest->tupleStore);
+		inlineDest->tupleStore = NULL;
+	}
+
+	if (inlineDest->recordSetData != NULL)
+	{
+		pfree(inlineDest->recordSetData->data);
+		inlineDest->recordSetData = NULL;
+	}
+
+	inlineDest->remoteFileDest = remoteFileDest;
+}
+
+
+/*
+ * ForwardCollectedRows sends the rows that were collected for the inlined
+ * result to another DestReceiver.
+ */
+static void
+ForwardCollectedRows(InlineResultDestReceiver *inlineDest, DestReceiver *dest)
+{
+	Tuplestorestate *tupleStore = inlineDest->tupleStore;
+	TupleTableSlot *slot = MakeSingleTupleTableSlotCompat(inlineDest->tupleDescriptor,
+														  &TTSOpsMinimalTuple);
+	bool forward = true;
+	bool copy = false;
+
+	tuplestore_rescan(tupleStore);
+
+	while (tuplestore_gettupleslot(tupleStore, forward, copy, slot))
+	{
+		dest->receiveSlot(slot, dest);
+	}
+
+	ExecDropSingleTupleTableSlot(slot);
+}
+
+
+/*
+ * InlineResultDestReceiverShutdown implements the rShutdown interface of
+ * InlineResultDestReceiver. It records the inlined result such that it
+ * replaces read_intermediate_result calls in task queries. When the result
+ * is also read locally, we still write it to a local file.
+ */
+static void
+InlineResultDestReceiverShutdown(DestReceiver *dest)
+{
+	InlineResultDestReceiver *inlineDest = (InlineResultDestReceiver *) dest;
+
+	if (inlineDest->remoteFileDest != NULL)
+	{
+		DestReceiver *remoteFileDest = inlineDest->remoteFileDest;
+
+		remoteFileDest->rShutdown(remoteFileDest);
+		return;
+	}
+
+	appendStringInfoChar(inlineDest->recordSetData, ']');
+
+	if (inlineDest->writeLocalFile)
+	{
+		List *nodeList = NIL;
+		bool writeLocalFile = true;
+		DestReceiver *localFileDest =
+			CreateRemoteFileDestReceiver(inlineDest->resultId,
+										 inlineDest->executorState, nodeList,
+										 writeLocalFile);
+
+		localFileDest->rStartup(localFileDest, inlineDest->operation,
+								inlineDest->tupleDescriptor);
+		ForwardCollectedRows(inlineDest, localFileDest);
+		localFileDest->rShutdown(localFileDest);
+		localFileDest->rDestroy(localFileDest);
+	}
+
+	tuplestore_end(inlineDest->tupleStore);
+	inlineDest->tupleStore = NULL;
+
+	ereport(DEBUG1, (errmsg("Subplan %s will be inlined into the task queries",
+							inlineDest->resultId)));
+
+	RecordInlinedIntermediateResult(inlineDest->resultId,
+									inlineDest->recordSetData->data);
+}
+
+
+/*
+ * InlineResultDestReceiverDestroy implements the rDestroy interface of
+ * InlineResultDestReceiver.
+ */
+static void
+InlineResultDestReceiverDestroy(DestReceiver *dest)
+{
+	InlineResultDestReceiver *inlineDest = (InlineResultDestReceiver *) dest;
+
+	if (inlineDest->remoteFileDest != NULL)
+	{
+		DestReceiver *remoteFileDest = inlineDest->remoteFileDest;
+
+		remoteFileDest->rDestroy(remoteFileDest);
+	}
+
+	pfree(inlineDest);
+}
+
+
+/*
+ * InlineResultDestReceiverBytesSent returns the size of the inlined result,
+ * or the size of the result data sent to each node if it was not inlined.
+ */
+static uint64
+InlineResultDestReceiverBytesSent(DestReceiver *dest)
+{
+	InlineResultDestReceiver *inlineDest = (InlineResultDestReceiver *) dest;
+
+	if (inlineDest->remoteFileDest != NULL)
+	{
+		return RemoteFileDestReceiverBytesSent(inlineDest->remoteFileDest);
+	}
+
+	return inlineDest->recordSetData != NULL ? inlineDest->recordSetData->len : 0;
+}
+
+
+/*
+ * RecordInlinedIntermediateResult remembers until the end of the transaction
+ * that read_intermediate_result calls for the given result should be
+ * replaced by a json_to_recordset call on the given JSON array.
+ */
+static void
+RecordInlinedIntermediateResult(char *resultId, char *recordSetData)
+{
+	MemoryContext oldContext = MemoryContextSwitchTo(TopTransactionContext);
+
+	InlinedIntermediateResult *inlinedResult = palloc0(
+		sizeof(InlinedIntermediateResult));
+	inlinedResult->resultId = pstrdup(resultId);
+	inlinedResult->recordSetData = pstrdup(recordSetData);
+	inlinedResult->reusedResultId = NULL;
+
+	InlinedIntermediateResultList = lappend(InlinedIntermediateResultList,
+											inlinedResult);
+
+	MemoryContextSwitchTo(oldContext);
+}
+
+
+/*
+ * ForgetInlinedIntermediateResult removes the given result from the inlined
+ * results, if it is there.
+ */
+static void
+ForgetInlinedIntermediateResult(char *resultId)
+{
+	InlinedIntermediateResult *inlinedResult = NULL;
+	foreach_ptr(inlinedResult, InlinedIntermediateResultList)
+	{
+		if (strcmp(inlinedResult->resultId, resultId) == 0)
+		{
+			InlinedIntermediateResultList = list_delete_ptr(
+				InlinedIntermediateResultList, inlinedResult);
+			return;
+		}
+	}
+}
+
+
+/*
+ * IntermediateResultIsInlined returns whether the given result is inlined into
+ * task queries.
+ */
+static bool
+IntermediateResultIsInlined(char *resultId)
+{
+	return FindInlinedIntermediateResult(resultId) != NULL;
+}
+
+
+/*
+ * FindInlinedIntermediateResult returns the inlined result with the given
+ * ID, or NULL if the result is not inlined.
+ */
+static InlinedIntermediateResult *
+FindInlinedIntermediateResult(char *resultId)
+{
+	InlinedIntermediateResult *inlinedResult = NULL;
+	foreach_ptr(inlinedResult, InlinedIntermediateResultList)
+	{
+		if (strcmp(inlinedResult->resultId, resultId) == 0)
+		{
+			return inlinedResult;
+		}
+	}
+
+	return NULL;
+}
+
+
+/*
+ * CanUseIntermediateResultCache returns whether subplans can reuse results
+ * of earlier statements in the current transaction. That requires every
+ * statement to see the same data, so the transaction should use a single
+ * snapshot, and it should not have modified distributed tables.
+ * Modifications of local tables advance the command ID, which is part of
+ * the cache key.
+ */
+static bool
+CanUseIntermediateResultCache(void)
+{
+	if (!EnableIntermediateResultCache)
+	{
+		return false;
+	}
+
+	if (!IsolationUsesXactSnapshot() || !ActiveSnapshotSet())
+	{
+		return false;
+	}
+
+	return XactModificationLevel == XACT_MODIFICATION_NONE;
+}
+
+
+/*
+ * ReuseCachedIntermediateResult tries to find an earlier result of the
+ * given subplan query that is available on all nodes that need it. If there
+ * is one, task queries read the earlier result rather than the given result
+ * and the function returns true.
+ */
+static bool
+ReuseCachedIntermediateResult(char *queryFingerprint, char *resultId,
+							  List *remoteWorkerNodeList, bool writeLocalFile)
+{
+	Oid userId = GetUserId();
+	CommandId commandId = GetActiveSnapshot()->curcid;
+
+	CachedIntermediateResult *cachedResult = NULL;
+	CachedIntermediateResult *candidateResult = NULL;
+	foreach_ptr(candidateResult, CachedIntermediateResultList)
+	{
+		if (candidateResult->userId == userId &&
+			candidateResult->commandId == commandId &&
+			strcmp(candidateResult->queryFingerprint, queryFingerprint) == 0)
+		{
+			cachedResult = candidateResult;
+			break;
+		}
+	}
+
+	if (cachedResult == NULL)
+	{
+		return false;
+	}
+
+	if (writeLocalFile && !cachedResult->hasLocalFile)
+	{
+		return false;
+	}
+
+	InlinedIntermediateResult *cachedInlinedResult =
+		FindInlinedIntermediateResult(cachedResult->resultId);
+
+	if (cachedInlinedResult == NULL)
+	{
+		WorkerNode *workerNode = NULL;
+		foreach_ptr(workerNode, remoteWorkerNodeList)
+		{
+			if (!list_member_int(cachedResult->nodeIdList, workerNode->nodeId))
+			{
+				return false;
+			}
+		}
+	}
+
+	ereport(DEBUG1, (errmsg("Subplan %s reuses the result of subplan %s",
+							resultId, cachedResult->resultId)));
+
+	if (strcmp(cachedResult->resultId, resultId) == 0)
+	{
+		/* the same plan ran earlier in the transaction, its result is in place */
+		return true;
+	}
+
+	ForgetInlinedIntermediateResult(resultId);
+	ForgetCachedIntermediateResult(resultId);
+
+	if (writeLocalFile)
+	{
+		LinkIntermediateResultFile(cachedResult->resultId, resultId);
+	}
+
+	MemoryContext oldContext = MemoryContextSwitchTo(TopTransactionContext);
+
+	InlinedIntermediateResult *reusedResult = palloc0(
+		sizeof(InlinedIntermediateResult));
+	reusedResult->resultId = pstrdup(resultId);
+
+	if (cachedInlinedResult != NULL)
+	{
+		reusedResult->recordSetData = cachedInlinedResult->recordSetData;
+	}
+	else
+	{
+		reusedResult->reusedResultId = cachedResult->resultId;
+	}
+
+	InlinedIntermediateResultList = lappend(InlinedIntermediateResultList,
+											reusedResult);
+
+	MemoryContextSwitchTo(oldContext);
+
+	return true;
+}
+
+
+/*
+ * RecordCachedIntermediateResult remembers until the end of the transaction
+ * that the given result holds the rows of the given subplan query.
+ */
+static void
+RecordCachedIntermediateResult(char *queryFingerprint, char *resultId,
+							   List *remoteWorkerNodeList, bool writeLocalFile)
+{
+	MemoryContext oldContext = MemoryContextSwitchTo(TopTransactionContext);
+
+	CachedIntermediateResult *cachedResult = palloc0(sizeof(CachedIntermediateResult));
+	cachedResult->queryFingerprint = pstrdup(queryFingerprint);
+	cachedResult->userId = GetUserId();
+	cachedResult->commandId = GetActiveSnapshot()->curcid;
+	cachedResult->resultId = pstrdup(resultId);
+	cachedResult->hasLocalFile = writeLocalFile;
+
+	WorkerNode *workerNode = NULL;
+	foreach_ptr(workerNode, remoteWorkerNodeList)
+	{
+		cachedResult->nodeIdList = lappend_int(cachedResult->nodeIdList,
+											   workerNode->nodeId);
+	}
+
+	CachedIntermediateResultList = lappend(CachedIntermediateResultList,
+										   cachedResult);
+
+	MemoryContextSwitchTo(oldContext);
+}
+
+
+/*
+ * ForgetCachedIntermediateResult removes cached results with the given ID,
+ * since their files are about to be overwritten.
+ */
+static void
+ForgetCachedIntermediateResult(char *resultId)
+{
+	CachedIntermediateResult *cachedResult = NULL;
+	foreach_ptr(cachedResult, CachedIntermediateResultList)
+	{
+		if (strcmp(cachedResult->resultId, resultId) == 0)
+		{
+			CachedIntermediateResultList = list_delete_ptr(
+				CachedIntermediateResultList, cachedResult);
+			return;
+		}
+	}
+}
+
+
+/*
+ * LinkIntermediateResultFile makes the local file of the target result a
+ * hard link to the local file of the source result, such that queries on the
+ * coordinator can read the source result under the target name.
+ */
+static void
+LinkIntermediateResultFile(char *sourceResultId, char *targetResultId)
+{
+	char *sourceFileName = QueryResultFileName(sourceResultId);
+	char *targetFileName = QueryResultFileName(targetResultId);
+
+	if (unlink(targetFileName) != 0 && errno != ENOENT)
+	{
+		ereport(ERROR, (errcode_for_file_access(),
+						errmsg("could not remove file \"%s\": %m", targetFileName)));
+	}
+
+	if (link(sourceFileName, targetFileName) != 0)
+	{
+		ereport(ERROR, (errcode_for_file_access(),
+						errmsg("could not link file \"%s\" to \"%s\": %m",
+							   sourceFileName, targetFileName)));
+	}
+}
+
+
+/*
+ * InlineIntermediateResultsInJob returns the task list of the job with the
+ * queries of the tasks rewritten to read the inlined results, if the job
+ * query reads any of them. The calls to read_intermediate_result are
+ * replaced in a copy of the job query, from which the query of each task is
+ * built again the way the pushdown and router planners build it. Tasks of
+ * cached plans must not change, so rewritten tasks are copies.
+ */
+List *
+InlineIntermediateResultsInJob(Job *job)
+{
+	List *taskList = job->taskList;
+	bool readsInlinedResult = false;
+
+	if (InlinedIntermediateResultList == NIL || !CanInlineIntermediateResultsInJob(job))
+	{
+		return taskList;
+	}
+
+	Query *inlinedJobQuery = copyObject(job->jobQuery);
+	InlineIntermediateResultsWalker((Node *) inlinedJobQuery, &readsInlinedResult);
+
+	if (!readsInlinedResult)
+	{
+		return taskList;
+	}
+
+	List *inlinedTaskList = NIL;
+
+	Task *task = NULL;
+	foreach_ptr(task, taskList)
+	{
+		Query *taskQuery = copyObject(inlinedJobQuery);
+
+		UpdateRelationToShardNames((Node *) taskQuery, task->relationShardList);
+		MakeQualsExplicit(taskQuery);
+
+		/* a shallow copy suffices, since we only change the query */
+		Task *inlinedTask = (Task *) palloc(sizeof(Task));
+		*inlinedTask = *task;
+
+		SetTaskQuery(inlinedTask, taskQuery);
+
+		ereport(DEBUG4, (errmsg("query after inlining intermediate results: %s",
+								ApplyLogRedaction(TaskQueryString(inlinedTask)))));
+
+		inlinedTaskList = lappend(inlinedTaskList, inlinedTask);
+	}
+
+	return inlinedTaskList;
+}
+
+
+/*
+ * CanInlineIntermediateResultsInJob returns whether the task queries of the
+ * given job can be built again from the job query. That is not the case for
+ * re-partition jobs, whose tasks read the results of other tasks, and for
+ * INSERTs, whose tasks are deparsed separately for every shard.
+ */
+static bool
+CanInlineIntermediateResultsInJob(Job *job)
+{
+	Query *jobQuery = job->jobQuery;
+
+	if (job->dependentJobList != NIL || jobQuery == NULL)
+	{
+		return false;
+	}
+
+	return jobQuery->commandType == CMD_SELECT ||
+		   jobQuery->commandType == CMD_UPDATE ||
+		   jobQuery->commandType == CMD_DELETE;
+}
+
+
+/*
+ * InlineIntermediateResultsWalker replaces the read_intermediate_result calls
+ * for inlined results in the range tables of the given query tree, which
+ * BuildSubPlanResultQuery creates. Inlined results are read with
+ * json_to_recordset, which takes the same column definition list, and reused
+ * results are read from the files of the earlier subplan. The tree is
+ * changed in place.
+ */
+static bool
+InlineIntermediateResultsWalker(Node *node, bool *readsInlinedResult)
+{
+	if (node == NULL)
+	{
+		return false;
+	}
+
+	if (IsA(node, Query))
+	{
+		return query_tree_walker((Query *) node, InlineIntermediateResultsWalker,
+								 readsInlinedResult, QTW_EXAMINE_RTES_BEFORE);
+	}
+
+	if (!IsA(node, RangeTblEntry))
+	{
+		return expression_tree_walker(node, InlineIntermediateResultsWalker,
+									  readsInlinedResult);
+	}
+
+	RangeTblEntry *rangeTableEntry = (RangeTblEntry *) node;
+	if (rangeTableEntry->rtekind != RTE_FUNCTION ||
+		list_length(rangeTableEntry->functions) != 1)
+	{
+		return false;
+	}
+
+	RangeTblFunction *rangeTableFunction = linitial(rangeTableEntry->functions);
+	FuncExpr *funcExpr = (FuncExpr *) rangeTableFunction->funcexpr;
+	if (!IsA(funcExpr, FuncExpr) ||
+		funcExpr->funcid != CitusReadIntermediateResultFuncId())
+	{
+		return false;
+	}
+
+	Const *resultIdConst = (Const *) linitial(funcExpr->args);
+	if (!IsA(resultIdConst, Const) || resultIdConst->constisnull)
+	{
+		return false;
+	}
+
+	char *resultId = TextDatumGetCString(resultIdConst->constvalue);
+	InlinedIntermediateResult *inlinedResult = FindInlinedIntermediateResult(resultId);
+	if (inlinedResult == NULL)
+	{
+		return false;
+	}
+
+	if (inlinedResult->reusedResultId != NULL)
+	{
+		resultIdConst->constvalue = CStringGetTextDatum(inlinedResult->reusedResultId);
+	}
+	else
+	{
+		Const *recordSetConst = makeConst(JSONOID, -1, InvalidOid, -1,
+										  CStringGetTextDatum(
+											  inlinedResult->recordSetData),
+										  false, false);
+
+		/* json_to_recordset also returns a set of records */
+		funcExpr->funcid = F_JSON_TO_RECORDSET;
+		funcExpr->args = list_make1(recordSetConst);
+	}
+
+	*readsInlinedResult = true;
+
+	return false;
 }
@@ -0,0 +1,406 @@
+/*-------------------------------------------------------------------------
+ *
+ * tenant_stats.c
+ *    Statistics of the most frequently queried distribution column values.
+ *
+ *    In multi-tenant applications the distribution column value identifies
+ *    the tenant, and the router queries of a few tenants often make up most
+ *    of the load of a cluster. The custom scan records every router query in
+ *    a shared hash keyed by the colocation group and the distribution column
+ *    value, which is shown by citus_stat_tenants and helps deciding which
+ *    tenants to isolate or move.
+ *
+ *    Unlike the statement statistics, the number of tenants is unbounded, so
+ *    the hash only keeps the citus.stat_tenants_max most called values using
+ *    the Space-Saving algorithm: when a new value arrives and the hash is
+ *    full, it takes the place of the least called value and inherits its
+ *    number of calls. The number of calls of a value is thereby never under-
+ *    estimated, and overestimated by at most calls_error. Values that are
+ *    called more often than 1 in citus.stat_tenants_max times are guaranteed
+ *    to be in the hash.
+ *
+ * Copyright (c) Citus Data, Inc.
+ *-------------------------------------------------------------------------
+ */
+
+#include "postgres.h"
+
+#include "fmgr.h"
+#include "miscadmin.h"
+
+#include "distributed/metadata_cache.h"
+#include "distributed/tenant_stats.h"
+#include "distributed/tuplestore.h"
+#include "mb/pg_wchar.h"
+#include "storage/ipc.h"
+#include "storage/lwlock.h"
+#include "storage/shmem.h"
+#include "storage/spin.h"
+#include "utils/builtins.h"
+#include "utils/hsearch.h"
+
+
+/* number of columns returned by citus_stat_tenants */
+#define CITUS_STAT_TENANTS_COLUMNS 8
+
+
+/*
+ * TenantStatsControlData contains the lock that protects the shared hash of
+ * tenant statistics.
+ */
+typedef struct TenantStatsControlData
+{
+	int trancheId;
+	char *lockTrancheName;
+	LWLock lock;
+} TenantStatsControlData;
+
+
+/*
+ * TenantStatsHashKey identifies a tenant, which is a distribution column value
+ * of a colocation group. The value is truncated to fit.
+ */
+typedef struct TenantStatsHashKey
+{
+	Oid databaseId;
+	uint32 colocationId;
+	char distributionValue[NAMEDATALEN];
+} TenantStatsHashKey;
+
+
+/* hash entry for the statistics of a tenant */
+typedef struct TenantStatsHashEntry
+{
+	TenantStatsHashKey key;
+
+	slock_t mutex;
+
+	/* number of calls, including the calls of the values it replaced */
+	int64 calls;
+
+	/* number of calls that the value inherited when it was added */
+	int64 callsError;
+
+	/* metrics of the calls since the value was added */
+	double totalTimeMs;
+	int64 rowCount;
+	int64 bytesReceived;
+} TenantStatsHashEntry;
+
+
+/* GUC, the maximum number of tenants that are tracked, 0 disables the statistics */
+int StatTenantsMax = 1000;
+
+static shmem_startup_hook_type prev_shmem_startup_hook = NULL;
+static TenantStatsControlData *TenantStatsSharedState = NULL;
+static HTAB *TenantStatsHash = NULL;
+
+
+static size_t TenantStatsShmemSize(void);
+static void TenantStatsShmemInit(void);
+static int64 RemoveLeastCalledTenant(void);
+
+PG_FUNCTION_INFO_V1(citus_stat_tenants);
+PG_FUNCTION_INFO_V1(citus_stat_tenants_reset);
+
+
+/*
+ * InitializeTenantStats, called at server start, requests the shared memory
+ * for the tenant statistics.
+ */
+void
+InitializeTenantStats(void)
+{
+	if (StatTenantsMax == 0)
+	{
+		return;
+	}
+
+	if (!IsUnderPostmaster)
+	{
+		RequestAddinShmemSpace(TenantStatsShmemSize());
+	}
+
+	prev_shmem_startup_hook = shmem_startup_hook;
+	shmem_startup_hook = TenantStatsShmemInit;
+}
+
+
+/*
+ * TenantStatsEnabled returns whether executions are recorded in the tenant
+ * statistics, such that callers can skip looking up the colocation group.
+ */
+bool
+TenantStatsEnabled(void)
+{
+	return TenantStatsHash != NULL;
+}
+
+
+/*
+ * CitusTenantStatsEntry adds an execution of a router query with the given
+ * distribution column value on the given colocation group to the tenant
+ * statistics.
+ */
+void
+CitusTenantStatsEntry(uint32 colocationId, char *distributionValue,
+					  CitusQueryExecutionStats *executionStats)
+{
+	TenantStatsHashKey key;
+	bool found = false;
+
+	if (TenantStatsHash == NULL)
+	{
+		return;
+	}
+
+	/* the key is hashed as a blob, so the padding needs to be zeroed */
+	memset(&key, 0, sizeof(TenantStatsHashKey));
+	key.databaseId = MyDatabaseId;
+	key.colocationId = colocationId;
+
+	int distributionValueLength = pg_mbcliplen(distributionValue,
+											   strlen(distributionValue),
+											   NAMEDATALEN - 1);
+	memcpy(key.distributionValue, distributionValue, distributionValueLength);
+
+	LWLockAcquire(&TenantStatsSharedState->lock, LW_SHARED);
+
+	TenantStatsHashEntry *entry = hash_search(TenantStatsHash, &key, HASH_FIND,
+											  &found);
+	if (!found)
+	{
+		int64 inheritedCalls = 0;
+
+		/* adding a new entry requires the lock in exclusive mode */
+		LWLockRelease(&TenantStatsSharedState->lock);
+		LWLockAcquire(&TenantStatsSharedState->lock, LW_EXCLUSIVE);
+
+		entry = hash_search(TenantStatsHash, &key, HASH_FIND, &found);
+		if (!found && hash_get_num_entries(TenantStatsHash) >= StatTenantsMax)
+		{
+			inheritedCalls = RemoveLeastCalledTenant();
+		}
+
+		entry = hash_search(TenantStatsHash, &key, HASH_ENTER_NULL, &found);
+		if (entry == NULL)
+		{
+			/* out of shared memory, the execution is not counted */
+			LWLockRelease(&TenantStatsSharedState->lock);
+			return;
+		}
+
+		if (!found)
+		{
+			SpinLockInit(&entry->mutex);
+			entry->calls = inheritedCalls;
+			entry->callsError = inheritedCalls;
+			entry->totalTimeMs = 0.0;
+			entry->rowCount = 0;
+			entry->bytesReceived = 0;
+		}
+	}
+
+	SpinLockAcquire(&entry->mutex);
+
+	entry->calls++;
+	entry->totalTimeMs += executionStats->executionTimeMs;
+	entry->rowCount += executionStats->rowCount;
+	entry->bytesReceived += executionStats->bytesReceived;
+
+	SpinLockRelease(&entry->mutex);
+
+	LWLockRelease(&TenantStatsSharedState->lock);
+}
+
+
+/*
+ * RemoveLeastCalledTenant removes the tenant with the fewest calls from the
+ * hash and returns its number of calls. The caller should hold the lock in
+ * exclusive mode, such that no calls are added concurrently.
+ */
+static int64
+RemoveLeastCalledTenant(void)
+{
+	HASH_SEQ_STATUS status;
+	TenantStatsHashEntry *entry = NULL;
+	TenantStatsHashEntry *leastCalledEntry = NULL;
+
+	hash_seq_init(&status, TenantStatsHash);
+	while ((entry = hash_seq_search(&status)) != NULL)
+	{
+		if (leastCalledEntry == NULL || entry->calls < leastCalledEntry->calls)
+		{
+			leastCalledEntry = entry;
+		}
+	}
+
+	if (leastCalledEntry == NULL)
+	{
+		return 0;
+	}
+
+	int64 leastCalls = leastCalledEntry->calls;
+
+	hash_search(TenantStatsHash, &leastCalledEntry->key, HASH_REMOVE, NULL);
+
+	return leastCalls;
+}
+
+
+/*
+ * citus_stat_tenants_reset removes the statistics of all tenants.
+ */
+Datum
+citus_stat_tenants_reset(PG_FUNCTION_ARGS)
+{
+	HASH_SEQ_STATUS status;
+	TenantStatsHashEntry *entry = NULL;
+
+	CheckCitusVersion(ERROR);
+
+	if (TenantStatsHash == NULL)
+	{
+		PG_RETURN_VOID();
+	}
+
+	LWLockAcquire(&TenantStatsSharedState->lock, LW_EXCLUSIVE);
+
+	hash_seq_init(&status, TenantStatsHash);
+	while ((entry = hash_seq_search(&status)) != NULL)
+	{
+		hash_search(TenantStatsHash, &entry->key, HASH_REMOVE, NULL);
+	}
+
+	LWLockRelease(&TenantStatsSharedState->lock);
+
+	PG_RETURN_VOID();
+}
+
+
+/*
+ * citus_stat_tenants returns the statistics of the tracked tenants.
+ */
+Datum
+citus_stat_tenants(PG_FUNCTION_ARGS)
+{
+	TupleDesc tupleDescriptor = NULL;
+	HASH_SEQ_STATUS status;
+	TenantStatsHashEntry *entry = NULL;
+
+	CheckCitusVersion(ERROR);
+
+	Tuplestorestate *tupleStore = SetupTuplestore(fcinfo, &tupleDescriptor);
+
+	if (TenantStatsHash == NULL)
+	{
+		tuplestore_donestoring(tupleStore);
+
+		PG_RETURN_VOID();
+	}
+
+	LWLockAcquire(&TenantStatsSharedState->lock, LW_SHARED);
+
+	hash_seq_init(&status, TenantStatsHash);
+	while ((entry = hash_seq_search(&status)) != NULL)
+	{
+		Datum values[CITUS_STAT_TENANTS_COLUMNS];
+		bool isNulls[CITUS_STAT_TENANTS_COLUMNS];
+
+		memset(values, 0, sizeof(values));
+		memset(isNulls, false, sizeof(isNulls));
+
+		SpinLockAcquire(&entry->mutex);
+		int64 calls = entry->calls;
+		int64 callsError = entry->callsError;
+		double totalTimeMs = entry->totalTimeMs;
+		int64 rowCount = entry->rowCount;
+		int64 bytesReceived = entry->bytesReceived;
+		SpinLockRelease(&entry->mutex);
+
+		values[0] = ObjectIdGetDatum(entry->key.databaseId);
+		values[1] = UInt32GetDatum(entry->key.colocationId);
+		values[2] = CStringGetTextDatum(entry->key.distributionValue);
+		values[3] = Int64GetDatum(calls);
+		values[4] = Int64GetDatum(callsError);
+		values[5] = Float8GetDatum(totalTimeMs);
+		values[6] = Int64GetDatum(rowCount);
+		values[7] = Int64GetDatum(bytesReceived);
+
+		tuplestore_putvalues(tupleStore, tupleDescriptor, values, isNulls);
+	}
+
+	LWLockRelease(&TenantStatsSharedState->lock);
+
+	tuplestore_donestoring(tupleStore);
+
+	PG_RETURN_VOID();
+}
+
+
+/*
+ * TenantStatsShmemSize returns the size of the shared memory needed for the
+ * tenant statistics.
+ */
+static size_t
+TenantStatsShmemSize(void)
+{
+	Size size = 0;
+
+	size = add_size(size, sizeof(TenantStatsControlData));
+
+	Size hashSize = hash_estimate_size(StatTenantsMax, sizeof(TenantStatsHashEntry));
+	size = add_size(size, hashSize);
+
+	return size;
+}
+
+
+/*
+ * TenantStatsShmemInit initializes the shared memory for the tenant
+ * statistics.
+ */
+static void
+TenantStatsShmemInit(void)
+{
+	bool alreadyInitialized = false;
+	HASHCTL info;
+
+	LWLockAcquire(AddinShmemInitLock, LW_EXCLUSIVE);
+
+	TenantStatsSharedState =
+		(TenantStatsControlData *) ShmemInitStruct("Citus Tenant Stats",
+												   sizeof(TenantStatsControlData),
+												   &alreadyInitialized);
+
+	/*
+	 * Might already be initialized on EXEC_BACKEND type platforms that call
+	 * shared library initialization functions in every backend.
+	 */
+	if (!alreadyInitialized)
+	{
+		TenantStatsSharedState->trancheId = LWLockNewTrancheId();
+		TenantStatsSharedState->lockTrancheName = "Citus Tenant Stats";
+		LWLockRegisterTranche(TenantStatsSharedState->trancheId,
+							  TenantStatsSharedState->lockTrancheName);
+
+		LWLockInitialize(&TenantStatsSharedState->lock,
+						 TenantStatsSharedState->trancheId);
+	}
+
+	memset(&info, 0, sizeof(info));
+	info.keysize = sizeof(TenantStatsHashKey);
+	info.entrysize = sizeof(TenantStatsHashEntry);
+	int hashFlags = (HASH_ELEM | HASH_BLOBS);
+
+	TenantStatsHash = ShmemInitHash("Citus Tenant Stats Hash",
+									StatTenantsMax, StatTenantsMax,
+									&info, hashFlags);
+
+	LWLockRelease(AddinShmemInitLock);
+
+	if (prev_shmem_startup_hook != NULL)
+	{
+		prev_shmem_startup_hook();
+	}
+}
@@ -0,0 +1,652 @@
+/*-------------------------------------------------------------------------
+ *
+ * alter_distributed_table.c
+ *
+ * This file contains functions to change the shard count or the distribution
+ * column of a hash distributed table.
+ *
+ * The table keeps its identity, so views, grants and foreign keys to
+ * reference tables remain in place. The metadata of the current shards is
+ * replaced by the metadata of shards for the new layout, which are created
+ * like the shards of a new distributed table. The rows of the current shards
+ * are then repartitioned on the workers into the new shards, in the same way
+ * as a repartitioned INSERT..SELECT, so they do not pass through the
+ * coordinator. Finally, the current shards are dropped. All of this happens
+ * within the coordinated transaction, so a failure leaves the current shards
+ * in place. Writes to the table are blocked while it is changed, but reads
+ * continue on the current shards until the transaction commits.
+ *
+ * Copyright (c) Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include "postgres.h"
+#include "fmgr.h"
+#include "miscadmin.h"
+
+#include "access/htup_details.h"
+#include "catalog/pg_class.h"
+#include "distributed/adaptive_executor.h"
+#include "distributed/colocation_utils.h"
+#include "distributed/commands.h"
+#include "distributed/commands/multi_copy.h"
+#include "distributed/distribution_column.h"
+#include "distributed/intermediate_results.h"
+#include "distributed/listutils.h"
+#include "distributed/master_metadata_utility.h"
+#include "distributed/master_protocol.h"
+#include "distributed/metadata_cache.h"
+#include "distributed/metadata_sync.h"
+#include "distributed/multi_executor.h"
+#include "distributed/multi_join_order.h"
+#include "distributed/multi_partitioning_utils.h"
+#include "distributed/multi_physical_planner.h"
+#include "distributed/pg_dist_partition.h"
+#include "distributed/resource_lock.h"
+#include "distributed/shared_library_init.h"
+#include "distributed/worker_protocol.h"
+#include "distributed/worker_transaction.h"
+#include "storage/lmgr.h"
+#include "utils/builtins.h"
+#include "utils/lsyscache.h"
+#include "utils/rel.h"
+#include "utils/typcache.h"
+
+
+static void ErrorIfCannotAlterDistributedTable(Oid relationId,
+											   Var *distributionColumn);
+static void AlterDistributedTableShards(Oid relationId, Var *distributionColumn,
+										int shardCount);
+static uint32 ColocationIdForAlteredTable(CitusTableCacheEntry *cacheEntry,
+										  Var *distributionColumn, int shardCount,
+										  int replicationFactor, Oid *colocatedTableId);
+static int CopiedColumnLists(Oid relationId, Var *distributionColumn,
+							 StringInfo columnList, StringInfo columnDefinitionList);
+static List * SourceShardSelectTaskList(List *shardIntervalList, char *columnList);
+static List * SourceShardDropTaskList(List *shardIntervalList);
+static List * TargetShardInsertTaskList(CitusTableCacheEntry *targetRelation,
+										List **shardResultIdList, char *columnList,
+										char *columnDefinitionList, bool binaryFormat);
+
+/* declarations for dynamic loading */
+PG_FUNCTION_INFO_V1(alter_distributed_table);
+
+
+/*
+ * alter_distributed_table changes the distribution column, the shard count, or
+ * both, of the given hash distributed table. The arguments that are NULL keep
+ * their current value.
+ *
+ * SQL signature:
+ *
+ * alter_distributed_table(
+ *     table_name regclass,
+ *     distribution_column text DEFAULT NULL,
+ *     shard_count int DEFAULT NULL
+ * ) RETURNS void
+ */
+Datum
+alter_distributed_table(PG_FUNCTION_ARGS)
+{
+	CheckCitusVersion(ERROR);
+	EnsureCoordinator();
+
+	if (PG_ARGISNULL(0))
+	{
+		ereport(ERROR, (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+						errmsg("table_name cannot be NULL")));
+	}
+
+	Oid relationId = PG_GETARG_OID(0);
+	char *relationName = get_rel_name(relationId);
+
+	if (PG_ARGISNULL(1) && PG_ARGISNULL(2))
+	{
+		ereport(ERROR, (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+						errmsg("either distribution_column or shard_count needs to "
+							   "be given")));
+	}
+
+	EnsureTableOwner(relationId);
+
+	/*
+	 * Block writes to the table, as well as concurrent moves, splits and DDL,
+	 * but allow reads on the current shards.
+	 */
+	LockRelationOid(relationId, ExclusiveLock);
+
+	if (!IsCitusTable(relationId) || PartitionMethod(relationId) != DISTRIBUTE_BY_HASH)
+	{
+		ereport(ERROR, (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+						errmsg("cannot alter table \"%s\"", relationName),
+						errdetail("Only hash distributed tables can be altered.")));
+	}
+
+	CitusTableCacheEntry *cacheEntry = GetCitusTableCacheEntry(relationId);
+	Var *distributionColumn = copyObject(cacheEntry->partitionColumn);
+	int shardCount = cacheEntry->shardIntervalArrayLength;
+
+	if (!PG_ARGISNULL(1))
+	{
+		char *distributionColumnName = text_to_cstring(PG_GETARG_TEXT_P(1));
+		Relation relation = relation_open(relationId, NoLock);
+
+		distributionColumn = BuildDistributionKeyFromColumnName(relation,
+																distributionColumnName);
+
+		relation_close(relation, NoLock);
+	}
+
+	if (!PG_ARGISNULL(2))
+	{
+		shardCount = PG_GETARG_INT32(2);
+
+		if (shardCount < 1 || shardCount > MAX_SHARD_COUNT)
+		{
+			ereport(ERROR, (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+							errmsg("shard_count must be between 1 and %d",
+								   MAX_SHARD_COUNT)));
+		}
+	}
+
+	if (distributionColumn->varattno == cacheEntry->partitionColumn->varattno &&
+		shardCount == cacheEntry->shardIntervalArrayLength)
+	{
+		ereport(NOTICE, (errmsg("table \"%s\" already has the given distribution "
+								"column and shard count", relationName)));
+
+		PG_RETURN_VOID();
+	}
+
+	ErrorIfCannotAlterDistributedTable(relationId, distributionColumn);
+
+	AlterDistributedTableShards(relationId, distributionColumn, shardCount);
+
+	PG_RETURN_VOID();
+}
+
+
+/*
+ * ErrorIfCannotAlterDistributedTable errors out if the given table cannot be
+ * altered to be distributed by the given column. Tables that are colocated
+ * with other tables are not supported, since the shards of all tables of a
+ * colocation group would need to change at once.
+ */
+static void
+ErrorIfCannotAlterDistributedTable(Oid relationId, Var *distributionColumn)
+{
+	char *relationName = get_rel_name(relationId);
+
+	if (list_length(ColocatedTableList(relationId)) > 1)
+	{
+		ereport(ERROR, (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+						errmsg("cannot alter table \"%s\" because it is colocated "
+							   "with other tables", relationName),
+						errdetail("The shards of all colocated tables would need to "
+								  "change at once, which is not supported.")));
+	}
+
+	if (PartitionedTable(relationId) || PartitionTable(relationId))
+	{
+		ereport(ERROR, (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+						errmsg("cannot alter partitioned table \"%s\"",
+							   relationName)));
+	}
+
+	if (get_rel_relkind(relationId) == RELKIND_FOREIGN_TABLE)
+	{
+		ereport(ERROR, (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+						errmsg("cannot alter foreign table \"%s\"", relationName)));
+	}
+
+	List *shardIntervalList = LoadShardIntervalList(relationId);
+
+	ShardInterval *shardInterval = NULL;
+	foreach_ptr(shardInterval, shardIntervalList)
+	{
+		uint64 shardId = shardInterval->shardId;
+		List *placementList = ShardPlacementList(shardId);
+		List *activePlacementList = ActiveShardPlacementList(shardId);
+
+		if (list_length(activePlacementList) != list_length(placementList))
+		{
+			ereport(ERROR, (errcode(ERRCODE_OBJECT_NOT_IN_PREREQUISITE_STATE),
+							errmsg("cannot alter table \"%s\" because shard "
+								   UINT64_FORMAT " has inactive placements",
+								   relationName, shardId),
+							errhint("Repair the placements using "
+									"master_copy_shard_placement() first.")));
+		}
+	}
+
+	/* the new distribution column needs to be usable for hash distribution */
+	TypeCacheEntry *typeEntry = lookup_type_cache(distributionColumn->vartype,
+												  TYPECACHE_HASH_PROC);
+	if (!OidIsValid(typeEntry->hash_proc))
+	{
+		ereport(ERROR, (errcode(ERRCODE_UNDEFINED_FUNCTION),
+						errmsg("could not identify a hash function for type %s",
+							   format_type_be(distributionColumn->vartype)),
+						errdatatype(distributionColumn->vartype),
+						errdetail("Partition column types must have a hash function "
+								  "defined to use hash partitioning.")));
+	}
+
+	Relation relation = relation_open(relationId, NoLock);
+
+#if PG_VERSION_NUM >= 120000
+	Form_pg_attribute attributeForm =
+		TupleDescAttr(RelationGetDescr(relation), distributionColumn->varattno - 1);
+	if (attributeForm->attgenerated == ATTRIBUTE_GENERATED_STORED)
+	{
+		ereport(ERROR, (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+						errmsg("cannot alter table \"%s\"", relationName),
+						errdetail("Distribution column must not use GENERATED ALWAYS "
+								  "AS (...) STORED.")));
+	}
+
+	if (distributionColumn->varcollid != InvalidOid &&
+		!get_collation_isdeterministic(distributionColumn->varcollid))
+	{
+		ereport(ERROR, (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+						errmsg("Hash distributed partition columns may not use "
+							   "a non deterministic collation")));
+	}
+#endif
+
+	/* unique constraints need to include the new distribution column */
+	ErrorIfUnsupportedConstraint(relation, DISTRIBUTE_BY_HASH, distributionColumn,
+								 INVALID_COLOCATION_ID);
+
+	relation_close(relation, NoLock);
+}
+
+
+/*
+ * AlterDistributedTableShards replaces the shards of the given table by shards
+ * for the given distribution column and shard count, and repartitions the rows
+ * of the current shards into them.
+ *
+ * The shards are created like the shards of a new table, with the same number
+ * of placements as the current shards. The metadata is changed first, such that
+ * the repartitioning can look up the new shards, but the current shards are
+ * still read through the placements that were loaded before.
+ */
+static void
+AlterDistributedTableShards(Oid relationId, Var *distributionColumn, int shardCount)
+{
+	CitusTableCacheEntry *cacheEntry = GetCitusTableCacheEntry(relationId);
+	char replicationModel = cacheEntry->replicationModel;
+	uint32 previousColocationId = cacheEntry->colocationId;
+	bool distributionColumnChanged =
+		distributionColumn->varattno != cacheEntry->partitionColumn->varattno;
+	bool shouldSyncMetadata = ShouldSyncTableMetadata(relationId);
+	List *metadataSyncCommandList = NIL;
+
+	List *sourceShardList = LoadShardIntervalList(relationId);
+	ShardInterval *firstShardInterval = (ShardInterval *) linitial(sourceShardList);
+	int replicationFactor =
+		list_length(ActiveShardPlacementList(firstShardInterval->shardId));
+
+	/* also blocks writes from workers with metadata */
+	BlockWritesToShardList(sourceShardList);
+
+	StringInfo columnList = makeStringInfo();
+	StringInfo columnDefinitionList = makeStringInfo();
+	int partitionColumnIndex = CopiedColumnLists(relationId, distributionColumn,
+												 columnList, columnDefinitionList);
+
+	Relation relation = relation_open(relationId, NoLock);
+	bool binaryFormat = CanUseBinaryCopyFormat(RelationGetDescr(relation));
+	relation_close(relation, NoLock);
+
+	/* generate the tasks and commands that depend on the current metadata first */
+	List *selectTaskList = SourceShardSelectTaskList(sourceShardList, columnList->data);
+	List *dropTaskList = SourceShardDropTaskList(sourceShardList);
+
+	ShardInterval *sourceShardInterval = NULL;
+	foreach_ptr(sourceShardInterval, sourceShardList)
+	{
+		uint64 shardId = sourceShardInterval->shardId;
+
+		if (shouldSyncMetadata)
+		{
+			metadataSyncCommandList =
+				list_concat(metadataSyncCommandList,
+							ShardDeleteCommandList(sourceShardInterval));
+		}
+
+		List *placementList = ShardPlacementList(shardId);
+
+		ShardPlacement *placement = NULL;
+		foreach_ptr(placement, placementList)
+		{
+			DeleteShardPlacementRow(placement->placementId);
+		}
+
+		DeleteShardRow(shardId);
+	}
+
+	Oid colocatedTableId = InvalidOid;
+	uint32 colocationId = ColocationIdForAlteredTable(cacheEntry, distributionColumn,
+													  shardCount, replicationFactor,
+													  &colocatedTableId);
+
+	DeletePartitionRow(relationId);
+	InsertIntoPgDistPartition(relationId, DISTRIBUTE_BY_HASH, distributionColumn,
+							  colocationId, replicationModel);
+
+	if (colocationId != previousColocationId)
+	{
+		DeleteColocationGroupIfNoTablesBelong(previousColocationId);
+	}
+
+	/*
+	 * Shards with foreign keys to reference tables are created and filled over
+	 * a single connection per node, since the reference table placements would
+	 * otherwise be accessed over multiple connections.
+	 */
+	bool useExclusiveConnections = true;
+	if (MultiShardConnectionType == SEQUENTIAL_CONNECTION ||
+		HasForeignKeyToReferenceTable(relationId))
+	{
+		SetLocalMultiShardModifyModeToSequential();
+		useExclusiveConnections = false;
+	}
+
+	if (colocatedTableId != InvalidOid)
+	{
+		CreateColocatedShards(relationId, colocatedTableId, useExclusiveConnections);
+	}
+	else
+	{
+		CreateShardsWithRoundRobinPolicy(relationId, shardCount, replicationFactor,
+										 useExclusiveConnections);
+	}
+
+	CitusTableCacheEntry *targetRelation = GetCitusTableCacheEntry(relationId);
+
+	StringInfo resultIdPrefix = makeStringInfo();
+	appendStringInfo(resultIdPrefix, "altered_table_%u", relationId);
+
+	List **shardResultIdList = RedistributeTaskListResults(resultIdPrefix->data,
+														   selectTaskList,
+														   partitionColumnIndex,
+														   targetRelation,
+														   binaryFormat);
+
+	List *insertTaskList = TargetShardInsertTaskList(targetRelation, shardResultIdList,
+													 columnList->data,
+													 columnDefinitionList->data,
+													 binaryFormat);
+	ExecuteTaskList(ROW_MODIFY_COMMUTATIVE, insertTaskList,
+					MaxAdaptiveExecutorPoolSize);
+
+	bool localExecutionSupported = true;
+	ExecuteUtilityTaskListWithoutResults(dropTaskList, localExecutionSupported);
+
+	if (shouldSyncMetadata)
+	{
+		if (distributionColumnChanged)
+		{
+			char *distributionColumnName = get_attname(relationId,
+													   distributionColumn->varattno,
+													   false);
+
+			metadataSyncCommandList =
+				lappend(metadataSyncCommandList,
+						DistributionColumnUpdateCommand(relationId,
+														distributionColumnName));
+		}
+
+		metadataSyncCommandList =
+			lappend(metadataSyncCommandList,
+					ColocationIdUpdateCommand(relationId, colocationId));
+		metadataSyncCommandList =
+			list_concat(metadataSyncCommandList,
+						ShardListInsertCommand(LoadShardIntervalList(relationId)));
+
+		char *metadataSyncCommand = NULL;
+		foreach_ptr(metadataSyncCommand, metadataSyncCommandList)
+		{
+			SendCommandToWorkersWithMetadata(metadataSyncCommand);
+		}
+	}
+}
+
+
+/*
+ * ColocationIdForAlteredTable returns the colocation group that the given
+ * table belongs to after it is altered, which is the default colocation group
+ * for the given distribution column type and shard count, as it would be for
+ * a new table. If another table belongs to that group, colocatedTableId is set
+ * to it, such that the new shards can be placed next to its shards.
+ */
+static uint32
+ColocationIdForAlteredTable(CitusTableCacheEntry *cacheEntry,
+							Var *distributionColumn, int shardCount,
+							int replicationFactor, Oid *colocatedTableId)
+{
+	Oid distributionColumnType = distributionColumn->vartype;
+	Oid distributionColumnCollation = get_typcollation(distributionColumnType);
+
+	/* prevent concurrent changes to the colocation groups */
+	LockRelationOid(DistColocationRelationId(), ExclusiveLock);
+
+	*colocatedTableId = InvalidOid;
+
+	uint32 colocationId = ColocationId(shardCount, replicationFactor,
+									   distributionColumnType,
+									   distributionColumnCollation);
+	if (colocationId == INVALID_COLOCATION_ID)
+	{
+		colocationId = CreateColocationGroup(shardCount, replicationFactor,
+											 distributionColumnType,
+											 distributionColumnCollation);
+	}
+	else if (colocationId != cacheEntry->colocationId)
+	{
+		/*
+		 * The table is the only table of its current group, so the new shards
+		 * only need to be placed next to the shards of another table if the
+		 * group changes.
+		 */
+		*colocatedTableId = ColocatedTableId(colocationId);
+	}
+
+	return colocationId;
+}
+
+
+/*
+ * CopiedColumnLists builds the comma-separated list of the columns of the given
+ * relation that are copied into the new shards, and the column definition list
+ * for reading them from an intermediate result. Generated columns are computed
+ * again by the new shards. It returns the index of the given distribution
+ * column in the list.
+ */
+static int
+CopiedColumnLists(Oid relationId, Var *distributionColumn, StringInfo columnList,
+				  StringInfo columnDefinitionList)
+{
+	Relation relation = relation_open(relationId, NoLock);
+	TupleDesc tupleDescriptor = RelationGetDescr(relation);
+	int partitionColumnIndex = -1;
+	int copiedColumnCount = 0;
+
+	for (int columnIndex = 0; columnIndex < tupleDescriptor->natts; columnIndex++)
+	{
+		Form_pg_attribute attributeForm = TupleDescAttr(tupleDescriptor, columnIndex);
+
+		if (attributeForm->attisdropped
+#if PG_VERSION_NUM >= 120000
+			|| attributeForm->attgenerated == ATTRIBUTE_GENERATED_STORED
+#endif
+			)
+		{
+			continue;
+		}
+
+		if (attributeForm->attnum == distributionColumn->varattno)
+		{
+			partitionColumnIndex = copiedColumnCount;
+		}
+
+		const char *columnName = quote_identifier(NameStr(attributeForm->attname));
+		char *columnType = format_type_with_typemod(attributeForm->atttypid,
+													attributeForm->atttypmod);
+
+		if (copiedColumnCount > 0)
+		{
+			appendStringInfoString(columnList, ", ");
+			appendStringInfoString(columnDefinitionList, ", ");
+		}
+
+		appendStringInfoString(columnList, columnName);
+		appendStringInfo(columnDefinitionList, "%s %s", columnName, columnType);
+
+		copiedColumnCount++;
+	}
+
+	relation_close(relation, NoLock);
+
+	Assert(partitionColumnIndex >= 0);
+
+	return partitionColumnIndex;
+}
+
+
+/*
+ * SourceShardSelectTaskList returns a task for each of the given shards that
+ * reads the given columns from one of its active placements.
+ */
+static List *
+SourceShardSelectTaskList(List *shardIntervalList, char *columnList)
+{
+	List *taskList = NIL;
+	uint32 taskId = 1;
+
+	ShardInterval *shardInterval = NULL;
+	foreach_ptr(shardInterval, shardIntervalList)
+	{
+		uint64 shardId = shardInterval->shardId;
+		StringInfo queryString = makeStringInfo();
+
+		appendStringInfo(queryString, "SELECT %s FROM %s", columnList,
+						 ConstructQualifiedShardName(shardInterval));
+
+		Task *task = CreateBasicTask(INVALID_JOB_ID, taskId++, SELECT_TASK,
+									 queryString->data);
+		task->anchorShardId = shardId;
+		task->taskPlacementList = ActiveShardPlacementList(shardId);
+
+		taskList = lappend(taskList, task);
+	}
+
+	return taskList;
+}
+
+
+/*
+ * SourceShardDropTaskList returns a task for each of the given shards that
+ * drops all of its placements.
+ */
+static List *
+SourceShardDropTaskList(List *shardIntervalList)
+{
+	List *taskList = NIL;
+	uint32 taskId = 1;
+
+	ShardInterval *shardInterval = NULL;
+	foreach_ptr(shardInterval, shardIntervalList)
+	{
+		uint64 shardId = shardInterval->shardId;
+		StringInfo dropCommand = makeStringInfo();
+
+		appendStringInfo(dropCommand, DROP_REGULAR_TABLE_COMMAND,
+						 ConstructQualifiedShardName(shardInterval));
+
+		Task *task = CreateBasicTask(INVALID_JOB_ID, taskId++, DDL_TASK,
+									 dropCommand->data);
+		task->replicationModel = REPLICATION_MODEL_INVALID;
+		task->anchorShardId = shardId;
+		task->taskPlacementList = ShardPlacementList(shardId);
+
+		taskList = lappend(taskList, task);
+	}
+
+	return taskList;
+}
+
+
+/*
+ * TargetShardInsertTaskList returns a task for each shard of the given table
+ * that inserts the intermediate results which were colocated with it, as
+ * listed in shardResultIdList by shard index. Shards without results are
+ * skipped.
+ */
+static List *
+TargetShardInsertTaskList(CitusTableCacheEntry *targetRelation,
+						  List **shardResultIdList, char *columnList,
+						  char *columnDefinitionList, bool binaryFormat)
+{
+	List *taskList = NIL;
+	uint32 taskId = 1;
+	const char *copyFormat = binaryFormat ? "binary" : "text";
+
+	for (int shardIndex = 0; shardIndex < targetRelation->shardIntervalArrayLength;
+		 shardIndex++)
+	{
+		ShardInterval *shardInterval =
+			targetRelation->sortedShardIntervalArray[shardIndex];
+		List *resultIdList = shardResultIdList[shardIndex];
+		uint64 shardId = shardInterval->shardId;
+
+		if (resultIdList == NIL)
+		{
+			continue;
+		}
+
+		StringInfo resultIdArray = makeStringInfo();
+		appendStringInfoString(resultIdArray, "ARRAY[");
+
+		char *resultId = NULL;
+		int resultIdIndex = 0;
+		foreach_ptr(resultId, resultIdList)
+		{
+			if (resultIdIndex++ > 0)
+			{
+				appendStringInfoString(resultIdArray, ",");
+			}
+
+			appendStringInfoString(resultIdArray, quote_literal_cstr(resultId));
+		}
+
+		appendStringInfoString(resultIdArray, "]::text[]");
+
+		StringInfo queryString = makeStringInfo();
+		appendStringInfo(queryString,
+						 "INSERT INTO %s (%s) SELECT %s FROM "
+						 "pg_catalog.read_intermediate_results(%s, "
+						 "'%s'::citus_copy_format) intermediate_result (%s)",
+						 ConstructQualifiedShardName(shardInterval), columnList,
+						 columnList, resultIdArray->data, copyFormat,
+						 columnDefinitionList);
+
+		RelationShard *relationShard = CitusMakeNode(RelationShard);
+		relationShard->relationId = targetRelation->relationId;
+		relationShard->shardId = shardId;
+
+		Task *task = CreateBasicTask(INVALID_JOB_ID, taskId++, MODIFY_TASK,
+									 queryString->data);
+		task->anchorShardId = shardId;
+		task->taskPlacementList = ActiveShardPlacementList(shardId);
+		task->relationShardList = list_make1(relationShard);
+		task->replicationModel = targetRelation->replicationModel;
+
+		taskList = lappend(taskList, task);
+	}
+
+	return taskList;
+}
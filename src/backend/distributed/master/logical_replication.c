@@ -0,0 +1,422 @@
+/*-------------------------------------------------------------------------
+ *
+ * logical_replication.c
+ *
+ * Routines for moving shards between nodes using logical replication, such
+ * that writes to the shards only need to be blocked for a short time.
+ *
+ * A move creates a publication for the shards on the source node and a
+ * subscription for it on the target node, on which the (empty) shards and
+ * their indexes already exist. PostgreSQL then copies the existing data and
+ * streams all changes that happen in the meantime to the target node. Once
+ * the target node caught up, writes to the shards are blocked until the end
+ * of the transaction, the last changes are replicated, and the subscription
+ * is dropped. The caller can then update the metadata and drop the shards on
+ * the source node while the writes are still blocked.
+ *
+ * Copyright (c) Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include "postgres.h"
+#include "miscadmin.h"
+#include "pgstat.h"
+
+#include "access/heapam.h"
+#include "catalog/pg_class.h"
+#include "commands/dbcommands.h"
+#include "distributed/connection_management.h"
+#include "distributed/listutils.h"
+#include "distributed/logical_replication.h"
+#include "distributed/master_protocol.h"
+#include "distributed/metadata_cache.h"
+#include "distributed/remote_commands.h"
+#include "distributed/resource_lock.h"
+#include "lib/stringinfo.h"
+#include "storage/ipc.h"
+#include "storage/latch.h"
+#include "utils/builtins.h"
+#include "utils/rel.h"
+#include "utils/relcache.h"
+
+
+/* time to wait between two checks whether the subscription caught up */
+#define SUBSCRIPTION_POLL_INTERVAL_MS 100
+
+#define CURRENT_WAL_LSN_COMMAND "SELECT pg_catalog.pg_current_wal_lsn()"
+
+
+static char * ShardTableListString(List *shardList);
+static char * ShardMovePublicationName(uint64 shardId);
+static char * ShardMoveSubscriptionName(uint64 shardId);
+static char * SourceNodeConnectionString(char *sourceNodeName, int sourceNodePort);
+static void WaitForSubscriptionTablesReady(MultiConnection *targetConnection,
+										   char *subscriptionName);
+static void WaitForSubscriptionCatchUp(MultiConnection *sourceConnection,
+									   MultiConnection *targetConnection,
+									   char *subscriptionName);
+static bool RemoteQueryReturnsTrue(MultiConnection *connection, char *query);
+static void WaitForNextPoll(void);
+static void DropShardMoveReplication(char *sourceNodeName, int sourceNodePort,
+									 char *targetNodeName, int targetNodePort,
+									 uint64 anchorShardId);
+
+
+/*
+ * RelationCanBeReplicatedLogically returns whether UPDATE and DELETE commands
+ * on the given relation can be replicated logically, which requires a replica
+ * identity.
+ */
+bool
+RelationCanBeReplicatedLogically(Oid relationId)
+{
+	Relation relation = relation_open(relationId, AccessShareLock);
+
+	bool hasReplicaIdentity =
+		relation->rd_rel->relreplident == REPLICA_IDENTITY_FULL ||
+		RelationGetReplicaIndex(relation) != InvalidOid;
+
+	relation_close(relation, NoLock);
+
+	return hasReplicaIdentity;
+}
+
+
+/*
+ * LogicallyReplicateShards replicates the data of the given colocated shards
+ * from the source node to the target node, on which the shards should already
+ * exist. When the function returns, the shards on the target node contain all
+ * data and writes to the shards are blocked until the end of the transaction.
+ *
+ * The replication runs over separate connections outside of the coordinated
+ * transaction, since subscriptions cannot be created in a transaction block.
+ * If anything fails, the publication, subscription and replication slot are
+ * dropped on a best-effort basis before the error is rethrown.
+ */
+void
+LogicallyReplicateShards(List *shardList, char *sourceNodeName, int sourceNodePort,
+						 char *targetNodeName, int targetNodePort)
+{
+	ShardInterval *anchorShardInterval = (ShardInterval *) linitial(shardList);
+	uint64 anchorShardId = anchorShardInterval->shardId;
+	char *superUser = CitusExtensionOwnerName();
+	char *publicationName = ShardMovePublicationName(anchorShardId);
+	char *subscriptionName = ShardMoveSubscriptionName(anchorShardId);
+	StringInfo createPublicationCommand = makeStringInfo();
+	StringInfo createSubscriptionCommand = makeStringInfo();
+	StringInfo dropSubscriptionCommand = makeStringInfo();
+	StringInfo dropPublicationCommand = makeStringInfo();
+	int connectionFlags = FORCE_NEW_CONNECTION;
+
+	appendStringInfo(createPublicationCommand, "CREATE PUBLICATION %s FOR TABLE %s",
+					 quote_identifier(publicationName), ShardTableListString(shardList));
+
+	appendStringInfo(createSubscriptionCommand,
+					 "CREATE SUBSCRIPTION %s CONNECTION %s PUBLICATION %s "
+					 "WITH (slot_name = %s)",
+					 quote_identifier(subscriptionName),
+					 quote_literal_cstr(SourceNodeConnectionString(sourceNodeName,
+																   sourceNodePort)),
+					 quote_identifier(publicationName),
+					 quote_identifier(subscriptionName));
+
+	appendStringInfo(dropSubscriptionCommand, "DROP SUBSCRIPTION %s",
+					 quote_identifier(subscriptionName));
+
+	appendStringInfo(dropPublicationCommand, "DROP PUBLICATION IF EXISTS %s",
+					 quote_identifier(publicationName));
+
+	ereport(DEBUG1, (errmsg("replicating %d shards logically from %s:%d to %s:%d",
+							list_length(shardList), sourceNodeName,
+							sourceNodePort, targetNodeName, targetNodePort)));
+
+	MultiConnection *sourceConnection =
+		GetNodeUserDatabaseConnection(connectionFlags, sourceNodeName, sourceNodePort,
+									  superUser, NULL);
+	MultiConnection *targetConnection =
+		GetNodeUserDatabaseConnection(connectionFlags, targetNodeName, targetNodePort,
+									  superUser, NULL);
+
+	PG_TRY();
+	{
+		ExecuteCriticalRemoteCommand(sourceConnection, createPublicationCommand->data);
+
+		/* creates the replication slot and starts copying the existing data */
+		ExecuteCriticalRemoteCommand(targetConnection, createSubscriptionCommand->data);
+
+		WaitForSubscriptionTablesReady(targetConnection, subscriptionName);
+
+		/* catch up with the writes that happened during the initial copy */
+		WaitForSubscriptionCatchUp(sourceConnection, targetConnection,
+								   subscriptionName);
+
+		/* DANGER: from here on writes are blocked until the end of the transaction */
+		BlockWritesToShardList(shardList);
+
+		/* replicate the writes that finished before we got the locks */
+		WaitForSubscriptionCatchUp(sourceConnection, targetConnection,
+								   subscriptionName);
+
+		/* drops the replication slot on the source node as well */
+		ExecuteCriticalRemoteCommand(targetConnection, dropSubscriptionCommand->data);
+		ExecuteCriticalRemoteCommand(sourceConnection, dropPublicationCommand->data);
+	}
+	PG_CATCH();
+	{
+		CloseConnection(sourceConnection);
+		CloseConnection(targetConnection);
+
+		DropShardMoveReplication(sourceNodeName, sourceNodePort, targetNodeName,
+								 targetNodePort, anchorShardId);
+
+		PG_RE_THROW();
+	}
+	PG_END_TRY();
+
+	CloseConnection(sourceConnection);
+	CloseConnection(targetConnection);
+}
+
+
+/*
+ * ShardTableListString returns a comma-separated list of the qualified names
+ * of the given shards.
+ */
+static char *
+ShardTableListString(List *shardList)
+{
+	StringInfo tableList = makeStringInfo();
+
+	ShardInterval *shardInterval = NULL;
+	foreach_ptr(shardInterval, shardList)
+	{
+		if (tableList->len > 0)
+		{
+			appendStringInfoString(tableList, ", ");
+		}
+
+		appendStringInfoString(tableList, ConstructQualifiedShardName(shardInterval));
+	}
+
+	return tableList->data;
+}
+
+
+/*
+ * ShardMovePublicationName returns the name of the publication of a move of
+ * the shards that are colocated with the given shard.
+ */
+static char *
+ShardMovePublicationName(uint64 shardId)
+{
+	StringInfo publicationName = makeStringInfo();
+
+	appendStringInfo(publicationName, SHARD_MOVE_PUBLICATION_PREFIX UINT64_FORMAT,
+					 shardId);
+
+	return publicationName->data;
+}
+
+
+/*
+ * ShardMoveSubscriptionName returns the name of the subscription, and the
+ * replication slot, of a move of the shards that are colocated with the given
+ * shard.
+ */
+static char *
+ShardMoveSubscriptionName(uint64 shardId)
+{
+	StringInfo subscriptionName = makeStringInfo();
+
+	appendStringInfo(subscriptionName, SHARD_MOVE_SUBSCRIPTION_PREFIX UINT64_FORMAT,
+					 shardId);
+
+	return subscriptionName->data;
+}
+
+
+/*
+ * SourceNodeConnectionString returns the connection string that the target
+ * node uses to connect to the source node, including citus.node_conninfo.
+ */
+static char *
+SourceNodeConnectionString(char *sourceNodeName, int sourceNodePort)
+{
+	StringInfo connectionString = makeStringInfo();
+
+	appendStringInfo(connectionString, "host='%s' port=%d user='%s' dbname='%s'",
+					 sourceNodeName, sourceNodePort, CitusExtensionOwnerName(),
+					 get_database_name(MyDatabaseId));
+
+	if (NodeConninfo != NULL && NodeConninfo[0] != '\0')
+	{
+		appendStringInfo(connectionString, " %s", NodeConninfo);
+	}
+
+	return connectionString->data;
+}
+
+
+/*
+ * WaitForSubscriptionTablesReady waits until the initial copy of all tables of
+ * the given subscription finished and the apply worker took over.
+ */
+static void
+WaitForSubscriptionTablesReady(MultiConnection *targetConnection,
+							   char *subscriptionName)
+{
+	StringInfo readyCommand = makeStringInfo();
+
+	appendStringInfo(readyCommand,
+					 "SELECT bool_and(srsubstate = 'r') "
+					 "FROM pg_catalog.pg_subscription_rel r "
+					 "JOIN pg_catalog.pg_subscription s ON (r.srsubid = s.oid) "
+					 "WHERE s.subname = %s",
+					 quote_literal_cstr(subscriptionName));
+
+	while (!RemoteQueryReturnsTrue(targetConnection, readyCommand->data))
+	{
+		WaitForNextPoll();
+	}
+}
+
+
+/*
+ * WaitForSubscriptionCatchUp waits until the given subscription replicated
+ * all changes that the source node wrote up to now.
+ */
+static void
+WaitForSubscriptionCatchUp(MultiConnection *sourceConnection,
+						   MultiConnection *targetConnection, char *subscriptionName)
+{
+	PGresult *result = NULL;
+	StringInfo caughtUpCommand = makeStringInfo();
+
+	int queryResult = ExecuteOptionalRemoteCommand(sourceConnection,
+												   CURRENT_WAL_LSN_COMMAND, &result);
+	if (queryResult != RESPONSE_OKAY)
+	{
+		ereport(ERROR, (errmsg("could not get the current WAL location of %s:%d",
+							   sourceConnection->hostname, sourceConnection->port)));
+	}
+
+	char *sourceLSN = pstrdup(PQgetvalue(result, 0, 0));
+
+	PQclear(result);
+	ForgetResults(sourceConnection);
+
+	appendStringInfo(caughtUpCommand,
+					 "SELECT coalesce(min(latest_end_lsn) >= %s::pg_lsn, false) "
+					 "FROM pg_catalog.pg_stat_subscription WHERE subname = %s",
+					 quote_literal_cstr(sourceLSN),
+					 quote_literal_cstr(subscriptionName));
+
+	while (!RemoteQueryReturnsTrue(targetConnection, caughtUpCommand->data))
+	{
+		WaitForNextPoll();
+	}
+}
+
+
+/*
+ * RemoteQueryReturnsTrue runs the given query, which should return a single
+ * boolean, over the given connection and returns its result. NULL is treated
+ * as false.
+ */
+static bool
+RemoteQueryReturnsTrue(MultiConnection *connection, char *query)
+{
+	PGresult *result = NULL;
+
+	int queryResult = ExecuteOptionalRemoteCommand(connection, query, &result);
+	if (queryResult != RESPONSE_OKAY)
+	{
+		ereport(ERROR, (errmsg("could not get the state of the shard move on %s:%d",
+							   connection->hostname, connection->port)));
+	}
+
+	bool isTrue = PQntuples(result) == 1 && !PQgetisnull(result, 0, 0) &&
+				  strcmp(PQgetvalue(result, 0, 0), "t") == 0;
+
+	PQclear(result);
+	ForgetResults(connection);
+
+	return isTrue;
+}
+
+
+/*
+ * WaitForNextPoll sleeps until it is time to check the state of the
+ * subscription again, while remaining responsive to cancellation.
+ */
+static void
+WaitForNextPoll(void)
+{
+	int rc = WaitLatch(MyLatch, WL_LATCH_SET | WL_TIMEOUT | WL_POSTMASTER_DEATH,
+					   SUBSCRIPTION_POLL_INTERVAL_MS, PG_WAIT_EXTENSION);
+
+	ResetLatch(MyLatch);
+
+	if (rc & WL_POSTMASTER_DEATH)
+	{
+		proc_exit(1);
+	}
+
+	CHECK_FOR_INTERRUPTS();
+}
+
+
+/*
+ * DropShardMoveReplication drops the subscription, replication slot and
+ * publication of a failed shard move over new connections, ignoring any
+ * errors. The subscription is disabled and detached from its slot first, such
+ * that it can be dropped even if the source node is unreachable.
+ */
+static void
+DropShardMoveReplication(char *sourceNodeName, int sourceNodePort,
+						 char *targetNodeName, int targetNodePort,
+						 uint64 anchorShardId)
+{
+	char *superUser = CitusExtensionOwnerName();
+	char *publicationName = ShardMovePublicationName(anchorShardId);
+	char *subscriptionName = ShardMoveSubscriptionName(anchorShardId);
+	StringInfo dropSubscriptionCommand = makeStringInfo();
+	StringInfo dropSlotCommand = makeStringInfo();
+	StringInfo dropPublicationCommand = makeStringInfo();
+	int connectionFlags = FORCE_NEW_CONNECTION;
+
+	appendStringInfo(dropSubscriptionCommand,
+					 "DO $$BEGIN "
+					 "IF EXISTS (SELECT 1 FROM pg_catalog.pg_subscription "
+					 "WHERE subname = %s) THEN "
+					 "ALTER SUBSCRIPTION %s DISABLE; "
+					 "ALTER SUBSCRIPTION %s SET (slot_name = NONE); "
+					 "DROP SUBSCRIPTION %s; "
+					 "END IF; END$$",
+					 quote_literal_cstr(subscriptionName),
+					 quote_identifier(subscriptionName),
+					 quote_identifier(subscriptionName),
+					 quote_identifier(subscriptionName));
+
+	appendStringInfo(dropSlotCommand,
+					 "SELECT pg_catalog.pg_drop_replication_slot(slot_name) "
+					 "FROM pg_catalog.pg_replication_slots WHERE slot_name = %s",
+					 quote_literal_cstr(subscriptionName));
+
+	appendStringInfo(dropPublicationCommand, "DROP PUBLICATION IF EXISTS %s",
+					 quote_identifier(publicationName));
+
+	MultiConnection *targetConnection =
+		GetNodeUserDatabaseConnection(connectionFlags, targetNodeName, targetNodePort,
+									  superUser, NULL);
+	ExecuteOptionalRemoteCommand(targetConnection, dropSubscriptionCommand->data, NULL);
+	CloseConnection(targetConnection);
+
+	MultiConnection *sourceConnection =
+		GetNodeUserDatabaseConnection(connectionFlags, sourceNodeName, sourceNodePort,
+									  superUser, NULL);
+	ExecuteOptionalRemoteCommand(sourceConnection, dropSlotCommand->data, NULL);
+	ExecuteOptionalRemoteCommand(sourceConnection, dropPublicationCommand->data, NULL);
+	CloseConnection(sourceConnection);
+}
@@ -53,6 +53,9 @@
 #include "utils/palloc.h"
 
 
+/* local function forward declarations */
+static List * CreatedShardPlacementList(Oid relationId);
+
 /* declarations for dynamic loading */
 PG_FUNCTION_INFO_V1(master_create_worker_shards);
 
@@ -108,7 +111,6 @@ CreateShardsWithRoundRobinPolicy(Oid distributedTableId, int32 shardCount,
 {
 	CitusTableCacheEntry *cacheEntry = GetCitusTableCacheEntry(distributedTableId);
 	bool colocatedShard = false;
-	List *insertedShardPlacements = NIL;
 
 	/* make sure table is hash partitioned */
 	CheckHashPartitionedTable(distributedTableId);
@@ -215,16 +217,13 @@ CreateShardsWithRoundRobinPolicy(Oid distributedTableId, int32 shardCount,
 		InsertShardRow(distributedTableId, shardId, shardStorageType,
 					   minHashTokenText, maxHashTokenText);
 
-		List *currentInsertedShardPlacements = InsertShardPlacementRows(
-			distributedTableId,
-			shardId,
-			workerNodeList,
-			roundRobinNodeIndex,
-			replicationFactor);
-		insertedShardPlacements = list_concat(insertedShardPlacements,
-											  currentInsertedShardPlacements);
+		InsertShardPlacementRows(distributedTableId, shardId, workerNodeList,
+								 roundRobinNodeIndex, replicationFactor);
 	}
 
+	/* load the placements only once all metadata rows are in place */
+	List *insertedShardPlacements = CreatedShardPlacementList(distributedTableId);
+
 	CreateShardsOnWorkers(distributedTableId, insertedShardPlacements,
 						  useExclusiveConnections, colocatedShard);
 }
@@ -239,7 +238,6 @@ CreateColocatedShards(Oid targetRelationId, Oid sourceRelationId, bool
 					  useExclusiveConnections)
 {
 	bool colocatedShard = true;
-	List *insertedShardPlacements = NIL;
 
 	/* make sure that tables are hash partitioned */
 	CheckHashPartitionedTable(targetRelationId);
@@ -306,17 +304,14 @@ CreateColocatedShards(Oid targetRelationId, Oid sourceRelationId, bool
 			 * Optimistically add shard placement row the pg_dist_shard_placement, in case
 			 * of any error it will be roll-backed.
 			 */
-			uint64 shardPlacementId = InsertShardPlacementRow(newShardId,
-															  INVALID_PLACEMENT_ID,
-															  shardState, shardSize,
-															  groupId);
-
-			ShardPlacement *shardPlacement = LoadShardPlacement(newShardId,
-																shardPlacementId);
-			insertedShardPlacements = lappend(insertedShardPlacements, shardPlacement);
+			InsertShardPlacementRow(newShardId, INVALID_PLACEMENT_ID, shardState,
+									shardSize, groupId);
 		}
 	}
 
+	/* load the placements only once all metadata rows are in place */
+	List *insertedShardPlacements = CreatedShardPlacementList(targetRelationId);
+
 	CreateShardsOnWorkers(targetRelationId, insertedShardPlacements,
 						  useExclusiveConnections, colocatedShard);
 }
@@ -375,15 +370,39 @@ CreateReferenceTableShard(Oid distributedTableId)
 	InsertShardRow(distributedTableId, shardId, shardStorageType, shardMinValue,
 				   shardMaxValue);
 
-	List *insertedShardPlacements = InsertShardPlacementRows(distributedTableId, shardId,
-															 nodeList, workerStartIndex,
-															 replicationFactor);
+	InsertShardPlacementRows(distributedTableId, shardId, nodeList, workerStartIndex,
+							 replicationFactor);
+
+	List *insertedShardPlacements = ShardPlacementList(shardId);
 
 	CreateShardsOnWorkers(distributedTableId, insertedShardPlacements,
 						  useExclusiveConnection, colocatedShard);
 }
 
 
+/*
+ * CreatedShardPlacementList returns the placements of all shards of the given
+ * table. It is used after creating the shard metadata of a table that did not
+ * have shards before, such that the metadata cache entry of the table is only
+ * built once rather than after inserting each placement.
+ */
+static List *
+CreatedShardPlacementList(Oid relationId)
+{
+	List *shardPlacementList = NIL;
+	List *shardIntervalList = LoadShardIntervalList(relationId);
+
+	ShardInterval *shardInterval = NULL;
+	foreach_ptr(shardInterval, shardIntervalList)
+	{
+		List *placementList = ShardPlacementList(shardInterval->shardId);
+		shardPlacementList = list_concat(shardPlacementList, placementList);
+	}
+
+	return shardPlacementList;
+}
+
+
 /*
  * CheckHashPartitionedTable looks up the partition information for the given
  * tableId and checks if the table is hash partitioned. If not, the function
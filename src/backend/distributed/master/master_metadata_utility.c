@@ -48,6 +48,7 @@
 #include "distributed/relay_utility.h"
 #include "distributed/resource_lock.h"
 #include "distributed/remote_commands.h"
+#include "distributed/tuplestore.h"
 #include "distributed/worker_manager.h"
 #include "distributed/worker_protocol.h"
 #include "distributed/version_compat.h"
@@ -71,8 +72,13 @@ static void RecordDistributedRelationDependencies(Oid distributedRelationId,
 static GroupShardPlacement * TupleToGroupShardPlacement(TupleDesc tupleDesc,
 														HeapTuple heapTuple);
 static uint64 DistributedTableSize(Oid relationId, char *sizeQuery);
-static uint64 DistributedTableSizeOnWorker(WorkerNode *workerNode, Oid relationId,
-										   char *sizeQuery);
+static uint64 * DistributedTableSizeList(List *relationIdList, List *sizeQueryList);
+static StringInfo GenerateSizeQueryOnWorker(WorkerNode *workerNode, List *relationIdList,
+											List *sizeQueryList);
+static void AppendSizeQueryOnMultiplePlacements(StringInfo selectQuery,
+												List *shardIntervalList,
+												char *sizeQuery);
+static char * RelationSizeFunction(Oid relationId, char *sizeQuery);
 static List * ShardIntervalsOnWorkerGroup(WorkerNode *workerNode, Oid relationId);
 static void ErrorIfNotSuitableToGetSize(Oid relationId);
 static ShardPlacement * ShardPlacementOnGroup(uint64 shardId, int groupId);
@@ -82,6 +88,7 @@ static ShardPlacement * ShardPlacementOnGroup(uint64 shardId, int groupId);
 PG_FUNCTION_INFO_V1(citus_table_size);
 PG_FUNCTION_INFO_V1(citus_total_relation_size);
 PG_FUNCTION_INFO_V1(citus_relation_size);
+PG_FUNCTION_INFO_V1(citus_table_sizes);
 
 
 /*
@@ -96,11 +103,6 @@ citus_total_relation_size(PG_FUNCTION_ARGS)
 
 	CheckCitusVersion(ERROR);
 
-	if (CStoreTable(relationId))
-	{
-		tableSizeFunction = CSTORE_TABLE_SIZE_FUNCTION;
-	}
-
 	uint64 totalRelationSize = DistributedTableSize(relationId, tableSizeFunction);
 
 	PG_RETURN_INT64(totalRelationSize);
@@ -119,11 +121,6 @@ citus_table_size(PG_FUNCTION_ARGS)
 
 	CheckCitusVersion(ERROR);
 
-	if (CStoreTable(relationId))
-	{
-		tableSizeFunction = CSTORE_TABLE_SIZE_FUNCTION;
-	}
-
 	uint64 tableSize = DistributedTableSize(relationId, tableSizeFunction);
 
 	PG_RETURN_INT64(tableSize);
@@ -142,26 +139,104 @@ citus_relation_size(PG_FUNCTION_ARGS)
 
 	CheckCitusVersion(ERROR);
 
-	if (CStoreTable(relationId))
+	uint64 relationSize = DistributedTableSize(relationId, tableSizeFunction);
+
+	PG_RETURN_INT64(relationSize);
+}
+
+
+/*
+ * citus_table_sizes accepts an array of tables and returns the relation size,
+ * table size and total relation size of each of them. The sizes of all the
+ * tables are fetched with a single query on each node, and the nodes are
+ * queried concurrently, such that monitoring many tables does not take a round
+ * trip per table and node.
+ */
+Datum
+citus_table_sizes(PG_FUNCTION_ARGS)
+{
+	ArrayType *relationIdArrayObject = PG_GETARG_ARRAYTYPE_P(0);
+	List *relationIdList = NIL;
+	List *sizeQueryList = NIL;
+	TupleDesc tupleDescriptor = NULL;
+
+	CheckCitusVersion(ERROR);
+
+	int relationCount = ArrayObjectCount(relationIdArrayObject);
+	Datum *relationIdDatumArray = DeconstructArrayObject(relationIdArrayObject);
+
+	for (int relationIndex = 0; relationIndex < relationCount; relationIndex++)
 	{
-		tableSizeFunction = CSTORE_TABLE_SIZE_FUNCTION;
+		Oid relationId = DatumGetObjectId(relationIdDatumArray[relationIndex]);
+
+		/* one size per column of the result, in the same order */
+		relationIdList = lappend_oid(relationIdList, relationId);
+		sizeQueryList = lappend(sizeQueryList, PG_RELATION_SIZE_FUNCTION);
+		relationIdList = lappend_oid(relationIdList, relationId);
+		sizeQueryList = lappend(sizeQueryList, PG_TABLE_SIZE_FUNCTION);
+		relationIdList = lappend_oid(relationIdList, relationId);
+		sizeQueryList = lappend(sizeQueryList, PG_TOTAL_RELATION_SIZE_FUNCTION);
 	}
 
-	uint64 relationSize = DistributedTableSize(relationId, tableSizeFunction);
+	uint64 *sizeArray = DistributedTableSizeList(relationIdList, sizeQueryList);
 
-	PG_RETURN_INT64(relationSize);
+	Tuplestorestate *tupleStore = SetupTuplestore(fcinfo, &tupleDescriptor);
+
+	for (int relationIndex = 0; relationIndex < relationCount; relationIndex++)
+	{
+		Datum values[4];
+		bool isNulls[4];
+		int sizeIndex = relationIndex * 3;
+
+		memset(values, 0, sizeof(values));
+		memset(isNulls, false, sizeof(isNulls));
+
+		values[0] = relationIdDatumArray[relationIndex];
+		values[1] = Int64GetDatum(sizeArray[sizeIndex]);
+		values[2] = Int64GetDatum(sizeArray[sizeIndex + 1]);
+		values[3] = Int64GetDatum(sizeArray[sizeIndex + 2]);
+
+		tuplestore_putvalues(tupleStore, tupleDescriptor, values, isNulls);
+	}
+
+	/* clean up and return the tuplestore */
+	tuplestore_donestoring(tupleStore);
+
+	PG_RETURN_VOID();
 }
 
 
 /*
  * DistributedTableSize is helper function for each kind of citus size functions.
- * It first checks whether the table is distributed and size query can be run on
- * it. Connection to each node has to be established to get the size of the table.
+ * It returns the size of a single table, see DistributedTableSizeList.
  */
 static uint64
 DistributedTableSize(Oid relationId, char *sizeQuery)
 {
-	uint64 totalRelationSize = 0;
+	uint64 *sizeArray = DistributedTableSizeList(list_make1_oid(relationId),
+												 list_make1(sizeQuery));
+
+	return sizeArray[0];
+}
+
+
+/*
+ * DistributedTableSizeList returns an array with the size of each table in
+ * relationIdList, computed by the size function in the same position of
+ * sizeQueryList. It first checks whether the tables are distributed and size
+ * queries can be run on them. A connection to each node has to be established
+ * to get the sizes. All nodes receive their query before we wait for any of
+ * the results, such that the nodes compute the sizes concurrently.
+ */
+static uint64 *
+DistributedTableSizeList(List *relationIdList, List *sizeQueryList)
+{
+	List *relationList = NIL;
+	List *connectionList = NIL;
+	List *queryList = NIL;
+	uint32 connectionFlag = 0;
+	bool raiseInterrupts = true;
+	bool raiseErrors = true;
 
 	if (XactModificationLevel == XACT_MODIFICATION_DATA)
 	{
@@ -170,71 +245,148 @@ DistributedTableSize(Oid relationId, char *sizeQuery)
 							   " blocks which contain multi-shard data modifications")));
 	}
 
-	Relation relation = try_relation_open(relationId, AccessShareLock);
+	uint64 *sizeArray = palloc0(Max(list_length(relationIdList), 1) * sizeof(uint64));
 
-	if (relation == NULL)
+	Oid relationId = InvalidOid;
+	foreach_oid(relationId, relationIdList)
 	{
-		ereport(ERROR,
-				(errmsg("could not compute table size: relation does not exist")));
+		Relation relation = try_relation_open(relationId, AccessShareLock);
+
+		if (relation == NULL)
+		{
+			ereport(ERROR,
+					(errmsg("could not compute table size: relation does not exist")));
+		}
+
+		ErrorIfNotSuitableToGetSize(relationId);
+
+		relationList = lappend(relationList, relation);
 	}
 
-	ErrorIfNotSuitableToGetSize(relationId);
+	if (relationIdList == NIL)
+	{
+		return sizeArray;
+	}
 
 	List *workerNodeList = ActiveReadableNodeList();
 	WorkerNode *workerNode = NULL;
 	foreach_ptr(workerNode, workerNodeList)
 	{
-		uint64 relationSizeOnNode = DistributedTableSizeOnWorker(workerNode, relationId,
-																 sizeQuery);
-		totalRelationSize += relationSizeOnNode;
+		StringInfo tableSizeQuery = GenerateSizeQueryOnWorker(workerNode, relationIdList,
+															  sizeQueryList);
+		MultiConnection *connection = StartNodeConnection(connectionFlag,
+														  workerNode->workerName,
+														  workerNode->workerPort);
+
+		connectionList = lappend(connectionList, connection);
+		queryList = lappend(queryList, tableSizeQuery->data);
+	}
+
+	FinishConnectionListEstablishment(connectionList);
+
+	ListCell *connectionCell = NULL;
+	ListCell *queryCell = NULL;
+	forboth(connectionCell, connectionList, queryCell, queryList)
+	{
+		MultiConnection *connection = (MultiConnection *) lfirst(connectionCell);
+		char *tableSizeQuery = (char *) lfirst(queryCell);
+
+		if (SendRemoteCommand(connection, tableSizeQuery) == 0)
+		{
+			ReportConnectionError(connection, WARNING);
+			ereport(ERROR, (errcode(ERRCODE_CONNECTION_FAILURE),
+							errmsg("cannot get the size because of a connection error")));
+		}
+	}
+
+	if (list_length(connectionList) > 1)
+	{
+		WaitForAllConnections(connectionList, raiseInterrupts);
+	}
+
+	MultiConnection *connection = NULL;
+	foreach_ptr(connection, connectionList)
+	{
+		PGresult *result = GetRemoteCommandResult(connection, raiseInterrupts);
+		if (!IsResponseOK(result) || PQntuples(result) != 1 ||
+			PQnfields(result) != list_length(relationIdList))
+		{
+			ReportResultError(connection, result, WARNING);
+			PQclear(result);
+
+			ereport(ERROR, (errcode(ERRCODE_CONNECTION_FAILURE),
+							errmsg("cannot get the size because of a connection error")));
+		}
+
+		for (int sizeIndex = 0; sizeIndex < list_length(relationIdList); sizeIndex++)
+		{
+			char *tableSizeString = PQgetvalue(result, 0, sizeIndex);
+			sizeArray[sizeIndex] += SafeStringToUint64(tableSizeString);
+		}
+
+		PQclear(result);
+		ClearResults(connection, raiseErrors);
 	}
 
-	heap_close(relation, AccessShareLock);
+	Relation relation = NULL;
+	foreach_ptr(relation, relationList)
+	{
+		heap_close(relation, AccessShareLock);
+	}
 
-	return totalRelationSize;
+	return sizeArray;
 }
 
 
 /*
- * DistributedTableSizeOnWorker gets the workerNode and relationId to calculate
- * size of that relation on the given workerNode by summing up the size of each
- * shard placement.
+ * GenerateSizeQueryOnWorker generates a query that returns a single row with a
+ * column for each table in relationIdList, containing the sum of the sizes of
+ * the shard placements of the table on the given node, computed by the size
+ * function in the same position of sizeQueryList.
  */
-static uint64
-DistributedTableSizeOnWorker(WorkerNode *workerNode, Oid relationId, char *sizeQuery)
+static StringInfo
+GenerateSizeQueryOnWorker(WorkerNode *workerNode, List *relationIdList,
+						  List *sizeQueryList)
 {
-	char *workerNodeName = workerNode->workerName;
-	uint32 workerNodePort = workerNode->workerPort;
-	uint32 connectionFlag = 0;
-	PGresult *result = NULL;
-	bool raiseErrors = true;
+	StringInfo selectQuery = makeStringInfo();
 
-	List *shardIntervalsOnNode = ShardIntervalsOnWorkerGroup(workerNode, relationId);
+	appendStringInfo(selectQuery, "SELECT ");
 
-	StringInfo tableSizeQuery = GenerateSizeQueryOnMultiplePlacements(
-		shardIntervalsOnNode,
-		sizeQuery);
+	ListCell *relationIdCell = NULL;
+	ListCell *sizeQueryCell = NULL;
+	forboth(relationIdCell, relationIdList, sizeQueryCell, sizeQueryList)
+	{
+		Oid relationId = lfirst_oid(relationIdCell);
+		char *sizeQuery = RelationSizeFunction(relationId, lfirst(sizeQueryCell));
+		List *shardIntervalsOnNode = ShardIntervalsOnWorkerGroup(workerNode, relationId);
 
-	MultiConnection *connection = GetNodeConnection(connectionFlag, workerNodeName,
-													workerNodePort);
-	int queryResult = ExecuteOptionalRemoteCommand(connection, tableSizeQuery->data,
-												   &result);
+		if (relationIdCell != list_head(relationIdList))
+		{
+			appendStringInfo(selectQuery, ", ");
+		}
 
-	if (queryResult != 0)
-	{
-		ereport(ERROR, (errcode(ERRCODE_CONNECTION_FAILURE),
-						errmsg("cannot get the size because of a connection error")));
+		AppendSizeQueryOnMultiplePlacements(selectQuery, shardIntervalsOnNode, sizeQuery);
 	}
 
-	List *sizeList = ReadFirstColumnAsText(result);
-	StringInfo tableSizeStringInfo = (StringInfo) linitial(sizeList);
-	char *tableSizeString = tableSizeStringInfo->data;
-	uint64 tableSize = SafeStringToUint64(tableSizeString);
+	appendStringInfo(selectQuery, ";");
+
+	return selectQuery;
+}
+
 
-	PQclear(result);
-	ClearResults(connection, raiseErrors);
+/*
+ * RelationSizeFunction returns the size function to use for the given table,
+ * which is the given size function unless the table is a cstore table.
+ */
+static char *
+RelationSizeFunction(Oid relationId, char *sizeQuery)
+{
+	if (CStoreTable(relationId))
+	{
+		return CSTORE_TABLE_SIZE_FUNCTION;
+	}
 
-	return tableSize;
+	return sizeQuery;
 }
 
 
@@ -338,7 +490,21 @@ GenerateSizeQueryOnMultiplePlacements(List *shardIntervalList, char *sizeQuery)
 	StringInfo selectQuery = makeStringInfo();
 
 	appendStringInfo(selectQuery, "SELECT ");
+	AppendSizeQueryOnMultiplePlacements(selectQuery, shardIntervalList, sizeQuery);
+	appendStringInfo(selectQuery, ";");
 
+	return selectQuery;
+}
+
+
+/*
+ * AppendSizeQueryOnMultiplePlacements appends an expression that sums up the
+ * sizes of the given shards to selectQuery.
+ */
+static void
+AppendSizeQueryOnMultiplePlacements(StringInfo selectQuery, List *shardIntervalList,
+									char *sizeQuery)
+{
 	ShardInterval *shardInterval = NULL;
 	foreach_ptr(shardInterval, shardIntervalList)
 	{
@@ -359,9 +525,7 @@ GenerateSizeQueryOnMultiplePlacements(List *shardIntervalList, char *sizeQuery)
 	 * Add 0 as a last size, it handles empty list case and makes size control checks
 	 * unnecessary which would have implemented without this line.
 	 */
-	appendStringInfo(selectQuery, "0;");
-
-	return selectQuery;
+	appendStringInfo(selectQuery, "0");
 }
 
 
@@ -641,6 +805,41 @@ ShardLength(uint64 shardId)
 }
 
 
+/*
+ * RelationSizeFromShardStatistics sets relationSize to the total size of the
+ * shards of the given table as recorded in pg_dist_placement, which is kept up
+ * to date for append-distributed tables and by master_update_shard_statistics().
+ * Reference tables are never repartitioned and are counted as empty. The
+ * function returns false if no size is recorded for a distributed table.
+ */
+bool
+RelationSizeFromShardStatistics(Oid relationId, uint64 *relationSize)
+{
+	CitusTableCacheEntry *cacheEntry = GetCitusTableCacheEntry(relationId);
+
+	*relationSize = 0;
+
+	if (cacheEntry->partitionMethod == DISTRIBUTE_BY_NONE)
+	{
+		return true;
+	}
+
+	for (int shardIndex = 0; shardIndex < cacheEntry->shardIntervalArrayLength;
+		 shardIndex++)
+	{
+		if (cacheEntry->arrayOfPlacementArrayLengths[shardIndex] > 0)
+		{
+			GroupShardPlacement *placementArray =
+				cacheEntry->arrayOfPlacementArrays[shardIndex];
+
+			*relationSize += placementArray[0].shardLength;
+		}
+	}
+
+	return *relationSize > 0;
+}
+
+
 /*
  * NodeGroupHasShardPlacements returns whether any active shards are placed on the group
  */
@@ -781,6 +980,54 @@ BuildShardPlacementList(ShardInterval *shardInterval)
 }
 
 
+/*
+ * BuildShardPlacementListForShardRange finds the shard placements of all shards
+ * with an identifier between the given bounds with a single index scan, and
+ * returns them in their in-memory representation in a new list.
+ *
+ * Like BuildShardPlacementList, this should only be called from
+ * metadata_cache.c.
+ */
+List *
+BuildShardPlacementListForShardRange(uint64 minShardId, uint64 maxShardId)
+{
+	List *shardPlacementList = NIL;
+	ScanKeyData scanKey[2];
+	int scanKeyCount = 2;
+	bool indexOK = true;
+
+	Relation pgPlacement = heap_open(DistPlacementRelationId(), AccessShareLock);
+
+	ScanKeyInit(&scanKey[0], Anum_pg_dist_placement_shardid,
+				BTGreaterEqualStrategyNumber, F_INT8GE, Int64GetDatum(minShardId));
+	ScanKeyInit(&scanKey[1], Anum_pg_dist_placement_shardid,
+				BTLessEqualStrategyNumber, F_INT8LE, Int64GetDatum(maxShardId));
+
+	SysScanDesc scanDescriptor = systable_beginscan(pgPlacement,
+													DistPlacementShardidIndexId(),
+													indexOK,
+													NULL, scanKeyCount, scanKey);
+
+	HeapTuple heapTuple = systable_getnext(scanDescriptor);
+	while (HeapTupleIsValid(heapTuple))
+	{
+		TupleDesc tupleDescriptor = RelationGetDescr(pgPlacement);
+
+		GroupShardPlacement *placement =
+			TupleToGroupShardPlacement(tupleDescriptor, heapTuple);
+
+		shardPlacementList = lappend(shardPlacementList, placement);
+
+		heapTuple = systable_getnext(scanDescriptor);
+	}
+
+	systable_endscan(scanDescriptor);
+	heap_close(pgPlacement, NoLock);
+
+	return shardPlacementList;
+}
+
+
 /*
  * BuildShardPlacementListForGroup finds shard placements for the given groupId
  * from system catalogs, converts these placements to their in-memory
@@ -1312,6 +1559,64 @@ UpdateShardPlacementState(uint64 placementId, char shardState)
 }
 
 
+/*
+ * UpdateShardPlacementLength sets the shardLength for the placement identified
+ * by placementId.
+ */
+void
+UpdateShardPlacementLength(uint64 placementId, uint64 shardLength)
+{
+	ScanKeyData scanKey[1];
+	int scanKeyCount = 1;
+	bool indexOK = true;
+	Datum values[Natts_pg_dist_placement];
+	bool isnull[Natts_pg_dist_placement];
+	bool replace[Natts_pg_dist_placement];
+	bool colIsNull = false;
+
+	Relation pgDistPlacement = heap_open(DistPlacementRelationId(), RowExclusiveLock);
+	TupleDesc tupleDescriptor = RelationGetDescr(pgDistPlacement);
+	ScanKeyInit(&scanKey[0], Anum_pg_dist_placement_placementid,
+				BTEqualStrategyNumber, F_INT8EQ, Int64GetDatum(placementId));
+
+	SysScanDesc scanDescriptor = systable_beginscan(pgDistPlacement,
+													DistPlacementPlacementidIndexId(),
+													indexOK,
+													NULL, scanKeyCount, scanKey);
+
+	HeapTuple heapTuple = systable_getnext(scanDescriptor);
+	if (!HeapTupleIsValid(heapTuple))
+	{
+		/* the placement was removed since we read the metadata */
+		systable_endscan(scanDescriptor);
+		heap_close(pgDistPlacement, NoLock);
+
+		return;
+	}
+
+	memset(replace, 0, sizeof(replace));
+
+	values[Anum_pg_dist_placement_shardlength - 1] = Int64GetDatum(shardLength);
+	isnull[Anum_pg_dist_placement_shardlength - 1] = false;
+	replace[Anum_pg_dist_placement_shardlength - 1] = true;
+
+	heapTuple = heap_modify_tuple(heapTuple, tupleDescriptor, values, isnull, replace);
+
+	CatalogTupleUpdate(pgDistPlacement, &heapTuple->t_self, heapTuple);
+
+	uint64 shardId = DatumGetInt64(heap_getattr(heapTuple,
+												Anum_pg_dist_placement_shardid,
+												tupleDescriptor, &colIsNull));
+	Assert(!colIsNull);
+	CitusInvalidateRelcacheByShardId(shardId);
+
+	CommandCounterIncrement();
+
+	systable_endscan(scanDescriptor);
+	heap_close(pgDistPlacement, NoLock);
+}
+
+
 /*
  * Check that the current user has `mode` permissions on relationId, error out
  * if not. Superusers always have such permissions.
@@ -18,16 +18,20 @@
 #include <string.h>
 
 #include "catalog/pg_class.h"
+#include "distributed/adaptive_executor.h"
 #include "distributed/colocation_utils.h"
 #include "distributed/commands.h"
 #include "distributed/connection_management.h"
+#include "distributed/deparse_shard_query.h"
 #include "distributed/distributed_planner.h"
 #include "distributed/listutils.h"
+#include "distributed/logical_replication.h"
 #include "distributed/master_protocol.h"
 #include "distributed/metadata_cache.h"
 #include "distributed/metadata_sync.h"
 #include "distributed/multi_join_order.h"
 #include "distributed/multi_partitioning_utils.h"
+#include "distributed/reference_table_utils.h"
 #include "distributed/resource_lock.h"
 #include "distributed/worker_manager.h"
 #include "distributed/worker_protocol.h"
@@ -48,6 +52,10 @@
 #define TRANSFER_MODE_BLOCK_WRITES 'b'
 
 
+/* GUC, number of connections that copy the data and build the indexes of a shard */
+int ShardCopyParallelism = 1;
+
+
 /* local function forward declarations */
 static char LookupShardTransferMode(Oid shardReplicationModeOid);
 static void RepairShardPlacement(int64 shardId, const char *sourceNodeName,
@@ -59,6 +67,25 @@ static List * CopyPartitionShardsCommandList(ShardInterval *shardInterval,
 static void EnsureShardCanBeRepaired(int64 shardId, const char *sourceNodeName,
 									 int32 sourceNodePort, const char *targetNodeName,
 									 int32 targetNodePort);
+static void EnsureShardCanBeMoved(List *colocatedShardList, const char *sourceNodeName,
+								  int32 sourceNodePort, const char *targetNodeName,
+								  int32 targetNodePort);
+static bool ColocatedShardsCanBeReplicatedLogically(List *colocatedShardList);
+static void CreateShardsOnTargetNode(List *colocatedShardList, char *sourceNodeName,
+									 int32 sourceNodePort, char *targetNodeName,
+									 int32 targetNodePort, bool includeData);
+static void UpdateColocatedShardPlacementMetadata(List *colocatedShardList,
+												  char *sourceNodeName,
+												  int32 sourceNodePort,
+												  int32 targetGroupId);
+static void DropColocatedShardsOnSourceNode(List *colocatedShardList,
+											char *sourceNodeName,
+											int32 sourceNodePort);
+static void CopyShardsInParallel(List *shardIntervalList, const char *sourceNodeName,
+								 int32 sourceNodePort, const char *targetNodeName,
+								 int32 targetNodePort, const char *tableOwner);
+static Task * ShardCopyTask(WorkerNode *targetNode, uint64 shardId, int taskId,
+							char *command);
 static List * RecreateTableDDLCommandList(Oid relationId);
 static List * WorkerApplyShardDDLCommandList(List *ddlCommandList, int64 shardId);
 
@@ -109,6 +136,8 @@ master_copy_shard_placement(PG_FUNCTION_ARGS)
 	EnsureCoordinator();
 	CheckCitusVersion(ERROR);
 
+	EnsureReferenceTablesExistOnAllNodes();
+
 	/* RepairShardPlacement function repairs only given shard */
 	RepairShardPlacement(shardId, sourceNodeName, sourceNodePort, targetNodeName,
 						 targetNodePort);
@@ -120,13 +149,289 @@ master_copy_shard_placement(PG_FUNCTION_ARGS)
 /*
  * master_move_shard_placement moves given shard (and its co-located shards) from one
  * node to the other node.
+ *
+ * By default, the shards are copied using logical replication, such that writes
+ * are only blocked while the target node catches up with the last changes.
+ * Tables without a replica identity cannot be replicated logically, since
+ * UPDATE and DELETE commands on them would fail on the source node. Those can
+ * be moved using the block_writes mode, which blocks writes to the shards
+ * during the entire copy.
  */
 Datum
 master_move_shard_placement(PG_FUNCTION_ARGS)
 {
-	ereport(ERROR, (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
-					errmsg("master_move_shard_placement() is only supported on "
-						   "Citus Enterprise")));
+	int64 shardId = PG_GETARG_INT64(0);
+	text *sourceNodeNameText = PG_GETARG_TEXT_P(1);
+	int32 sourceNodePort = PG_GETARG_INT32(2);
+	text *targetNodeNameText = PG_GETARG_TEXT_P(3);
+	int32 targetNodePort = PG_GETARG_INT32(4);
+	Oid shardReplicationModeOid = PG_GETARG_OID(5);
+	char shardReplicationMode = LookupShardTransferMode(shardReplicationModeOid);
+
+	char *sourceNodeName = text_to_cstring(sourceNodeNameText);
+	char *targetNodeName = text_to_cstring(targetNodeNameText);
+
+	EnsureCoordinator();
+	CheckCitusVersion(ERROR);
+
+	/* the shards may be joined with reference tables on the target node */
+	EnsureReferenceTablesExistOnAllNodes();
+
+	ShardInterval *shardInterval = LoadShardInterval(shardId);
+	Oid distributedTableId = shardInterval->relationId;
+
+	/*
+	 * Prevent the colocated tables from being dropped or altered, and concurrent
+	 * moves of the same shards. We sort the tables to avoid deadlocks.
+	 */
+	List *colocatedTableList = ColocatedTableList(distributedTableId);
+	colocatedTableList = SortList(colocatedTableList, CompareOids);
+
+	Oid colocatedTableId = InvalidOid;
+	foreach_oid(colocatedTableId, colocatedTableList)
+	{
+		LockRelationOid(colocatedTableId, ShareUpdateExclusiveLock);
+
+		EnsureTableOwner(colocatedTableId);
+	}
+
+	List *colocatedShardList = ColocatedShardIntervalList(shardInterval);
+
+	EnsureShardCanBeMoved(colocatedShardList, sourceNodeName, sourceNodePort,
+						  targetNodeName, targetNodePort);
+
+	WorkerNode *targetNode = ForceFindWorkerNode(targetNodeName, targetNodePort);
+
+	bool useLogicalReplication = shardReplicationMode != TRANSFER_MODE_BLOCK_WRITES;
+	if (shardReplicationMode == TRANSFER_MODE_AUTOMATIC &&
+		!ColocatedShardsCanBeReplicatedLogically(colocatedShardList))
+	{
+		ereport(ERROR, (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+						errmsg("cannot use logical replication to move shards of "
+							   "tables without a replica identity"),
+						errdetail("UPDATE and DELETE commands on the shard will "
+								  "error out during logical replication unless "
+								  "there is a REPLICA IDENTITY or PRIMARY KEY."),
+						errhint("Use shard_transfer_mode := 'block_writes' to "
+								"block writes during the move instead.")));
+	}
+
+	EnsureNoModificationsHaveBeenDone();
+
+	if (!useLogicalReplication)
+	{
+		/* DANGER: writes are blocked until the end of the transaction */
+		BlockWritesToShardList(colocatedShardList);
+	}
+
+	/* logical replication copies the data into the shards and their indexes */
+	bool includeData = !useLogicalReplication;
+	CreateShardsOnTargetNode(colocatedShardList, sourceNodeName, sourceNodePort,
+							 targetNodeName, targetNodePort, includeData);
+
+	if (useLogicalReplication)
+	{
+		/* blocks writes for the last part of the replication */
+		LogicallyReplicateShards(colocatedShardList, sourceNodeName, sourceNodePort,
+								 targetNodeName, targetNodePort);
+	}
+
+	UpdateColocatedShardPlacementMetadata(colocatedShardList, sourceNodeName,
+										  sourceNodePort, targetNode->groupId);
+
+	DropColocatedShardsOnSourceNode(colocatedShardList, sourceNodeName,
+									sourceNodePort);
+
+	PG_RETURN_VOID();
+}
+
+
+/*
+ * EnsureShardCanBeMoved checks whether the given colocated shards have an
+ * active placement on the source node and no placement on the target node,
+ * and whether their tables can be moved at all.
+ */
+static void
+EnsureShardCanBeMoved(List *colocatedShardList, const char *sourceNodeName,
+					  int32 sourceNodePort, const char *targetNodeName,
+					  int32 targetNodePort)
+{
+	ShardInterval *colocatedShard = NULL;
+	foreach_ptr(colocatedShard, colocatedShardList)
+	{
+		Oid relationId = colocatedShard->relationId;
+		char *relationName = get_rel_name(relationId);
+
+		if (PartitionMethod(relationId) == DISTRIBUTE_BY_NONE)
+		{
+			ereport(ERROR, (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+							errmsg("cannot move shard"),
+							errdetail("Table %s is a reference table. Reference "
+									  "tables are replicated to all nodes.",
+									  relationName)));
+		}
+
+		if (get_rel_relkind(relationId) == RELKIND_FOREIGN_TABLE)
+		{
+			ereport(ERROR, (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+							errmsg("cannot move shard"),
+							errdetail("Table %s is a foreign table. Moving "
+									  "shards backed by foreign tables is "
+									  "not supported.", relationName)));
+		}
+
+		if (PartitionedTableNoLock(relationId) || PartitionTableNoLock(relationId))
+		{
+			ereport(ERROR, (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+							errmsg("cannot move shard"),
+							errdetail("Table %s is a partitioned table or a partition. "
+									  "Moving shards of partitioned tables is not "
+									  "supported.", relationName)));
+		}
+
+		List *placementList = ShardPlacementList(colocatedShard->shardId);
+
+		ShardPlacement *sourcePlacement =
+			ForceSearchShardPlacementInList(placementList, sourceNodeName,
+											sourceNodePort);
+		if (sourcePlacement->shardState != SHARD_STATE_ACTIVE)
+		{
+			ereport(ERROR, (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+							errmsg("source placement must be in active state")));
+		}
+
+		ShardPlacement *targetPlacement =
+			SearchShardPlacementInList(placementList, targetNodeName, targetNodePort);
+		if (targetPlacement != NULL)
+		{
+			ereport(ERROR, (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+							errmsg("shard " UINT64_FORMAT " already has a "
+										  "placement on the target node",
+										  colocatedShard->shardId)));
+		}
+	}
+}
+
+
+/*
+ * ColocatedShardsCanBeReplicatedLogically returns whether all tables of the
+ * given colocated shards have a replica identity.
+ */
+static bool
+ColocatedShardsCanBeReplicatedLogically(List *colocatedShardList)
+{
+	ShardInterval *colocatedShard = NULL;
+	foreach_ptr(colocatedShard, colocatedShardList)
+	{
+		if (!RelationCanBeReplicatedLogically(colocatedShard->relationId))
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+
+/*
+ * CreateShardsOnTargetNode creates the given colocated shards, their indexes
+ * and their foreign keys on the target node, optionally including their data.
+ *
+ * The foreign keys can be created before the data is replicated logically,
+ * since the subscription workers on the target node do not fire triggers.
+ */
+static void
+CreateShardsOnTargetNode(List *colocatedShardList, char *sourceNodeName,
+						 int32 sourceNodePort, char *targetNodeName,
+						 int32 targetNodePort, bool includeData)
+{
+	List *ddlCommandList = NIL;
+	List *foreignConstraintCommandList = NIL;
+	ShardInterval *firstShard = (ShardInterval *) linitial(colocatedShardList);
+	char *tableOwner = TableOwner(firstShard->relationId);
+
+	if (includeData && ShardCopyParallelism > 1)
+	{
+		CopyShardsInParallel(colocatedShardList, sourceNodeName, sourceNodePort,
+							 targetNodeName, targetNodePort, tableOwner);
+		return;
+	}
+
+	ShardInterval *colocatedShard = NULL;
+	foreach_ptr(colocatedShard, colocatedShardList)
+	{
+		List *copyCommandList = CopyShardCommandList(colocatedShard, sourceNodeName,
+													 sourceNodePort, includeData);
+		ddlCommandList = list_concat(ddlCommandList, copyCommandList);
+
+		/* colocated shards may reference each other, so create them last */
+		foreignConstraintCommandList =
+			list_concat(foreignConstraintCommandList,
+						CopyShardForeignConstraintCommandList(colocatedShard));
+	}
+
+	ddlCommandList = list_concat(ddlCommandList, foreignConstraintCommandList);
+
+	SendCommandListToWorkerInSingleTransaction(targetNodeName, targetNodePort,
+											   tableOwner, ddlCommandList);
+}
+
+
+/*
+ * UpdateColocatedShardPlacementMetadata moves the placements of the given
+ * colocated shards on the source node to the target group, keeping their
+ * placement ids, and propagates the change to workers with metadata.
+ */
+static void
+UpdateColocatedShardPlacementMetadata(List *colocatedShardList, char *sourceNodeName,
+									  int32 sourceNodePort, int32 targetGroupId)
+{
+	ShardInterval *colocatedShard = NULL;
+	foreach_ptr(colocatedShard, colocatedShardList)
+	{
+		uint64 colocatedShardId = colocatedShard->shardId;
+		List *placementList = ShardPlacementList(colocatedShardId);
+		ShardPlacement *placement =
+			ForceSearchShardPlacementInList(placementList, sourceNodeName,
+											sourceNodePort);
+
+		DeleteShardPlacementRow(placement->placementId);
+		InsertShardPlacementRow(colocatedShardId, placement->placementId,
+								SHARD_STATE_ACTIVE, placement->shardLength,
+								targetGroupId);
+
+		if (ShouldSyncTableMetadata(colocatedShard->relationId))
+		{
+			char *placementCommand =
+				PlacementUpsertCommand(colocatedShardId, placement->placementId,
+									   SHARD_STATE_ACTIVE, placement->shardLength,
+									   targetGroupId);
+
+			SendCommandToWorkersWithMetadata(placementCommand);
+		}
+	}
+}
+
+
+/*
+ * DropColocatedShardsOnSourceNode drops the given colocated shards on the
+ * source node as part of the coordinated transaction, such that they are
+ * only dropped if the metadata changes commit.
+ */
+static void
+DropColocatedShardsOnSourceNode(List *colocatedShardList, char *sourceNodeName,
+								int32 sourceNodePort)
+{
+	ShardInterval *colocatedShard = NULL;
+	foreach_ptr(colocatedShard, colocatedShardList)
+	{
+		char *qualifiedShardName = ConstructQualifiedShardName(colocatedShard);
+		StringInfo dropCommand = makeStringInfo();
+
+		appendStringInfo(dropCommand, DROP_REGULAR_TABLE_COMMAND, qualifiedShardName);
+
+		SendCommandToWorker(sourceNodeName, sourceNodePort, dropCommand->data);
+	}
 }
 
 
@@ -276,42 +581,53 @@ RepairShardPlacement(int64 shardId, const char *sourceNodeName, int32 sourceNode
 	bool partitionedTable = PartitionedTableNoLock(distributedTableId);
 	bool includeData = !partitionedTable;
 
-	/* we generate necessary commands to recreate the shard in target node */
-	List *ddlCommandList =
-		CopyShardCommandList(shardInterval, sourceNodeName, sourceNodePort, includeData);
-	List *foreignConstraintCommandList = CopyShardForeignConstraintCommandList(
-		shardInterval);
-	ddlCommandList = list_concat(ddlCommandList, foreignConstraintCommandList);
-
-	/*
-	 * CopyShardCommandList() drops the table which cascades to partitions if the
-	 * table is a partitioned table. This means that we need to create both parent
-	 * table and its partitions.
-	 *
-	 * We also skipped copying the data, so include it here.
-	 */
-	if (partitionedTable)
+	if (!partitionedTable && ShardCopyParallelism > 1)
 	{
-		char *shardName = ConstructQualifiedShardName(shardInterval);
-		StringInfo copyShardDataCommand = makeStringInfo();
+		EnsureNoModificationsHaveBeenDone();
+		CopyShardsInParallel(list_make1(shardInterval), sourceNodeName,
+							 sourceNodePort, targetNodeName, targetNodePort,
+							 tableOwner);
+	}
+	else
+	{
+		/* we generate necessary commands to recreate the shard in target node */
+		List *ddlCommandList = CopyShardCommandList(shardInterval, sourceNodeName,
+													sourceNodePort, includeData);
+		List *foreignConstraintCommandList = CopyShardForeignConstraintCommandList(
+			shardInterval);
+		ddlCommandList = list_concat(ddlCommandList, foreignConstraintCommandList);
 
-		List *partitionCommandList =
-			CopyPartitionShardsCommandList(shardInterval, sourceNodeName, sourceNodePort);
-		ddlCommandList = list_concat(ddlCommandList, partitionCommandList);
+		/*
+		 * CopyShardCommandList() drops the table which cascades to partitions if the
+		 * table is a partitioned table. This means that we need to create both parent
+		 * table and its partitions.
+		 *
+		 * We also skipped copying the data, so include it here.
+		 */
+		if (partitionedTable)
+		{
+			char *shardName = ConstructQualifiedShardName(shardInterval);
+			StringInfo copyShardDataCommand = makeStringInfo();
+
+			List *partitionCommandList =
+				CopyPartitionShardsCommandList(shardInterval, sourceNodeName,
+											   sourceNodePort);
+			ddlCommandList = list_concat(ddlCommandList, partitionCommandList);
+
+			/* finally copy the data as well */
+			appendStringInfo(copyShardDataCommand, WORKER_APPEND_TABLE_TO_SHARD,
+							 quote_literal_cstr(shardName), /* table to append */
+							 quote_literal_cstr(shardName), /* remote table name */
+							 quote_literal_cstr(sourceNodeName), /* remote host */
+							 sourceNodePort); /* remote port */
+			ddlCommandList = lappend(ddlCommandList, copyShardDataCommand->data);
+		}
 
-		/* finally copy the data as well */
-		appendStringInfo(copyShardDataCommand, WORKER_APPEND_TABLE_TO_SHARD,
-						 quote_literal_cstr(shardName), /* table to append */
-						 quote_literal_cstr(shardName), /* remote table name */
-						 quote_literal_cstr(sourceNodeName), /* remote host */
-						 sourceNodePort); /* remote port */
-		ddlCommandList = lappend(ddlCommandList, copyShardDataCommand->data);
+		EnsureNoModificationsHaveBeenDone();
+		SendCommandListToWorkerInSingleTransaction(targetNodeName, targetNodePort,
+												   tableOwner, ddlCommandList);
 	}
 
-	EnsureNoModificationsHaveBeenDone();
-	SendCommandListToWorkerInSingleTransaction(targetNodeName, targetNodePort, tableOwner,
-											   ddlCommandList);
-
 	/* after successful repair, we update shard state as healthy*/
 	List *placementList = ShardPlacementList(shardId);
 	ShardPlacement *placement = ForceSearchShardPlacementInList(placementList,
@@ -482,6 +798,131 @@ CopyShardCommandList(ShardInterval *shardInterval, const char *sourceNodeName,
 }
 
 
+/*
+ * CopyShardsInParallel recreates the given shards on the target node and
+ * copies their data from the source node over citus.shard_copy_parallelism
+ * connections, each of which copies a range of the blocks of every shard.
+ * Once the data is copied, the indexes and constraints are built concurrently
+ * over the same number of connections, and finally the foreign keys are
+ * created.
+ *
+ * Unlike CopyShardCommandList, every step commits on its own, since the
+ * connections that copy the data need to see the created tables. If a step
+ * fails, the tables are left behind on the target node without a healthy
+ * placement, and are dropped when the copy is retried.
+ */
+static void
+CopyShardsInParallel(List *shardIntervalList, const char *sourceNodeName,
+					 int32 sourceNodePort, const char *targetNodeName,
+					 int32 targetNodePort, const char *tableOwner)
+{
+	List *createTableCommandList = NIL;
+	List *copyDataTaskList = NIL;
+	List *createIndexTaskList = NIL;
+	List *foreignConstraintCommandList = NIL;
+	int taskId = 1;
+
+	WorkerNode *targetNode = ForceFindWorkerNode(targetNodeName, targetNodePort);
+
+	ShardInterval *shardInterval = NULL;
+	foreach_ptr(shardInterval, shardIntervalList)
+	{
+		uint64 shardId = shardInterval->shardId;
+		Oid relationId = shardInterval->relationId;
+		char *shardName = ConstructQualifiedShardName(shardInterval);
+
+		List *tableRecreationCommandList = RecreateTableDDLCommandList(relationId);
+		tableRecreationCommandList =
+			WorkerApplyShardDDLCommandList(tableRecreationCommandList, shardId);
+		createTableCommandList = list_concat(createTableCommandList,
+											 tableRecreationCommandList);
+
+		for (int rangeIndex = 0; rangeIndex < ShardCopyParallelism; rangeIndex++)
+		{
+			StringInfo copyShardDataCommand = makeStringInfo();
+			appendStringInfo(copyShardDataCommand, WORKER_APPEND_TABLE_RANGE_TO_SHARD,
+							 quote_literal_cstr(shardName), /* table to append */
+							 quote_literal_cstr(shardName), /* remote table name */
+							 quote_literal_cstr(sourceNodeName), /* remote host */
+							 sourceNodePort, /* remote port */
+							 rangeIndex, ShardCopyParallelism);
+
+			Task *copyDataTask = ShardCopyTask(targetNode, shardId, taskId++,
+											   copyShardDataCommand->data);
+			copyDataTaskList = lappend(copyDataTaskList, copyDataTask);
+		}
+
+		List *indexCommandList = GetTableIndexAndConstraintCommands(relationId);
+		indexCommandList = WorkerApplyShardDDLCommandList(indexCommandList, shardId);
+
+		char *indexCommand = NULL;
+		foreach_ptr(indexCommand, indexCommandList)
+		{
+			Task *createIndexTask = ShardCopyTask(targetNode, shardId, taskId++,
+												  indexCommand);
+			createIndexTaskList = lappend(createIndexTaskList, createIndexTask);
+		}
+
+		/* colocated shards may reference each other, so create them last */
+		foreignConstraintCommandList =
+			list_concat(foreignConstraintCommandList,
+						CopyShardForeignConstraintCommandList(shardInterval));
+	}
+
+	SendCommandListToWorkerInSingleTransaction(targetNodeName, targetNodePort,
+											   tableOwner, createTableCommandList);
+
+	ExecuteTaskListOutsideTransaction(ROW_MODIFY_NONE, copyDataTaskList,
+									  ShardCopyParallelism, NIL);
+
+	/*
+	 * Each index build can itself use up to max_parallel_maintenance_workers
+	 * of the target node, so we only limit the number of concurrent builds.
+	 */
+	if (createIndexTaskList != NIL)
+	{
+		ExecuteTaskListOutsideTransaction(ROW_MODIFY_NONE, createIndexTaskList,
+										  ShardCopyParallelism, NIL);
+	}
+
+	if (foreignConstraintCommandList != NIL)
+	{
+		SendCommandListToWorkerInSingleTransaction(targetNodeName, targetNodePort,
+												   tableOwner,
+												   foreignConstraintCommandList);
+	}
+}
+
+
+/*
+ * ShardCopyTask returns a task that runs the given command of a shard copy on
+ * the target node.
+ */
+static Task *
+ShardCopyTask(WorkerNode *targetNode, uint64 shardId, int taskId, char *command)
+{
+	ShardPlacement *targetPlacement = CitusMakeNode(ShardPlacement);
+	targetPlacement->nodeName = targetNode->workerName;
+	targetPlacement->nodePort = targetNode->workerPort;
+	targetPlacement->nodeId = targetNode->nodeId;
+	targetPlacement->groupId = targetNode->groupId;
+	targetPlacement->shardId = shardId;
+
+	Task *task = CitusMakeNode(Task);
+	task->jobId = INVALID_JOB_ID;
+	task->taskId = taskId;
+	task->taskType = DDL_TASK;
+	SetTaskQueryString(task, command);
+	task->replicationModel = REPLICATION_MODEL_INVALID;
+	task->dependentTaskList = NIL;
+	task->anchorShardId = shardId;
+	task->relationShardList = NIL;
+	task->taskPlacementList = list_make1(targetPlacement);
+
+	return task;
+}
+
+
 /*
  * CopyShardForeignConstraintCommandList generates command list to create foreign
  * constraints existing in source shard after copying it to the other node.
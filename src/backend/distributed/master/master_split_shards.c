@@ -5,6 +5,15 @@
  * This file contains functions to split a shard according to a given
  * distribution column value.
  *
+ * A split replaces a hash shard, and the shards that are colocated with it,
+ * with shards that cover consecutive sub-ranges of its hash range. The new
+ * shards are created next to the placements of the original shards, filled
+ * from them, and then the original shards are dropped, all within the
+ * coordinated transaction that also updates the metadata. Writes to the shards
+ * are blocked while they are split, but reads continue on the original shards
+ * until the transaction commits. The new shards can be moved to other nodes
+ * afterwards using master_move_shard_placement.
+ *
  * Copyright (c) Citus Data, Inc.
  *
  *-------------------------------------------------------------------------
@@ -16,19 +25,26 @@
 
 #include "catalog/pg_class.h"
 #include "distributed/colocation_utils.h"
+#include "distributed/commands.h"
+#include "distributed/listutils.h"
+#include "distributed/master_metadata_utility.h"
 #include "distributed/master_protocol.h"
 #include "distributed/metadata_cache.h"
 #include "distributed/metadata_sync.h"
 #include "distributed/multi_join_order.h"
+#include "distributed/multi_partitioning_utils.h"
 #include "distributed/multi_router_planner.h"
 #include "distributed/pg_dist_partition.h"
 #include "distributed/pg_dist_shard.h"
+#include "distributed/reference_table_utils.h"
 #include "distributed/remote_commands.h"
 #include "distributed/resource_lock.h"
+#include "distributed/shardinterval_utils.h"
 #include "distributed/worker_manager.h"
 #include "distributed/worker_protocol.h"
 #include "distributed/worker_transaction.h"
 #include "nodes/pg_list.h"
+#include "storage/lmgr.h"
 #include "storage/lock.h"
 #include "utils/builtins.h"
 #include "utils/elog.h"
@@ -37,21 +53,523 @@
 #include "utils/typcache.h"
 
 
+/*
+ * ShardSplitRange is a sub-range of the hash range of a shard that is split.
+ */
+typedef struct ShardSplitRange
+{
+	int32 minValue;
+	int32 maxValue;
+} ShardSplitRange;
+
+
+static List * SplitShardGroup(ShardInterval *sourceShardInterval,
+							  List *splitRangeList);
+static void ErrorIfCannotSplitShardGroup(List *colocatedTableList,
+										 List *colocatedShardList);
+static List * CreateSplitShardsMetadata(ShardInterval *sourceShardInterval,
+										List *splitRangeList);
+static List * SplitShardCommandList(ShardInterval *sourceShardInterval,
+									List *splitShardIdList,
+									List *splitRangeList, bool foreignKeysOnly);
+static Datum TenantIdToDistributionValue(Datum tenantIdDatum, Oid tenantIdType,
+										 Oid distributionColumnType);
+
 /* declarations for dynamic loading */
 PG_FUNCTION_INFO_V1(isolate_tenant_to_new_shard);
+PG_FUNCTION_INFO_V1(master_split_shard);
 PG_FUNCTION_INFO_V1(worker_hash);
 
 
 /*
  * isolate_tenant_to_new_shard isolates a tenant to its own shard by spliting
- * the current matching shard.
+ * the current matching shard into the shard of the tenant's hash value and the
+ * shards of the hash values below and above it, for all colocated tables. It
+ * returns the id of the new shard of the given table that contains the tenant.
+ *
+ * SQL signature:
+ *
+ * isolate_tenant_to_new_shard(
+ *     table_name regclass,
+ *     tenant_id "any",
+ *     cascade_option text
+ * ) RETURNS bigint
  */
 Datum
 isolate_tenant_to_new_shard(PG_FUNCTION_ARGS)
 {
-	ereport(ERROR, (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
-					errmsg("isolate_tenant_to_new_shard() is only supported on "
-						   "Citus Enterprise")));
+	Oid relationId = PG_GETARG_OID(0);
+	Datum tenantIdDatum = PG_GETARG_DATUM(1);
+	char *cascadeOption = text_to_cstring(PG_GETARG_TEXT_P(2));
+	Oid tenantIdType = get_fn_expr_argtype(fcinfo->flinfo, 1);
+	List *splitRangeList = NIL;
+
+	CheckCitusVersion(ERROR);
+	EnsureCoordinator();
+
+	CitusTableCacheEntry *cacheEntry = GetCitusTableCacheEntry(relationId);
+	char *relationName = get_rel_name(relationId);
+
+	if (cacheEntry->partitionMethod != DISTRIBUTE_BY_HASH)
+	{
+		ereport(ERROR, (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+						errmsg("cannot isolate tenant because tenant isolation "
+							   "is only support for hash distributed tables")));
+	}
+
+	bool cascade = pg_strncasecmp(cascadeOption, "CASCADE", NAMEDATALEN) == 0;
+	if (!cascade && strlen(cascadeOption) > 0)
+	{
+		ereport(ERROR, (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+						errmsg("invalid cascade option \"%s\"", cascadeOption),
+						errhint("The only valid cascade option is CASCADE.")));
+	}
+
+	if (!cascade && list_length(ColocatedTableList(relationId)) > 1)
+	{
+		ereport(ERROR, (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+						errmsg("cannot isolate tenant because \"%s\" has colocated "
+							   "tables", relationName),
+						errhint("Use CASCADE option to isolate tenants for the "
+								"colocated tables too. Example usage: "
+								"isolate_tenant_to_new_shard('%s', "
+								"'<tenant_id>', 'CASCADE')", relationName)));
+	}
+
+	if (tenantIdType == InvalidOid)
+	{
+		ereport(ERROR, (errmsg("could not determine the type of the tenant id")));
+	}
+
+	Var *distributionColumn = cacheEntry->partitionColumn;
+	Datum tenantIdValue = TenantIdToDistributionValue(tenantIdDatum, tenantIdType,
+													  distributionColumn->vartype);
+	Datum hashedValueDatum = FunctionCall1Coll(cacheEntry->hashFunction,
+											   distributionColumn->varcollid,
+											   tenantIdValue);
+	int32 hashedValue = DatumGetInt32(hashedValueDatum);
+
+	int shardIndex = FindShardIntervalIndex(hashedValueDatum, cacheEntry);
+	if (shardIndex == INVALID_SHARD_INDEX)
+	{
+		ereport(ERROR, (errmsg("could not find the shard of the tenant in \"%s\"",
+							   relationName)));
+	}
+
+	uint64 sourceShardId = cacheEntry->sortedShardIntervalArray[shardIndex]->shardId;
+	ShardInterval *sourceShardInterval = LoadShardInterval(sourceShardId);
+	int32 shardMinValue = DatumGetInt32(sourceShardInterval->minValue);
+	int32 shardMaxValue = DatumGetInt32(sourceShardInterval->maxValue);
+
+	if (shardMinValue == hashedValue && shardMaxValue == hashedValue)
+	{
+		ereport(ERROR, (errmsg("table \"%s\" has already been isolated for the "
+							   "given value", relationName)));
+	}
+
+	/* the tenant's shard is the second range, unless it is the first */
+	int tenantRangeIndex = 0;
+
+	if (shardMinValue < hashedValue)
+	{
+		ShardSplitRange *lowerRange = palloc0(sizeof(ShardSplitRange));
+		lowerRange->minValue = shardMinValue;
+		lowerRange->maxValue = hashedValue - 1;
+
+		splitRangeList = lappend(splitRangeList, lowerRange);
+		tenantRangeIndex = 1;
+	}
+
+	ShardSplitRange *tenantRange = palloc0(sizeof(ShardSplitRange));
+	tenantRange->minValue = hashedValue;
+	tenantRange->maxValue = hashedValue;
+	splitRangeList = lappend(splitRangeList, tenantRange);
+
+	if (hashedValue < shardMaxValue)
+	{
+		ShardSplitRange *upperRange = palloc0(sizeof(ShardSplitRange));
+		upperRange->minValue = hashedValue + 1;
+		upperRange->maxValue = shardMaxValue;
+
+		splitRangeList = lappend(splitRangeList, upperRange);
+	}
+
+	List *splitShardList = SplitShardGroup(sourceShardInterval, splitRangeList);
+	ShardInterval *tenantShardInterval = list_nth(splitShardList, tenantRangeIndex);
+
+	PG_RETURN_INT64(tenantShardInterval->shardId);
+}
+
+
+/*
+ * master_split_shard splits the given hash shard, and the shards that are
+ * colocated with it, into the given number of shards with hash ranges of equal
+ * size.
+ *
+ * SQL signature:
+ *
+ * master_split_shard(
+ *     shard_id bigint,
+ *     split_count int
+ * ) RETURNS void
+ */
+Datum
+master_split_shard(PG_FUNCTION_ARGS)
+{
+	uint64 shardId = PG_GETARG_INT64(0);
+	int32 splitCount = PG_GETARG_INT32(1);
+	List *splitRangeList = NIL;
+
+	CheckCitusVersion(ERROR);
+	EnsureCoordinator();
+
+	ShardInterval *sourceShardInterval = LoadShardInterval(shardId);
+	Oid relationId = sourceShardInterval->relationId;
+
+	if (PartitionMethod(relationId) != DISTRIBUTE_BY_HASH)
+	{
+		ereport(ERROR, (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+						errmsg("cannot split shard " UINT64_FORMAT, shardId),
+						errdetail("Only shards of hash distributed tables can be "
+								  "split.")));
+	}
+
+	int64 shardMinValue = DatumGetInt32(sourceShardInterval->minValue);
+	int64 shardMaxValue = DatumGetInt32(sourceShardInterval->maxValue);
+	int64 hashRangeSize = shardMaxValue - shardMinValue + 1;
+
+	if (splitCount < 2 || splitCount > hashRangeSize)
+	{
+		ereport(ERROR, (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+						errmsg("split_count must be between 2 and the size of the "
+							   "hash range of the shard, " INT64_FORMAT,
+							   hashRangeSize)));
+	}
+
+	for (int rangeIndex = 0; rangeIndex < splitCount; rangeIndex++)
+	{
+		ShardSplitRange *splitRange = palloc0(sizeof(ShardSplitRange));
+		splitRange->minValue = (int32) (shardMinValue +
+										hashRangeSize * rangeIndex / splitCount);
+		splitRange->maxValue = (int32) (shardMinValue +
+										hashRangeSize * (rangeIndex + 1) / splitCount -
+										1);
+
+		splitRangeList = lappend(splitRangeList, splitRange);
+	}
+
+	SplitShardGroup(sourceShardInterval, splitRangeList);
+
+	PG_RETURN_VOID();
+}
+
+
+/*
+ * SplitShardGroup replaces the given shard and the shards that are colocated
+ * with it by shards that cover the given consecutive sub-ranges of its hash
+ * range, and returns the new shards of the given shard's table in range order.
+ *
+ * The metadata is changed first, such that the commands that create the new
+ * shards on the workers can look up the colocated new shards they reference.
+ * Both the metadata changes and the commands are part of the coordinated
+ * transaction, so a failure leaves the original shards in place.
+ */
+static List *
+SplitShardGroup(ShardInterval *sourceShardInterval, List *splitRangeList)
+{
+	Oid relationId = sourceShardInterval->relationId;
+	List *splitShardList = NIL;
+	List *splitShardIdListList = NIL;
+	List *sourcePlacementList = ShardPlacementList(sourceShardInterval->shardId);
+
+	/* prevent concurrent moves, splits and DDL on the colocated tables */
+	List *colocatedTableList = SortList(ColocatedTableList(relationId), CompareOids);
+
+	Oid colocatedTableId = InvalidOid;
+	foreach_oid(colocatedTableId, colocatedTableList)
+	{
+		LockRelationOid(colocatedTableId, ShareUpdateExclusiveLock);
+		EnsureTableOwner(colocatedTableId);
+	}
+
+	List *colocatedShardList = ColocatedShardIntervalList(sourceShardInterval);
+
+	ErrorIfCannotSplitShardGroup(colocatedTableList, colocatedShardList);
+
+	BlockWritesToShardList(colocatedShardList);
+
+	/* generate the commands that depend on the old metadata first */
+	List *metadataSyncCommandList = NIL;
+	bool shouldSyncMetadata = ShouldSyncTableMetadata(relationId);
+
+	ShardInterval *colocatedShard = NULL;
+	foreach_ptr(colocatedShard, colocatedShardList)
+	{
+		if (shouldSyncMetadata)
+		{
+			metadataSyncCommandList =
+				list_concat(metadataSyncCommandList,
+							ShardDeleteCommandList(colocatedShard));
+		}
+
+		List *splitShardIdList = CreateSplitShardsMetadata(colocatedShard,
+														   splitRangeList);
+		splitShardIdListList = lappend(splitShardIdListList, splitShardIdList);
+	}
+
+	/* create the new shards before the foreign keys between them */
+	List *splitCommandList = NIL;
+	List *foreignKeyCommandList = NIL;
+	List *dropCommandList = NIL;
+
+	ListCell *colocatedShardCell = NULL;
+	ListCell *splitShardIdListCell = NULL;
+	forboth(colocatedShardCell, colocatedShardList, splitShardIdListCell,
+			splitShardIdListList)
+	{
+		ShardInterval *colocatedShardInterval = lfirst(colocatedShardCell);
+		List *splitShardIdList = lfirst(splitShardIdListCell);
+		bool foreignKeysOnly = false;
+		StringInfo dropCommand = makeStringInfo();
+
+		splitCommandList =
+			list_concat(splitCommandList,
+						SplitShardCommandList(colocatedShardInterval, splitShardIdList,
+											  splitRangeList, foreignKeysOnly));
+
+		foreignKeysOnly = true;
+		foreignKeyCommandList =
+			list_concat(foreignKeyCommandList,
+						SplitShardCommandList(colocatedShardInterval, splitShardIdList,
+											  splitRangeList, foreignKeysOnly));
+
+		appendStringInfo(dropCommand, DROP_REGULAR_TABLE_COMMAND,
+						 ConstructQualifiedShardName(colocatedShardInterval));
+		dropCommandList = lappend(dropCommandList, dropCommand->data);
+
+		List *newShardIntervalList = NIL;
+		uint64 *splitShardId = NULL;
+		foreach_ptr(splitShardId, splitShardIdList)
+		{
+			ShardInterval *splitShardInterval = LoadShardInterval(*splitShardId);
+			newShardIntervalList = lappend(newShardIntervalList, splitShardInterval);
+
+			if (colocatedShardInterval->relationId == relationId)
+			{
+				splitShardList = lappend(splitShardList, splitShardInterval);
+			}
+		}
+
+		if (shouldSyncMetadata)
+		{
+			metadataSyncCommandList =
+				list_concat(metadataSyncCommandList,
+							ShardListInsertCommand(newShardIntervalList));
+		}
+	}
+
+	List *commandList = list_concat(splitCommandList, foreignKeyCommandList);
+	commandList = list_concat(commandList, dropCommandList);
+
+	ShardPlacement *sourcePlacement = NULL;
+	foreach_ptr(sourcePlacement, sourcePlacementList)
+	{
+		char *command = NULL;
+		foreach_ptr(command, commandList)
+		{
+			SendCommandToWorker(sourcePlacement->nodeName, sourcePlacement->nodePort,
+								command);
+		}
+	}
+
+	char *metadataSyncCommand = NULL;
+	foreach_ptr(metadataSyncCommand, metadataSyncCommandList)
+	{
+		SendCommandToWorkersWithMetadata(metadataSyncCommand);
+	}
+
+	return splitShardList;
+}
+
+
+/*
+ * ErrorIfCannotSplitShardGroup errors out if the given colocated shards cannot
+ * be split, which is the case for shards of partitioned and foreign tables and
+ * for shards with inactive placements.
+ */
+static void
+ErrorIfCannotSplitShardGroup(List *colocatedTableList, List *colocatedShardList)
+{
+	Oid colocatedTableId = InvalidOid;
+	foreach_oid(colocatedTableId, colocatedTableList)
+	{
+		char *relationName = get_rel_name(colocatedTableId);
+
+		if (PartitionedTable(colocatedTableId) || PartitionTable(colocatedTableId))
+		{
+			ereport(ERROR, (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+							errmsg("cannot split shards of partitioned table \"%s\"",
+								   relationName)));
+		}
+
+		if (get_rel_relkind(colocatedTableId) == RELKIND_FOREIGN_TABLE)
+		{
+			ereport(ERROR, (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+							errmsg("cannot split shards of foreign table \"%s\"",
+								   relationName)));
+		}
+	}
+
+	ShardInterval *colocatedShard = NULL;
+	foreach_ptr(colocatedShard, colocatedShardList)
+	{
+		uint64 shardId = colocatedShard->shardId;
+		List *placementList = ShardPlacementList(shardId);
+		List *activePlacementList = ActiveShardPlacementList(shardId);
+
+		if (list_length(activePlacementList) != list_length(placementList))
+		{
+			ereport(ERROR, (errcode(ERRCODE_OBJECT_NOT_IN_PREREQUISITE_STATE),
+							errmsg("cannot split shard " UINT64_FORMAT " because it "
+								   "has inactive placements", shardId),
+							errhint("Repair the placements using "
+									"master_copy_shard_placement() first.")));
+		}
+	}
+}
+
+
+/*
+ * CreateSplitShardsMetadata replaces the metadata of the given shard by the
+ * metadata of new shards for the given sub-ranges, with placements in the
+ * same groups as the placements of the given shard. It returns the ids of the
+ * new shards as a list of uint64 *.
+ */
+static List *
+CreateSplitShardsMetadata(ShardInterval *sourceShardInterval, List *splitRangeList)
+{
+	uint64 sourceShardId = sourceShardInterval->shardId;
+	List *sourcePlacementList = ShardPlacementList(sourceShardId);
+	List *splitShardIdList = NIL;
+
+	ShardSplitRange *splitRange = NULL;
+	foreach_ptr(splitRange, splitRangeList)
+	{
+		uint64 *splitShardId = palloc0(sizeof(uint64));
+		*splitShardId = GetNextShardId();
+
+		InsertShardRow(sourceShardInterval->relationId, *splitShardId,
+					   sourceShardInterval->storageType,
+					   IntegerToText(splitRange->minValue),
+					   IntegerToText(splitRange->maxValue));
+
+		ShardPlacement *sourcePlacement = NULL;
+		foreach_ptr(sourcePlacement, sourcePlacementList)
+		{
+			uint64 shardLength = 0;
+
+			InsertShardPlacementRow(*splitShardId, INVALID_PLACEMENT_ID,
+									SHARD_STATE_ACTIVE, shardLength,
+									sourcePlacement->groupId);
+		}
+
+		splitShardIdList = lappend(splitShardIdList, splitShardId);
+	}
+
+	ShardPlacement *sourcePlacement = NULL;
+	foreach_ptr(sourcePlacement, sourcePlacementList)
+	{
+		DeleteShardPlacementRow(sourcePlacement->placementId);
+	}
+
+	DeleteShardRow(sourceShardId);
+
+	return splitShardIdList;
+}
+
+
+/*
+ * SplitShardCommandList returns the commands that create the given new shards
+ * next to a placement of the given source shard and fill them with the rows of
+ * their sub-ranges, or only the commands that create their foreign keys.
+ */
+static List *
+SplitShardCommandList(ShardInterval *sourceShardInterval, List *splitShardIdList,
+					  List *splitRangeList, bool foreignKeysOnly)
+{
+	Oid relationId = sourceShardInterval->relationId;
+	List *commandList = NIL;
+	bool includeSequenceDefaults = false;
+
+	List *tableCreationCommandList = GetTableCreationCommands(relationId,
+															   includeSequenceDefaults);
+	List *indexCommandList = GetTableIndexAndConstraintCommands(relationId);
+	List *foreignConstraintCommandList = GetTableForeignConstraintCommands(relationId);
+
+	Var *distributionColumn = DistPartitionKey(relationId);
+	char *distributionColumnName = get_attname(relationId,
+											   distributionColumn->varattno, false);
+	char *sourceShardName = ConstructQualifiedShardName(sourceShardInterval);
+
+	ListCell *splitShardIdCell = NULL;
+	ListCell *splitRangeCell = NULL;
+	forboth(splitShardIdCell, splitShardIdList, splitRangeCell, splitRangeList)
+	{
+		uint64 splitShardId = *((uint64 *) lfirst(splitShardIdCell));
+		ShardSplitRange *splitRange = lfirst(splitRangeCell);
+		ShardInterval *splitShardInterval = LoadShardInterval(splitShardId);
+		int shardIndex = ShardIndex(splitShardInterval);
+
+		if (foreignKeysOnly)
+		{
+			commandList = list_concat(commandList,
+									  WorkerCreateShardCommandList(
+										  relationId, shardIndex, splitShardId, NIL,
+										  foreignConstraintCommandList));
+			continue;
+		}
+
+		commandList = list_concat(commandList,
+								  WorkerCreateShardCommandList(
+									  relationId, shardIndex, splitShardId,
+									  tableCreationCommandList, NIL));
+
+		StringInfo copyCommand = makeStringInfo();
+		appendStringInfo(copyCommand,
+						 "INSERT INTO %s SELECT * FROM %s "
+						 "WHERE pg_catalog.worker_hash(%s) BETWEEN %d AND %d",
+						 ConstructQualifiedShardName(splitShardInterval),
+						 sourceShardName, quote_identifier(distributionColumnName),
+						 splitRange->minValue, splitRange->maxValue);
+		commandList = lappend(commandList, copyCommand->data);
+
+		/* build the indexes once the data is copied */
+		commandList = list_concat(commandList,
+								  WorkerCreateShardCommandList(
+									  relationId, shardIndex, splitShardId,
+									  indexCommandList, NIL));
+	}
+
+	return commandList;
+}
+
+
+/*
+ * TenantIdToDistributionValue converts the given tenant id to the type of the
+ * distribution column, using the text representation if the types differ.
+ */
+static Datum
+TenantIdToDistributionValue(Datum tenantIdDatum, Oid tenantIdType,
+							Oid distributionColumnType)
+{
+	if (tenantIdType == distributionColumnType)
+	{
+		return tenantIdDatum;
+	}
+
+	char *tenantIdString = DatumToString(tenantIdDatum, tenantIdType);
+
+	return StringToDatum(tenantIdString, distributionColumnType);
 }
 
 
@@ -59,11 +59,34 @@
 #include "utils/rel.h"
 
 
+/*
+ * ShardCreationBatch is a task that creates multiple shards on a node, which is
+ * built by CreateShardBatchTaskList.
+ */
+typedef struct ShardCreationBatch
+{
+	uint32 nodeId;
+	Task *task;
+	StringInfo commandString;
+	int shardCount;
+} ShardCreationBatch;
+
+
 /* Local functions forward declarations */
 static List * RelationShardListForShardCreate(ShardInterval *shardInterval);
+static uint64 UpdateShardStatisticsInternal(int64 shardId, bool shardRangeKnown,
+											text *minValue, text *maxValue);
 static bool WorkerShardStats(ShardPlacement *placement, Oid relationId,
-							 const char *shardName, uint64 *shardSize,
-							 text **shardMinValue, text **shardMaxValue);
+							 const char *shardName, bool fetchShardRange,
+							 uint64 *shardSize, text **shardMinValue,
+							 text **shardMaxValue);
+static List * CreateShardBatchTaskList(Oid distributedRelationId, List *shardPlacements,
+									   List *ddlCommandList,
+									   List *foreignConstraintCommandList,
+									   bool colocatedShard, int batchSize);
+
+/* Config variables managed via guc.c */
+int ShardCreationBatchSize = 1; /* number of shards created per command on a worker */
 
 /* exports for SQL callable functions */
 PG_FUNCTION_INFO_V1(master_create_empty_shard);
@@ -437,15 +460,17 @@ CreateAppendDistributedShardPlacements(Oid relationId, int64 shardId,
 
 /*
  * InsertShardPlacementRows inserts shard placements to the metadata table on
- * the coordinator node. Then, returns the list of added shard placements.
+ * the coordinator node. The function does not load the added placements, since
+ * every load after an insert rebuilds the metadata cache entry of the table.
+ * Callers that create many shards therefore load the placements once, after all
+ * metadata rows are inserted.
  */
-List *
+void
 InsertShardPlacementRows(Oid relationId, int64 shardId, List *workerNodeList,
 						 int workerStartIndex, int replicationFactor)
 {
 	int workerNodeCount = list_length(workerNodeList);
 	int placementsInserted = 0;
-	List *insertedShardPlacements = NIL;
 
 	for (int attemptNumber = 0; attemptNumber < replicationFactor; attemptNumber++)
 	{
@@ -455,11 +480,8 @@ InsertShardPlacementRows(Oid relationId, int64 shardId, List *workerNodeList,
 		const ShardState shardState = SHARD_STATE_ACTIVE;
 		const uint64 shardSize = 0;
 
-		uint64 shardPlacementId = InsertShardPlacementRow(shardId, INVALID_PLACEMENT_ID,
-														  shardState, shardSize,
-														  nodeGroupId);
-		ShardPlacement *shardPlacement = LoadShardPlacement(shardId, shardPlacementId);
-		insertedShardPlacements = lappend(insertedShardPlacements, shardPlacement);
+		InsertShardPlacementRow(shardId, INVALID_PLACEMENT_ID, shardState, shardSize,
+								nodeGroupId);
 
 		placementsInserted++;
 		if (placementsInserted >= replicationFactor)
@@ -467,8 +489,6 @@ InsertShardPlacementRows(Oid relationId, int64 shardId, List *workerNodeList,
 			break;
 		}
 	}
-
-	return insertedShardPlacements;
 }
 
 
@@ -491,6 +511,22 @@ CreateShardsOnWorkers(Oid distributedRelationId, List *shardPlacements,
 	List *taskList = NIL;
 	int poolSize = 1;
 
+	/*
+	 * Exclusive connections are used to access the shards in parallel later in
+	 * the transaction, which requires each shard to be created over its own
+	 * connection. Otherwise, all shards of a worker are created over the same
+	 * connection anyway and we can save round trips by creating them in batches.
+	 */
+	if (!useExclusiveConnection && ShardCreationBatchSize > 1)
+	{
+		taskList = CreateShardBatchTaskList(distributedRelationId, shardPlacements,
+											ddlCommandList,
+											foreignConstraintCommandList,
+											colocatedShard, ShardCreationBatchSize);
+		ExecuteTaskList(ROW_MODIFY_NONE, taskList, poolSize);
+		return;
+	}
+
 	ShardPlacement *shardPlacement = NULL;
 	foreach_ptr(shardPlacement, shardPlacements)
 	{
@@ -550,6 +586,98 @@ CreateShardsOnWorkers(Oid distributedRelationId, List *shardPlacements,
 }
 
 
+/*
+ * CreateShardBatchTaskList returns a list of tasks that create the given shard
+ * placements, where each task creates up to batchSize placements on the same
+ * node using a single multi-statement command.
+ */
+static List *
+CreateShardBatchTaskList(Oid distributedRelationId, List *shardPlacements,
+						 List *ddlCommandList, List *foreignConstraintCommandList,
+						 bool colocatedShard, int batchSize)
+{
+	List *taskList = NIL;
+	List *openBatchList = NIL;
+	int taskId = 1;
+
+	ShardPlacement *shardPlacement = NULL;
+	foreach_ptr(shardPlacement, shardPlacements)
+	{
+		uint64 shardId = shardPlacement->shardId;
+		ShardInterval *shardInterval = LoadShardInterval(shardId);
+		int shardIndex = -1;
+		ShardCreationBatch *batch = NULL;
+
+		if (colocatedShard)
+		{
+			shardIndex = ShardIndex(shardInterval);
+		}
+
+		List *commandList = WorkerCreateShardCommandList(distributedRelationId,
+														 shardIndex,
+														 shardId, ddlCommandList,
+														 foreignConstraintCommandList);
+
+		/* find the batch that is currently being filled for the node */
+		ShardCreationBatch *openBatch = NULL;
+		foreach_ptr(openBatch, openBatchList)
+		{
+			if (openBatch->nodeId == shardPlacement->nodeId)
+			{
+				batch = openBatch;
+				break;
+			}
+		}
+
+		if (batch == NULL)
+		{
+			Task *task = CitusMakeNode(Task);
+			task->jobId = INVALID_JOB_ID;
+			task->taskId = taskId++;
+			task->taskType = DDL_TASK;
+			task->replicationModel = REPLICATION_MODEL_INVALID;
+			task->dependentTaskList = NIL;
+			task->anchorShardId = shardId;
+			task->relationShardList = NIL;
+			task->taskPlacementList = list_make1(shardPlacement);
+
+			batch = palloc0(sizeof(ShardCreationBatch));
+			batch->nodeId = shardPlacement->nodeId;
+			batch->task = task;
+			batch->commandString = makeStringInfo();
+
+			taskList = lappend(taskList, task);
+			openBatchList = lappend(openBatchList, batch);
+		}
+		else
+		{
+			appendStringInfoChar(batch->commandString, ';');
+		}
+
+		appendStringInfoString(batch->commandString, StringJoin(commandList, ';'));
+		batch->task->relationShardList =
+			list_concat(batch->task->relationShardList,
+						RelationShardListForShardCreate(shardInterval));
+		batch->shardCount++;
+
+		if (batch->shardCount >= batchSize)
+		{
+			SetTaskQueryString(batch->task, batch->commandString->data);
+			openBatchList = list_delete_ptr(openBatchList, batch);
+		}
+	}
+
+	/* set the commands of the batches that did not fill up */
+	ShardCreationBatch *openBatch = NULL;
+	foreach_ptr(openBatch, openBatchList)
+	{
+		SetTaskQueryString(openBatch->task, openBatch->commandString->data);
+	}
+
+	return taskList;
+}
+
+
 /*
  * RelationShardListForShardCreate gets a shard interval and returns the placement
  * accesses that would happen when a placement of the shard interval is created.
@@ -753,6 +881,37 @@ WorkerCreateShardCommandList(Oid relationId, int shardIndex, uint64 shardId,
  */
 uint64
 UpdateShardStatistics(int64 shardId)
+{
+	bool shardRangeKnown = false;
+
+	return UpdateShardStatisticsInternal(shardId, shardRangeKnown, NULL, NULL);
+}
+
+
+/*
+ * UpdateShardStatisticsWithRange updates the metadata of the given shard like
+ * UpdateShardStatistics, but takes the min/max values of an append-partitioned
+ * shard from the caller instead of scanning the shard for them. The caller
+ * tracks them while copying all rows of the shard. NULL values mean that the
+ * shard has no rows with a partition column value.
+ */
+uint64
+UpdateShardStatisticsWithRange(int64 shardId, text *minValue, text *maxValue)
+{
+	bool shardRangeKnown = true;
+
+	return UpdateShardStatisticsInternal(shardId, shardRangeKnown, minValue, maxValue);
+}
+
+
+/*
+ * UpdateShardStatisticsInternal updates the shard size and, unless the range is
+ * known, shard min/max values of the given shard from one of its placements and
+ * returns the updated shard size.
+ */
+static uint64
+UpdateShardStatisticsInternal(int64 shardId, bool shardRangeKnown, text *minValue,
+							  text *maxValue)
 {
 	ShardInterval *shardInterval = LoadShardInterval(shardId);
 	Oid relationId = shardInterval->relationId;
@@ -760,8 +919,6 @@ UpdateShardStatistics(int64 shardId)
 	char partitionType = PartitionMethod(relationId);
 	bool statsOK = false;
 	uint64 shardSize = 0;
-	text *minValue = NULL;
-	text *maxValue = NULL;
 
 	/* Build shard qualified name. */
 	char *shardName = get_rel_name(relationId);
@@ -778,8 +935,18 @@ UpdateShardStatistics(int64 shardId)
 	ShardPlacement *placement = NULL;
 	foreach_ptr(placement, shardPlacementList)
 	{
+		text *placementMinValue = NULL;
+		text *placementMaxValue = NULL;
+
 		statsOK = WorkerShardStats(placement, relationId, shardQualifiedName,
-								   &shardSize, &minValue, &maxValue);
+								   !shardRangeKnown, &shardSize, &placementMinValue,
+								   &placementMaxValue);
+		if (statsOK && !shardRangeKnown)
+		{
+			minValue = placementMinValue;
+			maxValue = placementMaxValue;
+		}
+
 		if (statsOK)
 		{
 			break;
@@ -836,10 +1003,13 @@ UpdateShardStatistics(int64 shardId)
 /*
  * WorkerShardStats queries the worker node, and retrieves shard statistics that
  * we assume have changed after new table data have been appended to the shard.
+ * The min/max values are only retrieved when fetchShardRange is set, since they
+ * take a scan of the shard.
  */
 static bool
 WorkerShardStats(ShardPlacement *placement, Oid relationId, const char *shardName,
-				 uint64 *shardSize, text **shardMinValue, text **shardMaxValue)
+				 bool fetchShardRange, uint64 *shardSize, text **shardMinValue,
+				 text **shardMaxValue)
 {
 	StringInfo tableSizeQuery = makeStringInfo();
 
@@ -903,9 +1073,9 @@ WorkerShardStats(ShardPlacement *placement, Oid relationId, const char *shardNam
 	PQclear(queryResult);
 	ForgetResults(connection);
 
-	if (partitionType != DISTRIBUTE_BY_APPEND)
+	if (partitionType != DISTRIBUTE_BY_APPEND || !fetchShardRange)
 	{
-		/* we don't need min/max for non-append distributed tables */
+		/* we don't need min/max for non-append tables or when they are known */
 		return true;
 	}
 
@@ -16,6 +16,7 @@
 #include "commands/tablecmds.h"
 #include "commands/trigger.h"
 #include "distributed/commands/utility_hook.h"
+#include "distributed/citus_nodes.h"
 #include "distributed/deparse_shard_query.h"
 #include "distributed/listutils.h"
 #include "distributed/master_metadata_utility.h"
@@ -28,7 +29,22 @@
 #include "utils/lsyscache.h"
 #include "utils/rel.h"
 
+/*
+ * TruncateShardGroup is a group of shards of a table that have their
+ * placements on the same nodes, which are truncated by a single task.
+ */
+typedef struct TruncateShardGroup
+{
+	uint64 anchorShardId;
+	List *placementList;
+	List *relationShardList;
+	StringInfo truncateCommand;
+} TruncateShardGroup;
+
+
 static List * TruncateTaskList(Oid relationId);
+static TruncateShardGroup * FindTruncateShardGroup(List *shardGroupList,
+												   List *placementList);
 
 
 /* exports for SQL callable functions */
@@ -91,6 +107,10 @@ citus_truncate_trigger(PG_FUNCTION_ARGS)
  * distributed table. This is handled separately from other DDL commands
  * because we handle it via the TRUNCATE trigger, which is called whenever
  * a truncate cascades.
+ *
+ * Shards whose placements are on the same nodes are truncated by a single
+ * task, such that each node receives a single TRUNCATE for all of its shards
+ * instead of one command per shard.
  */
 static List *
 TruncateTaskList(Oid relationId)
@@ -98,6 +118,9 @@ TruncateTaskList(Oid relationId)
 	/* resulting task list */
 	List *taskList = NIL;
 
+	/* groups of shards that have their placements on the same nodes */
+	List *shardGroupList = NIL;
+
 	/* enumerate the tasks when putting them to the taskList */
 	int taskId = 1;
 
@@ -121,21 +144,99 @@ TruncateTaskList(Oid relationId)
 
 		char *quotedShardName = quote_qualified_identifier(schemaName, shardRelationName);
 
-		StringInfo shardQueryString = makeStringInfo();
-		appendStringInfo(shardQueryString, "TRUNCATE TABLE %s CASCADE", quotedShardName);
+		List *placementList = SortList(ActiveShardPlacementList(shardId),
+									   CompareShardPlacementsByWorker);
+
+		TruncateShardGroup *shardGroup = FindTruncateShardGroup(shardGroupList,
+																placementList);
+		if (shardGroup == NULL)
+		{
+			shardGroup = palloc0(sizeof(TruncateShardGroup));
+			shardGroup->anchorShardId = shardId;
+			shardGroup->placementList = placementList;
+			shardGroup->truncateCommand = makeStringInfo();
+
+			appendStringInfo(shardGroup->truncateCommand, "TRUNCATE TABLE %s",
+							 quotedShardName);
+
+			shardGroupList = lappend(shardGroupList, shardGroup);
+		}
+		else
+		{
+			appendStringInfo(shardGroup->truncateCommand, ", %s", quotedShardName);
+		}
+
+		RelationShard *relationShard = CitusMakeNode(RelationShard);
+		relationShard->relationId = relationId;
+		relationShard->shardId = shardId;
+
+		shardGroup->relationShardList = lappend(shardGroup->relationShardList,
+												relationShard);
+	}
+
+	TruncateShardGroup *shardGroup = NULL;
+	foreach_ptr(shardGroup, shardGroupList)
+	{
+		appendStringInfoString(shardGroup->truncateCommand, " CASCADE");
 
 		Task *task = CitusMakeNode(Task);
 		task->jobId = INVALID_JOB_ID;
 		task->taskId = taskId++;
 		task->taskType = DDL_TASK;
-		SetTaskQueryString(task, shardQueryString->data);
+		SetTaskQueryString(task, shardGroup->truncateCommand->data);
 		task->dependentTaskList = NULL;
 		task->replicationModel = REPLICATION_MODEL_INVALID;
-		task->anchorShardId = shardId;
-		task->taskPlacementList = ActiveShardPlacementList(shardId);
+		task->anchorShardId = shardGroup->anchorShardId;
+		task->taskPlacementList = shardGroup->placementList;
+
+		/* the placements of all shards are accessed by the task */
+		task->relationShardList = shardGroup->relationShardList;
 
 		taskList = lappend(taskList, task);
 	}
 
 	return taskList;
 }
+
+
+/*
+ * FindTruncateShardGroup returns the group in the given list whose placements
+ * are on the same nodes as the given placements, both sorted by node, or NULL
+ * if there is none.
+ */
+static TruncateShardGroup *
+FindTruncateShardGroup(List *shardGroupList, List *placementList)
+{
+	TruncateShardGroup *shardGroup = NULL;
+	foreach_ptr(shardGroup, shardGroupList)
+	{
+		if (list_length(shardGroup->placementList) != list_length(placementList))
+		{
+			continue;
+		}
+
+		bool sameNodes = true;
+		ListCell *groupPlacementCell = NULL;
+		ListCell *placementCell = NULL;
+
+		forboth(groupPlacementCell, shardGroup->placementList,
+				placementCell, placementList)
+		{
+			ShardPlacement *groupPlacement = lfirst(groupPlacementCell);
+			ShardPlacement *placement = lfirst(placementCell);
+
+			if (groupPlacement->groupId != placement->groupId)
+			{
+				sameNodes = false;
+				break;
+			}
+		}
+
+		if (sameNodes)
+		{
+			return shardGroup;
+		}
+	}
+
+	return NULL;
+}
@@ -4,6 +4,26 @@
  *
  * Function definitions for the shard rebalancer tool.
  *
+ * The rebalancer plans moves of shard placements between the active primary
+ * nodes based on the functions of a rebalance strategy in
+ * pg_dist_rebalance_strategy: the cost of a shard, the capacity of a node and
+ * whether a shard is allowed on a node. The utilization of a node is the total
+ * cost of its shards divided by its capacity. Shards of nodes that should not
+ * have shards are always moved away. Other shards are moved from the nodes that
+ * are utilized the most to the nodes that are utilized the least, until the
+ * utilization of all nodes is within the threshold around the average or no
+ * move improves the balance anymore. Each placement moves at most once, and
+ * all colocated shards move together.
+ *
+ * The moves are executed by calling master_move_shard_placement over separate
+ * connections to the coordinator itself, such that every move commits on its
+ * own and moves of different shard groups can run in parallel, limited by
+ * citus.max_rebalancer_parallel_moves in total and by
+ * citus.max_rebalancer_moves_per_node for every node. When
+ * citus.rebalancer_max_move_rate is set, new moves are not started while the
+ * total size of the started moves exceeds what the rate allows since the
+ * start of the rebalance.
+ *
  * Copyright (c) Citus Data, Inc.
  *
  * $Id$
@@ -12,28 +32,1451 @@
  */
 
 #include "postgres.h"
+#include "miscadmin.h"
+#include "pgstat.h"
 
+#include "access/genam.h"
+#include "access/heapam.h"
 #include "access/htup_details.h"
+#include "access/xact.h"
+#include "catalog/pg_class.h"
 #include "catalog/pg_type.h"
 #include "catalog/pg_proc.h"
+#include "distributed/citus_safe_lib.h"
+#include "distributed/colocation_utils.h"
+#include "distributed/connection_management.h"
 #include "distributed/enterprise.h"
+#include "distributed/listutils.h"
+#include "distributed/master_metadata_utility.h"
+#include "distributed/master_protocol.h"
+#include "distributed/metadata_cache.h"
+#include "distributed/multi_join_order.h"
+#include "distributed/multi_partitioning_utils.h"
+#include "distributed/pg_dist_rebalance_strategy.h"
+#include "distributed/reference_table_utils.h"
+#include "distributed/remote_commands.h"
+#include "distributed/resource_lock.h"
+#include "distributed/shard_rebalancer.h"
+#include "distributed/task_tracker.h"
+#include "distributed/tuplestore.h"
+#include "distributed/worker_manager.h"
+#include "distributed/worker_protocol.h"
+#include "lib/stringinfo.h"
+#include "postmaster/postmaster.h"
+#include "storage/ipc.h"
+#include "storage/latch.h"
+#include "storage/lmgr.h"
+#include "storage/lock.h"
+#include "utils/builtins.h"
+#include "utils/fmgroids.h"
+#include "utils/inval.h"
+#include "utils/lsyscache.h"
 #include "utils/syscache.h"
+#include "utils/timestamp.h"
+
+
+/* time to wait between two checks whether running moves finished */
+#define REBALANCER_POLL_INTERVAL_MS 100
+
+
+/*
+ * RebalanceOptions contains the arguments of a rebalance operation, with the
+ * defaults of the rebalance strategy applied.
+ */
+typedef struct RebalanceOptions
+{
+	/* one table of every colocation group to rebalance */
+	List *relationIdList;
+
+	float4 threshold;
+	int32 maxShardMoves;
+	ArrayType *excludedShardArray;
+	bool drainOnly;
+	Form_pg_dist_rebalance_strategy rebalanceStrategy;
+} RebalanceOptions;
+
+
+/*
+ * ShardCost is the cost of a shard placement on a node, according to the
+ * shard cost function of the rebalance strategy.
+ */
+typedef struct ShardCost
+{
+	uint64 shardId;
+	float8 cost;
+
+	/* false if the shard is excluded or was already moved by the plan */
+	bool movable;
+} ShardCost;
+
+
+/*
+ * NodeFillState describes how full a node is during planning.
+ */
+typedef struct NodeFillState
+{
+	WorkerNode *node;
+
+	/* capacity of the node, 0 if the node should not have shards */
+	float8 capacity;
+
+	/* total cost of the shards on the node */
+	float8 totalCost;
+
+	/* ShardCost * of the placements on the node */
+	List *shardCostList;
+} NodeFillState;
+
+
+/*
+ * RebalanceState is the state of planning the moves of a colocation group.
+ */
+typedef struct RebalanceState
+{
+	RebalanceOptions *options;
+
+	/* NodeFillState * of all active primary nodes */
+	List *fillStateList;
+
+	/* total cost of all placements and capacity of all nodes that get shards */
+	float8 totalCost;
+	float8 totalCapacity;
+
+	/* PlacementUpdateEvent * of the moves planned so far */
+	List *placementUpdateList;
+} RebalanceState;
 
 
+/*
+ * PlacementUpdateEvent is a planned move of a shard, and its colocated
+ * shards, from one node to another.
+ */
+typedef struct PlacementUpdateEvent
+{
+	Oid relationId;
+	uint64 shardId;
+	WorkerNode *sourceNode;
+	WorkerNode *targetNode;
+
+	/* size of the shard and its colocated shards on the source node */
+	uint64 shardSize;
+
+	/* connection that runs the move, while it is running */
+	MultiConnection *connection;
+} PlacementUpdateEvent;
+
+
+/*
+ * RebalanceExecution is the state of executing the planned moves.
+ */
+typedef struct RebalanceExecution
+{
+	List *pendingMoveList;
+	List *runningMoveList;
+
+	/* label of the citus.shard_transfer_mode to use for the moves */
+	char *shardTransferMode;
+
+	/* total size of the shards of the started moves, for throttling */
+	uint64 bytesStarted;
+	TimestampTz startTime;
+} RebalanceExecution;
+
+
+/* GUC, maximum number of shard moves the rebalancer runs at the same time */
+int MaxRebalancerParallelMoves = 1;
+
+/* GUC, maximum number of concurrent shard moves from or to a single node */
+int MaxRebalancerMovesPerNode = 1;
+
+/* GUC, maximum rate at which the rebalancer starts moving data, in kB/s */
+int RebalancerMaxMoveRate = 0;
+
+
+static RebalanceOptions * RebalanceOptionsFromArgs(FunctionCallInfo fcinfo,
+												   int drainOnlyArgIndex,
+												   int strategyArgIndex);
+static Form_pg_dist_rebalance_strategy GetRebalanceStrategy(Name strategyName);
+static List * RelationIdListToRebalance(Oid relationId);
+static bool ColocationGroupCanBeMoved(Oid relationId);
+static void AcquireRebalanceColocationLock(Oid relationId);
+static List * GetRebalanceSteps(RebalanceOptions *options);
+static RebalanceState * CreateRebalanceState(Oid relationId, List *workerNodeList,
+											 RebalanceOptions *options);
+static List * ExcludedShardIndexList(Oid relationId, ArrayType *excludedShardArray);
+static NodeFillState * FindNodeFillState(RebalanceState *state, uint32 nodeId);
+static bool MoveShardAwayFromDrainedNode(RebalanceState *state);
+static bool MoveShardToBalanceNodes(RebalanceState *state);
+static NodeFillState * LeastUtilizedTargetNode(RebalanceState *state,
+											   ShardCost *shardCost);
+static bool ShardCanMoveToNode(RebalanceState *state, ShardCost *shardCost,
+							   NodeFillState *targetFillState);
+static void ApplyPlacementUpdate(RebalanceState *state, Oid relationId,
+								 NodeFillState *sourceFillState,
+								 NodeFillState *targetFillState,
+								 ShardCost *shardCost);
+static float8 NodeUtilization(NodeFillState *fillState);
+static int CompareNodeFillStateUtilization(const void *leftElement,
+										   const void *rightElement);
+static uint64 ShardGroupSizeOnNode(ShardInterval *shardInterval, char *nodeName,
+								   int nodePort);
+static void RebalanceTableShards(RebalanceOptions *options, Oid shardTransferModeOid);
+static void ExecutePlacementUpdates(List *placementUpdateList,
+									char *shardTransferMode);
+static void StartPendingMoves(RebalanceExecution *execution);
+static bool MoveRateExceeded(RebalanceExecution *execution);
+static int RunningMoveCountOnNode(List *runningMoveList, WorkerNode *workerNode);
+static void StartPlacementMove(PlacementUpdateEvent *move, char *shardTransferMode);
+static bool FinishRunningMoves(RebalanceExecution *execution);
+static void ExecuteRebalancerCommandInSeparateTransaction(char *command);
+static void WaitForRebalancerPoll(void);
 static void EnsureShardCostUDF(Oid functionOid);
 static void EnsureNodeCapacityUDF(Oid functionOid);
 static void EnsureShardAllowedOnNodeUDF(Oid functionOid);
 
-NOT_SUPPORTED_IN_COMMUNITY(rebalance_table_shards);
 NOT_SUPPORTED_IN_COMMUNITY(replicate_table_shards);
-NOT_SUPPORTED_IN_COMMUNITY(get_rebalance_table_shards_plan);
 NOT_SUPPORTED_IN_COMMUNITY(get_rebalance_progress);
-NOT_SUPPORTED_IN_COMMUNITY(master_drain_node);
-NOT_SUPPORTED_IN_COMMUNITY(citus_shard_cost_by_disk_size);
+PG_FUNCTION_INFO_V1(rebalance_table_shards);
+PG_FUNCTION_INFO_V1(get_rebalance_table_shards_plan);
+PG_FUNCTION_INFO_V1(master_drain_node);
+PG_FUNCTION_INFO_V1(citus_shard_cost_by_disk_size);
 PG_FUNCTION_INFO_V1(pg_dist_rebalance_strategy_enterprise_check);
 PG_FUNCTION_INFO_V1(citus_validate_rebalance_strategy_functions);
 
 
+/*
+ * rebalance_table_shards moves shards of the given table, and the shards that
+ * are colocated with them, such that the utilization of the nodes is balanced
+ * according to the rebalance strategy. If no table is given, the shards of all
+ * hash distributed tables are rebalanced.
+ *
+ * SQL signature:
+ *
+ * rebalance_table_shards(
+ *     relation regclass,
+ *     threshold float4,
+ *     max_shard_moves int,
+ *     excluded_shard_list bigint[],
+ *     shard_transfer_mode citus.shard_transfer_mode,
+ *     drain_only boolean,
+ *     rebalance_strategy name
+ * ) RETURNS VOID
+ */
+Datum
+rebalance_table_shards(PG_FUNCTION_ARGS)
+{
+	/* every move commits on its own */
+	PreventInTransactionBlock(true, "rebalance_table_shards");
+
+	CheckCitusVersion(ERROR);
+	EnsureCoordinator();
+
+	if (PG_ARGISNULL(4))
+	{
+		ereport(ERROR, (errmsg("shard_transfer_mode cannot be NULL")));
+	}
+
+	int drainOnlyArgIndex = 5;
+	int strategyArgIndex = 6;
+	RebalanceOptions *options = RebalanceOptionsFromArgs(fcinfo, drainOnlyArgIndex,
+														 strategyArgIndex);
+	Oid shardTransferModeOid = PG_GETARG_OID(4);
+
+	RebalanceTableShards(options, shardTransferModeOid);
+
+	PG_RETURN_VOID();
+}
+
+
+/*
+ * get_rebalance_table_shards_plan returns the moves that rebalance_table_shards
+ * would do with the same arguments, without executing them.
+ *
+ * SQL signature:
+ *
+ * get_rebalance_table_shards_plan(
+ *     relation regclass,
+ *     threshold float4,
+ *     max_shard_moves int,
+ *     excluded_shard_list bigint[],
+ *     drain_only boolean,
+ *     rebalance_strategy name
+ * ) RETURNS TABLE (table_name regclass, shardid bigint, shard_size bigint,
+ *                  sourcename text, sourceport int, targetname text,
+ *                  targetport int)
+ */
+Datum
+get_rebalance_table_shards_plan(PG_FUNCTION_ARGS)
+{
+	TupleDesc tupleDescriptor = NULL;
+
+	CheckCitusVersion(ERROR);
+	EnsureCoordinator();
+
+	int drainOnlyArgIndex = 4;
+	int strategyArgIndex = 5;
+	RebalanceOptions *options = RebalanceOptionsFromArgs(fcinfo, drainOnlyArgIndex,
+														 strategyArgIndex);
+
+	List *placementUpdateList = GetRebalanceSteps(options);
+
+	Tuplestorestate *tupleStore = SetupTuplestore(fcinfo, &tupleDescriptor);
+
+	PlacementUpdateEvent *move = NULL;
+	foreach_ptr(move, placementUpdateList)
+	{
+		Datum values[7];
+		bool nulls[7];
+
+		memset(values, 0, sizeof(values));
+		memset(nulls, 0, sizeof(nulls));
+
+		ShardInterval *shardInterval = LoadShardInterval(move->shardId);
+		uint64 shardSize = ShardGroupSizeOnNode(shardInterval,
+												move->sourceNode->workerName,
+												move->sourceNode->workerPort);
+
+		values[0] = ObjectIdGetDatum(move->relationId);
+		values[1] = UInt64GetDatum(move->shardId);
+		values[2] = UInt64GetDatum(shardSize);
+		values[3] = PointerGetDatum(cstring_to_text(move->sourceNode->workerName));
+		values[4] = UInt32GetDatum(move->sourceNode->workerPort);
+		values[5] = PointerGetDatum(cstring_to_text(move->targetNode->workerName));
+		values[6] = UInt32GetDatum(move->targetNode->workerPort);
+
+		tuplestore_putvalues(tupleStore, tupleDescriptor, values, nulls);
+	}
+
+	tuplestore_donestoring(tupleStore);
+
+	return (Datum) 0;
+}
+
+
+/*
+ * master_drain_node marks the given node such that it should not have shards
+ * anymore, and then moves all shards of hash distributed tables away from it.
+ *
+ * SQL signature:
+ *
+ * master_drain_node(
+ *     nodename text,
+ *     nodeport integer,
+ *     shard_transfer_mode citus.shard_transfer_mode,
+ *     rebalance_strategy name
+ * ) RETURNS VOID
+ */
+Datum
+master_drain_node(PG_FUNCTION_ARGS)
+{
+	StringInfo setNodePropertyCommand = makeStringInfo();
+
+	/* every move commits on its own */
+	PreventInTransactionBlock(true, "master_drain_node");
+
+	CheckCitusVersion(ERROR);
+	EnsureCoordinator();
+
+	if (PG_ARGISNULL(0) || PG_ARGISNULL(1) || PG_ARGISNULL(2))
+	{
+		ereport(ERROR, (errmsg("nodename, nodeport and shard_transfer_mode cannot "
+							   "be NULL")));
+	}
+
+	char *nodeName = text_to_cstring(PG_GETARG_TEXT_P(0));
+	int32 nodePort = PG_GETARG_INT32(1);
+	Oid shardTransferModeOid = PG_GETARG_OID(2);
+	Name strategyName = PG_ARGISNULL(3) ? NULL : PG_GETARG_NAME(3);
+
+	/* error out early if the node does not exist */
+	ForceFindWorkerNode(nodeName, nodePort);
+
+	/*
+	 * Commit the node property first, such that the node does not get new
+	 * shards even if one of the moves fails.
+	 */
+	appendStringInfo(setNodePropertyCommand,
+					 "SELECT pg_catalog.master_set_node_property(%s, %d, "
+					 "'shouldhaveshards', false)",
+					 quote_literal_cstr(nodeName), nodePort);
+
+	ExecuteRebalancerCommandInSeparateTransaction(setNodePropertyCommand->data);
+
+	/* make sure we see the new node property */
+	AcceptInvalidationMessages();
+
+	RebalanceOptions *options = palloc0(sizeof(RebalanceOptions));
+	options->relationIdList = RelationIdListToRebalance(InvalidOid);
+	options->maxShardMoves = INT_MAX;
+	options->drainOnly = true;
+	options->rebalanceStrategy = GetRebalanceStrategy(strategyName);
+	options->threshold = options->rebalanceStrategy->defaultThreshold;
+
+	RebalanceTableShards(options, shardTransferModeOid);
+
+	PG_RETURN_VOID();
+}
+
+
+/*
+ * citus_shard_cost_by_disk_size returns the total size of the given shard and
+ * the shards that are colocated with it on the first active placement of the
+ * shard.
+ *
+ * SQL signature:
+ *
+ * citus_shard_cost_by_disk_size(shardid bigint) RETURNS float4
+ */
+Datum
+citus_shard_cost_by_disk_size(PG_FUNCTION_ARGS)
+{
+	uint64 shardId = PG_GETARG_INT64(0);
+
+	CheckCitusVersion(ERROR);
+
+	ShardInterval *shardInterval = LoadShardInterval(shardId);
+	List *placementList = ActiveShardPlacementList(shardId);
+	if (placementList == NIL)
+	{
+		ereport(ERROR, (errmsg("shard " UINT64_FORMAT " has no active placements",
+							   shardId)));
+	}
+
+	ShardPlacement *placement = (ShardPlacement *) linitial(placementList);
+	uint64 shardGroupSize = ShardGroupSizeOnNode(shardInterval, placement->nodeName,
+												 placement->nodePort);
+
+	PG_RETURN_FLOAT4((float4) shardGroupSize);
+}
+
+
+/*
+ * RebalanceOptionsFromArgs builds the options of a rebalance operation from the
+ * arguments of rebalance_table_shards or get_rebalance_table_shards_plan,
+ * which share the first four arguments.
+ */
+static RebalanceOptions *
+RebalanceOptionsFromArgs(FunctionCallInfo fcinfo, int drainOnlyArgIndex,
+						 int strategyArgIndex)
+{
+	RebalanceOptions *options = palloc0(sizeof(RebalanceOptions));
+	Oid relationId = PG_ARGISNULL(0) ? InvalidOid : PG_GETARG_OID(0);
+	Name strategyName = PG_ARGISNULL(strategyArgIndex) ?
+						NULL : PG_GETARG_NAME(strategyArgIndex);
+
+	options->relationIdList = RelationIdListToRebalance(relationId);
+	options->maxShardMoves = PG_ARGISNULL(2) ? INT_MAX : PG_GETARG_INT32(2);
+	options->excludedShardArray = PG_ARGISNULL(3) ? NULL : PG_GETARG_ARRAYTYPE_P(3);
+	options->drainOnly = PG_ARGISNULL(drainOnlyArgIndex) ?
+						 false : PG_GETARG_BOOL(drainOnlyArgIndex);
+	options->rebalanceStrategy = GetRebalanceStrategy(strategyName);
+
+	if (PG_ARGISNULL(1))
+	{
+		options->threshold = options->rebalanceStrategy->defaultThreshold;
+	}
+	else
+	{
+		options->threshold = PG_GETARG_FLOAT4(1);
+	}
+
+	if (options->threshold < options->rebalanceStrategy->minimumThreshold)
+	{
+		ereport(ERROR, (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+						errmsg("threshold %g is lower than the minimum threshold "
+							   "%g of rebalance strategy \"%s\"",
+							   options->threshold,
+							   options->rebalanceStrategy->minimumThreshold,
+							   NameStr(options->rebalanceStrategy->name))));
+	}
+
+	return options;
+}
+
+
+/*
+ * GetRebalanceStrategy returns the rebalance strategy with the given name, or
+ * the default strategy if no name is given.
+ */
+static Form_pg_dist_rebalance_strategy
+GetRebalanceStrategy(Name strategyName)
+{
+	Form_pg_dist_rebalance_strategy strategy = NULL;
+
+	Relation pgDistRebalanceStrategy = heap_open(DistRebalanceStrategyRelationId(),
+												 AccessShareLock);
+	SysScanDesc scanDescriptor = systable_beginscan(pgDistRebalanceStrategy,
+													InvalidOid, false, NULL, 0,
+													NULL);
+
+	HeapTuple heapTuple = systable_getnext(scanDescriptor);
+	while (HeapTupleIsValid(heapTuple))
+	{
+		Form_pg_dist_rebalance_strategy strategyForm =
+			(Form_pg_dist_rebalance_strategy) GETSTRUCT(heapTuple);
+
+		if ((strategyName == NULL && strategyForm->default_strategy) ||
+			(strategyName != NULL &&
+			 namestrcmp(&strategyForm->name, NameStr(*strategyName)) == 0))
+		{
+			strategy = palloc0(sizeof(FormData_pg_dist_rebalance_strategy));
+			memcpy(strategy, strategyForm, sizeof(FormData_pg_dist_rebalance_strategy));
+			break;
+		}
+
+		heapTuple = systable_getnext(scanDescriptor);
+	}
+
+	systable_endscan(scanDescriptor);
+	heap_close(pgDistRebalanceStrategy, NoLock);
+
+	if (strategy == NULL && strategyName == NULL)
+	{
+		ereport(ERROR, (errmsg("no rebalance_strategy was provided, but there is "
+							   "also no default strategy set")));
+	}
+	else if (strategy == NULL)
+	{
+		ereport(ERROR, (errmsg("could not find rebalance strategy with name %s",
+							   NameStr(*strategyName))));
+	}
+
+	return strategy;
+}
+
+
+/*
+ * RelationIdListToRebalance returns a list with one table of every colocation
+ * group that should be rebalanced. If a table is given, only its colocation
+ * group is rebalanced. Otherwise, all colocation groups of hash distributed
+ * tables whose shards can be moved are rebalanced.
+ */
+static List *
+RelationIdListToRebalance(Oid relationId)
+{
+	List *relationIdList = NIL;
+	List *colocationIdList = NIL;
+
+	if (OidIsValid(relationId))
+	{
+		EnsureTableOwner(relationId);
+
+		if (PartitionMethod(relationId) != DISTRIBUTE_BY_HASH)
+		{
+			ereport(ERROR, (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+							errmsg("only hash distributed tables can be rebalanced")));
+		}
+
+		if (!ColocationGroupCanBeMoved(relationId))
+		{
+			ereport(ERROR, (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+							errmsg("cannot rebalance %s", get_rel_name(relationId)),
+							errdetail("Shards of partitioned tables and foreign "
+									  "tables cannot be moved.")));
+		}
+
+		return list_make1_oid(relationId);
+	}
+
+	List *distributedTableList = SortList(DistTableOidList(), CompareOids);
+
+	Oid distributedTableId = InvalidOid;
+	foreach_oid(distributedTableId, distributedTableList)
+	{
+		if (PartitionMethod(distributedTableId) != DISTRIBUTE_BY_HASH)
+		{
+			continue;
+		}
+
+		uint32 colocationId = TableColocationId(distributedTableId);
+		if (colocationId != INVALID_COLOCATION_ID &&
+			list_member_int(colocationIdList, colocationId))
+		{
+			continue;
+		}
+
+		colocationIdList = lappend_int(colocationIdList, colocationId);
+
+		if (!ColocationGroupCanBeMoved(distributedTableId))
+		{
+			ereport(NOTICE, (errmsg("skipping %s and its colocated tables, since "
+									"shards of partitioned tables and foreign "
+									"tables cannot be moved",
+									get_rel_name(distributedTableId))));
+			continue;
+		}
+
+		relationIdList = lappend_oid(relationIdList, distributedTableId);
+	}
+
+	return relationIdList;
+}
+
+
+/*
+ * ColocationGroupCanBeMoved returns whether master_move_shard_placement can
+ * move the shards of the given table and its colocated tables.
+ */
+static bool
+ColocationGroupCanBeMoved(Oid relationId)
+{
+	List *colocatedTableList = ColocatedTableList(relationId);
+
+	Oid colocatedTableId = InvalidOid;
+	foreach_oid(colocatedTableId, colocatedTableList)
+	{
+		if (PartitionedTableNoLock(colocatedTableId) ||
+			PartitionTableNoLock(colocatedTableId) ||
+			get_rel_relkind(colocatedTableId) == RELKIND_FOREIGN_TABLE)
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+
+/*
+ * AcquireRebalanceColocationLock prevents concurrent rebalance operations on
+ * the colocation group of the given table, and errors out if one is running.
+ * The moves themselves run in other backends, so the lock does not conflict
+ * with any lock they take.
+ */
+static void
+AcquireRebalanceColocationLock(Oid relationId)
+{
+	LOCKTAG tag;
+	const bool sessionLock = false;
+	const bool dontWait = true;
+
+	uint32 colocationId = TableColocationId(relationId);
+	int64 lockId = colocationId != INVALID_COLOCATION_ID ? colocationId : relationId;
+
+	SET_LOCKTAG_REBALANCE_COLOCATION(tag, lockId);
+
+	LockAcquireResult lockAcquired = LockAcquire(&tag, ExclusiveLock, sessionLock,
+												 dontWait);
+	if (!lockAcquired)
+	{
+		ereport(ERROR, (errmsg("could not acquire the lock required to rebalance %s",
+							   get_rel_name(relationId)),
+						errdetail("Another rebalance operation on the same tables "
+								  "may be running.")));
+	}
+}
+
+
+/*
+ * GetRebalanceSteps returns the moves that rebalance the colocation groups of
+ * the given options, as a list of PlacementUpdateEvent *.
+ */
+static List *
+GetRebalanceSteps(RebalanceOptions *options)
+{
+	List *placementUpdateList = NIL;
+
+	List *workerNodeList = ActivePrimaryNodeList(NoLock);
+	workerNodeList = SortList(workerNodeList, CompareWorkerNodes);
+
+	Oid relationId = InvalidOid;
+	foreach_oid(relationId, options->relationIdList)
+	{
+		int remainingMoves = options->maxShardMoves - list_length(placementUpdateList);
+		if (remainingMoves <= 0)
+		{
+			break;
+		}
+
+		RebalanceState *state = CreateRebalanceState(relationId, workerNodeList,
+													 options);
+
+		while (list_length(state->placementUpdateList) < remainingMoves)
+		{
+			if (MoveShardAwayFromDrainedNode(state))
+			{
+				continue;
+			}
+
+			if (options->drainOnly || !MoveShardToBalanceNodes(state))
+			{
+				break;
+			}
+		}
+
+		placementUpdateList = list_concat(placementUpdateList,
+										  state->placementUpdateList);
+	}
+
+	return placementUpdateList;
+}
+
+
+/*
+ * CreateRebalanceState computes the capacity of the given nodes and the cost
+ * of the active placements of the shards of the given table on them.
+ */
+static RebalanceState *
+CreateRebalanceState(Oid relationId, List *workerNodeList, RebalanceOptions *options)
+{
+	RebalanceState *state = palloc0(sizeof(RebalanceState));
+	Form_pg_dist_rebalance_strategy strategy = options->rebalanceStrategy;
+
+	state->options = options;
+
+	WorkerNode *workerNode = NULL;
+	foreach_ptr(workerNode, workerNodeList)
+	{
+		NodeFillState *fillState = palloc0(sizeof(NodeFillState));
+		fillState->node = workerNode;
+
+		if (workerNode->shouldHaveShards)
+		{
+			Datum capacityDatum = OidFunctionCall1(strategy->nodeCapacityFunction,
+												   Int32GetDatum(workerNode->nodeId));
+
+			fillState->capacity = DatumGetFloat4(capacityDatum);
+			if (fillState->capacity <= 0)
+			{
+				ereport(ERROR, (errmsg("capacity of node %s:%d must be positive",
+									   workerNode->workerName,
+									   workerNode->workerPort)));
+			}
+
+			state->totalCapacity += fillState->capacity;
+		}
+
+		state->fillStateList = lappend(state->fillStateList, fillState);
+	}
+
+	List *excludedShardIndexList = ExcludedShardIndexList(relationId,
+														  options->excludedShardArray);
+
+	List *shardIntervalList = LoadShardIntervalList(relationId);
+
+	ShardInterval *shardInterval = NULL;
+	foreach_ptr(shardInterval, shardIntervalList)
+	{
+		uint64 shardId = shardInterval->shardId;
+		bool excluded = list_member_int(excludedShardIndexList,
+										shardInterval->shardIndex);
+
+		Datum costDatum = OidFunctionCall1(strategy->shardCostFunction,
+										   Int64GetDatum(shardId));
+		float8 cost = DatumGetFloat4(costDatum);
+		if (cost < 0)
+		{
+			ereport(ERROR, (errmsg("cost of shard " UINT64_FORMAT " must not be "
+														   "negative", shardId)));
+		}
+
+		List *placementList = ActiveShardPlacementList(shardId);
+
+		ShardPlacement *placement = NULL;
+		foreach_ptr(placement, placementList)
+		{
+			NodeFillState *fillState = FindNodeFillState(state, placement->nodeId);
+			if (fillState == NULL)
+			{
+				/* placements on inactive nodes cannot be moved */
+				continue;
+			}
+
+			ShardCost *shardCost = palloc0(sizeof(ShardCost));
+			shardCost->shardId = shardId;
+			shardCost->cost = cost;
+			shardCost->movable = !excluded;
+
+			fillState->shardCostList = lappend(fillState->shardCostList, shardCost);
+			fillState->totalCost += cost;
+			state->totalCost += cost;
+		}
+	}
+
+	return state;
+}
+
+
+/*
+ * ExcludedShardIndexList returns the indexes of the shards of the given
+ * table's colocation group that are in the given array of excluded shard ids.
+ */
+static List *
+ExcludedShardIndexList(Oid relationId, ArrayType *excludedShardArray)
+{
+	List *excludedShardIndexList = NIL;
+
+	if (excludedShardArray == NULL)
+	{
+		return NIL;
+	}
+
+	int excludedShardCount = ArrayObjectCount(excludedShardArray);
+	if (excludedShardCount == 0)
+	{
+		return NIL;
+	}
+
+	Datum *excludedShardDatumArray = DeconstructArrayObject(excludedShardArray);
+	List *colocatedTableList = ColocatedTableList(relationId);
+
+	for (int shardIndex = 0; shardIndex < excludedShardCount; shardIndex++)
+	{
+		uint64 excludedShardId = DatumGetInt64(excludedShardDatumArray[shardIndex]);
+		ShardInterval *excludedShard = LoadShardInterval(excludedShardId);
+
+		if (list_member_oid(colocatedTableList, excludedShard->relationId))
+		{
+			excludedShardIndexList = lappend_int(excludedShardIndexList,
+												 excludedShard->shardIndex);
+		}
+	}
+
+	return excludedShardIndexList;
+}
+
+
+/*
+ * FindNodeFillState returns the fill state of the node with the given id, or
+ * NULL if the node is not an active primary.
+ */
+static NodeFillState *
+FindNodeFillState(RebalanceState *state, uint32 nodeId)
+{
+	NodeFillState *fillState = NULL;
+	foreach_ptr(fillState, state->fillStateList)
+	{
+		if (fillState->node->nodeId == nodeId)
+		{
+			return fillState;
+		}
+	}
+
+	return NULL;
+}
+
+
+/*
+ * MoveShardAwayFromDrainedNode plans a move of a shard from a node that should
+ * not have shards to the node that is utilized the least after the move, and
+ * returns whether it planned a move.
+ */
+static bool
+MoveShardAwayFromDrainedNode(RebalanceState *state)
+{
+	NodeFillState *sourceFillState = NULL;
+	foreach_ptr(sourceFillState, state->fillStateList)
+	{
+		if (sourceFillState->node->shouldHaveShards)
+		{
+			continue;
+		}
+
+		ShardCost *shardCost = NULL;
+		foreach_ptr(shardCost, sourceFillState->shardCostList)
+		{
+			if (!shardCost->movable)
+			{
+				continue;
+			}
+
+			NodeFillState *targetFillState = LeastUtilizedTargetNode(state, shardCost);
+			if (targetFillState == NULL)
+			{
+				ereport(WARNING, (errmsg("could not find a node for shard "
+										 UINT64_FORMAT " of node %s:%d, which should "
+													   "not have shards",
+										 shardCost->shardId,
+										 sourceFillState->node->workerName,
+										 sourceFillState->node->workerPort)));
+
+				shardCost->movable = false;
+				continue;
+			}
+
+			Oid relationId = LoadShardInterval(shardCost->shardId)->relationId;
+			ApplyPlacementUpdate(state, relationId, sourceFillState, targetFillState,
+								 shardCost);
+			return true;
+		}
+	}
+
+	return false;
+}
+
+
+/*
+ * MoveShardToBalanceNodes plans a move of a shard from a node that is utilized
+ * more to a node that is utilized less, of which at least one is outside of
+ * the threshold around the average utilization, and returns whether it planned
+ * a move. Of the shards that can move between the first such pair of nodes,
+ * it picks the shard with the highest cost which does not make the target
+ * node more utilized than the source node was.
+ */
+static bool
+MoveShardToBalanceNodes(RebalanceState *state)
+{
+	List *receivingFillStateList = NIL;
+
+	if (state->totalCapacity <= 0)
+	{
+		return false;
+	}
+
+	float8 averageUtilization = state->totalCost / state->totalCapacity;
+	float8 upperBound = averageUtilization * (1 + state->options->threshold);
+	float8 lowerBound = averageUtilization * (1 - state->options->threshold);
+
+	NodeFillState *fillState = NULL;
+	foreach_ptr(fillState, state->fillStateList)
+	{
+		if (fillState->node->shouldHaveShards)
+		{
+			receivingFillStateList = lappend(receivingFillStateList, fillState);
+		}
+	}
+
+	/* least utilized nodes first */
+	receivingFillStateList = SortList(receivingFillStateList,
+									  CompareNodeFillStateUtilization);
+
+	/* try to move shards away from the most utilized nodes first */
+	for (int sourceIndex = list_length(receivingFillStateList) - 1;
+		 sourceIndex >= 0; sourceIndex--)
+	{
+		NodeFillState *sourceFillState = list_nth(receivingFillStateList, sourceIndex);
+		float8 sourceUtilization = NodeUtilization(sourceFillState);
+
+		NodeFillState *targetFillState = NULL;
+		foreach_ptr(targetFillState, receivingFillStateList)
+		{
+			float8 targetUtilization = NodeUtilization(targetFillState);
+			if (targetUtilization >= sourceUtilization)
+			{
+				/* moving to this or any later node does not improve the balance */
+				break;
+			}
+
+			if (sourceUtilization <= upperBound && targetUtilization >= lowerBound)
+			{
+				/* both nodes are balanced well enough */
+				continue;
+			}
+
+			ShardCost *bestShardCost = NULL;
+
+			ShardCost *shardCost = NULL;
+			foreach_ptr(shardCost, sourceFillState->shardCostList)
+			{
+				float8 newTargetUtilization =
+					(targetFillState->totalCost + shardCost->cost) /
+					targetFillState->capacity;
+
+				if (newTargetUtilization >= sourceUtilization ||
+					(bestShardCost != NULL && bestShardCost->cost >= shardCost->cost) ||
+					!ShardCanMoveToNode(state, shardCost, targetFillState))
+				{
+					continue;
+				}
+
+				bestShardCost = shardCost;
+			}
+
+			if (bestShardCost != NULL)
+			{
+				Oid relationId = LoadShardInterval(bestShardCost->shardId)->relationId;
+				ApplyPlacementUpdate(state, relationId, sourceFillState,
+									 targetFillState, bestShardCost);
+				return true;
+			}
+		}
+	}
+
+	return false;
+}
+
+
+/*
+ * LeastUtilizedTargetNode returns the node that should have shards and is
+ * utilized the least after moving the given shard to it, of the nodes the
+ * shard can move to. It returns NULL if there is no such node.
+ */
+static NodeFillState *
+LeastUtilizedTargetNode(RebalanceState *state, ShardCost *shardCost)
+{
+	NodeFillState *bestFillState = NULL;
+	float8 bestUtilization = 0;
+
+	NodeFillState *fillState = NULL;
+	foreach_ptr(fillState, state->fillStateList)
+	{
+		if (!fillState->node->shouldHaveShards)
+		{
+			continue;
+		}
+
+		float8 newUtilization = (fillState->totalCost + shardCost->cost) /
+								fillState->capacity;
+		if (bestFillState != NULL && newUtilization >= bestUtilization)
+		{
+			continue;
+		}
+
+		if (!ShardCanMoveToNode(state, shardCost, fillState))
+		{
+			continue;
+		}
+
+		bestFillState = fillState;
+		bestUtilization = newUtilization;
+	}
+
+	return bestFillState;
+}
+
+
+/*
+ * ShardCanMoveToNode returns whether the given placement can move to the
+ * given node, which requires that the placement was not moved or excluded,
+ * that the node does not have a placement of the shard yet, and that the
+ * rebalance strategy allows the shard on the node.
+ */
+static bool
+ShardCanMoveToNode(RebalanceState *state, ShardCost *shardCost,
+				   NodeFillState *targetFillState)
+{
+	Oid shardAllowedOnNodeFunction =
+		state->options->rebalanceStrategy->shardAllowedOnNodeFunction;
+
+	if (!shardCost->movable)
+	{
+		return false;
+	}
+
+	ShardCost *targetShardCost = NULL;
+	foreach_ptr(targetShardCost, targetFillState->shardCostList)
+	{
+		if (targetShardCost->shardId == shardCost->shardId)
+		{
+			return false;
+		}
+	}
+
+	Datum allowedDatum = OidFunctionCall2(shardAllowedOnNodeFunction,
+										  Int64GetDatum(shardCost->shardId),
+										  Int32GetDatum(targetFillState->node->nodeId));
+
+	return DatumGetBool(allowedDatum);
+}
+
+
+/*
+ * ApplyPlacementUpdate records a move of the given placement from the source
+ * node to the target node and updates the fill states accordingly.
+ */
+static void
+ApplyPlacementUpdate(RebalanceState *state, Oid relationId,
+					 NodeFillState *sourceFillState, NodeFillState *targetFillState,
+					 ShardCost *shardCost)
+{
+	PlacementUpdateEvent *move = palloc0(sizeof(PlacementUpdateEvent));
+	move->relationId = relationId;
+	move->shardId = shardCost->shardId;
+	move->sourceNode = sourceFillState->node;
+	move->targetNode = targetFillState->node;
+
+	state->placementUpdateList = lappend(state->placementUpdateList, move);
+
+	/* every placement moves at most once */
+	shardCost->movable = false;
+
+	sourceFillState->shardCostList = list_delete_ptr(sourceFillState->shardCostList,
+													 shardCost);
+	sourceFillState->totalCost -= shardCost->cost;
+
+	targetFillState->shardCostList = lappend(targetFillState->shardCostList,
+											 shardCost);
+	targetFillState->totalCost += shardCost->cost;
+}
+
+
+/*
+ * NodeUtilization returns the total cost of the shards on the node divided by
+ * its capacity.
+ */
+static float8
+NodeUtilization(NodeFillState *fillState)
+{
+	return fillState->totalCost / fillState->capacity;
+}
+
+
+/*
+ * CompareNodeFillStateUtilization orders node fill states by utilization, and
+ * by node id for nodes that are utilized equally.
+ */
+static int
+CompareNodeFillStateUtilization(const void *leftElement, const void *rightElement)
+{
+	NodeFillState *leftFillState = *((NodeFillState **) leftElement);
+	NodeFillState *rightFillState = *((NodeFillState **) rightElement);
+	float8 leftUtilization = NodeUtilization(leftFillState);
+	float8 rightUtilization = NodeUtilization(rightFillState);
+
+	if (leftUtilization < rightUtilization)
+	{
+		return -1;
+	}
+	else if (leftUtilization > rightUtilization)
+	{
+		return 1;
+	}
+
+	if (leftFillState->node->nodeId < rightFillState->node->nodeId)
+	{
+		return -1;
+	}
+	else if (leftFillState->node->nodeId > rightFillState->node->nodeId)
+	{
+		return 1;
+	}
+
+	return 0;
+}
+
+
+/*
+ * ShardGroupSizeOnNode returns the total size of the given shard and the
+ * shards that are colocated with it on the given node.
+ */
+static uint64
+ShardGroupSizeOnNode(ShardInterval *shardInterval, char *nodeName, int nodePort)
+{
+	uint32 connectionFlags = 0;
+	PGresult *result = NULL;
+	bool raiseErrors = true;
+
+	List *colocatedShardList = ColocatedShardIntervalList(shardInterval);
+	StringInfo sizeQuery = GenerateSizeQueryOnMultiplePlacements(
+		colocatedShardList, PG_TOTAL_RELATION_SIZE_FUNCTION);
+
+	MultiConnection *connection = GetNodeConnection(connectionFlags, nodeName,
+													nodePort);
+	int queryResult = ExecuteOptionalRemoteCommand(connection, sizeQuery->data,
+												   &result);
+	if (queryResult != RESPONSE_OKAY)
+	{
+		ereport(ERROR, (errcode(ERRCODE_CONNECTION_FAILURE),
+						errmsg("cannot get the size of shard " UINT64_FORMAT
+							   " on %s:%d", shardInterval->shardId, nodeName,
+							   nodePort)));
+	}
+
+	List *sizeList = ReadFirstColumnAsText(result);
+	StringInfo sizeString = (StringInfo) linitial(sizeList);
+	uint64 shardGroupSize = SafeStringToUint64(sizeString->data);
+
+	PQclear(result);
+	ClearResults(connection, raiseErrors);
+
+	return shardGroupSize;
+}
+
+
+/*
+ * RebalanceTableShards plans the moves for the given options and executes
+ * them using the given shard transfer mode.
+ */
+static void
+RebalanceTableShards(RebalanceOptions *options, Oid shardTransferModeOid)
+{
+	Datum transferModeDatum = DirectFunctionCall1(enum_out, shardTransferModeOid);
+	char *shardTransferMode = DatumGetCString(transferModeDatum);
+
+	Oid relationId = InvalidOid;
+	foreach_oid(relationId, options->relationIdList)
+	{
+		AcquireRebalanceColocationLock(relationId);
+	}
+
+	List *placementUpdateList = GetRebalanceSteps(options);
+
+	if (RebalancerMaxMoveRate > 0)
+	{
+		PlacementUpdateEvent *move = NULL;
+		foreach_ptr(move, placementUpdateList)
+		{
+			ShardInterval *shardInterval = LoadShardInterval(move->shardId);
+
+			move->shardSize = ShardGroupSizeOnNode(shardInterval,
+												   move->sourceNode->workerName,
+												   move->sourceNode->workerPort);
+		}
+	}
+
+	ExecutePlacementUpdates(placementUpdateList, shardTransferMode);
+}
+
+
+/*
+ * ExecutePlacementUpdates runs the given moves, starting every move as soon as
+ * the concurrency limits and the move rate allow it. Moves that finished are
+ * committed. If a move fails, the running moves are cancelled and the error
+ * is rethrown.
+ */
+static void
+ExecutePlacementUpdates(List *placementUpdateList, char *shardTransferMode)
+{
+	RebalanceExecution *execution = palloc0(sizeof(RebalanceExecution));
+	execution->pendingMoveList = placementUpdateList;
+	execution->shardTransferMode = shardTransferMode;
+	execution->startTime = GetCurrentTimestamp();
+
+	PG_TRY();
+	{
+		while (execution->pendingMoveList != NIL || execution->runningMoveList != NIL)
+		{
+			StartPendingMoves(execution);
+
+			if (!FinishRunningMoves(execution))
+			{
+				WaitForRebalancerPoll();
+			}
+		}
+	}
+	PG_CATCH();
+	{
+		PlacementUpdateEvent *move = NULL;
+		foreach_ptr(move, execution->runningMoveList)
+		{
+			if (move->connection != NULL)
+			{
+				SendCancelationRequest(move->connection);
+			}
+		}
+
+		PG_RE_THROW();
+	}
+	PG_END_TRY();
+}
+
+
+/*
+ * StartPendingMoves starts the pending moves whose nodes are not busy with
+ * other moves, in the order of the plan, as long as the concurrency limits
+ * and the move rate allow it.
+ */
+static void
+StartPendingMoves(RebalanceExecution *execution)
+{
+	List *stillPendingMoveList = NIL;
+
+	PlacementUpdateEvent *move = NULL;
+	foreach_ptr(move, execution->pendingMoveList)
+	{
+		List *runningMoveList = execution->runningMoveList;
+
+		if (list_length(runningMoveList) >= MaxRebalancerParallelMoves ||
+			MoveRateExceeded(execution) ||
+			RunningMoveCountOnNode(runningMoveList, move->sourceNode) >=
+			MaxRebalancerMovesPerNode ||
+			RunningMoveCountOnNode(runningMoveList, move->targetNode) >=
+			MaxRebalancerMovesPerNode)
+		{
+			stillPendingMoveList = lappend(stillPendingMoveList, move);
+			continue;
+		}
+
+		StartPlacementMove(move, execution->shardTransferMode);
+
+		execution->bytesStarted += move->shardSize;
+		execution->runningMoveList = lappend(execution->runningMoveList, move);
+	}
+
+	execution->pendingMoveList = stillPendingMoveList;
+}
+
+
+/*
+ * MoveRateExceeded returns whether starting another move would exceed
+ * citus.rebalancer_max_move_rate, that is when the started moves already
+ * moved more data than the rate allows since the start of the execution.
+ */
+static bool
+MoveRateExceeded(RebalanceExecution *execution)
+{
+	long elapsedSeconds = 0;
+	int elapsedMicroseconds = 0;
+
+	if (RebalancerMaxMoveRate <= 0)
+	{
+		return false;
+	}
+
+	TimestampDifference(execution->startTime, GetCurrentTimestamp(),
+						&elapsedSeconds, &elapsedMicroseconds);
+
+	float8 elapsedTime = elapsedSeconds + elapsedMicroseconds / 1000000.0;
+	float8 allowedBytes = elapsedTime * RebalancerMaxMoveRate * 1024.0;
+
+	return execution->bytesStarted > allowedBytes;
+}
+
+
+/*
+ * RunningMoveCountOnNode returns the number of running moves from or to the
+ * given node.
+ */
+static int
+RunningMoveCountOnNode(List *runningMoveList, WorkerNode *workerNode)
+{
+	int runningMoveCount = 0;
+
+	PlacementUpdateEvent *move = NULL;
+	foreach_ptr(move, runningMoveList)
+	{
+		if (move->sourceNode->nodeId == workerNode->nodeId ||
+			move->targetNode->nodeId == workerNode->nodeId)
+		{
+			runningMoveCount++;
+		}
+	}
+
+	return runningMoveCount;
+}
+
+
+/*
+ * StartPlacementMove sends a master_move_shard_placement call for the given
+ * move over a new connection to the coordinator itself, without waiting for
+ * the result.
+ */
+static void
+StartPlacementMove(PlacementUpdateEvent *move, char *shardTransferMode)
+{
+	StringInfo moveCommand = makeStringInfo();
+	int connectionFlags = FORCE_NEW_CONNECTION;
+
+	appendStringInfo(moveCommand,
+					 "SELECT pg_catalog.master_move_shard_placement(" UINT64_FORMAT
+					 ", %s, %u, %s, %u, shard_transfer_mode := %s)",
+					 move->shardId,
+					 quote_literal_cstr(move->sourceNode->workerName),
+					 move->sourceNode->workerPort,
+					 quote_literal_cstr(move->targetNode->workerName),
+					 move->targetNode->workerPort,
+					 quote_literal_cstr(shardTransferMode));
+
+	ereport(NOTICE, (errmsg("Moving shard " UINT64_FORMAT " from %s:%u to %s:%u ...",
+							move->shardId, move->sourceNode->workerName,
+							move->sourceNode->workerPort,
+							move->targetNode->workerName,
+							move->targetNode->workerPort)));
+
+	MultiConnection *connection =
+		GetNodeUserDatabaseConnection(connectionFlags, LOCAL_HOST_NAME, PostPortNumber,
+									  NULL, NULL);
+	if (PQstatus(connection->pgConn) != CONNECTION_OK)
+	{
+		ReportConnectionError(connection, ERROR);
+	}
+
+	int querySent = SendRemoteCommand(connection, moveCommand->data);
+	if (querySent == 0)
+	{
+		ReportConnectionError(connection, ERROR);
+	}
+
+	move->connection = connection;
+}
+
+
+/*
+ * FinishRunningMoves checks which of the running moves finished, errors out if
+ * one of them failed, and returns whether any move finished.
+ */
+static bool
+FinishRunningMoves(RebalanceExecution *execution)
+{
+	List *stillRunningMoveList = NIL;
+	bool raiseInterrupts = true;
+	bool anyMoveFinished = false;
+
+	PlacementUpdateEvent *move = NULL;
+	foreach_ptr(move, execution->runningMoveList)
+	{
+		MultiConnection *connection = move->connection;
+
+		if (PQconsumeInput(connection->pgConn) == 0)
+		{
+			ReportConnectionError(connection, ERROR);
+		}
+
+		if (PQisBusy(connection->pgConn))
+		{
+			stillRunningMoveList = lappend(stillRunningMoveList, move);
+			continue;
+		}
+
+		PGresult *result = GetRemoteCommandResult(connection, raiseInterrupts);
+		if (!IsResponseOK(result))
+		{
+			ReportResultError(connection, result, ERROR);
+		}
+
+		PQclear(result);
+		ForgetResults(connection);
+		CloseConnection(connection);
+
+		move->connection = NULL;
+		anyMoveFinished = true;
+	}
+
+	execution->runningMoveList = stillRunningMoveList;
+
+	return anyMoveFinished;
+}
+
+
+/*
+ * ExecuteRebalancerCommandInSeparateTransaction runs the given command over a
+ * new connection to the coordinator itself, such that it commits immediately.
+ */
+static void
+ExecuteRebalancerCommandInSeparateTransaction(char *command)
+{
+	int connectionFlags = FORCE_NEW_CONNECTION;
+
+	MultiConnection *connection =
+		GetNodeUserDatabaseConnection(connectionFlags, LOCAL_HOST_NAME, PostPortNumber,
+									  NULL, NULL);
+
+	ExecuteCriticalRemoteCommand(connection, command);
+	CloseConnection(connection);
+}
+
+
+/*
+ * WaitForRebalancerPoll sleeps until it is time to check the running moves
+ * again, while remaining responsive to cancellation.
+ */
+static void
+WaitForRebalancerPoll(void)
+{
+	int rc = WaitLatch(MyLatch, WL_LATCH_SET | WL_TIMEOUT | WL_POSTMASTER_DEATH,
+					   REBALANCER_POLL_INTERVAL_MS, PG_WAIT_EXTENSION);
+
+	ResetLatch(MyLatch);
+
+	if (rc & WL_POSTMASTER_DEATH)
+	{
+		proc_exit(1);
+	}
+
+	CHECK_FOR_INTERRUPTS();
+}
+
+
 /*
  * citus_rebalance_strategy_enterprise_check is trigger function, intended for
  * use in prohibiting writes to pg_dist_rebalance_strategy in Citus Community.
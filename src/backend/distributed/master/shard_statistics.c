@@ -0,0 +1,280 @@
+/*-------------------------------------------------------------------------
+ *
+ * shard_statistics.c
+ *   Keeps the shard sizes in pg_dist_placement up to date for tables other
+ *   than append-distributed tables, whose sizes are updated when data is
+ *   appended.
+ *
+ *   The planner uses the recorded sizes to pick repartition join orders, to
+ *   broadcast small tables in joins and to decide on inlining CTEs, but
+ *   without this refresh they are only set by master_update_shard_statistics.
+ *   Every citus.shard_statistics_refresh_interval, the maintenance daemon on
+ *   the coordinator sends a single query per node for the sizes of all the
+ *   placements on that node, to all nodes concurrently.
+ *
+ * Copyright (c) Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include "postgres.h"
+
+#include "libpq-fe.h"
+#include "miscadmin.h"
+
+#include "distributed/citus_safe_lib.h"
+#include "distributed/connection_management.h"
+#include "distributed/listutils.h"
+#include "distributed/master_metadata_utility.h"
+#include "distributed/master_protocol.h"
+#include "distributed/metadata_cache.h"
+#include "distributed/remote_commands.h"
+#include "distributed/shard_statistics.h"
+#include "distributed/worker_manager.h"
+#include "distributed/worker_protocol.h"
+#include "utils/builtins.h"
+#include "utils/lsyscache.h"
+
+
+/*
+ * Recorded sizes are only updated when they change by more than this
+ * fraction, since every update invalidates the cached plans on the table.
+ */
+#define SHARD_SIZE_CHANGE_THRESHOLD 0.1
+
+
+/* GUC, milliseconds between refreshes of the shard sizes, 0 disables them */
+int ShardStatisticsRefreshInterval = 0;
+
+
+static List * PlacementsToRefreshOnGroup(List *citusTableList, int32 groupId);
+static char * ShardSizeQuery(List *placementList);
+static void UpdateChangedShardSizes(MultiConnection *connection,
+									List *placementList);
+static bool ShardSizeChanged(uint64 recordedSize, uint64 currentSize);
+
+
+/*
+ * RefreshShardStatistics fetches the sizes of the placements on all active
+ * primary nodes and records the ones that changed in pg_dist_placement. It
+ * only runs on the coordinator, since pg_dist_placement is synced from there.
+ */
+void
+RefreshShardStatistics(void)
+{
+	List *connectionList = NIL;
+	List *placementListList = NIL;
+	uint32 connectionFlags = 0;
+	bool raiseInterrupts = true;
+
+	if (!IsCoordinator())
+	{
+		return;
+	}
+
+	List *citusTableList = CitusTableList();
+	List *workerNodeList = ActivePrimaryNodeList(NoLock);
+
+	WorkerNode *workerNode = NULL;
+	foreach_ptr(workerNode, workerNodeList)
+	{
+		List *placementList = PlacementsToRefreshOnGroup(citusTableList,
+														 workerNode->groupId);
+		if (placementList == NIL)
+		{
+			continue;
+		}
+
+		MultiConnection *connection = StartNodeConnection(connectionFlags,
+														  workerNode->workerName,
+														  workerNode->workerPort);
+
+		connectionList = lappend(connectionList, connection);
+		placementListList = lappend(placementListList, placementList);
+	}
+
+	if (connectionList == NIL)
+	{
+		return;
+	}
+
+	FinishConnectionListEstablishment(connectionList);
+
+	List *sentConnectionList = NIL;
+	List *sentPlacementListList = NIL;
+
+	ListCell *connectionCell = NULL;
+	ListCell *placementListCell = NULL;
+	forboth(connectionCell, connectionList, placementListCell, placementListList)
+	{
+		MultiConnection *connection = (MultiConnection *) lfirst(connectionCell);
+		List *placementList = (List *) lfirst(placementListCell);
+
+		if (SendRemoteCommand(connection, ShardSizeQuery(placementList)) == 0)
+		{
+			ReportConnectionError(connection, WARNING);
+			continue;
+		}
+
+		sentConnectionList = lappend(sentConnectionList, connection);
+		sentPlacementListList = lappend(sentPlacementListList, placementList);
+	}
+
+	/* let the nodes compute the sizes concurrently before reading any result */
+	if (list_length(sentConnectionList) > 1)
+	{
+		WaitForAllConnections(sentConnectionList, raiseInterrupts);
+	}
+
+	forboth(connectionCell, sentConnectionList, placementListCell,
+			sentPlacementListList)
+	{
+		MultiConnection *connection = (MultiConnection *) lfirst(connectionCell);
+		List *placementList = (List *) lfirst(placementListCell);
+
+		UpdateChangedShardSizes(connection, placementList);
+	}
+}
+
+
+/*
+ * PlacementsToRefreshOnGroup returns copies of the placements on the given
+ * group of the tables whose shard sizes are not otherwise kept up to date.
+ * The placements are copied because updating pg_dist_placement invalidates
+ * the metadata cache entries they come from.
+ */
+static List *
+PlacementsToRefreshOnGroup(List *citusTableList, int32 groupId)
+{
+	List *placementList = NIL;
+
+	CitusTableCacheEntry *cacheEntry = NULL;
+	foreach_ptr(cacheEntry, citusTableList)
+	{
+		Oid relationId = cacheEntry->relationId;
+
+		/* reference tables are never repartitioned, cstore sizes differ */
+		if (cacheEntry->partitionMethod == DISTRIBUTE_BY_APPEND ||
+			cacheEntry->partitionMethod == DISTRIBUTE_BY_NONE ||
+			CStoreTable(relationId))
+		{
+			continue;
+		}
+
+		List *groupPlacementList = GroupShardPlacementsForTableOnGroup(relationId,
+																	   groupId);
+
+		GroupShardPlacement *groupPlacement = NULL;
+		foreach_ptr(groupPlacement, groupPlacementList)
+		{
+			GroupShardPlacement *placementCopy = palloc0(sizeof(GroupShardPlacement));
+			*placementCopy = *groupPlacement;
+
+			placementList = lappend(placementList, placementCopy);
+		}
+	}
+
+	return placementList;
+}
+
+
+/*
+ * ShardSizeQuery returns a query for the sizes of the given placements, in
+ * the same order. Shards that do not exist, for instance because they were
+ * dropped concurrently, have a NULL size.
+ */
+static char *
+ShardSizeQuery(List *placementList)
+{
+	StringInfo shardNameArray = makeStringInfo();
+	StringInfo sizeQuery = makeStringInfo();
+
+	appendStringInfoString(shardNameArray, "ARRAY[");
+
+	GroupShardPlacement *placement = NULL;
+	foreach_ptr(placement, placementList)
+	{
+		uint64 shardId = placement->shardId;
+		Oid relationId = RelationIdForShard(shardId);
+		char *shardName = get_rel_name(relationId);
+		char *schemaName = get_namespace_name(get_rel_namespace(relationId));
+
+		AppendShardIdToName(&shardName, shardId);
+
+		if (placement != linitial(placementList))
+		{
+			appendStringInfoString(shardNameArray, ",");
+		}
+
+		appendStringInfoString(shardNameArray,
+							   quote_literal_cstr(quote_qualified_identifier(schemaName,
+																			 shardName)));
+	}
+
+	appendStringInfoString(shardNameArray, "]::text[]");
+
+	appendStringInfo(sizeQuery,
+					 "SELECT pg_table_size(to_regclass(shard_name)) "
+					 "FROM unnest(%s) WITH ORDINALITY AS shards(shard_name, shard_index) "
+					 "ORDER BY shard_index",
+					 shardNameArray->data);
+
+	return sizeQuery->data;
+}
+
+
+/*
+ * UpdateChangedShardSizes reads the sizes of the given placements from the
+ * result of ShardSizeQuery on the connection, and updates the placements
+ * whose size changed.
+ */
+static void
+UpdateChangedShardSizes(MultiConnection *connection, List *placementList)
+{
+	bool raiseInterrupts = true;
+	bool raiseErrors = false;
+
+	PGresult *result = GetRemoteCommandResult(connection, raiseInterrupts);
+	if (!IsResponseOK(result) || PQntuples(result) != list_length(placementList))
+	{
+		ReportResultError(connection, result, WARNING);
+		PQclear(result);
+		ClearResults(connection, raiseErrors);
+
+		return;
+	}
+
+	int rowIndex = 0;
+	GroupShardPlacement *placement = NULL;
+	foreach_ptr(placement, placementList)
+	{
+		if (!PQgetisnull(result, rowIndex, 0))
+		{
+			uint64 shardSize = SafeStringToUint64(PQgetvalue(result, rowIndex, 0));
+
+			if (ShardSizeChanged(placement->shardLength, shardSize))
+			{
+				UpdateShardPlacementLength(placement->placementId, shardSize);
+			}
+		}
+
+		rowIndex++;
+	}
+
+	PQclear(result);
+	ClearResults(connection, raiseErrors);
+}
+
+
+/*
+ * ShardSizeChanged returns whether the current size of a shard differs from
+ * its recorded size by more than SHARD_SIZE_CHANGE_THRESHOLD.
+ */
+static bool
+ShardSizeChanged(uint64 recordedSize, uint64 currentSize)
+{
+	uint64 sizeDifference = (currentSize > recordedSize) ? currentSize - recordedSize :
+							recordedSize - currentSize;
+
+	return sizeDifference > SHARD_SIZE_CHANGE_THRESHOLD * recordedSize;
+}
@@ -40,6 +40,7 @@
 
 static int ExecuteCommandAsSuperuser(char *query, int paramCount, Oid *paramTypes,
 									 Datum *paramValues);
+static bool IsObjectInDistObjectTable(const ObjectAddress *address);
 
 PG_FUNCTION_INFO_V1(master_unmark_object_distributed);
 
@@ -246,10 +247,32 @@ UnmarkObjectDistributed(const ObjectAddress *address)
 
 /*
  * IsObjectDistributed returns if the object addressed is already distributed in the
- * cluster. This performs a local indexed lookup in pg_dist_object.
+ * cluster. The dependency walk calls this for every dependency of every object that
+ * is created or altered, hence the answer comes from the DistObjectCacheHash, which
+ * is invalidated whenever pg_dist_object changes.
  */
 bool
 IsObjectDistributed(const ObjectAddress *address)
+{
+	DistObjectCacheEntry *cacheEntry = LookupDistObjectCacheEntry(address->classId,
+																  address->objectId,
+																  address->objectSubId);
+	if (cacheEntry == NULL)
+	{
+		/* the cache is not available while the extension is being created or updated */
+		return IsObjectInDistObjectTable(address);
+	}
+
+	return cacheEntry->isDistributed;
+}
+
+
+/*
+ * IsObjectInDistObjectTable returns if the object addressed has a record in
+ * pg_dist_object. This performs a local indexed lookup in pg_dist_object.
+ */
+static bool
+IsObjectInDistObjectTable(const ObjectAddress *address)
 {
 	ScanKeyData key[3];
 	bool result = false;
@@ -39,17 +39,23 @@
 #include "distributed/metadata/pg_dist_object.h"
 #include "distributed/metadata_cache.h"
 #include "distributed/multi_executor.h"
+#include "distributed/multi_router_planner.h"
 #include "distributed/pg_dist_local_group.h"
 #include "distributed/pg_dist_node_metadata.h"
 #include "distributed/pg_dist_node.h"
 #include "distributed/pg_dist_partition.h"
 #include "distributed/pg_dist_shard.h"
 #include "distributed/pg_dist_placement.h"
+#include "distributed/pg_dist_poolinfo.h"
+#include "distributed/relation_restriction_equivalence.h"
+#include "distributed/secondary_node_stats.h"
 #include "distributed/shared_library_init.h"
+#include "distributed/shared_metadata_cache.h"
 #include "distributed/shardinterval_utils.h"
 #include "distributed/version_compat.h"
 #include "distributed/worker_manager.h"
 #include "distributed/worker_protocol.h"
+#include "distributed/worker_shard_visibility.h"
 #include "executor/executor.h"
 #include "nodes/makefuncs.h"
 #include "nodes/memnodes.h"
@@ -119,6 +125,8 @@ typedef struct MetadataCacheData
 	Oid distNodeRelationId;
 	Oid distNodeNodeIdIndexId;
 	Oid distLocalGroupRelationId;
+	Oid distPoolinfoRelationId;
+	Oid distPoolinfoIndexId;
 	Oid distObjectRelationId;
 	Oid distObjectPrimaryKeyIndexId;
 	Oid distColocationRelationId;
@@ -161,6 +169,9 @@ static MetadataCacheData MetadataCache;
 /* Citus extension version variables */
 bool EnableVersionChecks = true; /* version checks are enabled */
 
+/* patch cache entries in place when only the placements of a table changed */
+bool EnableShardLevelCacheInvalidation = false;
+
 static bool citusVersionKnownCompatible = false;
 
 /* Hash table for informations about each partition */
@@ -168,6 +179,18 @@ static HTAB *DistTableCacheHash = NULL;
 
 /* Hash table for informations about each shard */
 static HTAB *DistShardCacheHash = NULL;
+
+/*
+ * Direct-mapped cache of DistShardCacheHash entries, indexed by the low bits
+ * of the shard id. The shards of a table have consecutive identifiers, hence
+ * lookups of the shards of a table with up to SHARD_LOOKUP_CACHE_SIZE shards
+ * never evict each other, and skip hashing the shard id.
+ */
+#define SHARD_LOOKUP_CACHE_SIZE 1024
+#define ShardLookupCacheIndex(shardId) \
+	((uint64) (shardId) & (SHARD_LOOKUP_CACHE_SIZE - 1))
+
+static ShardCacheEntry *ShardLookupCache[SHARD_LOOKUP_CACHE_SIZE];
 static MemoryContext MetadataCacheMemoryContext = NULL;
 
 /* Hash table for information about each object */
@@ -194,7 +217,28 @@ static ShardCacheEntry * LookupShardCacheEntry(int64 shardId);
 static CitusTableCacheEntry * LookupCitusTableCacheEntry(Oid relationId);
 static void BuildCitusTableCacheEntry(CitusTableCacheEntry *cacheEntry);
 static void BuildCachedShardList(CitusTableCacheEntry *cacheEntry);
+static bool RevalidateCitusTableCacheEntry(CitusTableCacheEntry *cacheEntry);
+static GroupShardPlacement * FindGroupShardPlacement(ShardCacheEntry *shardEntry,
+													 uint64 placementId);
+static bool CachedDistPartitionUnchanged(CitusTableCacheEntry *cacheEntry);
+static bool CachedShardIntervalsUnchanged(CitusTableCacheEntry *cacheEntry);
+static bool CachedShardIntervalEquals(CitusTableCacheEntry *cacheEntry,
+									  ShardInterval *cachedInterval,
+									  ShardInterval *newInterval);
+static void RefreshCachedPlacements(CitusTableCacheEntry *cacheEntry);
+static bool PlacementListMatchesArray(List *placementList,
+									  GroupShardPlacement *placementArray,
+									  int placementArrayLength);
+static SharedShardMetadata * DistShardTupleToSharedShardMetadata(HeapTuple heapTuple,
+																 TupleDesc
+																 tupleDescriptor);
+static ShardInterval * SharedShardMetadataToShardInterval(SharedShardMetadata *
+														  shardMetadata,
+														  Oid relationId,
+														  Oid intervalTypeId,
+														  int32 intervalTypeMod);
 static void PrepareWorkerNodeCache(void);
+static WorkerNode * LookupLagBoundedNodeForGroup(int32 groupId);
 static bool CheckInstalledVersion(int elevel);
 static char * AvailableExtensionVersion(void);
 static char * InstalledExtensionVersion(void);
@@ -207,6 +251,11 @@ static void RegisterForeignKeyGraphCacheCallbacks(void);
 static void RegisterWorkerNodeCacheCallbacks(void);
 static void RegisterLocalGroupIdCacheCallbacks(void);
 static uint32 WorkerNodeHashCode(const void *key, Size keySize);
+static void BuildCumulativeMaxShardIndexArray(CitusTableCacheEntry *cacheEntry,
+											  ShardInterval **sortedShardIntervalArray,
+											  int shardIntervalArrayLength,
+											  FmgrInfo *shardIntervalCompareFunction);
+static void BuildHashBucketShardIndexArray(CitusTableCacheEntry *cacheEntry);
 static void ResetCitusTableCacheEntry(CitusTableCacheEntry *cacheEntry);
 static void CreateDistTableCache(void);
 static void CreateDistObjectCache(void);
@@ -422,6 +471,40 @@ GroupShardPlacement *
 LoadGroupShardPlacement(uint64 shardId, uint64 placementId)
 {
 	ShardCacheEntry *shardEntry = LookupShardCacheEntry(shardId);
+	GroupShardPlacement *cachedPlacement = FindGroupShardPlacement(shardEntry,
+																   placementId);
+
+	GroupShardPlacement *shardPlacement = CitusMakeNode(GroupShardPlacement);
+	*shardPlacement = *cachedPlacement;
+
+	return shardPlacement;
+}
+
+
+/*
+ * LoadShardPlacement returns a shard placement for the primary node.
+ */
+ShardPlacement *
+LoadShardPlacement(uint64 shardId, uint64 placementId)
+{
+	ShardCacheEntry *shardEntry = LookupShardCacheEntry(shardId);
+	GroupShardPlacement *groupPlacement = FindGroupShardPlacement(shardEntry,
+																  placementId);
+	ShardPlacement *nodePlacement = ResolveGroupShardPlacement(groupPlacement,
+															   shardEntry);
+
+	return nodePlacement;
+}
+
+
+/*
+ * FindGroupShardPlacement returns the cached placement with the given id of
+ * the shard of the given cache entry, or errors out if there is none. The
+ * returned placement points into the cache and must not be modified.
+ */
+static GroupShardPlacement *
+FindGroupShardPlacement(ShardCacheEntry *shardEntry, uint64 placementId)
+{
 	CitusTableCacheEntry *tableEntry = shardEntry->tableEntry;
 
 	/* the offset better be in a valid range */
@@ -436,11 +519,7 @@ LoadGroupShardPlacement(uint64 shardId, uint64 placementId)
 	{
 		if (placementArray[i].placementId == placementId)
 		{
-			GroupShardPlacement *shardPlacement = CitusMakeNode(GroupShardPlacement);
-
-			*shardPlacement = placementArray[i];
-
-			return shardPlacement;
+			return &placementArray[i];
 		}
 	}
 
@@ -450,17 +529,26 @@ LoadGroupShardPlacement(uint64 shardId, uint64 placementId)
 
 
 /*
- * LoadShardPlacement returns a shard placement for the primary node.
+ * CachedGroupShardPlacementArray returns the cached placements of the given
+ * shard and sets placementCount to their number. Unlike ShardPlacementList,
+ * this does not copy the placements, which makes it suitable for hot code
+ * paths that only need to inspect the groups and states of the placements.
+ *
+ * The returned array points into the metadata cache. It must not be modified,
+ * and is only valid until the next invalidation message is processed.
  */
-ShardPlacement *
-LoadShardPlacement(uint64 shardId, uint64 placementId)
+GroupShardPlacement *
+CachedGroupShardPlacementArray(uint64 shardId, int *placementCount)
 {
 	ShardCacheEntry *shardEntry = LookupShardCacheEntry(shardId);
-	GroupShardPlacement *groupPlacement = LoadGroupShardPlacement(shardId, placementId);
-	ShardPlacement *nodePlacement = ResolveGroupShardPlacement(groupPlacement,
-															   shardEntry);
+	CitusTableCacheEntry *tableEntry = shardEntry->tableEntry;
 
-	return nodePlacement;
+	/* the offset better be in a valid range */
+	Assert(shardEntry->shardIndex < tableEntry->shardIntervalArrayLength);
+
+	*placementCount = tableEntry->arrayOfPlacementArrayLengths[shardEntry->shardIndex];
+
+	return tableEntry->arrayOfPlacementArrays[shardEntry->shardIndex];
 }
 
 
@@ -602,6 +690,12 @@ LookupNodeForGroup(int32 groupId)
 
 	PrepareWorkerNodeCache();
 
+	if (ReadFromSecondaries == USE_SECONDARY_NODES_ALWAYS &&
+		MaxSecondaryReplicationLag != DISABLE_SECONDARY_LAG_ROUTING)
+	{
+		return LookupLagBoundedNodeForGroup(groupId);
+	}
+
 	for (int workerNodeIndex = 0; workerNodeIndex < WorkerNodeCount; workerNodeIndex++)
 	{
 		WorkerNode *workerNode = WorkerNodeArray[workerNodeIndex];
@@ -649,6 +743,57 @@ LookupNodeForGroup(int32 groupId)
 }
 
 
+/*
+ * LookupLagBoundedNodeForGroup returns the least loaded secondary of the given
+ * group whose replication lag is within citus.max_secondary_replication_lag.
+ * If none of the secondaries is within the bound, reads go to the primary of
+ * the group, such that they never see data that is older than the bound.
+ */
+static WorkerNode *
+LookupLagBoundedNodeForGroup(int32 groupId)
+{
+	List *secondaryNodeList = NIL;
+	WorkerNode *primaryNode = NULL;
+
+	for (int workerNodeIndex = 0; workerNodeIndex < WorkerNodeCount; workerNodeIndex++)
+	{
+		WorkerNode *workerNode = WorkerNodeArray[workerNodeIndex];
+		if (workerNode->groupId != groupId)
+		{
+			continue;
+		}
+
+		if (NodeIsSecondary(workerNode))
+		{
+			secondaryNodeList = lappend(secondaryNodeList, workerNode);
+		}
+		else if (NodeIsPrimary(workerNode))
+		{
+			primaryNode = workerNode;
+		}
+	}
+
+	WorkerNode *secondaryNode = ChooseSecondaryNode(secondaryNodeList);
+	if (secondaryNode != NULL)
+	{
+		return secondaryNode;
+	}
+
+	if (primaryNode == NULL)
+	{
+		ereport(ERROR, (errmsg("node group %d does not have a secondary node within "
+							   "citus.max_secondary_replication_lag or a primary node",
+							   groupId)));
+	}
+
+	ereport(DEBUG2, (errmsg("routing reads of node group %d to the primary since "
+							"no secondary is within "
+							"citus.max_secondary_replication_lag", groupId)));
+
+	return primaryNode;
+}
+
+
 /*
  * ShardPlacementList returns the list of placements for the given shard from
  * the cache.
@@ -706,9 +851,21 @@ LookupShardCacheEntry(int64 shardId)
 
 	InitializeCaches();
 
-	/* lookup cache entry */
-	ShardCacheEntry *shardEntry = hash_search(DistShardCacheHash, &shardId, HASH_FIND,
-											  &foundInCache);
+	/* lookup cache entry, first in the direct-mapped cache */
+	ShardCacheEntry *shardEntry = ShardLookupCache[ShardLookupCacheIndex(shardId)];
+	if (shardEntry != NULL && shardEntry->shardId == shardId)
+	{
+		foundInCache = true;
+	}
+	else
+	{
+		shardEntry = hash_search(DistShardCacheHash, &shardId, HASH_FIND,
+								 &foundInCache);
+		if (foundInCache)
+		{
+			ShardLookupCache[ShardLookupCacheIndex(shardId)] = shardEntry;
+		}
+	}
 
 	if (!foundInCache)
 	{
@@ -766,6 +923,8 @@ LookupShardCacheEntry(int64 shardId)
 			ereport(ERROR, (errmsg("could not find valid entry for shard "
 								   UINT64_FORMAT, shardId)));
 		}
+
+		ShardLookupCache[ShardLookupCacheIndex(shardId)] = shardEntry;
 	}
 
 	return shardEntry;
@@ -805,6 +964,32 @@ GetCitusTableCacheEntry(Oid distributedRelationId)
 }
 
 
+/*
+ * RebuildCitusTableCacheEntry discards the cache entry of the given distributed
+ * table and builds it again from the catalogs, such that the planner
+ * microbenchmarks can measure BuildCitusTableCacheEntry without going through
+ * invalidations.
+ */
+void
+RebuildCitusTableCacheEntry(Oid relationId)
+{
+	CitusTableCacheEntry *cacheEntry = GetCitusTableCacheEntry(relationId);
+
+	HOLD_INTERRUPTS();
+
+	ResetCitusTableCacheEntry(cacheEntry);
+
+	/* zero out entry, but not the key part */
+	memset(((char *) cacheEntry) + sizeof(Oid), 0,
+		   sizeof(CitusTableCacheEntry) - sizeof(Oid));
+
+	BuildCitusTableCacheEntry(cacheEntry);
+	cacheEntry->isValid = true;
+
+	RESUME_INTERRUPTS();
+}
+
+
 /*
  * GetCitusTableCacheEntry returns the distributed table metadata for the
  * passed relationId. For efficiency it caches lookups.
@@ -872,6 +1057,24 @@ LookupCitusTableCacheEntry(Oid relationId)
 			return cacheEntry;
 		}
 
+		/*
+		 * Most invalidations of distributed tables, for instance those of shard
+		 * moves and placement state changes, leave the shards of the table as
+		 * they are. In that case we only reload the placements of the entry.
+		 */
+		if (EnableShardLevelCacheInvalidation && cacheEntry->isCitusTable)
+		{
+			HOLD_INTERRUPTS();
+			bool revalidated = RevalidateCitusTableCacheEntry(cacheEntry);
+			RESUME_INTERRUPTS();
+
+			if (revalidated)
+			{
+				cacheEntry->isValid = true;
+				return cacheEntry;
+			}
+		}
+
 		/* free the content of old, invalid, entries */
 		ResetCitusTableCacheEntry(cacheEntry);
 	}
@@ -1099,6 +1302,13 @@ BuildCitusTableCacheEntry(CitusTableCacheEntry *cacheEntry)
 		cacheEntry->hasUniformHashDistribution =
 			HasUniformHashDistribution(cacheEntry->sortedShardIntervalArray,
 									   cacheEntry->shardIntervalArrayLength);
+
+		if (!cacheEntry->hasUniformHashDistribution &&
+			!cacheEntry->hasOverlappingShardInterval &&
+			cacheEntry->shardIntervalArrayLength > 0)
+		{
+			BuildHashBucketShardIndexArray(cacheEntry);
+		}
 	}
 	else
 	{
@@ -1141,9 +1351,83 @@ BuildCachedShardList(CitusTableCacheEntry *cacheEntry)
 							  &intervalTypeId,
 							  &intervalTypeMod);
 
-	List *distShardTupleList = LookupDistShardTuples(cacheEntry->relationId);
-	int shardIntervalArrayLength = list_length(distShardTupleList);
-	if (shardIntervalArrayLength > 0)
+	/*
+	 * When the shared metadata cache is usable, we either build the shard list
+	 * from the rows another backend stored, or store the rows we read below.
+	 */
+	bool useSharedCache = SharedMetadataCacheUsable();
+	bool foundInSharedCache = false;
+	uint64 sharedCacheGeneration = 0;
+	List *sharedShardMetadataList = NIL;
+	List *distShardTupleList = NIL;
+	int shardIntervalArrayLength = 0;
+
+	if (useSharedCache)
+	{
+		foundInSharedCache = LookupSharedShardMetadata(cacheEntry->relationId,
+													   &sharedShardMetadataList);
+		if (!foundInSharedCache)
+		{
+			sharedCacheGeneration = SharedMetadataCacheGeneration(cacheEntry->relationId);
+		}
+	}
+
+	if (foundInSharedCache)
+	{
+		shardIntervalArrayLength = list_length(sharedShardMetadataList);
+	}
+	else
+	{
+		distShardTupleList = LookupDistShardTuples(cacheEntry->relationId);
+		shardIntervalArrayLength = list_length(distShardTupleList);
+	}
+
+	/* shard rows in pg_dist_shard order, to be completed with their placements */
+	SharedShardMetadata **sharedShardMetadataArray =
+		palloc0(Max(shardIntervalArrayLength, 1) * sizeof(SharedShardMetadata *));
+
+	if (foundInSharedCache && shardIntervalArrayLength > 0)
+	{
+		SharedShardMetadata *shardMetadata = NULL;
+		int arrayIndex = 0;
+
+		shardIntervalArray = MemoryContextAllocZero(MetadataCacheMemoryContext,
+													shardIntervalArrayLength *
+													sizeof(ShardInterval *));
+
+		cacheEntry->arrayOfPlacementArrays =
+			MemoryContextAllocZero(MetadataCacheMemoryContext,
+								   shardIntervalArrayLength *
+								   sizeof(GroupShardPlacement *));
+		cacheEntry->arrayOfPlacementArrayLengths =
+			MemoryContextAllocZero(MetadataCacheMemoryContext,
+								   shardIntervalArrayLength *
+								   sizeof(int));
+
+		foreach_ptr(shardMetadata, sharedShardMetadataList)
+		{
+			ShardInterval *shardInterval =
+				SharedShardMetadataToShardInterval(shardMetadata,
+												   cacheEntry->relationId,
+												   intervalTypeId, intervalTypeMod);
+			MemoryContext oldContext = MemoryContextSwitchTo(MetadataCacheMemoryContext);
+
+			ShardInterval *newShardInterval = (ShardInterval *) palloc0(
+				sizeof(ShardInterval));
+			CopyShardInterval(shardInterval, newShardInterval);
+
+			/* remember the position of the rows until the loop below */
+			newShardInterval->shardIndex = arrayIndex;
+			shardIntervalArray[arrayIndex] = newShardInterval;
+
+			MemoryContextSwitchTo(oldContext);
+
+			sharedShardMetadataArray[arrayIndex] = shardMetadata;
+
+			arrayIndex++;
+		}
+	}
+	else if (shardIntervalArrayLength > 0)
 	{
 		Relation distShardRelation = heap_open(DistShardRelationId(), AccessShareLock);
 		TupleDesc distShardTupleDesc = RelationGetDescr(distShardRelation);
@@ -1174,17 +1458,29 @@ BuildCachedShardList(CitusTableCacheEntry *cacheEntry)
 			ShardInterval *newShardInterval = (ShardInterval *) palloc0(
 				sizeof(ShardInterval));
 			CopyShardInterval(shardInterval, newShardInterval);
+
+			/* remember the position of the rows until the loop below */
+			newShardInterval->shardIndex = arrayIndex;
 			shardIntervalArray[arrayIndex] = newShardInterval;
 
 			MemoryContextSwitchTo(oldContext);
 
+			if (useSharedCache)
+			{
+				sharedShardMetadataArray[arrayIndex] =
+					DistShardTupleToSharedShardMetadata(shardTuple, distShardTupleDesc);
+			}
+
 			heap_freetuple(shardTuple);
 
 			arrayIndex++;
 		}
 
 		heap_close(distShardRelation, AccessShareLock);
+	}
 
+	if (shardIntervalArrayLength > 0)
+	{
 		ShardInterval *firstShardInterval = shardIntervalArray[0];
 		bool foundInCache = false;
 		ShardCacheEntry *shardEntry = hash_search(DistShardCacheHash,
@@ -1238,116 +1534,606 @@ BuildCachedShardList(CitusTableCacheEntry *cacheEntry)
 	/* reference tables has a single shard which is not initialized */
 	if (cacheEntry->partitionMethod == DISTRIBUTE_BY_NONE)
 	{
-		cacheEntry->hasUninitializedShardInterval = true;
-		cacheEntry->hasOverlappingShardInterval = true;
+		cacheEntry->hasUninitializedShardInterval = true;
+		cacheEntry->hasOverlappingShardInterval = true;
+
+		/*
+		 * Note that during create_reference_table() call,
+		 * the reference table do not have any shards.
+		 */
+		if (shardIntervalArrayLength > 1)
+		{
+			char *relationName = get_rel_name(cacheEntry->relationId);
+
+			ereport(ERROR, (errcode(ERRCODE_OBJECT_NOT_IN_PREREQUISITE_STATE),
+							errmsg("reference table \"%s\" has more than 1 shard",
+								   relationName)));
+		}
+
+		/* since there is a zero or one shard, it is already sorted */
+		sortedShardIntervalArray = shardIntervalArray;
+	}
+	else
+	{
+		/* sort the interval array */
+		sortedShardIntervalArray = SortShardIntervalArray(shardIntervalArray,
+														  shardIntervalArrayLength,
+														  cacheEntry->partitionColumn->
+														  varcollid,
+														  shardIntervalCompareFunction);
+
+		/* check if there exists any shard intervals with no min/max values */
+		cacheEntry->hasUninitializedShardInterval =
+			HasUninitializedShardInterval(sortedShardIntervalArray,
+										  shardIntervalArrayLength);
+
+		if (!cacheEntry->hasUninitializedShardInterval)
+		{
+			cacheEntry->hasOverlappingShardInterval =
+				HasOverlappingShardInterval(sortedShardIntervalArray,
+											shardIntervalArrayLength,
+											cacheEntry->partitionColumn->varcollid,
+											shardIntervalCompareFunction);
+		}
+		else
+		{
+			cacheEntry->hasOverlappingShardInterval = true;
+		}
+
+		ErrorIfInconsistentShardIntervals(cacheEntry);
+
+		if (cacheEntry->hasOverlappingShardInterval)
+		{
+			BuildCumulativeMaxShardIndexArray(cacheEntry, sortedShardIntervalArray,
+											  shardIntervalArrayLength,
+											  shardIntervalCompareFunction);
+		}
+	}
+
+	/*
+	 * We set these here, so ResetCitusTableCacheEntry() can see what has been
+	 * entered into DistShardCacheHash even if the following loop is interrupted
+	 * by throwing errors, etc.
+	 */
+	cacheEntry->sortedShardIntervalArray = sortedShardIntervalArray;
+	cacheEntry->shardIntervalArrayLength = 0;
+
+	/* maintain shardId->(table,ShardInterval) cache */
+	for (int shardIndex = 0; shardIndex < shardIntervalArrayLength; shardIndex++)
+	{
+		ShardInterval *shardInterval = sortedShardIntervalArray[shardIndex];
+		bool foundInCache = false;
+		int placementOffset = 0;
+
+		ShardCacheEntry *shardEntry = hash_search(DistShardCacheHash,
+												  &shardInterval->shardId, HASH_ENTER,
+												  &foundInCache);
+		if (foundInCache)
+		{
+			ereport(ERROR, (errmsg("cached metadata for shard " UINT64_FORMAT
+								   " is inconsistent",
+								   shardInterval->shardId),
+							errhint("Reconnect and try again.")));
+		}
+
+		/*
+		 * We should increment this only after we are sure this hasn't already
+		 * been assigned to any other relations. ResetCitusTableCacheEntry()
+		 * depends on this.
+		 */
+		cacheEntry->shardIntervalArrayLength++;
+
+		shardEntry->shardIndex = shardIndex;
+		shardEntry->tableEntry = cacheEntry;
+
+		/* build list of shard placements */
+		SharedShardMetadata *shardMetadata =
+			sharedShardMetadataArray[shardInterval->shardIndex];
+		List *placementList = NIL;
+		if (foundInSharedCache)
+		{
+			placementList = shardMetadata->placementList;
+		}
+		else
+		{
+			placementList = BuildShardPlacementList(shardInterval);
+
+			if (useSharedCache)
+			{
+				shardMetadata->placementList = placementList;
+			}
+		}
+
+		int numberOfPlacements = list_length(placementList);
+
+		/* and copy that list into the cache entry */
+		MemoryContext oldContext = MemoryContextSwitchTo(MetadataCacheMemoryContext);
+		GroupShardPlacement *placementArray = palloc0(numberOfPlacements *
+													  sizeof(GroupShardPlacement));
+		GroupShardPlacement *srcPlacement = NULL;
+		foreach_ptr(srcPlacement, placementList)
+		{
+			placementArray[placementOffset] = *srcPlacement;
+			placementOffset++;
+		}
+		MemoryContextSwitchTo(oldContext);
+
+		cacheEntry->arrayOfPlacementArrays[shardIndex] = placementArray;
+		cacheEntry->arrayOfPlacementArrayLengths[shardIndex] = numberOfPlacements;
+
+		/* store the shard index in the ShardInterval */
+		shardInterval->shardIndex = shardIndex;
+	}
+
+	cacheEntry->shardColumnCompareFunction = shardColumnCompareFunction;
+	cacheEntry->shardIntervalCompareFunction = shardIntervalCompareFunction;
+
+	if (useSharedCache && !foundInSharedCache)
+	{
+		List *shardMetadataList = NIL;
+
+		for (int shardIndex = 0; shardIndex < shardIntervalArrayLength; shardIndex++)
+		{
+			shardMetadataList = lappend(shardMetadataList,
+										sharedShardMetadataArray[shardIndex]);
+		}
+
+		StoreSharedShardMetadata(cacheEntry->relationId, sharedCacheGeneration,
+								 shardMetadataList);
+	}
+}
+
+
+/*
+ * RevalidateCitusTableCacheEntry brings an invalidated cache entry up to date
+ * without rebuilding it, if the pg_dist_partition and pg_dist_shard rows of
+ * the table did not change since the entry was built. The placement arrays of
+ * shards whose placements changed are replaced, while the sorted shard
+ * intervals and everything derived from them are kept. The function returns
+ * false if the entry needs to be rebuilt.
+ */
+static bool
+RevalidateCitusTableCacheEntry(CitusTableCacheEntry *cacheEntry)
+{
+	if (!CachedDistPartitionUnchanged(cacheEntry))
+	{
+		return false;
+	}
+
+	if (!CachedShardIntervalsUnchanged(cacheEntry))
+	{
+		return false;
+	}
+
+	RefreshCachedPlacements(cacheEntry);
+
+	/* the invalidation might have been caused by a foreign key change */
+	list_free(cacheEntry->referencedRelationsViaForeignKey);
+	list_free(cacheEntry->referencingRelationsViaForeignKey);
+
+	MemoryContext oldContext = MemoryContextSwitchTo(MetadataCacheMemoryContext);
+
+	cacheEntry->referencedRelationsViaForeignKey = ReferencedRelationIdList(
+		cacheEntry->relationId);
+	cacheEntry->referencingRelationsViaForeignKey = ReferencingRelationIdList(
+		cacheEntry->relationId);
+
+	MemoryContextSwitchTo(oldContext);
+
+	return true;
+}
+
+
+/*
+ * CachedDistPartitionUnchanged returns whether the pg_dist_partition row of the
+ * table still matches the given cache entry.
+ */
+static bool
+CachedDistPartitionUnchanged(CitusTableCacheEntry *cacheEntry)
+{
+	Datum datumArray[Natts_pg_dist_partition];
+	bool isNullArray[Natts_pg_dist_partition];
+	bool partitionUnchanged = true;
+
+	Relation pgDistPartition = heap_open(DistPartitionRelationId(), AccessShareLock);
+	HeapTuple distPartitionTuple =
+		LookupDistPartitionTuple(pgDistPartition, cacheEntry->relationId);
+	if (distPartitionTuple == NULL)
+	{
+		heap_close(pgDistPartition, NoLock);
+		return false;
+	}
+
+	TupleDesc tupleDescriptor = RelationGetDescr(pgDistPartition);
+	heap_deform_tuple(distPartitionTuple, tupleDescriptor, datumArray, isNullArray);
+
+	char partitionMethod =
+		DatumGetChar(datumArray[Anum_pg_dist_partition_partmethod - 1]);
+	if (partitionMethod != cacheEntry->partitionMethod)
+	{
+		partitionUnchanged = false;
+	}
+
+	bool partitionKeyIsNull = isNullArray[Anum_pg_dist_partition_partkey - 1];
+	if (partitionKeyIsNull != (cacheEntry->partitionKeyString == NULL))
+	{
+		partitionUnchanged = false;
+	}
+	else if (!partitionKeyIsNull)
+	{
+		char *partitionKeyString =
+			TextDatumGetCString(datumArray[Anum_pg_dist_partition_partkey - 1]);
+
+		if (strcmp(partitionKeyString, cacheEntry->partitionKeyString) != 0)
+		{
+			partitionUnchanged = false;
+		}
+	}
+
+	uint32 colocationId = INVALID_COLOCATION_ID;
+	if (!isNullArray[Anum_pg_dist_partition_colocationid - 1])
+	{
+		colocationId =
+			DatumGetUInt32(datumArray[Anum_pg_dist_partition_colocationid - 1]);
+	}
+
+	if (colocationId != cacheEntry->colocationId)
+	{
+		partitionUnchanged = false;
+	}
+
+	char replicationModel = 'c';
+	if (!isNullArray[Anum_pg_dist_partition_repmodel - 1])
+	{
+		replicationModel =
+			DatumGetChar(datumArray[Anum_pg_dist_partition_repmodel - 1]);
+	}
+
+	if (replicationModel != cacheEntry->replicationModel)
+	{
+		partitionUnchanged = false;
+	}
+
+	heap_freetuple(distPartitionTuple);
+	heap_close(pgDistPartition, NoLock);
+
+	return partitionUnchanged;
+}
+
+
+/*
+ * CachedShardIntervalsUnchanged returns whether the pg_dist_shard rows of the
+ * table still describe the shard intervals of the given cache entry.
+ */
+static bool
+CachedShardIntervalsUnchanged(CitusTableCacheEntry *cacheEntry)
+{
+	Oid columnTypeId = InvalidOid;
+	int32 columnTypeMod = -1;
+	Oid intervalTypeId = InvalidOid;
+	int32 intervalTypeMod = -1;
+	bool shardIntervalsUnchanged = true;
+
+	List *distShardTupleList = LookupDistShardTuples(cacheEntry->relationId);
+	if (list_length(distShardTupleList) != cacheEntry->shardIntervalArrayLength)
+	{
+		return false;
+	}
+
+	if (distShardTupleList == NIL)
+	{
+		return true;
+	}
+
+	GetPartitionTypeInputInfo(cacheEntry->partitionKeyString,
+							  cacheEntry->partitionMethod,
+							  &columnTypeId,
+							  &columnTypeMod,
+							  &intervalTypeId,
+							  &intervalTypeMod);
+
+	Relation distShardRelation = heap_open(DistShardRelationId(), AccessShareLock);
+	TupleDesc distShardTupleDesc = RelationGetDescr(distShardRelation);
+
+	HeapTuple shardTuple = NULL;
+	foreach_ptr(shardTuple, distShardTupleList)
+	{
+		bool foundInCache = false;
+
+		ShardInterval *newShardInterval = TupleToShardInterval(shardTuple,
+															   distShardTupleDesc,
+															   intervalTypeId,
+															   intervalTypeMod);
+
+		ShardCacheEntry *shardEntry = hash_search(DistShardCacheHash,
+												  &newShardInterval->shardId,
+												  HASH_FIND, &foundInCache);
+		if (!foundInCache || shardEntry->tableEntry != cacheEntry)
+		{
+			shardIntervalsUnchanged = false;
+			break;
+		}
+
+		ShardInterval *cachedShardInterval =
+			cacheEntry->sortedShardIntervalArray[shardEntry->shardIndex];
+		if (!CachedShardIntervalEquals(cacheEntry, cachedShardInterval,
+									   newShardInterval))
+		{
+			shardIntervalsUnchanged = false;
+			break;
+		}
+	}
+
+	heap_close(distShardRelation, AccessShareLock);
+
+	return shardIntervalsUnchanged;
+}
+
+
+/*
+ * CachedShardIntervalEquals returns whether a cached shard interval has the
+ * same storage type and min/max values as a shard interval that was read from
+ * pg_dist_shard.
+ */
+static bool
+CachedShardIntervalEquals(CitusTableCacheEntry *cacheEntry,
+						  ShardInterval *cachedInterval, ShardInterval *newInterval)
+{
+	if (cachedInterval->storageType != newInterval->storageType ||
+		cachedInterval->minValueExists != newInterval->minValueExists ||
+		cachedInterval->maxValueExists != newInterval->maxValueExists)
+	{
+		return false;
+	}
+
+	/* min and max values are either both set or both unset */
+	if (!newInterval->minValueExists)
+	{
+		return true;
+	}
+
+	FmgrInfo *compareFunction = cacheEntry->shardIntervalCompareFunction;
+	if (compareFunction == NULL)
+	{
+		return false;
+	}
+
+	Oid collation = InvalidOid;
+	if (cacheEntry->partitionColumn != NULL)
+	{
+		collation = cacheEntry->partitionColumn->varcollid;
+	}
+
+	int minComparison = DatumGetInt32(FunctionCall2Coll(compareFunction, collation,
+														cachedInterval->minValue,
+														newInterval->minValue));
+	int maxComparison = DatumGetInt32(FunctionCall2Coll(compareFunction, collation,
+														cachedInterval->maxValue,
+														newInterval->maxValue));
+
+	return minComparison == 0 && maxComparison == 0;
+}
+
+
+/*
+ * RefreshCachedPlacements reloads the placements of all shards in the given
+ * cache entry, and replaces the placement arrays of the shards whose
+ * placements changed. When the shard identifiers of the table are (mostly)
+ * contiguous, which they are unless shards were added later on, we read all
+ * placements with a single index scan instead of one scan per shard.
+ */
+static void
+RefreshCachedPlacements(CitusTableCacheEntry *cacheEntry)
+{
+	int shardIntervalArrayLength = cacheEntry->shardIntervalArrayLength;
+	if (shardIntervalArrayLength == 0)
+	{
+		return;
+	}
+
+	List **placementListArray = palloc0(shardIntervalArrayLength * sizeof(List *));
+	uint64 minShardId = cacheEntry->sortedShardIntervalArray[0]->shardId;
+	uint64 maxShardId = minShardId;
+
+	for (int shardIndex = 0; shardIndex < shardIntervalArrayLength; shardIndex++)
+	{
+		uint64 shardId = cacheEntry->sortedShardIntervalArray[shardIndex]->shardId;
+
+		minShardId = Min(minShardId, shardId);
+		maxShardId = Max(maxShardId, shardId);
+	}
+
+	if (maxShardId - minShardId < 2 * (uint64) shardIntervalArrayLength)
+	{
+		List *placementList = BuildShardPlacementListForShardRange(minShardId,
+																   maxShardId);
 
-		/*
-		 * Note that during create_reference_table() call,
-		 * the reference table do not have any shards.
-		 */
-		if (shardIntervalArrayLength > 1)
+		GroupShardPlacement *placement = NULL;
+		foreach_ptr(placement, placementList)
 		{
-			char *relationName = get_rel_name(cacheEntry->relationId);
+			bool foundInCache = false;
 
-			ereport(ERROR, (errcode(ERRCODE_OBJECT_NOT_IN_PREREQUISITE_STATE),
-							errmsg("reference table \"%s\" has more than 1 shard",
-								   relationName)));
-		}
+			/* skip placements of shards of other tables within the range */
+			ShardCacheEntry *shardEntry = hash_search(DistShardCacheHash,
+													  &placement->shardId,
+													  HASH_FIND, &foundInCache);
+			if (!foundInCache || shardEntry->tableEntry != cacheEntry)
+			{
+				continue;
+			}
 
-		/* since there is a zero or one shard, it is already sorted */
-		sortedShardIntervalArray = shardIntervalArray;
+			placementListArray[shardEntry->shardIndex] =
+				lappend(placementListArray[shardEntry->shardIndex], placement);
+		}
 	}
 	else
 	{
-		/* sort the interval array */
-		sortedShardIntervalArray = SortShardIntervalArray(shardIntervalArray,
-														  shardIntervalArrayLength,
-														  cacheEntry->partitionColumn->
-														  varcollid,
-														  shardIntervalCompareFunction);
-
-		/* check if there exists any shard intervals with no min/max values */
-		cacheEntry->hasUninitializedShardInterval =
-			HasUninitializedShardInterval(sortedShardIntervalArray,
-										  shardIntervalArrayLength);
-
-		if (!cacheEntry->hasUninitializedShardInterval)
-		{
-			cacheEntry->hasOverlappingShardInterval =
-				HasOverlappingShardInterval(sortedShardIntervalArray,
-											shardIntervalArrayLength,
-											cacheEntry->partitionColumn->varcollid,
-											shardIntervalCompareFunction);
-		}
-		else
+		for (int shardIndex = 0; shardIndex < shardIntervalArrayLength; shardIndex++)
 		{
-			cacheEntry->hasOverlappingShardInterval = true;
-		}
+			ShardInterval *shardInterval =
+				cacheEntry->sortedShardIntervalArray[shardIndex];
 
-		ErrorIfInconsistentShardIntervals(cacheEntry);
+			placementListArray[shardIndex] = BuildShardPlacementList(shardInterval);
+		}
 	}
 
-	/*
-	 * We set these here, so ResetCitusTableCacheEntry() can see what has been
-	 * entered into DistShardCacheHash even if the following loop is interrupted
-	 * by throwing errors, etc.
-	 */
-	cacheEntry->sortedShardIntervalArray = sortedShardIntervalArray;
-	cacheEntry->shardIntervalArrayLength = 0;
-
-	/* maintain shardId->(table,ShardInterval) cache */
 	for (int shardIndex = 0; shardIndex < shardIntervalArrayLength; shardIndex++)
 	{
-		ShardInterval *shardInterval = sortedShardIntervalArray[shardIndex];
-		bool foundInCache = false;
+		List *placementList = placementListArray[shardIndex];
+		GroupShardPlacement *cachedPlacementArray =
+			cacheEntry->arrayOfPlacementArrays[shardIndex];
+		int cachedPlacementCount = cacheEntry->arrayOfPlacementArrayLengths[shardIndex];
 		int placementOffset = 0;
 
-		ShardCacheEntry *shardEntry = hash_search(DistShardCacheHash,
-												  &shardInterval->shardId, HASH_ENTER,
-												  &foundInCache);
-		if (foundInCache)
+		if (PlacementListMatchesArray(placementList, cachedPlacementArray,
+									  cachedPlacementCount))
 		{
-			ereport(ERROR, (errmsg("cached metadata for shard " UINT64_FORMAT
-								   " is inconsistent",
-								   shardInterval->shardId),
-							errhint("Reconnect and try again.")));
+			continue;
 		}
 
-		/*
-		 * We should increment this only after we are sure this hasn't already
-		 * been assigned to any other relations. ResetCitusTableCacheEntry()
-		 * depends on this.
-		 */
-		cacheEntry->shardIntervalArrayLength++;
-
-		shardEntry->shardIndex = shardIndex;
-		shardEntry->tableEntry = cacheEntry;
-
-		/* build list of shard placements */
-		List *placementList = BuildShardPlacementList(shardInterval);
 		int numberOfPlacements = list_length(placementList);
+		GroupShardPlacement *placementArray =
+			MemoryContextAllocZero(MetadataCacheMemoryContext,
+								   numberOfPlacements * sizeof(GroupShardPlacement));
 
-		/* and copy that list into the cache entry */
-		MemoryContext oldContext = MemoryContextSwitchTo(MetadataCacheMemoryContext);
-		GroupShardPlacement *placementArray = palloc0(numberOfPlacements *
-													  sizeof(GroupShardPlacement));
 		GroupShardPlacement *srcPlacement = NULL;
 		foreach_ptr(srcPlacement, placementList)
 		{
 			placementArray[placementOffset] = *srcPlacement;
 			placementOffset++;
 		}
-		MemoryContextSwitchTo(oldContext);
+
+		if (cachedPlacementArray != NULL)
+		{
+			pfree(cachedPlacementArray);
+		}
 
 		cacheEntry->arrayOfPlacementArrays[shardIndex] = placementArray;
 		cacheEntry->arrayOfPlacementArrayLengths[shardIndex] = numberOfPlacements;
+	}
 
-		/* store the shard index in the ShardInterval */
-		shardInterval->shardIndex = shardIndex;
+	pfree(placementListArray);
+}
+
+
+/*
+ * PlacementListMatchesArray returns whether the given list of placements
+ * contains the same placements as the given cached placement array, in any
+ * order.
+ */
+static bool
+PlacementListMatchesArray(List *placementList, GroupShardPlacement *placementArray,
+						  int placementArrayLength)
+{
+	if (list_length(placementList) != placementArrayLength)
+	{
+		return false;
 	}
 
-	cacheEntry->shardColumnCompareFunction = shardColumnCompareFunction;
-	cacheEntry->shardIntervalCompareFunction = shardIntervalCompareFunction;
+	GroupShardPlacement *placement = NULL;
+	foreach_ptr(placement, placementList)
+	{
+		bool placementFound = false;
+
+		for (int placementIndex = 0; placementIndex < placementArrayLength;
+			 placementIndex++)
+		{
+			GroupShardPlacement *cachedPlacement = &placementArray[placementIndex];
+
+			if (cachedPlacement->placementId == placement->placementId)
+			{
+				placementFound =
+					cachedPlacement->shardId == placement->shardId &&
+					cachedPlacement->shardLength == placement->shardLength &&
+					cachedPlacement->shardState == placement->shardState &&
+					cachedPlacement->groupId == placement->groupId;
+				break;
+			}
+		}
+
+		if (!placementFound)
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+
+/*
+ * DistShardTupleToSharedShardMetadata returns the parts of the given
+ * pg_dist_shard tuple that we keep in the shared metadata cache.
+ */
+static SharedShardMetadata *
+DistShardTupleToSharedShardMetadata(HeapTuple heapTuple, TupleDesc tupleDescriptor)
+{
+	Datum datumArray[Natts_pg_dist_shard];
+	bool isNullArray[Natts_pg_dist_shard];
+
+	heap_deform_tuple(heapTuple, tupleDescriptor, datumArray, isNullArray);
+
+	SharedShardMetadata *shardMetadata = palloc0(sizeof(SharedShardMetadata));
+	shardMetadata->shardId =
+		DatumGetInt64(datumArray[Anum_pg_dist_shard_shardid - 1]);
+	shardMetadata->storageType =
+		DatumGetChar(datumArray[Anum_pg_dist_shard_shardstorage - 1]);
+
+	if (!isNullArray[Anum_pg_dist_shard_shardminvalue - 1])
+	{
+		shardMetadata->minValue =
+			TextDatumGetCString(datumArray[Anum_pg_dist_shard_shardminvalue - 1]);
+	}
+
+	if (!isNullArray[Anum_pg_dist_shard_shardmaxvalue - 1])
+	{
+		shardMetadata->maxValue =
+			TextDatumGetCString(datumArray[Anum_pg_dist_shard_shardmaxvalue - 1]);
+	}
+
+	return shardMetadata;
+}
+
+
+/*
+ * SharedShardMetadataToShardInterval transforms shard rows read from the
+ * shared metadata cache into a new ShardInterval, in the same way as we
+ * transform pg_dist_shard tuples.
+ */
+static ShardInterval *
+SharedShardMetadataToShardInterval(SharedShardMetadata *shardMetadata, Oid relationId,
+								   Oid intervalTypeId, int32 intervalTypeMod)
+{
+	Datum datumArray[Natts_pg_dist_shard];
+	bool isNullArray[Natts_pg_dist_shard];
+
+	memset(datumArray, 0, sizeof(datumArray));
+	memset(isNullArray, true, sizeof(isNullArray));
+
+	datumArray[Anum_pg_dist_shard_logicalrelid - 1] = ObjectIdGetDatum(relationId);
+	isNullArray[Anum_pg_dist_shard_logicalrelid - 1] = false;
+	datumArray[Anum_pg_dist_shard_shardid - 1] = Int64GetDatum(shardMetadata->shardId);
+	isNullArray[Anum_pg_dist_shard_shardid - 1] = false;
+	datumArray[Anum_pg_dist_shard_shardstorage - 1] =
+		CharGetDatum(shardMetadata->storageType);
+	isNullArray[Anum_pg_dist_shard_shardstorage - 1] = false;
+
+	if (shardMetadata->minValue != NULL)
+	{
+		datumArray[Anum_pg_dist_shard_shardminvalue - 1] =
+			CStringGetTextDatum(shardMetadata->minValue);
+		isNullArray[Anum_pg_dist_shard_shardminvalue - 1] = false;
+	}
+
+	if (shardMetadata->maxValue != NULL)
+	{
+		datumArray[Anum_pg_dist_shard_shardmaxvalue - 1] =
+			CStringGetTextDatum(shardMetadata->maxValue);
+		isNullArray[Anum_pg_dist_shard_shardmaxvalue - 1] = false;
+	}
+
+	return DeformedDistShardTupleToShardInterval(datumArray, isNullArray,
+												 intervalTypeId, intervalTypeMod);
 }
 
 
@@ -1448,6 +2234,110 @@ HasUninitializedShardInterval(ShardInterval **sortedShardIntervalArray, int shar
 }
 
 
+/*
+ * BuildHashBucketShardIndexArray builds the index that FindShardIntervalIndex
+ * uses for hash distributed tables whose shards do not divide the hash space
+ * uniformly, such as after tenant isolation. The hash space is divided into a
+ * power of 2 equal buckets, at least 4 for every shard and at most 2^16, and
+ * for every bucket it records the first shard whose max value is not below the
+ * start of the bucket. Since the shards do not overlap, a lookup only checks
+ * the few shards that start within the bucket instead of binary searching all
+ * shards through fmgr.
+ */
+static void
+BuildHashBucketShardIndexArray(CitusTableCacheEntry *cacheEntry)
+{
+	ShardInterval **sortedShardIntervalArray = cacheEntry->sortedShardIntervalArray;
+	int shardCount = cacheEntry->shardIntervalArrayLength;
+	int hashBucketBits = 1;
+	int shardIndex = 0;
+
+	while (hashBucketBits < 16 && (1 << hashBucketBits) < 4 * shardCount)
+	{
+		hashBucketBits++;
+	}
+
+	int hashBucketCount = 1 << hashBucketBits;
+	int64 hashBucketSize = HASH_TOKEN_COUNT / hashBucketCount;
+	int *hashBucketShardIndexArray =
+		MemoryContextAlloc(MetadataCacheMemoryContext, hashBucketCount * sizeof(int));
+
+	for (int bucketIndex = 0; bucketIndex < hashBucketCount; bucketIndex++)
+	{
+		int64 bucketMinHashToken = (int64) INT32_MIN + bucketIndex * hashBucketSize;
+
+		while (shardIndex < shardCount - 1 &&
+			   DatumGetInt32(sortedShardIntervalArray[shardIndex]->maxValue) <
+			   bucketMinHashToken)
+		{
+			shardIndex++;
+		}
+
+		hashBucketShardIndexArray[bucketIndex] = shardIndex;
+	}
+
+	cacheEntry->hashBucketShardIndexArray = hashBucketShardIndexArray;
+	cacheEntry->hashBucketBits = hashBucketBits;
+}
+
+
+/*
+ * BuildCumulativeMaxShardIndexArray builds the index that shard pruning uses for
+ * tables with overlapping shard intervals, such as append distributed tables
+ * with many shards. For every position in the sorted shard interval array it
+ * records the shard with the largest max value so far. Unlike the max values
+ * themselves, those are sorted, so pruning can binary search for the first
+ * shard that may contain values above a lower bound instead of checking every
+ * shard.
+ *
+ * Shards without min/max values are sorted last and are not part of the index.
+ */
+static void
+BuildCumulativeMaxShardIndexArray(CitusTableCacheEntry *cacheEntry,
+								  ShardInterval **sortedShardIntervalArray,
+								  int shardIntervalArrayLength,
+								  FmgrInfo *shardIntervalCompareFunction)
+{
+	Oid shardIntervalCollation = cacheEntry->partitionColumn->varcollid;
+	int initializedShardCount = 0;
+
+	while (initializedShardCount < shardIntervalArrayLength &&
+		   sortedShardIntervalArray[initializedShardCount]->minValueExists &&
+		   sortedShardIntervalArray[initializedShardCount]->maxValueExists)
+	{
+		initializedShardCount++;
+	}
+
+	if (initializedShardCount == 0)
+	{
+		return;
+	}
+
+	int *cumulativeMaxShardIndexArray =
+		MemoryContextAlloc(MetadataCacheMemoryContext,
+						   initializedShardCount * sizeof(int));
+
+	int maxShardIndex = 0;
+	for (int shardIndex = 0; shardIndex < initializedShardCount; shardIndex++)
+	{
+		Datum comparisonDatum =
+			FunctionCall2Coll(shardIntervalCompareFunction, shardIntervalCollation,
+							  sortedShardIntervalArray[shardIndex]->maxValue,
+							  sortedShardIntervalArray[maxShardIndex]->maxValue);
+
+		if (DatumGetInt32(comparisonDatum) > 0)
+		{
+			maxShardIndex = shardIndex;
+		}
+
+		cumulativeMaxShardIndexArray[shardIndex] = maxShardIndex;
+	}
+
+	cacheEntry->cumulativeMaxShardIndexArray = cumulativeMaxShardIndexArray;
+	cacheEntry->cumulativeMaxShardIndexArrayLength = initializedShardCount;
+}
+
+
 /*
  * HasOverlappingShardInterval determines whether the given list of sorted
  * shards has overlapping ranges.
@@ -1914,6 +2804,28 @@ DistNodeNodeIdIndexId(void)
 }
 
 
+/* return oid of pg_dist_poolinfo relation */
+Oid
+DistPoolinfoRelationId(void)
+{
+	CachedRelationLookup("pg_dist_poolinfo",
+						 &MetadataCache.distPoolinfoRelationId);
+
+	return MetadataCache.distPoolinfoRelationId;
+}
+
+
+/* return oid of pg_dist_poolinfo's primary key index */
+Oid
+DistPoolinfoIndexId(void)
+{
+	CachedRelationLookup("pg_dist_poolinfo_pkey",
+						 &MetadataCache.distPoolinfoIndexId);
+
+	return MetadataCache.distPoolinfoIndexId;
+}
+
+
 /* return oid of pg_dist_local_group relation */
 Oid
 DistLocalGroupIdRelationId(void)
@@ -2762,7 +3674,12 @@ master_dist_authinfo_cache_invalidate(PG_FUNCTION_ARGS)
 
 	CheckCitusVersion(ERROR);
 
-	/* no-op in community edition */
+	/*
+	 * Connection parameters are cached per backend, so make sure every backend
+	 * recomputes them after pg_dist_poolinfo changed. pg_dist_authinfo cannot
+	 * be written to in community edition.
+	 */
+	CitusInvalidateRelcacheByRelid(DistPoolinfoRelationId());
 
 	PG_RETURN_DATUM(PointerGetDatum(NULL));
 }
@@ -2873,6 +3790,7 @@ InitializeCaches(void)
 			MetadataCacheMemoryContext = NULL;
 			DistTableCacheHash = NULL;
 			DistShardCacheHash = NULL;
+			memset(ShardLookupCache, 0, sizeof(ShardLookupCache));
 
 			PG_RE_THROW();
 		}
@@ -3258,6 +4176,20 @@ ResetCitusTableCacheEntry(CitusTableCacheEntry *cacheEntry)
 		cacheEntry->partitionColumn = NULL;
 	}
 
+	if (cacheEntry->cumulativeMaxShardIndexArray != NULL)
+	{
+		pfree(cacheEntry->cumulativeMaxShardIndexArray);
+		cacheEntry->cumulativeMaxShardIndexArray = NULL;
+		cacheEntry->cumulativeMaxShardIndexArrayLength = 0;
+	}
+
+	if (cacheEntry->hashBucketShardIndexArray != NULL)
+	{
+		pfree(cacheEntry->hashBucketShardIndexArray);
+		cacheEntry->hashBucketShardIndexArray = NULL;
+		cacheEntry->hashBucketBits = 0;
+	}
+
 	if (cacheEntry->shardIntervalArrayLength == 0)
 	{
 		return;
@@ -3278,11 +4210,18 @@ ResetCitusTableCacheEntry(CitusTableCacheEntry *cacheEntry)
 			pfree(placementArray);
 		}
 
-		/* delete per-shard cache-entry */
-		hash_search(DistShardCacheHash, &shardInterval->shardId, HASH_REMOVE,
-					&foundInCache);
+		/* delete per-shard cache-entry, and its direct-mapped cache slot */
+		ShardCacheEntry *shardEntry = hash_search(DistShardCacheHash,
+												  &shardInterval->shardId,
+												  HASH_REMOVE, &foundInCache);
 		Assert(foundInCache);
 
+		if (ShardLookupCache[ShardLookupCacheIndex(shardInterval->shardId)] ==
+			shardEntry)
+		{
+			ShardLookupCache[ShardLookupCacheIndex(shardInterval->shardId)] = NULL;
+		}
+
 		/* delete data pointed to by ShardInterval */
 		if (!valueByVal)
 		{
@@ -3380,17 +4319,32 @@ InvalidateForeignKeyGraph(void)
 static void
 InvalidateDistRelationCacheCallback(Datum argument, Oid relationId)
 {
+	/* cached fast path plans embed the shards and placements of the table */
+	InvalidateFastPathPlanCache(relationId);
+
+	/* distribution key equalities depend on the distribution of the table */
+	InvalidateRestrictionEquivalenceCache(relationId);
+
+	/* colocated shard maps depend on the shards and placements of the table */
+	InvalidateColocatedShardMaps(relationId);
+
+	/* which relations are shards depends on the shards and names of the table */
+	InvalidateKnownShardCache(relationId);
+
 	/* invalidate either entire cache or a specific entry */
 	if (relationId == InvalidOid)
 	{
 		InvalidateDistTableCache();
 		InvalidateDistObjectCache();
+		ResetSharedMetadataCache();
 	}
 	else
 	{
 		void *hashKey = (void *) &relationId;
 		bool foundInCache = false;
 
+		/* other backends build their entries from the shared rows */
+		InvalidateSharedShardMetadata(relationId);
 
 		CitusTableCacheEntry *cacheEntry = hash_search(DistTableCacheHash, hashKey,
 													   HASH_FIND, &foundInCache);
@@ -3407,6 +4361,9 @@ InvalidateDistRelationCacheCallback(Datum argument, Oid relationId)
 		if (relationId == MetadataCache.distPartitionRelationId)
 		{
 			InvalidateMetadataSystemCache();
+			ResetSharedMetadataCache();
+			InvalidateColocatedShardMaps(InvalidOid);
+			InvalidateKnownShardCache(InvalidOid);
 		}
 
 		if (relationId == MetadataCache.distObjectRelationId)
@@ -3573,6 +4530,15 @@ InvalidateNodeRelationCacheCallback(Datum argument, Oid relationId)
 	if (relationId == InvalidOid || relationId == MetadataCache.distNodeRelationId)
 	{
 		workerNodeHashValid = false;
+
+		/* cached fast path plans embed the names of the nodes */
+		InvalidateFastPathPlanCache(InvalidOid);
+	}
+
+	if (relationId != InvalidOid && relationId == MetadataCache.distPoolinfoRelationId)
+	{
+		/* connections to nodes may need to go through a different pooler */
+		InvalidateConnParamsHashEntries();
 	}
 }
 
@@ -4113,18 +5079,74 @@ authinfo_valid(PG_FUNCTION_ARGS)
 
 
 /*
- * poolinfo_valid is a check constraint which errors on all rows, intended for
- * use in prohibiting writes to pg_dist_poolinfo in Citus Community.
+ * poolinfo_valid is a check constraint which ensures that the connection
+ * settings in pg_dist_poolinfo only tell Citus where to find the pooler of
+ * a node, that is they only set host, port and dbname.
  */
 Datum
 poolinfo_valid(PG_FUNCTION_ARGS)
 {
-	ereport(ERROR, (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
-					errmsg("cannot write to pg_dist_poolinfo"),
-					errdetail(
-						"Citus Community Edition does not support the use of "
-						"pooler options."),
-					errhint("To learn more about using advanced pooling schemes "
-							"with Citus, please contact us at "
-							"https://citusdata.com/about/contact_us")));
+	char *poolinfo = text_to_cstring(PG_GETARG_TEXT_P(0));
+
+	/* this array _must_ be kept in an order usable by bsearch */
+	const char *whitelist[] = {
+		"dbname",
+		"host",
+		"port"
+	};
+	char *errorMsg = NULL;
+
+	bool poolinfoValid = CheckConninfo(poolinfo, whitelist, lengthof(whitelist),
+									   &errorMsg);
+	if (!poolinfoValid)
+	{
+		ereport(ERROR, (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+						errmsg("invalid poolinfo: %s", poolinfo),
+						errdetail("%s", errorMsg)));
+	}
+
+	PG_RETURN_BOOL(true);
+}
+
+
+/*
+ * GetPoolinfoViaCatalog returns the pooler connection settings of the node with
+ * the given node ID from pg_dist_poolinfo, or NULL if connections to the node
+ * do not go through a pooler.
+ */
+char *
+GetPoolinfoViaCatalog(int32 nodeId)
+{
+	ScanKeyData scanKey[1];
+	const int scanKeyCount = 1;
+	bool indexOK = true;
+	char *poolinfo = NULL;
+
+	/* set scan arguments */
+	ScanKeyInit(&scanKey[0], Anum_pg_dist_poolinfo_nodeid, BTEqualStrategyNumber,
+				F_INT4EQ, Int32GetDatum(nodeId));
+
+	Relation pgDistPoolinfo = heap_open(DistPoolinfoRelationId(), AccessShareLock);
+
+	SysScanDesc scanDescriptor = systable_beginscan(pgDistPoolinfo,
+													DistPoolinfoIndexId(),
+													indexOK, NULL, scanKeyCount,
+													scanKey);
+	TupleDesc tupleDescriptor = RelationGetDescr(pgDistPoolinfo);
+
+	HeapTuple heapTuple = systable_getnext(scanDescriptor);
+	if (HeapTupleIsValid(heapTuple))
+	{
+		bool isNull = false;
+		Datum poolinfoDatum = heap_getattr(heapTuple, Anum_pg_dist_poolinfo_poolinfo,
+										   tupleDescriptor, &isNull);
+
+		Assert(!isNull);
+		poolinfo = TextDatumGetCString(poolinfoDatum);
+	}
+
+	systable_endscan(scanDescriptor);
+	heap_close(pgDistPoolinfo, AccessShareLock);
+
+	return poolinfo;
 }
@@ -38,14 +38,18 @@
 #include "distributed/metadata_sync.h"
 #include "distributed/multi_join_order.h"
 #include "distributed/multi_partitioning_utils.h"
+#include "distributed/multi_progress.h"
 #include "distributed/pg_dist_node.h"
 #include "distributed/remote_commands.h"
+#include "distributed/tuplestore.h"
 #include "distributed/worker_manager.h"
 #include "distributed/worker_transaction.h"
 #include "distributed/version_compat.h"
 #include "foreign/foreign.h"
 #include "miscadmin.h"
 #include "nodes/pg_list.h"
+#include "pgstat.h"
+#include "storage/latch.h"
 #include "storage/lmgr.h"
 #include "utils/builtins.h"
 #include "utils/fmgroids.h"
@@ -54,6 +58,31 @@
 #include "utils/syscache.h"
 
 
+/*
+ * MetadataSyncNodeState tracks the progress of sending the metadata snapshot
+ * to a single node over a non-blocking connection.
+ */
+typedef struct MetadataSyncNodeState
+{
+	WorkerNode *workerNode;
+	MultiConnection *connection;
+	char *localGroupIdUpdateCommand;
+
+	/* index of the next command, 0 is the local group id update */
+	int commandIndex;
+	bool commandInProgress;
+
+	/* events to wait for when the node cannot make progress */
+	int waitEvents;
+
+	/* whether all commands completed or the remote transaction failed */
+	bool done;
+
+	/* progress of the node, possibly in shared memory */
+	MetadataSyncProgress *progress;
+} MetadataSyncNodeState;
+
+
 static char * LocalGroupIdUpdateCommand(int32 groupId);
 static void UpdateDistNodeBoolAttr(const char *nodeName, int32 nodePort,
 								   int attrNum, bool value);
@@ -62,7 +91,16 @@ static char * TruncateTriggerCreateCommand(Oid relationId);
 static char * SchemaOwnerName(Oid objectId);
 static bool HasMetadataWorkers(void);
 static List * DetachPartitionCommandList(void);
-static bool SyncMetadataSnapshotToNode(WorkerNode *workerNode, bool raiseOnError);
+static List * SyncMetadataSnapshotToNodeList(List *workerNodeList, bool raiseOnError);
+static List * BatchMetadataCommandList(List *commandList);
+static void AdvanceMetadataSync(MetadataSyncNodeState *nodeState,
+								char **commandBatchArray, int commandBatchCount,
+								bool raiseOnError);
+static bool ConsumeMetadataCommandResults(MultiConnection *connection,
+										  bool raiseOnError);
+static void WaitForMetadataSyncNodes(MetadataSyncNodeState *nodeStateArray,
+									 int nodeCount, int pendingNodeCount);
+static char * MetadataSyncProgressStateName(MetadataSyncProgressState state);
 static List * GenerateGrantOnSchemaQueriesFromAclItem(Oid schemaOid,
 													  AclItem *aclItem);
 static GrantStmt * GenerateGrantOnSchemaStmtForRights(Oid roleOid,
@@ -71,8 +109,12 @@ static GrantStmt * GenerateGrantOnSchemaStmtForRights(Oid roleOid,
 													  bool withGrantOption);
 static char * GenerateSetRoleQuery(Oid roleOid);
 
+/* config variable for the size of snapshot command batches in kB */
+int MetadataSyncBatchSize = 0;
+
 PG_FUNCTION_INFO_V1(start_metadata_sync_to_node);
 PG_FUNCTION_INFO_V1(stop_metadata_sync_to_node);
+PG_FUNCTION_INFO_V1(citus_metadata_sync_progress);
 
 
 /*
@@ -103,7 +145,7 @@ StartMetadataSyncToNode(const char *nodeNameString, int32 nodePort)
 	char *escapedNodeName = quote_literal_cstr(nodeNameString);
 
 	/* fail if metadata synchronization doesn't succeed */
-	bool raiseInterrupts = true;
+	bool raiseOnError = true;
 
 	EnsureCoordinator();
 	EnsureSuperUser();
@@ -151,7 +193,7 @@ StartMetadataSyncToNode(const char *nodeNameString, int32 nodePort)
 		return;
 	}
 
-	SyncMetadataSnapshotToNode(workerNode, raiseInterrupts);
+	SyncMetadataSnapshotToNodeList(list_make1(workerNode), raiseOnError);
 	MarkNodeMetadataSynced(workerNode->workerName, workerNode->workerPort, true);
 }
 
@@ -243,54 +285,484 @@ ShouldSyncTableMetadata(Oid relationId)
 
 
 /*
- * SyncMetadataSnapshotToNode does the following:
+ * SyncMetadataSnapshotToNodeList does the following on all given workers in
+ * parallel:
  *  1. Sets the localGroupId on the worker so the worker knows which tuple in
  *     pg_dist_node represents itself.
  *  2. Recreates the distributed metadata on the given worker.
- * If raiseOnError is true, it errors out if synchronization fails.
+ *
+ * The snapshot commands are generated only once for all workers and are
+ * combined into batches of up to citus.metadata_sync_batch_size to save round
+ * trips. Each worker is sent its commands over a non-blocking connection at
+ * its own pace, such that a slow worker does not hold up the others, and the
+ * progress of each worker is shown in citus_metadata_sync_progress.
+ *
+ * If raiseOnError is true, it errors out if synchronization fails. Otherwise,
+ * it returns the list of workers that were synchronized.
  */
-static bool
-SyncMetadataSnapshotToNode(WorkerNode *workerNode, bool raiseOnError)
+static List *
+SyncMetadataSnapshotToNodeList(List *workerNodeList, bool raiseOnError)
 {
 	char *extensionOwner = CitusExtensionOwnerName();
-
-	/* generate and add the local group id's update query */
-	char *localGroupIdUpdateCommand = LocalGroupIdUpdateCommand(workerNode->groupId);
+	int nodeCount = list_length(workerNodeList);
+	List *connectionList = NIL;
+	List *syncedNodeList = NIL;
 
 	/* generate the queries which drop the metadata */
-	List *dropMetadataCommandList = MetadataDropCommands();
+	List *recreateMetadataSnapshotCommandList = MetadataDropCommands();
 
 	/* generate the queries which create the metadata from scratch */
 	List *createMetadataCommandList = MetadataCreateCommands();
 
-	List *recreateMetadataSnapshotCommandList = list_make1(localGroupIdUpdateCommand);
-	recreateMetadataSnapshotCommandList = list_concat(recreateMetadataSnapshotCommandList,
-													  dropMetadataCommandList);
 	recreateMetadataSnapshotCommandList = list_concat(recreateMetadataSnapshotCommandList,
 													  createMetadataCommandList);
 
+	List *commandBatchList =
+		BatchMetadataCommandList(recreateMetadataSnapshotCommandList);
+	int commandBatchCount = list_length(commandBatchList);
+	char **commandBatchArray = palloc0(commandBatchCount * sizeof(char *));
+	int commandBatchIndex = 0;
+
+	char *commandBatch = NULL;
+	foreach_ptr(commandBatch, commandBatchList)
+	{
+		commandBatchArray[commandBatchIndex++] = commandBatch;
+	}
+
+	/* make the progress of each node visible to other backends */
+	ProgressMonitorData *monitor =
+		CreateProgressMonitor(METADATA_SYNC_MAGIC_NUMBER, nodeCount,
+							  sizeof(MetadataSyncProgress), DistNodeRelationId());
+	MetadataSyncProgress *progressArray = NULL;
+	if (monitor != NULL)
+	{
+		progressArray = (MetadataSyncProgress *) monitor->steps;
+	}
+	else
+	{
+		progressArray = palloc(nodeCount * sizeof(MetadataSyncProgress));
+	}
+
+	memset(progressArray, 0, nodeCount * sizeof(MetadataSyncProgress));
+
+	MetadataSyncNodeState *nodeStateArray =
+		palloc0(nodeCount * sizeof(MetadataSyncNodeState));
+	int nodeIndex = 0;
+
+	WorkerNode *workerNode = NULL;
+	foreach_ptr(workerNode, workerNodeList)
+	{
+		MetadataSyncNodeState *nodeState = &nodeStateArray[nodeIndex];
+		int connectionFlags = FORCE_NEW_CONNECTION;
+
+		MultiConnection *connection =
+			StartNodeUserDatabaseConnection(connectionFlags, workerNode->workerName,
+											workerNode->workerPort, extensionOwner,
+											NULL);
+		if (raiseOnError)
+		{
+			MarkRemoteTransactionCritical(connection);
+		}
+
+		nodeState->workerNode = workerNode;
+		nodeState->connection = connection;
+		nodeState->localGroupIdUpdateCommand =
+			LocalGroupIdUpdateCommand(workerNode->groupId);
+		nodeState->progress = &progressArray[nodeIndex];
+		nodeState->progress->nodeId = workerNode->nodeId;
+		nodeState->progress->state = METADATA_SYNC_PROGRESS_SENDING;
+		nodeState->progress->commandCount = commandBatchCount + 1;
+
+		connectionList = lappend(connectionList, connection);
+		nodeIndex++;
+	}
+
+	FinishConnectionListEstablishment(connectionList);
+
 	/*
-	 * Send the snapshot recreation commands in a single remote transaction and
-	 * if requested, error out in any kind of failure. Note that it is not
-	 * required to send createMetadataSnapshotCommandList in the same transaction
-	 * that we send nodeDeleteCommand and nodeInsertCommand commands below.
+	 * Send the snapshot recreation commands in a single remote transaction per
+	 * node. A failure on one node does not affect the other nodes unless we
+	 * are asked to error out.
 	 */
-	if (raiseOnError)
+	RemoteTransactionListBegin(connectionList);
+
+	int pendingNodeCount = nodeCount;
+	while (pendingNodeCount > 0)
 	{
-		SendCommandListToWorkerInSingleTransaction(workerNode->workerName,
-												   workerNode->workerPort,
-												   extensionOwner,
-												   recreateMetadataSnapshotCommandList);
-		return true;
+		pendingNodeCount = 0;
+
+		for (nodeIndex = 0; nodeIndex < nodeCount; nodeIndex++)
+		{
+			MetadataSyncNodeState *nodeState = &nodeStateArray[nodeIndex];
+
+			AdvanceMetadataSync(nodeState, commandBatchArray, commandBatchCount,
+								raiseOnError);
+
+			if (!nodeState->done)
+			{
+				pendingNodeCount++;
+			}
+		}
+
+		if (pendingNodeCount > 0)
+		{
+			WaitForMetadataSyncNodes(nodeStateArray, nodeCount, pendingNodeCount);
+		}
 	}
-	else
+
+	for (nodeIndex = 0; nodeIndex < nodeCount; nodeIndex++)
+	{
+		MetadataSyncNodeState *nodeState = &nodeStateArray[nodeIndex];
+
+		nodeState->progress->state = METADATA_SYNC_PROGRESS_COMMITTING;
+		StartRemoteTransactionCommit(nodeState->connection);
+	}
+
+	for (nodeIndex = 0; nodeIndex < nodeCount; nodeIndex++)
+	{
+		MetadataSyncNodeState *nodeState = &nodeStateArray[nodeIndex];
+		MultiConnection *connection = nodeState->connection;
+		RemoteTransaction *transaction = &connection->remoteTransaction;
+
+		workerNode = nodeState->workerNode;
+
+		FinishRemoteTransactionCommit(connection);
+
+		if (transaction->transactionState == REMOTE_TRANS_COMMITTED &&
+			!transaction->transactionFailed)
+		{
+			nodeState->progress->state = METADATA_SYNC_PROGRESS_SYNCED;
+			syncedNodeList = lappend(syncedNodeList, workerNode);
+		}
+		else if (raiseOnError)
+		{
+			ereport(ERROR, (errmsg("failed to sync metadata to %s:%d",
+								   workerNode->workerName, workerNode->workerPort)));
+		}
+		else
+		{
+			nodeState->progress->state = METADATA_SYNC_PROGRESS_FAILED;
+		}
+
+		CloseConnection(connection);
+	}
+
+	if (monitor != NULL)
+	{
+		FinalizeCurrentProgressMonitor();
+	}
+
+	return syncedNodeList;
+}
+
+
+/*
+ * BatchMetadataCommandList combines the given commands into multi-statement
+ * commands of up to citus.metadata_sync_batch_size each. A single command that
+ * exceeds the batch size is sent on its own. If batching is disabled, the
+ * commands are returned as they are.
+ */
+static List *
+BatchMetadataCommandList(List *commandList)
+{
+	Size batchSize = (Size) MetadataSyncBatchSize * 1024L;
+	List *commandBatchList = NIL;
+	StringInfo commandBatch = NULL;
+
+	if (MetadataSyncBatchSize == 0)
+	{
+		return commandList;
+	}
+
+	const char *command = NULL;
+	foreach_ptr(command, commandList)
+	{
+		Size commandLength = strlen(command);
+
+		if (commandBatch != NULL && commandBatch->len + commandLength + 2 > batchSize)
+		{
+			commandBatchList = lappend(commandBatchList, commandBatch->data);
+			commandBatch = NULL;
+		}
+
+		if (commandBatch == NULL)
+		{
+			commandBatch = makeStringInfo();
+		}
+		else
+		{
+			appendStringInfoString(commandBatch, ";\n");
+		}
+
+		appendStringInfoString(commandBatch, command);
+	}
+
+	if (commandBatch != NULL)
+	{
+		commandBatchList = lappend(commandBatchList, commandBatch->data);
+	}
+
+	return commandBatchList;
+}
+
+
+/*
+ * AdvanceMetadataSync sends the snapshot commands to the node of the given
+ * state and consumes their results for as long as it can do so without
+ * blocking. When it has to wait, it records the events to wait for. The node
+ * is done once all commands completed or the remote transaction failed.
+ */
+static void
+AdvanceMetadataSync(MetadataSyncNodeState *nodeState, char **commandBatchArray,
+					int commandBatchCount, bool raiseOnError)
+{
+	MultiConnection *connection = nodeState->connection;
+	RemoteTransaction *transaction = &connection->remoteTransaction;
+	PGconn *pgConn = connection->pgConn;
+
+	while (!nodeState->done)
+	{
+		if (!nodeState->commandInProgress)
+		{
+			if (transaction->transactionFailed ||
+				nodeState->commandIndex > commandBatchCount)
+			{
+				nodeState->done = true;
+				break;
+			}
+
+			/* the local group id differs per node, so we send it on its own */
+			const char *command = nodeState->localGroupIdUpdateCommand;
+			if (nodeState->commandIndex > 0)
+			{
+				command = commandBatchArray[nodeState->commandIndex - 1];
+			}
+
+			if (!SendRemoteCommand(connection, command))
+			{
+				HandleRemoteTransactionConnectionError(connection, raiseOnError);
+				nodeState->done = true;
+				break;
+			}
+
+			nodeState->commandInProgress = true;
+		}
+
+		int sendStatus = PQflush(pgConn);
+		if (sendStatus == -1)
+		{
+			HandleRemoteTransactionConnectionError(connection, raiseOnError);
+			nodeState->done = true;
+			break;
+		}
+		else if (sendStatus == 1)
+		{
+			/* wait until we can send the rest of the command */
+			nodeState->waitEvents = WL_SOCKET_READABLE | WL_SOCKET_WRITEABLE;
+			break;
+		}
+
+		if (PQconsumeInput(pgConn) == 0)
+		{
+			HandleRemoteTransactionConnectionError(connection, raiseOnError);
+			nodeState->done = true;
+			break;
+		}
+
+		if (!ConsumeMetadataCommandResults(connection, raiseOnError))
+		{
+			/* wait until the remaining results arrive */
+			nodeState->waitEvents = WL_SOCKET_READABLE;
+			break;
+		}
+
+		nodeState->commandInProgress = false;
+		nodeState->commandIndex++;
+		nodeState->progress->commandsCompleted++;
+	}
+
+	if (nodeState->done && transaction->transactionFailed)
+	{
+		nodeState->progress->state = METADATA_SYNC_PROGRESS_FAILED;
+	}
+}
+
+
+/*
+ * ConsumeMetadataCommandResults consumes the results of the command in
+ * progress on the given connection that arrived so far, and returns whether
+ * all of them arrived. Unlike ExecuteCriticalRemoteCommand, it checks all
+ * results rather than only the first one, since a batch consists of many
+ * statements and any of them may fail.
+ */
+static bool
+ConsumeMetadataCommandResults(MultiConnection *connection, bool raiseOnError)
+{
+	RemoteTransaction *transaction = &connection->remoteTransaction;
+	PGconn *pgConn = connection->pgConn;
+
+	while (!PQisBusy(pgConn))
+	{
+		PGresult *result = PQgetResult(pgConn);
+		if (result == NULL)
+		{
+			return true;
+		}
+
+		if (!IsResponseOK(result) && !transaction->transactionFailed)
+		{
+			HandleRemoteTransactionResultError(connection, result, raiseOnError);
+		}
+
+		PQclear(result);
+	}
+
+	return false;
+}
+
+
+/*
+ * WaitForMetadataSyncNodes waits until at least one of the nodes that are not
+ * done yet can make progress, or until the latch is set.
+ */
+static void
+WaitForMetadataSyncNodes(MetadataSyncNodeState *nodeStateArray, int nodeCount,
+						 int pendingNodeCount)
+{
+	int eventSetSize = pendingNodeCount + 2;
+	WaitEvent *events = palloc0(eventSetSize * sizeof(WaitEvent));
+	bool postmasterDied = false;
+	bool latchSet = false;
+
+	WaitEventSet *waitEventSet = CreateWaitEventSet(CurrentMemoryContext,
+													eventSetSize);
+	AddWaitEventToSet(waitEventSet, WL_POSTMASTER_DEATH, PGINVALID_SOCKET, NULL, NULL);
+	AddWaitEventToSet(waitEventSet, WL_LATCH_SET, PGINVALID_SOCKET, MyLatch, NULL);
+
+	for (int nodeIndex = 0; nodeIndex < nodeCount; nodeIndex++)
 	{
-		bool success =
-			SendOptionalCommandListToWorkerInTransaction(workerNode->workerName,
-														 workerNode->workerPort,
-														 extensionOwner,
-														 recreateMetadataSnapshotCommandList);
-		return success;
+		MetadataSyncNodeState *nodeState = &nodeStateArray[nodeIndex];
+
+		if (!nodeState->done)
+		{
+			int sock = PQsocket(nodeState->connection->pgConn);
+
+			AddWaitEventToSet(waitEventSet, nodeState->waitEvents, sock, NULL,
+							  (void *) nodeState);
+		}
+	}
+
+	long timeout = -1;
+	int eventCount = WaitEventSetWait(waitEventSet, timeout, events, eventSetSize,
+									  WAIT_EVENT_CLIENT_READ);
+
+	for (int eventIndex = 0; eventIndex < eventCount; eventIndex++)
+	{
+		WaitEvent *event = &events[eventIndex];
+
+		postmasterDied |= (event->events & WL_POSTMASTER_DEATH) != 0;
+		latchSet |= (event->events & WL_LATCH_SET) != 0;
+	}
+
+	/* free the wait event set before we might throw an error */
+	FreeWaitEventSet(waitEventSet);
+	pfree(events);
+
+	if (postmasterDied)
+	{
+		ereport(ERROR, (errmsg("postmaster was shut down, exiting")));
+	}
+
+	if (latchSet)
+	{
+		ResetLatch(MyLatch);
+		CHECK_FOR_INTERRUPTS();
+	}
+}
+
+
+/*
+ * citus_metadata_sync_progress returns the progress of the metadata syncs that
+ * are in progress, with a row for every node that is being synced.
+ */
+Datum
+citus_metadata_sync_progress(PG_FUNCTION_ARGS)
+{
+	List *attachedDSMSegments = NIL;
+	TupleDesc tupleDescriptor = NULL;
+
+	CheckCitusVersion(ERROR);
+
+	Tuplestorestate *tupleStore = SetupTuplestore(fcinfo, &tupleDescriptor);
+	List *monitorList = ProgressMonitorList(METADATA_SYNC_MAGIC_NUMBER,
+											&attachedDSMSegments);
+
+	ProgressMonitorData *monitor = NULL;
+	foreach_ptr(monitor, monitorList)
+	{
+		MetadataSyncProgress *progressArray = (MetadataSyncProgress *) monitor->steps;
+
+		for (int stepIndex = 0; stepIndex < monitor->stepCount; stepIndex++)
+		{
+			MetadataSyncProgress *progress = &progressArray[stepIndex];
+			Datum values[5];
+			bool isNulls[5];
+
+			memset(values, 0, sizeof(values));
+			memset(isNulls, false, sizeof(isNulls));
+
+			values[0] = Int32GetDatum(monitor->processId);
+			values[1] = Int32GetDatum(progress->nodeId);
+			values[2] = CStringGetTextDatum(MetadataSyncProgressStateName(
+												progress->state));
+			values[3] = Int64GetDatum(progress->commandsCompleted);
+			values[4] = Int64GetDatum(progress->commandCount);
+
+			tuplestore_putvalues(tupleStore, tupleDescriptor, values, isNulls);
+		}
+	}
+
+	tuplestore_donestoring(tupleStore);
+
+	DetachFromDSMSegments(attachedDSMSegments);
+
+	PG_RETURN_VOID();
+}
+
+
+/*
+ * MetadataSyncProgressStateName returns the name of the given state, as shown
+ * in citus_metadata_sync_progress.
+ */
+static char *
+MetadataSyncProgressStateName(MetadataSyncProgressState state)
+{
+	switch (state)
+	{
+		case METADATA_SYNC_PROGRESS_SENDING:
+		{
+			return "sending";
+		}
+
+		case METADATA_SYNC_PROGRESS_COMMITTING:
+		{
+			return "committing";
+		}
+
+		case METADATA_SYNC_PROGRESS_SYNCED:
+		{
+			return "synced";
+		}
+
+		case METADATA_SYNC_PROGRESS_FAILED:
+		{
+			return "failed";
+		}
+
+		default:
+		{
+			return "unknown";
+		}
 	}
 }
 
@@ -914,6 +1386,27 @@ ColocationIdUpdateCommand(Oid relationId, uint32 colocationId)
 }
 
 
+/*
+ * DistributionColumnUpdateCommand creates the SQL command to change the
+ * distribution column of the given table to the column with the given name in
+ * pg_dist_partition.
+ */
+char *
+DistributionColumnUpdateCommand(Oid relationId, char *distributionColumnName)
+{
+	StringInfo command = makeStringInfo();
+	char *qualifiedRelationName = generate_qualified_relation_name(relationId);
+	appendStringInfo(command, "UPDATE pg_dist_partition "
+							  "SET partkey = column_name_to_column(%s,%s) "
+							  "WHERE logicalrelid = %s::regclass",
+					 quote_literal_cstr(qualifiedRelationName),
+					 quote_literal_cstr(distributionColumnName),
+					 quote_literal_cstr(qualifiedRelationName));
+
+	return command->data;
+}
+
+
 /*
  * PlacementUpsertCommand creates a SQL command for upserting a pg_dist_placment
  * entry with the given properties. In the case of a conflict on placementId, the command
@@ -1373,22 +1866,34 @@ SyncMetadataToNodes(void)
 	}
 
 	List *workerList = ActivePrimaryWorkerNodeList(NoLock);
+	List *syncNodeList = NIL;
 	WorkerNode *workerNode = NULL;
 	foreach_ptr(workerNode, workerList)
 	{
 		if (workerNode->hasMetadata && !workerNode->metadataSynced)
 		{
-			bool raiseInterrupts = false;
+			syncNodeList = lappend(syncNodeList, workerNode);
+		}
+	}
 
-			if (!SyncMetadataSnapshotToNode(workerNode, raiseInterrupts))
-			{
-				result = METADATA_SYNC_FAILED_SYNC;
-			}
-			else
-			{
-				MarkNodeMetadataSynced(workerNode->workerName,
-									   workerNode->workerPort, true);
-			}
+	if (syncNodeList == NIL)
+	{
+		return result;
+	}
+
+	bool raiseOnError = false;
+	List *syncedNodeList = SyncMetadataSnapshotToNodeList(syncNodeList, raiseOnError);
+
+	foreach_ptr(workerNode, syncNodeList)
+	{
+		if (!list_member_ptr(syncedNodeList, workerNode))
+		{
+			result = METADATA_SYNC_FAILED_SYNC;
+		}
+		else
+		{
+			MarkNodeMetadataSynced(workerNode->workerName,
+								   workerNode->workerPort, true);
 		}
 	}
 
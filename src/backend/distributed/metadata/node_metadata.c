@@ -10,6 +10,7 @@
 
 
 #include "access/genam.h"
+#include "access/hash.h"
 #include "access/heapam.h"
 #include "access/htup.h"
 #include "access/htup_details.h"
@@ -21,11 +22,13 @@
 #include "catalog/namespace.h"
 #include "commands/sequence.h"
 #include "distributed/citus_acquire_lock.h"
+#include "distributed/citus_ruleutils.h"
 #include "distributed/citus_safe_lib.h"
 #include "distributed/colocation_utils.h"
 #include "distributed/commands.h"
 #include "distributed/commands/utility_hook.h"
 #include "distributed/connection_management.h"
+#include "distributed/listutils.h"
 #include "distributed/maintenanced.h"
 #include "distributed/master_protocol.h"
 #include "distributed/master_metadata_utility.h"
@@ -36,9 +39,11 @@
 #include "distributed/multi_router_planner.h"
 #include "distributed/pg_dist_node.h"
 #include "distributed/reference_table_utils.h"
+#include "distributed/relay_utility.h"
 #include "distributed/remote_commands.h"
 #include "distributed/resource_lock.h"
 #include "distributed/shardinterval_utils.h"
+#include "distributed/tuplestore.h"
 #include "distributed/worker_manager.h"
 #include "distributed/worker_transaction.h"
 #include "lib/stringinfo.h"
@@ -48,6 +53,7 @@
 #include "storage/fd.h"
 #include "utils/builtins.h"
 #include "utils/fmgroids.h"
+#include "utils/inval.h"
 #include "utils/lsyscache.h"
 #include "utils/rel.h"
 #include "utils/relcache.h"
@@ -90,6 +96,8 @@ static WorkerNode * ModifiableWorkerNode(const char *nodeName, int32 nodePort);
 static void UpdateNodeLocation(int32 nodeId, char *newNodeName, int32 newNodePort);
 static bool UnsetMetadataSyncedForAll(void);
 static WorkerNode * SetShouldHaveShards(WorkerNode *workerNode, bool shouldHaveShards);
+static CitusTableCacheEntry * ShardMapCacheEntry(Oid relationId);
+static int64 ShardMapToken(CitusTableCacheEntry *cacheEntry);
 
 /* declarations for dynamic loading */
 PG_FUNCTION_INFO_V1(master_add_node);
@@ -101,6 +109,9 @@ PG_FUNCTION_INFO_V1(master_disable_node);
 PG_FUNCTION_INFO_V1(master_activate_node);
 PG_FUNCTION_INFO_V1(master_update_node);
 PG_FUNCTION_INFO_V1(get_shard_id_for_distribution_column);
+PG_FUNCTION_INFO_V1(citus_shard_map);
+PG_FUNCTION_INFO_V1(citus_shard_map_token);
+PG_FUNCTION_INFO_V1(citus_check_shard_map_token);
 
 
 /*
@@ -360,7 +371,8 @@ master_set_node_property(PG_FUNCTION_ARGS)
  * SetUpDistributedTableDependencies sets up up the following on a node if it's
  * a primary node that currently stores data:
  * - All dependencies (e.g., types, schemas)
- * - Reference tables, because they are needed to handle queries efficiently.
+ * - Reference tables, because they are needed to handle queries efficiently,
+ *   unless citus.replicate_reference_tables_on_activate defers them
  * - Distributed functions
  */
 static void
@@ -371,8 +383,12 @@ SetUpDistributedTableDependencies(WorkerNode *newWorkerNode)
 		EnsureNoModificationsHaveBeenDone();
 		ReplicateAllDependenciesToNode(newWorkerNode->workerName,
 									   newWorkerNode->workerPort);
-		ReplicateAllReferenceTablesToNode(newWorkerNode->workerName,
-										  newWorkerNode->workerPort);
+
+		if (ReplicateReferenceTablesOnActivate)
+		{
+			ReplicateAllReferenceTablesToNode(newWorkerNode->workerName,
+											  newWorkerNode->workerPort);
+		}
 
 		/*
 		 * Let the maintenance daemon do the hard work of syncing the metadata.
@@ -856,6 +872,219 @@ get_shard_id_for_distribution_column(PG_FUNCTION_ARGS)
 }
 
 
+/*
+ * citus_shard_map returns a row for every active placement of every shard of
+ * the given distributed table, in the order of the shard intervals. Shard
+ * names are qualified with the schema of the table. Along with
+ * the hash function of hash-distributed tables, this allows clients to route
+ * rows to shard placements themselves. Clients that write to the placements
+ * directly should obtain citus_shard_map_token() in the same transaction and
+ * verify it with citus_check_shard_map_token() before committing.
+ */
+Datum
+citus_shard_map(PG_FUNCTION_ARGS)
+{
+	Oid relationId = PG_GETARG_OID(0);
+	TupleDesc tupleDescriptor = NULL;
+
+	CheckCitusVersion(ERROR);
+
+	CitusTableCacheEntry *cacheEntry = ShardMapCacheEntry(relationId);
+	Tuplestorestate *tupleStore = SetupTuplestore(fcinfo, &tupleDescriptor);
+	char *schemaName = get_namespace_name(get_rel_namespace(relationId));
+
+	for (int shardIndex = 0; shardIndex < cacheEntry->shardIntervalArrayLength;
+		 shardIndex++)
+	{
+		ShardInterval *shardInterval = cacheEntry->sortedShardIntervalArray[shardIndex];
+		uint64 shardId = shardInterval->shardId;
+		char *shardName = get_rel_name(relationId);
+
+		AppendShardIdToName(&shardName, shardId);
+
+		char *qualifiedShardName = quote_qualified_identifier(schemaName, shardName);
+
+		List *placementList = ActiveShardPlacementList(shardId);
+		ShardPlacement *placement = NULL;
+		foreach_ptr(placement, placementList)
+		{
+			Datum values[7];
+			bool isNulls[7];
+
+			memset(values, 0, sizeof(values));
+			memset(isNulls, false, sizeof(isNulls));
+
+			values[0] = Int64GetDatum(shardId);
+			values[1] = CStringGetTextDatum(qualifiedShardName);
+
+			if (shardInterval->minValueExists)
+			{
+				values[2] = CStringGetTextDatum(DatumToString(shardInterval->minValue,
+															  shardInterval->valueTypeId));
+			}
+			else
+			{
+				isNulls[2] = true;
+			}
+
+			if (shardInterval->maxValueExists)
+			{
+				values[3] = CStringGetTextDatum(DatumToString(shardInterval->maxValue,
+															  shardInterval->valueTypeId));
+			}
+			else
+			{
+				isNulls[3] = true;
+			}
+
+			if (cacheEntry->hashFunction != NULL)
+			{
+				values[4] = ObjectIdGetDatum(cacheEntry->hashFunction->fn_oid);
+			}
+			else
+			{
+				isNulls[4] = true;
+			}
+
+			values[5] = CStringGetTextDatum(placement->nodeName);
+			values[6] = Int32GetDatum(placement->nodePort);
+
+			tuplestore_putvalues(tupleStore, tupleDescriptor, values, isNulls);
+		}
+	}
+
+	/* clean up and return the tuplestore */
+	tuplestore_donestoring(tupleStore);
+
+	PG_RETURN_VOID();
+}
+
+
+/*
+ * citus_shard_map_token returns a token that identifies the current shard map
+ * of the given distributed table, as returned by citus_shard_map(). The token
+ * changes whenever shards are added, split, or moved, or when the location of
+ * a node with placements changes.
+ */
+Datum
+citus_shard_map_token(PG_FUNCTION_ARGS)
+{
+	Oid relationId = PG_GETARG_OID(0);
+
+	CheckCitusVersion(ERROR);
+
+	CitusTableCacheEntry *cacheEntry = ShardMapCacheEntry(relationId);
+
+	PG_RETURN_INT64(ShardMapToken(cacheEntry));
+}
+
+
+/*
+ * citus_check_shard_map_token errors out if the shard map of the given table no
+ * longer matches the given token. The function takes share locks on the shard
+ * metadata, such that the shard map cannot change until the end of the calling
+ * transaction. Clients that write to shard placements directly call it before
+ * committing these writes, and keep the transaction open until they did.
+ */
+Datum
+citus_check_shard_map_token(PG_FUNCTION_ARGS)
+{
+	Oid relationId = PG_GETARG_OID(0);
+	int64 token = PG_GETARG_INT64(1);
+
+	CheckCitusVersion(ERROR);
+
+	CitusTableCacheEntry *cacheEntry = ShardMapCacheEntry(relationId);
+
+	/* block shard moves, splits and placement changes until the end of transaction */
+	List *shardIntervalList = LoadShardIntervalList(relationId);
+	LockShardListMetadata(shardIntervalList, ShareLock);
+
+	/* changes that committed while we waited for the locks invalidate the cache */
+	AcceptInvalidationMessages();
+	cacheEntry = ShardMapCacheEntry(relationId);
+
+	if (ShardMapToken(cacheEntry) != token)
+	{
+		ereport(ERROR, (errcode(ERRCODE_T_R_SERIALIZATION_FAILURE),
+						errmsg("shard map of table %s has changed",
+							   generate_qualified_relation_name(relationId)),
+						errhint("Obtain the shard map again using citus_shard_map() "
+								"and retry.")));
+	}
+
+	PG_RETURN_VOID();
+}
+
+
+/*
+ * ShardMapCacheEntry returns the cache entry of the distributed table whose
+ * shard map is requested, after checking permissions.
+ */
+static CitusTableCacheEntry *
+ShardMapCacheEntry(Oid relationId)
+{
+	EnsureTablePermissions(relationId, ACL_SELECT);
+
+	if (!IsCitusTable(relationId))
+	{
+		ereport(ERROR, (errcode(ERRCODE_INVALID_TABLE_DEFINITION),
+						errmsg("relation is not distributed")));
+	}
+
+	return GetCitusTableCacheEntry(relationId);
+}
+
+
+/*
+ * ShardMapToken hashes the shard intervals of the given table along with the
+ * locations of their active placements.
+ */
+static int64
+ShardMapToken(CitusTableCacheEntry *cacheEntry)
+{
+	StringInfo shardMap = makeStringInfo();
+
+	for (int shardIndex = 0; shardIndex < cacheEntry->shardIntervalArrayLength;
+		 shardIndex++)
+	{
+		ShardInterval *shardInterval = cacheEntry->sortedShardIntervalArray[shardIndex];
+		uint64 shardId = shardInterval->shardId;
+
+		appendStringInfo(shardMap, UINT64_FORMAT, shardId);
+
+		if (shardInterval->minValueExists)
+		{
+			appendStringInfo(shardMap, ":%s",
+							 DatumToString(shardInterval->minValue,
+										   shardInterval->valueTypeId));
+		}
+
+		if (shardInterval->maxValueExists)
+		{
+			appendStringInfo(shardMap, ":%s",
+							 DatumToString(shardInterval->maxValue,
+										   shardInterval->valueTypeId));
+		}
+
+		List *placementList = ActiveShardPlacementList(shardId);
+		ShardPlacement *placement = NULL;
+		foreach_ptr(placement, placementList)
+		{
+			appendStringInfo(shardMap, ",%s:%u", placement->nodeName,
+							 placement->nodePort);
+		}
+
+		appendStringInfoChar(shardMap, ';');
+	}
+
+	uint64 token = DatumGetUInt64(hash_any_extended((unsigned char *) shardMap->data,
+													shardMap->len, 0));
+
+	return (int64) token;
+}
+
+
 /*
  * FindWorkerNode searches over the worker nodes and returns the workerNode
  * if it already exists. Else, the function returns NULL.
@@ -0,0 +1,725 @@
+/*-------------------------------------------------------------------------
+ *
+ * shared_metadata_cache.c
+ *   Keeps a copy of the pg_dist_shard and pg_dist_placement rows of
+ *   distributed tables in shared memory, such that a backend that builds
+ *   its metadata cache entry for a table does not have to scan the
+ *   catalogs if another backend already did so.
+ *
+ *   The rows of a table are serialized into a single chunk of a dynamic
+ *   shared memory area that lives in the main shared memory segment, and
+ *   found through a shared hash keyed by (database, relation). Backends
+ *   still build their own CitusTableCacheEntry from the rows, since shard
+ *   intervals, comparison functions and placement lists are backend-local
+ *   objects, but they skip the index scans and tuple deforming.
+ *
+ *   Rows are removed from the cache by the relcache invalidation callback
+ *   of the metadata cache. To not store rows that an invalidation has
+ *   already made stale, every invalidation increments a counter, and rows
+ *   are only stored if the counter did not change since the backend that
+ *   read them took its catalog snapshot.
+ *
+ * Copyright (c) Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include "postgres.h"
+
+#include "miscadmin.h"
+
+#include "access/hash.h"
+#include "access/xact.h"
+#include "distributed/listutils.h"
+#include "distributed/master_metadata_utility.h"
+#include "distributed/shared_metadata_cache.h"
+#include "port/atomics.h"
+#include "storage/ipc.h"
+#include "storage/lwlock.h"
+#include "storage/shmem.h"
+#include "utils/dsa.h"
+#include "utils/hsearch.h"
+#include "utils/memutils.h"
+#include "utils/snapmgr.h"
+
+
+/* number of invalidation counters, relations are spread over them by hash */
+#define SHARED_METADATA_CACHE_COUNTER_COUNT 256
+
+/* expected size of the rows of a table, used to size the shared hash */
+#define SHARED_METADATA_CACHE_AVERAGE_ENTRY_SIZE 4096
+#define SHARED_METADATA_CACHE_MIN_ENTRIES 64
+
+/* offset of a NULL shard range value */
+#define SERIALIZED_NULL_VALUE_OFFSET -1
+
+
+/*
+ * SharedMetadataCacheControlData contains the lock that protects the shared
+ * hash, and the counters that are incremented on invalidation.
+ */
+typedef struct SharedMetadataCacheControlData
+{
+	int trancheId;
+	char *lockTrancheName;
+	LWLock lock;
+
+	int areaTrancheId;
+	char *areaTrancheName;
+
+	/* incremented when the whole cache of a database is reset */
+	pg_atomic_uint64 resetCounter;
+
+	/* incremented when a relation that hashes to the counter is invalidated */
+	pg_atomic_uint64 invalidationCounters[SHARED_METADATA_CACHE_COUNTER_COUNT];
+} SharedMetadataCacheControlData;
+
+
+/* hash key for the shared cache, relation ids are only unique per database */
+typedef struct SharedMetadataCacheHashKey
+{
+	Oid databaseId;
+	Oid relationId;
+} SharedMetadataCacheHashKey;
+
+
+/* hash entry for the shared cache, pointing to the serialized rows */
+typedef struct SharedMetadataCacheHashEntry
+{
+	SharedMetadataCacheHashKey key;
+
+	dsa_pointer data;
+	Size size;
+} SharedMetadataCacheHashEntry;
+
+
+/*
+ * The serialized rows of a table start with a header, followed by the shard
+ * rows, the placement rows of all shards in the order of the shards, and the
+ * text of the shard ranges.
+ */
+typedef struct SerializedShardMetadataHeader
+{
+	int32 shardCount;
+	int32 placementCount;
+} SerializedShardMetadataHeader;
+
+typedef struct SerializedShard
+{
+	uint64 shardId;
+	int32 minValueOffset;
+	int32 maxValueOffset;
+	int32 placementCount;
+	char storageType;
+} SerializedShard;
+
+typedef struct SerializedPlacement
+{
+	uint64 placementId;
+	uint64 shardLength;
+	int32 groupId;
+	int32 shardState;
+} SerializedPlacement;
+
+
+/* GUC, size of the shared cache in kB */
+int SharedMetadataCacheSize = 0;
+
+static shmem_startup_hook_type prev_shmem_startup_hook = NULL;
+static SharedMetadataCacheControlData *MetadataCacheSharedState = NULL;
+
+/* shared hash of cached tables */
+static HTAB *SharedMetadataCacheHash = NULL;
+
+/* memory of the dynamic shared memory area, and our mapping of it */
+static void *SharedMetadataAreaPlace = NULL;
+static dsa_area *SharedMetadataArea = NULL;
+
+
+static Size SharedMetadataCacheShmemSize(void);
+static Size SharedMetadataAreaSize(void);
+static long SharedMetadataCacheMaxEntries(void);
+static void SharedMetadataCacheShmemInit(void);
+static void AttachSharedMetadataArea(void);
+static pg_atomic_uint64 * InvalidationCounter(Oid relationId);
+static uint64 CurrentGeneration(Oid relationId);
+static void BuildSharedMetadataCacheHashKey(SharedMetadataCacheHashKey *key,
+											Oid relationId);
+static char * SerializeShardMetadata(List *shardMetadataList, Size *size);
+static List * DeserializeShardMetadata(char *data);
+
+
+/*
+ * InitializeSharedMetadataCache, called at server start, requests the shared
+ * memory for the cache if it is enabled.
+ */
+void
+InitializeSharedMetadataCache(void)
+{
+	if (SharedMetadataCacheSize == 0)
+	{
+		return;
+	}
+
+	if (!IsUnderPostmaster)
+	{
+		RequestAddinShmemSpace(SharedMetadataCacheShmemSize());
+	}
+
+	prev_shmem_startup_hook = shmem_startup_hook;
+	shmem_startup_hook = SharedMetadataCacheShmemInit;
+}
+
+
+/*
+ * SharedMetadataCacheUsable returns whether the current backend can read rows
+ * from and store rows into the shared cache. Transactions that got a
+ * transaction id might have changed the metadata, and their uncommitted rows
+ * must neither be shared with other backends nor be hidden by shared rows.
+ */
+bool
+SharedMetadataCacheUsable(void)
+{
+	if (MetadataCacheSharedState == NULL)
+	{
+		return false;
+	}
+
+	if (GetTopTransactionIdIfAny() != InvalidTransactionId)
+	{
+		return false;
+	}
+
+	AttachSharedMetadataArea();
+
+	return true;
+}
+
+
+/*
+ * SharedMetadataCacheGeneration returns the invalidation generation of the
+ * given relation, which the caller passes to StoreSharedShardMetadata after
+ * reading the rows of the relation from the catalogs.
+ *
+ * We drop the catalog snapshot after reading the counters, such that the
+ * rows are read with a snapshot that includes all metadata changes for which
+ * an invalidation was counted so far.
+ */
+uint64
+SharedMetadataCacheGeneration(Oid relationId)
+{
+	uint64 generation = CurrentGeneration(relationId);
+
+	InvalidateCatalogSnapshot();
+
+	return generation;
+}
+
+
+/*
+ * LookupSharedShardMetadata copies the cached rows of the given relation into
+ * a list of SharedShardMetadata in the current memory context. The function
+ * returns false if the relation is not in the cache.
+ */
+bool
+LookupSharedShardMetadata(Oid relationId, List **shardMetadataList)
+{
+	SharedMetadataCacheHashKey key;
+	bool found = false;
+
+	BuildSharedMetadataCacheHashKey(&key, relationId);
+
+	LWLockAcquire(&MetadataCacheSharedState->lock, LW_SHARED);
+
+	SharedMetadataCacheHashEntry *entry = hash_search(SharedMetadataCacheHash, &key,
+													  HASH_FIND, &found);
+	if (!found)
+	{
+		LWLockRelease(&MetadataCacheSharedState->lock);
+		return false;
+	}
+
+	char *data = palloc(entry->size);
+	memcpy(data, dsa_get_address(SharedMetadataArea, entry->data), entry->size);
+
+	LWLockRelease(&MetadataCacheSharedState->lock);
+
+	*shardMetadataList = DeserializeShardMetadata(data);
+
+	pfree(data);
+
+	return true;
+}
+
+
+/*
+ * StoreSharedShardMetadata stores the given rows of a relation in the shared
+ * cache, unless the relation was invalidated after the given generation was
+ * obtained. The rows are silently not stored if the cache is full.
+ */
+void
+StoreSharedShardMetadata(Oid relationId, uint64 generation, List *shardMetadataList)
+{
+	SharedMetadataCacheHashKey key;
+	Size size = 0;
+	bool found = false;
+
+	char *data = SerializeShardMetadata(shardMetadataList, &size);
+	dsa_pointer sharedData = dsa_allocate_extended(SharedMetadataArea, size,
+												   DSA_ALLOC_NO_OOM);
+	if (!DsaPointerIsValid(sharedData))
+	{
+		pfree(data);
+		return;
+	}
+
+	memcpy(dsa_get_address(SharedMetadataArea, sharedData), data, size);
+	pfree(data);
+
+	BuildSharedMetadataCacheHashKey(&key, relationId);
+
+	LWLockAcquire(&MetadataCacheSharedState->lock, LW_EXCLUSIVE);
+
+	if (CurrentGeneration(relationId) != generation)
+	{
+		LWLockRelease(&MetadataCacheSharedState->lock);
+		dsa_free(SharedMetadataArea, sharedData);
+		return;
+	}
+
+	SharedMetadataCacheHashEntry *entry = hash_search(SharedMetadataCacheHash, &key,
+													  HASH_ENTER_NULL, &found);
+	if (entry == NULL)
+	{
+		LWLockRelease(&MetadataCacheSharedState->lock);
+		dsa_free(SharedMetadataArea, sharedData);
+		return;
+	}
+
+	if (found)
+	{
+		dsa_free(SharedMetadataArea, entry->data);
+	}
+
+	entry->data = sharedData;
+	entry->size = size;
+
+	LWLockRelease(&MetadataCacheSharedState->lock);
+}
+
+
+/*
+ * InvalidateSharedShardMetadata removes the rows of the given relation from
+ * the shared cache, and makes sure rows that other backends are currently
+ * reading are not stored.
+ */
+void
+InvalidateSharedShardMetadata(Oid relationId)
+{
+	SharedMetadataCacheHashKey key;
+	bool found = false;
+
+	if (MetadataCacheSharedState == NULL)
+	{
+		return;
+	}
+
+	pg_atomic_fetch_add_u64(InvalidationCounter(relationId), 1);
+
+	BuildSharedMetadataCacheHashKey(&key, relationId);
+
+	/* most invalidations are for other relations, check before locking exclusively */
+	LWLockAcquire(&MetadataCacheSharedState->lock, LW_SHARED);
+	hash_search(SharedMetadataCacheHash, &key, HASH_FIND, &found);
+	LWLockRelease(&MetadataCacheSharedState->lock);
+
+	if (!found)
+	{
+		return;
+	}
+
+	AttachSharedMetadataArea();
+
+	LWLockAcquire(&MetadataCacheSharedState->lock, LW_EXCLUSIVE);
+
+	SharedMetadataCacheHashEntry *entry = hash_search(SharedMetadataCacheHash, &key,
+													  HASH_FIND, &found);
+	if (found)
+	{
+		dsa_free(SharedMetadataArea, entry->data);
+		hash_search(SharedMetadataCacheHash, &key, HASH_REMOVE, NULL);
+	}
+
+	LWLockRelease(&MetadataCacheSharedState->lock);
+}
+
+
+/*
+ * ResetSharedMetadataCache removes the rows of all relations of the current
+ * database from the shared cache.
+ */
+void
+ResetSharedMetadataCache(void)
+{
+	HASH_SEQ_STATUS status;
+	SharedMetadataCacheHashEntry *entry = NULL;
+
+	if (MetadataCacheSharedState == NULL)
+	{
+		return;
+	}
+
+	pg_atomic_fetch_add_u64(&MetadataCacheSharedState->resetCounter, 1);
+
+	AttachSharedMetadataArea();
+
+	LWLockAcquire(&MetadataCacheSharedState->lock, LW_EXCLUSIVE);
+
+	hash_seq_init(&status, SharedMetadataCacheHash);
+	while ((entry = hash_seq_search(&status)) != NULL)
+	{
+		if (entry->key.databaseId != MyDatabaseId)
+		{
+			continue;
+		}
+
+		dsa_free(SharedMetadataArea, entry->data);
+		hash_search(SharedMetadataCacheHash, &entry->key, HASH_REMOVE, NULL);
+	}
+
+	LWLockRelease(&MetadataCacheSharedState->lock);
+}
+
+
+/*
+ * AttachSharedMetadataArea maps the dynamic shared memory area of the cache
+ * in the current backend, if not done yet.
+ */
+static void
+AttachSharedMetadataArea(void)
+{
+	if (SharedMetadataArea != NULL)
+	{
+		return;
+	}
+
+	MemoryContext oldContext = MemoryContextSwitchTo(TopMemoryContext);
+	SharedMetadataArea = dsa_attach_in_place(SharedMetadataAreaPlace, NULL);
+	MemoryContextSwitchTo(oldContext);
+
+	on_shmem_exit(dsa_on_shmem_exit_release_in_place,
+				  PointerGetDatum(SharedMetadataAreaPlace));
+}
+
+
+/*
+ * InvalidationCounter returns the counter that is incremented when the given
+ * relation of the current database is invalidated.
+ */
+static pg_atomic_uint64 *
+InvalidationCounter(Oid relationId)
+{
+	uint32 counterIndex = DatumGetUInt32(hash_uint32(relationId ^ MyDatabaseId)) %
+						  SHARED_METADATA_CACHE_COUNTER_COUNT;
+
+	return &MetadataCacheSharedState->invalidationCounters[counterIndex];
+}
+
+
+/*
+ * CurrentGeneration returns the sum of the reset counter and the invalidation
+ * counter of the given relation. Both only ever increase, so the sum changes
+ * whenever either of them does.
+ */
+static uint64
+CurrentGeneration(Oid relationId)
+{
+	return pg_atomic_read_u64(&MetadataCacheSharedState->resetCounter) +
+		   pg_atomic_read_u64(InvalidationCounter(relationId));
+}
+
+
+/*
+ * BuildSharedMetadataCacheHashKey fills the hash key of the given relation of
+ * the current database. The key is zeroed first since it is hashed as a blob.
+ */
+static void
+BuildSharedMetadataCacheHashKey(SharedMetadataCacheHashKey *key, Oid relationId)
+{
+	memset(key, 0, sizeof(SharedMetadataCacheHashKey));
+	key->databaseId = MyDatabaseId;
+	key->relationId = relationId;
+}
+
+
+/*
+ * SerializeShardMetadata serializes the given list of SharedShardMetadata into
+ * a single chunk of memory, and returns the chunk and its size.
+ */
+static char *
+SerializeShardMetadata(List *shardMetadataList, Size *size)
+{
+	int placementCount = 0;
+	Size stringSize = 0;
+	SharedShardMetadata *shardMetadata = NULL;
+
+	foreach_ptr(shardMetadata, shardMetadataList)
+	{
+		placementCount += list_length(shardMetadata->placementList);
+
+		if (shardMetadata->minValue != NULL)
+		{
+			stringSize += strlen(shardMetadata->minValue) + 1;
+		}
+
+		if (shardMetadata->maxValue != NULL)
+		{
+			stringSize += strlen(shardMetadata->maxValue) + 1;
+		}
+	}
+
+	int shardCount = list_length(shardMetadataList);
+	Size totalSize = sizeof(SerializedShardMetadataHeader) +
+					 shardCount * sizeof(SerializedShard) +
+					 placementCount * sizeof(SerializedPlacement) +
+					 stringSize;
+
+	char *data = palloc0(totalSize);
+
+	SerializedShardMetadataHeader *header = (SerializedShardMetadataHeader *) data;
+	SerializedShard *shardArray =
+		(SerializedShard *) (data + sizeof(SerializedShardMetadataHeader));
+	SerializedPlacement *placementArray =
+		(SerializedPlacement *) (shardArray + shardCount);
+	char *stringArea = (char *) (placementArray + placementCount);
+	int32 stringOffset = 0;
+	int shardIndex = 0;
+	int placementIndex = 0;
+
+	header->shardCount = shardCount;
+	header->placementCount = placementCount;
+
+	foreach_ptr(shardMetadata, shardMetadataList)
+	{
+		SerializedShard *shard = &shardArray[shardIndex];
+		GroupShardPlacement *placement = NULL;
+
+		shard->shardId = shardMetadata->shardId;
+		shard->storageType = shardMetadata->storageType;
+		shard->placementCount = list_length(shardMetadata->placementList);
+
+		shard->minValueOffset = SERIALIZED_NULL_VALUE_OFFSET;
+		if (shardMetadata->minValue != NULL)
+		{
+			shard->minValueOffset = stringOffset;
+			strcpy(stringArea + stringOffset, shardMetadata->minValue);
+			stringOffset += strlen(shardMetadata->minValue) + 1;
+		}
+
+		shard->maxValueOffset = SERIALIZED_NULL_VALUE_OFFSET;
+		if (shardMetadata->maxValue != NULL)
+		{
+			shard->maxValueOffset = stringOffset;
+			strcpy(stringArea + stringOffset, shardMetadata->maxValue);
+			stringOffset += strlen(shardMetadata->maxValue) + 1;
+		}
+
+		foreach_ptr(placement, shardMetadata->placementList)
+		{
+			SerializedPlacement *serializedPlacement = &placementArray[placementIndex];
+
+			serializedPlacement->placementId = placement->placementId;
+			serializedPlacement->shardLength = placement->shardLength;
+			serializedPlacement->groupId = placement->groupId;
+			serializedPlacement->shardState = placement->shardState;
+
+			placementIndex++;
+		}
+
+		shardIndex++;
+	}
+
+	*size = totalSize;
+
+	return data;
+}
+
+
+/*
+ * DeserializeShardMetadata builds a list of SharedShardMetadata from the
+ * given serialized rows in the current memory context.
+ */
+static List *
+DeserializeShardMetadata(char *data)
+{
+	List *shardMetadataList = NIL;
+
+	SerializedShardMetadataHeader *header = (SerializedShardMetadataHeader *) data;
+	SerializedShard *shardArray =
+		(SerializedShard *) (data + sizeof(SerializedShardMetadataHeader));
+	SerializedPlacement *placementArray =
+		(SerializedPlacement *) (shardArray + header->shardCount);
+	char *stringArea = (char *) (placementArray + header->placementCount);
+	int placementIndex = 0;
+
+	for (int shardIndex = 0; shardIndex < header->shardCount; shardIndex++)
+	{
+		SerializedShard *shard = &shardArray[shardIndex];
+		SharedShardMetadata *shardMetadata = palloc0(sizeof(SharedShardMetadata));
+
+		shardMetadata->shardId = shard->shardId;
+		shardMetadata->storageType = shard->storageType;
+
+		if (shard->minValueOffset != SERIALIZED_NULL_VALUE_OFFSET)
+		{
+			shardMetadata->minValue = pstrdup(stringArea + shard->minValueOffset);
+		}
+
+		if (shard->maxValueOffset != SERIALIZED_NULL_VALUE_OFFSET)
+		{
+			shardMetadata->maxValue = pstrdup(stringArea + shard->maxValueOffset);
+		}
+
+		for (int shardPlacementIndex = 0; shardPlacementIndex < shard->placementCount;
+			 shardPlacementIndex++)
+		{
+			SerializedPlacement *serializedPlacement = &placementArray[placementIndex];
+			GroupShardPlacement *placement = CitusMakeNode(GroupShardPlacement);
+
+			placement->placementId = serializedPlacement->placementId;
+			placement->shardId = shard->shardId;
+			placement->shardLength = serializedPlacement->shardLength;
+			placement->groupId = serializedPlacement->groupId;
+			placement->shardState = serializedPlacement->shardState;
+
+			shardMetadata->placementList = lappend(shardMetadata->placementList,
+												   placement);
+			placementIndex++;
+		}
+
+		shardMetadataList = lappend(shardMetadataList, shardMetadata);
+	}
+
+	return shardMetadataList;
+}
+
+
+/*
+ * SharedMetadataAreaSize returns the size of the dynamic shared memory
+ * area that holds the serialized rows.
+ */
+static Size
+SharedMetadataAreaSize(void)
+{
+	return Max((Size) SharedMetadataCacheSize * 1024L, dsa_minimum_size());
+}
+
+
+/*
+ * SharedMetadataCacheMaxEntries returns the maximum number of tables in the
+ * shared hash, based on the size of the area.
+ */
+static long
+SharedMetadataCacheMaxEntries(void)
+{
+	return Max(SharedMetadataAreaSize() / SHARED_METADATA_CACHE_AVERAGE_ENTRY_SIZE,
+			   SHARED_METADATA_CACHE_MIN_ENTRIES);
+}
+
+
+/*
+ * SharedMetadataCacheShmemSize returns the size of the shared memory needed
+ * for the cache.
+ */
+static Size
+SharedMetadataCacheShmemSize(void)
+{
+	Size size = 0;
+
+	size = add_size(size, sizeof(SharedMetadataCacheControlData));
+
+	Size hashSize = hash_estimate_size(SharedMetadataCacheMaxEntries(),
+									   sizeof(SharedMetadataCacheHashEntry));
+	size = add_size(size, hashSize);
+
+	size = add_size(size, SharedMetadataAreaSize());
+
+	return size;
+}
+
+
+/*
+ * SharedMetadataCacheShmemInit initializes the shared memory for the cache.
+ */
+static void
+SharedMetadataCacheShmemInit(void)
+{
+	bool alreadyInitialized = false;
+	bool areaInitialized = false;
+	HASHCTL info;
+
+	LWLockAcquire(AddinShmemInitLock, LW_EXCLUSIVE);
+
+	MetadataCacheSharedState =
+		(SharedMetadataCacheControlData *) ShmemInitStruct(
+			"Citus Shared Metadata Cache",
+			sizeof(SharedMetadataCacheControlData),
+			&alreadyInitialized);
+
+	SharedMetadataAreaPlace = ShmemInitStruct("Citus Shared Metadata Cache Area",
+											  SharedMetadataAreaSize(),
+											  &areaInitialized);
+
+	/*
+	 * Might already be initialized on EXEC_BACKEND type platforms that call
+	 * shared library initialization functions in every backend.
+	 */
+	if (!alreadyInitialized)
+	{
+		MetadataCacheSharedState->trancheId = LWLockNewTrancheId();
+		MetadataCacheSharedState->lockTrancheName = "Citus Shared Metadata Cache";
+		LWLockRegisterTranche(MetadataCacheSharedState->trancheId,
+							  MetadataCacheSharedState->lockTrancheName);
+
+		LWLockInitialize(&MetadataCacheSharedState->lock,
+						 MetadataCacheSharedState->trancheId);
+
+		MetadataCacheSharedState->areaTrancheId = LWLockNewTrancheId();
+		MetadataCacheSharedState->areaTrancheName = "Citus Shared Metadata Cache Area";
+		LWLockRegisterTranche(MetadataCacheSharedState->areaTrancheId,
+							  MetadataCacheSharedState->areaTrancheName);
+
+		pg_atomic_init_u64(&MetadataCacheSharedState->resetCounter, 0);
+		for (int counterIndex = 0; counterIndex < SHARED_METADATA_CACHE_COUNTER_COUNT;
+			 counterIndex++)
+		{
+			pg_atomic_init_u64(&MetadataCacheSharedState->invalidationCounters[
+								   counterIndex], 0);
+		}
+
+		/* limit the area to its place, such that it never creates DSM segments */
+		dsa_area *area = dsa_create_in_place(SharedMetadataAreaPlace,
+											 SharedMetadataAreaSize(),
+											 MetadataCacheSharedState->areaTrancheId,
+											 NULL);
+		dsa_set_size_limit(area, SharedMetadataAreaSize());
+		dsa_detach(area);
+	}
+
+	memset(&info, 0, sizeof(info));
+	info.keysize = sizeof(SharedMetadataCacheHashKey);
+	info.entrysize = sizeof(SharedMetadataCacheHashEntry);
+	int hashFlags = (HASH_ELEM | HASH_BLOBS);
+
+	SharedMetadataCacheHash = ShmemInitHash("Citus Shared Metadata Cache Hash",
+											SharedMetadataCacheMaxEntries(),
+											SharedMetadataCacheMaxEntries(),
+											&info, hashFlags);
+
+	LWLockRelease(AddinShmemInitLock);
+
+	if (prev_shmem_startup_hook != NULL)
+	{
+		prev_shmem_startup_hook();
+	}
+}
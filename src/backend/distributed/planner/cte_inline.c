@@ -16,6 +16,10 @@
 #include "postgres.h"
 
 #include "distributed/cte_inline.h"
+#include "distributed/listutils.h"
+#include "distributed/master_metadata_utility.h"
+#include "distributed/metadata_cache.h"
+#include "distributed/query_utils.h"
 #include "nodes/nodeFuncs.h"
 #if PG_VERSION_NUM >= 120000
 #include "optimizer/optimizer.h"
@@ -52,6 +56,9 @@ typedef struct inline_cte_walker_context
 
 /* copy & paste from Postgres source, moved into a function for readability */
 static bool PostgreSQLCTEInlineCondition(CommonTableExpr *cte, CmdType cmdType);
+static bool CTEInlineCondition(CommonTableExpr *cte, CmdType cmdType);
+static bool SmallCTEInlineCondition(CommonTableExpr *cte, CmdType cmdType);
+static bool CTEInputSizeFromShardStatistics(Query *cteQuery, uint64 *inputSize);
 
 /* the following utility functions are copy & paste from PostgreSQL code */
 static void inline_cte(Query *mainQuery, CommonTableExpr *cte);
@@ -69,6 +76,9 @@ static bool QueryTreeContainsInlinableCteWalker(Node *node);
 /* controlled via GUC */
 bool EnableCTEInlining = true;
 
+/* GUC, maximum size in KB of the tables read by multiply-referenced CTEs to inline */
+int CTEInlineSizeThreshold = 0;
+
 /*
  * RecursivelyInlineCtesInQueryTree gets a query and recursively traverses the
  * tree from top to bottom. On each level, the CTEs that are eligable for
@@ -135,7 +145,7 @@ InlineCTEsInQueryTree(Query *query)
 		 * First, make sure that Postgres is OK to inline the CTE. Later, check for
 		 * distributed query planning constraints that might prevent inlining.
 		 */
-		if (PostgreSQLCTEInlineCondition(cte, query->commandType))
+		if (CTEInlineCondition(cte, query->commandType))
 		{
 			elog(DEBUG1, "CTE %s is going to be inlined via "
 						 "distributed planning", cte->ctename);
@@ -183,7 +193,7 @@ QueryTreeContainsInlinableCteWalker(Node *node)
 		{
 			CommonTableExpr *cte = (CommonTableExpr *) lfirst(cteCell);
 
-			if (PostgreSQLCTEInlineCondition(cte, query->commandType))
+			if (CTEInlineCondition(cte, query->commandType))
 			{
 				/*
 				 * Return true even if we can find a single CTE that is
@@ -200,6 +210,100 @@ QueryTreeContainsInlinableCteWalker(Node *node)
 }
 
 
+/*
+ * CTEInlineCondition returns true if the CTE should be inlined, either because
+ * Postgres would inline it, or because it is referenced multiple times but the
+ * tables it reads are small enough to compute it once for every reference.
+ */
+static bool
+CTEInlineCondition(CommonTableExpr *cte, CmdType cmdType)
+{
+	return PostgreSQLCTEInlineCondition(cte, cmdType) ||
+		   SmallCTEInlineCondition(cte, cmdType);
+}
+
+
+/*
+ * SmallCTEInlineCondition returns true if the CTE is referenced multiple
+ * times without a preference for materializing it, is otherwise safe to
+ * inline, and the tables it reads multiplied by the number of references are
+ * below citus.cte_inline_size_threshold.
+ *
+ * Inlining such a CTE computes it once for every reference, but lets us push
+ * it down along with the rest of the query instead of sending its result to
+ * the coordinator and back to the workers, which pays off when the tables are
+ * small. The sizes come from pg_dist_placement, since the coordinator has no
+ * statistics of the shards. CTEs that read tables whose size is not known are
+ * still materialized.
+ */
+static bool
+SmallCTEInlineCondition(CommonTableExpr *cte, CmdType cmdType)
+{
+	uint64 inputSize = 0;
+
+	if (CTEInlineSizeThreshold <= 0 || cte->cterefcount < 2)
+	{
+		return false;
+	}
+
+#if PG_VERSION_NUM >= 120000
+	if (cte->ctematerialized != CTEMaterializeDefault)
+	{
+		return false;
+	}
+#endif
+
+	if (cte->cterecursive ||
+		cmdType != CMD_SELECT ||
+		contain_dml(cte->ctequery) ||
+		contain_volatile_functions(cte->ctequery))
+	{
+		return false;
+	}
+
+	if (!CTEInputSizeFromShardStatistics((Query *) cte->ctequery, &inputSize))
+	{
+		return false;
+	}
+
+	uint64 thresholdInBytes = (uint64) CTEInlineSizeThreshold * 1024;
+
+	return inputSize <= thresholdInBytes / cte->cterefcount;
+}
+
+
+/*
+ * CTEInputSizeFromShardStatistics sets inputSize to the total size of the
+ * Citus tables that the CTE query reads, and returns false if the query reads
+ * a local table or a distributed table whose size is not known.
+ */
+static bool
+CTEInputSizeFromShardStatistics(Query *cteQuery, uint64 *inputSize)
+{
+	List *rangeTableList = NIL;
+
+	*inputSize = 0;
+
+	ExtractRangeTableRelationWalker((Node *) cteQuery, &rangeTableList);
+
+	RangeTblEntry *rangeTableEntry = NULL;
+	foreach_ptr(rangeTableEntry, rangeTableList)
+	{
+		uint64 relationSize = 0;
+
+		if (!IsCitusTable(rangeTableEntry->relid) ||
+			!RelationSizeFromShardStatistics(rangeTableEntry->relid, &relationSize))
+		{
+			return false;
+		}
+
+		*inputSize += relationSize;
+	}
+
+	return true;
+}
+
+
 /*
  * PostgreSQLCTEInlineCondition returns true if the CTE is considered
  * safe to inline by Postgres.
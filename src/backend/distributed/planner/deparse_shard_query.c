@@ -12,7 +12,9 @@
 #include "postgres.h"
 #include "c.h"
 
+#include "access/hash.h"
 #include "access/heapam.h"
+#include "catalog/pg_type.h"
 #include "distributed/citus_nodefuncs.h"
 #include "distributed/citus_ruleutils.h"
 #include "distributed/deparse_shard_query.h"
@@ -32,15 +34,63 @@
 #include "nodes/pg_list.h"
 #include "parser/parsetree.h"
 #include "storage/lock.h"
+#include "utils/builtins.h"
 #include "utils/lsyscache.h"
 #include "utils/rel.h"
 
 
+/*
+ * QueryTemplateContext collects the constants that are replaced by parameters
+ * when deparsing the template of a query.
+ */
+typedef struct QueryTemplateContext
+{
+	List *constList;
+} QueryTemplateContext;
+
+
+/*
+ * PlaceholderContext is used to replace the relations in a query by shard
+ * name placeholders.
+ */
+typedef struct PlaceholderContext
+{
+	ShardQueryTemplate *queryTemplate;
+	List *relationShardList;
+
+	/* number of range table entries that got a placeholder */
+	int placeholderRteCount;
+} PlaceholderContext;
+
+
+/*
+ * Placeholders in a ShardQueryTemplate are quoted identifiers of the form
+ * "$citus_shard_<id>$". The deparser always quotes such names, so the quotes
+ * are part of the placeholder.
+ */
+#define SHARD_NAME_PLACEHOLDER_PREFIX "\"$citus_shard_"
+#define SHARD_NAME_PLACEHOLDER_SUFFIX "$\""
+
+
+/* GUC, whether router tasks are executed with prepared statements */
+bool EnablePreparedStatementCaching = false;
+
+/* GUC, whether multi-shard queries are deparsed once for all shards */
+bool EnableShardQueryTemplates = true;
+
+
 static void UpdateTaskQueryString(Query *query, Oid distributedTableId,
 								  RangeTblEntry *valuesRTE, Task *task);
+static bool ContainsParamWalker(Node *node, void *context);
+static Node * ReplaceConstsWithParamsMutator(Node *node,
+											 QueryTemplateContext *context);
+static uint64 HashResultTypes(List *targetList, uint64 hash);
 static void ConvertRteToSubqueryWithEmptyResult(RangeTblEntry *rte);
-static bool ShouldLazyDeparseQuery(Task *task);
 static char * DeparseTaskQuery(Task *task, Query *query);
+static bool ReplaceRelationsWithPlaceholders(Node *node,
+											 PlaceholderContext *context);
+static int CountPlaceholders(char *templateString);
+static RelationShard * FindRelationShard(List *relationShardList, Oid relationId);
 
 
 /*
@@ -54,6 +104,7 @@ RebuildQueryStrings(Job *workerJob)
 	List *taskList = workerJob->taskList;
 	Oid relationId = ((RangeTblEntry *) linitial(originalQuery->rtable))->relid;
 	RangeTblEntry *valuesRTE = ExtractDistributedInsertValuesRTE(originalQuery);
+	ShardQueryTemplate *queryTemplate = NULL;
 
 	Task *task = NULL;
 
@@ -63,6 +114,31 @@ RebuildQueryStrings(Job *workerJob)
 
 		if (UpdateOrDeleteQuery(query) && list_length(taskList) > 1)
 		{
+			if (EnableShardQueryTemplates && !ShouldLazyDeparseQuery(task))
+			{
+				/* deparse the query once and fill in the shard names of every task */
+				if (queryTemplate == NULL)
+				{
+					Query *templateQuery = copyObject(originalQuery);
+
+					queryTemplate = DeparseShardQueryTemplate(templateQuery,
+															  task->relationShardList);
+				}
+
+				char *queryString =
+					InstantiateShardQueryTemplate(queryTemplate, task->relationShardList);
+				if (queryString != NULL)
+				{
+					SetTaskQueryString(task, queryString);
+					task->parametersInQueryStringResolved =
+						workerJob->parametersInJobQueryResolved;
+
+					ereport(DEBUG4, (errmsg("query after rebuilding:  %s",
+											ApplyLogRedaction(queryString))));
+					continue;
+				}
+			}
+
 			query = copyObject(originalQuery);
 		}
 		else if (query->commandType == CMD_INSERT && task->modifyWithSubquery)
@@ -404,7 +480,7 @@ ConvertRteToSubqueryWithEmptyResult(RangeTblEntry *rte)
  * when adding it to the task. Right now it simply checks if any shards on the
  * local node can be used for the task.
  */
-static bool
+bool
 ShouldLazyDeparseQuery(Task *task)
 {
 	return TaskAccessesLocalNode(task);
@@ -420,6 +496,11 @@ ShouldLazyDeparseQuery(Task *task)
 void
 SetTaskQuery(Task *task, Query *query)
 {
+	/* a prepared statement would no longer match the query */
+	task->preparedStatementName = NULL;
+	task->prepareCommand = NULL;
+	task->executeCommand = NULL;
+
 	if (ShouldLazyDeparseQuery(task))
 	{
 		task->queryForLocalExecution = query;
@@ -442,6 +523,199 @@ SetTaskQueryString(Task *task, char *queryString)
 {
 	task->queryForLocalExecution = NULL;
 	task->queryStringLazy = queryString;
+
+	/* a prepared statement would no longer match the query string */
+	task->preparedStatementName = NULL;
+	task->prepareCommand = NULL;
+	task->executeCommand = NULL;
+}
+
+
+/*
+ * SetTaskQueryTemplate sets up a router task to be executed with a statement
+ * that is prepared once per connection, such that the worker does not parse
+ * and plan the query on every execution. The statement is deparsed from the
+ * query with the constants in its WHERE clause replaced by parameters, so
+ * executions of the same query with different values share it, and the task
+ * executes it with the constants as arguments.
+ *
+ * Statements are named after a hash of their text and of the types of their
+ * parameters and results. DDL that changes the deparsed query or its result
+ * types therefore leads to a new statement rather than executing a stale one,
+ * other DDL on the shards is handled by the plan cache of the worker.
+ */
+void
+SetTaskQueryTemplate(Task *task, Query *query)
+{
+	QueryTemplateContext context = { NIL };
+
+	if (!EnablePreparedStatementCaching || task->queryStringLazy == NULL)
+	{
+		/* tasks that might run locally keep the query for local execution */
+		return;
+	}
+
+	if (query->commandType != CMD_SELECT && query->commandType != CMD_UPDATE &&
+		query->commandType != CMD_DELETE)
+	{
+		return;
+	}
+
+	if (query->hasSubLinks || query->cteList != NIL || query->jointree == NULL ||
+		query->jointree->quals == NULL)
+	{
+		return;
+	}
+
+	/* parameters that are not resolved are sent along with the query string */
+	if (query_tree_walker(query, ContainsParamWalker, NULL, 0))
+	{
+		return;
+	}
+
+	Query *templateQuery = copyObject(query);
+	templateQuery->jointree->quals =
+		ReplaceConstsWithParamsMutator(templateQuery->jointree->quals, &context);
+	if (context.constList == NIL)
+	{
+		return;
+	}
+
+	StringInfo templateString = makeStringInfo();
+	pg_get_query_def(templateQuery, templateString);
+
+	int paramCount = list_length(context.constList);
+	Oid *paramTypes = palloc0(paramCount * sizeof(Oid));
+	StringInfo paramTypeNames = makeStringInfo();
+	StringInfo paramValues = makeStringInfo();
+	int paramIndex = 0;
+
+	Const *constNode = NULL;
+	foreach_ptr(constNode, context.constList)
+	{
+		paramTypes[paramIndex] = constNode->consttype;
+
+		appendStringInfo(paramTypeNames, "%s%s", paramIndex > 0 ? ", " : "",
+						 format_type_be_qualified(constNode->consttype));
+		appendStringInfo(paramValues, "%s%s", paramIndex > 0 ? ", " : "",
+						 pg_get_rule_expr((Node *) constNode));
+
+		paramIndex++;
+	}
+
+	uint64 hash = DatumGetUInt64(hash_any_extended(
+									 (unsigned char *) templateString->data,
+									 templateString->len, 0));
+	hash = DatumGetUInt64(hash_any_extended((unsigned char *) paramTypes,
+											paramCount * sizeof(Oid), hash));
+	hash = HashResultTypes(query->targetList, hash);
+	hash = HashResultTypes(query->returningList, hash);
+
+	char *statementName = psprintf("citus_prepared_" UINT64_FORMAT, hash);
+
+	StringInfo prepareCommand = makeStringInfo();
+	appendStringInfo(prepareCommand, "PREPARE %s(%s) AS %s", statementName,
+					 paramTypeNames->data, templateString->data);
+
+	StringInfo executeCommand = makeStringInfo();
+	appendStringInfo(executeCommand, "EXECUTE %s(%s)", statementName,
+					 paramValues->data);
+
+	task->preparedStatementName = statementName;
+	task->prepareCommand = prepareCommand->data;
+	task->executeCommand = executeCommand->data;
+}
+
+
+/*
+ * ContainsParamWalker returns true if the expression contains a Param.
+ */
+static bool
+ContainsParamWalker(Node *node, void *context)
+{
+	if (node == NULL)
+	{
+		return false;
+	}
+
+	if (IsA(node, Param))
+	{
+		return true;
+	}
+
+	if (IsA(node, Query))
+	{
+		return query_tree_walker((Query *) node, ContainsParamWalker, context, 0);
+	}
+
+	return expression_tree_walker(node, ContainsParamWalker, context);
+}
+
+
+/*
+ * ReplaceConstsWithParamsMutator replaces the constants in the expression by
+ * parameters that are numbered in the order of context->constList, to which
+ * the constants are added. Constants of pseudo types and of unknown type
+ * cannot be parameters and are kept.
+ */
+static Node *
+ReplaceConstsWithParamsMutator(Node *node, QueryTemplateContext *context)
+{
+	if (node == NULL)
+	{
+		return NULL;
+	}
+
+	if (IsA(node, Const))
+	{
+		Const *constNode = (Const *) node;
+
+		if (constNode->consttype == UNKNOWNOID ||
+			get_typtype(constNode->consttype) == TYPTYPE_PSEUDO)
+		{
+			return node;
+		}
+
+		context->constList = lappend(context->constList, constNode);
+
+		Param *param = makeNode(Param);
+		param->paramkind = PARAM_EXTERN;
+		param->paramid = list_length(context->constList);
+		param->paramtype = constNode->consttype;
+		param->paramtypmod = constNode->consttypmod;
+		param->paramcollid = constNode->constcollid;
+		param->location = -1;
+
+		return (Node *) param;
+	}
+
+	return expression_tree_mutator(node, ReplaceConstsWithParamsMutator,
+								   (void *) context);
+}
+
+
+/*
+ * HashResultTypes adds the types of the columns in the target list to the
+ * hash and returns the result.
+ */
+static uint64
+HashResultTypes(List *targetList, uint64 hash)
+{
+	TargetEntry *targetEntry = NULL;
+	foreach_ptr(targetEntry, targetList)
+	{
+		if (targetEntry->resjunk)
+		{
+			continue;
+		}
+
+		Oid resultType = exprType((Node *) targetEntry->expr);
+
+		hash = DatumGetUInt64(hash_any_extended((unsigned char *) &resultType,
+												sizeof(Oid), hash));
+	}
+
+	return hash;
 }
 
 
@@ -505,3 +779,256 @@ TaskQueryString(Task *task)
 	MemoryContextSwitchTo(previousContext);
 	return task->queryStringLazy;
 }
+
+
+/*
+ * DeparseShardQueryTemplate deparses the given query once into a template in
+ * which the name of every relation is replaced by a placeholder, such that
+ * the query string of a task can be generated by InstantiateShardQueryTemplate
+ * without deparsing the query for every shard. Relations that do not have a
+ * shard in the given relation shard list are replaced by an empty result, as
+ * UpdateRelationToShardNames does. The range table entries of the query are
+ * changed in place, so callers should pass a copy.
+ *
+ * The template string is NULL when the placeholders in the deparsed query do
+ * not match the relations in the query, for instance because a string
+ * constant looks like a placeholder. Callers then deparse every task.
+ */
+ShardQueryTemplate *
+DeparseShardQueryTemplate(Query *query, List *relationShardList)
+{
+	ShardQueryTemplate *queryTemplate = palloc0(sizeof(ShardQueryTemplate));
+	StringInfo templateString = makeStringInfo();
+	PlaceholderContext context;
+
+	context.queryTemplate = queryTemplate;
+	context.relationShardList = relationShardList;
+	context.placeholderRteCount = 0;
+
+	ReplaceRelationsWithPlaceholders((Node *) query, &context);
+
+	pg_get_query_def(query, templateString);
+
+	if (CountPlaceholders(templateString->data) == context.placeholderRteCount)
+	{
+		queryTemplate->templateString = templateString->data;
+	}
+
+	return queryTemplate;
+}
+
+
+/*
+ * ReplaceRelationsWithPlaceholders walks over the query tree and replaces
+ * every relation by a shard whose name is the placeholder of the relation,
+ * similar to UpdateRelationToShardNames. All range table entries of the same
+ * relation share a placeholder.
+ */
+static bool
+ReplaceRelationsWithPlaceholders(Node *node, PlaceholderContext *context)
+{
+	if (node == NULL)
+	{
+		return false;
+	}
+
+	/* want to look at all RTEs, even in subqueries, CTEs and such */
+	if (IsA(node, Query))
+	{
+		return query_tree_walker((Query *) node, ReplaceRelationsWithPlaceholders,
+								 context, QTW_EXAMINE_RTES_BEFORE);
+	}
+
+	if (!IsA(node, RangeTblEntry))
+	{
+		return expression_tree_walker(node, ReplaceRelationsWithPlaceholders,
+									  context);
+	}
+
+	RangeTblEntry *rangeTableEntry = (RangeTblEntry *) node;
+	if (rangeTableEntry->rtekind != RTE_RELATION)
+	{
+		return false;
+	}
+
+	ShardQueryTemplate *queryTemplate = context->queryTemplate;
+	Oid relationId = rangeTableEntry->relid;
+
+	RelationShard *relationShard = FindRelationShard(context->relationShardList,
+													 relationId);
+	if (relationShard == NULL || relationShard->shardId == INVALID_SHARD_ID)
+	{
+		queryTemplate->emptyRelationIdList =
+			list_append_unique_oid(queryTemplate->emptyRelationIdList, relationId);
+
+		ConvertRteToSubqueryWithEmptyResult(rangeTableEntry);
+		return false;
+	}
+
+	int placeholderId = 0;
+	ListCell *relationIdCell = NULL;
+
+	foreach(relationIdCell, queryTemplate->relationIdList)
+	{
+		if (lfirst_oid(relationIdCell) == relationId)
+		{
+			break;
+		}
+
+		placeholderId++;
+	}
+
+	if (relationIdCell == NULL)
+	{
+		char *schemaName = get_namespace_name(get_rel_namespace(relationId));
+
+		queryTemplate->relationIdList = lappend_oid(queryTemplate->relationIdList,
+													relationId);
+		queryTemplate->schemaNameList = lappend(queryTemplate->schemaNameList,
+												schemaName);
+		queryTemplate->relationNameList = lappend(queryTemplate->relationNameList,
+												  get_rel_name(relationId));
+	}
+
+	char *placeholderName = psprintf("$citus_shard_%d$", placeholderId);
+
+	SetRangeTblExtraData(rangeTableEntry, CITUS_RTE_SHARD, NULL, placeholderName,
+						 NIL, NIL, NIL, NIL, NIL);
+
+	context->placeholderRteCount++;
+
+	return false;
+}
+
+
+/*
+ * CountPlaceholders returns the number of shard name placeholders in the
+ * given template string.
+ */
+static int
+CountPlaceholders(char *templateString)
+{
+	int placeholderCount = 0;
+	char *placeholder = strstr(templateString, SHARD_NAME_PLACEHOLDER_PREFIX);
+
+	while (placeholder != NULL)
+	{
+		placeholderCount++;
+
+		placeholder = strstr(placeholder + strlen(SHARD_NAME_PLACEHOLDER_PREFIX),
+							 SHARD_NAME_PLACEHOLDER_PREFIX);
+	}
+
+	return placeholderCount;
+}
+
+
+/*
+ * InstantiateShardQueryTemplate generates the query string of a task from the
+ * template by replacing every placeholder with the qualified name of the shard
+ * of its relation in the given relation shard list.
+ *
+ * The function returns NULL if the template string is NULL, or if the task
+ * does not access shards of the same relations as the relation shard list
+ * the template was created with, since UpdateRelationToShardNames would then
+ * replace other relations by an empty result. The caller then deparses the
+ * query of the task.
+ */
+char *
+InstantiateShardQueryTemplate(ShardQueryTemplate *queryTemplate,
+							  List *relationShardList)
+{
+	if (queryTemplate->templateString == NULL)
+	{
+		return NULL;
+	}
+
+	RelationShard *relationShard = NULL;
+	Oid emptyRelationId = InvalidOid;
+
+	foreach_oid(emptyRelationId, queryTemplate->emptyRelationIdList)
+	{
+		relationShard = FindRelationShard(relationShardList, emptyRelationId);
+		if (relationShard != NULL && relationShard->shardId != INVALID_SHARD_ID)
+		{
+			return NULL;
+		}
+	}
+
+	int placeholderCount = list_length(queryTemplate->relationIdList);
+	char **shardNameArray = palloc0(placeholderCount * sizeof(char *));
+	int placeholderId = 0;
+
+	for (placeholderId = 0; placeholderId < placeholderCount; placeholderId++)
+	{
+		Oid relationId = list_nth_oid(queryTemplate->relationIdList, placeholderId);
+		char *schemaName = list_nth(queryTemplate->schemaNameList, placeholderId);
+		char *shardName = pstrdup(list_nth(queryTemplate->relationNameList,
+										   placeholderId));
+
+		relationShard = FindRelationShard(relationShardList, relationId);
+		if (relationShard == NULL || relationShard->shardId == INVALID_SHARD_ID)
+		{
+			return NULL;
+		}
+
+		AppendShardIdToName(&shardName, relationShard->shardId);
+
+		shardNameArray[placeholderId] = quote_qualified_identifier(schemaName,
+																   shardName);
+	}
+
+	StringInfo queryString = makeStringInfo();
+	char *templateCursor = queryTemplate->templateString;
+	char *placeholder = strstr(templateCursor, SHARD_NAME_PLACEHOLDER_PREFIX);
+
+	while (placeholder != NULL)
+	{
+		char *placeholderIdString = placeholder +
+									strlen(SHARD_NAME_PLACEHOLDER_PREFIX);
+		char *placeholderEnd = NULL;
+
+		placeholderId = (int) strtol(placeholderIdString, &placeholderEnd, 10);
+		if (placeholderEnd == placeholderIdString || placeholderId < 0 ||
+			placeholderId >= placeholderCount ||
+			strncmp(placeholderEnd, SHARD_NAME_PLACEHOLDER_SUFFIX,
+					strlen(SHARD_NAME_PLACEHOLDER_SUFFIX)) != 0)
+		{
+			/* a constant that looks like a placeholder, deparse the task instead */
+			return NULL;
+		}
+
+		appendBinaryStringInfo(queryString, templateCursor,
+							   placeholder - templateCursor);
+		appendStringInfoString(queryString, shardNameArray[placeholderId]);
+
+		templateCursor = placeholderEnd + strlen(SHARD_NAME_PLACEHOLDER_SUFFIX);
+		placeholder = strstr(templateCursor, SHARD_NAME_PLACEHOLDER_PREFIX);
+	}
+
+	appendStringInfoString(queryString, templateCursor);
+
+	return queryString->data;
+}
+
+
+/*
+ * FindRelationShard returns the first relation shard of the given relation in
+ * the list, which is the one UpdateRelationToShardNames uses, or NULL if the
+ * list does not contain the relation.
+ */
+static RelationShard *
+FindRelationShard(List *relationShardList, Oid relationId)
+{
+	RelationShard *relationShard = NULL;
+
+	foreach_ptr(relationShard, relationShardList)
+	{
+		if (relationShard->relationId == relationId)
+		{
+			return relationShard;
+		}
+	}
+
+	return NULL;
+}
@@ -17,12 +17,14 @@
 #include "catalog/pg_class.h"
 #include "catalog/pg_proc.h"
 #include "catalog/pg_type.h"
+#include "distributed/adaptive_executor.h"
 #include "distributed/citus_nodefuncs.h"
 #include "distributed/citus_nodes.h"
 #include "distributed/cte_inline.h"
 #include "distributed/function_call_delegation.h"
 #include "distributed/insert_select_planner.h"
 #include "distributed/intermediate_result_pruning.h"
+#include "distributed/intermediate_result_scan.h"
 #include "distributed/intermediate_results.h"
 #include "distributed/listutils.h"
 #include "distributed/master_protocol.h"
@@ -39,6 +41,7 @@
 #include "distributed/query_utils.h"
 #include "distributed/recursive_planning.h"
 #include "distributed/shardinterval_utils.h"
+#include "distributed/stat_counters.h"
 #include "distributed/version_compat.h"
 #include "distributed/worker_shard_visibility.h"
 #include "executor/executor.h"
@@ -46,15 +49,19 @@
 #include "nodes/nodeFuncs.h"
 #include "parser/parsetree.h"
 #include "parser/parse_type.h"
+#include "portability/instr_time.h"
 #if PG_VERSION_NUM >= 120000
 #include "optimizer/optimizer.h"
 #include "optimizer/plancat.h"
 #else
+#include "optimizer/clauses.h"
 #include "optimizer/cost.h"
+#include "optimizer/var.h"
 #endif
 #include "optimizer/pathnode.h"
 #include "optimizer/planner.h"
 #include "optimizer/planmain.h"
+#include "rewrite/rewriteManip.h"
 #include "utils/builtins.h"
 #include "utils/datum.h"
 #include "utils/lsyscache.h"
@@ -69,6 +76,28 @@ static uint64 NextPlanId = 1;
 /* keep track of planner call stack levels */
 int PlannerLevel = 0;
 
+/* GUC, determining whether multi-shard SELECTs can have generic plans */
+bool EnableGenericMultiShardPlans = false;
+
+/* GUC, determining whether the time spent in each planning phase is logged */
+bool LogPlanningTime = false;
+
+
+/*
+ * PlanningPhaseTimes keeps the time spent in the phases of distributed planning
+ * of the top-level statement. Planner calls for subplans are counted as part
+ * of the phase that triggers them.
+ */
+typedef struct PlanningPhaseTimes
+{
+	instr_time standardPlanner;
+	instr_time routerPlanner;
+	instr_time recursivePlanning;
+	instr_time logicalPlanner;
+} PlanningPhaseTimes;
+
+static PlanningPhaseTimes planningPhaseTimes;
+
 static bool ListContainsDistributedTableRTE(List *rangeTableList);
 static bool IsUpdateOrDelete(Query *query);
 static PlannedStmt * CreateDistributedPlannedStmt(
@@ -109,7 +138,8 @@ static void AdjustReadIntermediateResultCost(RangeTblEntry *rangeTableEntry,
 											 RelOptInfo *relOptInfo);
 static void AdjustReadIntermediateResultArrayCost(RangeTblEntry *rangeTableEntry,
 												  RelOptInfo *relOptInfo);
-static void AdjustReadIntermediateResultsCostInternal(RelOptInfo *relOptInfo,
+static void AdjustReadIntermediateResultsCostInternal(RangeTblEntry *rangeTableEntry,
+													  RelOptInfo *relOptInfo,
 													  List *columnTypes,
 													  int resultIdCount,
 													  Datum *resultIds,
@@ -122,11 +152,22 @@ static void PopPlannerRestrictionContext(void);
 static void ResetPlannerRestrictionContext(
 	PlannerRestrictionContext *plannerRestrictionContext);
 static bool HasUnresolvedExternParamsWalker(Node *expression, ParamListInfo boundParams);
+static bool CanPlanMultiShardQueryWithParams(Query *query);
+static bool IsSingleDistributedTableQuery(Query *query);
+static bool ExternParamsAffectShardPruningWalker(Node *node, Query *query);
+static bool StableExpressionsAffectShardPruningWalker(Node *node, Query *query);
+static bool IsStableExpression(Node *expression);
+static List * TaskPruningQualList(Query *query);
 static bool IsLocalReferenceTableJoin(Query *parse, List *rangeTableList);
 static bool QueryIsNotSimpleSelect(Node *node);
 static bool UpdateReferenceTablesWithShard(Node *node, void *context);
 static PlannedStmt * PlanFastPathDistributedStmt(DistributedPlanningContext *planContext,
 												 Node *distributionKeyValue);
+static bool TrackPlanningPhaseTimes(void);
+static void StartPlanningPhase(instr_time *phaseStart);
+static void EndPlanningPhase(instr_time *phaseStart, instr_time *phaseTime);
+static void LogPlanningPhaseTimes(instr_time *planningStart);
+static void CountDistributedPlan(DistributedPlan *distributedPlan);
 static PlannedStmt * PlanDistributedStmt(DistributedPlanningContext *planContext,
 										 List *rangeTableList, int rteIdCounter);
 
@@ -142,6 +183,8 @@ distributed_planner(Query *parse, int cursorOptions, ParamListInfo boundParams)
 	int rteIdCounter = 1;
 	bool fastPathRouterQuery = false;
 	Node *distributionKeyValue = NULL;
+	Query *fastPathCacheQuery = NULL;
+	instr_time planningStart;
 	DistributedPlanningContext planContext = {
 		.query = parse,
 		.cursorOptions = cursorOptions,
@@ -178,6 +221,18 @@ distributed_planner(Query *parse, int cursorOptions, ParamListInfo boundParams)
 		}
 	}
 
+	if (fastPathRouterQuery && MaxCachedFastPathPlans > 0)
+	{
+		result = GetCachedFastPathPlan(parse, cursorOptions, distributionKeyValue);
+		if (result != NULL)
+		{
+			return result;
+		}
+
+		/* the planner scribbles on the parse tree, keep a copy for the cache */
+		fastPathCacheQuery = copyObject(parse);
+	}
+
 	if (fastPathRouterQuery)
 	{
 		/*
@@ -236,6 +291,12 @@ distributed_planner(Query *parse, int cursorOptions, ParamListInfo boundParams)
 	 */
 	PlannerLevel++;
 
+	INSTR_TIME_SET_ZERO(planningStart);
+	if (TrackPlanningPhaseTimes())
+	{
+		memset(&planningPhaseTimes, 0, sizeof(PlanningPhaseTimes));
+		INSTR_TIME_SET_CURRENT(planningStart);
+	}
 
 	PG_TRY();
 	{
@@ -245,14 +306,19 @@ distributed_planner(Query *parse, int cursorOptions, ParamListInfo boundParams)
 		}
 		else
 		{
+			instr_time phaseStart;
+
 			/*
 			 * Call into standard_planner because the Citus planner relies on both the
 			 * restriction information per table and parse tree transformations made by
 			 * postgres' planner.
 			 */
+			StartPlanningPhase(&phaseStart);
 			planContext.plan = standard_planner(planContext.query,
 												planContext.cursorOptions,
 												planContext.boundParams);
+			EndPlanningPhase(&phaseStart, &planningPhaseTimes.standardPlanner);
+
 			if (needsDistributedPlanning)
 			{
 				result = PlanDistributedStmt(&planContext, rangeTableList, rteIdCounter);
@@ -273,11 +339,29 @@ distributed_planner(Query *parse, int cursorOptions, ParamListInfo boundParams)
 	}
 	PG_END_TRY();
 
+	/* make the plan cache replan when the query is run by a different user */
+	if (planContext.plannerRestrictionContext->fastPathRestrictionContext->
+		prunedToPartition)
+	{
+		result->dependsOnRole = true;
+	}
+
+	if (needsDistributedPlanning && TrackPlanningPhaseTimes())
+	{
+		LogPlanningPhaseTimes(&planningStart);
+	}
+
 	PlannerLevel--;
 
 	/* remove the context from the context list */
 	PopPlannerRestrictionContext();
 
+	if (fastPathCacheQuery != NULL)
+	{
+		CacheFastPathPlan(fastPathCacheQuery, cursorOptions, distributionKeyValue,
+						  result);
+	}
+
 	/*
 	 * In some cases, for example; parameterized SQL functions, we may miss that
 	 * there is a need for distributed planning. Such cases only become clear after
@@ -578,13 +662,88 @@ PlanFastPathDistributedStmt(DistributedPlanningContext *planContext,
 		fastPathContext->distributionKeyHasParam = true;
 	}
 
+	instr_time phaseStart;
+
+	StartPlanningPhase(&phaseStart);
 	planContext->plan = FastPathPlanner(planContext->originalQuery, planContext->query,
 										planContext->boundParams);
+	EndPlanningPhase(&phaseStart, &planningPhaseTimes.standardPlanner);
 
 	return CreateDistributedPlannedStmt(planContext);
 }
 
 
+/*
+ * TrackPlanningPhaseTimes returns whether the time spent in the planning phases
+ * should be measured, which we only do for the top-level planner call when
+ * citus.log_planning_time is enabled.
+ */
+static bool
+TrackPlanningPhaseTimes(void)
+{
+	return LogPlanningTime && PlannerLevel == 1;
+}
+
+
+/*
+ * StartPlanningPhase records the start time of a planning phase.
+ */
+static void
+StartPlanningPhase(instr_time *phaseStart)
+{
+	if (TrackPlanningPhaseTimes())
+	{
+		INSTR_TIME_SET_CURRENT(*phaseStart);
+	}
+	else
+	{
+		INSTR_TIME_SET_ZERO(*phaseStart);
+	}
+}
+
+
+/*
+ * EndPlanningPhase adds the time passed since the given start of a planning
+ * phase to the total time of that phase.
+ */
+static void
+EndPlanningPhase(instr_time *phaseStart, instr_time *phaseTime)
+{
+	if (!TrackPlanningPhaseTimes() || INSTR_TIME_IS_ZERO(*phaseStart))
+	{
+		return;
+	}
+
+	instr_time phaseEnd;
+	INSTR_TIME_SET_CURRENT(phaseEnd);
+	INSTR_TIME_ACCUM_DIFF(*phaseTime, phaseEnd, *phaseStart);
+}
+
+
+/*
+ * LogPlanningPhaseTimes logs the total time spent in planning the current
+ * statement since planningStart, and the time spent in each of its phases.
+ */
+static void
+LogPlanningPhaseTimes(instr_time *planningStart)
+{
+	instr_time planningTime;
+	INSTR_TIME_SET_CURRENT(planningTime);
+	INSTR_TIME_SUBTRACT(planningTime, *planningStart);
+
+	ereport(LOG, (errmsg("distributed planning took %.3f ms",
+						 INSTR_TIME_GET_MILLISEC(planningTime)),
+				  errdetail("standard planner: %.3f ms, router planner: %.3f ms, "
+							"recursive planning: %.3f ms, logical planner: %.3f ms",
+							INSTR_TIME_GET_MILLISEC(planningPhaseTimes.standardPlanner),
+							INSTR_TIME_GET_MILLISEC(planningPhaseTimes.routerPlanner),
+							INSTR_TIME_GET_MILLISEC(
+								planningPhaseTimes.recursivePlanning),
+							INSTR_TIME_GET_MILLISEC(planningPhaseTimes.logicalPlanner)),
+				  errhidestmt(true)));
+}
+
+
 /*
  * PlanDistributedStmt creates a distributed planned statement using the PG
  * planner.
@@ -716,7 +875,8 @@ CreateDistributedPlannedStmt(DistributedPlanningContext *planContext)
 	distributedPlan->planId = planId;
 
 	/* create final plan by combining local plan with distributed plan */
-	resultPlan = FinalizePlan(planContext->plan, distributedPlan);
+	resultPlan = FinalizePlan(planContext->plan, distributedPlan,
+							  planContext->cursorOptions);
 
 	/*
 	 * As explained above, force planning costs to be unrealistically high if
@@ -885,6 +1045,9 @@ CreateDistributedPlan(uint64 planId, Query *originalQuery, Query *query, ParamLi
 {
 	DistributedPlan *distributedPlan = NULL;
 	bool hasCtes = originalQuery->cteList != NIL;
+	instr_time phaseStart;
+
+	StartPlanningPhase(&phaseStart);
 
 	if (IsModifyCommand(originalQuery))
 	{
@@ -908,6 +1071,11 @@ CreateDistributedPlan(uint64 planId, Query *originalQuery, Query *query, ParamLi
 			distributedPlan =
 				CreateInsertSelectPlan(planId, originalQuery, plannerRestrictionContext);
 		}
+		else if (!hasUnresolvedParams && MultiRowInsertCanUseCopy(originalQuery))
+		{
+			/* large multi-row INSERTs copy their rows into the shards */
+			distributedPlan = CreateMultiRowInsertCopyPlan(planId, originalQuery);
+		}
 		else
 		{
 			/* modifications are always routed through the same planner/executor */
@@ -918,6 +1086,8 @@ CreateDistributedPlan(uint64 planId, Query *originalQuery, Query *query, ParamLi
 		/* the functions above always return a plan, possibly with an error */
 		Assert(distributedPlan);
 
+		EndPlanningPhase(&phaseStart, &planningPhaseTimes.routerPlanner);
+
 		if (distributedPlan->planningError == NULL)
 		{
 			FinalizeDistributedPlan(distributedPlan, originalQuery);
@@ -940,6 +1110,9 @@ CreateDistributedPlan(uint64 planId, Query *originalQuery, Query *query, ParamLi
 
 		distributedPlan = CreateRouterPlan(originalQuery, query,
 										   plannerRestrictionContext);
+
+		EndPlanningPhase(&phaseStart, &planningPhaseTimes.routerPlanner);
+
 		if (distributedPlan->planningError == NULL)
 		{
 			FinalizeDistributedPlan(distributedPlan, originalQuery);
@@ -956,13 +1129,13 @@ CreateDistributedPlan(uint64 planId, Query *originalQuery, Query *query, ParamLi
 		}
 	}
 
-	if (hasUnresolvedParams)
+	if (hasUnresolvedParams && !CanPlanMultiShardQueryWithParams(originalQuery))
 	{
 		/*
 		 * There are parameters that don't have a value in boundParams.
 		 *
 		 * The remainder of the planning logic cannot handle unbound
-		 * parameters. We return a NULL plan, which will have an
+		 * parameters in general. We return a NULL plan, which will have an
 		 * extremely high cost, such that postgres will replan with
 		 * bound parameters.
 		 */
@@ -986,8 +1159,16 @@ CreateDistributedPlan(uint64 planId, Query *originalQuery, Query *query, ParamLi
 	 * Plan subqueries and CTEs that cannot be pushed down by recursively
 	 * calling the planner and return the resulting plans to subPlanList.
 	 */
+	StartPlanningPhase(&phaseStart);
 	List *subPlanList = GenerateSubplansForSubqueriesAndCTEs(planId, originalQuery,
 															 plannerRestrictionContext);
+	EndPlanningPhase(&phaseStart, &planningPhaseTimes.recursivePlanning);
+
+	if (hasUnresolvedParams && subPlanList != NIL)
+	{
+		/* the replanned query would no longer be checked for parameters */
+		return NULL;
+	}
 
 	/*
 	 * If subqueries were recursively planned then we need to replan the query
@@ -1027,7 +1208,9 @@ CreateDistributedPlan(uint64 planId, Query *originalQuery, Query *query, ParamLi
 		 * being contiguous.
 		 */
 
+		StartPlanningPhase(&phaseStart);
 		standard_planner(newQuery, 0, boundParams);
+		EndPlanningPhase(&phaseStart, &planningPhaseTimes.standardPlanner);
 
 		/* overwrite the old transformed query with the new transformed query */
 		*query = *newQuery;
@@ -1065,6 +1248,7 @@ CreateDistributedPlan(uint64 planId, Query *originalQuery, Query *query, ParamLi
 	query->cteList = NIL;
 	Assert(originalQuery->cteList == NIL);
 
+	StartPlanningPhase(&phaseStart);
 	MultiTreeRoot *logicalPlan = MultiLogicalPlanCreate(originalQuery, query,
 														plannerRestrictionContext);
 	MultiLogicalPlanOptimize(logicalPlan);
@@ -1082,9 +1266,35 @@ CreateDistributedPlan(uint64 planId, Query *originalQuery, Query *query, ParamLi
 	distributedPlan = CreatePhysicalDistributedPlan(logicalPlan,
 													plannerRestrictionContext);
 
+	EndPlanningPhase(&phaseStart, &planningPhaseTimes.logicalPlanner);
+
 	/* distributed plan currently should always succeed or error out */
 	Assert(distributedPlan && distributedPlan->planningError == NULL);
 
+	if (hasUnresolvedParams && distributedPlan->workerJob->dependentJobList != NIL)
+	{
+		/* tasks of repartition jobs are not sent with the parameters */
+		return NULL;
+	}
+
+	if ((hasUnresolvedParams &&
+		 ExternParamsAffectShardPruningWalker((Node *) originalQuery->jointree,
+											  originalQuery)) ||
+		(distributedPlan->workerJob->dependentJobList == NIL &&
+		 IsSingleDistributedTableQuery(originalQuery) &&
+		 StableExpressionsAffectShardPruningWalker((Node *) originalQuery->jointree,
+												   originalQuery)))
+	{
+		/*
+		 * The plan has a task for every shard, since the values that the
+		 * distribution column is compared with are not known yet. Keep the
+		 * filters, such that the executor can skip the shards that the
+		 * parameters and stable functions rule out.
+		 */
+		distributedPlan->workerJob->taskPruningQualList =
+			TaskPruningQualList(originalQuery);
+	}
+
 	FinalizeDistributedPlan(distributedPlan, originalQuery);
 
 	return distributedPlan;
@@ -1105,6 +1315,7 @@ FinalizeDistributedPlan(DistributedPlan *plan, Query *originalQuery)
 	if (!plan->fastPathRouterPlan)
 	{
 		RecordSubPlansUsedInPlan(plan, originalQuery);
+		RecordPartitionedSubPlanResults(plan, originalQuery);
 	}
 }
 
@@ -1307,6 +1518,9 @@ ResolveExternalParams(Node *inputNode, ParamListInfo boundParams)
 /*
  * GetDistributedPlan returns the associated DistributedPlan for a CustomScan.
  *
+ * The plan is kept in the CustomScan as a node tree, so cached plans are used
+ * as they are, without being serialized to and read back from a string.
+ *
  * Callers should only read from the returned data structure, since it may be
  * the plan of a prepared statement and may therefore be reused.
  */
@@ -1318,20 +1532,51 @@ GetDistributedPlan(CustomScan *customScan)
 	Node *node = (Node *) linitial(customScan->custom_private);
 	Assert(CitusIsA(node, DistributedPlan));
 
-	CheckNodeCopyAndSerialization(node);
-
 	DistributedPlan *distributedPlan = (DistributedPlan *) node;
 
 	return distributedPlan;
 }
 
 
+/*
+ * CountDistributedPlan increments the stat counter of the type of the given
+ * distributed plan.
+ */
+static void
+CountDistributedPlan(DistributedPlan *distributedPlan)
+{
+	Job *workerJob = distributedPlan->workerJob;
+
+	if (distributedPlan->insertSelectQuery != NULL)
+	{
+		IncrementStatCounter(STAT_INSERT_SELECT_VIA_COORDINATOR_PLANS);
+	}
+	else if (distributedPlan->fastPathRouterPlan)
+	{
+		IncrementStatCounter(STAT_FAST_PATH_PLANS);
+	}
+	else if (workerJob != NULL && workerJob->dependentJobList != NIL)
+	{
+		IncrementStatCounter(STAT_REPARTITION_PLANS);
+	}
+	else if (IsMultiTaskPlan(distributedPlan))
+	{
+		IncrementStatCounter(STAT_MULTI_SHARD_PLANS);
+	}
+	else
+	{
+		IncrementStatCounter(STAT_ROUTER_PLANS);
+	}
+}
+
+
 /*
  * FinalizePlan combines local plan with distributed plan and creates a plan
  * which can be run by the PostgreSQL executor.
  */
 PlannedStmt *
-FinalizePlan(PlannedStmt *localPlan, DistributedPlan *distributedPlan)
+FinalizePlan(PlannedStmt *localPlan, DistributedPlan *distributedPlan,
+			 int cursorOptions)
 {
 	PlannedStmt *finalPlan = NULL;
 	CustomScan *customScan = makeNode(CustomScan);
@@ -1340,6 +1585,8 @@ FinalizePlan(PlannedStmt *localPlan, DistributedPlan *distributedPlan)
 	if (!distributedPlan->planningError)
 	{
 		executorType = JobExecutorType(distributedPlan);
+
+		CountDistributedPlan(distributedPlan);
 	}
 
 	switch (executorType)
@@ -1388,9 +1635,25 @@ FinalizePlan(PlannedStmt *localPlan, DistributedPlan *distributedPlan)
 
 	Node *distributedPlanData = (Node *) distributedPlan;
 
+	/*
+	 * Check the copy and serialization functions once per plan rather than on
+	 * every execution of a cached plan, which matters for plans with many tasks.
+	 */
+	CheckNodeCopyAndSerialization(distributedPlanData);
+
 	customScan->custom_private = list_make1(distributedPlanData);
 	customScan->flags = CUSTOMPATH_SUPPORT_BACKWARD_SCAN;
 
+	/*
+	 * Cursors that do not ask for SCROLL become forward-only when the scan
+	 * cannot go backwards, which allows a streaming execution to fetch their
+	 * rows from the workers as they are fetched from the cursor.
+	 */
+	if (EnableStreamingExecution && !(cursorOptions & CURSOR_OPT_SCROLL))
+	{
+		customScan->flags &= ~CUSTOMPATH_SUPPORT_BACKWARD_SCAN;
+	}
+
 	if (distributedPlan->masterQuery)
 	{
 		finalPlan = FinalizeNonRouterPlan(localPlan, distributedPlan, customScan);
@@ -1910,6 +2173,40 @@ multi_relation_restriction_hook(PlannerInfo *root, RelOptInfo *relOptInfo,
 }
 
 
+/*
+ * CitusGetRelationInfo is the get_relation_info_hook, which sets the size of
+ * distributed tables to the size of all shards, as stored by ANALYZE when
+ * citus.analyze_sample_shard_count is set. Postgres otherwise estimates the
+ * size of the table from the empty table on the coordinator.
+ */
+void
+CitusGetRelationInfo(PlannerInfo *root, Oid relationId, bool inhparent,
+					 RelOptInfo *relOptInfo)
+{
+	if (inhparent || !CitusHasBeenLoaded() || !IsCitusTable(relationId))
+	{
+		return;
+	}
+
+	HeapTuple classTuple = SearchSysCache1(RELOID, ObjectIdGetDatum(relationId));
+	if (!HeapTupleIsValid(classTuple))
+	{
+		return;
+	}
+
+	Form_pg_class classForm = (Form_pg_class) GETSTRUCT(classTuple);
+
+	/* the table on the coordinator has no pages unless ANALYZE stored them */
+	if (classForm->relpages > 0 && classForm->reltuples > 0)
+	{
+		relOptInfo->pages = classForm->relpages;
+		relOptInfo->tuples = classForm->reltuples;
+	}
+
+	ReleaseSysCache(classTuple);
+}
+
+
 /*
  * AdjustReadIntermediateResultCost adjusts the row count and total cost
  * of a read_intermediate_result call based on the file size.
@@ -1954,7 +2251,7 @@ AdjustReadIntermediateResultCost(RangeTblEntry *rangeTableEntry, RelOptInfo *rel
 		return;
 	}
 
-	AdjustReadIntermediateResultsCostInternal(relOptInfo,
+	AdjustReadIntermediateResultsCostInternal(rangeTableEntry, relOptInfo,
 											  rangeTableFunction->funccoltypes,
 											  1, &resultIdDatum, resultFormatConst);
 }
@@ -2010,7 +2307,7 @@ AdjustReadIntermediateResultArrayCost(RangeTblEntry *rangeTableEntry,
 		return;
 	}
 
-	AdjustReadIntermediateResultsCostInternal(relOptInfo,
+	AdjustReadIntermediateResultsCostInternal(rangeTableEntry, relOptInfo,
 											  rangeTableFunction->funccoltypes,
 											  resultIdCount, resultIdArray,
 											  resultFormatConst);
@@ -2019,10 +2316,12 @@ AdjustReadIntermediateResultArrayCost(RangeTblEntry *rangeTableEntry,
 
 /*
  * AdjustReadIntermediateResultsCostInternal adjusts the row count and total cost
- * of reading intermediate results based on file sizes.
+ * of reading intermediate results based on file sizes. For binary results, it
+ * also adds a path that lets parallel workers divide the rows.
  */
 static void
-AdjustReadIntermediateResultsCostInternal(RelOptInfo *relOptInfo, List *columnTypes,
+AdjustReadIntermediateResultsCostInternal(RangeTblEntry *rangeTableEntry,
+										  RelOptInfo *relOptInfo, List *columnTypes,
 										  int resultIdCount, Datum *resultIds,
 										  Const *resultFormatConst)
 {
@@ -2124,6 +2423,13 @@ AdjustReadIntermediateResultsCostInternal(RelOptInfo *relOptInfo, List *columnTy
 #if PG_VERSION_NUM >= 120000
 	path->startup_cost = funcCost.startup + relOptInfo->baserestrictcost.startup;
 #endif
+
+	if (binaryFormat && !rangeTableEntry->funcordinality)
+	{
+		AddParallelIntermediateResultScanPath(relOptInfo, rowCountEstimate,
+											  totalResultSize, path->startup_cost,
+											  rowCost, ioCost);
+	}
 }
 
 
@@ -2340,6 +2646,208 @@ HasUnresolvedExternParamsWalker(Node *expression, ParamListInfo boundParams)
 }
 
 
+/*
+ * CanPlanMultiShardQueryWithParams returns whether a multi-shard SELECT with
+ * parameters that do not have a value yet can be planned as is, such that the
+ * plan can be cached as a generic plan and reused across executions of a
+ * prepared statement. The task queries then contain the parameters, and the
+ * executor sends the parameter values along with them.
+ *
+ * This is only possible when the parameters only appear in the filters of the
+ * top-level query, since other parts of the planner require the constant
+ * values. Parameters that are compared with a distribution column would
+ * allow pruning shards if they were known, so we prefer custom plans then.
+ */
+static bool
+CanPlanMultiShardQueryWithParams(Query *query)
+{
+	if (!EnableGenericMultiShardPlans)
+	{
+		return false;
+	}
+
+	if (TaskExecutorType != MULTI_EXECUTOR_ADAPTIVE)
+	{
+		return false;
+	}
+
+	if (query->commandType != CMD_SELECT || query->hasSubLinks ||
+		query->cteList != NIL || query->setOperations != NULL)
+	{
+		return false;
+	}
+
+	if (HasUnresolvedExternParamsWalker((Node *) query->targetList, NULL) ||
+		HasUnresolvedExternParamsWalker(query->havingQual, NULL) ||
+		HasUnresolvedExternParamsWalker(query->limitCount, NULL) ||
+		HasUnresolvedExternParamsWalker(query->limitOffset, NULL) ||
+		range_table_walker(query->rtable, HasUnresolvedExternParamsWalker, NULL, 0))
+	{
+		return false;
+	}
+
+	if (ExternParamsAffectShardPruningWalker((Node *) query->jointree, query))
+	{
+		/* the executor can only prune the tasks of a query on a single table */
+		return IsSingleDistributedTableQuery(query);
+	}
+
+	return true;
+}
+
+
+/*
+ * IsSingleDistributedTableQuery returns true if the query only reads from a
+ * single hash or range distributed table, such that the tasks of the query
+ * map to the shards of that table.
+ */
+static bool
+IsSingleDistributedTableQuery(Query *query)
+{
+	if (list_length(query->rtable) != 1)
+	{
+		return false;
+	}
+
+	RangeTblEntry *rangeTableEntry = (RangeTblEntry *) linitial(query->rtable);
+	if (rangeTableEntry->rtekind != RTE_RELATION ||
+		!IsCitusTable(rangeTableEntry->relid))
+	{
+		return false;
+	}
+
+	char partitionMethod = PartitionMethod(rangeTableEntry->relid);
+	return partitionMethod == DISTRIBUTE_BY_HASH || partitionMethod == DISTRIBUTE_BY_RANGE;
+}
+
+
+/*
+ * ExternParamsAffectShardPruningWalker returns true if the given expression
+ * contains an operator that compares a distribution column of the query with
+ * an expression that contains a parameter.
+ */
+static bool
+ExternParamsAffectShardPruningWalker(Node *node, Query *query)
+{
+	if (node == NULL)
+	{
+		return false;
+	}
+
+	List *argumentList = NIL;
+	if (IsA(node, OpExpr))
+	{
+		argumentList = ((OpExpr *) node)->args;
+	}
+	else if (IsA(node, ScalarArrayOpExpr))
+	{
+		argumentList = ((ScalarArrayOpExpr *) node)->args;
+	}
+
+	if (argumentList != NIL &&
+		HasUnresolvedExternParamsWalker((Node *) argumentList, NULL))
+	{
+		Expr *argument = NULL;
+		foreach_ptr(argument, argumentList)
+		{
+			if (IsPartitionColumn(argument, query))
+			{
+				return true;
+			}
+		}
+	}
+
+	return expression_tree_walker(node, ExternParamsAffectShardPruningWalker, query);
+}
+
+
+/*
+ * StableExpressionsAffectShardPruningWalker returns true if the given
+ * expression contains an operator that compares a distribution column of the
+ * query with an expression that calls stable functions, such as now(). The
+ * planner cannot fold such expressions into constants, but the executor can
+ * evaluate them when the execution starts.
+ */
+static bool
+StableExpressionsAffectShardPruningWalker(Node *node, Query *query)
+{
+	if (node == NULL)
+	{
+		return false;
+	}
+
+	List *argumentList = NIL;
+	if (IsA(node, OpExpr))
+	{
+		argumentList = ((OpExpr *) node)->args;
+	}
+	else if (IsA(node, ScalarArrayOpExpr))
+	{
+		argumentList = ((ScalarArrayOpExpr *) node)->args;
+	}
+
+	if (list_length(argumentList) == 2)
+	{
+		Node *leftArgument = linitial(argumentList);
+		Node *rightArgument = lsecond(argumentList);
+
+		if ((IsPartitionColumn((Expr *) leftArgument, query) &&
+			 IsStableExpression(rightArgument)) ||
+			(IsPartitionColumn((Expr *) rightArgument, query) &&
+			 IsStableExpression(leftArgument)))
+		{
+			return true;
+		}
+	}
+
+	return expression_tree_walker(node, StableExpressionsAffectShardPruningWalker,
+								  query);
+}
+
+
+/*
+ * IsStableExpression returns true if the given expression does not refer to
+ * columns and calls stable, but no volatile functions.
+ */
+static bool
+IsStableExpression(Node *expression)
+{
+	return contain_mutable_functions(expression) &&
+		   !contain_volatile_functions(expression) &&
+		   !contain_var_clause(expression) &&
+		   !checkExprHasSubLink(expression);
+}
+
+
+/*
+ * TaskPruningQualList returns the filters of the given query that the executor
+ * can prune the tasks with once the values of the parameters and the stable
+ * functions are known. Filters that have volatile functions or subqueries are
+ * left out, since their values on the coordinator could differ from those on
+ * the workers.
+ */
+static List *
+TaskPruningQualList(Query *query)
+{
+	Node *quals = copyObject(query->jointree->quals);
+	List *qualList = make_ands_implicit((Expr *) quals);
+	List *taskPruningQualList = NIL;
+
+	Node *qual = NULL;
+	foreach_ptr(qual, qualList)
+	{
+		if (contain_volatile_functions(qual) || checkExprHasSubLink(qual))
+		{
+			continue;
+		}
+
+		taskPruningQualList = lappend(taskPruningQualList, qual);
+	}
+
+	return taskPruningQualList;
+}
+
+
 /*
  * IsLocalReferenceTableJoin returns if the given query is a join between
  * reference tables and local tables.
@@ -2353,23 +2861,16 @@ IsLocalReferenceTableJoin(Query *parse, List *rangeTableList)
 
 	bool hasReferenceTableReplica = false;
 
-	/*
-	 * We only allow join between reference tables and local tables in the
-	 * coordinator.
-	 */
-	if (!IsCoordinator())
-	{
-		return false;
-	}
-
 	/*
 	 * All groups that have pg_dist_node entries, also have reference
-	 * table replicas.
+	 * table replicas. This holds for the coordinator as well as for the
+	 * workers with metadata, so both can join their local tables with
+	 * the local replicas.
 	 */
-	PrimaryNodeForGroup(COORDINATOR_GROUP_ID, &hasReferenceTableReplica);
+	PrimaryNodeForGroup(GetLocalGroupId(), &hasReferenceTableReplica);
 
 	/*
-	 * If reference table doesn't have replicas on the coordinator, we don't
+	 * If reference table doesn't have replicas on this node, we don't
 	 * allow joins with local tables.
 	 */
 	if (!hasReferenceTableReplica)
@@ -34,14 +34,20 @@
  */
 #include "postgres.h"
 
+#include "distributed/citus_custom_scan.h"
 #include "distributed/distributed_planner.h"
+#include "distributed/hash_helpers.h"
 #include "distributed/insert_select_planner.h"
 #include "distributed/multi_physical_planner.h" /* only to use some utility functions */
 #include "distributed/metadata_cache.h"
 #include "distributed/multi_router_planner.h"
 #include "distributed/pg_dist_partition.h"
+#include "distributed/query_utils.h"
+#include "distributed/relay_utility.h"
 #include "distributed/shardinterval_utils.h"
 #include "distributed/shard_pruning.h"
+#include "distributed/version_compat.h"
+#include "lib/ilist.h"
 #if PG_VERSION_NUM >= 120000
 #include "nodes/makefuncs.h"
 #endif
@@ -54,14 +60,88 @@
 #include "optimizer/clauses.h"
 #endif
 #include "tcop/pquery.h"
+#include "utils/memutils.h"
 
 bool EnableFastPathRouterPlanner = true;
 
+/* GUC, maximum number of fast path router plans cached per backend, 0 disables */
+int MaxCachedFastPathPlans = 0;
+
+
+/*
+ * FastPathPlanCacheKey identifies the cached plans that may belong to a query.
+ * Different queries can have the same hash, so the queries of the plans with
+ * the same key are still compared.
+ */
+typedef struct FastPathPlanCacheKey
+{
+	/* the table that the query accesses */
+	Oid relationId;
+
+	/* cursor options that the query was planned with */
+	int cursorOptions;
+
+	/* hash of the query tree, see HashQueryTreeWalker */
+	uint32 queryHash;
+} FastPathPlanCacheKey;
+
+
+/*
+ * FastPathPlanCacheBucket holds the cached plans with the same key.
+ */
+typedef struct FastPathPlanCacheBucket
+{
+	FastPathPlanCacheKey key;
+	dlist_head entryList;
+} FastPathPlanCacheBucket;
+
+
+/*
+ * FastPathPlanCacheEntry is a fast path router plan that this backend created
+ * earlier. The plan is reused when the same query (as it is after parse
+ * analysis) is planned again, until the metadata of the table changes.
+ */
+typedef struct FastPathPlanCacheEntry
+{
+	FastPathPlanCacheKey key;
+
+	/* Const or Param that the distribution column is compared with */
+	Node *distributionKeyValue;
+
+	/* the query as it was passed to the planner */
+	Query *query;
+
+	/* the distributed planned statement */
+	PlannedStmt *plan;
+
+	/* memory context that holds the entry */
+	MemoryContext memoryContext;
+
+	/* node in the entry list of the bucket */
+	dlist_node bucketNode;
+
+	/* node in FastPathPlanCacheList */
+	dlist_node cacheListNode;
+} FastPathPlanCacheEntry;
+
+/* buckets of cached plans, by FastPathPlanCacheKey */
+static HTAB *FastPathPlanCacheHash = NULL;
+
+/* cached plans, least recently used first */
+static dlist_head FastPathPlanCacheList = DLIST_STATIC_INIT(FastPathPlanCacheList);
+static int FastPathPlanCacheCount = 0;
+static MemoryContext FastPathPlanCacheContext = NULL;
+
 static bool ColumnAppearsMultipleTimes(Node *quals, Var *distributionKey);
 static bool ConjunctionContainsColumnFilter(Node *node, Var *column,
 											Node **distributionKeyValue);
 static bool DistKeyInSimpleOpExpression(Expr *clause, Var *distColumn,
 										Node **distributionKeyValue);
+static bool FastPathPlanIsCacheable(Query *query, Node *distributionKeyValue,
+									PlannedStmt *plan);
+static void InitializeFastPathPlanCache(void);
+static FastPathPlanCacheKey FastPathPlanKey(Query *query, int cursorOptions);
+static void RemoveFastPathPlanCacheEntry(FastPathPlanCacheEntry *cacheEntry);
 
 
 /*
@@ -421,3 +501,277 @@ DistKeyInSimpleOpExpression(Expr *clause, Var *distColumn, Node **distributionKe
 
 	return distColumnExists;
 }
+
+
+/*
+ * GetCachedFastPathPlan returns a copy of the plan that this backend created
+ * earlier for the given fast path router query, or NULL if there is none.
+ *
+ * Clients that do not prepare their statements, for instance ORMs behind a
+ * connection pooler, send the same simple lookups over and over again. For
+ * those we skip the router planner and deparsing the shard query. Queries
+ * with a parameter on the distribution column are cached with deferred
+ * pruning, such that only the shard and the parameters are bound on
+ * execution.
+ */
+PlannedStmt *
+GetCachedFastPathPlan(Query *query, int cursorOptions, Node *distributionKeyValue)
+{
+	if (MaxCachedFastPathPlans <= 0 || distributionKeyValue == NULL ||
+		FastPathPlanCacheCount == 0)
+	{
+		return NULL;
+	}
+
+	FastPathPlanCacheKey cacheKey = FastPathPlanKey(query, cursorOptions);
+	bool found = false;
+
+	FastPathPlanCacheBucket *cacheBucket = hash_search(FastPathPlanCacheHash, &cacheKey,
+													   HASH_FIND, &found);
+	if (!found)
+	{
+		return NULL;
+	}
+
+	dlist_iter iter;
+	dlist_foreach(iter, &cacheBucket->entryList)
+	{
+		FastPathPlanCacheEntry *cacheEntry =
+			dlist_container(FastPathPlanCacheEntry, bucketNode, iter.cur);
+
+		if (!equal(cacheEntry->distributionKeyValue, distributionKeyValue) ||
+			!equal(cacheEntry->query, query))
+		{
+			continue;
+		}
+
+		/* move the entry to the end of the list, it was used most recently */
+		dlist_move_tail(&FastPathPlanCacheList, &cacheEntry->cacheListNode);
+
+		ereport(DEBUG2, (errmsg("using cached fast-path router plan")));
+
+		PlannedStmt *plan = copyObject(cacheEntry->plan);
+
+		/* these fields are ignored when comparing the queries */
+		plan->queryId = query->queryId;
+		plan->stmt_location = query->stmt_location;
+		plan->stmt_len = query->stmt_len;
+
+		return plan;
+	}
+
+	return NULL;
+}
+
+
+/*
+ * CacheFastPathPlan remembers the plan of a fast path router query, such that
+ * GetCachedFastPathPlan can return it when the same query is planned again.
+ * The query should be a copy that was taken before planning, since the
+ * planner scribbles on its input. Plans that depend on anything other than
+ * the query and the metadata of the table are not cached.
+ */
+void
+CacheFastPathPlan(Query *query, int cursorOptions, Node *distributionKeyValue,
+				  PlannedStmt *plan)
+{
+	if (MaxCachedFastPathPlans <= 0 ||
+		!FastPathPlanIsCacheable(query, distributionKeyValue, plan))
+	{
+		return;
+	}
+
+	if (FastPathPlanCacheHash == NULL)
+	{
+		InitializeFastPathPlanCache();
+	}
+
+	/* evict the least recently used plans */
+	while (FastPathPlanCacheCount > 0 &&
+		   FastPathPlanCacheCount >= MaxCachedFastPathPlans)
+	{
+		RemoveFastPathPlanCacheEntry(
+			dlist_head_element(FastPathPlanCacheEntry, cacheListNode,
+							   &FastPathPlanCacheList));
+	}
+
+	MemoryContext entryContext = AllocSetContextCreate(FastPathPlanCacheContext,
+													   "Fast Path Plan Cache Entry",
+													   ALLOCSET_SMALL_SIZES);
+	MemoryContext oldContext = MemoryContextSwitchTo(entryContext);
+
+	FastPathPlanCacheEntry *cacheEntry = palloc0(sizeof(FastPathPlanCacheEntry));
+	cacheEntry->key = FastPathPlanKey(query, cursorOptions);
+	cacheEntry->distributionKeyValue = copyObject(distributionKeyValue);
+	cacheEntry->query = copyObject(query);
+	cacheEntry->plan = copyObject(plan);
+	cacheEntry->memoryContext = entryContext;
+
+	MemoryContextSwitchTo(oldContext);
+
+	bool found = false;
+	FastPathPlanCacheBucket *cacheBucket = hash_search(FastPathPlanCacheHash,
+													   &cacheEntry->key, HASH_ENTER,
+													   &found);
+	if (!found)
+	{
+		dlist_init(&cacheBucket->entryList);
+	}
+
+	dlist_push_tail(&cacheBucket->entryList, &cacheEntry->bucketNode);
+	dlist_push_tail(&FastPathPlanCacheList, &cacheEntry->cacheListNode);
+	FastPathPlanCacheCount++;
+}
+
+
+/*
+ * InitializeFastPathPlanCache creates the memory context and the hash table
+ * of the fast path plan cache.
+ */
+static void
+InitializeFastPathPlanCache(void)
+{
+	HASHCTL info;
+
+	FastPathPlanCacheContext = AllocSetContextCreate(CacheMemoryContext,
+													 "Fast Path Plan Cache",
+													 ALLOCSET_DEFAULT_SIZES);
+
+	memset(&info, 0, sizeof(info));
+	info.keysize = sizeof(FastPathPlanCacheKey);
+	info.entrysize = sizeof(FastPathPlanCacheBucket);
+	info.hcxt = FastPathPlanCacheContext;
+	int hashFlags = (HASH_ELEM | HASH_BLOBS | HASH_CONTEXT);
+
+	FastPathPlanCacheHash = hash_create("Fast Path Plan Cache Hash", 64, &info,
+										hashFlags);
+}
+
+
+/*
+ * FastPathPlanKey returns the key of the cached plans of the given query.
+ */
+static FastPathPlanCacheKey
+FastPathPlanKey(Query *query, int cursorOptions)
+{
+	FastPathPlanCacheKey cacheKey;
+	uint32 queryHash = 0;
+
+	/* the key is hashed as a blob, so clear any padding */
+	memset(&cacheKey, 0, sizeof(cacheKey));
+
+	HashQueryTreeWalker((Node *) query, &queryHash);
+
+	cacheKey.relationId = ExtractFirstCitusTableId(query);
+	cacheKey.cursorOptions = cursorOptions;
+	cacheKey.queryHash = queryHash;
+
+	return cacheKey;
+}
+
+
+/*
+ * FastPathPlanIsCacheable returns true if the plan of the given fast path
+ * router query only depends on the query and the metadata of the table it
+ * accesses.
+ *
+ * We only cache SELECTs on a single shard of a distributed table. Round-robin
+ * and locality task assignment may pick a different placement on every
+ * planning, so plans are not cached under those policies.
+ */
+static bool
+FastPathPlanIsCacheable(Query *query, Node *distributionKeyValue, PlannedStmt *plan)
+{
+	if (query->commandType != CMD_SELECT || distributionKeyValue == NULL)
+	{
+		return false;
+	}
+
+	if (TaskAssignmentPolicy == TASK_ASSIGNMENT_ROUND_ROBIN ||
+		TaskAssignmentPolicy == TASK_ASSIGNMENT_LOCALITY)
+	{
+		return false;
+	}
+
+	/* plans pruned to a partition depend on the privileges of the user */
+	if (plan->dependsOnRole)
+	{
+		return false;
+	}
+
+	CustomScan *customScan = FetchCitusCustomScanIfExists(plan->planTree);
+	if (customScan == NULL)
+	{
+		return false;
+	}
+
+	DistributedPlan *distributedPlan = GetDistributedPlan(customScan);
+	if (distributedPlan->planningError != NULL ||
+		distributedPlan->subPlanList != NIL ||
+		distributedPlan->workerJob == NULL)
+	{
+		return false;
+	}
+
+	Job *workerJob = distributedPlan->workerJob;
+	if (workerJob->deferredPruning)
+	{
+		/* the shard is picked on every execution */
+		return true;
+	}
+
+	if (list_length(workerJob->taskList) != 1)
+	{
+		return false;
+	}
+
+	/* queries that prune to zero shards run on a dummy placement */
+	Task *task = (Task *) linitial(workerJob->taskList);
+	return task->anchorShardId != INVALID_SHARD_ID;
+}
+
+
+/*
+ * InvalidateFastPathPlanCache removes the cached plans of queries on the
+ * given relation, or all cached plans if relationId is InvalidOid. It is
+ * called when the metadata of distributed tables or nodes changes.
+ */
+void
+InvalidateFastPathPlanCache(Oid relationId)
+{
+	dlist_mutable_iter iter;
+	dlist_foreach_modify(iter, &FastPathPlanCacheList)
+	{
+		FastPathPlanCacheEntry *cacheEntry =
+			dlist_container(FastPathPlanCacheEntry, cacheListNode, iter.cur);
+
+		if (relationId == InvalidOid || cacheEntry->key.relationId == relationId)
+		{
+			RemoveFastPathPlanCacheEntry(cacheEntry);
+		}
+	}
+}
+
+
+/*
+ * RemoveFastPathPlanCacheEntry removes an entry from the fast path plan cache
+ * and frees its memory.
+ */
+static void
+RemoveFastPathPlanCacheEntry(FastPathPlanCacheEntry *cacheEntry)
+{
+	FastPathPlanCacheBucket *cacheBucket = hash_search(FastPathPlanCacheHash,
+													   &cacheEntry->key, HASH_FIND,
+													   NULL);
+
+	dlist_delete(&cacheEntry->bucketNode);
+	dlist_delete(&cacheEntry->cacheListNode);
+	FastPathPlanCacheCount--;
+
+	if (cacheBucket != NULL && dlist_is_empty(&cacheBucket->entryList))
+	{
+		hash_search(FastPathPlanCacheHash, &cacheEntry->key, HASH_REMOVE, NULL);
+	}
+
+	MemoryContextDelete(cacheEntry->memoryContext);
+}
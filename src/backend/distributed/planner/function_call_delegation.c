@@ -12,6 +12,7 @@
 
 #include "postgres.h"
 
+#include "access/hash.h"
 #include "catalog/pg_proc.h"
 #include "catalog/pg_type.h"
 #include "commands/defrem.h"
@@ -25,6 +26,7 @@
 #include "distributed/function_call_delegation.h"
 #include "distributed/insert_select_planner.h"
 #include "distributed/insert_select_executor.h"
+#include "distributed/listutils.h"
 #include "distributed/master_metadata_utility.h"
 #include "distributed/master_protocol.h"
 #include "distributed/metadata_cache.h"
@@ -46,6 +48,8 @@
 #endif
 #include "miscadmin.h"
 #include "tcop/dest.h"
+#include "utils/array.h"
+#include "utils/builtins.h"
 #include "utils/lsyscache.h"
 #include "utils/syscache.h"
 
@@ -55,7 +59,23 @@ struct ParamWalkerContext
 	ParamKind paramKind;
 };
 
+
+/* GUC, whether calls with an array of distribution argument values are split */
+bool EnableBatchedFunctionDelegation = false;
+
+/* GUC, whether delegated calls are executed with prepared statements */
+bool EnablePreparedFunctionDelegation = false;
+
+
 static bool contain_param_walker(Node *node, void *context);
+static bool FunctionCallHasParams(DistributedPlanningContext *planContext,
+								  FuncExpr *funcExpr);
+static PlannedStmt * TryToDelegateBatchedFunctionCall(
+	DistributedPlanningContext *planContext, FuncExpr *funcExpr,
+	int distributionArgIndex, CitusTableCacheEntry *distTable);
+static PlannedStmt * FinalizeDelegatedFunctionCallPlan(
+	DistributedPlanningContext *planContext, List *taskList);
+static void SetTaskPreparedStatement(Task *task, FuncExpr *funcExpr);
 
 /*
  * contain_param_walker scans node for Param nodes.
@@ -113,9 +133,6 @@ TryToDelegateFunctionCall(DistributedPlanningContext *planContext)
 	ShardPlacement *placement = NULL;
 	WorkerNode *workerNode = NULL;
 	Task *task = NULL;
-	Job *job = NULL;
-	DistributedPlan *distributedPlan = CitusMakeNode(DistributedPlan);
-	struct ParamWalkerContext walkerParamContext = { 0 };
 
 	if (!CitusHasBeenLoaded() || !CheckCitusVersion(DEBUG4))
 	{
@@ -308,6 +325,19 @@ TryToDelegateFunctionCall(DistributedPlanningContext *planContext)
 		return NULL;
 	}
 
+	/*
+	 * A set returning function that gets an array of distribution argument
+	 * values can be split into a call per worker, whose results we append.
+	 */
+	if (EnableBatchedFunctionDelegation && funcExpr->funcretset &&
+		type_is_array(partitionValue->consttype) &&
+		!type_is_array(partitionColumn->vartype))
+	{
+		return TryToDelegateBatchedFunctionCall(planContext, funcExpr,
+												procedure->distributionArgIndex,
+												distTable);
+	}
+
 	partitionValueDatum = partitionValue->constvalue;
 
 	if (partitionValue->consttype != partitionColumn->vartype)
@@ -345,20 +375,8 @@ TryToDelegateFunctionCall(DistributedPlanningContext *planContext)
 		return NULL;
 	}
 
-	(void) expression_tree_walker((Node *) funcExpr->args, contain_param_walker,
-								  &walkerParamContext);
-	if (walkerParamContext.hasParam)
+	if (FunctionCallHasParams(planContext, funcExpr))
 	{
-		if (walkerParamContext.paramKind == PARAM_EXTERN)
-		{
-			/* Don't log a message, we should end up here again without a parameter */
-			DissuadePlannerFromUsingPlan(planContext->plan);
-		}
-		else
-		{
-			ereport(DEBUG1, (errmsg("arguments in a distributed function must "
-									"not contain subqueries")));
-		}
 		return NULL;
 	}
 
@@ -370,13 +388,286 @@ TryToDelegateFunctionCall(DistributedPlanningContext *planContext)
 	SetTaskQuery(task, planContext->query);
 	task->anchorShardId = shardInterval->shardId;
 	task->replicationModel = distTable->replicationModel;
+	SetTaskPreparedStatement(task, funcExpr);
+
+	return FinalizeDelegatedFunctionCallPlan(planContext, list_make1(task));
+}
+
+
+/*
+ * FunctionCallHasParams returns true if the arguments of the function call
+ * contain parameters, which prevents delegating the call. If the parameters
+ * are external, the planner is dissuaded from using the plan, such that we
+ * get here again once the parameters are known.
+ */
+static bool
+FunctionCallHasParams(DistributedPlanningContext *planContext, FuncExpr *funcExpr)
+{
+	struct ParamWalkerContext walkerParamContext = { 0 };
+
+	(void) expression_tree_walker((Node *) funcExpr->args, contain_param_walker,
+								  &walkerParamContext);
+	if (!walkerParamContext.hasParam)
+	{
+		return false;
+	}
+
+	if (walkerParamContext.paramKind == PARAM_EXTERN)
+	{
+		/* Don't log a message, we should end up here again without a parameter */
+		DissuadePlannerFromUsingPlan(planContext->plan);
+	}
+	else
+	{
+		ereport(DEBUG1, (errmsg("arguments in a distributed function must "
+								"not contain subqueries")));
+	}
 
-	job = CitusMakeNode(Job);
+	return true;
+}
+
+
+/*
+ * TryToDelegateBatchedFunctionCall delegates a call of a set returning
+ * function whose distribution argument is an array by splitting it into a
+ * call per worker that only gets the array elements that belong to shards on
+ * that worker. The calls run in parallel and their results are appended.
+ *
+ * Every call runs in a separate transaction on its worker, which is why the
+ * batched delegation needs to be enabled explicitly.
+ */
+static PlannedStmt *
+TryToDelegateBatchedFunctionCall(DistributedPlanningContext *planContext,
+								 FuncExpr *funcExpr, int distributionArgIndex,
+								 CitusTableCacheEntry *distTable)
+{
+	List *taskList = NIL;
+	uint32 taskId = 1;
+
+	if (FunctionCallHasParams(planContext, funcExpr))
+	{
+		return NULL;
+	}
+
+	List *batchList = SplitFunctionCallByDistributionArgument(funcExpr,
+															  distributionArgIndex,
+															  distTable);
+	if (batchList == NIL)
+	{
+		return NULL;
+	}
+
+	ereport(DEBUG1, (errmsg("pushing down the function call in %d batches",
+							list_length(batchList))));
+
+	BatchedFunctionCall *batch = NULL;
+	foreach_ptr(batch, batchList)
+	{
+		Query *batchQuery = copyObject(planContext->query);
+		TargetEntry *batchTargetEntry = (TargetEntry *) linitial(batchQuery->targetList);
+
+		batchTargetEntry->expr = (Expr *) batch->funcExpr;
+
+		Task *task = CitusMakeNode(Task);
+		task->taskType = SELECT_TASK;
+		task->taskId = taskId++;
+		task->taskPlacementList = list_make1(batch->placement);
+		SetTaskQuery(task, batchQuery);
+		task->anchorShardId = batch->placement->shardId;
+		task->replicationModel = distTable->replicationModel;
+		SetTaskPreparedStatement(task, batch->funcExpr);
+
+		taskList = lappend(taskList, task);
+	}
+
+	return FinalizeDelegatedFunctionCallPlan(planContext, taskList);
+}
+
+
+/*
+ * SplitFunctionCallByDistributionArgument splits a call of a distributed
+ * function or procedure whose distribution argument is an array of values
+ * of the distribution column into a BatchedFunctionCall per worker. Each of
+ * them gets the array elements that belong to the shards on its worker.
+ *
+ * The function returns NIL if the call cannot be split, for instance because
+ * the array contains NULLs or a shard is not on a worker with metadata.
+ */
+List *
+SplitFunctionCallByDistributionArgument(FuncExpr *funcExpr, int distributionArgIndex,
+										CitusTableCacheEntry *distTable)
+{
+	Var *partitionColumn = distTable->partitionColumn;
+	List *batchList = NIL;
+	int16 typeLength = 0;
+	bool typeByValue = false;
+	char typeAlign = 0;
+	Datum *elements = NULL;
+	bool *elementNulls = NULL;
+	int elementCount = 0;
+	CopyCoercionData coercionData;
+
+	/* evaluate the array, ARRAY[...] is not yet folded into a constant in CALL */
+	Node *distributionArg = (Node *) list_nth(funcExpr->args, distributionArgIndex);
+	distributionArg = eval_const_expressions(NULL, distributionArg);
+	if (!IsA(distributionArg, Const))
+	{
+		ereport(DEBUG1, (errmsg("distribution argument value must be a constant")));
+		return NIL;
+	}
+
+	Const *arrayConst = (Const *) distributionArg;
+	if (arrayConst->constisnull)
+	{
+		ereport(DEBUG1, (errmsg("distribution argument array must not be NULL")));
+		return NIL;
+	}
+
+	ArrayType *array = DatumGetArrayTypeP(arrayConst->constvalue);
+	if (ARR_NDIM(array) > 1)
+	{
+		ereport(DEBUG1, (errmsg("distribution argument array must have a "
+								"single dimension")));
+		return NIL;
+	}
+
+	Oid elementType = ARR_ELEMTYPE(array);
+	get_typlenbyvalalign(elementType, &typeLength, &typeByValue, &typeAlign);
+	deconstruct_array(array, elementType, typeLength, typeByValue, typeAlign,
+					  &elements, &elementNulls, &elementCount);
+	if (elementCount == 0)
+	{
+		ereport(DEBUG1, (errmsg("distribution argument array is empty")));
+		return NIL;
+	}
+
+	bool needsCoercion = elementType != partitionColumn->vartype;
+	if (needsCoercion)
+	{
+		ConversionPathForTypes(elementType, partitionColumn->vartype, &coercionData);
+	}
+
+	/* the index of the batch that gets each element */
+	int *elementBatchIndexes = palloc0(elementCount * sizeof(int));
+
+	for (int elementIndex = 0; elementIndex < elementCount; elementIndex++)
+	{
+		if (elementNulls[elementIndex])
+		{
+			ereport(DEBUG1, (errmsg("distribution argument array must not "
+									"contain NULLs")));
+			return NIL;
+		}
+
+		Datum partitionValueDatum = elements[elementIndex];
+		if (needsCoercion)
+		{
+			partitionValueDatum = CoerceColumnValue(partitionValueDatum, &coercionData);
+		}
+
+		ShardInterval *shardInterval = FindShardInterval(partitionValueDatum, distTable);
+		if (shardInterval == NULL)
+		{
+			ereport(DEBUG1, (errmsg("cannot push down call, failed to find shard "
+									"interval")));
+			return NIL;
+		}
+
+		List *placementList = ActiveShardPlacementList(shardInterval->shardId);
+		if (list_length(placementList) != 1)
+		{
+			/* punt on this for now */
+			ereport(DEBUG1, (errmsg("cannot push down function call for replicated "
+									"distributed tables")));
+			return NIL;
+		}
+
+		ShardPlacement *placement = (ShardPlacement *) linitial(placementList);
+		WorkerNode *workerNode = FindWorkerNode(placement->nodeName,
+												placement->nodePort);
+		if (workerNode == NULL || !workerNode->hasMetadata ||
+			!workerNode->metadataSynced)
+		{
+			ereport(DEBUG1, (errmsg("the worker node does not have metadata")));
+			return NIL;
+		}
+
+		/* find the batch of the worker, or start one */
+		int elementBatchIndex = 0;
+		ListCell *batchCell = NULL;
+		foreach(batchCell, batchList)
+		{
+			BatchedFunctionCall *batch = (BatchedFunctionCall *) lfirst(batchCell);
+
+			if (batch->placement->groupId == placement->groupId)
+			{
+				break;
+			}
+
+			elementBatchIndex++;
+		}
+
+		if (batchCell == NULL)
+		{
+			BatchedFunctionCall *batch = palloc0(sizeof(BatchedFunctionCall));
+			batch->placement = placement;
+
+			batchList = lappend(batchList, batch);
+		}
+
+		elementBatchIndexes[elementIndex] = elementBatchIndex;
+	}
+
+	/* build the calls with the array elements of each batch */
+	Datum *batchElements = palloc0(elementCount * sizeof(Datum));
+	int batchIndex = 0;
+
+	BatchedFunctionCall *batch = NULL;
+	foreach_ptr(batch, batchList)
+	{
+		int batchElementCount = 0;
+
+		for (int elementIndex = 0; elementIndex < elementCount; elementIndex++)
+		{
+			if (elementBatchIndexes[elementIndex] == batchIndex)
+			{
+				batchElements[batchElementCount++] = elements[elementIndex];
+			}
+		}
+
+		ArrayType *batchArray = construct_array(batchElements, batchElementCount,
+												elementType, typeLength, typeByValue,
+												typeAlign);
+
+		Const *batchConst = copyObject(arrayConst);
+		batchConst->constvalue = PointerGetDatum(batchArray);
+
+		batch->funcExpr = copyObject(funcExpr);
+
+		ListCell *argCell = list_nth_cell(batch->funcExpr->args, distributionArgIndex);
+		lfirst(argCell) = batchConst;
+
+		batchIndex++;
+	}
+
+	return batchList;
+}
+
+
+/*
+ * FinalizeDelegatedFunctionCallPlan returns the plan that runs the tasks of a
+ * delegated function call.
+ */
+static PlannedStmt *
+FinalizeDelegatedFunctionCallPlan(DistributedPlanningContext *planContext,
+								  List *taskList)
+{
+	Job *job = CitusMakeNode(Job);
 	job->jobId = UniqueJobId();
 	job->jobQuery = planContext->query;
-	job->taskList = list_make1(task);
+	job->taskList = taskList;
 
-	distributedPlan = CitusMakeNode(DistributedPlan);
+	DistributedPlan *distributedPlan = CitusMakeNode(DistributedPlan);
 	distributedPlan->workerJob = job;
 	distributedPlan->masterQuery = NULL;
 	distributedPlan->routerExecutable = true;
@@ -385,5 +676,87 @@ TryToDelegateFunctionCall(DistributedPlanningContext *planContext)
 	/* worker will take care of any necessary locking, treat query as read-only */
 	distributedPlan->modLevel = ROW_MODIFY_READONLY;
 
-	return FinalizePlan(planContext->plan, distributedPlan);
+	return FinalizePlan(planContext->plan, distributedPlan,
+						planContext->cursorOptions);
+}
+
+
+/*
+ * SetTaskPreparedStatement sets up the task of a delegated function call to
+ * be executed with a statement that is prepared once per connection, such
+ * that the worker does not parse and plan the call every time. Statements
+ * are named after the function and the types of its arguments, and they get
+ * all arguments of the call as parameters.
+ */
+static void
+SetTaskPreparedStatement(Task *task, FuncExpr *funcExpr)
+{
+	List *paramList = NIL;
+	int argumentIndex = 0;
+
+	if (!EnablePreparedFunctionDelegation)
+	{
+		return;
+	}
+
+	int argumentCount = list_length(funcExpr->args);
+	Oid *argumentTypes = palloc0(Max(argumentCount, 1) * sizeof(Oid));
+	StringInfo prepareCommand = makeStringInfo();
+	StringInfo executeCommand = makeStringInfo();
+	StringInfo argumentTypeNames = makeStringInfo();
+	StringInfo argumentValues = makeStringInfo();
+
+	Node *argument = NULL;
+	foreach_ptr(argument, funcExpr->args)
+	{
+		Param *param = makeNode(Param);
+		param->paramkind = PARAM_EXTERN;
+		param->paramid = argumentIndex + 1;
+		param->paramtype = exprType(argument);
+		param->paramtypmod = exprTypmod(argument);
+		param->paramcollid = exprCollation(argument);
+		param->location = -1;
+
+		paramList = lappend(paramList, param);
+		argumentTypes[argumentIndex] = param->paramtype;
+
+		appendStringInfo(argumentTypeNames, "%s%s", argumentIndex > 0 ? ", " : "",
+						 format_type_be_qualified(param->paramtype));
+		appendStringInfo(argumentValues, "%s%s", argumentIndex > 0 ? ", " : "",
+						 pg_get_rule_expr(argument));
+
+		argumentIndex++;
+	}
+
+	uint32 argumentTypesHash = 0;
+	if (argumentCount > 0)
+	{
+		argumentTypesHash = DatumGetUInt32(hash_any((unsigned char *) argumentTypes,
+													argumentCount * sizeof(Oid)));
+	}
+
+	FuncExpr *preparedFuncExpr = copyObject(funcExpr);
+	preparedFuncExpr->args = paramList;
+
+	char *statementName = psprintf("citus_delegated_call_%u_%u", funcExpr->funcid,
+								   argumentTypesHash);
+
+	if (argumentCount > 0)
+	{
+		appendStringInfo(prepareCommand, "PREPARE %s(%s) AS SELECT %s", statementName,
+						 argumentTypeNames->data,
+						 pg_get_rule_expr((Node *) preparedFuncExpr));
+		appendStringInfo(executeCommand, "EXECUTE %s(%s)", statementName,
+						 argumentValues->data);
+	}
+	else
+	{
+		appendStringInfo(prepareCommand, "PREPARE %s AS SELECT %s", statementName,
+						 pg_get_rule_expr((Node *) preparedFuncExpr));
+		appendStringInfo(executeCommand, "EXECUTE %s", statementName);
+	}
+
+	task->preparedStatementName = statementName;
+	task->prepareCommand = prepareCommand->data;
+	task->executeCommand = executeCommand->data;
 }
@@ -47,6 +47,10 @@
 #include "utils/rel.h"
 
 
+/* GUC, number of rows from which multi-row INSERTs are sent with COPY, 0 disables */
+int MultiRowInsertCopyThreshold = 0;
+
+
 static DistributedPlan * CreateDistributedInsertSelectPlan(Query *originalQuery,
 														   PlannerRestrictionContext *
 														   plannerRestrictionContext);
@@ -71,6 +75,8 @@ static DeferredErrorMessage * InsertPartitionColumnMatchesSelect(Query *query,
 																 selectPartitionColumnTableId);
 static DistributedPlan * CreateCoordinatorInsertSelectPlan(uint64 planId, Query *parse);
 static DeferredErrorMessage * CoordinatorInsertSelectSupported(Query *insertSelectQuery);
+static RangeTblEntry * MultiRowInsertValuesRTE(Query *query, Index *valuesRTIndex);
+static RangeTblEntry * WrapValuesRTEInSubquery(RangeTblEntry *valuesRte);
 
 
 /*
@@ -1138,6 +1144,162 @@ CreateCoordinatorInsertSelectPlan(uint64 planId, Query *parse)
 }
 
 
+/*
+ * MultiRowInsertCanUseCopy returns whether the given multi-row INSERT into a
+ * distributed table has at least citus.multi_row_insert_copy_threshold rows
+ * and can be executed by copying the rows into the shards, rather than by
+ * splitting the VALUES list by shard and deparsing a task for every shard.
+ *
+ * Note that the input query should be the original parsetree of the query.
+ */
+bool
+MultiRowInsertCanUseCopy(Query *query)
+{
+	Index valuesRTIndex = 0;
+
+	if (MultiRowInsertCopyThreshold <= 0 || query->commandType != CMD_INSERT)
+	{
+		return false;
+	}
+
+	/* RETURNING and ON CONFLICT would need the rows to pass through the workers */
+	if (query->returningList != NIL || query->onConflict != NULL ||
+		query->cteList != NIL || query->hasSubLinks)
+	{
+		return false;
+	}
+
+	RangeTblEntry *valuesRte = MultiRowInsertValuesRTE(query, &valuesRTIndex);
+	if (valuesRte == NULL ||
+		list_length(valuesRte->values_lists) < MultiRowInsertCopyThreshold)
+	{
+		return false;
+	}
+
+	/* COPY into an append-distributed table would create new shards */
+	RangeTblEntry *insertRte = ExtractResultRelationRTE(query);
+	if (!IsCitusTable(insertRte->relid) ||
+		PartitionMethod(insertRte->relid) == DISTRIBUTE_BY_APPEND)
+	{
+		return false;
+	}
+
+	return true;
+}
+
+
+/*
+ * CreateMultiRowInsertCopyPlan creates a plan for a multi-row INSERT for
+ * which MultiRowInsertCanUseCopy returned true. The INSERT is turned into
+ * INSERT INTO table SELECT * FROM (VALUES ...), such that the executor of
+ * INSERT ... SELECT via the coordinator evaluates the VALUES list locally and
+ * copies the rows into the shards with the CitusCopyDestReceiver.
+ */
+DistributedPlan *
+CreateMultiRowInsertCopyPlan(uint64 planId, Query *originalQuery)
+{
+	Index valuesRTIndex = 0;
+	Query *insertSelectQuery = copyObject(originalQuery);
+
+	RangeTblEntry *valuesRte = MultiRowInsertValuesRTE(insertSelectQuery,
+													   &valuesRTIndex);
+	Assert(valuesRte != NULL);
+
+	/* the target list keeps referring to the columns of the VALUES list */
+	RangeTblEntry *subqueryRte = WrapValuesRTEInSubquery(valuesRte);
+	ListCell *valuesRteCell = list_nth_cell(insertSelectQuery->rtable,
+											valuesRTIndex - 1);
+	lfirst(valuesRteCell) = subqueryRte;
+
+	ereport(DEBUG1, (errmsg("copying the rows of the multi-row INSERT into the "
+							"shards")));
+
+	return CreateCoordinatorInsertSelectPlan(planId, insertSelectQuery);
+}
+
+
+/*
+ * MultiRowInsertValuesRTE returns the VALUES range table entry that the
+ * given multi-row INSERT selects from, and sets valuesRTIndex to its index
+ * in the range table. It returns NULL if the INSERT does not select from a
+ * VALUES list.
+ */
+static RangeTblEntry *
+MultiRowInsertValuesRTE(Query *query, Index *valuesRTIndex)
+{
+	if (query->jointree == NULL || list_length(query->jointree->fromlist) != 1)
+	{
+		return NULL;
+	}
+
+	RangeTblRef *rangeTableReference = linitial(query->jointree->fromlist);
+	if (!IsA(rangeTableReference, RangeTblRef))
+	{
+		return NULL;
+	}
+
+	RangeTblEntry *valuesRte = rt_fetch(rangeTableReference->rtindex, query->rtable);
+	if (valuesRte->rtekind != RTE_VALUES)
+	{
+		return NULL;
+	}
+
+	*valuesRTIndex = rangeTableReference->rtindex;
+
+	return valuesRte;
+}
+
+
+/*
+ * WrapValuesRTEInSubquery returns a subquery range table entry for
+ * SELECT * FROM (VALUES ...) with the given VALUES range table entry, whose
+ * columns match the columns of the VALUES list.
+ */
+static RangeTblEntry *
+WrapValuesRTEInSubquery(RangeTblEntry *valuesRte)
+{
+	ParseState *pstate = make_parsestate(NULL);
+	List *targetList = NIL;
+	int columnCount = list_length(valuesRte->eref->colnames);
+	int indexInRangeTable = 1;
+
+	Query *valuesQuery = makeNode(Query);
+	valuesQuery->commandType = CMD_SELECT;
+	valuesQuery->querySource = QSRC_ORIGINAL;
+	valuesQuery->canSetTag = true;
+	valuesQuery->rtable = list_make1(valuesRte);
+
+	RangeTblRef *valuesRangeTableRef = makeNode(RangeTblRef);
+	valuesRangeTableRef->rtindex = indexInRangeTable;
+	valuesQuery->jointree = makeFromExpr(list_make1(valuesRangeTableRef), NULL);
+
+	for (int columnIndex = 0; columnIndex < columnCount; columnIndex++)
+	{
+		AttrNumber columnNumber = columnIndex + 1;
+		char *columnName = strVal(list_nth(valuesRte->eref->colnames, columnIndex));
+		Oid columnType = list_nth_oid(valuesRte->coltypes, columnIndex);
+		int32 columnTypmod = list_nth_int(valuesRte->coltypmods, columnIndex);
+		Oid columnCollation = list_nth_oid(valuesRte->colcollations, columnIndex);
+
+		Var *column = makeVar(indexInRangeTable, columnNumber, columnType,
+							  columnTypmod, columnCollation, 0);
+
+		TargetEntry *targetEntry = makeTargetEntry((Expr *) column, columnNumber,
+												   pstrdup(columnName), false);
+		targetList = lappend(targetList, targetEntry);
+	}
+
+	valuesQuery->targetList = targetList;
+
+	Alias *selectAlias = makeAlias("*SELECT*", NIL);
+	bool lateral = false;
+	bool inFromClause = true;
+
+	return addRangeTableEntryForSubquery(pstate, valuesQuery, selectAlias, lateral,
+										 inFromClause);
+}
+
+
 /*
  * CoordinatorInsertSelectSupported returns an error if executing an
  * INSERT ... SELECT command by pulling results of the SELECT to the coordinator
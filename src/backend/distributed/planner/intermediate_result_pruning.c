@@ -17,9 +17,15 @@
 #include "distributed/listutils.h"
 #include "distributed/log_utils.h"
 #include "distributed/metadata_cache.h"
+#include "distributed/multi_logical_planner.h"
 #include "distributed/query_utils.h"
 #include "distributed/worker_manager.h"
+#include "nodes/makefuncs.h"
+#include "optimizer/clauses.h"
+#include "parser/parse_relation.h"
+#include "parser/parsetree.h"
 #include "utils/builtins.h"
+#include "utils/typcache.h"
 
 /* controlled via GUC, used mostly for testing */
 bool LogIntermediateResults = false;
@@ -35,6 +41,14 @@ static bool UsedSubPlansEqual(UsedDistributedSubPlan *left,
 							  UsedDistributedSubPlan *right);
 static UsedDistributedSubPlan * UsedSubPlanListMember(List *list,
 													  UsedDistributedSubPlan *usedPlan);
+static void ExtractInnerJoinTree(Node *joinTreeNode, List **rangeTableIndexList,
+								 List **qualList);
+static int IntermediateResultReferenceCount(Query *query, char *resultId);
+static bool FindPartitionedResultJoin(Query *query, List *innerJoinRangeTableIndexList,
+									  List *innerJoinQualList,
+									  UsedDistributedSubPlan *usedPlan);
+static int IntermediateResultColumnIndex(Query *query, Var *column, char *resultId);
+static Oid HashDistributedTableOfColumn(Query *query, Var *column);
 
 
 /*
@@ -74,6 +88,8 @@ FindSubPlansUsedInNode(Node *node)
 
 			/* the callers are responsible for setting the accurate location */
 			usedPlan->locationMask = SUBPLAN_ACCESS_NONE;
+			usedPlan->partitionRelationId = InvalidOid;
+			usedPlan->partitionColumnIndex = -1;
 
 			if (!UsedSubPlanListMember(usedSubPlanList, usedPlan))
 			{
@@ -117,6 +133,18 @@ RecordSubplanExecutionsOnNodes(HTAB *intermediateResultsHash,
 		IntermediateResultsHashEntry *entry = SearchIntermediateResult(
 			intermediateResultsHash, resultId);
 
+		/* a result that is used by several plans may need all rows on all nodes */
+		entry->usedPlanCount++;
+		if (entry->usedPlanCount == 1)
+		{
+			entry->partitionRelationId = usedPlan->partitionRelationId;
+			entry->partitionColumnIndex = usedPlan->partitionColumnIndex;
+		}
+		else
+		{
+			entry->partitionRelationId = InvalidOid;
+		}
+
 		if (usedPlan->locationMask & SUBPLAN_ACCESS_LOCAL)
 		{
 			/* subPlan needs to be written locally as the planner decided */
@@ -377,6 +405,9 @@ SearchIntermediateResult(HTAB *intermediateResultsHash, char *resultId)
 	{
 		entry->nodeIdList = NIL;
 		entry->writeLocalFile = false;
+		entry->usedPlanCount = 0;
+		entry->partitionRelationId = InvalidOid;
+		entry->partitionColumnIndex = -1;
 	}
 
 	return entry;
@@ -475,3 +506,291 @@ UsedSubPlansEqual(UsedDistributedSubPlan *left, UsedDistributedSubPlan *right)
 
 	return false;
 }
+
+
+/*
+ * RecordPartitionedSubPlanResults finds the subplans of a multi-shard SELECT
+ * whose result is only joined with a hash-distributed table on its
+ * distribution column. A task can then only match the rows whose join key
+ * hashes into the shard of the task, so the executor can send each row only
+ * to the nodes that have that shard instead of broadcasting the result to all
+ * nodes that run a task.
+ *
+ * The decision is recorded on the used subplans of the plan. Whether the
+ * result is also used by other plans is only known during execution.
+ */
+void
+RecordPartitionedSubPlanResults(DistributedPlan *plan, Query *originalQuery)
+{
+	Job *workerJob = plan->workerJob;
+	List *innerJoinRangeTableIndexList = NIL;
+	List *innerJoinQualList = NIL;
+
+	if (plan->usedSubPlanNodeList == NIL || originalQuery->commandType != CMD_SELECT ||
+		workerJob == NULL || workerJob->dependentJobList != NIL ||
+		list_length(workerJob->taskList) < 2)
+	{
+		return;
+	}
+
+	ExtractInnerJoinTree((Node *) originalQuery->jointree,
+						 &innerJoinRangeTableIndexList, &innerJoinQualList);
+
+	UsedDistributedSubPlan *usedPlan = NULL;
+	foreach_ptr(usedPlan, plan->usedSubPlanNodeList)
+	{
+		if (usedPlan->locationMask != SUBPLAN_ACCESS_REMOTE)
+		{
+			continue;
+		}
+
+		/* the join only restricts the rows of the reference that it is on */
+		if (IntermediateResultReferenceCount(originalQuery, usedPlan->subPlanId) != 1)
+		{
+			continue;
+		}
+
+		FindPartitionedResultJoin(originalQuery, innerJoinRangeTableIndexList,
+								  innerJoinQualList, usedPlan);
+	}
+}
+
+
+/*
+ * ExtractInnerJoinTree walks the join tree down through inner joins, and
+ * adds the range table indexes it finds to rangeTableIndexList and the join
+ * and WHERE conditions to qualList. The rows of those range table entries that
+ * do not satisfy a condition in qualList never make it into the result. The
+ * walk does not descend into outer joins.
+ */
+static void
+ExtractInnerJoinTree(Node *joinTreeNode, List **rangeTableIndexList, List **qualList)
+{
+	if (joinTreeNode == NULL)
+	{
+		return;
+	}
+
+	if (IsA(joinTreeNode, RangeTblRef))
+	{
+		RangeTblRef *rangeTableRef = (RangeTblRef *) joinTreeNode;
+
+		*rangeTableIndexList = lappend_int(*rangeTableIndexList,
+										   rangeTableRef->rtindex);
+	}
+	else if (IsA(joinTreeNode, FromExpr))
+	{
+		FromExpr *fromExpr = (FromExpr *) joinTreeNode;
+		Node *fromElement = NULL;
+
+		foreach_ptr(fromElement, fromExpr->fromlist)
+		{
+			ExtractInnerJoinTree(fromElement, rangeTableIndexList, qualList);
+		}
+
+		*qualList = list_concat(*qualList,
+								make_ands_implicit((Expr *) fromExpr->quals));
+	}
+	else if (IsA(joinTreeNode, JoinExpr))
+	{
+		JoinExpr *joinExpr = (JoinExpr *) joinTreeNode;
+
+		if (joinExpr->jointype != JOIN_INNER)
+		{
+			return;
+		}
+
+		ExtractInnerJoinTree(joinExpr->larg, rangeTableIndexList, qualList);
+		ExtractInnerJoinTree(joinExpr->rarg, rangeTableIndexList, qualList);
+
+		*qualList = list_concat(*qualList,
+								make_ands_implicit((Expr *) joinExpr->quals));
+	}
+}
+
+
+/*
+ * IntermediateResultReferenceCount returns the number of times the query,
+ * including its subqueries, reads the given intermediate result.
+ */
+static int
+IntermediateResultReferenceCount(Query *query, char *resultId)
+{
+	List *rangeTableList = NIL;
+	int referenceCount = 0;
+
+	ExtractRangeTableEntryWalker((Node *) query, &rangeTableList);
+
+	RangeTblEntry *rangeTableEntry = NULL;
+	foreach_ptr(rangeTableEntry, rangeTableList)
+	{
+		if (rangeTableEntry->rtekind != RTE_FUNCTION)
+		{
+			continue;
+		}
+
+		char *referencedResultId = FindIntermediateResultIdIfExists(rangeTableEntry);
+		if (referencedResultId != NULL && strcmp(referencedResultId, resultId) == 0)
+		{
+			referenceCount++;
+		}
+	}
+
+	return referenceCount;
+}
+
+
+/*
+ * FindPartitionedResultJoin looks for an equality condition in
+ * innerJoinQualList between a column of the intermediate result of usedPlan
+ * and the distribution column of a hash-distributed table, both of which are
+ * inner joined. If it finds one, it records the table and the result column
+ * in usedPlan and returns true.
+ */
+static bool
+FindPartitionedResultJoin(Query *query, List *innerJoinRangeTableIndexList,
+						  List *innerJoinQualList, UsedDistributedSubPlan *usedPlan)
+{
+	Node *qual = NULL;
+	foreach_ptr(qual, innerJoinQualList)
+	{
+		if (!IsA(qual, OpExpr) || list_length(((OpExpr *) qual)->args) != 2)
+		{
+			continue;
+		}
+
+		OpExpr *opExpr = (OpExpr *) qual;
+		Node *leftArg = linitial(opExpr->args);
+		Node *rightArg = lsecond(opExpr->args);
+
+		if (!IsA(leftArg, Var) || !IsA(rightArg, Var))
+		{
+			continue;
+		}
+
+		Var *leftColumn = (Var *) leftArg;
+		Var *rightColumn = (Var *) rightArg;
+
+		if (leftColumn->varlevelsup != 0 || rightColumn->varlevelsup != 0 ||
+			leftColumn->vartype != rightColumn->vartype ||
+			!list_member_int(innerJoinRangeTableIndexList, leftColumn->varno) ||
+			!list_member_int(innerJoinRangeTableIndexList, rightColumn->varno))
+		{
+			continue;
+		}
+
+		/* values that are equal need to hash into the same shard */
+		TypeCacheEntry *typeEntry = lookup_type_cache(leftColumn->vartype,
+													  TYPECACHE_EQ_OPR);
+		if (opExpr->opno != typeEntry->eq_opr)
+		{
+			continue;
+		}
+
+		for (int argumentOrder = 0; argumentOrder < 2; argumentOrder++)
+		{
+			Var *resultColumn = argumentOrder == 0 ? leftColumn : rightColumn;
+			Var *distributedColumn = argumentOrder == 0 ? rightColumn : leftColumn;
+
+			int resultColumnIndex = IntermediateResultColumnIndex(query, resultColumn,
+																  usedPlan->subPlanId);
+			if (resultColumnIndex < 0)
+			{
+				continue;
+			}
+
+			Oid relationId = HashDistributedTableOfColumn(query, distributedColumn);
+			if (!OidIsValid(relationId))
+			{
+				continue;
+			}
+
+			usedPlan->partitionRelationId = relationId;
+			usedPlan->partitionColumnIndex = resultColumnIndex;
+
+			return true;
+		}
+	}
+
+	return false;
+}
+
+
+/*
+ * IntermediateResultColumnIndex returns the index of the column of the given
+ * intermediate result that the given column refers to, if the column belongs
+ * to a subquery that reads all rows of the result. Otherwise, it returns -1.
+ */
+static int
+IntermediateResultColumnIndex(Query *query, Var *column, char *resultId)
+{
+	RangeTblEntry *rangeTableEntry = rt_fetch(column->varno, query->rtable);
+	if (rangeTableEntry->rtekind != RTE_SUBQUERY)
+	{
+		return -1;
+	}
+
+	/* a LIMIT or an aggregate would pick rows from the result as a whole */
+	Query *subquery = rangeTableEntry->subquery;
+	if (list_length(subquery->rtable) != 1 || subquery->setOperations != NULL ||
+		subquery->hasAggs || subquery->hasWindowFuncs || subquery->hasTargetSRFs ||
+		subquery->groupClause != NIL || subquery->distinctClause != NIL ||
+		subquery->limitCount != NULL || subquery->limitOffset != NULL)
+	{
+		return -1;
+	}
+
+	RangeTblEntry *functionEntry = linitial(subquery->rtable);
+	if (functionEntry->rtekind != RTE_FUNCTION || functionEntry->funcordinality)
+	{
+		return -1;
+	}
+
+	char *referencedResultId = FindIntermediateResultIdIfExists(functionEntry);
+	if (referencedResultId == NULL || strcmp(referencedResultId, resultId) != 0)
+	{
+		return -1;
+	}
+
+	TargetEntry *targetEntry = get_tle_by_resno(subquery->targetList,
+												column->varattno);
+	if (targetEntry == NULL || !IsA(targetEntry->expr, Var))
+	{
+		return -1;
+	}
+
+	Var *functionColumn = (Var *) targetEntry->expr;
+	if (functionColumn->varno != 1 || functionColumn->varlevelsup != 0)
+	{
+		return -1;
+	}
+
+	return functionColumn->varattno - 1;
+}
+
+
+/*
+ * HashDistributedTableOfColumn returns the hash-distributed table whose
+ * distribution column the given column is, or InvalidOid if it is not one.
+ */
+static Oid
+HashDistributedTableOfColumn(Query *query, Var *column)
+{
+	RangeTblEntry *rangeTableEntry = rt_fetch(column->varno, query->rtable);
+	if (rangeTableEntry->rtekind != RTE_RELATION ||
+		!IsCitusTable(rangeTableEntry->relid))
+	{
+		return InvalidOid;
+	}
+
+	Oid relationId = rangeTableEntry->relid;
+	CitusTableCacheEntry *cacheEntry = GetCitusTableCacheEntry(relationId);
+	if (cacheEntry->partitionMethod != DISTRIBUTE_BY_HASH ||
+		cacheEntry->partitionColumn->varattno != column->varattno ||
+		cacheEntry->partitionColumn->vartype != column->vartype)
+	{
+		return InvalidOid;
+	}
+
+	return relationId;
+}
@@ -20,12 +20,15 @@
 #include "commands/explain.h"
 #include "commands/tablecmds.h"
 #include "optimizer/cost.h"
+#include "distributed/adaptive_executor.h"
 #include "distributed/citus_nodefuncs.h"
 #include "distributed/connection_management.h"
 #include "distributed/deparse_shard_query.h"
 #include "distributed/insert_select_planner.h"
 #include "distributed/insert_select_executor.h"
 #include "distributed/listutils.h"
+#include "distributed/local_executor.h"
+#include "distributed/metadata_cache.h"
 #include "distributed/multi_client_executor.h"
 #include "distributed/multi_executor.h"
 #include "distributed/multi_explain.h"
@@ -39,6 +42,7 @@
 #include "distributed/remote_commands.h"
 #include "distributed/recursive_planning.h"
 #include "distributed/placement_connection.h"
+#include "distributed/subplan_execution.h"
 #include "distributed/worker_protocol.h"
 #include "distributed/version_compat.h"
 #include "lib/stringinfo.h"
@@ -78,13 +82,18 @@ typedef struct RemoteExplainPlan
 
 
 /* Explain functions for distributed queries */
-static void ExplainSubPlans(DistributedPlan *distributedPlan, ExplainState *es);
-static void ExplainJob(Job *job, ExplainState *es);
+static void ExplainSubPlans(DistributedPlan *distributedPlan, List *subPlanStatsList,
+							ExplainState *es);
+static void ExplainSubPlanStats(SubPlanExecutionStats *subPlanStats, ExplainState *es);
+static void ExplainJob(Job *job, CitusScanState *scanState, ExplainState *es);
 static void ExplainMapMergeJob(MapMergeJob *mapMergeJob, ExplainState *es);
-static void ExplainTaskList(List *taskList, ExplainState *es);
+static void ExplainTaskList(List *taskList, List *taskTimingList, ExplainState *es);
+static RemoteExplainPlan * LocalExplain(Task *task, ExplainState *es);
 static RemoteExplainPlan * RemoteExplain(Task *task, ExplainState *es);
 static void ExplainTask(Task *task, int placementIndex, List *explainOutputList,
-						ExplainState *es);
+						TaskExecutionTiming *taskTiming, ExplainState *es);
+static void ExplainTaskTiming(TaskExecutionTiming *taskTiming, ExplainState *es);
+static bool ExplainExecutionTimings(ExplainState *es);
 static void ExplainTaskPlacement(ShardPlacement *taskPlacement, List *explainOutputList,
 								 ExplainState *es);
 static StringInfo BuildRemoteExplainQuery(char *queryString, ExplainState *es);
@@ -119,10 +128,10 @@ CitusExplainScan(CustomScanState *node, List *ancestors, struct ExplainState *es
 
 	if (distributedPlan->subPlanList != NIL)
 	{
-		ExplainSubPlans(distributedPlan, es);
+		ExplainSubPlans(distributedPlan, scanState->subPlanStatsList, es);
 	}
 
-	ExplainJob(distributedPlan->workerJob, es);
+	ExplainJob(distributedPlan->workerJob, scanState, es);
 
 	ExplainCloseGroup("Distributed Query", "Distributed Query", true, es);
 }
@@ -185,9 +194,13 @@ CoordinatorInsertSelectExplainScan(CustomScanState *node, List *ancestors,
  * and complex subqueries. Because the planning for these queries
  * is done along with the top-level plan, we cannot determine the
  * planning time and set it to 0.
+ *
+ * In EXPLAIN ANALYZE, the size of the result of each subplan, the nodes it
+ * was sent to and the time it took are shown as well.
  */
 static void
-ExplainSubPlans(DistributedPlan *distributedPlan, ExplainState *es)
+ExplainSubPlans(DistributedPlan *distributedPlan, List *subPlanStatsList,
+				ExplainState *es)
 {
 	ListCell *subPlanCell = NULL;
 	uint64 planId = distributedPlan->planId;
@@ -214,6 +227,21 @@ ExplainSubPlans(DistributedPlan *distributedPlan, ExplainState *es)
 
 		INSTR_TIME_SET_ZERO(planduration);
 
+		if (ExplainExecutionTimings(es))
+		{
+			char *resultId = GenerateResultId(planId, subPlan->subPlanId);
+
+			SubPlanExecutionStats *subPlanStats = NULL;
+			foreach_ptr(subPlanStats, subPlanStatsList)
+			{
+				if (strcmp(subPlanStats->resultId, resultId) == 0)
+				{
+					ExplainSubPlanStats(subPlanStats, es);
+					break;
+				}
+			}
+		}
+
 		ExplainOnePlan(plan, into, es, queryString, params, NULL, &planduration);
 
 		if (es->format == EXPLAIN_FORMAT_TEXT)
@@ -226,18 +254,51 @@ ExplainSubPlans(DistributedPlan *distributedPlan, ExplainState *es)
 }
 
 
+/*
+ * ExplainSubPlanStats shows how the result of a subplan was distributed in
+ * EXPLAIN ANALYZE.
+ */
+static void
+ExplainSubPlanStats(SubPlanExecutionStats *subPlanStats, ExplainState *es)
+{
+	if (subPlanStats->reused)
+	{
+		ExplainPropertyText("Result Destination", "Reused earlier result", es);
+	}
+	else if (subPlanStats->inlined)
+	{
+		ExplainPropertyText("Result Destination", "Inlined into task queries", es);
+	}
+	else
+	{
+		StringInfo destinationText = makeStringInfo();
+		appendStringInfo(destinationText, "%s %d nodes",
+						 subPlanStats->partitioned ? "Partitioned across" : "Sent to",
+						 subPlanStats->nodeCount);
+
+		ExplainPropertyText("Result Destination", destinationText->data, es);
+	}
+
+	ExplainPropertyInteger("Result Size", "bytes", subPlanStats->resultSize, es);
+	ExplainPropertyFloat("Subplan Execution Time", "ms", subPlanStats->executionTimeMs,
+						 3, es);
+}
+
+
 /*
  * ExplainJob shows the EXPLAIN output for a Job in the physical plan of
  * a distributed query by showing the remote EXPLAIN for the first task,
  * or all tasks if citus.explain_all_tasks is on.
  */
 static void
-ExplainJob(Job *job, ExplainState *es)
+ExplainJob(Job *job, CitusScanState *scanState, ExplainState *es)
 {
 	List *dependentJobList = job->dependentJobList;
 	int dependentJobCount = list_length(dependentJobList);
 	ListCell *dependentJobCell = NULL;
-	List *taskList = job->taskList;
+
+	/* show the task queries that read inlined results like the executor does */
+	List *taskList = InlineIntermediateResultsInJob(job);
 	int taskCount = list_length(taskList);
 
 	ExplainOpenGroup("Job", "Job", true, es);
@@ -261,6 +322,21 @@ ExplainJob(Job *job, ExplainState *es)
 		ExplainPropertyText("Tasks Shown", tasksShownText->data, es);
 	}
 
+	if (ExplainExecutionTimings(es) && scanState->finishedRemoteScan)
+	{
+		ExplainPropertyInteger("Data Received From Workers", "bytes",
+							   scanState->bytesReceived, es);
+
+		/* only shown with a memory limit, such that plans do not depend on work_mem */
+		if (MaxCoordinatorQueryMemory >= 0 && scanState->tupleStoreMemory > 0)
+		{
+			ExplainPropertyInteger("Tuple Store Memory", "kB",
+								   scanState->tupleStoreMemory, es);
+			ExplainPropertyInteger("Tuple Stores Spilled To Disk", NULL,
+								   scanState->spilledTupleStoreCount, es);
+		}
+	}
+
 	/*
 	 * We cannot fetch EXPLAIN plans for jobs that have dependencies, since the
 	 * intermediate tables have not been created.
@@ -269,7 +345,7 @@ ExplainJob(Job *job, ExplainState *es)
 	{
 		ExplainOpenGroup("Tasks", "Tasks", false, es);
 
-		ExplainTaskList(taskList, es);
+		ExplainTaskList(taskList, scanState->taskTimingList, es);
 
 		ExplainCloseGroup("Tasks", "Tasks", false, es);
 	}
@@ -349,10 +425,11 @@ ExplainMapMergeJob(MapMergeJob *mapMergeJob, ExplainState *es)
 
 /*
  * ExplainTaskList shows the remote EXPLAIN for the first task in taskList,
- * or all tasks if citus.explain_all_tasks is on.
+ * or all tasks if citus.explain_all_tasks is on. In EXPLAIN ANALYZE, the
+ * timings of the execution of the shown tasks are included.
  */
 static void
-ExplainTaskList(List *taskList, ExplainState *es)
+ExplainTaskList(List *taskList, List *taskTimingList, ExplainState *es)
 {
 	ListCell *taskCell = NULL;
 	ListCell *remoteExplainCell = NULL;
@@ -365,7 +442,12 @@ ExplainTaskList(List *taskList, ExplainState *es)
 	{
 		Task *task = (Task *) lfirst(taskCell);
 
-		RemoteExplainPlan *remoteExplain = RemoteExplain(task, es);
+		RemoteExplainPlan *remoteExplain = LocalExplain(task, es);
+		if (remoteExplain == NULL)
+		{
+			remoteExplain = RemoteExplain(task, es);
+		}
+
 		remoteExplainList = lappend(remoteExplainList, remoteExplain);
 
 		if (!ExplainAllTasks)
@@ -379,10 +461,115 @@ ExplainTaskList(List *taskList, ExplainState *es)
 		Task *task = (Task *) lfirst(taskCell);
 		RemoteExplainPlan *remoteExplain =
 			(RemoteExplainPlan *) lfirst(remoteExplainCell);
+		TaskExecutionTiming *taskTiming = NULL;
+
+		if (ExplainExecutionTimings(es))
+		{
+			TaskExecutionTiming *candidateTiming = NULL;
+			foreach_ptr(candidateTiming, taskTimingList)
+			{
+				if (candidateTiming->taskId == task->taskId)
+				{
+					taskTiming = candidateTiming;
+					break;
+				}
+			}
+		}
 
 		ExplainTask(task, remoteExplain->placementIndex,
-					remoteExplain->explainOutputList, es);
+					remoteExplain->explainOutputList, taskTiming, es);
+	}
+}
+
+
+/*
+ * LocalExplain explains a task whose first placement is on the local node
+ * by planning the query tree of the task in the current backend, which saves
+ * deparsing the query, sending it over a connection to the local node, and
+ * parsing it again. The output is the same as that of RemoteExplain.
+ *
+ * EXPLAIN ANALYZE, tasks without a query tree and tasks that local execution
+ * would not run locally are explained remotely, in which case the function
+ * returns NULL.
+ */
+static RemoteExplainPlan *
+LocalExplain(Task *task, ExplainState *es)
+{
+	Query *taskQuery = task->queryForLocalExecution;
+
+	if (es->analyze || taskQuery == NULL || taskQuery->commandType == CMD_INSERT ||
+		list_length(task->taskPlacementList) == 0)
+	{
+		return NULL;
+	}
+
+	/* keep showing the first placement, as RemoteExplain does */
+	ShardPlacement *taskPlacement = linitial(task->taskPlacementList);
+	if (taskPlacement->groupId != GetLocalGroupId() ||
+		!ShouldExecuteTasksLocally(list_make1(task)))
+	{
+		return NULL;
+	}
+
+	/* intermediate results are inlined in the remote EXPLAIN */
+	if (ContainsReadIntermediateResultFunction((Node *) taskQuery) ||
+		ContainsReadIntermediateResultArrayFunction((Node *) taskQuery))
+	{
+		return NULL;
+	}
+
+	ExplainState *localExplainState = NewExplainState();
+	localExplainState->verbose = es->verbose;
+	localExplainState->costs = es->costs;
+	localExplainState->buffers = es->buffers;
+	localExplainState->timing = es->timing;
+	localExplainState->summary = es->summary;
+	localExplainState->format = es->format;
+
+	instr_time planStart;
+	instr_time planDuration;
+
+	INSTR_TIME_SET_CURRENT(planStart);
+
+	Query *shardQuery = LocalTaskQuery(task, NULL);
+	PlannedStmt *localPlan = planner(shardQuery, CURSOR_OPT_PARALLEL_OK, NULL);
+
+	INSTR_TIME_SET_CURRENT(planDuration);
+	INSTR_TIME_SUBTRACT(planDuration, planStart);
+
+	ExplainBeginOutput(localExplainState);
+	ExplainOnePlan(localPlan, NULL, localExplainState, "", NULL, NULL, &planDuration);
+	ExplainEndOutput(localExplainState);
+
+	RemoteExplainPlan *localExplain = palloc0(sizeof(RemoteExplainPlan));
+	localExplain->placementIndex = 0;
+
+	if (localExplainState->format != EXPLAIN_FORMAT_TEXT)
+	{
+		localExplain->explainOutputList = list_make1(localExplainState->str);
+		return localExplain;
+	}
+
+	/* EXPLAIN returns a row for every line of a text plan */
+	char *lineStart = localExplainState->str->data;
+	while (*lineStart != '\0')
+	{
+		char *lineEnd = strchr(lineStart, '\n');
+		StringInfo rowString = makeStringInfo();
+
+		if (lineEnd == NULL)
+		{
+			lineEnd = lineStart + strlen(lineStart);
+		}
+
+		appendBinaryStringInfo(rowString, lineStart, lineEnd - lineStart);
+		localExplain->explainOutputList = lappend(localExplain->explainOutputList,
+												  rowString);
+
+		lineStart = (*lineEnd == '\n') ? lineEnd + 1 : lineEnd;
 	}
+
+	return localExplain;
 }
 
 
@@ -467,10 +654,12 @@ RemoteExplain(Task *task, ExplainState *es)
 /*
  * ExplainTask shows the EXPLAIN output for an single task. The output has been
  * fetched from the placement at index placementIndex. If explainOutputList is NIL,
- * then the EXPLAIN output could not be fetched from any placement.
+ * then the EXPLAIN output could not be fetched from any placement. If taskTiming
+ * is not NULL, the timings of the execution of the task are shown first.
  */
 static void
-ExplainTask(Task *task, int placementIndex, List *explainOutputList, ExplainState *es)
+ExplainTask(Task *task, int placementIndex, List *explainOutputList,
+			TaskExecutionTiming *taskTiming, ExplainState *es)
 {
 	ExplainOpenGroup("Task", NULL, true, es);
 
@@ -481,6 +670,11 @@ ExplainTask(Task *task, int placementIndex, List *explainOutputList, ExplainStat
 		es->indent += 3;
 	}
 
+	if (taskTiming != NULL)
+	{
+		ExplainTaskTiming(taskTiming, es);
+	}
+
 	if (explainOutputList != NIL)
 	{
 		List *taskPlacementList = task->taskPlacementList;
@@ -502,6 +696,45 @@ ExplainTask(Task *task, int placementIndex, List *explainOutputList, ExplainStat
 }
 
 
+/*
+ * ExplainTaskTiming shows where the time of the execution of a task was spent:
+ * waiting for a connection, waiting for a session in the worker pool, on the
+ * worker until the first result arrived, and receiving the results.
+ */
+static void
+ExplainTaskTiming(TaskExecutionTiming *taskTiming, ExplainState *es)
+{
+	StringInfo nodeAddress = makeStringInfo();
+	appendStringInfo(nodeAddress, "host=%s port=%d", taskTiming->nodeName,
+					 taskTiming->nodePort);
+
+	ExplainOpenGroup("Execution", "Execution", true, es);
+
+	ExplainPropertyText("Executed On", nodeAddress->data, es);
+	ExplainPropertyFloat("Connection Wait", "ms", taskTiming->connectionWaitMs, 3, es);
+	ExplainPropertyFloat("Queue Time", "ms", taskTiming->queueTimeMs, 3, es);
+	ExplainPropertyFloat("Remote Execution Time", "ms", taskTiming->executionTimeMs,
+						 3, es);
+	ExplainPropertyFloat("Result Transfer Time", "ms", taskTiming->transferTimeMs,
+						 3, es);
+	ExplainPropertyInteger("Data Received", "bytes", taskTiming->bytesReceived, es);
+
+	ExplainCloseGroup("Execution", "Execution", true, es);
+}
+
+
+/*
+ * ExplainExecutionTimings returns whether the timings of the distributed
+ * execution are shown, which is only the case in EXPLAIN ANALYZE with TIMING
+ * on, since they differ between runs.
+ */
+static bool
+ExplainExecutionTimings(ExplainState *es)
+{
+	return es->analyze && es->timing;
+}
+
+
 /*
  * ExplainTaskPlacement shows the EXPLAIN output for an individual task placement.
  * It corrects the indentation of the remote explain output to match the local
@@ -2,7 +2,8 @@
  *
  * multi_join_order.c
  *
- * Routines for constructing the join order list using a rule-based approach.
+ * Routines for constructing the join order list using a rule-based approach,
+ * optionally guided by the shard sizes recorded in the metadata.
  *
  * Copyright (c) Citus Data, Inc.
  *
@@ -42,6 +43,7 @@
 /* Config variables managed via guc.c */
 bool LogMultiJoinOrder = false; /* print join order as a debugging aid */
 bool EnableSingleHashRepartitioning = false;
+bool EnableCostBasedJoinOrder = false;
 
 /* Function pointer type definition for join rule evaluation functions */
 typedef JoinOrderNode *(*RuleEvalFunction) (JoinOrderNode *currentJoinNode,
@@ -62,6 +64,8 @@ static List * BestJoinOrder(List *candidateJoinOrders);
 static List * FewestOfJoinRuleType(List *candidateJoinOrders, JoinRuleType ruleType);
 static uint32 JoinRuleTypeCount(List *joinOrder, JoinRuleType ruleTypeToCount);
 static List * LatestLargeDataTransfer(List *candidateJoinOrders);
+static List * LeastRepartitionedData(List *candidateJoinOrders);
+static bool RepartitionedDataSize(List *joinOrder, uint64 *repartitionedSize);
 static void PrintJoinOrderList(List *joinOrder);
 static uint32 LargeDataTransferLocation(List *joinOrder);
 static List * TableEntryListDifference(List *lhsTableList, List *rhsTableList);
@@ -435,6 +439,18 @@ BestJoinOrder(List *candidateJoinOrders)
 	uint32 highestValidIndex = JOIN_RULE_LAST - 1;
 	uint32 candidateCount PG_USED_FOR_ASSERTS_ONLY = 0;
 
+	if (EnableCostBasedJoinOrder)
+	{
+		/* cartesian products are avoided regardless of the table sizes */
+		candidateJoinOrders = FewestOfJoinRuleType(candidateJoinOrders,
+												   CARTESIAN_PRODUCT);
+		candidateJoinOrders = FewestOfJoinRuleType(candidateJoinOrders,
+												   CARTESIAN_PRODUCT_REFERENCE_JOIN);
+
+		/* the rules below break the ties, if there are any */
+		candidateJoinOrders = LeastRepartitionedData(candidateJoinOrders);
+	}
+
 	/*
 	 * We start with the highest ranking rule type (cartesian product), and walk
 	 * over these rules in reverse order. For each rule type, we then keep join
@@ -598,6 +614,109 @@ LargeDataTransferLocation(List *joinOrder)
 }
 
 
+/*
+ * LeastRepartitionedData finds and returns the join orders that repartition
+ * the least amount of data, based on the shard sizes in the metadata. If the
+ * size of any of the tables is not known, the function returns all candidate
+ * join orders, and the rule-based heuristics decide on their own.
+ */
+static List *
+LeastRepartitionedData(List *candidateJoinOrders)
+{
+	List *leastJoinOrders = NIL;
+	uint64 leastRepartitionedSize = 0;
+
+	List *joinOrder = NIL;
+	foreach_ptr(joinOrder, candidateJoinOrders)
+	{
+		uint64 repartitionedSize = 0;
+
+		if (!RepartitionedDataSize(joinOrder, &repartitionedSize))
+		{
+			return candidateJoinOrders;
+		}
+
+		if (leastJoinOrders == NIL || repartitionedSize < leastRepartitionedSize)
+		{
+			leastJoinOrders = list_make1(joinOrder);
+			leastRepartitionedSize = repartitionedSize;
+		}
+		else if (repartitionedSize == leastRepartitionedSize)
+		{
+			leastJoinOrders = lappend(leastJoinOrders, joinOrder);
+		}
+	}
+
+	return leastJoinOrders;
+}
+
+
+/*
+ * RepartitionedDataSize estimates the number of bytes that the given join order
+ * sends over the network when repartitioning, and returns false if the size of
+ * one of the tables in the join order is not known.
+ *
+ * The size of the rows joined so far is estimated as the total size of the
+ * tables joined so far. A single partition join repartitions either the
+ * candidate table, or the tables joined so far when the candidate table is
+ * the new anchor table. A dual partition join repartitions both.
+ */
+static bool
+RepartitionedDataSize(List *joinOrder, uint64 *repartitionedSize)
+{
+	uint64 joinedSize = 0;
+
+	*repartitionedSize = 0;
+
+	JoinOrderNode *joinOrderNode = NULL;
+	foreach_ptr(joinOrderNode, joinOrder)
+	{
+		TableEntry *tableEntry = joinOrderNode->tableEntry;
+		uint64 tableSize = 0;
+
+		if (!RelationSizeFromShardStatistics(tableEntry->relationId, &tableSize))
+		{
+			return false;
+		}
+
+		switch (joinOrderNode->joinRuleType)
+		{
+			case SINGLE_HASH_PARTITION_JOIN:
+			case SINGLE_RANGE_PARTITION_JOIN:
+			{
+				if (joinOrderNode->anchorTable == tableEntry)
+				{
+					*repartitionedSize += joinedSize;
+				}
+				else
+				{
+					*repartitionedSize += tableSize;
+				}
+
+				break;
+			}
+
+			case DUAL_PARTITION_JOIN:
+			case CARTESIAN_PRODUCT:
+			{
+				*repartitionedSize += joinedSize + tableSize;
+				break;
+			}
+
+			default:
+			{
+				/* the first table and local or reference joins move no data */
+				break;
+			}
+		}
+
+		joinedSize += tableSize;
+	}
+
+	return true;
+}
+
+
 /* Prints the join order list and join rules for debugging purposes. */
 static void
 PrintJoinOrderList(List *joinOrder)
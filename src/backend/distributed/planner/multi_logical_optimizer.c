@@ -36,6 +36,7 @@
 #include "distributed/multi_logical_planner.h"
 #include "distributed/multi_physical_planner.h"
 #include "distributed/pg_dist_partition.h"
+#include "distributed/tdigest_extension.h"
 #include "distributed/worker_protocol.h"
 #include "distributed/version_compat.h"
 #include "nodes/makefuncs.h"
@@ -205,6 +206,7 @@ static void ApplyExtendedOpNodes(MultiExtendedOp *originalNode,
 								 MultiExtendedOp *workerNode);
 static void TransformSubqueryNode(MultiTable *subqueryNode, bool
 								  requiresIntermediateRowPullUp);
+static void TransformWindowSubqueryNode(MultiTable *subqueryNode);
 static MultiExtendedOp * MasterExtendedOpNode(MultiExtendedOp *originalOpNode,
 											  ExtendedOpNodeProperties *
 											  extendedOpNodeProperties);
@@ -266,6 +268,9 @@ static bool WorkerAggregateWalker(Node *node,
 static List * WorkerAggregateExpressionList(Aggref *originalAggregate,
 											WorkerAggregateWalkerContext *walkerContextry);
 static AggregateType GetAggregateType(Aggref *aggregatExpression);
+static AggregateType TDigestAggregateType(Aggref *aggregateExpression);
+static bool IsTDigestPercentileAggregate(AggregateType aggregateType);
+static Oid TDigestMasterAggregateOid(AggregateType aggregateType);
 static Oid AggregateArgumentType(Aggref *aggregate);
 static bool AggregateEnabledCustom(Aggref *aggregateExpression);
 static Oid CitusFunctionOidWithSignature(char *functionName, int numargs, Oid *argtypes);
@@ -1312,6 +1317,14 @@ ApplyExtendedOpNodes(MultiExtendedOp *originalNode, MultiExtendedOp *masterNode,
 static void
 TransformSubqueryNode(MultiTable *subqueryNode, bool requiresIntermediateRowPullUp)
 {
+	MultiExtendedOp *subqueryOpNode =
+		(MultiExtendedOp *) ChildNode((MultiUnaryNode *) subqueryNode);
+	if (subqueryOpNode->hasWindowFuncs)
+	{
+		TransformWindowSubqueryNode(subqueryNode);
+		return;
+	}
+
 	if (CoordinatorAggregationStrategy != COORDINATOR_AGGREGATION_DISABLED &&
 		RequiresIntermediateRowPullUp((MultiNode *) subqueryNode))
 	{
@@ -1381,6 +1394,105 @@ TransformSubqueryNode(MultiTable *subqueryNode, bool requiresIntermediateRowPull
 }
 
 
+/*
+ * TransformWindowSubqueryNode splits the extended operator node of a subquery
+ * with window functions into a worker operator node, which only projects the
+ * columns that the subquery uses, and a master operator node, which evaluates
+ * the window functions on these columns. We create a partition node on the
+ * column that all window functions are partitioned by and set it as the child
+ * of the master operator node, such that the rows of each window partition are
+ * repartitioned together and the window functions run in parallel.
+ */
+static void
+TransformWindowSubqueryNode(MultiTable *subqueryNode)
+{
+	const uint32 masterTableId = 1; /* only one table on master node */
+
+	MultiExtendedOp *extendedOpNode =
+		(MultiExtendedOp *) ChildNode((MultiUnaryNode *) subqueryNode);
+	MultiNode *collectNode = ChildNode((MultiUnaryNode *) extendedOpNode);
+	MultiNode *collectChildNode = ChildNode((MultiUnaryNode *) collectNode);
+
+	Var *windowPartitionColumn = WindowPartitionColumn(extendedOpNode->windowClause,
+													   extendedOpNode->targetList);
+	if (windowPartitionColumn == NULL)
+	{
+		ereport(ERROR, (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+						errmsg("cannot run this subquery"),
+						errdetail("Window functions in subqueries must all be "
+								  "partitioned by the same column")));
+	}
+
+	/* the worker operator node projects each column used by the subquery once */
+	List *workerColumnList = NIL;
+	List *originalColumnList = pull_var_clause_default(
+		(Node *) extendedOpNode->targetList);
+	Var *originalColumn = NULL;
+	foreach_ptr(originalColumn, originalColumnList)
+	{
+		workerColumnList = list_append_unique(workerColumnList, originalColumn);
+	}
+
+	List *workerTargetEntryList = NIL;
+	AttrNumber workerColumnId = 1;
+	Var *workerColumn = NULL;
+	foreach_ptr(workerColumn, workerColumnList)
+	{
+		StringInfo columnNameString = makeStringInfo();
+		appendStringInfo(columnNameString, WORKER_COLUMN_FORMAT, workerColumnId);
+
+		TargetEntry *workerTargetEntry = makeTargetEntry((Expr *) copyObject(
+															 workerColumn),
+														 workerColumnId,
+														 columnNameString->data,
+														 false);
+		workerTargetEntryList = lappend(workerTargetEntryList, workerTargetEntry);
+		workerColumnId++;
+	}
+
+	MultiExtendedOp *workerExtendedOpNode = CitusMakeNode(MultiExtendedOp);
+	workerExtendedOpNode->targetList = workerTargetEntryList;
+
+	/* the master operator node references the columns projected by the workers */
+	List *masterTargetEntryList = copyObject(extendedOpNode->targetList);
+	List *masterColumnList = pull_var_clause_default((Node *) masterTargetEntryList);
+	Var *masterColumn = NULL;
+	foreach_ptr(masterColumn, masterColumnList)
+	{
+		int columnIndex = 0;
+
+		foreach_ptr(workerColumn, workerColumnList)
+		{
+			columnIndex++;
+
+			if (equal(masterColumn, workerColumn))
+			{
+				break;
+			}
+		}
+
+		masterColumn->varno = masterTableId;
+		masterColumn->varnoold = masterTableId;
+		masterColumn->varattno = columnIndex;
+		masterColumn->varoattno = columnIndex;
+	}
+
+	MultiExtendedOp *masterExtendedOpNode = CitusMakeNode(MultiExtendedOp);
+	masterExtendedOpNode->targetList = masterTargetEntryList;
+	masterExtendedOpNode->hasWindowFuncs = extendedOpNode->hasWindowFuncs;
+	masterExtendedOpNode->windowClause = extendedOpNode->windowClause;
+
+	MultiPartition *partitionNode = CitusMakeNode(MultiPartition);
+	partitionNode->partitionColumn = windowPartitionColumn;
+
+	SetChild((MultiUnaryNode *) subqueryNode, (MultiNode *) masterExtendedOpNode);
+	SetChild((MultiUnaryNode *) masterExtendedOpNode, (MultiNode *) partitionNode);
+	SetChild((MultiUnaryNode *) partitionNode, (MultiNode *) collectNode);
+	SetChild((MultiUnaryNode *) collectNode, (MultiNode *) workerExtendedOpNode);
+	SetChild((MultiUnaryNode *) workerExtendedOpNode, (MultiNode *) collectChildNode);
+}
+
+
 /*
  * MasterExtendedOpNode creates the master extended operator node from the given
  * target entries. The function walks over these target entries; and for entries
@@ -1542,7 +1654,7 @@ MasterAggregateMutator(Node *originalNode, MasterAggregateWalkerContext *walkerC
 /*
  * MasterAggregateExpression creates the master aggregate expression using the
  * original aggregate and aggregate's type information. This function handles
- * the average, count, array_agg, hll and topn aggregates separately due to
+ * the average, count, array_agg, hll, topn and tdigest aggregates separately due to
  * differences in these aggregate functions' transformations.
  *
  * Note that this function has implicit knowledge of the transformations applied
@@ -1924,6 +2036,71 @@ MasterAggregateExpression(Aggref *originalAggregate,
 
 		newMasterExpression = (Expr *) unionAggregate;
 	}
+	else if (aggregateType == AGGREGATE_TDIGEST_COMBINE ||
+			 aggregateType == AGGREGATE_TDIGEST_ADD_DOUBLE)
+	{
+		/*
+		 * The tdigest aggregates are computed as they are on the worker nodes.
+		 * We then gather the digests on the master, and merge them with the
+		 * tdigest(tdigest) aggregate.
+		 */
+		Oid tdigestType = TDigestExtensionTypeOid();
+		Oid unionFunctionId = TDigestExtensionAggTDigest1();
+
+		Var *tdigestColumn = makeVar(masterTableId, walkerContext->columnId, tdigestType,
+									 -1, InvalidOid, columnLevelsUp);
+		walkerContext->columnId++;
+
+		TargetEntry *tdigestTargetEntry = makeTargetEntry((Expr *) tdigestColumn,
+														  argumentId, NULL, false);
+
+		Aggref *unionAggregate = makeNode(Aggref);
+		unionAggregate->aggfnoid = unionFunctionId;
+		unionAggregate->aggtype = tdigestType;
+		unionAggregate->args = list_make1(tdigestTargetEntry);
+		unionAggregate->aggkind = AGGKIND_NORMAL;
+		unionAggregate->aggfilter = NULL;
+		unionAggregate->aggtranstype = InvalidOid;
+		unionAggregate->aggargtypes = list_make1_oid(tdigestType);
+		unionAggregate->aggsplit = AGGSPLIT_SIMPLE;
+
+		newMasterExpression = (Expr *) unionAggregate;
+	}
+	else if (IsTDigestPercentileAggregate(aggregateType))
+	{
+		/*
+		 * Percentile aggregates are handled in two steps. First, we compute a
+		 * tdigest on the worker nodes. Then, we gather the digests on the master
+		 * and compute the percentiles with the variant of the original aggregate
+		 * that takes a tdigest, passing it the original quantile argument.
+		 */
+		const AttrNumber quantileArgumentId = 2;
+		Oid tdigestType = TDigestExtensionTypeOid();
+
+		Var *tdigestColumn = makeVar(masterTableId, walkerContext->columnId, tdigestType,
+									 -1, InvalidOid, columnLevelsUp);
+		walkerContext->columnId++;
+
+		TargetEntry *tdigestTargetEntry = makeTargetEntry((Expr *) tdigestColumn,
+														  argumentId, NULL, false);
+
+		/* the quantile is the last argument of all percentile aggregates */
+		TargetEntry *quantileTargetEntry = copyObject(llast(originalAggregate->args));
+		quantileTargetEntry->resno = quantileArgumentId;
+		Oid quantileType = exprType((Node *) quantileTargetEntry->expr);
+
+		Aggref *percentileAggregate = makeNode(Aggref);
+		percentileAggregate->aggfnoid = TDigestMasterAggregateOid(aggregateType);
+		percentileAggregate->aggtype = originalAggregate->aggtype;
+		percentileAggregate->args = list_make2(tdigestTargetEntry, quantileTargetEntry);
+		percentileAggregate->aggkind = AGGKIND_NORMAL;
+		percentileAggregate->aggfilter = NULL;
+		percentileAggregate->aggtranstype = InvalidOid;
+		percentileAggregate->aggargtypes = list_make2_oid(tdigestType, quantileType);
+		percentileAggregate->aggsplit = AGGSPLIT_SIMPLE;
+
+		newMasterExpression = (Expr *) percentileAggregate;
+	}
 	else if (aggregateType == AGGREGATE_CUSTOM_COMBINE)
 	{
 		HeapTuple aggTuple =
@@ -3032,6 +3209,36 @@ WorkerAggregateExpressionList(Aggref *originalAggregate,
 		workerAggregateList = lappend(workerAggregateList, sumAggregate);
 		workerAggregateList = lappend(workerAggregateList, countAggregate);
 	}
+	else if (IsTDigestPercentileAggregate(aggregateType))
+	{
+		/*
+		 * If the original aggregate computes a percentile, we want to compute
+		 * tdigest(value, compression) over raw values and tdigest(tdigest) over
+		 * digests on worker nodes. The quantile arguments are only used on the
+		 * master node.
+		 */
+		Oid tdigestType = TDigestExtensionTypeOid();
+		Aggref *tdigestAggregate = copyObject(originalAggregate);
+
+		if (list_length(originalAggregate->args) == 3)
+		{
+			tdigestAggregate->aggfnoid = TDigestExtensionAggTDigest2();
+			tdigestAggregate->args = list_truncate(tdigestAggregate->args, 2);
+			tdigestAggregate->aggargtypes = list_make2_oid(FLOAT8OID, INT4OID);
+		}
+		else
+		{
+			tdigestAggregate->aggfnoid = TDigestExtensionAggTDigest1();
+			tdigestAggregate->args = list_truncate(tdigestAggregate->args, 1);
+			tdigestAggregate->aggargtypes = list_make1_oid(tdigestType);
+		}
+
+		tdigestAggregate->aggtype = tdigestType;
+		tdigestAggregate->aggtranstype = InvalidOid;
+		tdigestAggregate->aggsplit = AGGSPLIT_SIMPLE;
+
+		workerAggregateList = lappend(workerAggregateList, tdigestAggregate);
+	}
 	else if (aggregateType == AGGREGATE_CUSTOM_COMBINE)
 	{
 		HeapTuple aggTuple =
@@ -3139,6 +3346,15 @@ GetAggregateType(Aggref *aggregateExpression)
 		}
 	}
 
+	if (IsTDigestAggregateName(aggregateProcName))
+	{
+		AggregateType tdigestAggregateType = TDigestAggregateType(aggregateExpression);
+		if (tdigestAggregateType != AGGREGATE_INVALID_FIRST)
+		{
+			return tdigestAggregateType;
+		}
+	}
+
 	if (AggregateEnabledCustom(aggregateExpression))
 	{
 		return AGGREGATE_CUSTOM_COMBINE;
@@ -3155,6 +3371,147 @@ GetAggregateType(Aggref *aggregateExpression)
 }
 
 
+/*
+ * TDigestAggregateType matches the given aggregate against the aggregates of
+ * the tdigest extension, and returns the corresponding aggregate type. The
+ * function returns AGGREGATE_INVALID_FIRST if the aggregate is not one of them,
+ * or if it is used in a form that we cannot split into worker and master parts.
+ */
+static AggregateType
+TDigestAggregateType(Aggref *aggregateExpression)
+{
+	Oid aggFunctionId = aggregateExpression->aggfnoid;
+	List *argumentList = aggregateExpression->args;
+
+	if (aggregateExpression->aggdistinct != NIL || aggregateExpression->aggorder != NIL)
+	{
+		return AGGREGATE_INVALID_FIRST;
+	}
+
+	/*
+	 * The compression argument ends up in the worker query and the quantile
+	 * argument in the master query, so neither of them can refer to columns.
+	 */
+	TargetEntry *argument = NULL;
+	foreach_ptr(argument, argumentList)
+	{
+		if (argument != linitial(argumentList) &&
+			contain_var_clause((Node *) argument->expr))
+		{
+			return AGGREGATE_INVALID_FIRST;
+		}
+	}
+
+	int argumentCount = list_length(argumentList);
+	if (argumentCount == 1)
+	{
+		if (aggFunctionId == TDigestExtensionAggTDigest1())
+		{
+			return AGGREGATE_TDIGEST_COMBINE;
+		}
+	}
+	else if (argumentCount == 2)
+	{
+		if (aggFunctionId == TDigestExtensionAggTDigest2())
+		{
+			return AGGREGATE_TDIGEST_ADD_DOUBLE;
+		}
+		else if (aggFunctionId == TDigestExtensionAggTDigestPercentile2())
+		{
+			return AGGREGATE_TDIGEST_PERCENTILE_TDIGEST_DOUBLE;
+		}
+		else if (aggFunctionId == TDigestExtensionAggTDigestPercentile2a())
+		{
+			return AGGREGATE_TDIGEST_PERCENTILE_TDIGEST_DOUBLEARRAY;
+		}
+		else if (aggFunctionId == TDigestExtensionAggTDigestPercentileOf2())
+		{
+			return AGGREGATE_TDIGEST_PERCENTILE_OF_TDIGEST_DOUBLE;
+		}
+		else if (aggFunctionId == TDigestExtensionAggTDigestPercentileOf2a())
+		{
+			return AGGREGATE_TDIGEST_PERCENTILE_OF_TDIGEST_DOUBLEARRAY;
+		}
+	}
+	else if (argumentCount == 3)
+	{
+		if (aggFunctionId == TDigestExtensionAggTDigestPercentile3())
+		{
+			return AGGREGATE_TDIGEST_PERCENTILE_ADD_DOUBLE;
+		}
+		else if (aggFunctionId == TDigestExtensionAggTDigestPercentile3a())
+		{
+			return AGGREGATE_TDIGEST_PERCENTILE_ADD_DOUBLEARRAY;
+		}
+		else if (aggFunctionId == TDigestExtensionAggTDigestPercentileOf3())
+		{
+			return AGGREGATE_TDIGEST_PERCENTILE_OF_ADD_DOUBLE;
+		}
+		else if (aggFunctionId == TDigestExtensionAggTDigestPercentileOf3a())
+		{
+			return AGGREGATE_TDIGEST_PERCENTILE_OF_ADD_DOUBLEARRAY;
+		}
+	}
+
+	return AGGREGATE_INVALID_FIRST;
+}
+
+
+/*
+ * IsTDigestPercentileAggregate returns whether the given aggregate type is one
+ * of the tdigest_percentile() or tdigest_percentile_of() aggregates.
+ */
+static bool
+IsTDigestPercentileAggregate(AggregateType aggregateType)
+{
+	return aggregateType >= AGGREGATE_TDIGEST_PERCENTILE_ADD_DOUBLE &&
+		   aggregateType <= AGGREGATE_TDIGEST_PERCENTILE_OF_TDIGEST_DOUBLEARRAY;
+}
+
+
+/*
+ * TDigestMasterAggregateOid returns the oid of the aggregate that computes the
+ * given percentile aggregate's result from the tdigests gathered on the master.
+ * These are the variants of the aggregate that take a tdigest as their input.
+ */
+static Oid
+TDigestMasterAggregateOid(AggregateType aggregateType)
+{
+	switch (aggregateType)
+	{
+		case AGGREGATE_TDIGEST_PERCENTILE_ADD_DOUBLE:
+		case AGGREGATE_TDIGEST_PERCENTILE_TDIGEST_DOUBLE:
+		{
+			return TDigestExtensionAggTDigestPercentile2();
+		}
+
+		case AGGREGATE_TDIGEST_PERCENTILE_ADD_DOUBLEARRAY:
+		case AGGREGATE_TDIGEST_PERCENTILE_TDIGEST_DOUBLEARRAY:
+		{
+			return TDigestExtensionAggTDigestPercentile2a();
+		}
+
+		case AGGREGATE_TDIGEST_PERCENTILE_OF_ADD_DOUBLE:
+		case AGGREGATE_TDIGEST_PERCENTILE_OF_TDIGEST_DOUBLE:
+		{
+			return TDigestExtensionAggTDigestPercentileOf2();
+		}
+
+		case AGGREGATE_TDIGEST_PERCENTILE_OF_ADD_DOUBLEARRAY:
+		case AGGREGATE_TDIGEST_PERCENTILE_OF_TDIGEST_DOUBLEARRAY:
+		{
+			return TDigestExtensionAggTDigestPercentileOf2a();
+		}
+
+		default:
+		{
+			ereport(ERROR, (errmsg("unrecognized tdigest aggregate type: %d",
+								   aggregateType)));
+		}
+	}
+}
+
+
 /* Extracts the type of the argument over which the aggregate is operating. */
 static Oid
 AggregateArgumentType(Aggref *aggregate)
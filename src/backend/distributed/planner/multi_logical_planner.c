@@ -18,6 +18,7 @@
 #include "access/nbtree.h"
 #include "catalog/pg_am.h"
 #include "catalog/pg_class.h"
+#include "catalog/pg_namespace.h"
 #include "commands/defrem.h"
 #include "distributed/citus_clauses.h"
 #include "distributed/colocation_utils.h"
@@ -31,6 +32,7 @@
 #include "distributed/query_pushdown_planning.h"
 #include "distributed/query_utils.h"
 #include "distributed/multi_router_planner.h"
+#include "distributed/multi_server_executor.h"
 #include "distributed/worker_protocol.h"
 #include "distributed/version_compat.h"
 #include "nodes/makefuncs.h"
@@ -45,6 +47,7 @@
 #include "optimizer/clauses.h"
 #include "optimizer/prep.h"
 #include "optimizer/tlist.h"
+#include "parser/parse_oper.h"
 #include "parser/parsetree.h"
 #include "utils/builtins.h"
 #include "utils/datum.h"
@@ -69,6 +72,18 @@ typedef MultiNode *(*RuleApplyFunction) (MultiNode *leftNode, MultiNode *rightNo
 
 static RuleApplyFunction RuleApplyFunctionArray[JOIN_RULE_LAST] = { 0 }; /* join rules */
 
+/*
+ * GUC, whether queries that group a single distributed table by another column
+ * finalize their aggregates on the workers after repartitioning on that column
+ */
+bool EnableRepartitionedGroupBy = false;
+
+/*
+ * GUC, whether count(distinct) on a column other than the distribution column
+ * is computed exactly on the workers after repartitioning on that column
+ */
+bool EnableRepartitionedCountDistinct = false;
+
 /* Local functions forward declarations */
 static bool AllTargetExpressionsAreColumnReferences(List *targetEntryList);
 static FieldSelect * CompositeFieldRecursive(Expr *expression, Query *query);
@@ -91,6 +106,18 @@ static MultiNode * MultiJoinTree(List *joinOrderList, List *collectTableList,
 static MultiCollect * CollectNodeForTable(List *collectTableList, uint32 rangeTableId);
 static MultiSelect * MultiSelectNode(List *whereClauseList);
 static bool IsSelectClause(Node *clause);
+static MultiNode * MultiNodeTreeInternal(Query *queryTree, bool repartitionSubquery);
+static DeferredErrorMessage * DeferErrorIfQueryNotSupportedInternal(Query *queryTree,
+																	bool
+																	repartitionSubquery);
+static bool RepartitionableWindowFunctions(Query *queryTree);
+static bool ShouldRepartitionGroupBy(Query *queryTree);
+static Query * WrapGroupByInRepartitionSubquery(Query *queryTree);
+static bool ShouldRepartitionCountDistinct(Query *queryTree);
+static Var * CountDistinctColumn(List *targetEntryList);
+static Query * WrapCountDistinctInRepartitionSubquery(Query *queryTree,
+													  Var *distinctColumn);
+static Node * ReplaceCountDistinctMutator(Node *node, Var *subqueryColumn);
 
 /* Local functions forward declarations for applying joins */
 static MultiNode * ApplyJoinRule(MultiNode *leftNode, MultiNode *rightNode,
@@ -152,6 +179,20 @@ MultiLogicalPlanCreate(Query *originalQuery, Query *queryTree,
 		multiQueryNode = SubqueryMultiNodeTree(originalQuery, queryTree,
 											   plannerRestrictionContext);
 	}
+	else if (ShouldRepartitionGroupBy(queryTree))
+	{
+		Query *repartitionQuery = WrapGroupByInRepartitionSubquery(queryTree);
+
+		multiQueryNode = MultiNodeTree(repartitionQuery);
+	}
+	else if (ShouldRepartitionCountDistinct(queryTree))
+	{
+		Var *distinctColumn = CountDistinctColumn(queryTree->targetList);
+		Query *repartitionQuery = WrapCountDistinctInRepartitionSubquery(queryTree,
+																		 distinctColumn);
+
+		multiQueryNode = MultiNodeTree(repartitionQuery);
+	}
 	else
 	{
 		multiQueryNode = MultiNodeTree(queryTree);
@@ -165,6 +206,392 @@ MultiLogicalPlanCreate(Query *originalQuery, Query *queryTree,
 }
 
 
+/*
+ * ShouldRepartitionGroupBy returns true if the given query groups a single
+ * distributed table by a column other than its distribution column and
+ * citus.enable_repartitioned_group_by is enabled. Such queries would otherwise
+ * combine the partial aggregates of all groups on the coordinator. Instead, we
+ * plan them as a repartitioned subquery, which sends the partial aggregates of
+ * each group to one of the workers and finalizes them there in parallel.
+ */
+static bool
+ShouldRepartitionGroupBy(Query *queryTree)
+{
+	List *rangeTableIndexList = NIL;
+
+	if (!EnableRepartitionedGroupBy)
+	{
+		return false;
+	}
+
+	/* repartitioned subqueries run as map-merge jobs */
+	if (TaskExecutorType != MULTI_EXECUTOR_TASK_TRACKER && !EnableRepartitionJoins)
+	{
+		return false;
+	}
+
+	if (queryTree->commandType != CMD_SELECT || !queryTree->hasAggs ||
+		queryTree->groupClause == NIL || queryTree->groupingSets != NIL ||
+		queryTree->hasWindowFuncs || queryTree->hasSubLinks ||
+		queryTree->hasTargetSRFs || queryTree->setOperations != NULL ||
+		queryTree->cteList != NIL || queryTree->rowMarks != NIL)
+	{
+		return false;
+	}
+
+	ExtractRangeTableIndexWalker((Node *) queryTree->jointree, &rangeTableIndexList);
+	if (list_length(rangeTableIndexList) != 1)
+	{
+		return false;
+	}
+
+	int rangeTableIndex = linitial_int(rangeTableIndexList);
+	RangeTblEntry *rangeTableEntry = rt_fetch(rangeTableIndex, queryTree->rtable);
+	if (rangeTableEntry->rtekind != RTE_RELATION ||
+		!IsCitusTable(rangeTableEntry->relid) ||
+		PartitionMethod(rangeTableEntry->relid) == DISTRIBUTE_BY_NONE)
+	{
+		return false;
+	}
+
+	List *groupTargetEntryList = GroupTargetEntryList(queryTree->groupClause,
+													  queryTree->targetList);
+
+	/* we repartition on the first group by expression */
+	TargetEntry *groupByTargetEntry = (TargetEntry *) linitial(groupTargetEntryList);
+	if (!IsA(groupByTargetEntry->expr, Var) && !IsA(groupByTargetEntry->expr, FuncExpr))
+	{
+		return false;
+	}
+
+	/* groups on the distribution column are already finalized on the workers */
+	Var *partitionColumn = PartitionColumn(rangeTableEntry->relid, rangeTableIndex);
+	if (partitionColumn != NULL &&
+		tlist_member((Expr *) partitionColumn, groupTargetEntryList) != NULL)
+	{
+		return false;
+	}
+
+	return true;
+}
+
+
+/*
+ * WrapGroupByInRepartitionSubquery moves the aggregates, GROUP BY and HAVING
+ * clauses of the given query into a subquery, and keeps the ORDER BY, DISTINCT
+ * and LIMIT clauses in an outer query that selects all columns of the
+ * subquery. The subquery is then planned as a repartitioned subquery, which
+ * leaves only the final rows to be processed on the coordinator.
+ */
+static Query *
+WrapGroupByInRepartitionSubquery(Query *queryTree)
+{
+	Query *subquery = copyObject(queryTree);
+	List *columnNameList = NIL;
+	List *outerTargetList = NIL;
+
+	subquery->sortClause = NIL;
+	subquery->distinctClause = NIL;
+	subquery->hasDistinctOn = false;
+	subquery->limitCount = NULL;
+	subquery->limitOffset = NULL;
+
+	TargetEntry *targetEntry = NULL;
+	foreach_ptr(targetEntry, subquery->targetList)
+	{
+		/* the outer query references each target entry of the subquery */
+		const Index subqueryTableId = 1;
+		Var *column = makeVarFromTargetEntry(subqueryTableId, targetEntry);
+		char *columnName = targetEntry->resname;
+
+		if (columnName == NULL)
+		{
+			columnName = "?column?";
+		}
+
+		TargetEntry *outerTargetEntry = makeTargetEntry((Expr *) column,
+														targetEntry->resno,
+														columnName,
+														targetEntry->resjunk);
+		outerTargetEntry->ressortgroupref = targetEntry->ressortgroupref;
+		outerTargetList = lappend(outerTargetList, outerTargetEntry);
+
+		columnNameList = lappend(columnNameList, makeString(columnName));
+
+		/* columns that are only used for sorting are also returned by the subquery */
+		targetEntry->resjunk = false;
+	}
+
+	RangeTblEntry *subqueryRangeTableEntry = makeNode(RangeTblEntry);
+	subqueryRangeTableEntry->rtekind = RTE_SUBQUERY;
+	subqueryRangeTableEntry->subquery = subquery;
+	subqueryRangeTableEntry->alias = makeAlias("repartitioned_subquery", NIL);
+	subqueryRangeTableEntry->eref = makeAlias("repartitioned_subquery",
+											  columnNameList);
+	subqueryRangeTableEntry->inFromCl = true;
+
+	RangeTblRef *subqueryRangeTableRef = makeNode(RangeTblRef);
+	subqueryRangeTableRef->rtindex = 1;
+
+	Query *outerQuery = makeNode(Query);
+	outerQuery->commandType = CMD_SELECT;
+	outerQuery->querySource = QSRC_ORIGINAL;
+	outerQuery->canSetTag = true;
+	outerQuery->rtable = list_make1(subqueryRangeTableEntry);
+	outerQuery->jointree = makeFromExpr(list_make1(subqueryRangeTableRef), NULL);
+	outerQuery->targetList = outerTargetList;
+	outerQuery->sortClause = queryTree->sortClause;
+	outerQuery->distinctClause = queryTree->distinctClause;
+	outerQuery->hasDistinctOn = queryTree->hasDistinctOn;
+	outerQuery->limitCount = queryTree->limitCount;
+	outerQuery->limitOffset = queryTree->limitOffset;
+
+	return outerQuery;
+}
+
+
+/*
+ * ShouldRepartitionCountDistinct returns true if the given query computes
+ * count(distinct) on a column other than the distribution column of a single
+ * distributed table without a GROUP BY, and
+ * citus.enable_repartitioned_count_distinct is enabled. Such queries would
+ * otherwise pull the distinct values of all shards to the coordinator.
+ * Queries with a GROUP BY are covered by citus.enable_repartitioned_group_by.
+ */
+static bool
+ShouldRepartitionCountDistinct(Query *queryTree)
+{
+	List *rangeTableIndexList = NIL;
+
+	if (!EnableRepartitionedCountDistinct)
+	{
+		return false;
+	}
+
+	/* approximations are cheaper than an exact count and were asked for */
+	if (CountDistinctErrorRate != DISABLE_DISTINCT_APPROXIMATION)
+	{
+		return false;
+	}
+
+	/* repartitioned subqueries run as map-merge jobs */
+	if (TaskExecutorType != MULTI_EXECUTOR_TASK_TRACKER && !EnableRepartitionJoins)
+	{
+		return false;
+	}
+
+	if (queryTree->commandType != CMD_SELECT || !queryTree->hasAggs ||
+		queryTree->groupClause != NIL || queryTree->groupingSets != NIL ||
+		queryTree->havingQual != NULL ||
+		queryTree->hasWindowFuncs || queryTree->hasSubLinks ||
+		queryTree->hasTargetSRFs || queryTree->setOperations != NULL ||
+		queryTree->cteList != NIL || queryTree->rowMarks != NIL)
+	{
+		return false;
+	}
+
+	ExtractRangeTableIndexWalker((Node *) queryTree->jointree, &rangeTableIndexList);
+	if (list_length(rangeTableIndexList) != 1)
+	{
+		return false;
+	}
+
+	int rangeTableIndex = linitial_int(rangeTableIndexList);
+	RangeTblEntry *rangeTableEntry = rt_fetch(rangeTableIndex, queryTree->rtable);
+	if (rangeTableEntry->rtekind != RTE_RELATION ||
+		!IsCitusTable(rangeTableEntry->relid) ||
+		PartitionMethod(rangeTableEntry->relid) == DISTRIBUTE_BY_NONE)
+	{
+		return false;
+	}
+
+	Var *distinctColumn = CountDistinctColumn(queryTree->targetList);
+	if (distinctColumn == NULL)
+	{
+		return false;
+	}
+
+	/* distinct values of the distribution column are already counted per shard */
+	Var *partitionColumn = PartitionColumn(rangeTableEntry->relid, rangeTableIndex);
+	if (partitionColumn != NULL && distinctColumn->varattno == partitionColumn->varattno)
+	{
+		return false;
+	}
+
+	return true;
+}
+
+
+/*
+ * CountDistinctColumn returns the column that all aggregates in the given
+ * target list count the distinct values of, or NULL if the target list has
+ * other aggregates or count(distinct) on different columns or expressions.
+ */
+static Var *
+CountDistinctColumn(List *targetEntryList)
+{
+	Var *distinctColumn = NULL;
+
+	List *expressionList = pull_var_clause((Node *) targetEntryList,
+										   PVC_INCLUDE_AGGREGATES);
+	Node *expression = NULL;
+	foreach_ptr(expression, expressionList)
+	{
+		if (!IsA(expression, Aggref))
+		{
+			return NULL;
+		}
+
+		Aggref *aggregate = (Aggref *) expression;
+		if (aggregate->aggdistinct == NIL || aggregate->aggfilter != NULL ||
+			list_length(aggregate->args) != 1 ||
+			get_func_namespace(aggregate->aggfnoid) != PG_CATALOG_NAMESPACE ||
+			strncmp(get_func_name(aggregate->aggfnoid), "count", NAMEDATALEN) != 0)
+		{
+			return NULL;
+		}
+
+		TargetEntry *argumentEntry = (TargetEntry *) linitial(aggregate->args);
+		if (!IsA(argumentEntry->expr, Var) ||
+			((Var *) argumentEntry->expr)->varlevelsup != 0)
+		{
+			return NULL;
+		}
+
+		Var *argumentColumn = (Var *) argumentEntry->expr;
+		if (distinctColumn == NULL)
+		{
+			distinctColumn = argumentColumn;
+		}
+		else if (!equal(distinctColumn, argumentColumn))
+		{
+			return NULL;
+		}
+	}
+
+	return distinctColumn;
+}
+
+
+/*
+ * WrapCountDistinctInRepartitionSubquery rewrites a query that counts the
+ * distinct values of the given column into a subquery that groups by that
+ * column, and an outer query that counts the rows of the subquery instead.
+ * The subquery is then planned as a repartitioned subquery: the workers
+ * repartition the values of each shard by the column, deduplicate each
+ * partition in parallel, count the distinct values of their partitions and
+ * the coordinator only sums these counts. NULLs end up in their own group and
+ * are skipped by the outer count, as in count(distinct).
+ */
+static Query *
+WrapCountDistinctInRepartitionSubquery(Query *queryTree, Var *distinctColumn)
+{
+	Query *subquery = copyObject(queryTree);
+	Oid sortOperatorId = InvalidOid;
+	Oid equalityOperatorId = InvalidOid;
+	bool hashable = false;
+	const Index subqueryTableId = 1;
+	const Index groupReference = 1;
+
+	/* the repartitioned subquery plan requires an aggregate in the subquery */
+	List *aggregateList = pull_var_clause((Node *) queryTree->targetList,
+										  PVC_INCLUDE_AGGREGATES);
+	Aggref *countAggregate = (Aggref *) copyObject(linitial(aggregateList));
+	countAggregate->aggdistinct = NIL;
+
+	TargetEntry *columnTargetEntry = makeTargetEntry((Expr *) copyObject(
+														 distinctColumn), 1,
+													 "distinct_column", false);
+	columnTargetEntry->ressortgroupref = groupReference;
+
+	TargetEntry *countTargetEntry = makeTargetEntry((Expr *) countAggregate, 2,
+													"count", false);
+
+	get_sort_group_operators(distinctColumn->vartype, true, true, false,
+							 &sortOperatorId, &equalityOperatorId, NULL, &hashable);
+
+	SortGroupClause *groupClause = makeNode(SortGroupClause);
+	groupClause->tleSortGroupRef = groupReference;
+	groupClause->eqop = equalityOperatorId;
+	groupClause->sortop = sortOperatorId;
+	groupClause->nulls_first = false;
+	groupClause->hashable = hashable;
+
+	subquery->targetList = list_make2(columnTargetEntry, countTargetEntry);
+	subquery->groupClause = list_make1(groupClause);
+	subquery->sortClause = NIL;
+	subquery->distinctClause = NIL;
+	subquery->hasDistinctOn = false;
+	subquery->limitCount = NULL;
+	subquery->limitOffset = NULL;
+
+	RangeTblEntry *subqueryRangeTableEntry = makeNode(RangeTblEntry);
+	subqueryRangeTableEntry->rtekind = RTE_SUBQUERY;
+	subqueryRangeTableEntry->subquery = subquery;
+	subqueryRangeTableEntry->alias = makeAlias("repartitioned_subquery", NIL);
+	subqueryRangeTableEntry->eref =
+		makeAlias("repartitioned_subquery",
+				  list_make2(makeString("distinct_column"), makeString("count")));
+	subqueryRangeTableEntry->inFromCl = true;
+
+	RangeTblRef *subqueryRangeTableRef = makeNode(RangeTblRef);
+	subqueryRangeTableRef->rtindex = subqueryTableId;
+
+	/* the outer query counts the groups where it counted distinct values */
+	Var *subqueryColumn = makeVarFromTargetEntry(subqueryTableId, columnTargetEntry);
+	List *outerTargetList =
+		(List *) ReplaceCountDistinctMutator((Node *) queryTree->targetList,
+											 subqueryColumn);
+
+	Query *outerQuery = makeNode(Query);
+	outerQuery->commandType = CMD_SELECT;
+	outerQuery->querySource = QSRC_ORIGINAL;
+	outerQuery->canSetTag = true;
+	outerQuery->hasAggs = true;
+	outerQuery->rtable = list_make1(subqueryRangeTableEntry);
+	outerQuery->jointree = makeFromExpr(list_make1(subqueryRangeTableRef), NULL);
+	outerQuery->targetList = outerTargetList;
+	outerQuery->sortClause = queryTree->sortClause;
+	outerQuery->distinctClause = queryTree->distinctClause;
+	outerQuery->hasDistinctOn = queryTree->hasDistinctOn;
+	outerQuery->limitCount = queryTree->limitCount;
+	outerQuery->limitOffset = queryTree->limitOffset;
+
+	return outerQuery;
+}
+
+
+/*
+ * ReplaceCountDistinctMutator replaces the count(distinct) aggregates in the
+ * given expression with a count of the given column of the subquery that
+ * WrapCountDistinctInRepartitionSubquery created.
+ */
+static Node *
+ReplaceCountDistinctMutator(Node *node, Var *subqueryColumn)
+{
+	if (node == NULL)
+	{
+		return NULL;
+	}
+
+	if (IsA(node, Aggref))
+	{
+		Aggref *countAggregate = (Aggref *) copyObject(node);
+		TargetEntry *argumentEntry = makeTargetEntry((Expr *) copyObject(
+														 subqueryColumn), 1,
+													 NULL, false);
+
+		countAggregate->args = list_make1(argumentEntry);
+		countAggregate->aggdistinct = NIL;
+
+		return (Node *) countAggregate;
+	}
+
+	return expression_tree_mutator(node, ReplaceCountDistinctMutator,
+								   (void *) subqueryColumn);
+}
+
+
 /*
  * FindNodeCheck finds a node for which the check function returns true.
  *
@@ -206,7 +633,7 @@ FindNodeCheck(Node *node, bool (*check)(Node *))
  *   - Only a single RTE_RELATION exists, which means only a single table
  *     name is specified on the whole query
  *   - No sublinks exists in the subquery
- *   - No window functions in the subquery
+ *   - Window functions in the subquery are partitioned by a common column
  *
  * Note that the caller should still call DeferErrorIfUnsupportedSubqueryRepartition()
  * to ensure that Citus supports the subquery. Also, this function is designed to run
@@ -224,8 +651,11 @@ SingleRelationRepartitionSubquery(Query *queryTree)
 		return false;
 	}
 
-	/* we don't support window functions */
-	if (queryTree->hasWindowFuncs)
+	/*
+	 * We only support window functions that are all partitioned by the same
+	 * column, which we can repartition the rows by.
+	 */
+	if (queryTree->hasWindowFuncs && !RepartitionableWindowFunctions(queryTree))
 	{
 		return false;
 	}
@@ -649,6 +1079,19 @@ SubqueryEntryList(Query *queryTree)
  */
 MultiNode *
 MultiNodeTree(Query *queryTree)
+{
+	return MultiNodeTreeInternal(queryTree, false);
+}
+
+
+/*
+ * MultiNodeTreeInternal builds the logical plan tree for MultiNodeTree(). The
+ * repartitionSubquery flag is set for subqueries that are planned by
+ * repartitioning their results, whose window functions are evaluated after
+ * the rows are repartitioned by the PARTITION BY column.
+ */
+static MultiNode *
+MultiNodeTreeInternal(Query *queryTree, bool repartitionSubquery)
 {
 	List *rangeTableList = queryTree->rtable;
 	List *targetEntryList = queryTree->targetList;
@@ -661,8 +1104,8 @@ MultiNodeTree(Query *queryTree)
 	MultiNode *currentTopNode = NULL;
 
 	/* verify we can perform distributed planning on this query */
-	DeferredErrorMessage *unsupportedQueryError = DeferErrorIfQueryNotSupported(
-		queryTree);
+	DeferredErrorMessage *unsupportedQueryError =
+		DeferErrorIfQueryNotSupportedInternal(queryTree, repartitionSubquery);
 	if (unsupportedQueryError != NULL)
 	{
 		RaiseDeferredError(unsupportedQueryError, ERROR);
@@ -723,7 +1166,7 @@ MultiNodeTree(Query *queryTree)
 		}
 
 		/* recursively create child nested multitree */
-		MultiNode *subqueryExtendedNode = MultiNodeTree(subqueryTree);
+		MultiNode *subqueryExtendedNode = MultiNodeTreeInternal(subqueryTree, true);
 
 		SetChild((MultiUnaryNode *) subqueryCollectNode, (MultiNode *) subqueryNode);
 		SetChild((MultiUnaryNode *) subqueryNode, subqueryExtendedNode);
@@ -920,6 +1363,19 @@ FindIntermediateResultIdIfExists(RangeTblEntry *rte)
  */
 DeferredErrorMessage *
 DeferErrorIfQueryNotSupported(Query *queryTree)
+{
+	return DeferErrorIfQueryNotSupportedInternal(queryTree, false);
+}
+
+
+/*
+ * DeferErrorIfQueryNotSupportedInternal implements DeferErrorIfQueryNotSupported().
+ * Window functions that cannot be pushed down are allowed in subqueries that are
+ * repartitioned, since DeferErrorIfUnsupportedSubqueryRepartition() already
+ * checked that they can be evaluated after the repartitioning.
+ */
+static DeferredErrorMessage *
+DeferErrorIfQueryNotSupportedInternal(Query *queryTree, bool repartitionSubquery)
 {
 	char *errorMessage = NULL;
 	bool preconditionsSatisfied = true;
@@ -942,7 +1398,7 @@ DeferErrorIfQueryNotSupported(Query *queryTree)
 		errorHint = filterHint;
 	}
 
-	if (queryTree->hasWindowFuncs &&
+	if (queryTree->hasWindowFuncs && !repartitionSubquery &&
 		!SafeToPushdownWindowFunction(queryTree, &errorInfo))
 	{
 		preconditionsSatisfied = false;
@@ -1150,16 +1606,43 @@ DeferErrorIfUnsupportedSubqueryRepartition(Query *subqueryTree)
 	bool preconditionsSatisfied = true;
 	List *joinTreeTableIndexList = NIL;
 
-	if (!subqueryTree->hasAggs)
+	if (subqueryTree->hasWindowFuncs)
 	{
-		preconditionsSatisfied = false;
-		errorDetail = "Subqueries without aggregates are not supported yet";
-	}
+		/* window functions are evaluated after repartitioning on their own */
+		if (subqueryTree->hasAggs || subqueryTree->groupClause != NIL)
+		{
+			preconditionsSatisfied = false;
+			errorDetail = "Subqueries with window functions and aggregates are "
+						  "not supported yet";
+		}
 
-	if (subqueryTree->groupClause == NIL)
+		if (subqueryTree->distinctClause != NIL)
+		{
+			preconditionsSatisfied = false;
+			errorDetail = "Subqueries with window functions and distinct are "
+						  "not supported yet";
+		}
+
+		if (!RepartitionableWindowFunctions(subqueryTree))
+		{
+			preconditionsSatisfied = false;
+			errorDetail = "Window functions in subqueries must all be partitioned "
+						  "by the same column";
+		}
+	}
+	else
 	{
-		preconditionsSatisfied = false;
-		errorDetail = "Subqueries without group by clause are not supported yet";
+		if (!subqueryTree->hasAggs)
+		{
+			preconditionsSatisfied = false;
+			errorDetail = "Subqueries without aggregates are not supported yet";
+		}
+
+		if (subqueryTree->groupClause == NIL)
+		{
+			preconditionsSatisfied = false;
+			errorDetail = "Subqueries without group by clause are not supported yet";
+		}
 	}
 
 	if (subqueryTree->sortClause != NULL)
@@ -1218,6 +1701,74 @@ DeferErrorIfUnsupportedSubqueryRepartition(Query *subqueryTree)
 }
 
 
+/*
+ * RepartitionableWindowFunctions returns true if all window functions of the
+ * given query are partitioned by a common column, and the query can therefore
+ * be evaluated after repartitioning its rows by that column.
+ */
+static bool
+RepartitionableWindowFunctions(Query *queryTree)
+{
+	Var *partitionColumn = WindowPartitionColumn(queryTree->windowClause,
+												 queryTree->targetList);
+
+	return partitionColumn != NULL;
+}
+
+
+/*
+ * WindowPartitionColumn returns a column that appears in the PARTITION BY
+ * clause of each of the given window clauses, or NULL if there is no such
+ * column. Rows that agree on the returned column fall into the same window
+ * partition for every window function.
+ */
+Var *
+WindowPartitionColumn(List *windowClauseList, List *targetEntryList)
+{
+	if (windowClauseList == NIL)
+	{
+		return NULL;
+	}
+
+	WindowClause *firstWindowClause = (WindowClause *) linitial(windowClauseList);
+	List *firstPartitionTargetList = GroupTargetEntryList(
+		firstWindowClause->partitionClause, targetEntryList);
+
+	TargetEntry *firstPartitionTargetEntry = NULL;
+	foreach_ptr(firstPartitionTargetEntry, firstPartitionTargetList)
+	{
+		Expr *partitionExpression = firstPartitionTargetEntry->expr;
+		bool partitionedByColumn = true;
+
+		if (!IsA(partitionExpression, Var) ||
+			((Var *) partitionExpression)->varlevelsup != 0)
+		{
+			continue;
+		}
+
+		WindowClause *windowClause = NULL;
+		foreach_ptr(windowClause, windowClauseList)
+		{
+			List *partitionTargetList = GroupTargetEntryList(
+				windowClause->partitionClause, targetEntryList);
+
+			if (!tlist_member(partitionExpression, partitionTargetList))
+			{
+				partitionedByColumn = false;
+				break;
+			}
+		}
+
+		if (partitionedByColumn)
+		{
+			return (Var *) partitionExpression;
+		}
+	}
+
+	return NULL;
+}
+
+
 /*
  * HasComplexRangeTableType checks if the given query tree contains any complex
  * range table types. For this, the function walks over all range tables in the
@@ -14,7 +14,9 @@
 #include "postgres.h"
 
 #include "catalog/pg_type.h"
+#include "distributed/citus_custom_scan.h"
 #include "distributed/citus_ruleutils.h"
+#include "distributed/distributed_planner.h"
 #include "distributed/listutils.h"
 #include "distributed/metadata_cache.h"
 #include "distributed/multi_master_planner.h"
@@ -22,6 +24,7 @@
 #include "nodes/makefuncs.h"
 #include "nodes/nodeFuncs.h"
 #include "optimizer/planner.h"
+#include "optimizer/tlist.h"
 #include "rewrite/rewriteManip.h"
 
 static List * MasterTargetList(List *workerTargetList);
@@ -29,11 +32,16 @@ static PlannedStmt * BuildSelectStatementViaStdPlanner(Query *masterQuery,
 													   List *masterTargetList,
 													   CustomScan *remoteScan);
 static bool FindCitusExtradataContainerRTE(Node *node, RangeTblEntry **result);
+static bool CanMergeSortedTaskResults(DistributedPlan *distributedPlan);
+static TargetEntry * NonJunkTargetEntry(List *targetList, AttrNumber columnId);
 
 static Plan * CitusCustomScanPathPlan(PlannerInfo *root, RelOptInfo *rel,
 									  struct CustomPath *best_path, List *tlist,
 									  List *clauses, List *custom_plans);
 
+/* GUC, whether the sorted rows of the tasks are merged rather than sorted again */
+bool EnableSortedTaskResultMerge = false;
+
 bool ReplaceCitusExtraDataContainer = false;
 CustomScan *ReplaceCitusExtraDataContainerWithCustomScan = NULL;
 
@@ -63,6 +71,13 @@ MasterNodeSelectPlan(DistributedPlan *distributedPlan, CustomScan *remoteScan)
 	Job *workerJob = distributedPlan->workerJob;
 	List *workerTargetList = workerJob->jobQuery->targetList;
 	List *masterTargetList = MasterTargetList(workerTargetList);
+
+	/* task tracker results are read from files one task at a time */
+	distributedPlan->mergeSortedTaskResults =
+		EnableSortedTaskResultMerge &&
+		remoteScan->methods == &AdaptiveExecutorCustomScanMethods &&
+		CanMergeSortedTaskResults(distributedPlan);
+
 	return BuildSelectStatementViaStdPlanner(masterQuery, masterTargetList, remoteScan);
 }
 
@@ -148,10 +163,143 @@ CreateCitusCustomScanPath(PlannerInfo *root, RelOptInfo *relOptInfo,
 	path->custom_path.path.rows = 100000;
 	path->remoteScan = remoteScan;
 
+	/*
+	 * The remote scan cannot run in parallel workers: its distributed plan is
+	 * made of Citus nodes that cannot be read back from the serialized plan, and
+	 * the results of the remote execution live in a tuple store of the leader.
+	 * We therefore mark the path as parallel unsafe, which keeps the standard
+	 * planner from building partial paths on top of it, and the combine query is
+	 * always executed by the backend that coordinates the distributed query.
+	 */
+	path->custom_path.path.parallel_aware = false;
+	path->custom_path.path.parallel_safe = false;
+	path->custom_path.path.parallel_workers = 0;
+
+	/*
+	 * When the rows of every task are already sorted in the order of the query,
+	 * the executor merges them, so the standard planner does not need to add a
+	 * Sort on top of the scan.
+	 */
+	DistributedPlan *distributedPlan = GetDistributedPlan(remoteScan);
+	if (distributedPlan->mergeSortedTaskResults)
+	{
+		path->custom_path.path.pathkeys = root->sort_pathkeys;
+	}
+
 	return (Path *) path;
 }
 
 
+/*
+ * CanMergeSortedTaskResults returns true if the ORDER BY of the masterQuery is
+ * the only operation on top of the scan and the worker query sorts the rows
+ * of every task in the same order, such that the coordinator only needs to
+ * merge the rows of the tasks.
+ *
+ * We only consider plain column references to the scan for the sort keys
+ * and require the worker query to sort on the same columns with the same
+ * operators, which is what ProcessLimitOrderByForWorkerQuery pushes down for
+ * ORDER BY .. LIMIT queries.
+ */
+static bool
+CanMergeSortedTaskResults(DistributedPlan *distributedPlan)
+{
+	Query *masterQuery = distributedPlan->masterQuery;
+	Job *workerJob = distributedPlan->workerJob;
+
+	if (masterQuery == NULL || masterQuery->sortClause == NIL ||
+		workerJob == NULL || workerJob->jobQuery == NULL)
+	{
+		return false;
+	}
+
+	if (masterQuery->hasAggs || masterQuery->hasWindowFuncs ||
+		masterQuery->hasTargetSRFs || masterQuery->groupClause != NIL ||
+		masterQuery->groupingSets != NIL || masterQuery->distinctClause != NIL ||
+		masterQuery->havingQual != NULL || list_length(masterQuery->rtable) != 1)
+	{
+		return false;
+	}
+
+	/* the rows of repartition jobs are not sorted by the tasks */
+	if (workerJob->dependentJobList != NIL)
+	{
+		return false;
+	}
+
+	Query *workerQuery = workerJob->jobQuery;
+	if (list_length(workerQuery->sortClause) < list_length(masterQuery->sortClause))
+	{
+		return false;
+	}
+
+	ListCell *masterSortCell = NULL;
+	ListCell *workerSortCell = NULL;
+	forboth(masterSortCell, masterQuery->sortClause, workerSortCell,
+			workerQuery->sortClause)
+	{
+		SortGroupClause *masterSortClause = (SortGroupClause *) lfirst(masterSortCell);
+		SortGroupClause *workerSortClause = (SortGroupClause *) lfirst(workerSortCell);
+		TargetEntry *masterSortEntry =
+			get_sortgroupclause_tle(masterSortClause, masterQuery->targetList);
+		TargetEntry *workerSortEntry =
+			get_sortgroupclause_tle(workerSortClause, workerQuery->targetList);
+
+		if (!IsA(masterSortEntry->expr, Var) || workerSortEntry->resjunk)
+		{
+			return false;
+		}
+
+		/* the column of the scan needs to be the one the workers sort on */
+		Var *sortColumn = (Var *) masterSortEntry->expr;
+		if (sortColumn->varlevelsup != 0 ||
+			NonJunkTargetEntry(workerQuery->targetList, sortColumn->varattno) !=
+			workerSortEntry)
+		{
+			return false;
+		}
+
+		if (masterSortClause->sortop != workerSortClause->sortop ||
+			masterSortClause->nulls_first != workerSortClause->nulls_first)
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+
+/*
+ * NonJunkTargetEntry returns the target entry of the given target list that
+ * becomes the column with the given number of the scan, since MasterTargetList
+ * skips the junk entries, or NULL if there is no such column.
+ */
+static TargetEntry *
+NonJunkTargetEntry(List *targetList, AttrNumber columnId)
+{
+	AttrNumber currentColumnId = 1;
+
+	TargetEntry *targetEntry = NULL;
+	foreach_ptr(targetEntry, targetList)
+	{
+		if (targetEntry->resjunk)
+		{
+			continue;
+		}
+
+		if (currentColumnId == columnId)
+		{
+			return targetEntry;
+		}
+
+		currentColumnId++;
+	}
+
+	return NULL;
+}
+
+
 /*
  * CitusCustomScanPathPlan is called for the CitusCustomScanPath node in the best_path
  * after the postgres planner has evaluated all possible paths.
@@ -36,6 +36,7 @@
 #include "distributed/citus_nodes.h"
 #include "distributed/citus_ruleutils.h"
 #include "distributed/colocation_utils.h"
+#include "distributed/connection_management.h"
 #include "distributed/deparse_shard_query.h"
 #include "distributed/master_protocol.h"
 #include "distributed/metadata_cache.h"
@@ -82,6 +83,7 @@
 /* Policy to use when assigning tasks to worker nodes */
 int TaskAssignmentPolicy = TASK_ASSIGNMENT_GREEDY;
 bool EnableUniqueJobIds = true;
+bool EnablePartitionFetchCompression = false;
 
 
 /*
@@ -150,7 +152,9 @@ static Task * QueryPushdownTaskCreate(Query *originalQuery, int shardIndex,
 									  RelationRestrictionContext *restrictionContext,
 									  uint32 taskId,
 									  TaskType taskType,
-									  bool modifyRequiresMasterEvaluation);
+									  bool modifyRequiresMasterEvaluation,
+									  ShardQueryTemplate **queryTemplate);
+static Query * QueryPushdownTaskQuery(Query *originalQuery, List *relationShardList);
 static bool ShardIntervalsEqual(FmgrInfo *comparisonFunction,
 								Oid collation,
 								ShardInterval *firstInterval,
@@ -202,8 +206,6 @@ static List * AssignDualHashTaskList(List *taskList);
 static void AssignDataFetchDependencies(List *taskList);
 static uint32 TaskListHighestTaskId(List *taskList);
 static List * MapTaskList(MapMergeJob *mapMergeJob, List *filterTaskList);
-static StringInfo CreateMapQueryString(MapMergeJob *mapMergeJob, Task *filterTask,
-									   char *partitionColumnName);
 static char * ColumnName(Var *column, List *rangeTableList);
 static List * MergeTaskList(MapMergeJob *mapMergeJob, List *mapTaskList,
 							uint32 taskIdIndex);
@@ -808,6 +810,8 @@ BuildReduceQuery(MultiExtendedOp *extendedOpNode, List *dependentJobList)
 	reduceQuery->limitCount = extendedOpNode->limitCount;
 	reduceQuery->havingQual = extendedOpNode->havingQual;
 	reduceQuery->hasAggs = contain_aggs_of_level((Node *) targetList, 0);
+	reduceQuery->hasWindowFuncs = extendedOpNode->hasWindowFuncs;
+	reduceQuery->windowClause = extendedOpNode->windowClause;
 
 	return reduceQuery;
 }
@@ -2156,10 +2160,20 @@ QueryPushdownSqlTaskList(Query *query, uint64 jobId,
 	int shardCount = 0;
 	bool *taskRequiredForShardIndex = NULL;
 	ListCell *prunedRelationShardCell = NULL;
+	ShardQueryTemplate *queryTemplate = NULL;
 
 	/* error if shards are not co-partitioned */
 	ErrorIfUnsupportedShardDistribution(query);
 
+	/*
+	 * Reference tables on the outer side of outer joins are restricted to
+	 * the hash range of the shard of each task, see
+	 * ReferenceTableOuterJoinsArePushdownSafe().
+	 */
+	bool restrictReferenceTables = taskType == SELECT_TASK &&
+								   EnableReferenceTableOuterJoinPushdown &&
+								   HasReferenceTableOuterJoin(query);
+
 	if (list_length(relationRestrictionContext->relationRestrictionList) == 0)
 	{
 		ereport(ERROR, (errmsg("cannot handle complex subqueries when the "
@@ -2214,6 +2228,18 @@ QueryPushdownSqlTaskList(Query *query, uint64 jobId,
 		 */
 		if (IsInnerTableOfOuterJoin(relationRestriction))
 		{
+			if (restrictReferenceTables)
+			{
+				/* every shard returns the reference table rows in its hash range */
+				for (int shardIndex = 0; shardIndex < shardCount; shardIndex++)
+				{
+					taskRequiredForShardIndex[shardIndex] = true;
+				}
+
+				minShardOffset = 0;
+				maxShardOffset = shardCount - 1;
+			}
+
 			continue;
 		}
 
@@ -2248,11 +2274,24 @@ QueryPushdownSqlTaskList(Query *query, uint64 jobId,
 			continue;
 		}
 
-		Task *subqueryTask = QueryPushdownTaskCreate(query, shardOffset,
+		Query *taskQuery = query;
+		ShardQueryTemplate **taskQueryTemplate = &queryTemplate;
+
+		if (restrictReferenceTables)
+		{
+			taskQuery = copyObject(query);
+			RestrictReferenceTableOuterJoinsToShard(taskQuery, shardOffset);
+
+			/* the restrictions differ between shards, so we cannot use a template */
+			taskQueryTemplate = NULL;
+		}
+
+		Task *subqueryTask = QueryPushdownTaskCreate(taskQuery, shardOffset,
 													 relationRestrictionContext,
 													 taskIdIndex,
 													 taskType,
-													 modifyRequiresMasterEvaluation);
+													 modifyRequiresMasterEvaluation,
+													 taskQueryTemplate);
 		subqueryTask->jobId = jobId;
 		sqlTaskList = lappend(sqlTaskList, subqueryTask);
 
@@ -2425,15 +2464,19 @@ ErrorIfUnsupportedShardDistribution(Query *query)
 /*
  * SubqueryTaskCreate creates a sql task by replacing the target
  * shardInterval's boundary value.
+ *
+ * Tasks that might be executed locally keep their query tree. The query
+ * string of other tasks is generated from the query template, which is
+ * deparsed for the first such task and passed on to the next ones, such that
+ * the query is not deparsed for every shard. Callers pass a NULL queryTemplate
+ * if the queries of the tasks differ in more than their shards.
  */
 static Task *
 QueryPushdownTaskCreate(Query *originalQuery, int shardIndex,
 						RelationRestrictionContext *restrictionContext, uint32 taskId,
-						TaskType taskType, bool modifyRequiresMasterEvaluation)
+						TaskType taskType, bool modifyRequiresMasterEvaluation,
+						ShardQueryTemplate **queryTemplate)
 {
-	Query *taskQuery = copyObject(originalQuery);
-
-	StringInfo queryString = makeStringInfo();
 	ListCell *restrictionCell = NULL;
 	List *taskShardList = NIL;
 	List *relationShardList = NIL;
@@ -2510,43 +2553,97 @@ QueryPushdownTaskCreate(Query *originalQuery, int shardIndex,
 							   "shards in the query")));
 	}
 
-	/*
-	 * Augment the relations in the query with the shard IDs.
-	 */
-	UpdateRelationToShardNames((Node *) taskQuery, relationShardList);
+	Task *subqueryTask = CreateBasicTask(jobId, taskId, taskType, NULL);
+	subqueryTask->dependentTaskList = NULL;
+	subqueryTask->anchorShardId = anchorShardId;
+	subqueryTask->taskPlacementList = selectPlacementList;
+	subqueryTask->relationShardList = relationShardList;
 
-	/*
-	 * Ands are made implicit during shard pruning, as predicate comparison and
-	 * refutation depend on it being so. We need to make them explicit again so
-	 * that the query string is generated as (...) AND (...) as opposed to
-	 * (...), (...).
-	 */
-	if (taskQuery->jointree->quals != NULL && IsA(taskQuery->jointree->quals, List))
+	if (((taskType == MODIFY_TASK && !modifyRequiresMasterEvaluation) ||
+		 taskType == SELECT_TASK) && ShouldLazyDeparseQuery(subqueryTask))
 	{
-		taskQuery->jointree->quals = (Node *) make_ands_explicit(
-			(List *) taskQuery->jointree->quals);
+		/* keep the query tree, such that local execution does not need to parse */
+		Query *taskQuery = QueryPushdownTaskQuery(originalQuery, relationShardList);
+		SetTaskQuery(subqueryTask, taskQuery);
+
+		ereport(DEBUG4, (errmsg("distributed statement: %s",
+								ApplyLogRedaction(TaskQueryString(subqueryTask)))));
 	}
+	else if ((taskType == MODIFY_TASK && !modifyRequiresMasterEvaluation) ||
+			 taskType == SELECT_TASK)
+	{
+		char *queryString = NULL;
 
-	Task *subqueryTask = CreateBasicTask(jobId, taskId, taskType, NULL);
+		if (EnableShardQueryTemplates && queryTemplate != NULL)
+		{
+			if (*queryTemplate == NULL)
+			{
+				Query *templateQuery = copyObject(originalQuery);
+				MakeQualsExplicit(templateQuery);
+
+				*queryTemplate = DeparseShardQueryTemplate(templateQuery,
+														   relationShardList);
+			}
+
+			queryString = InstantiateShardQueryTemplate(*queryTemplate,
+														relationShardList);
+		}
+
+		if (queryString == NULL)
+		{
+			Query *taskQuery = QueryPushdownTaskQuery(originalQuery, relationShardList);
+			StringInfo queryStringInfo = makeStringInfo();
+
+			pg_get_query_def(taskQuery, queryStringInfo);
+			queryString = queryStringInfo->data;
+		}
 
-	if ((taskType == MODIFY_TASK && !modifyRequiresMasterEvaluation) ||
-		taskType == SELECT_TASK)
-	{
-		pg_get_query_def(taskQuery, queryString);
 		ereport(DEBUG4, (errmsg("distributed statement: %s",
-								ApplyLogRedaction(queryString->data))));
-		SetTaskQueryString(subqueryTask, queryString->data);
+								ApplyLogRedaction(queryString))));
+		SetTaskQueryString(subqueryTask, queryString);
 	}
 
-	subqueryTask->dependentTaskList = NULL;
-	subqueryTask->anchorShardId = anchorShardId;
-	subqueryTask->taskPlacementList = selectPlacementList;
-	subqueryTask->relationShardList = relationShardList;
-
 	return subqueryTask;
 }
 
 
+/*
+ * QueryPushdownTaskQuery returns a copy of the query of a query pushdown task
+ * in which the relations are replaced by the given shards.
+ */
+static Query *
+QueryPushdownTaskQuery(Query *originalQuery, List *relationShardList)
+{
+	Query *taskQuery = copyObject(originalQuery);
+
+	/*
+	 * Augment the relations in the query with the shard IDs.
+	 */
+	UpdateRelationToShardNames((Node *) taskQuery, relationShardList);
+	MakeQualsExplicit(taskQuery);
+
+	return taskQuery;
+}
+
+
+/*
+ * MakeQualsExplicit makes the implicit ands in the WHERE clause of the query
+ * explicit again. Ands are made implicit during shard pruning, as predicate
+ * comparison and refutation depend on it being so. We need to make them
+ * explicit again so that the query string is generated as (...) AND (...) as
+ * opposed to (...), (...).
+ */
+void
+MakeQualsExplicit(Query *query)
+{
+	if (query->jointree->quals != NULL && IsA(query->jointree->quals, List))
+	{
+		query->jointree->quals = (Node *) make_ands_explicit(
+			(List *) query->jointree->quals);
+	}
+}
+
+
 /*
  * CoPartitionedTables checks if given two distributed tables have 1-to-1 shard
  * placement matching. It first checks for the shard count, if tables don't have
@@ -4320,9 +4417,39 @@ static List *
 MapTaskList(MapMergeJob *mapMergeJob, List *filterTaskList)
 {
 	List *mapTaskList = NIL;
+	ListCell *filterTaskCell = NULL;
+	char *partitionColumnName = MapTaskPartitionColumnName(mapMergeJob);
+
+	foreach(filterTaskCell, filterTaskList)
+	{
+		Task *filterTask = (Task *) lfirst(filterTaskCell);
+		char *filterQueryString = TaskQueryString(filterTask);
+		StringInfo mapQueryString = CreateMapQueryString(mapMergeJob, filterTask,
+														 filterQueryString,
+														 partitionColumnName);
+
+		/* convert filter query task into map task */
+		Task *mapTask = filterTask;
+		SetTaskQueryString(mapTask, mapQueryString->data);
+		mapTask->filterQueryString = filterQueryString;
+		mapTask->taskType = MAP_TASK;
+
+		mapTaskList = lappend(mapTaskList, mapTask);
+	}
+
+	return mapTaskList;
+}
+
+
+/*
+ * MapTaskPartitionColumnName returns the name under which the filter queries of
+ * the given MapMerge job return the column that the map tasks partition on.
+ */
+char *
+MapTaskPartitionColumnName(MapMergeJob *mapMergeJob)
+{
 	Query *filterQuery = mapMergeJob->job.jobQuery;
 	List *rangeTableList = filterQuery->rtable;
-	ListCell *filterTaskCell = NULL;
 	Var *partitionColumn = mapMergeJob->partitionColumn;
 	char *partitionColumnName = NULL;
 
@@ -4352,37 +4479,23 @@ MapTaskList(MapMergeJob *mapMergeJob, List *filterTaskList)
 		}
 	}
 
-	foreach(filterTaskCell, filterTaskList)
-	{
-		Task *filterTask = (Task *) lfirst(filterTaskCell);
-		StringInfo mapQueryString = CreateMapQueryString(mapMergeJob, filterTask,
-														 partitionColumnName);
-
-		/* convert filter query task into map task */
-		Task *mapTask = filterTask;
-		SetTaskQueryString(mapTask, mapQueryString->data);
-		mapTask->taskType = MAP_TASK;
-
-		mapTaskList = lappend(mapTaskList, mapTask);
-	}
-
-	return mapTaskList;
+	return partitionColumnName;
 }
 
 
 /*
- * CreateMapQueryString creates and returns the map query string for the given filterTask.
+ * CreateMapQueryString creates and returns the map query string that
+ * repartitions the results of the given filter query for the given map task.
  */
-static StringInfo
-CreateMapQueryString(MapMergeJob *mapMergeJob, Task *filterTask,
-					 char *partitionColumnName)
+StringInfo
+CreateMapQueryString(MapMergeJob *mapMergeJob, Task *mapTask,
+					 char *filterQueryString, char *partitionColumnName)
 {
-	uint64 jobId = filterTask->jobId;
-	uint32 taskId = filterTask->taskId;
+	uint64 jobId = mapTask->jobId;
+	uint32 taskId = mapTask->taskId;
 
 	/* wrap repartition query string around filter query string */
 	StringInfo mapQueryString = makeStringInfo();
-	char *filterQueryString = TaskQueryString(filterTask);
 	char *filterQueryEscapedText = quote_literal_cstr(filterQueryString);
 	PartitionType partitionType = mapMergeJob->partitionType;
 
@@ -4428,6 +4541,78 @@ CreateMapQueryString(MapMergeJob *mapMergeJob, Task *filterTask,
 }
 
 
+/*
+ * CreateSkewHashMapQueryString creates and returns a map query string that hash
+ * partitions the results of the given filter query like the map tasks of the
+ * given dual hash map merge job, except that rows with the given split hash
+ * values are spread over all partitions, and rows with the given broadcast hash
+ * values are written to all partitions. Both arrays hold integers.
+ */
+StringInfo
+CreateSkewHashMapQueryString(MapMergeJob *mapMergeJob, Task *mapTask,
+							 char *filterQueryString, char *partitionColumnName,
+							 ArrayType *splitHashObject, ArrayType *broadcastHashObject)
+{
+	Var *partitionColumn = mapMergeJob->partitionColumn;
+	char *partitionColumnTypeFullName =
+		format_type_be_qualified(partitionColumn->vartype);
+	uint32 partitionCount = mapMergeJob->partitionCount;
+	int32 hashTypeMod = get_typmodin(INT4OID);
+
+	Assert(mapMergeJob->partitionType == DUAL_HASH_PARTITION_TYPE);
+
+	ShardInterval **intervalArray = GenerateSyntheticShardIntervalArray(partitionCount);
+	ArrayType *hashRangeObject = SplitPointObject(intervalArray, partitionCount);
+	StringInfo hashRangeString = ArrayObjectToString(hashRangeObject, INT4OID,
+													 hashTypeMod);
+	StringInfo splitHashString = ArrayObjectToString(splitHashObject, INT4OID,
+													 hashTypeMod);
+	StringInfo broadcastHashString = ArrayObjectToString(broadcastHashObject, INT4OID,
+														 hashTypeMod);
+
+	StringInfo mapQueryString = makeStringInfo();
+	appendStringInfo(mapQueryString, SKEW_HASH_PARTITION_COMMAND, mapTask->jobId,
+					 mapTask->taskId, quote_literal_cstr(filterQueryString),
+					 partitionColumnName, partitionColumnTypeFullName,
+					 hashRangeString->data, splitHashString->data,
+					 broadcastHashString->data);
+
+	return mapQueryString;
+}
+
+
+/*
+ * CreateRangeMapQueryString creates and returns a map query string that range
+ * repartitions the results of the given filter query on the given split points,
+ * instead of the partitioning of the given map merge job. The split points need
+ * to be of the type of the partition column.
+ */
+StringInfo
+CreateRangeMapQueryString(MapMergeJob *mapMergeJob, Task *mapTask,
+						  char *filterQueryString, char *partitionColumnName,
+						  ArrayType *splitPointObject)
+{
+	Var *partitionColumn = mapMergeJob->partitionColumn;
+	Oid partitionColumnType = partitionColumn->vartype;
+	char *partitionColumnTypeFullName = format_type_be_qualified(partitionColumnType);
+	int32 partitionColumnTypeMod = partitionColumn->vartypmod;
+
+	Assert(ARR_ELEMTYPE(splitPointObject) == partitionColumnType);
+
+	StringInfo splitPointString = ArrayObjectToString(splitPointObject,
+													  partitionColumnType,
+													  partitionColumnTypeMod);
+
+	StringInfo mapQueryString = makeStringInfo();
+	appendStringInfo(mapQueryString, RANGE_PARTITION_COMMAND, mapTask->jobId,
+					 mapTask->taskId, quote_literal_cstr(filterQueryString),
+					 partitionColumnName, partitionColumnTypeFullName,
+					 splitPointString->data);
+
+	return mapQueryString;
+}
+
+
 /*
  * GenerateSyntheticShardIntervalArray returns a shard interval pointer array
  * which has a uniform hash distribution for the given input partitionCount.
@@ -4680,7 +4865,8 @@ MergeTaskList(MapMergeJob *mapMergeJob, List *mapTaskList, uint32 taskIdIndex)
 			appendStringInfo(mapFetchQueryString, MAP_OUTPUT_FETCH_COMMAND,
 							 mapTask->jobId, mapTask->taskId, partitionId,
 							 mergeTaskId, /* fetch results to merge task */
-							 mapTaskNodeName, mapTaskNodePort);
+							 mapTaskNodeName, mapTaskNodePort,
+							 EnablePartitionFetchCompression ? ", true" : "");
 
 			Task *mapOutputFetchTask = CreateBasicTask(jobId, taskIdIndex,
 													   MAP_OUTPUT_FETCH_TASK,
@@ -5080,6 +5266,10 @@ AssignAnchorShardTaskList(List *taskList)
 	{
 		assignedTaskList = RoundRobinAssignTaskList(taskList);
 	}
+	else if (TaskAssignmentPolicy == TASK_ASSIGNMENT_LOCALITY)
+	{
+		assignedTaskList = LocalityAssignTaskList(taskList);
+	}
 
 	Assert(assignedTaskList != NIL);
 	return assignedTaskList;
@@ -5294,6 +5484,67 @@ RoundRobinReorder(Task *task, List *placementList)
 }
 
 
+/*
+ * LocalityAssignTaskList assigns each task to the placement that is closest
+ * to this backend, as decided by LocalityReorder.
+ */
+List *
+LocalityAssignTaskList(List *taskList)
+{
+	taskList = ReorderAndAssignTaskList(taskList, LocalityReorder);
+
+	return taskList;
+}
+
+
+/*
+ * LocalityReorder implements the core of the locality assignment policy. It
+ * moves the placement on the local node to the front of a copy of the
+ * placement list, such that the task can be executed locally without any
+ * network round trips. If there is no local placement, it instead moves the
+ * placement on the node to which this backend currently holds the fewest
+ * connections to the front, which spreads concurrent reads over the nodes and
+ * tends to reuse idle connections. Ties keep the original placement order.
+ */
+List *
+LocalityReorder(Task *task, List *placementList)
+{
+	int32 localGroupId = GetLocalGroupId();
+	ShardPlacement *preferredPlacement = NULL;
+	int preferredConnectionCount = 0;
+
+	ShardPlacement *placement = NULL;
+	foreach_ptr(placement, placementList)
+	{
+		if (placement->groupId == localGroupId)
+		{
+			preferredPlacement = placement;
+			break;
+		}
+
+		int connectionCount = NodeConnectionCount(placement->nodeName,
+												  placement->nodePort);
+		if (preferredPlacement == NULL || connectionCount < preferredConnectionCount)
+		{
+			preferredPlacement = placement;
+			preferredConnectionCount = connectionCount;
+		}
+	}
+
+	if (preferredPlacement == NULL)
+	{
+		return placementList;
+	}
+
+	List *reorderedPlacementList = list_copy(placementList);
+	reorderedPlacementList = list_delete_ptr(reorderedPlacementList,
+											 preferredPlacement);
+	reorderedPlacementList = lcons(preferredPlacement, reorderedPlacementList);
+
+	return reorderedPlacementList;
+}
+
+
 /*
  * ReorderAndAssignTaskList finds the placements for a task based on its anchor
  * shard id and then sorts them by insertion time. If reorderFunction is given,
@@ -50,6 +50,7 @@
 #include "distributed/shard_pruning.h"
 #include "executor/execdesc.h"
 #include "lib/stringinfo.h"
+#include "miscadmin.h"
 #include "nodes/makefuncs.h"
 #include "nodes/nodeFuncs.h"
 #include "nodes/nodes.h"
@@ -74,8 +75,10 @@
 #include "utils/builtins.h"
 #include "utils/elog.h"
 #include "utils/errcodes.h"
+#include "utils/acl.h"
 #include "utils/lsyscache.h"
 #include "utils/rel.h"
+#include "utils/rls.h"
 #include "utils/typcache.h"
 
 #include "catalog/pg_proc.h"
@@ -114,6 +117,9 @@ typedef struct WalkerState
 
 bool EnableRouterExecution = true;
 
+/* if true, fast path queries on partitioned tables are sent to a partition shard */
+bool EnableFastPathPartitionPruning = false;
+
 
 /* planner functions forward declarations */
 static void CreateSingleTaskRouterPlan(DistributedPlan *distributedPlan,
@@ -162,6 +168,12 @@ static List * SingleShardModifyTaskList(Query *query, uint64 jobId,
 										List *relationShardList, List *placementList,
 										uint64 shardId, bool parametersInQueryResolved);
 static List * RemoveCoordinatorPlacement(List *placementList);
+static List * ActivePlacementGroupIdList(uint64 shardId);
+static List * PruneFastPathQueryToPartitionShard(Query *query,
+												 List *prunedShardIntervalListList,
+												 FastPathRestrictionContext *
+												 fastPathContext);
+static bool QueryReferencesWholeRow(Query *query);
 static void ReorderTaskPlacementsByTaskAssignmentPolicy(Job *job,
 														TaskAssignmentPolicyType
 														taskAssignmentPolicy,
@@ -350,7 +362,6 @@ AddShardIntervalRestrictionToSelect(Query *subqery, ShardInterval *shardInterval
 	List *targetList = subqery->targetList;
 	ListCell *targetEntryCell = NULL;
 	Var *targetPartitionColumnVar = NULL;
-	List *boundExpressionList = NIL;
 
 	/* iterate through the target entries */
 	foreach(targetEntryCell, targetList)
@@ -368,6 +379,36 @@ AddShardIntervalRestrictionToSelect(Query *subqery, ShardInterval *shardInterval
 	/* we should have found target partition column */
 	Assert(targetPartitionColumnVar != NULL);
 
+	Expr *andedBoundExpressions =
+		ShardIntervalRestrictionExpression(targetPartitionColumnVar, shardInterval);
+
+	/* finally add the quals */
+	if (subqery->jointree->quals == NULL)
+	{
+		subqery->jointree->quals = (Node *) andedBoundExpressions;
+	}
+	else
+	{
+		subqery->jointree->quals = make_and_qual(subqery->jointree->quals,
+												 (Node *) andedBoundExpressions);
+	}
+}
+
+
+/*
+ * ShardIntervalRestrictionExpression returns the following range boundaries
+ * for the given column and shardInterval:
+ *
+ *    hashfunc(partitionColumn) >= $lower_bound AND
+ *    hashfunc(partitionColumn) <= $upper_bound
+ *
+ * The column needs to have the type of the partition column of the shard.
+ */
+Expr *
+ShardIntervalRestrictionExpression(Var *partitionColumn, ShardInterval *shardInterval)
+{
+	List *boundExpressionList = NIL;
+
 	Oid integer4GEoperatorId = get_opfamily_member(INTEGER_BTREE_FAM_OID, INT4OID,
 												   INT4OID,
 												   BTGreaterEqualStrategyNumber);
@@ -380,7 +421,7 @@ AddShardIntervalRestrictionToSelect(Query *subqery, ShardInterval *shardInterval
 	Assert(integer4LEoperatorId != InvalidOid);
 
 	/* look up the type cache */
-	TypeCacheEntry *typeEntry = lookup_type_cache(targetPartitionColumnVar->vartype,
+	TypeCacheEntry *typeEntry = lookup_type_cache(partitionColumn->vartype,
 												  TYPECACHE_HASH_PROC_FINFO);
 
 	/* probably never possible given that the tables are already hash partitioned */
@@ -388,7 +429,7 @@ AddShardIntervalRestrictionToSelect(Query *subqery, ShardInterval *shardInterval
 	{
 		ereport(ERROR, (errcode(ERRCODE_UNDEFINED_FUNCTION),
 						errmsg("could not identify a hash function for type %s",
-							   format_type_be(targetPartitionColumnVar->vartype))));
+							   format_type_be(partitionColumn->vartype))));
 	}
 
 	/*
@@ -397,7 +438,7 @@ AddShardIntervalRestrictionToSelect(Query *subqery, ShardInterval *shardInterval
 	 */
 	FuncExpr *hashFunctionExpr = makeNode(FuncExpr);
 	hashFunctionExpr->funcid = CitusWorkerHashFunctionId();
-	hashFunctionExpr->args = list_make1(targetPartitionColumnVar);
+	hashFunctionExpr->args = list_make1(partitionColumn);
 
 	/* hash functions always return INT4 */
 	hashFunctionExpr->funcresulttype = INT4OID;
@@ -433,18 +474,7 @@ AddShardIntervalRestrictionToSelect(Query *subqery, ShardInterval *shardInterval
 	boundExpressionList = lappend(boundExpressionList, greaterThanAndEqualsBoundExpr);
 	boundExpressionList = lappend(boundExpressionList, lessThanAndEqualsBoundExpr);
 
-	Expr *andedBoundExpressions = make_ands_explicit(boundExpressionList);
-
-	/* finally add the quals */
-	if (subqery->jointree->quals == NULL)
-	{
-		subqery->jointree->quals = (Node *) andedBoundExpressions;
-	}
-	else
-	{
-		subqery->jointree->quals = make_and_qual(subqery->jointree->quals,
-												 (Node *) andedBoundExpressions);
-	}
+	return make_ands_explicit(boundExpressionList);
 }
 
 
@@ -1725,6 +1755,8 @@ GenerateSingleShardRouterTaskList(Job *job, List *relationShardList,
  *
  * Supported Types
  * - TASK_ASSIGNMENT_ROUND_ROBIN round robin schedule queries among placements
+ * - TASK_ASSIGNMENT_LOCALITY prefer the local placement, otherwise the placement
+ *   on the node with the fewest connections from this backend
  *
  * By default it does not reorder the task list, implying a first-replica strategy.
  */
@@ -1760,6 +1792,21 @@ ReorderTaskPlacementsByTaskAssignmentPolicy(Job *job,
 		List *reorderedPlacementList = RoundRobinReorder(task, placementList);
 		task->taskPlacementList = reorderedPlacementList;
 
+		ShardPlacement *primaryPlacement = (ShardPlacement *) linitial(
+			reorderedPlacementList);
+		ereport(DEBUG3, (errmsg("assigned task %u to node %s:%u", task->taskId,
+								primaryPlacement->nodeName,
+								primaryPlacement->nodePort)));
+	}
+	else if (taskAssignmentPolicy == TASK_ASSIGNMENT_LOCALITY)
+	{
+		Assert(list_length(job->taskList) == 1);
+		Task *task = (Task *) linitial(job->taskList);
+
+		Assert(ReadOnlyTask(task->taskType));
+		List *reorderedPlacementList = LocalityReorder(task, placementList);
+		task->taskPlacementList = reorderedPlacementList;
+
 		ShardPlacement *primaryPlacement = (ShardPlacement *) linitial(
 			reorderedPlacementList);
 		ereport(DEBUG3, (errmsg("assigned task %u to node %s:%u", task->taskId,
@@ -1821,6 +1868,7 @@ SingleShardSelectTaskList(Query *query, uint64 jobId, List *relationShardList,
 	 */
 	task->taskPlacementList = placementList;
 	SetTaskQuery(task, query);
+	SetTaskQueryTemplate(task, query);
 	task->anchorShardId = shardId;
 	task->jobId = jobId;
 	task->relationShardList = relationShardList;
@@ -1902,6 +1950,7 @@ SingleShardModifyTaskList(Query *query, uint64 jobId, List *relationShardList,
 
 	task->taskPlacementList = placementList;
 	SetTaskQuery(task, query);
+	SetTaskQueryTemplate(task, query);
 	task->anchorShardId = shardId;
 	task->jobId = jobId;
 	task->relationShardList = relationShardList;
@@ -2033,6 +2082,15 @@ PlanRouterQuery(Query *originalQuery,
 			return planningError;
 		}
 
+		if (EnableFastPathPartitionPruning && commandType == CMD_SELECT &&
+			!isMultiShardQuery)
+		{
+			shardIntervalList =
+				PruneFastPathQueryToPartitionShard(originalQuery, shardIntervalList,
+												   plannerRestrictionContext->
+												   fastPathRestrictionContext);
+		}
+
 		*prunedShardIntervalListList = shardIntervalList;
 
 		if (!isMultiShardQuery)
@@ -2214,6 +2272,126 @@ CreateDummyPlacement(void)
 }
 
 
+/*
+ * PruneFastPathQueryToPartitionShard checks whether the single shard that a
+ * fast path SELECT on a partitioned table is routed to can be narrowed down to
+ * the shard of one of its partitions, by testing the quals of the query against
+ * the partition constraints. If so, the shard of the partition is returned in
+ * the same form as TargetShardIntervalForFastPathQuery() does. Otherwise, the
+ * input is returned.
+ *
+ * This saves the worker from opening and pruning all the partitions of the
+ * shard while planning the query.
+ *
+ * The query keeps reading from the parent, such that its Vars, which use the
+ * attribute numbers of the parent, and the permission checks on the parent stay
+ * as they are. Only the name of the shard in the query is replaced with the
+ * name of the shard of the partition, the deparser refers to the columns of a
+ * shard by name. Querying the partition directly requires privileges on the
+ * partition and applies its row level security policies, so partitions that
+ * the current user cannot read as they are read through the parent are left
+ * to the worker.
+ */
+static List *
+PruneFastPathQueryToPartitionShard(Query *query, List *prunedShardIntervalListList,
+								   FastPathRestrictionContext *fastPathContext)
+{
+	if (list_length(prunedShardIntervalListList) != 1)
+	{
+		return prunedShardIntervalListList;
+	}
+
+	List *shardIntervalList = (List *) linitial(prunedShardIntervalListList);
+	if (list_length(shardIntervalList) != 1)
+	{
+		return prunedShardIntervalListList;
+	}
+
+	ShardInterval *shardInterval = (ShardInterval *) linitial(shardIntervalList);
+	Oid relationId = shardInterval->relationId;
+	if (!PartitionedTable(relationId))
+	{
+		return prunedShardIntervalListList;
+	}
+
+	/* a whole row of the partition may have its columns in a different order */
+	if (query->hasSubLinks || QueryReferencesWholeRow(query))
+	{
+		return prunedShardIntervalListList;
+	}
+
+	/* fold casts of constants, otherwise they cannot refute partition constraints */
+	Node *quals = eval_const_expressions(NULL, copyObject(query->jointree->quals));
+	List *partitionList =
+		PartitionsNotRefutedByClauses(relationId, make_ands_implicit((Expr *) quals));
+	if (list_length(partitionList) != 1)
+	{
+		return prunedShardIntervalListList;
+	}
+
+	/* we only go down a single level, sub-partitions are pruned by the worker */
+	Oid partitionId = linitial_oid(partitionList);
+	if (PartitionedTable(partitionId))
+	{
+		return prunedShardIntervalListList;
+	}
+
+	if (pg_class_aclcheck(partitionId, GetUserId(), ACL_SELECT) != ACLCHECK_OK ||
+		check_enable_rls(partitionId, InvalidOid, true) == RLS_ENABLED)
+	{
+		return prunedShardIntervalListList;
+	}
+
+	/* partitions are always co-located with their parent */
+	int shardIndex = ShardIndex(shardInterval);
+	uint64 partitionShardId = ColocatedShardIdInRelation(partitionId, shardIndex);
+	ShardInterval *partitionShardInterval = LoadShardInterval(partitionShardId);
+
+	char *partitionShardName = get_rel_name(partitionId);
+	char *partitionSchemaName = get_namespace_name(get_rel_namespace(partitionId));
+	AppendShardIdToName(&partitionShardName, partitionShardId);
+
+	/* UpdateRelationToShardNames() skips the RTE once it refers to a shard */
+	RangeTblEntry *rangeTableEntry = (RangeTblEntry *) linitial(query->rtable);
+	ModifyRangeTblExtraData(rangeTableEntry, CITUS_RTE_SHARD, partitionSchemaName,
+							partitionShardName, NIL);
+
+	/* the plan depends on the privileges of the current user on the partition */
+	fastPathContext->prunedToPartition = true;
+
+	ereport(DEBUG2, (errmsg("query is pruned to partition %s",
+							get_rel_name(partitionId))));
+
+	return list_make1(list_make1(partitionShardInterval));
+}
+
+
+/*
+ * QueryReferencesWholeRow returns whether the target list or the quals of the
+ * given query reference a whole row of a relation.
+ */
+static bool
+QueryReferencesWholeRow(Query *query)
+{
+	List *expressionList = list_make2(query->targetList, query->jointree->quals);
+	List *varList = pull_var_clause((Node *) expressionList,
+									PVC_RECURSE_AGGREGATES |
+									PVC_RECURSE_WINDOWFUNCS |
+									PVC_RECURSE_PLACEHOLDERS);
+
+	Var *var = NULL;
+	foreach_ptr(var, varList)
+	{
+		if (var->varattno == InvalidAttrNumber)
+		{
+			return true;
+		}
+	}
+
+	return false;
+}
+
+
 /*
  * RelationShardListForShardIntervalList is a utility function which gets a list of
  * shardInterval, and returns a list of RelationShard.
@@ -2504,13 +2682,21 @@ RelationPrunesToMultipleShards(List *relationShardList)
  * shard intervals provided to the select query. It returns NIL if no placement
  * exists. The caller should check if there are any shard intervals exist for
  * placement check prior to calling this function.
+ *
+ * The returned placements are those of the last shard. To not build a list of
+ * placements for every shard, we intersect the groups of the cached placements
+ * and only resolve the placements of the last shard. Shards of colocated tables
+ * that the colocated shard map of their colocation group knows to be placed in
+ * the same groups are skipped altogether.
  */
 List *
 WorkersContainingAllShards(List *prunedShardIntervalsList)
 {
 	ListCell *prunedShardIntervalCell = NULL;
 	bool firstShard = true;
-	List *currentPlacementList = NIL;
+	List *currentGroupIdList = NIL;
+	uint64 lastShardId = INVALID_SHARD_ID;
+	ShardInterval *firstColocatedShard = NULL;
 
 	foreach(prunedShardIntervalCell, prunedShardIntervalsList)
 	{
@@ -2526,29 +2712,64 @@ WorkersContainingAllShards(List *prunedShardIntervalsList)
 		ShardInterval *shardInterval = (ShardInterval *) linitial(shardIntervalList);
 		uint64 shardId = shardInterval->shardId;
 
-		/* retrieve all active shard placements for this shard */
-		List *newPlacementList = ActiveShardPlacementList(shardId);
+		lastShardId = shardId;
+
+		/*
+		 * A shard that is known to be placed in the same groups as a colocated
+		 * shard we already looked at does not change the groups.
+		 */
+		if (firstColocatedShard != NULL &&
+			ColocatedShardsCoPlaced(firstColocatedShard, shardInterval))
+		{
+			continue;
+		}
+
+		/* retrieve the groups of all active shard placements for this shard */
+		List *newGroupIdList = ActivePlacementGroupIdList(shardId);
 
 		if (firstShard)
 		{
 			firstShard = false;
-			currentPlacementList = newPlacementList;
+			currentGroupIdList = newGroupIdList;
 		}
 		else
 		{
-			/* keep placements that still exists for this shard */
-			currentPlacementList = IntersectPlacementList(currentPlacementList,
-														  newPlacementList);
+			/* keep groups that still have a placement of this shard */
+			currentGroupIdList = list_intersection_int(currentGroupIdList,
+													   newGroupIdList);
+		}
+
+		if (firstColocatedShard == NULL &&
+			PartitionMethod(shardInterval->relationId) == DISTRIBUTE_BY_HASH)
+		{
+			firstColocatedShard = shardInterval;
 		}
 
 		/*
-		 * Bail out if placement list becomes empty. This means there is no worker
+		 * Bail out if group list becomes empty. This means there is no worker
 		 * containing all shards referenced by the query, hence we can not forward
 		 * this query directly to any worker.
 		 */
-		if (currentPlacementList == NIL)
+		if (currentGroupIdList == NIL)
 		{
-			break;
+			return NIL;
+		}
+	}
+
+	if (firstShard)
+	{
+		return NIL;
+	}
+
+	List *currentPlacementList = NIL;
+	List *lastPlacementList = ActiveShardPlacementList(lastShardId);
+
+	ShardPlacement *placement = NULL;
+	foreach_ptr(placement, lastPlacementList)
+	{
+		if (list_member_int(currentGroupIdList, placement->groupId))
+		{
+			currentPlacementList = lappend(currentPlacementList, placement);
 		}
 	}
 
@@ -2556,6 +2777,33 @@ WorkersContainingAllShards(List *prunedShardIntervalsList)
 }
 
 
+/*
+ * ActivePlacementGroupIdList returns the groups of the active placements of
+ * the given shard, read from the metadata cache without copying placements.
+ */
+static List *
+ActivePlacementGroupIdList(uint64 shardId)
+{
+	List *groupIdList = NIL;
+	int placementCount = 0;
+
+	GroupShardPlacement *placementArray =
+		CachedGroupShardPlacementArray(shardId, &placementCount);
+
+	for (int placementIndex = 0; placementIndex < placementCount; placementIndex++)
+	{
+		GroupShardPlacement *placement = &placementArray[placementIndex];
+
+		if (placement->shardState == SHARD_STATE_ACTIVE)
+		{
+			groupIdList = list_append_unique_int(groupIdList, placement->groupId);
+		}
+	}
+
+	return groupIdList;
+}
+
+
 /*
  * BuildRoutesForInsert returns a list of ModifyRoute objects for an INSERT
  * query or an empty list if the partition column value is defined as an ex-
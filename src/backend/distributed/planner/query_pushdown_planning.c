@@ -43,7 +43,9 @@
 #endif
 #include "nodes/pg_list.h"
 #include "optimizer/clauses.h"
+#include "optimizer/tlist.h"
 #include "parser/parsetree.h"
+#include "utils/typcache.h"
 
 
 /*
@@ -65,6 +67,9 @@ typedef enum RecurringTuplesType
 /* Config variable managed via guc.c */
 bool SubqueryPushdown = false; /* is subquery pushdown enabled */
 
+/* GUC, whether reference tables can be on the outer side of pushed down joins */
+bool EnableReferenceTableOuterJoinPushdown = false;
+
 
 /* Local functions forward declarations */
 static bool JoinTreeContainsSubqueryWalker(Node *joinTreeNode, void *context);
@@ -74,7 +79,12 @@ static bool WindowPartitionOnDistributionColumn(Query *query);
 static DeferredErrorMessage * DeferErrorIfFromClauseRecurs(Query *queryTree);
 static RecurringTuplesType FromClauseRecurringTupleType(Query *queryTree);
 static DeferredErrorMessage * DeferredErrorIfUnsupportedRecurringTuplesJoin(
-	PlannerRestrictionContext *plannerRestrictionContext);
+	PlannerRestrictionContext *plannerRestrictionContext,
+	bool referenceTableOuterJoinsAreSafe);
+static bool ExtractOuterJoinExprWalker(Node *node, List **outerJoinExprList);
+static bool ReferenceTableOuterJoinColumns(Query *query, JoinExpr *joinExpr,
+										   Var **referenceColumn,
+										   Var **distributionColumn);
 static DeferredErrorMessage * DeferErrorIfUnsupportedTableCombination(Query *queryTree);
 static bool ExtractSetOperationStatmentWalker(Node *node, List **setOperationList);
 static bool ShouldRecurseForRecurringTuplesJoinChecks(RelOptInfo *relOptInfo);
@@ -609,8 +619,15 @@ DeferErrorIfUnsupportedSubqueryPushdown(Query *originalQuery,
 		return error;
 	}
 
-	/* we shouldn't allow reference tables in the outer part of outer joins */
-	error = DeferredErrorIfUnsupportedRecurringTuplesJoin(plannerRestrictionContext);
+	/*
+	 * We shouldn't allow reference tables in the outer part of outer joins,
+	 * unless the tasks only return the rows of the reference table that hash
+	 * into their shard.
+	 */
+	bool referenceTableOuterJoinsAreSafe =
+		ReferenceTableOuterJoinsArePushdownSafe(originalQuery);
+	error = DeferredErrorIfUnsupportedRecurringTuplesJoin(
+		plannerRestrictionContext, referenceTableOuterJoinsAreSafe);
 	if (error)
 	{
 		return error;
@@ -771,11 +788,14 @@ FromClauseRecurringTupleType(Query *queryTree)
  * (Note that PostgreSQL converts right joins to left joins. While converting
  * join types, innerrel and outerrel are also switched.) Otherwise we will
  * definitely have duplicate rows. Beside, reference tables can not be used
- * with full outer joins because of the same reason.
+ * with full outer joins because of the same reason. The exception are left
+ * joins when referenceTableOuterJoinsAreSafe is set, see
+ * ReferenceTableOuterJoinsArePushdownSafe().
  */
 static DeferredErrorMessage *
 DeferredErrorIfUnsupportedRecurringTuplesJoin(
-	PlannerRestrictionContext *plannerRestrictionContext)
+	PlannerRestrictionContext *plannerRestrictionContext,
+	bool referenceTableOuterJoinsAreSafe)
 {
 	List *joinRestrictionList =
 		plannerRestrictionContext->joinRestrictionContext->joinRestrictionList;
@@ -791,6 +811,12 @@ DeferredErrorIfUnsupportedRecurringTuplesJoin(
 		RelOptInfo *innerrel = joinRestriction->innerrel;
 		RelOptInfo *outerrel = joinRestriction->outerrel;
 
+		if (joinType == JOIN_LEFT && referenceTableOuterJoinsAreSafe)
+		{
+			/* each reference table row is only returned by the task of one shard */
+			continue;
+		}
+
 		if (joinType == JOIN_SEMI || joinType == JOIN_ANTI || joinType == JOIN_LEFT)
 		{
 			/*
@@ -855,6 +881,368 @@ DeferredErrorIfUnsupportedRecurringTuplesJoin(
 }
 
 
+/*
+ * ReferenceTableOuterJoinsArePushdownSafe returns true if
+ * citus.enable_reference_table_outer_join_pushdown is enabled and the given
+ * SELECT query can be pushed down even though its outer joins have reference
+ * tables on their outer side. That is the case if every outer join in the query
+ * is a left or right join of a reference table with a hash distributed table on
+ * its distribution column in the FROM clause of the query itself.
+ *
+ * The task of each shard then only returns the rows of the reference table
+ * whose join column hashes into the range of that shard, see
+ * RestrictReferenceTableOuterJoinsToShard(). Since a row can only match rows
+ * in that shard, every row of the reference table is returned exactly once,
+ * either joined or with NULLs. Grouping by the distribution column, window
+ * functions, set operations and subqueries in WHERE could still see the
+ * unmatched rows of several shards, so we do not allow them.
+ */
+bool
+ReferenceTableOuterJoinsArePushdownSafe(Query *query)
+{
+	List *queryList = NIL;
+	List *outerJoinExprList = NIL;
+
+	if (!EnableReferenceTableOuterJoinPushdown || query->commandType != CMD_SELECT)
+	{
+		return false;
+	}
+
+	if (query->hasSubLinks || query->hasWindowFuncs || query->setOperations != NULL ||
+		query->groupingSets != NIL)
+	{
+		return false;
+	}
+
+	/* outer joins in subqueries keep their usual restrictions */
+	ExtractQueryWalker((Node *) query, &queryList);
+
+	Query *subquery = NULL;
+	foreach_ptr(subquery, queryList)
+	{
+		if (subquery != query &&
+			FindNodeCheck((Node *) subquery->jointree, IsOuterJoinExpr))
+		{
+			return false;
+		}
+	}
+
+	ExtractOuterJoinExprWalker((Node *) query->jointree, &outerJoinExprList);
+	if (outerJoinExprList == NIL)
+	{
+		return false;
+	}
+
+	JoinExpr *joinExpr = NULL;
+	foreach_ptr(joinExpr, outerJoinExprList)
+	{
+		Var *referenceColumn = NULL;
+		Var *distributionColumn = NULL;
+
+		if (!ReferenceTableOuterJoinColumns(query, joinExpr, &referenceColumn,
+											&distributionColumn))
+		{
+			return false;
+		}
+
+		/* every shard could return a group of unmatched rows */
+		List *groupingClauseList = list_concat(list_copy(query->groupClause),
+											   query->distinctClause);
+
+		SortGroupClause *groupingClause = NULL;
+		foreach_ptr(groupingClause, groupingClauseList)
+		{
+			TargetEntry *groupingEntry = get_sortgroupclause_tle(groupingClause,
+																 query->targetList);
+			List *groupingColumnList = pull_var_clause_default(
+				(Node *) groupingEntry->expr);
+
+			if (list_member(groupingColumnList, distributionColumn))
+			{
+				return false;
+			}
+		}
+	}
+
+	return true;
+}
+
+
+/*
+ * HasReferenceTableOuterJoin returns true if a query in the given query tree
+ * has an outer join that RestrictReferenceTableOuterJoinsToShard() restricts.
+ */
+bool
+HasReferenceTableOuterJoin(Query *query)
+{
+	List *queryList = NIL;
+
+	ExtractQueryWalker((Node *) query, &queryList);
+
+	Query *subquery = NULL;
+	foreach_ptr(subquery, queryList)
+	{
+		List *outerJoinExprList = NIL;
+
+		ExtractOuterJoinExprWalker((Node *) subquery->jointree, &outerJoinExprList);
+
+		JoinExpr *joinExpr = NULL;
+		foreach_ptr(joinExpr, outerJoinExprList)
+		{
+			Var *referenceColumn = NULL;
+			Var *distributionColumn = NULL;
+
+			if (ReferenceTableOuterJoinColumns(subquery, joinExpr, &referenceColumn,
+											   &distributionColumn))
+			{
+				return true;
+			}
+		}
+	}
+
+	return false;
+}
+
+
+/*
+ * RestrictReferenceTableOuterJoinsToShard adds a filter to each query in the
+ * given query tree that has a reference table on the outer side of an outer
+ * join with a distributed table, as ReferenceTableOuterJoinsArePushdownSafe()
+ * allows. The filter keeps the rows of the reference table whose join column
+ * hashes into the range of the shard with the given index. Rows with NULLs in
+ * the join column never match and are kept by the first shard.
+ *
+ * The filter is added to the WHERE clause of the query, which is equivalent
+ * to filtering the reference table before the join, since the reference table
+ * is on the outer side of all outer joins that are allowed.
+ */
+void
+RestrictReferenceTableOuterJoinsToShard(Query *query, int shardIndex)
+{
+	List *queryList = NIL;
+
+	ExtractQueryWalker((Node *) query, &queryList);
+
+	Query *subquery = NULL;
+	foreach_ptr(subquery, queryList)
+	{
+		List *outerJoinExprList = NIL;
+
+		ExtractOuterJoinExprWalker((Node *) subquery->jointree, &outerJoinExprList);
+
+		JoinExpr *joinExpr = NULL;
+		foreach_ptr(joinExpr, outerJoinExprList)
+		{
+			Var *referenceColumn = NULL;
+			Var *distributionColumn = NULL;
+
+			if (!ReferenceTableOuterJoinColumns(subquery, joinExpr, &referenceColumn,
+												&distributionColumn))
+			{
+				continue;
+			}
+
+			RangeTblEntry *distributedEntry = rt_fetch(distributionColumn->varno,
+													   subquery->rtable);
+			CitusTableCacheEntry *cacheEntry =
+				GetCitusTableCacheEntry(distributedEntry->relid);
+			ShardInterval *shardInterval =
+				cacheEntry->sortedShardIntervalArray[shardIndex];
+
+			Expr *shardRestriction = ShardIntervalRestrictionExpression(
+				copyObject(referenceColumn), shardInterval);
+
+			if (shardIndex == 0)
+			{
+				NullTest *nullTest = makeNode(NullTest);
+				nullTest->arg = (Expr *) copyObject(referenceColumn);
+				nullTest->nulltesttype = IS_NULL;
+				nullTest->argisrow = false;
+				nullTest->location = -1;
+
+				shardRestriction = make_orclause(list_make2(nullTest,
+															shardRestriction));
+			}
+
+			Node *quals = subquery->jointree->quals;
+			if (quals == NULL)
+			{
+				subquery->jointree->quals = (Node *) shardRestriction;
+			}
+			else if (IsA(quals, List))
+			{
+				subquery->jointree->quals = (Node *) lappend((List *) quals,
+															 shardRestriction);
+			}
+			else
+			{
+				subquery->jointree->quals = make_and_qual(quals,
+														  (Node *) shardRestriction);
+			}
+		}
+	}
+}
+
+
+/*
+ * ExtractOuterJoinExprWalker collects the outer joins in the given join tree,
+ * without descending into subqueries.
+ */
+static bool
+ExtractOuterJoinExprWalker(Node *node, List **outerJoinExprList)
+{
+	if (node == NULL)
+	{
+		return false;
+	}
+
+	if (IsA(node, Query))
+	{
+		return false;
+	}
+
+	if (IsOuterJoinExpr(node))
+	{
+		*outerJoinExprList = lappend(*outerJoinExprList, node);
+	}
+
+	return expression_tree_walker(node, ExtractOuterJoinExprWalker,
+								  outerJoinExprList);
+}
+
+
+/*
+ * ReferenceTableOuterJoinColumns returns true if the given join is a left or
+ * right join with a reference table on its outer side and a hash distributed
+ * table on its inner side, and its join clause contains an equality between a
+ * column of the reference table and the distribution column. In that case,
+ * the two columns are returned.
+ *
+ * The columns need to have the same type, such that the reference table
+ * column is hashed in the same way as the distribution column.
+ */
+static bool
+ReferenceTableOuterJoinColumns(Query *query, JoinExpr *joinExpr, Var **referenceColumn,
+							   Var **distributionColumn)
+{
+	Node *outerNode = NULL;
+	Node *innerNode = NULL;
+
+	if (joinExpr->jointype == JOIN_LEFT)
+	{
+		outerNode = joinExpr->larg;
+		innerNode = joinExpr->rarg;
+	}
+	else if (joinExpr->jointype == JOIN_RIGHT)
+	{
+		outerNode = joinExpr->rarg;
+		innerNode = joinExpr->larg;
+	}
+	else
+	{
+		return false;
+	}
+
+	if (!IsA(outerNode, RangeTblRef) || !IsA(innerNode, RangeTblRef))
+	{
+		return false;
+	}
+
+	int outerIndex = ((RangeTblRef *) outerNode)->rtindex;
+	int innerIndex = ((RangeTblRef *) innerNode)->rtindex;
+	RangeTblEntry *outerEntry = rt_fetch(outerIndex, query->rtable);
+	RangeTblEntry *innerEntry = rt_fetch(innerIndex, query->rtable);
+
+	if (outerEntry->rtekind != RTE_RELATION || !IsCitusTable(outerEntry->relid) ||
+		PartitionMethod(outerEntry->relid) != DISTRIBUTE_BY_NONE)
+	{
+		return false;
+	}
+
+	if (innerEntry->rtekind != RTE_RELATION || !IsCitusTable(innerEntry->relid) ||
+		PartitionMethod(innerEntry->relid) != DISTRIBUTE_BY_HASH)
+	{
+		return false;
+	}
+
+	Var *partitionColumn = PartitionColumn(innerEntry->relid, innerIndex);
+
+	List *joinClauseList = NIL;
+	if (joinExpr->quals != NULL && IsA(joinExpr->quals, List))
+	{
+		joinClauseList = (List *) joinExpr->quals;
+	}
+	else
+	{
+		joinClauseList = make_ands_implicit((Expr *) joinExpr->quals);
+	}
+
+	Node *joinClause = NULL;
+	foreach_ptr(joinClause, joinClauseList)
+	{
+		if (!IsA(joinClause, OpExpr) || list_length(((OpExpr *) joinClause)->args) != 2)
+		{
+			continue;
+		}
+
+		OpExpr *joinOpExpr = (OpExpr *) joinClause;
+		Node *leftArgument = linitial(joinOpExpr->args);
+		Node *rightArgument = lsecond(joinOpExpr->args);
+
+		if (!IsA(leftArgument, Var) || !IsA(rightArgument, Var))
+		{
+			continue;
+		}
+
+		Var *leftColumn = (Var *) leftArgument;
+		Var *rightColumn = (Var *) rightArgument;
+		Var *outerColumn = NULL;
+		Var *innerColumn = NULL;
+
+		if (leftColumn->varlevelsup != 0 || rightColumn->varlevelsup != 0)
+		{
+			continue;
+		}
+
+		if (leftColumn->varno == outerIndex && rightColumn->varno == innerIndex)
+		{
+			outerColumn = leftColumn;
+			innerColumn = rightColumn;
+		}
+		else if (leftColumn->varno == innerIndex && rightColumn->varno == outerIndex)
+		{
+			outerColumn = rightColumn;
+			innerColumn = leftColumn;
+		}
+		else
+		{
+			continue;
+		}
+
+		if (innerColumn->varattno != partitionColumn->varattno ||
+			outerColumn->vartype != innerColumn->vartype)
+		{
+			continue;
+		}
+
+		/* the shards are hashed by the hash function that matches this equality */
+		TypeCacheEntry *typeEntry = lookup_type_cache(innerColumn->vartype,
+													  TYPECACHE_EQ_OPR);
+		if (joinOpExpr->opno != typeEntry->eq_opr)
+		{
+			continue;
+		}
+
+		*referenceColumn = outerColumn;
+		*distributionColumn = innerColumn;
+
+		return true;
+	}
+
+	return false;
+}
+
+
 /*
  * DeferErrorIfCannotPushdownSubquery checks if we can push down the given
  * subquery to worker nodes. If we cannot push down the subquery, this function
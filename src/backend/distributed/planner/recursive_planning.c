@@ -70,11 +70,17 @@
 #include "distributed/query_pushdown_planning.h"
 #include "distributed/recursive_planning.h"
 #include "distributed/relation_restriction_equivalence.h"
+#include "distributed/subplan_execution.h"
 #include "distributed/log_utils.h"
 #include "distributed/version_compat.h"
 #include "lib/stringinfo.h"
 #include "optimizer/planner.h"
 #include "optimizer/prep.h"
+#if PG_VERSION_NUM >= 120000
+#include "optimizer/optimizer.h"
+#else
+#include "optimizer/clauses.h"
+#endif
 #include "parser/parsetree.h"
 #include "nodes/makefuncs.h"
 #include "nodes/nodeFuncs.h"
@@ -88,11 +94,21 @@
 #endif
 #include "utils/builtins.h"
 #include "utils/guc.h"
+#include "utils/lsyscache.h"
 
 
 /* track depth of current recursive planner query */
 static int recursivePlanningDepth = 0;
 
+/* GUC, whether columns of CTEs that are not referenced are left out of subplans */
+bool EnableCTEColumnPruning = false;
+
+/*
+ * GUC, size in kB below which distributed tables that are not joined on their
+ * distribution column are broadcast as intermediate results, 0 disables it
+ */
+int BroadcastJoinThreshold = 0;
+
 /*
  * RecursivePlanningContext is used to recursively plan subqueries
  * and CTEs, pull results to the coordinator, and push it back into
@@ -118,6 +134,25 @@ typedef struct CteReferenceWalkerContext
 	List *cteReferenceList;
 } CteReferenceWalkerContext;
 
+/*
+ * CteColumnUsageWalkerContext is used to find the columns of a CTE that are
+ * referenced in the query, in CteColumnUsageWalker.
+ */
+typedef struct CteColumnUsageWalkerContext
+{
+	/* name of the CTE, which is defined in the top-level query */
+	char *cteName;
+
+	/* queries that are being walked, from the top-level query down */
+	List *queryStack;
+
+	/* attribute numbers of the referenced columns */
+	Bitmapset *usedColumns;
+
+	/* whether the CTE is referenced as a whole row */
+	bool wholeRowUsed;
+} CteColumnUsageWalkerContext;
+
 /*
  * VarLevelsUpWalkerContext is used to find Vars in a (sub)query that
  * refer to upper levels and therefore cannot be planned separately.
@@ -129,6 +164,7 @@ typedef struct VarLevelsUpWalkerContext
 
 
 /* local function forward declarations */
+static bool QueryMayNeedRecursivePlanning(Query *query);
 static DeferredErrorMessage * RecursivelyPlanSubqueriesAndCTEs(Query *query,
 															   RecursivePlanningContext *
 															   context);
@@ -170,12 +206,21 @@ static void RecursivelyPlanSubquery(Query *subquery,
 									RecursivePlanningContext *planningContext);
 static DistributedSubPlan * CreateDistributedSubPlan(uint32 subPlanId,
 													 Query *subPlanQuery);
+static bool ContainsParamWalker(Node *node, void *context);
 static bool CteReferenceListWalker(Node *node, CteReferenceWalkerContext *context);
+static void RemoveUnusedCteColumns(Query *query, CommonTableExpr *cte);
+static bool CteColumnUsageWalker(Node *node, CteColumnUsageWalkerContext *context);
 static bool ContainsReferencesToOuterQuery(Query *query);
 static bool ContainsReferencesToOuterQueryWalker(Node *node,
 												 VarLevelsUpWalkerContext *context);
 static bool NodeContainsSubqueryReferencingOuterQuery(Node *node);
 static void WrapFunctionsInSubqueries(Query *query);
+static void RecursivelyPlanSmallDistributedTables(Query *query,
+												  RecursivePlanningContext *context);
+static bool ShouldBroadcastDistributedTables(Query *query,
+											 RecursivePlanningContext *context);
+static bool RelationHasDroppedColumns(RangeTblEntry *rangeTableEntry);
+static void TransformRelationRTEIntoSubquery(RangeTblEntry *rangeTableEntry);
 static void TransformFunctionRTE(RangeTblEntry *rangeTblEntry);
 static bool ShouldTransformRTE(RangeTblEntry *rangeTableEntry);
 static Query * BuildReadIntermediateResultsQuery(List *targetEntryList,
@@ -196,6 +241,16 @@ GenerateSubplansForSubqueriesAndCTEs(uint64 planId, Query *originalQuery,
 {
 	RecursivePlanningContext context;
 
+	if (!QueryMayNeedRecursivePlanning(originalQuery))
+	{
+		/*
+		 * Avoid the costly distribution key equality check below for queries
+		 * that only join relations, which is common for short queries that the
+		 * router planner could not handle.
+		 */
+		return NIL;
+	}
+
 	recursivePlanningDepth++;
 
 	/*
@@ -220,7 +275,8 @@ GenerateSubplansForSubqueriesAndCTEs(uint64 planId, Query *originalQuery,
 	 * each each subquery and subquery joins among subqueries.
 	 */
 	context.allDistributionKeysInQueryAreEqual =
-		AllDistributionKeysInQueryAreEqual(originalQuery, plannerRestrictionContext);
+		AllDistributionKeysInTopLevelQueryAreEqual(originalQuery,
+												   plannerRestrictionContext);
 
 	DeferredErrorMessage *error = RecursivelyPlanSubqueriesAndCTEs(originalQuery,
 																   &context);
@@ -246,6 +302,44 @@ GenerateSubplansForSubqueriesAndCTEs(uint64 planId, Query *originalQuery,
 }
 
 
+/*
+ * QueryMayNeedRecursivePlanning returns false if the query has nothing that
+ * RecursivelyPlanSubqueriesAndCTEs() could plan, that is, no CTEs, sublinks,
+ * set operations, subqueries or functions in the FROM clause. It only looks at
+ * the top level of the query, since any lower level is reached via one of those.
+ */
+static bool
+QueryMayNeedRecursivePlanning(Query *query)
+{
+	if (query->cteList != NIL || query->hasSubLinks || query->setOperations != NULL)
+	{
+		return true;
+	}
+
+	int relationCount = 0;
+	RangeTblEntry *rangeTableEntry = NULL;
+	foreach_ptr(rangeTableEntry, query->rtable)
+	{
+		if (rangeTableEntry->rtekind == RTE_RELATION)
+		{
+			relationCount++;
+		}
+		else if (rangeTableEntry->rtekind != RTE_JOIN)
+		{
+			return true;
+		}
+	}
+
+	/* small tables in a join might be broadcast as intermediate results */
+	if (BroadcastJoinThreshold > 0 && relationCount > 1)
+	{
+		return true;
+	}
+
+	return false;
+}
+
+
 /*
  * RecursivelyPlanSubqueriesAndCTEs finds subqueries and CTEs that cannot be pushed down to
  * workers directly and instead plans them by recursively calling the planner and
@@ -287,6 +381,9 @@ RecursivelyPlanSubqueriesAndCTEs(Query *query, RecursivePlanningContext *context
 	/* make sure function calls in joins are executed in the coordinator */
 	WrapFunctionsInSubqueries(query);
 
+	/* broadcast small tables that are not joined on the distribution column */
+	RecursivelyPlanSmallDistributedTables(query, context);
+
 	/* descend into subqueries */
 	query_tree_walker(query, RecursivelyPlanSubqueryWalker, context, 0);
 
@@ -745,6 +842,11 @@ RecursivelyPlanCTEs(Query *query, RecursivePlanningContext *planningContext)
 									ApplyLogRedaction(subPlanString->data))));
 		}
 
+		if (EnableCTEColumnPruning)
+		{
+			RemoveUnusedCteColumns(query, cte);
+		}
+
 		/* build a sub plan for the CTE */
 		DistributedSubPlan *subPlan = CreateDistributedSubPlan(subPlanId, subquery);
 		planningContext->subPlanList = lappend(planningContext->subPlanList, subPlan);
@@ -1168,8 +1270,28 @@ static DistributedSubPlan *
 CreateDistributedSubPlan(uint32 subPlanId, Query *subPlanQuery)
 {
 	int cursorOptions = 0;
+	char *queryFingerprint = NULL;
+	bool readsIntermediateResults =
+		ContainsReadIntermediateResultFunction((Node *) subPlanQuery);
+
+	/*
+	 * Results of read-only subplans that do not depend on other results can
+	 * be reused by identical subplans later in the same transaction, which
+	 * we recognise by the deparsed query. The deparsed query does not include
+	 * the values of parameters, so subplans with parameters are not reused.
+	 */
+	if (EnableIntermediateResultCache && subPlanQuery->commandType == CMD_SELECT &&
+		!subPlanQuery->hasModifyingCTE && subPlanQuery->rowMarks == NIL &&
+		!readsIntermediateResults &&
+		!contain_volatile_functions((Node *) subPlanQuery) &&
+		!ContainsParamWalker((Node *) subPlanQuery, NULL))
+	{
+		StringInfo subPlanString = makeStringInfo();
+		pg_get_query_def(subPlanQuery, subPlanString);
+		queryFingerprint = subPlanString->data;
+	}
 
-	if (ContainsReadIntermediateResultFunction((Node *) subPlanQuery))
+	if (readsIntermediateResults)
 	{
 		/*
 		 * Make sure we go through distributed planning if there are
@@ -1185,11 +1307,37 @@ CreateDistributedSubPlan(uint32 subPlanId, Query *subPlanQuery)
 	DistributedSubPlan *subPlan = CitusMakeNode(DistributedSubPlan);
 	subPlan->plan = planner(subPlanQuery, cursorOptions, NULL);
 	subPlan->subPlanId = subPlanId;
+	subPlan->queryFingerprint = queryFingerprint;
 
 	return subPlan;
 }
 
 
+/*
+ * ContainsParamWalker returns true if the given expression or query, including
+ * its subqueries, contains a Param.
+ */
+static bool
+ContainsParamWalker(Node *node, void *context)
+{
+	if (node == NULL)
+	{
+		return false;
+	}
+
+	if (IsA(node, Param))
+	{
+		return true;
+	}
+	else if (IsA(node, Query))
+	{
+		return query_tree_walker((Query *) node, ContainsParamWalker, context, 0);
+	}
+
+	return expression_tree_walker(node, ContainsParamWalker, context);
+}
+
+
 /*
  * CteReferenceListWalker finds all references to CTEs in the top level of a query
  * and adds them to context->cteReferenceList.
@@ -1234,6 +1382,128 @@ CteReferenceListWalker(Node *node, CteReferenceWalkerContext *context)
 }
 
 
+/*
+ * RemoveUnusedCteColumns replaces the target entries of the given CTE that
+ * are not referenced anywhere in the query by NULL constants of the same
+ * type, such that the intermediate result of the CTE only carries the
+ * columns that are read. The CTE keeps its columns, hence the references to
+ * the other columns remain valid.
+ *
+ * The checks follow remove_unused_subquery_outputs() in PostgreSQL, which
+ * does the same for subqueries in FROM.
+ */
+static void
+RemoveUnusedCteColumns(Query *query, CommonTableExpr *cte)
+{
+	Query *cteQuery = (Query *) cte->ctequery;
+	ListCell *targetEntryCell = NULL;
+
+	if (cteQuery->commandType != CMD_SELECT ||
+		cteQuery->setOperations != NULL ||
+		cteQuery->distinctClause != NIL ||
+		cteQuery->hasTargetSRFs)
+	{
+		/* every column affects the rows that the CTE returns */
+		return;
+	}
+
+	CteColumnUsageWalkerContext context = { 0 };
+	context.cteName = cte->ctename;
+
+	CteColumnUsageWalker((Node *) query, &context);
+
+	if (context.wholeRowUsed)
+	{
+		return;
+	}
+
+	foreach(targetEntryCell, cteQuery->targetList)
+	{
+		TargetEntry *targetEntry = (TargetEntry *) lfirst(targetEntryCell);
+		Node *targetExpr = (Node *) targetEntry->expr;
+
+		if (targetEntry->resjunk || targetEntry->ressortgroupref != 0)
+		{
+			/* junk columns are not in the result, others are used for sorting */
+			continue;
+		}
+
+		if (bms_is_member(targetEntry->resno, context.usedColumns))
+		{
+			continue;
+		}
+
+		if (IsA(targetExpr, Const) || contain_volatile_functions(targetExpr))
+		{
+			continue;
+		}
+
+		targetEntry->expr = (Expr *) makeNullConst(exprType(targetExpr),
+												   exprTypmod(targetExpr),
+												   exprCollation(targetExpr));
+	}
+}
+
+
+/*
+ * CteColumnUsageWalker adds the attribute numbers of the columns of the CTE
+ * in context->cteName that are referenced in the walked query tree to
+ * context->usedColumns.
+ */
+static bool
+CteColumnUsageWalker(Node *node, CteColumnUsageWalkerContext *context)
+{
+	if (node == NULL)
+	{
+		return false;
+	}
+
+	if (IsA(node, Var))
+	{
+		Var *column = (Var *) node;
+		int queryLevel = list_length(context->queryStack) - 1 - column->varlevelsup;
+
+		if (queryLevel < 0)
+		{
+			return false;
+		}
+
+		Query *query = (Query *) list_nth(context->queryStack, queryLevel);
+		RangeTblEntry *rangeTableEntry = rt_fetch(column->varno, query->rtable);
+
+		if (rangeTableEntry->rtekind == RTE_CTE &&
+			rangeTableEntry->ctelevelsup == queryLevel &&
+			strncmp(rangeTableEntry->ctename, context->cteName, NAMEDATALEN) == 0)
+		{
+			if (column->varattno == InvalidAttrNumber)
+			{
+				context->wholeRowUsed = true;
+			}
+			else
+			{
+				context->usedColumns = bms_add_member(context->usedColumns,
+													  column->varattno);
+			}
+		}
+
+		return false;
+	}
+	else if (IsA(node, Query))
+	{
+		Query *query = (Query *) node;
+
+		context->queryStack = lappend(context->queryStack, query);
+		query_tree_walker(query, CteColumnUsageWalker, context, 0);
+		context->queryStack = list_truncate(context->queryStack,
+											list_length(context->queryStack) - 1);
+
+		return false;
+	}
+
+	return expression_tree_walker(node, CteColumnUsageWalker, context);
+}
+
+
 /*
  * ContainsReferencesToOuterQuery determines whether the given query contains
  * anything that points outside of the query itself. Such queries cannot be
@@ -1384,6 +1654,209 @@ WrapFunctionsInSubqueries(Query *query)
 }
 
 
+/*
+ * RecursivelyPlanSmallDistributedTables replaces the distributed tables of the
+ * query whose size, as recorded in pg_dist_placement, is below
+ * citus.broadcast_join_threshold by an intermediate result. Since intermediate
+ * results are broadcast to all workers, the remaining join can be pushed down
+ * to the shards of the other tables instead of repartitioning both sides of the
+ * join. The largest distributed table of the query is always kept, such that
+ * the query remains distributed.
+ */
+static void
+RecursivelyPlanSmallDistributedTables(Query *query, RecursivePlanningContext *context)
+{
+	if (!ShouldBroadcastDistributedTables(query, context))
+	{
+		return;
+	}
+
+	uint64 thresholdInBytes = (uint64) BroadcastJoinThreshold * 1024;
+	RangeTblEntry *largestRangeTableEntry = NULL;
+	uint64 largestRelationSize = 0;
+	List *smallRangeTableEntryList = NIL;
+
+	RangeTblEntry *rangeTableEntry = NULL;
+	foreach_ptr(rangeTableEntry, query->rtable)
+	{
+		uint64 relationSize = 0;
+
+		if (rangeTableEntry->rtekind != RTE_RELATION ||
+			!IsCitusTable(rangeTableEntry->relid) ||
+			PartitionMethod(rangeTableEntry->relid) == DISTRIBUTE_BY_NONE)
+		{
+			continue;
+		}
+
+		/* tables without recorded size are considered large */
+		if (!RelationSizeFromShardStatistics(rangeTableEntry->relid, &relationSize))
+		{
+			relationSize = PG_UINT64_MAX;
+		}
+
+		if (largestRangeTableEntry == NULL || relationSize > largestRelationSize)
+		{
+			/* the previous largest table may still be broadcast */
+			if (largestRangeTableEntry != NULL &&
+				largestRelationSize <= thresholdInBytes)
+			{
+				smallRangeTableEntryList = lappend(smallRangeTableEntryList,
+												   largestRangeTableEntry);
+			}
+
+			largestRangeTableEntry = rangeTableEntry;
+			largestRelationSize = relationSize;
+		}
+		else if (relationSize <= thresholdInBytes)
+		{
+			smallRangeTableEntryList = lappend(smallRangeTableEntryList,
+											   rangeTableEntry);
+		}
+	}
+
+	foreach_ptr(rangeTableEntry, smallRangeTableEntryList)
+	{
+		if (RelationHasDroppedColumns(rangeTableEntry))
+		{
+			continue;
+		}
+
+		TransformRelationRTEIntoSubquery(rangeTableEntry);
+		RecursivelyPlanSubquery(rangeTableEntry->subquery, context);
+	}
+}
+
+
+/*
+ * ShouldBroadcastDistributedTables returns true if small distributed tables
+ * of the given query may be replaced by intermediate results. We only do so
+ * for top-level SELECT queries with inner joins that are not already on the
+ * distribution column, since an intermediate result on the outer side of an
+ * outer join cannot be pushed down.
+ */
+static bool
+ShouldBroadcastDistributedTables(Query *query, RecursivePlanningContext *context)
+{
+	if (BroadcastJoinThreshold <= 0)
+	{
+		return false;
+	}
+
+	if (context->level != 0 || context->allDistributionKeysInQueryAreEqual)
+	{
+		return false;
+	}
+
+	if (query->commandType != CMD_SELECT || query->rowMarks != NIL)
+	{
+		return false;
+	}
+
+	int distributedTableCount = 0;
+	RangeTblEntry *rangeTableEntry = NULL;
+	foreach_ptr(rangeTableEntry, query->rtable)
+	{
+		if (rangeTableEntry->rtekind == RTE_JOIN &&
+			rangeTableEntry->jointype != JOIN_INNER)
+		{
+			return false;
+		}
+
+		if (rangeTableEntry->rtekind == RTE_RELATION &&
+			IsCitusTable(rangeTableEntry->relid) &&
+			PartitionMethod(rangeTableEntry->relid) != DISTRIBUTE_BY_NONE)
+		{
+			if (rangeTableEntry->tablesample != NULL)
+			{
+				return false;
+			}
+
+			distributedTableCount++;
+		}
+	}
+
+	return distributedTableCount > 1;
+}
+
+
+/*
+ * RelationHasDroppedColumns returns true if the relation of the given range
+ * table entry had any columns dropped, which the parser represents by empty
+ * column names.
+ */
+static bool
+RelationHasDroppedColumns(RangeTblEntry *rangeTableEntry)
+{
+	Value *columnName = NULL;
+	foreach_ptr(columnName, rangeTableEntry->eref->colnames)
+	{
+		if (strlen(strVal(columnName)) == 0)
+		{
+			return true;
+		}
+	}
+
+	return false;
+}
+
+
+/*
+ * TransformRelationRTEIntoSubquery wraps a given relation RangeTableEntry
+ * inside a (SELECT <all columns> FROM relation) subquery. The target list
+ * follows the attribute numbers of the relation, such that Vars in the
+ * query that refer to the range table entry remain valid.
+ *
+ * The said RangeTableEntry is modified and now points to the new subquery.
+ */
+static void
+TransformRelationRTEIntoSubquery(RangeTblEntry *rangeTableEntry)
+{
+	Query *subquery = makeNode(Query);
+	RangeTblRef *newRangeTableRef = makeNode(RangeTblRef);
+	Oid relationId = rangeTableEntry->relid;
+	AttrNumber attributeNumber = 1;
+
+	subquery->commandType = CMD_SELECT;
+
+	/* copy the input rangeTableEntry to prevent cycles */
+	RangeTblEntry *newRangeTableEntry = copyObject(rangeTableEntry);
+
+	/* set the FROM expression to the subquery */
+	subquery->rtable = list_make1(newRangeTableEntry);
+	newRangeTableRef->rtindex = 1;
+	subquery->jointree = makeFromExpr(list_make1(newRangeTableRef), NULL);
+
+	Value *columnName = NULL;
+	foreach_ptr(columnName, rangeTableEntry->eref->colnames)
+	{
+		Oid columnType = InvalidOid;
+		int32 columnTypeMod = -1;
+		Oid columnCollation = InvalidOid;
+
+		get_atttypetypmodcoll(relationId, attributeNumber, &columnType,
+							  &columnTypeMod, &columnCollation);
+
+		Var *targetColumn = makeVar(1, attributeNumber, columnType, columnTypeMod,
+									columnCollation, 0);
+		TargetEntry *targetEntry = makeTargetEntry((Expr *) targetColumn,
+												   attributeNumber,
+												   pstrdup(strVal(columnName)), false);
+		subquery->targetList = lappend(subquery->targetList, targetEntry);
+
+		attributeNumber++;
+	}
+
+	/* permissions are checked on the relation inside the subquery */
+	rangeTableEntry->rtekind = RTE_SUBQUERY;
+	rangeTableEntry->subquery = subquery;
+	rangeTableEntry->relid = InvalidOid;
+	rangeTableEntry->relkind = 0;
+	rangeTableEntry->inh = false;
+	rangeTableEntry->requiredPerms = 0;
+	rangeTableEntry->values_lists = NIL;
+}
+
+
 /*
  * TransformFunctionRTE wraps a given function RangeTableEntry
  * inside a (SELECT * from function() f) subquery.
@@ -10,8 +10,10 @@
  */
 #include "postgres.h"
 
+#include "access/hash.h"
 #include "distributed/colocation_utils.h"
 #include "distributed/distributed_planner.h"
+#include "distributed/hash_helpers.h"
 #include "distributed/listutils.h"
 #include "distributed/metadata_cache.h"
 #include "distributed/multi_logical_planner.h"
@@ -19,6 +21,7 @@
 #include "distributed/pg_dist_partition.h"
 #include "distributed/query_utils.h"
 #include "distributed/relation_restriction_equivalence.h"
+#include "lib/ilist.h"
 #include "nodes/nodeFuncs.h"
 #include "nodes/pg_list.h"
 #include "nodes/primnodes.h"
@@ -29,9 +32,65 @@
 #endif
 #include "parser/parsetree.h"
 #include "optimizer/pathnode.h"
+#include "utils/memutils.h"
 
 static uint32 attributeEquivalenceId = 1;
 
+/* GUC, maximum number of distribution key equality results cached per backend */
+int MaxCachedRestrictionEquivalences = 0;
+
+
+/*
+ * RestrictionEquivalenceCacheEntry remembers whether all distribution keys
+ * are equal in a query that this backend planned earlier, such that the
+ * attribute equivalences do not need to be generated again when the same
+ * query is planned again, until the metadata of one of its tables changes.
+ */
+typedef struct RestrictionEquivalenceCacheEntry
+{
+	/* hash of the query and the relations, see RestrictionEquivalenceHash */
+	uint32 queryHash;
+
+	/* the relations in the planner restriction context, in order */
+	List *relationIdList;
+
+	/* the query (with resolved parameters) as it was passed to recursive planning */
+	Query *query;
+
+	bool allDistributionKeysInQueryAreEqual;
+
+	/* memory context that holds the entry */
+	MemoryContext memoryContext;
+
+	/* node in the entry list of the bucket */
+	dlist_node bucketNode;
+
+	/* node in RestrictionEquivalenceCacheList */
+	dlist_node cacheListNode;
+} RestrictionEquivalenceCacheEntry;
+
+
+/*
+ * RestrictionEquivalenceCacheBucket holds the cache entries with the same hash.
+ * Different queries can have the same hash, so the queries of the entries in
+ * a bucket are still compared.
+ */
+typedef struct RestrictionEquivalenceCacheBucket
+{
+	uint32 queryHash;
+	dlist_head entryList;
+} RestrictionEquivalenceCacheBucket;
+
+
+/* buckets of cache entries, by hash */
+static HTAB *RestrictionEquivalenceCacheHash = NULL;
+
+/* cache entries, the least recently used entry first */
+static dlist_head RestrictionEquivalenceCacheList =
+	DLIST_STATIC_INIT(RestrictionEquivalenceCacheList);
+static int RestrictionEquivalenceCacheCount = 0;
+static MemoryContext RestrictionEquivalenceCacheContext = NULL;
+
 
 /*
  * AttributeEquivalenceClass
@@ -151,6 +210,15 @@ static Relids QueryRteIdentities(Query *queryTree);
 static bool JoinRestrictionListExistsInContext(JoinRestriction *joinRestrictionInput,
 											   JoinRestrictionContext *
 											   joinRestrictionContext);
+static List * RestrictionContextRelationIdList(RelationRestrictionContext *
+											   restrictionContext);
+static uint32 RestrictionEquivalenceHash(Query *query, List *relationIdList);
+static void CacheRestrictionEquivalence(Query *query, List *relationIdList,
+										uint32 queryHash,
+										bool allDistributionKeysInQueryAreEqual);
+static void InitializeRestrictionEquivalenceCache(void);
+static void RemoveRestrictionEquivalenceCacheEntry(
+	RestrictionEquivalenceCacheEntry *cacheEntry);
 
 
 /*
@@ -194,6 +262,251 @@ AllDistributionKeysInQueryAreEqual(Query *originalQuery,
 }
 
 
+/*
+ * AllDistributionKeysInTopLevelQueryAreEqual is AllDistributionKeysInQueryAreEqual
+ * for the query that the planner restriction context was built for, as opposed to
+ * one of its subqueries. The result only depends on the query and the metadata of
+ * the tables in it, so it is remembered for when the same query is planned again,
+ * for instance on every execution of a prepared statement that gets custom plans.
+ */
+bool
+AllDistributionKeysInTopLevelQueryAreEqual(Query *originalQuery,
+										   PlannerRestrictionContext *
+										   plannerRestrictionContext)
+{
+	RelationRestrictionContext *restrictionContext =
+		plannerRestrictionContext->relationRestrictionContext;
+
+	if (MaxCachedRestrictionEquivalences <= 0 || originalQuery->cteList != NIL ||
+		ContextContainsLocalRelation(restrictionContext) ||
+		!ContainsMultipleDistributedRelations(plannerRestrictionContext))
+	{
+		/* the check is cheap for these queries */
+		return AllDistributionKeysInQueryAreEqual(originalQuery,
+												  plannerRestrictionContext);
+	}
+
+	List *relationIdList = RestrictionContextRelationIdList(restrictionContext);
+	uint32 queryHash = RestrictionEquivalenceHash(originalQuery, relationIdList);
+	bool found = false;
+
+	RestrictionEquivalenceCacheBucket *cacheBucket = NULL;
+	if (RestrictionEquivalenceCacheCount > 0)
+	{
+		cacheBucket = hash_search(RestrictionEquivalenceCacheHash, &queryHash,
+								  HASH_FIND, &found);
+	}
+
+	if (found)
+	{
+		dlist_iter iter;
+		dlist_foreach(iter, &cacheBucket->entryList)
+		{
+			RestrictionEquivalenceCacheEntry *cacheEntry =
+				dlist_container(RestrictionEquivalenceCacheEntry, bucketNode,
+								iter.cur);
+
+			if (!equal(cacheEntry->relationIdList, relationIdList) ||
+				!equal(cacheEntry->query, originalQuery))
+			{
+				continue;
+			}
+
+			/* move the entry to the end of the list, it was used most recently */
+			dlist_move_tail(&RestrictionEquivalenceCacheList,
+							&cacheEntry->cacheListNode);
+
+			ereport(DEBUG2, (errmsg("using cached distribution key equality of the "
+									"query")));
+
+			return cacheEntry->allDistributionKeysInQueryAreEqual;
+		}
+	}
+
+	bool allDistributionKeysInQueryAreEqual =
+		AllDistributionKeysInQueryAreEqual(originalQuery, plannerRestrictionContext);
+
+	/*
+	 * Queries that read intermediate results are planned once, the names of the
+	 * results are specific to the plan.
+	 */
+	if (!ContainsReadIntermediateResultFunction((Node *) originalQuery) &&
+		!ContainsReadIntermediateResultArrayFunction((Node *) originalQuery))
+	{
+		CacheRestrictionEquivalence(originalQuery, relationIdList, queryHash,
+									allDistributionKeysInQueryAreEqual);
+	}
+
+	return allDistributionKeysInQueryAreEqual;
+}
+
+
+/*
+ * RestrictionContextRelationIdList returns the relation ids of the relation
+ * restrictions in the given context, in the order of the restrictions.
+ */
+static List *
+RestrictionContextRelationIdList(RelationRestrictionContext *restrictionContext)
+{
+	List *relationIdList = NIL;
+
+	RelationRestriction *relationRestriction = NULL;
+	foreach_ptr(relationRestriction, restrictionContext->relationRestrictionList)
+	{
+		relationIdList = lappend_oid(relationIdList, relationRestriction->relationId);
+	}
+
+	return relationIdList;
+}
+
+
+/*
+ * RestrictionEquivalenceHash returns the hash of the given query and relations,
+ * which is the same for queries and relation lists that are equal().
+ */
+static uint32
+RestrictionEquivalenceHash(Query *query, List *relationIdList)
+{
+	uint32 queryHash = 0;
+
+	HashQueryTreeWalker((Node *) query, &queryHash);
+
+	Oid relationId = InvalidOid;
+	foreach_oid(relationId, relationIdList)
+	{
+		queryHash = hash_combine(queryHash, hash_uint32(relationId));
+	}
+
+	return queryHash;
+}
+
+
+/*
+ * CacheRestrictionEquivalence adds the distribution key equality of the given
+ * query to the cache, evicting the least recently used entries if needed.
+ */
+static void
+CacheRestrictionEquivalence(Query *query, List *relationIdList, uint32 queryHash,
+							bool allDistributionKeysInQueryAreEqual)
+{
+	if (RestrictionEquivalenceCacheHash == NULL)
+	{
+		InitializeRestrictionEquivalenceCache();
+	}
+
+	/* evict the least recently used entries */
+	while (RestrictionEquivalenceCacheCount > 0 &&
+		   RestrictionEquivalenceCacheCount >= MaxCachedRestrictionEquivalences)
+	{
+		RemoveRestrictionEquivalenceCacheEntry(
+			dlist_head_element(RestrictionEquivalenceCacheEntry, cacheListNode,
+							   &RestrictionEquivalenceCacheList));
+	}
+
+	MemoryContext entryContext =
+		AllocSetContextCreate(RestrictionEquivalenceCacheContext,
+							  "Restriction Equivalence Cache Entry",
+							  ALLOCSET_SMALL_SIZES);
+	MemoryContext oldContext = MemoryContextSwitchTo(entryContext);
+
+	RestrictionEquivalenceCacheEntry *cacheEntry =
+		palloc0(sizeof(RestrictionEquivalenceCacheEntry));
+	cacheEntry->queryHash = queryHash;
+	cacheEntry->relationIdList = list_copy(relationIdList);
+	cacheEntry->query = copyObject(query);
+	cacheEntry->allDistributionKeysInQueryAreEqual = allDistributionKeysInQueryAreEqual;
+	cacheEntry->memoryContext = entryContext;
+
+	MemoryContextSwitchTo(oldContext);
+
+	bool found = false;
+	RestrictionEquivalenceCacheBucket *cacheBucket =
+		hash_search(RestrictionEquivalenceCacheHash, &queryHash, HASH_ENTER, &found);
+	if (!found)
+	{
+		dlist_init(&cacheBucket->entryList);
+	}
+
+	dlist_push_tail(&cacheBucket->entryList, &cacheEntry->bucketNode);
+	dlist_push_tail(&RestrictionEquivalenceCacheList, &cacheEntry->cacheListNode);
+	RestrictionEquivalenceCacheCount++;
+}
+
+
+/*
+ * InitializeRestrictionEquivalenceCache creates the memory context and the
+ * hash table of the distribution key equality cache.
+ */
+static void
+InitializeRestrictionEquivalenceCache(void)
+{
+	HASHCTL info;
+
+	RestrictionEquivalenceCacheContext =
+		AllocSetContextCreate(CacheMemoryContext,
+							  "Restriction Equivalence Cache",
+							  ALLOCSET_DEFAULT_SIZES);
+
+	memset(&info, 0, sizeof(info));
+	info.keysize = sizeof(uint32);
+	info.entrysize = sizeof(RestrictionEquivalenceCacheBucket);
+	info.hcxt = RestrictionEquivalenceCacheContext;
+	int hashFlags = (HASH_ELEM | HASH_BLOBS | HASH_CONTEXT);
+
+	RestrictionEquivalenceCacheHash = hash_create("Restriction Equivalence Cache Hash",
+												  64, &info, hashFlags);
+}
+
+
+/*
+ * InvalidateRestrictionEquivalenceCache removes the cached distribution key
+ * equalities of queries on the given relation, or all of them if relationId
+ * is InvalidOid. It is called when the metadata of distributed tables changes.
+ */
+void
+InvalidateRestrictionEquivalenceCache(Oid relationId)
+{
+	dlist_mutable_iter iter;
+	dlist_foreach_modify(iter, &RestrictionEquivalenceCacheList)
+	{
+		RestrictionEquivalenceCacheEntry *cacheEntry =
+			dlist_container(RestrictionEquivalenceCacheEntry, cacheListNode,
+							iter.cur);
+
+		if (relationId == InvalidOid ||
+			list_member_oid(cacheEntry->relationIdList, relationId))
+		{
+			RemoveRestrictionEquivalenceCacheEntry(cacheEntry);
+		}
+	}
+}
+
+
+/*
+ * RemoveRestrictionEquivalenceCacheEntry removes an entry from the cache and
+ * frees its memory.
+ */
+static void
+RemoveRestrictionEquivalenceCacheEntry(RestrictionEquivalenceCacheEntry *cacheEntry)
+{
+	RestrictionEquivalenceCacheBucket *cacheBucket =
+		hash_search(RestrictionEquivalenceCacheHash, &cacheEntry->queryHash,
+					HASH_FIND, NULL);
+
+	dlist_delete(&cacheEntry->bucketNode);
+	dlist_delete(&cacheEntry->cacheListNode);
+	RestrictionEquivalenceCacheCount--;
+
+	if (cacheBucket != NULL && dlist_is_empty(&cacheBucket->entryList))
+	{
+		hash_search(RestrictionEquivalenceCacheHash, &cacheEntry->queryHash,
+					HASH_REMOVE, NULL);
+	}
+
+	MemoryContextDelete(cacheEntry->memoryContext);
+}
+
+
 /*
  * ContextContainsLocalRelation determines whether the given
  * RelationRestrictionContext contains any local tables.
@@ -92,6 +92,7 @@
 #include "utils/lsyscache.h"
 #include "utils/memutils.h"
 #include "utils/ruleutils.h"
+#include "utils/typcache.h"
 
 
 /*
@@ -249,6 +250,8 @@ static bool IsValidPartitionKeyRestriction(OpExpr *opClause);
 static void AddPartitionKeyRestrictionToInstance(ClauseWalkerContext *context,
 												 OpExpr *opClause, Var *varClause,
 												 Const *constantClause);
+static Var * RestrictionColumn(OpExpr *opClause, Node *operand, Var *partitionColumn);
+static bool IsIntegerTypeWideningCast(Oid sourceType, Oid targetType);
 static bool VarConstOpExprClause(OpExpr *opClause, Var *partitionColumn,
 								 Var **varClause, Const **constantClause);
 static Const * TransformPartitionRestrictionValue(Var *partitionColumn,
@@ -275,6 +278,9 @@ static List * PruneOne(CitusTableCacheEntry *cacheEntry, ClauseWalkerContext *co
 static List * PruneWithBoundaries(CitusTableCacheEntry *cacheEntry,
 								  ClauseWalkerContext *context,
 								  PruningInstance *prune);
+static List * PruneOverlappingWithBoundaries(CitusTableCacheEntry *cacheEntry,
+											 ClauseWalkerContext *context,
+											 PruningInstance *prune);
 static List * ExhaustivePrune(CitusTableCacheEntry *cacheEntry,
 							  ClauseWalkerContext *context,
 							  PruningInstance *prune);
@@ -903,17 +909,18 @@ VarConstOpExprClause(OpExpr *opClause, Var *partitionColumn, Var **varClause,
 		return false;
 	}
 
-	if (IsA(rightOperand, Const) && IsA(leftOperand, Var))
+	if (IsA(rightOperand, Const))
 	{
-		foundVarClause = (Var *) leftOperand;
+		foundVarClause = RestrictionColumn(opClause, leftOperand, partitionColumn);
 		foundConstantClause = (Const *) rightOperand;
 	}
-	else if (IsA(leftOperand, Const) && IsA(rightOperand, Var))
+	else if (IsA(leftOperand, Const))
 	{
-		foundVarClause = (Var *) rightOperand;
+		foundVarClause = RestrictionColumn(opClause, rightOperand, partitionColumn);
 		foundConstantClause = (Const *) leftOperand;
 	}
-	else
+
+	if (foundVarClause == NULL)
 	{
 		return false;
 	}
@@ -930,6 +937,80 @@ VarConstOpExprClause(OpExpr *opClause, Var *partitionColumn, Var **varClause,
 }
 
 
+/*
+ * RestrictionColumn returns the column that the given operand of a
+ * restriction refers to, or NULL if the operand is not a column.
+ *
+ * Implicit casts are already stripped from the operand. The column may also
+ * have an explicit cast that keeps the order of the values, such as a cast of
+ * a varchar column to text or of an integer column to bigint, as long as the
+ * operator is one of the comparison operators of the column type.
+ */
+static Var *
+RestrictionColumn(OpExpr *opClause, Node *operand, Var *partitionColumn)
+{
+	Node *castArgument = NULL;
+
+	if (IsA(operand, Var))
+	{
+		return (Var *) operand;
+	}
+	else if (IsA(operand, RelabelType))
+	{
+		/* binary-compatible casts do not change the value */
+		castArgument = (Node *) ((RelabelType *) operand)->arg;
+	}
+	else if (IsA(operand, FuncExpr) &&
+			 ((FuncExpr *) operand)->funcformat == COERCE_EXPLICIT_CAST &&
+			 list_length(((FuncExpr *) operand)->args) == 1)
+	{
+		FuncExpr *castExpr = (FuncExpr *) operand;
+		Node *argument = (Node *) linitial(castExpr->args);
+
+		if (IsIntegerTypeWideningCast(exprType(argument), castExpr->funcresulttype))
+		{
+			castArgument = argument;
+		}
+	}
+
+	if (castArgument == NULL || !IsA(castArgument, Var))
+	{
+		return NULL;
+	}
+
+	TypeCacheEntry *typeEntry = lookup_type_cache(partitionColumn->vartype,
+												  TYPECACHE_BTREE_OPFAMILY);
+	if (!OidIsValid(typeEntry->btree_opf) ||
+		!op_in_opfamily(opClause->opno, typeEntry->btree_opf))
+	{
+		return NULL;
+	}
+
+	return (Var *) castArgument;
+}
+
+
+/*
+ * IsIntegerTypeWideningCast returns whether a cast from the source type to the
+ * target type converts one integer type into a wider one, which keeps the
+ * value as is.
+ */
+static bool
+IsIntegerTypeWideningCast(Oid sourceType, Oid targetType)
+{
+	if (sourceType == INT2OID)
+	{
+		return targetType == INT4OID || targetType == INT8OID;
+	}
+	else if (sourceType == INT4OID)
+	{
+		return targetType == INT8OID;
+	}
+
+	return false;
+}
+
+
 /*
  * AddSAOPartitionKeyRestrictionToInstance adds partcol = arrayelem operator
  * restriction to the current pruning instance for each element of the array. These
@@ -1476,9 +1557,6 @@ PruneOne(CitusTableCacheEntry *cacheEntry, ClauseWalkerContext *context,
 	/*
 	 * Next method: binary search with fuzzy boundaries. Can't trivially do so
 	 * if shards have overlapping boundaries.
-	 *
-	 * TODO: If we kept shard intervals separately sorted by both upper and
-	 * lower boundaries, this should be possible?
 	 */
 	if (!cacheEntry->hasOverlappingShardInterval && (
 			prune->greaterConsts || prune->greaterEqualConsts ||
@@ -1487,6 +1565,18 @@ PruneOne(CitusTableCacheEntry *cacheEntry, ClauseWalkerContext *context,
 		return PruneWithBoundaries(cacheEntry, context, prune);
 	}
 
+	/*
+	 * With overlapping boundaries, binary search on the min values and on the
+	 * largest max value so far to narrow down the shards to check.
+	 */
+	if (cacheEntry->cumulativeMaxShardIndexArray != NULL && (
+			prune->equalConsts ||
+			prune->greaterConsts || prune->greaterEqualConsts ||
+			prune->lessConsts || prune->lessEqualConsts))
+	{
+		return PruneOverlappingWithBoundaries(cacheEntry, context, prune);
+	}
+
 	/*
 	 * Brute force: Check each shard.
 	 */
@@ -1794,6 +1884,138 @@ PruneWithBoundaries(CitusTableCacheEntry *cacheEntry, ClauseWalkerContext *conte
 }
 
 
+/*
+ * PruneOverlappingWithBoundaries returns the same shards as ExhaustivePrune for
+ * a table with overlapping shard intervals, but only checks the shards that
+ * are within the bounds of the constraints.
+ *
+ * Shards are sorted by their min value, so the ones whose min value is above
+ * the upper bound are at the end of the array. The largest max value so far
+ * (cumulativeMaxShardIndexArray) never decreases, so the shards before the
+ * first position where it reaches the lower bound all have smaller max values.
+ * Both positions are found with a binary search. Shards in between are checked
+ * one by one against all constraints, and shards without min/max values are
+ * always kept.
+ */
+static List *
+PruneOverlappingWithBoundaries(CitusTableCacheEntry *cacheEntry,
+							   ClauseWalkerContext *context,
+							   PruningInstance *prune)
+{
+	List *remainingShardList = NIL;
+	int shardCount = cacheEntry->shardIntervalArrayLength;
+	ShardInterval **sortedShardIntervalArray = cacheEntry->sortedShardIntervalArray;
+	int *cumulativeMaxShardIndexArray = cacheEntry->cumulativeMaxShardIndexArray;
+	int indexedShardCount = cacheEntry->cumulativeMaxShardIndexArrayLength;
+	FunctionCallInfo compareFunctionCall = (FunctionCallInfo) &
+										   context->compareIntervalFunctionCall;
+	int lowerBoundIdx = 0;
+	int upperBoundIdx = indexedShardCount - 1;
+
+	/*
+	 * Pick one lower and one upper bound, the other constraints are checked
+	 * for each remaining shard below.
+	 */
+	Const *lowerBoundConst = prune->equalConsts;
+	bool lowerBoundInclusive = true;
+	if (lowerBoundConst == NULL && prune->greaterEqualConsts != NULL)
+	{
+		lowerBoundConst = prune->greaterEqualConsts;
+	}
+	else if (lowerBoundConst == NULL && prune->greaterConsts != NULL)
+	{
+		lowerBoundConst = prune->greaterConsts;
+		lowerBoundInclusive = false;
+	}
+
+	Const *upperBoundConst = prune->equalConsts;
+	bool upperBoundInclusive = true;
+	if (upperBoundConst == NULL && prune->lessEqualConsts != NULL)
+	{
+		upperBoundConst = prune->lessEqualConsts;
+	}
+	else if (upperBoundConst == NULL && prune->lessConsts != NULL)
+	{
+		upperBoundConst = prune->lessConsts;
+		upperBoundInclusive = false;
+	}
+
+	if (lowerBoundConst != NULL)
+	{
+		/* find the first shard of which the largest max value so far is in range */
+		int lowIdx = 0;
+		int highIdx = indexedShardCount;
+
+		while (lowIdx < highIdx)
+		{
+			int middleIdx = lowIdx + ((highIdx - lowIdx) / 2);
+			ShardInterval *maxShardInterval =
+				sortedShardIntervalArray[cumulativeMaxShardIndexArray[middleIdx]];
+			int comparison = PerformValueCompare(compareFunctionCall,
+												 maxShardInterval->maxValue,
+												 lowerBoundConst->constvalue);
+
+			if (comparison > 0 || (comparison == 0 && lowerBoundInclusive))
+			{
+				highIdx = middleIdx;
+			}
+			else
+			{
+				lowIdx = middleIdx + 1;
+			}
+		}
+
+		lowerBoundIdx = lowIdx;
+	}
+
+	if (upperBoundConst != NULL)
+	{
+		/* find the first shard of which the min value is out of range */
+		int lowIdx = 0;
+		int highIdx = indexedShardCount;
+
+		while (lowIdx < highIdx)
+		{
+			int middleIdx = lowIdx + ((highIdx - lowIdx) / 2);
+			int comparison = PerformValueCompare(compareFunctionCall,
+												 sortedShardIntervalArray[middleIdx]->
+												 minValue,
+												 upperBoundConst->constvalue);
+
+			if (comparison > 0 || (comparison == 0 && !upperBoundInclusive))
+			{
+				highIdx = middleIdx;
+			}
+			else
+			{
+				lowIdx = middleIdx + 1;
+			}
+		}
+
+		upperBoundIdx = lowIdx - 1;
+	}
+
+	for (int curIdx = lowerBoundIdx; curIdx <= upperBoundIdx; curIdx++)
+	{
+		ShardInterval *curInterval = sortedShardIntervalArray[curIdx];
+
+		if (!ExhaustivePruneOne(curInterval, context, prune))
+		{
+			remainingShardList = lappend(remainingShardList, curInterval);
+		}
+	}
+
+	/* shards without min/max values cannot be pruned */
+	for (int curIdx = indexedShardCount; curIdx < shardCount; curIdx++)
+	{
+		remainingShardList = lappend(remainingShardList,
+									 sortedShardIntervalArray[curIdx]);
+	}
+
+	return remainingShardList;
+}
+
+
 /*
  * ExhaustivePrune returns a list of shards matching PruningInstances
  * constraints, by simply checking them for each individual shard.
@@ -0,0 +1,335 @@
+/*-------------------------------------------------------------------------
+ *
+ * command_progress.c
+ *    Tracking of the progress of long running COPY, INSERT..SELECT and
+ *    repartition queries, shown by citus_command_progress.
+ *
+ *    A command keeps a step for every shard it copies into, for every phase
+ *    of a repartitioned INSERT..SELECT, or for every job of a repartition
+ *    query in a progress monitor. The backend that runs the command updates
+ *    the counters of the steps while it runs, and other backends read them
+ *    without locking, such that the counters can be slightly behind.
+ *
+ * Copyright (c) Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include "postgres.h"
+
+#include "distributed/command_progress.h"
+#include "distributed/listutils.h"
+#include "distributed/metadata_cache.h"
+#include "distributed/tuplestore.h"
+#include "utils/builtins.h"
+#include "utils/memutils.h"
+
+
+#define CITUS_COMMAND_PROGRESS_COLUMNS 10
+
+
+/* progress of the command that is running in the current backend */
+static CommandProgress *CurrentCommandProgress = NULL;
+
+
+static void CommandProgressReturnRows(uint64 progressTypeMagicNumber,
+									  Tuplestorestate *tupleStore,
+									  TupleDesc tupleDescriptor);
+static char * CommandProgressCommandName(uint64 progressTypeMagicNumber);
+static char * CommandProgressStepName(CommandProgressStepType stepType);
+
+
+PG_FUNCTION_INFO_V1(citus_command_progress);
+
+
+/*
+ * StartCommandProgress creates a progress monitor with the given number of
+ * steps for the command that is about to run in the current backend. The
+ * caller fills in the type and id of every step.
+ *
+ * A backend can only have a single progress monitor, so the function returns
+ * NULL if the command is part of another command that is already monitored,
+ * or if no shared memory can be allocated for the monitor. The progress of
+ * the command is then not shown.
+ */
+CommandProgress *
+StartCommandProgress(uint64 progressTypeMagicNumber, Oid relationId, int stepCount)
+{
+	if (stepCount <= 0 || ProgressMonitorActive())
+	{
+		return NULL;
+	}
+
+	ProgressMonitorData *monitor =
+		CreateProgressMonitor(progressTypeMagicNumber, stepCount,
+							  sizeof(CommandProgressStep), relationId);
+	if (monitor == NULL)
+	{
+		return NULL;
+	}
+
+	/* outlive the memory contexts of the parts of the command */
+	CommandProgress *progress = MemoryContextAllocZero(TopTransactionContext,
+													   sizeof(CommandProgress));
+	progress->progressTypeMagicNumber = progressTypeMagicNumber;
+	progress->monitor = monitor;
+	progress->steps = (CommandProgressStep *) monitor->steps;
+	progress->stepCount = stepCount;
+
+	memset(progress->steps, 0, stepCount * sizeof(CommandProgressStep));
+
+	for (int stepIndex = 0; stepIndex < stepCount; stepIndex++)
+	{
+		progress->steps[stepIndex].relationId = relationId;
+	}
+
+	CurrentCommandProgress = progress;
+
+	return progress;
+}
+
+
+/*
+ * GetCurrentCommandProgress returns the progress of the command of the given
+ * type that is running in the current backend, or NULL if there is none.
+ */
+CommandProgress *
+GetCurrentCommandProgress(uint64 progressTypeMagicNumber)
+{
+	if (CurrentCommandProgress == NULL ||
+		CurrentCommandProgress->progressTypeMagicNumber != progressTypeMagicNumber)
+	{
+		return NULL;
+	}
+
+	return CurrentCommandProgress;
+}
+
+
+/*
+ * CommandProgressStepById returns the step of the given type and id, or NULL
+ * if progress is NULL or does not have such a step.
+ */
+CommandProgressStep *
+CommandProgressStepById(CommandProgress *progress, CommandProgressStepType stepType,
+						uint64 stepId)
+{
+	if (progress == NULL)
+	{
+		return NULL;
+	}
+
+	for (int stepIndex = 0; stepIndex < progress->stepCount; stepIndex++)
+	{
+		CommandProgressStep *step = &progress->steps[stepIndex];
+
+		if (step->stepType == stepType && step->stepId == stepId)
+		{
+			return step;
+		}
+	}
+
+	return NULL;
+}
+
+
+/*
+ * CommandProgressTasksCompleted is a TaskCompletedCallback for the adaptive
+ * executor that adds the completed tasks to the done tasks of the
+ * CommandProgressStep passed as the context. No new tasks are added to the
+ * execution.
+ */
+List *
+CommandProgressTasksCompleted(List *completedTaskList, void *context)
+{
+	CommandProgressStep *step = (CommandProgressStep *) context;
+
+	step->tasksDone += list_length(completedTaskList);
+
+	return NIL;
+}
+
+
+/*
+ * FinishCommandProgress removes the progress monitor of the command. It does
+ * nothing if progress is NULL, such that callers do not need to check whether
+ * the progress is monitored.
+ */
+void
+FinishCommandProgress(CommandProgress *progress)
+{
+	if (progress == NULL)
+	{
+		return;
+	}
+
+	if (progress->monitor != NULL)
+	{
+		FinalizeCurrentProgressMonitor();
+		progress->monitor = NULL;
+	}
+
+	if (CurrentCommandProgress == progress)
+	{
+		CurrentCommandProgress = NULL;
+	}
+}
+
+
+/*
+ * ResetCommandProgress forgets the progress of the current command when the
+ * (sub)transaction that runs it aborts. The progress monitor itself is
+ * released along with the resources of the transaction.
+ */
+void
+ResetCommandProgress(void)
+{
+	CurrentCommandProgress = NULL;
+}
+
+
+/*
+ * citus_command_progress returns the progress of every step of the COPY,
+ * INSERT..SELECT and repartition queries that are running on this node.
+ */
+Datum
+citus_command_progress(PG_FUNCTION_ARGS)
+{
+	TupleDesc tupleDescriptor = NULL;
+
+	CheckCitusVersion(ERROR);
+
+	Tuplestorestate *tupleStore = SetupTuplestore(fcinfo, &tupleDescriptor);
+
+	CommandProgressReturnRows(COPY_PROGRESS_MAGIC_NUMBER, tupleStore,
+							  tupleDescriptor);
+	CommandProgressReturnRows(INSERT_SELECT_PROGRESS_MAGIC_NUMBER, tupleStore,
+							  tupleDescriptor);
+	CommandProgressReturnRows(REPARTITION_QUERY_PROGRESS_MAGIC_NUMBER, tupleStore,
+							  tupleDescriptor);
+
+	tuplestore_donestoring(tupleStore);
+
+	PG_RETURN_VOID();
+}
+
+
+/*
+ * CommandProgressReturnRows adds a row for every step in the progress
+ * monitors with the given magic number to the tuple store.
+ */
+static void
+CommandProgressReturnRows(uint64 progressTypeMagicNumber, Tuplestorestate *tupleStore,
+						  TupleDesc tupleDescriptor)
+{
+	List *attachedDSMSegments = NIL;
+	List *monitorList = ProgressMonitorList(progressTypeMagicNumber,
+											&attachedDSMSegments);
+	char *commandName = CommandProgressCommandName(progressTypeMagicNumber);
+
+	ProgressMonitorData *monitor = NULL;
+	foreach_ptr(monitor, monitorList)
+	{
+		CommandProgressStep *steps = (CommandProgressStep *) monitor->steps;
+
+		for (int stepIndex = 0; stepIndex < monitor->stepCount; stepIndex++)
+		{
+			CommandProgressStep *step = &steps[stepIndex];
+			Datum values[CITUS_COMMAND_PROGRESS_COLUMNS];
+			bool isNulls[CITUS_COMMAND_PROGRESS_COLUMNS];
+
+			memset(values, 0, sizeof(values));
+			memset(isNulls, false, sizeof(isNulls));
+
+			values[0] = Int32GetDatum(monitor->processId);
+			values[1] = CStringGetTextDatum(commandName);
+			values[2] = ObjectIdGetDatum(step->relationId);
+			isNulls[2] = !OidIsValid(step->relationId);
+			values[3] = CStringGetTextDatum(CommandProgressStepName(step->stepType));
+			values[4] = Int64GetDatum(step->stepId);
+			values[5] = Int64GetDatum(step->tasksTotal);
+			values[6] = Int64GetDatum(step->tasksDone);
+			values[7] = Int64GetDatum(step->fragmentCount);
+			values[8] = Int64GetDatum(step->rowCount);
+			values[9] = Int64GetDatum(step->byteCount);
+
+			tuplestore_putvalues(tupleStore, tupleDescriptor, values, isNulls);
+		}
+	}
+
+	DetachFromDSMSegments(attachedDSMSegments);
+}
+
+
+/*
+ * CommandProgressCommandName returns the name of the command with the given
+ * magic number, as shown in citus_command_progress.
+ */
+static char *
+CommandProgressCommandName(uint64 progressTypeMagicNumber)
+{
+	switch (progressTypeMagicNumber)
+	{
+		case COPY_PROGRESS_MAGIC_NUMBER:
+		{
+			return "copy";
+		}
+
+		case INSERT_SELECT_PROGRESS_MAGIC_NUMBER:
+		{
+			return "insert_select";
+		}
+
+		case REPARTITION_QUERY_PROGRESS_MAGIC_NUMBER:
+		{
+			return "repartition_query";
+		}
+
+		default:
+		{
+			return "unknown";
+		}
+	}
+}
+
+
+/*
+ * CommandProgressStepName returns the name of the given step type, as shown
+ * in citus_command_progress.
+ */
+static char *
+CommandProgressStepName(CommandProgressStepType stepType)
+{
+	switch (stepType)
+	{
+		case COMMAND_PROGRESS_STEP_SHARD:
+		{
+			return "shard";
+		}
+
+		case COMMAND_PROGRESS_STEP_PARTITION:
+		{
+			return "partition";
+		}
+
+		case COMMAND_PROGRESS_STEP_FETCH:
+		{
+			return "fetch";
+		}
+
+		case COMMAND_PROGRESS_STEP_INSERT:
+		{
+			return "insert";
+		}
+
+		case COMMAND_PROGRESS_STEP_JOB:
+		{
+			return "job";
+		}
+
+		default:
+		{
+			return "unknown";
+		}
+	}
+}
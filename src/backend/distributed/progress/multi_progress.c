@@ -91,6 +91,19 @@ GetCurrentProgressMonitor(void)
 }
 
 
+/*
+ * ProgressMonitorActive returns whether the current backend has a progress
+ * monitor that was not finalized yet. A backend can only have a single
+ * progress monitor at a time.
+ */
+bool
+ProgressMonitorActive(void)
+{
+	return currentProgressDSMHandle != DSM_HANDLE_INVALID &&
+		   dsm_find_mapping(currentProgressDSMHandle) != NULL;
+}
+
+
 /*
  * FinalizeCurrentProgressMonitor releases the dynamic memory segment of the current
  * progress monitoring data structure and removes the process from
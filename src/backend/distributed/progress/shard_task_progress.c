@@ -0,0 +1,193 @@
+/*-------------------------------------------------------------------------
+ *
+ * shard_task_progress.c
+ *    Tracking of the progress of utility commands that run a task on every
+ *    shard of a distributed table, such as CREATE INDEX CONCURRENTLY and
+ *    VACUUM. Each shard is a step in a progress monitor, which is marked as
+ *    done once the task on the shard finished, such that other backends can
+ *    see how far a long running command got.
+ *
+ * Copyright (c) Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include "postgres.h"
+
+#include "distributed/listutils.h"
+#include "distributed/multi_physical_planner.h"
+#include "distributed/shard_task_progress.h"
+#include "distributed/tuplestore.h"
+#include "utils/builtins.h"
+
+
+static char * ShardTaskProgressStateName(ShardTaskProgressState state);
+
+
+/*
+ * StartShardTaskProgress creates a progress monitor with a step for the
+ * anchor shard of every task in the given list, all in the waiting state. If
+ * no shared memory can be allocated for the monitor, the progress is only
+ * kept in the current backend.
+ */
+ShardTaskProgressTracker *
+StartShardTaskProgress(uint64 progressTypeMagicNumber, List *taskList, Oid relationId)
+{
+	int taskCount = list_length(taskList);
+	ShardTaskProgressTracker *tracker = palloc0(sizeof(ShardTaskProgressTracker));
+
+	Assert(taskCount > 0);
+
+	tracker->monitor = CreateProgressMonitor(progressTypeMagicNumber, taskCount,
+											 sizeof(ShardTaskProgress), relationId);
+	if (tracker->monitor != NULL)
+	{
+		tracker->progressArray = (ShardTaskProgress *) tracker->monitor->steps;
+	}
+	else
+	{
+		tracker->progressArray = palloc(taskCount * sizeof(ShardTaskProgress));
+	}
+
+	memset(tracker->progressArray, 0, taskCount * sizeof(ShardTaskProgress));
+	tracker->progressCount = taskCount;
+
+	int taskIndex = 0;
+	Task *task = NULL;
+	foreach_ptr(task, taskList)
+	{
+		ShardTaskProgress *progress = &tracker->progressArray[taskIndex];
+
+		progress->shardId = task->anchorShardId;
+		progress->state = SHARD_TASK_PROGRESS_WAITING;
+
+		taskIndex++;
+	}
+
+	return tracker;
+}
+
+
+/*
+ * MarkShardTasksDone marks the anchor shards of the given tasks as done.
+ */
+void
+MarkShardTasksDone(ShardTaskProgressTracker *tracker, List *taskList)
+{
+	Task *task = NULL;
+	foreach_ptr(task, taskList)
+	{
+		for (int progressIndex = 0; progressIndex < tracker->progressCount;
+			 progressIndex++)
+		{
+			ShardTaskProgress *progress = &tracker->progressArray[progressIndex];
+
+			if (progress->shardId == task->anchorShardId)
+			{
+				progress->state = SHARD_TASK_PROGRESS_DONE;
+			}
+		}
+	}
+}
+
+
+/*
+ * ShardTaskProgressTasksCompleted is a TaskCompletedCallback for the adaptive
+ * executor that marks the shards of the completed tasks as done in the
+ * ShardTaskProgressTracker passed as the context. No new tasks are added to
+ * the execution.
+ */
+List *
+ShardTaskProgressTasksCompleted(List *completedTaskList, void *context)
+{
+	ShardTaskProgressTracker *tracker = (ShardTaskProgressTracker *) context;
+
+	MarkShardTasksDone(tracker, completedTaskList);
+
+	return NIL;
+}
+
+
+/*
+ * FinishShardTaskProgress removes the progress monitor of the tracker.
+ */
+void
+FinishShardTaskProgress(ShardTaskProgressTracker *tracker)
+{
+	if (tracker->monitor != NULL)
+	{
+		FinalizeCurrentProgressMonitor();
+		tracker->monitor = NULL;
+	}
+}
+
+
+/*
+ * ShardTaskProgressReturnRows returns the state of every shard in the progress
+ * monitors with the given magic number as the result set of the UDF that is
+ * called with fcinfo, with the columns pid, shardid and state.
+ */
+void
+ShardTaskProgressReturnRows(uint64 progressTypeMagicNumber, FunctionCallInfo fcinfo)
+{
+	List *attachedDSMSegments = NIL;
+	TupleDesc tupleDescriptor = NULL;
+
+	Tuplestorestate *tupleStore = SetupTuplestore(fcinfo, &tupleDescriptor);
+	List *monitorList = ProgressMonitorList(progressTypeMagicNumber,
+											&attachedDSMSegments);
+
+	ProgressMonitorData *monitor = NULL;
+	foreach_ptr(monitor, monitorList)
+	{
+		ShardTaskProgress *progressArray = (ShardTaskProgress *) monitor->steps;
+
+		for (int stepIndex = 0; stepIndex < monitor->stepCount; stepIndex++)
+		{
+			ShardTaskProgress *progress = &progressArray[stepIndex];
+			Datum values[3];
+			bool isNulls[3];
+
+			memset(values, 0, sizeof(values));
+			memset(isNulls, false, sizeof(isNulls));
+
+			values[0] = Int32GetDatum(monitor->processId);
+			values[1] = Int64GetDatum(progress->shardId);
+			values[2] = CStringGetTextDatum(ShardTaskProgressStateName(
+												progress->state));
+
+			tuplestore_putvalues(tupleStore, tupleDescriptor, values, isNulls);
+		}
+	}
+
+	tuplestore_donestoring(tupleStore);
+
+	DetachFromDSMSegments(attachedDSMSegments);
+}
+
+
+/*
+ * ShardTaskProgressStateName returns the name of the given state, as shown in
+ * the progress UDFs.
+ */
+static char *
+ShardTaskProgressStateName(ShardTaskProgressState state)
+{
+	switch (state)
+	{
+		case SHARD_TASK_PROGRESS_WAITING:
+		{
+			return "waiting";
+		}
+
+		case SHARD_TASK_PROGRESS_DONE:
+		{
+			return "done";
+		}
+
+		default:
+		{
+			return "unknown";
+		}
+	}
+}
@@ -33,24 +33,38 @@
 #include "distributed/commands/multi_copy.h"
 #include "distributed/commands/utility_hook.h"
 #include "distributed/connection_management.h"
+#include "distributed/copy_compression.h"
+#include "distributed/cpu_affinity.h"
 #include "distributed/cte_inline.h"
+#include "distributed/ddl_buffer.h"
+#include "distributed/deparse_shard_query.h"
 #include "distributed/distributed_deadlock_detection.h"
+#include "distributed/function_call_delegation.h"
 #include "distributed/insert_select_executor.h"
+#include "distributed/insert_select_planner.h"
 #include "distributed/intermediate_result_pruning.h"
+#include "distributed/intermediate_result_scan.h"
+#include "distributed/intermediate_results.h"
+#include "distributed/job_cache_space.h"
 #include "distributed/local_executor.h"
+#include "distributed/local_multi_copy.h"
 #include "distributed/maintenanced.h"
 #include "distributed/master_metadata_utility.h"
 #include "distributed/master_protocol.h"
 #include "distributed/metadata_cache.h"
 #include "distributed/metadata_sync.h"
+#include "distributed/insert_buffer.h"
 #include "distributed/multi_executor.h"
 #include "distributed/multi_explain.h"
 #include "distributed/multi_join_order.h"
 #include "distributed/multi_logical_optimizer.h"
+#include "distributed/multi_logical_planner.h"
 #include "distributed/distributed_planner.h"
+#include "distributed/distributed_snapshot.h"
 #include "distributed/multi_master_planner.h"
 #include "distributed/multi_router_planner.h"
 #include "distributed/multi_server_executor.h"
+#include "distributed/node_health.h"
 #include "distributed/pg_dist_partition.h"
 #include "distributed/placement_connection.h"
 #include "distributed/relation_access_tracking.h"
@@ -58,13 +72,29 @@
 #include "distributed/query_pushdown_planning.h"
 #include "distributed/time_constants.h"
 #include "distributed/query_stats.h"
+#include "distributed/recursive_planning.h"
+#include "distributed/relation_restriction_equivalence.h"
+#include "distributed/reference_table_utils.h"
 #include "distributed/remote_commands.h"
+#include "distributed/result_cache.h"
+#include "distributed/repartition_join_execution.h"
+#include "distributed/secondary_node_stats.h"
+#include "distributed/shard_query_stats.h"
+#include "distributed/shard_rebalancer.h"
+#include "distributed/shard_statistics.h"
+#include "distributed/shared_connection_stats.h"
 #include "distributed/shared_library_init.h"
+#include "distributed/shared_metadata_cache.h"
+#include "distributed/stat_counters.h"
 #include "distributed/statistics_collection.h"
 #include "distributed/subplan_execution.h"
 #include "distributed/task_tracker.h"
+#include "distributed/tenant_stats.h"
+#include "distributed/time_partitions.h"
 #include "distributed/transaction_management.h"
 #include "distributed/transaction_recovery.h"
+#include "distributed/transmit.h"
+#include "distributed/wait_sampling.h"
 #include "distributed/worker_manager.h"
 #include "distributed/worker_protocol.h"
 #include "distributed/worker_shard_visibility.h"
@@ -73,6 +103,7 @@
 #include "postmaster/postmaster.h"
 #include "optimizer/planner.h"
 #include "optimizer/paths.h"
+#include "optimizer/plancat.h"
 #include "tcop/tcopprot.h"
 #include "utils/guc.h"
 #include "utils/guc_tables.h"
@@ -96,6 +127,9 @@ static bool ErrorIfNotASuitableDeadlockFactor(double *newval, void **extra,
 											  GucSource source);
 static bool WarnIfDeprecatedExecutorUsed(int *newval, void **extra, GucSource source);
 static bool NodeConninfoGucCheckHook(char **newval, void **extra, GucSource source);
+static bool JobCacheDirectoriesGucCheckHook(char **newval, void **extra,
+											GucSource source);
+static bool CpuAffinityGucCheckHook(char **newval, void **extra, GucSource source);
 static void NodeConninfoGucAssignHook(const char *newval, void *extra);
 static bool StatisticsCollectionGucCheckHook(bool *newval, void **extra, GucSource
 											 source);
@@ -118,6 +152,14 @@ static const struct config_enum_entry task_assignment_policy_options[] = {
 	{ "greedy", TASK_ASSIGNMENT_GREEDY, false },
 	{ "first-replica", TASK_ASSIGNMENT_FIRST_REPLICA, false },
 	{ "round-robin", TASK_ASSIGNMENT_ROUND_ROBIN, false },
+	{ "locality", TASK_ASSIGNMENT_LOCALITY, false },
+	{ "least-loaded", TASK_ASSIGNMENT_LOCALITY, true },
+	{ NULL, 0, false }
+};
+
+static const struct config_enum_entry task_ordering_policy_options[] = {
+	{ "planning-order", TASK_ORDERING_PLANNING_ORDER, false },
+	{ "longest-first", TASK_ORDERING_LONGEST_FIRST, false },
 	{ NULL, 0, false }
 };
 
@@ -175,6 +217,13 @@ static const struct config_enum_entry multi_shard_modify_connection_options[] =
 	{ NULL, 0, false }
 };
 
+static const struct config_enum_entry reference_table_transfer_mode_options[] = {
+	{ "auto", REFERENCE_TABLE_TRANSFER_AUTOMATIC, false },
+	{ "force_logical", REFERENCE_TABLE_TRANSFER_FORCE_LOGICAL, false },
+	{ "block_writes", REFERENCE_TABLE_TRANSFER_BLOCK_WRITES, false },
+	{ NULL, 0, false }
+};
+
 /* *INDENT-ON* */
 
 
@@ -253,6 +302,7 @@ _PG_init(void)
 	/* register for planner hook */
 	set_rel_pathlist_hook = multi_relation_restriction_hook;
 	set_join_pathlist_hook = multi_join_restriction_hook;
+	get_relation_info_hook = CitusGetRelationInfo;
 	ExecutorStart_hook = CitusExecutorStart;
 	ExecutorRun_hook = CitusExecutorRun;
 
@@ -268,8 +318,17 @@ _PG_init(void)
 	InitializeTransactionManagement();
 	InitializeBackendManagement();
 	InitializeConnectionManagement();
+	InitializeSharedConnectionStats();
+	InitializeSecondaryNodeStats();
+	InitializeNodeHealth();
+	InitializeShardQueryStats();
+	InitializeSharedMetadataCache();
+	InitializeResultCache();
 	InitPlacementConnectionManagement();
 	InitializeCitusQueryStats();
+	InitializeTenantStats();
+	InitializeWaitSampling();
+	InitializeStatCounters();
 
 	atexit(CitusBackendAtExit);
 
@@ -425,6 +484,67 @@ RegisterCitusConfigVariables(void)
 		GUC_UNIT_MS | GUC_STANDARD,
 		NULL, NULL, NULL);
 
+	DefineCustomIntVariable(
+		"citus.node_heartbeat_interval",
+		gettext_noop("Sets the time to wait between checks of whether the nodes "
+					 "are up."),
+		gettext_noop("The maintenance daemon connects to every node at this "
+					 "interval. Queries do not wait for "
+					 "citus.node_connection_timeout for nodes it could not connect "
+					 "to, and such nodes are checked again with an increasing "
+					 "delay until they are up. Setting it to 0 disables the "
+					 "checks."),
+		&NodeHeartbeatInterval,
+		0, 0, 7 * MS_PER_DAY,
+		PGC_SIGHUP,
+		GUC_UNIT_MS | GUC_STANDARD,
+		NULL, NULL, NULL);
+
+	DefineCustomStringVariable(
+		"citus.maintenance_daemon_cpu_affinity",
+		gettext_noop("Sets the CPUs that the maintenance daemon pins itself to"),
+		gettext_noop("The value is a comma-separated list of CPU numbers and "
+					 "ranges, such as \"0-3\", which keeps the work of the "
+					 "maintenance daemon away from the CPUs of executor backends. An "
+					 "empty value leaves the maintenance daemon unpinned. Only "
+					 "supported on Linux."),
+		&MaintenanceDaemonCpuAffinity,
+		"",
+		PGC_SIGHUP,
+		GUC_STANDARD,
+		CpuAffinityGucCheckHook, NULL, NULL);
+
+	DefineCustomIntVariable(
+		"citus.shard_statistics_refresh_interval",
+		gettext_noop("Sets the time to wait between refreshes of the shard sizes "
+					 "in pg_dist_placement."),
+		gettext_noop("The maintenance daemon on the coordinator fetches the sizes "
+					 "of the shards of hash and range distributed tables from the "
+					 "nodes at this interval, and records the sizes that changed "
+					 "by more than 10%. The planner uses the sizes to pick join "
+					 "orders, broadcast small tables and inline CTEs. Setting it "
+					 "to 0 disables the refresh."),
+		&ShardStatisticsRefreshInterval,
+		0, 0, 7 * MS_PER_DAY,
+		PGC_SIGHUP,
+		GUC_UNIT_MS | GUC_STANDARD,
+		NULL, NULL, NULL);
+
+	DefineCustomIntVariable(
+		"citus.time_partition_maintenance_interval",
+		gettext_noop("Sets the time to wait between runs of the time partition "
+					 "maintenance."),
+		gettext_noop("The maintenance daemon on the coordinator creates the "
+					 "partitions that the tables in pg_dist_time_partition_policy "
+					 "need for their premake interval, and drops or detaches the "
+					 "partitions that are older than their retention interval, at "
+					 "this interval. Setting it to 0 disables the maintenance."),
+		&TimePartitionMaintenanceInterval,
+		0, 0, 7 * MS_PER_DAY,
+		PGC_SIGHUP,
+		GUC_UNIT_MS | GUC_STANDARD,
+		NULL, NULL, NULL);
+
 	DefineCustomIntVariable(
 		"citus.sslmode",
 		gettext_noop("This variable has been deprecated. Use the citus.node_conninfo "
@@ -459,6 +579,20 @@ RegisterCitusConfigVariables(void)
 		GUC_STANDARD,
 		NULL, NULL, NULL);
 
+	DefineCustomBoolVariable(
+		"citus.enable_merge_task_views",
+		gettext_noop("Enables reading fetched partition files through a view."),
+		gettext_noop("When enabled, worker_merge_files_into_table creates a view "
+					 "that reads the fetched partition files of a merge task on "
+					 "every scan, instead of copying the files into a task "
+					 "table. This avoids writing the shuffled data to disk a "
+					 "second time when joining large tables."),
+		&EnableMergeTaskViews,
+		false,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
 	DefineCustomBoolVariable(
 		"citus.expire_cached_shards",
 		gettext_noop("This GUC variable has been deprecated."),
@@ -480,6 +614,37 @@ RegisterCitusConfigVariables(void)
 		GUC_STANDARD,
 		NULL, NULL, NULL);
 
+	DefineCustomBoolVariable(
+		"citus.enable_parallel_local_execution",
+		gettext_noop("Enables parallel scans of shards that are executed locally."),
+		gettext_noop("Local execution runs the tasks on local shards one at a "
+					 "time within the current session. When enabled, read-only "
+					 "local tasks are planned such that PostgreSQL can use "
+					 "parallel workers to scan a shard when that is cheaper, "
+					 "limited by max_parallel_workers_per_gather."),
+		&EnableParallelLocalExecution,
+		false,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
+	DefineCustomBoolVariable(
+		"citus.enable_cost_based_join_order",
+		gettext_noop("Uses the shard sizes to pick the join order of repartition "
+					 "joins."),
+		gettext_noop("By default, the join order of queries that need to "
+					 "repartition tables is picked by ranking the join methods "
+					 "only. When this is enabled, the join order that sends the "
+					 "least data over the network is picked, based on the shard "
+					 "sizes in pg_dist_placement, such that the smaller tables "
+					 "are repartitioned. The ranking is still used when the size "
+					 "of a table is not known."),
+		&EnableCostBasedJoinOrder,
+		false,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
 	DefineCustomBoolVariable(
 		"citus.enable_single_hash_repartition_joins",
 		gettext_noop("Enables single hash repartitioning between hash "
@@ -501,6 +666,156 @@ RegisterCitusConfigVariables(void)
 		GUC_NO_SHOW_ALL,
 		NULL, NULL, NULL);
 
+	DefineCustomIntVariable(
+		"citus.insert_select_batch_size",
+		gettext_noop("Number of rows after which an INSERT..SELECT via the "
+					 "coordinator with ON CONFLICT or RETURNING inserts the rows "
+					 "it collected so far."),
+		gettext_noop("By default, an INSERT..SELECT that collects its rows on the "
+					 "coordinator and has an ON CONFLICT or RETURNING clause first "
+					 "writes all rows of the SELECT to intermediate results on the "
+					 "nodes of the target shards, and only then inserts them. When "
+					 "set, the SELECT is executed in batches of this many rows, "
+					 "each of which is inserted before the next batch is read, "
+					 "such that the intermediate results only hold a single "
+					 "batch. Note that ON CONFLICT DO UPDATE only errors out on "
+					 "rows that conflict within the same batch. 0 disables "
+					 "batching."),
+		&InsertSelectBatchSize,
+		0, 0, INT_MAX,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
+	DefineCustomIntVariable(
+		"citus.multi_row_insert_copy_threshold",
+		gettext_noop("Sets the number of rows from which multi-row INSERTs are "
+					 "executed with COPY."),
+		gettext_noop("Multi-row INSERTs into distributed tables are split into a "
+					 "VALUES list for every shard, which is costly to plan for "
+					 "many rows. INSERTs with at least this many rows and without "
+					 "RETURNING or ON CONFLICT instead evaluate the VALUES list "
+					 "on the coordinator and copy the rows into the shards. "
+					 "0 disables this."),
+		&MultiRowInsertCopyThreshold,
+		0, 0, INT_MAX,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
+	DefineCustomBoolVariable(
+		"citus.enable_repartitioned_group_by",
+		gettext_noop("Enables finalizing aggregates on the workers for queries "
+					 "that group by a non-distribution column"),
+		gettext_noop("By default, the partial aggregates of queries that group a "
+					 "distributed table by a column other than its distribution "
+					 "column are combined on the coordinator. When enabled, the "
+					 "partial aggregates are instead repartitioned by the first "
+					 "group by column and finalized on the workers in parallel."),
+		&EnableRepartitionedGroupBy,
+		false,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
+	DefineCustomBoolVariable(
+		"citus.enable_repartitioned_count_distinct",
+		gettext_noop("Enables computing exact count(distinct) on a "
+					 "non-distribution column on the workers"),
+		gettext_noop("By default, the distinct values of a column other than the "
+					 "distribution column are pulled to the coordinator to compute "
+					 "count(distinct) without a group by. When enabled, the values "
+					 "are instead repartitioned by the column, and the distinct "
+					 "values of each partition are counted on the workers in "
+					 "parallel. The coordinator only sums these counts."),
+		&EnableRepartitionedCountDistinct,
+		false,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
+	DefineCustomBoolVariable(
+		"citus.enable_batched_function_delegation",
+		gettext_noop("Enables splitting calls of distributed functions and "
+					 "procedures whose distribution argument is an array into "
+					 "a call per worker."),
+		gettext_noop("A call of a distributed set returning function or a "
+					 "procedure without output arguments whose distribution "
+					 "argument is an array of distribution column values is "
+					 "normally executed on the coordinator. When enabled, the "
+					 "array is split by the workers that hold the shards of its "
+					 "elements, and each worker runs the call with its elements "
+					 "in parallel. Note that the calls on different workers are "
+					 "not atomic, since each of them commits on its own."),
+		&EnableBatchedFunctionDelegation,
+		false,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
+	DefineCustomBoolVariable(
+		"citus.enable_prepared_function_delegation",
+		gettext_noop("Executes function calls that are delegated to a worker "
+					 "with statements that are prepared once per connection."),
+		gettext_noop("A delegated function call is normally sent to the worker "
+					 "as a SELECT, which the worker parses and plans on every "
+					 "call. When enabled, the call is prepared on the worker "
+					 "connection the first time the function is called with "
+					 "the same argument types, and later calls only execute "
+					 "the prepared statement with their arguments. This should "
+					 "not be used when the connections to the workers go "
+					 "through a pooler in transaction pooling mode."),
+		&EnablePreparedFunctionDelegation,
+		false,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
+	DefineCustomBoolVariable(
+		"citus.enable_prepared_statement_caching",
+		gettext_noop("Executes router queries with statements that are "
+					 "prepared once per worker connection."),
+		gettext_noop("A router query is normally sent to the worker with its "
+					 "constants, and the worker parses and plans it on every "
+					 "execution. When enabled, queries on a single shard whose "
+					 "WHERE clause has constants are prepared on the worker "
+					 "connection with parameters in place of the constants, and "
+					 "later executions of the same query with other values only "
+					 "execute the prepared statement. This should not be used "
+					 "when the connections to the workers go through a pooler "
+					 "in transaction pooling mode."),
+		&EnablePreparedStatementCaching,
+		false,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
+	DefineCustomIntVariable(
+		"citus.max_prepared_statements_per_connection",
+		gettext_noop("Maximum number of statements the executor prepares over "
+					 "a worker connection."),
+		gettext_noop("Once a connection has this many prepared statements, "
+					 "queries whose statement is not yet prepared over the "
+					 "connection are sent as plain queries."),
+		&MaxPreparedStatementsPerConnection,
+		1000, 0, INT_MAX,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
+	DefineCustomBoolVariable(
+		"citus.enable_shard_query_templates",
+		gettext_noop("Deparses multi-shard queries only once for all shards."),
+		gettext_noop("When enabled, the planner deparses the query of a "
+					 "multi-shard task list once with placeholders for the "
+					 "shard names, and fills in the shard names of every "
+					 "task instead of deparsing the query for every shard."),
+		&EnableShardQueryTemplates,
+		true,
+		PGC_USERSET,
+		GUC_NO_SHOW_ALL,
+		NULL, NULL, NULL);
+
 	DefineCustomBoolVariable(
 		"citus.enable_fast_path_router_planner",
 		gettext_noop("Enables fast path router planner"),
@@ -511,6 +826,57 @@ RegisterCitusConfigVariables(void)
 		GUC_NO_SHOW_ALL,
 		NULL, NULL, NULL);
 
+	DefineCustomBoolVariable(
+		"citus.enable_fast_path_partition_pruning",
+		gettext_noop("Sends fast path router queries on partitioned tables to "
+					 "the shard of a single partition when possible."),
+		gettext_noop("When the filters of a query on the distribution column "
+					 "also exclude all but one partition of a partitioned table, "
+					 "the coordinator picks the shard of that partition and the "
+					 "worker does not need to consider the other partitions while "
+					 "planning the query."),
+		&EnableFastPathPartitionPruning,
+		false,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
+	DefineCustomIntVariable(
+		"citus.max_cached_fast_path_plans",
+		gettext_noop("Sets the maximum number of fast path router plans each "
+					 "backend keeps for reuse."),
+		gettext_noop("Simple queries on a single shard, such as lookups on the "
+					 "distribution column, are planned again whenever a client "
+					 "sends them without preparing them. When this is set, each "
+					 "backend keeps up to this many of those plans and reuses them "
+					 "when the same query is sent again, until the metadata of the "
+					 "table changes. Queries that filter on the distribution column "
+					 "with a parameter reuse their plan for any parameter value. "
+					 "0 disables the cache."),
+		&MaxCachedFastPathPlans,
+		0, 0, 10000,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
+	DefineCustomIntVariable(
+		"citus.max_cached_restriction_equivalences",
+		gettext_noop("Sets the maximum number of queries for which each backend "
+					 "remembers whether they join on the distribution columns."),
+		gettext_noop("Deciding whether all tables in a complex query are joined "
+					 "on their distribution columns is costly for queries with "
+					 "many joins and subqueries, and it is repeated whenever the "
+					 "query is planned again, for instance on every execution of "
+					 "a prepared statement. When this is set, each backend keeps "
+					 "up to this many of those results and reuses them when the "
+					 "same query is planned again, until the metadata of one of "
+					 "its tables changes. 0 disables the cache."),
+		&MaxCachedRestrictionEquivalences,
+		0, 0, 10000,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
 	DefineCustomBoolVariable(
 		"citus.override_table_visibility",
 		gettext_noop("Enables replacing occurencens of pg_catalog.pg_table_visible() "
@@ -548,6 +914,23 @@ RegisterCitusConfigVariables(void)
 		GUC_STANDARD,
 		NULL, NULL, NULL);
 
+	DefineCustomBoolVariable(
+		"citus.enable_reference_table_outer_join_pushdown",
+		gettext_noop("Enables pushing down outer joins with a reference table on "
+					 "the outer side"),
+		gettext_noop("By default, queries like reference_table LEFT JOIN "
+					 "distributed_table cannot be pushed down, since every shard "
+					 "would return the unmatched rows of the reference table. When "
+					 "enabled, such joins on the distribution column are pushed "
+					 "down and the task of each shard only returns the reference "
+					 "table rows whose join column hashes into the range of the "
+					 "shard."),
+		&EnableReferenceTableOuterJoinPushdown,
+		false,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
 	DefineCustomBoolVariable(
 		"citus.log_multi_join_order",
 		gettext_noop("Logs the distributed join order to the server log."),
@@ -569,6 +952,19 @@ RegisterCitusConfigVariables(void)
 		GUC_STANDARD,
 		NULL, NULL, NULL);
 
+	DefineCustomBoolVariable(
+		"citus.log_planning_time",
+		gettext_noop("Logs the time spent in each phase of distributed planning."),
+		gettext_noop("For every distributed query that is planned, the total "
+					 "planning time is logged together with the time spent in "
+					 "the postgres planner, the router planner, recursive "
+					 "planning and the logical planner."),
+		&LogPlanningTime,
+		false,
+		PGC_USERSET,
+		GUC_NO_SHOW_ALL,
+		NULL, NULL, NULL);
+
 	DefineCustomBoolVariable(
 		"citus.log_local_commands",
 		gettext_noop("Log queries that are executed locally, can be overriden by "
@@ -649,6 +1045,22 @@ RegisterCitusConfigVariables(void)
 		GUC_STANDARD,
 		ErrorIfNotASuitableDeadlockFactor, NULL, NULL);
 
+	DefineCustomIntVariable(
+		"citus.recover_2pc_connections_per_worker",
+		gettext_noop("Sets the number of connections per worker used to "
+					 "recover 2PCs."),
+		gettext_noop("2PC transaction recovery commits or aborts the prepared "
+					 "transactions of all workers in parallel. This setting "
+					 "determines how many connections to each worker are "
+					 "used to send the COMMIT PREPARED and ROLLBACK PREPARED "
+					 "commands, which speeds up recovering a large number "
+					 "of prepared transactions."),
+		&Recover2PCConnectionsPerWorker,
+		1, 1, 64,
+		PGC_SIGHUP,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
 	DefineCustomIntVariable(
 		"citus.recover_2pc_interval",
 		gettext_noop("Sets the time to wait between recovering 2PCs."),
@@ -663,6 +1075,35 @@ RegisterCitusConfigVariables(void)
 		GUC_UNIT_MS | GUC_STANDARD,
 		NULL, NULL, NULL);
 
+	DefineCustomIntVariable(
+		"citus.background_job_time_limit",
+		gettext_noop("Sets the maximum time a background job of the maintenance "
+					 "daemon may run."),
+		gettext_noop("The maintenance daemon runs jobs like 2PC recovery, the "
+					 "shard statistics refresh and the time partition "
+					 "maintenance in separate background workers, and "
+					 "terminates a worker that runs for longer than this. "
+					 "The job is started again at its next interval. Setting "
+					 "it to 0 lets the jobs run until they finish."),
+		&BackgroundJobTimeLimit,
+		0, 0, 7 * MS_PER_DAY,
+		PGC_SIGHUP,
+		GUC_UNIT_MS | GUC_STANDARD,
+		NULL, NULL, NULL);
+
+	DefineCustomIntVariable(
+		"citus.metadata_sync_batch_size",
+		gettext_noop("Sets the size of the command batches used to sync metadata."),
+		gettext_noop("When syncing the metadata snapshot to a node, commands are "
+					 "combined into multi-statement commands of up to this size "
+					 "to reduce the number of round trips. 0 sends each command "
+					 "on its own."),
+		&MetadataSyncBatchSize,
+		0, 0, 256 * 1024,
+		PGC_USERSET,
+		GUC_UNIT_KB | GUC_STANDARD,
+		NULL, NULL, NULL);
+
 	DefineCustomIntVariable(
 		"citus.metadata_sync_interval",
 		gettext_noop("Sets the time to wait between metadata syncs."),
@@ -704,6 +1145,24 @@ RegisterCitusConfigVariables(void)
 		GUC_NO_SHOW_ALL,
 		NULL, NULL, NULL);
 
+	DefineCustomBoolVariable(
+		"citus.read_only_select_opens_transaction_block",
+		gettext_noop("Open transaction blocks for SELECT commands in read-only "
+					 "transactions"),
+		gettext_noop("When disabled, SELECT commands in a READ ONLY transaction block "
+					 "at the read committed isolation level run outside of a "
+					 "transaction block on the workers, which saves the round trip "
+					 "of the BEGIN and of the COMMIT on every connection. Since each "
+					 "statement takes a new snapshot and the transaction cannot "
+					 "write, the results are the same, but locks on the shards are "
+					 "released after each statement and changes made through "
+					 "function calls on the workers are not rolled back."),
+		&ReadOnlySelectOpensTransactionBlock,
+		true,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
 	DefineCustomBoolVariable(
 		"citus.function_opens_transaction_block",
 		gettext_noop("Open transaction blocks for function calls"),
@@ -734,6 +1193,38 @@ RegisterCitusConfigVariables(void)
 		GUC_NO_SHOW_ALL,
 		NULL, NULL, NULL);
 
+	DefineCustomStringVariable(
+		"citus.executor_cpu_affinity",
+		gettext_noop("Sets the CPUs that backends pin themselves to when they run a "
+					 "distributed query"),
+		gettext_noop("On coordinators with multiple sockets, pinning the backends "
+					 "that process the results of many connections to the CPUs of "
+					 "one socket avoids cross-socket memory traffic. The value is a "
+					 "comma-separated list of CPU numbers and ranges, such as "
+					 "\"0-7,16-23\", and is typically set per role or database. An "
+					 "empty value leaves the backends unpinned. Only supported on "
+					 "Linux."),
+		&ExecutorCpuAffinity,
+		"",
+		PGC_SUSET,
+		GUC_STANDARD,
+		CpuAffinityGucCheckHook, NULL, NULL);
+
+	DefineCustomBoolVariable(
+		"citus.log_worker_pool_cpu_time",
+		gettext_noop("Logs the CPU time that distributed queries spend on each "
+					 "worker node"),
+		gettext_noop("When enabled, the adaptive executor measures the CPU time it "
+					 "spends on sending commands to and processing the results of each "
+					 "worker node, and logs it together with the number of tasks "
+					 "when the execution finishes. Measuring the CPU time adds a "
+					 "system call for every connection event."),
+		&LogWorkerPoolCpuTime,
+		false,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
 	DefineCustomIntVariable(
 		"citus.executor_slow_start_interval",
 		gettext_noop("Time to wait between opening connections to the same worker node"),
@@ -751,129 +1242,540 @@ RegisterCitusConfigVariables(void)
 		NULL, NULL, NULL);
 
 	DefineCustomBoolVariable(
-		"citus.enable_deadlock_prevention",
-		gettext_noop("Avoids deadlocks by preventing concurrent multi-shard commands"),
-		gettext_noop("Multi-shard modifications such as UPDATE, DELETE, and "
-					 "INSERT...SELECT are typically executed in parallel. If multiple "
-					 "such commands run concurrently and affect the same rows, then "
-					 "they are likely to deadlock. When enabled, this flag prevents "
-					 "multi-shard modifications from running concurrently when they "
-					 "affect the same shards in order to prevent deadlocks."),
-		&EnableDeadlockPrevention,
-		true,
+		"citus.enable_adaptive_slow_start",
+		gettext_noop("Uses connection establishment and task execution times to "
+					 "decide how many connections to open"),
+		gettext_noop("By default, the number of connections the executor opens to a "
+					 "worker increases by one every citus.executor_slow_start_interval "
+					 "while there are tasks waiting. When enabled, the executor "
+					 "only opens additional connections if they are expected to become "
+					 "usable before the existing connections finish the waiting tasks, "
+					 "and it backs off when connection establishment slows down, "
+					 "which avoids connection storms on overloaded workers."),
+		&EnableAdaptiveSlowStart,
+		false,
 		PGC_USERSET,
 		GUC_STANDARD,
 		NULL, NULL, NULL);
 
-	DefineCustomBoolVariable(
-		"citus.enable_ddl_propagation",
-		gettext_noop("Enables propagating DDL statements to worker shards"),
-		NULL,
-		&EnableDDLPropagation,
-		true,
+	DefineCustomIntVariable(
+		"citus.executor_pipeline_depth",
+		gettext_noop("Sets the number of read-only tasks the adaptive executor sends "
+					 "over a connection at once"),
+		gettext_noop("When a multi-shard SELECT has more tasks than connections, each "
+					 "connection normally waits for the result of a task before "
+					 "sending the next one. When this setting is larger than 1, up to "
+					 "the configured number of ready tasks are sent back-to-back as a "
+					 "single multi-statement query and their results are processed "
+					 "as they arrive, which saves a network round trip per task. "
+					 "Setting this to 1 disables pipelining."),
+		&ExecutorPipelineDepth,
+		1, 1, 1000,
 		PGC_USERSET,
-		GUC_NO_SHOW_ALL,
+		GUC_STANDARD,
 		NULL, NULL, NULL);
 
 	DefineCustomBoolVariable(
-		"citus.enable_object_propagation",
-		gettext_noop("Enables propagating object creation for more complex objects, "
-					 "schema's will always be created"),
-		NULL,
-		&EnableDependencyCreation,
-		true,
+		"citus.enable_work_stealing",
+		gettext_noop("Allows idle worker connections to take over read-only tasks "
+					 "that are waiting for another worker"),
+		gettext_noop("Read-only tasks on reference tables and replicated shards can "
+					 "run on any of their placements, but the executor picks one "
+					 "placement up front based on citus.task_assignment_policy. When "
+					 "enabled, a connection that has no more tasks to run on its own "
+					 "worker starts a task that has not yet started on another worker "
+					 "if it also has a placement on its own worker."),
+		&EnableWorkStealing,
+		false,
 		PGC_USERSET,
-		GUC_NO_SHOW_ALL,
+		GUC_STANDARD,
 		NULL, NULL, NULL);
 
-	DefineCustomBoolVariable(
-		"citus.enable_create_type_propagation",
-		gettext_noop("Enables propagating of CREATE TYPE statements to workers"),
-		NULL,
-		&EnableCreateTypePropagation,
-		true,
+	DefineCustomIntVariable(
+		"citus.shard_affinity_group_count",
+		gettext_noop("Sets the number of groups into which the executor divides the "
+					 "shards of a worker, with one connection per group"),
+		gettext_noop("When set, each connection to a worker gets its own group of "
+					 "shards and prefers to run tasks on those shards, even across "
+					 "queries when the connection is cached. The worker backends then "
+					 "work on disjoint sets of shards with warm caches, much like a "
+					 "core that owns a fixed set of shards. Tasks of other groups are "
+					 "still taken once a connection runs out of its own. Setting this "
+					 "to the number of cores of the workers, along with "
+					 "citus.max_cached_conns_per_worker, works best. 0 disables "
+					 "shard affinity."),
+		&ShardAffinityGroupCount,
+		0, 0, 10000,
 		PGC_USERSET,
-		GUC_NO_SHOW_ALL,
+		GUC_STANDARD,
 		NULL, NULL, NULL);
 
 	DefineCustomBoolVariable(
-		"citus.enable_alter_role_propagation",
-		gettext_noop("Enables propagating role passwords statements to workers"),
-		NULL,
-		&EnableAlterRolePropagation,
+		"citus.enable_streaming_execution",
+		gettext_noop("Returns rows of multi-shard SELECTs while the workers are "
+					 "still sending results"),
+		gettext_noop("By default, the adaptive executor stores all rows of a "
+					 "distributed query in a tuple store before returning the first "
+					 "row. When enabled, top-level read-only queries that run outside "
+					 "of a transaction block return rows as soon as they arrive and "
+					 "only read more rows from the workers once the buffered rows are "
+					 "consumed, which reduces the time to the first row and the memory "
+					 "and disk used for large results. Read-only queries whose rows "
+					 "all come from a single local task return rows straight from "
+					 "the plan of that task, also within transaction blocks. "
+					 "Cursors that are not declared SCROLL, and other named "
+					 "portals, also stream within transaction blocks, such that "
+					 "each FETCH only reads the rows it returns from the workers."),
+		&EnableStreamingExecution,
 		false,
 		PGC_USERSET,
 		GUC_STANDARD,
 		NULL, NULL, NULL);
 
-	/*
-	 * We shouldn't need this variable after we drop support to PostgreSQL 11 and
-	 * below. So, noting it here with PG_VERSION_NUM < 120000
-	 */
 	DefineCustomBoolVariable(
-		"citus.enable_cte_inlining",
-		gettext_noop("When set to false, CTE inlining feature is disabled"),
-		gettext_noop("This feature is not intended for users. It is developed "
-					 "to get consistent regression test outputs between Postgres 11"
-					 "and Postgres 12. In Postgres 12+, the user can control the behaviour"
-					 "by [NOT] MATERIALIZED keyword on CTEs. However, in PG 11, we cannot do "
-					 "that."),
-		&EnableCTEInlining,
-		true,
-		PGC_SUSET,
-		GUC_NO_SHOW_ALL,
-		NULL, NULL, NULL);
-
-	DefineCustomEnumVariable(
-		"citus.propagate_set_commands",
-		gettext_noop("Sets which SET commands are propagated to workers."),
-		NULL,
-		&PropagateSetCommands,
-		PROPSETCMD_NONE,
-		propagate_set_commands_options,
+		"citus.enable_limit_early_termination",
+		gettext_noop("Stops multi-shard SELECTs with a LIMIT once enough rows "
+					 "were received"),
+		gettext_noop("By default, the adaptive executor waits for all tasks of a "
+					 "multi-shard SELECT to finish, even if the query has a LIMIT "
+					 "without ORDER BY and the coordinator already received enough "
+					 "rows. When enabled, such queries that run outside of a "
+					 "distributed transaction do not start their remaining tasks "
+					 "and cancel the tasks that are still running once they "
+					 "received enough rows."),
+		&EnableLimitEarlyTermination,
+		false,
 		PGC_USERSET,
 		GUC_STANDARD,
 		NULL, NULL, NULL);
 
 	DefineCustomBoolVariable(
-		"citus.enable_router_execution",
-		gettext_noop("Enables router execution"),
-		NULL,
-		&EnableRouterExecution,
-		true,
+		"citus.enable_sorted_task_result_merge",
+		gettext_noop("Merges the sorted rows of the tasks of multi-shard SELECTs "
+					 "with an ORDER BY"),
+		gettext_noop("When the ORDER BY of a multi-shard SELECT is pushed down to "
+					 "the workers, for instance along with its LIMIT, the rows of "
+					 "every task are already sorted, but by default the coordinator "
+					 "sorts all rows again. When enabled, the adaptive executor "
+					 "merges the sorted rows of the tasks instead of the coordinator "
+					 "adding a sort on top of the distributed scan."),
+		&EnableSortedTaskResultMerge,
+		false,
 		PGC_USERSET,
-		GUC_NO_SHOW_ALL,
+		GUC_STANDARD,
 		NULL, NULL, NULL);
 
 	DefineCustomIntVariable(
-		"citus.shard_count",
-		gettext_noop("Sets the number of shards for a new hash-partitioned table"
-					 "created with create_distributed_table()."),
-		NULL,
-		&ShardCount,
-		32, 1, MAX_SHARD_COUNT,
+		"citus.hedged_read_percentile",
+		gettext_noop("Sets the percentile of task execution times after which "
+					 "read-only tasks are also started on another placement"),
+		gettext_noop("When a read-only task of a replicated or reference table runs "
+					 "longer than the given percentile of the execution times of "
+					 "recent read-only tasks in the session, the adaptive executor "
+					 "also starts it on another placement, uses the rows of the "
+					 "placement that returns them first and cancels the other. "
+					 "This only happens outside of distributed transactions. "
+					 "0 disables hedged reads."),
+		&HedgedReadPercentile,
+		0, 0, 100,
 		PGC_USERSET,
 		GUC_STANDARD,
 		NULL, NULL, NULL);
 
 	DefineCustomIntVariable(
-		"citus.shard_replication_factor",
-		gettext_noop("Sets the replication factor for shards."),
-		gettext_noop("Shards are replicated across nodes according to this "
-					 "replication factor. Note that shards read this "
-					 "configuration value at sharded table creation time, "
-					 "and later reuse the initially read value."),
-		&ShardReplicationFactor,
-		1, 1, MAX_SHARD_REPLICATION_FACTOR,
+		"citus.hedged_read_min_delay",
+		gettext_noop("Sets the minimum time a read-only task runs before it is "
+					 "also started on another placement"),
+		gettext_noop("Keeps citus.hedged_read_percentile from starting tasks on "
+					 "other placements when tasks are fast anyway."),
+		&HedgedReadMinDelay,
+		10, 0, INT_MAX,
+		PGC_USERSET,
+		GUC_UNIT_MS | GUC_STANDARD,
+		NULL, NULL, NULL);
+
+	DefineCustomBoolVariable(
+		"citus.enable_binary_protocol",
+		gettext_noop("Requests the results of SELECT tasks in binary format"),
+		gettext_noop("By default, workers send the results of queries in text "
+					 "format, which the coordinator parses using the input function "
+					 "of each column type. When enabled, results whose column types "
+					 "all have binary send and receive functions are transferred in "
+					 "binary format instead, which avoids the conversion to and from "
+					 "text for types such as numeric, timestamp and arrays."),
+		&EnableBinaryProtocol,
+		false,
 		PGC_USERSET,
 		GUC_STANDARD,
 		NULL, NULL, NULL);
 
-	DefineCustomIntVariable(
-		"citus.shard_max_size",
-		gettext_noop("Sets the maximum size a shard will grow before it gets split."),
-		gettext_noop("Shards store table and file data. When the source "
-					 "file's size for one shard exceeds this configuration "
+	DefineCustomBoolVariable(
+		"citus.enable_async_commit_prepared",
+		gettext_noop("Returns from commit before the workers finished COMMIT "
+					 "PREPARED"),
+		gettext_noop("After a transaction that uses two-phase commit committed "
+					 "on the coordinator, its records in pg_dist_transaction "
+					 "guarantee that the prepared transactions on the workers get "
+					 "committed. When enabled, the coordinator sends COMMIT PREPARED "
+					 "without waiting for the replies, which are read before the "
+					 "next statement of the session runs. If a COMMIT PREPARED "
+					 "fails, 2PC recovery commits the transaction later on."),
+		&EnableAsyncCommitPrepared,
+		false,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
+	DefineCustomBoolVariable(
+		"citus.enable_pipelined_prepare",
+		gettext_noop("Sends PREPARE TRANSACTION along with the last command of "
+					 "an implicit transaction"),
+		gettext_noop("Multi-shard modifications that run as a single statement "
+					 "outside of a transaction block and use 2PC normally send "
+					 "PREPARE TRANSACTION to the workers at commit time. When "
+					 "enabled, the executor sends it in the same round trip as the "
+					 "last task on each connection instead. Clients that send "
+					 "several statements in one implicit transaction through the "
+					 "extended protocol should not enable this setting."),
+		&EnablePipelinedPrepare,
+		false,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
+	DefineCustomBoolVariable(
+		"citus.enable_pipelined_begin",
+		gettext_noop("Sends BEGIN along with the first command of a remote "
+					 "transaction"),
+		gettext_noop("By default, the executor waits for the result of the BEGIN "
+					 "of a remote transaction before sending the first task over "
+					 "the connection. When enabled, the BEGIN and the task are "
+					 "sent as a single multi-statement query, which saves a round "
+					 "trip on every connection that a transaction block uses. "
+					 "Queries with parameters, binary results, or active savepoints "
+					 "and SET LOCAL commands still send BEGIN separately."),
+		&EnablePipelinedBegin,
+		false,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
+	DefineCustomBoolVariable(
+		"citus.enable_intermediate_result_cache",
+		gettext_noop("Reuses CTE and subquery results within a transaction"),
+		gettext_noop("When enabled, a CTE or complex subquery that was already "
+					 "executed earlier in a repeatable read or serializable "
+					 "transaction, as the same user and without modifications "
+					 "in between, reads the existing result files instead of "
+					 "being executed and broadcast again. Subqueries with "
+					 "volatile functions or that read other results are always "
+					 "executed."),
+		&EnableIntermediateResultCache,
+		false,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
+	DefineCustomBoolVariable(
+		"citus.enable_concurrent_subplan_execution",
+		gettext_noop("Executes the subqueries and CTEs of a query that do not "
+					 "depend on each other concurrently."),
+		gettext_noop("By default, the recursively planned subqueries and CTEs of "
+					 "a query are executed one after the other. When enabled, the "
+					 "tasks of the read-only subqueries and CTEs that do not read "
+					 "the results of other subqueries run in a single execution, "
+					 "after which their results are sent to the workers."),
+		&EnableConcurrentSubPlanExecution,
+		false,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
+	DefineCustomBoolVariable(
+		"citus.enable_generic_multi_shard_plans",
+		gettext_noop("Allows multi-shard SELECTs with parameters to have generic "
+					 "plans."),
+		gettext_noop("By default, prepared multi-shard SELECTs with parameters are "
+					 "planned again for every execution, including the task "
+					 "queries that are sent to the workers. When enabled, such "
+					 "queries are planned with the parameters in the task queries "
+					 "if the parameters only appear in the WHERE clause and are "
+					 "not compared with a distribution column. The plan can then "
+					 "be cached, and the parameter values are sent with the task "
+					 "queries on every execution."),
+		&EnableGenericMultiShardPlans,
+		false,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
+	DefineCustomBoolVariable(
+		"citus.enable_intermediate_result_compression",
+		gettext_noop("Compresses intermediate results sent between nodes"),
+		gettext_noop("When enabled, intermediate results that are broadcast to "
+					 "or fetched from other nodes are compressed with pglz in "
+					 "blocks of 64kB. This reduces network traffic for large "
+					 "results at the cost of CPU time on both ends."),
+		&EnableIntermediateResultCompression,
+		false,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
+	DefineCustomBoolVariable(
+		"citus.enable_partitioned_subplan_results",
+		gettext_noop("Sends the rows of subquery and CTE results only to the "
+					 "nodes that can join them."),
+		gettext_noop("When a subquery or CTE result is only joined with a "
+					 "hash-distributed table on its distribution column, a "
+					 "task can only match the rows that hash into the shard of "
+					 "the task. When enabled, the coordinator sends each row "
+					 "only to the nodes that have that shard, instead of "
+					 "sending the whole result to every node that runs a task."),
+		&EnablePartitionedSubPlanResults,
+		false,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
+	DefineCustomBoolVariable(
+		"citus.enable_parallel_intermediate_result_scan",
+		gettext_noop("Enables parallel workers to divide the rows of binary "
+					 "intermediate results."),
+		gettext_noop("Reading an intermediate result is a function scan, which "
+					 "is executed entirely by one process. When enabled, the "
+					 "planner also considers a parallel scan of binary results "
+					 "that are larger than min_parallel_table_scan_size, in "
+					 "which each process parses a share of the rows."),
+		&EnableParallelIntermediateResultScan,
+		true,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
+	DefineCustomBoolVariable(
+		"citus.enable_push_based_repartition",
+		gettext_noop("Pushes result partitions of repartitioned INSERT..SELECT "
+					 "to their target nodes while the SELECT runs."),
+		gettext_noop("By default, the tasks of a repartitioned INSERT..SELECT "
+					 "write each partition of their results to a local file, "
+					 "and the files are then fetched by the nodes of the target "
+					 "shards. When enabled, the tasks stream the partitions to "
+					 "the target nodes over COPY instead, so the transfers "
+					 "overlap with the SELECT. When the shards of the target "
+					 "table have multiple placements, the partitions are "
+					 "pushed to the first placement and then fetched by the "
+					 "other placements."),
+		&EnablePushBasedRepartition,
+		false,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
+	DefineCustomBoolVariable(
+		"citus.enable_copy_pass_through",
+		gettext_noop("Forwards rows of COPY into hash-distributed tables without "
+					 "parsing them"),
+		gettext_noop("By default, COPY parses every column of each row on the "
+					 "coordinator and serializes it again before sending it to "
+					 "the workers. When enabled, COPY in text or csv format into "
+					 "a hash-distributed table only parses the distribution "
+					 "column and forwards the other fields as they are. Invalid "
+					 "values in other columns are then reported by the workers."),
+		&EnableCopyPassThrough,
+		false,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
+	DefineCustomBoolVariable(
+		"citus.enable_deadlock_prevention",
+		gettext_noop("Avoids deadlocks by preventing concurrent multi-shard commands"),
+		gettext_noop("Multi-shard modifications such as UPDATE, DELETE, and "
+					 "INSERT...SELECT are typically executed in parallel. If multiple "
+					 "such commands run concurrently and affect the same rows, then "
+					 "they are likely to deadlock. When enabled, this flag prevents "
+					 "multi-shard modifications from running concurrently when they "
+					 "affect the same shards in order to prevent deadlocks."),
+		&EnableDeadlockPrevention,
+		true,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
+	DefineCustomBoolVariable(
+		"citus.enable_ddl_propagation",
+		gettext_noop("Enables propagating DDL statements to worker shards"),
+		NULL,
+		&EnableDDLPropagation,
+		true,
+		PGC_USERSET,
+		GUC_NO_SHOW_ALL,
+		NULL, NULL, NULL);
+
+	DefineCustomBoolVariable(
+		"citus.enable_batched_shard_ddl",
+		gettext_noop("Applies DDL commands to all shards on a node in a single call."),
+		gettext_noop("When enabled, ALTER TABLE and renames on distributed tables "
+					 "send one worker_apply_multi_shard_ddl_command call per group "
+					 "of shards with placements on the same nodes, instead of one "
+					 "call per shard, such that the command takes one round trip "
+					 "per node. All workers need to be on a Citus version that "
+					 "has the function."),
+		&EnableBatchedShardDDL,
+		false,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
+	DefineCustomBoolVariable(
+		"citus.enable_object_propagation",
+		gettext_noop("Enables propagating object creation for more complex objects, "
+					 "schema's will always be created"),
+		NULL,
+		&EnableDependencyCreation,
+		true,
+		PGC_USERSET,
+		GUC_NO_SHOW_ALL,
+		NULL, NULL, NULL);
+
+	DefineCustomBoolVariable(
+		"citus.enable_create_type_propagation",
+		gettext_noop("Enables propagating of CREATE TYPE statements to workers"),
+		NULL,
+		&EnableCreateTypePropagation,
+		true,
+		PGC_USERSET,
+		GUC_NO_SHOW_ALL,
+		NULL, NULL, NULL);
+
+	DefineCustomBoolVariable(
+		"citus.enable_alter_role_propagation",
+		gettext_noop("Enables propagating role passwords statements to workers"),
+		NULL,
+		&EnableAlterRolePropagation,
+		false,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
+	/*
+	 * We shouldn't need this variable after we drop support to PostgreSQL 11 and
+	 * below. So, noting it here with PG_VERSION_NUM < 120000
+	 */
+	DefineCustomBoolVariable(
+		"citus.enable_cte_inlining",
+		gettext_noop("When set to false, CTE inlining feature is disabled"),
+		gettext_noop("This feature is not intended for users. It is developed "
+					 "to get consistent regression test outputs between Postgres 11"
+					 "and Postgres 12. In Postgres 12+, the user can control the behaviour"
+					 "by [NOT] MATERIALIZED keyword on CTEs. However, in PG 11, we cannot do "
+					 "that."),
+		&EnableCTEInlining,
+		true,
+		PGC_SUSET,
+		GUC_NO_SHOW_ALL,
+		NULL, NULL, NULL);
+
+	DefineCustomIntVariable(
+		"citus.cte_inline_size_threshold",
+		gettext_noop("Sets the maximum size in KB of the tables read by CTEs that "
+					 "are inlined even though they are referenced multiple times."),
+		gettext_noop("CTEs that are referenced multiple times are normally "
+					 "materialized into an intermediate result. When the size of "
+					 "the tables that such a CTE reads, as recorded in "
+					 "pg_dist_placement, multiplied by the number of references "
+					 "is below this threshold, the CTE is inlined instead, such "
+					 "that it can be pushed down with the rest of the query. "
+					 "0 disables inlining multiply-referenced CTEs."),
+		&CTEInlineSizeThreshold,
+		0, 0, MAX_KILOBYTES,
+		PGC_USERSET,
+		GUC_UNIT_KB | GUC_STANDARD,
+		NULL, NULL, NULL);
+
+	DefineCustomBoolVariable(
+		"citus.enable_cte_column_pruning",
+		gettext_noop("Leaves columns of CTEs that are not referenced out of their "
+					 "intermediate results"),
+		gettext_noop("CTEs that cannot be inlined are executed separately and "
+					 "their results are sent to the workers as intermediate "
+					 "results. When enabled, the columns of such a CTE that the "
+					 "query does not reference are replaced by NULLs, such that "
+					 "they are neither computed, transferred nor decoded."),
+		&EnableCTEColumnPruning,
+		false,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
+	DefineCustomEnumVariable(
+		"citus.propagate_set_commands",
+		gettext_noop("Sets which SET commands are propagated to workers."),
+		NULL,
+		&PropagateSetCommands,
+		PROPSETCMD_NONE,
+		propagate_set_commands_options,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
+	DefineCustomBoolVariable(
+		"citus.enable_router_execution",
+		gettext_noop("Enables router execution"),
+		NULL,
+		&EnableRouterExecution,
+		true,
+		PGC_USERSET,
+		GUC_NO_SHOW_ALL,
+		NULL, NULL, NULL);
+
+	DefineCustomIntVariable(
+		"citus.shard_count",
+		gettext_noop("Sets the number of shards for a new hash-partitioned table"
+					 "created with create_distributed_table()."),
+		NULL,
+		&ShardCount,
+		32, 1, MAX_SHARD_COUNT,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
+	DefineCustomIntVariable(
+		"citus.shard_creation_batch_size",
+		gettext_noop("Sets the number of shards that are created on a worker "
+					 "with a single command."),
+		gettext_noop("When creating the shards of a distributed table outside "
+					 "of a transaction block, the shards of a worker are created "
+					 "one at a time over the same connection. Setting this to a "
+					 "higher value creates that many shards, including their "
+					 "indexes and constraints, in a single multi-statement "
+					 "command, which saves a round trip per shard when creating "
+					 "tables with many shards."),
+		&ShardCreationBatchSize,
+		1, 1, MAX_SHARD_COUNT,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
+	DefineCustomIntVariable(
+		"citus.shard_replication_factor",
+		gettext_noop("Sets the replication factor for shards."),
+		gettext_noop("Shards are replicated across nodes according to this "
+					 "replication factor. Note that shards read this "
+					 "configuration value at sharded table creation time, "
+					 "and later reuse the initially read value."),
+		&ShardReplicationFactor,
+		1, 1, MAX_SHARD_REPLICATION_FACTOR,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
+	DefineCustomIntVariable(
+		"citus.shard_max_size",
+		gettext_noop("Sets the maximum size a shard will grow before it gets split."),
+		gettext_noop("Shards store table and file data. When the source "
+					 "file's size for one shard exceeds this configuration "
 					 "value, the database ensures that either a new shard "
 					 "gets created, or the current one gets split. Note that "
 					 "shards read this configuration value at sharded table "
@@ -884,6 +1786,149 @@ RegisterCitusConfigVariables(void)
 		GUC_UNIT_KB | GUC_STANDARD,
 		NULL, NULL, NULL);
 
+	DefineCustomIntVariable(
+		"citus.shard_copy_parallelism",
+		gettext_noop("Sets the number of connections used to copy a shard."),
+		gettext_noop("When copying or moving a shard without logical "
+					 "replication, the data is copied over this many "
+					 "connections in parallel, each of which copies a range of "
+					 "the blocks of the shard, and the indexes are built over "
+					 "this many connections once the data is copied. When set "
+					 "to 1, the shard is copied in a single transaction. "
+					 "Reference tables are copied to new nodes over this many "
+					 "connections, one table at a time per connection."),
+		&ShardCopyParallelism,
+		1, 1, 64,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
+	DefineCustomIntVariable(
+		"citus.max_rebalancer_parallel_moves",
+		gettext_noop("Sets the maximum number of shard moves the rebalancer runs "
+					 "at the same time."),
+		gettext_noop("The rebalancer runs every shard move in a separate "
+					 "transaction. Moves of different shard groups between "
+					 "different nodes can run in parallel, which shortens the "
+					 "rebalance at the cost of more load on the nodes."),
+		&MaxRebalancerParallelMoves,
+		1, 1, 1000,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
+	DefineCustomIntVariable(
+		"citus.max_rebalancer_moves_per_node",
+		gettext_noop("Sets the maximum number of shard moves the rebalancer runs "
+					 "from or to a single node at the same time."),
+		NULL,
+		&MaxRebalancerMovesPerNode,
+		1, 1, 1000,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
+	DefineCustomIntVariable(
+		"citus.rebalancer_max_move_rate",
+		gettext_noop("Sets the maximum rate at which the rebalancer moves shard data."),
+		gettext_noop("When set, the rebalancer does not start a new shard move "
+					 "while the total size of the shards it started moving "
+					 "exceeds this rate since the start of the rebalance. "
+					 "0 means no limit."),
+		&RebalancerMaxMoveRate,
+		0, 0, INT_MAX,
+		PGC_USERSET,
+		GUC_UNIT_KB | GUC_STANDARD,
+		NULL, NULL, NULL);
+
+	DefineCustomEnumVariable(
+		"citus.reference_table_transfer_mode",
+		gettext_noop("Sets how reference tables are copied to new nodes."),
+		gettext_noop("With block_writes, writes to the reference tables are "
+					 "blocked while they are copied. With force_logical, the "
+					 "tables are replicated logically and writes are only "
+					 "blocked while the node catches up with the last changes. "
+					 "auto uses logical replication if all reference tables "
+					 "have a replica identity."),
+		&ReferenceTableTransferMode,
+		REFERENCE_TABLE_TRANSFER_BLOCK_WRITES,
+		reference_table_transfer_mode_options,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
+	DefineCustomBoolVariable(
+		"citus.replicate_reference_tables_on_activate",
+		gettext_noop("Copies reference tables to nodes when they are activated."),
+		gettext_noop("When disabled, reference tables are only copied to a node "
+					 "once shards of distributed tables are placed on it, for "
+					 "instance by create_distributed_table or when moving "
+					 "shards."),
+		&ReplicateReferenceTablesOnActivate,
+		true,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
+	DefineCustomIntVariable(
+		"citus.shard_query_stats_max",
+		gettext_noop("Sets the maximum number of shards for which query statistics "
+					 "are kept."),
+		gettext_noop("The number of tasks and their execution time are tracked "
+					 "per shard in a shared hash table, which is used by the "
+					 "by_query_load rebalance strategy. This configuration "
+					 "value limits the size of the hash table, tasks on shards "
+					 "that do not fit are not counted. 0 disables the "
+					 "statistics."),
+		&ShardQueryStatsMax,
+		10000, 0, INT_MAX,
+		PGC_POSTMASTER,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
+	DefineCustomIntVariable(
+		"citus.shared_metadata_cache_size",
+		gettext_noop("Sets the size of the shared memory cache of shard metadata."),
+		gettext_noop("When set, the pg_dist_shard and pg_dist_placement rows of "
+					 "distributed tables are kept in shared memory, such that "
+					 "backends that access a table for the first time do not "
+					 "need to read them from the catalogs if another backend "
+					 "already did so. Tables that do not fit in the cache are "
+					 "read from the catalogs. The default, 0, disables the cache."),
+		&SharedMetadataCacheSize,
+		0, 0, MAX_KILOBYTES,
+		PGC_POSTMASTER,
+		GUC_UNIT_KB | GUC_STANDARD,
+		NULL, NULL, NULL);
+
+	DefineCustomIntVariable(
+		"citus.result_cache_size",
+		gettext_noop("Sets the size of the shared memory cache of query results."),
+		gettext_noop("When set, the results of read-only queries that consist of "
+					 "a single task, such as router queries and queries on "
+					 "reference tables, are kept in shared memory until a "
+					 "transaction modifies one of their shards through the "
+					 "coordinator. Modifications from workers with metadata or "
+					 "directly on the shards are not seen by the cache. The "
+					 "default, 0, disables the cache."),
+		&ResultCacheSize,
+		0, 0, MAX_KILOBYTES,
+		PGC_POSTMASTER,
+		GUC_UNIT_KB | GUC_STANDARD,
+		NULL, NULL, NULL);
+
+	DefineCustomBoolVariable(
+		"citus.enable_result_cache",
+		gettext_noop("Enables the use of the shared memory cache of query results."),
+		gettext_noop("Queries only use the cache when citus.result_cache_size is "
+					 "set. Sessions that need to see modifications that the cache "
+					 "does not track can disable it."),
+		&EnableResultCache,
+		true,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
 	DefineCustomBoolVariable(
 		"citus.sort_returning",
 		gettext_noop("Sorts the RETURNING clause to get consistent test output"),
@@ -899,16 +1944,172 @@ RegisterCitusConfigVariables(void)
 		NULL, NULL, NULL);
 
 	DefineCustomIntVariable(
-		"citus.max_intermediate_result_size",
-		gettext_noop("Sets the maximum size of the intermediate results in KB for "
-					 "CTEs and complex subqueries."),
-		NULL,
-		&MaxIntermediateResult,
-		1048576, -1, MAX_KILOBYTES,
+		"citus.stat_statements_max",
+		gettext_noop("Sets the maximum number of statements for which distributed "
+					 "execution statistics are kept."),
+		gettext_noop("The calls, execution time, tasks, rows, received bytes and "
+					 "accessed shards of distributed queries are tracked per "
+					 "query, executor and partition key value in a shared hash "
+					 "table, which is shown by citus_stat_statements. When the "
+					 "hash table is full, the least called entries are removed. "
+					 "0 disables the statistics."),
+		&StatStatementsMax,
+		50000, 0, INT_MAX,
+		PGC_POSTMASTER,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
+	DefineCustomIntVariable(
+		"citus.stat_tenants_max",
+		gettext_noop("Sets the maximum number of distribution column values for "
+					 "which router query statistics are kept."),
+		gettext_noop("The calls, execution time, rows and received bytes of "
+					 "router queries are tracked per colocation group and "
+					 "distribution column value, which is shown by "
+					 "citus_stat_tenants. When more values are queried, only the "
+					 "most called ones are kept, and their number of calls may be "
+					 "overestimated by up to calls_error. 0 disables the "
+					 "statistics."),
+		&StatTenantsMax,
+		1000, 0, INT_MAX,
+		PGC_POSTMASTER,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
+	DefineCustomIntVariable(
+		"citus.wait_sampling_interval",
+		gettext_noop("Sets the time between samples of the wait events of "
+					 "distributed queries."),
+		gettext_noop("The maintenance daemon periodically records which "
+					 "backends that take part in distributed queries are "
+					 "waiting, and what they are waiting on, in a ring buffer "
+					 "that is shown by citus_wait_samples. 0 disables "
+					 "sampling."),
+		&WaitSamplingInterval,
+		1 * MS_PER_SECOND, 0, 7 * MS_PER_DAY,
+		PGC_SIGHUP,
+		GUC_UNIT_MS | GUC_STANDARD,
+		NULL, NULL, NULL);
+
+	DefineCustomIntVariable(
+		"citus.wait_sampling_buffer_size",
+		gettext_noop("Sets the number of wait event samples that are kept."),
+		gettext_noop("When the ring buffer of citus_wait_samples is full, the "
+					 "oldest samples are overwritten. 0 disables sampling."),
+		&WaitSamplingBufferSize,
+		10000, 0, INT_MAX / 2,
+		PGC_POSTMASTER,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
+	DefineCustomIntVariable(
+		"citus.max_intermediate_result_size",
+		gettext_noop("Sets the maximum size of the intermediate results in KB for "
+					 "CTEs and complex subqueries."),
+		NULL,
+		&MaxIntermediateResult,
+		1048576, -1, MAX_KILOBYTES,
+		PGC_USERSET,
+		GUC_UNIT_KB | GUC_STANDARD,
+		NULL, NULL, NULL);
+
+	DefineCustomIntVariable(
+		"citus.max_coordinator_query_memory",
+		gettext_noop("Sets the maximum memory in KB that the tuple stores of a "
+					 "distributed query use on the coordinator."),
+		gettext_noop("The rows that the coordinator receives from the workers are "
+					 "kept in tuple stores that each use up to work_mem before they "
+					 "spill to disk. Queries that merge the sorted results of their "
+					 "tasks have a tuple store for every task. When set, the tuple "
+					 "stores of a query share this amount of memory, such that they "
+					 "spill to disk rather than using work_mem each. -1 disables the "
+					 "limit."),
+		&MaxCoordinatorQueryMemory,
+		-1, -1, MAX_KILOBYTES,
+		PGC_USERSET,
+		GUC_UNIT_KB | GUC_STANDARD,
+		NULL, NULL, NULL);
+
+	DefineCustomIntVariable(
+		"citus.max_inlined_intermediate_result_size",
+		gettext_noop("Sets the maximum size in KB of CTE and subquery results that "
+					 "are inlined into the queries sent to the workers."),
+		gettext_noop("Results of CTEs and complex subqueries are normally written to "
+					 "files on the workers that read them. Results that are smaller "
+					 "than this size are instead kept on the coordinator and sent as "
+					 "part of the queries that use them, which avoids a round trip "
+					 "to each worker. 0 disables inlining."),
+		&MaxInlinedIntermediateResultSize,
+		0, 0, MAX_KILOBYTES,
+		PGC_USERSET,
+		GUC_UNIT_KB | GUC_STANDARD,
+		NULL, NULL, NULL);
+
+	DefineCustomIntVariable(
+		"citus.broadcast_join_threshold",
+		gettext_noop("Sets the maximum size in KB of distributed tables that are "
+					 "broadcast to all workers in non-colocated joins."),
+		gettext_noop("When a query joins distributed tables on columns other than "
+					 "their distribution columns, tables whose size recorded in "
+					 "pg_dist_placement is below this threshold are read into an "
+					 "intermediate result that is sent to all workers, such that the "
+					 "join can be pushed down without repartitioning the other "
+					 "tables. 0 disables broadcasting."),
+		&BroadcastJoinThreshold,
+		0, 0, MAX_KILOBYTES,
+		PGC_USERSET,
+		GUC_UNIT_KB | GUC_STANDARD,
+		NULL, NULL, NULL);
+
+	DefineCustomIntVariable(
+		"citus.max_intermediate_result_fetch_connections",
+		gettext_noop("Sets the maximum number of connections that "
+					 "fetch_intermediate_results() opens to the source node."),
+		gettext_noop("When a node fetches several intermediate results from "
+					 "another node, such as the fragments of a repartitioned "
+					 "INSERT..SELECT, it fetches them one after another over a "
+					 "single connection by default. When set higher, up to this "
+					 "many connections are opened and the results are fetched in "
+					 "parallel. The setting applies on the node that fetches the "
+					 "results."),
+		&MaxIntermediateResultFetchConnections,
+		1, 1, 1024,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
+	DefineCustomIntVariable(
+		"citus.max_decoded_result_cache_size",
+		gettext_noop("Sets the maximum total size in KB of intermediate result files "
+					 "whose decoded rows a backend keeps during a transaction."),
+		gettext_noop("Tasks that run over the same connection often read the same "
+					 "intermediate result. When a result file is smaller than this "
+					 "size, the backend keeps its decoded rows in memory until the "
+					 "end of the transaction, and later reads of the unchanged file "
+					 "reuse them instead of parsing it again. The rows can take "
+					 "more memory than the file. 0 disables this."),
+		&MaxDecodedResultCacheSize,
+		0, 0, MAX_KILOBYTES,
 		PGC_USERSET,
 		GUC_UNIT_KB | GUC_STANDARD,
 		NULL, NULL, NULL);
 
+	DefineCustomIntVariable(
+		"citus.intermediate_result_fanout",
+		gettext_noop("Sets the number of workers to which the coordinator sends "
+					 "each CTE and subquery result directly."),
+		gettext_noop("When the result of a CTE or complex subquery is needed on more "
+					 "workers than this, the coordinator only sends it to this many "
+					 "workers. The remaining workers then fetch the result from the "
+					 "workers that already have it, such that the number of workers "
+					 "that have the result doubles in each round. 0 makes the "
+					 "coordinator send results to all workers."),
+		&IntermediateResultFanout,
+		0, 0, INT_MAX,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
 	DefineCustomIntVariable(
 		"citus.max_adaptive_executor_pool_size",
 		gettext_noop("Sets the maximum number of connections per worker node used by "
@@ -927,6 +2128,81 @@ RegisterCitusConfigVariables(void)
 		GUC_STANDARD,
 		NULL, NULL, NULL);
 
+	DefineCustomIntVariable(
+		"citus.analyze_sample_shard_count",
+		gettext_noop("Sets the number of shards that ANALYZE samples to build "
+					 "statistics of a distributed table on the coordinator"),
+		gettext_noop("The table on the coordinator is empty, so the planner on the "
+					 "coordinator has no statistics of distributed tables. When "
+					 "set, ANALYZE on a distributed table also samples rows from "
+					 "this many shards in parallel and stores the column "
+					 "statistics of the sample and the total number of rows of "
+					 "the shards for the table on the coordinator. 0 disables "
+					 "coordinator statistics."),
+		&AnalyzeSampleShardCount,
+		0, 0, INT_MAX,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
+	DefineCustomIntVariable(
+		"citus.max_concurrent_vacuums_per_node",
+		gettext_noop("Sets the maximum number of shards on a single worker node "
+					 "that a distributed VACUUM or ANALYZE processes at a time"),
+		gettext_noop("VACUUM and ANALYZE on distributed tables run on the shards on "
+					 "all worker nodes in parallel. This setting bounds the number "
+					 "of shards that are processed on a worker at the same time, to "
+					 "limit the I/O load of maintenance on the workers. 0 means the "
+					 "number is only limited by "
+					 "citus.max_adaptive_executor_pool_size."),
+		&MaxConcurrentVacuumsPerNode,
+		0, 0, INT_MAX,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
+	DefineCustomIntVariable(
+		"citus.worker_vacuum_cost_delay",
+		gettext_noop("Sets vacuum_cost_delay for VACUUM and ANALYZE on shards"),
+		gettext_noop("When set, distributed VACUUM and ANALYZE commands run on the "
+					 "workers with this cost-based vacuum delay, such that "
+					 "maintenance on many shards can be throttled from the "
+					 "coordinator. -1 uses the vacuum_cost_delay of the workers."),
+		&WorkerVacuumCostDelay,
+		-1, -1, 100,
+		PGC_USERSET,
+		GUC_UNIT_MS | GUC_STANDARD,
+		NULL, NULL, NULL);
+
+	DefineCustomIntVariable(
+		"citus.worker_vacuum_cost_limit",
+		gettext_noop("Sets vacuum_cost_limit for VACUUM and ANALYZE on shards"),
+		gettext_noop("When set, distributed VACUUM and ANALYZE commands run on the "
+					 "workers with this cost limit for the cost-based vacuum "
+					 "delay. -1 uses the vacuum_cost_limit of the workers."),
+		&WorkerVacuumCostLimit,
+		-1, -1, 10000,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
+	DefineCustomIntVariable(
+		"citus.max_concurrent_index_builds_per_node",
+		gettext_noop("Sets the maximum number of shards on a single worker node on "
+					 "which a CONCURRENTLY-enabled index command runs at a time"),
+		gettext_noop("CREATE INDEX CONCURRENTLY, REINDEX CONCURRENTLY and DROP INDEX "
+					 "CONCURRENTLY run on the shards on all worker nodes in "
+					 "parallel. Building many indexes on the same worker at once "
+					 "competes for its CPU, disk and maintenance_work_mem, this "
+					 "setting bounds the number of shards that are processed on a "
+					 "worker at the same time. 0 means the number is only limited "
+					 "by citus.max_adaptive_executor_pool_size."),
+		&MaxConcurrentIndexBuildsPerNode,
+		0, 0, INT_MAX,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
 	DefineCustomIntVariable(
 		"citus.max_worker_nodes_tracked",
 		gettext_noop("Sets the maximum number of worker nodes that are tracked."),
@@ -982,6 +2258,60 @@ RegisterCitusConfigVariables(void)
 		GUC_STANDARD,
 		NULL, NULL, NULL);
 
+	DefineCustomIntVariable(
+		"citus.max_shared_pool_size",
+		gettext_noop("Sets the maximum number of connections to each node across "
+					 "all backends."),
+		gettext_noop("Each backend counts the connections it opens to the other "
+					 "nodes in shared memory. Multi-shard queries only open "
+					 "additional connections to a node while the node is below this "
+					 "limit and otherwise run their tasks over fewer connections, "
+					 "while the first connection to a node waits up to "
+					 "citus.node_connection_timeout for other backends to close "
+					 "theirs. The default, 0, uses max_connections of this node as "
+					 "the limit and -1 disables throttling."),
+		&MaxSharedPoolSize,
+		0, -1, INT_MAX,
+		PGC_SIGHUP,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
+	DefineCustomBoolVariable(
+		"citus.release_connections_at_shared_pool_limit",
+		gettext_noop("Closes connections to nodes that reached "
+					 "citus.max_shared_pool_size at the end of the transaction."),
+		gettext_noop("Backends keep up to citus.max_cached_conns_per_worker "
+					 "connections to each node open after a transaction. When a "
+					 "node has citus.max_shared_pool_size connections across all "
+					 "backends, this makes backends close their connections to the "
+					 "node instead, such that the backends that wait for a "
+					 "connection to the node can take over the slots. Sessions "
+					 "that are idle keep the connections of their last "
+					 "transaction open."),
+		&ReleaseConnectionsAtSharedPoolLimit,
+		true,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
+	DefineCustomIntVariable(
+		"citus.warm_up_connection_count",
+		gettext_noop("Sets the number of connections to each node to establish "
+					 "before the first distributed query of a session."),
+		gettext_noop("When set, the first distributed query in a session opens "
+					 "this number of connections to every active primary node in "
+					 "parallel and keeps them cached, such that the first query "
+					 "does not need to slow start its connection pools. The value is "
+					 "capped at citus.max_cached_conns_per_worker. To establish "
+					 "connections before any query runs, for instance from the "
+					 "connect query of a connection pooler, use "
+					 "citus_warm_up_connections()."),
+		&WarmUpConnectionCount,
+		0, 0, INT_MAX,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
 	DefineCustomIntVariable(
 		"citus.max_assign_task_batch_size",
 		gettext_noop("Sets the maximum number of tasks to assign per round."),
@@ -1023,6 +2353,122 @@ RegisterCitusConfigVariables(void)
 		GUC_STANDARD,
 		NULL, NULL, NULL);
 
+	DefineCustomIntVariable(
+		"citus.append_copy_shard_count",
+		gettext_noop("Sets the number of new shards that COPY into an "
+					 "append-distributed table fills at the same time."),
+		gettext_noop("By default, COPY into an append-distributed table fills "
+					 "one new shard at a time until it reaches "
+					 "citus.shard_max_size. When this is set to a higher value, "
+					 "COPY creates that many shards and distributes the input "
+					 "across them in blocks of 64kB, such that the shards are "
+					 "written in parallel. Shards are placed on different workers "
+					 "when citus.shard_placement_policy is set to round-robin."),
+		&AppendCopyShardCount,
+		1, 1, 64,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
+	DefineCustomIntVariable(
+		"citus.copy_memory_limit",
+		gettext_noop("Sets the maximum memory that a COPY uses to buffer rows "
+					 "for shard placements."),
+		gettext_noop("COPY buffers rows for each shard placement it writes to "
+					 "before sending them, which can use a lot of memory when "
+					 "copying into tables with many shards. When the buffers "
+					 "exceed this limit, the rows buffered for the least recently "
+					 "used shards are sent and their buffers are released. "
+					 "0 disables the limit."),
+		&CopyMemoryLimit,
+		0, 0, MAX_KILOBYTES,
+		PGC_USERSET,
+		GUC_UNIT_KB | GUC_STANDARD,
+		NULL, NULL, NULL);
+
+	DefineCustomBoolVariable(
+		"citus.enable_copy_select_forwarding",
+		gettext_noop("Enables forwarding the COPY output of the workers for "
+					 "COPY (SELECT ..) TO STDOUT."),
+		gettext_noop("When the query of a COPY (SELECT ..) TO STDOUT outside of "
+					 "a transaction block is a multi-shard query whose task "
+					 "results only need to be concatenated, each task runs as "
+					 "a COPY on the workers and their output is sent to the "
+					 "client as it arrives, over multiple connections per "
+					 "worker. Otherwise, the rows are collected by the executor "
+					 "and formatted on the coordinator. Queries that should read "
+					 "from a distributed snapshot always go through the "
+					 "executor."),
+		&EnableCopySelectForwarding,
+		false,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
+	DefineCustomIntVariable(
+		"citus.copy_switchover_threshold",
+		gettext_noop("Sets the threshold for copy to be switched "
+					 "over per connection."),
+		gettext_noop("When a single connection is used for the COPY into "
+					 "multiple placements, the rows of the placements that "
+					 "do not have an active COPY on the connection are buffered. "
+					 "Once the buffer of a placement exceeds this size, the "
+					 "connection ends its current COPY and starts one for that "
+					 "placement. Lower values reduce memory use during COPY "
+					 "into tables with many shards, at the cost of starting "
+					 "more COPY commands."),
+		&CopySwitchOverThresholdBytes,
+		4 * 1024 * 1024, 1, INT_MAX,
+		PGC_USERSET,
+		GUC_UNIT_BYTE | GUC_STANDARD,
+		NULL, NULL, NULL);
+
+	DefineCustomIntVariable(
+		"citus.local_copy_flush_threshold",
+		gettext_noop("Sets the threshold for local copy to be flushed."),
+		gettext_noop("Rows copied into a local placement are buffered and "
+					 "written to the shard once the buffer exceeds this size."),
+		&LocalCopyFlushThresholdBytes,
+		512 * 1024, 1, INT_MAX,
+		PGC_USERSET,
+		GUC_UNIT_BYTE | GUC_STANDARD,
+		NULL, NULL, NULL);
+
+	DefineCustomIntVariable(
+		"citus.ddl_buffer_size",
+		gettext_noop("Sets the number of DDL commands on distributed tables that "
+					 "are buffered in transaction blocks."),
+		gettext_noop("When set, the shard commands of DDL commands in a transaction "
+					 "block are not sent to the workers right away. They are sent "
+					 "as a single command per node once this many DDL commands "
+					 "are buffered, before the next statement that is not such a "
+					 "DDL command, or at commit. Errors in the buffered commands "
+					 "are therefore reported by a later statement. Commands on "
+					 "tables with replicated shards or metadata on the workers "
+					 "are not buffered. 0 disables buffering."),
+		&DDLBufferSize,
+		0, 0, INT_MAX,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
+	DefineCustomIntVariable(
+		"citus.insert_buffer_size",
+		gettext_noop("Sets the number of rows of single-row INSERTs buffered "
+					 "per shard in transaction blocks."),
+		gettext_noop("When set, router INSERTs of a single row without RETURNING "
+					 "or ON CONFLICT in a transaction block are not sent to the "
+					 "worker right away. Their rows are sent to each shard as a "
+					 "single multi-row INSERT once this many rows are buffered, "
+					 "before the next statement that is not such an INSERT, or "
+					 "at commit. Errors in the buffered rows are therefore "
+					 "reported by a later statement. 0 disables buffering."),
+		&InsertBufferSize,
+		0, 0, INT_MAX,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
 	DefineCustomIntVariable(
 		"citus.partition_buffer_size",
 		gettext_noop("Sets the buffer size to use for partition operations."),
@@ -1037,6 +2483,25 @@ RegisterCitusConfigVariables(void)
 		GUC_UNIT_KB | GUC_STANDARD,
 		NULL, NULL, NULL);
 
+	DefineCustomIntVariable(
+		"citus.local_file_flush_after",
+		gettext_noop("Number of bytes written to an intermediate result or "
+					 "partition file after which writeback is started."),
+		gettext_noop("Intermediate results and partition files are written "
+					 "into the page cache. When many dirty pages pile up, the "
+					 "kernel stalls the writing backend until they are written "
+					 "back. When this setting is enabled, the kernel is asked "
+					 "to write the file back in the background each time this "
+					 "amount of data was added to it, such that producing the "
+					 "data and writing it to disk overlap. This causes disk "
+					 "writes for files that might otherwise be removed before "
+					 "being written back. 0 disables forced writeback."),
+		&LocalFileFlushAfter,
+		0, 0, (INT_MAX / 1024), /* result stored in int variable */
+		PGC_USERSET,
+		GUC_UNIT_KB | GUC_STANDARD,
+		NULL, NULL, NULL);
+
 	DefineCustomIntVariable(
 		"citus.large_table_shard_count",
 		gettext_noop("This variable has been deprecated."),
@@ -1102,6 +2567,78 @@ RegisterCitusConfigVariables(void)
 		GUC_STANDARD,
 		NULL, NULL, NULL);
 
+	DefineCustomBoolVariable(
+		"citus.enable_distributed_snapshot",
+		gettext_noop("Reads from a consistent snapshot of all nodes in multi-shard "
+					 "queries and repeatable read transactions."),
+		gettext_noop("By default, every node takes its own snapshot, so a multi-shard "
+					 "SELECT may see a distributed transaction as committed on some "
+					 "nodes but not on others. When enabled, multi-shard SELECTs "
+					 "outside of transaction blocks and repeatable read transactions "
+					 "first begin a repeatable read transaction on all nodes while "
+					 "2PC commits are briefly blocked, and all connections of the "
+					 "transaction import the snapshots of those transactions. "
+					 "Transactions that commit without 2PC, or use "
+					 "citus.enable_async_commit_prepared, may still be observed "
+					 "partially."),
+		&EnableDistributedSnapshot,
+		false,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
+	DefineCustomBoolVariable(
+		"citus.enable_lazy_savepoint_propagation",
+		gettext_noop("Sends savepoints only to the connections that are used inside "
+					 "them."),
+		gettext_noop("By default, every SAVEPOINT, RELEASE SAVEPOINT and ROLLBACK TO "
+					 "SAVEPOINT is sent to all connections that take part in the "
+					 "transaction, which costs round trips to every worker for each "
+					 "iteration of a PL/pgSQL loop with an exception block. When "
+					 "enabled, a SAVEPOINT is only sent to a connection right before "
+					 "the connection is first used inside the sub-transaction, and "
+					 "connections that did not receive it are skipped when it is "
+					 "released or rolled back."),
+		&EnableLazySavepointPropagation,
+		false,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
+	DefineCustomBoolVariable(
+		"citus.enable_single_participant_commit",
+		gettext_noop("Commits transactions that involve a single remote transaction "
+					 "without 2PC"),
+		gettext_noop("When a transaction that would use two-phase commit only opened "
+					 "a transaction over a single connection and did not write "
+					 "anything on the coordinator, committing the remote transaction "
+					 "is already atomic. When enabled, Citus then sends a plain "
+					 "COMMIT, which skips PREPARE TRANSACTION, the record in "
+					 "pg_dist_transaction and its recovery."),
+		&EnableSingleParticipantCommit,
+		false,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
+	DefineCustomIntVariable(
+		"citus.two_phase_commit_delay",
+		gettext_noop("Sets the delay in microseconds between committing a "
+					 "2PC transaction on the coordinator and flushing its "
+					 "commit record to disk."),
+		gettext_noop("Under high concurrency, the WAL flush of the coordinator "
+					 "commit of 2PC transactions can become the bottleneck. "
+					 "When set, commit_delay is set to this value for the "
+					 "commit of 2PC transactions, such that a single flush "
+					 "covers the commits of concurrent transactions. As with "
+					 "commit_delay, the delay only applies when at least "
+					 "commit_siblings other transactions are active."),
+		&TwoPhaseCommitDelay,
+		0, 0, 100000,
+		PGC_SUSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
 	DefineCustomEnumVariable(
 		"citus.single_shard_commit_protocol",
 		gettext_noop(
@@ -1125,8 +2662,10 @@ RegisterCitusConfigVariables(void)
 					 "use when making these assignments. The greedy policy aims to "
 					 "evenly distribute tasks across worker nodes, first-replica just "
 					 "assigns tasks in the order shard placements were created, "
-					 "and the round-robin policy assigns tasks to worker nodes in "
-					 "a round-robin fashion."),
+					 "the round-robin policy assigns tasks to worker nodes in "
+					 "a round-robin fashion, and the locality policy assigns tasks "
+					 "to the local placement if there is one and otherwise to the "
+					 "worker node with the fewest connections from this session."),
 		&TaskAssignmentPolicy,
 		TASK_ASSIGNMENT_GREEDY,
 		task_assignment_policy_options,
@@ -1134,6 +2673,22 @@ RegisterCitusConfigVariables(void)
 		GUC_STANDARD,
 		NULL, NULL, NULL);
 
+	DefineCustomEnumVariable(
+		"citus.task_ordering_policy",
+		gettext_noop("Sets the order in which the adaptive executor starts "
+					 "read-only tasks."),
+		gettext_noop("By default, tasks are started in the order in which they were "
+					 "planned. When set to longest-first, the executor starts the tasks "
+					 "that took longest in earlier executions of the same shards in "
+					 "the current session first, such that a large shard does not end "
+					 "up at the tail of a multi-shard query."),
+		&TaskOrderingPolicy,
+		TASK_ORDERING_PLANNING_ORDER,
+		task_ordering_policy_options,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
 	DefineCustomEnumVariable(
 		"citus.replication_model",
 		gettext_noop("Sets the replication model to be used for distributed tables."),
@@ -1148,6 +2703,39 @@ RegisterCitusConfigVariables(void)
 		GUC_SUPERUSER_ONLY,
 		NULL, NULL, NULL);
 
+	DefineCustomBoolVariable(
+		"citus.enable_parallel_local_data_copy",
+		gettext_noop("Reads existing data with a parallel scan when distributing a "
+					 "table"),
+		gettext_noop("By default, create_distributed_table reads the data of an "
+					 "existing table with a single heap scan. When enabled, the data "
+					 "is read by a query on the local table that is planned by "
+					 "PostgreSQL, which can use parallel workers to read large "
+					 "tables. Tables with row level security and tables with a shard "
+					 "placement on the coordinator are always read with a heap scan."),
+		&EnableParallelLocalDataCopy,
+		false,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
+	DefineCustomIntVariable(
+		"citus.distributed_sequence_cache_size",
+		gettext_noop("Sets the minimum number of values that backends cache from "
+					 "the sequences of distributed tables."),
+		gettext_noop("When a table is distributed, the sequences that it owns, for "
+					 "instance those of serial columns, are altered to cache at least "
+					 "this many values, unless their CACHE is already larger. Every "
+					 "backend then only accesses the sequence once for that many "
+					 "values, at the cost of the gaps that unused cached values "
+					 "leave behind. The cache size is also used for the sequences "
+					 "on MX workers. 0 leaves the sequences unchanged."),
+		&DistributedSequenceCacheSize,
+		0, 0, INT_MAX,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
 	DefineCustomEnumVariable(
 		"citus.task_executor_type",
 		gettext_noop("Sets the executor type to be used for distributed queries."),
@@ -1175,6 +2763,92 @@ RegisterCitusConfigVariables(void)
 		GUC_STANDARD,
 		NULL, NULL, NULL);
 
+	DefineCustomBoolVariable(
+		"citus.enable_repartition_join_bloom_filter",
+		gettext_noop("Filters the larger input of repartition joins with a bloom "
+					 "filter."),
+		gettext_noop("When enabled, the adaptive executor builds a bloom filter "
+					 "over the join keys of the smaller input of a dual hash "
+					 "repartition join before shuffling, and the map tasks of "
+					 "the larger input skip rows that cannot find a join "
+					 "partner. Input sizes are taken from the shard statistics, "
+					 "and joins without statistics are not filtered."),
+		&EnableRepartitionJoinBloomFilter,
+		false,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
+	DefineCustomIntVariable(
+		"citus.repartition_join_bloom_filter_size",
+		gettext_noop("Sets the size of the bloom filters of repartition joins."),
+		gettext_noop("Larger filters let fewer rows without a join partner "
+					 "through, but are more costly to build and to send to the "
+					 "map tasks."),
+		&RepartitionJoinBloomFilterSize,
+		256, 1, 65536,
+		PGC_USERSET,
+		GUC_UNIT_KB | GUC_STANDARD,
+		NULL, NULL, NULL);
+
+	DefineCustomBoolVariable(
+		"citus.enable_partition_fetch_compression",
+		gettext_noop("Compresses partition files while they are fetched between "
+					 "workers."),
+		gettext_noop("When enabled, the fetch tasks of repartition joins ask the "
+					 "worker that holds a partition file to send it in pglz "
+					 "compressed frames, which the fetching worker decompresses "
+					 "as they arrive. This trades CPU time on both workers for "
+					 "less network traffic."),
+		&EnablePartitionFetchCompression,
+		false,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
+	DefineCustomBoolVariable(
+		"citus.enable_repartition_join_sampling",
+		gettext_noop("Range partitions the inputs of repartition joins on sampled "
+					 "split points."),
+		gettext_noop("When enabled, the adaptive executor samples the join keys "
+					 "of both inputs of a dual hash repartition join before "
+					 "shuffling, and both inputs are range partitioned on the "
+					 "quantiles of the sample instead of hash partitioned. This "
+					 "keeps the merge tasks balanced when the join keys are "
+					 "skewed, at the cost of an extra scan of the inputs."),
+		&EnableRepartitionJoinSampling,
+		false,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
+	DefineCustomBoolVariable(
+		"citus.enable_repartition_join_skew_handling",
+		gettext_noop("Spreads the rows of heavy hitter join keys of repartition "
+					 "joins over all partitions."),
+		gettext_noop("When enabled, the adaptive executor samples the join keys "
+					 "of both inputs of a dual hash repartition inner join before "
+					 "shuffling. The rows of join keys that would overload a "
+					 "single merge task are spread over all partitions, and the "
+					 "matching rows of the other input are sent to every "
+					 "partition."),
+		&EnableRepartitionJoinSkewHandling,
+		false,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
+	DefineCustomRealVariable(
+		"citus.repartition_join_sample_percent",
+		gettext_noop("Sets the percentage of rows sampled to pick the split points "
+					 "and heavy hitters of repartition joins."),
+		NULL,
+		&RepartitionJoinSamplePercent,
+		1.0, 0.001, 100.0,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
 	DefineCustomEnumVariable(
 		"citus.shard_placement_policy",
 		gettext_noop("Sets the policy to use when choosing nodes for shard placement."),
@@ -1201,6 +2875,37 @@ RegisterCitusConfigVariables(void)
 		GUC_STANDARD,
 		NULL, NULL, NULL);
 
+	DefineCustomIntVariable(
+		"citus.max_secondary_replication_lag",
+		gettext_noop("Sets the maximum replication lag of the secondary nodes that "
+					 "SELECT queries are routed to."),
+		gettext_noop("When citus.use_secondary_nodes is set to 'always', SELECT "
+					 "queries are routed to the least loaded secondary of each node "
+					 "group that is at most this far behind its primary, according "
+					 "to the last check of the maintenance daemon. If no secondary "
+					 "is within the bound, queries are routed to the primary. "
+					 "Setting it to -1 routes queries to the first secondary of "
+					 "each node group regardless of its lag."),
+		&MaxSecondaryReplicationLag,
+		DISABLE_SECONDARY_LAG_ROUTING, DISABLE_SECONDARY_LAG_ROUTING, INT_MAX,
+		PGC_USERSET,
+		GUC_UNIT_MS | GUC_STANDARD,
+		NULL, NULL, NULL);
+
+	DefineCustomIntVariable(
+		"citus.secondary_node_check_interval",
+		gettext_noop("Sets the time to wait between checks of the replication lag "
+					 "of the secondary nodes."),
+		gettext_noop("The maintenance daemon checks the replication lag and the "
+					 "number of active backends of all secondaries at this "
+					 "interval, which citus.max_secondary_replication_lag uses to "
+					 "route SELECT queries. Setting it to 0 disables the checks."),
+		&SecondaryNodeCheckInterval,
+		5 * MS_PER_SECOND, 0, 7 * MS_PER_DAY,
+		PGC_SIGHUP,
+		GUC_UNIT_MS | GUC_STANDARD,
+		NULL, NULL, NULL);
+
 	DefineCustomEnumVariable(
 		"citus.multi_task_query_log_level",
 		gettext_noop("Sets the level of multi task query execution log messages"),
@@ -1251,6 +2956,22 @@ RegisterCitusConfigVariables(void)
 		GUC_STANDARD,
 		NULL, NULL, NULL);
 
+	DefineCustomBoolVariable(
+		"citus.enable_shard_level_cache_invalidation",
+		gettext_noop("Enables patching the cached metadata of a distributed table "
+					 "in place when only its placements changed."),
+		gettext_noop("When a distributed table is invalidated, for instance because "
+					 "one of its shards was moved, the metadata cache entry of the "
+					 "table is normally rebuilt from scratch. When enabled, the "
+					 "shards of the table are compared with the cached ones, and if "
+					 "they did not change only the placements of the changed shards "
+					 "are replaced, which keeps the sorted shard intervals."),
+		&EnableShardLevelCacheInvalidation,
+		false,
+		PGC_USERSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
 	DefineCustomBoolVariable(
 		"citus.enable_version_checks",
 		gettext_noop("Enables version checks during CREATE/ALTER EXTENSION commands"),
@@ -1316,6 +3037,19 @@ RegisterCitusConfigVariables(void)
 		GUC_STANDARD,
 		NULL, NULL, NULL);
 
+	DefineCustomBoolVariable(
+		"citus.enable_stat_counters",
+		gettext_noop("Enables counting connection, planner and executor events."),
+		gettext_noop("When enabled, the number of established, failed and reused "
+					 "connections, sequential executions, local and remote tasks, "
+					 "and distributed plans of each type are counted per backend "
+					 "in shared memory and shown by citus_stat_counters."),
+		&EnableStatCounters,
+		true,
+		PGC_SUSET,
+		GUC_STANDARD,
+		NULL, NULL, NULL);
+
 	DefineCustomBoolVariable(
 		"citus.enable_statistics_collection",
 		gettext_noop("Enables sending basic usage statistics to Citus."),
@@ -1334,6 +3068,64 @@ RegisterCitusConfigVariables(void)
 		&StatisticsCollectionGucCheckHook,
 		NULL, NULL);
 
+	DefineCustomStringVariable(
+		"citus.job_cache_directories",
+		gettext_noop("Sets the directories in which to place repartition and "
+					 "intermediate result files."),
+		gettext_noop("Repartition jobs and intermediate results write their files "
+					 "to the pgsql_job_cache directory in the data directory by "
+					 "default. When this is set to a comma-separated list of "
+					 "absolute paths, each new job and intermediate results "
+					 "directory is placed on the next of these directories in "
+					 "turn, which spreads the files over their devices."),
+		&JobCacheDirectories,
+		"",
+		PGC_SIGHUP,
+		GUC_SUPERUSER_ONLY,
+		JobCacheDirectoriesGucCheckHook, NULL, NULL);
+
+	DefineCustomIntVariable(
+		"citus.max_job_cache_size",
+		gettext_noop("Limits the disk space used by repartition and intermediate "
+					 "result files on a node."),
+		gettext_noop("Queries that would make the files in the job cache of a node "
+					 "exceed this size fail, and fail before they start writing "
+					 "files when the job cache is already full. -1 means no "
+					 "limit."),
+		&MaxJobCacheSize,
+		-1, -1, INT_MAX,
+		PGC_SUSET,
+		GUC_UNIT_KB | GUC_STANDARD,
+		NULL, NULL, NULL);
+
+	DefineCustomIntVariable(
+		"citus.job_cache_cleanup_interval",
+		gettext_noop("Sets the time to wait between removals of orphaned "
+					 "repartition and intermediate result files."),
+		gettext_noop("The maintenance daemon removes the directories in the job "
+					 "cache of a node whose owner is gone, for instance after a "
+					 "crash, at this interval. Setting it to 0 disables the "
+					 "cleanup."),
+		&JobCacheCleanupInterval,
+		5 * MS_PER_MINUTE, 0, 7 * MS_PER_DAY,
+		PGC_SIGHUP,
+		GUC_UNIT_MS | GUC_STANDARD,
+		NULL, NULL, NULL);
+
+	DefineCustomIntVariable(
+		"citus.orphaned_job_directory_age",
+		gettext_noop("Sets the age after which unmodified repartition job "
+					 "directories count as orphaned."),
+		gettext_noop("Repartition job directories are owned by a backend on "
+					 "another node, so the job cache cleanup removes them once "
+					 "they were not modified for this long. -1 never removes "
+					 "them."),
+		&OrphanedJobDirectoryAge,
+		24 * 60 * 60, -1, INT_MAX,
+		PGC_SIGHUP,
+		GUC_UNIT_S | GUC_STANDARD,
+		NULL, NULL, NULL);
+
 	DefineCustomStringVariable(
 		"citus.node_conninfo",
 		gettext_noop("Sets parameters used for outbound connections."),
@@ -1457,6 +3249,69 @@ NodeConninfoGucCheckHook(char **newval, void **extra, GucSource source)
 }
 
 
+/*
+ * JobCacheDirectoriesGucCheckHook ensures that citus.job_cache_directories is a
+ * list of absolute paths.
+ */
+static bool
+JobCacheDirectoriesGucCheckHook(char **newval, void **extra, GucSource source)
+{
+	if (*newval == NULL || (*newval)[0] == '\0')
+	{
+		return true;
+	}
+
+	List *directoryList = JobCacheDirectoryList(*newval);
+	if (directoryList == NIL)
+	{
+		GUC_check_errdetail("List syntax is invalid.");
+		return false;
+	}
+
+	ListCell *directoryCell = NULL;
+	foreach(directoryCell, directoryList)
+	{
+		char *directoryName = (char *) lfirst(directoryCell);
+
+		if (!is_absolute_path(directoryName))
+		{
+			GUC_check_errdetail("\"%s\" is not an absolute path.", directoryName);
+			return false;
+		}
+	}
+
+	return true;
+}
+
+
+/*
+ * CpuAffinityGucCheckHook ensures that the CPU affinity settings are lists of
+ * CPU numbers and ranges, and that they are only set where pinning works.
+ */
+static bool
+CpuAffinityGucCheckHook(char **newval, void **extra, GucSource source)
+{
+	if (*newval == NULL || (*newval)[0] == '\0')
+	{
+		return true;
+	}
+
+	if (!CpuAffinityIsSupported())
+	{
+		GUC_check_errdetail("CPU affinity is only supported on Linux.");
+		return false;
+	}
+
+	if (!CpuListIsValid(*newval))
+	{
+		GUC_check_errdetail("List syntax is invalid.");
+		return false;
+	}
+
+	return true;
+}
+
+
 /*
  * NodeConninfoGucAssignHook is the assignment hook for the node_conninfo GUC
  * variable. Though this GUC is a "string", we actually parse it as a non-URI
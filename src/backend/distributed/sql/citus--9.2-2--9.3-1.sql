@@ -3,3 +3,88 @@
 /* bump version to 9.3-1 */
 
 #include "udfs/citus_extradata_container/9.3-1.sql"
+#include "udfs/citus_warm_up_connections/9.3-1.sql"
+#include "udfs/citus_shard_map/9.3-1.sql"
+#include "udfs/worker_push_partitioned_query_result/9.3-1.sql"
+#include "udfs/worker_read_merge_files/9.3-1.sql"
+#include "udfs/worker_bloom_filter_build/9.3-1.sql"
+#include "udfs/worker_bloom_filter_contains/9.3-1.sql"
+#include "udfs/worker_skew_hash_partition_table/9.3-1.sql"
+#include "udfs/worker_fetch_partition_file/9.3-1.sql"
+#include "udfs/citus_metadata_sync_progress/9.3-1.sql"
+#include "udfs/dump_local_wait_edges_older_than/9.3-1.sql"
+#include "udfs/worker_append_table_range_to_shard/9.3-1.sql"
+#include "udfs/master_split_shard/9.3-1.sql"
+#include "udfs/citus_shard_query_stats/9.3-1.sql"
+#include "udfs/citus_shard_query_stats_reset/9.3-1.sql"
+#include "udfs/citus_shard_cost_by_query_load/9.3-1.sql"
+#include "udfs/citus_concurrent_index_progress/9.3-1.sql"
+#include "udfs/citus_vacuum_progress/9.3-1.sql"
+#include "udfs/citus_query_stats/9.3-1.sql"
+#include "udfs/citus_stat_statements/9.3-1.sql"
+#include "udfs/citus_wait_samples/9.3-1.sql"
+#include "udfs/citus_wait_samples_reset/9.3-1.sql"
+#include "udfs/citus_stat_counters/9.3-1.sql"
+#include "udfs/citus_stat_counters_reset/9.3-1.sql"
+#include "udfs/citus_command_progress/9.3-1.sql"
+#include "udfs/worker_apply_multi_shard_ddl_command/9.3-1.sql"
+#include "udfs/citus_table_sizes/9.3-1.sql"
+
+CREATE TABLE citus.pg_dist_time_partition_policy(
+    logicalrelid regclass NOT NULL PRIMARY KEY,
+    partition_interval interval NOT NULL,
+    premake_interval interval NOT NULL,
+    retention_interval interval,
+    detach_expired boolean NOT NULL DEFAULT false
+);
+ALTER TABLE citus.pg_dist_time_partition_policy SET SCHEMA pg_catalog;
+GRANT SELECT ON pg_catalog.pg_dist_time_partition_policy TO public;
+
+#include "udfs/create_time_partitions/9.3-1.sql"
+#include "udfs/expire_time_partitions/9.3-1.sql"
+#include "udfs/citus_set_time_partition_policy/9.3-1.sql"
+#include "udfs/citus_run_time_partition_maintenance/9.3-1.sql"
+
+CREATE TABLE citus.pg_dist_rollup(
+    rollup_name text NOT NULL PRIMARY KEY,
+    source_table regclass NOT NULL,
+    watermark_column name NOT NULL,
+    watermark_sequence regclass NOT NULL,
+    rollup_query text NOT NULL,
+    last_watermark bigint NOT NULL
+);
+ALTER TABLE citus.pg_dist_rollup SET SCHEMA pg_catalog;
+GRANT SELECT ON pg_catalog.pg_dist_rollup TO public;
+
+#include "udfs/citus_create_rollup/9.3-1.sql"
+#include "udfs/citus_run_rollup/9.3-1.sql"
+#include "udfs/citus_background_jobs/9.3-1.sql"
+#include "udfs/citus_job_cache_size/9.3-1.sql"
+#include "udfs/citus_job_cache_sizes/9.3-1.sql"
+#include "udfs/citus_stat_tenants/9.3-1.sql"
+#include "udfs/citus_stat_tenants_reset/9.3-1.sql"
+#include "udfs/alter_distributed_table/9.3-1.sql"
+#include "udfs/citus_lookup_rows/9.3-1.sql"
+
+ALTER TABLE pg_catalog.pg_dist_rebalance_strategy
+    DISABLE TRIGGER pg_dist_rebalance_strategy_enterprise_check_trigger;
+INSERT INTO
+    pg_catalog.pg_dist_rebalance_strategy(
+        name,
+        default_strategy,
+        shard_cost_function,
+        node_capacity_function,
+        shard_allowed_on_node_function,
+        default_threshold,
+        minimum_threshold
+    ) VALUES (
+        'by_query_load',
+        false,
+        'citus_shard_cost_by_query_load',
+        'citus_node_capacity_1',
+        'citus_shard_allowed_on_node_true',
+        0.1,
+        0.01
+    );
+ALTER TABLE pg_catalog.pg_dist_rebalance_strategy
+    ENABLE TRIGGER pg_dist_rebalance_strategy_enterprise_check_trigger;
@@ -0,0 +1,9 @@
+CREATE FUNCTION pg_catalog.alter_distributed_table(
+    table_name regclass,
+    distribution_column text DEFAULT NULL,
+    shard_count integer DEFAULT NULL)
+    RETURNS void
+    LANGUAGE C
+    AS 'MODULE_PATHNAME', $$alter_distributed_table$$;
+COMMENT ON FUNCTION pg_catalog.alter_distributed_table(regclass, text, integer)
+    IS 'change the distribution column or shard count of a hash distributed table';
@@ -0,0 +1,19 @@
+CREATE OR REPLACE FUNCTION pg_catalog.citus_background_jobs(
+    OUT database_id oid,
+    OUT job_name text,
+    OUT process_id int,
+    OUT last_start_time timestamptz,
+    OUT last_finish_time timestamptz,
+    OUT last_run_succeeded bool,
+    OUT run_count int8,
+    OUT failure_count int8)
+    RETURNS SETOF record
+    LANGUAGE C STRICT
+AS 'MODULE_PATHNAME', $$citus_background_jobs$$;
+COMMENT ON FUNCTION pg_catalog.citus_background_jobs()
+    IS 'returns the jobs that the maintenance daemons run in background workers';
+
+CREATE VIEW citus.citus_background_jobs AS
+SELECT * FROM pg_catalog.citus_background_jobs();
+ALTER VIEW citus.citus_background_jobs SET SCHEMA pg_catalog;
+GRANT SELECT ON pg_catalog.citus_background_jobs TO PUBLIC;
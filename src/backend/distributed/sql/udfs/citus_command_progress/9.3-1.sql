@@ -0,0 +1,21 @@
+CREATE OR REPLACE FUNCTION pg_catalog.citus_command_progress(
+    OUT pid int,
+    OUT command text,
+    OUT table_name regclass,
+    OUT step text,
+    OUT step_id bigint,
+    OUT tasks_total bigint,
+    OUT tasks_done bigint,
+    OUT fragments bigint,
+    OUT rows bigint,
+    OUT bytes bigint)
+    RETURNS SETOF record
+    LANGUAGE C STRICT
+AS 'MODULE_PATHNAME', $$citus_command_progress$$;
+COMMENT ON FUNCTION pg_catalog.citus_command_progress()
+    IS 'returns the progress of COPY, INSERT..SELECT and repartition queries that are in progress';
+
+CREATE VIEW citus.citus_command_progress AS
+SELECT * FROM pg_catalog.citus_command_progress();
+ALTER VIEW citus.citus_command_progress SET SCHEMA pg_catalog;
+GRANT SELECT ON pg_catalog.citus_command_progress TO PUBLIC;
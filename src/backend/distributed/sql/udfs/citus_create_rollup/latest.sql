@@ -0,0 +1,51 @@
+CREATE OR REPLACE FUNCTION pg_catalog.citus_create_rollup(
+    rollup_name text,
+    source_table regclass,
+    watermark_column name,
+    rollup_query text
+)
+    RETURNS void
+    LANGUAGE plpgsql
+    STRICT
+    SET search_path = pg_catalog
+AS $$
+DECLARE
+    watermark_sequence regclass;
+BEGIN
+    watermark_sequence := pg_get_serial_sequence(source_table::text, watermark_column);
+    IF watermark_sequence IS NULL THEN
+        RAISE EXCEPTION 'column % of % is not filled from a sequence',
+                        watermark_column, source_table
+        USING HINT = 'The watermark column should be a serial, bigserial or identity column.';
+    END IF;
+
+    IF (SELECT s.seqcache FROM pg_sequence s WHERE s.seqrelid = watermark_sequence) > 1 THEN
+        RAISE EXCEPTION 'sequence % caches more than one value', watermark_sequence
+        USING DETAIL = 'Cached values can be used after a rollup has passed them.';
+    END IF;
+
+    INSERT INTO pg_dist_rollup
+    VALUES (rollup_name, source_table, watermark_column, watermark_sequence,
+            rollup_query, 0);
+END;
+$$;
+
+COMMENT ON FUNCTION pg_catalog.citus_create_rollup(text,regclass,name,text)
+    IS 'creates a rollup that aggregates the new rows of a table by running the rollup query over the rows that were not aggregated yet';
+
+CREATE OR REPLACE FUNCTION pg_catalog.citus_drop_rollup(rollup_name text)
+    RETURNS void
+    LANGUAGE plpgsql
+    STRICT
+    SET search_path = pg_catalog
+AS $$
+BEGIN
+    DELETE FROM pg_dist_rollup r WHERE r.rollup_name = $1;
+    IF NOT FOUND THEN
+        RAISE EXCEPTION 'rollup % does not exist', rollup_name;
+    END IF;
+END;
+$$;
+
+COMMENT ON FUNCTION pg_catalog.citus_drop_rollup(text)
+    IS 'drops a rollup, without dropping the table it aggregates into';
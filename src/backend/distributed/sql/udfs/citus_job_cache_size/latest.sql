@@ -0,0 +1,12 @@
+CREATE OR REPLACE FUNCTION pg_catalog.citus_job_cache_size(
+    OUT total_bytes int8,
+    OUT orphaned_bytes int8,
+    OUT directory_count int,
+    OUT orphaned_directory_count int)
+    RETURNS record
+    LANGUAGE C STRICT
+AS 'MODULE_PATHNAME', $$citus_job_cache_size$$;
+COMMENT ON FUNCTION pg_catalog.citus_job_cache_size()
+    IS 'returns the space used by repartition and intermediate result files on this node';
+
+REVOKE ALL ON FUNCTION pg_catalog.citus_job_cache_size() FROM PUBLIC;
@@ -0,0 +1,27 @@
+CREATE OR REPLACE FUNCTION pg_catalog.citus_job_cache_sizes(
+    OUT nodename text,
+    OUT nodeport int,
+    OUT total_bytes int8,
+    OUT orphaned_bytes int8,
+    OUT directory_count int,
+    OUT orphaned_directory_count int)
+    RETURNS SETOF record
+    LANGUAGE sql
+AS $function$
+    SELECT node_size.nodename,
+           node_size.nodeport,
+           split_part(node_size.result, ',', 1)::int8,
+           split_part(node_size.result, ',', 2)::int8,
+           split_part(node_size.result, ',', 3)::int,
+           split_part(node_size.result, ',', 4)::int
+    FROM pg_catalog.run_command_on_workers($$
+        SELECT concat_ws(',', total_bytes, orphaned_bytes, directory_count,
+                         orphaned_directory_count)
+        FROM pg_catalog.citus_job_cache_size()
+    $$) AS node_size
+    WHERE node_size.success
+$function$;
+COMMENT ON FUNCTION pg_catalog.citus_job_cache_sizes()
+    IS 'returns the space used by repartition and intermediate result files on each worker';
+
+REVOKE ALL ON FUNCTION pg_catalog.citus_job_cache_sizes() FROM PUBLIC;
@@ -0,0 +1,7 @@
+CREATE OR REPLACE FUNCTION pg_catalog.citus_lookup_rows(row_type anyelement,
+                                                        distribution_values text[])
+    RETURNS SETOF anyelement
+    LANGUAGE C
+AS 'MODULE_PATHNAME', $$citus_lookup_rows$$;
+COMMENT ON FUNCTION pg_catalog.citus_lookup_rows(anyelement, text[])
+    IS 'returns the rows of a distributed table whose distribution column has one of the given values';
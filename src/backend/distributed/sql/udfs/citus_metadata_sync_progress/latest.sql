@@ -0,0 +1,19 @@
+CREATE OR REPLACE FUNCTION pg_catalog.citus_metadata_sync_progress(
+    OUT pid int,
+    OUT nodeid int,
+    OUT state text,
+    OUT commands_completed bigint,
+    OUT command_count bigint)
+    RETURNS SETOF record
+    LANGUAGE C STRICT
+AS 'MODULE_PATHNAME', $$citus_metadata_sync_progress$$;
+COMMENT ON FUNCTION pg_catalog.citus_metadata_sync_progress()
+    IS 'returns the progress of metadata syncs to nodes that are in progress';
+
+CREATE VIEW citus.citus_metadata_sync_progress AS
+SELECT p.pid, p.nodeid, n.nodename, n.nodeport, p.state,
+       p.commands_completed, p.command_count
+FROM pg_catalog.citus_metadata_sync_progress() p
+JOIN pg_catalog.pg_dist_node n USING (nodeid);
+ALTER VIEW citus.citus_metadata_sync_progress SET SCHEMA pg_catalog;
+GRANT SELECT ON pg_catalog.citus_metadata_sync_progress TO PUBLIC;
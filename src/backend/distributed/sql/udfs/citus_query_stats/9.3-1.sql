@@ -0,0 +1,20 @@
+DROP FUNCTION pg_catalog.citus_query_stats();
+CREATE OR REPLACE FUNCTION pg_catalog.citus_query_stats(
+    OUT queryid bigint,
+    OUT userid oid,
+    OUT dbid oid,
+    OUT executor bigint,
+    OUT partition_key text,
+    OUT calls bigint,
+    OUT total_time double precision,
+    OUT min_time double precision,
+    OUT max_time double precision,
+    OUT tasks bigint,
+    OUT rows bigint,
+    OUT bytes_received bigint,
+    OUT shards bigint)
+    RETURNS SETOF record
+    LANGUAGE C STRICT
+AS 'MODULE_PATHNAME', $$citus_query_stats$$;
+COMMENT ON FUNCTION pg_catalog.citus_query_stats()
+    IS 'returns the execution statistics of distributed queries per executor and partition key';
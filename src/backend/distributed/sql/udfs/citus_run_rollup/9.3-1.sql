@@ -0,0 +1,42 @@
+CREATE OR REPLACE FUNCTION pg_catalog.citus_run_rollup(rollup_name text)
+    RETURNS bigint
+    LANGUAGE plpgsql
+    STRICT
+    SET search_path = pg_catalog
+AS $$
+DECLARE
+    rollup_job record;
+    window_end bigint;
+BEGIN
+    -- concurrent runs of the same rollup would aggregate the same rows twice
+    SELECT * INTO rollup_job FROM pg_dist_rollup r WHERE r.rollup_name = $1 FOR UPDATE;
+    IF NOT FOUND THEN
+        RAISE EXCEPTION 'rollup % does not exist', rollup_name;
+    END IF;
+
+    window_end := coalesce(pg_sequence_last_value(rollup_job.watermark_sequence), 0);
+    IF window_end <= rollup_job.last_watermark THEN
+        RETURN rollup_job.last_watermark;
+    END IF;
+
+    -- writes that obtained a watermark up to window_end may not have committed
+    -- yet, wait for them by taking a lock that conflicts with writes, which is
+    -- released right away when the subtransaction is rolled back
+    BEGIN
+        EXECUTE format('LOCK TABLE %s IN EXCLUSIVE MODE', rollup_job.source_table);
+        RAISE EXCEPTION USING ERRCODE = 'CIRLK';
+    EXCEPTION WHEN SQLSTATE 'CIRLK' THEN
+        NULL;
+    END;
+
+    -- the rollup query is planned like any INSERT..SELECT, pushed down when colocated
+    EXECUTE rollup_job.rollup_query USING rollup_job.last_watermark + 1, window_end;
+
+    UPDATE pg_dist_rollup r SET last_watermark = window_end WHERE r.rollup_name = $1;
+
+    RETURN window_end;
+END;
+$$;
+
+COMMENT ON FUNCTION pg_catalog.citus_run_rollup(text)
+    IS 'aggregates the rows of the source table of a rollup that were added since the last run';
@@ -0,0 +1,33 @@
+CREATE OR REPLACE FUNCTION pg_catalog.citus_run_time_partition_maintenance()
+    RETURNS void
+    LANGUAGE plpgsql
+    SET search_path = pg_catalog
+AS $$
+DECLARE
+    policy record;
+BEGIN
+    -- forget the policies of tables that were dropped
+    DELETE FROM pg_dist_time_partition_policy p
+    WHERE NOT EXISTS (SELECT 1 FROM pg_class c WHERE c.oid = p.logicalrelid);
+
+    FOR policy IN SELECT * FROM pg_dist_time_partition_policy ORDER BY logicalrelid LOOP
+        BEGIN
+            PERFORM create_time_partitions(policy.logicalrelid, policy.partition_interval,
+                                           now() + policy.premake_interval);
+
+            IF policy.retention_interval IS NOT NULL THEN
+                PERFORM expire_time_partitions(policy.logicalrelid,
+                                               now() - policy.retention_interval,
+                                               policy.detach_expired);
+            END IF;
+        EXCEPTION WHEN OTHERS THEN
+            -- do not let one table keep the others from being maintained
+            RAISE WARNING 'could not maintain the partitions of %: %',
+                          policy.logicalrelid, SQLERRM;
+        END;
+    END LOOP;
+END;
+$$;
+
+COMMENT ON FUNCTION pg_catalog.citus_run_time_partition_maintenance()
+    IS 'creates and expires the partitions of the tables in pg_dist_time_partition_policy';
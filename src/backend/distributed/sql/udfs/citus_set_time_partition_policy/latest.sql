@@ -0,0 +1,44 @@
+CREATE OR REPLACE FUNCTION pg_catalog.citus_set_time_partition_policy(
+    table_name regclass,
+    partition_interval interval,
+    premake_interval interval DEFAULT '7 days',
+    retention_interval interval DEFAULT NULL,
+    detach_expired boolean DEFAULT false
+)
+    RETURNS void
+    LANGUAGE plpgsql
+    SET search_path = pg_catalog
+AS $$
+BEGIN
+    IF premake_interval < interval '0' OR retention_interval <= interval '0' THEN
+        RAISE EXCEPTION 'premake and retention intervals should be positive';
+    END IF;
+
+    INSERT INTO pg_dist_time_partition_policy
+    VALUES (table_name, partition_interval, premake_interval, retention_interval,
+            detach_expired)
+    ON CONFLICT (logicalrelid) DO UPDATE SET
+        partition_interval = EXCLUDED.partition_interval,
+        premake_interval = EXCLUDED.premake_interval,
+        retention_interval = EXCLUDED.retention_interval,
+        detach_expired = EXCLUDED.detach_expired;
+
+    -- create the partitions right away, which also validates the table
+    PERFORM create_time_partitions(table_name, partition_interval,
+                                   now() + premake_interval);
+END;
+$$;
+
+COMMENT ON FUNCTION pg_catalog.citus_set_time_partition_policy(regclass,interval,interval,interval,boolean)
+    IS 'sets the intervals at which the maintenance daemon creates and expires the partitions of a time partitioned table';
+
+CREATE OR REPLACE FUNCTION pg_catalog.citus_remove_time_partition_policy(table_name regclass)
+    RETURNS void
+    LANGUAGE sql
+    STRICT
+AS $$
+    DELETE FROM pg_catalog.pg_dist_time_partition_policy WHERE logicalrelid = table_name;
+$$;
+
+COMMENT ON FUNCTION pg_catalog.citus_remove_time_partition_policy(regclass)
+    IS 'stops the maintenance daemon from creating and expiring the partitions of a time partitioned table';
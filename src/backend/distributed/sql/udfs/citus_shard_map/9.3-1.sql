@@ -0,0 +1,28 @@
+CREATE OR REPLACE FUNCTION pg_catalog.citus_shard_map(
+    table_name regclass,
+    OUT shardid bigint,
+    OUT shard_name text,
+    OUT shard_min_value text,
+    OUT shard_max_value text,
+    OUT hash_function regproc,
+    OUT nodename text,
+    OUT nodeport int)
+    RETURNS SETOF record
+    LANGUAGE C STRICT
+AS 'MODULE_PATHNAME', $$citus_shard_map$$;
+COMMENT ON FUNCTION pg_catalog.citus_shard_map(regclass)
+    IS 'returns the shard intervals and active placements of a distributed table';
+
+CREATE OR REPLACE FUNCTION pg_catalog.citus_shard_map_token(table_name regclass)
+    RETURNS bigint
+    LANGUAGE C STRICT
+AS 'MODULE_PATHNAME', $$citus_shard_map_token$$;
+COMMENT ON FUNCTION pg_catalog.citus_shard_map_token(regclass)
+    IS 'returns a token that changes whenever the shard map of a distributed table changes';
+
+CREATE OR REPLACE FUNCTION pg_catalog.citus_check_shard_map_token(table_name regclass, token bigint)
+    RETURNS void
+    LANGUAGE C STRICT
+AS 'MODULE_PATHNAME', $$citus_check_shard_map_token$$;
+COMMENT ON FUNCTION pg_catalog.citus_check_shard_map_token(regclass, bigint)
+    IS 'errors out if the shard map of a distributed table no longer matches the token';
@@ -0,0 +1,9 @@
+CREATE OR REPLACE FUNCTION pg_catalog.citus_shard_query_stats(
+    OUT shardid bigint,
+    OUT query_count bigint,
+    OUT total_time double precision)
+    RETURNS SETOF record
+    LANGUAGE C STRICT
+AS 'MODULE_PATHNAME', $$citus_shard_query_stats$$;
+COMMENT ON FUNCTION pg_catalog.citus_shard_query_stats()
+    IS 'returns the number of tasks and their total execution time in milliseconds per shard';
@@ -0,0 +1,7 @@
+CREATE OR REPLACE FUNCTION pg_catalog.citus_shard_query_stats_reset()
+    RETURNS void
+    LANGUAGE C STRICT
+AS 'MODULE_PATHNAME', $$citus_shard_query_stats_reset$$;
+COMMENT ON FUNCTION pg_catalog.citus_shard_query_stats_reset()
+    IS 'removes the query statistics of all shards';
+REVOKE ALL ON FUNCTION pg_catalog.citus_shard_query_stats_reset() FROM PUBLIC;
@@ -0,0 +1,23 @@
+CREATE OR REPLACE FUNCTION pg_catalog.citus_stat_counters(
+    OUT connection_establishment_succeeded bigint,
+    OUT connection_establishment_failed bigint,
+    OUT connection_reused bigint,
+    OUT sequential_executions bigint,
+    OUT local_tasks_executed bigint,
+    OUT remote_tasks_executed bigint,
+    OUT fast_path_plans bigint,
+    OUT router_plans bigint,
+    OUT multi_shard_plans bigint,
+    OUT repartition_plans bigint,
+    OUT insert_select_via_coordinator_plans bigint,
+    OUT stats_reset timestamptz)
+    RETURNS SETOF record
+    LANGUAGE C STRICT
+AS 'MODULE_PATHNAME', $$citus_stat_counters$$;
+COMMENT ON FUNCTION pg_catalog.citus_stat_counters()
+    IS 'returns the connection, planner and executor event counters of all backends';
+
+CREATE VIEW citus.citus_stat_counters AS
+SELECT * FROM pg_catalog.citus_stat_counters();
+ALTER VIEW citus.citus_stat_counters SET SCHEMA pg_catalog;
+GRANT SELECT ON pg_catalog.citus_stat_counters TO PUBLIC;
@@ -0,0 +1,7 @@
+CREATE OR REPLACE FUNCTION pg_catalog.citus_stat_counters_reset()
+    RETURNS void
+    LANGUAGE C STRICT
+AS 'MODULE_PATHNAME', $$citus_stat_counters_reset$$;
+COMMENT ON FUNCTION pg_catalog.citus_stat_counters_reset()
+    IS 'resets the connection, planner and executor event counters';
+REVOKE ALL ON FUNCTION pg_catalog.citus_stat_counters_reset() FROM PUBLIC;
@@ -0,0 +1,58 @@
+DROP VIEW pg_catalog.citus_stat_statements;
+DROP FUNCTION pg_catalog.citus_stat_statements();
+CREATE OR REPLACE FUNCTION pg_catalog.citus_stat_statements(
+    OUT queryid bigint,
+    OUT userid oid,
+    OUT dbid oid,
+    OUT query text,
+    OUT executor bigint,
+    OUT partition_key text,
+    OUT calls bigint,
+    OUT total_time double precision,
+    OUT min_time double precision,
+    OUT max_time double precision,
+    OUT tasks bigint,
+    OUT rows bigint,
+    OUT bytes_received bigint,
+    OUT shards bigint)
+RETURNS SETOF record
+LANGUAGE plpgsql
+AS $citus_stat_statements$
+BEGIN
+ IF EXISTS (
+    SELECT extname FROM pg_extension
+    WHERE extname = 'pg_stat_statements')
+ THEN
+    RETURN QUERY SELECT pss.queryid, pss.userid, pss.dbid, pss.query, cqs.executor,
+                        cqs.partition_key, cqs.calls, cqs.total_time, cqs.min_time,
+                        cqs.max_time, cqs.tasks, cqs.rows, cqs.bytes_received,
+                        cqs.shards
+                 FROM pg_stat_statements(true) pss
+                    JOIN citus_query_stats() cqs
+                    USING (queryid, userid, dbid);
+ ELSE
+    RAISE EXCEPTION 'pg_stat_statements is not installed'
+        USING HINT = 'install pg_stat_statements extension and try again';
+ END IF;
+END;
+$citus_stat_statements$;
+
+CREATE VIEW citus.citus_stat_statements AS
+SELECT
+  queryid,
+  userid,
+  dbid,
+  query,
+  pg_catalog.citus_executor_name(executor::int) AS executor,
+  partition_key,
+  calls,
+  total_time,
+  min_time,
+  max_time,
+  tasks,
+  rows,
+  bytes_received,
+  shards
+FROM pg_catalog.citus_stat_statements();
+ALTER VIEW citus.citus_stat_statements SET SCHEMA pg_catalog;
+GRANT SELECT ON pg_catalog.citus_stat_statements TO public;
@@ -0,0 +1,19 @@
+CREATE OR REPLACE FUNCTION pg_catalog.citus_stat_tenants(
+    OUT database_id oid,
+    OUT colocation_id int,
+    OUT distribution_value text,
+    OUT calls bigint,
+    OUT calls_error bigint,
+    OUT total_time double precision,
+    OUT rows bigint,
+    OUT bytes_received bigint)
+    RETURNS SETOF record
+    LANGUAGE C STRICT
+AS 'MODULE_PATHNAME', $$citus_stat_tenants$$;
+COMMENT ON FUNCTION pg_catalog.citus_stat_tenants()
+    IS 'returns the router query statistics of the most called distribution column values';
+
+CREATE VIEW citus.citus_stat_tenants AS
+SELECT * FROM pg_catalog.citus_stat_tenants();
+ALTER VIEW citus.citus_stat_tenants SET SCHEMA pg_catalog;
+GRANT SELECT ON pg_catalog.citus_stat_tenants TO PUBLIC;
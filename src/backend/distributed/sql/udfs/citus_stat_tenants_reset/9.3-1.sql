@@ -0,0 +1,7 @@
+CREATE OR REPLACE FUNCTION pg_catalog.citus_stat_tenants_reset()
+    RETURNS void
+    LANGUAGE C STRICT
+AS 'MODULE_PATHNAME', $$citus_stat_tenants_reset$$;
+COMMENT ON FUNCTION pg_catalog.citus_stat_tenants_reset()
+    IS 'removes the statistics of all distribution column values';
+REVOKE ALL ON FUNCTION pg_catalog.citus_stat_tenants_reset() FROM PUBLIC;
@@ -0,0 +1,11 @@
+CREATE OR REPLACE FUNCTION pg_catalog.citus_table_sizes(
+    table_names regclass[],
+    OUT table_name regclass,
+    OUT relation_size bigint,
+    OUT table_size bigint,
+    OUT total_relation_size bigint)
+    RETURNS SETOF record
+    LANGUAGE C STRICT
+AS 'MODULE_PATHNAME', $$citus_table_sizes$$;
+COMMENT ON FUNCTION pg_catalog.citus_table_sizes(regclass[])
+    IS 'returns the relation, table and total relation sizes of the given distributed tables';
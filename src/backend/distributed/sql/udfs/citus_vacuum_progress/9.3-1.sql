@@ -0,0 +1,16 @@
+CREATE OR REPLACE FUNCTION pg_catalog.citus_vacuum_progress(
+    OUT pid int,
+    OUT shardid bigint,
+    OUT state text)
+    RETURNS SETOF record
+    LANGUAGE C STRICT
+AS 'MODULE_PATHNAME', $$citus_vacuum_progress$$;
+COMMENT ON FUNCTION pg_catalog.citus_vacuum_progress()
+    IS 'returns the progress of distributed VACUUM and ANALYZE commands on shards that are in progress';
+
+CREATE VIEW citus.citus_vacuum_progress AS
+SELECT p.pid, s.logicalrelid AS table_name, p.shardid, p.state
+FROM pg_catalog.citus_vacuum_progress() p
+JOIN pg_catalog.pg_dist_shard s USING (shardid);
+ALTER VIEW citus.citus_vacuum_progress SET SCHEMA pg_catalog;
+GRANT SELECT ON pg_catalog.citus_vacuum_progress TO PUBLIC;
@@ -0,0 +1,20 @@
+CREATE OR REPLACE FUNCTION pg_catalog.citus_wait_samples(
+    OUT sample_time timestamptz,
+    OUT database_id oid,
+    OUT process_id int,
+    OUT initiator_node_identifier int,
+    OUT worker_query bool,
+    OUT transaction_number int8,
+    OUT citus_wait_event text,
+    OUT wait_event_type text,
+    OUT wait_event text)
+    RETURNS SETOF record
+    LANGUAGE C STRICT
+AS 'MODULE_PATHNAME', $$citus_wait_samples$$;
+COMMENT ON FUNCTION pg_catalog.citus_wait_samples()
+    IS 'returns the periodic samples of what backends in distributed queries were waiting on';
+
+CREATE VIEW citus.citus_wait_samples AS
+SELECT * FROM pg_catalog.citus_wait_samples();
+ALTER VIEW citus.citus_wait_samples SET SCHEMA pg_catalog;
+GRANT SELECT ON pg_catalog.citus_wait_samples TO PUBLIC;
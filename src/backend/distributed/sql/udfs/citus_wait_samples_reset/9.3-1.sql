@@ -0,0 +1,7 @@
+CREATE OR REPLACE FUNCTION pg_catalog.citus_wait_samples_reset()
+    RETURNS void
+    LANGUAGE C STRICT
+AS 'MODULE_PATHNAME', $$citus_wait_samples_reset$$;
+COMMENT ON FUNCTION pg_catalog.citus_wait_samples_reset()
+    IS 'removes all wait event samples';
+REVOKE ALL ON FUNCTION pg_catalog.citus_wait_samples_reset() FROM PUBLIC;
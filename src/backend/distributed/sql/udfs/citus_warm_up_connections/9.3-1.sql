@@ -0,0 +1,6 @@
+CREATE OR REPLACE FUNCTION pg_catalog.citus_warm_up_connections(connection_count int DEFAULT 1)
+    RETURNS int
+    LANGUAGE C STRICT
+AS 'MODULE_PATHNAME', $$citus_warm_up_connections$$;
+COMMENT ON FUNCTION pg_catalog.citus_warm_up_connections(int)
+    IS 'establishes and caches connections to all active primary nodes';
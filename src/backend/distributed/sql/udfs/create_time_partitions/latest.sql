@@ -0,0 +1,124 @@
+CREATE OR REPLACE FUNCTION pg_catalog.create_time_partitions(
+    table_name regclass,
+    partition_interval interval,
+    end_at timestamptz,
+    start_from timestamptz DEFAULT now()
+)
+    RETURNS int
+    LANGUAGE plpgsql
+    SET search_path = pg_catalog
+AS $$
+DECLARE
+    partition_strategy "char";
+    partition_column_count int;
+    partition_column_type regtype;
+    parent_schema text;
+    parent_name text;
+    parent_owner text;
+    saved_role text;
+    partition_units text[] := ARRAY['month', 'day', 'hour', 'minute', 'second'];
+    suffix_formats text[] := ARRAY['YYYY_MM', 'YYYY_MM_DD', 'YYYY_MM_DD_HH24',
+                                   'YYYY_MM_DD_HH24MI', 'YYYY_MM_DD_HH24MISS'];
+    unit_index int := 1;
+    range_start timestamptz;
+    range_end timestamptz;
+    range_start_text text;
+    range_end_text text;
+    partition_name text;
+    partition_count int := 0;
+BEGIN
+    SELECT p.partstrat, p.partnatts, a.atttypid::regtype
+    INTO partition_strategy, partition_column_count, partition_column_type
+    FROM pg_partitioned_table p
+    LEFT JOIN pg_attribute a ON (a.attrelid = p.partrelid AND a.attnum = p.partattrs[0])
+    WHERE p.partrelid = table_name;
+
+    IF NOT FOUND THEN
+        RAISE EXCEPTION '% is not a partitioned table', table_name;
+    END IF;
+
+    IF partition_strategy <> 'r' OR partition_column_count <> 1 OR
+       partition_column_type IS NULL OR
+       partition_column_type NOT IN ('date'::regtype, 'timestamp'::regtype,
+                                     'timestamptz'::regtype) THEN
+        RAISE EXCEPTION 'cannot create time partitions for %', table_name
+        USING DETAIL = 'Only tables that are range partitioned by a single date, '
+                       'timestamp or timestamptz column are supported.';
+    END IF;
+
+    IF partition_interval <= interval '0' THEN
+        RAISE EXCEPTION 'partition interval should be positive';
+    END IF;
+
+    IF partition_column_type = 'date'::regtype AND
+       partition_interval <> date_trunc('day', partition_interval) THEN
+        RAISE EXCEPTION 'partition interval should be whole days for a date column';
+    END IF;
+
+    SELECT n.nspname, c.relname, pg_get_userbyid(c.relowner)
+    INTO parent_schema, parent_name, parent_owner
+    FROM pg_class c JOIN pg_namespace n ON (n.oid = c.relnamespace)
+    WHERE c.oid = table_name;
+
+    -- start at the coarsest unit of which the interval is a whole number
+    WHILE unit_index < array_length(partition_units, 1) AND
+          partition_interval <> date_trunc(partition_units[unit_index],
+                                           partition_interval) LOOP
+        unit_index := unit_index + 1;
+    END LOOP;
+
+    range_start := date_trunc(partition_units[unit_index], start_from);
+
+    -- continue after the existing partitions, such that the ranges do not overlap
+    SELECT greatest(range_start,
+                    max((regexp_match(pg_get_expr(c.relpartbound, c.oid),
+                                      'TO \(''([^'']*)''\)'))[1]::timestamptz))
+    INTO range_start
+    FROM pg_inherits i JOIN pg_class c ON (c.oid = i.inhrelid)
+    WHERE i.inhparent = table_name;
+
+    -- name the partitions by their start, as precise as the first one needs
+    WHILE unit_index < array_length(partition_units, 1) AND
+          range_start <> date_trunc(partition_units[unit_index], range_start) LOOP
+        unit_index := unit_index + 1;
+    END LOOP;
+
+    -- the partitions should be owned by the owner of the parent
+    saved_role := current_setting('role');
+    IF current_user <> parent_owner THEN
+        PERFORM set_config('role', parent_owner, true);
+    END IF;
+
+    WHILE range_start < end_at LOOP
+        range_end := range_start + partition_interval;
+
+        IF partition_column_type = 'date'::regtype THEN
+            range_start_text := range_start::date::text;
+            range_end_text := range_end::date::text;
+        ELSIF partition_column_type = 'timestamp'::regtype THEN
+            range_start_text := range_start::timestamp::text;
+            range_end_text := range_end::timestamp::text;
+        ELSE
+            range_start_text := range_start::text;
+            range_end_text := range_end::text;
+        END IF;
+
+        partition_name := parent_name || '_p' ||
+                          to_char(range_start, suffix_formats[unit_index]);
+
+        EXECUTE format('CREATE TABLE %I.%I PARTITION OF %I.%I FOR VALUES FROM (%L) TO (%L)',
+                       parent_schema, partition_name, parent_schema, parent_name,
+                       range_start_text, range_end_text);
+
+        partition_count := partition_count + 1;
+        range_start := range_end;
+    END LOOP;
+
+    PERFORM set_config('role', saved_role, true);
+
+    RETURN partition_count;
+END;
+$$;
+
+COMMENT ON FUNCTION pg_catalog.create_time_partitions(regclass,interval,timestamptz,timestamptz)
+    IS 'creates the partitions of a time partitioned table that cover the given range';
@@ -0,0 +1,16 @@
+CREATE FUNCTION pg_catalog.dump_local_wait_edges_older_than(
+                    min_transaction_age_ms int4,
+                    OUT waiting_pid int4,
+                    OUT waiting_node_id int4,
+                    OUT waiting_transaction_num int8,
+                    OUT waiting_transaction_stamp timestamptz,
+                    OUT blocking_pid int4,
+                    OUT blocking_node_id int4,
+                    OUT blocking_transaction_num int8,
+                    OUT blocking_transaction_stamp timestamptz,
+                    OUT blocking_transaction_waiting bool)
+RETURNS SETOF RECORD
+LANGUAGE C STRICT
+AS 'MODULE_PATHNAME', $$dump_local_wait_edges_older_than$$;
+COMMENT ON FUNCTION pg_catalog.dump_local_wait_edges_older_than(int4)
+IS 'returns local lock wait chains that start from distributed transactions older than the given number of milliseconds';
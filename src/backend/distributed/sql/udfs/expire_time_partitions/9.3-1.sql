@@ -0,0 +1,41 @@
+CREATE OR REPLACE FUNCTION pg_catalog.expire_time_partitions(
+    table_name regclass,
+    older_than timestamptz,
+    detach_only boolean DEFAULT false
+)
+    RETURNS int
+    LANGUAGE plpgsql
+    SET search_path = pg_catalog
+AS $$
+DECLARE
+    expired_partition regclass;
+    partition_count int := 0;
+BEGIN
+    IF NOT EXISTS (SELECT 1 FROM pg_partitioned_table p WHERE p.partrelid = table_name) THEN
+        RAISE EXCEPTION '% is not a partitioned table', table_name;
+    END IF;
+
+    FOR expired_partition IN
+        SELECT c.oid::regclass
+        FROM pg_inherits i JOIN pg_class c ON (c.oid = i.inhrelid)
+        WHERE i.inhparent = table_name AND
+              (regexp_match(pg_get_expr(c.relpartbound, c.oid),
+                            'TO \(''([^'']*)''\)'))[1]::timestamptz <= older_than
+        ORDER BY c.oid
+    LOOP
+        IF detach_only THEN
+            EXECUTE format('ALTER TABLE %s DETACH PARTITION %s',
+                           table_name, expired_partition);
+        ELSE
+            EXECUTE format('DROP TABLE %s', expired_partition);
+        END IF;
+
+        partition_count := partition_count + 1;
+    END LOOP;
+
+    RETURN partition_count;
+END;
+$$;
+
+COMMENT ON FUNCTION pg_catalog.expire_time_partitions(regclass,timestamptz,boolean)
+    IS 'drops or detaches the partitions of a time partitioned table that end before the given time';
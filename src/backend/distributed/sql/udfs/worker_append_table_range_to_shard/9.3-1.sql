@@ -0,0 +1,8 @@
+CREATE FUNCTION pg_catalog.worker_append_table_range_to_shard(text, text, text, integer,
+                                                              integer, integer)
+    RETURNS void
+    LANGUAGE C STRICT
+    AS 'MODULE_PATHNAME', $$worker_append_table_range_to_shard$$;
+COMMENT ON FUNCTION pg_catalog.worker_append_table_range_to_shard(text, text, text, integer,
+                                                                  integer, integer)
+    IS 'append a block range of a remote table to a shard, concurrently with other ranges';
@@ -0,0 +1,8 @@
+CREATE FUNCTION pg_catalog.worker_apply_multi_shard_ddl_command(shard_ids bigint[],
+                                                                schema_name text,
+                                                                ddl_command text)
+    RETURNS void
+    LANGUAGE C STRICT
+    AS 'MODULE_PATHNAME', $$worker_apply_multi_shard_ddl_command$$;
+COMMENT ON FUNCTION pg_catalog.worker_apply_multi_shard_ddl_command(bigint[], text, text)
+    IS 'extend ddl command with each of the shard ids and apply on database';
@@ -0,0 +1,13 @@
+CREATE FUNCTION pg_catalog.worker_bloom_filter_build_sfunc(bytea, integer, integer)
+RETURNS bytea
+LANGUAGE C PARALLEL SAFE
+AS 'MODULE_PATHNAME', $$worker_bloom_filter_build_sfunc$$;
+COMMENT ON FUNCTION pg_catalog.worker_bloom_filter_build_sfunc(bytea, integer, integer)
+IS 'add a hash value to a bloom filter of the given size in bytes';
+
+CREATE AGGREGATE pg_catalog.worker_bloom_filter_build(integer, integer) (
+        sfunc = pg_catalog.worker_bloom_filter_build_sfunc,
+        stype = bytea
+);
+COMMENT ON AGGREGATE pg_catalog.worker_bloom_filter_build(integer, integer)
+IS 'build a bloom filter of the given size in bytes over a set of hash values';
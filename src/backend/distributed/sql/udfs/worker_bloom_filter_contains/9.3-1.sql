@@ -0,0 +1,6 @@
+CREATE FUNCTION pg_catalog.worker_bloom_filter_contains(bytea, integer)
+RETURNS boolean
+LANGUAGE C STRICT IMMUTABLE PARALLEL SAFE
+AS 'MODULE_PATHNAME', $$worker_bloom_filter_contains$$;
+COMMENT ON FUNCTION pg_catalog.worker_bloom_filter_contains(bytea, integer)
+IS 'check whether a hash value may have been added to a bloom filter';
@@ -0,0 +1,8 @@
+CREATE FUNCTION pg_catalog.worker_fetch_partition_file(bigint, integer, integer, integer, text,
+                                                       integer, compress boolean)
+    RETURNS void
+    LANGUAGE C STRICT
+    AS 'MODULE_PATHNAME', $$worker_fetch_partition_file$$;
+COMMENT ON FUNCTION pg_catalog.worker_fetch_partition_file(bigint, integer, integer, integer, text,
+                                                           integer, boolean)
+    IS 'fetch partition file from remote node, optionally in compressed frames';
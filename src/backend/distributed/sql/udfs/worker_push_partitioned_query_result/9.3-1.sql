@@ -0,0 +1,18 @@
+CREATE OR REPLACE FUNCTION pg_catalog.worker_push_partitioned_query_result(
+    result_prefix text,
+    query text,
+    partition_column_index int,
+    partition_method citus.distribution_type,
+    partition_min_values text[],
+    partition_max_values text[],
+    binaryCopy boolean,
+    target_node_names text[],
+    target_node_ports int[],
+    OUT partition_index int,
+    OUT rows_written bigint,
+    OUT bytes_written bigint)
+RETURNS SETOF record
+LANGUAGE C STRICT VOLATILE
+AS 'MODULE_PATHNAME', $$worker_push_partitioned_query_result$$;
+COMMENT ON FUNCTION pg_catalog.worker_push_partitioned_query_result(text, text, int, citus.distribution_type, text[], text[], boolean, text[], int[])
+IS 'execute a query and push the partitions of its results to result files on the given nodes';
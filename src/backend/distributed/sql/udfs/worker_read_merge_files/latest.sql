@@ -0,0 +1,9 @@
+CREATE OR REPLACE FUNCTION pg_catalog.worker_read_merge_files(
+    job_id bigint,
+    task_id integer,
+    format pg_catalog.citus_copy_format default 'text')
+RETURNS SETOF record
+LANGUAGE C STRICT VOLATILE
+AS 'MODULE_PATHNAME', $$worker_read_merge_files$$;
+COMMENT ON FUNCTION pg_catalog.worker_read_merge_files(bigint,integer,pg_catalog.citus_copy_format)
+IS 'read the partition files fetched for a merge task and return them as a set of records';
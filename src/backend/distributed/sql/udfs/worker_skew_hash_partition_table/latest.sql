@@ -0,0 +1,8 @@
+CREATE FUNCTION pg_catalog.worker_skew_hash_partition_table(bigint, integer, text, text, oid,
+                                                            anyarray, integer[], integer[])
+    RETURNS void
+    LANGUAGE C STRICT
+    AS 'MODULE_PATHNAME', $$worker_skew_hash_partition_table$$;
+COMMENT ON FUNCTION pg_catalog.worker_skew_hash_partition_table(bigint, integer, text, text, oid,
+                                                                anyarray, integer[], integer[])
+    IS 'hash partition query results, spreading and broadcasting heavy hitters';
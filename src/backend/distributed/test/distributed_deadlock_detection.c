@@ -50,7 +50,8 @@ get_adjacency_list_wait_graph(PG_FUNCTION_ARGS)
 	CheckCitusVersion(ERROR);
 
 	Tuplestorestate *tupleStore = SetupTuplestore(fcinfo, &tupleDescriptor);
-	WaitGraph *waitGraph = BuildGlobalWaitGraph();
+	int minTransactionAgeMs = 0;
+	WaitGraph *waitGraph = BuildGlobalWaitGraph(minTransactionAgeMs);
 	HTAB *adjacencyList = BuildAdjacencyListsForWaitGraph(waitGraph);
 
 	/* iterate on all nodes */
@@ -0,0 +1,517 @@
+/*-------------------------------------------------------------------------
+ *
+ * test/src/planner_microbenchmarks.c
+ *
+ * This file contains functions that run hot paths of the planner, such as
+ * shard pruning and deparsing, a given number of times and return how long
+ * they took and how much memory they used. They allow profiling the planner
+ * on a given schema without running a full load test.
+ *
+ * Copyright (c) Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include "postgres.h"
+#include "c.h"
+#include "fmgr.h"
+#include "funcapi.h"
+#include "miscadmin.h"
+
+#include <float.h>
+
+#include "access/htup_details.h"
+#include "access/stratnum.h"
+#include "distributed/citus_custom_scan.h"
+#include "distributed/deparse_shard_query.h"
+#include "distributed/distributed_planner.h"
+#include "distributed/errormessage.h"
+#include "distributed/listutils.h"
+#include "distributed/metadata_cache.h"
+#include "distributed/multi_join_order.h"
+#include "distributed/multi_physical_planner.h"
+#include "distributed/shard_pruning.h"
+#include "distributed/shardinterval_utils.h"
+#include "nodes/memnodes.h"
+#include "nodes/nodeFuncs.h"
+#include "nodes/parsenodes.h"
+#include "nodes/pg_list.h"
+#include "nodes/primnodes.h"
+#include "optimizer/clauses.h"
+#include "portability/instr_time.h"
+#include "tcop/tcopprot.h"
+#include "utils/builtins.h"
+#include "utils/lsyscache.h"
+#include "utils/memutils.h"
+
+
+/* number of columns returned by the microbenchmark functions */
+#define MICROBENCHMARK_COLUMN_COUNT 6
+
+
+/* function that runs one iteration of a microbenchmark */
+typedef void (*MicrobenchmarkFunction)(void *arg);
+
+/* timings and memory usage of the iterations of a microbenchmark */
+typedef struct MicrobenchmarkStats
+{
+	int iterationCount;
+	double totalTimeUs;
+	double minTimeUs;
+	double maxTimeUs;
+
+	/* growth of the memory used by all memory contexts, over all iterations */
+	int64 memoryUsedBytes;
+} MicrobenchmarkStats;
+
+/* arguments of the shard pruning microbenchmark */
+typedef struct PruneShardsArgs
+{
+	Oid relationId;
+	List *whereClauseList;
+} PruneShardsArgs;
+
+/* arguments of the shard interval lookup microbenchmark */
+typedef struct FindShardIntervalArgs
+{
+	Datum partitionValue;
+	CitusTableCacheEntry *cacheEntry;
+} FindShardIntervalArgs;
+
+
+/* local function forward declarations */
+static void RunMicrobenchmark(MicrobenchmarkFunction function, void *arg,
+							  int iterationCount, MicrobenchmarkStats *stats);
+static int64 MemoryContextTreeUsedBytes(MemoryContext context);
+static void AddMemoryContextTreeCounters(MemoryContext context,
+										 MemoryContextCounters *counters);
+static Datum MicrobenchmarkStatsTuple(FunctionCallInfo fcinfo,
+									  MicrobenchmarkStats *stats);
+static int IterationCountArgument(FunctionCallInfo fcinfo, int argumentIndex);
+static Var * DistributionColumnForMicrobenchmark(Oid relationId);
+static Datum DistributionValueFromText(Var *partitionColumn, text *value);
+static Query * AnalyzeMicrobenchmarkQuery(text *queryText);
+static void PruneShardsIteration(void *arg);
+static void FindShardIntervalIteration(void *arg);
+static void RebuildCacheEntryIteration(void *arg);
+static void RebuildQueryStringsIteration(void *arg);
+static void DistributedPlannerIteration(void *arg);
+
+
+/* declarations for dynamic loading */
+PG_FUNCTION_INFO_V1(benchmark_prune_shards);
+PG_FUNCTION_INFO_V1(benchmark_find_shard_interval);
+PG_FUNCTION_INFO_V1(benchmark_build_table_cache_entry);
+PG_FUNCTION_INFO_V1(benchmark_rebuild_query_strings);
+PG_FUNCTION_INFO_V1(benchmark_distributed_planner);
+
+
+/*
+ * benchmark_prune_shards prunes the shards of the given distributed table
+ * using an equality filter on the distribution column with the given value.
+ */
+Datum
+benchmark_prune_shards(PG_FUNCTION_ARGS)
+{
+	Oid relationId = PG_GETARG_OID(0);
+	text *value = PG_GETARG_TEXT_P(1);
+	int iterationCount = IterationCountArgument(fcinfo, 2);
+	PruneShardsArgs args;
+	MicrobenchmarkStats stats;
+
+	Var *partitionColumn = DistributionColumnForMicrobenchmark(relationId);
+	OpExpr *equalityExpr = MakeOpExpression(partitionColumn, BTEqualStrategyNumber);
+	Const *rightConst = (Const *) get_rightop((Expr *) equalityExpr);
+
+	rightConst->constvalue = DistributionValueFromText(partitionColumn, value);
+	rightConst->constisnull = false;
+
+	args.relationId = relationId;
+	args.whereClauseList = list_make1(equalityExpr);
+
+	RunMicrobenchmark(PruneShardsIteration, &args, iterationCount, &stats);
+
+	return MicrobenchmarkStatsTuple(fcinfo, &stats);
+}
+
+
+/*
+ * benchmark_find_shard_interval looks up the shard interval of the given
+ * distribution column value in the metadata cache of the given table.
+ */
+Datum
+benchmark_find_shard_interval(PG_FUNCTION_ARGS)
+{
+	Oid relationId = PG_GETARG_OID(0);
+	text *value = PG_GETARG_TEXT_P(1);
+	int iterationCount = IterationCountArgument(fcinfo, 2);
+	FindShardIntervalArgs args;
+	MicrobenchmarkStats stats;
+
+	Var *partitionColumn = DistributionColumnForMicrobenchmark(relationId);
+	CitusTableCacheEntry *cacheEntry = GetCitusTableCacheEntry(relationId);
+
+	if (cacheEntry->partitionMethod != DISTRIBUTE_BY_HASH &&
+		cacheEntry->partitionMethod != DISTRIBUTE_BY_RANGE)
+	{
+		ereport(ERROR, (errmsg("relation %s is not hash or range distributed",
+							   get_rel_name(relationId))));
+	}
+
+	args.partitionValue = DistributionValueFromText(partitionColumn, value);
+	args.cacheEntry = cacheEntry;
+
+	RunMicrobenchmark(FindShardIntervalIteration, &args, iterationCount, &stats);
+
+	return MicrobenchmarkStatsTuple(fcinfo, &stats);
+}
+
+
+/*
+ * benchmark_build_table_cache_entry builds the metadata cache entry of the
+ * given distributed table from the catalogs.
+ */
+Datum
+benchmark_build_table_cache_entry(PG_FUNCTION_ARGS)
+{
+	Oid relationId = PG_GETARG_OID(0);
+	int iterationCount = IterationCountArgument(fcinfo, 1);
+	MicrobenchmarkStats stats;
+
+	/* error out early for tables that are not distributed */
+	GetCitusTableCacheEntry(relationId);
+
+	RunMicrobenchmark(RebuildCacheEntryIteration, &relationId, iterationCount,
+					  &stats);
+
+	return MicrobenchmarkStatsTuple(fcinfo, &stats);
+}
+
+
+/*
+ * benchmark_rebuild_query_strings plans the given query once and then
+ * deparses the queries of the tasks of its worker job.
+ */
+Datum
+benchmark_rebuild_query_strings(PG_FUNCTION_ARGS)
+{
+	text *queryText = PG_GETARG_TEXT_P(0);
+	int iterationCount = IterationCountArgument(fcinfo, 1);
+	MicrobenchmarkStats stats;
+
+	Query *query = AnalyzeMicrobenchmarkQuery(queryText);
+	PlannedStmt *plannedStatement = pg_plan_query(query, 0, NULL);
+
+	CustomScan *customScan = FetchCitusCustomScanIfExists(plannedStatement->planTree);
+	if (customScan == NULL)
+	{
+		ereport(ERROR, (errmsg("query is not planned by Citus")));
+	}
+
+	DistributedPlan *distributedPlan = GetDistributedPlan(customScan);
+	if (distributedPlan->planningError != NULL)
+	{
+		RaiseDeferredError(distributedPlan->planningError, ERROR);
+	}
+
+	Job *workerJob = distributedPlan->workerJob;
+	if (workerJob == NULL || workerJob->jobQuery == NULL)
+	{
+		ereport(ERROR, (errmsg("query does not have a job whose queries are "
+							   "deparsed per task")));
+	}
+
+	RunMicrobenchmark(RebuildQueryStringsIteration, workerJob, iterationCount,
+					  &stats);
+
+	return MicrobenchmarkStatsTuple(fcinfo, &stats);
+}
+
+
+/*
+ * benchmark_distributed_planner plans the given query, which goes through
+ * distributed_planner for queries on distributed tables. Every iteration
+ * plans a copy of the query, since the planner modifies the query it plans.
+ */
+Datum
+benchmark_distributed_planner(PG_FUNCTION_ARGS)
+{
+	text *queryText = PG_GETARG_TEXT_P(0);
+	int iterationCount = IterationCountArgument(fcinfo, 1);
+	MicrobenchmarkStats stats;
+
+	Query *query = AnalyzeMicrobenchmarkQuery(queryText);
+
+	RunMicrobenchmark(DistributedPlannerIteration, query, iterationCount, &stats);
+
+	return MicrobenchmarkStatsTuple(fcinfo, &stats);
+}
+
+
+/*
+ * RunMicrobenchmark calls the given function iterationCount times and fills in
+ * the timings of the calls along with how much the memory used by all memory
+ * contexts grew. The iterations allocate in a memory context of their own,
+ * which is only released after the last iteration, such that results of an
+ * iteration may be used by the next one.
+ */
+static void
+RunMicrobenchmark(MicrobenchmarkFunction function, void *arg, int iterationCount,
+				  MicrobenchmarkStats *stats)
+{
+	MemoryContext benchmarkContext =
+		AllocSetContextCreate(CurrentMemoryContext, "Planner Microbenchmark",
+							  ALLOCSET_DEFAULT_SIZES);
+	MemoryContext oldContext = MemoryContextSwitchTo(benchmarkContext);
+
+	memset(stats, 0, sizeof(MicrobenchmarkStats));
+	stats->iterationCount = iterationCount;
+	stats->minTimeUs = DBL_MAX;
+
+	int64 usedBytesBefore = MemoryContextTreeUsedBytes(TopMemoryContext);
+
+	for (int iterationIndex = 0; iterationIndex < iterationCount; iterationIndex++)
+	{
+		instr_time startTime;
+		instr_time endTime;
+
+		CHECK_FOR_INTERRUPTS();
+
+		INSTR_TIME_SET_CURRENT(startTime);
+
+		function(arg);
+
+		INSTR_TIME_SET_CURRENT(endTime);
+		INSTR_TIME_SUBTRACT(endTime, startTime);
+
+		double iterationTimeUs = INSTR_TIME_GET_MICROSEC(endTime);
+
+		stats->totalTimeUs += iterationTimeUs;
+		stats->minTimeUs = Min(stats->minTimeUs, iterationTimeUs);
+		stats->maxTimeUs = Max(stats->maxTimeUs, iterationTimeUs);
+	}
+
+	stats->memoryUsedBytes = MemoryContextTreeUsedBytes(TopMemoryContext) -
+							 usedBytesBefore;
+
+	MemoryContextSwitchTo(oldContext);
+	MemoryContextDelete(benchmarkContext);
+
+	if (iterationCount == 0)
+	{
+		stats->minTimeUs = 0;
+	}
+}
+
+
+/*
+ * MemoryContextTreeUsedBytes returns the memory used by the given memory
+ * context and all of its descendants, excluding free space.
+ */
+static int64
+MemoryContextTreeUsedBytes(MemoryContext context)
+{
+	MemoryContextCounters counters;
+
+	memset(&counters, 0, sizeof(MemoryContextCounters));
+
+	AddMemoryContextTreeCounters(context, &counters);
+
+	return (int64) counters.totalspace - (int64) counters.freespace;
+}
+
+
+/*
+ * AddMemoryContextTreeCounters adds the counters of the given memory context
+ * and all of its descendants to counters.
+ */
+static void
+AddMemoryContextTreeCounters(MemoryContext context, MemoryContextCounters *counters)
+{
+	context->methods->stats(context, NULL, NULL, counters);
+
+	for (MemoryContext child = context->firstchild; child != NULL;
+		 child = child->nextchild)
+	{
+		AddMemoryContextTreeCounters(child, counters);
+	}
+}
+
+
+/*
+ * MicrobenchmarkStatsTuple returns the given statistics as a record of the
+ * result type of the calling function.
+ */
+static Datum
+MicrobenchmarkStatsTuple(FunctionCallInfo fcinfo, MicrobenchmarkStats *stats)
+{
+	TupleDesc tupleDescriptor = NULL;
+	Datum values[MICROBENCHMARK_COLUMN_COUNT];
+	bool isNulls[MICROBENCHMARK_COLUMN_COUNT];
+	int iterationCount = Max(stats->iterationCount, 1);
+
+	if (get_call_result_type(fcinfo, NULL, &tupleDescriptor) != TYPEFUNC_COMPOSITE)
+	{
+		ereport(ERROR, (errmsg("return type must be a row type")));
+	}
+
+	tupleDescriptor = BlessTupleDesc(tupleDescriptor);
+
+	memset(isNulls, false, sizeof(isNulls));
+
+	values[0] = Int32GetDatum(stats->iterationCount);
+	values[1] = Float8GetDatum(stats->totalTimeUs / 1000.0);
+	values[2] = Float8GetDatum(stats->totalTimeUs / iterationCount);
+	values[3] = Float8GetDatum(stats->minTimeUs);
+	values[4] = Float8GetDatum(stats->maxTimeUs);
+	values[5] = Int64GetDatum(stats->memoryUsedBytes / iterationCount);
+
+	HeapTuple heapTuple = heap_form_tuple(tupleDescriptor, values, isNulls);
+
+	PG_RETURN_DATUM(HeapTupleGetDatum(heapTuple));
+}
+
+
+/*
+ * IterationCountArgument returns the iteration count at the given argument
+ * position and errors out when it is negative.
+ */
+static int
+IterationCountArgument(FunctionCallInfo fcinfo, int argumentIndex)
+{
+	int iterationCount = PG_GETARG_INT32(argumentIndex);
+
+	if (iterationCount < 0)
+	{
+		ereport(ERROR, (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+						errmsg("number of iterations cannot be negative")));
+	}
+
+	return iterationCount;
+}
+
+
+/*
+ * DistributionColumnForMicrobenchmark returns the distribution column of the
+ * given table and errors out for tables that do not have one.
+ */
+static Var *
+DistributionColumnForMicrobenchmark(Oid relationId)
+{
+	uint32 rangeTableId = 1;
+
+	/* errors out for tables that are not distributed */
+	GetCitusTableCacheEntry(relationId);
+
+	Var *partitionColumn = PartitionColumn(relationId, rangeTableId);
+	if (partitionColumn == NULL)
+	{
+		ereport(ERROR, (errmsg("relation %s does not have a distribution column",
+							   get_rel_name(relationId))));
+	}
+
+	return partitionColumn;
+}
+
+
+/*
+ * DistributionValueFromText converts the given text to a value of the type of
+ * the given distribution column.
+ */
+static Datum
+DistributionValueFromText(Var *partitionColumn, text *value)
+{
+	Oid inputFunctionId = InvalidOid;
+	Oid typeIOParam = InvalidOid;
+
+	getTypeInputInfo(partitionColumn->vartype, &inputFunctionId, &typeIOParam);
+
+	return OidInputFunctionCall(inputFunctionId, text_to_cstring(value), typeIOParam,
+								partitionColumn->vartypmod);
+}
+
+
+/*
+ * AnalyzeMicrobenchmarkQuery parses and analyzes the given query text, which
+ * should contain a single query.
+ */
+static Query *
+AnalyzeMicrobenchmarkQuery(text *queryText)
+{
+	char *queryString = text_to_cstring(queryText);
+	List *parseTreeList = pg_parse_query(queryString);
+
+	if (list_length(parseTreeList) != 1)
+	{
+		ereport(ERROR, (errmsg("can only benchmark a single query")));
+	}
+
+	RawStmt *rawStatement = (RawStmt *) linitial(parseTreeList);
+	List *queryTreeList = pg_analyze_and_rewrite(rawStatement, queryString, NULL, 0,
+												 NULL);
+
+	if (list_length(queryTreeList) != 1)
+	{
+		ereport(ERROR, (errmsg("can only benchmark a query that is not rewritten "
+							   "into multiple queries")));
+	}
+
+	Query *query = (Query *) linitial(queryTreeList);
+	if (query->commandType == CMD_UTILITY)
+	{
+		ereport(ERROR, (errmsg("can only benchmark queries, not utility commands")));
+	}
+
+	return query;
+}
+
+
+/* PruneShardsIteration prunes the shards of the table of the arguments. */
+static void
+PruneShardsIteration(void *arg)
+{
+	PruneShardsArgs *args = (PruneShardsArgs *) arg;
+	Index rangeTableId = 1;
+
+	PruneShards(args->relationId, rangeTableId, args->whereClauseList, NULL);
+}
+
+
+/* FindShardIntervalIteration looks up the shard interval of the value. */
+static void
+FindShardIntervalIteration(void *arg)
+{
+	FindShardIntervalArgs *args = (FindShardIntervalArgs *) arg;
+
+	FindShardInterval(args->partitionValue, args->cacheEntry);
+}
+
+
+/* RebuildCacheEntryIteration rebuilds the metadata cache entry of the table */
+static void
+RebuildCacheEntryIteration(void *arg)
+{
+	Oid relationId = *((Oid *) arg);
+
+	RebuildCitusTableCacheEntry(relationId);
+}
+
+
+/* RebuildQueryStringsIteration deparses the task queries of the job */
+static void
+RebuildQueryStringsIteration(void *arg)
+{
+	Job *workerJob = (Job *) arg;
+
+	RebuildQueryStrings(workerJob);
+}
+
+
+/* DistributedPlannerIteration plans a copy of the query */
+static void
+DistributedPlannerIteration(void *arg)
+{
+	Query *query = (Query *) arg;
+
+	pg_plan_query(copyObject(query), 0, NULL);
+}
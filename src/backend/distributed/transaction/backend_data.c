@@ -74,6 +74,9 @@ static BackendData *MyBackendData = NULL;
 
 static void BackendManagementShmemInit(void);
 static size_t BackendManagementShmemSize(void);
+static inline void StartBackendDataChange(BackendData *backendData);
+static inline void FinishBackendDataChange(BackendData *backendData);
+static void ReadBackendData(BackendData *backendData, BackendData *result);
 
 
 PG_FUNCTION_INFO_V1(assign_distributed_transaction_id);
@@ -126,6 +129,8 @@ assign_distributed_transaction_id(PG_FUNCTION_ARGS)
 							   "transaction id")));
 	}
 
+	StartBackendDataChange(MyBackendData);
+
 	MyBackendData->databaseId = MyDatabaseId;
 	MyBackendData->userId = userId;
 
@@ -138,6 +143,7 @@ assign_distributed_transaction_id(PG_FUNCTION_ARGS)
 		MyBackendData->transactionId.initiatorNodeIdentifier;
 	MyBackendData->citusBackend.transactionOriginator = false;
 
+	FinishBackendDataChange(MyBackendData);
 	SpinLockRelease(&MyBackendData->mutex);
 
 	PG_RETURN_VOID();
@@ -350,37 +356,22 @@ StoreAllActiveTransactions(Tuplestorestate *tupleStore, TupleDesc tupleDescripto
 	bool showAllTransactions = superuser();
 	const Oid userId = GetUserId();
 
-	/*
-	 * We don't want to initialize memory while spinlock is held so we
-	 * prefer to do it here. This initialization is done only for the first
-	 * row.
-	 */
-	memset(values, 0, sizeof(values));
-	memset(isNulls, false, sizeof(isNulls));
-
 	if (is_member_of_role(userId, DEFAULT_ROLE_MONITOR))
 	{
 		showAllTransactions = true;
 	}
 
-	/* we're reading all distributed transactions, prevent new backends */
-	LockBackendSharedMemory(LW_SHARED);
-
 	for (int backendIndex = 0; backendIndex < MaxBackends; ++backendIndex)
 	{
-		BackendData *currentBackend =
-			&backendManagementShmemData->backends[backendIndex];
-
-		/* to work on data after releasing g spinlock to protect against errors */
-		int initiatorNodeIdentifier = -1;
-		uint64 transactionNumber = 0;
+		BackendData currentBackend;
 
-		SpinLockAcquire(&currentBackend->mutex);
+		/* read a consistent copy without blocking the backend */
+		ReadBackendData(&backendManagementShmemData->backends[backendIndex],
+						&currentBackend);
 
 		/* we're only interested in backends initiated by Citus */
-		if (currentBackend->citusBackend.initiatorNodeIdentifier < 0)
+		if (currentBackend.citusBackend.initiatorNodeIdentifier < 0)
 		{
-			SpinLockRelease(&currentBackend->mutex);
 			continue;
 		}
 
@@ -388,15 +379,12 @@ StoreAllActiveTransactions(Tuplestorestate *tupleStore, TupleDesc tupleDescripto
 		 * Unless the user has a role that allows seeing all transactions (superuser,
 		 * pg_monitor), skip over transactions belonging to other users.
 		 */
-		if (!showAllTransactions && currentBackend->userId != userId)
+		if (!showAllTransactions && currentBackend.userId != userId)
 		{
-			SpinLockRelease(&currentBackend->mutex);
 			continue;
 		}
 
-		Oid databaseId = currentBackend->databaseId;
 		int backendPid = ProcGlobal->allProcs[backendIndex].pid;
-		initiatorNodeIdentifier = currentBackend->citusBackend.initiatorNodeIdentifier;
 
 		/*
 		 * We prefer to use worker_query instead of transactionOriginator in the user facing
@@ -407,32 +395,20 @@ StoreAllActiveTransactions(Tuplestorestate *tupleStore, TupleDesc tupleDescripto
 		 * inside a distributed transaction.
 		 */
 		bool coordinatorOriginatedQuery =
-			currentBackend->citusBackend.transactionOriginator;
+			currentBackend.citusBackend.transactionOriginator;
 
-		transactionNumber = currentBackend->transactionId.transactionNumber;
-		TimestampTz transactionIdTimestamp = currentBackend->transactionId.timestamp;
-
-		SpinLockRelease(&currentBackend->mutex);
+		memset(values, 0, sizeof(values));
+		memset(isNulls, false, sizeof(isNulls));
 
-		values[0] = ObjectIdGetDatum(databaseId);
+		values[0] = ObjectIdGetDatum(currentBackend.databaseId);
 		values[1] = Int32GetDatum(backendPid);
-		values[2] = Int32GetDatum(initiatorNodeIdentifier);
+		values[2] = Int32GetDatum(currentBackend.citusBackend.initiatorNodeIdentifier);
 		values[3] = !coordinatorOriginatedQuery;
-		values[4] = UInt64GetDatum(transactionNumber);
-		values[5] = TimestampTzGetDatum(transactionIdTimestamp);
+		values[4] = UInt64GetDatum(currentBackend.transactionId.transactionNumber);
+		values[5] = TimestampTzGetDatum(currentBackend.transactionId.timestamp);
 
 		tuplestore_putvalues(tupleStore, tupleDescriptor, values, isNulls);
-
-		/*
-		 * We don't want to initialize memory while spinlock is held so we
-		 * prefer to do it here. This initialization is done for the rows
-		 * starting from the second one.
-		 */
-		memset(values, 0, sizeof(values));
-		memset(isNulls, false, sizeof(isNulls));
 	}
-
-	UnlockBackendSharedMemory();
 }
 
 
@@ -509,6 +485,7 @@ BackendManagementShmemInit(void)
 				&backendManagementShmemData->backends[backendIndex];
 			backendData->citusBackend.initiatorNodeIdentifier = -1;
 			SpinLockInit(&backendData->mutex);
+			pg_atomic_init_u32(&backendData->changeCount, 0);
 		}
 	}
 
@@ -619,12 +596,8 @@ InitializeBackendData(void)
 
 	Assert(MyBackendData);
 
-	LockBackendSharedMemory(LW_EXCLUSIVE);
-
-	/* zero out the backend data */
+	/* zero out the backend data, concurrent readers retry while we do */
 	UnSetDistributedTransactionId();
-
-	UnlockBackendSharedMemory();
 }
 
 
@@ -639,6 +612,7 @@ UnSetDistributedTransactionId(void)
 	if (MyBackendData)
 	{
 		SpinLockAcquire(&MyBackendData->mutex);
+		StartBackendDataChange(MyBackendData);
 
 		MyBackendData->databaseId = 0;
 		MyBackendData->userId = 0;
@@ -650,6 +624,7 @@ UnSetDistributedTransactionId(void)
 		MyBackendData->citusBackend.initiatorNodeIdentifier = -1;
 		MyBackendData->citusBackend.transactionOriginator = false;
 
+		FinishBackendDataChange(MyBackendData);
 		SpinLockRelease(&MyBackendData->mutex);
 	}
 }
@@ -664,7 +639,9 @@ UnSetDistributedTransactionId(void)
  * transaction while we're reading the all backends' data.
  *
  * The primary goal is to provide consistent view of the current distributed
- * transactions while doing the deadlock detection.
+ * transactions while doing the deadlock detection. Backends do not take the
+ * lock to change their own backend data, and readers of individual backends
+ * use ReadBackendData instead, so the lock never blocks regular backends.
  */
 void
 LockBackendSharedMemory(LWLockMode lockMode)
@@ -733,6 +710,7 @@ AssignDistributedTransactionId(void)
 	Oid userId = GetUserId();
 
 	SpinLockAcquire(&MyBackendData->mutex);
+	StartBackendDataChange(MyBackendData);
 
 	MyBackendData->databaseId = MyDatabaseId;
 	MyBackendData->userId = userId;
@@ -745,6 +723,7 @@ AssignDistributedTransactionId(void)
 	MyBackendData->citusBackend.initiatorNodeIdentifier = localGroupId;
 	MyBackendData->citusBackend.transactionOriginator = true;
 
+	FinishBackendDataChange(MyBackendData);
 	SpinLockRelease(&MyBackendData->mutex);
 }
 
@@ -763,10 +742,12 @@ MarkCitusInitiatedCoordinatorBackend(void)
 	int32 localGroupId = GetLocalGroupId();
 
 	SpinLockAcquire(&MyBackendData->mutex);
+	StartBackendDataChange(MyBackendData);
 
 	MyBackendData->citusBackend.initiatorNodeIdentifier = localGroupId;
 	MyBackendData->citusBackend.transactionOriginator = true;
 
+	FinishBackendDataChange(MyBackendData);
 	SpinLockRelease(&MyBackendData->mutex);
 }
 
@@ -789,6 +770,9 @@ CurrentDistributedTransactionNumber(void)
  * GetBackendDataForProc writes the backend data for the given process to
  * result. If the process is part of a lock group (parallel query) it
  * returns the leader data instead.
+ *
+ * The function does not take the mutex of the backend data, so the deadlock
+ * detector scanning all backends never blocks them, see ReadBackendData.
  */
 void
 GetBackendDataForProc(PGPROC *proc, BackendData *result)
@@ -802,11 +786,64 @@ GetBackendDataForProc(PGPROC *proc, BackendData *result)
 
 	BackendData *backendData = &backendManagementShmemData->backends[pgprocno];
 
-	SpinLockAcquire(&backendData->mutex);
+	ReadBackendData(backendData, result);
+}
+
+
+/*
+ * StartBackendDataChange marks the start of a change to the given backend data,
+ * which makes concurrent readers retry until FinishBackendDataChange is called.
+ * The caller must hold the mutex of the backend data, which serializes writers.
+ */
+static inline void
+StartBackendDataChange(BackendData *backendData)
+{
+	/* the atomic increment is a full barrier, so the changes cannot precede it */
+	pg_atomic_fetch_add_u32(&backendData->changeCount, 1);
+}
+
+
+/*
+ * FinishBackendDataChange marks the end of a change to the given backend data.
+ */
+static inline void
+FinishBackendDataChange(BackendData *backendData)
+{
+	/* the atomic increment is a full barrier, so the changes cannot follow it */
+	pg_atomic_fetch_add_u32(&backendData->changeCount, 1);
+}
+
+
+/*
+ * ReadBackendData copies the given backend data to result without taking its
+ * mutex. The copy is retried if a change was in progress when we started
+ * reading, or if the backend data changed while we were copying it. Changes
+ * only modify a few fields and never block, so retries are rare and short.
+ */
+static void
+ReadBackendData(BackendData *backendData, BackendData *result)
+{
+	while (true)
+	{
+		uint32 changeCount = pg_atomic_read_u32(&backendData->changeCount);
+		if (changeCount % 2 != 0)
+		{
+			/* a change is in progress */
+			pg_spin_delay();
+			continue;
+		}
+
+		pg_read_barrier();
 
-	*result = *backendData;
+		memcpy(result, backendData, sizeof(BackendData));
 
-	SpinLockRelease(&backendData->mutex);
+		pg_read_barrier();
+
+		if (pg_atomic_read_u32(&backendData->changeCount) == changeCount)
+		{
+			return;
+		}
+	}
 }
 
 
@@ -830,7 +867,10 @@ CancelTransactionDueToDeadlock(PGPROC *proc)
 	/* send a SIGINT only if the process is still in a distributed transaction */
 	if (backendData->transactionId.transactionNumber != 0)
 	{
+		StartBackendDataChange(backendData);
 		backendData->cancelledDueToDeadlock = true;
+		FinishBackendDataChange(backendData);
+
 		SpinLockRelease(&backendData->mutex);
 
 		if (kill(proc->pid, SIGINT) != 0)
@@ -924,6 +964,46 @@ ActiveDistributedTransactionNumbers(void)
 }
 
 
+/*
+ * ActiveDistributedTransactionIds returns a list of copies of the ids of the
+ * distributed transactions that backends on this node take part in, whether
+ * they started the transaction or not.
+ */
+List *
+ActiveDistributedTransactionIds(void)
+{
+	List *activeTransactionIdList = NIL;
+
+	for (int curBackend = 0; curBackend < MaxBackends; curBackend++)
+	{
+		PGPROC *currentProc = &ProcGlobal->allProcs[curBackend];
+		BackendData currentBackendData;
+
+		if (currentProc->pid == 0)
+		{
+			/* unused PGPROC slot */
+			continue;
+		}
+
+		GetBackendDataForProc(currentProc, &currentBackendData);
+
+		if (!IsInDistributedTransaction(&currentBackendData))
+		{
+			/* not a distributed transaction */
+			continue;
+		}
+
+		DistributedTransactionId *transactionId =
+			(DistributedTransactionId *) palloc0(sizeof(DistributedTransactionId));
+		*transactionId = currentBackendData.transactionId;
+
+		activeTransactionIdList = lappend(activeTransactionIdList, transactionId);
+	}
+
+	return activeTransactionIdList;
+}
+
+
 /*
  * GetMyProcLocalTransactionId() is a wrapper for
  * getting lxid of MyProc.
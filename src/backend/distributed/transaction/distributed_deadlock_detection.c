@@ -52,6 +52,7 @@ static void BuildDeadlockPathList(QueuedTransactionNode *cycledTransactionNode,
 								  TransactionNode **transactionNodeStack,
 								  List **deadlockPath);
 static void ResetVisitedFields(HTAB *adjacencyList);
+static int TrimTransactionsOutsideOfCycles(HTAB *adjacencyList);
 static bool AssociateDistributedTransactionWithBackendProc(TransactionNode *
 														   transactionNode);
 static TransactionNode * GetOrCreateTransactionNode(HTAB *adjacencyList,
@@ -74,7 +75,8 @@ PG_FUNCTION_INFO_V1(check_distributed_deadlocks);
 Datum
 check_distributed_deadlocks(PG_FUNCTION_ARGS)
 {
-	bool deadlockFound = CheckForDistributedDeadlocks();
+	int minTransactionAgeMs = 0;
+	bool deadlockFound = CheckForDistributedDeadlocks(minTransactionAgeMs);
 
 	return BoolGetDatum(deadlockFound);
 }
@@ -93,6 +95,12 @@ check_distributed_deadlocks(PG_FUNCTION_ARGS)
  * distributed deadlock. Upon finding a deadlock, the youngest
  * participant backend is cancelled.
  *
+ * If minTransactionAgeMs is positive, the nodes only report wait edges that
+ * start from distributed transactions that are at least that old, see
+ * BuildGlobalWaitGraph. Before searching, transactions that cannot be part
+ * of a cycle are trimmed from the graph, and the search only starts from
+ * the remaining transactions.
+ *
  * The complexity of the algorithm is O(N) for each distributed
  * transaction that's checked for deadlocks. Note that there exists
  *  0 to MaxBackends number of transactions.
@@ -101,7 +109,7 @@ check_distributed_deadlocks(PG_FUNCTION_ARGS)
  * false.
  */
 bool
-CheckForDistributedDeadlocks(void)
+CheckForDistributedDeadlocks(int minTransactionAgeMs)
 {
 	HASH_SEQ_STATUS status;
 	TransactionNode *transactionNode = NULL;
@@ -119,11 +127,18 @@ CheckForDistributedDeadlocks(void)
 		return false;
 	}
 
-	WaitGraph *waitGraph = BuildGlobalWaitGraph();
+	WaitGraph *waitGraph = BuildGlobalWaitGraph(minTransactionAgeMs);
 	HTAB *adjacencyLists = BuildAdjacencyListsForWaitGraph(waitGraph);
 
 	int edgeCount = waitGraph->edgeCount;
 
+	int suspiciousTransactionCount = TrimTransactionsOutsideOfCycles(adjacencyLists);
+	if (suspiciousTransactionCount == 0)
+	{
+		/* the wait graph has no cycles */
+		return false;
+	}
+
 	/*
 	 * We iterate on transaction nodes and search for deadlocks where the
 	 * starting node is the given transaction node.
@@ -145,6 +160,12 @@ CheckForDistributedDeadlocks(void)
 			continue;
 		}
 
+		/* a transaction that was trimmed cannot be part of a deadlock */
+		if (transactionNode->remainingWaitsForCount == 0)
+		{
+			continue;
+		}
+
 		ResetVisitedFields(adjacencyLists);
 
 		bool deadlockFound = CheckDeadlockForTransactionNode(transactionNode,
@@ -304,6 +325,12 @@ PrependOutgoingNodesToQueue(TransactionNode *transactionNode, int currentStackDe
 	TransactionNode *waitForTransaction = NULL;
 	foreach_ptr(waitForTransaction, transactionNode->waitsFor)
 	{
+		/* trimmed transactions do not lead back to the starting transaction */
+		if (waitForTransaction->remainingWaitsForCount == 0)
+		{
+			continue;
+		}
+
 		QueuedTransactionNode *queuedNode = palloc0(sizeof(QueuedTransactionNode));
 
 		queuedNode->transactionNode = waitForTransaction;
@@ -354,6 +381,68 @@ ResetVisitedFields(HTAB *adjacencyList)
 }
 
 
+/*
+ * TrimTransactionsOutsideOfCycles removes the transactions that cannot be
+ * part of a cycle in the wait graph, and returns the number of transactions
+ * that remain.
+ *
+ * A transaction that does not wait for any remaining transaction cannot be
+ * part of a cycle. We therefore repeatedly trim such transactions, starting
+ * from the ones that do not wait at all, and decrement the remaining waits
+ * of the transactions waiting for them. Trimmed transactions end up with a
+ * remainingWaitsForCount of 0, while every remaining transaction waits for
+ * another remaining transaction, so it is on or leads to a cycle. The typical
+ * wait graph of a busy cluster consists of wait chains without cycles, which
+ * are trimmed completely in time linear to the number of edges.
+ */
+static int
+TrimTransactionsOutsideOfCycles(HTAB *adjacencyList)
+{
+	HASH_SEQ_STATUS status;
+	TransactionNode *transactionNode = NULL;
+	List *trimmableTransactionList = NIL;
+	int remainingTransactionCount = 0;
+
+	hash_seq_init(&status, adjacencyList);
+
+	while ((transactionNode = (TransactionNode *) hash_seq_search(&status)) != 0)
+	{
+		transactionNode->remainingWaitsForCount = list_length(transactionNode->waitsFor);
+
+		if (transactionNode->remainingWaitsForCount == 0)
+		{
+			trimmableTransactionList = lappend(trimmableTransactionList,
+											   transactionNode);
+		}
+		else
+		{
+			remainingTransactionCount++;
+		}
+	}
+
+	while (trimmableTransactionList != NIL)
+	{
+		TransactionNode *trimmedTransaction = linitial(trimmableTransactionList);
+		trimmableTransactionList = list_delete_first(trimmableTransactionList);
+
+		TransactionNode *waitingTransaction = NULL;
+		foreach_ptr(waitingTransaction, trimmedTransaction->waitedOnBy)
+		{
+			waitingTransaction->remainingWaitsForCount--;
+
+			if (waitingTransaction->remainingWaitsForCount == 0)
+			{
+				trimmableTransactionList = lappend(trimmableTransactionList,
+												   waitingTransaction);
+				remainingTransactionCount--;
+			}
+		}
+	}
+
+	return remainingTransactionCount;
+}
+
+
 /*
  * AssociateDistributedTransactionWithBackendProc gets a transaction node
  * and searches the corresponding backend. Once found, transactionNodes'
@@ -486,6 +575,8 @@ BuildAdjacencyListsForWaitGraph(WaitGraph *waitGraph)
 
 		waitingTransaction->waitsFor = lappend(waitingTransaction->waitsFor,
 											   blockingTransaction);
+		blockingTransaction->waitedOnBy = lappend(blockingTransaction->waitedOnBy,
+												  waitingTransaction);
 	}
 
 	return adjacencyList;
@@ -509,6 +600,8 @@ GetOrCreateTransactionNode(HTAB *adjacencyList, DistributedTransactionId *transa
 	if (!found)
 	{
 		transactionNode->waitsFor = NIL;
+		transactionNode->waitedOnBy = NIL;
+		transactionNode->remainingWaitsForCount = 0;
 		transactionNode->initiatorProc = NULL;
 	}
 
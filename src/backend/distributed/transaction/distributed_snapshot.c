@@ -0,0 +1,274 @@
+/*-------------------------------------------------------------------------
+ *
+ * distributed_snapshot.c
+ *
+ * Routines for reading from a consistent snapshot of all nodes.
+ *
+ * By default, every node takes its own snapshot when a query starts on it, so
+ * a multi-shard read can observe a distributed transaction as committed on
+ * some nodes and not yet committed on others. When citus.enable_distributed_snapshot
+ * is enabled, the first distributed execution of a repeatable read transaction,
+ * or a multi-shard SELECT outside of a transaction block, instead opens a
+ * repeatable read transaction on every node while commits of 2PC transactions
+ * are briefly blocked. Those transactions export their snapshots, and all other
+ * connections that the transaction opens to the same node import them, such
+ * that every shard is read at the same point in the distributed commit order.
+ *
+ * Commits are only blocked while the snapshots are taken, which takes a single
+ * round trip to all nodes. Writers are never blocked by the reads themselves.
+ *
+ * Copyright (c) Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include "postgres.h"
+
+#include "access/xact.h"
+#include "distributed/connection_management.h"
+#include "distributed/distributed_snapshot.h"
+#include "distributed/listutils.h"
+#include "distributed/local_executor.h"
+#include "distributed/metadata_cache.h"
+#include "distributed/remote_commands.h"
+#include "distributed/remote_transaction.h"
+#include "distributed/transaction_management.h"
+#include "distributed/worker_manager.h"
+#include "storage/lmgr.h"
+#include "storage/lock.h"
+#include "utils/memutils.h"
+
+
+#define EXPORT_SNAPSHOT_COMMAND "SELECT pg_catalog.pg_export_snapshot()"
+
+
+/*
+ * NodeSnapshot is the snapshot of a node that is part of the distributed
+ * snapshot of the current transaction.
+ */
+typedef struct NodeSnapshot
+{
+	char *nodeName;
+	int nodePort;
+
+	/* identifier returned by pg_export_snapshot() */
+	char *snapshotId;
+} NodeSnapshot;
+
+
+/* GUC, determines whether multi-shard reads use a distributed snapshot */
+bool EnableDistributedSnapshot = false;
+
+/* list of NodeSnapshot * of the current transaction, in TopTransactionContext */
+static List *NodeSnapshotList = NIL;
+
+/* whether the current transaction reads from a distributed snapshot */
+static bool DistributedSnapshotActive = false;
+
+
+static void EstablishDistributedSnapshot(void);
+
+
+/*
+ * EnsureDistributedSnapshotForExecution establishes a distributed snapshot
+ * before the given execution starts if the execution should read from one,
+ * and the transaction does not have one yet.
+ */
+void
+EnsureDistributedSnapshotForExecution(RowModifyLevel modLevel, List *taskList,
+									  bool hasDependentJobs)
+{
+	if (!ShouldEstablishDistributedSnapshot(modLevel, taskList, hasDependentJobs))
+	{
+		return;
+	}
+
+	EstablishDistributedSnapshot();
+}
+
+
+/*
+ * ShouldEstablishDistributedSnapshot returns true if the given execution is
+ * the first distributed execution of a transaction that should read from a
+ * distributed snapshot.
+ */
+bool
+ShouldEstablishDistributedSnapshot(RowModifyLevel modLevel, List *taskList,
+								   bool hasDependentJobs)
+{
+	if (!EnableDistributedSnapshot || DistributedSnapshotActive)
+	{
+		return false;
+	}
+
+	if (ReadFromSecondaries == USE_SECONDARY_NODES_ALWAYS)
+	{
+		/* snapshots cannot be exported during recovery */
+		return false;
+	}
+
+	if (XactIsoLevel < XACT_REPEATABLE_READ &&
+		(IsMultiStatementTransaction() || modLevel != ROW_MODIFY_READONLY ||
+		 list_length(taskList) < 2))
+	{
+		/*
+		 * Read committed transaction blocks take a new snapshot for every
+		 * statement anyway, and single shard reads are always consistent.
+		 */
+		return false;
+	}
+
+	if (hasDependentJobs)
+	{
+		/* map tasks of repartition joins run outside of the transaction */
+		ereport(DEBUG1, (errmsg("not using a distributed snapshot for a query "
+								"with repartition jobs")));
+		return false;
+	}
+
+	if (!dlist_is_empty(&InProgressTransactions) || TransactionAccessedLocalPlacement)
+	{
+		/* the snapshots of the nodes we already accessed are taken */
+		ereport(DEBUG1, (errmsg("not using a distributed snapshot since the "
+								"transaction already accessed shards")));
+		return false;
+	}
+
+	return true;
+}
+
+
+/*
+ * EstablishDistributedSnapshot begins a repeatable read transaction on all
+ * primary nodes while 2PC commits are blocked, and remembers the snapshots
+ * of those transactions such that other connections to the same nodes can
+ * import them.
+ *
+ * Writers hold a RowExclusiveLock on pg_dist_transaction from the moment they
+ * log the PREPARE records until COMMIT PREPARED finished on all nodes, so a
+ * ShareLock on pg_dist_transaction guarantees that no 2PC transaction is half
+ * committed while the snapshots are taken. Concurrent readers do not block
+ * each other, since ShareLock does not conflict with itself.
+ */
+static void
+EstablishDistributedSnapshot(void)
+{
+	List *connectionList = NIL;
+	List *snapshotList = NIL;
+	bool raiseInterrupts = true;
+
+	List *nodeList = ActivePrimaryNodeList(NoLock);
+	if (nodeList == NIL)
+	{
+		return;
+	}
+
+	UseCoordinatedTransaction();
+
+	WorkerNode *workerNode = NULL;
+	foreach_ptr(workerNode, nodeList)
+	{
+		int connectionFlags = 0;
+		MultiConnection *connection =
+			StartNodeUserDatabaseConnection(connectionFlags, workerNode->workerName,
+											workerNode->workerPort, NULL, NULL);
+
+		connectionList = lappend(connectionList, connection);
+	}
+
+	FinishConnectionListEstablishment(connectionList);
+
+	/* from now on, new remote transactions use repeatable read */
+	DistributedSnapshotActive = true;
+
+	/* DANGER: block 2PC commits for as short as possible */
+	LockRelationOid(DistTransactionRelationId(), ShareLock);
+
+	/* the first query of a repeatable read transaction takes the snapshot */
+	RemoteTransactionListBegin(connectionList);
+
+	UnlockRelationOid(DistTransactionRelationId(), ShareLock);
+
+	MultiConnection *connection = NULL;
+	foreach_ptr(connection, connectionList)
+	{
+		int querySent = SendRemoteCommand(connection, EXPORT_SNAPSHOT_COMMAND);
+		if (querySent == 0)
+		{
+			ReportConnectionError(connection, ERROR);
+		}
+	}
+
+	MemoryContext oldContext = MemoryContextSwitchTo(TopTransactionContext);
+
+	foreach_ptr(connection, connectionList)
+	{
+		PGresult *result = GetRemoteCommandResult(connection, raiseInterrupts);
+		if (!IsResponseOK(result) || PQntuples(result) != 1)
+		{
+			ReportResultError(connection, result, ERROR);
+		}
+
+		NodeSnapshot *nodeSnapshot = palloc0(sizeof(NodeSnapshot));
+		nodeSnapshot->nodeName = pstrdup(connection->hostname);
+		nodeSnapshot->nodePort = connection->port;
+		nodeSnapshot->snapshotId = pstrdup(PQgetvalue(result, 0, 0));
+
+		snapshotList = lappend(snapshotList, nodeSnapshot);
+
+		PQclear(result);
+		ForgetResults(connection);
+	}
+
+	MemoryContextSwitchTo(oldContext);
+
+	NodeSnapshotList = snapshotList;
+
+	ereport(DEBUG1, (errmsg("reading from a distributed snapshot of %d nodes",
+							list_length(snapshotList))));
+}
+
+
+/*
+ * InDistributedSnapshot returns whether the current transaction reads from a
+ * distributed snapshot, in which case remote transactions use repeatable read
+ * and local execution is not used.
+ */
+bool
+InDistributedSnapshot(void)
+{
+	return DistributedSnapshotActive;
+}
+
+
+/*
+ * DistributedSnapshotIdForNode returns the identifier of the exported snapshot
+ * of the given node, or NULL if we do not have a snapshot of the node (yet).
+ */
+char *
+DistributedSnapshotIdForNode(char *nodeName, int nodePort)
+{
+	NodeSnapshot *nodeSnapshot = NULL;
+	foreach_ptr(nodeSnapshot, NodeSnapshotList)
+	{
+		if (nodeSnapshot->nodePort == nodePort &&
+			strncmp(nodeSnapshot->nodeName, nodeName, MAX_NODE_LENGTH) == 0)
+		{
+			return nodeSnapshot->snapshotId;
+		}
+	}
+
+	return NULL;
+}
+
+
+/*
+ * ResetDistributedSnapshot forgets the distributed snapshot at the end of the
+ * transaction. The list itself is freed along with TopTransactionContext.
+ */
+void
+ResetDistributedSnapshot(void)
+{
+	NodeSnapshotList = NIL;
+	DistributedSnapshotActive = false;
+}
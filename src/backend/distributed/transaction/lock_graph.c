@@ -47,7 +47,8 @@ typedef struct PROCStack
 
 static void AddWaitEdgeFromResult(WaitGraph *waitGraph, PGresult *result, int rowIndex);
 static void ReturnWaitGraph(WaitGraph *waitGraph, FunctionCallInfo fcinfo);
-static WaitGraph * BuildLocalWaitGraph(void);
+static WaitGraph * BuildLocalWaitGraph(int minTransactionAgeMs);
+static bool IsTransactionYoungerThan(BackendData *backendData, TimestampTz cutoffTime);
 static bool IsProcessWaitingForSafeOperations(PGPROC *proc);
 static void LockLockData(void);
 static void UnlockLockData(void);
@@ -64,6 +65,7 @@ static bool IsConflictingLockMask(int holdMask, int conflictMask);
 
 
 PG_FUNCTION_INFO_V1(dump_local_wait_edges);
+PG_FUNCTION_INFO_V1(dump_local_wait_edges_older_than);
 PG_FUNCTION_INFO_V1(dump_global_wait_edges);
 
 
@@ -74,7 +76,8 @@ PG_FUNCTION_INFO_V1(dump_global_wait_edges);
 Datum
 dump_global_wait_edges(PG_FUNCTION_ARGS)
 {
-	WaitGraph *waitGraph = BuildGlobalWaitGraph();
+	int minTransactionAgeMs = 0;
+	WaitGraph *waitGraph = BuildGlobalWaitGraph(minTransactionAgeMs);
 
 	ReturnWaitGraph(waitGraph, fcinfo);
 
@@ -86,16 +89,33 @@ dump_global_wait_edges(PG_FUNCTION_ARGS)
  * BuildGlobalWaitGraph builds a wait graph for distributed transactions
  * that originate from this node, including edges from all (other) worker
  * nodes.
+ *
+ * If minTransactionAgeMs is positive, every node only starts searching for
+ * wait edges from distributed transactions that started at least that long
+ * ago. A deadlock among younger transactions is then found once all of them
+ * are old enough, while the many short waits of a busy cluster never need to
+ * be sent to this node.
  */
 WaitGraph *
-BuildGlobalWaitGraph(void)
+BuildGlobalWaitGraph(int minTransactionAgeMs)
 {
 	List *workerNodeList = ActiveReadableNodeList();
 	char *nodeUser = CitusExtensionOwnerName();
 	List *connectionList = NIL;
 	int32 localGroupId = GetLocalGroupId();
+	StringInfo command = makeStringInfo();
+
+	WaitGraph *waitGraph = BuildLocalWaitGraph(minTransactionAgeMs);
 
-	WaitGraph *waitGraph = BuildLocalWaitGraph();
+	if (minTransactionAgeMs > 0)
+	{
+		appendStringInfo(command, "SELECT * FROM dump_local_wait_edges_older_than(%d)",
+						 minTransactionAgeMs);
+	}
+	else
+	{
+		appendStringInfoString(command, "SELECT * FROM dump_local_wait_edges()");
+	}
 
 	/* open connections in parallel */
 	WorkerNode *workerNode = NULL;
@@ -124,9 +144,7 @@ BuildGlobalWaitGraph(void)
 	MultiConnection *connection = NULL;
 	foreach_ptr(connection, connectionList)
 	{
-		const char *command = "SELECT * FROM dump_local_wait_edges()";
-
-		int querySent = SendRemoteCommand(connection, command);
+		int querySent = SendRemoteCommand(connection, command->data);
 		if (querySent == 0)
 		{
 			ReportConnectionError(connection, WARNING);
@@ -256,7 +274,25 @@ ParseTimestampTzField(PGresult *result, int rowIndex, int colIndex)
 Datum
 dump_local_wait_edges(PG_FUNCTION_ARGS)
 {
-	WaitGraph *waitGraph = BuildLocalWaitGraph();
+	int minTransactionAgeMs = 0;
+	WaitGraph *waitGraph = BuildLocalWaitGraph(minTransactionAgeMs);
+	ReturnWaitGraph(waitGraph, fcinfo);
+
+	return (Datum) 0;
+}
+
+
+/*
+ * dump_local_wait_edges_older_than returns the local wait edges like
+ * dump_local_wait_edges, but only starts searching from distributed
+ * transactions that started at least the given number of milliseconds ago.
+ */
+Datum
+dump_local_wait_edges_older_than(PG_FUNCTION_ARGS)
+{
+	int minTransactionAgeMs = PG_GETARG_INT32(0);
+
+	WaitGraph *waitGraph = BuildLocalWaitGraph(minTransactionAgeMs);
 	ReturnWaitGraph(waitGraph, fcinfo);
 
 	return (Datum) 0;
@@ -330,13 +366,21 @@ ReturnWaitGraph(WaitGraph *waitGraph, FunctionCallInfo fcinfo)
 
 /*
  * BuildLocalWaitGraph builds a wait graph for distributed transactions
- * that originate from the local node.
+ * that originate from the local node. If minTransactionAgeMs is positive,
+ * the search only starts from distributed transactions that started at
+ * least that long ago.
+ *
+ * PGPROC does not record when a process started waiting, but a transaction
+ * cannot have waited longer than it exists, so the age of the transaction
+ * is a safe stand-in for the age of the wait.
  */
 static WaitGraph *
-BuildLocalWaitGraph(void)
+BuildLocalWaitGraph(int minTransactionAgeMs)
 {
 	PROCStack remaining;
 	int totalProcs = TotalProcCount();
+	TimestampTz cutoffTime = TimestampTzPlusMilliseconds(GetCurrentTimestamp(),
+														 -minTransactionAgeMs);
 
 	/*
 	 * Try hard to avoid allocations while holding lock. Thus we pre-allocate
@@ -387,6 +431,13 @@ BuildLocalWaitGraph(void)
 			continue;
 		}
 
+		/* skip transactions that cannot have waited long enough */
+		if (minTransactionAgeMs > 0 &&
+			IsTransactionYoungerThan(&currentBackendData, cutoffTime))
+		{
+			continue;
+		}
+
 		/* skip if the process is not blocked */
 		if (!IsProcessWaitingForLock(currentProc))
 		{
@@ -437,6 +488,18 @@ BuildLocalWaitGraph(void)
 }
 
 
+/*
+ * IsTransactionYoungerThan returns whether the distributed transaction of the
+ * given backend started after the given time.
+ */
+static bool
+IsTransactionYoungerThan(BackendData *backendData, TimestampTz cutoffTime)
+{
+	return timestamptz_cmp_internal(backendData->transactionId.timestamp,
+									cutoffTime) > 0;
+}
+
+
 /*
  * IsProcessWaitingForSafeOperations returns true if the given PROC
  * waiting on relation extension locks, page locks or speculative locks.
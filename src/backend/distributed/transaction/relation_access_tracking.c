@@ -44,6 +44,10 @@ bool EnforceForeignKeyRestrictions = true;
 									(1 << (PLACEMENT_ACCESS_DDL + \
 										   PARALLEL_MODE_FLAG_OFFSET)))
 
+/* bits representing the access type and the parallel access mode */
+#define ACCESS_BIT(accessType) (1 << (accessType))
+#define PARALLEL_ACCESS_BIT(accessType) (1 << ((accessType) + PARALLEL_MODE_FLAG_OFFSET))
+
 
 /*
  * Hash table mapping relations to the
@@ -81,6 +85,13 @@ typedef struct RelationAccessHashEntry
 
 static HTAB *RelationAccessHash;
 
+/*
+ * Union of the relationAccessMode bits of all relations in RelationAccessHash,
+ * such that conflict checks can skip the hash lookups for access types that
+ * did not happen in the transaction at all.
+ */
+static int RelationAccessModesInTransaction = 0;
+
 
 /* functions related to access recording */
 static void RecordRelationAccessBase(Oid relationId, ShardPlacementAccessType accessType);
@@ -91,6 +102,7 @@ static void RecordRelationParallelModifyAccessForTask(Task *task);
 static void RecordRelationParallelDDLAccessForTask(Task *task);
 static RelationAccessMode GetRelationAccessMode(Oid relationId,
 												ShardPlacementAccessType accessType);
+static int GetRelationAccessModeBits(Oid relationId);
 static void RecordParallelRelationAccess(Oid relationId, ShardPlacementAccessType
 										 placementAccess);
 static void RecordParallelRelationAccessToCache(Oid relationId,
@@ -124,6 +136,7 @@ void
 ResetRelationAccessHash()
 {
 	hash_delete_all(RelationAccessHash);
+	RelationAccessModesInTransaction = 0;
 }
 
 
@@ -256,7 +269,9 @@ RecordPlacementAccessToCache(Oid relationId, ShardPlacementAccessType accessType
 	}
 
 	/* set the bit representing the access type */
-	hashEntry->relationAccessMode |= (1 << (accessType));
+	hashEntry->relationAccessMode |= ACCESS_BIT(accessType);
+
+	RelationAccessModesInTransaction |= hashEntry->relationAccessMode;
 }
 
 
@@ -532,11 +547,12 @@ RecordParallelRelationAccessToCache(Oid relationId,
 	}
 
 	/* set the bit representing the access type */
-	hashEntry->relationAccessMode |= (1 << (placementAccess));
+	hashEntry->relationAccessMode |= ACCESS_BIT(placementAccess);
 
 	/* set the bit representing access mode */
-	int parallelRelationAccessBit = placementAccess + PARALLEL_MODE_FLAG_OFFSET;
-	hashEntry->relationAccessMode |= (1 << parallelRelationAccessBit);
+	hashEntry->relationAccessMode |= PARALLEL_ACCESS_BIT(placementAccess);
+
+	RelationAccessModesInTransaction |= hashEntry->relationAccessMode;
 }
 
 
@@ -547,30 +563,12 @@ RecordParallelRelationAccessToCache(Oid relationId,
 bool
 ParallelQueryExecutedInTransaction(void)
 {
-	HASH_SEQ_STATUS status;
-
 	if (!ShouldRecordRelationAccess() || RelationAccessHash == NULL)
 	{
 		return false;
 	}
 
-	hash_seq_init(&status, RelationAccessHash);
-
-	RelationAccessHashEntry *hashEntry = (RelationAccessHashEntry *) hash_seq_search(
-		&status);
-	while (hashEntry != NULL)
-	{
-		int relationAccessMode = hashEntry->relationAccessMode;
-		if ((relationAccessMode & PARALLEL_ACCESS_MASK))
-		{
-			hash_seq_term(&status);
-			return true;
-		}
-
-		hashEntry = (RelationAccessHashEntry *) hash_seq_search(&status);
-	}
-
-	return false;
+	return (RelationAccessModesInTransaction & PARALLEL_ACCESS_MASK) != 0;
 }
 
 
@@ -611,35 +609,20 @@ GetRelationDDLAccessMode(Oid relationId)
 static RelationAccessMode
 GetRelationAccessMode(Oid relationId, ShardPlacementAccessType accessType)
 {
-	RelationAccessHashKey hashKey;
-	bool found = false;
-	int parallelRelationAccessBit = accessType + PARALLEL_MODE_FLAG_OFFSET;
-
 	/* no point in getting the mode when not inside a transaction block */
 	if (!ShouldRecordRelationAccess())
 	{
 		return RELATION_NOT_ACCESSED;
 	}
 
-	hashKey.relationId = relationId;
-
-	RelationAccessHashEntry *hashEntry = hash_search(RelationAccessHash, &hashKey,
-													 HASH_FIND, &found);
-	if (!found)
-	{
-		/* relation not accessed at all */
-		return RELATION_NOT_ACCESSED;
-	}
-
-
-	int relationAcessMode = hashEntry->relationAccessMode;
-	if (!(relationAcessMode & (1 << accessType)))
+	int relationAcessMode = GetRelationAccessModeBits(relationId);
+	if (!(relationAcessMode & ACCESS_BIT(accessType)))
 	{
 		/* relation not accessed with the given access type */
 		return RELATION_NOT_ACCESSED;
 	}
 
-	if (relationAcessMode & (1 << parallelRelationAccessBit))
+	if (relationAcessMode & PARALLEL_ACCESS_BIT(accessType))
 	{
 		return RELATION_PARALLEL_ACCESSED;
 	}
@@ -650,6 +633,36 @@ GetRelationAccessMode(Oid relationId, ShardPlacementAccessType accessType)
 }
 
 
+/*
+ * GetRelationAccessModeBits returns the relationAccessMode bits recorded for
+ * the given relation in the current transaction, or 0 if the relation has not
+ * been accessed.
+ */
+static int
+GetRelationAccessModeBits(Oid relationId)
+{
+	RelationAccessHashKey hashKey;
+	bool found = false;
+
+	if (RelationAccessModesInTransaction == 0)
+	{
+		/* no relation accessed at all */
+		return 0;
+	}
+
+	hashKey.relationId = relationId;
+
+	RelationAccessHashEntry *hashEntry = hash_search(RelationAccessHash, &hashKey,
+													 HASH_FIND, &found);
+	if (!found)
+	{
+		return 0;
+	}
+
+	return hashEntry->relationAccessMode;
+}
+
+
 /*
  * ShouldRecordRelationAccess returns true when we should keep track
  * of the relation accesses.
@@ -882,6 +895,24 @@ HoldsConflictingLockWithReferencedRelations(Oid relationId, ShardPlacementAccess
 											ShardPlacementAccessType *
 											conflictingAccessMode)
 {
+	/*
+	 * Both DML and DDL operations on a reference table conflicts with
+	 * any parallel operation on distributed tables. A select on a reference
+	 * table could conflict with a DDL on a distributed table.
+	 */
+	int conflictingAccessBits = ACCESS_BIT(PLACEMENT_ACCESS_DML) |
+								ACCESS_BIT(PLACEMENT_ACCESS_DDL);
+	if (placementAccess == PLACEMENT_ACCESS_DDL)
+	{
+		conflictingAccessBits |= ACCESS_BIT(PLACEMENT_ACCESS_SELECT);
+	}
+
+	if (!(RelationAccessModesInTransaction & conflictingAccessBits))
+	{
+		/* no relation was accessed in a conflicting way */
+		return false;
+	}
+
 	CitusTableCacheEntry *cacheEntry = GetCitusTableCacheEntry(relationId);
 
 	Oid referencedRelation = InvalidOid;
@@ -893,41 +924,29 @@ HoldsConflictingLockWithReferencedRelations(Oid relationId, ShardPlacementAccess
 			continue;
 		}
 
-		/*
-		 * A select on a reference table could conflict with a DDL
-		 * on a distributed table.
-		 */
-		RelationAccessMode selectMode = GetRelationSelectAccessMode(referencedRelation);
-		if (placementAccess == PLACEMENT_ACCESS_DDL &&
-			selectMode != RELATION_NOT_ACCESSED)
+		int accessBits = GetRelationAccessModeBits(referencedRelation) &
+						 conflictingAccessBits;
+		if (accessBits == 0)
 		{
-			*conflictingRelationId = referencedRelation;
-			*conflictingAccessMode = PLACEMENT_ACCESS_SELECT;
-
-			return true;
+			continue;
 		}
 
-		/*
-		 * Both DML and DDL operations on a reference table conflicts with
-		 * any parallel operation on distributed tables.
-		 */
-		RelationAccessMode dmlMode = GetRelationDMLAccessMode(referencedRelation);
-		if (dmlMode != RELATION_NOT_ACCESSED)
+		*conflictingRelationId = referencedRelation;
+
+		if (accessBits & ACCESS_BIT(PLACEMENT_ACCESS_SELECT))
+		{
+			*conflictingAccessMode = PLACEMENT_ACCESS_SELECT;
+		}
+		else if (accessBits & ACCESS_BIT(PLACEMENT_ACCESS_DML))
 		{
-			*conflictingRelationId = referencedRelation;
 			*conflictingAccessMode = PLACEMENT_ACCESS_DML;
-
-			return true;
 		}
-
-		RelationAccessMode ddlMode = GetRelationDDLAccessMode(referencedRelation);
-		if (ddlMode != RELATION_NOT_ACCESSED)
+		else
 		{
-			*conflictingRelationId = referencedRelation;
 			*conflictingAccessMode = PLACEMENT_ACCESS_DDL;
-
-			return true;
 		}
+
+		return true;
 	}
 
 	return false;
@@ -947,8 +966,35 @@ HoldsConflictingLockWithReferencingRelations(Oid relationId, ShardPlacementAcces
 											 ShardPlacementAccessType *
 											 conflictingAccessMode)
 {
+	/*
+	 * Rules that we apply:
+	 *      - SELECT on a reference might table conflict with
+	 *        a previous parallel DDL on a distributed table
+	 *      - DML on a reference table might conflict with
+	 *        a previous parallel DML or DDL on a distributed
+	 *        table
+	 *      - DDL on a reference table might conflict with
+	 *        a parellel SELECT, DML or DDL on a distributed
+	 *        table
+	 */
+	int conflictingAccessBits = PARALLEL_ACCESS_BIT(PLACEMENT_ACCESS_DDL);
+	if (placementAccess == PLACEMENT_ACCESS_DML)
+	{
+		conflictingAccessBits |= PARALLEL_ACCESS_BIT(PLACEMENT_ACCESS_DML);
+	}
+	else if (placementAccess == PLACEMENT_ACCESS_DDL)
+	{
+		conflictingAccessBits |= PARALLEL_ACCESS_BIT(PLACEMENT_ACCESS_DML) |
+								 PARALLEL_ACCESS_BIT(PLACEMENT_ACCESS_SELECT);
+	}
+
+	if (!(RelationAccessModesInTransaction & conflictingAccessBits))
+	{
+		/* no relation was accessed in parallel in a conflicting way */
+		return false;
+	}
+
 	CitusTableCacheEntry *cacheEntry = GetCitusTableCacheEntry(relationId);
-	bool holdsConflictingLocks = false;
 
 	Assert(PartitionMethod(relationId) == DISTRIBUTE_BY_NONE);
 
@@ -965,77 +1011,30 @@ HoldsConflictingLockWithReferencingRelations(Oid relationId, ShardPlacementAcces
 			continue;
 		}
 
-		/*
-		 * Rules that we apply:
-		 *      - SELECT on a reference might table conflict with
-		 *        a previous parallel DDL on a distributed table
-		 *      - DML on a reference table might conflict with
-		 *        a previous parallel DML or DDL on a distributed
-		 *        table
-		 *      - DDL on a reference table might conflict with
-		 *        a parellel SELECT, DML or DDL on a distributed
-		 *        table
-		 */
-		if (placementAccess == PLACEMENT_ACCESS_SELECT)
+		int accessBits = GetRelationAccessModeBits(referencingRelation) &
+						 conflictingAccessBits;
+		if (accessBits == 0)
 		{
-			RelationAccessMode ddlMode = GetRelationDDLAccessMode(referencingRelation);
+			continue;
+		}
 
-			if (ddlMode == RELATION_PARALLEL_ACCESSED)
-			{
-				/* SELECT on a distributed table conflicts with DDL / TRUNCATE */
-				holdsConflictingLocks = true;
-				*conflictingAccessMode = PLACEMENT_ACCESS_DDL;
-			}
+		/* report the strongest conflicting access */
+		if (accessBits & PARALLEL_ACCESS_BIT(PLACEMENT_ACCESS_DDL))
+		{
+			*conflictingAccessMode = PLACEMENT_ACCESS_DDL;
 		}
-		else if (placementAccess == PLACEMENT_ACCESS_DML)
+		else if (accessBits & PARALLEL_ACCESS_BIT(PLACEMENT_ACCESS_DML))
 		{
-			RelationAccessMode dmlMode = GetRelationDMLAccessMode(referencingRelation);
-
-			if (dmlMode == RELATION_PARALLEL_ACCESSED)
-			{
-				holdsConflictingLocks = true;
-				*conflictingAccessMode = PLACEMENT_ACCESS_DML;
-			}
-
-			RelationAccessMode ddlMode = GetRelationDDLAccessMode(referencingRelation);
-			if (ddlMode == RELATION_PARALLEL_ACCESSED)
-			{
-				/* SELECT on a distributed table conflicts with DDL / TRUNCATE */
-				holdsConflictingLocks = true;
-				*conflictingAccessMode = PLACEMENT_ACCESS_DDL;
-			}
+			*conflictingAccessMode = PLACEMENT_ACCESS_DML;
 		}
-		else if (placementAccess == PLACEMENT_ACCESS_DDL)
+		else
 		{
-			RelationAccessMode selectMode = GetRelationSelectAccessMode(
-				referencingRelation);
-			if (selectMode == RELATION_PARALLEL_ACCESSED)
-			{
-				holdsConflictingLocks = true;
-				*conflictingAccessMode = PLACEMENT_ACCESS_SELECT;
-			}
-
-			RelationAccessMode dmlMode = GetRelationDMLAccessMode(referencingRelation);
-			if (dmlMode == RELATION_PARALLEL_ACCESSED)
-			{
-				holdsConflictingLocks = true;
-				*conflictingAccessMode = PLACEMENT_ACCESS_DML;
-			}
-
-			RelationAccessMode ddlMode = GetRelationDDLAccessMode(referencingRelation);
-			if (ddlMode == RELATION_PARALLEL_ACCESSED)
-			{
-				holdsConflictingLocks = true;
-				*conflictingAccessMode = PLACEMENT_ACCESS_DDL;
-			}
+			*conflictingAccessMode = PLACEMENT_ACCESS_SELECT;
 		}
 
-		if (holdsConflictingLocks)
-		{
-			*conflictingRelationId = referencingRelation;
+		*conflictingRelationId = referencingRelation;
 
-			return true;
-		}
+		return true;
 	}
 
 	return false;
@@ -18,6 +18,7 @@
 #include "distributed/backend_data.h"
 #include "distributed/citus_safe_lib.h"
 #include "distributed/connection_management.h"
+#include "distributed/distributed_snapshot.h"
 #include "distributed/listutils.h"
 #include "distributed/metadata_cache.h"
 #include "distributed/remote_commands.h"
@@ -33,10 +34,17 @@
 #define PREPARED_TRANSACTION_NAME_FORMAT "citus_%u_%u_"UINT64_FORMAT "_%u"
 
 
-static void StartRemoteTransactionSavepointBegin(MultiConnection *connection,
-												 SubTransactionId subId);
-static void FinishRemoteTransactionSavepointBegin(MultiConnection *connection,
-												  SubTransactionId subId);
+/* GUC, determining whether commit returns before COMMIT PREPARED finished */
+bool EnableAsyncCommitPrepared = false;
+
+/* whether any connection has the result of a COMMIT PREPARED pending */
+bool CommitPreparedPending = false;
+
+/* GUC, determining whether savepoints are only sent to connections that use them */
+bool EnableLazySavepointPropagation = false;
+
+
+static void FinishRemoteTransactionPendingSavepoints(MultiConnection *connection);
 static void StartRemoteTransactionSavepointRelease(MultiConnection *connection,
 												   SubTransactionId subId);
 static void FinishRemoteTransactionSavepointRelease(MultiConnection *connection,
@@ -46,7 +54,12 @@ static void StartRemoteTransactionSavepointRollback(MultiConnection *connection,
 static void FinishRemoteTransactionSavepointRollback(MultiConnection *connection,
 													 SubTransactionId subId);
 
+static StringInfo RemoteTransactionBeginCommand(MultiConnection *connection,
+												int *statementCount);
+static void AppendAssignDistributedTransactionIdCommand(StringInfo command);
 static void Assign2PCIdentifier(MultiConnection *connection);
+static void SendRemoteTransactionPrepare(struct MultiConnection *connection);
+static char * RemoteTransactionPrepareCommand(struct MultiConnection *connection);
 static void WarnAboutLeakedPreparedTransaction(MultiConnection *connection, bool commit);
 
 
@@ -68,8 +81,9 @@ StartRemoteTransactionBegin(struct MultiConnection *connection)
 
 	transaction->transactionState = REMOTE_TRANS_STARTING;
 
+	int statementCount = 0;
 	StringInfo beginAndSetDistributedTransactionId =
-		BeginAndSetDistributedTransactionIdCommand();
+		RemoteTransactionBeginCommand(connection, &statementCount);
 
 	/* append context for in-progress SAVEPOINTs for this transaction */
 	List *activeSubXacts = ActiveSubXactContexts();
@@ -131,17 +145,67 @@ BeginAndSetDistributedTransactionIdCommand(void)
 	 * and send both in one step. The reason is purely performance, we don't want
 	 * seperate roundtrips for these two statements.
 	 */
+	AppendAssignDistributedTransactionIdCommand(beginAndSetDistributedTransactionId);
+
+	return beginAndSetDistributedTransactionId;
+}
+
+
+/*
+ * RemoteTransactionBeginCommand returns the command to begin the remote
+ * transaction on the given connection, and sets statementCount to the number
+ * of statements in the command. When the transaction reads from a distributed
+ * snapshot, the remote transaction uses repeatable read and imports the
+ * snapshot of the node, if we already exported one.
+ */
+static StringInfo
+RemoteTransactionBeginCommand(MultiConnection *connection, int *statementCount)
+{
+	/* BEGIN and assign_distributed_transaction_id() */
+	*statementCount = 2;
+
+	if (!InDistributedSnapshot())
+	{
+		return BeginAndSetDistributedTransactionIdCommand();
+	}
+
+	StringInfo beginCommand = makeStringInfo();
+
+	appendStringInfoString(beginCommand,
+						   "BEGIN TRANSACTION ISOLATION LEVEL REPEATABLE READ;");
+
+	/* the snapshot has to be set before the first query of the transaction */
+	char *snapshotId = DistributedSnapshotIdForNode(connection->hostname,
+													connection->port);
+	if (snapshotId != NULL)
+	{
+		appendStringInfo(beginCommand, "SET TRANSACTION SNAPSHOT %s;",
+						 quote_literal_cstr(snapshotId));
+		(*statementCount)++;
+	}
+
+	AppendAssignDistributedTransactionIdCommand(beginCommand);
+
+	return beginCommand;
+}
+
+
+/*
+ * AppendAssignDistributedTransactionIdCommand appends the command to assign the
+ * distributed transaction id of the current transaction to the given command.
+ */
+static void
+AppendAssignDistributedTransactionIdCommand(StringInfo command)
+{
 	DistributedTransactionId *distributedTransactionId =
 		GetCurrentDistributedTransactionId();
 	const char *timestamp = timestamptz_to_str(distributedTransactionId->timestamp);
-	appendStringInfo(beginAndSetDistributedTransactionId,
+	appendStringInfo(command,
 					 "SELECT assign_distributed_transaction_id(%d, " UINT64_FORMAT
 					 ", '%s');",
 					 distributedTransactionId->initiatorNodeIdentifier,
 					 distributedTransactionId->transactionNumber,
 					 timestamp);
-
-	return beginAndSetDistributedTransactionId;
 }
 
 
@@ -171,6 +235,61 @@ FinishRemoteTransactionBegin(struct MultiConnection *connection)
 }
 
 
+/*
+ * CanPipelineRemoteTransactionBegin returns whether the BEGIN of a remote
+ * transaction can be sent in the same round trip as the first command of the
+ * transaction. We only do that when the BEGIN does not need to replay any
+ * savepoints or SET LOCAL commands, such that the caller knows how many
+ * results of the BEGIN precede the results of its command.
+ */
+bool
+CanPipelineRemoteTransactionBegin(void)
+{
+	if (ActiveSubXacts() != NIL)
+	{
+		return false;
+	}
+
+	if (activeSetStmts != NULL && activeSetStmts->len > 0)
+	{
+		return false;
+	}
+
+	return true;
+}
+
+
+/*
+ * PipelinedRemoteTransactionBeginCommand starts the remote transaction on the
+ * given connection like StartRemoteTransactionBegin does, but returns the
+ * BEGIN command instead of sending it. The caller sends it along with the
+ * first command of the transaction, and skips pendingBeginResultCount results
+ * before reading the results of its command.
+ */
+char *
+PipelinedRemoteTransactionBeginCommand(struct MultiConnection *connection)
+{
+	RemoteTransaction *transaction = &connection->remoteTransaction;
+
+	Assert(transaction->transactionState == REMOTE_TRANS_NOT_STARTED);
+	Assert(CanPipelineRemoteTransactionBegin());
+
+	/* remember transaction as being in-progress */
+	dlist_push_tail(&InProgressTransactions, &connection->transactionNode);
+
+	transaction->transactionState = REMOTE_TRANS_STARTING;
+	transaction->lastSuccessfulSubXact = TopSubTransactionId;
+	transaction->lastQueuedSubXact = TopSubTransactionId;
+
+	StringInfo beginCommand =
+		RemoteTransactionBeginCommand(connection, &transaction->pendingBeginResultCount);
+
+	transaction->beginSent = true;
+
+	return beginCommand->data;
+}
+
+
 /*
  * RemoteTransactionBegin begins a remote transaction in a blocking manner.
  */
@@ -362,6 +481,22 @@ StartRemoteTransactionAbort(MultiConnection *connection)
 
 	Assert(transaction->transactionState != REMOTE_TRANS_NOT_STARTED);
 
+	/*
+	 * If we pipelined PREPARE TRANSACTION after the last command, the worker
+	 * is no longer in a transaction block once the PREPARE succeeded, in which
+	 * case we need ROLLBACK PREPARED rather than ROLLBACK.
+	 */
+	if (transaction->preparePipelined)
+	{
+		if (ClearResultsIfReady(connection) &&
+			PQtransactionStatus(connection->pgConn) == PQTRANS_IDLE)
+		{
+			transaction->transactionState = REMOTE_TRANS_PREPARED;
+		}
+
+		transaction->preparePipelined = false;
+	}
+
 	/*
 	 * Clear previous results, so we have a better chance to send ROLLBACK
 	 * [PREPARED]. If we've previously sent a PREPARE TRANSACTION, we always
@@ -482,7 +617,29 @@ void
 StartRemoteTransactionPrepare(struct MultiConnection *connection)
 {
 	RemoteTransaction *transaction = &connection->remoteTransaction;
-	StringInfoData command;
+
+	Assign2PCIdentifier(connection);
+
+	/* log transactions to workers in pg_dist_transaction */
+	WorkerNode *workerNode = FindWorkerNode(connection->hostname, connection->port);
+	if (workerNode != NULL)
+	{
+		LogTransactionRecord(workerNode->groupId, transaction->preparedName);
+	}
+
+	SendRemoteTransactionPrepare(connection);
+}
+
+
+/*
+ * SendRemoteTransactionPrepare sends PREPARE TRANSACTION for the 2PC identifier
+ * that was assigned to the connection, without logging the transaction in
+ * pg_dist_transaction.
+ */
+static void
+SendRemoteTransactionPrepare(struct MultiConnection *connection)
+{
+	RemoteTransaction *transaction = &connection->remoteTransaction;
 	const bool raiseErrors = true;
 
 	/* can't prepare a nonexistant transaction */
@@ -494,20 +651,9 @@ StartRemoteTransactionPrepare(struct MultiConnection *connection)
 	/* can't prepare if already started to prepare/abort/commit */
 	Assert(transaction->transactionState < REMOTE_TRANS_PREPARING);
 
-	Assign2PCIdentifier(connection);
-
-	/* log transactions to workers in pg_dist_transaction */
-	WorkerNode *workerNode = FindWorkerNode(connection->hostname, connection->port);
-	if (workerNode != NULL)
-	{
-		LogTransactionRecord(workerNode->groupId, transaction->preparedName);
-	}
+	char *command = RemoteTransactionPrepareCommand(connection);
 
-	initStringInfo(&command);
-	appendStringInfo(&command, "PREPARE TRANSACTION %s",
-					 quote_literal_cstr(transaction->preparedName));
-
-	if (!SendRemoteCommand(connection, command.data))
+	if (!SendRemoteCommand(connection, command))
 	{
 		HandleRemoteTransactionConnectionError(connection, raiseErrors);
 	}
@@ -518,6 +664,91 @@ StartRemoteTransactionPrepare(struct MultiConnection *connection)
 }
 
 
+/*
+ * RemoteTransactionPrepareCommand returns the PREPARE TRANSACTION command for
+ * the 2PC identifier that was assigned to the connection.
+ */
+static char *
+RemoteTransactionPrepareCommand(struct MultiConnection *connection)
+{
+	RemoteTransaction *transaction = &connection->remoteTransaction;
+	StringInfo command = makeStringInfo();
+
+	appendStringInfo(command, "PREPARE TRANSACTION %s",
+					 quote_literal_cstr(transaction->preparedName));
+
+	return command->data;
+}
+
+
+/*
+ * PipelinedRemoteTransactionPrepareCommand returns a PREPARE TRANSACTION
+ * command that the caller sends in the same round trip as the last command of
+ * the transaction on the connection. The transaction is logged in
+ * pg_dist_transaction along with all the other participants when the
+ * coordinated transaction is prepared, and the caller should call
+ * FinishPipelinedRemoteTransactionPrepare once the results of the command were
+ * received successfully.
+ */
+char *
+PipelinedRemoteTransactionPrepareCommand(struct MultiConnection *connection)
+{
+	RemoteTransaction *transaction = &connection->remoteTransaction;
+
+	Assert(transaction->beginSent && !transaction->transactionFailed);
+	Assert(transaction->transactionState < REMOTE_TRANS_PREPARING);
+
+	Assign2PCIdentifier(connection);
+	transaction->preparePipelined = true;
+
+	return RemoteTransactionPrepareCommand(connection);
+}
+
+
+/*
+ * FinishPipelinedRemoteTransactionPrepare marks the transaction on the
+ * connection as prepared after the results of a pipelined PREPARE TRANSACTION
+ * were received. No more commands can be sent in the transaction.
+ */
+void
+FinishPipelinedRemoteTransactionPrepare(struct MultiConnection *connection)
+{
+	RemoteTransaction *transaction = &connection->remoteTransaction;
+
+	Assert(transaction->preparePipelined);
+
+	transaction->preparePipelined = false;
+	transaction->transactionState = REMOTE_TRANS_PREPARED;
+}
+
+
+/*
+ * AnyRemoteTransactionPrepared returns whether any of the transactions that
+ * participate in the coordinated transaction was already prepared, or is being
+ * prepared, through a pipelined PREPARE TRANSACTION.
+ */
+bool
+AnyRemoteTransactionPrepared(void)
+{
+	dlist_iter iter;
+
+	dlist_foreach(iter, &InProgressTransactions)
+	{
+		MultiConnection *connection = dlist_container(MultiConnection, transactionNode,
+													  iter.cur);
+		RemoteTransaction *transaction = &connection->remoteTransaction;
+
+		if (transaction->preparePipelined ||
+			transaction->transactionState == REMOTE_TRANS_PREPARED)
+		{
+			return true;
+		}
+	}
+
+	return false;
+}
+
+
 /*
  * FinishRemoteTransactionPrepare finishes the work
  * StartRemoteTransactionPrepare initiated. It blocks if necessary (i.e. if
@@ -596,7 +827,9 @@ RemoteTransactionBeginIfNecessary(MultiConnection *connection)
  * RemoteTransactionsBeginIfNecessary begins, if necessary according to this
  * session's coordinated transaction state, and the remote transaction's
  * state, an explicit transaction on all the connections.  This is done in
- * parallel, to lessen latency penalties.
+ * parallel, to lessen latency penalties. Transactions that are already in
+ * progress are brought into the active sub-transactions, in case savepoints
+ * are propagated lazily.
  */
 void
 RemoteTransactionsBeginIfNecessary(List *connectionList)
@@ -655,6 +888,113 @@ RemoteTransactionsBeginIfNecessary(List *connectionList)
 
 		FinishRemoteTransactionBegin(connection);
 	}
+
+	/* send the savepoints that transactions in progress did not receive yet */
+	List *savepointConnectionList = NIL;
+	foreach_ptr(connection, connectionList)
+	{
+		RemoteTransaction *transaction = &connection->remoteTransaction;
+
+		if (transaction->transactionFailed ||
+			transaction->transactionState != REMOTE_TRANS_STARTED ||
+			!RemoteTransactionHasPendingSavepoints(connection))
+		{
+			continue;
+		}
+
+		StartRemoteTransactionPendingSavepoints(connection);
+		savepointConnectionList = lappend(savepointConnectionList, connection);
+	}
+
+	if (savepointConnectionList == NIL)
+	{
+		return;
+	}
+
+	WaitForAllConnections(savepointConnectionList, raiseInterrupts);
+
+	foreach_ptr(connection, savepointConnectionList)
+	{
+		RemoteTransaction *transaction = &connection->remoteTransaction;
+		if (transaction->transactionFailed)
+		{
+			continue;
+		}
+
+		FinishRemoteTransactionPendingSavepoints(connection);
+	}
+}
+
+
+/*
+ * RemoteTransactionHasPendingSavepoints returns whether the given connection
+ * did not yet receive the SAVEPOINT commands of all active sub-transactions.
+ */
+bool
+RemoteTransactionHasPendingSavepoints(MultiConnection *connection)
+{
+	RemoteTransaction *transaction = &connection->remoteTransaction;
+
+	List *activeSubXacts = ActiveSubXacts();
+	if (activeSubXacts == NIL)
+	{
+		return false;
+	}
+
+	/* savepoints that were sent have lower ids than the ones that were not */
+	SubTransactionId currentSubXact = llast_int(activeSubXacts);
+
+	return transaction->lastQueuedSubXact < currentSubXact;
+}
+
+
+/*
+ * StartRemoteTransactionPendingSavepoints sends, in a single command, the
+ * SAVEPOINT commands of all active sub-transactions that the remote transaction
+ * did not receive yet, in a non-blocking manner.
+ */
+void
+StartRemoteTransactionPendingSavepoints(MultiConnection *connection)
+{
+	const bool raiseErrors = true;
+	RemoteTransaction *transaction = &connection->remoteTransaction;
+	StringInfo savepointCommand = makeStringInfo();
+
+	int subId = 0;
+	foreach_int(subId, ActiveSubXacts())
+	{
+		if (subId <= transaction->lastQueuedSubXact)
+		{
+			continue;
+		}
+
+		appendStringInfo(savepointCommand, "SAVEPOINT savepoint_%u;", subId);
+		transaction->lastQueuedSubXact = subId;
+	}
+
+	if (!SendRemoteCommand(connection, savepointCommand->data))
+	{
+		HandleRemoteTransactionConnectionError(connection, raiseErrors);
+	}
+}
+
+
+/*
+ * FinishRemoteTransactionPendingSavepoints finishes the work
+ * StartRemoteTransactionPendingSavepoints initiated. It blocks if necessary
+ * (i.e. if PQisBusy() would return true).
+ */
+static void
+FinishRemoteTransactionPendingSavepoints(MultiConnection *connection)
+{
+	RemoteTransaction *transaction = &connection->remoteTransaction;
+	const bool raiseErrors = true;
+
+	bool clearSuccessful = ClearResults(connection, raiseErrors);
+	if (clearSuccessful)
+	{
+		transaction->lastSuccessfulSubXact = transaction->lastQueuedSubXact;
+	}
 }
 
 
@@ -796,12 +1136,17 @@ ResetRemoteTransaction(struct MultiConnection *connection)
 /*
  * CoordinatedRemoteTransactionsPrepare PREPAREs a 2PC transaction on all
  * non-failed transactions participating in the coordinated transaction.
+ *
+ * Transactions that were already prepared through a pipelined PREPARE
+ * TRANSACTION are skipped. The transactions of all participants are logged in
+ * pg_dist_transaction at once, while the PREPARE commands are in flight.
  */
 void
 CoordinatedRemoteTransactionsPrepare(void)
 {
 	dlist_iter iter;
 	List *connectionList = NIL;
+	List *transactionRecordList = NIL;
 
 	/* issue PREPARE TRANSACTION; to all relevant remote nodes */
 
@@ -820,10 +1165,27 @@ CoordinatedRemoteTransactionsPrepare(void)
 			continue;
 		}
 
-		StartRemoteTransactionPrepare(connection);
-		connectionList = lappend(connectionList, connection);
+		if (transaction->transactionState != REMOTE_TRANS_PREPARED)
+		{
+			Assign2PCIdentifier(connection);
+			SendRemoteTransactionPrepare(connection);
+			connectionList = lappend(connectionList, connection);
+		}
+
+		/* log transactions to workers in pg_dist_transaction */
+		WorkerNode *workerNode = FindWorkerNode(connection->hostname, connection->port);
+		if (workerNode != NULL)
+		{
+			TransactionRecord *transactionRecord = palloc0(sizeof(TransactionRecord));
+			transactionRecord->groupId = workerNode->groupId;
+			transactionRecord->transactionName = transaction->preparedName;
+
+			transactionRecordList = lappend(transactionRecordList, transactionRecord);
+		}
 	}
 
+	LogTransactionRecordList(transactionRecordList);
+
 	bool raiseInterrupts = true;
 	WaitForAllConnections(connectionList, raiseInterrupts);
 
@@ -860,6 +1222,16 @@ CoordinatedRemoteTransactionsCommit(void)
 	dlist_iter iter;
 	List *connectionList = NIL;
 
+	/*
+	 * Once the local transaction committed, the records in pg_dist_transaction
+	 * guarantee that the prepared transactions get committed, if needed by 2PC
+	 * recovery. In that case we can return without waiting for the results of
+	 * COMMIT PREPARED, which are only read before the next statement.
+	 */
+	bool asyncCommitPrepared = EnableAsyncCommitPrepared &&
+							   CurrentCoordinatedTransactionState ==
+							   COORD_TRANS_PREPARED;
+
 	/*
 	 * Issue appropriate transaction commands to remote nodes. If everything
 	 * went well that's going to be COMMIT or COMMIT PREPARED, if individual
@@ -883,6 +1255,19 @@ CoordinatedRemoteTransactionsCommit(void)
 		}
 
 		StartRemoteTransactionCommit(connection);
+
+		if (asyncCommitPrepared &&
+			transaction->transactionState == REMOTE_TRANS_2PC_COMMITTING &&
+			FinishConnectionSend(connection))
+		{
+			/* FinishPendingCommitPrepared reads the result */
+			connection->commitPreparedPending = true;
+			CommitPreparedPending = true;
+
+			transaction->transactionState = REMOTE_TRANS_COMMITTED;
+			continue;
+		}
+
 		connectionList = lappend(connectionList, connection);
 	}
 
@@ -910,6 +1295,41 @@ CoordinatedRemoteTransactionsCommit(void)
 }
 
 
+/*
+ * FinishPendingCommitPrepared reads the result of a COMMIT PREPARED that was
+ * sent over the connection at the end of an earlier transaction. Failures only
+ * cause a warning, since the record in pg_dist_transaction makes sure 2PC
+ * recovery commits the prepared transaction later on.
+ */
+void
+FinishPendingCommitPrepared(struct MultiConnection *connection)
+{
+	const bool raiseInterrupts = true;
+
+	Assert(connection->commitPreparedPending);
+
+	PGresult *result = GetRemoteCommandResult(connection, raiseInterrupts);
+	if (!IsResponseOK(result))
+	{
+		ReportResultError(connection, result, WARNING);
+
+		ereport(WARNING, (errmsg("failed to commit prepared transaction on %s:%d",
+								 connection->hostname, connection->port),
+						  errdetail("The transaction will be committed by 2PC "
+									"recovery.")));
+	}
+
+	PQclear(result);
+
+	connection->commitPreparedPending = false;
+
+	if (!ClearResults(connection, false))
+	{
+		ShutdownConnection(connection);
+	}
+}
+
+
 /*
  * CoordinatedRemoteTransactionsAbort performs distributed transactions
  * handling at abort time.
@@ -967,6 +1387,11 @@ CoordinatedRemoteTransactionsAbort(void)
  * CoordinatedRemoteTransactionsSavepointBegin sends the SAVEPOINT command for
  * the given sub-transaction id to all connections participating in the current
  * transaction.
+ *
+ * When citus.enable_lazy_savepoint_propagation is enabled, we do not send
+ * anything yet. Instead, the SAVEPOINT is sent to a connection right before
+ * the connection is first used inside the sub-transaction, such that
+ * sub-transactions that do not touch a worker do not cost round trips to it.
  */
 void
 CoordinatedRemoteTransactionsSavepointBegin(SubTransactionId subId)
@@ -975,40 +1400,40 @@ CoordinatedRemoteTransactionsSavepointBegin(SubTransactionId subId)
 	const bool raiseInterrupts = true;
 	List *connectionList = NIL;
 
+	if (EnableLazySavepointPropagation)
+	{
+		return;
+	}
+
 	/* asynchronously send SAVEPOINT */
 	dlist_foreach(iter, &InProgressTransactions)
 	{
 		MultiConnection *connection = dlist_container(MultiConnection, transactionNode,
 													  iter.cur);
 		RemoteTransaction *transaction = &connection->remoteTransaction;
-		if (transaction->transactionFailed)
+		if (transaction->transactionFailed ||
+			!RemoteTransactionHasPendingSavepoints(connection))
 		{
 			continue;
 		}
 
-		StartRemoteTransactionSavepointBegin(connection, subId);
+		StartRemoteTransactionPendingSavepoints(connection);
 		connectionList = lappend(connectionList, connection);
 	}
 
 	WaitForAllConnections(connectionList, raiseInterrupts);
 
 	/* and wait for the results */
-	dlist_foreach(iter, &InProgressTransactions)
+	MultiConnection *connection = NULL;
+	foreach_ptr(connection, connectionList)
 	{
-		MultiConnection *connection = dlist_container(MultiConnection, transactionNode,
-													  iter.cur);
 		RemoteTransaction *transaction = &connection->remoteTransaction;
 		if (transaction->transactionFailed)
 		{
 			continue;
 		}
 
-		FinishRemoteTransactionSavepointBegin(connection, subId);
-
-		if (!transaction->transactionFailed)
-		{
-			transaction->lastSuccessfulSubXact = subId;
-		}
+		FinishRemoteTransactionPendingSavepoints(connection);
 	}
 }
 
@@ -1016,7 +1441,7 @@ CoordinatedRemoteTransactionsSavepointBegin(SubTransactionId subId)
 /*
  * CoordinatedRemoteTransactionsSavepointRelease sends the RELEASE SAVEPOINT
  * command for the given sub-transaction id to all connections participating in
- * the current transaction.
+ * the current transaction that received the SAVEPOINT.
  */
 void
 CoordinatedRemoteTransactionsSavepointRelease(SubTransactionId subId)
@@ -1036,6 +1461,12 @@ CoordinatedRemoteTransactionsSavepointRelease(SubTransactionId subId)
 			continue;
 		}
 
+		if (transaction->lastQueuedSubXact < subId)
+		{
+			/* connection was not used in the sub-transaction */
+			continue;
+		}
+
 		StartRemoteTransactionSavepointRelease(connection, subId);
 		connectionList = lappend(connectionList, connection);
 	}
@@ -1043,10 +1474,9 @@ CoordinatedRemoteTransactionsSavepointRelease(SubTransactionId subId)
 	WaitForAllConnections(connectionList, raiseInterrupts);
 
 	/* and wait for the results */
-	dlist_foreach(iter, &InProgressTransactions)
+	MultiConnection *connection = NULL;
+	foreach_ptr(connection, connectionList)
 	{
-		MultiConnection *connection = dlist_container(MultiConnection, transactionNode,
-													  iter.cur);
 		RemoteTransaction *transaction = &connection->remoteTransaction;
 		if (transaction->transactionFailed)
 		{
@@ -1083,6 +1513,17 @@ CoordinatedRemoteTransactionsSavepointRollback(SubTransactionId subId)
 		/* clear results, but don't show cancelation warning messages from workers. */
 		ClearResultsDiscardWarnings(connection, raiseInterrupts);
 
+		if (transaction->lastQueuedSubXact < subId)
+		{
+			/* connection was not used in the sub-transaction, nothing to undo */
+			if (!transaction->transactionFailed)
+			{
+				transaction->transactionState = REMOTE_TRANS_STARTED;
+			}
+
+			continue;
+		}
+
 		if (transaction->transactionFailed)
 		{
 			if (transaction->lastSuccessfulSubXact <= subId)
@@ -1108,10 +1549,9 @@ CoordinatedRemoteTransactionsSavepointRollback(SubTransactionId subId)
 	WaitForAllConnections(connectionList, raiseInterrupts);
 
 	/* and wait for the results */
-	dlist_foreach(iter, &InProgressTransactions)
+	MultiConnection *connection = NULL;
+	foreach_ptr(connection, connectionList)
 	{
-		MultiConnection *connection = dlist_container(MultiConnection, transactionNode,
-													  iter.cur);
 		RemoteTransaction *transaction = &connection->remoteTransaction;
 		if (transaction->transactionFailed && !transaction->transactionRecovering)
 		{
@@ -1123,44 +1563,6 @@ CoordinatedRemoteTransactionsSavepointRollback(SubTransactionId subId)
 }
 
 
-/*
- * StartRemoteTransactionSavepointBegin initiates SAVEPOINT command for the given
- * subtransaction id in a non-blocking manner.
- */
-static void
-StartRemoteTransactionSavepointBegin(MultiConnection *connection, SubTransactionId subId)
-{
-	const bool raiseErrors = true;
-	StringInfo savepointCommand = makeStringInfo();
-	appendStringInfo(savepointCommand, "SAVEPOINT savepoint_%u", subId);
-
-	if (!SendRemoteCommand(connection, savepointCommand->data))
-	{
-		HandleRemoteTransactionConnectionError(connection, raiseErrors);
-	}
-}
-
-
-/*
- * FinishRemoteTransactionSavepointBegin finishes the work
- * StartRemoteTransactionSavepointBegin initiated. It blocks if necessary (i.e.
- * if PQisBusy() would return true).
- */
-static void
-FinishRemoteTransactionSavepointBegin(MultiConnection *connection, SubTransactionId subId)
-{
-	const bool raiseErrors = true;
-	PGresult *result = GetRemoteCommandResult(connection, raiseErrors);
-	if (!IsResponseOK(result))
-	{
-		HandleRemoteTransactionResultError(connection, result, raiseErrors);
-	}
-
-	PQclear(result);
-	ForgetResults(connection);
-}
-
-
 /*
  * StartRemoteTransactionSavepointRelease initiates RELEASE SAVEPOINT command for
  * the given subtransaction id in a non-blocking manner.
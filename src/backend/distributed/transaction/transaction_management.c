@@ -21,17 +21,23 @@
 #include "access/xact.h"
 #include "distributed/backend_data.h"
 #include "distributed/citus_safe_lib.h"
+#include "distributed/command_progress.h"
 #include "distributed/connection_management.h"
+#include "distributed/ddl_buffer.h"
 #include "distributed/distributed_planner.h"
+#include "distributed/distributed_snapshot.h"
 #include "distributed/hash_helpers.h"
+#include "distributed/insert_buffer.h"
 #include "distributed/intermediate_results.h"
 #include "distributed/listutils.h"
 #include "distributed/local_executor.h"
 #include "distributed/multi_executor.h"
 #include "distributed/transaction_management.h"
 #include "distributed/placement_connection.h"
+#include "distributed/result_cache.h"
 #include "distributed/subplan_execution.h"
 #include "distributed/version_compat.h"
+#include "distributed/wait_sampling.h"
 #include "utils/hsearch.h"
 #include "utils/guc.h"
 #include "utils/memutils.h"
@@ -51,6 +57,12 @@ int SavedMultiShardCommitProtocol = COMMIT_PROTOCOL_BARE;
  */
 bool SelectOpensTransactionBlock = true;
 
+/*
+ * GUC that determines whether a SELECT in a read-only, read committed transaction
+ * block runs in a transaction block on the worker.
+ */
+bool ReadOnlySelectOpensTransactionBlock = true;
+
 /* controls use of locks to enforce safe commutativity */
 bool AllModificationsCommutative = false;
 
@@ -97,6 +109,12 @@ bool CoordinatedTransactionUses2PC = false;
 /* if disabled, distributed statements in a function may run as separate transactions */
 bool FunctionOpensTransactionBlock = true;
 
+/* GUC, determining whether 2PC is skipped if only one remote transaction is involved */
+bool EnableSingleParticipantCommit = false;
+
+/* GUC, microseconds to wait for concurrent 2PC commits before flushing the commit */
+int TwoPhaseCommitDelay = 0;
+
 
 /* transaction management functions */
 static void CoordinatedTransactionCallback(XactEvent event, void *arg);
@@ -104,12 +122,14 @@ static void CoordinatedSubTransactionCallback(SubXactEvent event, SubTransaction
 											  SubTransactionId parentSubid, void *arg);
 
 /* remaining functions */
+static void DelayCommitFlushForGroupCommit(void);
 static void ResetShardPlacementTransactionState(void);
 static void AdjustMaxPreparedTransactions(void);
 static void PushSubXact(SubTransactionId subId);
 static void PopSubXact(SubTransactionId subId);
 static void SwallowErrors(void (*func)());
 static bool MaybeExecutingUDF(void);
+static bool CoordinatedTransactionHasSingleParticipant(void);
 static void ResetGlobalVariables(void);
 
 
@@ -249,6 +269,9 @@ CoordinatedTransactionCallback(XactEvent event, void *arg)
 				AfterXactConnectionHandling(true);
 			}
 
+			/* the changes are visible on all nodes, cached results are stale */
+			ResultCacheAtEOXact();
+
 			ResetGlobalVariables();
 
 			UnSetDistributedTransactionId();
@@ -285,6 +308,21 @@ CoordinatedTransactionCallback(XactEvent event, void *arg)
 			}
 			ResetShardPlacementTransactionState();
 
+			/* an error may have been thrown while waiting on a worker */
+			SetCitusWaitState(CITUS_WAIT_NONE);
+
+			/* the connections of suspended cursors are cancelled below */
+			ForgetSuspendedStreamingExecutions();
+
+			/* the progress monitor of a failed command is released */
+			ResetCommandProgress();
+
+			/* cancel the commands on all nodes at once, instead of one by one */
+			if (CurrentCoordinatedTransactionState != COORD_TRANS_NONE)
+			{
+				SwallowErrors(CancelRunningRemoteCommands);
+			}
+
 			/* handles both already prepared and open transactions */
 			if (CurrentCoordinatedTransactionState > COORD_TRANS_IDLE)
 			{
@@ -298,6 +336,9 @@ CoordinatedTransactionCallback(XactEvent event, void *arg)
 				AfterXactConnectionHandling(false);
 			}
 
+			/* some nodes may have committed before the abort */
+			ResultCacheAtEOXact();
+
 			ResetGlobalVariables();
 
 			/*
@@ -357,6 +398,10 @@ CoordinatedTransactionCallback(XactEvent event, void *arg)
 
 		case XACT_EVENT_PRE_COMMIT:
 		{
+			/* buffered rows and DDL become part of the remote transactions to commit */
+			FlushBufferedInserts();
+			FlushBufferedDDLCommands();
+
 			/*
 			 * If the distributed query involves 2PC, we already removed
 			 * the intermediate result directory on XACT_EVENT_PREPARE. However,
@@ -388,11 +433,26 @@ CoordinatedTransactionCallback(XactEvent event, void *arg)
 			 */
 			MarkFailedShardPlacements();
 
+			if (CoordinatedTransactionUses2PC && EnableSingleParticipantCommit &&
+				CoordinatedTransactionHasSingleParticipant())
+			{
+				/*
+				 * A single remote transaction commits or aborts atomically by
+				 * itself, which makes PREPARE and the recovery record redundant.
+				 */
+				CoordinatedTransactionUses2PC = false;
+			}
+
 			if (CoordinatedTransactionUses2PC)
 			{
 				CoordinatedRemoteTransactionsPrepare();
 				CurrentCoordinatedTransactionState = COORD_TRANS_PREPARED;
 
+				if (TwoPhaseCommitDelay > 0)
+				{
+					DelayCommitFlushForGroupCommit();
+				}
+
 				/*
 				 * Make sure we did not have any failures on connections marked as
 				 * critical before committing.
@@ -423,6 +483,9 @@ CoordinatedTransactionCallback(XactEvent event, void *arg)
 		case XACT_EVENT_PARALLEL_PRE_COMMIT:
 		case XACT_EVENT_PRE_PREPARE:
 		{
+			FlushBufferedInserts();
+			FlushBufferedDDLCommands();
+
 			if (InCoordinatedTransaction())
 			{
 				ereport(ERROR, (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
@@ -435,6 +498,35 @@ CoordinatedTransactionCallback(XactEvent event, void *arg)
 }
 
 
+/*
+ * DelayCommitFlushForGroupCommit makes the commit of the current transaction
+ * wait citus.two_phase_commit_delay microseconds before flushing WAL, if at
+ * least commit_siblings other transactions are active.
+ *
+ * The commit record of a 2PC transaction, which includes its pg_dist_transaction
+ * records, has to be flushed before COMMIT PREPARED can be sent to the workers.
+ * When many multi-shard transactions commit concurrently, the flush on the
+ * coordinator becomes the bottleneck. Postgres already lets one backend flush
+ * the commit records of all backends that are waiting for it, and commit_delay
+ * makes that backend wait for more commit records to be inserted first. We set
+ * it only for the commit of 2PC transactions, since those additionally wait
+ * for round trips to all workers and gain the most from sharing a flush.
+ */
+static void
+DelayCommitFlushForGroupCommit(void)
+{
+	char commitDelayString[12];
+
+	SafeSnprintf(commitDelayString, sizeof(commitDelayString), "%d",
+				 TwoPhaseCommitDelay);
+
+	/* commit_delay is reset at the end of the transaction */
+	set_config_option("commit_delay", commitDelayString,
+					  PGC_SUSET, PGC_S_SESSION,
+					  GUC_ACTION_LOCAL, true, 0, false);
+}
+
+
 /*
  * ResetGlobalVariables resets global variables that
  * might be changed during the execution of queries.
@@ -449,6 +541,12 @@ ResetGlobalVariables()
 	dlist_init(&InProgressTransactions);
 	activeSetStmts = NULL;
 	CoordinatedTransactionUses2PC = false;
+	InlinedIntermediateResultList = NIL;
+	CachedIntermediateResultList = NIL;
+	PrefetchedSubPlanResultList = NIL;
+	ResetDistributedSnapshot();
+	ResetInsertBuffers();
+	ResetDDLBuffer();
 }
 
 
@@ -490,6 +588,20 @@ CoordinatedSubTransactionCallback(SubXactEvent event, SubTransactionId subId,
 		case SUBXACT_EVENT_START_SUB:
 		{
 			PushSubXact(subId);
+
+			/*
+			 * Rows and DDL buffered before the savepoint must not be rolled back
+			 * with it, so send them before the savepoint is started on the workers.
+			 */
+			FlushBufferedInserts();
+			FlushBufferedDDLCommands();
+
+			/*
+			 * The remaining results of suspended cursors are read before the
+			 * savepoint, which cannot be sent over busy connections.
+			 */
+			FinishSuspendedStreamingExecutions();
+
 			if (InCoordinatedTransaction())
 			{
 				CoordinatedRemoteTransactionsSavepointBegin(subId);
@@ -503,17 +615,28 @@ CoordinatedSubTransactionCallback(SubXactEvent event, SubTransactionId subId,
 			{
 				CoordinatedRemoteTransactionsSavepointRelease(subId);
 			}
+			BufferedInsertsAtSubXactCommit();
+			BufferedDDLCommandsAtSubXactCommit();
 			PopSubXact(subId);
 			break;
 		}
 
 		case SUBXACT_EVENT_ABORT_SUB:
 		{
+			/* cursors suspended since the savepoint were opened in it */
+			ForgetSuspendedStreamingExecutions();
+
 			if (InCoordinatedTransaction())
 			{
 				CoordinatedRemoteTransactionsSavepointRollback(subId);
 			}
+			BufferedInsertsAtSubXactAbort();
+			BufferedDDLCommandsAtSubXactAbort();
 			PopSubXact(subId);
+			ResetCommandProgress();
+
+			/* prefetched rows of the aborted statement are freed along with it */
+			PrefetchedSubPlanResultList = NIL;
 
 			UnsetCitusNoticeLevel();
 			break;
@@ -719,6 +842,53 @@ IsMultiStatementTransaction(void)
 }
 
 
+/*
+ * CoordinatedTransactionHasSingleParticipant returns whether the coordinated
+ * transaction consists of a single remote transaction that has not been
+ * prepared yet, and the local transaction did not write anything. In that case
+ * the outcome of the distributed transaction is decided by committing the
+ * remote transaction before the local one, as is done without 2PC.
+ *
+ * Note that connections rather than nodes participate in the transaction, so
+ * modifications that used multiple connections to the same node still use
+ * 2PC.
+ */
+static bool
+CoordinatedTransactionHasSingleParticipant(void)
+{
+	if (TransactionAccessedLocalPlacement ||
+		GetTopTransactionIdIfAny() != InvalidTransactionId)
+	{
+		/* the local transaction has its own writes to commit */
+		return false;
+	}
+
+	if (AnyRemoteTransactionPrepared())
+	{
+		return false;
+	}
+
+	int participantCount = 0;
+	dlist_iter iter;
+
+	dlist_foreach(iter, &InProgressTransactions)
+	{
+		MultiConnection *connection = dlist_container(MultiConnection, transactionNode,
+													  iter.cur);
+
+		if (connection->remoteTransaction.transactionFailed)
+		{
+			/* keep the regular handling of failed transactions */
+			return false;
+		}
+
+		participantCount++;
+	}
+
+	return participantCount == 1;
+}
+
+
 /*
  * MaybeExecutingUDF returns true if we are possibly executing a function call.
  * We use nested level of executor to check this, so this can return true for
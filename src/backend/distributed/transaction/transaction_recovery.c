@@ -49,13 +49,61 @@
 PG_FUNCTION_INFO_V1(recover_prepared_transactions);
 
 
+/* number of recovered transactions after which we log the progress */
+#define RECOVERY_PROGRESS_REPORT_INTERVAL 10000
+
+
+/*
+ * WorkerRecoveryState tracks the recovery of the prepared transactions on a
+ * single worker.
+ */
+typedef struct WorkerRecoveryState
+{
+	WorkerNode *workerNode;
+
+	/* connections to the worker, the first one is used for queries */
+	List *connectionList;
+
+	/* prepared transactions on the worker before and after the snapshot */
+	HTAB *pendingTransactionSet;
+	HTAB *recheckTransactionSet;
+
+	/* COMMIT/ROLLBACK PREPARED commands to send, and the next one to send */
+	List *commandList;
+	int nextCommandIndex;
+
+	/* whether we stopped recovering the worker due to a failure */
+	bool failed;
+
+	int recoveredTransactionCount;
+} WorkerRecoveryState;
+
+
+/*
+ * RecoveryCommand describes a prepared transaction to commit or roll back. For
+ * commits, recordTid points to the recovery record to delete afterwards.
+ */
+typedef struct RecoveryCommand
+{
+	char *transactionName;
+	bool shouldCommit;
+	ItemPointerData recordTid;
+} RecoveryCommand;
+
+
+/* GUC, number of connections per worker to recover prepared transactions over */
+int Recover2PCConnectionsPerWorker = 1;
+
+
 /* Local functions forward declarations */
-static int RecoverWorkerTransactions(WorkerNode *workerNode);
-static List * PendingWorkerTransactionList(MultiConnection *connection);
+static List * StartWorkerRecovery(List *workerList);
+static WorkerRecoveryState * FindWorkerRecoveryState(List *recoveryStateList,
+													 int32 groupId);
+static void FetchPendingWorkerTransactions(List *recoveryStateList, bool isRecheck);
 static bool IsTransactionInProgress(HTAB *activeTransactionNumberSet,
 									char *preparedTransactionName);
-static bool RecoverPreparedTransactionOnWorker(MultiConnection *connection,
-											   char *transactionName, bool shouldCommit);
+static int ExecuteRecoveryCommands(List *recoveryStateList, Relation pgDistTransaction);
+static char * RecoveryCommandString(RecoveryCommand *recoveryCommand);
 
 
 /*
@@ -80,24 +128,59 @@ recover_prepared_transactions(PG_FUNCTION_ARGS)
  */
 void
 LogTransactionRecord(int32 groupId, char *transactionName)
+{
+	TransactionRecord transactionRecord;
+
+	transactionRecord.groupId = groupId;
+	transactionRecord.transactionName = transactionName;
+
+	LogTransactionRecordList(list_make1(&transactionRecord));
+}
+
+
+/*
+ * LogTransactionRecordList registers the transactions in the given list of
+ * TransactionRecords as prepared. The records are inserted in one go, such
+ * that we open pg_dist_transaction and its indexes only once for all workers
+ * that participate in a distributed transaction.
+ */
+void
+LogTransactionRecordList(List *transactionRecordList)
 {
 	Datum values[Natts_pg_dist_transaction];
 	bool isNulls[Natts_pg_dist_transaction];
 
-	/* form new transaction tuple */
-	memset(values, 0, sizeof(values));
-	memset(isNulls, false, sizeof(isNulls));
-
-	values[Anum_pg_dist_transaction_groupid - 1] = Int32GetDatum(groupId);
-	values[Anum_pg_dist_transaction_gid - 1] = CStringGetTextDatum(transactionName);
+	if (transactionRecordList == NIL)
+	{
+		return;
+	}
 
-	/* open transaction relation and insert new tuple */
+	/* open transaction relation and its indexes */
 	Relation pgDistTransaction = heap_open(DistTransactionRelationId(), RowExclusiveLock);
+	CatalogIndexState indexState = CatalogOpenIndexes(pgDistTransaction);
 
 	TupleDesc tupleDescriptor = RelationGetDescr(pgDistTransaction);
-	HeapTuple heapTuple = heap_form_tuple(tupleDescriptor, values, isNulls);
 
-	CatalogTupleInsert(pgDistTransaction, heapTuple);
+	TransactionRecord *transactionRecord = NULL;
+	foreach_ptr(transactionRecord, transactionRecordList)
+	{
+		/* form new transaction tuple */
+		memset(values, 0, sizeof(values));
+		memset(isNulls, false, sizeof(isNulls));
+
+		values[Anum_pg_dist_transaction_groupid - 1] =
+			Int32GetDatum(transactionRecord->groupId);
+		values[Anum_pg_dist_transaction_gid - 1] =
+			CStringGetTextDatum(transactionRecord->transactionName);
+
+		HeapTuple heapTuple = heap_form_tuple(tupleDescriptor, values, isNulls);
+
+		CatalogTupleInsertWithInfo(pgDistTransaction, heapTuple, indexState);
+
+		heap_freetuple(heapTuple);
+	}
+
+	CatalogCloseIndexes(indexState);
 
 	CommandCounterIncrement();
 
@@ -109,64 +192,38 @@ LogTransactionRecord(int32 groupId, char *transactionName)
 /*
  * RecoverTwoPhaseCommits recovers any pending prepared
  * transactions started by this node on other nodes.
+ *
+ * The workers are recovered together: the lists of prepared transactions are
+ * requested from all workers in parallel, pg_dist_transaction is scanned once
+ * for all workers, and the COMMIT/ROLLBACK PREPARED commands are sent to all
+ * workers at the same time, over up to citus.recover_2pc_connections_per_worker
+ * connections per worker.
  */
 int
 RecoverTwoPhaseCommits(void)
 {
 	int recoveredTransactionCount = 0;
-
-	List *workerList = ActivePrimaryNodeList(NoLock);
-	WorkerNode *workerNode = NULL;
-	foreach_ptr(workerNode, workerList)
-	{
-		recoveredTransactionCount += RecoverWorkerTransactions(workerNode);
-	}
-
-	return recoveredTransactionCount;
-}
-
-
-/*
- * RecoverWorkerTransactions recovers any pending prepared transactions
- * started by this node on the specified worker.
- */
-static int
-RecoverWorkerTransactions(WorkerNode *workerNode)
-{
-	int recoveredTransactionCount = 0;
-
-	int32 groupId = workerNode->groupId;
-	char *nodeName = workerNode->workerName;
-	int nodePort = workerNode->workerPort;
-
-
-	ScanKeyData scanKey[1];
-	int scanKeyCount = 1;
-	bool indexOK = true;
+	ScanKeyData *scanKey = NULL;
+	int scanKeyCount = 0;
+	bool indexOK = false;
 	HeapTuple heapTuple = NULL;
 
-	HASH_SEQ_STATUS status;
-
-	bool recoveryFailed = false;
-
-	int connectionFlags = 0;
-	MultiConnection *connection = GetNodeConnection(connectionFlags, nodeName, nodePort);
-	if (connection->pgConn == NULL || PQstatus(connection->pgConn) != CONNECTION_OK)
+	List *workerList = ActivePrimaryNodeList(NoLock);
+	if (workerList == NIL)
 	{
-		ereport(WARNING, (errmsg("transaction recovery cannot connect to %s:%d",
-								 nodeName, nodePort)));
-
 		return 0;
 	}
 
 	MemoryContext localContext = AllocSetContextCreateExtended(CurrentMemoryContext,
-															   "RecoverWorkerTransactions",
+															   "RecoverTwoPhaseCommits",
 															   ALLOCSET_DEFAULT_MINSIZE,
 															   ALLOCSET_DEFAULT_INITSIZE,
 															   ALLOCSET_DEFAULT_MAXSIZE);
 
 	MemoryContext oldContext = MemoryContextSwitchTo(localContext);
 
+	List *recoveryStateList = StartWorkerRecovery(workerList);
+
 	/* take table lock first to avoid running concurrently */
 	Relation pgDistTransaction = heap_open(DistTransactionRelationId(),
 										   ShareUpdateExclusiveLock);
@@ -202,32 +259,29 @@ RecoverWorkerTransactions(WorkerNode *workerNode)
 	 * We therefore observe the set of prepared transactions one more time in
 	 * step 4. The aforementioned transactions would show up in Q, but not in
 	 * P. We can skip those transactions and recover them later.
+	 *
+	 * Each step is performed for all workers before moving on to the next step,
+	 * which preserves the order for every individual worker.
 	 */
 
-	/* find stale prepared transactions on the remote node */
-	List *pendingTransactionList = PendingWorkerTransactionList(connection);
-	HTAB *pendingTransactionSet = ListToHashSet(pendingTransactionList, NAMEDATALEN,
-												true);
+	/* find stale prepared transactions on the remote nodes */
+	bool isRecheck = false;
+	FetchPendingWorkerTransactions(recoveryStateList, isRecheck);
 
 	/* find in-progress distributed transactions */
 	List *activeTransactionNumberList = ActiveDistributedTransactionNumbers();
 	HTAB *activeTransactionNumberSet = ListToHashSet(activeTransactionNumberList,
 													 sizeof(uint64), false);
 
-	/* scan through all recovery records of the current worker */
-	ScanKeyInit(&scanKey[0], Anum_pg_dist_transaction_groupid,
-				BTEqualStrategyNumber, F_INT4EQ, Int32GetDatum(groupId));
-
 	/* get a snapshot of pg_dist_transaction */
 	SysScanDesc scanDescriptor = systable_beginscan(pgDistTransaction,
 													DistTransactionGroupIndexId(),
 													indexOK,
 													NULL, scanKeyCount, scanKey);
 
-	/* find stale prepared transactions on the remote node */
-	List *recheckTransactionList = PendingWorkerTransactionList(connection);
-	HTAB *recheckTransactionSet = ListToHashSet(recheckTransactionList, NAMEDATALEN,
-												true);
+	/* find stale prepared transactions on the remote nodes */
+	isRecheck = true;
+	FetchPendingWorkerTransactions(recoveryStateList, isRecheck);
 
 	while (HeapTupleIsValid(heapTuple = systable_getnext(scanDescriptor)))
 	{
@@ -235,6 +289,16 @@ RecoverWorkerTransactions(WorkerNode *workerNode)
 		bool foundPreparedTransactionBeforeCommit = false;
 		bool foundPreparedTransactionAfterCommit = false;
 
+		Datum groupIdDatum = heap_getattr(heapTuple, Anum_pg_dist_transaction_groupid,
+										  tupleDescriptor, &isNull);
+		WorkerRecoveryState *recoveryState =
+			FindWorkerRecoveryState(recoveryStateList, DatumGetInt32(groupIdDatum));
+		if (recoveryState == NULL || recoveryState->failed)
+		{
+			/* the node is not active or we could not reach it */
+			continue;
+		}
+
 		Datum transactionNameDatum = heap_getattr(heapTuple,
 												  Anum_pg_dist_transaction_gid,
 												  tupleDescriptor, &isNull);
@@ -256,43 +320,31 @@ RecoverWorkerTransactions(WorkerNode *workerNode)
 		 * Remove the transaction from the pending list such that only transactions
 		 * that need to be aborted remain at the end.
 		 */
-		hash_search(pendingTransactionSet, transactionName, HASH_REMOVE,
+		hash_search(recoveryState->pendingTransactionSet, transactionName, HASH_REMOVE,
 					&foundPreparedTransactionBeforeCommit);
 
-		hash_search(recheckTransactionSet, transactionName, HASH_FIND,
+		hash_search(recoveryState->recheckTransactionSet, transactionName, HASH_FIND,
 					&foundPreparedTransactionAfterCommit);
 
 		if (foundPreparedTransactionBeforeCommit && foundPreparedTransactionAfterCommit)
 		{
 			/*
 			 * The transaction was committed, but the prepared transaction still exists
-			 * on the worker. Try committing it.
+			 * on the worker. Try committing it, and delete the recovery record once
+			 * that succeeded.
 			 *
 			 * We double check that the recovery record exists both before and after
 			 * checking ActiveDistributedTransactionNumbers(), since we may have
 			 * observed a prepared transaction that was committed immediately after.
 			 */
-			bool shouldCommit = true;
-			bool commitSucceeded = RecoverPreparedTransactionOnWorker(connection,
-																	  transactionName,
-																	  shouldCommit);
-			if (!commitSucceeded)
-			{
-				/*
-				 * Failed to commit on the current worker. Stop without throwing
-				 * an error to allow recover_prepared_transactions to continue with
-				 * other workers.
-				 */
-				recoveryFailed = true;
-				break;
-			}
-
-			recoveredTransactionCount++;
+			RecoveryCommand *recoveryCommand = palloc0(sizeof(RecoveryCommand));
+			recoveryCommand->transactionName = transactionName;
+			recoveryCommand->shouldCommit = true;
+			recoveryCommand->recordTid = heapTuple->t_self;
 
-			/*
-			 * We successfully committed the prepared transaction, safe to delete
-			 * the recovery record.
-			 */
+			recoveryState->commandList = lappend(recoveryState->commandList,
+												 recoveryCommand);
+			continue;
 		}
 		else if (foundPreparedTransactionAfterCommit)
 		{
@@ -322,38 +374,40 @@ RecoverWorkerTransactions(WorkerNode *workerNode)
 
 			continue;
 		}
-		else
-		{
-			/*
-			 * We found a recovery record without any prepared transaction. It
-			 * must have already been committed, so it's safe to delete the
-			 * recovery record.
-			 *
-			 * Transactions that started after we observed pendingTransactionSet,
-			 * but successfully committed their prepared transactions before
-			 * ActiveDistributedTransactionNumbers are indistinguishable from
-			 * transactions that committed at an earlier time, in which case it's
-			 * safe delete the recovery record as well.
-			 */
-		}
 
+		/*
+		 * We found a recovery record without any prepared transaction. It
+		 * must have already been committed, so it's safe to delete the
+		 * recovery record.
+		 *
+		 * Transactions that started after we observed pendingTransactionSet,
+		 * but successfully committed their prepared transactions before
+		 * ActiveDistributedTransactionNumbers are indistinguishable from
+		 * transactions that committed at an earlier time, in which case it's
+		 * safe delete the recovery record as well.
+		 */
 		simple_heap_delete(pgDistTransaction, &heapTuple->t_self);
 	}
 
 	systable_endscan(scanDescriptor);
-	heap_close(pgDistTransaction, NoLock);
 
-	if (!recoveryFailed)
+	WorkerRecoveryState *recoveryState = NULL;
+	foreach_ptr(recoveryState, recoveryStateList)
 	{
+		HASH_SEQ_STATUS status;
 		char *pendingTransactionName = NULL;
-		bool abortSucceeded = true;
+
+		if (recoveryState->failed)
+		{
+			continue;
+		}
 
 		/*
 		 * All remaining prepared transactions that are not part of an in-progress
 		 * distributed transaction should be aborted since we did not find a recovery
 		 * record, which implies the disributed transaction aborted.
 		 */
-		hash_seq_init(&status, pendingTransactionSet);
+		hash_seq_init(&status, recoveryState->pendingTransactionSet);
 
 		while ((pendingTransactionName = hash_seq_search(&status)) != NULL)
 		{
@@ -365,20 +419,20 @@ RecoverWorkerTransactions(WorkerNode *workerNode)
 				continue;
 			}
 
-			bool shouldCommit = false;
-			abortSucceeded = RecoverPreparedTransactionOnWorker(connection,
-																pendingTransactionName,
-																shouldCommit);
-			if (!abortSucceeded)
-			{
-				hash_seq_term(&status);
-				break;
-			}
+			RecoveryCommand *recoveryCommand = palloc0(sizeof(RecoveryCommand));
+			recoveryCommand->transactionName = pendingTransactionName;
+			recoveryCommand->shouldCommit = false;
 
-			recoveredTransactionCount++;
+			recoveryState->commandList = lappend(recoveryState->commandList,
+												 recoveryCommand);
 		}
 	}
 
+	recoveredTransactionCount = ExecuteRecoveryCommands(recoveryStateList,
+														pgDistTransaction);
+
+	heap_close(pgDistTransaction, NoLock);
+
 	MemoryContextSwitchTo(oldContext);
 	MemoryContextDelete(localContext);
 
@@ -387,47 +441,331 @@ RecoverWorkerTransactions(WorkerNode *workerNode)
 
 
 /*
- * PendingWorkerTransactionList returns a list of pending prepared
- * transactions on a remote node that were started by this node.
+ * StartWorkerRecovery opens the connections for recovering the prepared
+ * transactions on the given workers and returns a WorkerRecoveryState for
+ * each worker. Workers that we cannot connect to are marked as failed.
  */
 static List *
-PendingWorkerTransactionList(MultiConnection *connection)
+StartWorkerRecovery(List *workerList)
+{
+	List *recoveryStateList = NIL;
+	List *allConnectionList = NIL;
+
+	WorkerNode *workerNode = NULL;
+	foreach_ptr(workerNode, workerList)
+	{
+		WorkerRecoveryState *recoveryState = palloc0(sizeof(WorkerRecoveryState));
+		recoveryState->workerNode = workerNode;
+
+		for (int connectionIndex = 0; connectionIndex < Recover2PCConnectionsPerWorker;
+			 connectionIndex++)
+		{
+			/* the first connection may be a cached one */
+			int connectionFlags = connectionIndex == 0 ? 0 : FORCE_NEW_CONNECTION;
+
+			MultiConnection *connection = StartNodeConnection(connectionFlags,
+															  workerNode->workerName,
+															  workerNode->workerPort);
+
+			recoveryState->connectionList = lappend(recoveryState->connectionList,
+													connection);
+			allConnectionList = lappend(allConnectionList, connection);
+		}
+
+		recoveryStateList = lappend(recoveryStateList, recoveryState);
+	}
+
+	FinishConnectionListEstablishment(allConnectionList);
+
+	WorkerRecoveryState *recoveryState = NULL;
+	foreach_ptr(recoveryState, recoveryStateList)
+	{
+		List *connectedList = NIL;
+
+		MultiConnection *connection = NULL;
+		foreach_ptr(connection, recoveryState->connectionList)
+		{
+			if (connection->pgConn != NULL &&
+				PQstatus(connection->pgConn) == CONNECTION_OK)
+			{
+				connectedList = lappend(connectedList, connection);
+			}
+		}
+
+		MultiConnection *firstConnection = linitial(recoveryState->connectionList);
+		if (!list_member_ptr(connectedList, firstConnection))
+		{
+			ereport(WARNING, (errmsg("transaction recovery cannot connect to %s:%d",
+									 recoveryState->workerNode->workerName,
+									 recoveryState->workerNode->workerPort)));
+
+			recoveryState->failed = true;
+		}
+
+		recoveryState->connectionList = connectedList;
+	}
+
+	return recoveryStateList;
+}
+
+
+/*
+ * FindWorkerRecoveryState returns the recovery state of the worker in the
+ * given group, or NULL if the group is not being recovered.
+ */
+static WorkerRecoveryState *
+FindWorkerRecoveryState(List *recoveryStateList, int32 groupId)
+{
+	WorkerRecoveryState *recoveryState = NULL;
+	foreach_ptr(recoveryState, recoveryStateList)
+	{
+		if (recoveryState->workerNode->groupId == groupId)
+		{
+			return recoveryState;
+		}
+	}
+
+	return NULL;
+}
+
+
+/*
+ * FetchPendingWorkerTransactions requests the pending prepared transactions
+ * that were started by this node from all workers in parallel, and stores them
+ * in the pendingTransactionSet of each worker, or in the recheckTransactionSet
+ * if isRecheck is true.
+ */
+static void
+FetchPendingWorkerTransactions(List *recoveryStateList, bool isRecheck)
 {
 	StringInfo command = makeStringInfo();
 	bool raiseInterrupts = true;
-	List *transactionNames = NIL;
+	List *connectionList = NIL;
 	int32 coordinatorId = GetLocalGroupId();
 
 	appendStringInfo(command, "SELECT gid FROM pg_prepared_xacts "
 							  "WHERE gid LIKE 'citus\\_%d\\_%%'",
 					 coordinatorId);
 
-	int querySent = SendRemoteCommand(connection, command->data);
-	if (querySent == 0)
+	WorkerRecoveryState *recoveryState = NULL;
+	foreach_ptr(recoveryState, recoveryStateList)
 	{
-		ReportConnectionError(connection, ERROR);
+		if (recoveryState->failed)
+		{
+			continue;
+		}
+
+		MultiConnection *connection = linitial(recoveryState->connectionList);
+
+		int querySent = SendRemoteCommand(connection, command->data);
+		if (querySent == 0)
+		{
+			ReportConnectionError(connection, ERROR);
+		}
+
+		connectionList = lappend(connectionList, connection);
 	}
 
-	PGresult *result = GetRemoteCommandResult(connection, raiseInterrupts);
-	if (!IsResponseOK(result))
+	WaitForAllConnections(connectionList, raiseInterrupts);
+
+	foreach_ptr(recoveryState, recoveryStateList)
 	{
-		ReportResultError(connection, result, ERROR);
+		List *transactionNames = NIL;
+
+		if (recoveryState->failed)
+		{
+			continue;
+		}
+
+		MultiConnection *connection = linitial(recoveryState->connectionList);
+
+		PGresult *result = GetRemoteCommandResult(connection, raiseInterrupts);
+		if (!IsResponseOK(result))
+		{
+			ReportResultError(connection, result, ERROR);
+		}
+
+		int rowCount = PQntuples(result);
+
+		for (int rowIndex = 0; rowIndex < rowCount; rowIndex++)
+		{
+			const int columnIndex = 0;
+			char *transactionName = PQgetvalue(result, rowIndex, columnIndex);
+
+			transactionNames = lappend(transactionNames, pstrdup(transactionName));
+		}
+
+		PQclear(result);
+		ForgetResults(connection);
+
+		HTAB *transactionSet = ListToHashSet(transactionNames, NAMEDATALEN, true);
+		if (isRecheck)
+		{
+			recoveryState->recheckTransactionSet = transactionSet;
+		}
+		else
+		{
+			recoveryState->pendingTransactionSet = transactionSet;
+		}
 	}
+}
+
+
+/*
+ * ExecuteRecoveryCommands sends the COMMIT/ROLLBACK PREPARED commands of all
+ * workers. In every round, we send the next command of a worker over each of
+ * its idle connections, and wait for the results of all workers at once. The
+ * recovery record of a committed transaction is deleted once the commit
+ * succeeded. A failure stops recovery on the worker, without throwing an error,
+ * to allow recovery to continue with the other workers.
+ *
+ * The function returns the number of recovered transactions.
+ */
+static int
+ExecuteRecoveryCommands(List *recoveryStateList, Relation pgDistTransaction)
+{
+	int recoveredTransactionCount = 0;
+	int totalCommandCount = 0;
+	int lastReportedCount = 0;
+	bool raiseInterrupts = true;
 
-	int rowCount = PQntuples(result);
+	WorkerRecoveryState *recoveryState = NULL;
+	foreach_ptr(recoveryState, recoveryStateList)
+	{
+		totalCommandCount += list_length(recoveryState->commandList);
+	}
 
-	for (int rowIndex = 0; rowIndex < rowCount; rowIndex++)
+	while (true)
 	{
-		const int columnIndex = 0;
-		char *transactionName = PQgetvalue(result, rowIndex, columnIndex);
+		List *connectionList = NIL;
+		List *sentCommandList = NIL;
+		List *sentStateList = NIL;
+
+		foreach_ptr(recoveryState, recoveryStateList)
+		{
+			MultiConnection *connection = NULL;
+			foreach_ptr(connection, recoveryState->connectionList)
+			{
+				if (recoveryState->failed ||
+					recoveryState->nextCommandIndex >=
+					list_length(recoveryState->commandList))
+				{
+					break;
+				}
+
+				RecoveryCommand *recoveryCommand =
+					list_nth(recoveryState->commandList,
+							 recoveryState->nextCommandIndex);
+				char *commandString = RecoveryCommandString(recoveryCommand);
+
+				recoveryState->nextCommandIndex++;
+
+				if (!SendRemoteCommand(connection, commandString))
+				{
+					ReportConnectionError(connection, WARNING);
+					recoveryState->failed = true;
+					break;
+				}
+
+				connectionList = lappend(connectionList, connection);
+				sentCommandList = lappend(sentCommandList, recoveryCommand);
+				sentStateList = lappend(sentStateList, recoveryState);
+			}
+		}
+
+		if (connectionList == NIL)
+		{
+			break;
+		}
+
+		WaitForAllConnections(connectionList, raiseInterrupts);
+
+		ListCell *connectionCell = NULL;
+		ListCell *commandCell = NULL;
+		ListCell *stateCell = NULL;
+		forthree(connectionCell, connectionList, commandCell, sentCommandList,
+				 stateCell, sentStateList)
+		{
+			MultiConnection *connection = lfirst(connectionCell);
+			RecoveryCommand *recoveryCommand = lfirst(commandCell);
+			recoveryState = lfirst(stateCell);
+
+			PGresult *result = GetRemoteCommandResult(connection, raiseInterrupts);
+			if (!IsResponseOK(result))
+			{
+				ReportResultError(connection, result, WARNING);
+				PQclear(result);
+				ClearResults(connection, false);
 
-		transactionNames = lappend(transactionNames, pstrdup(transactionName));
+				recoveryState->failed = true;
+				continue;
+			}
+
+			PQclear(result);
+			ClearResults(connection, false);
+
+			if (recoveryCommand->shouldCommit)
+			{
+				/* the prepared transaction committed, delete the recovery record */
+				simple_heap_delete(pgDistTransaction, &recoveryCommand->recordTid);
+			}
+
+			ereport(DEBUG1, (errmsg("recovered a prepared transaction on %s:%d",
+									connection->hostname, connection->port),
+							 errcontext("%s", RecoveryCommandString(recoveryCommand))));
+
+			recoveryState->recoveredTransactionCount++;
+			recoveredTransactionCount++;
+		}
+
+		if (recoveredTransactionCount - lastReportedCount >=
+			RECOVERY_PROGRESS_REPORT_INTERVAL)
+		{
+			ereport(LOG, (errmsg("recovered %d of %d prepared transactions",
+								 recoveredTransactionCount, totalCommandCount)));
+
+			lastReportedCount = recoveredTransactionCount;
+		}
 	}
 
-	PQclear(result);
-	ForgetResults(connection);
+	foreach_ptr(recoveryState, recoveryStateList)
+	{
+		if (recoveryState->recoveredTransactionCount > 0)
+		{
+			ereport(LOG, (errmsg("recovered %d prepared transactions on %s:%d",
+								 recoveryState->recoveredTransactionCount,
+								 recoveryState->workerNode->workerName,
+								 recoveryState->workerNode->workerPort)));
+		}
+	}
 
-	return transactionNames;
+	return recoveredTransactionCount;
+}
+
+
+/*
+ * RecoveryCommandString returns the COMMIT PREPARED or ROLLBACK PREPARED
+ * command for the given recovery command.
+ */
+static char *
+RecoveryCommandString(RecoveryCommand *recoveryCommand)
+{
+	StringInfo command = makeStringInfo();
+
+	if (recoveryCommand->shouldCommit)
+	{
+		/* should have committed this prepared transaction */
+		appendStringInfo(command, "COMMIT PREPARED %s",
+						 quote_literal_cstr(recoveryCommand->transactionName));
+	}
+	else
+	{
+		/* should have aborted this prepared transaction */
+		appendStringInfo(command, "ROLLBACK PREPARED %s",
+						 quote_literal_cstr(recoveryCommand->transactionName));
+	}
+
+	return command->data;
 }
 
 
@@ -458,49 +796,3 @@ IsTransactionInProgress(HTAB *activeTransactionNumberSet, char *preparedTransact
 
 	return isTransactionInProgress;
 }
-
-
-/*
- * RecoverPreparedTransactionOnWorker recovers a single prepared transaction over
- * the given connection. If shouldCommit is true we send
- */
-static bool
-RecoverPreparedTransactionOnWorker(MultiConnection *connection, char *transactionName,
-								   bool shouldCommit)
-{
-	StringInfo command = makeStringInfo();
-	PGresult *result = NULL;
-	bool raiseInterrupts = false;
-
-	if (shouldCommit)
-	{
-		/* should have committed this prepared transaction */
-		appendStringInfo(command, "COMMIT PREPARED %s",
-						 quote_literal_cstr(transactionName));
-	}
-	else
-	{
-		/* should have aborted this prepared transaction */
-		appendStringInfo(command, "ROLLBACK PREPARED %s",
-						 quote_literal_cstr(transactionName));
-	}
-
-	int executeCommand = ExecuteOptionalRemoteCommand(connection, command->data, &result);
-	if (executeCommand == QUERY_SEND_FAILED)
-	{
-		return false;
-	}
-	if (executeCommand == RESPONSE_NOT_OKAY)
-	{
-		return false;
-	}
-
-	PQclear(result);
-	ClearResults(connection, raiseInterrupts);
-
-	ereport(LOG, (errmsg("recovered a prepared transaction on %s:%d",
-						 connection->hostname, connection->port),
-				  errcontext("%s", command->data)));
-
-	return true;
-}
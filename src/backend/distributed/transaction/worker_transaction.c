@@ -45,6 +45,7 @@ static void SendCommandToWorkersParamsInternal(TargetWorkerSet targetWorkerSet,
 static void ErrorIfAnyMetadataNodeOutOfSync(List *metadataNodeList);
 static void SendCommandListToAllWorkersInternal(List *commandList, bool failOnError,
 												const char *superuser);
+static List * OpenNewConnectionsToWorkers(List *workerNodeList, const char *user);
 static List * OpenConnectionsToWorkersInParallel(TargetWorkerSet targetWorkerSet,
 												 const char *user);
 static void GetConnectionsResults(List *connectionList, bool failOnError);
@@ -73,17 +74,36 @@ void
 SendCommandToWorkersAsUser(TargetWorkerSet targetWorkerSet, const char *nodeUser,
 						   const char *command)
 {
+	List *connectionList = NIL;
 	List *workerNodeList = TargetWorkerSetNodeList(targetWorkerSet, ShareLock);
 
-	/* run commands serially */
+	UseCoordinatedTransaction();
+	CoordinatedTransactionUse2PC();
+
+	/* open connections in parallel */
 	WorkerNode *workerNode = NULL;
 	foreach_ptr(workerNode, workerNodeList)
 	{
 		const char *nodeName = workerNode->workerName;
 		int nodePort = workerNode->workerPort;
+		uint32 connectionFlags = 0;
+
+		MultiConnection *connection = StartNodeUserDatabaseConnection(connectionFlags,
+																	  nodeName, nodePort,
+																	  nodeUser, NULL);
 
-		SendCommandToWorkerAsUser(nodeName, nodePort, nodeUser, command);
+		MarkRemoteTransactionCritical(connection);
+
+		connectionList = lappend(connectionList, connection);
 	}
+
+	FinishConnectionListEstablishment(connectionList);
+
+	RemoteTransactionsBeginIfNecessary(connectionList);
+
+	List *commandList = list_make1((char *) command);
+
+	ExecuteCriticalRemoteCommandListInParallel(connectionList, commandList);
 }
 
 
@@ -149,33 +169,96 @@ SendCommandListToAllWorkers(List *commandList, const char *superuser)
 
 /*
  * SendCommandListToAllWorkersInternal sends the given command to all workers in a single
- * transaction as a superuser. If failOnError is false, then it continues sending the commandList to other
- * workers even if it fails in one of them.
+ * transaction per worker as a superuser, running the commands on all workers
+ * concurrently. If failOnError is false, then it continues sending the commandList
+ * to other workers even if it fails in one of them, and the transactions of the
+ * workers on which it failed are rolled back.
  */
 static void
 SendCommandListToAllWorkersInternal(List *commandList, bool failOnError, const
 									char *superuser)
 {
 	List *workerNodeList = ActivePrimaryWorkerNodeList(NoLock);
+	List *failedConnectionList = NIL;
 
-	WorkerNode *workerNode = NULL;
-	foreach_ptr(workerNode, workerNodeList)
+	List *connectionList = OpenNewConnectionsToWorkers(workerNodeList, superuser);
+
+	MultiConnection *connection = NULL;
+	foreach_ptr(connection, connectionList)
 	{
 		if (failOnError)
 		{
-			SendCommandListToWorkerInSingleTransaction(workerNode->workerName,
-													   workerNode->workerPort,
-													   superuser,
-													   commandList);
+			MarkRemoteTransactionCritical(connection);
+		}
+	}
+
+	RemoteTransactionListBegin(connectionList);
+
+	if (failOnError)
+	{
+		ExecuteCriticalRemoteCommandListInParallel(connectionList, commandList);
+	}
+	else
+	{
+		ExecuteOptionalRemoteCommandListInParallel(connectionList, commandList,
+												   &failedConnectionList);
+	}
+
+	/* commit or roll back on all workers in parallel */
+	foreach_ptr(connection, connectionList)
+	{
+		if (list_member_ptr(failedConnectionList, connection))
+		{
+			StartRemoteTransactionAbort(connection);
 		}
 		else
 		{
-			SendOptionalCommandListToWorkerInTransaction(workerNode->workerName,
-														 workerNode->workerPort,
-														 superuser,
-														 commandList);
+			StartRemoteTransactionCommit(connection);
 		}
 	}
+
+	foreach_ptr(connection, connectionList)
+	{
+		if (list_member_ptr(failedConnectionList, connection))
+		{
+			FinishRemoteTransactionAbort(connection);
+		}
+		else
+		{
+			FinishRemoteTransactionCommit(connection);
+		}
+
+		CloseConnection(connection);
+	}
+}
+
+
+/*
+ * OpenNewConnectionsToWorkers opens a new connection to each of the given
+ * workers in parallel, as the given user, and waits until all of them are
+ * established or failed.
+ */
+static List *
+OpenNewConnectionsToWorkers(List *workerNodeList, const char *user)
+{
+	List *connectionList = NIL;
+
+	WorkerNode *workerNode = NULL;
+	foreach_ptr(workerNode, workerNodeList)
+	{
+		const char *nodeName = workerNode->workerName;
+		int nodePort = workerNode->workerPort;
+		int connectionFlags = FORCE_NEW_CONNECTION;
+
+		MultiConnection *connection = StartNodeUserDatabaseConnection(connectionFlags,
+																	  nodeName, nodePort,
+																	  user, NULL);
+		connectionList = lappend(connectionList, connection);
+	}
+
+	FinishConnectionListEstablishment(connectionList);
+
+	return connectionList;
 }
 
 
@@ -224,7 +307,7 @@ TargetWorkerSetNodeList(TargetWorkerSet targetWorkerSet, LOCKMODE lockMode)
 
 /*
  * SendBareCommandListToMetadataWorkers sends a list of commands to metadata
- * workers in serial. Commands are committed immediately: new connections are
+ * workers in parallel. Commands are committed immediately: new connections are
  * always used and no transaction block is used (hence "bare"). The connections
  * are made as the extension owner to ensure write access to the Citus metadata
  * tables. Primarly useful for INDEX commands using CONCURRENTLY.
@@ -238,34 +321,22 @@ SendBareCommandListToMetadataWorkers(List *commandList)
 
 	ErrorIfAnyMetadataNodeOutOfSync(workerNodeList);
 
-	/* run commands serially */
-	WorkerNode *workerNode = NULL;
-	foreach_ptr(workerNode, workerNodeList)
-	{
-		const char *nodeName = workerNode->workerName;
-		int nodePort = workerNode->workerPort;
-		int connectionFlags = FORCE_NEW_CONNECTION;
-
-		MultiConnection *workerConnection = GetNodeUserDatabaseConnection(connectionFlags,
-																		  nodeName,
-																		  nodePort,
-																		  nodeUser, NULL);
+	List *connectionList = OpenNewConnectionsToWorkers(workerNodeList, nodeUser);
 
-		/* iterate over the commands and execute them in the same connection */
-		const char *commandString = NULL;
-		foreach_ptr(commandString, commandList)
-		{
-			ExecuteCriticalRemoteCommand(workerConnection, commandString);
-		}
+	/* run the commands on all workers concurrently */
+	ExecuteCriticalRemoteCommandListInParallel(connectionList, commandList);
 
-		CloseConnection(workerConnection);
+	MultiConnection *connection = NULL;
+	foreach_ptr(connection, connectionList)
+	{
+		CloseConnection(connection);
 	}
 }
 
 
 /*
  * SendBareOptionalCommandListToAllWorkersAsUser sends a list of commands
- * to all workers in serial. Commands are committed immediately: new
+ * to all workers in parallel. Commands are committed immediately: new
  * connections are always used and no transaction block is used (hence "bare").
  */
 int
@@ -273,35 +344,19 @@ SendBareOptionalCommandListToAllWorkersAsUser(List *commandList, const char *use
 {
 	TargetWorkerSet targetWorkerSet = ALL_WORKERS;
 	List *workerNodeList = TargetWorkerSetNodeList(targetWorkerSet, ShareLock);
-	int maxError = RESPONSE_OKAY;
+	List *failedConnectionList = NIL;
 
-	/* run commands serially */
-	WorkerNode *workerNode = NULL;
-	foreach_ptr(workerNode, workerNodeList)
-	{
-		const char *nodeName = workerNode->workerName;
-		int nodePort = workerNode->workerPort;
-		int connectionFlags = FORCE_NEW_CONNECTION;
+	List *connectionList = OpenNewConnectionsToWorkers(workerNodeList, user);
 
-		MultiConnection *workerConnection = GetNodeUserDatabaseConnection(connectionFlags,
-																		  nodeName,
-																		  nodePort, user,
-																		  NULL);
+	/* run the commands on all workers concurrently */
+	int maxError = ExecuteOptionalRemoteCommandListInParallel(connectionList,
+															  commandList,
+															  &failedConnectionList);
 
-		/* iterate over the commands and execute them in the same connection */
-		const char *commandString = NULL;
-		foreach_ptr(commandString, commandList)
-		{
-			int result = ExecuteOptionalRemoteCommand(workerConnection, commandString,
-													  NULL);
-			if (result != RESPONSE_OKAY)
-			{
-				maxError = Max(maxError, result);
-				break;
-			}
-		}
-
-		CloseConnection(workerConnection);
+	MultiConnection *connection = NULL;
+	foreach_ptr(connection, connectionList)
+	{
+		CloseConnection(connection);
 	}
 
 	return maxError;
@@ -491,7 +546,7 @@ SendCommandToWorkersParamsInternal(TargetWorkerSet targetWorkerSet, const char *
 	foreach_ptr(connection, connectionList)
 	{
 		int querySent = SendRemoteCommandParams(connection, command, parameterCount,
-												parameterTypes, parameterValues);
+												parameterTypes, parameterValues, false);
 		if (querySent == 0)
 		{
 			ReportConnectionError(connection, ERROR);
@@ -90,7 +90,7 @@ StartLockAcquireHelperBackgroundWorker(int backendToHelp, int32 lock_cooldown)
 	worker.bgw_main_arg = Int32GetDatum(backendToHelp);
 	worker.bgw_notify_pid = 0;
 
-	memcpy_s(worker.bgw_extra, sizeof(worker.bgw_extra), &args, sizeof(args));
+	memcpy_struct(worker.bgw_extra, args);
 
 	if (!RegisterDynamicBackgroundWorker(&worker, &handle))
 	{
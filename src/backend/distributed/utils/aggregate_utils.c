@@ -49,12 +49,24 @@ typedef struct StypeBox
 	bool transtypeByVal;
 	bool valueNull;
 	bool valueInit;
+
+	/*
+	 * Functions called for every row, looked up once on the first call of the
+	 * support aggregate's transition function so that later rows skip the
+	 * catalog lookups. transfn is the aggregate's transition function for
+	 * worker_partial_agg, or its combine function for coord_combine_agg, in
+	 * which case deserialfn is the transition type's input function.
+	 */
+	FmgrInfo transfn;
+	FmgrInfo deserialfn;
+	Oid deserialIOParam;
 } StypeBox;
 
 static HeapTuple GetAggregateForm(Oid oid, Form_pg_aggregate *form);
 static HeapTuple GetProcForm(Oid oid, Form_pg_proc *form);
 static HeapTuple GetTypeForm(Oid oid, Form_pg_type *form);
 static void * pallocInAggContext(FunctionCallInfo fcinfo, size_t size);
+static MemoryContext GetAggContext(FunctionCallInfo fcinfo);
 static void aclcheckAggregate(ObjectType objectType, Oid userOid, Oid funcOid);
 static Datum GetAggInitVal(Datum textInitVal, Oid transtype);
 static void InitializeStypeBox(FunctionCallInfo fcinfo, StypeBox *box, HeapTuple aggTuple,
@@ -120,13 +132,23 @@ GetTypeForm(Oid oid, Form_pg_type *form)
  */
 static void *
 pallocInAggContext(FunctionCallInfo fcinfo, size_t size)
+{
+	return MemoryContextAlloc(GetAggContext(fcinfo), size);
+}
+
+
+/*
+ * GetAggContext returns fcinfo's aggregate context
+ */
+static MemoryContext
+GetAggContext(FunctionCallInfo fcinfo)
 {
 	MemoryContext aggregateContext;
 	if (!AggCheckCallContext(fcinfo, &aggregateContext))
 	{
 		elog(ERROR, "Aggregate function called without an aggregate context");
 	}
-	return MemoryContextAlloc(aggregateContext, size);
+	return aggregateContext;
 }
 
 
@@ -342,7 +364,6 @@ worker_partial_agg_sfunc(PG_FUNCTION_ARGS)
 	StypeBox *box = NULL;
 	Form_pg_aggregate aggform;
 	LOCAL_FCINFO(innerFcinfo, FUNC_MAX_ARGS);
-	FmgrInfo info;
 	int argumentIndex = 0;
 	bool initialCall = PG_ARGISNULL(0);
 
@@ -356,29 +377,24 @@ worker_partial_agg_sfunc(PG_FUNCTION_ARGS)
 			ereport(ERROR, (errmsg(
 								"worker_partial_agg_sfunc could not confirm type correctness")));
 		}
-	}
-	else
-	{
-		box = (StypeBox *) PG_GETARG_POINTER(0);
-		Assert(box->agg == PG_GETARG_OID(1));
-	}
 
-	HeapTuple aggtuple = GetAggregateForm(box->agg, &aggform);
-	Oid aggsfunc = aggform->aggtransfn;
-	if (initialCall)
-	{
+		HeapTuple aggtuple = GetAggregateForm(box->agg, &aggform);
+		Oid aggsfunc = aggform->aggtransfn;
 		InitializeStypeBox(fcinfo, box, aggtuple, aggform->aggtranstype);
-	}
-	ReleaseSysCache(aggtuple);
-	if (initialCall)
-	{
+		ReleaseSysCache(aggtuple);
+
 		get_typlenbyval(box->transtype,
 						&box->transtypeLen,
 						&box->transtypeByVal);
+		fmgr_info_cxt(aggsfunc, &box->transfn, GetAggContext(fcinfo));
+	}
+	else
+	{
+		box = (StypeBox *) PG_GETARG_POINTER(0);
+		Assert(box->agg == PG_GETARG_OID(1));
 	}
 
-	fmgr_info(aggsfunc, &info);
-	if (info.fn_strict)
+	if (box->transfn.fn_strict)
 	{
 		for (argumentIndex = 2; argumentIndex < PG_NARGS(); argumentIndex++)
 		{
@@ -400,8 +416,8 @@ worker_partial_agg_sfunc(PG_FUNCTION_ARGS)
 		}
 	}
 
-	InitFunctionCallInfoData(*innerFcinfo, &info, fcinfo->nargs - 1, fcinfo->fncollation,
-							 fcinfo->context, fcinfo->resultinfo);
+	InitFunctionCallInfoData(*innerFcinfo, &box->transfn, fcinfo->nargs - 1,
+							 fcinfo->fncollation, fcinfo->context, fcinfo->resultinfo);
 	fcSetArgExt(innerFcinfo, 0, box->value, box->valueNull);
 	for (argumentIndex = 1; argumentIndex < innerFcinfo->nargs; argumentIndex++)
 	{
@@ -492,7 +508,6 @@ Datum
 coord_combine_agg_sfunc(PG_FUNCTION_ARGS)
 {
 	LOCAL_FCINFO(innerFcinfo, 3);
-	FmgrInfo info;
 	Form_pg_aggregate aggform;
 	Form_pg_type transtypeform;
 	Datum value;
@@ -502,70 +517,63 @@ coord_combine_agg_sfunc(PG_FUNCTION_ARGS)
 	{
 		box = pallocInAggContext(fcinfo, sizeof(StypeBox));
 		box->agg = PG_GETARG_OID(1);
-	}
-	else
-	{
-		box = (StypeBox *) PG_GETARG_POINTER(0);
-		Assert(box->agg == PG_GETARG_OID(1));
-	}
 
-	HeapTuple aggtuple = GetAggregateForm(box->agg, &aggform);
+		HeapTuple aggtuple = GetAggregateForm(box->agg, &aggform);
 
-	if (aggform->aggcombinefn == InvalidOid)
-	{
-		ereport(ERROR, (errmsg(
-							"coord_combine_agg_sfunc expects an aggregate with COMBINEFUNC")));
-	}
-
-	if (aggform->aggtranstype == INTERNALOID)
-	{
-		ereport(ERROR,
-				(errmsg(
-					 "coord_combine_agg_sfunc does not support aggregates with INTERNAL transition state")));
-	}
+		if (aggform->aggcombinefn == InvalidOid)
+		{
+			ereport(ERROR, (errmsg(
+								"coord_combine_agg_sfunc expects an aggregate with COMBINEFUNC")));
+		}
 
-	Oid combine = aggform->aggcombinefn;
+		if (aggform->aggtranstype == INTERNALOID)
+		{
+			ereport(ERROR,
+					(errmsg(
+						 "coord_combine_agg_sfunc does not support aggregates with INTERNAL transition state")));
+		}
 
-	if (PG_ARGISNULL(0))
-	{
+		Oid combine = aggform->aggcombinefn;
 		InitializeStypeBox(fcinfo, box, aggtuple, aggform->aggtranstype);
-	}
-
-	ReleaseSysCache(aggtuple);
+		ReleaseSysCache(aggtuple);
 
-	if (PG_ARGISNULL(0))
-	{
 		get_typlenbyval(box->transtype,
 						&box->transtypeLen,
 						&box->transtypeByVal);
+
+		HeapTuple transtypetuple = GetTypeForm(box->transtype, &transtypeform);
+		box->deserialIOParam = getTypeIOParam(transtypetuple);
+		Oid deserial = transtypeform->typinput;
+		ReleaseSysCache(transtypetuple);
+
+		MemoryContext aggregateContext = GetAggContext(fcinfo);
+		fmgr_info_cxt(deserial, &box->deserialfn, aggregateContext);
+		fmgr_info_cxt(combine, &box->transfn, aggregateContext);
+	}
+	else
+	{
+		box = (StypeBox *) PG_GETARG_POINTER(0);
+		Assert(box->agg == PG_GETARG_OID(1));
 	}
 
 	bool valueNull = PG_ARGISNULL(2);
-	HeapTuple transtypetuple = GetTypeForm(box->transtype, &transtypeform);
-	Oid ioparam = getTypeIOParam(transtypetuple);
-	Oid deserial = transtypeform->typinput;
-	ReleaseSysCache(transtypetuple);
-
-	fmgr_info(deserial, &info);
-	if (valueNull && info.fn_strict)
+	if (valueNull && box->deserialfn.fn_strict)
 	{
 		value = (Datum) 0;
 	}
 	else
 	{
-		InitFunctionCallInfoData(*innerFcinfo, &info, 3, fcinfo->fncollation,
+		InitFunctionCallInfoData(*innerFcinfo, &box->deserialfn, 3, fcinfo->fncollation,
 								 fcinfo->context, fcinfo->resultinfo);
 		fcSetArgExt(innerFcinfo, 0, PG_GETARG_DATUM(2), valueNull);
-		fcSetArg(innerFcinfo, 1, ObjectIdGetDatum(ioparam));
+		fcSetArg(innerFcinfo, 1, ObjectIdGetDatum(box->deserialIOParam));
 		fcSetArg(innerFcinfo, 2, Int32GetDatum(-1)); /* typmod */
 
 		value = FunctionCallInvoke(innerFcinfo);
 		valueNull = innerFcinfo->isnull;
 	}
 
-	fmgr_info(combine, &info);
-
-	if (info.fn_strict)
+	if (box->transfn.fn_strict)
 	{
 		if (valueNull)
 		{
@@ -584,7 +592,7 @@ coord_combine_agg_sfunc(PG_FUNCTION_ARGS)
 		}
 	}
 
-	InitFunctionCallInfoData(*innerFcinfo, &info, 2, fcinfo->fncollation,
+	InitFunctionCallInfoData(*innerFcinfo, &box->transfn, 2, fcinfo->fncollation,
 							 fcinfo->context, fcinfo->resultinfo);
 	fcSetArgExt(innerFcinfo, 0, box->value, box->valueNull);
 	fcSetArgExt(innerFcinfo, 1, value, valueNull);
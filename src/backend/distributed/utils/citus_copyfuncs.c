@@ -85,6 +85,7 @@ copyJobInfo(Job *newnode, Job *from)
 	COPY_SCALAR_FIELD(requiresMasterEvaluation);
 	COPY_SCALAR_FIELD(deferredPruning);
 	COPY_NODE_FIELD(partitionKeyValue);
+	COPY_NODE_FIELD(taskPruningQualList);
 	COPY_NODE_FIELD(localPlannedStatements);
 	COPY_SCALAR_FIELD(parametersInJobQueryResolved);
 }
@@ -120,6 +121,7 @@ CopyNodeDistributedPlan(COPYFUNC_ARGS)
 	COPY_NODE_FIELD(subPlanList);
 	COPY_NODE_FIELD(usedSubPlanNodeList);
 	COPY_SCALAR_FIELD(fastPathRouterPlan);
+	COPY_SCALAR_FIELD(mergeSortedTaskResults);
 	COPY_NODE_FIELD(planningError);
 }
 
@@ -131,6 +133,7 @@ CopyNodeDistributedSubPlan(COPYFUNC_ARGS)
 
 	COPY_SCALAR_FIELD(subPlanId);
 	COPY_NODE_FIELD(plan);
+	COPY_STRING_FIELD(queryFingerprint);
 }
 
 
@@ -141,6 +144,8 @@ CopyNodeUsedDistributedSubPlan(COPYFUNC_ARGS)
 
 	COPY_STRING_FIELD(subPlanId);
 	COPY_SCALAR_FIELD(locationMask);
+	COPY_SCALAR_FIELD(partitionRelationId);
+	COPY_SCALAR_FIELD(partitionColumnIndex);
 }
 
 
@@ -266,6 +271,7 @@ CopyNodeTask(COPYFUNC_ARGS)
 	COPY_NODE_FIELD(dependentTaskList);
 	COPY_SCALAR_FIELD(partitionId);
 	COPY_SCALAR_FIELD(upstreamTaskId);
+	COPY_STRING_FIELD(filterQueryString);
 	COPY_NODE_FIELD(shardInterval);
 	COPY_SCALAR_FIELD(assignmentConstrained);
 	COPY_NODE_FIELD(taskExecution);
@@ -276,6 +282,9 @@ CopyNodeTask(COPYFUNC_ARGS)
 	COPY_NODE_FIELD(rowValuesLists);
 	COPY_SCALAR_FIELD(partiallyLocalOrRemote);
 	COPY_SCALAR_FIELD(parametersInQueryStringResolved);
+	COPY_STRING_FIELD(preparedStatementName);
+	COPY_STRING_FIELD(prepareCommand);
+	COPY_STRING_FIELD(executeCommand);
 }
 
 
@@ -196,6 +196,7 @@ OutDistributedPlan(OUTFUNC_ARGS)
 	WRITE_NODE_FIELD(subPlanList);
 	WRITE_NODE_FIELD(usedSubPlanNodeList);
 	WRITE_BOOL_FIELD(fastPathRouterPlan);
+	WRITE_BOOL_FIELD(mergeSortedTaskResults);
 
 	WRITE_NODE_FIELD(planningError);
 }
@@ -210,6 +211,7 @@ OutDistributedSubPlan(OUTFUNC_ARGS)
 
 	WRITE_UINT_FIELD(subPlanId);
 	WRITE_NODE_FIELD(plan);
+	WRITE_STRING_FIELD(queryFingerprint);
 }
 
 void
@@ -221,6 +223,8 @@ OutUsedDistributedSubPlan(OUTFUNC_ARGS)
 
 	WRITE_STRING_FIELD(subPlanId);
 	WRITE_INT_FIELD(locationMask);
+	WRITE_OID_FIELD(partitionRelationId);
+	WRITE_INT_FIELD(partitionColumnIndex);
 }
 
 
@@ -338,6 +342,7 @@ OutJobFields(StringInfo str, const Job *node)
 	WRITE_BOOL_FIELD(requiresMasterEvaluation);
 	WRITE_BOOL_FIELD(deferredPruning);
 	WRITE_NODE_FIELD(partitionKeyValue);
+	WRITE_NODE_FIELD(taskPruningQualList);
 	WRITE_NODE_FIELD(localPlannedStatements);
 	WRITE_BOOL_FIELD(parametersInJobQueryResolved);
 }
@@ -484,6 +489,7 @@ OutTask(OUTFUNC_ARGS)
 	WRITE_NODE_FIELD(dependentTaskList);
 	WRITE_UINT_FIELD(partitionId);
 	WRITE_UINT_FIELD(upstreamTaskId);
+	WRITE_STRING_FIELD(filterQueryString);
 	WRITE_NODE_FIELD(shardInterval);
 	WRITE_BOOL_FIELD(assignmentConstrained);
 	WRITE_NODE_FIELD(taskExecution);
@@ -494,6 +500,9 @@ OutTask(OUTFUNC_ARGS)
 	WRITE_NODE_FIELD(rowValuesLists);
 	WRITE_BOOL_FIELD(partiallyLocalOrRemote);
 	WRITE_BOOL_FIELD(parametersInQueryStringResolved);
+	WRITE_STRING_FIELD(preparedStatementName);
+	WRITE_STRING_FIELD(prepareCommand);
+	WRITE_STRING_FIELD(executeCommand);
 }
 
 
@@ -161,99 +161,6 @@ SafeStringToUint64(const char *str)
 }
 
 
-/*
- * SafeQsort is the non reentrant version of qsort (qsort vs qsort_r), but it
- * does the input checks required for qsort_s:
- *  1. count or size is greater than RSIZE_MAX
- *  2. ptr or comp is a null pointer (unless count is zero)
- * source: https://en.cppreference.com/w/c/algorithm/qsort
- *
- * When it hits these errors it calls the ereport_constraint_handler.
- *
- * NOTE: this functions calls pg_qsort instead of stdlib qsort.
- */
-void
-SafeQsort(void *ptr, rsize_t count, rsize_t size,
-		  int (*comp)(const void *, const void *))
-{
-	if (count > RSIZE_MAX_MEM)
-	{
-		ereport_constraint_handler("SafeQsort: count exceeds max",
-								   NULL, ESLEMAX);
-	}
-
-	if (size > RSIZE_MAX_MEM)
-	{
-		ereport_constraint_handler("SafeQsort: size exceeds max",
-								   NULL, ESLEMAX);
-	}
-	if (size != 0)
-	{
-		if (ptr == NULL)
-		{
-			ereport_constraint_handler("SafeQsort: ptr is NULL", NULL, ESNULLP);
-		}
-		if (comp == NULL)
-		{
-			ereport_constraint_handler("SafeQsort: comp is NULL", NULL, ESNULLP);
-		}
-	}
-	pg_qsort(ptr, count, size, comp);
-}
-
-
-/*
- * SafeBsearch is a non reentrant version of bsearch, but it does the
- * input checks required for bsearch_s:
- *  1. count or size is greater than RSIZE_MAX
- *  2. key, ptr or comp is a null pointer (unless count is zero)
- * source: https://en.cppreference.com/w/c/algorithm/bsearch
- *
- * When it hits these errors it calls the ereport_constraint_handler.
- *
- * NOTE: this functions calls pg_qsort instead of stdlib qsort.
- */
-void *
-SafeBsearch(const void *key, const void *ptr, rsize_t count, rsize_t size,
-			int (*comp)(const void *, const void *))
-{
-	if (count > RSIZE_MAX_MEM)
-	{
-		ereport_constraint_handler("SafeBsearch: count exceeds max",
-								   NULL, ESLEMAX);
-	}
-
-	if (size > RSIZE_MAX_MEM)
-	{
-		ereport_constraint_handler("SafeBsearch: size exceeds max",
-								   NULL, ESLEMAX);
-	}
-	if (size != 0)
-	{
-		if (key == NULL)
-		{
-			ereport_constraint_handler("SafeBsearch: key is NULL", NULL, ESNULLP);
-		}
-		if (ptr == NULL)
-		{
-			ereport_constraint_handler("SafeBsearch: ptr is NULL", NULL, ESNULLP);
-		}
-		if (comp == NULL)
-		{
-			ereport_constraint_handler("SafeBsearch: comp is NULL", NULL, ESNULLP);
-		}
-	}
-
-	/*
-	 * Explanation of IGNORE-BANNED:
-	 * bsearch is safe to use here since we check the same thing bsearch_s
-	 * does. We cannot use bsearch_s as a replacement, since it's not available
-	 * in safestringlib.
-	 */
-	return bsearch(key, ptr, count, size, comp); /* IGNORE-BANNED */
-}
-
-
 /*
  * SafeSnprintf is a safer replacement for snprintf, which is needed since
  * safestringlib doesn't implement snprintf_s.
@@ -27,6 +27,7 @@
 #include "distributed/metadata_sync.h"
 #include "distributed/multi_logical_planner.h"
 #include "distributed/pg_dist_colocation.h"
+#include "distributed/reference_table_utils.h"
 #include "distributed/resource_lock.h"
 #include "distributed/shardinterval_utils.h"
 #include "distributed/worker_protocol.h"
@@ -35,9 +36,45 @@
 #include "utils/builtins.h"
 #include "utils/fmgroids.h"
 #include "utils/lsyscache.h"
+#include "utils/memutils.h"
 #include "utils/rel.h"
 
 
+/*
+ * ColocatedShardMap maps the shard indexes of a colocation group to the
+ * colocated shards of its tables, such that planning joins of colocated tables
+ * does not need to compare the shards and placements of every table again.
+ * A map is built when it is first needed and is removed when the metadata of
+ * one of its tables changes.
+ */
+typedef struct ColocatedShardMap
+{
+	uint32 colocationId;
+
+	/* tables in the colocation group when the map was built */
+	List *relationIdList;
+	int relationCount;
+	int shardCount;
+
+	/* shard ids, at [shardIndex * relationCount + relationIndex] */
+	uint64 *shardIdArray;
+
+	/* whether the active placements of the shards at an index are in the same groups */
+	bool *coPlacedArray;
+
+	/* memory context that holds the map */
+	MemoryContext memoryContext;
+} ColocatedShardMap;
+
+
+/* colocated shard maps of this backend */
+static List *ColocatedShardMapList = NIL;
+static MemoryContext ColocatedShardMapContext = NULL;
+
+/* incremented on every invalidation, to detect invalidations while building a map */
+static uint64 ColocatedShardMapGeneration = 0;
+
+
 /* local function forward declarations */
 static void MarkTablesColocated(Oid sourceRelationId, Oid targetRelationId);
 static void ErrorIfShardPlacementsNotColocated(Oid leftRelationId, Oid rightRelationId);
@@ -50,6 +87,12 @@ static int CompareShardPlacementsByNode(const void *leftElement,
 static void UpdateRelationColocationGroup(Oid distributedRelationId, uint32 colocationId);
 static List * ColocationGroupTableList(Oid colocationId);
 static void DeleteColocationGroup(uint32 colocationId);
+static ColocatedShardMap * GetColocatedShardMap(uint32 colocationId);
+static ColocatedShardMap * BuildColocatedShardMap(uint32 colocationId);
+static bool ShardsHaveSameActivePlacementGroups(uint64 leftShardId, uint64 rightShardId);
+static List * ActivePlacementGroupIds(uint64 shardId);
+static bool ShardInColocatedShardMap(ColocatedShardMap *colocatedShardMap,
+									 ShardInterval *shardInterval);
 
 
 /* exports for SQL callable functions */
@@ -1033,3 +1076,281 @@ DeleteColocationGroup(uint32 colocationId)
 	systable_endscan(scanDescriptor);
 	heap_close(pgDistColocation, RowExclusiveLock);
 }
+
+
+/*
+ * ColocatedShardsCoPlaced returns whether the given shards are at the same
+ * shard index of tables in the same colocation group, and the active placements
+ * of all shards at that index are in the same groups. In that case, a worker
+ * that has one of the shards has all of them. The function returns false if it
+ * cannot tell from the colocated shard map of the colocation group.
+ */
+bool
+ColocatedShardsCoPlaced(ShardInterval *leftShardInterval,
+						ShardInterval *rightShardInterval)
+{
+	CitusTableCacheEntry *leftCacheEntry =
+		GetCitusTableCacheEntry(leftShardInterval->relationId);
+	CitusTableCacheEntry *rightCacheEntry =
+		GetCitusTableCacheEntry(rightShardInterval->relationId);
+	uint32 colocationId = leftCacheEntry->colocationId;
+
+	if (leftCacheEntry->partitionMethod != DISTRIBUTE_BY_HASH ||
+		rightCacheEntry->partitionMethod != DISTRIBUTE_BY_HASH ||
+		colocationId == INVALID_COLOCATION_ID ||
+		colocationId != rightCacheEntry->colocationId ||
+		leftShardInterval->shardIndex != rightShardInterval->shardIndex)
+	{
+		return false;
+	}
+
+	ColocatedShardMap *colocatedShardMap = GetColocatedShardMap(colocationId);
+	if (colocatedShardMap == NULL ||
+		!ShardInColocatedShardMap(colocatedShardMap, leftShardInterval) ||
+		!ShardInColocatedShardMap(colocatedShardMap, rightShardInterval))
+	{
+		return false;
+	}
+
+	return colocatedShardMap->coPlacedArray[leftShardInterval->shardIndex];
+}
+
+
+/*
+ * ShardInColocatedShardMap returns whether the given shard is in the given map
+ * at its shard index.
+ */
+static bool
+ShardInColocatedShardMap(ColocatedShardMap *colocatedShardMap,
+						 ShardInterval *shardInterval)
+{
+	int shardIndex = shardInterval->shardIndex;
+	int relationIndex = 0;
+
+	if (shardIndex < 0 || shardIndex >= colocatedShardMap->shardCount)
+	{
+		return false;
+	}
+
+	Oid relationId = InvalidOid;
+	foreach_oid(relationId, colocatedShardMap->relationIdList)
+	{
+		if (relationId == shardInterval->relationId)
+		{
+			int shardIdIndex = shardIndex * colocatedShardMap->relationCount +
+							   relationIndex;
+
+			return colocatedShardMap->shardIdArray[shardIdIndex] ==
+				   shardInterval->shardId;
+		}
+
+		relationIndex++;
+	}
+
+	return false;
+}
+
+
+/*
+ * GetColocatedShardMap returns the colocated shard map of the given colocation
+ * group, and builds it if needed. It returns NULL if the map cannot be built.
+ */
+static ColocatedShardMap *
+GetColocatedShardMap(uint32 colocationId)
+{
+	ColocatedShardMap *colocatedShardMap = NULL;
+	foreach_ptr(colocatedShardMap, ColocatedShardMapList)
+	{
+		if (colocatedShardMap->colocationId == colocationId)
+		{
+			return colocatedShardMap;
+		}
+	}
+
+	return BuildColocatedShardMap(colocationId);
+}
+
+
+/*
+ * BuildColocatedShardMap builds the colocated shard map of the given colocation
+ * group from the metadata cache and adds it to the cached maps. It returns NULL
+ * if the tables of the group do not have the same number of shards, or if the
+ * metadata changed while the map was built.
+ */
+static ColocatedShardMap *
+BuildColocatedShardMap(uint32 colocationId)
+{
+	uint64 generation = ColocatedShardMapGeneration;
+	List *relationIdList = SortList(ColocationGroupTableList(colocationId),
+									CompareOids);
+	int relationCount = list_length(relationIdList);
+
+	if (relationCount == 0)
+	{
+		return NULL;
+	}
+
+	if (ColocatedShardMapContext == NULL)
+	{
+		ColocatedShardMapContext = AllocSetContextCreate(CacheMemoryContext,
+														 "Colocated Shard Map Cache",
+														 ALLOCSET_DEFAULT_SIZES);
+	}
+
+	MemoryContext mapContext = AllocSetContextCreate(ColocatedShardMapContext,
+													 "Colocated Shard Map",
+													 ALLOCSET_SMALL_SIZES);
+	MemoryContext oldContext = MemoryContextSwitchTo(mapContext);
+
+	ColocatedShardMap *colocatedShardMap = palloc0(sizeof(ColocatedShardMap));
+	colocatedShardMap->colocationId = colocationId;
+	colocatedShardMap->relationIdList = list_copy(relationIdList);
+	colocatedShardMap->relationCount = relationCount;
+	colocatedShardMap->shardCount = -1;
+	colocatedShardMap->memoryContext = mapContext;
+
+	MemoryContextSwitchTo(oldContext);
+
+	int relationIndex = 0;
+	Oid relationId = InvalidOid;
+	foreach_oid(relationId, relationIdList)
+	{
+		CitusTableCacheEntry *cacheEntry = GetCitusTableCacheEntry(relationId);
+		int shardCount = cacheEntry->shardIntervalArrayLength;
+
+		if (colocatedShardMap->shardCount == -1)
+		{
+			colocatedShardMap->shardCount = shardCount;
+			colocatedShardMap->shardIdArray =
+				MemoryContextAllocZero(mapContext, (Size) shardCount * relationCount *
+									   sizeof(uint64));
+		}
+		else if (colocatedShardMap->shardCount != shardCount)
+		{
+			MemoryContextDelete(mapContext);
+			return NULL;
+		}
+
+		for (int shardIndex = 0; shardIndex < shardCount; shardIndex++)
+		{
+			ShardInterval *shardInterval =
+				cacheEntry->sortedShardIntervalArray[shardIndex];
+
+			colocatedShardMap->shardIdArray[shardIndex * relationCount + relationIndex] =
+				shardInterval->shardId;
+		}
+
+		relationIndex++;
+	}
+
+	int shardCount = colocatedShardMap->shardCount;
+	colocatedShardMap->coPlacedArray =
+		MemoryContextAllocZero(mapContext, Max(shardCount, 1) * sizeof(bool));
+
+	for (int shardIndex = 0; shardIndex < shardCount; shardIndex++)
+	{
+		uint64 *shardIdArray =
+			&colocatedShardMap->shardIdArray[shardIndex * relationCount];
+		bool coPlaced = true;
+
+		for (relationIndex = 1; relationIndex < relationCount && coPlaced;
+			 relationIndex++)
+		{
+			coPlaced = ShardsHaveSameActivePlacementGroups(shardIdArray[0],
+														   shardIdArray[relationIndex]);
+		}
+
+		colocatedShardMap->coPlacedArray[shardIndex] = coPlaced;
+	}
+
+	/* the map may be stale if the metadata changed in the meantime */
+	if (generation != ColocatedShardMapGeneration)
+	{
+		MemoryContextDelete(mapContext);
+		return NULL;
+	}
+
+	oldContext = MemoryContextSwitchTo(ColocatedShardMapContext);
+	ColocatedShardMapList = lappend(ColocatedShardMapList, colocatedShardMap);
+	MemoryContextSwitchTo(oldContext);
+
+	return colocatedShardMap;
+}
+
+
+/*
+ * ShardsHaveSameActivePlacementGroups returns whether the active placements of
+ * the given shards are in the same groups.
+ */
+static bool
+ShardsHaveSameActivePlacementGroups(uint64 leftShardId, uint64 rightShardId)
+{
+	List *leftGroupIdList = ActivePlacementGroupIds(leftShardId);
+	List *rightGroupIdList = ActivePlacementGroupIds(rightShardId);
+
+	return list_length(leftGroupIdList) == list_length(rightGroupIdList) &&
+		   list_difference_int(leftGroupIdList, rightGroupIdList) == NIL;
+}
+
+
+/*
+ * ActivePlacementGroupIds returns the groups of the active placements of the
+ * given shard.
+ */
+static List *
+ActivePlacementGroupIds(uint64 shardId)
+{
+	List *groupIdList = NIL;
+	int placementCount = 0;
+
+	GroupShardPlacement *placementArray =
+		CachedGroupShardPlacementArray(shardId, &placementCount);
+
+	for (int placementIndex = 0; placementIndex < placementCount; placementIndex++)
+	{
+		GroupShardPlacement *placement = &placementArray[placementIndex];
+
+		if (placement->shardState == SHARD_STATE_ACTIVE)
+		{
+			groupIdList = list_append_unique_int(groupIdList, placement->groupId);
+		}
+	}
+
+	return groupIdList;
+}
+
+
+/*
+ * InvalidateColocatedShardMaps removes the colocated shard maps that contain
+ * the given table, or all of them if relationId is InvalidOid. It is called
+ * when the metadata of distributed tables changes. A table that is added to a
+ * colocation group is not in the map of the group, which is harmless since
+ * the maps are only used to answer questions about the tables in them.
+ */
+void
+InvalidateColocatedShardMaps(Oid relationId)
+{
+	ColocatedShardMapGeneration++;
+
+	if (ColocatedShardMapList == NIL)
+	{
+		return;
+	}
+
+	/* removing maps modifies the list, so walk over a copy */
+	List *colocatedShardMapList = list_copy(ColocatedShardMapList);
+
+	ColocatedShardMap *colocatedShardMap = NULL;
+	foreach_ptr(colocatedShardMap, colocatedShardMapList)
+	{
+		if (relationId == InvalidOid ||
+			list_member_oid(colocatedShardMap->relationIdList, relationId))
+		{
+			ColocatedShardMapList = list_delete_ptr(ColocatedShardMapList,
+													colocatedShardMap);
+			MemoryContextDelete(colocatedShardMap->memoryContext);
+		}
+	}
+
+	list_free(colocatedShardMapList);
+}
@@ -0,0 +1,108 @@
+/*-------------------------------------------------------------------------
+ *
+ * copy_compression.c
+ *	  Compressed framing of COPY data streams between nodes.
+ *
+ * Intermediate results that are sent between nodes using
+ * COPY ... WITH (format result, compression pglz) carry compressed frames
+ * in their CopyData messages. Each frame starts with the length of the raw
+ * data as a 4-byte integer in network byte order, followed by the data
+ * compressed using pglz. When compression does not reduce the size of the
+ * data, the data is stored as is, which the receiver recognizes by the frame
+ * being exactly 4 bytes longer than the raw data.
+ *
+ * Copyright (c) Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include "postgres.h"
+
+#include <netinet/in.h> /* for htonl */
+
+#include "common/pg_lzcompress.h"
+#include "distributed/copy_compression.h"
+#include "distributed/version_compat.h"
+
+
+/* GUC, whether intermediate results are compressed while sent between nodes */
+bool EnableIntermediateResultCompression = false;
+
+
+/*
+ * AppendCompressedCopyFrame compresses the given data and appends the
+ * resulting frame to the frame buffer.
+ */
+void
+AppendCompressedCopyFrame(StringInfo frame, const char *data, int dataLength)
+{
+	uint32 rawLength = htonl((uint32) dataLength);
+
+	appendBinaryStringInfo(frame, (char *) &rawLength, sizeof(uint32));
+
+	enlargeStringInfo(frame, PGLZ_MAX_OUTPUT(dataLength));
+
+	int32 compressedLength = pglz_compress(data, dataLength, frame->data + frame->len,
+										   PGLZ_strategy_always);
+	if (compressedLength < 0 || compressedLength >= dataLength)
+	{
+		/* data is not compressible, send it as is */
+		appendBinaryStringInfo(frame, data, dataLength);
+	}
+	else
+	{
+		frame->len += compressedLength;
+		frame->data[frame->len] = '\0';
+	}
+}
+
+
+/*
+ * AppendDecompressedCopyFrame decompresses a frame created by
+ * AppendCompressedCopyFrame and appends the raw data to the given buffer.
+ */
+void
+AppendDecompressedCopyFrame(StringInfo rawData, const char *frame, int frameLength)
+{
+	uint32 networkRawLength = 0;
+
+	if (frameLength < (int) sizeof(uint32))
+	{
+		ereport(ERROR, (errcode(ERRCODE_DATA_CORRUPTED),
+						errmsg("compressed COPY frame is too short")));
+	}
+
+	memcpy(&networkRawLength, frame, sizeof(uint32));
+
+	int rawLength = (int) ntohl(networkRawLength);
+	const char *payload = frame + sizeof(uint32);
+	int payloadLength = frameLength - sizeof(uint32);
+
+	if (rawLength < 0 || payloadLength > rawLength)
+	{
+		ereport(ERROR, (errcode(ERRCODE_DATA_CORRUPTED),
+						errmsg("invalid length in compressed COPY frame")));
+	}
+
+	enlargeStringInfo(rawData, rawLength);
+
+	if (payloadLength == rawLength)
+	{
+		/* data was sent uncompressed */
+		memcpy(rawData->data + rawData->len, payload, rawLength);
+	}
+	else
+	{
+		int32 decompressedLength = pglz_decompress_compat(payload, payloadLength,
+														  rawData->data + rawData->len,
+														  rawLength);
+		if (decompressedLength != rawLength)
+		{
+			ereport(ERROR, (errcode(ERRCODE_DATA_CORRUPTED),
+							errmsg("could not decompress COPY frame")));
+		}
+	}
+
+	rawData->len += rawLength;
+	rawData->data[rawData->len] = '\0';
+}
@@ -0,0 +1,265 @@
+/*-------------------------------------------------------------------------
+ *
+ * cpu_affinity.c
+ *	  Pinning of executor backends and the maintenance daemon to CPUs.
+ *
+ * On coordinators with multiple sockets, a backend that runs a distributed
+ * query processes the results of many connections on whatever CPU the
+ * scheduler picks, and may move between sockets while doing so. When
+ * citus.executor_cpu_affinity lists CPUs, a backend pins itself to them
+ * when it starts a distributed execution, which keeps its memory and the
+ * socket buffers of its connections local. Setting it per role or database
+ * places the executor heavy sessions on their own socket. The maintenance
+ * daemon pins itself to citus.maintenance_daemon_cpu_affinity the same way.
+ *
+ * CPUs are given as a comma-separated list of CPU numbers and ranges, such
+ * as "0-7,16-23", the same as for taskset. An empty list restores the CPUs
+ * that the process could run on before it pinned itself. Pinning is only
+ * supported on Linux.
+ *
+ * Copyright (c) Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include "postgres.h"
+
+#ifdef __linux__
+#include <sched.h>
+#endif
+
+#include "distributed/cpu_affinity.h"
+#include "utils/memutils.h"
+
+
+/* highest CPU number that can be listed, plus one */
+#define MAX_AFFINITY_CPU_COUNT 1024
+
+
+/* Config variables managed via guc.c */
+char *ExecutorCpuAffinity = "";
+char *MaintenanceDaemonCpuAffinity = "";
+
+#ifdef __linux__
+
+/* CPU list that the process is pinned to, NULL if it is not pinned */
+static char *AppliedCpuList = NULL;
+
+/* CPUs that the process could run on before it pinned itself */
+static cpu_set_t OriginalCpuSet;
+
+#endif
+
+
+static bool ParseCpuList(const char *cpuList, bool *cpuSelected);
+static bool ParseCpuNumber(const char **position, int *cpuNumber);
+
+
+/*
+ * CpuAffinityIsSupported returns whether processes can be pinned to CPUs on
+ * this platform.
+ */
+bool
+CpuAffinityIsSupported(void)
+{
+#ifdef __linux__
+	return true;
+#else
+	return false;
+#endif
+}
+
+
+/*
+ * CpuListIsValid returns whether the given string is a valid list of CPU
+ * numbers and ranges.
+ */
+bool
+CpuListIsValid(const char *cpuList)
+{
+	bool cpuSelected[MAX_AFFINITY_CPU_COUNT];
+
+	return ParseCpuList(cpuList, cpuSelected);
+}
+
+
+/*
+ * ApplyCpuAffinity pins the current process to the CPUs in the given list,
+ * unless it is already pinned to them. An empty list undoes the pinning. If
+ * the CPUs cannot be set, for instance because none of them is available to
+ * the process, we only warn once, since running anywhere is fine.
+ */
+void
+ApplyCpuAffinity(const char *cpuList)
+{
+#ifdef __linux__
+	bool cpuSelected[MAX_AFFINITY_CPU_COUNT];
+	cpu_set_t cpuSet;
+
+	if (cpuList == NULL || cpuList[0] == '\0')
+	{
+		if (AppliedCpuList == NULL)
+		{
+			return;
+		}
+
+		/* restore the CPUs from before pinning */
+		if (sched_setaffinity(0, sizeof(OriginalCpuSet), &OriginalCpuSet) != 0)
+		{
+			ereport(WARNING, (errmsg("could not reset CPU affinity: %m")));
+		}
+
+		pfree(AppliedCpuList);
+		AppliedCpuList = NULL;
+
+		return;
+	}
+
+	if (AppliedCpuList != NULL && strcmp(AppliedCpuList, cpuList) == 0)
+	{
+		return;
+	}
+
+	if (!ParseCpuList(cpuList, cpuSelected))
+	{
+		/* the GUC check hook rejects invalid lists */
+		return;
+	}
+
+	if (AppliedCpuList == NULL &&
+		sched_getaffinity(0, sizeof(OriginalCpuSet), &OriginalCpuSet) != 0)
+	{
+		ereport(WARNING, (errmsg("could not get CPU affinity: %m")));
+		return;
+	}
+
+	CPU_ZERO(&cpuSet);
+
+	for (int cpuNumber = 0; cpuNumber < MAX_AFFINITY_CPU_COUNT &&
+		 cpuNumber < CPU_SETSIZE; cpuNumber++)
+	{
+		if (cpuSelected[cpuNumber])
+		{
+			CPU_SET(cpuNumber, &cpuSet);
+		}
+	}
+
+	if (sched_setaffinity(0, sizeof(cpuSet), &cpuSet) != 0)
+	{
+		ereport(WARNING, (errmsg("could not set CPU affinity to \"%s\": %m",
+								 cpuList)));
+	}
+
+	if (AppliedCpuList != NULL)
+	{
+		pfree(AppliedCpuList);
+	}
+
+	/* remember the list even if it failed, to not warn for every query */
+	AppliedCpuList = MemoryContextStrdup(TopMemoryContext, cpuList);
+#endif
+}
+
+
+/*
+ * ParseCpuList parses a comma-separated list of CPU numbers and ranges of
+ * CPU numbers into the cpuSelected array, which has MAX_AFFINITY_CPU_COUNT
+ * entries. It returns false if the list is not valid.
+ */
+static bool
+ParseCpuList(const char *cpuList, bool *cpuSelected)
+{
+	const char *position = cpuList;
+
+	memset(cpuSelected, 0, MAX_AFFINITY_CPU_COUNT * sizeof(bool));
+
+	if (cpuList == NULL)
+	{
+		return false;
+	}
+
+	while (true)
+	{
+		int firstCpu = 0;
+		int lastCpu = 0;
+
+		if (!ParseCpuNumber(&position, &firstCpu))
+		{
+			return false;
+		}
+
+		lastCpu = firstCpu;
+
+		if (*position == '-')
+		{
+			position++;
+
+			if (!ParseCpuNumber(&position, &lastCpu) || lastCpu < firstCpu)
+			{
+				return false;
+			}
+		}
+
+		for (int cpuNumber = firstCpu; cpuNumber <= lastCpu; cpuNumber++)
+		{
+			cpuSelected[cpuNumber] = true;
+		}
+
+		while (*position == ' ')
+		{
+			position++;
+		}
+
+		if (*position == '\0')
+		{
+			return true;
+		}
+
+		if (*position != ',')
+		{
+			return false;
+		}
+
+		position++;
+	}
+}
+
+
+/*
+ * ParseCpuNumber parses a CPU number at the given position, after optional
+ * spaces, and moves the position past it. It returns false if there is no
+ * number or the number is too high.
+ */
+static bool
+ParseCpuNumber(const char **position, int *cpuNumber)
+{
+	const char *current = *position;
+	int number = 0;
+
+	while (*current == ' ')
+	{
+		current++;
+	}
+
+	if (*current < '0' || *current > '9')
+	{
+		return false;
+	}
+
+	while (*current >= '0' && *current <= '9')
+	{
+		number = number * 10 + (*current - '0');
+
+		if (number >= MAX_AFFINITY_CPU_COUNT)
+		{
+			return false;
+		}
+
+		current++;
+	}
+
+	*cpuNumber = number;
+	*position = current;
+
+	return true;
+}
@@ -21,6 +21,7 @@
 
 #ifdef USE_OPENSSL
 #include "openssl/dsa.h"
+#include "openssl/ec.h"
 #include "openssl/err.h"
 #include "openssl/pem.h"
 #include "openssl/rsa.h"
@@ -278,7 +279,10 @@ CreateCertificatesWhenNeeded()
 
 
 /*
- * GeneratePrivateKey uses open ssl functions to generate an RSA private key of 2048 bits.
+ * GeneratePrivateKey uses open ssl functions to generate an ECDSA private key on the
+ * P-256 curve. Compared to an RSA key of 2048 bits, which offers a similar level of
+ * security, signing the handshake with this key is an order of magnitude cheaper, which
+ * matters for workers that accept many new intra-cluster connections at once.
  * All OpenSSL resources created during the process are added to the memory context active
  * when the function is called and therefore should not be freed by the caller.
  */
@@ -294,26 +298,26 @@ GeneratePrivateKey()
 	EnsureReleaseResource((MemoryContextCallbackFunction) (&EVP_PKEY_free),
 						  privateKey);
 
-	BIGNUM *exponent = BN_new();
-	EnsureReleaseResource((MemoryContextCallbackFunction) (&BN_free), exponent);
-
-	/* load the exponent to use for the generation of the key */
-	int success = BN_set_word(exponent, RSA_F4);
-	if (success != 1)
+	EC_KEY *ecKey = EC_KEY_new_by_curve_name(NID_X9_62_prime256v1);
+	if (!ecKey)
 	{
-		ereport(ERROR, (errmsg("unable to prepare exponent for RSA algorithm")));
+		ereport(ERROR, (errmsg("unable to prepare curve for ECDSA algorithm")));
 	}
 
-	RSA *rsa = RSA_new();
-	success = RSA_generate_key_ex(rsa, 2048, exponent, NULL);
+	/* store the curve by name, clients only accept named curves */
+	EC_KEY_set_asn1_flag(ecKey, OPENSSL_EC_NAMED_CURVE);
+
+	int success = EC_KEY_generate_key(ecKey);
 	if (success != 1)
 	{
-		ereport(ERROR, (errmsg("unable to generate RSA key")));
+		EC_KEY_free(ecKey);
+		ereport(ERROR, (errmsg("unable to generate ECDSA key")));
 	}
 
-	if (!EVP_PKEY_assign_RSA(privateKey, rsa))
+	if (!EVP_PKEY_assign_EC_KEY(privateKey, ecKey))
 	{
-		ereport(ERROR, (errmsg("unable to assign RSA key to use as private key")));
+		EC_KEY_free(ecKey);
+		ereport(ERROR, (errmsg("unable to assign ECDSA key to use as private key")));
 	}
 
 	/* The key has been generated, return it. */
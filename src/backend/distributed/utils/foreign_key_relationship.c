@@ -41,6 +41,9 @@ typedef struct ForeignConstraintRelationshipGraph
 {
 	HTAB *nodeMap;
 	bool isValid;
+
+	/* context that holds the graph, the nodes and the cached relation id lists */
+	MemoryContext memoryContext;
 }ForeignConstraintRelationshipGraph;
 
 /*
@@ -49,6 +52,11 @@ typedef struct ForeignConstraintRelationshipGraph
  * information for that node in the latest DFS and the list of adjacency nodes.
  * Note that we also hold back adjacency nodes for getting referenced node over
  * that one.
+ *
+ * The relations that are transitively referenced by and referencing the node
+ * are computed on the first request and kept until the graph is invalidated,
+ * since the relation cache asks for them whenever a distributed table is
+ * invalidated, which usually happens without any foreign key change.
  */
 typedef struct ForeignConstraintRelationshipNode
 {
@@ -56,6 +64,11 @@ typedef struct ForeignConstraintRelationshipNode
 	bool visited;
 	List *adjacencyList;
 	List *backAdjacencyList;
+
+	bool referencedRelationIdListValid;
+	List *referencedRelationIdList;
+	bool referencingRelationIdListValid;
+	List *referencingRelationIdList;
 }ForeignConstraintRelationshipNode;
 
 
@@ -120,6 +133,9 @@ ReferencingRelationIdList(Oid relationId)
  * GetForeignConstraintRelationshipHelper returns the list of oids referenced or
  * referencing given relation id. It is a helper function for providing results
  * to public functions ReferencedRelationIdList and ReferencingRelationIdList.
+ *
+ * The list is allocated in the current memory context, and is copied from the
+ * list cached in the node of the relation once it has been computed.
  */
 static List *
 GetForeignConstraintRelationshipHelper(Oid relationId, bool isReferencing)
@@ -127,6 +143,8 @@ GetForeignConstraintRelationshipHelper(Oid relationId, bool isReferencing)
 	List *foreignConstraintList = NIL;
 	List *foreignNodeList = NIL;
 	bool isFound = false;
+	List **cachedRelationIdList = NULL;
+	bool *cachedRelationIdListValid = NULL;
 
 	CreateForeignConstraintRelationshipGraph();
 
@@ -144,6 +162,25 @@ GetForeignConstraintRelationshipHelper(Oid relationId, bool isReferencing)
 		return NIL;
 	}
 
+	if (isReferencing)
+	{
+		cachedRelationIdList = &relationNode->referencingRelationIdList;
+		cachedRelationIdListValid = &relationNode->referencingRelationIdListValid;
+	}
+	else
+	{
+		cachedRelationIdList = &relationNode->referencedRelationIdList;
+		cachedRelationIdListValid = &relationNode->referencedRelationIdListValid;
+	}
+
+	if (*cachedRelationIdListValid)
+	{
+		return list_copy(*cachedRelationIdList);
+	}
+
+	MemoryContext oldContext =
+		MemoryContextSwitchTo(fConstraintRelationshipGraph->memoryContext);
+
 	GetConnectedListHelper(relationNode, &foreignNodeList, isReferencing);
 
 	/*
@@ -161,7 +198,14 @@ GetForeignConstraintRelationshipHelper(Oid relationId, bool isReferencing)
 	/* set to false separately, since we don't add itself to foreign node list */
 	relationNode->visited = false;
 
-	return foreignConstraintList;
+	list_free(foreignNodeList);
+
+	*cachedRelationIdList = foreignConstraintList;
+	*cachedRelationIdListValid = true;
+
+	MemoryContextSwitchTo(oldContext);
+
+	return list_copy(foreignConstraintList);
 }
 
 
@@ -195,6 +239,7 @@ CreateForeignConstraintRelationshipGraph()
 	fConstraintRelationshipGraph = (ForeignConstraintRelationshipGraph *) palloc(
 		sizeof(ForeignConstraintRelationshipGraph));
 	fConstraintRelationshipGraph->isValid = false;
+	fConstraintRelationshipGraph->memoryContext = fConstraintRelationshipMemoryContext;
 
 	/* create (oid) -> [ForeignConstraintRelationshipNode] hash */
 	memset(&info, 0, sizeof(info));
@@ -411,6 +456,10 @@ CreateOrFindNode(HTAB *adjacencyLists, Oid relid)
 		node->adjacencyList = NIL;
 		node->backAdjacencyList = NIL;
 		node->visited = false;
+		node->referencedRelationIdListValid = false;
+		node->referencedRelationIdList = NIL;
+		node->referencingRelationIdListValid = false;
+		node->referencingRelationIdList = NIL;
 	}
 
 	return node;
@@ -420,8 +469,8 @@ CreateOrFindNode(HTAB *adjacencyLists, Oid relid)
 /*
  * ClearForeignConstraintRelationshipGraphContext clear all the allocated memory obtained
  * for foreign constraint relationship graph. Since all the variables of relationship
- * graph was obtained within the same context, destroying hash map is enough as
- * it deletes the context.
+ * graph, including the hash map and the cached relation id lists, was obtained
+ * within the same context, deleting that context is enough.
  */
 void
 ClearForeignConstraintRelationshipGraphContext()
@@ -431,6 +480,6 @@ ClearForeignConstraintRelationshipGraphContext()
 		return;
 	}
 
-	hash_destroy(fConstraintRelationshipGraph->nodeMap);
+	MemoryContextDelete(fConstraintRelationshipGraph->memoryContext);
 	fConstraintRelationshipGraph = NULL;
 }
@@ -0,0 +1,684 @@
+/*-------------------------------------------------------------------------
+ *
+ * job_cache_space.c
+ *	  Placement and size limits of the files in the job cache directory.
+ *
+ * Repartition jobs and intermediate results write their files to directories
+ * under base/pgsql_job_cache, which shares its device with the heap and the
+ * WAL. When citus.job_cache_directories lists other locations, we create each
+ * new job and intermediate results directory on the next location in turn,
+ * and put a symbolic link to it in base/pgsql_job_cache. All file names that
+ * nodes exchange therefore stay the same, and files of different jobs are
+ * spread over the devices of the locations.
+ *
+ * citus.max_job_cache_size limits the space that the job cache uses on a
+ * node. We measure it when a task or a transaction starts writing to the job
+ * cache, so a query fails early when the node is already full, and then count
+ * the bytes that the backend writes on top of the measurement.
+ *
+ * Directories whose owner went away without removing them, for instance
+ * because a node crashed, are removed by the maintenance daemon every
+ * citus.job_cache_cleanup_interval. An intermediate results directory is
+ * orphaned when no backend on the node takes part in its distributed
+ * transaction, or when its process is gone. The owner of a repartition job
+ * directory is a backend on another node, so those are orphaned when they
+ * were not modified for citus.orphaned_job_directory_age.
+ *
+ * Copyright (c) Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include "postgres.h"
+#include "funcapi.h"
+#include "miscadmin.h"
+
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "access/htup_details.h"
+#include "distributed/backend_data.h"
+#include "distributed/job_cache_space.h"
+#include "distributed/listutils.h"
+#include "distributed/metadata_cache.h"
+#include "distributed/transmit.h"
+#include "distributed/worker_protocol.h"
+#include "postmaster/postmaster.h"
+#include "storage/fd.h"
+#include "storage/proc.h"
+#include "storage/procarray.h"
+#include "utils/builtins.h"
+#include "utils/varlena.h"
+
+
+/* directory on a location that holds the job cache directories we place there */
+#define JOB_CACHE_LOCATION_DIR_FORMAT "%s/" PG_JOB_CACHE_DIR ".%d"
+
+/*
+ * Intermediate results directories that were modified more recently are never
+ * orphaned, since their transaction number may just have been reused after a
+ * restart of the node that started the transaction.
+ */
+#define ORPHANED_RESULTS_DIRECTORY_MIN_AGE_SECONDS 60
+
+#define CITUS_JOB_CACHE_SIZE_COLUMN_COUNT 4
+
+
+/*
+ * JobCacheUsage is the space used by the directories in the job cache, as
+ * measured by ScanJobCache.
+ */
+typedef struct JobCacheUsage
+{
+	uint64 totalBytes;
+	uint64 orphanedBytes;
+	int directoryCount;
+	int orphanedDirectoryCount;
+} JobCacheUsage;
+
+
+/* Config variables managed via guc.c */
+char *JobCacheDirectories = "";
+int MaxJobCacheSize = -1;
+int JobCacheCleanupInterval = 300000;
+int OrphanedJobDirectoryAge = 86400;
+
+/* location on which we place the next job cache directory */
+static int NextJobCacheLocationIndex = -1;
+
+/*
+ * Job cache size at the last check, the bytes this backend wrote since, and the
+ * transaction in which we checked.
+ */
+static uint64 JobCacheSizeAtCheck = 0;
+static uint64 JobCacheBytesWritten = 0;
+static LocalTransactionId JobCacheCheckTransactionId = InvalidLocalTransactionId;
+
+
+static char * NextJobCacheLocation(void);
+static bool JobCacheLocationElement(const char *filename);
+static uint64 DirectorySize(const char *directoryName);
+static uint64 JobCacheSizeLimit(void);
+static void ScanJobCache(bool removeOrphanedDirectories, JobCacheUsage *usage);
+static bool JobCacheDirectoryIsOrphaned(const char *baseFilename,
+										struct stat *fileStat,
+										List *activeTransactionIdList);
+static bool DistributedTransactionIdInList(List *transactionIdList,
+										   int initiatorNodeIdentifier,
+										   uint64 transactionNumber);
+
+
+PG_FUNCTION_INFO_V1(citus_job_cache_size);
+
+
+/*
+ * JobCacheDirectoryList parses the given comma-separated list of directories,
+ * and returns the list of their canonical paths. The function returns NIL if
+ * the list is malformed.
+ */
+List *
+JobCacheDirectoryList(const char *directoriesString)
+{
+	List *directoryList = NIL;
+
+	if (directoriesString == NULL)
+	{
+		return NIL;
+	}
+
+	char *rawString = pstrdup(directoriesString);
+	if (!SplitDirectoriesString(rawString, ',', &directoryList))
+	{
+		return NIL;
+	}
+
+	return directoryList;
+}
+
+
+/*
+ * CreateJobCacheDirectory creates the given directory in the job cache. If
+ * citus.job_cache_directories is set, the function creates the directory on
+ * the next of its locations, and the given directory as a symbolic link to it.
+ *
+ * If existsOk is true, the function returns false when the directory already
+ * exists instead of erroring out.
+ */
+bool
+CreateJobCacheDirectory(const char *directoryName, bool existsOk)
+{
+	char *location = NextJobCacheLocation();
+
+	if (location == NULL)
+	{
+		if (mkdir(directoryName, S_IRWXU) != 0)
+		{
+			if (errno == EEXIST && existsOk)
+			{
+				return false;
+			}
+
+			ereport(ERROR, (errcode_for_file_access(),
+							errmsg("could not create directory \"%s\": %m",
+								   directoryName)));
+		}
+
+		return true;
+	}
+
+	StringInfo locationDirectoryName = makeStringInfo();
+	appendStringInfo(locationDirectoryName, JOB_CACHE_LOCATION_DIR_FORMAT, location,
+					 PostPortNumber);
+
+	if (mkdir(locationDirectoryName->data, S_IRWXU) != 0 && errno != EEXIST)
+	{
+		ereport(ERROR, (errcode_for_file_access(),
+						errmsg("could not create directory \"%s\": %m",
+							   locationDirectoryName->data)));
+	}
+
+	/* the target is named after the link, which is unique within the cache */
+	StringInfo targetDirectoryName = makeStringInfo();
+	appendStringInfo(targetDirectoryName, "%s/%s", locationDirectoryName->data,
+					 last_dir_separator(directoryName) != NULL ?
+					 last_dir_separator(directoryName) + 1 : directoryName);
+
+	if (mkdir(targetDirectoryName->data, S_IRWXU) != 0 && errno != EEXIST)
+	{
+		ereport(ERROR, (errcode_for_file_access(),
+						errmsg("could not create directory \"%s\": %m",
+							   targetDirectoryName->data)));
+	}
+
+	if (symlink(targetDirectoryName->data, directoryName) != 0)
+	{
+		int linkErrno = errno;
+
+		if (linkErrno == EEXIST && existsOk)
+		{
+			/* someone else created the directory, it owns the target */
+			return false;
+		}
+
+		rmdir(targetDirectoryName->data);
+
+		errno = linkErrno;
+		ereport(ERROR, (errcode_for_file_access(),
+						errmsg("could not create symbolic link \"%s\": %m",
+							   directoryName)));
+	}
+
+	return true;
+}
+
+
+/*
+ * RemoveJobCacheDirectoryLink removes the given symbolic link from the job
+ * cache. If the link points to a directory that CreateJobCacheDirectory placed
+ * on a location, the function removes that directory as well.
+ */
+void
+RemoveJobCacheDirectoryLink(const char *linkName)
+{
+	char targetName[MAXPGPATH];
+
+	int targetLength = readlink(linkName, targetName, sizeof(targetName) - 1);
+	if (targetLength >= 0)
+	{
+		targetName[targetLength] = '\0';
+
+		if (JobCacheLocationElement(targetName))
+		{
+			CitusRemoveDirectory(targetName);
+		}
+	}
+
+	if (unlink(linkName) != 0 && errno != ENOENT)
+	{
+		ereport(ERROR, (errcode_for_file_access(),
+						errmsg("could not remove file \"%s\": %m", linkName)));
+	}
+}
+
+
+/*
+ * RemoveJobCacheLocations removes the job cache directories of this node from
+ * all locations in citus.job_cache_directories. We call it on start-up along
+ * with emptying base/pgsql_job_cache, which removes only the directories that
+ * still have a link.
+ */
+void
+RemoveJobCacheLocations(void)
+{
+	List *locationList = JobCacheDirectoryList(JobCacheDirectories);
+	StringInfo locationDirectoryName = makeStringInfo();
+
+	ListCell *locationCell = NULL;
+	foreach(locationCell, locationList)
+	{
+		char *location = (char *) lfirst(locationCell);
+
+		resetStringInfo(locationDirectoryName);
+		appendStringInfo(locationDirectoryName, JOB_CACHE_LOCATION_DIR_FORMAT,
+						 location, PostPortNumber);
+
+		CitusRemoveDirectory(locationDirectoryName->data);
+	}
+
+	FreeStringInfo(locationDirectoryName);
+}
+
+
+/*
+ * CheckJobCacheSpace measures the space that the job cache uses on this node,
+ * and errors out if it already exceeds citus.max_job_cache_size. Callers call
+ * this before they start writing files to the job cache, and report the bytes
+ * they write through ReserveJobCacheSpace.
+ */
+void
+CheckJobCacheSpace(void)
+{
+	if (MaxJobCacheSize < 0)
+	{
+		return;
+	}
+
+	JobCacheSizeAtCheck = DirectorySize("base/" PG_JOB_CACHE_DIR);
+	JobCacheBytesWritten = 0;
+	JobCacheCheckTransactionId = MyProc->lxid;
+
+	if (JobCacheSizeAtCheck >= JobCacheSizeLimit())
+	{
+		ereport(ERROR, (errcode(ERRCODE_CONFIGURATION_LIMIT_EXCEEDED),
+						errmsg("job cache size exceeds citus.max_job_cache_size "
+							   "(%dkB)", MaxJobCacheSize)));
+	}
+}
+
+
+/*
+ * ReserveJobCacheSpace accounts for the given number of bytes that we are
+ * about to write to the job cache, and errors out if the job cache would then
+ * exceed citus.max_job_cache_size. Other backends may have written to the job
+ * cache since the last check, so we measure it again in every transaction.
+ */
+void
+ReserveJobCacheSpace(uint64 byteCount)
+{
+	if (MaxJobCacheSize < 0)
+	{
+		return;
+	}
+
+	if (JobCacheCheckTransactionId != MyProc->lxid)
+	{
+		CheckJobCacheSpace();
+	}
+
+	JobCacheBytesWritten += byteCount;
+
+	if (JobCacheSizeAtCheck + JobCacheBytesWritten > JobCacheSizeLimit())
+	{
+		ereport(ERROR, (errcode(ERRCODE_CONFIGURATION_LIMIT_EXCEEDED),
+						errmsg("job cache size exceeds citus.max_job_cache_size "
+							   "(%dkB)", MaxJobCacheSize)));
+	}
+}
+
+
+/*
+ * RemoveOrphanedJobCacheDirectories removes the directories in the job cache
+ * whose owner is gone, and logs the space that was reclaimed.
+ */
+void
+RemoveOrphanedJobCacheDirectories(void)
+{
+	JobCacheUsage usage;
+	bool removeOrphanedDirectories = true;
+
+	ScanJobCache(removeOrphanedDirectories, &usage);
+
+	if (usage.orphanedDirectoryCount > 0)
+	{
+		ereport(LOG, (errmsg("removed %d orphaned job cache directories, "
+							 "reclaiming " UINT64_FORMAT " bytes",
+							 usage.orphanedDirectoryCount, usage.orphanedBytes)));
+	}
+}
+
+
+/*
+ * citus_job_cache_size returns the space that the job cache uses on this
+ * node, and how much of it belongs to orphaned directories that the
+ * maintenance daemon removes at its next cleanup.
+ */
+Datum
+citus_job_cache_size(PG_FUNCTION_ARGS)
+{
+	TupleDesc tupleDescriptor = NULL;
+	Datum values[CITUS_JOB_CACHE_SIZE_COLUMN_COUNT];
+	bool isNulls[CITUS_JOB_CACHE_SIZE_COLUMN_COUNT];
+	JobCacheUsage usage;
+	bool removeOrphanedDirectories = false;
+
+	CheckCitusVersion(ERROR);
+
+	if (get_call_result_type(fcinfo, NULL, &tupleDescriptor) != TYPEFUNC_COMPOSITE)
+	{
+		elog(ERROR, "return type must be a row type");
+	}
+
+	ScanJobCache(removeOrphanedDirectories, &usage);
+
+	memset(values, 0, sizeof(values));
+	memset(isNulls, false, sizeof(isNulls));
+
+	values[0] = UInt64GetDatum(usage.totalBytes);
+	values[1] = UInt64GetDatum(usage.orphanedBytes);
+	values[2] = Int32GetDatum(usage.directoryCount);
+	values[3] = Int32GetDatum(usage.orphanedDirectoryCount);
+
+	HeapTuple heapTuple = heap_form_tuple(tupleDescriptor, values, isNulls);
+
+	PG_RETURN_DATUM(HeapTupleGetDatum(heapTuple));
+}
+
+
+/*
+ * ScanJobCache measures the directories in base/pgsql_job_cache and, if
+ * removeOrphanedDirectories is true, removes the orphaned ones. Files
+ * directly in the job cache are counted, but never removed.
+ */
+static void
+ScanJobCache(bool removeOrphanedDirectories, JobCacheUsage *usage)
+{
+	const char *jobCacheDirectoryName = "base/" PG_JOB_CACHE_DIR;
+
+	memset(usage, 0, sizeof(JobCacheUsage));
+
+	/* take the ids before listing, directories created afterwards are newer */
+	List *activeTransactionIdList = ActiveDistributedTransactionIds();
+
+	DIR *jobCacheDirectory = AllocateDir(jobCacheDirectoryName);
+	if (jobCacheDirectory == NULL)
+	{
+		if (errno == ENOENT)
+		{
+			return;
+		}
+
+		ereport(ERROR, (errcode_for_file_access(),
+						errmsg("could not open directory \"%s\": %m",
+							   jobCacheDirectoryName)));
+	}
+
+	StringInfo fullFilename = makeStringInfo();
+	struct dirent *directoryEntry = NULL;
+	while ((directoryEntry = ReadDir(jobCacheDirectory,
+									 jobCacheDirectoryName)) != NULL)
+	{
+		const char *baseFilename = directoryEntry->d_name;
+		struct stat fileStat;
+		struct stat linkStat;
+
+		if (strncmp(baseFilename, ".", MAXPGPATH) == 0 ||
+			strncmp(baseFilename, "..", MAXPGPATH) == 0)
+		{
+			continue;
+		}
+
+		resetStringInfo(fullFilename);
+		appendStringInfo(fullFilename, "%s/%s", jobCacheDirectoryName, baseFilename);
+
+		if (stat(fullFilename->data, &fileStat) != 0 ||
+			lstat(fullFilename->data, &linkStat) != 0)
+		{
+			/* removed while we walk the directory */
+			continue;
+		}
+
+		if (!S_ISDIR(fileStat.st_mode))
+		{
+			usage->totalBytes += fileStat.st_size;
+			continue;
+		}
+
+		uint64 directorySize = DirectorySize(fullFilename->data);
+
+		usage->totalBytes += directorySize;
+		usage->directoryCount++;
+
+		if (!JobCacheDirectoryIsOrphaned(baseFilename, &fileStat,
+										 activeTransactionIdList))
+		{
+			continue;
+		}
+
+		usage->orphanedBytes += directorySize;
+		usage->orphanedDirectoryCount++;
+
+		if (!removeOrphanedDirectories)
+		{
+			continue;
+		}
+
+		if (S_ISLNK(linkStat.st_mode))
+		{
+			RemoveJobCacheDirectoryLink(fullFilename->data);
+		}
+		else
+		{
+			CitusRemoveDirectory(fullFilename->data);
+		}
+	}
+
+	FreeStringInfo(fullFilename);
+	FreeDir(jobCacheDirectory);
+}
+
+
+/*
+ * JobCacheDirectoryIsOrphaned returns whether the job cache directory with
+ * the given name and status was left behind by its owner. The names are
+ * those of IntermediateResultsDirectory and the repartition job directories.
+ */
+static bool
+JobCacheDirectoryIsOrphaned(const char *baseFilename, struct stat *fileStat,
+							List *activeTransactionIdList)
+{
+	Oid userId = InvalidOid;
+	int initiatorNodeIdentifier = 0;
+	uint64 transactionNumber = 0;
+	int processId = 0;
+	int parsedLength = 0;
+	int baseFilenameLength = strlen(baseFilename);
+	double directoryAge = difftime(time(NULL), fileStat->st_mtime);
+
+	if (sscanf(baseFilename, "%u_%d_" UINT64_FORMAT "%n", &userId,
+			   &initiatorNodeIdentifier, &transactionNumber, &parsedLength) == 3 &&
+		parsedLength == baseFilenameLength)
+	{
+		/* <user id>_<coordinator node id>_<transaction number> */
+		return directoryAge >= ORPHANED_RESULTS_DIRECTORY_MIN_AGE_SECONDS &&
+			   !DistributedTransactionIdInList(activeTransactionIdList,
+											   initiatorNodeIdentifier,
+											   transactionNumber);
+	}
+
+	if (sscanf(baseFilename, "%u_%d%n", &userId, &processId, &parsedLength) == 2 &&
+		parsedLength == baseFilenameLength)
+	{
+		/* <user id>_<process id> */
+		return directoryAge >= ORPHANED_RESULTS_DIRECTORY_MIN_AGE_SECONDS &&
+			   BackendPidGetProc(processId) == NULL;
+	}
+
+	if (strncmp(baseFilename, JOB_DIRECTORY_PREFIX,
+				strlen(JOB_DIRECTORY_PREFIX)) == 0 ||
+		strncmp(baseFilename, MASTER_JOB_DIRECTORY_PREFIX,
+				strlen(MASTER_JOB_DIRECTORY_PREFIX)) == 0)
+	{
+		return OrphanedJobDirectoryAge >= 0 && directoryAge >= OrphanedJobDirectoryAge;
+	}
+
+	return false;
+}
+
+
+/*
+ * DistributedTransactionIdInList returns whether the given list contains the
+ * distributed transaction with the given initiator and number.
+ */
+static bool
+DistributedTransactionIdInList(List *transactionIdList, int initiatorNodeIdentifier,
+							   uint64 transactionNumber)
+{
+	DistributedTransactionId *transactionId = NULL;
+	foreach_ptr(transactionId, transactionIdList)
+	{
+		if (transactionId->initiatorNodeIdentifier == initiatorNodeIdentifier &&
+			transactionId->transactionNumber == transactionNumber)
+		{
+			return true;
+		}
+	}
+
+	return false;
+}
+
+
+/*
+ * NextJobCacheLocation returns the location in citus.job_cache_directories on
+ * which to place the next job cache directory, or NULL if there is none. Each
+ * backend starts at a different location and then goes round-robin.
+ */
+static char *
+NextJobCacheLocation(void)
+{
+	List *locationList = JobCacheDirectoryList(JobCacheDirectories);
+	int locationCount = list_length(locationList);
+
+	if (locationCount == 0)
+	{
+		return NULL;
+	}
+
+	if (NextJobCacheLocationIndex < 0)
+	{
+		NextJobCacheLocationIndex = MyProcPid;
+	}
+
+	int locationIndex = NextJobCacheLocationIndex % locationCount;
+	NextJobCacheLocationIndex = locationIndex + 1;
+
+	return (char *) list_nth(locationList, locationIndex);
+}
+
+
+/*
+ * JobCacheLocationElement returns whether the given file name lives in the
+ * job cache directory of this node on one of the locations.
+ */
+static bool
+JobCacheLocationElement(const char *filename)
+{
+	List *locationList = JobCacheDirectoryList(JobCacheDirectories);
+	StringInfo locationDirectoryName = makeStringInfo();
+	bool locationElement = false;
+
+	ListCell *locationCell = NULL;
+	foreach(locationCell, locationList)
+	{
+		char *location = (char *) lfirst(locationCell);
+
+		resetStringInfo(locationDirectoryName);
+		appendStringInfo(locationDirectoryName, JOB_CACHE_LOCATION_DIR_FORMAT "/",
+						 location, PostPortNumber);
+
+		if (strncmp(filename, locationDirectoryName->data,
+					locationDirectoryName->len) == 0)
+		{
+			locationElement = true;
+			break;
+		}
+	}
+
+	FreeStringInfo(locationDirectoryName);
+
+	return locationElement;
+}
+
+
+/*
+ * DirectorySize returns the total size of the files in the given directory and
+ * its subdirectories, following the symbolic links to job cache directories on
+ * other locations. Files that are removed while we walk the directory do not
+ * count.
+ */
+static uint64
+DirectorySize(const char *directoryName)
+{
+	uint64 directorySize = 0;
+
+	DIR *directory = AllocateDir(directoryName);
+	if (directory == NULL)
+	{
+		if (errno == ENOENT)
+		{
+			return 0;
+		}
+
+		ereport(ERROR, (errcode_for_file_access(),
+						errmsg("could not open directory \"%s\": %m",
+							   directoryName)));
+	}
+
+	StringInfo fullFilename = makeStringInfo();
+	struct dirent *directoryEntry = NULL;
+	while ((directoryEntry = ReadDir(directory, directoryName)) != NULL)
+	{
+		const char *baseFilename = directoryEntry->d_name;
+		struct stat fileStat;
+
+		if (strncmp(baseFilename, ".", MAXPGPATH) == 0 ||
+			strncmp(baseFilename, "..", MAXPGPATH) == 0)
+		{
+			continue;
+		}
+
+		resetStringInfo(fullFilename);
+		appendStringInfo(fullFilename, "%s/%s", directoryName, baseFilename);
+
+		if (stat(fullFilename->data, &fileStat) != 0)
+		{
+			continue;
+		}
+
+		if (S_ISDIR(fileStat.st_mode))
+		{
+			directorySize += DirectorySize(fullFilename->data);
+		}
+		else
+		{
+			directorySize += fileStat.st_size;
+		}
+	}
+
+	FreeStringInfo(fullFilename);
+	FreeDir(directory);
+
+	return directorySize;
+}
+
+
+/*
+ * JobCacheSizeLimit returns citus.max_job_cache_size in bytes.
+ */
+static uint64
+JobCacheSizeLimit(void)
+{
+	Assert(MaxJobCacheSize >= 0);
+
+	return (uint64) MaxJobCacheSize * 1024;
+}
@@ -9,6 +9,13 @@
  * can then perform work like deadlock detection, prepared transaction
  * recovery, and cleanup.
  *
+ * Jobs that can take long, like prepared transaction recovery, are not run
+ * by the maintenance daemon itself, such that they do not delay deadlock
+ * detection. Instead, the daemon starts a dynamic background worker for each
+ * run of such a job, at most one per job at a time, and terminates it after
+ * citus.background_job_time_limit. The jobs are shown by
+ * citus_background_jobs.
+ *
  * Copyright (c) Citus Data, Inc.
  *
  *-------------------------------------------------------------------------
@@ -31,14 +38,22 @@
 #include "libpq/pqsignal.h"
 #include "catalog/namespace.h"
 #include "distributed/citus_safe_lib.h"
+#include "distributed/cpu_affinity.h"
 #include "distributed/distributed_deadlock_detection.h"
+#include "distributed/job_cache_space.h"
 #include "distributed/maintenanced.h"
 #include "distributed/master_protocol.h"
 #include "distributed/metadata_cache.h"
 #include "distributed/metadata_sync.h"
+#include "distributed/node_health.h"
+#include "distributed/secondary_node_stats.h"
+#include "distributed/shard_statistics.h"
 #include "distributed/statistics_collection.h"
+#include "distributed/time_partitions.h"
 #include "distributed/transaction_recovery.h"
+#include "distributed/tuplestore.h"
 #include "distributed/version_compat.h"
+#include "distributed/wait_sampling.h"
 #include "nodes/makefuncs.h"
 #include "postmaster/bgworker.h"
 #include "postmaster/postmaster.h"
@@ -49,9 +64,76 @@
 #include "storage/lmgr.h"
 #include "storage/lwlock.h"
 #include "tcop/tcopprot.h"
+#include "utils/builtins.h"
 #include "utils/memutils.h"
 #include "utils/lsyscache.h"
 
+
+#define CITUS_BACKGROUND_JOBS_COLUMN_COUNT 8
+
+
+/*
+ * BackgroundJobType enumerates the jobs that the maintenance daemon runs in
+ * dynamic background workers, see BackgroundJobs.
+ */
+typedef enum BackgroundJobType
+{
+	BACKGROUND_JOB_2PC_RECOVERY = 0,
+	BACKGROUND_JOB_SHARD_STATISTICS_REFRESH,
+	BACKGROUND_JOB_TIME_PARTITION_MAINTENANCE,
+	BACKGROUND_JOB_JOB_CACHE_CLEANUP,
+	BACKGROUND_JOB_COUNT
+} BackgroundJobType;
+
+
+/*
+ * BackgroundJob describes a job that the maintenance daemon runs in dynamic
+ * background workers.
+ */
+typedef struct BackgroundJob
+{
+	const char *name;
+
+	/* GUC, milliseconds between the starts of two runs, <= 0 disables the job */
+	int *interval;
+
+	/* whether the job writes, and thus only runs on primaries */
+	bool primaryOnly;
+
+	/* runs the job inside a transaction that holds the extension lock */
+	void (*run)(void);
+} BackgroundJob;
+
+
+/*
+ * BackgroundJobState is the state of a job in a database, in shared memory.
+ */
+typedef struct BackgroundJobState
+{
+	/* process running the job, 0 while the job is not running */
+	pid_t workerPid;
+
+	/* set by the worker when the run completed without an error */
+	bool lastRunSucceeded;
+
+	TimestampTz lastStartTime;
+	TimestampTz lastFinishTime;
+	uint64 runCount;
+	uint64 failureCount;
+} BackgroundJobState;
+
+
+/*
+ * BackgroundJobWorkerArgs is passed to the background worker of a job in
+ * bgw_extra.
+ */
+typedef struct BackgroundJobWorkerArgs
+{
+	Oid databaseOid;
+	Oid userOid;
+} BackgroundJobWorkerArgs;
+
+
 /*
  * Shared memory data for all maintenance workers.
  */
@@ -82,6 +164,9 @@ typedef struct MaintenanceDaemonDBData
 	bool daemonStarted;
 	bool triggerMetadataSync;
 	Latch *latch; /* pointer to the background worker's latch */
+
+	/* state of the jobs run in dynamic background workers */
+	BackgroundJobState jobStates[BACKGROUND_JOB_COUNT];
 } MaintenanceDaemonDBData;
 
 /* config variable for distributed deadlock detection timeout */
@@ -92,6 +177,9 @@ int Recover2PCInterval = 60000;
 int MetadataSyncInterval = 60000;
 int MetadataSyncRetryInterval = 5000;
 
+/* GUC, milliseconds after which a background job is terminated, 0 if never */
+int BackgroundJobTimeLimit = 0;
+
 static shmem_startup_hook_type prev_shmem_startup_hook = NULL;
 static MaintenanceDaemonControlData *MaintenanceDaemonControl = NULL;
 
@@ -111,6 +199,35 @@ static void MaintenanceDaemonShmemInit(void);
 static void MaintenanceDaemonErrorContext(void *arg);
 static bool LockCitusExtension(void);
 static bool MetadataSyncTriggeredCheckAndReset(MaintenanceDaemonDBData *dbData);
+static double ScheduleBackgroundJobs(MaintenanceDaemonDBData *myDbData,
+									 BackgroundWorkerHandle **jobHandles,
+									 double timeout);
+static bool StartBackgroundJob(MaintenanceDaemonDBData *myDbData,
+							   BackgroundJobType jobType,
+							   BackgroundWorkerHandle **jobHandle);
+static void FinishBackgroundJob(MaintenanceDaemonDBData *myDbData,
+								BackgroundJobType jobType);
+static void RunBackgroundJob(const BackgroundJob *job);
+static void BackgroundJobErrorContext(void *arg);
+static void RunTwoPhaseCommitRecoveryJob(void);
+
+
+/*
+ * BackgroundJobs contains the jobs that the maintenance daemon runs in dynamic
+ * background workers, indexed by BackgroundJobType.
+ */
+static const BackgroundJob BackgroundJobs[BACKGROUND_JOB_COUNT] = {
+	{ "2PC recovery", &Recover2PCInterval, true, RunTwoPhaseCommitRecoveryJob },
+	{ "shard statistics refresh", &ShardStatisticsRefreshInterval, true,
+	  RefreshShardStatistics },
+	{ "time partition maintenance", &TimePartitionMaintenanceInterval, true,
+	  MaintainTimePartitions },
+	{ "job cache cleanup", &JobCacheCleanupInterval, false,
+	  RemoveOrphanedJobCacheDirectories }
+};
+
+
+PG_FUNCTION_INFO_V1(citus_background_jobs);
 
 
 /*
@@ -193,8 +310,7 @@ InitializeMaintenanceDaemonBackend(void)
 				 "CitusMaintenanceDaemonMain");
 
 		worker.bgw_main_arg = ObjectIdGetDatum(MyDatabaseId);
-		memcpy_s(worker.bgw_extra, sizeof(worker.bgw_extra), &extensionOwner,
-				 sizeof(Oid));
+		memcpy_struct(worker.bgw_extra, extensionOwner);
 		worker.bgw_notify_pid = MyProcPid;
 
 		if (!RegisterDynamicBackgroundWorker(&worker, &handle))
@@ -206,6 +322,7 @@ InitializeMaintenanceDaemonBackend(void)
 		dbData->daemonStarted = true;
 		dbData->workerPid = 0;
 		dbData->triggerMetadataSync = false;
+		memset(dbData->jobStates, 0, sizeof(dbData->jobStates));
 		LWLockRelease(&MaintenanceDaemonControl->lock);
 
 		pid_t pid;
@@ -247,8 +364,13 @@ CitusMaintenanceDaemonMain(Datum main_arg)
 		TimestampTzPlusMilliseconds(GetCurrentTimestamp(), 60 * 1000);
 	bool retryStatsCollection USED_WITH_LIBCURL_ONLY = false;
 	ErrorContextCallback errorCallback;
-	TimestampTz lastRecoveryTime = 0;
 	TimestampTz nextMetadataSyncTime = 0;
+	TimestampTz lastWaitSamplingTime = 0;
+	TimestampTz lastSecondaryCheckTime = 0;
+	TimestampTz lastHeartbeatTime = 0;
+	BackgroundWorkerHandle *jobHandles[BACKGROUND_JOB_COUNT];
+
+	memset(jobHandles, 0, sizeof(jobHandles));
 
 	/*
 	 * Look up this worker's configuration.
@@ -316,6 +438,9 @@ CitusMaintenanceDaemonMain(Datum main_arg)
 
 		Assert(myDbData->workerPid == MyProcPid);
 
+		/* follows changes of citus.maintenance_daemon_cpu_affinity on reload */
+		ApplyCpuAffinity(MaintenanceDaemonCpuAffinity);
+
 		/*
 		 * XXX: Each task should clear the metadata cache before every iteration
 		 * by calling InvalidateMetadataSystemCache(), because otherwise it
@@ -431,45 +556,85 @@ CitusMaintenanceDaemonMain(Datum main_arg)
 		}
 
 		/*
-		 * If enabled, run 2PC recovery on primary nodes (where !RecoveryInProgress()),
-		 * since we'll write to the pg_dist_transaction log.
+		 * Start the jobs that are due in background workers, such as 2PC
+		 * recovery, and terminate the ones that ran for too long.
+		 */
+		timeout = ScheduleBackgroundJobs(myDbData, jobHandles, timeout);
+
+		/*
+		 * Sampling wait events only reads shared memory, so it does not need
+		 * a transaction or the extension lock.
 		 */
-		if (Recover2PCInterval > 0 && !RecoveryInProgress() &&
-			TimestampDifferenceExceeds(lastRecoveryTime, GetCurrentTimestamp(),
-									   Recover2PCInterval))
+		if (WaitSamplingInterval > 0)
 		{
-			int recoveredTransactionCount = 0;
+			if (TimestampDifferenceExceeds(lastWaitSamplingTime, GetCurrentTimestamp(),
+										   WaitSamplingInterval))
+			{
+				lastWaitSamplingTime = GetCurrentTimestamp();
 
+				SampleCitusWaitStates();
+			}
+
+			/* make sure we don't wait too long */
+			timeout = Min(timeout, WaitSamplingInterval);
+		}
+
+		/*
+		 * Check the replication lag of the secondaries, such that reads can be
+		 * routed to the ones within citus.max_secondary_replication_lag.
+		 */
+		if (SecondaryNodeCheckInterval > 0 &&
+			TimestampDifferenceExceeds(lastSecondaryCheckTime, GetCurrentTimestamp(),
+									   SecondaryNodeCheckInterval))
+		{
 			InvalidateMetadataSystemCache();
 			StartTransactionCommand();
 
 			if (!LockCitusExtension())
 			{
 				ereport(DEBUG1, (errmsg("could not lock the citus extension, "
-										"skipping 2PC recovery")));
+										"skipping the check of secondary nodes")));
 			}
 			else if (CheckCitusVersion(DEBUG1) && CitusHasBeenLoaded())
 			{
-				/*
-				 * Record last recovery time at start to ensure we run once per
-				 * Recover2PCInterval even if RecoverTwoPhaseCommits takes some time.
-				 */
-				lastRecoveryTime = GetCurrentTimestamp();
+				lastSecondaryCheckTime = GetCurrentTimestamp();
 
-				recoveredTransactionCount = RecoverTwoPhaseCommits();
+				CheckSecondaryNodes();
 			}
 
 			CommitTransactionCommand();
 
-			if (recoveredTransactionCount > 0)
+			/* make sure we don't wait too long */
+			timeout = Min(timeout, SecondaryNodeCheckInterval);
+		}
+
+		/*
+		 * Check which nodes are down, such that queries do not wait for
+		 * connections to them in every backend.
+		 */
+		if (NodeHeartbeatInterval > 0 &&
+			TimestampDifferenceExceeds(lastHeartbeatTime, GetCurrentTimestamp(),
+									   NodeHeartbeatInterval))
+		{
+			InvalidateMetadataSystemCache();
+			StartTransactionCommand();
+
+			if (!LockCitusExtension())
 			{
-				ereport(LOG, (errmsg("maintenance daemon recovered %d distributed "
-									 "transactions",
-									 recoveredTransactionCount)));
+				ereport(DEBUG1, (errmsg("could not lock the citus extension, "
+										"skipping the node heartbeat")));
 			}
+			else if (CheckCitusVersion(DEBUG1) && CitusHasBeenLoaded())
+			{
+				lastHeartbeatTime = GetCurrentTimestamp();
+
+				CheckNodeHealth();
+			}
+
+			CommitTransactionCommand();
 
 			/* make sure we don't wait too long */
-			timeout = Min(timeout, Recover2PCInterval);
+			timeout = Min(timeout, NodeHeartbeatInterval);
 		}
 
 		/* the config value -1 disables the distributed deadlock detection  */
@@ -496,7 +661,11 @@ CitusMaintenanceDaemonMain(Datum main_arg)
 			}
 			else if (CheckCitusVersion(DEBUG1) && CitusHasBeenLoaded())
 			{
-				foundDeadlock = CheckForDistributedDeadlocks();
+				/*
+				 * Like the local deadlock detector, only consider waits that
+				 * could have lasted deadlock_timeout.
+				 */
+				foundDeadlock = CheckForDistributedDeadlocks(DeadlockTimeout);
 			}
 
 			CommitTransactionCommand();
@@ -735,6 +904,9 @@ StopMaintenanceDaemon(Oid databaseId)
 {
 	bool found = false;
 	pid_t workerPid = 0;
+	pid_t jobWorkerPids[BACKGROUND_JOB_COUNT];
+
+	memset(jobWorkerPids, 0, sizeof(jobWorkerPids));
 
 	LWLockAcquire(&MaintenanceDaemonControl->lock, LW_EXCLUSIVE);
 
@@ -746,6 +918,11 @@ StopMaintenanceDaemon(Oid databaseId)
 	if (found)
 	{
 		workerPid = dbData->workerPid;
+
+		for (int jobType = 0; jobType < BACKGROUND_JOB_COUNT; jobType++)
+		{
+			jobWorkerPids[jobType] = dbData->jobStates[jobType].workerPid;
+		}
 	}
 
 	LWLockRelease(&MaintenanceDaemonControl->lock);
@@ -754,6 +931,15 @@ StopMaintenanceDaemon(Oid databaseId)
 	{
 		kill(workerPid, SIGTERM);
 	}
+
+	/* the background jobs are connected to the database as well */
+	for (int jobType = 0; jobType < BACKGROUND_JOB_COUNT; jobType++)
+	{
+		if (jobWorkerPids[jobType] > 0)
+		{
+			kill(jobWorkerPids[jobType], SIGTERM);
+		}
+	}
 }
 
 
@@ -800,3 +986,372 @@ MetadataSyncTriggeredCheckAndReset(MaintenanceDaemonDBData *dbData)
 
 	return metadataSyncTriggered;
 }
+
+
+/*
+ * ScheduleBackgroundJobs starts a background worker for each job that is due
+ * and not running, and terminates the workers that ran for longer than
+ * citus.background_job_time_limit. The function returns the given timeout,
+ * lowered to the time until the next job is due.
+ *
+ * The background workers notify the maintenance daemon when they exit, so
+ * finished jobs are noticed as soon as the daemon wakes up.
+ */
+static double
+ScheduleBackgroundJobs(MaintenanceDaemonDBData *myDbData,
+					   BackgroundWorkerHandle **jobHandles, double timeout)
+{
+	for (int jobType = 0; jobType < BACKGROUND_JOB_COUNT; jobType++)
+	{
+		const BackgroundJob *job = &BackgroundJobs[jobType];
+		BackgroundJobState *jobState = &myDbData->jobStates[jobType];
+		int jobInterval = *job->interval;
+
+		if (jobHandles[jobType] != NULL)
+		{
+			pid_t jobWorkerPid = 0;
+
+			BgwHandleStatus status = GetBackgroundWorkerPid(jobHandles[jobType],
+															&jobWorkerPid);
+			if (status == BGWH_STOPPED)
+			{
+				FinishBackgroundJob(myDbData, jobType);
+
+				pfree(jobHandles[jobType]);
+				jobHandles[jobType] = NULL;
+			}
+			else
+			{
+				if (BackgroundJobTimeLimit > 0 &&
+					TimestampDifferenceExceeds(jobState->lastStartTime,
+											   GetCurrentTimestamp(),
+											   BackgroundJobTimeLimit))
+				{
+					ereport(LOG, (errmsg("terminating the %s job, which ran for "
+										 "more than %d ms", job->name,
+										 BackgroundJobTimeLimit)));
+
+					TerminateBackgroundWorker(jobHandles[jobType]);
+				}
+
+				if (BackgroundJobTimeLimit > 0)
+				{
+					/* make sure we notice when the job runs for too long */
+					timeout = Min(timeout, BackgroundJobTimeLimit);
+				}
+
+				continue;
+			}
+		}
+
+		if (jobInterval <= 0 || (job->primaryOnly && RecoveryInProgress()))
+		{
+			continue;
+		}
+
+		if (TimestampDifferenceExceeds(jobState->lastStartTime, GetCurrentTimestamp(),
+									   jobInterval))
+		{
+			if (!StartBackgroundJob(myDbData, jobType, &jobHandles[jobType]))
+			{
+				/* no background worker slot left, run the job ourselves */
+				RunBackgroundJob(job);
+
+				LWLockAcquire(&MaintenanceDaemonControl->lock, LW_EXCLUSIVE);
+				jobState->lastRunSucceeded = true;
+				LWLockRelease(&MaintenanceDaemonControl->lock);
+
+				FinishBackgroundJob(myDbData, jobType);
+			}
+		}
+
+		/* make sure we don't wait too long */
+		timeout = Min(timeout, jobInterval);
+	}
+
+	return timeout;
+}
+
+
+/*
+ * StartBackgroundJob registers a dynamic background worker that runs the
+ * given job, and records the start of the run. The function returns false
+ * if no background worker slot is left, in which case the start is recorded
+ * as well.
+ */
+static bool
+StartBackgroundJob(MaintenanceDaemonDBData *myDbData, BackgroundJobType jobType,
+				   BackgroundWorkerHandle **jobHandle)
+{
+	BackgroundWorker worker;
+	BackgroundJobWorkerArgs workerArgs;
+	BackgroundJobState *jobState = &myDbData->jobStates[jobType];
+
+	memset(&worker, 0, sizeof(worker));
+	memset(&workerArgs, 0, sizeof(workerArgs));
+
+	workerArgs.databaseOid = myDbData->databaseOid;
+	workerArgs.userOid = myDbData->userOid;
+
+	SafeSnprintf(worker.bgw_name, sizeof(worker.bgw_name),
+				 "Citus Background Job: %s %u/%u", BackgroundJobs[jobType].name,
+				 workerArgs.databaseOid, workerArgs.userOid);
+
+	worker.bgw_flags = BGWORKER_SHMEM_ACCESS | BGWORKER_BACKEND_DATABASE_CONNECTION;
+	worker.bgw_start_time = BgWorkerStart_ConsistentState;
+
+	/* the maintenance daemon starts the next run when it is due */
+	worker.bgw_restart_time = BGW_NEVER_RESTART;
+	strcpy_s(worker.bgw_library_name, sizeof(worker.bgw_library_name), "citus");
+	strcpy_s(worker.bgw_function_name, sizeof(worker.bgw_function_name),
+			 "CitusBackgroundJobMain");
+	worker.bgw_main_arg = Int32GetDatum(jobType);
+	memcpy_struct(worker.bgw_extra, workerArgs);
+
+	/* wake up the maintenance daemon when the job finishes */
+	worker.bgw_notify_pid = MyProcPid;
+
+	LWLockAcquire(&MaintenanceDaemonControl->lock, LW_EXCLUSIVE);
+	jobState->lastRunSucceeded = false;
+	jobState->lastStartTime = GetCurrentTimestamp();
+	LWLockRelease(&MaintenanceDaemonControl->lock);
+
+	if (!RegisterDynamicBackgroundWorker(&worker, jobHandle))
+	{
+		ereport(DEBUG1, (errmsg("could not start a background worker for the %s "
+								"job", BackgroundJobs[jobType].name),
+						 errhint("Increasing max_worker_processes might help.")));
+
+		*jobHandle = NULL;
+
+		return false;
+	}
+
+	return true;
+}
+
+
+/*
+ * FinishBackgroundJob records the end of the current run of the given job.
+ * Runs that did not record their success, because they errored out or were
+ * terminated, count as failures.
+ */
+static void
+FinishBackgroundJob(MaintenanceDaemonDBData *myDbData, BackgroundJobType jobType)
+{
+	BackgroundJobState *jobState = &myDbData->jobStates[jobType];
+
+	LWLockAcquire(&MaintenanceDaemonControl->lock, LW_EXCLUSIVE);
+
+	jobState->workerPid = 0;
+	jobState->lastFinishTime = GetCurrentTimestamp();
+	jobState->runCount++;
+
+	if (!jobState->lastRunSucceeded)
+	{
+		jobState->failureCount++;
+	}
+
+	LWLockRelease(&MaintenanceDaemonControl->lock);
+}
+
+
+/*
+ * CitusBackgroundJobMain is the main routine of the dynamic background
+ * workers that run a single job for the maintenance daemon.
+ */
+void
+CitusBackgroundJobMain(Datum main_arg)
+{
+	int jobType = DatumGetInt32(main_arg);
+	BackgroundJobWorkerArgs workerArgs;
+	ErrorContextCallback errorCallback;
+
+	memcpy_s(&workerArgs, sizeof(workerArgs), MyBgworkerEntry->bgw_extra,
+			 sizeof(BackgroundJobWorkerArgs));
+
+	if (jobType < 0 || jobType >= BACKGROUND_JOB_COUNT)
+	{
+		proc_exit(0);
+	}
+
+	const BackgroundJob *job = &BackgroundJobs[jobType];
+
+	pqsignal(SIGTERM, die);
+	BackgroundWorkerUnblockSignals();
+
+	LWLockAcquire(&MaintenanceDaemonControl->lock, LW_EXCLUSIVE);
+
+	MaintenanceDaemonDBData *dbData = (MaintenanceDaemonDBData *)
+									  hash_search(MaintenanceDaemonDBHash,
+												  &workerArgs.databaseOid,
+												  HASH_FIND, NULL);
+	if (dbData == NULL)
+	{
+		/* the database was dropped or the daemon was stopped */
+		LWLockRelease(&MaintenanceDaemonControl->lock);
+		proc_exit(0);
+	}
+
+	/* from this point, DROP DATABASE will attempt to kill the worker */
+	dbData->jobStates[jobType].workerPid = MyProcPid;
+
+	LWLockRelease(&MaintenanceDaemonControl->lock);
+
+	memset(&errorCallback, 0, sizeof(errorCallback));
+	errorCallback.callback = BackgroundJobErrorContext;
+	errorCallback.arg = (void *) job;
+	errorCallback.previous = error_context_stack;
+	error_context_stack = &errorCallback;
+
+	BackgroundWorkerInitializeConnectionByOid(workerArgs.databaseOid,
+											  workerArgs.userOid, 0);
+
+	/* make worker recognizable in pg_stat_activity */
+	pgstat_report_appname("Citus Background Job");
+
+	RunBackgroundJob(job);
+
+	LWLockAcquire(&MaintenanceDaemonControl->lock, LW_EXCLUSIVE);
+
+	dbData = (MaintenanceDaemonDBData *) hash_search(MaintenanceDaemonDBHash,
+													 &workerArgs.databaseOid,
+													 HASH_FIND, NULL);
+	if (dbData != NULL && dbData->jobStates[jobType].workerPid == MyProcPid)
+	{
+		dbData->jobStates[jobType].lastRunSucceeded = true;
+	}
+
+	LWLockRelease(&MaintenanceDaemonControl->lock);
+
+	proc_exit(0);
+}
+
+
+/*
+ * RunBackgroundJob runs the given job in a transaction that holds a lock on
+ * the Citus extension, unless the extension is not accessible.
+ */
+static void
+RunBackgroundJob(const BackgroundJob *job)
+{
+	InvalidateMetadataSystemCache();
+	StartTransactionCommand();
+
+	if (!LockCitusExtension())
+	{
+		ereport(DEBUG1, (errmsg("could not lock the citus extension, "
+								"skipping the %s job", job->name)));
+	}
+	else if (CheckCitusVersion(DEBUG1) && CitusHasBeenLoaded())
+	{
+		job->run();
+	}
+
+	CommitTransactionCommand();
+}
+
+
+/*
+ * BackgroundJobErrorContext adds the job to log messages of background jobs.
+ */
+static void
+BackgroundJobErrorContext(void *arg)
+{
+	BackgroundJob *job = (BackgroundJob *) arg;
+	errcontext("Citus background job %s for database %u", job->name, MyDatabaseId);
+}
+
+
+/*
+ * RunTwoPhaseCommitRecoveryJob recovers the prepared transactions on the
+ * nodes that belong to failed distributed transactions.
+ */
+static void
+RunTwoPhaseCommitRecoveryJob(void)
+{
+	int recoveredTransactionCount = RecoverTwoPhaseCommits();
+
+	if (recoveredTransactionCount > 0)
+	{
+		ereport(LOG, (errmsg("maintenance daemon recovered %d distributed "
+							 "transactions",
+							 recoveredTransactionCount)));
+	}
+}
+
+
+/*
+ * citus_background_jobs returns the state of the jobs that the maintenance
+ * daemons run in background workers, for all databases.
+ */
+Datum
+citus_background_jobs(PG_FUNCTION_ARGS)
+{
+	TupleDesc tupleDescriptor = NULL;
+	HASH_SEQ_STATUS status;
+	MaintenanceDaemonDBData *dbData = NULL;
+
+	CheckCitusVersion(ERROR);
+
+	Tuplestorestate *tupleStore = SetupTuplestore(fcinfo, &tupleDescriptor);
+
+	LWLockAcquire(&MaintenanceDaemonControl->lock, LW_SHARED);
+
+	hash_seq_init(&status, MaintenanceDaemonDBHash);
+	while ((dbData = (MaintenanceDaemonDBData *) hash_seq_search(&status)) != NULL)
+	{
+		for (int jobType = 0; jobType < BACKGROUND_JOB_COUNT; jobType++)
+		{
+			BackgroundJobState *jobState = &dbData->jobStates[jobType];
+			Datum values[CITUS_BACKGROUND_JOBS_COLUMN_COUNT];
+			bool isNulls[CITUS_BACKGROUND_JOBS_COLUMN_COUNT];
+
+			memset(values, 0, sizeof(values));
+			memset(isNulls, false, sizeof(isNulls));
+
+			values[0] = ObjectIdGetDatum(dbData->databaseOid);
+			values[1] = CStringGetTextDatum(BackgroundJobs[jobType].name);
+
+			if (jobState->workerPid > 0)
+			{
+				values[2] = Int32GetDatum(jobState->workerPid);
+			}
+			else
+			{
+				isNulls[2] = true;
+			}
+
+			if (jobState->lastStartTime != 0)
+			{
+				values[3] = TimestampTzGetDatum(jobState->lastStartTime);
+			}
+			else
+			{
+				isNulls[3] = true;
+			}
+
+			if (jobState->lastFinishTime != 0)
+			{
+				values[4] = TimestampTzGetDatum(jobState->lastFinishTime);
+				values[5] = BoolGetDatum(jobState->lastRunSucceeded);
+			}
+			else
+			{
+				isNulls[4] = true;
+				isNulls[5] = true;
+			}
+
+			values[6] = UInt64GetDatum(jobState->runCount);
+			values[7] = UInt64GetDatum(jobState->failureCount);
+
+			tuplestore_putvalues(tupleStore, tupleDescriptor, values, isNulls);
+		}
+	}
+
+	LWLockRelease(&MaintenanceDaemonControl->lock);
+
+	tuplestore_donestoring(tupleStore);
+
+	PG_RETURN_VOID();
+}
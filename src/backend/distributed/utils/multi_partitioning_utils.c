@@ -15,6 +15,7 @@
 #include "catalog/pg_inherits.h"
 #include "distributed/citus_ruleutils.h"
 #include "distributed/colocation_utils.h"
+#include "distributed/listutils.h"
 #include "distributed/master_metadata_utility.h"
 #include "distributed/master_protocol.h"
 #include "distributed/multi_partitioning_utils.h"
@@ -23,11 +24,15 @@
 #include "nodes/pg_list.h"
 #include "pgstat.h"
 #if PG_VERSION_NUM >= 120000
+#include "optimizer/optimizer.h"
 #include "partitioning/partdesc.h"
+#else
+#include "optimizer/predtest.h"
 #endif
 #include "utils/builtins.h"
 #include "utils/fmgroids.h"
 #include "utils/lsyscache.h"
+#include "utils/partcache.h"
 #include "utils/rel.h"
 #include "utils/syscache.h"
 
@@ -303,6 +308,45 @@ PartitionList(Oid parentRelationId)
 }
 
 
+/*
+ * PartitionsNotRefutedByClauses takes a parent relation and a list of implicitly
+ * ANDed clauses of which the Vars refer to the parent with range table index 1.
+ * It returns the Oid list of partitions whose partition constraint does not
+ * contradict the clauses, that is, the partitions that may contain matching rows.
+ */
+List *
+PartitionsNotRefutedByClauses(Oid parentRelationId, List *clauseList)
+{
+	List *partitionList = PartitionList(parentRelationId);
+	List *remainingPartitionList = NIL;
+	Relation parentRelation = heap_open(parentRelationId, AccessShareLock);
+
+	Oid partitionId = InvalidOid;
+	foreach_oid(partitionId, partitionList)
+	{
+		Relation partitionRelation = heap_open(partitionId, AccessShareLock);
+		bool foundWholeRow = false;
+
+		/* the partition constraint uses the attribute numbers of the partition */
+		List *partitionQual = RelationGetPartitionQual(partitionRelation);
+		partitionQual = map_partition_varattnos(partitionQual, 1, parentRelation,
+												partitionRelation, &foundWholeRow);
+
+		heap_close(partitionRelation, NoLock);
+
+		if (!predicate_refuted_by(partitionQual, clauseList, false))
+		{
+			remainingPartitionList = lappend_oid(remainingPartitionList, partitionId);
+		}
+	}
+
+	/* keep the lock */
+	heap_close(parentRelation, NoLock);
+
+	return remainingPartitionList;
+}
+
+
 /*
  * GenerateDetachPartitionCommand gets a partition table and returns
  * "ALTER TABLE parent_table DETACH PARTITION partitionName" command.
@@ -12,10 +12,13 @@
 
 #include "postgres.h"
 
+#include "access/hash.h"
 #include "catalog/pg_class.h"
+#include "distributed/hash_helpers.h"
 #include "distributed/query_utils.h"
 #include "distributed/version_compat.h"
 #include "nodes/nodeFuncs.h"
+#include "utils/datum.h"
 
 
 static bool CitusQueryableRangeTableRelation(RangeTblEntry *rangeTableEntry);
@@ -176,3 +179,102 @@ ExtractRangeTableIndexWalker(Node *node, List **rangeTableIndexList)
 
 	return walkerResult;
 }
+
+
+/*
+ * HashQueryTreeWalker adds the node types, constants, columns, parameters,
+ * relations, operators and functions of the given query tree to the hash.
+ * Those are all compared by equal(), so equal queries have the same hash,
+ * while parse locations, which equal() ignores, are left out.
+ */
+bool
+HashQueryTreeWalker(Node *node, uint32 *queryHash)
+{
+	if (node == NULL)
+	{
+		return false;
+	}
+
+	*queryHash = hash_combine(*queryHash, hash_uint32((uint32) nodeTag(node)));
+
+	if (IsA(node, Query))
+	{
+		Query *query = (Query *) node;
+
+		*queryHash = hash_combine(*queryHash, hash_uint32((uint32) query->commandType));
+
+		return query_tree_walker(query, HashQueryTreeWalker, queryHash,
+								 QTW_EXAMINE_RTES_BEFORE);
+	}
+	else if (IsA(node, RangeTblEntry))
+	{
+		RangeTblEntry *rangeTableEntry = (RangeTblEntry *) node;
+
+		*queryHash = hash_combine(*queryHash, hash_uint32(rangeTableEntry->relid));
+
+		/* range_table_walker walks the contents of the entry */
+		return false;
+	}
+	else if (IsA(node, Const))
+	{
+		Const *constNode = (Const *) node;
+
+		*queryHash = hash_combine(*queryHash, hash_uint32(constNode->consttype));
+
+		if (constNode->constisnull)
+		{
+			return false;
+		}
+
+		/* equal() compares the bytes of the datum, as datumIsEqual does */
+		uint32 valueHash = 0;
+		if (constNode->constbyval)
+		{
+			valueHash = DatumGetUInt32(hash_any((unsigned char *) &constNode->constvalue,
+												sizeof(Datum)));
+		}
+		else
+		{
+			Size valueSize = datumGetSize(constNode->constvalue, false,
+										  constNode->constlen);
+
+			valueHash = DatumGetUInt32(hash_any((unsigned char *) DatumGetPointer(
+													constNode->constvalue),
+												valueSize));
+		}
+
+		*queryHash = hash_combine(*queryHash, valueHash);
+
+		return false;
+	}
+	else if (IsA(node, Var))
+	{
+		Var *column = (Var *) node;
+
+		*queryHash = hash_combine(*queryHash, hash_uint32(column->varno));
+		*queryHash = hash_combine(*queryHash, hash_uint32(column->varattno));
+		*queryHash = hash_combine(*queryHash, hash_uint32(column->varlevelsup));
+
+		return false;
+	}
+	else if (IsA(node, Param))
+	{
+		Param *param = (Param *) node;
+
+		*queryHash = hash_combine(*queryHash, hash_uint32(param->paramkind));
+		*queryHash = hash_combine(*queryHash, hash_uint32(param->paramid));
+
+		return false;
+	}
+	else if (IsA(node, OpExpr))
+	{
+		*queryHash = hash_combine(*queryHash, hash_uint32(((OpExpr *) node)->opno));
+	}
+	else if (IsA(node, FuncExpr))
+	{
+		*queryHash = hash_combine(*queryHash,
+								  hash_uint32(((FuncExpr *) node)->funcid));
+	}
+
+	return expression_tree_walker(node, HashQueryTreeWalker, queryHash);
+}
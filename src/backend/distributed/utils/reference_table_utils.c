@@ -15,14 +15,19 @@
 #include "access/heapam.h"
 #include "access/htup_details.h"
 #include "access/genam.h"
+#include "distributed/adaptive_executor.h"
+#include "distributed/citus_nodes.h"
 #include "distributed/colocation_utils.h"
 #include "distributed/commands.h"
+#include "distributed/deparse_shard_query.h"
 #include "distributed/listutils.h"
+#include "distributed/logical_replication.h"
 #include "distributed/master_protocol.h"
 #include "distributed/master_metadata_utility.h"
 #include "distributed/metadata_cache.h"
 #include "distributed/metadata_sync.h"
 #include "distributed/multi_logical_planner.h"
+#include "distributed/multi_physical_planner.h"
 #include "distributed/reference_table_utils.h"
 #include "distributed/resource_lock.h"
 #include "distributed/shardinterval_utils.h"
@@ -35,11 +40,29 @@
 #include "utils/rel.h"
 
 
+/* GUC, how reference tables are copied to nodes */
+int ReferenceTableTransferMode = REFERENCE_TABLE_TRANSFER_BLOCK_WRITES;
+
+/* GUC, whether reference tables are copied to nodes when they are activated */
+bool ReplicateReferenceTablesOnActivate = true;
+
+
 /* local function forward declarations */
 static void ReplicateSingleShardTableToAllNodes(Oid relationId);
 static void ReplicateShardToAllNodes(ShardInterval *shardInterval);
 static void ReplicateShardToNode(ShardInterval *shardInterval, char *nodeName,
 								 int nodePort);
+static List * MissingReferenceTableShardList(List *referenceTableList, char *nodeName,
+											 int nodePort);
+static bool ShouldReplicateReferenceTablesLogically(List *shardIntervalList);
+static void CopyReferenceTableShardsToNode(List *shardIntervalList, char *nodeName,
+										   int nodePort, bool includeData);
+static Task * ReferenceTableCopyTask(WorkerNode *targetNode, uint64 shardId, int taskId,
+									 char *command);
+static void ReplicateReferenceTableShardsLogically(List *shardIntervalList,
+												   char *nodeName, int nodePort);
+static void ActivatePlacementOnNode(ShardInterval *shardInterval, char *nodeName,
+									int nodePort);
 static void ConvertToReferenceTableMetadata(Oid relationId, uint64 shardId);
 
 /* exports for SQL callable functions */
@@ -112,10 +135,14 @@ upgrade_to_reference_table(PG_FUNCTION_ARGS)
 
 /*
  * ReplicateAllReferenceTablesToNode function finds all reference tables and
- * replicates them to the given worker node. It also modifies pg_dist_colocation
- * table to update the replication factor column when necessary. This function
- * skips reference tables if that node already has healthy placement of that
- * reference table to prevent unnecessary data transfer.
+ * replicates them to the given worker node. This function skips reference
+ * tables if that node already has healthy placement of that reference table
+ * to prevent unnecessary data transfer.
+ *
+ * Depending on citus.reference_table_transfer_mode, the tables are either
+ * copied while writes to them are blocked, or replicated logically such that
+ * writes are only blocked while the node catches up with the last changes.
+ * The tables are copied over citus.shard_copy_parallelism connections.
  */
 void
 ReplicateAllReferenceTablesToNode(char *nodeName, int nodePort)
@@ -123,49 +150,335 @@ ReplicateAllReferenceTablesToNode(char *nodeName, int nodePort)
 	List *referenceTableList = ReferenceTableOidList();
 
 	/* if there is no reference table, we do not need to replicate anything */
-	if (list_length(referenceTableList) > 0)
+	if (list_length(referenceTableList) == 0)
 	{
-		List *referenceShardIntervalList = NIL;
+		return;
+	}
 
-		/*
-		 * We sort the reference table list to prevent deadlocks in concurrent
-		 * ReplicateAllReferenceTablesToAllNodes calls.
-		 */
-		referenceTableList = SortList(referenceTableList, CompareOids);
-		Oid referenceTableId = InvalidOid;
-		foreach_oid(referenceTableId, referenceTableList)
-		{
-			List *shardIntervalList = LoadShardIntervalList(referenceTableId);
-			ShardInterval *shardInterval = (ShardInterval *) linitial(shardIntervalList);
+	/*
+	 * We sort the reference table list to prevent deadlocks in concurrent
+	 * ReplicateAllReferenceTablesToNode calls.
+	 */
+	referenceTableList = SortList(referenceTableList, CompareOids);
 
-			referenceShardIntervalList = lappend(referenceShardIntervalList,
-												 shardInterval);
-		}
+	List *missingShardIntervalList = MissingReferenceTableShardList(referenceTableList,
+																	nodeName,
+																	nodePort);
+	if (missingShardIntervalList == NIL)
+	{
+		return;
+	}
+
+	/*
+	 * Prevent concurrent copies of the same reference tables, without blocking
+	 * writes. Another backend may have copied them before we got the locks.
+	 */
+	ShardInterval *shardInterval = NULL;
+	foreach_ptr(shardInterval, missingShardIntervalList)
+	{
+		LockRelationOid(shardInterval->relationId, ShareUpdateExclusiveLock);
+	}
+
+	referenceTableList = NIL;
+	foreach_ptr(shardInterval, missingShardIntervalList)
+	{
+		referenceTableList = lappend_oid(referenceTableList, shardInterval->relationId);
+	}
 
+	missingShardIntervalList = MissingReferenceTableShardList(referenceTableList,
+															  nodeName, nodePort);
+	if (missingShardIntervalList == NIL)
+	{
+		return;
+	}
+
+	bool useLogicalReplication =
+		ShouldReplicateReferenceTablesLogically(missingShardIntervalList);
+
+	if (!useLogicalReplication)
+	{
 		if (ClusterHasKnownMetadataWorkers())
 		{
-			BlockWritesToShardList(referenceShardIntervalList);
+			BlockWritesToShardList(missingShardIntervalList);
 		}
 
-		ShardInterval *shardInterval = NULL;
-		foreach_ptr(shardInterval, referenceShardIntervalList)
+		foreach_ptr(shardInterval, missingShardIntervalList)
 		{
-			uint64 shardId = shardInterval->shardId;
+			LockShardDistributionMetadata(shardInterval->shardId, ExclusiveLock);
+		}
+	}
+
+	foreach_ptr(shardInterval, missingShardIntervalList)
+	{
+		ereport(NOTICE, (errmsg("Replicating reference table \"%s\" to the node %s:%d",
+								get_rel_name(shardInterval->relationId), nodeName,
+								nodePort)));
+	}
+
+	EnsureNoModificationsHaveBeenDone();
+
+	/* logical replication copies the data into the tables and their indexes */
+	bool includeData = !useLogicalReplication;
+	CopyReferenceTableShardsToNode(missingShardIntervalList, nodeName, nodePort,
+								   includeData);
+
+	if (useLogicalReplication)
+	{
+		/* blocks writes for the last part of the replication */
+		ReplicateReferenceTableShardsLogically(missingShardIntervalList, nodeName,
+											   nodePort);
+	}
+
+	/* create foreign constraints between reference tables */
+	foreach_ptr(shardInterval, missingShardIntervalList)
+	{
+		char *tableOwner = TableOwner(shardInterval->relationId);
+		List *commandList = CopyShardForeignConstraintCommandList(shardInterval);
+
+		SendCommandListToWorkerInSingleTransaction(nodeName, nodePort, tableOwner,
+												   commandList);
+	}
+
+	foreach_ptr(shardInterval, missingShardIntervalList)
+	{
+		ActivatePlacementOnNode(shardInterval, nodeName, nodePort);
+	}
+}
+
+
+/*
+ * EnsureReferenceTablesExistOnAllNodes replicates the reference tables to all
+ * nodes that should have reference table placements but do not have them yet,
+ * which happens when citus.replicate_reference_tables_on_activate was off
+ * while the nodes were activated. It is called before shards are placed on
+ * nodes, since queries that join those shards with reference tables need the
+ * reference tables on the same node.
+ */
+void
+EnsureReferenceTablesExistOnAllNodes(void)
+{
+	List *referenceTableList = ReferenceTableOidList();
+
+	if (list_length(referenceTableList) == 0)
+	{
+		return;
+	}
 
-			LockShardDistributionMetadata(shardId, ExclusiveLock);
+	List *nodeList = ReferenceTablePlacementNodeList(ShareLock);
+	nodeList = SortList(nodeList, CompareWorkerNodes);
 
-			ReplicateShardToNode(shardInterval, nodeName, nodePort);
+	WorkerNode *workerNode = NULL;
+	foreach_ptr(workerNode, nodeList)
+	{
+		ReplicateAllReferenceTablesToNode(workerNode->workerName,
+										  workerNode->workerPort);
+	}
+}
+
+
+/*
+ * MissingReferenceTableShardList returns the shards of the given reference
+ * tables that do not have a healthy placement on the given node.
+ */
+static List *
+MissingReferenceTableShardList(List *referenceTableList, char *nodeName, int nodePort)
+{
+	List *missingShardIntervalList = NIL;
+
+	Oid referenceTableId = InvalidOid;
+	foreach_oid(referenceTableId, referenceTableList)
+	{
+		List *shardIntervalList = LoadShardIntervalList(referenceTableId);
+		ShardInterval *shardInterval = (ShardInterval *) linitial(shardIntervalList);
+
+		List *shardPlacementList = ShardPlacementList(shardInterval->shardId);
+		ShardPlacement *targetPlacement =
+			SearchShardPlacementInList(shardPlacementList, nodeName, nodePort);
+
+		if (targetPlacement == NULL || targetPlacement->shardState != SHARD_STATE_ACTIVE)
+		{
+			missingShardIntervalList = lappend(missingShardIntervalList, shardInterval);
 		}
+	}
 
-		/* create foreign constraints between reference tables */
-		foreach_ptr(shardInterval, referenceShardIntervalList)
+	return missingShardIntervalList;
+}
+
+
+/*
+ * ShouldReplicateReferenceTablesLogically returns whether the given reference
+ * table shards should be replicated logically according to
+ * citus.reference_table_transfer_mode.
+ */
+static bool
+ShouldReplicateReferenceTablesLogically(List *shardIntervalList)
+{
+	if (ReferenceTableTransferMode == REFERENCE_TABLE_TRANSFER_BLOCK_WRITES)
+	{
+		return false;
+	}
+	else if (ReferenceTableTransferMode == REFERENCE_TABLE_TRANSFER_FORCE_LOGICAL)
+	{
+		return true;
+	}
+
+	/* UPDATE and DELETE commands error out on tables without a replica identity */
+	ShardInterval *shardInterval = NULL;
+	foreach_ptr(shardInterval, shardIntervalList)
+	{
+		if (!RelationCanBeReplicatedLogically(shardInterval->relationId))
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+
+/*
+ * CopyReferenceTableShardsToNode creates the given reference table shards and
+ * their indexes on the given node, optionally including their data. Every
+ * shard is copied in its own transaction, and when citus.shard_copy_parallelism
+ * is higher than 1, that many shards are copied at the same time.
+ */
+static void
+CopyReferenceTableShardsToNode(List *shardIntervalList, char *nodeName, int nodePort,
+							   bool includeData)
+{
+	List *copyTaskList = NIL;
+	bool missingOk = false;
+	int taskId = 1;
+
+	WorkerNode *targetNode = ForceFindWorkerNode(nodeName, nodePort);
+
+	ShardInterval *shardInterval = NULL;
+	foreach_ptr(shardInterval, shardIntervalList)
+	{
+		uint64 shardId = shardInterval->shardId;
+		ShardPlacement *sourcePlacement = ActiveShardPlacement(shardId, missingOk);
+		List *ddlCommandList = CopyShardCommandList(shardInterval,
+													sourcePlacement->nodeName,
+													sourcePlacement->nodePort,
+													includeData);
+
+		if (ShardCopyParallelism == 1)
 		{
 			char *tableOwner = TableOwner(shardInterval->relationId);
-			List *commandList = CopyShardForeignConstraintCommandList(shardInterval);
 
 			SendCommandListToWorkerInSingleTransaction(nodeName, nodePort, tableOwner,
-													   commandList);
+													   ddlCommandList);
+			continue;
 		}
+
+		/*
+		 * The commands run in a single implicit transaction on the target node.
+		 * The table is owned by the table owner, since the commands include an
+		 * ALTER TABLE .. OWNER TO.
+		 */
+		char *copyCommand = StringJoin(ddlCommandList, ';');
+		Task *copyTask = ReferenceTableCopyTask(targetNode, shardId, taskId++,
+												copyCommand);
+
+		copyTaskList = lappend(copyTaskList, copyTask);
+	}
+
+	if (copyTaskList != NIL)
+	{
+		ExecuteTaskListOutsideTransaction(ROW_MODIFY_NONE, copyTaskList,
+										  ShardCopyParallelism, NIL);
+	}
+}
+
+
+/*
+ * ReferenceTableCopyTask returns a task that runs the given command to copy a
+ * reference table shard on the target node.
+ */
+static Task *
+ReferenceTableCopyTask(WorkerNode *targetNode, uint64 shardId, int taskId,
+					   char *command)
+{
+	ShardPlacement *targetPlacement = CitusMakeNode(ShardPlacement);
+	targetPlacement->nodeName = targetNode->workerName;
+	targetPlacement->nodePort = targetNode->workerPort;
+	targetPlacement->nodeId = targetNode->nodeId;
+	targetPlacement->groupId = targetNode->groupId;
+	targetPlacement->shardId = shardId;
+
+	Task *task = CitusMakeNode(Task);
+	task->jobId = INVALID_JOB_ID;
+	task->taskId = taskId;
+	task->taskType = DDL_TASK;
+	SetTaskQueryString(task, command);
+	task->replicationModel = REPLICATION_MODEL_INVALID;
+	task->dependentTaskList = NIL;
+	task->anchorShardId = shardId;
+	task->relationShardList = NIL;
+	task->taskPlacementList = list_make1(targetPlacement);
+
+	return task;
+}
+
+
+/*
+ * ReplicateReferenceTableShardsLogically streams the data of the given
+ * reference table shards, which already exist on the given node, from the
+ * nodes that have their first active placement. The shards with the same
+ * source node share a subscription, whose initial copy PostgreSQL runs for
+ * several tables at the same time. Writes to the shards are blocked until the
+ * end of the transaction once they caught up.
+ */
+static void
+ReplicateReferenceTableShardsLogically(List *shardIntervalList, char *nodeName,
+									   int nodePort)
+{
+	List *sourcePlacementList = NIL;
+	List *sourceShardListList = NIL;
+	bool missingOk = false;
+
+	ShardInterval *shardInterval = NULL;
+	foreach_ptr(shardInterval, shardIntervalList)
+	{
+		ShardPlacement *placement = ActiveShardPlacement(shardInterval->shardId,
+														 missingOk);
+		ListCell *sourcePlacementCell = NULL;
+		ListCell *sourceShardListCell = NULL;
+		bool found = false;
+
+		forboth(sourcePlacementCell, sourcePlacementList,
+				sourceShardListCell, sourceShardListList)
+		{
+			ShardPlacement *sourcePlacement =
+				(ShardPlacement *) lfirst(sourcePlacementCell);
+
+			if (sourcePlacement->nodeId == placement->nodeId)
+			{
+				lfirst(sourceShardListCell) = lappend(lfirst(sourceShardListCell),
+													  shardInterval);
+				found = true;
+				break;
+			}
+		}
+
+		if (!found)
+		{
+			sourcePlacementList = lappend(sourcePlacementList, placement);
+			sourceShardListList = lappend(sourceShardListList,
+										  list_make1(shardInterval));
+		}
+	}
+
+	ListCell *sourcePlacementCell = NULL;
+	ListCell *sourceShardListCell = NULL;
+	forboth(sourcePlacementCell, sourcePlacementList,
+			sourceShardListCell, sourceShardListList)
+	{
+		ShardPlacement *sourcePlacement = (ShardPlacement *) lfirst(sourcePlacementCell);
+		List *sourceShardList = (List *) lfirst(sourceShardListCell);
+
+		LogicallyReplicateShards(sourceShardList, sourcePlacement->nodeName,
+								 sourcePlacement->nodePort, nodeName, nodePort);
 	}
 }
 
@@ -282,9 +595,6 @@ ReplicateShardToNode(ShardInterval *shardInterval, char *nodeName, int nodePort)
 	 */
 	if (targetPlacement == NULL || targetPlacement->shardState != SHARD_STATE_ACTIVE)
 	{
-		uint64 placementId = 0;
-		int32 groupId = 0;
-
 		ereport(NOTICE, (errmsg("Replicating reference table \"%s\" to the node %s:%d",
 								get_rel_name(shardInterval->relationId), nodeName,
 								nodePort)));
@@ -292,36 +602,55 @@ ReplicateShardToNode(ShardInterval *shardInterval, char *nodeName, int nodePort)
 		EnsureNoModificationsHaveBeenDone();
 		SendCommandListToWorkerInSingleTransaction(nodeName, nodePort, tableOwner,
 												   ddlCommandList);
-		if (targetPlacement == NULL)
-		{
-			groupId = GroupForNode(nodeName, nodePort);
+		ActivatePlacementOnNode(shardInterval, nodeName, nodePort);
+	}
+}
 
-			placementId = GetNextPlacementId();
-			InsertShardPlacementRow(shardId, placementId, SHARD_STATE_ACTIVE, 0,
-									groupId);
-		}
-		else
-		{
-			groupId = targetPlacement->groupId;
-			placementId = targetPlacement->placementId;
-			UpdateShardPlacementState(placementId, SHARD_STATE_ACTIVE);
-		}
 
-		/*
-		 * Although ReplicateShardToAllNodes is used only for reference tables,
-		 * during the upgrade phase, the placements are created before the table is
-		 * marked as a reference table. All metadata (including the placement
-		 * metadata) will be copied to workers after all reference table changed
-		 * are finished.
-		 */
-		if (ShouldSyncTableMetadata(shardInterval->relationId))
-		{
-			char *placementCommand = PlacementUpsertCommand(shardId, placementId,
-															SHARD_STATE_ACTIVE, 0,
-															groupId);
+/*
+ * ActivatePlacementOnNode inserts an active placement of the given shard on
+ * the given node into pg_dist_placement, or marks the existing placement as
+ * active, after the shard was copied to the node.
+ */
+static void
+ActivatePlacementOnNode(ShardInterval *shardInterval, char *nodeName, int nodePort)
+{
+	uint64 shardId = shardInterval->shardId;
+	uint64 placementId = 0;
+	int32 groupId = 0;
 
-			SendCommandToWorkersWithMetadata(placementCommand);
-		}
+	List *shardPlacementList = ShardPlacementList(shardId);
+	ShardPlacement *targetPlacement = SearchShardPlacementInList(shardPlacementList,
+																 nodeName, nodePort);
+
+	if (targetPlacement == NULL)
+	{
+		groupId = GroupForNode(nodeName, nodePort);
+
+		placementId = GetNextPlacementId();
+		InsertShardPlacementRow(shardId, placementId, SHARD_STATE_ACTIVE, 0, groupId);
+	}
+	else
+	{
+		groupId = targetPlacement->groupId;
+		placementId = targetPlacement->placementId;
+		UpdateShardPlacementState(placementId, SHARD_STATE_ACTIVE);
+	}
+
+	/*
+	 * Although ReplicateShardToAllNodes is used only for reference tables,
+	 * during the upgrade phase, the placements are created before the table is
+	 * marked as a reference table. All metadata (including the placement
+	 * metadata) will be copied to workers after all reference table changed
+	 * are finished.
+	 */
+	if (ShouldSyncTableMetadata(shardInterval->relationId))
+	{
+		char *placementCommand = PlacementUpsertCommand(shardId, placementId,
+														SHARD_STATE_ACTIVE, 0,
+														groupId);
+
+		SendCommandToWorkersWithMetadata(placementCommand);
 	}
 }
 
@@ -11,6 +11,7 @@
 #include "stdint.h"
 #include "postgres.h"
 
+#include "access/hash.h"
 #include "access/nbtree.h"
 #include "catalog/pg_am.h"
 #include "catalog/pg_collation.h"
@@ -24,7 +25,12 @@
 #include "distributed/pg_dist_partition.h"
 #include "distributed/worker_protocol.h"
 #include "utils/catcache.h"
+#include "utils/fmgroids.h"
 #include "utils/memutils.h"
+#include "utils/uuid.h"
+
+
+static int FindHashBucketShardIndex(int32 hashedValue, CitusTableCacheEntry *cacheEntry);
 
 
 /*
@@ -281,9 +287,9 @@ FindShardInterval(Datum partitionColumnValue, CitusTableCacheEntry *cacheEntry)
 
 	if (cacheEntry->partitionMethod == DISTRIBUTE_BY_HASH)
 	{
-		searchedValue = FunctionCall1Coll(cacheEntry->hashFunction,
-										  cacheEntry->partitionColumn->varcollid,
-										  partitionColumnValue);
+		searchedValue = HashDistributionValue(cacheEntry->hashFunction,
+											  cacheEntry->partitionColumn->varcollid,
+											  partitionColumnValue);
 	}
 
 	int shardIndex = FindShardIntervalIndex(searchedValue, cacheEntry);
@@ -297,6 +303,58 @@ FindShardInterval(Datum partitionColumnValue, CitusTableCacheEntry *cacheEntry)
 }
 
 
+/*
+ * HashDistributionValue returns the hash of the given distribution column
+ * value, as computed by the given hash function.
+ *
+ * COPY and repartitioning hash every row, so for the built-in hash functions
+ * of the common integer and uuid distribution column types we compute the
+ * hash directly, the same way hashint2, hashint4, hashint8 and uuid_hash do,
+ * instead of going through fmgr. Other hash functions, including hashtext
+ * which depends on the collation, are called through fmgr.
+ */
+Datum
+HashDistributionValue(FmgrInfo *hashFunction, Oid collation, Datum value)
+{
+	switch (hashFunction->fn_oid)
+	{
+		case F_HASHINT2:
+		{
+			return hash_uint32((int32) DatumGetInt16(value));
+		}
+
+		case F_HASHINT4:
+		{
+			return hash_uint32(DatumGetInt32(value));
+		}
+
+		case F_HASHINT8:
+		{
+			/* the hash of an int8 equals the hash of an int4 with the same value */
+			int64 int64Value = DatumGetInt64(value);
+			uint32 lowHalf = (uint32) int64Value;
+			uint32 highHalf = (uint32) (int64Value >> 32);
+
+			lowHalf ^= (int64Value >= 0) ? highHalf : ~highHalf;
+
+			return hash_uint32(lowHalf);
+		}
+
+		case F_UUID_HASH:
+		{
+			pg_uuid_t *uuidValue = DatumGetUUIDP(value);
+
+			return hash_any(uuidValue->data, UUID_LEN);
+		}
+
+		default:
+		{
+			return FunctionCall1Coll(hashFunction, collation, value);
+		}
+	}
+}
+
+
 /*
  * FindShardIntervalIndex finds the index of the shard interval which covers
  * the searched value. Note that the searched value must be the hashed value
@@ -327,7 +385,20 @@ FindShardIntervalIndex(Datum searchedValue, CitusTableCacheEntry *cacheEntry)
 
 	if (partitionMethod == DISTRIBUTE_BY_HASH)
 	{
-		if (useBinarySearch)
+		if (useBinarySearch && cacheEntry->hashBucketShardIndexArray != NULL)
+		{
+			shardIndex = FindHashBucketShardIndex(DatumGetInt32(searchedValue),
+												  cacheEntry);
+
+			if (shardIndex == INVALID_SHARD_INDEX)
+			{
+				ereport(ERROR, (errcode(ERRCODE_DATA_EXCEPTION),
+								errmsg("cannot find shard interval"),
+								errdetail("Hash of the partition column value "
+										  "does not fall into any shards.")));
+			}
+		}
+		else if (useBinarySearch)
 		{
 			Assert(compareFunction != NULL);
 
@@ -385,6 +456,36 @@ FindShardIntervalIndex(Datum searchedValue, CitusTableCacheEntry *cacheEntry)
 }
 
 
+/*
+ * FindHashBucketShardIndex finds the index of the shard of a hash distributed
+ * table that covers the given hash value using the hash buckets of the table,
+ * and returns INVALID_SHARD_INDEX if no shard covers the hash value.
+ */
+static int
+FindHashBucketShardIndex(int32 hashedValue, CitusTableCacheEntry *cacheEntry)
+{
+	ShardInterval **shardIntervalCache = cacheEntry->sortedShardIntervalArray;
+	int shardCount = cacheEntry->shardIntervalArrayLength;
+	uint32 hashToken = (uint32) hashedValue - (uint32) INT32_MIN;
+	uint32 bucketIndex = hashToken >> (32 - cacheEntry->hashBucketBits);
+	int shardIndex = cacheEntry->hashBucketShardIndexArray[bucketIndex];
+
+	while (shardIndex < shardCount &&
+		   DatumGetInt32(shardIntervalCache[shardIndex]->maxValue) < hashedValue)
+	{
+		shardIndex++;
+	}
+
+	if (shardIndex == shardCount ||
+		DatumGetInt32(shardIntervalCache[shardIndex]->minValue) > hashedValue)
+	{
+		return INVALID_SHARD_INDEX;
+	}
+
+	return shardIndex;
+}
+
+
 /*
  * SearchCachedShardInterval performs a binary search for a shard interval
  * matching a given partition column value and returns it's index in the cached
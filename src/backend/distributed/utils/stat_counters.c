@@ -0,0 +1,314 @@
+/*-------------------------------------------------------------------------
+ *
+ * stat_counters.c
+ *	  Counters of how connections are opened and reused, how queries are
+ *	  planned and how their tasks are executed, shown by citus_stat_counters.
+ *
+ *	  Every backend increments its own counters in shared memory, indexed by
+ *	  pgprocno, so increments never contend with other backends. When a
+ *	  backend exits, its counters are added to the shared totals and reset,
+ *	  such that the next backend in the same slot starts from 0. Reading the
+ *	  counters sums the totals and the counters of all backends.
+ *
+ * Copyright (c) Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include "postgres.h"
+
+#include "funcapi.h"
+#include "miscadmin.h"
+
+#include "distributed/backend_data.h"
+#include "distributed/metadata_cache.h"
+#include "distributed/stat_counters.h"
+#include "distributed/tuplestore.h"
+#include "port/atomics.h"
+#include "storage/ipc.h"
+#include "storage/lwlock.h"
+#include "storage/proc.h"
+#include "storage/shmem.h"
+#include "storage/spin.h"
+#include "utils/timestamp.h"
+
+
+/*
+ * StatCountersShmemData contains the totals of the backends that exited and
+ * the counters of all backends that are running.
+ */
+typedef struct StatCountersShmemData
+{
+	/* protects resetTime */
+	slock_t mutex;
+	TimestampTz resetTime;
+
+	pg_atomic_uint64 totals[N_CITUS_STAT_COUNTERS];
+
+	/* N_CITUS_STAT_COUNTERS counters for every backend, indexed by pgprocno */
+	pg_atomic_uint64 backendCounters[FLEXIBLE_ARRAY_MEMBER];
+} StatCountersShmemData;
+
+
+/* GUC, whether the counters are incremented */
+bool EnableStatCounters = true;
+
+static shmem_startup_hook_type prev_shmem_startup_hook = NULL;
+static StatCountersShmemData *StatCountersShmem = NULL;
+
+/* counters of the current backend, set on the first increment */
+static pg_atomic_uint64 *MyStatCounters = NULL;
+
+
+static size_t StatCountersShmemSize(void);
+static void StatCountersShmemInit(void);
+static void SetUpMyStatCounters(void);
+static void FlushMyStatCounters(int code, Datum arg);
+
+
+PG_FUNCTION_INFO_V1(citus_stat_counters);
+PG_FUNCTION_INFO_V1(citus_stat_counters_reset);
+
+
+/*
+ * InitializeStatCounters, called at server start, requests the shared memory
+ * for the counters.
+ */
+void
+InitializeStatCounters(void)
+{
+	if (!IsUnderPostmaster)
+	{
+		RequestAddinShmemSpace(StatCountersShmemSize());
+	}
+
+	prev_shmem_startup_hook = shmem_startup_hook;
+	shmem_startup_hook = StatCountersShmemInit;
+}
+
+
+/*
+ * IncrementStatCounter increments the given counter of the current backend.
+ * Only the current backend increments its counters, so the increment never
+ * waits for other backends.
+ */
+void
+IncrementStatCounter(CitusStatCounter counter)
+{
+	if (!EnableStatCounters)
+	{
+		return;
+	}
+
+	if (MyStatCounters == NULL)
+	{
+		SetUpMyStatCounters();
+
+		if (MyStatCounters == NULL)
+		{
+			return;
+		}
+	}
+
+	pg_atomic_fetch_add_u64(&MyStatCounters[counter], 1);
+}
+
+
+/*
+ * SetUpMyStatCounters points MyStatCounters to the counters of the current
+ * backend in shared memory and makes sure they are added to the totals when
+ * the backend exits.
+ */
+static void
+SetUpMyStatCounters(void)
+{
+	if (StatCountersShmem == NULL || MyProc == NULL)
+	{
+		return;
+	}
+
+	MyStatCounters =
+		&StatCountersShmem->backendCounters[MyProc->pgprocno * N_CITUS_STAT_COUNTERS];
+
+	before_shmem_exit(FlushMyStatCounters, (Datum) 0);
+}
+
+
+/*
+ * FlushMyStatCounters adds the counters of the exiting backend to the totals
+ * and resets them for the next backend in the same slot.
+ */
+static void
+FlushMyStatCounters(int code, Datum arg)
+{
+	if (MyStatCounters == NULL)
+	{
+		return;
+	}
+
+	for (int counter = 0; counter < N_CITUS_STAT_COUNTERS; counter++)
+	{
+		uint64 value = pg_atomic_exchange_u64(&MyStatCounters[counter], 0);
+
+		pg_atomic_fetch_add_u64(&StatCountersShmem->totals[counter], value);
+	}
+
+	MyStatCounters = NULL;
+}
+
+
+/*
+ * citus_stat_counters returns the counters summed over all backends since
+ * the last reset, and the time of the last reset.
+ */
+Datum
+citus_stat_counters(PG_FUNCTION_ARGS)
+{
+	TupleDesc tupleDescriptor = NULL;
+	Datum values[N_CITUS_STAT_COUNTERS + 1];
+	bool isNulls[N_CITUS_STAT_COUNTERS + 1];
+	uint64 counterValues[N_CITUS_STAT_COUNTERS];
+
+	CheckCitusVersion(ERROR);
+
+	Tuplestorestate *tupleStore = SetupTuplestore(fcinfo, &tupleDescriptor);
+
+	memset(values, 0, sizeof(values));
+	memset(isNulls, false, sizeof(isNulls));
+	memset(counterValues, 0, sizeof(counterValues));
+
+	if (StatCountersShmem == NULL)
+	{
+		tuplestore_donestoring(tupleStore);
+
+		PG_RETURN_VOID();
+	}
+
+	int totalProcs = TotalProcCount();
+
+	for (int counter = 0; counter < N_CITUS_STAT_COUNTERS; counter++)
+	{
+		counterValues[counter] = pg_atomic_read_u64(&StatCountersShmem->totals[counter]);
+
+		for (int procIndex = 0; procIndex < totalProcs; procIndex++)
+		{
+			pg_atomic_uint64 *backendCounters =
+				&StatCountersShmem->backendCounters[procIndex * N_CITUS_STAT_COUNTERS];
+
+			counterValues[counter] += pg_atomic_read_u64(&backendCounters[counter]);
+		}
+
+		values[counter] = Int64GetDatum(counterValues[counter]);
+	}
+
+	SpinLockAcquire(&StatCountersShmem->mutex);
+	TimestampTz resetTime = StatCountersShmem->resetTime;
+	SpinLockRelease(&StatCountersShmem->mutex);
+
+	values[N_CITUS_STAT_COUNTERS] = TimestampTzGetDatum(resetTime);
+
+	tuplestore_putvalues(tupleStore, tupleDescriptor, values, isNulls);
+	tuplestore_donestoring(tupleStore);
+
+	PG_RETURN_VOID();
+}
+
+
+/*
+ * citus_stat_counters_reset resets the counters of all backends and the
+ * totals to 0. Increments that happen concurrently may or may not be
+ * counted.
+ */
+Datum
+citus_stat_counters_reset(PG_FUNCTION_ARGS)
+{
+	CheckCitusVersion(ERROR);
+
+	if (StatCountersShmem == NULL)
+	{
+		PG_RETURN_VOID();
+	}
+
+	int counterCount = TotalProcCount() * N_CITUS_STAT_COUNTERS;
+
+	for (int counter = 0; counter < N_CITUS_STAT_COUNTERS; counter++)
+	{
+		pg_atomic_write_u64(&StatCountersShmem->totals[counter], 0);
+	}
+
+	for (int counterIndex = 0; counterIndex < counterCount; counterIndex++)
+	{
+		pg_atomic_write_u64(&StatCountersShmem->backendCounters[counterIndex], 0);
+	}
+
+	TimestampTz resetTime = GetCurrentTimestamp();
+
+	SpinLockAcquire(&StatCountersShmem->mutex);
+	StatCountersShmem->resetTime = resetTime;
+	SpinLockRelease(&StatCountersShmem->mutex);
+
+	PG_RETURN_VOID();
+}
+
+
+/*
+ * StatCountersShmemSize returns the size of the shared memory needed for the
+ * counters.
+ */
+static size_t
+StatCountersShmemSize(void)
+{
+	Size size = 0;
+	Size counterCount = mul_size(TotalProcCount(), N_CITUS_STAT_COUNTERS);
+
+	size = add_size(size, offsetof(StatCountersShmemData, backendCounters));
+	size = add_size(size, mul_size(sizeof(pg_atomic_uint64), counterCount));
+
+	return size;
+}
+
+
+/*
+ * StatCountersShmemInit initializes the shared memory for the counters.
+ */
+static void
+StatCountersShmemInit(void)
+{
+	bool alreadyInitialized = false;
+
+	LWLockAcquire(AddinShmemInitLock, LW_EXCLUSIVE);
+
+	StatCountersShmem =
+		(StatCountersShmemData *) ShmemInitStruct("Citus Stat Counters",
+												  StatCountersShmemSize(),
+												  &alreadyInitialized);
+
+	/*
+	 * Might already be initialized on EXEC_BACKEND type platforms that call
+	 * shared library initialization functions in every backend.
+	 */
+	if (!alreadyInitialized)
+	{
+		int counterCount = TotalProcCount() * N_CITUS_STAT_COUNTERS;
+
+		SpinLockInit(&StatCountersShmem->mutex);
+		StatCountersShmem->resetTime = GetCurrentTimestamp();
+
+		for (int counter = 0; counter < N_CITUS_STAT_COUNTERS; counter++)
+		{
+			pg_atomic_init_u64(&StatCountersShmem->totals[counter], 0);
+		}
+
+		for (int counterIndex = 0; counterIndex < counterCount; counterIndex++)
+		{
+			pg_atomic_init_u64(&StatCountersShmem->backendCounters[counterIndex], 0);
+		}
+	}
+
+	LWLockRelease(AddinShmemInitLock);
+
+	if (prev_shmem_startup_hook != NULL)
+	{
+		prev_shmem_startup_hook();
+	}
+}
@@ -0,0 +1,242 @@
+/*-------------------------------------------------------------------------
+ *
+ * tdigest_extension.c
+ *	  Helper functions to get access to tdigest specific data.
+ *
+ * Copyright (c) Citus Data, Inc.
+ *-------------------------------------------------------------------------
+ */
+
+#include "postgres.h"
+
+#include "catalog/pg_type.h"
+#include "commands/extension.h"
+#include "distributed/tdigest_extension.h"
+#include "distributed/version_compat.h"
+#include "parser/parse_func.h"
+#include "utils/lsyscache.h"
+#include "utils/syscache.h"
+
+
+static Oid LookupTDigestFunction(const char *functionName, int argcount, Oid *argtypes);
+
+
+/*
+ * IsTDigestAggregateName returns whether the given name is the name of one of
+ * the aggregates defined by the tdigest extension. It allows callers to skip
+ * the catalog lookups below for all other aggregates.
+ */
+bool
+IsTDigestAggregateName(const char *aggregateName)
+{
+	return strncmp(aggregateName, TDIGEST_AGGREGATE_NAME, NAMEDATALEN) == 0 ||
+		   strncmp(aggregateName, TDIGEST_PERCENTILE_AGGREGATE_NAME, NAMEDATALEN) == 0 ||
+		   strncmp(aggregateName, TDIGEST_PERCENTILE_OF_AGGREGATE_NAME,
+				   NAMEDATALEN) == 0;
+}
+
+
+/*
+ * TDigestExtensionSchema finds the schema the tdigest extension is installed in.
+ * The function returns InvalidOid if the extension is not installed.
+ */
+Oid
+TDigestExtensionSchema(void)
+{
+	Oid extensionOid = get_extension_oid(TDIGEST_EXTENSION_NAME, true);
+	if (extensionOid == InvalidOid)
+	{
+		return InvalidOid;
+	}
+
+	return get_extension_schema(extensionOid);
+}
+
+
+/*
+ * TDigestExtensionTypeOid performs a lookup for the Oid of the type representing
+ * the tdigest as installed by the tdigest extension returns InvalidOid if the
+ * type cannot be found.
+ */
+Oid
+TDigestExtensionTypeOid(void)
+{
+	Oid tdigestSchemaOid = TDigestExtensionSchema();
+	if (tdigestSchemaOid == InvalidOid)
+	{
+		return InvalidOid;
+	}
+
+	return GetSysCacheOid2Compat(TYPENAMENSP, Anum_pg_type_oid,
+								 PointerGetDatum(TDIGEST_TYPE_NAME),
+								 ObjectIdGetDatum(tdigestSchemaOid));
+}
+
+
+/*
+ * LookupTDigestFunction is a helper function specifically to lookup functions in the
+ * namespace/schema where the tdigest extension is installed. This makes the lookup of
+ * following aggregate functions easier and less repetitive.
+ */
+static Oid
+LookupTDigestFunction(const char *functionName, int argcount, Oid *argtypes)
+{
+	Oid tdigestSchemaOid = TDigestExtensionSchema();
+	if (tdigestSchemaOid == InvalidOid)
+	{
+		return InvalidOid;
+	}
+
+	char *namespaceName = get_namespace_name(tdigestSchemaOid);
+	return LookupFuncName(
+		list_make2(makeString(namespaceName), makeString(pstrdup(functionName))),
+		argcount, argtypes, true);
+}
+
+
+/*
+ * TDigestExtensionAggTDigest1 performs a lookup for the Oid of the tdigest aggregate;
+ *   tdigest(tdigest)
+ *
+ * If the aggregate is not found InvalidOid is returned.
+ */
+Oid
+TDigestExtensionAggTDigest1(void)
+{
+	return LookupTDigestFunction(TDIGEST_AGGREGATE_NAME, 1,
+								 (Oid[]) { TDigestExtensionTypeOid() });
+}
+
+
+/*
+ * TDigestExtensionAggTDigest2 performs a lookup for the Oid of the tdigest aggregate;
+ *   tdigest(value double precision, compression int)
+ *
+ * If the aggregate is not found InvalidOid is returned.
+ */
+Oid
+TDigestExtensionAggTDigest2(void)
+{
+	return LookupTDigestFunction(TDIGEST_AGGREGATE_NAME, 2,
+								 (Oid[]) { FLOAT8OID, INT4OID });
+}
+
+
+/*
+ * TDigestExtensionAggTDigestPercentile2 performs a lookup for the Oid of the tdigest
+ * aggregate;
+ *   tdigest_percentile(tdigest, double precision)
+ *
+ * If the aggregate is not found InvalidOid is returned.
+ */
+Oid
+TDigestExtensionAggTDigestPercentile2(void)
+{
+	return LookupTDigestFunction(TDIGEST_PERCENTILE_AGGREGATE_NAME, 2,
+								 (Oid[]) { TDigestExtensionTypeOid(), FLOAT8OID });
+}
+
+
+/*
+ * TDigestExtensionAggTDigestPercentile2a performs a lookup for the Oid of the tdigest
+ * aggregate;
+ *   tdigest_percentile(tdigest, double precision[])
+ *
+ * If the aggregate is not found InvalidOid is returned.
+ */
+Oid
+TDigestExtensionAggTDigestPercentile2a(void)
+{
+	return LookupTDigestFunction(TDIGEST_PERCENTILE_AGGREGATE_NAME, 2,
+								 (Oid[]) { TDigestExtensionTypeOid(), FLOAT8ARRAYOID });
+}
+
+
+/*
+ * TDigestExtensionAggTDigestPercentile3 performs a lookup for the Oid of the tdigest
+ * aggregate;
+ *   tdigest_percentile(double precision, int, double precision)
+ *
+ * If the aggregate is not found InvalidOid is returned.
+ */
+Oid
+TDigestExtensionAggTDigestPercentile3(void)
+{
+	return LookupTDigestFunction(TDIGEST_PERCENTILE_AGGREGATE_NAME, 3,
+								 (Oid[]) { FLOAT8OID, INT4OID, FLOAT8OID });
+}
+
+
+/*
+ * TDigestExtensionAggTDigestPercentile3a performs a lookup for the Oid of the tdigest
+ * aggregate;
+ *   tdigest_percentile(double precision, int, double precision[])
+ *
+ * If the aggregate is not found InvalidOid is returned.
+ */
+Oid
+TDigestExtensionAggTDigestPercentile3a(void)
+{
+	return LookupTDigestFunction(TDIGEST_PERCENTILE_AGGREGATE_NAME, 3,
+								 (Oid[]) { FLOAT8OID, INT4OID, FLOAT8ARRAYOID });
+}
+
+
+/*
+ * TDigestExtensionAggTDigestPercentileOf2 performs a lookup for the Oid of the tdigest
+ * aggregate;
+ *   tdigest_percentile_of(tdigest, double precision)
+ *
+ * If the aggregate is not found InvalidOid is returned.
+ */
+Oid
+TDigestExtensionAggTDigestPercentileOf2(void)
+{
+	return LookupTDigestFunction(TDIGEST_PERCENTILE_OF_AGGREGATE_NAME, 2,
+								 (Oid[]) { TDigestExtensionTypeOid(), FLOAT8OID });
+}
+
+
+/*
+ * TDigestExtensionAggTDigestPercentileOf2a performs a lookup for the Oid of the tdigest
+ * aggregate;
+ *   tdigest_percentile_of(tdigest, double precision[])
+ *
+ * If the aggregate is not found InvalidOid is returned.
+ */
+Oid
+TDigestExtensionAggTDigestPercentileOf2a(void)
+{
+	return LookupTDigestFunction(TDIGEST_PERCENTILE_OF_AGGREGATE_NAME, 2,
+								 (Oid[]) { TDigestExtensionTypeOid(), FLOAT8ARRAYOID });
+}
+
+
+/*
+ * TDigestExtensionAggTDigestPercentileOf3 performs a lookup for the Oid of the tdigest
+ * aggregate;
+ *   tdigest_percentile_of(double precision, int, double precision)
+ *
+ * If the aggregate is not found InvalidOid is returned.
+ */
+Oid
+TDigestExtensionAggTDigestPercentileOf3(void)
+{
+	return LookupTDigestFunction(TDIGEST_PERCENTILE_OF_AGGREGATE_NAME, 3,
+								 (Oid[]) { FLOAT8OID, INT4OID, FLOAT8OID });
+}
+
+
+/*
+ * TDigestExtensionAggTDigestPercentileOf3a performs a lookup for the Oid of the tdigest
+ * aggregate;
+ *   tdigest_percentile_of(double precision, int, double precision[])
+ *
+ * If the aggregate is not found InvalidOid is returned.
+ */
+Oid
+TDigestExtensionAggTDigestPercentileOf3a(void)
+{
+	return LookupTDigestFunction(TDIGEST_PERCENTILE_OF_AGGREGATE_NAME, 3,
+								 (Oid[]) { FLOAT8OID, INT4OID, FLOAT8ARRAYOID });
+}
@@ -0,0 +1,68 @@
+/*-------------------------------------------------------------------------
+ *
+ * time_partitions.c
+ *   Keeps the partitions of the tables in pg_dist_time_partition_policy up
+ *   to date.
+ *
+ *   Every citus.time_partition_maintenance_interval, the maintenance daemon
+ *   on the coordinator calls citus_run_time_partition_maintenance(), which
+ *   creates the partitions that cover the premake interval of each table
+ *   and drops or detaches the partitions that are older than the retention
+ *   interval. The partitions are created and dropped through the regular
+ *   utility hook, which propagates them to the shards of distributed tables.
+ *
+ * Copyright (c) Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include "postgres.h"
+
+#include "executor/spi.h"
+#include "distributed/master_protocol.h"
+#include "distributed/time_partitions.h"
+#include "utils/snapmgr.h"
+
+
+/* GUC, milliseconds between partition maintenance runs, 0 disables them */
+int TimePartitionMaintenanceInterval = 0;
+
+
+/*
+ * MaintainTimePartitions creates and expires the partitions of the time
+ * partitioned tables that have a policy. It only runs on the coordinator,
+ * since the partitions of distributed tables are created from there.
+ */
+void
+MaintainTimePartitions(void)
+{
+	if (!IsCoordinator())
+	{
+		return;
+	}
+
+	PushActiveSnapshot(GetTransactionSnapshot());
+
+	int spiConnected = SPI_connect();
+	if (spiConnected != SPI_OK_CONNECT)
+	{
+		ereport(ERROR, (errmsg("could not connect to SPI manager")));
+	}
+
+	const char *maintenanceQuery =
+		"SELECT pg_catalog.citus_run_time_partition_maintenance()";
+
+	int spiStatus = SPI_execute(maintenanceQuery, false, 0);
+	if (spiStatus != SPI_OK_SELECT)
+	{
+		ereport(ERROR, (errmsg("could not run the time partition maintenance")));
+	}
+
+	int spiFinished = SPI_finish();
+	if (spiFinished != SPI_OK_FINISH)
+	{
+		ereport(ERROR, (errmsg("could not disconnect from SPI manager")));
+	}
+
+	PopActiveSnapshot();
+}
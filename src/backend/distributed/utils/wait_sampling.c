@@ -0,0 +1,438 @@
+/*-------------------------------------------------------------------------
+ *
+ * wait_sampling.c
+ *	  Periodically records what the backends that take part in distributed
+ *	  queries are waiting on, such that wait-time profiles can be built
+ *	  without repeatedly querying citus_dist_stat_activity on all nodes.
+ *
+ *	  Backends publish what they are waiting on inside Citus (connection
+ *	  establishment, a slot in the shared connection pool, remote results,
+ *	  COPY, intermediate results) in a shared array indexed by pgprocno with
+ *	  a single atomic write. The maintenance daemon of each database
+ *	  periodically combines those with the Postgres wait events (e.g. locks)
+ *	  of the backends in its database, and appends the waiting backends to
+ *	  a ring buffer of citus.wait_sampling_buffer_size samples in shared
+ *	  memory, which is shown by citus_wait_samples.
+ *
+ * Copyright (c) Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include "postgres.h"
+
+#include "funcapi.h"
+#include "miscadmin.h"
+#include "pgstat.h"
+
+#include "catalog/pg_authid.h"
+#include "distributed/backend_data.h"
+#include "distributed/metadata_cache.h"
+#include "distributed/tuplestore.h"
+#include "distributed/wait_sampling.h"
+#include "port/atomics.h"
+#include "storage/ipc.h"
+#include "storage/lwlock.h"
+#include "storage/proc.h"
+#include "storage/shmem.h"
+#include "utils/acl.h"
+#include "utils/builtins.h"
+#include "utils/timestamp.h"
+
+
+#define CITUS_WAIT_SAMPLES_COLUMN_COUNT 9
+
+
+/* a single sample of a waiting backend */
+typedef struct CitusWaitSample
+{
+	TimestampTz sampleTime;
+	int pid;
+	Oid databaseId;
+	Oid userId;
+	int initiatorNodeIdentifier;
+	bool transactionOriginator;
+	uint64 transactionNumber;
+	CitusWaitState citusWaitState;
+	uint32 waitEventInfo;
+} CitusWaitSample;
+
+
+/*
+ * WaitSamplingShmemData contains the wait states of all backends and the
+ * ring buffer of samples, which is protected by the lock.
+ */
+typedef struct WaitSamplingShmemData
+{
+	int trancheId;
+	char *lockTrancheName;
+	LWLock lock;
+
+	/* total number of samples taken, the next sample goes to this modulo size */
+	uint64 sampleCount;
+
+	/* wait states of all backends, indexed by pgprocno */
+	pg_atomic_uint32 *waitStates;
+
+	CitusWaitSample samples[FLEXIBLE_ARRAY_MEMBER];
+} WaitSamplingShmemData;
+
+
+/* GUC, number of milliseconds between samples, 0 disables sampling */
+int WaitSamplingInterval = 1000;
+
+/* GUC, number of samples kept in the ring buffer, 0 disables the wait states */
+int WaitSamplingBufferSize = 10000;
+
+static shmem_startup_hook_type prev_shmem_startup_hook = NULL;
+static WaitSamplingShmemData *WaitSamplingShmem = NULL;
+
+
+static size_t WaitSamplingShmemSize(void);
+static void WaitSamplingShmemInit(void);
+static const char * CitusWaitStateName(CitusWaitState waitState);
+
+
+PG_FUNCTION_INFO_V1(citus_wait_samples);
+PG_FUNCTION_INFO_V1(citus_wait_samples_reset);
+
+
+/*
+ * InitializeWaitSampling, called at server start, requests the shared memory
+ * for the wait states and the samples.
+ */
+void
+InitializeWaitSampling(void)
+{
+	if (WaitSamplingBufferSize == 0)
+	{
+		return;
+	}
+
+	if (!IsUnderPostmaster)
+	{
+		RequestAddinShmemSpace(WaitSamplingShmemSize());
+	}
+
+	prev_shmem_startup_hook = shmem_startup_hook;
+	shmem_startup_hook = WaitSamplingShmemInit;
+}
+
+
+/*
+ * SetCitusWaitState publishes what the current backend is waiting on, or that
+ * it stopped waiting when waitState is CITUS_WAIT_NONE. It only performs a
+ * single unlocked write, so it can be called around every wait.
+ */
+void
+SetCitusWaitState(CitusWaitState waitState)
+{
+	if (WaitSamplingShmem == NULL || MyProc == NULL)
+	{
+		return;
+	}
+
+	pg_atomic_write_u32(&WaitSamplingShmem->waitStates[MyProc->pgprocno], waitState);
+}
+
+
+/*
+ * SampleCitusWaitStates records a sample for every backend in the current
+ * database that is waiting inside Citus, or that takes part in a distributed
+ * query and is waiting on something else than its client. It is called
+ * periodically by the maintenance daemon.
+ */
+void
+SampleCitusWaitStates(void)
+{
+	int totalProcs = TotalProcCount();
+
+	if (WaitSamplingShmem == NULL)
+	{
+		return;
+	}
+
+	TimestampTz sampleTime = GetCurrentTimestamp();
+
+	LWLockAcquire(&WaitSamplingShmem->lock, LW_EXCLUSIVE);
+
+	for (int procIndex = 0; procIndex < totalProcs; procIndex++)
+	{
+		PGPROC *proc = &ProcGlobal->allProcs[procIndex];
+		BackendData backendData;
+
+		if (proc->pid == 0 || proc->pid == MyProcPid ||
+			proc->databaseId != MyDatabaseId)
+		{
+			continue;
+		}
+
+		CitusWaitState citusWaitState =
+			pg_atomic_read_u32(&WaitSamplingShmem->waitStates[procIndex]);
+
+		/* the wait event is written without a lock, read it only once */
+		uint32 waitEventInfo = *((volatile uint32 *) &proc->wait_event_info);
+
+		if (citusWaitState == CITUS_WAIT_NONE)
+		{
+			uint32 waitEventClass = waitEventInfo & 0xFF000000;
+
+			/* idle backends wait for their client or for activity */
+			if (waitEventInfo == 0 || waitEventClass == PG_WAIT_CLIENT ||
+				waitEventClass == PG_WAIT_ACTIVITY)
+			{
+				continue;
+			}
+		}
+
+		GetBackendDataForProc(proc, &backendData);
+
+		/* we're only interested in backends that take part in distributed queries */
+		if (citusWaitState == CITUS_WAIT_NONE &&
+			backendData.citusBackend.initiatorNodeIdentifier < 0)
+		{
+			continue;
+		}
+
+		uint64 sampleIndex = WaitSamplingShmem->sampleCount % WaitSamplingBufferSize;
+		CitusWaitSample *sample = &WaitSamplingShmem->samples[sampleIndex];
+
+		sample->sampleTime = sampleTime;
+		sample->pid = proc->pid;
+		sample->databaseId = proc->databaseId;
+		sample->userId = proc->roleId;
+		sample->initiatorNodeIdentifier =
+			backendData.citusBackend.initiatorNodeIdentifier;
+		sample->transactionOriginator = backendData.citusBackend.transactionOriginator;
+		sample->transactionNumber = backendData.transactionId.transactionNumber;
+		sample->citusWaitState = citusWaitState;
+		sample->waitEventInfo = waitEventInfo;
+
+		WaitSamplingShmem->sampleCount++;
+	}
+
+	LWLockRelease(&WaitSamplingShmem->lock);
+}
+
+
+/*
+ * citus_wait_samples returns the samples in the ring buffer, oldest first.
+ * Unless the user is a member of pg_monitor, only the samples of the user's
+ * own backends are returned.
+ */
+Datum
+citus_wait_samples(PG_FUNCTION_ARGS)
+{
+	TupleDesc tupleDescriptor = NULL;
+	Oid userId = GetUserId();
+	bool showAllSamples = is_member_of_role(userId, DEFAULT_ROLE_MONITOR);
+
+	CheckCitusVersion(ERROR);
+
+	Tuplestorestate *tupleStore = SetupTuplestore(fcinfo, &tupleDescriptor);
+
+	if (WaitSamplingShmem == NULL)
+	{
+		tuplestore_donestoring(tupleStore);
+
+		PG_RETURN_VOID();
+	}
+
+	LWLockAcquire(&WaitSamplingShmem->lock, LW_SHARED);
+
+	uint64 sampleCount = WaitSamplingShmem->sampleCount;
+	uint64 firstSample = 0;
+
+	if (sampleCount > WaitSamplingBufferSize)
+	{
+		firstSample = sampleCount - WaitSamplingBufferSize;
+	}
+
+	for (uint64 sampleNumber = firstSample; sampleNumber < sampleCount; sampleNumber++)
+	{
+		CitusWaitSample *sample =
+			&WaitSamplingShmem->samples[sampleNumber % WaitSamplingBufferSize];
+		Datum values[CITUS_WAIT_SAMPLES_COLUMN_COUNT];
+		bool isNulls[CITUS_WAIT_SAMPLES_COLUMN_COUNT];
+
+		if (!showAllSamples && sample->userId != userId)
+		{
+			continue;
+		}
+
+		memset(values, 0, sizeof(values));
+		memset(isNulls, false, sizeof(isNulls));
+
+		values[0] = TimestampTzGetDatum(sample->sampleTime);
+		values[1] = ObjectIdGetDatum(sample->databaseId);
+		values[2] = Int32GetDatum(sample->pid);
+		values[3] = Int32GetDatum(sample->initiatorNodeIdentifier);
+		values[4] = BoolGetDatum(!sample->transactionOriginator);
+		values[5] = UInt64GetDatum(sample->transactionNumber);
+
+		const char *citusWaitStateName = CitusWaitStateName(sample->citusWaitState);
+		if (citusWaitStateName != NULL)
+		{
+			values[6] = CStringGetTextDatum(citusWaitStateName);
+		}
+		else
+		{
+			isNulls[6] = true;
+		}
+
+		const char *waitEventType = pgstat_get_wait_event_type(sample->waitEventInfo);
+		const char *waitEvent = pgstat_get_wait_event(sample->waitEventInfo);
+		if (waitEventType != NULL && waitEvent != NULL)
+		{
+			values[7] = CStringGetTextDatum(waitEventType);
+			values[8] = CStringGetTextDatum(waitEvent);
+		}
+		else
+		{
+			isNulls[7] = true;
+			isNulls[8] = true;
+		}
+
+		tuplestore_putvalues(tupleStore, tupleDescriptor, values, isNulls);
+	}
+
+	LWLockRelease(&WaitSamplingShmem->lock);
+
+	tuplestore_donestoring(tupleStore);
+
+	PG_RETURN_VOID();
+}
+
+
+/*
+ * citus_wait_samples_reset removes all samples from the ring buffer.
+ */
+Datum
+citus_wait_samples_reset(PG_FUNCTION_ARGS)
+{
+	CheckCitusVersion(ERROR);
+
+	if (WaitSamplingShmem == NULL)
+	{
+		PG_RETURN_VOID();
+	}
+
+	LWLockAcquire(&WaitSamplingShmem->lock, LW_EXCLUSIVE);
+	WaitSamplingShmem->sampleCount = 0;
+	LWLockRelease(&WaitSamplingShmem->lock);
+
+	PG_RETURN_VOID();
+}
+
+
+/*
+ * CitusWaitStateName returns the name of the given wait state as shown in
+ * citus_wait_samples, or NULL if the backend is not waiting inside Citus.
+ */
+static const char *
+CitusWaitStateName(CitusWaitState waitState)
+{
+	switch (waitState)
+	{
+		case CITUS_WAIT_CONNECTION_ESTABLISHMENT:
+		{
+			return "ConnectionEstablishment";
+		}
+
+		case CITUS_WAIT_CONNECTION_SLOT:
+		{
+			return "SharedPoolSlot";
+		}
+
+		case CITUS_WAIT_REMOTE_RESULT:
+		{
+			return "RemoteResult";
+		}
+
+		case CITUS_WAIT_COPY:
+		{
+			return "CopyData";
+		}
+
+		case CITUS_WAIT_INTERMEDIATE_RESULT:
+		{
+			return "IntermediateResult";
+		}
+
+		case CITUS_WAIT_NONE:
+		default:
+		{
+			return NULL;
+		}
+	}
+}
+
+
+/*
+ * WaitSamplingShmemSize returns the size of the shared memory needed for the
+ * wait states and the samples.
+ */
+static size_t
+WaitSamplingShmemSize(void)
+{
+	Size size = 0;
+
+	size = add_size(size, offsetof(WaitSamplingShmemData, samples));
+	size = add_size(size, mul_size(sizeof(CitusWaitSample), WaitSamplingBufferSize));
+	size = add_size(size, mul_size(sizeof(pg_atomic_uint32), TotalProcCount()));
+
+	return size;
+}
+
+
+/*
+ * WaitSamplingShmemInit initializes the shared memory for the wait states and
+ * the samples.
+ */
+static void
+WaitSamplingShmemInit(void)
+{
+	bool alreadyInitialized = false;
+
+	LWLockAcquire(AddinShmemInitLock, LW_EXCLUSIVE);
+
+	WaitSamplingShmem =
+		(WaitSamplingShmemData *) ShmemInitStruct("Citus Wait Sampling",
+												  WaitSamplingShmemSize(),
+												  &alreadyInitialized);
+
+	/*
+	 * Might already be initialized on EXEC_BACKEND type platforms that call
+	 * shared library initialization functions in every backend.
+	 */
+	if (!alreadyInitialized)
+	{
+		int totalProcs = TotalProcCount();
+
+		WaitSamplingShmem->trancheId = LWLockNewTrancheId();
+		WaitSamplingShmem->lockTrancheName = "Citus Wait Sampling";
+		LWLockRegisterTranche(WaitSamplingShmem->trancheId,
+							  WaitSamplingShmem->lockTrancheName);
+
+		LWLockInitialize(&WaitSamplingShmem->lock, WaitSamplingShmem->trancheId);
+
+		WaitSamplingShmem->sampleCount = 0;
+
+		/* the wait states follow the ring buffer */
+		CitusWaitSample *samplesEnd = &WaitSamplingShmem->samples[WaitSamplingBufferSize];
+		WaitSamplingShmem->waitStates = (pg_atomic_uint32 *) samplesEnd;
+
+		for (int procIndex = 0; procIndex < totalProcs; procIndex++)
+		{
+			pg_atomic_init_u32(&WaitSamplingShmem->waitStates[procIndex],
+							   CITUS_WAIT_NONE);
+		}
+	}
+
+	LWLockRelease(AddinShmemInitLock);
+
+	if (prev_shmem_startup_hook != NULL)
+	{
+		prev_shmem_startup_hook();
+	}
+}
@@ -31,6 +31,7 @@
 
 #include "commands/dbcommands.h"
 #include "distributed/citus_safe_lib.h"
+#include "distributed/job_cache_space.h"
 #include "distributed/listutils.h"
 #include "distributed/multi_client_executor.h"
 #include "distributed/multi_server_executor.h"
@@ -350,6 +351,9 @@ TrackerCleanupJobDirectories(void)
 	CitusRemoveDirectory(jobCacheDirectory->data);
 	CitusCreateDirectory(jobCacheDirectory);
 
+	/* remove directories on other locations that lost their link */
+	RemoveJobCacheLocations();
+
 	FreeStringInfo(jobCacheDirectory);
 }
 
@@ -1084,7 +1088,8 @@ CreateJobDirectoryIfNotExists(uint64 jobId)
 	bool jobDirectoryExists = DirectoryExists(jobDirectoryName);
 	if (!jobDirectoryExists)
 	{
-		CitusCreateDirectory(jobDirectoryName);
+		bool existsOk = false;
+		CreateJobCacheDirectory(jobDirectoryName->data, existsOk);
 	}
 
 	FreeStringInfo(jobDirectoryName);
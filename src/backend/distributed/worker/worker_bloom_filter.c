@@ -0,0 +1,221 @@
+/*-------------------------------------------------------------------------
+ *
+ * worker_bloom_filter.c
+ *
+ * Routines for building and probing Bloom filters over the hash values of
+ * repartition join keys. The coordinator builds a filter over the join keys of
+ * the smaller side of a dual hash repartition join, and the map tasks of the
+ * larger side use it to skip rows that cannot have a join partner before they
+ * are written to partition files.
+ *
+ * A filter is a plain bytea whose bits are addressed through double hashing of
+ * the 32-bit hash value of the join key, which means filters of the same size
+ * can be combined with a bitwise or.
+ *
+ * Copyright (c) Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include "postgres.h"
+
+#include "access/hash.h"
+#include "distributed/bloom_filter.h"
+#include "utils/builtins.h"
+
+
+static uint32 BloomFilterBitCount(bytea *bloomFilter);
+static uint32 BloomFilterProbeBit(uint32 hashValue, uint32 probeIndex, uint32 bitCount);
+
+
+/* exports for SQL callable functions */
+PG_FUNCTION_INFO_V1(worker_bloom_filter_build_sfunc);
+PG_FUNCTION_INFO_V1(worker_bloom_filter_contains);
+
+
+/*
+ * worker_bloom_filter_build_sfunc is the transition function of the
+ * worker_bloom_filter_build aggregate. The function allocates a filter of the
+ * given size in bytes on the first call, and then adds the given hash value to
+ * the filter in place. NULL hash values are skipped, since they never find a
+ * join partner.
+ */
+Datum
+worker_bloom_filter_build_sfunc(PG_FUNCTION_ARGS)
+{
+	bytea *bloomFilter = NULL;
+	MemoryContext aggregateContext = NULL;
+
+	if (!AggCheckCallContext(fcinfo, &aggregateContext))
+	{
+		ereport(ERROR, (errmsg("worker_bloom_filter_build_sfunc called from "
+							   "non-aggregate context")));
+	}
+
+	if (PG_ARGISNULL(0))
+	{
+		int32 filterSize = PG_ARGISNULL(2) ? 0 : PG_GETARG_INT32(2);
+		if (filterSize <= 0)
+		{
+			ereport(ERROR, (errmsg("bloom filter size must be positive")));
+		}
+
+		bloomFilter = MemoryContextAllocZero(aggregateContext, VARHDRSZ + filterSize);
+		SET_VARSIZE(bloomFilter, VARHDRSZ + filterSize);
+	}
+	else
+	{
+		/* we allocated the filter ourselves, so it is never toasted */
+		bloomFilter = (bytea *) PG_GETARG_POINTER(0);
+	}
+
+	if (!PG_ARGISNULL(1))
+	{
+		BloomFilterAddHash(bloomFilter, (uint32) PG_GETARG_INT32(1));
+	}
+
+	PG_RETURN_BYTEA_P(bloomFilter);
+}
+
+
+/*
+ * worker_bloom_filter_contains returns whether the given hash value may have
+ * been added to the given filter. False positives are possible, false negatives
+ * are not.
+ */
+Datum
+worker_bloom_filter_contains(PG_FUNCTION_ARGS)
+{
+	bytea *bloomFilter = PG_GETARG_BYTEA_PP(0);
+	uint32 hashValue = (uint32) PG_GETARG_INT32(1);
+
+	PG_RETURN_BOOL(BloomFilterContainsHash(bloomFilter, hashValue));
+}
+
+
+/*
+ * BloomFilterAddHash sets the bits of the given hash value in the given filter.
+ * The filter must not be toasted or packed.
+ */
+void
+BloomFilterAddHash(bytea *bloomFilter, uint32 hashValue)
+{
+	uint8 *filterBits = (uint8 *) VARDATA(bloomFilter);
+	uint32 bitCount = BloomFilterBitCount(bloomFilter);
+
+	for (uint32 probeIndex = 0; probeIndex < BLOOM_FILTER_PROBE_COUNT; probeIndex++)
+	{
+		uint32 bit = BloomFilterProbeBit(hashValue, probeIndex, bitCount);
+
+		filterBits[bit / BITS_PER_BYTE] |= (1 << (bit % BITS_PER_BYTE));
+	}
+}
+
+
+/*
+ * BloomFilterContainsHash returns whether all bits of the given hash value are
+ * set in the given filter. An empty filter contains all hash values.
+ */
+bool
+BloomFilterContainsHash(bytea *bloomFilter, uint32 hashValue)
+{
+	uint8 *filterBits = (uint8 *) VARDATA_ANY(bloomFilter);
+	uint32 bitCount = BloomFilterBitCount(bloomFilter);
+
+	if (bitCount == 0)
+	{
+		return true;
+	}
+
+	for (uint32 probeIndex = 0; probeIndex < BLOOM_FILTER_PROBE_COUNT; probeIndex++)
+	{
+		uint32 bit = BloomFilterProbeBit(hashValue, probeIndex, bitCount);
+
+		if ((filterBits[bit / BITS_PER_BYTE] & (1 << (bit % BITS_PER_BYTE))) == 0)
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+
+/*
+ * BloomFilterUnion adds all hash values of the other filter to the given filter.
+ * Both filters need to be of the same size, and the given filter must not be
+ * toasted or packed.
+ */
+void
+BloomFilterUnion(bytea *bloomFilter, bytea *otherBloomFilter)
+{
+	uint8 *filterBits = (uint8 *) VARDATA(bloomFilter);
+	uint8 *otherFilterBits = (uint8 *) VARDATA_ANY(otherBloomFilter);
+	Size filterSize = VARSIZE(bloomFilter) - VARHDRSZ;
+
+	if (VARSIZE_ANY_EXHDR(otherBloomFilter) != filterSize)
+	{
+		ereport(ERROR, (errmsg("cannot combine bloom filters of different sizes")));
+	}
+
+	for (Size byteIndex = 0; byteIndex < filterSize; byteIndex++)
+	{
+		filterBits[byteIndex] |= otherFilterBits[byteIndex];
+	}
+}
+
+
+/*
+ * BloomFilterFillFactor returns the fraction of bits that are set in the given
+ * filter. A filter that has most of its bits set filters out hardly any rows.
+ */
+double
+BloomFilterFillFactor(bytea *bloomFilter)
+{
+	uint8 *filterBits = (uint8 *) VARDATA_ANY(bloomFilter);
+	Size filterSize = VARSIZE_ANY_EXHDR(bloomFilter);
+	uint64 setBitCount = 0;
+
+	if (filterSize == 0)
+	{
+		return 1.0;
+	}
+
+	for (Size byteIndex = 0; byteIndex < filterSize; byteIndex++)
+	{
+		uint8 filterByte = filterBits[byteIndex];
+
+		while (filterByte != 0)
+		{
+			filterByte &= filterByte - 1;
+			setBitCount++;
+		}
+	}
+
+	return (double) setBitCount / (filterSize * BITS_PER_BYTE);
+}
+
+
+/*
+ * BloomFilterBitCount returns the number of bits in the given filter.
+ */
+static uint32
+BloomFilterBitCount(bytea *bloomFilter)
+{
+	return VARSIZE_ANY_EXHDR(bloomFilter) * BITS_PER_BYTE;
+}
+
+
+/*
+ * BloomFilterProbeBit returns the bit to check for the given probe of a hash
+ * value. We derive the probes from two hash values through double hashing, and
+ * keep the second hash odd so the probes of a value do not collapse.
+ */
+static uint32
+BloomFilterProbeBit(uint32 hashValue, uint32 probeIndex, uint32 bitCount)
+{
+	uint32 secondHashValue = DatumGetUInt32(hash_uint32(hashValue)) | 1;
+
+	return (uint32) (((uint64) hashValue + (uint64) probeIndex * secondHashValue) %
+					 bitCount);
+}
@@ -57,12 +57,16 @@
 /* Local functions forward declarations */
 static void FetchRegularFileAsSuperUser(const char *nodeName, uint32 nodePort,
 										StringInfo remoteFilename,
-										StringInfo localFilename);
+										StringInfo localFilename, bool compress);
 static bool ReceiveRegularFile(const char *nodeName, uint32 nodePort,
 							   const char *nodeUser, StringInfo transmitCommand,
-							   StringInfo filePath);
+							   StringInfo filePath, bool decompress);
 static void ReceiveResourceCleanup(int32 connectionId, const char *filename,
 								   int32 fileDescriptor);
+static void AppendRemoteTableToShard(text *shardQualifiedNameText,
+									 text *sourceQualifiedNameText,
+									 char *sourceNodeName, uint32 sourceNodePort,
+									 int32 rangeIndex, int32 rangeCount);
 static void CitusDeleteFile(const char *filename);
 static bool check_log_statement(List *stmt_list);
 static void AlterSequenceMinMax(Oid sequenceId, char *schemaName, char *sequenceName,
@@ -73,9 +77,11 @@ static void SetDefElemArg(AlterSeqStmt *statement, const char *name, Node *arg);
 /* exports for SQL callable functions */
 PG_FUNCTION_INFO_V1(worker_fetch_partition_file);
 PG_FUNCTION_INFO_V1(worker_apply_shard_ddl_command);
+PG_FUNCTION_INFO_V1(worker_apply_multi_shard_ddl_command);
 PG_FUNCTION_INFO_V1(worker_apply_inter_shard_ddl_command);
 PG_FUNCTION_INFO_V1(worker_apply_sequence_command);
 PG_FUNCTION_INFO_V1(worker_append_table_to_shard);
+PG_FUNCTION_INFO_V1(worker_append_table_range_to_shard);
 
 /*
  * Following UDFs are stub functions, you can check their comments for more
@@ -91,6 +97,8 @@ PG_FUNCTION_INFO_V1(master_expire_table_cache);
  * worker_fetch_partition_file fetches a partition file from the remote node.
  * The function assumes an upstream compute task depends on this partition file,
  * and therefore directly fetches the file into the upstream task's directory.
+ * If the optional compress argument is true, the remote node sends the file in
+ * compressed frames, which we decompress as they arrive.
  */
 Datum
 worker_fetch_partition_file(PG_FUNCTION_ARGS)
@@ -101,6 +109,7 @@ worker_fetch_partition_file(PG_FUNCTION_ARGS)
 	uint32 upstreamTaskId = PG_GETARG_UINT32(3);
 	text *nodeNameText = PG_GETARG_TEXT_P(4);
 	uint32 nodePort = PG_GETARG_UINT32(5);
+	bool compress = (PG_NARGS() > 6) ? PG_GETARG_BOOL(6) : false;
 
 	/* remote filename is <jobId>/<partitionTaskId>/<partitionFileId> */
 	StringInfo remoteDirectoryName = TaskDirectoryName(jobId, partitionTaskId);
@@ -126,7 +135,8 @@ worker_fetch_partition_file(PG_FUNCTION_ARGS)
 	char *nodeName = text_to_cstring(nodeNameText);
 
 	/* we've made sure the file names are sanitized, safe to fetch as superuser */
-	FetchRegularFileAsSuperUser(nodeName, nodePort, remoteFilename, taskFilename);
+	FetchRegularFileAsSuperUser(nodeName, nodePort, remoteFilename, taskFilename,
+								compress);
 
 	PG_RETURN_VOID();
 }
@@ -167,7 +177,8 @@ UserTaskFilename(StringInfo directoryName, uint32 taskId)
  */
 static void
 FetchRegularFileAsSuperUser(const char *nodeName, uint32 nodePort,
-							StringInfo remoteFilename, StringInfo localFilename)
+							StringInfo remoteFilename, StringInfo localFilename,
+							bool compress)
 {
 	char *userName = CurrentUserName();
 	uint32 randomId = (uint32) random();
@@ -182,14 +193,16 @@ FetchRegularFileAsSuperUser(const char *nodeName, uint32 nodePort,
 					 MIN_TASK_FILENAME_WIDTH, randomId, ATTEMPT_FILE_SUFFIX);
 
 	StringInfo transmitCommand = makeStringInfo();
-	appendStringInfo(transmitCommand, TRANSMIT_WITH_USER_COMMAND, remoteFilename->data,
-					 quote_literal_cstr(userName));
+	appendStringInfo(transmitCommand,
+					 compress ? TRANSMIT_COMPRESSED_WITH_USER_COMMAND :
+					 TRANSMIT_WITH_USER_COMMAND,
+					 remoteFilename->data, quote_literal_cstr(userName));
 
 	/* connect as superuser to give file access */
 	char *nodeUser = CitusExtensionOwnerName();
 
 	bool received = ReceiveRegularFile(nodeName, nodePort, nodeUser, transmitCommand,
-									   attemptFilename);
+									   attemptFilename, compress);
 	if (!received)
 	{
 		ereport(ERROR, (errmsg("could not receive file \"%s\" from %s:%u",
@@ -211,13 +224,14 @@ FetchRegularFileAsSuperUser(const char *nodeName, uint32 nodePort,
  * ReceiveRegularFile creates a local file at the given file path, and connects
  * to remote database that has the given node name and port number. The function
  * then issues the given transmit command using client-side logic (libpq), reads
- * the remote file's contents, and appends these contents to the local file. On
- * success, the function returns success; on failure, it cleans up all resources
- * and returns false.
+ * the remote file's contents, and appends these contents to the local file. If
+ * decompress is true, the contents arrive in compressed frames that we
+ * decompress before appending them. On success, the function returns success;
+ * on failure, it cleans up all resources and returns false.
  */
 static bool
 ReceiveRegularFile(const char *nodeName, uint32 nodePort, const char *nodeUser,
-				   StringInfo transmitCommand, StringInfo filePath)
+				   StringInfo transmitCommand, StringInfo filePath, bool decompress)
 {
 	char filename[MAXPGPATH];
 	const int fileFlags = (O_APPEND | O_CREAT | O_RDWR | O_TRUNC | PG_BINARY);
@@ -293,7 +307,17 @@ ReceiveRegularFile(const char *nodeName, uint32 nodePort, const char *nodeUser,
 	/* loop until we receive and append all the data from remote node */
 	while (!copyDone)
 	{
-		CopyStatus copyStatus = MultiClientCopyData(connectionId, fileDescriptor, NULL);
+		CopyStatus copyStatus = CLIENT_INVALID_COPY;
+		if (decompress)
+		{
+			copyStatus = MultiClientCopyDecompressedData(connectionId, fileDescriptor,
+														 NULL);
+		}
+		else
+		{
+			copyStatus = MultiClientCopyData(connectionId, fileDescriptor, NULL);
+		}
+
 		if (copyStatus == CLIENT_COPY_DONE)
 		{
 			copyDone = true;
@@ -403,6 +427,43 @@ worker_apply_shard_ddl_command(PG_FUNCTION_ARGS)
 }
 
 
+/*
+ * worker_apply_multi_shard_ddl_command applies the given DDL command to each
+ * of the given shards, like a worker_apply_shard_ddl_command call per shard,
+ * such that the coordinator needs a single call per node.
+ */
+Datum
+worker_apply_multi_shard_ddl_command(PG_FUNCTION_ARGS)
+{
+	ArrayType *shardIdArrayObject = PG_GETARG_ARRAYTYPE_P(0);
+	text *schemaNameText = PG_GETARG_TEXT_P(1);
+	text *ddlCommandText = PG_GETARG_TEXT_P(2);
+
+	char *schemaName = text_to_cstring(schemaNameText);
+	const char *ddlCommand = text_to_cstring(ddlCommandText);
+	Datum *shardIdArray = DeconstructArrayObject(shardIdArrayObject);
+	int32 shardIdCount = ArrayObjectCount(shardIdArrayObject);
+
+	CheckCitusVersion(ERROR);
+
+	for (int32 shardIndex = 0; shardIndex < shardIdCount; shardIndex++)
+	{
+		uint64 shardId = DatumGetInt64(shardIdArray[shardIndex]);
+
+		/* names are extended in place, so parse the command for every shard */
+		Node *ddlCommandNode = ParseTreeNode(ddlCommand);
+
+		RelayEventExtendNames(ddlCommandNode, schemaName, shardId);
+		CitusProcessUtility(ddlCommandNode, ddlCommand, PROCESS_UTILITY_TOPLEVEL, NULL,
+							None_Receiver, NULL);
+
+		CommandCounterIncrement();
+	}
+
+	PG_RETURN_VOID();
+}
+
+
 /*
  * worker_apply_inter_shard_ddl_command extends table, index, or constraint names in
  * the given DDL command. The function then applies this extended DDL command
@@ -611,9 +672,63 @@ worker_append_table_to_shard(PG_FUNCTION_ARGS)
 	text *sourceNodeNameText = PG_GETARG_TEXT_P(2);
 	uint32 sourceNodePort = PG_GETARG_UINT32(3);
 
+	CheckCitusVersion(ERROR);
+
+	/* the whole table is the only block range */
+	AppendRemoteTableToShard(shardQualifiedNameText, sourceQualifiedNameText,
+							 text_to_cstring(sourceNodeNameText), sourceNodePort,
+							 0, 1);
+
+	PG_RETURN_VOID();
+}
+
+
+/*
+ * worker_append_table_range_to_shard appends the rows of the given remote
+ * table in the blocks whose number modulo rangeCount is rangeIndex to the given
+ * shard. Together, the calls for all range indexes append the whole table, and
+ * unlike worker_append_table_to_shard they can run concurrently for the same
+ * shard to copy it over multiple streams.
+ */
+Datum
+worker_append_table_range_to_shard(PG_FUNCTION_ARGS)
+{
+	text *shardQualifiedNameText = PG_GETARG_TEXT_P(0);
+	text *sourceQualifiedNameText = PG_GETARG_TEXT_P(1);
+	text *sourceNodeNameText = PG_GETARG_TEXT_P(2);
+	uint32 sourceNodePort = PG_GETARG_UINT32(3);
+	int32 rangeIndex = PG_GETARG_INT32(4);
+	int32 rangeCount = PG_GETARG_INT32(5);
+
+	CheckCitusVersion(ERROR);
+
+	if (rangeCount < 1 || rangeIndex < 0 || rangeIndex >= rangeCount)
+	{
+		ereport(ERROR, (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+						errmsg("invalid block range %d of %d", rangeIndex,
+							   rangeCount)));
+	}
+
+	AppendRemoteTableToShard(shardQualifiedNameText, sourceQualifiedNameText,
+							 text_to_cstring(sourceNodeNameText), sourceNodePort,
+							 rangeIndex, rangeCount);
+
+	PG_RETURN_VOID();
+}
+
+
+/*
+ * AppendRemoteTableToShard fetches the rows of the given remote table in the
+ * given block range into the local file system, and then appends the file
+ * data into the given shard. A range count of 1 fetches the whole table.
+ */
+static void
+AppendRemoteTableToShard(text *shardQualifiedNameText, text *sourceQualifiedNameText,
+						 char *sourceNodeName, uint32 sourceNodePort,
+						 int32 rangeIndex, int32 rangeCount)
+{
 	List *shardQualifiedNameList = textToQualifiedNameList(shardQualifiedNameText);
 	List *sourceQualifiedNameList = textToQualifiedNameList(sourceQualifiedNameText);
-	char *sourceNodeName = text_to_cstring(sourceNodeNameText);
 
 	char *shardTableName = NULL;
 	char *shardSchemaName = NULL;
@@ -623,8 +738,6 @@ worker_append_table_to_shard(PG_FUNCTION_ARGS)
 	Oid savedUserId = InvalidOid;
 	int savedSecurityContext = 0;
 
-	CheckCitusVersion(ERROR);
-
 	/* We extract schema names and table names from qualified names */
 	DeconstructQualifiedName(shardQualifiedNameList, &shardSchemaName, &shardTableName);
 
@@ -634,16 +747,25 @@ worker_append_table_to_shard(PG_FUNCTION_ARGS)
 	/*
 	 * We lock on the shardId, but do not unlock. When the function returns, and
 	 * the transaction for this function commits, this lock will automatically
-	 * be released. This ensures appends to a shard happen in a serial manner.
+	 * be released. This ensures appends to a shard happen in a serial manner,
+	 * except for appends of different block ranges of the same copy, which
+	 * share the lock.
 	 */
 	uint64 shardId = ExtractShardIdFromTableName(shardTableName, false);
-	LockShardResource(shardId, AccessExclusiveLock);
+	LOCKMODE shardLockMode = rangeCount > 1 ? ShareLock : AccessExclusiveLock;
+	LockShardResource(shardId, shardLockMode);
 
 	/* copy remote table's data to this node */
 	StringInfo localFilePath = makeStringInfo();
 	appendStringInfo(localFilePath, "base/%s/%s" UINT64_FORMAT,
 					 PG_JOB_CACHE_DIR, TABLE_FILE_PREFIX, shardId);
 
+	/* concurrent appends of block ranges need separate files */
+	if (rangeCount > 1)
+	{
+		appendStringInfo(localFilePath, "_%d", rangeIndex);
+	}
+
 	char *sourceQualifiedName = quote_qualified_identifier(sourceSchemaName,
 														   sourceTableName);
 	StringInfo sourceCopyCommand = makeStringInfo();
@@ -657,7 +779,12 @@ worker_append_table_to_shard(PG_FUNCTION_ARGS)
 	sourceSchemaName = sourceSchemaName ? sourceSchemaName : "public";
 	Oid sourceSchemaId = get_namespace_oid(sourceSchemaName, false);
 	Oid sourceShardRelationId = get_relname_relid(sourceTableName, sourceSchemaId);
-	if (PartitionedTableNoLock(sourceShardRelationId))
+	if (rangeCount > 1)
+	{
+		appendStringInfo(sourceCopyCommand, COPY_SELECT_BLOCK_RANGE_OUT_COMMAND,
+						 sourceQualifiedName, rangeCount, rangeIndex);
+	}
+	else if (PartitionedTableNoLock(sourceShardRelationId))
 	{
 		appendStringInfo(sourceCopyCommand, COPY_SELECT_ALL_OUT_COMMAND,
 						 sourceQualifiedName);
@@ -667,9 +794,10 @@ worker_append_table_to_shard(PG_FUNCTION_ARGS)
 		appendStringInfo(sourceCopyCommand, COPY_OUT_COMMAND, sourceQualifiedName);
 	}
 
+	bool decompress = false;
 	bool received = ReceiveRegularFile(sourceNodeName, sourceNodePort, NULL,
-									   sourceCopyCommand,
-									   localFilePath);
+									   sourceCopyCommand, localFilePath,
+									   decompress);
 	if (!received)
 	{
 		ereport(ERROR, (errmsg("could not copy table \"%s\" from \"%s:%u\"",
@@ -701,8 +829,6 @@ worker_append_table_to_shard(PG_FUNCTION_ARGS)
 
 	/* finally delete the temporary file we created */
 	CitusDeleteFile(localFilePath->data);
-
-	PG_RETURN_VOID();
 }
 
 
@@ -28,7 +28,10 @@
 #include "commands/copy.h"
 #include "commands/tablecmds.h"
 #include "common/string.h"
+#include "distributed/listutils.h"
 #include "distributed/metadata_cache.h"
+#include "distributed/multi_executor.h"
+#include "distributed/tuplestore.h"
 #include "distributed/worker_protocol.h"
 #include "distributed/version_compat.h"
 #include "distributed/task_tracker_protocol.h"
@@ -45,17 +48,26 @@
 #include "distributed/resource_lock.h"
 
 
+/* Config variable managed via guc.c */
+bool EnableMergeTaskViews = false;
+
+
 /* Local functions forward declarations */
 static List * ArrayObjectToCStringList(ArrayType *arrayObject);
 static void CreateTaskTable(StringInfo schemaName, StringInfo relationName,
 							List *columnNameList, List *columnTypeList);
+static void CreateTaskView(uint64 jobId, uint32 taskId, StringInfo schemaName,
+						   StringInfo relationName, List *columnNameList,
+						   List *columnTypeList);
 static void CopyTaskFilesFromDirectory(StringInfo schemaName, StringInfo relationName,
 									   StringInfo sourceDirectoryName, Oid userId);
+static List * TaskFileNameList(StringInfo sourceDirectoryName, Oid userId);
 
 
 /* exports for SQL callable functions */
 PG_FUNCTION_INFO_V1(worker_merge_files_into_table);
 PG_FUNCTION_INFO_V1(worker_merge_files_and_run_query);
+PG_FUNCTION_INFO_V1(worker_read_merge_files);
 PG_FUNCTION_INFO_V1(worker_cleanup_job_schema_cache);
 PG_FUNCTION_INFO_V1(worker_create_schema);
 PG_FUNCTION_INFO_V1(worker_repartition_cleanup);
@@ -176,6 +188,19 @@ worker_merge_files_into_table(PG_FUNCTION_ARGS)
 	List *columnNameList = ArrayObjectToCStringList(columnNameObject);
 	List *columnTypeList = ArrayObjectToCStringList(columnTypeObject);
 
+	/*
+	 * When merge task views are enabled, we do not load the fetched files into
+	 * a table. We instead create a view that reads the files on every scan, so
+	 * that the join query reads the shuffled data only once.
+	 */
+	if (EnableMergeTaskViews)
+	{
+		CreateTaskView(jobId, taskId, jobSchemaName, taskTableName, columnNameList,
+					   columnTypeList);
+
+		PG_RETURN_VOID();
+	}
+
 	CreateTaskTable(jobSchemaName, taskTableName, columnNameList, columnTypeList);
 
 	/* need superuser to copy from files */
@@ -295,6 +320,46 @@ worker_merge_files_and_run_query(PG_FUNCTION_ARGS)
 }
 
 
+/*
+ * worker_read_merge_files returns the set of records in the files that were
+ * fetched into the given task's directory. The files are read in the copy
+ * format given as the third argument, and the caller provides the record
+ * definition through a column definition list.
+ *
+ * Like worker_merge_files_into_table, the function only reads the files that
+ * were fetched by the current user, and skips lingering attempt files.
+ */
+Datum
+worker_read_merge_files(PG_FUNCTION_ARGS)
+{
+	uint64 jobId = PG_GETARG_INT64(0);
+	uint32 taskId = PG_GETARG_UINT32(1);
+	Datum copyFormatOidDatum = PG_GETARG_DATUM(2);
+	Datum copyFormatLabelDatum = DirectFunctionCall1(enum_out, copyFormatOidDatum);
+	char *copyFormatLabel = DatumGetCString(copyFormatLabelDatum);
+
+	StringInfo taskDirectoryName = TaskDirectoryName(jobId, taskId);
+	TupleDesc tupleDescriptor = NULL;
+
+	CheckCitusVersion(ERROR);
+
+	Tuplestorestate *tupleStore = SetupTuplestore(fcinfo, &tupleDescriptor);
+
+	List *taskFileNameList = TaskFileNameList(taskDirectoryName, GetUserId());
+
+	char *taskFileName = NULL;
+	foreach_ptr(taskFileName, taskFileNameList)
+	{
+		ReadFileIntoTupleStore(taskFileName, copyFormatLabel, tupleDescriptor,
+							   tupleStore);
+	}
+
+	tuplestore_donestoring(tupleStore);
+
+	PG_RETURN_DATUM(0);
+}
+
+
 /*
  * worker_cleanup_job_schema_cache walks over all schemas in the database, and
  * removes schemas whose names start with the job schema prefix. Note that this
@@ -483,6 +548,72 @@ CreateTaskTable(StringInfo schemaName, StringInfo relationName,
 }
 
 
+/*
+ * CreateTaskView creates a view with the given name in the given schema, which
+ * reads the files in the task directory through worker_read_merge_files. Column
+ * types are normalized through the type cache before we build the view query, and
+ * the copy format is fixed at the time the files were fetched.
+ */
+static void
+CreateTaskView(uint64 jobId, uint32 taskId, StringInfo schemaName,
+			   StringInfo relationName, List *columnNameList, List *columnTypeList)
+{
+	StringInfo columnDefinitionString = makeStringInfo();
+	StringInfo createViewCommand = makeStringInfo();
+	const char *copyFormat = BinaryWorkerCopyFormat ? "binary" : "text";
+	ListCell *columnNameCell = NULL;
+	ListCell *columnTypeCell = NULL;
+
+	forboth(columnNameCell, columnNameList, columnTypeCell, columnTypeList)
+	{
+		const char *columnName = (const char *) lfirst(columnNameCell);
+		const char *columnType = (const char *) lfirst(columnTypeCell);
+		Oid columnTypeId = InvalidOid;
+		int32 columnTypeMod = -1;
+		bool missingOK = false;
+
+		parseTypeString(columnType, &columnTypeId, &columnTypeMod, missingOK);
+
+		if (columnDefinitionString->len > 0)
+		{
+			appendStringInfoString(columnDefinitionString, ", ");
+		}
+
+		appendStringInfo(columnDefinitionString, "%s %s", quote_identifier(columnName),
+						 format_type_with_typemod(columnTypeId, columnTypeMod));
+	}
+
+	appendStringInfo(createViewCommand,
+					 "CREATE VIEW %s AS SELECT * FROM "
+					 "pg_catalog.worker_read_merge_files(" UINT64_FORMAT ", %u, %s) "
+					 "AS merge_files(%s)",
+					 quote_qualified_identifier(schemaName->data, relationName->data),
+					 jobId, taskId, quote_literal_cstr(copyFormat),
+					 columnDefinitionString->data);
+
+	int connected = SPI_connect();
+	if (connected != SPI_OK_CONNECT)
+	{
+		ereport(ERROR, (errmsg("could not connect to SPI manager")));
+	}
+
+	int createViewResult = SPI_exec(createViewCommand->data, 0);
+	if (createViewResult < 0)
+	{
+		ereport(ERROR, (errmsg("execution was not successful \"%s\"",
+							   createViewCommand->data)));
+	}
+
+	int finished = SPI_finish();
+	if (finished != SPI_OK_FINISH)
+	{
+		ereport(ERROR, (errmsg("could not disconnect from SPI manager")));
+	}
+
+	CommandCounterIncrement();
+}
+
+
 /*
  * ColumnDefinitionList creates and returns a list of column definition objects
  * from two lists of column names and types. As an example, this function takes
@@ -552,21 +683,64 @@ CreateStatement(RangeVar *relation, List *columnDefinitionList)
 
 
 /*
- * CopyTaskFilesFromDirectory finds all files in the given directory, except for
- * those having an attempt suffix. The function then copies these files into the
- * database table identified by the given schema and table name.
+ * CopyTaskFilesFromDirectory copies the files returned by TaskFileNameList into
+ * the database table identified by the given schema and table name.
+ */
+static void
+CopyTaskFilesFromDirectory(StringInfo schemaName, StringInfo relationName,
+						   StringInfo sourceDirectoryName, Oid userId)
+{
+	uint64 copiedRowTotal = 0;
+	List *taskFileNameList = TaskFileNameList(sourceDirectoryName, userId);
+
+	char *fullFilename = NULL;
+	foreach_ptr(fullFilename, taskFileNameList)
+	{
+		const char *queryString = NULL;
+		uint64 copiedRowCount = 0;
+
+		/* build relation object and copy statement */
+		RangeVar *relation = makeRangeVar(schemaName->data, relationName->data, -1);
+		CopyStmt *copyStatement = CopyStatement(relation, fullFilename);
+		if (BinaryWorkerCopyFormat)
+		{
+			DefElem *copyOption = makeDefElem("format", (Node *) makeString("binary"),
+											  -1);
+			copyStatement->options = list_make1(copyOption);
+		}
+
+		{
+			ParseState *pstate = make_parsestate(NULL);
+			pstate->p_sourcetext = queryString;
+
+			DoCopy(pstate, copyStatement, -1, -1, &copiedRowCount);
+
+			free_parsestate(pstate);
+		}
+
+		copiedRowTotal += copiedRowCount;
+		CommandCounterIncrement();
+	}
+
+	ereport(DEBUG2, (errmsg("copied " UINT64_FORMAT " rows into table: \"%s.%s\"",
+							copiedRowTotal, schemaName->data, relationName->data)));
+}
+
+
+/*
+ * TaskFileNameList finds all files in the given directory, except for those
+ * having an attempt suffix, and returns the list of their full paths.
  *
  * The function makes sure all files were generated by the current user by checking
  * whether the filename ends with the username, since this is added to local file
  * names by functions such as worker_fetch_partition-file. Files that were generated
  * by other users calling worker_fetch_partition_file directly are skipped.
  */
-static void
-CopyTaskFilesFromDirectory(StringInfo schemaName, StringInfo relationName,
-						   StringInfo sourceDirectoryName, Oid userId)
+static List *
+TaskFileNameList(StringInfo sourceDirectoryName, Oid userId)
 {
 	const char *directoryName = sourceDirectoryName->data;
-	uint64 copiedRowTotal = 0;
+	List *taskFileNameList = NIL;
 	StringInfo expectedFileSuffix = makeStringInfo();
 
 	DIR *directory = AllocateDir(directoryName);
@@ -582,8 +756,6 @@ CopyTaskFilesFromDirectory(StringInfo schemaName, StringInfo relationName,
 	for (; directoryEntry != NULL; directoryEntry = ReadDir(directory, directoryName))
 	{
 		const char *baseFilename = directoryEntry->d_name;
-		const char *queryString = NULL;
-		uint64 copiedRowCount = 0;
 
 		/* if system file or lingering task file, skip it */
 		if (strncmp(baseFilename, ".", MAXPGPATH) == 0 ||
@@ -608,33 +780,12 @@ CopyTaskFilesFromDirectory(StringInfo schemaName, StringInfo relationName,
 		StringInfo fullFilename = makeStringInfo();
 		appendStringInfo(fullFilename, "%s/%s", directoryName, baseFilename);
 
-		/* build relation object and copy statement */
-		RangeVar *relation = makeRangeVar(schemaName->data, relationName->data, -1);
-		CopyStmt *copyStatement = CopyStatement(relation, fullFilename->data);
-		if (BinaryWorkerCopyFormat)
-		{
-			DefElem *copyOption = makeDefElem("format", (Node *) makeString("binary"),
-											  -1);
-			copyStatement->options = list_make1(copyOption);
-		}
-
-		{
-			ParseState *pstate = make_parsestate(NULL);
-			pstate->p_sourcetext = queryString;
-
-			DoCopy(pstate, copyStatement, -1, -1, &copiedRowCount);
-
-			free_parsestate(pstate);
-		}
-
-		copiedRowTotal += copiedRowCount;
-		CommandCounterIncrement();
+		taskFileNameList = lappend(taskFileNameList, fullFilename->data);
 	}
 
-	ereport(DEBUG2, (errmsg("copied " UINT64_FORMAT " rows into table: \"%s.%s\"",
-							copiedRowTotal, schemaName->data, relationName->data)));
-
 	FreeDir(directory);
+
+	return taskFileNameList;
 }
 
 
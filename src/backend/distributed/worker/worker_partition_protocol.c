@@ -35,8 +35,11 @@
 #include "commands/copy.h"
 #include "commands/defrem.h"
 #include "distributed/commands/multi_copy.h"
+#include "distributed/job_cache_space.h"
+#include "distributed/multi_executor.h"
 #include "distributed/multi_physical_planner.h"
 #include "distributed/resource_lock.h"
+#include "distributed/shardinterval_utils.h"
 #include "distributed/transmit.h"
 #include "distributed/worker_protocol.h"
 #include "distributed/version_compat.h"
@@ -53,28 +56,69 @@ bool BinaryWorkerCopyFormat = false;   /* binary format for copying between work
 int PartitionBufferSize = 16384; /* total partitioning buffer size in KB */
 
 /* Local variables */
-static uint32 FileBufferSizeInBytes = 0; /* file buffer size to init later */
+static uint64 PartitionBufferPoolSize = 0; /* total buffer size to init later */
+static uint64 PartitionBufferPoolUsed = 0; /* bytes buffered over all partition files */
 
 
 /* Local functions forward declarations */
 typedef uint32 (*PartitionIdFunction)(Datum, Oid, const void *);
 
+/*
+ * PartitionFileDestReceiver is used to stream the results of a filter query
+ * into partition files.
+ */
+typedef struct PartitionFileDestReceiver
+{
+	/* public DestReceiver interface */
+	DestReceiver pub;
+
+	/* descriptor of the tuples that the filter query returns */
+	TupleDesc tupleDescriptor;
+
+	/* MemoryContext for DestReceiver session */
+	MemoryContext memoryContext;
+
+	/* partitioning parameters */
+	const char *partitionColumnName;
+	Oid partitionColumnType;
+	int partitionColumnIndex;
+	Oid partitionColumnCollation;
+	PartitionIdFunction partitionIdFunction;
+	const void *partitionIdContext;
+
+	/* partition files to write the rows to */
+	FileOutputStream *partitionFileArray;
+	uint32 fileCount;
+
+	/* state on how to copy out data types */
+	CopyOutState rowOutputState;
+	FmgrInfo *columnOutputFunctions;
+} PartitionFileDestReceiver;
+
+
 static ShardInterval ** SyntheticShardIntervalArrayForShardMinValues(
 	Datum *shardMinValues,
 	int shardCount);
 static StringInfo InitTaskAttemptDirectory(uint64 jobId, uint32 taskId);
-static uint32 FileBufferSize(int partitionBufferSizeInKB, uint32 fileCount);
+static void InitPartitionBufferPool(int partitionBufferSizeInKB);
 static FileOutputStream * OpenPartitionFiles(StringInfo directoryName, uint32 fileCount);
 static void ClosePartitionFiles(FileOutputStream *partitionFileArray, uint32 fileCount);
 static void RenameDirectory(StringInfo oldDirectoryName, StringInfo newDirectoryName);
 static void FileOutputStreamWrite(FileOutputStream *file, StringInfo dataToWrite);
 static void FileOutputStreamFlush(FileOutputStream *file);
+static void EnforcePartitionBufferPoolSize(FileOutputStream *partitionFileArray,
+										   uint32 fileCount);
 static void FilterAndPartitionTable(const char *filterQuery,
 									const char *columnName, Oid columnType,
 									PartitionIdFunction partitionIdFunction,
 									const void *partitionIdContext,
 									FileOutputStream *partitionFileArray,
 									uint32 fileCount);
+static void PartitionFileDestReceiverStartup(DestReceiver *dest, int operation,
+											 TupleDesc inputTupleDescriptor);
+static bool PartitionFileDestReceiverReceive(TupleTableSlot *slot, DestReceiver *dest);
+static void PartitionFileDestReceiverShutdown(DestReceiver *dest);
+static void PartitionFileDestReceiverDestroy(DestReceiver *dest);
 static int ColumnIndex(TupleDesc rowDescriptor, const char *columnName);
 static CopyOutState InitRowOutputState(void);
 static void ClearRowOutputState(CopyOutState copyState);
@@ -82,6 +126,14 @@ static void OutputBinaryHeaders(FileOutputStream *partitionFileArray, uint32 fil
 static void OutputBinaryFooters(FileOutputStream *partitionFileArray, uint32 fileCount);
 static uint32 RangePartitionId(Datum partitionValue, Oid partitionCollation,
 							   const void *context);
+static HashPartitionContext * CreateHashPartitionContext(ArrayType *hashRangeObject,
+														 Oid partitionColumnType);
+static int32 * DeconstructInt32ArraySorted(ArrayType *arrayObject, int32 *elementCount);
+static int CompareInt32(const void *leftElement, const void *rightElement);
+static uint32 SkewHashPartitionId(Datum partitionValue, Oid partitionCollation,
+								  const void *context);
+static uint32 HashValuePartitionId(Datum hashDatum,
+								   HashPartitionContext *hashPartitionContext);
 static uint32 HashPartitionId(Datum partitionValue, Oid partitionCollation,
 							  const void *context);
 static StringInfo UserPartitionFilename(StringInfo directoryName, uint32 partitionId);
@@ -91,6 +143,7 @@ static bool FileIsLink(const char *filename, struct stat filestat);
 /* exports for SQL callable functions */
 PG_FUNCTION_INFO_V1(worker_range_partition_table);
 PG_FUNCTION_INFO_V1(worker_hash_partition_table);
+PG_FUNCTION_INFO_V1(worker_skew_hash_partition_table);
 
 
 /*
@@ -149,7 +202,7 @@ worker_range_partition_table(PG_FUNCTION_ARGS)
 
 	FileOutputStream *partitionFileArray = OpenPartitionFiles(taskAttemptDirectory,
 															  fileCount);
-	FileBufferSizeInBytes = FileBufferSize(PartitionBufferSize, fileCount);
+	InitPartitionBufferPool(PartitionBufferSize);
 
 	/* call the partitioning function that does the actual work */
 	FilterAndPartitionTable(filterQuery, partitionColumn, partitionColumnType,
@@ -188,11 +241,113 @@ worker_hash_partition_table(PG_FUNCTION_ARGS)
 	const char *filterQuery = text_to_cstring(filterQueryText);
 	const char *partitionColumn = text_to_cstring(partitionColumnText);
 
-	Datum *hashRangeArray = DeconstructArrayObject(hashRangeObject);
-	int32 partitionCount = ArrayObjectCount(hashRangeObject);
+	CheckCitusVersion(ERROR);
+
+	HashPartitionContext *partitionContext =
+		CreateHashPartitionContext(hashRangeObject, partitionColumnType);
+
+	/* we create as many files as the number of split points */
+	uint32 fileCount = partitionContext->partitionCount;
+
+	/* init directories and files to write the partitioned data to */
+	StringInfo taskDirectory = InitTaskDirectory(jobId, taskId);
+	StringInfo taskAttemptDirectory = InitTaskAttemptDirectory(jobId, taskId);
+
+	FileOutputStream *partitionFileArray = OpenPartitionFiles(taskAttemptDirectory,
+															  fileCount);
+	InitPartitionBufferPool(PartitionBufferSize);
+
+	/* call the partitioning function that does the actual work */
+	FilterAndPartitionTable(filterQuery, partitionColumn, partitionColumnType,
+							&HashPartitionId, (const void *) partitionContext,
+							partitionFileArray, fileCount);
+
+	/* close partition files and atomically rename (commit) them */
+	ClosePartitionFiles(partitionFileArray, fileCount);
+	CitusRemoveDirectory(taskDirectory->data);
+	RenameDirectory(taskAttemptDirectory, taskDirectory);
+
+	PG_RETURN_VOID();
+}
+
+
+/*
+ * worker_skew_hash_partition_table hash partitions the results of the given
+ * filter query like worker_hash_partition_table, except for the rows whose
+ * partition column hashes to one of the given heavy hitter hash values. Rows
+ * with a hash value in split_hashes are spread over all partition files in
+ * turn, and rows with a hash value in broadcast_hashes are written to all
+ * partition files.
+ *
+ * When the other input of a join is partitioned with the roles of the two
+ * arrays swapped, each pair of joining rows still ends up in exactly one
+ * partition, while no single partition receives all rows of a heavy hitter.
+ */
+Datum
+worker_skew_hash_partition_table(PG_FUNCTION_ARGS)
+{
+	uint64 jobId = PG_GETARG_INT64(0);
+	uint32 taskId = PG_GETARG_UINT32(1);
+	text *filterQueryText = PG_GETARG_TEXT_P(2);
+	text *partitionColumnText = PG_GETARG_TEXT_P(3);
+	Oid partitionColumnType = PG_GETARG_OID(4);
+	ArrayType *hashRangeObject = PG_GETARG_ARRAYTYPE_P(5);
+	ArrayType *splitHashObject = PG_GETARG_ARRAYTYPE_P(6);
+	ArrayType *broadcastHashObject = PG_GETARG_ARRAYTYPE_P(7);
+
+	const char *filterQuery = text_to_cstring(filterQueryText);
+	const char *partitionColumn = text_to_cstring(partitionColumnText);
 
 	CheckCitusVersion(ERROR);
 
+	SkewHashPartitionContext *partitionContext =
+		palloc0(sizeof(SkewHashPartitionContext));
+	partitionContext->hashContext =
+		CreateHashPartitionContext(hashRangeObject, partitionColumnType);
+	partitionContext->splitHashArray =
+		DeconstructInt32ArraySorted(splitHashObject,
+									&partitionContext->splitHashCount);
+	partitionContext->broadcastHashArray =
+		DeconstructInt32ArraySorted(broadcastHashObject,
+									&partitionContext->broadcastHashCount);
+
+	/* start at a different file in each task to spread split rows evenly */
+	uint32 fileCount = partitionContext->hashContext->partitionCount;
+	partitionContext->nextSplitPartitionId = taskId % fileCount;
+
+	/* init directories and files to write the partitioned data to */
+	StringInfo taskDirectory = InitTaskDirectory(jobId, taskId);
+	StringInfo taskAttemptDirectory = InitTaskAttemptDirectory(jobId, taskId);
+
+	FileOutputStream *partitionFileArray = OpenPartitionFiles(taskAttemptDirectory,
+															  fileCount);
+	InitPartitionBufferPool(PartitionBufferSize);
+
+	/* call the partitioning function that does the actual work */
+	FilterAndPartitionTable(filterQuery, partitionColumn, partitionColumnType,
+							&SkewHashPartitionId, (const void *) partitionContext,
+							partitionFileArray, fileCount);
+
+	/* close partition files and atomically rename (commit) them */
+	ClosePartitionFiles(partitionFileArray, fileCount);
+	CitusRemoveDirectory(taskDirectory->data);
+	RenameDirectory(taskAttemptDirectory, taskDirectory);
+
+	PG_RETURN_VOID();
+}
+
+
+/*
+ * CreateHashPartitionContext creates the context for hash partitioning a
+ * column of the given type into the hash ranges that start at the values in
+ * the given array.
+ */
+static HashPartitionContext *
+CreateHashPartitionContext(ArrayType *hashRangeObject, Oid partitionColumnType)
+{
+	Datum *hashRangeArray = DeconstructArrayObject(hashRangeObject);
+	int32 partitionCount = ArrayObjectCount(hashRangeObject);
+
 	HashPartitionContext *partitionContext = palloc0(sizeof(HashPartitionContext));
 	partitionContext->syntheticShardIntervalArray =
 		SyntheticShardIntervalArrayForShardMinValues(hashRangeArray, partitionCount);
@@ -204,9 +359,6 @@ worker_hash_partition_table(PG_FUNCTION_ARGS)
 	FmgrInfo *hashFunction = GetFunctionInfo(partitionColumnType, HASH_AM_OID,
 											 HASHSTANDARD_PROC);
 
-	/* we create as many files as the number of split points */
-	uint32 fileCount = partitionCount;
-
 	partitionContext->hashFunction = hashFunction;
 	partitionContext->partitionCount = partitionCount;
 
@@ -217,25 +369,58 @@ worker_hash_partition_table(PG_FUNCTION_ARGS)
 			GetFunctionInfo(partitionColumnType, BTREE_AM_OID, BTORDER_PROC);
 	}
 
-	/* init directories and files to write the partitioned data to */
-	StringInfo taskDirectory = InitTaskDirectory(jobId, taskId);
-	StringInfo taskAttemptDirectory = InitTaskAttemptDirectory(jobId, taskId);
+	return partitionContext;
+}
 
-	FileOutputStream *partitionFileArray = OpenPartitionFiles(taskAttemptDirectory,
-															  fileCount);
-	FileBufferSizeInBytes = FileBufferSize(PartitionBufferSize, fileCount);
 
-	/* call the partitioning function that does the actual work */
-	FilterAndPartitionTable(filterQuery, partitionColumn, partitionColumnType,
-							&HashPartitionId, (const void *) partitionContext,
-							partitionFileArray, fileCount);
+/*
+ * DeconstructInt32ArraySorted returns the elements of the given integer array
+ * in sorted order, and sets elementCount to their number.
+ */
+static int32 *
+DeconstructInt32ArraySorted(ArrayType *arrayObject, int32 *elementCount)
+{
+	if (ARR_ELEMTYPE(arrayObject) != INT4OID || array_contains_nulls(arrayObject))
+	{
+		ereport(ERROR, (errmsg("heavy hitter hash values must be non-null "
+							   "integers")));
+	}
 
-	/* close partition files and atomically rename (commit) them */
-	ClosePartitionFiles(partitionFileArray, fileCount);
-	CitusRemoveDirectory(taskDirectory->data);
-	RenameDirectory(taskAttemptDirectory, taskDirectory);
+	Datum *datumArray = DeconstructArrayObject(arrayObject);
+	int32 datumCount = ArrayObjectCount(arrayObject);
+	int32 *valueArray = palloc0(Max(datumCount, 1) * sizeof(int32));
 
-	PG_RETURN_VOID();
+	for (int32 datumIndex = 0; datumIndex < datumCount; datumIndex++)
+	{
+		valueArray[datumIndex] = DatumGetInt32(datumArray[datumIndex]);
+	}
+
+	qsort(valueArray, datumCount, sizeof(int32), CompareInt32);
+
+	*elementCount = datumCount;
+	return valueArray;
+}
+
+
+/*
+ * CompareInt32 compares two int32 values for qsort and bsearch.
+ */
+static int
+CompareInt32(const void *leftElement, const void *rightElement)
+{
+	int32 leftValue = *((const int32 *) leftElement);
+	int32 rightValue = *((const int32 *) rightElement);
+
+	if (leftValue < rightValue)
+	{
+		return -1;
+	}
+	else if (leftValue > rightValue)
+	{
+		return 1;
+	}
+
+	return 0;
 }
 
 
@@ -379,12 +564,16 @@ InitTaskDirectory(uint64 jobId, uint32 taskId)
 	StringInfo jobDirectoryName = JobDirectoryName(jobId);
 	StringInfo taskDirectoryName = TaskDirectoryName(jobId, taskId);
 
+	/* fail before writing any files if the job cache is full */
+	CheckJobCacheSpace();
+
 	LockJobResource(jobId, AccessExclusiveLock);
 
 	bool jobDirectoryExists = DirectoryExists(jobDirectoryName);
 	if (!jobDirectoryExists)
 	{
-		CitusCreateDirectory(jobDirectoryName);
+		bool existsOk = false;
+		CreateJobCacheDirectory(jobDirectoryName->data, existsOk);
 	}
 
 	bool taskDirectoryExists = DirectoryExists(taskDirectoryName);
@@ -428,14 +617,18 @@ InitTaskAttemptDirectory(uint64 jobId, uint32 taskId)
 }
 
 
-/* Calculates and returns the buffer size to use for each file. */
-static uint32
-FileBufferSize(int partitionBufferSizeInKB, uint32 fileCount)
+/*
+ * InitPartitionBufferPool sets the total size of the buffers that partition
+ * files may hold before they are flushed. The partition files share this
+ * budget rather than each getting an equal slice of it, so that partitions
+ * that receive many rows still flush in large writes when the partition count
+ * is high or the data is skewed.
+ */
+static void
+InitPartitionBufferPool(int partitionBufferSizeInKB)
 {
-	double partitionBufferSize = (double) partitionBufferSizeInKB * 1024.0;
-	uint32 fileBufferSize = (uint32) rint(partitionBufferSize / fileCount);
-
-	return fileBufferSize;
+	PartitionBufferPoolSize = (uint64) partitionBufferSizeInKB * 1024;
+	PartitionBufferPoolUsed = 0;
 }
 
 
@@ -722,6 +915,17 @@ CitusRemoveDirectory(const char *filename)
 		struct stat fileStat;
 		int removed = 0;
 
+#ifndef WIN32
+
+		/* job cache directories on other locations are linked to */
+		int linkStatOK = lstat(filename, &fileStat);
+		if (linkStatOK == 0 && S_ISLNK(fileStat.st_mode))
+		{
+			RemoveJobCacheDirectoryLink(filename);
+			return;
+		}
+#endif
+
 		int statOK = stat(filename, &fileStat);
 		if (statOK < 0)
 		{
@@ -818,51 +1022,105 @@ RenameDirectory(StringInfo oldDirectoryName, StringInfo newDirectoryName)
 
 
 /*
- * FileOutputStreamWrite appends given data to file stream's internal buffers.
- * The function then checks if buffered data exceeds preconfigured buffer size;
- * if so, the function flushes the buffer to the underlying file.
+ * FileOutputStreamWrite appends given data to file stream's internal buffers,
+ * and accounts for it in the partition buffer pool. Callers are expected to
+ * call EnforcePartitionBufferPoolSize() to flush buffers when the pool fills.
  */
 static void
 FileOutputStreamWrite(FileOutputStream *file, StringInfo dataToWrite)
 {
-	StringInfo fileBuffer = file->fileBuffer;
-	uint32 newBufferSize = fileBuffer->len + dataToWrite->len;
-
-	appendBinaryStringInfo(fileBuffer, dataToWrite->data, dataToWrite->len);
-
-	if (newBufferSize > FileBufferSizeInBytes)
-	{
-		FileOutputStreamFlush(file);
+	appendBinaryStringInfo(file->fileBuffer, dataToWrite->data, dataToWrite->len);
 
-		resetStringInfo(fileBuffer);
-	}
+	PartitionBufferPoolUsed += dataToWrite->len;
 }
 
 
-/* Flushes data buffered in the file stream object to the underlying file. */
+/*
+ * Flushes data buffered in the file stream object to the underlying file, and
+ * returns the buffered bytes to the partition buffer pool.
+ */
 static void
 FileOutputStreamFlush(FileOutputStream *file)
 {
 	StringInfo fileBuffer = file->fileBuffer;
 
+	ReserveJobCacheSpace(fileBuffer->len);
+
 	errno = 0;
-	int written = FileWriteCompat(&file->fileCompat, fileBuffer->data, fileBuffer->len,
-								  PG_WAIT_IO);
+	int written = FileWriteWithWriteback(&file->fileCompat, fileBuffer->data,
+										 fileBuffer->len, PG_WAIT_IO);
 	if (written != fileBuffer->len)
 	{
 		ereport(ERROR, (errcode_for_file_access(),
 						errmsg("could not write %d bytes to partition file \"%s\"",
 							   fileBuffer->len, file->filePath->data)));
 	}
+
+	Assert(PartitionBufferPoolUsed >= (uint64) fileBuffer->len);
+	PartitionBufferPoolUsed -= fileBuffer->len;
+
+	resetStringInfo(fileBuffer);
+}
+
+
+/*
+ * EnforcePartitionBufferPoolSize flushes partition files while the data they
+ * buffer exceeds the partition buffer pool's size. The function always flushes
+ * the file with the largest buffer first, which keeps writes large and leaves
+ * the buffers of partitions that receive few rows in memory.
+ *
+ * The memory of flushed buffers is released as well, since a StringInfo keeps
+ * its allocation after being reset and partitions that once had a large buffer
+ * would otherwise hold on to memory beyond the pool's size.
+ */
+static void
+EnforcePartitionBufferPoolSize(FileOutputStream *partitionFileArray, uint32 fileCount)
+{
+	while (PartitionBufferPoolUsed > PartitionBufferPoolSize)
+	{
+		FileOutputStream *largestFile = NULL;
+
+		for (uint32 fileIndex = 0; fileIndex < fileCount; fileIndex++)
+		{
+			FileOutputStream *partitionFile = &partitionFileArray[fileIndex];
+
+			if (largestFile == NULL ||
+				partitionFile->fileBuffer->len > largestFile->fileBuffer->len)
+			{
+				largestFile = partitionFile;
+			}
+		}
+
+		if (largestFile == NULL || largestFile->fileBuffer->len == 0)
+		{
+			break;
+		}
+
+		FileOutputStreamFlush(largestFile);
+
+		/* reallocate the buffer in the context the partition files were opened in */
+		StringInfo fileBuffer = largestFile->fileBuffer;
+		MemoryContext bufferContext = GetMemoryChunkContext(fileBuffer->data);
+		MemoryContext oldContext = MemoryContextSwitchTo(bufferContext);
+
+		pfree(fileBuffer->data);
+		initStringInfo(fileBuffer);
+
+		MemoryContextSwitchTo(oldContext);
+	}
 }
 
 
 /*
- * FilterAndPartitionTable executes a given SQL query, and iterates over query
- * results in a read-only fashion. For each resulting row, the function applies
- * the partitioning function and determines the partition identifier. Then, the
- * function chooses the partition file corresponding to this identifier, and
- * serializes the row into this file using the copy command's text format.
+ * FilterAndPartitionTable executes a given SQL query, and streams query results
+ * into a PartitionFileDestReceiver. For each resulting row, the receiver applies
+ * the partitioning function and determines the partition identifier. Then, it
+ * chooses the partition file corresponding to this identifier, and serializes
+ * the row into this file using the copy command's text format.
+ *
+ * The query is planned with parallelism enabled and runs to completion, so the
+ * scan and the filter of large shards may be executed by parallel workers. The
+ * partitioning itself happens in this backend as tuples come out of the plan.
  */
 static void
 FilterAndPartitionTable(const char *filterQuery,
@@ -872,139 +1130,196 @@ FilterAndPartitionTable(const char *filterQuery,
 						FileOutputStream *partitionFileArray,
 						uint32 fileCount)
 {
-	FmgrInfo *columnOutputFunctions = NULL;
-	int partitionColumnIndex = 0;
-	Oid partitionColumnTypeId = InvalidOid;
-	Oid partitionColumnCollation = InvalidOid;
-
-	const char *noPortalName = NULL;
-	const bool readOnly = true;
-	const bool fetchForward = true;
-	const int noCursorOptions = 0;
-	const int prefetchCount = ROW_PREFETCH_COUNT;
-
-	int connected = SPI_connect();
-	if (connected != SPI_OK_CONNECT)
-	{
-		ereport(ERROR, (errmsg("could not connect to SPI manager")));
-	}
+	ParamListInfo paramListInfo = NULL;
+
+	PartitionFileDestReceiver *partitionFileDest =
+		palloc0(sizeof(PartitionFileDestReceiver));
+
+	/* set up the DestReceiver function pointers */
+	partitionFileDest->pub.receiveSlot = PartitionFileDestReceiverReceive;
+	partitionFileDest->pub.rStartup = PartitionFileDestReceiverStartup;
+	partitionFileDest->pub.rShutdown = PartitionFileDestReceiverShutdown;
+	partitionFileDest->pub.rDestroy = PartitionFileDestReceiverDestroy;
+	partitionFileDest->pub.mydest = DestCopyOut;
+
+	/* set up partitioning parameters */
+	partitionFileDest->partitionColumnName = partitionColumnName;
+	partitionFileDest->partitionColumnType = partitionColumnType;
+	partitionFileDest->partitionIdFunction = partitionIdFunction;
+	partitionFileDest->partitionIdContext = partitionIdContext;
+	partitionFileDest->partitionFileArray = partitionFileArray;
+	partitionFileDest->fileCount = fileCount;
+	partitionFileDest->memoryContext = CurrentMemoryContext;
+
+	ExecuteQueryStringIntoDestReceiver(filterQuery, paramListInfo,
+									   (DestReceiver *) partitionFileDest);
+
+	partitionFileDest->pub.rDestroy((DestReceiver *) partitionFileDest);
+}
+
+
+/*
+ * PartitionFileDestReceiverStartup implements the rStartup interface of
+ * PartitionFileDestReceiver. It finds the partition column in the tuples that
+ * the filter query returns, sets up the row output state, and writes the
+ * binary headers to the partition files if needed.
+ */
+static void
+PartitionFileDestReceiverStartup(DestReceiver *dest, int operation,
+								 TupleDesc inputTupleDescriptor)
+{
+	PartitionFileDestReceiver *partitionFileDest = (PartitionFileDestReceiver *) dest;
 
-	Portal queryPortal = SPI_cursor_open_with_args(noPortalName, filterQuery,
-												   0, NULL, NULL, NULL, /* no arguments */
-												   readOnly, noCursorOptions);
-	if (queryPortal == NULL)
+	if (partitionFileDest->fileCount == 0)
 	{
-		ereport(ERROR, (errmsg("could not open implicit cursor for query \"%s\"",
-							   ApplyLogRedaction(filterQuery))));
+		ereport(ERROR, (errmsg("no partition to read into")));
 	}
 
-	CopyOutState rowOutputState = InitRowOutputState();
+	int partitionColumnIndex = ColumnIndex(inputTupleDescriptor,
+										   partitionFileDest->partitionColumnName);
+	Form_pg_attribute partitionColumn = TupleDescAttr(inputTupleDescriptor,
+													  partitionColumnIndex - 1);
 
-	SPI_cursor_fetch(queryPortal, fetchForward, prefetchCount);
-	if (SPI_processed > 0)
+	if (partitionFileDest->partitionColumnType != partitionColumn->atttypid)
 	{
-		TupleDesc rowDescriptor = SPI_tuptable->tupdesc;
-
-		if (fileCount == 0)
-		{
-			ereport(ERROR, (errmsg("no partition to read into")));
-		}
+		ereport(ERROR, (errmsg("partition column types %u and %u do not match",
+							   partitionColumn->atttypid,
+							   partitionFileDest->partitionColumnType)));
+	}
 
-		partitionColumnIndex = ColumnIndex(rowDescriptor, partitionColumnName);
-		partitionColumnTypeId = SPI_gettypeid(rowDescriptor, partitionColumnIndex);
-		partitionColumnCollation = TupleDescAttr(rowDescriptor, partitionColumnIndex -
-												 1)->attcollation;
+	/* use the memory context that was in place when the DestReceiver was created */
+	MemoryContext oldContext = MemoryContextSwitchTo(partitionFileDest->memoryContext);
 
-		if (partitionColumnType != partitionColumnTypeId)
-		{
-			ereport(ERROR, (errmsg("partition column types %u and %u do not match",
-								   partitionColumnTypeId, partitionColumnType)));
-		}
+	partitionFileDest->tupleDescriptor = inputTupleDescriptor;
+	partitionFileDest->partitionColumnIndex = partitionColumnIndex;
+	partitionFileDest->partitionColumnCollation = partitionColumn->attcollation;
 
-		columnOutputFunctions = ColumnOutputFunctions(rowDescriptor,
-													  rowOutputState->binary);
-	}
+	CopyOutState rowOutputState = InitRowOutputState();
+	partitionFileDest->rowOutputState = rowOutputState;
+	partitionFileDest->columnOutputFunctions =
+		ColumnOutputFunctions(inputTupleDescriptor, rowOutputState->binary);
 
 	if (BinaryWorkerCopyFormat)
 	{
-		OutputBinaryHeaders(partitionFileArray, fileCount);
+		OutputBinaryHeaders(partitionFileDest->partitionFileArray,
+							partitionFileDest->fileCount);
 	}
 
-	uint32 columnCount = (uint32) SPI_tuptable->tupdesc->natts;
-	Datum *valueArray = (Datum *) palloc0(columnCount * sizeof(Datum));
-	bool *isNullArray = (bool *) palloc0(columnCount * sizeof(bool));
+	MemoryContextSwitchTo(oldContext);
+}
 
-	while (SPI_processed > 0)
-	{
-		for (uint64 rowIndex = 0; rowIndex < SPI_processed; rowIndex++)
-		{
-			HeapTuple row = SPI_tuptable->vals[rowIndex];
-			TupleDesc rowDescriptor = SPI_tuptable->tupdesc;
-			bool partitionKeyNull = false;
-			uint32 partitionId = 0;
-
-			Datum partitionKey = SPI_getbinval(row, rowDescriptor,
-											   partitionColumnIndex, &partitionKeyNull);
-
-			/*
-			 * If we have a partition key, we compute its bucket. Else if we have
-			 * a null key, we then put this tuple into the 0th bucket. Note that
-			 * the 0th bucket may hold other tuples as well, such as tuples whose
-			 * partition keys hash to the value 0.
-			 */
-			if (!partitionKeyNull)
-			{
-				partitionId = (*partitionIdFunction)(partitionKey,
-													 partitionColumnCollation,
-													 partitionIdContext);
-				if (partitionId == INVALID_SHARD_INDEX)
-				{
-					ereport(ERROR, (errmsg("invalid distribution column value")));
-				}
-			}
-			else
-			{
-				partitionId = 0;
-			}
 
-			/* deconstruct the tuple; this is faster than repeated heap_getattr */
-			heap_deform_tuple(row, rowDescriptor, valueArray, isNullArray);
+/*
+ * PartitionFileDestReceiverReceive implements the receiveSlot function of
+ * PartitionFileDestReceiver. It determines the partition of the tuple, and
+ * appends the serialized tuple to the corresponding partition file.
+ */
+static bool
+PartitionFileDestReceiverReceive(TupleTableSlot *slot, DestReceiver *dest)
+{
+	PartitionFileDestReceiver *partitionFileDest = (PartitionFileDestReceiver *) dest;
+	CopyOutState rowOutputState = partitionFileDest->rowOutputState;
+	uint32 partitionId = 0;
 
-			AppendCopyRowData(valueArray, isNullArray, rowDescriptor,
-							  rowOutputState, columnOutputFunctions, NULL);
+	slot_getallattrs(slot);
 
-			StringInfo rowText = rowOutputState->fe_msgbuf;
+	Datum *valueArray = slot->tts_values;
+	bool *isNullArray = slot->tts_isnull;
 
-			FileOutputStream *partitionFile = &partitionFileArray[partitionId];
-			FileOutputStreamWrite(partitionFile, rowText);
+	int partitionColumnOffset = partitionFileDest->partitionColumnIndex - 1;
+	Datum partitionKey = valueArray[partitionColumnOffset];
+	bool partitionKeyNull = isNullArray[partitionColumnOffset];
 
-			resetStringInfo(rowText);
-			MemoryContextReset(rowOutputState->rowcontext);
+	/*
+	 * If we have a partition key, we compute its bucket. Else if we have
+	 * a null key, we then put this tuple into the 0th bucket. Note that
+	 * the 0th bucket may hold other tuples as well, such as tuples whose
+	 * partition keys hash to the value 0.
+	 */
+	if (!partitionKeyNull)
+	{
+		partitionId = (*partitionFileDest->partitionIdFunction)(
+			partitionKey, partitionFileDest->partitionColumnCollation,
+			partitionFileDest->partitionIdContext);
+		if (partitionId == INVALID_SHARD_INDEX)
+		{
+			ereport(ERROR, (errmsg("invalid distribution column value")));
 		}
+	}
+	else
+	{
+		partitionId = 0;
+	}
 
-		SPI_freetuptable(SPI_tuptable);
+	AppendCopyRowData(valueArray, isNullArray, partitionFileDest->tupleDescriptor,
+					  rowOutputState, partitionFileDest->columnOutputFunctions, NULL);
 
-		SPI_cursor_fetch(queryPortal, fetchForward, prefetchCount);
+	StringInfo rowText = rowOutputState->fe_msgbuf;
+
+	if (partitionId == BROADCAST_PARTITION_ID)
+	{
+		/* the row joins with rows that were spread over all partitions */
+		for (uint32 fileIndex = 0; fileIndex < partitionFileDest->fileCount;
+			 fileIndex++)
+		{
+			FileOutputStreamWrite(&partitionFileDest->partitionFileArray[fileIndex],
+								  rowText);
+		}
 	}
+	else
+	{
+		FileOutputStream *partitionFile =
+			&partitionFileDest->partitionFileArray[partitionId];
+		FileOutputStreamWrite(partitionFile, rowText);
+	}
+	EnforcePartitionBufferPoolSize(partitionFileDest->partitionFileArray,
+								   partitionFileDest->fileCount);
 
-	pfree(valueArray);
-	pfree(isNullArray);
+	resetStringInfo(rowText);
+	MemoryContextReset(rowOutputState->rowcontext);
 
-	SPI_cursor_close(queryPortal);
+	return true;
+}
+
+
+/*
+ * PartitionFileDestReceiverShutdown implements the rShutdown interface of
+ * PartitionFileDestReceiver. It writes the binary footers to the partition
+ * files if needed, and frees the row output state. The partition files are
+ * closed by the caller.
+ */
+static void
+PartitionFileDestReceiverShutdown(DestReceiver *dest)
+{
+	PartitionFileDestReceiver *partitionFileDest = (PartitionFileDestReceiver *) dest;
 
 	if (BinaryWorkerCopyFormat)
 	{
-		OutputBinaryFooters(partitionFileArray, fileCount);
+		OutputBinaryFooters(partitionFileDest->partitionFileArray,
+							partitionFileDest->fileCount);
 	}
 
 	/* delete row output memory context */
-	ClearRowOutputState(rowOutputState);
+	ClearRowOutputState(partitionFileDest->rowOutputState);
+	partitionFileDest->rowOutputState = NULL;
+}
 
-	int finished = SPI_finish();
-	if (finished != SPI_OK_FINISH)
+
+/*
+ * PartitionFileDestReceiverDestroy implements the rDestroy interface of
+ * PartitionFileDestReceiver.
+ */
+static void
+PartitionFileDestReceiverDestroy(DestReceiver *dest)
+{
+	PartitionFileDestReceiver *partitionFileDest = (PartitionFileDestReceiver *) dest;
+
+	if (partitionFileDest->columnOutputFunctions)
 	{
-		ereport(ERROR, (errmsg("could not disconnect from SPI manager")));
+		pfree(partitionFileDest->columnOutputFunctions);
 	}
+
+	pfree(partitionFileDest);
 }
 
 
@@ -1234,12 +1549,67 @@ HashPartitionId(Datum partitionValue, Oid partitionCollation, const void *contex
 {
 	HashPartitionContext *hashPartitionContext = (HashPartitionContext *) context;
 	FmgrInfo *hashFunction = hashPartitionContext->hashFunction;
+	Datum hashDatum = HashDistributionValue(hashFunction, DEFAULT_COLLATION_OID,
+											partitionValue);
+
+	return HashValuePartitionId(hashDatum, hashPartitionContext);
+}
+
+
+/*
+ * SkewHashPartitionId determines the partition number for the given data value
+ * like HashPartitionId does, except for heavy hitters. For a value that hashes
+ * to one of the split hash values, it returns the partitions in turn, and for a
+ * value that hashes to one of the broadcast hash values, it returns
+ * BROADCAST_PARTITION_ID.
+ */
+static uint32
+SkewHashPartitionId(Datum partitionValue, Oid partitionCollation, const void *context)
+{
+	SkewHashPartitionContext *skewPartitionContext =
+		(SkewHashPartitionContext *) context;
+	HashPartitionContext *hashPartitionContext = skewPartitionContext->hashContext;
+	FmgrInfo *hashFunction = hashPartitionContext->hashFunction;
+	Datum hashDatum = HashDistributionValue(hashFunction, DEFAULT_COLLATION_OID,
+											partitionValue);
+	int32 hashValue = DatumGetInt32(hashDatum);
+
+	if (skewPartitionContext->broadcastHashCount > 0 &&
+		bsearch(&hashValue, skewPartitionContext->broadcastHashArray,
+				skewPartitionContext->broadcastHashCount, sizeof(int32),
+				CompareInt32) != NULL)
+	{
+		return BROADCAST_PARTITION_ID;
+	}
+
+	if (skewPartitionContext->splitHashCount > 0 &&
+		bsearch(&hashValue, skewPartitionContext->splitHashArray,
+				skewPartitionContext->splitHashCount, sizeof(int32),
+				CompareInt32) != NULL)
+	{
+		uint32 partitionId = skewPartitionContext->nextSplitPartitionId;
+
+		skewPartitionContext->nextSplitPartitionId =
+			(partitionId + 1) % hashPartitionContext->partitionCount;
+
+		return partitionId;
+	}
+
+	return HashValuePartitionId(hashDatum, hashPartitionContext);
+}
+
+
+/*
+ * HashValuePartitionId returns the partition number of the given hash value in
+ * the hash ranges of the given context.
+ */
+static uint32
+HashValuePartitionId(Datum hashDatum, HashPartitionContext *hashPartitionContext)
+{
 	uint32 partitionCount = hashPartitionContext->partitionCount;
 	ShardInterval **syntheticShardIntervalArray =
 		hashPartitionContext->syntheticShardIntervalArray;
 	FmgrInfo *comparisonFunction = hashPartitionContext->comparisonFunction;
-	Datum hashDatum = FunctionCall1Coll(hashFunction, DEFAULT_COLLATION_OID,
-										partitionValue);
 	int32 hashResult = 0;
 	uint32 hashPartitionId = 0;
 
@@ -17,14 +17,40 @@
 #include "distributed/worker_protocol.h"
 #include "distributed/worker_shard_visibility.h"
 #include "nodes/nodeFuncs.h"
+#include "utils/hsearch.h"
 #include "utils/lsyscache.h"
+#include "utils/memutils.h"
 #include "utils/syscache.h"
 
 
+/*
+ * KnownShardCacheEntry caches whether a relation is a known shard, and if so
+ * the distributed table that it belongs to.
+ */
+typedef struct KnownShardCacheEntry
+{
+	/* key, the oid of the relation */
+	Oid relationId;
+
+	bool isKnownShard;
+	Oid distributedRelationId;
+} KnownShardCacheEntry;
+
+
 /* Config variable managed via guc.c */
 bool OverrideTableVisibility = true;
 
+/*
+ * Relations that are or are not known shards, and the distributed tables of
+ * the known shards, such that invalidations of those tables flush the cache.
+ */
+static HTAB *KnownShardCacheHash = NULL;
+static HTAB *KnownShardDistributedRelationHash = NULL;
+
 static bool ReplaceTableVisibleFunctionWalker(Node *inputNode);
+static bool RelationIsAKnownShardInternal(Oid shardRelationId, bool *cacheable,
+										  Oid *distributedRelationId);
+static void InitializeKnownShardCache(void);
 
 PG_FUNCTION_INFO_V1(citus_table_is_visible);
 PG_FUNCTION_INFO_V1(relation_is_a_known_shard);
@@ -104,11 +130,15 @@ citus_table_is_visible(PG_FUNCTION_ARGS)
  *
  * We can only do that in MX since both the metadata and tables are only
  * present there.
+ *
+ * Catalog tools call this function for every relation in pg_class, hence the
+ * outcome is cached per relation until the relation or its distributed table
+ * is invalidated, see InvalidateKnownShardCache().
  */
 bool
 RelationIsAKnownShard(Oid shardRelationId, bool onlySearchPath)
 {
-	bool missingOk = true;
+	bool foundInCache = false;
 	char relKind = '\0';
 
 	if (!OidIsValid(shardRelationId))
@@ -133,12 +163,44 @@ RelationIsAKnownShard(Oid shardRelationId, bool onlySearchPath)
 		}
 	}
 
-	Relation relation = try_relation_open(shardRelationId, AccessShareLock);
-	if (relation == NULL)
+	InitializeKnownShardCache();
+
+	/*
+	 * If the input relation is an index we simply replace the
+	 * relationId with the corresponding relation to hide indexes
+	 * as well.
+	 */
+	Oid tableRelationId = shardRelationId;
+	relKind = get_rel_relkind(shardRelationId);
+	if (relKind == RELKIND_INDEX)
+	{
+		tableRelationId = IndexGetRelation(shardRelationId, true);
+	}
+
+	/* copy the outcome, the checks below may flush the cache */
+	bool cachedIsKnownShard = false;
+	KnownShardCacheEntry *cacheEntry = hash_search(KnownShardCacheHash,
+												   &tableRelationId, HASH_FIND,
+												   &foundInCache);
+	if (foundInCache)
 	{
-		return false;
+		cachedIsKnownShard = cacheEntry->isKnownShard;
+
+		/* the relation may have been dropped since, as in try_relation_open */
+		if (!SearchSysCacheExists1(RELOID, ObjectIdGetDatum(shardRelationId)))
+		{
+			return false;
+		}
+	}
+	else
+	{
+		Relation relation = try_relation_open(shardRelationId, AccessShareLock);
+		if (relation == NULL)
+		{
+			return false;
+		}
+		relation_close(relation, NoLock);
 	}
-	relation_close(relation, NoLock);
 
 	/* we're not interested in the relations that are not in the search path */
 	if (!RelationIsVisible(shardRelationId) && onlySearchPath)
@@ -146,17 +208,61 @@ RelationIsAKnownShard(Oid shardRelationId, bool onlySearchPath)
 		return false;
 	}
 
-	/*
-	 * If the input relation is an index we simply replace the
-	 * relationId with the corresponding relation to hide indexes
-	 * as well.
-	 */
-	relKind = get_rel_relkind(shardRelationId);
-	if (relKind == RELKIND_INDEX)
+	if (foundInCache)
+	{
+		return cachedIsKnownShard;
+	}
+
+	if (!OidIsValid(tableRelationId))
 	{
-		shardRelationId = IndexGetRelation(shardRelationId, false);
+		return false;
+	}
+
+	bool cacheable = false;
+	Oid distributedRelationId = InvalidOid;
+	bool isKnownShard = RelationIsAKnownShardInternal(tableRelationId, &cacheable,
+													  &distributedRelationId);
+
+	if (cacheable)
+	{
+		/* reading pg_dist_shard may have flushed the cache */
+		InitializeKnownShardCache();
+
+		cacheEntry = hash_search(KnownShardCacheHash, &tableRelationId, HASH_ENTER,
+								 &foundInCache);
+		cacheEntry->isKnownShard = isKnownShard;
+		cacheEntry->distributedRelationId = distributedRelationId;
+
+		if (OidIsValid(distributedRelationId))
+		{
+			hash_search(KnownShardDistributedRelationHash, &distributedRelationId,
+						HASH_ENTER, &foundInCache);
+		}
 	}
 
+	return isKnownShard;
+}
+
+
+/*
+ * RelationIsAKnownShardInternal checks whether the given table is a shard of
+ * a distributed table based on its name and pg_dist_shard, and sets
+ * distributedRelationId to that table if so.
+ *
+ * cacheable is set if the outcome only changes when the relation or the
+ * distributed table is invalidated. That is not the case for relations whose
+ * name looks like a shard of a shard id that is not in pg_dist_shard, since
+ * adding such a shard does not invalidate the relation.
+ */
+static bool
+RelationIsAKnownShardInternal(Oid shardRelationId, bool *cacheable,
+							  Oid *distributedRelationId)
+{
+	bool missingOk = true;
+
+	*cacheable = true;
+	*distributedRelationId = InvalidOid;
+
 	/* get the shard's relation name */
 	char *shardRelationName = get_rel_name(shardRelationId);
 
@@ -175,9 +281,13 @@ RelationIsAKnownShard(Oid shardRelationId, bool onlySearchPath)
 	if (!OidIsValid(relationId))
 	{
 		/* there is no such relation */
+		*cacheable = false;
 		return false;
 	}
 
+	/* renaming or moving the distributed table flushes the cache */
+	*distributedRelationId = relationId;
+
 	/* verify that their namespaces are the same */
 	if (get_rel_namespace(shardRelationId) != get_rel_namespace(relationId))
 	{
@@ -201,6 +311,74 @@ RelationIsAKnownShard(Oid shardRelationId, bool onlySearchPath)
 }
 
 
+/*
+ * InitializeKnownShardCache creates the hashes of the known shard cache if
+ * they do not exist yet.
+ */
+static void
+InitializeKnownShardCache(void)
+{
+	HASHCTL info;
+
+	if (KnownShardCacheHash != NULL)
+	{
+		return;
+	}
+
+	memset(&info, 0, sizeof(info));
+	info.keysize = sizeof(Oid);
+	info.entrysize = sizeof(KnownShardCacheEntry);
+	info.hcxt = CacheMemoryContext;
+	int hashFlags = (HASH_ELEM | HASH_BLOBS | HASH_CONTEXT);
+
+	KnownShardCacheHash = hash_create("Known Shard Cache", 1024, &info, hashFlags);
+
+	memset(&info, 0, sizeof(info));
+	info.keysize = sizeof(Oid);
+	info.entrysize = sizeof(Oid);
+	info.hcxt = CacheMemoryContext;
+
+	KnownShardDistributedRelationHash = hash_create("Known Shard Distributed Tables",
+													32, &info, hashFlags);
+}
+
+
+/*
+ * InvalidateKnownShardCache removes the given relation from the known shard
+ * cache. If the relation is the distributed table of cached shards, or the
+ * relation is InvalidOid, the entire cache is flushed, since the names and
+ * shards of the distributed table determine which relations are its shards.
+ */
+void
+InvalidateKnownShardCache(Oid relationId)
+{
+	bool foundInCache = false;
+
+	if (KnownShardCacheHash == NULL)
+	{
+		return;
+	}
+
+	if (OidIsValid(relationId))
+	{
+		hash_search(KnownShardCacheHash, &relationId, HASH_REMOVE, NULL);
+		hash_search(KnownShardDistributedRelationHash, &relationId, HASH_FIND,
+					&foundInCache);
+
+		if (!foundInCache)
+		{
+			return;
+		}
+	}
+
+	hash_destroy(KnownShardCacheHash);
+	hash_destroy(KnownShardDistributedRelationHash);
+
+	KnownShardCacheHash = NULL;
+	KnownShardDistributedRelationHash = NULL;
+}
+
+
 /*
  * ReplaceTableVisibleFunction is a wrapper around ReplaceTableVisibleFunctionWalker.
  * The replace functionality can be enabled/disable via a GUC. This function also
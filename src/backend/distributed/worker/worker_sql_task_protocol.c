@@ -14,6 +14,7 @@
 #include "pgstat.h"
 
 #include "distributed/commands/multi_copy.h"
+#include "distributed/job_cache_space.h"
 #include "distributed/multi_executor.h"
 #include "distributed/transmit.h"
 #include "distributed/version_compat.h"
@@ -247,8 +248,11 @@ TaskFileDestReceiverReceive(TupleTableSlot *slot, DestReceiver *dest)
 static void
 WriteToLocalFile(StringInfo copyData, TaskFileDestReceiver *taskFileDest)
 {
-	int bytesWritten = FileWriteCompat(&taskFileDest->fileCompat, copyData->data,
-									   copyData->len, PG_WAIT_IO);
+	ReserveJobCacheSpace(copyData->len);
+
+	int bytesWritten = FileWriteWithWriteback(&taskFileDest->fileCompat,
+											  copyData->data, copyData->len,
+											  PG_WAIT_IO);
 	if (bytesWritten < 0)
 	{
 		ereport(ERROR, (errcode_for_file_access(),
@@ -1,8 +1,19 @@
 #ifndef ADAPTIVE_EXECUTOR_H
 #define ADAPTIVE_EXECUTOR_H
 
+#include "distributed/multi_executor.h"
 #include "distributed/multi_physical_planner.h"
 
+/*
+ * TaskOrderingPolicy determines in which order the adaptive executor starts
+ * the tasks of a read-only execution.
+ */
+typedef enum TaskOrderingPolicy
+{
+	TASK_ORDERING_PLANNING_ORDER = 0,
+	TASK_ORDERING_LONGEST_FIRST = 1
+} TaskOrderingPolicy;
+
 /* GUC, determining whether Citus opens 1 connection per task */
 extern bool ForceMaxQueryParallelization;
 extern int MaxAdaptiveExecutorPoolSize;
@@ -10,10 +21,106 @@ extern int MaxAdaptiveExecutorPoolSize;
 /* GUC, number of ms to wait between opening connections to the same worker */
 extern int ExecutorSlowStartInterval;
 
+/* GUC, number of read-only tasks to send over a session at once */
+extern int ExecutorPipelineDepth;
+
+/* GUC, determining the order in which read-only tasks are started */
+extern int TaskOrderingPolicy;
+
+/* GUC, determining whether idle pools take over tasks that have other placements */
+extern bool EnableWorkStealing;
+
+/* GUC, number of groups the shards of a node are divided into, 0 disables */
+extern int ShardAffinityGroupCount;
+
+/* GUC, whether to log the CPU time spent on each worker pool */
+extern bool LogWorkerPoolCpuTime;
+
+/* GUC, determining whether slow start uses connection and task timings */
+extern bool EnableAdaptiveSlowStart;
+
+/* GUC, determining whether read-only scans return rows while results arrive */
+extern bool EnableStreamingExecution;
+
+/* GUC, determining whether LIMIT queries stop once they received enough rows */
+extern bool EnableLimitEarlyTermination;
+
+/* GUCs, determining after how long read-only tasks are hedged on another placement */
+extern int HedgedReadPercentile;
+extern int HedgedReadMinDelay;
+
+/* GUC, determining whether SELECT tasks receive their results in binary format */
+extern bool EnableBinaryProtocol;
+
+/* GUC, determining whether PREPARE TRANSACTION is sent along with the last task */
+extern bool EnablePipelinedPrepare;
+
+/* GUC, determining whether BEGIN is sent along with the first task */
+extern bool EnablePipelinedBegin;
+
+/* GUC, maximum number of statements the executor prepares over a connection */
+extern int MaxPreparedStatementsPerConnection;
+
+/* GUC, memory in kB that the tuple stores of an execution may use, -1 for no limit */
+extern int MaxCoordinatorQueryMemory;
+
+/*
+ * TaskExecutionTiming shows where the time of a successfully finished task was
+ * spent, for EXPLAIN ANALYZE.
+ */
+typedef struct TaskExecutionTiming
+{
+	uint32 taskId;
+	char *nodeName;
+	int nodePort;
+
+	/* time spent waiting for a new connection to the node to be established */
+	double connectionWaitMs;
+
+	/* time spent waiting in the worker pool for a session to become available */
+	double queueTimeMs;
+
+	/* time between sending the command and receiving the first result */
+	double executionTimeMs;
+
+	/* time between receiving the first and the last result */
+	double transferTimeMs;
+
+	/* size of the column values received */
+	uint64 bytesReceived;
+} TaskExecutionTiming;
+
+/*
+ * TaskCompletedCallback is called with the tasks that finished in an execution,
+ * and returns the tasks that should be added to the execution.
+ */
+typedef List *(*TaskCompletedCallback)(List *completedTaskList, void *context);
+
 extern uint64 ExecuteTaskList(RowModifyLevel modLevel, List *taskList,
 							  int targetPoolSize);
 extern uint64 ExecuteTaskListOutsideTransaction(RowModifyLevel modLevel, List *taskList,
 												int targetPoolSize, List *jobIdList);
+extern uint64 ExecuteTaskGraphOutsideTransaction(RowModifyLevel modLevel,
+												 List *taskList, int targetPoolSize,
+												 List *jobIdList,
+												 TaskCompletedCallback
+												 taskCompletedCallback,
+												 void *taskCompletedCallbackContext);
+extern uint64 ExecuteTaskListExtendedWithCallback(RowModifyLevel modLevel,
+												  List *taskList,
+												  TupleDesc tupleDescriptor,
+												  Tuplestorestate *tupleStore,
+												  bool hasReturning, int targetPoolSize,
+												  TransactionProperties *xactProperties,
+												  List *jobIdList,
+												  TaskCompletedCallback
+												  taskCompletedCallback,
+												  void *taskCompletedCallbackContext);
+extern int TupleStoreMemoryLimit(int tupleStoreCount);
+extern uint64 ExecuteTaskListWithCallback(RowModifyLevel modLevel, List *taskList,
+										  int targetPoolSize, char *sessionSetupCommand,
+										  TaskCompletedCallback taskCompletedCallback,
+										  void *taskCompletedCallbackContext);
 
 
 #endif /* ADAPTIVE_EXECUTOR_H */
@@ -17,6 +17,7 @@
 #include "datatype/timestamp.h"
 #include "distributed/transaction_identifier.h"
 #include "nodes/pg_list.h"
+#include "port/atomics.h"
 #include "storage/lwlock.h"
 #include "storage/proc.h"
 #include "storage/s_lock.h"
@@ -43,12 +44,18 @@ typedef struct CitusInitiatedBackend
  * transaction as well. In other words, we could have backends that
  * CitusInitiatedBackend is set but DistributedTransactionId is not set such as an
  * "INSERT" query which is not inside a transaction block.
+ *
+ * Writers hold the mutex, which serializes them, and increment changeCount
+ * before and after changing the data. Readers do not take the mutex, instead
+ * they copy the data and retry if changeCount was odd or changed meanwhile,
+ * such that scanning all backends never blocks the backends themselves.
  */
 typedef struct BackendData
 {
 	Oid databaseId;
 	Oid userId;
 	slock_t mutex;
+	pg_atomic_uint32 changeCount;
 	bool cancelledDueToDeadlock;
 	CitusInitiatedBackend citusBackend;
 	DistributedTransactionId transactionId;
@@ -67,6 +74,7 @@ extern void GetBackendDataForProc(PGPROC *proc, BackendData *result);
 extern void CancelTransactionDueToDeadlock(PGPROC *proc);
 extern bool MyBackendGotCancelledDueToDeadlock(void);
 extern List * ActiveDistributedTransactionNumbers(void);
+extern List * ActiveDistributedTransactionIds(void);
 LocalTransactionId GetMyProcLocalTransactionId(void);
 
 #endif /* BACKEND_DATA_H */
@@ -0,0 +1,40 @@
+/*-------------------------------------------------------------------------
+ *
+ * bloom_filter.h
+ *	  Bloom filters over the hash values of repartition join keys.
+ *
+ * Copyright (c) Citus Data, Inc.
+ *-------------------------------------------------------------------------
+ */
+
+#ifndef BLOOM_FILTER_H
+#define BLOOM_FILTER_H
+
+#include "postgres.h"
+
+#include "fmgr.h"
+
+
+/* number of bits we set in the filter for every hash value */
+#define BLOOM_FILTER_PROBE_COUNT 3
+
+/* build and probe functions for the filter pre-pass of repartition joins */
+#define BLOOM_FILTER_BUILD_QUERY \
+	"SELECT pg_catalog.worker_bloom_filter_build(" \
+	"pg_catalog.worker_hash(bloom_filter_input.%s), %d) FROM (%s) bloom_filter_input"
+#define BLOOM_FILTER_PROBE_QUERY \
+	"SELECT * FROM (%s) bloom_filter_input WHERE " \
+	"pg_catalog.worker_bloom_filter_contains(%s::bytea, " \
+	"pg_catalog.worker_hash(bloom_filter_input.%s))"
+
+
+extern void BloomFilterAddHash(bytea *bloomFilter, uint32 hashValue);
+extern bool BloomFilterContainsHash(bytea *bloomFilter, uint32 hashValue);
+extern void BloomFilterUnion(bytea *bloomFilter, bytea *otherBloomFilter);
+extern double BloomFilterFillFactor(bytea *bloomFilter);
+
+/* SQL callable functions */
+extern Datum worker_bloom_filter_build_sfunc(PG_FUNCTION_ARGS);
+extern Datum worker_bloom_filter_contains(PG_FUNCTION_ARGS);
+
+#endif /* BLOOM_FILTER_H */
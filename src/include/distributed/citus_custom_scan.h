@@ -14,6 +14,7 @@
 #include "distributed/multi_server_executor.h"
 #include "executor/execdesc.h"
 #include "nodes/plannodes.h"
+#include "portability/instr_time.h"
 
 typedef struct CitusScanState
 {
@@ -26,6 +27,44 @@ typedef struct CitusScanState
 	MultiExecutorType executorType;   /* distributed executor type */
 	bool finishedRemoteScan;          /* flag to check if remote scan is finished */
 	Tuplestorestate *tuplestorestate; /* tuple store to store distributed results */
+	int eflags;                       /* executor flags passed to BeginCustomScan */
+
+	/*
+	 * When the scan streams its results, the distributed execution that is still
+	 * running. The tuple store then only contains the rows that were received but
+	 * not yet returned.
+	 */
+	struct DistributedExecution *streamingExecution;
+
+	/*
+	 * When the scan streams the results of a single local task, the query
+	 * descriptor of the task. Rows are then returned straight from the plan
+	 * of the task rather than from the tuple store.
+	 */
+	struct QueryDesc *localQueryDesc;
+
+	/* anchor shard and start time of the streamed local task, for statistics */
+	uint64 localTaskShardId;
+	instr_time localTaskStartTime;
+
+	/* start time, returned rows and received bytes, for statement statistics */
+	instr_time startTime;
+	uint64 rowsReturned;
+	uint64 bytesReceived;
+
+	/*
+	 * Memory in kB that each tuple store of the execution may use, and the
+	 * number of tuple stores that spilled to disk, for EXPLAIN ANALYZE.
+	 */
+	int tupleStoreMemory;
+	int spilledTupleStoreCount;
+
+	/*
+	 * For EXPLAIN ANALYZE, the SubPlanExecutionStats of the subplans and the
+	 * TaskExecutionTimings of the remote tasks of the execution.
+	 */
+	List *subPlanStatsList;
+	List *taskTimingList;
 } CitusScanState;
 
 
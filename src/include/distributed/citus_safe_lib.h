@@ -20,12 +20,138 @@
 extern void ereport_constraint_handler(const char *message, void *pointer, errno_t error);
 extern int64 SafeStringToInt64(const char *str);
 extern uint64 SafeStringToUint64(const char *str);
-extern void SafeQsort(void *ptr, rsize_t count, rsize_t size,
-					  int (*comp)(const void *, const void *));
-void * SafeBsearch(const void *key, const void *ptr, rsize_t count, rsize_t size,
-				   int (*comp)(const void *, const void *));
 int SafeSnprintf(char *str, rsize_t count, const char *fmt, ...);
 
 #define memset_struct_0(variable) memset(&variable, 0, sizeof(variable))
 
+/*
+ * memcpy_struct copies the given variable into a variable or array of at least
+ * its size, which is checked at compile time, so there is nothing to check at
+ * runtime.
+ */
+#define memcpy_struct(destination, source) \
+	(StaticAssertExpr(sizeof(destination) >= sizeof(source), \
+					  "memcpy_struct: source is larger than destination"), \
+	 memcpy(&(destination), &(source), sizeof(source))) /* IGNORE-BANNED */
+
+
+/*
+ * SafeMemcpy is memcpy_s for hot paths. The checks of memcpy_s are inlined
+ * into the caller, and only when one of them fails memcpy_s is called, which
+ * clears the destination and calls the ereport_constraint_handler with the
+ * violated constraint.
+ */
+static inline void
+SafeMemcpy(void *destination, rsize_t destinationSize, const void *source,
+		   rsize_t count)
+{
+	const char *destinationBytes = (const char *) destination;
+	const char *sourceBytes = (const char *) source;
+
+	if (likely(destination != NULL && source != NULL && count > 0 &&
+			   count <= destinationSize && destinationSize <= RSIZE_MAX_MEM &&
+			   (destinationBytes + destinationSize <= sourceBytes ||
+				sourceBytes + count <= destinationBytes)))
+	{
+		/* the same checks as memcpy_s passed */
+		memcpy(destination, source, count); /* IGNORE-BANNED */
+		return;
+	}
+
+	memcpy_s(destination, destinationSize, source, count);
+}
+
+
+/*
+ * SafeQsort is the non reentrant version of qsort (qsort vs qsort_r), but it
+ * does the input checks required for qsort_s:
+ *  1. count or size is greater than RSIZE_MAX
+ *  2. ptr or comp is a null pointer (unless count is zero)
+ * source: https://en.cppreference.com/w/c/algorithm/qsort
+ *
+ * When it hits these errors it calls the ereport_constraint_handler. It is
+ * inlined, such that the checks of a constant size fold away.
+ *
+ * NOTE: this functions calls pg_qsort instead of stdlib qsort.
+ */
+static inline void
+SafeQsort(void *ptr, rsize_t count, rsize_t size,
+		  int (*comp)(const void *, const void *))
+{
+	if (unlikely(count > RSIZE_MAX_MEM))
+	{
+		ereport_constraint_handler("SafeQsort: count exceeds max",
+								   NULL, ESLEMAX);
+	}
+
+	if (unlikely(size > RSIZE_MAX_MEM))
+	{
+		ereport_constraint_handler("SafeQsort: size exceeds max",
+								   NULL, ESLEMAX);
+	}
+	if (size != 0)
+	{
+		if (unlikely(ptr == NULL))
+		{
+			ereport_constraint_handler("SafeQsort: ptr is NULL", NULL, ESNULLP);
+		}
+		if (unlikely(comp == NULL))
+		{
+			ereport_constraint_handler("SafeQsort: comp is NULL", NULL, ESNULLP);
+		}
+	}
+	pg_qsort(ptr, count, size, comp);
+}
+
+
+/*
+ * SafeBsearch is a non reentrant version of bsearch, but it does the
+ * input checks required for bsearch_s:
+ *  1. count or size is greater than RSIZE_MAX
+ *  2. key, ptr or comp is a null pointer (unless count is zero)
+ * source: https://en.cppreference.com/w/c/algorithm/bsearch
+ *
+ * When it hits these errors it calls the ereport_constraint_handler. It is
+ * inlined, such that the checks of a constant size fold away.
+ */
+static inline void *
+SafeBsearch(const void *key, const void *ptr, rsize_t count, rsize_t size,
+			int (*comp)(const void *, const void *))
+{
+	if (unlikely(count > RSIZE_MAX_MEM))
+	{
+		ereport_constraint_handler("SafeBsearch: count exceeds max",
+								   NULL, ESLEMAX);
+	}
+
+	if (unlikely(size > RSIZE_MAX_MEM))
+	{
+		ereport_constraint_handler("SafeBsearch: size exceeds max",
+								   NULL, ESLEMAX);
+	}
+	if (size != 0)
+	{
+		if (unlikely(key == NULL))
+		{
+			ereport_constraint_handler("SafeBsearch: key is NULL", NULL, ESNULLP);
+		}
+		if (unlikely(ptr == NULL))
+		{
+			ereport_constraint_handler("SafeBsearch: ptr is NULL", NULL, ESNULLP);
+		}
+		if (unlikely(comp == NULL))
+		{
+			ereport_constraint_handler("SafeBsearch: comp is NULL", NULL, ESNULLP);
+		}
+	}
+
+	/*
+	 * Explanation of IGNORE-BANNED:
+	 * bsearch is safe to use here since we check the same thing bsearch_s
+	 * does. We cannot use bsearch_s as a replacement, since it's not available
+	 * in safestringlib.
+	 */
+	return bsearch(key, ptr, count, size, comp); /* IGNORE-BANNED */
+}
+
 #endif
@@ -0,0 +1,82 @@
+/*-------------------------------------------------------------------------
+ *
+ * command_progress.h
+ *    Tracking of the progress of long running COPY, INSERT..SELECT and
+ *    repartition queries.
+ *
+ * Copyright (c) Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#ifndef COMMAND_PROGRESS_H
+#define COMMAND_PROGRESS_H
+
+#include "distributed/multi_progress.h"
+
+
+#define COPY_PROGRESS_MAGIC_NUMBER 1337133713371341
+#define INSERT_SELECT_PROGRESS_MAGIC_NUMBER 1337133713371342
+#define REPARTITION_QUERY_PROGRESS_MAGIC_NUMBER 1337133713371343
+
+
+/* the kinds of steps a command is made of, as shown in citus_command_progress */
+typedef enum CommandProgressStepType
+{
+	/* rows that COPY routed to a shard */
+	COMMAND_PROGRESS_STEP_SHARD = 0,
+
+	/* phases of a repartitioned INSERT..SELECT */
+	COMMAND_PROGRESS_STEP_PARTITION = 1,
+	COMMAND_PROGRESS_STEP_FETCH = 2,
+	COMMAND_PROGRESS_STEP_INSERT = 3,
+
+	/* tasks of a job in a repartition query */
+	COMMAND_PROGRESS_STEP_JOB = 4
+} CommandProgressStepType;
+
+/*
+ * CommandProgressStep is the progress of a single step of a command, as kept
+ * in the progress monitor of the backend that runs the command. The counters
+ * that do not apply to a step stay 0.
+ */
+typedef struct CommandProgressStep
+{
+	CommandProgressStepType stepType;
+	Oid relationId;
+
+	/* shard id for shard steps, job id for job steps, 0 otherwise */
+	uint64 stepId;
+
+	int64 tasksTotal;
+	int64 tasksDone;
+	int64 fragmentCount;
+	int64 rowCount;
+	int64 byteCount;
+} CommandProgressStep;
+
+/*
+ * CommandProgress keeps the progress monitor of a command in the backend
+ * that runs the command.
+ */
+typedef struct CommandProgress
+{
+	uint64 progressTypeMagicNumber;
+	ProgressMonitorData *monitor;
+	CommandProgressStep *steps;
+	int stepCount;
+} CommandProgress;
+
+
+extern CommandProgress * StartCommandProgress(uint64 progressTypeMagicNumber,
+											  Oid relationId, int stepCount);
+extern CommandProgress * GetCurrentCommandProgress(uint64 progressTypeMagicNumber);
+extern CommandProgressStep * CommandProgressStepById(CommandProgress *progress,
+													 CommandProgressStepType stepType,
+													 uint64 stepId);
+extern void FinishCommandProgress(CommandProgress *progress);
+extern void ResetCommandProgress(void);
+extern List * CommandProgressTasksCompleted(List *completedTaskList, void *context);
+
+
+#endif /* COMMAND_PROGRESS_H */
@@ -142,6 +142,13 @@ extern List * PreprocessGrantStmt(Node *node, const char *queryString);
 
 
 /* index.c - forward declarations */
+
+/* GUC, maximum number of concurrent index commands running on a single node */
+extern int MaxConcurrentIndexBuildsPerNode;
+
+/* identifies the progress monitors of concurrent index commands */
+#define CONCURRENT_INDEX_MAGIC_NUMBER 1337133713371339
+
 extern bool IsIndexRenameStmt(RenameStmt *renameStmt);
 extern List * PreprocessIndexStmt(Node *createIndexStatement,
 								  const char *createIndexCommand);
@@ -152,6 +159,8 @@ extern List * PreprocessDropIndexStmt(Node *dropIndexStatement,
 extern List * PostprocessIndexStmt(Node *node,
 								   const char *queryString);
 extern void ErrorIfUnsupportedAlterIndexStmt(AlterTableStmt *alterTableStatement);
+extern void ExecuteConcurrentIndexTaskList(Oid relationId, List *taskList,
+										   bool localExecutionSupported);
 
 /* objectaddress.c - forward declarations */
 extern ObjectAddress CreateExtensionStmtObjectAddress(Node *stmt, bool missing_ok);
@@ -266,8 +275,24 @@ extern char * GenerateBackupNameForProcCollision(const ObjectAddress *address);
 extern ObjectWithArgs * ObjectWithArgsFromOid(Oid funcOid);
 
 /* vacuum.c - froward declarations */
+
+/* GUCs, per-node parallelism and cost-based delay of VACUUM and ANALYZE on shards */
+extern int MaxConcurrentVacuumsPerNode;
+extern int WorkerVacuumCostDelay;
+extern int WorkerVacuumCostLimit;
+
+/* identifies the progress monitors of distributed VACUUM and ANALYZE commands */
+#define VACUUM_MAGIC_NUMBER 1337133713371340
+
 extern void PostprocessVacuumStmt(VacuumStmt *vacuumStmt, const char *vacuumCommand);
 
+/* distributed_statistics.c - forward declarations */
+
+/* GUC, number of shards that ANALYZE samples for coordinator statistics */
+extern int AnalyzeSampleShardCount;
+
+extern void UpdateCoordinatorStatistics(Oid relationId);
+
 extern bool ShouldPropagateSetCommand(VariableSetStmt *setStmt);
 extern void PostprocessVariableSetStmt(VariableSetStmt *setStmt, const char *setCommand);
 
@@ -13,8 +13,10 @@
 #define MULTI_COPY_H
 
 
+#include "distributed/command_progress.h"
 #include "distributed/master_metadata_utility.h"
 #include "distributed/metadata_cache.h"
+#include "lib/ilist.h"
 #include "nodes/execnodes.h"
 #include "nodes/parsenodes.h"
 #include "parser/parse_coerce.h"
@@ -117,10 +119,19 @@ typedef struct CitusCopyDestReceiver
 	/* socket to CopyConnectionState map */
 	HTAB *connectionStateHash;
 
+	/* CopyShardStates ordered from most to least recently used */
+	dlist_head shardStateLruList;
+
+	/* memory used by the placement buffers beyond their initial size */
+	uint64 bufferedMemorySize;
+
 	/* state on how to copy out data types */
 	CopyOutState copyOutState;
 	FmgrInfo *columnOutputFunctions;
 
+	/* serialized form of the tuple that is being sent to the placements */
+	StringInfo rowData;
+
 	/* instructions for coercing incoming tuples */
 	CopyCoercionData *columnCoercionPaths;
 
@@ -135,9 +146,28 @@ typedef struct CitusCopyDestReceiver
 
 	/* copy into intermediate result */
 	char *intermediateResultIdPrefix;
+
+	/* progress of the COPY per shard, NULL if the progress is not monitored */
+	CommandProgress *progress;
 } CitusCopyDestReceiver;
 
 
+/* GUC, data size after which a connection switches over to another placement */
+extern int CopySwitchOverThresholdBytes;
+
+/* GUC, number of new shards that COPY into an append-distributed table fills at once */
+extern int AppendCopyShardCount;
+
+/* GUC, whether COPY into hash-distributed tables forwards rows without parsing them */
+extern bool EnableCopyPassThrough;
+
+/* GUC, memory in kB that COPY may use for buffering rows, 0 for no limit */
+extern int CopyMemoryLimit;
+
+/* GUC, whether COPY (SELECT ..) TO STDOUT forwards the COPY output of the workers */
+extern bool EnableCopySelectForwarding;
+
+
 /* function declarations for copying into a distributed table */
 extern CitusCopyDestReceiver * CreateCitusCopyDestReceiver(Oid relationId,
 														   List *columnNameList,
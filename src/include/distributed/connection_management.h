@@ -53,7 +53,15 @@ enum MultiConnectionMode
 	OUTSIDE_TRANSACTION = 1 << 4,
 
 	/* connection has not been used to access data */
-	REQUIRE_SIDECHANNEL = 1 << 5
+	REQUIRE_SIDECHANNEL = 1 << 5,
+
+	/*
+	 * Only establish a new connection if the node is below
+	 * citus.max_shared_pool_size, otherwise return NULL. Callers
+	 * that pass this flag must be able to proceed without the
+	 * connection.
+	 */
+	OPTIONAL_CONNECTION = 1 << 6
 };
 
 /*
@@ -134,6 +142,18 @@ typedef struct MultiConnection
 
 	/* number of bytes sent to PQputCopyData() since last flush */
 	uint64 copyBytesWrittenSinceLastFlush;
+
+	/* whether the connection is counted in the shared connection stats */
+	bool sharedCounterIncremented;
+
+	/* the result of a COMMIT PREPARED of a finished transaction is yet to be read */
+	bool commitPreparedPending;
+
+	/* names of the statements prepared over the connection */
+	List *preparedStatementList;
+
+	/* group of shards the executor prefers to run over the connection, or -1 */
+	int shardAffinityGroup;
 } MultiConnection;
 
 
@@ -179,6 +199,12 @@ extern int NodeConnectionTimeout;
 /* maximum number of connections to cache per worker per session */
 extern int MaxCachedConnectionsPerWorker;
 
+/* whether connections to nodes at citus.max_shared_pool_size are closed after use */
+extern bool ReleaseConnectionsAtSharedPoolLimit;
+
+/* number of connections to each node to open before the first distributed query */
+extern int WarmUpConnectionCount;
+
 /* parameters used for outbound connections */
 extern char *NodeConninfo;
 
@@ -223,12 +249,21 @@ extern void CloseNodeConnectionsAfterTransaction(char *nodeName, int nodePort);
 extern void CloseConnection(MultiConnection *connection);
 extern void ShutdownAllConnections(void);
 extern void ShutdownConnection(MultiConnection *connection);
+extern void CancelRunningRemoteCommands(void);
 
 /* dealing with a connection */
 extern void FinishConnectionListEstablishment(List *multiConnectionList);
 extern void FinishConnectionEstablishment(MultiConnection *connection);
+extern void WarmUpConnectionsIfNeeded(void);
+extern void WaitForPendingCommitPrepared(void);
+extern int WarmUpConnections(int connectionCount);
 extern void ClaimConnectionExclusively(MultiConnection *connection);
 extern void UnclaimConnection(MultiConnection *connection);
+extern int NodeConnectionCount(const char *hostname, int32 port);
+extern bool ConnectionHasPreparedStatement(MultiConnection *connection,
+										   const char *statementName);
+extern void RememberPreparedStatement(MultiConnection *connection,
+									  const char *statementName);
 
 /* dealing with notice handler */
 extern void SetCitusNoticeProcessor(MultiConnection *connection);
@@ -0,0 +1,29 @@
+/*-------------------------------------------------------------------------
+ *
+ * copy_compression.h
+ *	  Compressed framing of COPY data streams between nodes.
+ *
+ * Copyright (c) Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#ifndef COPY_COMPRESSION_H
+#define COPY_COMPRESSION_H
+
+#include "lib/stringinfo.h"
+
+
+/* amount of raw COPY data that is compressed into a single frame */
+#define COPY_COMPRESSION_BLOCK_SIZE (64 * 1024)
+
+/* GUC, whether intermediate results are compressed while sent between nodes */
+extern bool EnableIntermediateResultCompression;
+
+
+extern void AppendCompressedCopyFrame(StringInfo frame, const char *data,
+									  int dataLength);
+extern void AppendDecompressedCopyFrame(StringInfo rawData, const char *frame,
+										int frameLength);
+
+#endif /* COPY_COMPRESSION_H */
@@ -0,0 +1,24 @@
+/*-------------------------------------------------------------------------
+ *
+ * cpu_affinity.h
+ *	  Pinning of executor backends and the maintenance daemon to CPUs.
+ *
+ * Copyright (c) Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#ifndef CPU_AFFINITY_H
+#define CPU_AFFINITY_H
+
+
+/* Config variables managed via guc.c */
+extern char *ExecutorCpuAffinity;
+extern char *MaintenanceDaemonCpuAffinity;
+
+
+extern bool CpuAffinityIsSupported(void);
+extern bool CpuListIsValid(const char *cpuList);
+extern void ApplyCpuAffinity(const char *cpuList);
+
+#endif /* CPU_AFFINITY_H */
@@ -14,6 +14,7 @@
 #include "nodes/parsenodes.h"
 
 extern bool EnableCTEInlining;
+extern int CTEInlineSizeThreshold;
 
 extern void RecursivelyInlineCtesInQueryTree(Query *query);
 extern bool QueryTreeContainsInlinableCTE(Query *queryTree);
@@ -0,0 +1,29 @@
+/*-------------------------------------------------------------------------
+ *
+ * ddl_buffer.h
+ *   Deferred propagation of DDL commands in transaction blocks
+ *
+ * Copyright (c) Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#ifndef DDL_BUFFER_H
+#define DDL_BUFFER_H
+
+#include "nodes/nodes.h"
+#include "nodes/pg_list.h"
+
+/* GUC, number of DDL commands buffered in a transaction block */
+extern int DDLBufferSize;
+
+
+extern bool BufferDDLTaskListIfPossible(Oid relationId, List *taskList);
+extern bool BufferedDDLCommandsPending(void);
+extern bool IsBufferableDDLStatement(Node *parsetree);
+extern void FlushBufferedDDLCommands(void);
+extern void BufferedDDLCommandsAtSubXactCommit(void);
+extern void BufferedDDLCommandsAtSubXactAbort(void);
+extern void ResetDDLBuffer(void);
+
+#endif /* DDL_BUFFER_H */
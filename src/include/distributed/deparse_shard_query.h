@@ -21,11 +21,43 @@
 #include "distributed/citus_custom_scan.h"
 
 
+/* GUC, whether router tasks are executed with prepared statements */
+extern bool EnablePreparedStatementCaching;
+
+/* GUC, whether multi-shard queries are deparsed once for all shards */
+extern bool EnableShardQueryTemplates;
+
+
+/*
+ * ShardQueryTemplate is a query that is deparsed once for all shards, with a
+ * placeholder for the shard name of every relation in the query.
+ */
+typedef struct ShardQueryTemplate
+{
+	/* the deparsed query, NULL if the query cannot be deparsed as a template */
+	char *templateString;
+
+	/* the relation of every placeholder, in the order of placeholder ids */
+	List *relationIdList;
+	List *schemaNameList;
+	List *relationNameList;
+
+	/* relations that are replaced by an empty result, as they have no shard */
+	List *emptyRelationIdList;
+} ShardQueryTemplate;
+
+
 extern void RebuildQueryStrings(Job *workerJob);
 extern bool UpdateRelationToShardNames(Node *node, List *relationShardList);
+extern bool ShouldLazyDeparseQuery(Task *task);
 extern void SetTaskQuery(Task *task, Query *query);
 extern void SetTaskQueryString(Task *task, char *queryString);
+extern void SetTaskQueryTemplate(Task *task, Query *query);
 extern char * TaskQueryString(Task *task);
+extern ShardQueryTemplate * DeparseShardQueryTemplate(Query *query,
+													  List *relationShardList);
+extern char * InstantiateShardQueryTemplate(ShardQueryTemplate *queryTemplate,
+											List *relationShardList);
 extern bool UpdateRelationsToLocalShardTables(Node *node, List *relationShardList);
 
 #endif /* DEPARSE_SHARD_QUERY_H */
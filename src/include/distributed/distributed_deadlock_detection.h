@@ -27,6 +27,12 @@ typedef struct TransactionNode
 	/* list of TransactionNode that this distributed transaction is waiting for */
 	List *waitsFor;
 
+	/* list of TransactionNode that are waiting for this distributed transaction */
+	List *waitedOnBy;
+
+	/* number of waitsFor entries that may be part of a cycle, 0 once trimmed */
+	int remainingWaitsForCount;
+
 	/* backend that is on the initiator node */
 	PGPROC *initiatorProc;
 
@@ -38,7 +44,7 @@ typedef struct TransactionNode
 extern bool LogDistributedDeadlockDetection;
 
 
-extern bool CheckForDistributedDeadlocks(void);
+extern bool CheckForDistributedDeadlocks(int minTransactionAgeMs);
 extern HTAB * BuildAdjacencyListsForWaitGraph(WaitGraph *waitGraph);
 extern char * WaitsForToString(List *waitsFor);
 
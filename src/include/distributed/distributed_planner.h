@@ -36,6 +36,12 @@
 /* level of planner calls */
 extern int PlannerLevel;
 
+/* GUC, determining whether multi-shard SELECTs can have generic plans */
+extern bool EnableGenericMultiShardPlans;
+
+/* GUC, determining whether the time spent in each planning phase is logged */
+extern bool LogPlanningTime;
+
 
 typedef struct RelationRestrictionContext
 {
@@ -101,6 +107,12 @@ typedef struct FastPathRestrictionContext
 	 * Set to true when distKey = Param; in the queryTree
 	 */
 	bool distributionKeyHasParam;
+
+	/*
+	 * Set to true when the query was routed to the shard of a partition, which
+	 * depends on the privileges of the current user on the partition.
+	 */
+	bool prunedToPartition;
 }FastPathRestrictionContext;
 
 typedef struct PlannerRestrictionContext
@@ -188,6 +200,8 @@ extern bool NeedsDistributedPlanning(Query *query);
 extern struct DistributedPlan * GetDistributedPlan(CustomScan *node);
 extern void multi_relation_restriction_hook(PlannerInfo *root, RelOptInfo *relOptInfo,
 											Index restrictionIndex, RangeTblEntry *rte);
+extern void CitusGetRelationInfo(PlannerInfo *root, Oid relationId, bool inhparent,
+								 RelOptInfo *relOptInfo);
 extern void multi_join_restriction_hook(PlannerInfo *root,
 										RelOptInfo *joinrel,
 										RelOptInfo *outerrel,
@@ -204,6 +218,7 @@ extern int GetRTEIdentity(RangeTblEntry *rte);
 extern int32 BlessRecordExpression(Expr *expr);
 extern void DissuadePlannerFromUsingPlan(PlannedStmt *plan);
 extern PlannedStmt * FinalizePlan(PlannedStmt *localPlan,
-								  struct DistributedPlan *distributedPlan);
+								  struct DistributedPlan *distributedPlan,
+								  int cursorOptions);
 
 #endif /* DISTRIBUTED_PLANNER_H */
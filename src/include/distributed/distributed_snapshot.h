@@ -0,0 +1,31 @@
+/*-------------------------------------------------------------------------
+ *
+ * distributed_snapshot.h
+ *	  Consistent snapshots of all nodes for multi-shard reads.
+ *
+ * Copyright (c) Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#ifndef DISTRIBUTED_SNAPSHOT_H
+#define DISTRIBUTED_SNAPSHOT_H
+
+#include "distributed/multi_physical_planner.h"
+#include "nodes/pg_list.h"
+
+
+/* GUC, whether to read from a consistent snapshot of all nodes */
+extern bool EnableDistributedSnapshot;
+
+
+extern bool ShouldEstablishDistributedSnapshot(RowModifyLevel modLevel, List *taskList,
+											   bool hasDependentJobs);
+extern void EnsureDistributedSnapshotForExecution(RowModifyLevel modLevel,
+												  List *taskList,
+												  bool hasDependentJobs);
+extern bool InDistributedSnapshot(void);
+extern char * DistributedSnapshotIdForNode(char *nodeName, int nodePort);
+extern void ResetDistributedSnapshot(void);
+
+#endif /* DISTRIBUTED_SNAPSHOT_H */
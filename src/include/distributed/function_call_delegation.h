@@ -12,10 +12,32 @@
 #include "postgres.h"
 
 #include "distributed/distributed_planner.h"
+#include "distributed/metadata_cache.h"
 #include "distributed/multi_physical_planner.h"
 
 
+/*
+ * BatchedFunctionCall is the call of a distributed function or procedure on
+ * a single worker, which gets the elements of an array distribution argument
+ * that belong to the shards on that worker.
+ */
+typedef struct BatchedFunctionCall
+{
+	/* placement of the shard of the first element on the worker */
+	ShardPlacement *placement;
+
+	FuncExpr *funcExpr;
+} BatchedFunctionCall;
+
+
+extern bool EnableBatchedFunctionDelegation;
+extern bool EnablePreparedFunctionDelegation;
+
+
 PlannedStmt * TryToDelegateFunctionCall(DistributedPlanningContext *planContext);
+extern List * SplitFunctionCallByDistributionArgument(FuncExpr *funcExpr,
+													  int distributionArgIndex,
+													  CitusTableCacheEntry *distTable);
 
 
 #endif /* FUNCTION_CALL_DELEGATION_H */
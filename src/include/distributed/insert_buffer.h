@@ -0,0 +1,26 @@
+/*-------------------------------------------------------------------------
+ *
+ * insert_buffer.h
+ *   Write-behind buffering of single-row INSERTs in transaction blocks
+ *
+ * Copyright (c) Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#ifndef INSERT_BUFFER_H
+#define INSERT_BUFFER_H
+
+#include "distributed/citus_custom_scan.h"
+
+/* GUC, number of rows of single-row INSERTs buffered per shard */
+extern int InsertBufferSize;
+
+
+extern bool BufferInsertIfPossible(CitusScanState *scanState);
+extern void FlushBufferedInserts(void);
+extern void BufferedInsertsAtSubXactCommit(void);
+extern void BufferedInsertsAtSubXactAbort(void);
+extern void ResetInsertBuffers(void);
+
+#endif /* INSERT_BUFFER_H */
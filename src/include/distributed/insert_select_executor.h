@@ -17,6 +17,7 @@
 #include "executor/execdesc.h"
 
 extern bool EnableRepartitionedInsertSelect;
+extern int InsertSelectBatchSize;
 
 extern TupleTableSlot * CoordinatorInsertSelectExecScan(CustomScanState *node);
 extern bool ExecutingInsertSelect(void);
@@ -23,6 +23,10 @@
 #include "nodes/plannodes.h"
 
 
+/* GUC, number of rows from which multi-row INSERTs are sent with COPY */
+extern int MultiRowInsertCopyThreshold;
+
+
 extern bool InsertSelectIntoCitusTable(Query *query);
 extern bool CheckInsertSelectQuery(Query *query);
 extern bool InsertSelectIntoLocalTable(Query *query);
@@ -35,6 +39,9 @@ extern DistributedPlan * CreateInsertSelectPlan(uint64 planId, Query *originalQu
 												PlannerRestrictionContext *
 												plannerRestrictionContext);
 extern char * InsertSelectResultIdPrefix(uint64 planId);
+extern bool MultiRowInsertCanUseCopy(Query *query);
+extern DistributedPlan * CreateMultiRowInsertCopyPlan(uint64 planId,
+													  Query *originalQuery);
 
 
 #endif /* INSERT_SELECT_PLANNER_H */
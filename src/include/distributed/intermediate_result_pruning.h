@@ -28,6 +28,8 @@ extern void RecordSubplanExecutionsOnNodes(HTAB *intermediateResultsHash,
 										   DistributedPlan *distributedPlan);
 extern IntermediateResultsHashEntry * SearchIntermediateResult(HTAB *resultsHash,
 															   char *resultId);
+extern void RecordPartitionedSubPlanResults(DistributedPlan *plan,
+											Query *originalQuery);
 
 /* utility functions related to UsedSubPlans */
 extern List * MergeUsedSubPlanLists(List *leftSubPlanList, List *rightSubPlanList);
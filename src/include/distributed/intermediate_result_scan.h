@@ -0,0 +1,33 @@
+/*-------------------------------------------------------------------------
+ *
+ * intermediate_result_scan.h
+ *    Parallel scan of binary intermediate result files.
+ *
+ * Copyright (c) Citus Data, Inc.
+ *-------------------------------------------------------------------------
+ */
+
+#ifndef INTERMEDIATE_RESULT_SCAN_H
+#define INTERMEDIATE_RESULT_SCAN_H
+
+#include "nodes/extensible.h"
+#if PG_VERSION_NUM >= 120000
+#include "nodes/pathnodes.h"
+#else
+#include "nodes/relation.h"
+#endif
+
+
+/* GUC, whether reading intermediate results can use parallel workers */
+extern bool EnableParallelIntermediateResultScan;
+
+extern CustomScanMethods ParallelIntermediateResultScanMethods;
+
+
+extern void AddParallelIntermediateResultScanPath(RelOptInfo *relOptInfo,
+												  double rowCount,
+												  int64 totalResultSize,
+												  Cost startupCost, Cost rowCost,
+												  Cost ioCost);
+
+#endif /* INTERMEDIATE_RESULT_SCAN_H */
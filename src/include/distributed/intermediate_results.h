@@ -48,19 +48,48 @@ typedef struct DistributedResultFragment
 } DistributedResultFragment;
 
 
+/*
+ * IntermediateResultRowFilter decides whether the row at the given position
+ * in a sequence of result files is read, rows that are not read are skipped
+ * without parsing their fields.
+ */
+typedef bool (*IntermediateResultRowFilter)(uint64 rowIndex, void *context);
+
+
 /* intermediate_results.c */
+extern int MaxDecodedResultCacheSize;
+extern int MaxIntermediateResultFetchConnections;
+
 extern DestReceiver * CreateRemoteFileDestReceiver(const char *resultId,
 												   EState *executorState,
 												   List *initialNodeList, bool
 												   writeLocalFile);
-extern void SendQueryResultViaCopy(const char *resultId);
-extern void ReceiveQueryResultViaCopy(const char *resultId);
+extern DestReceiver * CreatePartitionedRemoteFileDestReceiver(const char *resultId,
+															  EState *executorState,
+															  List *initialNodeList,
+															  bool writeLocalFile,
+															  Oid partitionRelationId,
+															  int partitionColumnIndex);
+extern uint64 RemoteFileDestReceiverBytesSent(DestReceiver *destReceiver);
+extern void RelayIntermediateResult(const char *resultId, List *sourceNodeList,
+									List *targetNodeList);
+extern void SendQueryResultViaCopy(const char *resultId, bool compress);
+extern void ReceiveQueryResultViaCopy(const char *resultId, bool decompress);
 extern void RemoveIntermediateResultsDirectory(void);
 extern int64 IntermediateResultSize(const char *resultId);
 extern char * QueryResultFileName(const char *resultId);
 extern char * CreateIntermediateResultsDirectory(void);
+extern void ReadBinaryIntermediateResultsIntoTupleStore(Datum *resultIdArray,
+														int resultCount,
+														TupleDesc tupleDescriptor,
+														Tuplestorestate *tupleStore,
+														IntermediateResultRowFilter
+														rowFilter,
+														void *filterContext);
 
 /* distributed_intermediate_results.c */
+extern bool EnablePushBasedRepartition;
+
 extern List ** RedistributeTaskListResults(const char *resultIdPrefix,
 										   List *selectTaskList,
 										   int partitionColumnIndex,
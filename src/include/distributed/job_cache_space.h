@@ -0,0 +1,32 @@
+/*-------------------------------------------------------------------------
+ *
+ * job_cache_space.h
+ *	  Placement and size limits of the files in the job cache directory.
+ *
+ * Copyright (c) Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#ifndef JOB_CACHE_SPACE_H
+#define JOB_CACHE_SPACE_H
+
+#include "nodes/pg_list.h"
+
+
+/* Config variables managed via guc.c */
+extern char *JobCacheDirectories;
+extern int MaxJobCacheSize;
+extern int JobCacheCleanupInterval;
+extern int OrphanedJobDirectoryAge;
+
+
+extern List * JobCacheDirectoryList(const char *directoriesString);
+extern bool CreateJobCacheDirectory(const char *directoryName, bool existsOk);
+extern void RemoveJobCacheDirectoryLink(const char *linkName);
+extern void RemoveJobCacheLocations(void);
+extern void CheckJobCacheSpace(void);
+extern void ReserveJobCacheSpace(uint64 byteCount);
+extern void RemoveOrphanedJobCacheDirectories(void);
+
+#endif /* JOB_CACHE_SPACE_H */
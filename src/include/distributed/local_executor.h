@@ -15,6 +15,7 @@
 
 /* enabled with GUCs*/
 extern bool EnableLocalExecution;
+extern bool EnableParallelLocalExecution;
 extern bool LogLocalCommands;
 
 extern bool TransactionAccessedLocalPlacement;
@@ -25,6 +26,10 @@ extern uint64 ExtractAndExecuteLocalAndRemoteTasks(CitusScanState *scanState,
 												   List *taskList, RowModifyLevel
 												   rowModifyLevel, bool hasReturning);
 extern uint64 ExecuteLocalTaskList(CitusScanState *scanState, List *taskList);
+extern void StartLocalTaskStreaming(CitusScanState *scanState, Task *task);
+extern TupleTableSlot * ReturnTupleFromLocalTask(CitusScanState *scanState);
+extern void FinishLocalTaskStreaming(CitusScanState *scanState);
+extern Query * LocalTaskQuery(Task *task, ParamListInfo paramListInfo);
 extern void ExecuteLocalUtilityTaskList(List *localTaskList);
 extern void ExtractLocalAndRemoteTasks(bool readOnlyPlan, List *taskList,
 									   List **localTaskList, List **remoteTaskList);
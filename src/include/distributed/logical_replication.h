@@ -0,0 +1,26 @@
+/*-------------------------------------------------------------------------
+ *
+ * logical_replication.h
+ *	  Moving shards between nodes using logical replication.
+ *
+ * Copyright (c) Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#ifndef LOGICAL_REPLICATION_H
+#define LOGICAL_REPLICATION_H
+
+#include "nodes/pg_list.h"
+
+
+#define SHARD_MOVE_PUBLICATION_PREFIX "citus_shard_move_publication_"
+#define SHARD_MOVE_SUBSCRIPTION_PREFIX "citus_shard_move_subscription_"
+
+
+extern bool RelationCanBeReplicatedLogically(Oid relationId);
+extern void LogicallyReplicateShards(List *shardList, char *sourceNodeName,
+									 int sourceNodePort, char *targetNodeName,
+									 int targetNodePort);
+
+#endif /* LOGICAL_REPLICATION_H */
@@ -21,11 +21,15 @@
 /* config variable for */
 extern double DistributedDeadlockDetectionTimeoutFactor;
 
+/* GUC, milliseconds after which a background job is terminated, 0 if never */
+extern int BackgroundJobTimeLimit;
+
 extern void StopMaintenanceDaemon(Oid databaseId);
 extern void TriggerMetadataSync(Oid databaseId);
 extern void InitializeMaintenanceDaemon(void);
 extern void InitializeMaintenanceDaemonBackend(void);
 
 extern void CitusMaintenanceDaemonMain(Datum main_arg);
+extern void CitusBackgroundJobMain(Datum main_arg);
 
 #endif /* MAINTENANCED_H */
@@ -90,6 +90,8 @@ typedef struct ShardPlacement
 
 /* Config variable managed via guc.c */
 extern int ReplicationModel;
+extern bool EnableParallelLocalDataCopy;
+extern int DistributedSequenceCacheSize;
 
 /* Size functions */
 extern Datum citus_table_size(PG_FUNCTION_ARGS);
@@ -105,11 +107,14 @@ extern void CopyShardInterval(ShardInterval *srcInterval, ShardInterval *destInt
 extern void CopyShardPlacement(ShardPlacement *srcPlacement,
 							   ShardPlacement *destPlacement);
 extern uint64 ShardLength(uint64 shardId);
+extern bool RelationSizeFromShardStatistics(Oid relationId, uint64 *relationSize);
 extern bool NodeGroupHasShardPlacements(int32 groupId,
 										bool onlyConsiderActivePlacements);
 extern List * ActiveShardPlacementList(uint64 shardId);
 extern ShardPlacement * ActiveShardPlacement(uint64 shardId, bool missingOk);
 extern List * BuildShardPlacementList(ShardInterval *shardInterval);
+extern List * BuildShardPlacementListForShardRange(uint64 minShardId,
+												   uint64 maxShardId);
 extern List * AllShardPlacementsOnNodeGroup(int32 groupId);
 extern List * GroupShardPlacementsForTableOnGroup(Oid relationId, int32 groupId);
 extern StringInfo GenerateSizeQueryOnMultiplePlacements(List *shardIntervalList,
@@ -131,6 +136,7 @@ extern void UpdatePartitionShardPlacementStates(ShardPlacement *parentShardPlace
 												char shardState);
 extern void MarkShardPlacementInactive(ShardPlacement *shardPlacement);
 extern void UpdateShardPlacementState(uint64 placementId, char shardState);
+extern void UpdateShardPlacementLength(uint64 placementId, uint64 shardLength);
 extern void DeleteShardPlacementRow(uint64 placementId);
 extern void CreateDistributedTable(Oid relationId, Var *distributionColumn,
 								   char distributionMethod, char *colocateWithTableName,
@@ -59,8 +59,12 @@
 	"SELECT worker_apply_shard_ddl_command (" UINT64_FORMAT ", %s, %s)"
 #define WORKER_APPLY_SHARD_DDL_COMMAND_WITHOUT_SCHEMA \
 	"SELECT worker_apply_shard_ddl_command (" UINT64_FORMAT ", %s)"
+#define WORKER_APPLY_MULTI_SHARD_DDL_COMMAND \
+	"SELECT worker_apply_multi_shard_ddl_command (ARRAY[%s]::bigint[], %s, %s)"
 #define WORKER_APPEND_TABLE_TO_SHARD \
 	"SELECT worker_append_table_to_shard (%s, %s, %s, %u)"
+#define WORKER_APPEND_TABLE_RANGE_TO_SHARD \
+	"SELECT worker_append_table_range_to_shard (%s, %s, %s, %u, %d, %d)"
 #define WORKER_APPLY_INTER_SHARD_DDL_COMMAND \
 	"SELECT worker_apply_inter_shard_ddl_command (" UINT64_FORMAT ", %s, " UINT64_FORMAT \
 	", %s, %s)"
@@ -86,8 +90,10 @@ extern int ShardCount;
 extern int ShardReplicationFactor;
 extern int ShardMaxSize;
 extern int ShardPlacementPolicy;
+extern int ShardCreationBatchSize;
 extern int NextShardId;
 extern int NextPlacementId;
+extern int ShardCopyParallelism;
 
 
 extern bool IsCoordinator(void);
@@ -108,10 +114,12 @@ extern void CreateAppendDistributedShardPlacements(Oid relationId, int64 shardId
 extern void CreateShardsOnWorkers(Oid distributedRelationId, List *shardPlacements,
 								  bool useExclusiveConnection,
 								  bool colocatedShard);
-extern List * InsertShardPlacementRows(Oid relationId, int64 shardId,
-									   List *workerNodeList, int workerStartIndex,
-									   int replicationFactor);
+extern void InsertShardPlacementRows(Oid relationId, int64 shardId,
+									 List *workerNodeList, int workerStartIndex,
+									 int replicationFactor);
 extern uint64 UpdateShardStatistics(int64 shardId);
+extern uint64 UpdateShardStatisticsWithRange(int64 shardId, text *minValue,
+											 text *maxValue);
 extern void CreateShardsWithRoundRobinPolicy(Oid distributedTableId, int32 shardCount,
 											 int32 replicationFactor,
 											 bool useExclusiveConnections);
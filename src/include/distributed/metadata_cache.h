@@ -20,6 +20,7 @@
 #include "utils/hsearch.h"
 
 extern bool EnableVersionChecks;
+extern bool EnableShardLevelCacheInvalidation;
 
 /* managed via guc.c */
 typedef enum
@@ -68,6 +69,24 @@ typedef struct
 	int shardIntervalArrayLength;
 	ShardInterval **sortedShardIntervalArray;
 
+	/*
+	 * For tables with overlapping shard intervals, the index of the shard with
+	 * the largest max value among the shards up to each position in
+	 * sortedShardIntervalArray. Covers only the leading shards that have min/max
+	 * values, NULL if not built.
+	 */
+	int *cumulativeMaxShardIndexArray;
+	int cumulativeMaxShardIndexArrayLength;
+
+	/*
+	 * For hash distributed tables whose shards do not divide the hash space
+	 * uniformly, the index of the first shard that may contain the hash values
+	 * of each of the 2^hashBucketBits equal buckets of the hash space. NULL if
+	 * not built.
+	 */
+	int *hashBucketShardIndexArray;
+	int hashBucketBits;
+
 	/* comparator for partition column's type, NULL if DISTRIBUTE_BY_NONE */
 	FmgrInfo *shardColumnCompareFunction;
 
@@ -125,10 +144,14 @@ extern bool ReferenceTableShardId(uint64 shardId);
 extern ShardPlacement * FindShardPlacementOnGroup(int32 groupId, uint64 shardId);
 extern GroupShardPlacement * LoadGroupShardPlacement(uint64 shardId, uint64 placementId);
 extern ShardPlacement * LoadShardPlacement(uint64 shardId, uint64 placementId);
+extern GroupShardPlacement * CachedGroupShardPlacementArray(uint64 shardId,
+															int *placementCount);
 extern CitusTableCacheEntry * GetCitusTableCacheEntry(Oid distributedRelationId);
+extern void RebuildCitusTableCacheEntry(Oid relationId);
 extern DistObjectCacheEntry * LookupDistObjectCacheEntry(Oid classid, Oid objid, int32
 														 objsubid);
 extern int32 GetLocalGroupId(void);
+extern char * GetPoolinfoViaCatalog(int32 nodeId);
 extern List * DistTableOidList(void);
 extern Oid LookupShardRelation(int64 shardId, bool missing_ok);
 extern List * ShardPlacementList(uint64 shardId);
@@ -175,11 +198,13 @@ extern Oid DistPlacementRelationId(void);
 extern Oid DistNodeRelationId(void);
 extern Oid DistRebalanceStrategyRelationId(void);
 extern Oid DistLocalGroupIdRelationId(void);
+extern Oid DistPoolinfoRelationId(void);
 extern Oid DistObjectRelationId(void);
 extern Oid DistEnabledCustomAggregatesId(void);
 
 /* index oids */
 extern Oid DistNodeNodeIdIndexId(void);
+extern Oid DistPoolinfoIndexId(void);
 extern Oid DistPartitionLogicalRelidIndexId(void);
 extern Oid DistPartitionColocationidIndexId(void);
 extern Oid DistShardLogicalRelidIndexId(void);
@@ -19,6 +19,10 @@
 /* config variables */
 extern int MetadataSyncInterval;
 extern int MetadataSyncRetryInterval;
+extern int MetadataSyncBatchSize;
+
+/* identifies the progress monitors of metadata syncs */
+#define METADATA_SYNC_MAGIC_NUMBER 1337133713371338
 
 typedef enum
 {
@@ -27,6 +31,26 @@ typedef enum
 	METADATA_SYNC_FAILED_SYNC = 2
 } MetadataSyncResult;
 
+typedef enum MetadataSyncProgressState
+{
+	METADATA_SYNC_PROGRESS_SENDING = 0,
+	METADATA_SYNC_PROGRESS_COMMITTING = 1,
+	METADATA_SYNC_PROGRESS_SYNCED = 2,
+	METADATA_SYNC_PROGRESS_FAILED = 3
+} MetadataSyncProgressState;
+
+/*
+ * MetadataSyncProgress is the progress of syncing the metadata snapshot to a
+ * single node, as kept in the progress monitor of the syncing backend.
+ */
+typedef struct MetadataSyncProgress
+{
+	int32 nodeId;
+	MetadataSyncProgressState state;
+	uint64 commandsCompleted;
+	uint64 commandCount;
+} MetadataSyncProgress;
+
 /* Functions declarations for metadata syncing */
 extern void StartMetadataSyncToNode(const char *nodeNameString, int32 nodePort);
 extern bool ClusterHasKnownMetadataWorkers(void);
@@ -45,6 +69,8 @@ extern char * NodeDeleteCommand(uint32 nodeId);
 extern char * NodeStateUpdateCommand(uint32 nodeId, bool isActive);
 extern char * ShouldHaveShardsUpdateCommand(uint32 nodeId, bool shouldHaveShards);
 extern char * ColocationIdUpdateCommand(Oid relationId, uint32 colocationId);
+extern char * DistributionColumnUpdateCommand(Oid relationId,
+											  char *distributionColumnName);
 extern char * CreateSchemaDDLCommand(Oid schemaId);
 extern List * GrantOnSchemaDDLCommands(Oid schemaId);
 extern char * PlacementUpsertCommand(uint64 shardId, uint64 placementId, int shardState,
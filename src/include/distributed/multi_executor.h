@@ -74,6 +74,10 @@ extern void CitusExecutorRun(QueryDesc *queryDesc, ScanDirection direction, uint
 							 bool execute_once);
 extern void AdaptiveExecutorPreExecutorRun(CitusScanState *scanState);
 extern TupleTableSlot * AdaptiveExecutor(CitusScanState *scanState);
+extern TupleTableSlot * ReturnTupleFromStreamingExecution(CitusScanState *scanState);
+extern void FinishStreamingExecution(CitusScanState *scanState);
+extern void FinishSuspendedStreamingExecutions(void);
+extern void ForgetSuspendedStreamingExecutions(void);
 extern uint64 ExecuteTaskListExtended(RowModifyLevel modLevel, List *taskList,
 									  TupleDesc tupleDescriptor,
 									  Tuplestorestate *tupleStore,
@@ -84,6 +88,9 @@ extern uint64 ExecuteTaskListIntoTupleStore(RowModifyLevel modLevel, List *taskL
 											TupleDesc tupleDescriptor,
 											Tuplestorestate *tupleStore,
 											bool hasReturning);
+extern void ExecuteTaskListsIntoTupleStores(List *taskListList,
+											List *tupleDescriptorList,
+											List *tupleStoreList);
 extern void ExecuteUtilityTaskListWithoutResults(List *taskList, bool
 												 localExecutionSupported);
 extern uint64 ExecuteTaskList(RowModifyLevel modLevel, List *taskList, int
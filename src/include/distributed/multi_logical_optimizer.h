@@ -54,7 +54,8 @@
  *
  * Please note that the order of values in this enumeration is tied to the order
  * of elements in the following AggregateNames array. This order needs to be
- * preserved.
+ * preserved. The tdigest aggregates are overloaded by argument types, so they
+ * are identified by their oids and do not have entries in that array.
  */
 typedef enum
 {
@@ -80,9 +81,21 @@ typedef enum
 	AGGREGATE_TOPN_UNION_AGG = 19,
 	AGGREGATE_ANY_VALUE = 20,
 
+	/* support for github.com/tvondra/tdigest */
+	AGGREGATE_TDIGEST_COMBINE = 21,
+	AGGREGATE_TDIGEST_ADD_DOUBLE = 22,
+	AGGREGATE_TDIGEST_PERCENTILE_ADD_DOUBLE = 23,
+	AGGREGATE_TDIGEST_PERCENTILE_ADD_DOUBLEARRAY = 24,
+	AGGREGATE_TDIGEST_PERCENTILE_TDIGEST_DOUBLE = 25,
+	AGGREGATE_TDIGEST_PERCENTILE_TDIGEST_DOUBLEARRAY = 26,
+	AGGREGATE_TDIGEST_PERCENTILE_OF_ADD_DOUBLE = 27,
+	AGGREGATE_TDIGEST_PERCENTILE_OF_ADD_DOUBLEARRAY = 28,
+	AGGREGATE_TDIGEST_PERCENTILE_OF_TDIGEST_DOUBLE = 29,
+	AGGREGATE_TDIGEST_PERCENTILE_OF_TDIGEST_DOUBLEARRAY = 30,
+
 	/* AGGREGATE_CUSTOM must come last */
-	AGGREGATE_CUSTOM_COMBINE = 21,
-	AGGREGATE_CUSTOM_ROW_GATHER = 22,
+	AGGREGATE_CUSTOM_COMBINE = 31,
+	AGGREGATE_CUSTOM_ROW_GATHER = 32,
 } AggregateType;
 
 
@@ -182,6 +182,11 @@ typedef struct MultiExtendedOp
 } MultiExtendedOp;
 
 
+/* Config variable managed via guc.c */
+extern bool EnableRepartitionedGroupBy;
+extern bool EnableRepartitionedCountDistinct;
+
+
 /* Function declarations for building logical plans */
 extern MultiTreeRoot * MultiLogicalPlanCreate(Query *originalQuery, Query *queryTree,
 											  PlannerRestrictionContext *
@@ -223,6 +228,7 @@ extern MultiExtendedOp * MultiExtendedOpNode(Query *queryTree);
 extern DeferredErrorMessage * DeferErrorIfUnsupportedSubqueryRepartition(Query *
 																		 subqueryTree);
 extern MultiNode * MultiNodeTree(Query *queryTree);
+extern Var * WindowPartitionColumn(List *windowClauseList, List *targetEntryList);
 
 
 #endif   /* MULTI_LOGICAL_PLANNER_H */
@@ -34,11 +34,13 @@
 #define RESERVED_HASHED_COLUMN_ID MaxAttrNumber
 #define MERGE_COLUMN_FORMAT "merge_column_%u"
 #define MAP_OUTPUT_FETCH_COMMAND "SELECT worker_fetch_partition_file \
- (" UINT64_FORMAT ", %u, %u, %u, '%s', %u)"
+ (" UINT64_FORMAT ", %u, %u, %u, '%s', %u%s)"
 #define RANGE_PARTITION_COMMAND "SELECT worker_range_partition_table \
  (" UINT64_FORMAT ", %d, %s, '%s', '%s'::regtype, %s)"
 #define HASH_PARTITION_COMMAND "SELECT worker_hash_partition_table \
  (" UINT64_FORMAT ", %d, %s, '%s', '%s'::regtype, %s)"
+#define SKEW_HASH_PARTITION_COMMAND "SELECT worker_skew_hash_partition_table \
+ (" UINT64_FORMAT ", %d, %s, '%s', '%s'::regtype, %s, %s, %s)"
 #define MERGE_FILES_INTO_TABLE_COMMAND "SELECT worker_merge_files_into_table \
  (" UINT64_FORMAT ", %d, '%s', '%s')"
 #define MERGE_FILES_AND_RUN_QUERY_COMMAND \
@@ -98,7 +100,8 @@ typedef enum
 	TASK_ASSIGNMENT_INVALID_FIRST = 0,
 	TASK_ASSIGNMENT_GREEDY = 1,
 	TASK_ASSIGNMENT_ROUND_ROBIN = 2,
-	TASK_ASSIGNMENT_FIRST_REPLICA = 3
+	TASK_ASSIGNMENT_FIRST_REPLICA = 3,
+	TASK_ASSIGNMENT_LOCALITY = 4
 } TaskAssignmentPolicyType;
 
 
@@ -155,6 +158,13 @@ typedef struct Job
 	bool deferredPruning;
 	Const *partitionKeyValue;
 
+	/*
+	 * For multi-shard SELECTs with parameters on the distribution column, the
+	 * filters that are used to prune the task list once the parameters are
+	 * known on execution.
+	 */
+	List *taskPruningQualList;
+
 	/* for local shard queries, we may save the local plan here */
 	List *localPlannedStatements;
 
@@ -222,7 +232,8 @@ typedef struct Task
 	 *
 	 * queryForLocalExecution is only not null when the planner thinks the
 	 * query could possibly be locally executed. In that case deparsing+parsing
-	 * the query might not be necessary, so we do that lazily.
+	 * the query might not be necessary for local execution and EXPLAIN, so we
+	 * do that lazily.
 	 *
 	 * queryForLocalExecution should only be set by using SetTaskQuery()
 	 */
@@ -247,6 +258,7 @@ typedef struct Task
 
 	uint32 partitionId;
 	uint32 upstreamTaskId;         /* only applies to data fetch tasks */
+	char *filterQueryString;       /* only applies to map tasks */
 	ShardInterval *shardInterval;  /* only applies to merge tasks */
 	bool assignmentConstrained;    /* only applies to merge tasks */
 	TaskExecution *taskExecution;  /* used by task tracker executor */
@@ -288,6 +300,17 @@ typedef struct Task
 	 * query.
 	 */
 	bool parametersInQueryStringResolved;
+
+	/*
+	 * Delegated function calls can be executed with a statement that is only
+	 * prepared once per connection. preparedStatementName is then the name of
+	 * that statement, prepareCommand prepares it and executeCommand executes
+	 * it with the arguments of the call. The query string of the task is still
+	 * the call itself, for instance for EXPLAIN.
+	 */
+	char *preparedStatementName;
+	char *prepareCommand;
+	char *executeCommand;
 } Task;
 
 
@@ -382,6 +405,13 @@ typedef struct DistributedPlan
 	 */
 	bool fastPathRouterPlan;
 
+	/*
+	 * The rows of every task are sorted in the order of the ORDER BY of the
+	 * masterQuery, such that the executor can merge them instead of having
+	 * them sorted on the coordinator.
+	 */
+	bool mergeSortedTaskResults;
+
 	/*
 	 * NULL if this a valid plan, an error description otherwise. This will
 	 * e.g. be set if SQL features are present that a planner doesn't support,
@@ -403,6 +433,9 @@ typedef struct DistributedSubPlan
 
 	uint32 subPlanId;
 	PlannedStmt *plan;
+
+	/* deparsed query for reusing results within a transaction, or NULL */
+	char *queryFingerprint;
 } DistributedSubPlan;
 
 
@@ -416,6 +449,15 @@ typedef struct UsedDistributedSubPlan
 
 	char *subPlanId;
 	int locationMask;
+
+	/*
+	 * Hash-distributed table that the result is only joined with on the
+	 * distribution column, and the result column it is joined on, such that
+	 * each row only needs to be sent to the nodes of a single shard. The
+	 * relation is InvalidOid when the result needs to be broadcast.
+	 */
+	Oid partitionRelationId;
+	int partitionColumnIndex;
 } UsedDistributedSubPlan;
 
 
@@ -435,6 +477,7 @@ typedef struct OperatorCacheEntry
 /* Config variable managed via guc.c */
 extern int TaskAssignmentPolicy;
 extern bool EnableUniqueJobIds;
+extern bool EnablePartitionFetchCompression;
 
 
 /* Function declarations for building physical plans and constructing queries */
@@ -464,6 +507,19 @@ extern bool ShardIntervalsOverlap(ShardInterval *firstInterval,
 								  ShardInterval *secondInterval);
 extern bool CoPartitionedTables(Oid firstRelationId, Oid secondRelationId);
 extern ShardInterval ** GenerateSyntheticShardIntervalArray(int partitionCount);
+extern char * MapTaskPartitionColumnName(MapMergeJob *mapMergeJob);
+extern StringInfo CreateMapQueryString(MapMergeJob *mapMergeJob, Task *mapTask,
+									   char *filterQueryString,
+									   char *partitionColumnName);
+extern StringInfo CreateRangeMapQueryString(MapMergeJob *mapMergeJob, Task *mapTask,
+											char *filterQueryString,
+											char *partitionColumnName,
+											ArrayType *splitPointObject);
+extern StringInfo CreateSkewHashMapQueryString(MapMergeJob *mapMergeJob, Task *mapTask,
+											   char *filterQueryString,
+											   char *partitionColumnName,
+											   ArrayType *splitHashObject,
+											   ArrayType *broadcastHashObject);
 extern RowModifyLevel RowModifyLevelForQuery(Query *query);
 extern StringInfo ArrayObjectToString(ArrayType *arrayObject,
 									  Oid columnType, int32 columnTypeMod);
@@ -479,6 +535,8 @@ extern List * AssignAnchorShardTaskList(List *taskList);
 extern List * FirstReplicaAssignTaskList(List *taskList);
 extern List * RoundRobinAssignTaskList(List *taskList);
 extern List * RoundRobinReorder(Task *task, List *placementList);
+extern List * LocalityAssignTaskList(List *taskList);
+extern List * LocalityReorder(Task *task, List *placementList);
 extern int CompareTasksByTaskId(const void *leftElement, const void *rightElement);
 
 /* function declaration for creating Task */
@@ -487,6 +545,7 @@ extern List * QueryPushdownSqlTaskList(Query *query, uint64 jobId,
 									   relationRestrictionContext,
 									   List *prunedRelationShardList, TaskType taskType,
 									   bool modifyRequiresMasterEvaluation);
+extern void MakeQualsExplicit(Query *query);
 
 /* function declarations for managing jobs */
 extern uint64 UniqueJobId(void);
@@ -26,7 +26,9 @@
 #define CITUS_TABLE_ALIAS "citus_table_alias"
 
 extern bool EnableRouterExecution;
+extern bool EnableFastPathPartitionPruning;
 extern bool EnableFastPathRouterPlanner;
+extern int MaxCachedFastPathPlans;
 
 extern DistributedPlan * CreateRouterPlan(Query *originalQuery, Query *query,
 										  PlannerRestrictionContext *
@@ -73,6 +75,8 @@ extern RangeTblEntry * ExtractDistributedInsertValuesRTE(Query *query);
 extern bool IsMultiRowInsert(Query *query);
 extern void AddShardIntervalRestrictionToSelect(Query *subqery,
 												ShardInterval *shardInterval);
+extern Expr * ShardIntervalRestrictionExpression(Var *partitionColumn,
+												 ShardInterval *shardInterval);
 extern bool UpdateOrDeleteQuery(Query *query);
 extern List * WorkersContainingAllShards(List *prunedShardIntervalsList);
 
@@ -93,6 +97,11 @@ extern void GenerateSingleShardRouterTaskList(Job *job,
 extern PlannedStmt * FastPathPlanner(Query *originalQuery, Query *parse, ParamListInfo
 									 boundParams);
 extern bool FastPathRouterQuery(Query *query, Node **distributionKeyValue);
+extern PlannedStmt * GetCachedFastPathPlan(Query *query, int cursorOptions,
+										   Node *distributionKeyValue);
+extern void CacheFastPathPlan(Query *query, int cursorOptions,
+							  Node *distributionKeyValue, PlannedStmt *plan);
+extern void InvalidateFastPathPlanCache(Oid relationId);
 
 
 #endif /* MULTI_ROUTER_PLANNER_H */
@@ -4,5 +4,6 @@
 #define MULTI_TASK_TRACKER_EXECUTOR_H
 
 extern List * TaskAndExecutionList(List *jobTaskList);
+extern StringInfo MapFetchTaskQueryString(Task *mapFetchTask, Task *mapTask);
 
 #endif /* MULTI_TASK_TRACKER_EXECUTOR_H */
@@ -0,0 +1,22 @@
+/*-------------------------------------------------------------------------
+ *
+ * node_health.h
+ *   Tracking of the nodes that the maintenance daemon cannot connect to
+ *
+ * Copyright (c) Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#ifndef NODE_HEALTH_H
+#define NODE_HEALTH_H
+
+/* GUC, interval at which the maintenance daemon checks whether nodes are up */
+extern int NodeHeartbeatInterval;
+
+
+extern void InitializeNodeHealth(void);
+extern void CheckNodeHealth(void);
+extern bool NodeIsKnownToBeDown(const char *hostname, int port);
+
+#endif /* NODE_HEALTH_H */
@@ -0,0 +1,42 @@
+/*-------------------------------------------------------------------------
+ *
+ * pg_dist_poolinfo.h
+ *	  definition of the relation that holds the connection pooler settings
+ *	  for each node (pg_dist_poolinfo).
+ *
+ * Copyright (c) Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#ifndef PG_DIST_POOLINFO_H
+#define PG_DIST_POOLINFO_H
+
+/* ----------------
+ *		pg_dist_poolinfo definition.
+ * ----------------
+ */
+typedef struct FormData_pg_dist_poolinfo
+{
+	int nodeid;
+#ifdef CATALOG_VARLEN           /* variable-length fields start here */
+	text poolinfo;
+#endif
+} FormData_pg_dist_poolinfo;
+
+/* ----------------
+ *      FormData_pg_dist_poolinfo corresponds to a pointer to a tuple with
+ *      the format of pg_dist_poolinfo relation.
+ * ----------------
+ */
+typedef FormData_pg_dist_poolinfo *Form_pg_dist_poolinfo;
+
+/* ----------------
+ *      compiler constants for pg_dist_poolinfo
+ * ----------------
+ */
+#define Natts_pg_dist_poolinfo 2
+#define Anum_pg_dist_poolinfo_nodeid 1
+#define Anum_pg_dist_poolinfo_poolinfo 2
+
+#endif /* PG_DIST_POOLINFO_H */
@@ -21,6 +21,7 @@
 
 /* Config variables managed via guc.c */
 extern bool SubqueryPushdown;
+extern bool EnableReferenceTableOuterJoinPushdown;
 
 
 extern bool ShouldUseSubqueryPushDown(Query *originalQuery, Query *rewrittenQuery,
@@ -44,6 +45,9 @@ extern DeferredErrorMessage * DeferErrorIfCannotPushdownSubquery(Query *subquery
 																 bool
 																 outerMostQueryHasLimit);
 extern DeferredErrorMessage * DeferErrorIfUnsupportedUnionQuery(Query *queryTree);
+extern bool ReferenceTableOuterJoinsArePushdownSafe(Query *query);
+extern bool HasReferenceTableOuterJoin(Query *query);
+extern void RestrictReferenceTableOuterJoinsToShard(Query *query, int shardIndex);
 
 
 #endif /* QUERY_PUSHDOWN_PLANNING_H */
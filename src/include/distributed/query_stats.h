@@ -12,8 +12,28 @@
 
 #include "distributed/multi_server_executor.h"
 
+
+/*
+ * CitusQueryExecutionStats contains the metrics of a single execution of a
+ * distributed query that are added to its statement-level statistics.
+ */
+typedef struct CitusQueryExecutionStats
+{
+	double executionTimeMs;
+	uint64 taskCount;
+	uint64 rowCount;
+	uint64 bytesReceived;
+	uint64 shardCount;
+} CitusQueryExecutionStats;
+
+
+/* GUC, maximum number of statements for which statistics are kept */
+extern int StatStatementsMax;
+
+
 extern void InitializeCitusQueryStats(void);
 extern void CitusQueryStatsExecutorsEntry(uint64 queryId, MultiExecutorType executorType,
-										  char *partitionKey);
+										  char *partitionKey,
+										  CitusQueryExecutionStats *executionStats);
 
 #endif /* QUERY_STATS_H */
@@ -36,5 +36,6 @@ extern bool ExtractRangeTableRelationWalker(Node *node, List **rangeTableList);
 extern bool ExtractRangeTableEntryWalker(Node *node, List **rangeTableList);
 
 extern bool ExtractRangeTableIndexWalker(Node *node, List **rangeTableIndexList);
+extern bool HashQueryTreeWalker(Node *node, uint32 *queryHash);
 
 #endif /* QUERY_UTILS_H */
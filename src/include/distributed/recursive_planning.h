@@ -22,6 +22,12 @@
 #include "nodes/relation.h"
 #endif
 
+/* GUC, whether columns of CTEs that are not referenced are left out of subplans */
+extern bool EnableCTEColumnPruning;
+
+/* GUC, size in kB below which non-colocated distributed tables are broadcast */
+extern int BroadcastJoinThreshold;
+
 extern List * GenerateSubplansForSubqueriesAndCTEs(uint64 planId, Query *originalQuery,
 												   PlannerRestrictionContext *
 												   plannerRestrictionContext);
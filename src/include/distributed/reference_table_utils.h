@@ -16,8 +16,26 @@
 
 #include "listutils.h"
 
+
+/* values of citus.reference_table_transfer_mode */
+typedef enum ReferenceTableTransferModeType
+{
+	REFERENCE_TABLE_TRANSFER_AUTOMATIC = 0,
+	REFERENCE_TABLE_TRANSFER_FORCE_LOGICAL = 1,
+	REFERENCE_TABLE_TRANSFER_BLOCK_WRITES = 2
+} ReferenceTableTransferModeType;
+
+
+/* GUC, how reference tables are copied to nodes */
+extern int ReferenceTableTransferMode;
+
+/* GUC, whether reference tables are copied to nodes when they are activated */
+extern bool ReplicateReferenceTablesOnActivate;
+
+
 extern uint32 CreateReferenceTableColocationId(void);
 extern void ReplicateAllReferenceTablesToNode(char *nodeName, int nodePort);
+extern void EnsureReferenceTablesExistOnAllNodes(void);
 extern void DeleteAllReferenceTablePlacementsFromNodeGroup(int32 groupId);
 extern List * ReferenceTableOidList(void);
 extern int CompareOids(const void *leftElement, const void *rightElement);
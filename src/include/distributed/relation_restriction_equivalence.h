@@ -15,9 +15,16 @@
 #include "distributed/distributed_planner.h"
 
 
+/* GUC, maximum number of distribution key equality results cached per backend */
+extern int MaxCachedRestrictionEquivalences;
+
 extern bool AllDistributionKeysInQueryAreEqual(Query *originalQuery,
 											   PlannerRestrictionContext *
 											   plannerRestrictionContext);
+extern bool AllDistributionKeysInTopLevelQueryAreEqual(Query *originalQuery,
+													   PlannerRestrictionContext *
+													   plannerRestrictionContext);
+extern void InvalidateRestrictionEquivalenceCache(Oid relationId);
 extern bool SafeToPushdownUnionSubquery(PlannerRestrictionContext *
 										plannerRestrictionContext);
 extern bool ContainsUnionSubquery(Query *queryTree);
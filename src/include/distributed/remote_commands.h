@@ -40,6 +40,11 @@ extern void LogRemoteCommand(MultiConnection *connection, const char *command);
 /* wrappers around libpq functions, with command logging support */
 extern void ExecuteCriticalRemoteCommandList(MultiConnection *connection,
 											 List *commandList);
+extern void ExecuteCriticalRemoteCommandListInParallel(List *connectionList,
+													   List *commandList);
+extern int ExecuteOptionalRemoteCommandListInParallel(List *connectionList,
+													  List *commandList,
+													  List **failedConnectionList);
 extern void ExecuteCriticalRemoteCommand(MultiConnection *connection,
 										 const char *command);
 extern int ExecuteOptionalRemoteCommand(MultiConnection *connection,
@@ -48,7 +53,8 @@ extern int ExecuteOptionalRemoteCommand(MultiConnection *connection,
 extern int SendRemoteCommand(MultiConnection *connection, const char *command);
 extern int SendRemoteCommandParams(MultiConnection *connection, const char *command,
 								   int parameterCount, const Oid *parameterTypes,
-								   const char *const *parameterValues);
+								   const char *const *parameterValues,
+								   bool binaryResults);
 extern List * ReadFirstColumnAsText(PGresult *queryResult);
 extern PGresult * GetRemoteCommandResult(MultiConnection *connection,
 										 bool raiseInterrupts);
@@ -57,7 +63,10 @@ extern bool PutRemoteCopyData(MultiConnection *connection, const char *buffer,
 extern bool PutRemoteCopyEnd(MultiConnection *connection, const char *errormsg);
 
 /* waiting for multiple command results */
+extern bool FinishConnectionSend(MultiConnection *connection);
 extern void WaitForAllConnections(List *connectionList, bool raiseInterrupts);
+extern bool WaitForAllConnectionsWithTimeout(List *connectionList, bool raiseInterrupts,
+											 long timeoutMs);
 
 extern bool SendCancelationRequest(MultiConnection *connection);
 
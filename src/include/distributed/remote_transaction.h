@@ -75,7 +75,11 @@ typedef struct RemoteTransaction
 	 */
 	SubTransactionId lastSuccessfulSubXact;
 
-	/* Id of last savepoint queued before first query of transaction */
+	/*
+	 * Id of last savepoint queued on the connection. Since savepoint ids are
+	 * assigned incrementally, all active savepoints with a higher id still need
+	 * to be sent before the connection is used.
+	 */
 	SubTransactionId lastQueuedSubXact;
 
 	/* waiting for the result of a recovering ROLLBACK TO SAVEPOINT command */
@@ -86,9 +90,25 @@ typedef struct RemoteTransaction
 
 	/* set when BEGIN is sent over the connection */
 	bool beginSent;
+
+	/* number of results of a pipelined BEGIN that were not yet received */
+	int pendingBeginResultCount;
+
+	/* set when PREPARE TRANSACTION was sent along with the last command */
+	bool preparePipelined;
 } RemoteTransaction;
 
 
+/* GUC, determining whether commit returns before COMMIT PREPARED finished */
+extern bool EnableAsyncCommitPrepared;
+
+/* whether any connection has the result of a COMMIT PREPARED pending */
+extern bool CommitPreparedPending;
+
+/* GUC, determining whether savepoints are only sent to connections that use them */
+extern bool EnableLazySavepointPropagation;
+
+
 /* utility functions for dealing with remote transactions */
 extern bool ParsePreparedTransactionName(char *preparedTransactionName, int32 *groupId,
 										 int *procId, uint64 *transactionNumber,
@@ -99,10 +119,19 @@ extern void StartRemoteTransactionBegin(struct MultiConnection *connection);
 extern void FinishRemoteTransactionBegin(struct MultiConnection *connection);
 extern void RemoteTransactionBegin(struct MultiConnection *connection);
 extern void RemoteTransactionListBegin(List *connectionList);
+extern bool CanPipelineRemoteTransactionBegin(void);
+extern char * PipelinedRemoteTransactionBeginCommand(struct MultiConnection *
+													 connection);
 
 extern void StartRemoteTransactionPrepare(struct MultiConnection *connection);
 extern void FinishRemoteTransactionPrepare(struct MultiConnection *connection);
 extern void RemoteTransactionPrepare(struct MultiConnection *connection);
+extern char * PipelinedRemoteTransactionPrepareCommand(struct MultiConnection *
+													   connection);
+extern void FinishPipelinedRemoteTransactionPrepare(struct MultiConnection *
+													connection);
+extern bool AnyRemoteTransactionPrepared(void);
+extern void FinishPendingCommitPrepared(struct MultiConnection *connection);
 
 extern void StartRemoteTransactionCommit(struct MultiConnection *connection);
 extern void FinishRemoteTransactionCommit(struct MultiConnection *connection);
@@ -115,6 +144,8 @@ extern void RemoteTransactionAbort(struct MultiConnection *connection);
 /* start transaction if necessary */
 extern void RemoteTransactionBeginIfNecessary(struct MultiConnection *connection);
 extern void RemoteTransactionsBeginIfNecessary(List *connectionList);
+extern bool RemoteTransactionHasPendingSavepoints(struct MultiConnection *connection);
+extern void StartRemoteTransactionPendingSavepoints(struct MultiConnection *connection);
 
 /* other public functionality */
 extern void HandleRemoteTransactionConnectionError(struct MultiConnection *connection,
@@ -12,6 +12,14 @@
 
 #include "nodes/pg_list.h"
 
+
+/* Config variables managed via guc.c */
+extern bool EnableRepartitionJoinBloomFilter;
+extern int RepartitionJoinBloomFilterSize;
+extern bool EnableRepartitionJoinSampling;
+extern bool EnableRepartitionJoinSkewHandling;
+extern double RepartitionJoinSamplePercent;
+
 extern List * ExecuteDependentTasks(List *taskList, Job *topLevelJob);
 extern void DoRepartitionCleanup(List *jobIds);
 
@@ -0,0 +1,39 @@
+/*-------------------------------------------------------------------------
+ *
+ * result_cache.h
+ *   Cache of the results of single-task read-only queries in shared memory
+ *
+ * Copyright (c) Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#ifndef RESULT_CACHE_H
+#define RESULT_CACHE_H
+
+#include "distributed/citus_custom_scan.h"
+#include "nodes/pg_list.h"
+
+
+/* the cache key of a query, see ResultCacheKeyForExecution */
+typedef struct ResultCacheKey ResultCacheKey;
+
+
+/* GUC, size of the shared cache in kB, 0 disables the cache */
+extern int ResultCacheSize;
+
+/* GUC, whether queries of the current session use the cache */
+extern bool EnableResultCache;
+
+
+extern void InitializeResultCache(void);
+extern ResultCacheKey * ResultCacheKeyForExecution(CitusScanState *scanState,
+												   List *taskList);
+extern bool LookupCachedResult(ResultCacheKey *cacheKey, CitusScanState *scanState);
+extern void StoreCachedResult(ResultCacheKey *cacheKey, CitusScanState *scanState);
+extern void RecordModifiedShard(uint64 shardId);
+extern void RecordModifiedShardsOfTaskList(List *taskList);
+extern void RecordModifiedShardIntervals(List *shardIntervalList);
+extern void ResultCacheAtEOXact(void);
+
+#endif /* RESULT_CACHE_H */
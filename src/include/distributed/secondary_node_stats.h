@@ -0,0 +1,30 @@
+/*-------------------------------------------------------------------------
+ *
+ * secondary_node_stats.h
+ *   Tracking of the replication lag and load of secondary nodes
+ *
+ * Copyright (c) Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#ifndef SECONDARY_NODE_STATS_H
+#define SECONDARY_NODE_STATS_H
+
+#include "distributed/worker_manager.h"
+
+/* special value of citus.max_secondary_replication_lag to ignore the lag */
+#define DISABLE_SECONDARY_LAG_ROUTING -1
+
+/* GUC, maximum replication lag of secondaries that reads are routed to */
+extern int MaxSecondaryReplicationLag;
+
+/* GUC, interval at which the maintenance daemon checks the secondaries */
+extern int SecondaryNodeCheckInterval;
+
+
+extern void InitializeSecondaryNodeStats(void);
+extern void CheckSecondaryNodes(void);
+extern WorkerNode * ChooseSecondaryNode(List *secondaryNodeList);
+
+#endif /* SECONDARY_NODE_STATS_H */
@@ -0,0 +1,22 @@
+/*-------------------------------------------------------------------------
+ *
+ * shard_query_stats.h
+ *   Tracking of the number of tasks and their execution time per shard
+ *   across backends
+ *
+ * Copyright (c) Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#ifndef SHARD_QUERY_STATS_H
+#define SHARD_QUERY_STATS_H
+
+/* GUC, maximum number of shards for which query statistics are kept */
+extern int ShardQueryStatsMax;
+
+
+extern void InitializeShardQueryStats(void);
+extern void RecordShardQueryExecution(uint64 shardId, double executionTimeMs);
+
+#endif /* SHARD_QUERY_STATS_H */
@@ -0,0 +1,25 @@
+/*-------------------------------------------------------------------------
+ *
+ * shard_rebalancer.h
+ *	  Planning and executing shard moves to balance the shards of
+ *	  distributed tables across the nodes.
+ *
+ * Copyright (c) Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#ifndef SHARD_REBALANCER_H
+#define SHARD_REBALANCER_H
+
+
+/* GUC, maximum number of shard moves the rebalancer runs at the same time */
+extern int MaxRebalancerParallelMoves;
+
+/* GUC, maximum number of concurrent shard moves from or to a single node */
+extern int MaxRebalancerMovesPerNode;
+
+/* GUC, maximum rate at which the rebalancer starts moving data, in kB/s */
+extern int RebalancerMaxMoveRate;
+
+#endif /* SHARD_REBALANCER_H */
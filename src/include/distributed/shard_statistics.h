@@ -0,0 +1,20 @@
+/*-------------------------------------------------------------------------
+ *
+ * shard_statistics.h
+ *   Periodic refresh of the shard sizes in pg_dist_placement
+ *
+ * Copyright (c) Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#ifndef SHARD_STATISTICS_H
+#define SHARD_STATISTICS_H
+
+/* GUC, interval at which the maintenance daemon refreshes the shard sizes */
+extern int ShardStatisticsRefreshInterval;
+
+
+extern void RefreshShardStatistics(void);
+
+#endif /* SHARD_STATISTICS_H */
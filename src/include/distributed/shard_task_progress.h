@@ -0,0 +1,59 @@
+/*-------------------------------------------------------------------------
+ *
+ * shard_task_progress.h
+ *    Tracking of the progress of utility commands that run a task on every
+ *    shard of a distributed table.
+ *
+ * Copyright (c) Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#ifndef SHARD_TASK_PROGRESS_H
+#define SHARD_TASK_PROGRESS_H
+
+#include "fmgr.h"
+#include "distributed/multi_progress.h"
+#include "nodes/pg_list.h"
+
+
+typedef enum ShardTaskProgressState
+{
+	SHARD_TASK_PROGRESS_WAITING = 0,
+	SHARD_TASK_PROGRESS_DONE = 1
+} ShardTaskProgressState;
+
+/*
+ * ShardTaskProgress is the progress of a utility command on a single shard,
+ * as kept in the progress monitor of the backend that runs the command.
+ */
+typedef struct ShardTaskProgress
+{
+	uint64 shardId;
+	ShardTaskProgressState state;
+} ShardTaskProgress;
+
+/*
+ * ShardTaskProgressTracker keeps the progress of the shards of a utility
+ * command in the current backend. It is passed as the context of
+ * ShardTaskProgressTasksCompleted.
+ */
+typedef struct ShardTaskProgressTracker
+{
+	ProgressMonitorData *monitor;
+	ShardTaskProgress *progressArray;
+	int progressCount;
+} ShardTaskProgressTracker;
+
+
+extern ShardTaskProgressTracker * StartShardTaskProgress(uint64 progressTypeMagicNumber,
+														 List *taskList,
+														 Oid relationId);
+extern void MarkShardTasksDone(ShardTaskProgressTracker *tracker, List *taskList);
+extern List * ShardTaskProgressTasksCompleted(List *completedTaskList, void *context);
+extern void FinishShardTaskProgress(ShardTaskProgressTracker *tracker);
+extern void ShardTaskProgressReturnRows(uint64 progressTypeMagicNumber,
+										FunctionCallInfo fcinfo);
+
+
+#endif /* SHARD_TASK_PROGRESS_H */
@@ -49,6 +49,7 @@ extern int CompareRelationShards(const void *leftElement,
 extern int ShardIndex(ShardInterval *shardInterval);
 extern ShardInterval * FindShardInterval(Datum partitionColumnValue,
 										 CitusTableCacheEntry *cacheEntry);
+extern Datum HashDistributionValue(FmgrInfo *hashFunction, Oid collation, Datum value);
 extern int FindShardIntervalIndex(Datum searchedValue, CitusTableCacheEntry *cacheEntry);
 extern int SearchCachedShardInterval(Datum partitionColumnValue,
 									 ShardInterval **shardIntervalCache,
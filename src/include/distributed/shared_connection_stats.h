@@ -0,0 +1,29 @@
+/*-------------------------------------------------------------------------
+ *
+ * shared_connection_stats.h
+ *   Tracking of the number of connections to each node across backends
+ *
+ * Copyright (c) Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#ifndef SHARED_CONNECTION_STATS_H
+#define SHARED_CONNECTION_STATS_H
+
+/* special value of citus.max_shared_pool_size to disable the limit */
+#define DISABLE_CONNECTION_THROTTLING -1
+
+/* GUC, maximum number of connections to each node across all backends */
+extern int MaxSharedPoolSize;
+
+
+extern void InitializeSharedConnectionStats(void);
+extern int GetMaxSharedPoolSize(void);
+extern bool TryToIncrementSharedConnectionCounter(const char *hostname, int port);
+extern void IncrementSharedConnectionCounter(const char *hostname, int port);
+extern void WaitLoopForSharedConnection(const char *hostname, int port);
+extern void DecrementSharedConnectionCounter(const char *hostname, int port);
+extern bool SharedConnectionLimitReached(const char *hostname, int port);
+
+#endif /* SHARED_CONNECTION_STATS_H */
@@ -0,0 +1,49 @@
+/*-------------------------------------------------------------------------
+ *
+ * shared_metadata_cache.h
+ *   Cache of the pg_dist_shard and pg_dist_placement rows of distributed
+ *   tables in shared memory
+ *
+ * Copyright (c) Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#ifndef SHARED_METADATA_CACHE_H
+#define SHARED_METADATA_CACHE_H
+
+#include "nodes/pg_list.h"
+
+
+/*
+ * SharedShardMetadata is the backend-local form of a pg_dist_shard row and
+ * the pg_dist_placement rows of the shard, as stored in the shared cache.
+ */
+typedef struct SharedShardMetadata
+{
+	uint64 shardId;
+	char storageType;
+
+	/* text representation of the shard range, NULL if not set */
+	char *minValue;
+	char *maxValue;
+
+	/* list of GroupShardPlacement * */
+	List *placementList;
+} SharedShardMetadata;
+
+
+/* GUC, size of the shared cache in kB, 0 disables the cache */
+extern int SharedMetadataCacheSize;
+
+
+extern void InitializeSharedMetadataCache(void);
+extern bool SharedMetadataCacheUsable(void);
+extern uint64 SharedMetadataCacheGeneration(Oid relationId);
+extern bool LookupSharedShardMetadata(Oid relationId, List **shardMetadataList);
+extern void StoreSharedShardMetadata(Oid relationId, uint64 generation,
+									 List *shardMetadataList);
+extern void InvalidateSharedShardMetadata(Oid relationId);
+extern void ResetSharedMetadataCache(void);
+
+#endif /* SHARED_METADATA_CACHE_H */
@@ -0,0 +1,42 @@
+/*-------------------------------------------------------------------------
+ *
+ * stat_counters.h
+ *	  Counters of events in the planner, executor and connection layer
+ *	  that are aggregated across backends.
+ *
+ * Copyright (c) Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#ifndef STAT_COUNTERS_H
+#define STAT_COUNTERS_H
+
+
+/* the counters shown by citus_stat_counters, in the order of its columns */
+typedef enum CitusStatCounter
+{
+	STAT_CONNECTION_ESTABLISHMENT_SUCCEEDED,
+	STAT_CONNECTION_ESTABLISHMENT_FAILED,
+	STAT_CONNECTION_REUSED,
+	STAT_SEQUENTIAL_EXECUTIONS,
+	STAT_LOCAL_TASKS_EXECUTED,
+	STAT_REMOTE_TASKS_EXECUTED,
+	STAT_FAST_PATH_PLANS,
+	STAT_ROUTER_PLANS,
+	STAT_MULTI_SHARD_PLANS,
+	STAT_REPARTITION_PLANS,
+	STAT_INSERT_SELECT_VIA_COORDINATOR_PLANS,
+
+	N_CITUS_STAT_COUNTERS
+} CitusStatCounter;
+
+
+/* GUC, whether the counters are incremented */
+extern bool EnableStatCounters;
+
+
+extern void InitializeStatCounters(void);
+extern void IncrementStatCounter(CitusStatCounter counter);
+
+#endif /* STAT_COUNTERS_H */
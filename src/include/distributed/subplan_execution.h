@@ -13,11 +13,52 @@
 
 
 #include "distributed/multi_physical_planner.h"
+#include "utils/tuplestore.h"
 
 extern int MaxIntermediateResult;
 extern int SubPlanLevel;
+extern int MaxInlinedIntermediateResultSize;
+extern int IntermediateResultFanout;
+extern bool EnableIntermediateResultCache;
+extern List *InlinedIntermediateResultList;
+extern List *CachedIntermediateResultList;
+extern bool EnableConcurrentSubPlanExecution;
+extern bool EnablePartitionedSubPlanResults;
+extern List *PrefetchedSubPlanResultList;
 
-extern void ExecuteSubPlans(DistributedPlan *distributedPlan);
+/*
+ * SubPlanExecutionStats shows how a subplan result was distributed, for
+ * EXPLAIN ANALYZE.
+ */
+typedef struct SubPlanExecutionStats
+{
+	char *resultId;
+
+	/* number of nodes the result was sent to directly */
+	int nodeCount;
+
+	/*
+	 * size of the result data sent to each node, in bytes, or the total size
+	 * of the rows sent to all nodes when the result was partitioned
+	 */
+	uint64 resultSize;
+
+	/* time spent executing the subplan and sending its result */
+	double executionTimeMs;
+
+	/* whether the result was inlined into the task queries */
+	bool inlined;
+
+	/* whether the result of an earlier statement was reused */
+	bool reused;
+
+	/* whether rows were only sent to the nodes of their shard */
+	bool partitioned;
+} SubPlanExecutionStats;
+
+extern List * ExecuteSubPlans(DistributedPlan *distributedPlan);
+extern List * InlineIntermediateResultsInJob(Job *job);
+extern Tuplestorestate * TakePrefetchedSubPlanResult(uint64 planId);
 
 /**
  * IntermediateResultsHashEntry is used to store which nodes need to receive
@@ -32,12 +73,21 @@ extern void ExecuteSubPlans(DistributedPlan *distributedPlan);
  * writeLocalFile indicates if the intermediate result is accessed during local
  * execution. Note that there can possibly be an item for the local node in the
  * NodeIdList.
+ *
+ * partitionRelationId is set when the result is used by a single distributed
+ * plan, which only joins it with the given table on its distribution column.
+ * Rows are then only sent to the nodes that have the shard of the value in
+ * partitionColumnIndex.
  */
 typedef struct IntermediateResultsHashEntry
 {
 	char key[NAMEDATALEN];
 	List *nodeIdList;
 	bool writeLocalFile;
+
+	int usedPlanCount;
+	Oid partitionRelationId;
+	int partitionColumnIndex;
 } IntermediateResultsHashEntry;
 
 #endif /* SUBPLAN_EXECUTION_H */
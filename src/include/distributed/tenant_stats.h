@@ -0,0 +1,25 @@
+/*-------------------------------------------------------------------------
+ *
+ * tenant_stats.h
+ *    Statistics of the most frequently queried distribution column values.
+ *
+ * Copyright (c) Citus Data, Inc.
+ *-------------------------------------------------------------------------
+ */
+
+#ifndef TENANT_STATS_H
+#define TENANT_STATS_H
+
+#include "distributed/query_stats.h"
+
+
+/* GUC, maximum number of distribution column values that are tracked */
+extern int StatTenantsMax;
+
+
+extern void InitializeTenantStats(void);
+extern bool TenantStatsEnabled(void);
+extern void CitusTenantStatsEntry(uint32 colocationId, char *distributionValue,
+								  CitusQueryExecutionStats *executionStats);
+
+#endif /* TENANT_STATS_H */
@@ -0,0 +1,21 @@
+/*-------------------------------------------------------------------------
+ *
+ * time_partitions.h
+ *   Periodic creation and expiry of the partitions of time partitioned
+ *   tables
+ *
+ * Copyright (c) Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#ifndef TIME_PARTITIONS_H
+#define TIME_PARTITIONS_H
+
+/* GUC, interval at which the maintenance daemon maintains the partitions */
+extern int TimePartitionMaintenanceInterval;
+
+
+extern void MaintainTimePartitions(void);
+
+#endif /* TIME_PARTITIONS_H */
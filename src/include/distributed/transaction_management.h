@@ -67,12 +67,24 @@ typedef struct SubXactContext
  */
 extern bool SelectOpensTransactionBlock;
 
+/*
+ * GUC that determines whether a SELECT in a read-only, read committed transaction
+ * block runs in a transaction block on the worker.
+ */
+extern bool ReadOnlySelectOpensTransactionBlock;
+
 /*
  * GUC that determines whether a function should be considered a transaction
  * block.
  */
 extern bool FunctionOpensTransactionBlock;
 
+/* GUC, determining whether 2PC is skipped if only one remote transaction is involved */
+extern bool EnableSingleParticipantCommit;
+
+/* GUC, microseconds to delay the WAL flush of 2PC commits for group commit */
+extern int TwoPhaseCommitDelay;
+
 /* config variable managed via guc.c */
 extern int MultiShardCommitProtocol;
 extern int SingleShardCommitProtocol;
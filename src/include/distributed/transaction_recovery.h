@@ -11,13 +11,30 @@
 #ifndef TRANSACTION_RECOVERY_H
 #define TRANSACTION_RECOVERY_H
 
+#include "nodes/pg_list.h"
+
+
+/*
+ * TransactionRecord is a pg_dist_transaction row that is yet to be written,
+ * which records that the given transaction has been prepared on a worker.
+ */
+typedef struct TransactionRecord
+{
+	int32 groupId;
+	char *transactionName;
+} TransactionRecord;
+
 
 /* GUC to configure interval for 2PC auto-recovery */
 extern int Recover2PCInterval;
 
+/* GUC, number of connections per worker used by 2PC recovery */
+extern int Recover2PCConnectionsPerWorker;
+
 
 /* Functions declarations for worker transactions */
 extern void LogTransactionRecord(int32 groupId, char *transactionName);
+extern void LogTransactionRecordList(List *transactionRecordList);
 extern int RecoverTwoPhaseCommits(void);
 
 
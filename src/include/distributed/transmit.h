@@ -16,12 +16,19 @@
 #include "lib/stringinfo.h"
 #include "nodes/parsenodes.h"
 #include "storage/fd.h"
+#include "distributed/version_compat.h"
+
+
+/* GUC, the amount of written data in kB after which writeback is started */
+extern int LocalFileFlushAfter;
 
 
 /* Function declarations for transmitting files between two nodes */
-extern void RedirectCopyDataToRegularFile(const char *filename);
-extern void SendRegularFile(const char *filename);
+extern void RedirectCopyDataToRegularFile(const char *filename, bool decompress);
+extern void SendRegularFile(const char *filename, bool compress);
 extern File FileOpenForTransmit(const char *filename, int fileFlags, int fileMode);
+extern int FileWriteWithWriteback(FileCompat *file, char *buffer, int amount,
+								  uint32 wait_event_info);
 
 /* Function declaration local to commands and worker modules */
 extern void FreeStringInfo(StringInfo stringInfo);
@@ -29,6 +36,7 @@ extern void FreeStringInfo(StringInfo stringInfo);
 /* Local functions forward declarations for Transmit statement */
 extern bool IsTransmitStmt(Node *parsetree);
 extern char * TransmitStatementUser(CopyStmt *copyStatement);
+extern bool TransmitStatementIsCompressed(CopyStmt *copyStatement);
 extern void VerifyTransmitStmt(CopyStmt *copyStatement);
 
 
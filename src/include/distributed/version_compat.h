@@ -27,6 +27,8 @@
 #define MakeSingleTupleTableSlotCompat MakeSingleTupleTableSlot
 #define AllocSetContextCreateExtended AllocSetContextCreateInternal
 #define NextCopyFromCompat NextCopyFrom
+#define pglz_decompress_compat(source, slen, dest, rawsize) \
+	pglz_decompress(source, slen, dest, rawsize, true)
 #define ArrayRef SubscriptingRef
 #define T_ArrayRef T_SubscriptingRef
 #define or_clause is_orclause
@@ -90,6 +92,8 @@ FileCompatFromFileStart(File fileDesc)
 	MakeSingleTupleTableSlot(tupleDesc)
 #define NextCopyFromCompat(cstate, econtext, values, nulls) \
 	NextCopyFrom(cstate, econtext, values, nulls, NULL)
+#define pglz_decompress_compat(source, slen, dest, rawsize) \
+	pglz_decompress(source, slen, dest, rawsize)
 
 /*
  * In PG12 GetSysCacheOid requires an oid column,
@@ -113,22 +117,37 @@ FileCompatFromFileStart(File fileDesc)
 #define fcSetArgExt(fc, n, val, is_null) \
 	(((fc)->argnull[n] = (is_null)), ((fc)->arg[n] = (val)))
 
+/*
+ * Before PG12 files are read and written at their seek position, the offset
+ * only tracks it such that callers can refer to the written ranges.
+ */
 typedef struct
 {
 	File fd;
+	off_t offset;
 } FileCompat;
 
 static inline int
 FileWriteCompat(FileCompat *file, char *buffer, int amount, uint32 wait_event_info)
 {
-	return FileWrite(file->fd, buffer, amount, wait_event_info);
+	int count = FileWrite(file->fd, buffer, amount, wait_event_info);
+	if (count > 0)
+	{
+		file->offset += count;
+	}
+	return count;
 }
 
 
 static inline int
 FileReadCompat(FileCompat *file, char *buffer, int amount, uint32 wait_event_info)
 {
-	return FileRead(file->fd, buffer, amount, wait_event_info);
+	int count = FileRead(file->fd, buffer, amount, wait_event_info);
+	if (count > 0)
+	{
+		file->offset += count;
+	}
+	return count;
 }
 
 
@@ -137,6 +156,7 @@ FileCompatFromFileStart(File fileDesc)
 {
 	FileCompat fc = {
 		.fd = fileDesc,
+		.offset = 0,
 	};
 
 	return fc;
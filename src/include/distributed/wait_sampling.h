@@ -0,0 +1,42 @@
+/*-------------------------------------------------------------------------
+ *
+ * wait_sampling.h
+ *	  Periodic sampling of what the backends that take part in distributed
+ *	  queries are waiting on.
+ *
+ * Copyright (c) Citus Data, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#ifndef WAIT_SAMPLING_H
+#define WAIT_SAMPLING_H
+
+
+/*
+ * CitusWaitState describes what a backend is waiting on inside Citus. The
+ * Postgres wait event only shows that these waits happen in an extension.
+ */
+typedef enum CitusWaitState
+{
+	CITUS_WAIT_NONE = 0,
+	CITUS_WAIT_CONNECTION_ESTABLISHMENT,
+	CITUS_WAIT_CONNECTION_SLOT,
+	CITUS_WAIT_REMOTE_RESULT,
+	CITUS_WAIT_COPY,
+	CITUS_WAIT_INTERMEDIATE_RESULT
+} CitusWaitState;
+
+
+/* GUC, number of milliseconds between samples, 0 disables sampling */
+extern int WaitSamplingInterval;
+
+/* GUC, number of samples kept in the ring buffer */
+extern int WaitSamplingBufferSize;
+
+
+extern void InitializeWaitSampling(void);
+extern void SetCitusWaitState(CitusWaitState waitState);
+extern void SampleCitusWaitStates(void);
+
+#endif /* WAIT_SAMPLING_H */
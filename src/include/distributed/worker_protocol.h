@@ -24,10 +24,6 @@
 #include "utils/array.h"
 #include "distributed/version_compat.h"
 
-
-/* Number of rows to prefetch when reading data with a cursor */
-#define ROW_PREFETCH_COUNT 50
-
 /* Directory, file, table name, and UDF related defines for distributed tasks */
 #define PG_JOB_CACHE_DIR "pgsql_job_cache"
 #define MASTER_JOB_DIRECTORY_PREFIX "master_job_"
@@ -49,8 +45,13 @@
 /* the tablename in the overloaded COPY statement is the to-be-transferred file */
 #define TRANSMIT_WITH_USER_COMMAND \
 	"COPY \"%s\" TO STDOUT WITH (format 'transmit', user %s)"
+#define TRANSMIT_COMPRESSED_WITH_USER_COMMAND \
+	"COPY \"%s\" TO STDOUT WITH (format 'transmit', user %s, compression pglz)"
 #define COPY_OUT_COMMAND "COPY %s TO STDOUT"
 #define COPY_SELECT_ALL_OUT_COMMAND "COPY (SELECT * FROM %s) TO STDOUT"
+#define COPY_SELECT_BLOCK_RANGE_OUT_COMMAND \
+	"COPY (SELECT * FROM %s WHERE ((ctid::text::point)[0]::bigint %% %d) = %d) " \
+	"TO STDOUT"
 #define COPY_IN_COMMAND "COPY %s FROM '%s'"
 
 /* Defines that relate to creating tables */
@@ -86,6 +87,27 @@ typedef struct HashPartitionContext
 } HashPartitionContext;
 
 
+/* partition id that a partition function returns for rows that go to all files */
+#define BROADCAST_PARTITION_ID (PG_UINT32_MAX - 1)
+
+
+/*
+ * SkewHashPartitionContext keeps the data for hash re-partitioning with heavy
+ * hitters. Rows whose hash value is in splitHashArray are spread over all
+ * partitions in turn, and rows whose hash value is in broadcastHashArray are
+ * written to all partitions. Both arrays are sorted.
+ */
+typedef struct SkewHashPartitionContext
+{
+	HashPartitionContext *hashContext;
+	int32 *splitHashArray;
+	int32 splitHashCount;
+	int32 *broadcastHashArray;
+	int32 broadcastHashCount;
+	uint32 nextSplitPartitionId;
+} SkewHashPartitionContext;
+
+
 /*
  * FileOutputStream helps buffer write operations to a file; these writes are
  * then regularly flushed to the underlying file. This structure differs from
@@ -103,6 +125,7 @@ typedef struct FileOutputStream
 /* Config variables managed via guc.c */
 extern int PartitionBufferSize;
 extern bool BinaryWorkerCopyFormat;
+extern bool EnableMergeTaskViews;
 
 
 /* Function declarations local to the worker module */
@@ -151,17 +174,21 @@ extern Node * ParseTreeRawStmt(const char *ddlCommand);
 extern Datum worker_fetch_partition_file(PG_FUNCTION_ARGS);
 extern Datum worker_fetch_query_results_file(PG_FUNCTION_ARGS);
 extern Datum worker_apply_shard_ddl_command(PG_FUNCTION_ARGS);
+extern Datum worker_apply_multi_shard_ddl_command(PG_FUNCTION_ARGS);
 extern Datum worker_range_partition_table(PG_FUNCTION_ARGS);
 extern Datum worker_hash_partition_table(PG_FUNCTION_ARGS);
+extern Datum worker_skew_hash_partition_table(PG_FUNCTION_ARGS);
 extern Datum worker_merge_files_into_table(PG_FUNCTION_ARGS);
 extern Datum worker_create_schema(PG_FUNCTION_ARGS);
 extern Datum worker_merge_files_and_run_query(PG_FUNCTION_ARGS);
+extern Datum worker_read_merge_files(PG_FUNCTION_ARGS);
 extern Datum worker_cleanup_job_schema_cache(PG_FUNCTION_ARGS);
 
 /* Function declarations for fetching regular and foreign tables */
 extern Datum worker_fetch_foreign_file(PG_FUNCTION_ARGS);
 extern Datum worker_fetch_regular_table(PG_FUNCTION_ARGS);
 extern Datum worker_append_table_to_shard(PG_FUNCTION_ARGS);
+extern Datum worker_append_table_range_to_shard(PG_FUNCTION_ARGS);
 extern Datum worker_foreign_file_path(PG_FUNCTION_ARGS);
 extern Datum worker_find_block_local_path(PG_FUNCTION_ARGS);
 
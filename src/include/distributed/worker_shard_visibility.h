@@ -18,6 +18,7 @@ extern bool OverrideTableVisibility;
 
 extern void ReplaceTableVisibleFunction(Node *inputNode);
 extern bool RelationIsAKnownShard(Oid shardRelationId, bool onlySearchPath);
+extern void InvalidateKnownShardCache(Oid relationId);
 
 
 #endif /* WORKER_SHARD_VISIBILITY_H */
@@ -0,0 +1,44 @@
+--
+-- Tables for the workloads in benchmark/coordinator/workloads, whose shards use
+-- the blackhole table access method of the test functions. The shards discard
+-- all writes and return no rows, such that the workloads measure the cost of
+-- planning, executing and committing on the coordinator rather than on the
+-- workers. Requires PostgreSQL 12 or later.
+--
+SET citus.shard_count TO 32;
+SET citus.shard_replication_factor TO 1;
+
+SELECT 1 FROM master_add_node('localhost', :worker_1_port);
+SELECT 1 FROM master_add_node('localhost', :worker_2_port);
+
+-- the access method is added to the extension, such that shards may use it
+CREATE FUNCTION blackhole_am_handler(internal)
+RETURNS table_am_handler
+AS 'citus'
+LANGUAGE C;
+CREATE ACCESS METHOD blackhole_am TYPE TABLE HANDLER blackhole_am_handler;
+ALTER EXTENSION citus ADD FUNCTION blackhole_am_handler(internal);
+ALTER EXTENSION citus ADD ACCESS METHOD blackhole_am;
+
+SELECT run_command_on_workers($$
+    CREATE FUNCTION blackhole_am_handler(internal)
+    RETURNS table_am_handler
+    AS 'citus'
+    LANGUAGE C
+$$);
+SELECT run_command_on_workers($$
+    CREATE ACCESS METHOD blackhole_am TYPE TABLE HANDLER blackhole_am_handler
+$$);
+SELECT run_command_on_workers($$
+    ALTER EXTENSION citus ADD FUNCTION blackhole_am_handler(internal)
+$$);
+SELECT run_command_on_workers($$
+    ALTER EXTENSION citus ADD ACCESS METHOD blackhole_am
+$$);
+
+CREATE TABLE blackhole_events (
+    user_id bigint NOT NULL,
+    event_type int NOT NULL DEFAULT 0,
+    payload text
+) USING blackhole_am;
+SELECT create_distributed_table('blackhole_events', 'user_id');
@@ -0,0 +1,2 @@
+-- COPY of 10000 rows that the coordinator routes to all shards
+COPY blackhole_events (user_id) FROM PROGRAM 'seq 1 10000';
@@ -0,0 +1,2 @@
+-- aggregate over all shards through the adaptive executor
+SELECT count(*), max(event_type) FROM blackhole_events;
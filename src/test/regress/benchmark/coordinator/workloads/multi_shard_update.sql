@@ -0,0 +1,2 @@
+-- modification of all shards, which commits on both workers
+UPDATE blackhole_events SET event_type = 1 WHERE event_type = 0;
@@ -0,0 +1,3 @@
+-- single-row INSERT on one shard
+\set user_id random(1, 1000000)
+INSERT INTO blackhole_events (user_id, payload) VALUES (:user_id, 'payload');
@@ -0,0 +1,3 @@
+-- single-shard lookup by distribution column
+\set user_id random(1, 1000000)
+SELECT * FROM blackhole_events WHERE user_id = :user_id;
@@ -0,0 +1,6 @@
+-- transaction that writes to shards on both workers and thus commits with 2PC
+\set user_id random(1, 1000000)
+BEGIN;
+INSERT INTO blackhole_events (user_id) VALUES (:user_id);
+UPDATE blackhole_events SET event_type = 2 WHERE event_type = 1;
+COMMIT;
@@ -0,0 +1,56 @@
+--
+-- Tables and data for the workloads in benchmark/workloads, which run with
+-- pgbench against the coordinator of a cluster set up by pg_regress_multi.pl.
+--
+SET citus.shard_count TO 32;
+SET citus.shard_replication_factor TO 1;
+
+SELECT 1 FROM master_add_node('localhost', :worker_1_port);
+SELECT 1 FROM master_add_node('localhost', :worker_2_port);
+
+CREATE TABLE bench_countries (
+    country_id int PRIMARY KEY,
+    name text NOT NULL
+);
+SELECT create_reference_table('bench_countries');
+
+CREATE TABLE bench_users (
+    user_id bigint PRIMARY KEY,
+    country_id int NOT NULL,
+    name text NOT NULL
+);
+SELECT create_distributed_table('bench_users', 'user_id');
+
+CREATE TABLE bench_events (
+    user_id bigint NOT NULL,
+    event_id bigint NOT NULL,
+    referrer_id bigint NOT NULL,
+    event_type int NOT NULL,
+    value numeric NOT NULL
+);
+SELECT create_distributed_table('bench_events', 'user_id', colocate_with => 'bench_users');
+
+CREATE TABLE bench_user_totals (
+    user_id bigint PRIMARY KEY,
+    event_count bigint NOT NULL,
+    total numeric NOT NULL
+);
+SELECT create_distributed_table('bench_user_totals', 'user_id', colocate_with => 'bench_users');
+
+CREATE TABLE bench_ingest (
+    user_id bigint NOT NULL,
+    event_type int NOT NULL DEFAULT 0
+);
+SELECT create_distributed_table('bench_ingest', 'user_id', colocate_with => 'bench_users');
+
+INSERT INTO bench_countries
+SELECT i, 'country ' || i FROM generate_series(1, 100) i;
+
+INSERT INTO bench_users
+SELECT i, i % 100 + 1, 'user ' || i FROM generate_series(1, 100000) i;
+
+INSERT INTO bench_events
+SELECT i % 100000 + 1, i, (i * 7919) % 100000 + 1, i % 10, i % 1000
+FROM generate_series(1, 500000) i;
+
+ANALYZE bench_countries, bench_users, bench_events;
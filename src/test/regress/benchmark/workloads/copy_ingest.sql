@@ -0,0 +1,2 @@
+-- COPY of 10000 rows that are spread over all shards
+COPY bench_ingest (user_id) FROM PROGRAM 'seq 1 10000';
@@ -0,0 +1,3 @@
+-- single-shard lookup by distribution column, planned by the fast path planner
+\set user_id random(1, 100000)
+SELECT name, country_id FROM bench_users WHERE user_id = :user_id;
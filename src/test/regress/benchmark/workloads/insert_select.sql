@@ -0,0 +1,10 @@
+-- co-located INSERT..SELECT that is pushed down to the shards
+\set user_id random(1, 99000)
+INSERT INTO bench_user_totals (user_id, event_count, total)
+SELECT user_id, count(*), sum(value)
+FROM bench_events
+WHERE user_id BETWEEN :user_id AND :user_id + 1000
+GROUP BY user_id
+ON CONFLICT (user_id) DO UPDATE SET
+    event_count = EXCLUDED.event_count,
+    total = EXCLUDED.total;
@@ -0,0 +1,6 @@
+-- aggregate over all shards that is merged on the coordinator
+SELECT c.name, count(*), avg(e.value)
+FROM bench_events e JOIN bench_users u USING (user_id) JOIN bench_countries c USING (country_id)
+GROUP BY c.name
+ORDER BY 2 DESC
+LIMIT 10;
@@ -0,0 +1,5 @@
+-- join on a column that is not the distribution column of both tables
+SET citus.enable_repartition_joins TO on;
+SELECT count(*), sum(e.value)
+FROM bench_events e JOIN bench_users u ON (e.referrer_id = u.user_id)
+WHERE u.country_id = 1;
@@ -49,6 +49,11 @@ sub Usage()
     print "  --pg_ctl-timeout    	Timeout for pg_ctl\n";
     print "  --connection-timeout	Timeout for connecting to worker nodes\n";
     print "  --mitmproxy        	Start a mitmproxy for one of the workers\n";
+    print "  --benchmark         	Run the pgbench workloads in benchmark/ instead of tests\n";
+    print "  --benchmark-dir     	Directory with the setup.sql and workloads of the benchmark\n";
+    print "  --benchmark-duration	Seconds to run every benchmark workload\n";
+    print "  --benchmark-clients	Number of pgbench clients per benchmark workload\n";
+    print "  --benchmark-results	Path to write the benchmark results to\n";
     exit 1;
 }
 
@@ -80,6 +85,11 @@ my $pgCtlTimeout = undef;
 my $connectionTimeout = 5000;
 my $useMitmproxy = 0;
 my $mitmFifoPath = catfile($TMP_CHECKDIR, "mitmproxy.fifo");
+my $benchmark = 0;
+my $benchmarkDir = undef;
+my $benchmarkDuration = 30;
+my $benchmarkClients = 4;
+my $benchmarkResults = "benchmark_results.json";
 
 my $serversAreShutdown = "TRUE";
 my $usingWindows = 0;
@@ -108,6 +118,11 @@ GetOptions(
     'pg_ctl-timeout=s' => \$pgCtlTimeout,
     'connection-timeout=s' => \$connectionTimeout,
     'mitmproxy' => \$useMitmproxy,
+    'benchmark' => \$benchmark,
+    'benchmark-dir=s' => \$benchmarkDir,
+    'benchmark-duration=i' => \$benchmarkDuration,
+    'benchmark-clients=i' => \$benchmarkClients,
+    'benchmark-results=s' => \$benchmarkResults,
     'help' => sub { Usage() });
 
 # Update environment to include [DY]LD_LIBRARY_PATH/LIBDIR/etc -
@@ -337,6 +352,13 @@ push(@pgOptions, '-c', "citus.remote_task_check_interval=1ms");
 push(@pgOptions, '-c', "citus.shard_replication_factor=2");
 push(@pgOptions, '-c', "citus.node_connection_timeout=${connectionTimeout}");
 
+# build metadata cache entries from shared memory whenever possible
+push(@pgOptions, '-c', "citus.shared_metadata_cache_size=16MB");
+
+# keep a small result cache, which is only enabled by the tests that use it
+push(@pgOptions, '-c', "citus.result_cache_size=256kB");
+push(@pgOptions, '-c', "citus.enable_result_cache=off");
+
 # we disable slow start by default to encourage parallelism within tests
 push(@pgOptions, '-c', "citus.executor_slow_start_interval=0ms");
 
@@ -770,6 +792,170 @@ for my $port (@workerPorts)
     }
 }
 
+###
+# ChildrenCpuSeconds returns the CPU time in seconds of the processes that the
+# postmaster of the given data directory waited for, which are the backends
+# that exited. It returns undef when the time is not available, since it is
+# read from /proc.
+###
+sub ChildrenCpuSeconds
+{
+    my ($dataDir) = @_;
+    my $clockTicks = POSIX::sysconf(POSIX::_SC_CLK_TCK);
+
+    open(my $pidFile, '<', catfile($dataDir, "postmaster.pid")) or return undef;
+    my $postmasterPid = <$pidFile>;
+    close($pidFile);
+    chomp $postmasterPid;
+
+    open(my $statFile, '<', "/proc/$postmasterPid/stat") or return undef;
+    my $stat = <$statFile>;
+    close($statFile);
+
+    # the fields after the command name, which may contain spaces, start with the state
+    my @fields = split(' ', substr($stat, rindex($stat, ')') + 2));
+
+    # cutime and cstime, the user and system time of waited-for children
+    return ($fields[13] + $fields[14]) / $clockTicks;
+}
+
+###
+# Benchmarks run pgbench against the coordinator rather than pg_regress. Every
+# workload in the workloads directory of the benchmark runs for
+# $benchmarkDuration seconds after its setup.sql created and filled the tables,
+# and the throughput, latency percentiles and CPU time per transaction of each
+# workload are written as one JSON object per line to $benchmarkResults.
+###
+sub RunBenchmarks()
+{
+    $benchmarkDir = catfile($regressdir || ".", "benchmark") if !defined $benchmarkDir;
+    my $logDir = catfile($TMP_CHECKDIR, "benchmark");
+    my $psql = catfile($TMP_CHECKDIR, $TMP_BINDIR, "psql");
+
+    make_path($logDir);
+
+    system(catfile($bindir, "psql"),
+           ('-X', '-h', $host, '-p', $masterPort, '-U', $user, "-d", "postgres",
+            '-c', "CREATE DATABASE regression;")) == 0
+        or die "Could not create regression database on coordinator";
+
+    for my $extension (@extensions)
+    {
+        system(catfile($bindir, "psql"),
+               ('-X', '-h', $host, '-p', $masterPort, '-U', $user, "-d", "regression",
+                '-c', "CREATE EXTENSION IF NOT EXISTS $extension;")) == 0
+            or die "Could not create extension on coordinator";
+    }
+
+    system($psql, ('-X', '-q', '-h', $host, '-p', $masterPort, '-U', $user,
+                   '-d', 'regression', '-v', 'ON_ERROR_STOP=1',
+                   '-f', catfile($benchmarkDir, "setup.sql"))) == 0
+        or die "Could not set up the benchmark tables";
+
+    open(my $resultsFile, '>', $benchmarkResults)
+        or die "Could not open $benchmarkResults: $!";
+
+    for my $workloadFile (sort glob(catfile($benchmarkDir, "workloads", "*.sql")))
+    {
+        my $workload = basename($workloadFile, ".sql");
+        my $logPrefix = catfile($logDir, $workload);
+
+        unlink glob("$logPrefix.*");
+
+        print "running benchmark workload $workload\n";
+
+        my @dataDirs = (catfile($TMP_CHECKDIR, $MASTERDIR, "data"));
+        push(@dataDirs, catfile($TMP_CHECKDIR, "worker.$_", "data")) for @workerPorts;
+        my @cpuBefore = map { ChildrenCpuSeconds($_) } @dataDirs;
+
+        # pgbench writes the latency of every transaction to $logPrefix.<pid>[.<thread>]
+        if (system(catfile($bindir, "pgbench"),
+                   ('-n', '-h', $host, '-p', $masterPort, '-U', $user,
+                    '-c', $benchmarkClients, '-j', $benchmarkClients,
+                    '-T', $benchmarkDuration, '-f', $workloadFile,
+                    '-l', "--log-prefix=$logPrefix", 'regression')) != 0)
+        {
+            close($resultsFile);
+            return 1;
+        }
+
+        # give the postmasters time to wait for the backends of pgbench
+        sleep(1);
+
+        my @cpuAfter = map { ChildrenCpuSeconds($_) } @dataDirs;
+        my %cpuSeconds = ();
+        for my $nodeIndex (0 .. $#dataDirs)
+        {
+            my $nodeKind = $nodeIndex == 0 ? "coordinator" : "worker";
+
+            if (!defined $cpuBefore[$nodeIndex] || !defined $cpuAfter[$nodeIndex])
+            {
+                $cpuSeconds{$nodeKind} = undef;
+                next;
+            }
+
+            next if exists $cpuSeconds{$nodeKind} && !defined $cpuSeconds{$nodeKind};
+
+            $cpuSeconds{$nodeKind} = ($cpuSeconds{$nodeKind} || 0) +
+                                     $cpuAfter[$nodeIndex] - $cpuBefore[$nodeIndex];
+        }
+
+        my @latencies = ();
+        for my $logFile (glob("$logPrefix.*"))
+        {
+            open(my $log, '<', $logFile) or die "Could not open $logFile: $!";
+            while (my $line = <$log>)
+            {
+                my @fields = split(' ', $line);
+                push(@latencies, $fields[2] / 1000.0);
+            }
+            close($log);
+        }
+
+        @latencies = sort { $a <=> $b } @latencies;
+
+        my $transactionCount = scalar(@latencies);
+        my $latencySum = 0;
+        $latencySum += $_ for @latencies;
+
+        my $percentile = sub
+        {
+            my ($fraction) = @_;
+            return 0 if $transactionCount == 0;
+            my $index = int($fraction * ($transactionCount - 1) + 0.5);
+            return $latencies[$index];
+        };
+
+        # CPU time of the backends of all nodes of a kind, null if unknown
+        my $cpuPerTransaction = sub
+        {
+            my ($nodeKind) = @_;
+            return "null" if !defined $cpuSeconds{$nodeKind} || $transactionCount == 0;
+            return sprintf("%.3f", $cpuSeconds{$nodeKind} * 1000000 / $transactionCount);
+        };
+
+        printf $resultsFile
+            "{\"workload\": \"%s\", \"clients\": %d, \"duration_s\": %d, " .
+            "\"transactions\": %d, \"tps\": %.3f, \"latency_avg_ms\": %.3f, " .
+            "\"latency_p50_ms\": %.3f, \"latency_p90_ms\": %.3f, " .
+            "\"latency_p99_ms\": %.3f, \"latency_max_ms\": %.3f, " .
+            "\"coordinator_cpu_us_per_transaction\": %s, " .
+            "\"worker_cpu_us_per_transaction\": %s}\n",
+            $workload, $benchmarkClients, $benchmarkDuration, $transactionCount,
+            $transactionCount / $benchmarkDuration,
+            $transactionCount > 0 ? $latencySum / $transactionCount : 0,
+            $percentile->(0.5), $percentile->(0.9), $percentile->(0.99),
+            $percentile->(1.0), $cpuPerTransaction->("coordinator"),
+            $cpuPerTransaction->("worker");
+    }
+
+    close($resultsFile);
+
+    print "benchmark results written to $benchmarkResults\n";
+
+    return 0;
+}
+
 # Prepare pg_regress arguments
 my @arguments = (
     "--host", $host,
@@ -818,6 +1004,10 @@ elsif ($isolationtester)
     push(@arguments, "--dbname=regression");
     $exitcode = system("$isolationRegress", @arguments)
 }
+elsif ($benchmark)
+{
+    $exitcode = RunBenchmarks();
+}
 else
 {
     $exitcode = system("$plainRegress", @arguments);
@@ -34,4 +34,175 @@ SELECT sum(result::bigint) FROM run_command_on_workers($$
 $$);
 END;
 
+-- adaptive slow start only opens connections that are expected to finish a
+-- task, each worker has an empty shard followed by two slow shards
+SET citus.next_shard_id TO 801009100;
+SET citus.shard_count TO 6;
+CREATE TABLE slow_start (x int);
+SELECT create_distributed_table('slow_start', 'x');
+INSERT INTO slow_start
+SELECT DISTINCT ON (shardid) i
+FROM generate_series(1, 100) i, get_shard_id_for_distribution_column('slow_start', i) shardid
+WHERE shardid >= 801009102
+ORDER BY shardid, i;
+SET citus.shard_count TO 4;
+SET citus.executor_slow_start_interval TO '50ms';
+-- do not reuse connections, new connections give feedback on the workers
+SET citus.max_cached_conns_per_worker TO 0;
+SELECT count(*) FROM slow_start;
+-- the third task of each worker gets a connection of its own
+BEGIN;
+SELECT count(*) FROM slow_start WHERE pg_sleep(0.5) IS NOT NULL;
+SELECT sum(result::bigint) FROM run_command_on_workers($$
+  SELECT count(*) FROM pg_stat_activity
+  WHERE pid <> pg_backend_pid() AND query LIKE '%80100910%'
+$$);
+END;
+-- the first task was fast, so a new connection is not worth it
+SET citus.enable_adaptive_slow_start TO on;
+BEGIN;
+SELECT count(*) FROM slow_start WHERE pg_sleep(0.5) IS NOT NULL;
+SELECT sum(result::bigint) FROM run_command_on_workers($$
+  SELECT count(*) FROM pg_stat_activity
+  WHERE pid <> pg_backend_pid() AND query LIKE '%80100910%'
+$$);
+END;
+RESET citus.enable_adaptive_slow_start;
+RESET citus.max_cached_conns_per_worker;
+SET citus.executor_slow_start_interval TO '10ms';
+DROP TABLE slow_start;
+
+-- send multiple tasks over the same connection at once
+SET citus.max_adaptive_executor_pool_size TO 1;
+SET citus.executor_pipeline_depth TO 4;
+SELECT count(*) FROM test;
+SELECT x, y FROM test ORDER BY x;
+
+BEGIN;
+INSERT INTO test VALUES (5,6);
+SELECT count(*) FROM test;
+END;
+
+RESET citus.executor_pipeline_depth;
+RESET citus.max_adaptive_executor_pool_size;
+
+-- start the longest running tasks first
+SET citus.task_ordering_policy TO 'longest-first';
+SELECT count(*) FROM test;
+SELECT count(*) FROM test WHERE y > 0;
+RESET citus.task_ordering_policy;
+
+-- idle pools take over tasks on replicated shards from busy pools, only
+-- the task on the first shard is slow
+SET citus.shard_replication_factor TO 2;
+SET citus.next_shard_id TO 801009200;
+CREATE TABLE work_stealing (x int, slow bool);
+SELECT create_distributed_table('work_stealing', 'x');
+INSERT INTO work_stealing
+SELECT DISTINCT ON (shardid) i, shardid = 801009200
+FROM generate_series(1, 100) i, get_shard_id_for_distribution_column('work_stealing', i) shardid
+ORDER BY shardid, i;
+SET citus.max_adaptive_executor_pool_size TO 1;
+-- each worker runs two tasks
+SELECT count(*) FROM work_stealing WHERE NOT slow OR pg_sleep(1) IS NOT NULL
+GROUP BY inet_server_port() ORDER BY 1;
+-- the other worker runs the second task of the slow worker
+SET citus.enable_work_stealing TO on;
+SELECT count(*) FROM work_stealing WHERE NOT slow OR pg_sleep(1) IS NOT NULL
+GROUP BY inet_server_port() ORDER BY 1;
+RESET citus.enable_work_stealing;
+RESET citus.max_adaptive_executor_pool_size;
+DROP TABLE work_stealing;
+SET citus.shard_replication_factor TO 1;
+
+-- with shard affinity groups, a connection first runs the tasks of its group,
+-- one connection runs the tasks on the shards of the first worker
+SET citus.next_shard_id TO 801009300;
+SET citus.shard_count TO 8;
+CREATE TABLE shard_affinity (x int);
+SELECT create_distributed_table('shard_affinity', 'x');
+INSERT INTO shard_affinity
+SELECT DISTINCT ON (shardid) i
+FROM generate_series(1, 100) i, get_shard_id_for_distribution_column('shard_affinity', i) shardid
+ORDER BY shardid, i;
+SET citus.shard_count TO 4;
+SET citus.max_adaptive_executor_pool_size TO 1;
+SET citus.enable_cte_inlining TO false;
+-- the tasks run in shard order
+WITH tasks AS (SELECT x, inet_server_port() AS port, clock_timestamp() AS ts FROM shard_affinity)
+SELECT get_shard_id_for_distribution_column('shard_affinity', x) FROM tasks
+WHERE port = :worker_1_port ORDER BY ts;
+-- the shards with index 0 and 4 are in the group of the connection
+SET citus.shard_affinity_group_count TO 4;
+WITH tasks AS (SELECT x, inet_server_port() AS port, clock_timestamp() AS ts FROM shard_affinity)
+SELECT get_shard_id_for_distribution_column('shard_affinity', x) FROM tasks
+WHERE port = :worker_1_port ORDER BY ts;
+RESET citus.shard_affinity_group_count;
+RESET citus.enable_cte_inlining;
+RESET citus.max_adaptive_executor_pool_size;
+DROP TABLE shard_affinity;
+
+-- return rows while the workers are still sending results
+SET citus.enable_streaming_execution TO on;
+SELECT x, y FROM test ORDER BY x;
+SELECT count(*) FROM (SELECT x FROM test LIMIT 1) s;
+-- fetch the rows of cursors from the workers, also around other queries
+BEGIN;
+DECLARE test_cursor CURSOR FOR SELECT x, y FROM test ORDER BY x;
+FETCH 2 FROM test_cursor;
+SELECT count(*) FROM test;
+FETCH 2 FROM test_cursor;
+COMMIT;
+RESET citus.enable_streaming_execution;
+
+-- receive results in binary format
+SET citus.enable_binary_protocol TO on;
+SELECT x, y, x * 1.5 AS n, ARRAY[x, y] AS a FROM test ORDER BY x;
+SELECT count(*) FROM test WHERE y = 2;
+-- binary results count towards the intermediate result size
+SET citus.enable_cte_inlining TO false;
+SET citus.max_intermediate_result_size TO 1;
+WITH cte AS (SELECT x, repeat('a', 1000) AS r FROM test) SELECT count(*) FROM cte;
+RESET citus.max_intermediate_result_size;
+RESET citus.enable_cte_inlining;
+RESET citus.enable_binary_protocol;
+
+-- log the CPU time spent on the connections of each worker
+SET client_min_messages TO log;
+SELECT count(*) FROM test;
+SET citus.log_worker_pool_cpu_time TO on;
+SELECT count(*) FROM test;
+RESET citus.log_worker_pool_cpu_time;
+RESET client_min_messages;
+
+-- pin the backend to CPU 0 while running distributed queries
+SELECT substring(pg_read_file('/proc/self/status') FROM 'Cpus_allowed_list:\s*([0-9,-]+)') AS original_cpus \gset
+SET citus.executor_cpu_affinity TO '0';
+SELECT count(*) FROM test;
+SELECT substring(pg_read_file('/proc/self/status') FROM 'Cpus_allowed_list:\s*([0-9,-]+)') AS cpus;
+RESET citus.executor_cpu_affinity;
+SELECT count(*) FROM test;
+SELECT substring(pg_read_file('/proc/self/status') FROM 'Cpus_allowed_list:\s*([0-9,-]+)') = :'original_cpus' AS original_cpus;
+
+-- the maintenance daemon pins itself after a reload
+CREATE FUNCTION maintenance_daemon_cpus()
+RETURNS text LANGUAGE sql AS $$
+  SELECT substring(pg_read_file('/proc/' || pid || '/status') FROM 'Cpus_allowed_list:\s*([0-9,-]+)')
+  FROM pg_stat_activity
+  WHERE application_name = 'Citus Maintenance Daemon' AND datname = current_database()
+$$;
+ALTER SYSTEM SET citus.maintenance_daemon_cpu_affinity TO '0';
+SELECT pg_reload_conf();
+SELECT wait_until_true($$SELECT maintenance_daemon_cpus() = '0'$$);
+ALTER SYSTEM RESET citus.maintenance_daemon_cpu_affinity;
+SELECT pg_reload_conf();
+SELECT wait_until_true(format('SELECT maintenance_daemon_cpus() = %L', :'original_cpus'));
+DROP FUNCTION maintenance_daemon_cpus();
+
+-- pre-establish cached connections to all workers
+SET citus.max_cached_conns_per_worker TO 2;
+SELECT citus_warm_up_connections(2);
+SELECT citus_warm_up_connections(2);
+RESET citus.max_cached_conns_per_worker;
+
 DROP SCHEMA adaptive_executor CASCADE;
@@ -29,6 +29,84 @@ INSERT INTO ab values(1, 2);
 SELECT count(*) FROM (SELECT k.a FROM ab k, ab l WHERE k.a = l.b) first, (SELECT * FROM ab) second WHERE first.a = second.b;
 ROLLBACK;
 
+-- repartition joins can filter the larger input with a bloom filter over the
+-- join keys of the smaller input, input sizes come from the shard statistics
+CREATE TABLE bloom_small(a int, b int);
+SELECT create_distributed_table('bloom_small', 'a');
+INSERT INTO bloom_small SELECT i, i * 100 FROM generate_series(1,5) i;
+CREATE TABLE bloom_large(a int, b int);
+SELECT create_distributed_table('bloom_large', 'a');
+INSERT INTO bloom_large SELECT i, i FROM generate_series(1,1000) i;
+SELECT count(*) > 0 FROM (
+  SELECT master_update_shard_statistics(shardid) FROM pg_dist_shard
+  WHERE logicalrelid IN ('bloom_small'::regclass, 'bloom_large'::regclass)) statistics;
+
+SET citus.enable_repartition_join_bloom_filter TO on;
+SELECT count(*), sum(s.a), sum(l.a) FROM bloom_small s, bloom_large l WHERE s.b = l.b;
+
+-- tables without shard statistics are joined without a filter
+SELECT COUNT(*) FROM ab k, ab l
+WHERE k.a = l.b;
+
+-- map queries of cached plans are restored after each execution
+PREPARE bloom_join AS SELECT count(*) FROM bloom_small s, bloom_large l WHERE s.b = l.b;
+EXECUTE bloom_join;
+SET citus.enable_repartition_join_bloom_filter TO off;
+EXECUTE bloom_join;
+DEALLOCATE bloom_join;
+
+-- repartition joins can range partition both inputs on sampled split points
+SET citus.enable_repartition_join_sampling TO on;
+SET citus.repartition_join_sample_percent TO 100;
+SELECT count(*), sum(s.a), sum(l.a) FROM bloom_small s, bloom_large l WHERE s.b = l.b;
+SELECT count(*), count(s.a) FROM bloom_large l LEFT JOIN bloom_small s ON (s.b = l.b);
+SET citus.enable_repartition_join_bloom_filter TO on;
+SELECT count(*), sum(s.a), sum(l.a) FROM bloom_small s, bloom_large l WHERE s.b = l.b;
+SET citus.enable_repartition_join_bloom_filter TO off;
+RESET citus.repartition_join_sample_percent;
+SET citus.enable_repartition_join_sampling TO off;
+
+-- repartition joins can spread the rows of heavy hitter join keys
+CREATE TABLE skewed_large(a int, b int);
+SELECT create_distributed_table('skewed_large', 'a');
+INSERT INTO skewed_large SELECT i, 100 FROM generate_series(1,900) i;
+INSERT INTO skewed_large SELECT i, i FROM generate_series(901,1000) i;
+SET citus.enable_repartition_join_skew_handling TO on;
+SET citus.repartition_join_sample_percent TO 100;
+SELECT count(*), sum(s.a), sum(l.a) FROM bloom_small s, skewed_large l WHERE s.b = l.b;
+SELECT count(*), count(s.a) FROM skewed_large l LEFT JOIN bloom_small s ON (s.b = l.b);
+SET citus.enable_repartition_join_bloom_filter TO on;
+SELECT count(*), sum(s.a), sum(l.a) FROM bloom_small s, skewed_large l WHERE s.b = l.b;
+SET citus.enable_repartition_join_bloom_filter TO off;
+RESET citus.repartition_join_sample_percent;
+SET citus.enable_repartition_join_skew_handling TO off;
+
+-- partition files can be fetched in compressed frames
+SET citus.enable_partition_fetch_compression TO on;
+SELECT count(*), sum(s.a), sum(l.a) FROM bloom_small s, bloom_large l WHERE s.b = l.b;
+SELECT count(*), sum(s.a), sum(l.a) FROM bloom_small s, skewed_large l WHERE s.b = l.b;
+RESET citus.enable_partition_fetch_compression;
+
+-- repartition joins on replicated tables run on the adaptive executor, the
+-- fetches read the map output from the placement on which the map task ran
+SET citus.shard_replication_factor TO 2;
+CREATE TABLE ab_replicated(a int, b int);
+SELECT create_distributed_table('ab_replicated', 'a');
+INSERT INTO ab_replicated SELECT *,* FROM generate_series(1,10);
+SELECT COUNT(*) FROM ab_replicated k, ab_replicated l
+WHERE k.a = l.b;
+SELECT COUNT(*) FROM ab_replicated k, ab l
+WHERE k.a = l.b;
+SELECT COUNT(*) FROM ab_replicated k, ab_replicated l, ab m
+WHERE k.a = l.b AND k.a = m.b;
+
+-- fetch queries of cached plans are restored after each execution
+PREPARE replicated_join AS SELECT COUNT(*) FROM ab_replicated k, ab_replicated l WHERE k.a = l.b;
+EXECUTE replicated_join;
+EXECUTE replicated_join;
+DEALLOCATE replicated_join;
+SET citus.shard_replication_factor TO 1;
+
 SET citus.enable_single_hash_repartition_joins TO ON;
 
 CREATE TABLE single_hash_repartition_first (id int, sum int, avg float);
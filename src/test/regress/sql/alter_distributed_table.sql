@@ -0,0 +1,49 @@
+--
+-- ALTER_DISTRIBUTED_TABLE
+--
+-- Tests changing the shard count and distribution column of hash distributed tables.
+CREATE SCHEMA alter_distributed_table;
+SET search_path TO alter_distributed_table;
+SET citus.shard_count TO 4;
+SET citus.shard_replication_factor TO 1;
+SET citus.next_shard_id TO 8290000;
+
+CREATE TABLE events (tenant_id int, event_id int, dropped int, payload text, PRIMARY KEY (tenant_id, event_id));
+SELECT create_distributed_table('events', 'tenant_id');
+ALTER TABLE events DROP COLUMN dropped;
+
+INSERT INTO events SELECT i % 10, i, 'event ' || i FROM generate_series(1, 100) i;
+
+-- grow the table from 4 to 8 shards
+SELECT alter_distributed_table('events', shard_count := 8);
+
+SELECT count(*) FROM pg_dist_shard WHERE logicalrelid = 'events'::regclass;
+SELECT count(*), sum(event_id) FROM events;
+SELECT count(*) FROM events WHERE tenant_id = 3;
+
+-- distribute the table by another column
+SELECT alter_distributed_table('events', distribution_column := 'event_id');
+
+SELECT column_to_column_name(logicalrelid, partkey) FROM pg_dist_partition
+WHERE logicalrelid = 'events'::regclass;
+SELECT count(*) FROM pg_dist_shard WHERE logicalrelid = 'events'::regclass;
+SELECT count(*), sum(event_id) FROM events;
+SELECT * FROM events WHERE event_id = 42;
+
+-- writes after the change go to the new shards
+INSERT INTO events VALUES (1, 1000, 'event 1000');
+SELECT * FROM events WHERE event_id = 1000;
+
+-- invalid arguments
+SELECT alter_distributed_table('events');
+SELECT alter_distributed_table('events', shard_count := 0);
+SELECT alter_distributed_table('events', distribution_column := 'event_id');
+SELECT alter_distributed_table('events', distribution_column := 'payload');
+
+-- colocated tables need to change together, which is not supported
+CREATE TABLE events_copy (tenant_id int, event_id int);
+SELECT create_distributed_table('events_copy', 'event_id', colocate_with := 'events');
+SELECT alter_distributed_table('events', shard_count := 16);
+
+SET client_min_messages TO WARNING;
+DROP SCHEMA alter_distributed_table CASCADE;
@@ -0,0 +1,72 @@
+--
+-- BACKGROUND_JOBS
+--
+-- Tests running the jobs of the maintenance daemon in dynamic background
+-- workers, using the time partition maintenance job, which is off by default.
+CREATE SCHEMA background_jobs;
+SET search_path TO background_jobs;
+
+CREATE VIEW time_partition_job AS
+SELECT * FROM citus_background_jobs
+WHERE database_id = (SELECT oid FROM pg_database WHERE datname = current_database())
+AND job_name = 'time partition maintenance';
+
+-- the process of a running job is the background worker of the job
+CREATE VIEW time_partition_job_worker AS
+SELECT a.backend_type, a.wait_event_type
+FROM time_partition_job j JOIN pg_stat_activity a ON (a.pid = j.process_id);
+
+SELECT job_name FROM citus_background_jobs
+WHERE database_id = (SELECT oid FROM pg_database WHERE datname = current_database())
+ORDER BY job_name;
+
+-- the job does not run without citus.time_partition_maintenance_interval
+SELECT run_count AS runs_before FROM time_partition_job \gset
+SELECT pg_sleep(1);
+SELECT run_count = :runs_before AS no_runs, process_id IS NULL AS not_running
+FROM time_partition_job;
+
+-- with the interval set, a background worker runs the job
+ALTER SYSTEM SET citus.time_partition_maintenance_interval TO '100ms';
+SELECT pg_reload_conf();
+SELECT wait_until_true(format($$
+    SELECT run_count > %s AND last_run_succeeded FROM background_jobs.time_partition_job
+$$, :runs_before));
+
+-- a run that waits for a lock keeps running without a time limit
+BEGIN;
+LOCK TABLE pg_dist_time_partition_policy IN ACCESS EXCLUSIVE MODE;
+SELECT wait_until_true($$
+    SELECT count(*) = 1 FROM background_jobs.time_partition_job_worker
+    WHERE wait_event_type = 'Lock'
+$$);
+SELECT backend_type LIKE 'Citus Background Job: time partition maintenance %' AS job_worker
+FROM time_partition_job_worker;
+SELECT failure_count AS failures_before FROM time_partition_job \gset
+SELECT pg_sleep(1);
+SELECT failure_count = :failures_before AS no_failures, process_id IS NOT NULL AS running
+FROM time_partition_job;
+COMMIT;
+
+-- once the lock is released, the run finishes
+SELECT run_count AS runs_before FROM time_partition_job \gset
+SELECT wait_until_true(format($$
+    SELECT run_count > %s AND last_run_succeeded FROM background_jobs.time_partition_job
+$$, :runs_before));
+
+-- with citus.background_job_time_limit, the daemon terminates the run
+ALTER SYSTEM SET citus.background_job_time_limit TO '500ms';
+SELECT pg_reload_conf();
+BEGIN;
+LOCK TABLE pg_dist_time_partition_policy IN ACCESS EXCLUSIVE MODE;
+SELECT failure_count AS failures_before FROM time_partition_job \gset
+SELECT wait_until_true(format($$
+    SELECT failure_count > %s FROM background_jobs.time_partition_job
+$$, :failures_before));
+COMMIT;
+
+ALTER SYSTEM RESET citus.background_job_time_limit;
+ALTER SYSTEM RESET citus.time_partition_maintenance_interval;
+SELECT pg_reload_conf();
+
+DROP SCHEMA background_jobs CASCADE;
@@ -0,0 +1,39 @@
+--
+-- CITUS_LOOKUP_ROWS
+--
+-- Tests looking up the rows of many distribution column values in one query.
+CREATE SCHEMA citus_lookup_rows;
+SET search_path TO citus_lookup_rows;
+SET citus.shard_count TO 4;
+SET citus.shard_replication_factor TO 1;
+SET citus.next_shard_id TO 8500000;
+
+CREATE TABLE orders (order_id int, customer text, dropped int, amount numeric);
+ALTER TABLE orders DROP COLUMN dropped;
+SELECT create_distributed_table('orders', 'order_id');
+INSERT INTO orders SELECT i, 'customer ' || i, i * 10 FROM generate_series(1, 10) i;
+
+SELECT * FROM citus_lookup_rows(NULL::orders, ARRAY['2', '5', '9', '42']) ORDER BY order_id;
+SELECT * FROM citus_lookup_rows(NULL::orders, ARRAY['3', NULL, '3']) ORDER BY order_id;
+SELECT count(*) FROM citus_lookup_rows(NULL::orders, '{}');
+SELECT count(*) FROM citus_lookup_rows(NULL::orders, NULL);
+
+-- keys of a loop in a procedure
+DO $$
+DECLARE
+    total numeric := 0;
+    order_row orders;
+BEGIN
+    FOR order_row IN SELECT * FROM citus_lookup_rows(NULL::orders, ARRAY['1', '4', '7']) LOOP
+        total := total + order_row.amount;
+    END LOOP;
+    RAISE NOTICE 'total %', total;
+END;
+$$;
+
+-- only distributed tables are supported
+CREATE TABLE local_table (key int);
+SELECT * FROM citus_lookup_rows(NULL::local_table, ARRAY['1']);
+
+SET client_min_messages TO WARNING;
+DROP SCHEMA citus_lookup_rows CASCADE;
@@ -0,0 +1,51 @@
+--
+-- COORDINATOR_STATISTICS
+--
+-- Tests statistics of distributed tables on the coordinator, built by ANALYZE
+-- from a sample of the shards.
+CREATE SCHEMA coordinator_statistics;
+SET search_path TO coordinator_statistics;
+SET citus.shard_count TO 4;
+SET citus.shard_replication_factor TO 1;
+SET citus.next_shard_id TO 8600000;
+
+CREATE TABLE events (event_id int, dropped int, category int, note text);
+ALTER TABLE events DROP COLUMN dropped;
+SELECT create_distributed_table('events', 'event_id');
+INSERT INTO events
+SELECT i, i % 10, CASE WHEN i % 4 = 0 THEN NULL ELSE 'note' END
+FROM generate_series(1, 1000) i;
+
+-- without citus.analyze_sample_shard_count the coordinator has no statistics
+ANALYZE events;
+SELECT reltuples FROM pg_class WHERE oid = 'events'::regclass;
+SELECT count(*) FROM pg_stats WHERE schemaname = 'coordinator_statistics';
+
+-- sampling all shards reads all rows of this small table
+SET citus.analyze_sample_shard_count TO 4;
+ANALYZE events;
+SELECT reltuples, relpages > 0 AS has_pages FROM pg_class WHERE oid = 'events'::regclass;
+SELECT attname, null_frac, n_distinct FROM pg_stats
+WHERE schemaname = 'coordinator_statistics' AND tablename = 'events'
+ORDER BY attname;
+SELECT most_common_vals FROM pg_stats
+WHERE schemaname = 'coordinator_statistics' AND tablename = 'events'
+AND attname = 'note';
+
+-- the temporary sample table is dropped
+SELECT count(*) FROM pg_class WHERE relname LIKE 'citus_analyze_sample_%';
+
+-- sampling fewer shards still counts the rows of all shards
+SET citus.analyze_sample_shard_count TO 2;
+ANALYZE events;
+SELECT reltuples FROM pg_class WHERE oid = 'events'::regclass;
+SELECT attname, null_frac > 0 AS has_nulls FROM pg_stats
+WHERE schemaname = 'coordinator_statistics' AND tablename = 'events'
+ORDER BY attname;
+
+-- ANALYZE of a column list leaves the coordinator statistics as they are
+ANALYZE events (category);
+SELECT count(*) FROM pg_stats WHERE schemaname = 'coordinator_statistics';
+
+SET client_min_messages TO WARNING;
+DROP SCHEMA coordinator_statistics CASCADE;
@@ -0,0 +1,56 @@
+--
+-- COPY_MEMORY_LIMIT
+--
+-- Tests that COPY into tables with many shards sends the buffered rows of the
+-- least recently used shards when the placement buffers exceed
+-- citus.copy_memory_limit, without losing or duplicating rows.
+CREATE SCHEMA copy_memory_limit;
+SET search_path TO copy_memory_limit;
+SET citus.shard_count TO 32;
+SET citus.shard_replication_factor TO 1;
+SET citus.next_shard_id TO 8680000;
+
+CREATE TABLE unlimited (key int, value text DEFAULT repeat('x', 100));
+SELECT create_distributed_table('unlimited', 'key');
+CREATE TABLE limited (key int, value text DEFAULT repeat('x', 100));
+SELECT create_distributed_table('limited', 'key', colocate_with => 'unlimited');
+
+-- by default, the placement buffers are not limited
+SHOW citus.copy_memory_limit;
+COPY unlimited (key) FROM PROGRAM 'seq 1 20000';
+
+-- every shard gets more rows than fit in the limit
+SET citus.copy_memory_limit TO 16;
+COPY limited (key) FROM PROGRAM 'seq 1 20000';
+
+SELECT count(*), count(DISTINCT key), sum(length(value)) FROM limited;
+
+-- all shards have the same rows as without the limit
+SELECT count(*) FROM limited l FULL JOIN unlimited u USING (key)
+WHERE l.key IS NULL OR u.key IS NULL OR l.value <> u.value;
+SELECT count(*) FROM run_command_on_colocated_placements('limited', 'unlimited',
+	'SELECT (SELECT count(*) FROM %s) = (SELECT count(*) FROM %s)')
+WHERE result <> 't';
+
+-- in a transaction block, the rows evicted early are visible after the COPY
+BEGIN;
+COPY limited (key) FROM PROGRAM 'seq 20001 30000';
+SELECT count(*), count(DISTINCT key) FROM limited;
+ROLLBACK;
+SELECT count(*) FROM limited;
+
+-- the same holds with several placements per shard
+SET citus.shard_replication_factor TO 2;
+CREATE TABLE replicated (key int, value text DEFAULT repeat('x', 100));
+SELECT create_distributed_table('replicated', 'key');
+COPY replicated (key) FROM PROGRAM 'seq 1 20000';
+
+SELECT count(*), count(DISTINCT key), sum(length(value)) FROM replicated;
+SELECT sum(result::int) FROM run_command_on_placements('replicated',
+	'SELECT count(*) FROM %s');
+SELECT shardid FROM run_command_on_placements('replicated', 'SELECT count(*) FROM %s')
+GROUP BY shardid HAVING count(DISTINCT result) <> 1;
+
+RESET citus.copy_memory_limit;
+SET client_min_messages TO WARNING;
+DROP SCHEMA copy_memory_limit CASCADE;
@@ -0,0 +1,64 @@
+--
+-- COPY_SELECT_FORWARDING
+--
+-- Tests forwarding the COPY output of the workers for COPY (SELECT ..) TO STDOUT.
+CREATE SCHEMA copy_select_forwarding;
+SET search_path TO copy_select_forwarding;
+SET citus.shard_count TO 4;
+SET citus.shard_replication_factor TO 1;
+SET citus.next_shard_id TO 8400000;
+
+-- forwarding is off by default
+SHOW citus.enable_copy_select_forwarding;
+SET citus.enable_copy_select_forwarding TO on;
+
+CREATE TABLE items (key int, value text);
+SELECT create_distributed_table('items', 'key');
+INSERT INTO items VALUES (1, 'one');
+
+-- multi-shard query, only one shard has rows
+COPY (SELECT * FROM items) TO STDOUT;
+COPY (SELECT key * 2, upper(value) FROM items WHERE key > 0) TO STDOUT;
+
+-- the header is sent once
+COPY (SELECT key, value FROM items) TO STDOUT WITH (format csv, header);
+COPY (SELECT value FROM items) TO STDOUT WITH CSV HEADER DELIMITER '|';
+
+-- router query
+COPY (SELECT value, key FROM items WHERE key = 1) TO STDOUT;
+
+-- queries that need the coordinator are run by the executor
+COPY (SELECT count(*) FROM items) TO STDOUT;
+COPY (SELECT * FROM items ORDER BY key LIMIT 1) TO STDOUT;
+
+-- in transaction blocks, the executor is used
+BEGIN;
+COPY (SELECT * FROM items) TO STDOUT;
+COMMIT;
+
+-- errors on the workers are reported
+COPY (SELECT key / (key - 1) FROM items) TO STDOUT;
+
+-- replicated tables are read from one placement per shard
+SET citus.shard_replication_factor TO 2;
+CREATE TABLE replicated_items (key int, value text);
+SELECT create_distributed_table('replicated_items', 'key');
+INSERT INTO replicated_items VALUES (1, 'one'), (1, 'uno');
+COPY (SELECT * FROM replicated_items) TO STDOUT;
+SET citus.task_assignment_policy TO 'round-robin';
+COPY (SELECT * FROM replicated_items) TO STDOUT;
+COPY (SELECT value FROM replicated_items WHERE key = 1) TO STDOUT;
+RESET citus.task_assignment_policy;
+
+-- queries that should read from a distributed snapshot are run by the executor
+SET citus.enable_distributed_snapshot TO on;
+SET client_min_messages TO DEBUG1;
+COPY (SELECT * FROM items) TO STDOUT;
+RESET client_min_messages;
+RESET citus.enable_distributed_snapshot;
+
+SET citus.enable_copy_select_forwarding TO off;
+COPY (SELECT * FROM items) TO STDOUT;
+
+SET client_min_messages TO WARNING;
+DROP SCHEMA copy_select_forwarding CASCADE;
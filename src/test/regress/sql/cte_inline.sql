@@ -214,6 +214,26 @@ FROM
 	cte_1 as second_entry
 		USING (key);
 
+-- citus inlines CTEs that are used multiple times when the tables are small
+SET client_min_messages TO WARNING;
+UPDATE pg_dist_placement SET shardlength = 1
+WHERE shardid IN (SELECT shardid FROM pg_dist_shard WHERE logicalrelid = 'test_table'::regclass);
+SET citus.cte_inline_size_threshold TO '8kB';
+SET client_min_messages TO DEBUG;
+WITH cte_1 AS (SELECT * FROM test_table)
+SELECT
+	count(*)
+FROM
+	cte_1 as first_entry
+		JOIN
+	cte_1 as second_entry
+		USING (key);
+RESET citus.cte_inline_size_threshold;
+SET client_min_messages TO WARNING;
+UPDATE pg_dist_placement SET shardlength = 0
+WHERE shardid IN (SELECT shardid FROM pg_dist_shard WHERE logicalrelid = 'test_table'::regclass);
+SET client_min_messages TO DEBUG;
+
 -- NOT MATERIALIZED should cause the query to be inlined twice
 WITH cte_1 AS NOT MATERIALIZED (SELECT * FROM test_table)
 SELECT
@@ -599,6 +619,23 @@ WITH cte_1 AS (SELECT value FROM test_table WHERE key > 1),
 SELECT count(*)  FROM cte_1 JOIN cte_2 USING (value);
 
 
+-- independent CTEs that are not inlined can be executed concurrently
+SET client_min_messages TO WARNING;
+SET citus.enable_cte_inlining TO false;
+SET citus.enable_concurrent_subplan_execution TO on;
+WITH cte_1 AS (SELECT count(*) AS c FROM test_table WHERE key > 1),
+     cte_2 AS (SELECT max(value) AS value FROM test_table WHERE key > 3),
+     cte_3 AS (SELECT key FROM test_table WHERE key < 2 GROUP BY key)
+SELECT c, value, (SELECT count(*) FROM cte_3) FROM cte_1, cte_2;
+
+-- cte_2 reads the result of cte_1, so it is executed after it
+WITH cte_1 AS (SELECT key FROM test_table WHERE key > 7),
+     cte_2 AS (SELECT count(*) AS c FROM test_table WHERE key IN (SELECT key FROM cte_1)),
+     cte_3 AS (SELECT count(*) AS c FROM test_table WHERE key < 2)
+SELECT cte_2.c, cte_3.c FROM cte_2, cte_3;
+RESET citus.enable_concurrent_subplan_execution;
+RESET citus.enable_cte_inlining;
+
 -- prevent DROP CASCADE to give notices
 SET client_min_messages TO ERROR;
 DROP SCHEMA cte_inline CASCADE;
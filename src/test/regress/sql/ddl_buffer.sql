@@ -0,0 +1,56 @@
+--
+-- DDL_BUFFER
+--
+-- Tests buffering the shard commands of DDL commands in transaction blocks.
+CREATE SCHEMA ddl_buffer;
+SET search_path TO ddl_buffer;
+SET citus.shard_count TO 4;
+SET citus.shard_replication_factor TO 1;
+SET citus.next_shard_id TO 8300000;
+
+CREATE TABLE items (key int, value text);
+SELECT create_distributed_table('items', 'key');
+
+SET citus.ddl_buffer_size TO 100;
+
+-- the commands are sent together before the INSERT
+BEGIN;
+ALTER TABLE items ADD COLUMN price int;
+ALTER TABLE items ADD COLUMN label text;
+CREATE INDEX items_price_idx ON items (price);
+ALTER TABLE items RENAME COLUMN label TO name;
+INSERT INTO items VALUES (1, 'one', 10, 'first');
+SELECT * FROM items;
+COMMIT;
+
+SELECT DISTINCT result FROM run_command_on_placements('items', $$SELECT count(*) FROM pg_indexes WHERE tablename = '%s'$$);
+SELECT DISTINCT result FROM run_command_on_placements('items', $$SELECT string_agg(attname, ',' ORDER BY attnum) FROM pg_attribute WHERE attrelid = '%s'::regclass AND attnum > 0$$);
+
+-- the commands are sent at commit
+BEGIN;
+ALTER TABLE items ADD COLUMN weight int;
+ALTER TABLE items ALTER COLUMN weight SET DEFAULT 5;
+COMMIT;
+
+SELECT DISTINCT result FROM run_command_on_placements('items', $$SELECT count(*) FROM pg_attribute WHERE attrelid = '%s'::regclass AND attname = 'weight'$$);
+
+-- commands in a rolled back savepoint are not sent
+BEGIN;
+SAVEPOINT s1;
+ALTER TABLE items ADD COLUMN discarded int;
+ROLLBACK TO SAVEPOINT s1;
+ALTER TABLE items ADD COLUMN kept int;
+COMMIT;
+
+SELECT DISTINCT result FROM run_command_on_placements('items', $$SELECT count(*) FROM pg_attribute WHERE attrelid = '%s'::regclass AND attname IN ('discarded', 'kept')$$);
+
+-- commands in a rolled back transaction are not sent either
+BEGIN;
+ALTER TABLE items ADD COLUMN aborted int;
+ROLLBACK;
+
+SELECT DISTINCT result FROM run_command_on_placements('items', $$SELECT count(*) FROM pg_attribute WHERE attrelid = '%s'::regclass AND attname = 'aborted'$$);
+
+RESET citus.ddl_buffer_size;
+SET client_min_messages TO WARNING;
+DROP SCHEMA ddl_buffer CASCADE;
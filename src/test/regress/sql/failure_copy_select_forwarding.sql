@@ -0,0 +1,43 @@
+--
+-- FAILURE_COPY_SELECT_FORWARDING
+--
+-- Tests that COPY (SELECT ..) TO STDOUT retries the tasks on their other
+-- placements when forwarding the output of the workers.
+SELECT citus.mitmproxy('conn.allow()');
+SELECT citus.clear_network_traffic();
+
+SET citus.shard_count = 2;
+SET citus.shard_replication_factor = 2;
+
+CREATE TABLE copy_select_test (key int, value text);
+SELECT create_distributed_table('copy_select_test', 'key');
+
+-- put data in shard for which mitm node is first placement
+INSERT INTO copy_select_test VALUES (3, 'test data');
+
+SET citus.enable_copy_select_forwarding TO on;
+
+SELECT citus.mitmproxy('conn.onQuery(query="^COPY").kill()');
+
+-- router query
+COPY (SELECT * FROM copy_select_test WHERE key = 3) TO STDOUT;
+
+-- multi-shard query
+COPY (SELECT * FROM copy_select_test) TO STDOUT;
+
+-- the header is taken from the task that succeeded
+COPY (SELECT * FROM copy_select_test WHERE key = 3) TO STDOUT WITH (format csv, header);
+
+-- kill the connection when the worker asks for the COPY to start
+SELECT citus.mitmproxy('conn.onCopyOutResponse().kill()');
+COPY (SELECT * FROM copy_select_test) TO STDOUT;
+
+SELECT citus.mitmproxy('conn.allow()');
+
+COPY (SELECT * FROM copy_select_test) TO STDOUT;
+
+RESET citus.enable_copy_select_forwarding;
+
+-- ==== Clean up, we're done here ====
+
+DROP TABLE copy_select_test;
@@ -0,0 +1,57 @@
+--
+-- failure_node_heartbeat.sql tests failing fast on a node that the
+-- maintenance daemon could not connect to at its last heartbeat.
+--
+
+SELECT citus.mitmproxy('conn.allow()');
+
+CREATE SCHEMA fail_heartbeat;
+SET search_path TO 'fail_heartbeat';
+
+SET citus.shard_count TO 4;
+SET citus.shard_replication_factor TO 1;
+SET citus.max_cached_conns_per_worker TO 0;
+ALTER SEQUENCE pg_catalog.pg_dist_shardid_seq RESTART 8660000;
+
+CREATE TABLE products (
+    product_no integer,
+    name text
+);
+SELECT create_distributed_table('products', 'product_no');
+
+-- returns the error of a query on all shards, or NULL if it succeeds
+CREATE FUNCTION count_products_error()
+RETURNS text LANGUAGE plpgsql AS $$
+BEGIN
+    PERFORM count(*) FROM fail_heartbeat.products;
+    RETURN NULL;
+EXCEPTION WHEN OTHERS THEN
+    RETURN SQLERRM;
+END;
+$$;
+
+-- without heartbeats, queries try to connect to the node behind the proxy
+SHOW citus.node_heartbeat_interval;
+SELECT citus.mitmproxy('conn.kill()');
+SELECT count(*) FROM products;
+
+-- once a heartbeat could not connect, queries fail without connecting
+ALTER SYSTEM SET citus.node_heartbeat_interval TO '100ms';
+SELECT pg_reload_conf();
+SELECT wait_until_true($$
+    SELECT fail_heartbeat.count_products_error() LIKE '%since it is down'
+$$);
+SELECT count(*) FROM products;
+
+-- the next heartbeat that connects brings the node back
+SELECT citus.mitmproxy('conn.allow()');
+SELECT wait_until_true($$
+    SELECT fail_heartbeat.count_products_error() IS NULL
+$$);
+SELECT count(*) FROM products;
+
+ALTER SYSTEM RESET citus.node_heartbeat_interval;
+SELECT pg_reload_conf();
+
+SET client_min_messages TO WARNING;
+DROP SCHEMA fail_heartbeat CASCADE;
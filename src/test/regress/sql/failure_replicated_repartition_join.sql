@@ -0,0 +1,37 @@
+--
+-- FAILURE_REPLICATED_REPARTITION_JOIN
+--
+-- Tests that map tasks of repartition joins on replicated tables fail over
+-- to their other placement, and the fetches read from that placement.
+--
+CREATE SCHEMA replicated_repartition_join;
+SET search_path TO replicated_repartition_join;
+
+SELECT citus.mitmproxy('conn.allow()');
+
+SET citus.shard_count TO 2;
+SET citus.shard_replication_factor TO 2;
+SET citus.enable_repartition_joins TO on;
+SET citus.enable_single_hash_repartition_joins TO on;
+
+CREATE TABLE ab(a int, b int);
+SELECT create_distributed_table('ab', 'a');
+INSERT INTO ab SELECT *,* FROM generate_series(1,10);
+
+-- kill the map task whose first placement is on the mitm node
+SELECT citus.mitmproxy('conn.onQuery(query="worker_hash_partition_table").kill()');
+SELECT count(*) FROM ab k, ab l WHERE k.a = l.b;
+
+-- also fails over when the same plan is executed again
+PREPARE repartition_join AS SELECT count(*) FROM ab k, ab l WHERE k.a = l.b;
+EXECUTE repartition_join;
+EXECUTE repartition_join;
+
+SELECT citus.mitmproxy('conn.allow()');
+EXECUTE repartition_join;
+DEALLOCATE repartition_join;
+
+RESET citus.enable_single_hash_repartition_joins;
+RESET citus.enable_repartition_joins;
+SET client_min_messages TO WARNING;
+DROP SCHEMA replicated_repartition_join CASCADE;
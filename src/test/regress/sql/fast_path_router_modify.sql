@@ -173,4 +173,17 @@ RESET citus.enable_fast_path_router_planner;
 
 RESET client_min_messages;
 RESET citus.log_remote_commands;
+-- router queries can run as statements prepared on the worker connections
+SET citus.enable_prepared_statement_caching TO on;
+DELETE FROM modify_fast_path;
+INSERT INTO modify_fast_path VALUES (1, 1, 'a'), (2, 2, 'b'), (3, 3, 'c');
+SELECT * FROM modify_fast_path WHERE key = 1;
+SELECT * FROM modify_fast_path WHERE key = 1;
+SELECT * FROM modify_fast_path WHERE key = 2 AND value_2 = 'b';
+UPDATE modify_fast_path SET value_1 = value_1 + 10 WHERE key = 3 RETURNING *;
+UPDATE modify_fast_path SET value_1 = value_1 + 10 WHERE key = 3 RETURNING *;
+DELETE FROM modify_fast_path WHERE key = 2 RETURNING *;
+SELECT * FROM modify_fast_path ORDER BY key;
+RESET citus.enable_prepared_statement_caching;
+
 DROP SCHEMA fast_path_router_modify CASCADE;
@@ -0,0 +1,55 @@
+--
+-- HEDGED_READS
+--
+-- Tests starting slow reads of a replicated shard on another placement. The
+-- reads below sleep on the first placement of the shard, which is on the
+-- first worker.
+CREATE SCHEMA hedged_reads;
+SET search_path TO hedged_reads;
+SET citus.shard_count TO 1;
+SET citus.shard_replication_factor TO 2;
+SET citus.next_shard_id TO 8650000;
+
+CREATE TABLE readings (id int, value int);
+SELECT create_distributed_table('readings', 'id');
+INSERT INTO readings VALUES (1, 1);
+
+SELECT nodeport FROM pg_dist_shard_placement WHERE shardid = 8650000 ORDER BY nodeport;
+
+-- by default, a slow read waits for its placement
+SHOW citus.hedged_read_percentile;
+SELECT clock_timestamp() AS read_start \gset
+SELECT id, value, pg_sleep(CASE WHEN inet_server_port() = :worker_1_port THEN 2 ELSE 0 END)
+FROM readings WHERE id = 1;
+SELECT clock_timestamp() - :'read_start'::timestamptz >= '2s' AS waited;
+
+-- reads are only hedged once the execution times of enough reads are known
+SET citus.hedged_read_percentile TO 90;
+SELECT clock_timestamp() AS read_start \gset
+SELECT id, value, pg_sleep(CASE WHEN inet_server_port() = :worker_1_port THEN 2 ELSE 0 END)
+FROM readings WHERE id = 1;
+SELECT clock_timestamp() - :'read_start'::timestamptz >= '2s' AS waited;
+
+DO $$
+BEGIN
+    FOR i IN 1 .. 20 LOOP
+        PERFORM * FROM hedged_reads.readings WHERE id = 1;
+    END LOOP;
+END;
+$$;
+
+-- now the slow read is also started on the second placement, which returns
+-- the rows, and the read on the first placement is cancelled
+SELECT clock_timestamp() AS read_start \gset
+SELECT id, value, pg_sleep(CASE WHEN inet_server_port() = :worker_1_port THEN 2 ELSE 0 END)
+FROM readings WHERE id = 1;
+SELECT clock_timestamp() - :'read_start'::timestamptz < '2s' AS hedged;
+
+-- the first placement is still usable afterwards
+SELECT id, value, inet_server_port() = :worker_1_port AS on_first_placement
+FROM readings WHERE id = 1;
+
+RESET citus.hedged_read_percentile;
+
+SET client_min_messages TO WARNING;
+DROP SCHEMA hedged_reads CASCADE;
@@ -0,0 +1,89 @@
+--
+-- INSERT_BUFFER
+--
+-- Tests buffering single-row INSERTs in transaction blocks with
+-- citus.insert_buffer_size.
+CREATE SCHEMA insert_buffer;
+SET search_path TO insert_buffer;
+SET citus.shard_count TO 1;
+SET citus.shard_replication_factor TO 1;
+SET citus.next_shard_id TO 8620000;
+
+CREATE TABLE buffered (key int PRIMARY KEY, value int);
+SELECT create_distributed_table('buffered', 'key');
+
+CREATE TABLE buffered_ref (id int PRIMARY KEY);
+SELECT create_reference_table('buffered_ref');
+INSERT INTO buffered_ref VALUES (1);
+
+CREATE TABLE buffered_fk (key int, ref_id int REFERENCES buffered_ref (id));
+SELECT create_distributed_table('buffered_fk', 'key');
+
+-- by default INSERTs are sent right away
+SET client_min_messages TO DEBUG1;
+BEGIN;
+INSERT INTO buffered VALUES (1, 1);
+INSERT INTO buffered VALUES (2, 2);
+COMMIT;
+
+SET citus.insert_buffer_size TO 3;
+
+-- the rows of a shard are sent once it has citus.insert_buffer_size of them
+BEGIN;
+INSERT INTO buffered VALUES (3, 3);
+INSERT INTO buffered VALUES (4, 4);
+INSERT INTO buffered VALUES (5, 5);
+INSERT INTO buffered VALUES (6, 6);
+
+-- a read of the shard sends the remaining rows first and sees them
+SELECT count(*), sum(value) FROM buffered;
+COMMIT;
+
+-- outside of transaction blocks INSERTs are sent right away
+INSERT INTO buffered VALUES (7, 7);
+
+-- rows buffered after a savepoint are discarded when rolling back to it
+BEGIN;
+INSERT INTO buffered VALUES (8, 8);
+SAVEPOINT s1;
+INSERT INTO buffered VALUES (9, 9);
+ROLLBACK TO SAVEPOINT s1;
+INSERT INTO buffered VALUES (10, 10);
+COMMIT;
+SELECT key FROM buffered WHERE key >= 7 ORDER BY key;
+
+-- errors in buffered rows are reported when the rows are sent, here at commit
+\set VERBOSITY terse
+BEGIN;
+INSERT INTO buffered VALUES (1, 1);
+COMMIT;
+SELECT count(*) FROM buffered;
+
+-- tables with foreign keys are not buffered, the INSERT itself fails
+BEGIN;
+INSERT INTO buffered_fk VALUES (1, 2);
+ROLLBACK;
+\set VERBOSITY default
+
+-- rows to local placements are not buffered either
+RESET client_min_messages;
+SET client_min_messages TO WARNING;
+SELECT 1 FROM master_add_node('localhost', :master_port, groupid => 0);
+RESET client_min_messages;
+
+CREATE TABLE local_ref (key int, value int);
+SELECT create_reference_table('local_ref');
+
+SET citus.log_local_commands TO on;
+SET client_min_messages TO DEBUG1;
+BEGIN;
+INSERT INTO local_ref VALUES (1, 1);
+COMMIT;
+RESET client_min_messages;
+RESET citus.log_local_commands;
+
+DROP TABLE local_ref;
+SELECT 1 FROM master_remove_node('localhost', :master_port);
+
+RESET citus.insert_buffer_size;
+DROP SCHEMA insert_buffer CASCADE;
@@ -559,6 +559,45 @@ DO UPDATE SET
  cardinality = enriched.cardinality + excluded.cardinality,
  sum = enriched.sum + excluded.sum;
 
+-- partitions can be pushed to the nodes of the target shards
+SET citus.shard_replication_factor TO 1;
+CREATE TABLE push_source(a int, b int);
+SELECT create_distributed_table('push_source', 'a');
+INSERT INTO push_source SELECT s, s FROM generate_series(1, 100) s;
+CREATE TABLE push_target(a int, b int);
+SELECT create_distributed_table('push_target', 'a');
+
+SET citus.enable_push_based_repartition TO on;
+INSERT INTO push_target SELECT b + 1, a FROM push_source;
+SELECT count(*), sum(a), sum(b) FROM push_target;
+RESET citus.enable_push_based_repartition;
+
+-- partitions are also pushed to replicated target shards, from where they are
+-- fetched by the other placements, including casts, ON CONFLICT and RETURNING
+SET citus.shard_replication_factor TO 2;
+CREATE TABLE push_replicated_target(a bigint PRIMARY KEY, b numeric);
+SELECT create_distributed_table('push_replicated_target', 'a');
+
+SET citus.enable_push_based_repartition TO on;
+INSERT INTO push_replicated_target SELECT b + 1, a FROM push_source;
+INSERT INTO push_replicated_target SELECT b + 1, a FROM push_source
+ON CONFLICT (a) DO UPDATE SET b = push_replicated_target.b + excluded.b;
+INSERT INTO push_replicated_target SELECT b + 1, a FROM push_source
+ON CONFLICT (a) DO NOTHING RETURNING *;
+RESET citus.enable_push_based_repartition;
+
+SELECT count(*), sum(a), sum(b) FROM push_replicated_target;
+
+-- all placements of a shard have the same rows
+SELECT count(*) AS mismatched_shards FROM (
+  SELECT shardid
+  FROM run_command_on_placements('push_replicated_target',
+                                 'SELECT count(*) || '',''|| sum(b) FROM %s')
+  GROUP BY shardid HAVING count(DISTINCT result) > 1) s;
+SET citus.shard_replication_factor TO 1;
+
+DROP TABLE push_source, push_target, push_replicated_target;
+
 -- clean-up
 SET client_min_messages TO WARNING;
 DROP SCHEMA insert_select_repartition CASCADE;
@@ -608,6 +608,24 @@ FROM
     INNER JOIN joined_stats_cte_2 USING (account_id)
 ) inner_query;
 
+-- results that are joined on the distribution column can be partitioned
+SET citus.enable_partitioned_subplan_results TO on;
+WITH some_values_1 AS
+	(SELECT key, random() FROM table_1 WHERE value IN ('3', '4'))
+SELECT
+	count(*)
+FROM
+	some_values_1 JOIN table_2 USING (key);
+
+-- other joins still need the whole result
+WITH some_values_1 AS
+	(SELECT key, random() FROM table_1 WHERE value IN ('3', '4'))
+SELECT
+	count(*)
+FROM
+	some_values_1 JOIN table_2 ON (some_values_1.key < table_2.key);
+RESET citus.enable_partitioned_subplan_results;
+
 SET citus.task_assignment_policy to DEFAULT;
 SET client_min_messages TO DEFAULT;
 DROP TABLE table_1, table_2, table_3, ref_table, accounts, stats, range_partitioned;
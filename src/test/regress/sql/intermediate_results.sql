@@ -260,6 +260,11 @@ SELECT * FROM read_intermediate_results(ARRAY['squares_1', 'squares_2']::text[],
 SELECT * FROM fetch_intermediate_results(ARRAY['squares_1', 'squares_2']::text[], 'localhost', :worker_1_port);
 SELECT * FROM read_intermediate_results(ARRAY['squares_1', 'squares_2']::text[], 'binary') AS res (x int, x2 int);
 ROLLBACK TO SAVEPOINT s1;
+-- results can be fetched over several connections in parallel
+SET LOCAL citus.max_intermediate_result_fetch_connections TO 2;
+SELECT * FROM fetch_intermediate_results(ARRAY['squares_1', 'squares_2']::text[], 'localhost', :worker_1_port);
+SELECT * FROM read_intermediate_results(ARRAY['squares_1', 'squares_2']::text[], 'binary') AS res (x int, x2 int);
+ROLLBACK TO SAVEPOINT s1;
 -- empty result id list should succeed
 SELECT * FROM fetch_intermediate_results(ARRAY[]::text[], 'localhost', :worker_1_port);
 -- null in result id list should error gracefully
@@ -269,4 +274,68 @@ END;
 -- results should have been deleted after transaction commit
 SELECT * FROM read_intermediate_results(ARRAY['squares_1', 'squares_2']::text[], 'binary') AS res (x int, x2 int);
 
+-- intermediate results can be compressed while sent between nodes
+SET citus.enable_intermediate_result_compression TO on;
+BEGIN;
+SELECT broadcast_intermediate_result('squares_1', 'SELECT s, s*s FROM generate_series(1, 1000) s');
+SELECT * FROM fetch_intermediate_results(ARRAY['squares_1']::text[], 'localhost', :worker_1_port);
+SELECT count(*), sum(x2) FROM read_intermediate_result('squares_1', 'binary') AS res (x int, x2 int);
+END;
+RESET citus.enable_intermediate_result_compression;
+
+-- binary result files are mapped into memory, also when they have no rows or
+-- span several pages
+BEGIN;
+SELECT create_intermediate_result('no_rows', 'SELECT s FROM generate_series(1, 0) s');
+SELECT count(*) FROM read_intermediate_result('no_rows', 'binary') AS res (x int);
+SELECT create_intermediate_result('wide', 'SELECT s, repeat(''x'', 5000) FROM generate_series(1, 3) s');
+SELECT count(*), sum(length(y)) FROM read_intermediate_result('wide', 'binary') AS res (x int, y text);
+SELECT count(*), sum(length(y)) FROM read_intermediate_results(ARRAY['wide', 'no_rows', 'wide']::text[], 'binary') AS res (x int, y text);
+-- an empty file cannot be mapped, it is passed to COPY
+SELECT current_setting('data_directory') ||
+	format('/base/pgsql_job_cache/%s_%s_%s/empty.data', (SELECT oid FROM pg_roles WHERE rolname = current_user),
+		   initiator_node_identifier, transaction_number) AS empty_file
+FROM get_current_transaction_id() \gset
+COPY (SELECT 1 WHERE false) TO :'empty_file';
+SELECT count(*) FROM read_intermediate_result('empty', 'text') AS res (x int);
+SELECT count(*) FROM read_intermediate_result('empty', 'binary') AS res (x int);
+END;
+
+-- decoded rows of result files can be reused within a transaction
+BEGIN;
+SET LOCAL citus.max_decoded_result_cache_size TO '1MB';
+SELECT create_intermediate_result('cached', 'SELECT s FROM generate_series(1, 5) s');
+SELECT sum(x) FROM read_intermediate_result('cached', 'binary') AS res (x int);
+SELECT sum(x) FROM read_intermediate_result('cached', 'binary') AS res (x int);
+SELECT create_intermediate_result('cached', 'SELECT s * 2 FROM generate_series(1, 5) s');
+SELECT sum(x) FROM read_intermediate_result('cached', 'binary') AS res (x int);
+END;
+
+-- binary results can be divided among parallel workers
+BEGIN;
+SET LOCAL max_parallel_workers_per_gather TO 2;
+SET LOCAL parallel_setup_cost TO 0;
+SET LOCAL parallel_tuple_cost TO 0;
+SET LOCAL min_parallel_table_scan_size TO 0;
+SELECT create_intermediate_result('squares_1', 'SELECT s, s*s FROM generate_series(1, 10000) s');
+EXPLAIN (COSTS OFF) SELECT count(*), sum(x2) FROM read_intermediate_result('squares_1', 'binary') AS res (x int, x2 int);
+SELECT count(*), sum(x2) FROM read_intermediate_result('squares_1', 'binary') AS res (x int, x2 int);
+SELECT count(*), sum(x2) FROM read_intermediate_results(ARRAY['squares_1', 'squares_1']::text[], 'binary') AS res (x int, x2 int);
+SET LOCAL citus.enable_parallel_intermediate_result_scan TO off;
+EXPLAIN (COSTS OFF) SELECT count(*), sum(x2) FROM read_intermediate_result('squares_1', 'binary') AS res (x int, x2 int);
+END;
+
+-- results can be written back to disk while they are written
+BEGIN;
+SET LOCAL citus.local_file_flush_after TO '64kB';
+SELECT create_intermediate_result('squares_1', 'SELECT s, s::bigint * s FROM generate_series(1, 100000) s');
+SELECT count(*), sum(x2) FROM read_intermediate_result('squares_1', 'binary') AS res (x int, x2 bigint);
+END;
+
+-- the job cache size can be limited
+BEGIN;
+SET LOCAL citus.max_job_cache_size TO '1kB';
+SELECT create_intermediate_result('squares_1', 'SELECT s, s*s FROM generate_series(1, 1000) s');
+END;
+
 DROP SCHEMA intermediate_results CASCADE;
@@ -0,0 +1,64 @@
+--
+-- JOB_CACHE_CLEANUP
+--
+-- Tests removing orphaned directories from the job cache in the maintenance
+-- daemon, using a repartition job directory that no job cleans up.
+CREATE SCHEMA job_cache_cleanup;
+SET search_path TO job_cache_cleanup;
+
+CREATE VIEW job_cache_cleanup_job AS
+SELECT * FROM citus_background_jobs
+WHERE database_id = (SELECT oid FROM pg_database WHERE datname = current_database())
+AND job_name = 'job cache cleanup';
+
+CREATE VIEW job_directory AS
+SELECT * FROM pg_ls_dir('base/pgsql_job_cache') AS d(name)
+WHERE name = 'job_8650001';
+
+SELECT directory_count AS directories_before, orphaned_directory_count AS orphans_before
+FROM citus_job_cache_size() \gset
+
+-- leave a repartition job directory behind
+SELECT worker_hash_partition_table(8650001, 1, 'SELECT a FROM generate_series(1,100) AS a', 'a', 23, ARRAY[-2147483648, -1073741824, 0, 1073741824]::int4[]);
+SELECT count(*) FROM job_directory;
+
+-- a recently modified job directory is not orphaned by default
+SELECT directory_count = :directories_before + 1 AS one_more_directory,
+       orphaned_directory_count = :orphans_before AS no_more_orphans,
+       total_bytes > 0 AS has_files
+FROM citus_job_cache_size();
+
+-- so the cleanup keeps it
+ALTER SYSTEM SET citus.job_cache_cleanup_interval TO '100ms';
+SELECT pg_reload_conf();
+SELECT run_count AS runs_before FROM job_cache_cleanup_job \gset
+SELECT wait_until_true(format($$
+    SELECT run_count > %s AND last_run_succeeded FROM job_cache_cleanup.job_cache_cleanup_job
+$$, :runs_before));
+SELECT count(*) FROM job_directory;
+
+-- once it is older than citus.orphaned_job_directory_age, it is orphaned
+ALTER SYSTEM SET citus.job_cache_cleanup_interval TO 0;
+SELECT pg_reload_conf();
+SELECT pg_sleep(0.1);
+ALTER SYSTEM SET citus.orphaned_job_directory_age TO 0;
+SELECT pg_reload_conf();
+SELECT pg_sleep(0.1);
+SHOW citus.orphaned_job_directory_age;
+SELECT orphaned_directory_count > :orphans_before AS more_orphans,
+       orphaned_bytes > 0 AS has_orphaned_files
+FROM citus_job_cache_size();
+
+-- and the cleanup removes it
+ALTER SYSTEM SET citus.job_cache_cleanup_interval TO '100ms';
+SELECT pg_reload_conf();
+SELECT wait_until_true($$
+    SELECT count(*) = 0 FROM job_cache_cleanup.job_directory
+$$);
+SELECT orphaned_directory_count AS orphans_after FROM citus_job_cache_size();
+
+ALTER SYSTEM RESET citus.orphaned_job_directory_age;
+ALTER SYSTEM RESET citus.job_cache_cleanup_interval;
+SELECT pg_reload_conf();
+
+DROP SCHEMA job_cache_cleanup CASCADE;
@@ -215,7 +215,7 @@ TRUNCATE distributed_table;
 BEGIN;
 
 -- insert a lot of data ( around 8MB),
--- this should use local copy and it will exceed the LOCAL_COPY_FLUSH_THRESHOLD (512KB)
+-- this should use local copy and it will exceed citus.local_copy_flush_threshold (512kB by default)
 INSERT INTO distributed_table SELECT * , * FROM generate_series(20, 1000000);
 
 ROLLBACK;
@@ -274,6 +274,17 @@ BEGIN;
 	-- the shards that reside on this node
 	SELECT * FROM distributed_table WHERE value = '23' ORDER BY 1,2,3;
 
+	-- the local shards may also be scanned using parallel workers
+	SET LOCAL citus.enable_parallel_local_execution TO on;
+	SELECT * FROM distributed_table WHERE value = '23' ORDER BY 1,2,3;
+	RESET citus.enable_parallel_local_execution;
+
+	-- rows of a single local task can be returned straight from its plan
+	SET LOCAL citus.enable_streaming_execution TO on;
+	SELECT * FROM distributed_table WHERE key = 1 ORDER BY 1,2,3;
+	SELECT key FROM distributed_table WHERE key = 1 LIMIT 1;
+	RESET citus.enable_streaming_execution;
+
 	-- similarly, multi-shard modifications should use local exection
 	-- on the shards that reside on this node
 	DELETE FROM distributed_table WHERE value = '23';
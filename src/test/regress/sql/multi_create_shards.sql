@@ -138,6 +138,21 @@ SELECT shardmaxvalue::integer - shardminvalue::integer AS shard_size
 	WHERE logicalrelid = 'weird_shard_count'::regclass
 	ORDER BY shardminvalue::integer ASC;
 
+-- test creating the shards of each worker in batches
+CREATE TABLE batch_created_shards
+(
+	id bigint PRIMARY KEY,
+	name text
+);
+CREATE INDEX batch_created_shards_name_idx ON batch_created_shards (name);
+
+SET citus.shard_creation_batch_size TO 3;
+SELECT create_distributed_table('batch_created_shards', 'id', 'hash');
+RESET citus.shard_creation_batch_size;
+
+INSERT INTO batch_created_shards SELECT i, 'name' || i FROM generate_series(1, 100) i;
+SELECT count(*) FROM batch_created_shards WHERE name LIKE 'name%';
+
 -- cleanup foreign table, related shards and shard placements
 DELETE FROM pg_dist_shard_placement
 	WHERE shardid IN (SELECT shardid FROM pg_dist_shard
@@ -331,6 +331,33 @@ SELECT * FROM data_load_test ORDER BY col2;
 SELECT * FROM data_load_test WHERE col3 = 'world';
 DROP TABLE data_load_test;
 
+-- citus.enable_parallel_local_data_copy reads the local data with a query, such
+-- that parallel workers scan the table, which shows up as more than one scan
+SET parallel_setup_cost TO 0;
+SET parallel_tuple_cost TO 0;
+SET min_parallel_table_scan_size TO 0;
+SET max_parallel_workers_per_gather TO 2;
+CREATE TABLE data_load_test (col1 int, col2 text);
+INSERT INTO data_load_test SELECT i, 'hello' FROM generate_series(1, 1000) i;
+ANALYZE data_load_test;
+SELECT create_distributed_table('data_load_test', 'col1');
+SELECT wait_until_true($$SELECT seq_scan > 1 FROM pg_stat_user_tables WHERE relid = 'data_load_test'::regclass$$, '2 seconds');
+SELECT count(*) FROM data_load_test;
+DROP TABLE data_load_test;
+SET citus.enable_parallel_local_data_copy TO on;
+CREATE TABLE data_load_test (col1 int, col2 text);
+INSERT INTO data_load_test SELECT i, 'hello' FROM generate_series(1, 1000) i;
+ANALYZE data_load_test;
+SELECT create_distributed_table('data_load_test', 'col1');
+SELECT wait_until_true($$SELECT seq_scan > 1 FROM pg_stat_user_tables WHERE relid = 'data_load_test'::regclass$$);
+SELECT count(*) FROM data_load_test;
+DROP TABLE data_load_test;
+RESET citus.enable_parallel_local_data_copy;
+RESET parallel_setup_cost;
+RESET parallel_tuple_cost;
+RESET min_parallel_table_scan_size;
+RESET max_parallel_workers_per_gather;
+
 SET citus.shard_replication_factor TO default;
 SET citus.shard_count to 4;
 
@@ -107,6 +107,15 @@ SELECT load_shard_placement_array(540001, true);
 -- should see error for non-existent shard
 SELECT load_shard_placement_array(540001, false);
 
+-- placement changes are patched into the cached entry of the table
+SET citus.enable_shard_level_cache_invalidation TO on;
+UPDATE pg_dist_placement SET shardstate = 1 WHERE shardid = 540001;
+SELECT load_shard_placement_array(540001, true);
+UPDATE pg_dist_placement SET shardstate = 0 WHERE shardid = 540001
+  AND groupid = (SELECT groupid FROM pg_dist_node WHERE nodeport = :worker_2_port);
+SELECT load_shard_placement_array(540001, true);
+RESET citus.enable_shard_level_cache_invalidation;
+
 -- should see column id of 'name'
 SELECT partition_column_id('events_hash');
 
@@ -201,6 +210,13 @@ SELECT * FROM get_shardid_test_table1_540009;
 SELECT * FROM get_shardid_test_table1_540007;
 \c - - - :master_port
 
+-- test exporting the shard map for routing rows on the client
+SELECT shardid, shard_name, shard_min_value, shard_max_value, hash_function, nodeport
+FROM citus_shard_map('get_shardid_test_table1') ORDER BY shardid, nodeport;
+SELECT citus_shard_map_token('get_shardid_test_table1') AS shard_map_token \gset
+SELECT citus_check_shard_map_token('get_shardid_test_table1', :shard_map_token);
+SELECT citus_check_shard_map_token('get_shardid_test_table1', :shard_map_token + 1);
+
 -- test non-existing value
 SELECT get_shard_id_for_distribution_column('get_shardid_test_table1', 4);
 
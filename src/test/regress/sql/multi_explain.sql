@@ -587,3 +587,43 @@ SELECT true AS valid FROM explain_xml($$
   )
   SELECT * FROM result JOIN series ON (s = l_quantity) JOIN orders_hash_part ON (s = o_orderkey)
 $$);
+
+-- EXPLAIN ANALYZE shows where the time of each task and subplan went
+CREATE OR REPLACE FUNCTION explain_has_line(options text, query text, line_prefix text)
+RETURNS boolean AS $BODY$
+DECLARE
+  explain_line text;
+BEGIN
+  FOR explain_line IN EXECUTE 'EXPLAIN (' || options || ') ' || query LOOP
+    IF ltrim(explain_line) LIKE line_prefix || '%' THEN
+      RETURN true;
+    END IF;
+  END LOOP;
+  RETURN false;
+END;
+$BODY$ LANGUAGE plpgsql;
+
+SELECT explain_has_line('ANALYZE', 'SELECT count(*) FROM lineitem', 'Connection Wait');
+SELECT explain_has_line('ANALYZE', 'SELECT count(*) FROM lineitem', 'Queue Time');
+SELECT explain_has_line('ANALYZE', 'SELECT count(*) FROM lineitem', 'Result Transfer Time');
+SELECT explain_has_line('ANALYZE', 'SELECT count(*) FROM lineitem',
+						'Data Received From Workers');
+-- with citus.max_coordinator_query_memory, the tuple store spills to disk
+SELECT explain_has_line('ANALYZE', 'SELECT * FROM lineitem', 'Tuple Store Memory');
+SET citus.max_coordinator_query_memory TO '64kB';
+SELECT explain_has_line('ANALYZE', 'SELECT * FROM lineitem', 'Tuple Store Memory: 64 kB');
+SELECT explain_has_line('ANALYZE', 'SELECT * FROM lineitem', 'Tuple Stores Spilled To Disk: 1');
+SELECT explain_has_line('ANALYZE', 'SELECT count(*) FROM lineitem',
+						'Tuple Stores Spilled To Disk: 0');
+RESET citus.max_coordinator_query_memory;
+
+SET citus.enable_cte_inlining TO false;
+SELECT explain_has_line('ANALYZE', $$
+  WITH result AS (SELECT l_orderkey FROM lineitem ORDER BY 1 LIMIT 5)
+  SELECT count(*) FROM result JOIN orders_hash_part ON (l_orderkey = o_orderkey)
+$$, 'Subplan Execution Time');
+SET citus.enable_cte_inlining TO true;
+
+-- timings are not shown without TIMING or ANALYZE
+SELECT explain_has_line('ANALYZE, TIMING OFF', 'SELECT count(*) FROM lineitem', 'Queue Time');
+SELECT explain_has_line('COSTS OFF', 'SELECT count(*) FROM lineitem', 'Queue Time');
@@ -0,0 +1,41 @@
+\c - - - :master_port
+
+CREATE TABLE lag_table (a int, b int);
+SELECT create_distributed_table('lag_table', 'a');
+
+INSERT INTO lag_table (a, b) VALUES (1, 1), (2, 2);
+
+\c "port=9070 dbname=regression options='-c\ citus.use_secondary_nodes=always\ -c\ citus.cluster_name=second-cluster'"
+
+-- by default, reads go to the secondaries regardless of their replication lag
+SHOW citus.max_secondary_replication_lag;
+SELECT * FROM lag_table ORDER BY a;
+
+-- with a bound, reads go to the secondaries that the maintenance daemon
+-- found to be within it, so wait for the first check
+SET citus.max_secondary_replication_lag TO '1h';
+DO $$
+BEGIN
+    FOR i IN 1 .. 300 LOOP
+        BEGIN
+            PERFORM * FROM lag_table;
+            RETURN;
+        EXCEPTION WHEN OTHERS THEN
+            PERFORM pg_sleep(0.1);
+        END;
+    END LOOP;
+END;
+$$;
+SELECT * FROM lag_table ORDER BY a;
+
+-- the time since the last check counts as lag, so no secondary is within a
+-- bound of 1ms, and there is no primary in this cluster to fall back to
+SET citus.max_secondary_replication_lag TO '1ms';
+SELECT * FROM lag_table ORDER BY a;
+
+RESET citus.max_secondary_replication_lag;
+SELECT * FROM lag_table ORDER BY a;
+
+-- clean up after ourselves
+\c - - - :master_port
+DROP TABLE lag_table;
@@ -64,6 +64,15 @@ CREATE INDEX IF NOT EXISTS lineitem_orderkey_index on index_test_hash(a);
 -- Verify that we can create indexes concurrently
 CREATE INDEX CONCURRENTLY lineitem_concurrently_index ON lineitem (l_orderkey);
 
+-- Verify that we can bound the number of shards indexed at a time on each node
+SET citus.max_concurrent_index_builds_per_node TO 1;
+CREATE INDEX CONCURRENTLY index_test_hash_concurrently_b ON index_test_hash (b);
+DROP INDEX CONCURRENTLY index_test_hash_concurrently_b;
+RESET citus.max_concurrent_index_builds_per_node;
+
+-- no concurrent index command is in progress
+SELECT * FROM citus_concurrent_index_progress;
+
 -- Verify that we warn out on CLUSTER command for distributed tables and no parameter
 CLUSTER index_test_hash USING index_test_hash_index_a;
 CLUSTER;
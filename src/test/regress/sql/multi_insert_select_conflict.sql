@@ -315,4 +315,30 @@ INSERT INTO target_table SELECT * FROM cte_2 ON CONFLICT(col_1) DO UPDATE SET co
 SELECT * FROM target_table ORDER BY 1;
 
 RESET client_min_messages;
+
+-- insert the rows of the SELECT in batches
+SET citus.insert_select_batch_size TO 5;
+SET citus.sort_returning TO on;
+
+INSERT INTO target_table (col_1, col_2)
+SELECT
+	s, s
+FROM
+	generate_series(1,12) s
+ON CONFLICT(col_1) DO UPDATE SET col_2 = EXCLUDED.col_2 * 10
+RETURNING *;
+
+INSERT INTO target_table (col_1, col_2)
+SELECT
+	s, s
+FROM
+	generate_series(1,15) s
+ON CONFLICT DO NOTHING
+RETURNING col_1;
+
+SELECT count(*), sum(col_2) FROM target_table;
+
+RESET citus.sort_returning;
+RESET citus.insert_select_batch_size;
+
 DROP SCHEMA on_conflict CASCADE;
@@ -135,6 +135,22 @@ JOIN (
      WHERE event_type = 5
 ) AS some_users ON (some_users.user_id = bar.user_id);
 
+-- Validate that the cost-based join order repartitions the smaller table, which
+-- is lineitem_hash once we record a size for its shards
+SET citus.enable_single_hash_repartition_joins TO on;
+EXPLAIN (COSTS OFF)
+SELECT count(*) FROM orders, lineitem_hash
+	WHERE o_orderkey = l_orderkey;
+
+UPDATE pg_dist_placement SET shardlength = 1
+	WHERE shardid IN (SELECT shardid FROM pg_dist_shard WHERE logicalrelid = 'lineitem_hash'::regclass);
+SET citus.enable_cost_based_join_order TO on;
+EXPLAIN (COSTS OFF)
+SELECT count(*) FROM orders, lineitem_hash
+	WHERE o_orderkey = l_orderkey;
+RESET citus.enable_cost_based_join_order;
+RESET citus.enable_single_hash_repartition_joins;
+
 -- Reset client logging level to its previous value
 SET client_min_messages TO NOTICE;
 
@@ -223,4 +223,19 @@ SELECT
 	LIMIT 5;
 
 SET client_min_messages TO NOTICE;
+
+-- the execution stops once it received enough rows for the LIMIT
+SET citus.enable_limit_early_termination TO on;
+SELECT 1 AS one FROM lineitem_hash LIMIT 3;
+SELECT 1 AS one FROM lineitem_hash LIMIT 2 OFFSET 2;
+RESET citus.enable_limit_early_termination;
+
+-- the sorted rows of the tasks are merged rather than sorted again
+SET citus.enable_sorted_task_result_merge TO on;
+SELECT l_orderkey, l_linenumber FROM lineitem_hash
+	ORDER BY l_orderkey, l_linenumber LIMIT 4 OFFSET 4;
+SELECT l_orderkey, l_linenumber FROM lineitem
+	ORDER BY l_orderkey DESC, l_linenumber DESC LIMIT 3;
+RESET citus.enable_sorted_task_result_merge;
+
 DROP TABLE lineitem_hash;
@@ -134,7 +134,12 @@ RESET citus.replication_model;
 -- Check that repeated calls to start_metadata_sync_to_node has no side effects
 \c - - - :master_port
 SELECT start_metadata_sync_to_node('localhost', :worker_1_port);
+-- also send the snapshot in batches, which should give the same result
+SET citus.metadata_sync_batch_size TO '64kB';
 SELECT start_metadata_sync_to_node('localhost', :worker_1_port);
+RESET citus.metadata_sync_batch_size;
+-- no metadata sync is in progress
+SELECT * FROM citus_metadata_sync_progress;
 \c - - - :worker_1_port
 SELECT * FROM pg_dist_local_group;
 SELECT * FROM pg_dist_node ORDER BY nodeid;
@@ -504,6 +509,29 @@ DROP TABLE mx_table_with_small_sequence, mx_table_with_sequence;
 \ds mx_table_with_sequence_b_seq
 \ds mx_table_with_sequence_c_seq
 
+-- citus.distributed_sequence_cache_size raises the sequence cache, also on the workers
+\c - - - :master_port
+SET citus.shard_replication_factor TO 1;
+SET citus.replication_model TO 'streaming';
+SELECT nextval('pg_catalog.pg_dist_shardid_seq') AS last_shard_id \gset
+SELECT nextval('pg_catalog.pg_dist_placement_placementid_seq') AS last_placement_id \gset
+SELECT nextval('pg_catalog.pg_dist_colocationid_seq') AS last_colocation_id \gset
+CREATE TABLE mx_table_with_sequence(a int, b BIGSERIAL);
+SELECT create_distributed_table('mx_table_with_sequence', 'a');
+SELECT cache_size FROM pg_sequences WHERE sequencename = 'mx_table_with_sequence_b_seq';
+SELECT run_command_on_workers($$SELECT cache_size FROM pg_sequences WHERE sequencename = 'mx_table_with_sequence_b_seq'$$);
+DROP TABLE mx_table_with_sequence;
+SET citus.distributed_sequence_cache_size TO 100;
+CREATE TABLE mx_table_with_sequence(a int, b BIGSERIAL);
+SELECT create_distributed_table('mx_table_with_sequence', 'a');
+SELECT cache_size FROM pg_sequences WHERE sequencename = 'mx_table_with_sequence_b_seq';
+SELECT run_command_on_workers($$SELECT cache_size FROM pg_sequences WHERE sequencename = 'mx_table_with_sequence_b_seq'$$);
+DROP TABLE mx_table_with_sequence;
+RESET citus.distributed_sequence_cache_size;
+ALTER SEQUENCE pg_catalog.pg_dist_shardid_seq RESTART :last_shard_id;
+ALTER SEQUENCE pg_catalog.pg_dist_placement_placementid_seq RESTART :last_placement_id;
+ALTER SEQUENCE pg_catalog.pg_dist_colocationid_seq RESTART :last_colocation_id;
+
 -- Check that MX sequences play well with non-super users
 \c - - - :master_port
 
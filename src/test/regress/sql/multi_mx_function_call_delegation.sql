@@ -260,6 +260,45 @@ EXECUTE call_plan(2, 0);
 EXECUTE call_plan(2, 0);
 EXECUTE call_plan(2, 0);
 
+-- Calls with an array of distribution argument values are split by worker
+SET client_min_messages TO NOTICE;
+CREATE FUNCTION mx_call_func_batch(x int[])
+RETURNS SETOF int
+LANGUAGE plpgsql AS $$
+BEGIN
+    -- record the group that inserts the rows, which is 0 on the coordinator
+    INSERT INTO multi_mx_function_call_delegation.mx_call_dist_table_1
+        SELECT i, (select groupid from pg_dist_local_group) FROM unnest(x) i;
+    RETURN QUERY SELECT 1 WHERE false;
+END;$$;
+SELECT create_distributed_function('mx_call_func_batch(int[])', '$1', 'mx_call_dist_table_1');
+
+CREATE PROCEDURE mx_call_proc_batch(x int[])
+LANGUAGE plpgsql AS $$
+BEGIN
+    INSERT INTO multi_mx_function_call_delegation.mx_call_dist_table_1
+        SELECT i, (select groupid from pg_dist_local_group) FROM unnest(x) i;
+END;$$;
+SELECT create_distributed_function('mx_call_proc_batch(int[])', '$1', 'mx_call_dist_table_1');
+
+SET citus.enable_batched_function_delegation TO on;
+select mx_call_func_batch(ARRAY[100, 101, 102, 103, 104, 105, 106, 107]);
+CALL mx_call_proc_batch(ARRAY[200, 201, 202, 203, 204, 205, 206, 207]);
+
+-- every row was inserted on a worker
+SELECT id / 100 AS call, count(*), bool_and(val > 0) AS on_workers
+FROM mx_call_dist_table_1 WHERE id >= 100 GROUP BY 1 ORDER BY 1;
+RESET citus.enable_batched_function_delegation;
+SET client_min_messages TO DEBUG1;
+
+-- Delegated calls can use statements that are prepared once per connection
+SET citus.enable_prepared_function_delegation TO on;
+select mx_call_func(2, 0);
+select mx_call_func(2, 0);
+select mx_call_func_bigint(4, 2);
+select mx_call_func_bigint(4, 2);
+RESET citus.enable_prepared_function_delegation;
+
 \c - - - :worker_1_port
 SET search_path TO multi_mx_function_call_delegation, public;
 -- create_distributed_function is disallowed from worker nodes
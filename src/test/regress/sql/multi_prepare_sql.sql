@@ -655,6 +655,37 @@ WHERE shardid IN (
 EXECUTE countsome; -- should indicate replanning
 EXECUTE countsome; -- no replanning
 
+-- multi-shard queries with parameters can use a generic plan
+SET citus.enable_generic_multi_shard_plans TO on;
+PREPARE countdata(text) AS SELECT count(*) FROM test_table WHERE data = $1 HAVING COUNT(*) = immutable_bleat('replanning');
+EXECUTE countdata('a'); -- should indicate planning
+EXECUTE countdata('a'); -- should indicate planning
+EXECUTE countdata('a'); -- should indicate planning
+EXECUTE countdata('a'); -- should indicate planning
+EXECUTE countdata('a'); -- should indicate planning
+EXECUTE countdata('a'); -- should indicate planning of the generic plan
+EXECUTE countdata('a'); -- no replanning
+
+-- the generic plan skips the shards that the parameter values rule out
+PREPARE countids(int[]) AS SELECT count(*) FROM test_table WHERE test_id = ANY($1) HAVING COUNT(*) = immutable_bleat('replanning');
+EXECUTE countids('{1}'); -- should indicate planning
+EXECUTE countids('{1}'); -- should indicate planning
+EXECUTE countids('{1}'); -- should indicate planning
+EXECUTE countids('{1}'); -- should indicate planning
+EXECUTE countids('{1}'); -- should indicate planning
+EXECUTE countids('{1}'); -- should indicate planning of the generic plan
+SET client_min_messages TO DEBUG2;
+EXECUTE countids('{1}'); -- no replanning, but pruning
+RESET client_min_messages;
+RESET citus.enable_generic_multi_shard_plans;
+
+-- stable functions that the distribution column is compared with are evaluated on execution
+PREPARE countversion AS SELECT count(*) FROM test_table WHERE test_id = position('PostgreSQL' in version());
+EXECUTE countversion;
+SET client_min_messages TO DEBUG2;
+EXECUTE countversion;
+RESET client_min_messages;
+
 -- reset
 \set VERBOSITY default
 
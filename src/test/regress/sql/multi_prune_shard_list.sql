@@ -113,6 +113,15 @@ SELECT print_sorted_shard_intervals('pruning_range');
 UPDATE pg_dist_shard set shardminvalue = NULL, shardmaxvalue = NULL WHERE shardid = 800007;
 SELECT print_sorted_shard_intervals('pruning_range');
 
+-- overlapping shard intervals, shards without min/max values are never pruned
+UPDATE pg_dist_shard SET shardminvalue = 'a', shardmaxvalue = 'd' WHERE shardid = 800004;
+UPDATE pg_dist_shard SET shardminvalue = 'b', shardmaxvalue = 'c' WHERE shardid = 800005;
+UPDATE pg_dist_shard SET shardminvalue = 'e', shardmaxvalue = 'h' WHERE shardid = 800006;
+SELECT prune_using_single_value('pruning_range', 'c');
+SELECT prune_using_single_value('pruning_range', 'd');
+SELECT prune_using_single_value('pruning_range', 'f');
+SELECT prune_using_single_value('pruning_range', 'z');
+
 -- ===================================================================
 -- test pruning using values whose types are coerced
 -- ===================================================================
@@ -400,4 +400,21 @@ SET citus.select_opens_transaction_block TO off;
 SELECT id, pg_advisory_xact_lock(16) FROM test_table ORDER BY id;
 END;
 
+RESET citus.select_opens_transaction_block;
+
+-- read-only transactions at read committed do not need a distributed transaction
+-- either when read_only_select_opens_transaction_block is disabled
+BEGIN READ ONLY;
+SET LOCAL citus.read_only_select_opens_transaction_block TO off;
+SELECT id, pg_advisory_xact_lock(17) FROM test_table ORDER BY id;
+END;
+
+-- BEGIN is sent along with the first task on each connection
+BEGIN;
+SET LOCAL citus.enable_pipelined_begin TO on;
+SELECT count(*) FROM test_table;
+UPDATE test_table SET col_1 = col_1 WHERE id = 1;
+SELECT count(*) FROM test_table;
+ROLLBACK;
+
 DROP SCHEMA multi_real_time_transaction CASCADE;
@@ -523,6 +523,44 @@ SELECT master_add_node('invalid-node-name', 9999);
 SET client_min_messages to DEFAULT;
 \set VERBOSITY default
 
+-- reference tables can be replicated logically
+SELECT master_remove_node('localhost', :worker_2_port);
+CREATE TABLE ref_table_logical_1 (id int PRIMARY KEY, v int);
+CREATE TABLE ref_table_logical_2 (id int PRIMARY KEY, v int REFERENCES ref_table_logical_1 (id));
+SELECT create_reference_table('ref_table_logical_1'),
+       create_reference_table('ref_table_logical_2');
+INSERT INTO ref_table_logical_1 SELECT i, i FROM generate_series(1, 10) i;
+INSERT INTO ref_table_logical_2 SELECT i, i FROM generate_series(1, 10) i;
+
+SET citus.reference_table_transfer_mode TO 'force_logical';
+SELECT 1 FROM master_add_node('localhost', :worker_2_port);
+RESET citus.reference_table_transfer_mode;
+
+SELECT shardid, nodeport FROM pg_dist_shard_placement
+WHERE shardid IN (1370016, 1370017) AND nodeport = :worker_2_port ORDER BY shardid;
+SELECT run_command_on_workers('SELECT count(*) FROM ref_table_logical_2_1370017');
+SELECT run_command_on_workers('select count(*) from pg_constraint where contype=''f'' AND conname like ''ref_table_logical%'';');
+
+-- reference tables can be replicated when shards are first placed on a node
+SELECT master_remove_node('localhost', :worker_2_port);
+SET citus.replicate_reference_tables_on_activate TO off;
+SET citus.shard_copy_parallelism TO 2;
+SELECT 1 FROM master_add_node('localhost', :worker_2_port);
+
+SELECT shardid, nodeport FROM pg_dist_shard_placement
+WHERE shardid IN (1370016, 1370017) AND nodeport = :worker_2_port ORDER BY shardid;
+
+CREATE TABLE deferred_hash_table (id int);
+SELECT create_distributed_table('deferred_hash_table', 'id');
+
+SELECT shardid, nodeport FROM pg_dist_shard_placement
+WHERE shardid IN (1370016, 1370017) AND nodeport = :worker_2_port ORDER BY shardid;
+SELECT run_command_on_workers('SELECT count(*) FROM ref_table_logical_2_1370017');
+
+RESET citus.replicate_reference_tables_on_activate;
+RESET citus.shard_copy_parallelism;
+DROP TABLE deferred_hash_table, ref_table_logical_2, ref_table_logical_1;
+
 -- drop unnecassary tables
 DROP TABLE initially_not_replicated_reference_table;
 
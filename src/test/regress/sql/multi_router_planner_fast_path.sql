@@ -854,6 +854,71 @@ SELECT count(*) FILTER (where value = 15) FROM collections_list WHERE key = 4;
 SELECT count(*) FILTER (where value = 15) FROM collections_list_1 WHERE key = 4;
 SELECT count(*) FILTER (where value = 15) FROM collections_list_2 WHERE key = 4;
 
+-- plans are reused when the same query is sent again
+SET citus.max_cached_fast_path_plans TO 10;
+SELECT count(*) FROM collections_list WHERE key = 4;
+SELECT count(*) FROM collections_list WHERE key = 4;
+SELECT count(*) FROM collections_list WHERE key = 5;
+
+-- cached plans are dropped when the table changes
+SET client_min_messages to 'NOTICE';
+ALTER TABLE collections_list ALTER COLUMN value SET DEFAULT 0;
+SET client_min_messages to 'DEBUG2';
+SELECT count(*) FROM collections_list WHERE key = 4;
+SELECT count(*) FROM collections_list WHERE key = 4;
+SET client_min_messages to 'NOTICE';
+ALTER TABLE collections_list ALTER COLUMN value DROP DEFAULT;
+SET client_min_messages to 'DEBUG2';
+RESET citus.max_cached_fast_path_plans;
+
+-- the partition is picked on the coordinator when the filters exclude the others
+SET citus.enable_fast_path_partition_pruning TO on;
+SELECT count(*) FROM collections_list WHERE key = 4 AND collection_id = 1;
+SELECT count(*) FROM collections_list WHERE key = 4 AND collection_id = 2;
+SELECT count(*) FROM collections_list WHERE key = 4 AND collection_id > 0;
+RESET citus.enable_fast_path_partition_pruning;
+
+-- partitions are read by column name, also when their columns are in a different order
+SET client_min_messages to 'NOTICE';
+CREATE TABLE collections_layout (
+	key bigint,
+	dropped_column integer,
+	collection_id integer,
+	value text
+) PARTITION BY LIST (collection_id);
+ALTER TABLE collections_layout DROP COLUMN dropped_column;
+SELECT create_distributed_table('collections_layout', 'key');
+CREATE TABLE collections_layout_1 (value text, collection_id integer, key bigint);
+ALTER TABLE collections_layout ATTACH PARTITION collections_layout_1 FOR VALUES IN (1);
+CREATE TABLE collections_layout_2 PARTITION OF collections_layout FOR VALUES IN (2);
+INSERT INTO collections_layout VALUES (4, 1, 'first'), (4, 2, 'second'), (5, 1, 'other');
+
+SET client_min_messages to 'DEBUG2';
+SET citus.enable_fast_path_partition_pruning TO on;
+SELECT key, collection_id, value FROM collections_layout WHERE key = 4 AND collection_id = 1;
+SELECT * FROM collections_layout WHERE key = 4 AND collection_id = 2;
+
+-- whole rows are read through the parent
+SELECT collections_layout FROM collections_layout WHERE key = 4 AND collection_id = 1;
+
+-- users that can only read the parent read the partition through the parent
+SET client_min_messages to 'NOTICE';
+SELECT run_command_on_coordinator_and_workers('CREATE USER fast_path_parent_reader');
+SET citus.enable_ddl_propagation TO off;
+GRANT SELECT ON collections_layout TO fast_path_parent_reader;
+RESET citus.enable_ddl_propagation;
+SELECT DISTINCT result FROM run_command_on_placements('collections_layout', 'GRANT SELECT ON %s TO fast_path_parent_reader');
+
+SET ROLE fast_path_parent_reader;
+SET client_min_messages to 'DEBUG2';
+SELECT key, collection_id, value FROM collections_layout WHERE key = 4 AND collection_id = 1;
+SET client_min_messages to 'NOTICE';
+RESET ROLE;
+RESET citus.enable_fast_path_partition_pruning;
+
+DROP TABLE collections_layout;
+SELECT run_command_on_coordinator_and_workers('DROP USER fast_path_parent_reader');
+
 SET client_min_messages to 'NOTICE';
 
 DROP FUNCTION author_articles_max_id();
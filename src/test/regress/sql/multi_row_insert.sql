@@ -27,3 +27,61 @@ SELECT * FROM source_table_xyz ORDER BY 1;
 
 DROP TABLE source_table_xyz;
 DROP TYPE composite_key_type;
+
+-- multi-row INSERTs with at least citus.multi_row_insert_copy_threshold rows
+-- copy their rows into the shards
+SET citus.shard_count TO 4;
+CREATE TABLE copy_insert (key int, value text DEFAULT 'default', id bigserial, amount numeric(10,2));
+SELECT create_distributed_table('copy_insert', 'key');
+CREATE TABLE copy_insert_ref (key int, value text);
+SELECT create_reference_table('copy_insert_ref');
+CREATE TABLE copy_insert_append (key int, value text);
+SELECT create_distributed_table('copy_insert_append', 'key', 'append');
+
+SET citus.multi_row_insert_copy_threshold TO 3;
+SET client_min_messages TO DEBUG1;
+
+-- fewer rows than the threshold are still split by shard
+INSERT INTO copy_insert VALUES (1, 'one', DEFAULT, 1), (2, 'two', DEFAULT, 2);
+
+-- columns in a different order than in the table
+INSERT INTO copy_insert (amount, value, key) VALUES (3, 'three', 3), (4, 'four', 4), (5, 'five', 5);
+
+-- omitted columns get their defaults and serial values
+INSERT INTO copy_insert (key) VALUES (6), (7), (8);
+
+-- values are cast to the column types
+INSERT INTO copy_insert (key, value, amount) VALUES ('9', 9, 9.999), (10.4, 10, '10'), (11, 11, 11);
+
+-- reference tables
+INSERT INTO copy_insert_ref VALUES (1, 'one'), (2, 'two'), (3, 'three');
+
+-- append-distributed tables are excluded, since COPY would create a new shard
+INSERT INTO copy_insert_append VALUES (1, 'one'), (2, 'two'), (3, 'three');
+
+-- RETURNING, ON CONFLICT and unresolved parameters use the regular plan
+SET citus.sort_returning TO on;
+INSERT INTO copy_insert (key, value) VALUES (12, 'a'), (13, 'b'), (14, 'c') RETURNING key, value;
+RESET citus.sort_returning;
+INSERT INTO copy_insert (key, value) VALUES (15, 'a'), (16, 'b'), (17, 'c') ON CONFLICT DO NOTHING;
+
+PREPARE copy_insert_params(int, int, int) AS INSERT INTO copy_insert (key) VALUES ($1), ($2), ($3);
+EXECUTE copy_insert_params(18, 19, 20);
+EXECUTE copy_insert_params(21, 22, 23);
+EXECUTE copy_insert_params(24, 25, 26);
+EXECUTE copy_insert_params(27, 28, 29);
+EXECUTE copy_insert_params(30, 31, 32);
+-- the generic plan has unresolved parameters
+EXECUTE copy_insert_params(33, 34, 35);
+DEALLOCATE copy_insert_params;
+
+RESET client_min_messages;
+
+EXPLAIN (COSTS OFF) INSERT INTO copy_insert (key) VALUES (36), (37), (38);
+
+SELECT * FROM copy_insert WHERE key < 18 ORDER BY key;
+SELECT count(*), min(id), max(id) FROM copy_insert WHERE key >= 18;
+SELECT * FROM copy_insert_ref ORDER BY key;
+
+RESET citus.multi_row_insert_copy_threshold;
+DROP TABLE copy_insert, copy_insert_ref, copy_insert_append;
@@ -715,6 +715,25 @@ SELECT COUNT(*) FROM users_test_table WHERE user_id = 3 or user_id = 5;
 DELETE FROM users_test_table WHERE user_id = 3 or user_id = 5;
 SELECT COUNT(*) FROM users_test_table WHERE user_id = 3 or user_id = 5;
 
+-- multi-shard queries are deparsed once for all shards, also when a constant
+-- looks like one of the placeholders for the shard names
+CREATE TABLE shard_query_templates (id int, value text);
+SELECT create_distributed_table('shard_query_templates', 'id');
+INSERT INTO shard_query_templates VALUES (1, 'a'), (2, 'b'), (3, 'c'), (4, 'd');
+UPDATE shard_query_templates SET value = '"$citus_shard_0$"' WHERE id > 2;
+UPDATE shard_query_templates SET value = value || '!';
+SELECT * FROM shard_query_templates ORDER BY id;
+SELECT count(*) FROM (SELECT DISTINCT id, value FROM shard_query_templates) s
+WHERE value LIKE '%$citus_shard_%';
+SET citus.enable_shard_query_templates TO off;
+DELETE FROM shard_query_templates WHERE value = 'a!';
+SELECT count(*) FROM (SELECT DISTINCT id, value FROM shard_query_templates) s
+WHERE value LIKE '%$citus_shard_%';
+RESET citus.enable_shard_query_templates;
+DELETE FROM shard_query_templates WHERE value = '"$citus_shard_0$"!';
+SELECT * FROM shard_query_templates ORDER BY id;
+DROP TABLE shard_query_templates;
+
 DROP TABLE users_test_table;
 DROP TABLE events_test_table;
 DROP TABLE events_reference_copy_table;
@@ -328,3 +328,38 @@ SELECT * FROM articles TABLESAMPLE SYSTEM (100) WHERE author_id = 1 ORDER BY id;
 SELECT * FROM articles TABLESAMPLE BERNOULLI (100) WHERE author_id = 1 ORDER BY id;
 
 SET client_min_messages to 'NOTICE';
+
+-- executions of distributed queries are tracked when pg_stat_statements is loaded
+SELECT citus_stat_statements_reset();
+SELECT count(*) FROM articles WHERE author_id = 1;
+SELECT count(*) FROM articles;
+SELECT coalesce(bool_and(calls > 0 AND min_time <= max_time AND tasks >= calls AND
+                         shards >= tasks), true) AS valid_stats
+FROM citus_query_stats();
+
+-- the maintenance daemon samples what distributed queries are waiting on
+SELECT citus_wait_samples_reset();
+SELECT count(*) FROM articles;
+SELECT coalesce(bool_and(citus_wait_event IS NOT NULL OR wait_event IS NOT NULL), true)
+  AS valid_samples
+FROM citus_wait_samples;
+
+-- planner and executor events are counted across backends
+SELECT citus_stat_counters_reset();
+SELECT count(*) FROM articles WHERE author_id = 1;
+SELECT count(*) FROM articles;
+SELECT fast_path_plans >= 1 AS has_fast_path, multi_shard_plans >= 1 AS has_multi_shard,
+       remote_tasks_executed >= 3 AS has_remote_tasks
+FROM citus_stat_counters;
+
+-- router queries are counted per distribution column value
+SELECT citus_stat_tenants_reset();
+SELECT count(*) FROM articles WHERE author_id = 1;
+SELECT count(*) FROM articles WHERE author_id = 1;
+SELECT count(*) FROM articles WHERE author_id = 2;
+SELECT distribution_value, calls >= 1 AS called, rows >= 1 AS has_rows
+FROM citus_stat_tenants
+WHERE colocation_id = (SELECT colocationid FROM pg_dist_partition
+                       WHERE logicalrelid = 'articles'::regclass)
+  AND distribution_value IN ('1', '2')
+ORDER BY distribution_value;
@@ -198,3 +198,70 @@ SELECT max(l_suppkey) FROM
                 l_suppkey) z
 ) y;
 
+-- Check that we support window functions partitioned by a column other than
+-- the distribution column by repartitioning the rows on that column.
+
+select
+    count(*)
+from
+    (select
+        l_suppkey,
+        row_number() over (partition by l_suppkey order by l_orderkey, l_linenumber) as line_number
+    from
+        lineitem) as distributed_table
+where
+    line_number = 1;
+
+select
+    max(line_number)
+from
+    (select
+        l_suppkey,
+        row_number() over (partition by l_suppkey order by l_orderkey, l_linenumber) as line_number
+    from
+        lineitem) as distributed_table;
+
+-- Check that grouping by a non-distribution column can finalize the
+-- aggregates on the workers after repartitioning on the group by column.
+SET citus.enable_repartitioned_group_by TO on;
+
+select
+    l_suppkey,
+    count(*)
+from
+    lineitem
+group by
+    l_suppkey
+order by
+    2 desc, 1 desc
+limit 5;
+
+select
+    l_suppkey,
+    sum(l_quantity)
+from
+    lineitem
+group by
+    l_suppkey
+having
+    count(*) > 6;
+
+RESET citus.enable_repartitioned_group_by;
+
+-- Check that count(distinct) on a non-distribution column can be computed
+-- exactly on the workers after repartitioning on that column.
+SET citus.enable_repartitioned_count_distinct TO on;
+
+select
+    count(distinct l_shipmode)
+from
+    lineitem;
+
+select
+    count(distinct l_shipmode) * 2 as twice_ship_modes
+from
+    lineitem
+where
+    l_shipmode <> 'AIR';
+
+RESET citus.enable_repartitioned_count_distinct;
@@ -57,6 +57,17 @@ SELECT * FROM
   (SELECT random() FROM user_buy_test_table RIGHT JOIN users_ref_test_table
   ON user_buy_test_table.user_id = users_ref_test_table.id) subquery_1;
 
+-- Should work, the reference table is restricted to the hash range of each shard
+SET citus.enable_reference_table_outer_join_pushdown TO on;
+SELECT id, item_id FROM users_ref_test_table LEFT JOIN user_buy_test_table
+  ON users_ref_test_table.id = user_buy_test_table.user_id
+ORDER BY 1;
+
+SELECT k_no, count(user_id) FROM user_buy_test_table RIGHT JOIN users_ref_test_table
+  ON user_buy_test_table.user_id = users_ref_test_table.id
+GROUP BY k_no ORDER BY 1;
+RESET citus.enable_reference_table_outer_join_pushdown;
+
 -- Equi join test with reference table on non-partition keys
 SELECT count(*) FROM
   (SELECT random() FROM user_buy_test_table JOIN users_ref_test_table
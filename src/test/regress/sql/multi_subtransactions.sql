@@ -305,6 +305,33 @@ COMMIT;
 
 SELECT * FROM researchers WHERE lab_id=10;
 
+-- Savepoints are only sent to the connections that are used inside them
+SET citus.enable_lazy_savepoint_propagation TO on;
+BEGIN;
+INSERT INTO researchers VALUES (40, 20, 'Kurt Goedel');
+DO $$
+BEGIN
+  FOR i IN 1..3 LOOP
+    BEGIN
+      INSERT INTO researchers VALUES (40 + i, 21, 'Emil Post');
+      IF i = 2 THEN
+        RAISE EXCEPTION plpgsql_error;
+      END IF;
+    EXCEPTION
+      WHEN plpgsql_error THEN
+        RAISE NOTICE 'caught manual plpgsql_error';
+    END;
+  END LOOP;
+END $$;
+SAVEPOINT s1;
+INSERT INTO researchers VALUES (45, 20, 'Alfred Tarski');
+ROLLBACK TO SAVEPOINT s1;
+COMMIT;
+
+SELECT * FROM researchers WHERE lab_id IN (20, 21) ORDER BY id;
+
+RESET citus.enable_lazy_savepoint_propagation;
+
 -- Clean-up
 DROP TABLE artists;
 DROP TABLE researchers;
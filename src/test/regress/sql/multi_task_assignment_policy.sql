@@ -203,6 +203,25 @@ INSERT INTO explain_outputs
 SELECT count(DISTINCT value) FROM explain_outputs;
 TRUNCATE explain_outputs;
 
+-- the locality policy picks the placement on the node to which the session
+-- holds the fewest connections, close all cached connections first
+SET citus.max_cached_conns_per_worker TO 0;
+BEGIN;
+SET LOCAL citus.task_assignment_policy TO 'locality';
+SET LOCAL citus.explain_distributed_queries TO on;
+
+INSERT INTO explain_outputs
+       SELECT parse_explain_output('EXPLAIN SELECT count(*) FROM task_assignment_reference_table;', 'task_assignment_reference_table');
+INSERT INTO explain_outputs
+       SELECT parse_explain_output('EXPLAIN SELECT count(*) FROM task_assignment_reference_table;', 'task_assignment_reference_table');
+
+-- the connection of the first query is still open, so the second query
+-- should go to the other worker node
+SELECT count(DISTINCT value) FROM explain_outputs;
+TRUNCATE explain_outputs;
+COMMIT;
+RESET citus.max_cached_conns_per_worker;
+
 -- test that the round robin policy detects the anchor shard correctly
 -- we should not pick a reference table shard as the anchor shard when joining with a distributed table
 SET citus.shard_replication_factor TO 1;
@@ -155,3 +155,23 @@ CREATE OR REPLACE FUNCTION pg_catalog.partition_task_list_results(resultIdPrefix
                   targetShardIndex int)
     LANGUAGE C STRICT VOLATILE
     AS 'citus', $$partition_task_list_results$$;
+
+-- wait_until_true runs the given query until it returns true, for at most the given time
+CREATE OR REPLACE FUNCTION wait_until_true(condition text, timeout interval DEFAULT '30 seconds')
+    RETURNS bool
+    LANGUAGE plpgsql
+AS $$
+DECLARE
+    start_time timestamptz := clock_timestamp();
+    satisfied bool;
+BEGIN
+    LOOP
+        PERFORM pg_stat_clear_snapshot();
+        EXECUTE condition INTO satisfied;
+        IF satisfied OR clock_timestamp() > start_time + timeout THEN
+            RETURN coalesce(satisfied, false);
+        END IF;
+        PERFORM pg_sleep(0.1);
+    END LOOP;
+END;
+$$;
@@ -186,6 +186,50 @@ INSERT INTO test_recovery_single VALUES ('hello-2');
 COMMIT;
 SELECT count(*) FROM pg_dist_transaction;
 
+SELECT recover_prepared_transactions();
+
+-- sending PREPARE TRANSACTION along with the last command should also write
+-- one transaction recovery record per connection
+SET citus.enable_pipelined_prepare TO on;
+UPDATE test_recovery_single SET y = 'pipelined';
+SELECT count(*) FROM pg_dist_transaction;
+SELECT recover_prepared_transactions();
+SELECT count(*) FROM test_recovery_single WHERE y = 'pipelined';
+RESET citus.enable_pipelined_prepare;
+
+-- the next statement should see the changes once COMMIT PREPARED no longer
+-- delays the commit
+SET citus.enable_async_commit_prepared TO on;
+UPDATE test_recovery_single SET y = 'async';
+SELECT count(*) FROM test_recovery_single WHERE y = 'async';
+SELECT recover_prepared_transactions();
+RESET citus.enable_async_commit_prepared;
+
+-- a transaction with a single participant can commit without 2PC, the
+-- multi-shard insert goes to two shards on the same worker over one connection
+SET citus.next_shard_id TO 1220100;
+SET citus.shard_count TO 4;
+CREATE TABLE test_single_participant (x int);
+SELECT create_distributed_table('test_single_participant', 'x');
+SELECT min(i) AS first_value FROM generate_series(1, 100) i
+WHERE get_shard_id_for_distribution_column('test_single_participant', i) = 1220100 \gset
+SELECT min(i) AS second_value FROM generate_series(1, 100) i
+WHERE get_shard_id_for_distribution_column('test_single_participant', i) = 1220102 \gset
+SELECT recover_prepared_transactions();
+SET citus.multi_shard_modify_mode TO 'sequential';
+INSERT INTO test_single_participant VALUES (:first_value), (:second_value);
+SELECT count(*) FROM pg_dist_transaction;
+SET citus.enable_single_participant_commit TO on;
+INSERT INTO test_single_participant VALUES (:first_value), (:second_value);
+-- only the first transaction wrote a recovery record
+SELECT count(*) FROM pg_dist_transaction;
+RESET citus.enable_single_participant_commit;
+RESET citus.multi_shard_modify_mode;
+SELECT count(*) FROM test_single_participant;
+SELECT recover_prepared_transactions();
+DROP TABLE test_single_participant;
+SET citus.shard_count TO 2;
+
 
 -- Test whether auto-recovery runs
 ALTER SYSTEM SET citus.recover_2pc_interval TO 10;
@@ -311,6 +311,24 @@ SELECT run_command_on_workers($$SELECT wait_for_stats()$$);
 SELECT run_command_on_workers($$SELECT pg_stat_get_vacuum_count(tablename::regclass) from pg_tables where tablename LIKE 'dustbunnies_%' limit 1$$);
 SELECT run_command_on_workers($$SELECT pg_stat_get_analyze_count(tablename::regclass) from pg_tables where tablename LIKE 'dustbunnies_%' limit 1$$);
 
+-- VACUUM and ANALYZE can be throttled per node
+SET citus.max_concurrent_vacuums_per_node TO 1;
+SET citus.worker_vacuum_cost_delay TO '2ms';
+SET citus.worker_vacuum_cost_limit TO 1000;
+VACUUM dustbunnies;
+BEGIN;
+ANALYZE dustbunnies;
+COMMIT;
+RESET citus.max_concurrent_vacuums_per_node;
+RESET citus.worker_vacuum_cost_delay;
+RESET citus.worker_vacuum_cost_limit;
+
+-- no distributed VACUUM is in progress
+SELECT * FROM citus_vacuum_progress;
+
+-- no COPY, INSERT..SELECT or repartition query is in progress
+SELECT * FROM citus_command_progress;
+
 -- test worker_hash
 SELECT worker_hash(123);
 SELECT worker_hash('1997-08-08'::date);
@@ -803,6 +803,33 @@ SELECT create_distributed_table('table1','tenant_id');
 UPDATE table2 SET id=20 FROM table1_view WHERE table1_view.id=table2.id;
 UPDATE table2_p1 SET id=20 FROM table1_view WHERE table1_view.id=table2_p1.id;
 
+-- the distribution key equality of a query is reused when it is planned again
+SET citus.max_cached_restriction_equivalences TO 10;
+SELECT true AS valid FROM explain_json_2($$
+  SELECT count(*)
+  FROM
+    (SELECT user_id FROM users_table) AS foo,
+    (SELECT user_id FROM events_table) AS bar
+  WHERE foo.user_id = bar.user_id
+$$);
+SELECT true AS valid FROM explain_json_2($$
+  SELECT count(*)
+  FROM
+    (SELECT user_id FROM users_table) AS foo,
+    (SELECT user_id FROM events_table) AS bar
+  WHERE foo.user_id = bar.user_id
+$$);
+RESET citus.max_cached_restriction_equivalences;
+
+-- small distributed tables are broadcast in non-colocated joins
+CREATE TABLE broadcast_small (id int, tenant_id int);
+SELECT create_distributed_table('broadcast_small', 'tenant_id', colocate_with => 'none');
+UPDATE pg_dist_placement SET shardlength = 1
+WHERE shardid IN (SELECT shardid FROM pg_dist_shard WHERE logicalrelid = 'broadcast_small'::regclass);
+SET citus.broadcast_join_threshold TO '8kB';
+SELECT count(*) FROM table1 JOIN broadcast_small ON (table1.id = broadcast_small.id);
+RESET citus.broadcast_join_threshold;
+
 RESET client_min_messages;
 DROP FUNCTION explain_json_2(text);
 
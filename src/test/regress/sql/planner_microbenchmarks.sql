@@ -0,0 +1,84 @@
+CREATE SCHEMA planner_microbenchmarks;
+SET search_path TO planner_microbenchmarks;
+
+SET citus.next_shard_id TO 1660000;
+SET citus.shard_count TO 4;
+SET citus.shard_replication_factor TO 1;
+
+-- ===================================================================
+-- create test functions
+-- ===================================================================
+
+CREATE FUNCTION benchmark_prune_shards(relation regclass, value text, iteration_count int,
+                                       OUT iterations int, OUT total_time_ms float8,
+                                       OUT mean_time_us float8, OUT min_time_us float8,
+                                       OUT max_time_us float8, OUT mean_memory_bytes bigint)
+	AS 'citus'
+	LANGUAGE C STRICT;
+
+CREATE FUNCTION benchmark_find_shard_interval(relation regclass, value text, iteration_count int,
+                                              OUT iterations int, OUT total_time_ms float8,
+                                              OUT mean_time_us float8, OUT min_time_us float8,
+                                              OUT max_time_us float8, OUT mean_memory_bytes bigint)
+	AS 'citus'
+	LANGUAGE C STRICT;
+
+CREATE FUNCTION benchmark_build_table_cache_entry(relation regclass, iteration_count int,
+                                                  OUT iterations int, OUT total_time_ms float8,
+                                                  OUT mean_time_us float8, OUT min_time_us float8,
+                                                  OUT max_time_us float8, OUT mean_memory_bytes bigint)
+	AS 'citus'
+	LANGUAGE C STRICT;
+
+CREATE FUNCTION benchmark_rebuild_query_strings(query text, iteration_count int,
+                                                OUT iterations int, OUT total_time_ms float8,
+                                                OUT mean_time_us float8, OUT min_time_us float8,
+                                                OUT max_time_us float8, OUT mean_memory_bytes bigint)
+	AS 'citus'
+	LANGUAGE C STRICT;
+
+CREATE FUNCTION benchmark_distributed_planner(query text, iteration_count int,
+                                              OUT iterations int, OUT total_time_ms float8,
+                                              OUT mean_time_us float8, OUT min_time_us float8,
+                                              OUT max_time_us float8, OUT mean_memory_bytes bigint)
+	AS 'citus'
+	LANGUAGE C STRICT;
+
+CREATE TABLE events (user_id int, event_type int, payload text);
+SELECT create_distributed_table('events', 'user_id');
+
+CREATE TABLE event_types (event_type int PRIMARY KEY, name text);
+SELECT create_reference_table('event_types');
+
+-- timings vary between runs, so only check that they are consistent
+SELECT iterations, total_time_ms >= 0, min_time_us <= max_time_us
+FROM benchmark_prune_shards('events', '15', 100);
+
+SELECT iterations, total_time_ms >= 0, min_time_us <= max_time_us
+FROM benchmark_find_shard_interval('events', '15', 100);
+
+SELECT iterations, total_time_ms >= 0, min_time_us <= max_time_us
+FROM benchmark_build_table_cache_entry('events', 10);
+
+SELECT iterations, total_time_ms >= 0, min_time_us <= max_time_us
+FROM benchmark_rebuild_query_strings('UPDATE events SET payload = ''x'' WHERE event_type = 3', 10);
+
+SELECT iterations, total_time_ms >= 0, min_time_us <= max_time_us
+FROM benchmark_distributed_planner('SELECT count(*) FROM events JOIN event_types USING (event_type)', 10);
+
+-- the table is still usable after its cache entry was rebuilt
+INSERT INTO events VALUES (15, 3, 'a');
+SELECT * FROM events WHERE user_id = 15;
+
+-- zero iterations
+SELECT iterations, total_time_ms, min_time_us, max_time_us
+FROM benchmark_distributed_planner('SELECT count(*) FROM events', 0);
+
+-- error cases
+SELECT iterations FROM benchmark_prune_shards('events', '15', -1);
+SELECT iterations FROM benchmark_prune_shards('event_types', '15', 10);
+SELECT iterations FROM benchmark_distributed_planner('SELECT 1; SELECT 2', 10);
+SELECT iterations FROM benchmark_rebuild_query_strings('SELECT 1', 10);
+
+SET client_min_messages TO WARNING;
+DROP SCHEMA planner_microbenchmarks CASCADE;
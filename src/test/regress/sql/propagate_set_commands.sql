@@ -90,4 +90,17 @@ SET LOCAL enable_hashagg TO false;
 SELECT current_setting('enable_hashagg') FROM test WHERE id = 3;
 ABORT;
 
+-- distributed snapshots make the workers use repeatable read
+SET citus.enable_distributed_snapshot TO on;
+BEGIN ISOLATION LEVEL REPEATABLE READ;
+SELECT current_setting('transaction_isolation') FROM test WHERE id = 1;
+-- the other connections import the snapshots
+SELECT count(*) FROM test;
+SELECT current_setting('transaction_isolation') FROM test WHERE id = 3;
+END;
+
+-- also used for multi-shard queries outside of transaction blocks
+SELECT DISTINCT current_setting('transaction_isolation') FROM test;
+RESET citus.enable_distributed_snapshot;
+
 DROP SCHEMA propagate_set_commands CASCADE;
@@ -0,0 +1,124 @@
+--
+-- RESULT_CACHE
+--
+-- Tests the shared memory cache of the results of single-task queries. The
+-- test cluster runs with a small citus.result_cache_size and the cache
+-- disabled, so the cache is only used where it is enabled below.
+CREATE SCHEMA result_cache;
+SET search_path TO result_cache;
+SET citus.shard_count TO 4;
+SET citus.shard_replication_factor TO 1;
+SET citus.next_shard_id TO 8610000;
+
+SELECT run_command_on_coordinator_and_workers('CREATE USER result_cache_user SUPERUSER');
+
+CREATE TABLE cached (key int, value int);
+SELECT create_distributed_table('cached', 'key');
+INSERT INTO cached SELECT i, i FROM generate_series(1, 10) i;
+
+CREATE TABLE cached_large (key int, payload text);
+SELECT create_distributed_table('cached_large', 'key');
+INSERT INTO cached_large SELECT i, repeat('x', 12000) FROM generate_series(1, 60) i;
+
+-- the cache is not used by default in the tests
+SET client_min_messages TO DEBUG1;
+SELECT count(*), sum(value) FROM cached WHERE key = 1;
+SELECT count(*), sum(value) FROM cached WHERE key = 1;
+
+SET citus.enable_result_cache TO on;
+
+-- the second run of the same query uses the cached result
+SELECT count(*), sum(value) FROM cached WHERE key = 1;
+SELECT count(*), sum(value) FROM cached WHERE key = 1;
+
+-- other values are other queries
+SELECT count(*), sum(value) FROM cached WHERE key = 2;
+
+-- parameters are part of the key
+PREPARE cached_count(int) AS SELECT count(*) FROM cached WHERE key = 3 AND value >= $1;
+EXECUTE cached_count(0);
+EXECUTE cached_count(0);
+EXECUTE cached_count(4);
+EXECUTE cached_count(4);
+DEALLOCATE cached_count;
+
+-- results are cached per user
+SET ROLE result_cache_user;
+SELECT count(*), sum(value) FROM cached WHERE key = 1;
+SELECT count(*), sum(value) FROM cached WHERE key = 1;
+RESET ROLE;
+SELECT count(*), sum(value) FROM cached WHERE key = 1;
+
+-- an UPDATE of the shard invalidates the result
+UPDATE cached SET value = value + 1 WHERE key = 1;
+SELECT count(*), sum(value) FROM cached WHERE key = 1;
+SELECT count(*), sum(value) FROM cached WHERE key = 1;
+
+-- so does a COPY
+COPY cached FROM STDIN WITH CSV;
+1,10
+\.
+SELECT count(*), sum(value) FROM cached WHERE key = 1;
+SELECT count(*), sum(value) FROM cached WHERE key = 1;
+
+-- and a buffered INSERT, which records the shard before the row is sent
+BEGIN;
+SET LOCAL citus.insert_buffer_size TO 10;
+INSERT INTO cached VALUES (1, 100);
+COMMIT;
+SELECT count(*), sum(value) FROM cached WHERE key = 1;
+SELECT count(*), sum(value) FROM cached WHERE key = 1;
+
+-- a transaction that modified shards does not use the cache
+BEGIN;
+INSERT INTO cached VALUES (2, 2);
+SELECT count(*), sum(value) FROM cached WHERE key = 1;
+SELECT count(*), sum(value) FROM cached WHERE key = 1;
+COMMIT;
+SELECT count(*), sum(value) FROM cached WHERE key = 1;
+
+-- neither does a transaction with a repeatable read snapshot
+BEGIN TRANSACTION ISOLATION LEVEL REPEATABLE READ;
+SELECT count(*), sum(value) FROM cached WHERE key = 1;
+SELECT count(*), sum(value) FROM cached WHERE key = 1;
+COMMIT;
+
+-- queries with mutable functions are not cached
+SELECT count(*), sum(value) FROM cached WHERE key = 1 AND random() >= 0;
+SELECT count(*), sum(value) FROM cached WHERE key = 1 AND random() >= 0;
+
+-- EXPLAIN ANALYZE executes the task, the cached result exists but is not used
+SELECT count(*), sum(value) FROM cached WHERE key = 1;
+DO $$
+BEGIN
+	EXECUTE 'EXPLAIN (ANALYZE) SELECT count(*), sum(value) FROM result_cache.cached WHERE key = 1';
+END;
+$$;
+
+-- a TRUNCATE invalidates the results of all shards
+SELECT count(*), sum(value) FROM cached WHERE key = 2;
+TRUNCATE cached;
+SELECT count(*), sum(value) FROM cached WHERE key = 1;
+SELECT count(*), sum(value) FROM cached WHERE key = 2;
+SELECT count(*), sum(value) FROM cached WHERE key = 2;
+
+-- filling the small cache with large results evicts the other results
+SELECT count(*), sum(value) FROM cached WHERE key = 2;
+
+RESET client_min_messages;
+DO $$
+BEGIN
+	FOR i IN 1..60 LOOP
+		EXECUTE format('SELECT payload FROM result_cache.cached_large WHERE key = %s', i);
+	END LOOP;
+END;
+$$;
+SET client_min_messages TO DEBUG1;
+
+SELECT count(*), sum(value) FROM cached WHERE key = 2;
+SELECT count(*), sum(value) FROM cached WHERE key = 2;
+
+RESET client_min_messages;
+RESET citus.enable_result_cache;
+DROP SCHEMA result_cache CASCADE;
+SELECT run_command_on_coordinator_and_workers('DROP USER result_cache_user');
@@ -0,0 +1,55 @@
+--
+-- ROLLUPS
+--
+-- Tests incremental rollups with citus_create_rollup() and citus_run_rollup().
+CREATE SCHEMA rollups;
+SET search_path TO rollups;
+SET citus.shard_count TO 4;
+SET citus.shard_replication_factor TO 1;
+SET citus.next_shard_id TO 8640000;
+
+CREATE TABLE page_views (view_id bigserial, page_id int);
+SELECT create_distributed_table('page_views', 'page_id');
+
+CREATE TABLE page_view_counts (page_id int PRIMARY KEY, view_count bigint);
+SELECT create_distributed_table('page_view_counts', 'page_id', colocate_with := 'page_views');
+
+SELECT citus_create_rollup('page_view_counts', 'page_views', 'view_id', $$
+    INSERT INTO rollups.page_view_counts AS c
+    SELECT page_id, count(*) FROM rollups.page_views
+    WHERE view_id BETWEEN $1 AND $2
+    GROUP BY page_id
+    ON CONFLICT (page_id) DO UPDATE SET view_count = c.view_count + EXCLUDED.view_count
+$$);
+
+-- the first run aggregates all rows and advances the watermark
+INSERT INTO page_views (page_id) SELECT i % 3 FROM generate_series(1, 30) i;
+SELECT citus_run_rollup('page_view_counts');
+SELECT * FROM page_view_counts ORDER BY page_id;
+SELECT last_watermark FROM pg_dist_rollup WHERE rollup_name = 'page_view_counts';
+
+-- a run without new rows does not change the rollup
+SELECT citus_run_rollup('page_view_counts');
+SELECT * FROM page_view_counts ORDER BY page_id;
+
+-- later runs only aggregate the new rows
+INSERT INTO page_views (page_id) VALUES (0), (1), (1), (3);
+SELECT citus_run_rollup('page_view_counts');
+SELECT * FROM page_view_counts ORDER BY page_id;
+SELECT last_watermark FROM pg_dist_rollup WHERE rollup_name = 'page_view_counts';
+
+\set VERBOSITY terse
+-- the watermark column should be filled from a sequence that does not cache values
+CREATE SEQUENCE cached_sequence CACHE 10;
+CREATE TABLE cached_views (view_id bigint DEFAULT nextval('cached_sequence'), page_id int);
+ALTER SEQUENCE cached_sequence OWNED BY cached_views.view_id;
+SELECT citus_create_rollup('cached_views', 'cached_views', 'view_id', 'SELECT 1');
+SELECT citus_create_rollup('page_ids', 'page_views', 'page_id', 'SELECT 1');
+SELECT citus_run_rollup('page_ids');
+\set VERBOSITY default
+
+SELECT citus_drop_rollup('page_view_counts');
+SELECT count(*) FROM pg_dist_rollup;
+
+SET client_min_messages TO WARNING;
+DROP SCHEMA rollups CASCADE;
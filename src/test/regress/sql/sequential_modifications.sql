@@ -346,5 +346,25 @@ BEGIN;
     select create_distributed_table('test_create_seq_table' ,'a');
 ROLLBACK;
 
+-- DDL can be applied to all shards of a node in a single call
+SET citus.next_shard_id TO 16500;
+SET citus.shard_replication_factor TO 1;
+CREATE TABLE test_batched_ddl (a int);
+SELECT create_distributed_table('test_batched_ddl', 'a');
+SET citus.multi_shard_commit_protocol TO '1pc';
+SET citus.multi_shard_modify_mode TO 'sequential';
+\set VERBOSITY terse
+SET citus.log_remote_commands TO on;
+ALTER TABLE test_batched_ddl ADD COLUMN b int;
+SET citus.enable_batched_shard_ddl TO on;
+ALTER TABLE test_batched_ddl ADD COLUMN c int;
+RESET citus.enable_batched_shard_ddl;
+RESET citus.log_remote_commands;
+\set VERBOSITY default
+RESET citus.multi_shard_modify_mode;
+RESET citus.multi_shard_commit_protocol;
+DROP TABLE test_batched_ddl;
+RESET citus.shard_replication_factor;
+
 SET search_path TO 'public';
 DROP SCHEMA test_seq_ddl CASCADE;
@@ -0,0 +1,74 @@
+--
+-- SHARD_MOVE
+--
+-- Tests master_move_shard_placement with colocated tables.
+CREATE SCHEMA shard_move;
+SET search_path TO shard_move;
+SET citus.shard_count TO 4;
+SET citus.shard_replication_factor TO 1;
+SET citus.next_shard_id TO 8260000;
+
+CREATE TABLE table1 (a int PRIMARY KEY, b int);
+CREATE TABLE table2 (a int PRIMARY KEY, b int);
+SELECT create_distributed_table('table1', 'a');
+SELECT create_distributed_table('table2', 'a', colocate_with := 'table1');
+
+INSERT INTO table1 SELECT i, i FROM generate_series(1, 100) i;
+INSERT INTO table2 SELECT i, i FROM generate_series(1, 100) i;
+
+-- move a shard and its colocated shard using logical replication
+SELECT master_move_shard_placement(8260000, 'localhost', :worker_1_port, 'localhost', :worker_2_port);
+
+SELECT shardid, nodeport, shardstate FROM pg_dist_shard_placement
+WHERE shardid IN (8260000, 8260004) ORDER BY shardid;
+
+SELECT count(*) FROM table1;
+SELECT count(*) FROM table2;
+
+UPDATE table1 SET b = b + 1;
+SELECT sum(b) FROM table1;
+
+-- the shards are moved only once
+SELECT master_move_shard_placement(8260000, 'localhost', :worker_1_port, 'localhost', :worker_2_port);
+
+-- no replication state is left behind
+\c - - - :worker_1_port
+SELECT to_regclass('shard_move.table1_8260000');
+SELECT count(*) FROM pg_publication WHERE pubname LIKE 'citus_shard_move_%';
+SELECT count(*) FROM pg_replication_slots WHERE slot_name LIKE 'citus_shard_move_%';
+\c - - - :worker_2_port
+SELECT count(*) FROM pg_subscription WHERE subname LIKE 'citus_shard_move_%';
+\c - - - :master_port
+SET search_path TO shard_move;
+SET citus.shard_count TO 4;
+SET citus.shard_replication_factor TO 1;
+
+-- tables without a replica identity need to block writes
+CREATE TABLE table3 (a int, b int);
+SELECT create_distributed_table('table3', 'a', colocate_with := 'none');
+INSERT INTO table3 SELECT i, i FROM generate_series(1, 100) i;
+
+SELECT master_move_shard_placement(8260008, 'localhost', :worker_1_port, 'localhost', :worker_2_port);
+SELECT master_move_shard_placement(8260008, 'localhost', :worker_1_port, 'localhost', :worker_2_port,
+								   shard_transfer_mode := 'block_writes');
+
+SELECT shardid, nodeport, shardstate FROM pg_dist_shard_placement
+WHERE shardid = 8260008;
+
+SELECT count(*) FROM table3;
+
+-- copy the data and build the indexes over multiple connections
+SET citus.shard_copy_parallelism TO 4;
+SELECT master_move_shard_placement(8260001, 'localhost', :worker_2_port, 'localhost', :worker_1_port,
+								   shard_transfer_mode := 'block_writes');
+
+SELECT shardid, nodeport, shardstate FROM pg_dist_shard_placement
+WHERE shardid IN (8260001, 8260005) ORDER BY shardid;
+
+SELECT count(*) FROM table1;
+SELECT sum(b) FROM table2;
+
+RESET citus.shard_copy_parallelism;
+
+SET client_min_messages TO WARNING;
+DROP SCHEMA shard_move CASCADE;
@@ -0,0 +1,88 @@
+--
+-- SHARD_REBALANCER
+--
+-- Tests planning and executing shard moves with rebalance_table_shards.
+CREATE SCHEMA shard_rebalancer;
+SET search_path TO shard_rebalancer;
+SET citus.shard_count TO 8;
+SET citus.shard_replication_factor TO 1;
+SET citus.next_shard_id TO 8270000;
+
+CREATE TABLE table1 (a int PRIMARY KEY, b int);
+CREATE TABLE table2 (a int PRIMARY KEY, b int);
+SELECT create_distributed_table('table1', 'a');
+SELECT create_distributed_table('table2', 'a', colocate_with := 'table1');
+
+INSERT INTO table1 SELECT i, i FROM generate_series(1, 100) i;
+INSERT INTO table2 SELECT i, i FROM generate_series(1, 100) i;
+
+-- the shards are balanced after creating the tables
+SELECT table_name, shardid, sourceport, targetport
+FROM get_rebalance_table_shards_plan('table1');
+
+-- put 6 shard groups on the first worker and 2 on the second
+SELECT master_move_shard_placement(8270001, 'localhost', :worker_2_port, 'localhost', :worker_1_port, shard_transfer_mode := 'block_writes');
+SELECT master_move_shard_placement(8270003, 'localhost', :worker_2_port, 'localhost', :worker_1_port, shard_transfer_mode := 'block_writes');
+
+SELECT table_name, shardid, sourceport, targetport
+FROM get_rebalance_table_shards_plan('table1');
+
+-- the plan is the same for colocated tables
+SELECT table_name, shardid, sourceport, targetport
+FROM get_rebalance_table_shards_plan('table2');
+
+-- limit the number of moves
+SELECT table_name, shardid, sourceport, targetport
+FROM get_rebalance_table_shards_plan('table1', max_shard_moves := 1);
+
+-- excluded shards are not moved, also when a colocated shard is excluded
+SELECT table_name, shardid, sourceport, targetport
+FROM get_rebalance_table_shards_plan('table1', excluded_shard_list := '{8270000}');
+SELECT table_name, shardid, sourceport, targetport
+FROM get_rebalance_table_shards_plan('table1', excluded_shard_list := '{8270008}');
+
+-- a higher threshold tolerates more imbalance
+SELECT table_name, shardid, sourceport, targetport
+FROM get_rebalance_table_shards_plan('table1', threshold := 0.5);
+
+-- invalid arguments
+SELECT * FROM get_rebalance_table_shards_plan('table1', threshold := -1);
+SELECT * FROM get_rebalance_table_shards_plan('table1', rebalance_strategy := 'unknown');
+CREATE TABLE local_table (a int);
+SELECT * FROM get_rebalance_table_shards_plan('local_table');
+BEGIN;
+SELECT rebalance_table_shards('table1');
+ROLLBACK;
+
+-- run the moves in parallel
+SET citus.max_rebalancer_parallel_moves TO 2;
+SET citus.max_rebalancer_moves_per_node TO 2;
+SELECT rebalance_table_shards('table1', shard_transfer_mode := 'block_writes');
+
+SELECT nodeport, count(*) FROM pg_dist_shard_placement JOIN pg_dist_shard USING (shardid)
+WHERE logicalrelid = 'table1'::regclass GROUP BY nodeport ORDER BY nodeport;
+
+SELECT count(*) FROM table1;
+SELECT count(*) FROM table2;
+
+-- nothing is left to move
+SELECT table_name, shardid, sourceport, targetport
+FROM get_rebalance_table_shards_plan('table1');
+SELECT rebalance_table_shards('table1', shard_transfer_mode := 'block_writes');
+
+RESET citus.max_rebalancer_parallel_moves;
+RESET citus.max_rebalancer_moves_per_node;
+
+-- the by_query_load strategy balances the execution time of the queries
+SELECT citus_shard_query_stats_reset();
+SELECT table_name, shardid, sourceport, targetport
+FROM get_rebalance_table_shards_plan('table1', rebalance_strategy := 'by_query_load');
+SELECT count(*) FROM table1 WHERE a = 1 AND pg_sleep(0.1) IS NOT NULL;
+SELECT count(*) FROM table1 WHERE a = 1;
+SELECT count(*) FROM table2;
+SELECT shardid, query_count FROM citus_shard_query_stats() ORDER BY shardid;
+SELECT citus_shard_cost_by_query_load(8270000) >= 100 AS includes_sleep,
+       citus_shard_cost_by_query_load(8270000) > citus_shard_cost_by_query_load(8270001) AS most_expensive;
+
+SET client_min_messages TO WARNING;
+DROP SCHEMA shard_rebalancer CASCADE;
@@ -0,0 +1,57 @@
+--
+-- SHARD_SPLIT
+--
+-- Tests isolate_tenant_to_new_shard and master_split_shard with colocated tables.
+CREATE SCHEMA shard_split;
+SET search_path TO shard_split;
+SET citus.shard_count TO 4;
+SET citus.shard_replication_factor TO 1;
+SET citus.next_shard_id TO 8280000;
+
+CREATE TABLE table1 (a int PRIMARY KEY, b int);
+CREATE TABLE table2 (a int PRIMARY KEY REFERENCES table1 (a), b int);
+SELECT create_distributed_table('table1', 'a');
+SELECT create_distributed_table('table2', 'a', colocate_with := 'table1');
+
+INSERT INTO table1 SELECT i, i FROM generate_series(1, 100) i;
+INSERT INTO table2 SELECT i, i FROM generate_series(1, 100) i;
+
+-- colocated tables need to be isolated too
+SELECT isolate_tenant_to_new_shard('table1', 5);
+SELECT isolate_tenant_to_new_shard('table1', 5, 'invalid');
+
+SELECT isolate_tenant_to_new_shard('table1', 5, 'CASCADE');
+
+SELECT shardid, shardminvalue, shardmaxvalue FROM pg_dist_shard
+WHERE logicalrelid = 'table1'::regclass ORDER BY shardminvalue::int;
+
+SELECT shardid, nodeport FROM pg_dist_shard_placement
+WHERE shardid IN (8280009, 8280012) ORDER BY shardid;
+
+SELECT count(*) FROM table1;
+SELECT count(*) FROM table2;
+SELECT * FROM table2 WHERE a = 5;
+
+-- the tenant cannot be isolated again
+SELECT isolate_tenant_to_new_shard('table1', 5, 'CASCADE');
+
+-- the isolated tenant can move to its own node
+SELECT master_move_shard_placement(8280009, 'localhost', :worker_1_port, 'localhost', :worker_2_port,
+								   shard_transfer_mode := 'block_writes');
+SELECT * FROM table1 WHERE a = 5;
+
+-- split a shard into equal hash ranges
+SELECT master_split_shard(8280001, 1);
+SELECT master_split_shard(8280001);
+
+SELECT shardid, shardminvalue, shardmaxvalue FROM pg_dist_shard
+WHERE logicalrelid = 'table1'::regclass ORDER BY shardminvalue::int;
+
+SELECT count(*) FROM table1;
+SELECT count(*) FROM table2;
+
+-- the foreign keys still hold
+INSERT INTO table2 VALUES (1000, 1000);
+
+SET client_min_messages TO WARNING;
+DROP SCHEMA shard_split CASCADE;
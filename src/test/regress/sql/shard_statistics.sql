@@ -0,0 +1,64 @@
+--
+-- SHARD_STATISTICS
+--
+-- Tests refreshing the shard sizes of hash distributed tables in
+-- pg_dist_placement from the maintenance daemon.
+CREATE SCHEMA shard_statistics;
+SET search_path TO shard_statistics;
+SET citus.shard_count TO 4;
+SET citus.shard_replication_factor TO 1;
+SET citus.next_shard_id TO 8670000;
+
+CREATE TABLE sized (key int, value text);
+SELECT create_distributed_table('sized', 'key');
+INSERT INTO sized SELECT i, repeat('x', 100) FROM generate_series(1, 10000) i;
+
+CREATE VIEW sized_placements AS
+SELECT p.* FROM pg_dist_shard_placement p JOIN pg_dist_shard s USING (shardid)
+WHERE s.logicalrelid = 'shard_statistics.sized'::regclass;
+
+-- the refresh updates the sizes of all tables, restore the others afterwards
+CREATE TABLE other_placements AS
+SELECT placementid, shardlength
+FROM pg_dist_placement JOIN pg_dist_shard USING (shardid)
+JOIN pg_dist_partition USING (logicalrelid)
+WHERE partmethod IN ('h', 'r') AND logicalrelid <> 'sized'::regclass;
+
+-- by default, the sizes of hash distributed shards are not recorded
+SHOW citus.shard_statistics_refresh_interval;
+SELECT pg_sleep(1);
+SELECT shardid, shardlength FROM sized_placements ORDER BY shardid;
+
+-- with the refresh, they are recorded within 10% of the shard sizes
+ALTER SYSTEM SET citus.shard_statistics_refresh_interval TO '100ms';
+SELECT pg_reload_conf();
+SELECT wait_until_true($$
+    SELECT bool_and(shardlength > 0) FROM shard_statistics.sized_placements
+$$);
+SELECT bool_and(abs(p.shardlength - r.result::bigint) <= 0.1 * r.result::bigint) AS within_bound
+FROM sized_placements p
+JOIN run_command_on_placements('sized', 'SELECT pg_table_size(''%s'')') r
+USING (shardid, nodename, nodeport);
+
+-- and they follow the shards as they grow
+SELECT sum(shardlength) AS size_before FROM sized_placements \gset
+INSERT INTO sized SELECT i, repeat('x', 100) FROM generate_series(10001, 20000) i;
+SELECT wait_until_true(format($$
+    SELECT sum(shardlength) > %s * 1.5 FROM shard_statistics.sized_placements
+$$, :size_before));
+
+ALTER SYSTEM RESET citus.shard_statistics_refresh_interval;
+SELECT pg_reload_conf();
+SELECT pg_sleep(0.5);
+SELECT wait_until_true($$
+    SELECT process_id IS NULL FROM citus_background_jobs
+    WHERE database_id = (SELECT oid FROM pg_database WHERE datname = current_database())
+    AND job_name = 'shard statistics refresh'
+$$);
+
+UPDATE pg_dist_placement p SET shardlength = o.shardlength
+FROM other_placements o
+WHERE p.placementid = o.placementid AND p.shardlength <> o.shardlength;
+
+SET client_min_messages TO WARNING;
+DROP SCHEMA shard_statistics CASCADE;
@@ -0,0 +1,55 @@
+CREATE SCHEMA shared_connection_limit;
+SET search_path TO shared_connection_limit;
+
+SET citus.shard_count TO 4;
+SET citus.shard_replication_factor TO 1;
+SET citus.next_shard_id TO 801010000;
+CREATE TABLE test (x int, y int);
+SELECT create_distributed_table('test','x');
+INSERT INTO test VALUES (1,2);
+INSERT INTO test VALUES (3,2);
+
+-- slow tasks get a connection each
+SET citus.executor_slow_start_interval TO '10ms';
+BEGIN;
+SELECT count(*) FROM test a JOIN (SELECT x, pg_sleep(0.1) FROM test) b USING (x);
+SELECT sum(result::bigint) FROM run_command_on_workers($$
+  SELECT count(*) FROM pg_stat_activity
+  WHERE pid <> pg_backend_pid() AND query LIKE '%8010100%'
+$$);
+END;
+
+-- at the shared limit, the tasks of a node share the cached connection
+ALTER SYSTEM SET citus.max_shared_pool_size TO 1;
+SELECT pg_reload_conf();
+SELECT pg_sleep(0.1);
+BEGIN;
+SELECT count(*) FROM test a JOIN (SELECT x, pg_sleep(0.1) FROM test) b USING (x);
+SELECT sum(result::bigint) FROM run_command_on_workers($$
+  SELECT count(*) FROM pg_stat_activity
+  WHERE pid <> pg_backend_pid() AND query LIKE '%8010100%'
+$$);
+END;
+
+-- connections to a node at the limit are closed after the transaction, such
+-- that other backends can use them
+SELECT count(*) FROM test;
+SELECT wait_until_true($$
+  SELECT sum(result::bigint) = 0 FROM run_command_on_workers('
+    SELECT count(*) FROM pg_stat_activity
+    WHERE pid <> pg_backend_pid() AND query LIKE ''%8010100%''
+  ')
+$$);
+SET citus.release_connections_at_shared_pool_limit TO off;
+SELECT count(*) FROM test;
+SELECT sum(result::bigint) FROM run_command_on_workers($$
+  SELECT count(*) FROM pg_stat_activity
+  WHERE pid <> pg_backend_pid() AND query LIKE '%8010100%'
+$$);
+RESET citus.release_connections_at_shared_pool_limit;
+
+ALTER SYSTEM RESET citus.max_shared_pool_size;
+SELECT pg_reload_conf();
+RESET citus.executor_slow_start_interval;
+
+DROP SCHEMA shared_connection_limit CASCADE;
@@ -0,0 +1,70 @@
+--
+-- TDIGEST_AGGREGATE_SUPPORT
+--   test the integration of github.com/tvondra/tdigest aggregates into the citus planner
+--   for push down parts of the aggregate to the workers
+--
+
+-- Create tdigest extension if present, print false result otherwise
+SELECT CASE WHEN COUNT(*) > 0 THEN
+  'CREATE EXTENSION tdigest'
+ELSE 'SELECT false AS tdigest_present' END
+AS create_cmd FROM pg_available_extensions()
+WHERE name = 'tdigest'
+\gset
+
+:create_cmd;
+
+CREATE SCHEMA tdigest_aggregate_support;
+SET search_path TO tdigest_aggregate_support, public;
+
+-- disable row-gathering so that the queries below fail unless they are pushed down
+SET citus.coordinator_aggregation_strategy TO 'disabled';
+SET citus.shard_count TO 4;
+SET citus.next_shard_id TO 20070000;
+
+CREATE TABLE latencies (a int, b int, latency double precision);
+SELECT create_distributed_table('latencies', 'a');
+INSERT INTO latencies SELECT i % 17, i % 2, i FROM generate_series(1, 10000) AS i;
+
+-- percentiles of raw values are computed from tdigests built on the workers
+SELECT abs(tdigest_percentile(latency, 100, 0.99) - 9900) < 100 AS p99_ok
+FROM latencies;
+
+SELECT b, abs(tdigest_percentile(latency, 100, 0.5) - 5000) < 100 AS p50_ok
+FROM latencies
+GROUP BY b
+ORDER BY b;
+
+WITH percentiles AS (
+  SELECT tdigest_percentile(latency, 100, ARRAY[0.5, 0.99]) AS p
+  FROM latencies
+)
+SELECT abs(p[1] - 5000) < 100 AS p50_ok, abs(p[2] - 9900) < 100 AS p99_ok
+FROM percentiles;
+
+SELECT abs(tdigest_percentile_of(latency, 100, 2500) - 0.25) < 0.01 AS p25_ok
+FROM latencies;
+
+-- tdigests stored in a distributed table are merged on the coordinator
+CREATE TABLE latency_digests (a int, digest tdigest);
+SELECT create_distributed_table('latency_digests', 'a');
+INSERT INTO latency_digests
+  SELECT a, tdigest(latency, 100)
+  FROM latencies
+  GROUP BY a;
+
+SELECT abs(tdigest_percentile(digest, 0.99) - 9900) < 100 AS p99_ok
+FROM latency_digests;
+
+SELECT abs((tdigest_percentile_of(digest, ARRAY[2500, 7500]))[2] - 0.75) < 0.01 AS p75_ok
+FROM latency_digests;
+
+SELECT abs(tdigest_percentile(merged, 0.5) - 5000) < 100 AS p50_ok
+FROM (SELECT tdigest(digest) AS merged FROM latency_digests) merged_digests;
+
+-- quantiles that refer to columns cannot be evaluated on the coordinator
+SELECT tdigest_percentile(latency, 100, b / 2.0)
+FROM latencies;
+
+SET client_min_messages TO WARNING;
+DROP SCHEMA tdigest_aggregate_support CASCADE;
@@ -0,0 +1,116 @@
+--
+-- TIME_PARTITIONS
+--
+-- Tests creating and expiring the partitions of time partitioned tables,
+-- directly and by a policy in pg_dist_time_partition_policy.
+CREATE SCHEMA time_partitions;
+SET search_path TO time_partitions;
+SET citus.shard_count TO 2;
+SET citus.shard_replication_factor TO 1;
+SET citus.next_shard_id TO 8630000;
+SET datestyle TO 'ISO, YMD';
+
+CREATE FUNCTION partitions_of(parent regclass)
+RETURNS TABLE (partition_name name, partition_bound text, partition_owner name)
+LANGUAGE sql
+AS $$
+    SELECT c.relname, pg_get_expr(c.relpartbound, c.oid), pg_get_userbyid(c.relowner)
+    FROM pg_inherits i JOIN pg_class c ON (c.oid = i.inhrelid)
+    WHERE i.inhparent = parent
+    ORDER BY 1;
+$$;
+
+CREATE TABLE events (event_time timestamptz, payload int) PARTITION BY RANGE (event_time);
+SELECT create_distributed_table('events', 'payload');
+
+-- monthly partitions start at the month of start_from
+SELECT create_time_partitions('events', '1 month', '2020-04-01', '2020-01-15');
+SELECT partition_name, partition_bound FROM partitions_of('events');
+
+-- the partitions are distributed along with their parent
+SELECT count(*) FROM pg_dist_partition WHERE logicalrelid::text LIKE 'events_p%';
+
+-- later calls continue after the existing partitions
+SELECT create_time_partitions('events', '1 month', '2020-06-01', '2020-01-01');
+SELECT partition_name FROM partitions_of('events');
+
+-- partitions of 30 days are named by their day rather than their month
+CREATE TABLE daily (day date, payload int) PARTITION BY RANGE (day);
+SELECT create_time_partitions('daily', '30 days', '2020-03-01', '2020-01-01');
+SELECT create_time_partitions('daily', '1 month', '2020-05-01', '2020-01-01');
+SELECT partition_name, partition_bound FROM partitions_of('daily');
+
+-- partitions that are not whole hours are named by their minute
+CREATE TABLE frequent (event_time timestamp, payload int) PARTITION BY RANGE (event_time);
+SELECT create_time_partitions('frequent', '90 minutes', '2020-01-01 03:00', '2020-01-01');
+SELECT partition_name, partition_bound FROM partitions_of('frequent');
+
+\set VERBOSITY terse
+-- date columns cannot have partitions shorter than a day
+SELECT create_time_partitions('daily', '12 hours', '2020-06-01');
+SELECT create_time_partitions('daily', '-1 day', '2020-06-01');
+\set VERBOSITY default
+
+-- the partitions are owned by the owner of the parent
+SELECT run_command_on_coordinator_and_workers('CREATE USER time_partition_owner');
+SET citus.enable_ddl_propagation TO off;
+GRANT CREATE ON SCHEMA time_partitions TO time_partition_owner;
+RESET citus.enable_ddl_propagation;
+CREATE TABLE owned (created_at timestamptz) PARTITION BY RANGE (created_at);
+ALTER TABLE owned OWNER TO time_partition_owner;
+SELECT create_time_partitions('owned', '1 month', '2020-03-01', '2020-01-01');
+SELECT partition_name, partition_owner FROM partitions_of('owned');
+SELECT current_user;
+
+-- partitions that end before the given time are dropped, or only detached
+SELECT expire_time_partitions('events', '2020-03-01');
+SELECT expire_time_partitions('events', '2020-04-01', detach_only := true);
+SELECT partition_name FROM partitions_of('events');
+SELECT relispartition FROM pg_class WHERE relname = 'events_p2020_03';
+
+-- a policy creates the partitions for its premake interval right away
+CREATE TABLE policy_events (event_time timestamptz, payload int) PARTITION BY RANGE (event_time);
+SELECT create_distributed_table('policy_events', 'payload');
+SELECT create_time_partitions('policy_events', '1 day', now() - interval '3 days',
+                              now() - interval '5 days');
+SELECT citus_set_time_partition_policy('policy_events', '1 day',
+                                       premake_interval := '2 days',
+                                       retention_interval := '2 days');
+SELECT partition_interval, premake_interval, retention_interval, detach_expired
+FROM pg_dist_time_partition_policy WHERE logicalrelid = 'policy_events'::regclass;
+SELECT count(*) FROM partitions_of('policy_events');
+
+-- the maintenance expires the partitions that are older than the retention interval
+SELECT citus_run_time_partition_maintenance();
+SELECT count(*) FROM partitions_of('policy_events');
+SELECT citus_run_time_partition_maintenance();
+SELECT count(*) FROM partitions_of('policy_events');
+
+-- the maintenance daemon does not run the maintenance by default
+UPDATE pg_dist_time_partition_policy SET premake_interval = '4 days'
+WHERE logicalrelid = 'policy_events'::regclass;
+SELECT pg_sleep(1);
+SELECT count(*) FROM partitions_of('policy_events');
+
+-- with citus.time_partition_maintenance_interval it creates the new partitions
+ALTER SYSTEM SET citus.time_partition_maintenance_interval TO '100ms';
+SELECT pg_reload_conf();
+DO $$
+BEGIN
+    FOR i IN 1..300 LOOP
+        EXIT WHEN (SELECT count(*) FROM time_partitions.partitions_of('time_partitions.policy_events')) = 7;
+        PERFORM pg_sleep(0.1);
+    END LOOP;
+END;
+$$;
+SELECT count(*) FROM partitions_of('policy_events');
+
+SELECT citus_remove_time_partition_policy('policy_events');
+ALTER SYSTEM RESET citus.time_partition_maintenance_interval;
+SELECT pg_reload_conf();
+
+SET client_min_messages TO WARNING;
+DROP SCHEMA time_partitions CASCADE;
+RESET client_min_messages;
+RESET datestyle;
+SELECT run_command_on_coordinator_and_workers('DROP USER time_partition_owner');
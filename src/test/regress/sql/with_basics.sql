@@ -698,6 +698,93 @@ LEFT JOIN
 RESET citus.enable_cte_inlining;
 
 
+-- columns of CTEs that are not referenced can be left out of the subplan,
+-- prevent PG 11 - PG 12 outputs to diverge
+SET citus.enable_cte_inlining TO false;
+SET citus.enable_cte_column_pruning TO on;
+WITH cte AS (
+	SELECT user_id, value_2, value_1 from users_table WHERE user_id IN (1, 2) ORDER BY 1,2 LIMIT 5
+)
+SELECT value_2 FROM cte ORDER BY 1;
+
+-- the subplan sends NULL in place of value_1 to the workers
+\a\t
+EXPLAIN (COSTS OFF, VERBOSE true)
+WITH cte AS (
+	SELECT user_id, value_2, value_1 FROM users_table
+)
+SELECT user_id, value_2 FROM cte;
+
+-- without pruning the workers return value_1
+RESET citus.enable_cte_column_pruning;
+EXPLAIN (COSTS OFF, VERBOSE true)
+WITH cte AS (
+	SELECT user_id, value_2, value_1 FROM users_table
+)
+SELECT user_id, value_2 FROM cte;
+\a\t
+RESET citus.enable_cte_inlining;
+
+-- show where CTE results go, prevent PG 11 - PG 12 outputs to diverge
+SET citus.enable_cte_inlining TO false;
+SET citus.log_intermediate_results TO on;
+SET client_min_messages TO DEBUG1;
+
+-- small CTE results can be inlined into the task queries
+SET citus.max_inlined_intermediate_result_size TO '1kB';
+WITH cte AS (
+	SELECT DISTINCT user_id FROM users_table WHERE user_id IN (1, 2)
+)
+SELECT count(*) FROM users_table WHERE user_id IN (SELECT user_id FROM cte);
+
+-- results above the limit are sent as files
+WITH cte AS (
+	SELECT user_id, repeat('x', 100) AS padding FROM users_table
+)
+SELECT count(*) FROM users_table WHERE user_id IN (SELECT user_id FROM cte);
+RESET citus.max_inlined_intermediate_result_size;
+
+-- workers can fetch CTE results from other workers
+SET citus.intermediate_result_fanout TO 1;
+WITH cte AS (
+	SELECT DISTINCT user_id FROM users_table WHERE user_id IN (1, 2)
+)
+SELECT count(*) FROM users_table WHERE user_id IN (SELECT user_id FROM cte);
+RESET citus.intermediate_result_fanout;
+
+RESET client_min_messages;
+RESET citus.log_intermediate_results;
+RESET citus.enable_cte_inlining;
+
+-- identical CTEs can reuse results within a transaction
+BEGIN TRANSACTION ISOLATION LEVEL REPEATABLE READ;
+SET LOCAL citus.enable_intermediate_result_cache TO on;
+SET LOCAL citus.enable_cte_inlining TO false;
+SET LOCAL client_min_messages TO DEBUG1;
+WITH cte AS (
+	SELECT DISTINCT user_id FROM users_table WHERE user_id IN (1, 2)
+)
+SELECT count(*) FROM users_table WHERE user_id IN (SELECT user_id FROM cte);
+WITH cte AS (
+	SELECT DISTINCT user_id FROM users_table WHERE user_id IN (1, 2)
+)
+SELECT count(*) FROM users_table WHERE user_id IN (SELECT user_id FROM cte);
+-- a different CTE does not reuse the result
+WITH cte AS (
+	SELECT DISTINCT user_id FROM users_table WHERE user_id = 1 OR user_id = 2
+)
+SELECT count(*) FROM users_table WHERE user_id IN (SELECT user_id FROM cte);
+-- neither does a CTE with different parameters
+PREPARE cte_with_params(int, int) AS
+WITH cte AS (
+	SELECT DISTINCT user_id FROM users_table WHERE user_id IN ($1, $2)
+)
+SELECT count(*) FROM users_table WHERE user_id IN (SELECT user_id FROM cte);
+EXECUTE cte_with_params(1, 2);
+EXECUTE cte_with_params(2, 1);
+COMMIT;
+DEALLOCATE cte_with_params;
+
 DROP VIEW basic_view;
 DROP VIEW cte_view;
 DROP SCHEMA with_basics CASCADE;
@@ -33,3 +33,15 @@ SELECT COUNT(*) AS diff_lhs FROM ( :Select_All FROM :Task_Table_Name EXCEPT ALL
 
 SELECT COUNT(*) AS diff_rhs FROM ( :Select_All FROM lineitem EXCEPT ALL
        		   	    	   :Select_All FROM :Task_Table_Name ) diff;
+
+-- The same files can also be read directly through worker_read_merge_files,
+-- which is what merge task views use instead of a task table.
+
+SELECT COUNT(*) AS diff_merge_files FROM (
+       :Select_All FROM worker_read_merge_files(:JobId, :TaskId) AS merge_files(
+             orderkey bigint, partkey integer, suppkey integer, linenumber integer,
+             quantity decimal(15, 2), extendedprice decimal(15, 2), discount decimal(15, 2),
+             tax decimal(15, 2), returnflag char(1), linestatus char(1), shipdate date,
+             commitdate date, receiptdate date, shipinstruct char(25), shipmode char(10),
+             comment varchar(44))
+       EXCEPT ALL :Select_All FROM :Task_Table_Name ) diff;